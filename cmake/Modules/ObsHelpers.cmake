@@ -520,8 +520,9 @@ function(install_obs_plugin_with_data target datadir)
 endfunction()
 
 function(define_graphic_modules target)
-	foreach(dl_lib opengl d3d9 d3d11)
+	foreach(dl_lib opengl opengl-egl d3d9 d3d11)
 		string(TOUPPER ${dl_lib} dl_lib_upper)
+		string(REPLACE "-" "_" dl_lib_upper ${dl_lib_upper})
 		if(TARGET libobs-${dl_lib})
 			if(UNIX AND UNIX_STRUCTURE)
 				target_compile_definitions(${target}
@@ -11,12 +11,34 @@
 #define info(msg, ...) \
 	blog(LOG_WARNING, "%s"msg, info->log_prefix, ##__VA_ARGS__)
 
-struct update_info {
+/* files are fetched this many at a time, over as few connections as the
+ * server allows */
+#define MAX_CONCURRENT_DOWNLOADS 4
+
+/* validators of the last remote package.json that was seen, so that an
+ * unchanged package only costs a "304 Not Modified" */
+#define PACKAGE_META_FILE "package-meta.json"
+
+struct http_transfer {
 	char error[CURL_ERROR_SIZE];
 	struct curl_slist *header;
 	DARRAY(uint8_t) file_data;
-	char *user_agent;
 	CURL *curl;
+	bool added;
+	CURLcode result;
+	long response_code;
+
+	const char *name;
+	int version;
+
+	struct dstr etag;
+	struct dstr last_modified;
+};
+
+struct update_info {
+	struct curl_slist *header;
+	char *user_agent;
+	CURLM *multi;
 	char *url;
 
 	/* directories */
@@ -45,7 +67,6 @@ void update_info_destroy(struct update_info *info)
 	if (info->thread_created)
 		pthread_join(info->thread, NULL);
 
-	da_free(info->file_data);
 	bfree(info->log_prefix);
 	bfree(info->user_agent);
 	bfree(info->temp);
@@ -55,8 +76,8 @@ void update_info_destroy(struct update_info *info)
 
 	if (info->header)
 		curl_slist_free_all(info->header);
-	if (info->curl)
-		curl_easy_cleanup(info->curl);
+	if (info->multi)
+		curl_multi_cleanup(info->multi);
 	if (info->local_package)
 		obs_data_release(info->local_package);
 	if (info->cache_package)
@@ -67,37 +88,173 @@ void update_info_destroy(struct update_info *info)
 }
 
 static size_t http_write(uint8_t *ptr, size_t size, size_t nmemb,
-		struct update_info *info)
+		struct http_transfer *transfer)
 {
 	size_t total = size * nmemb;
 	if (total)
-		da_push_back_array(info->file_data, ptr, total);
+		da_push_back_array(transfer->file_data, ptr, total);
 
 	return total;
 }
 
-static bool do_http_request(struct update_info *info, const char *url)
+static void copy_header_value(struct dstr *dst, const char *val, size_t len)
 {
-	CURLcode code;
-	uint8_t null_terminator = 0;
+	while (len && (*val == ' ' || *val == '\t')) {
+		val++;
+		len--;
+	}
+	while (len && (val[len - 1] == '\r' || val[len - 1] == '\n' ||
+	               val[len - 1] == ' '))
+		len--;
 
-	da_resize(info->file_data, 0);
-	curl_easy_setopt(info->curl, CURLOPT_URL, url);
-	curl_easy_setopt(info->curl, CURLOPT_HTTPHEADER, info->header);
-	curl_easy_setopt(info->curl, CURLOPT_ERRORBUFFER, info->error);
-	curl_easy_setopt(info->curl, CURLOPT_WRITEFUNCTION, http_write);
-	curl_easy_setopt(info->curl, CURLOPT_WRITEDATA, info);
-	curl_easy_setopt(info->curl, CURLOPT_FAILONERROR, true);
+	dstr_ncopy(dst, val, len);
+}
 
-	code = curl_easy_perform(info->curl);
-	if (code != CURLE_OK) {
-		warn("Remote update of URL \"%s\" failed: %s", url,
-				info->error);
+static size_t http_header(char *buffer, size_t size, size_t nitems,
+		struct http_transfer *transfer)
+{
+	static const char etag[]          = "ETag:";
+	static const char last_modified[] = "Last-Modified:";
+	size_t total = size * nitems;
+
+	if (total > sizeof(etag) - 1 &&
+	    astrcmpi_n(buffer, etag, sizeof(etag) - 1) == 0)
+		copy_header_value(&transfer->etag,
+				buffer + sizeof(etag) - 1,
+				total - (sizeof(etag) - 1));
+
+	else if (total > sizeof(last_modified) - 1 &&
+	         astrcmpi_n(buffer, last_modified,
+			 sizeof(last_modified) - 1) == 0)
+		copy_header_value(&transfer->last_modified,
+				buffer + sizeof(last_modified) - 1,
+				total - (sizeof(last_modified) - 1));
+
+	return total;
+}
+
+static bool transfer_init(struct update_info *info,
+		struct http_transfer *transfer, const char *url,
+		struct curl_slist *header)
+{
+	transfer->result = CURLE_FAILED_INIT;
+	transfer->curl = curl_easy_init();
+	if (!transfer->curl) {
+		warn("Could not initialize Curl");
 		return false;
 	}
 
-	da_push_back(info->file_data, &null_terminator);
+	curl_easy_setopt(transfer->curl, CURLOPT_URL, url);
+	curl_easy_setopt(transfer->curl, CURLOPT_HTTPHEADER, header);
+	curl_easy_setopt(transfer->curl, CURLOPT_ERRORBUFFER, transfer->error);
+	curl_easy_setopt(transfer->curl, CURLOPT_WRITEFUNCTION, http_write);
+	curl_easy_setopt(transfer->curl, CURLOPT_WRITEDATA, transfer);
+	curl_easy_setopt(transfer->curl, CURLOPT_HEADERFUNCTION, http_header);
+	curl_easy_setopt(transfer->curl, CURLOPT_HEADERDATA, transfer);
+	curl_easy_setopt(transfer->curl, CURLOPT_FAILONERROR, true);
+	curl_easy_setopt(transfer->curl, CURLOPT_PRIVATE, transfer);
+#if LIBCURL_VERSION_NUM >= 0x072b00
+	/* wait for an existing HTTP/2 connection rather than opening more */
+	curl_easy_setopt(transfer->curl, CURLOPT_PIPEWAIT, 1L);
+#endif
+
+	return true;
+}
+
+static void transfer_free(struct update_info *info,
+		struct http_transfer *transfer)
+{
+	if (transfer->curl) {
+		if (transfer->added)
+			curl_multi_remove_handle(info->multi, transfer->curl);
+		curl_easy_cleanup(transfer->curl);
+	}
+	if (transfer->header)
+		curl_slist_free_all(transfer->header);
+
+	dstr_free(&transfer->etag);
+	dstr_free(&transfer->last_modified);
+	da_free(transfer->file_data);
+}
+
+static void finish_transfers(struct update_info *info, size_t *active)
+{
+	CURLMsg *msg;
+	int left;
+
+	while ((msg = curl_multi_info_read(info->multi, &left)) != NULL) {
+		struct http_transfer *transfer = NULL;
+		CURL *curl = msg->easy_handle;
+
+		if (msg->msg != CURLMSG_DONE)
+			continue;
+
+		curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char**)&transfer);
+		transfer->result = msg->data.result;
+		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE,
+				&transfer->response_code);
+
+		curl_multi_remove_handle(info->multi, curl);
+		transfer->added = false;
+		(*active)--;
+	}
+}
+
+/* runs all transfers on the shared multi handle.  the multi handle keeps the
+ * connection cache, so the package request and the file requests that follow
+ * it reuse the same connections */
+static void run_transfers(struct update_info *info,
+		struct http_transfer *transfers, size_t count)
+{
+	size_t next = 0;
+	size_t active = 0;
+
+	while (next < count || active) {
+		CURLMcode code;
+		int running;
+
+		while (next < count && active < MAX_CONCURRENT_DOWNLOADS) {
+			struct http_transfer *transfer = &transfers[next++];
+
+			if (!transfer->curl)
+				continue;
+
+			code = curl_multi_add_handle(info->multi,
+					transfer->curl);
+			if (code == CURLM_OK) {
+				transfer->added = true;
+				active++;
+			}
+		}
+
+		code = curl_multi_perform(info->multi, &running);
+		if (code != CURLM_OK) {
+			warn("Remote update failed: %s",
+					curl_multi_strerror(code));
+			break;
+		}
+
+		finish_transfers(info, &active);
+
+		if (active)
+			curl_multi_wait(info->multi, NULL, 0, 1000, NULL);
+	}
+}
+
+static bool transfer_succeeded(struct update_info *info,
+		struct http_transfer *transfer, const char *url)
+{
+	uint8_t null_terminator = 0;
+
+	if (transfer->result != CURLE_OK) {
+		warn("Remote update of URL \"%s\" failed: %s", url,
+				*transfer->error ?
+				transfer->error :
+				curl_easy_strerror(transfer->result));
+		return false;
+	}
 
+	da_push_back(transfer->file_data, &null_terminator);
 	return true;
 }
 
@@ -126,12 +283,19 @@ static bool init_update(struct update_info *info)
 {
 	struct dstr user_agent = {0};
 
-	info->curl = curl_easy_init();
-	if (!info->curl) {
+	info->multi = curl_multi_init();
+	if (!info->multi) {
 		warn("Could not initialize Curl");
 		return false;
 	}
 
+	curl_multi_setopt(info->multi, CURLMOPT_MAX_HOST_CONNECTIONS,
+			(long)MAX_CONCURRENT_DOWNLOADS);
+#if LIBCURL_VERSION_NUM >= 0x072b00
+	curl_multi_setopt(info->multi, CURLMOPT_PIPELINING,
+			CURLPIPE_MULTIPLEX);
+#endif
+
 	info->local_package = get_package(info->local, "package.json");
 	info->cache_package = get_package(info->cache, "package.json");
 
@@ -243,22 +407,13 @@ static int update_local_version(struct update_info *info)
 	return cache_version;
 }
 
-static inline bool do_relative_http_request(struct update_info *info,
-		const char *url, const char *file)
-{
-	char *full_url = get_path(url, file);
-	bool success = do_http_request(info, full_url);
-	bfree(full_url);
-	return success;
-}
-
-static inline void write_file_data(struct update_info *info,
+static inline void write_file_data(struct http_transfer *transfer,
 		const char *base_path, const char *file)
 {
 	char *full_path = get_path(base_path, file);
 	os_quick_write_utf8_file(full_path,
-			(char*)info->file_data.array,
-			info->file_data.num - 1, false);
+			(char*)transfer->file_data.array,
+			transfer->file_data.num - 1, false);
 	bfree(full_path);
 }
 
@@ -277,9 +432,16 @@ static inline void replace_file(const char *src_base_path,
 	bfree(src_path);
 }
 
-static bool update_remote_files(void *param, obs_data_t *remote_file)
+struct remote_files {
+	struct update_info *info;
+	DARRAY(struct http_transfer) transfers;
+};
+
+static bool find_remote_files(void *param, obs_data_t *remote_file)
 {
-	struct update_info *info = param;
+	struct remote_files *files = param;
+	struct update_info *info = files->info;
+	struct http_transfer *transfer;
 
 	struct file_update_data data = {
 		.name = obs_data_get_string(remote_file, "name"),
@@ -290,74 +452,188 @@ static bool update_remote_files(void *param, obs_data_t *remote_file)
 	if (!data.newer && data.found)
 		return true;
 
-	if (!do_relative_http_request(info, info->remote_url, data.name))
-		return true;
+	transfer = da_push_back_new(files->transfers);
+	transfer->name = data.name;
+	transfer->version = data.version;
+	return true;
+}
+
+static void update_remote_file(struct update_info *info,
+		struct http_transfer *transfer)
+{
+	char *full_url = get_path(info->remote_url, transfer->name);
+	bool success = transfer_succeeded(info, transfer, full_url);
+	bfree(full_url);
+
+	if (!success)
+		return;
 
 	if (info->callback) {
 		struct file_download_data download_data;
 		bool confirm;
 
-		download_data.name = data.name;
-		download_data.version = data.version;
-		download_data.buffer.da = info->file_data.da;
+		download_data.name = transfer->name;
+		download_data.version = transfer->version;
+		download_data.buffer.da = transfer->file_data.da;
 
 		confirm = info->callback(info->param, &download_data);
 
-		info->file_data.da = download_data.buffer.da;
+		transfer->file_data.da = download_data.buffer.da;
 
 		if (!confirm) {
 			info("Update file '%s' (version %d) rejected",
-					data.name, data.version);
-			return true;
+					transfer->name, transfer->version);
+			return;
 		}
 	}
 
-	write_file_data(info, info->temp, data.name);
-	replace_file(info->temp, info->cache, data.name);
+	write_file_data(transfer, info->temp, transfer->name);
+	replace_file(info->temp, info->cache, transfer->name);
 
 	info("Successfully updated file '%s' (version %d)",
-			data.name, data.version);
-	return true;
+			transfer->name, transfer->version);
+}
+
+static void update_remote_files(struct update_info *info)
+{
+	struct remote_files files = {info};
+
+	enum_files(info->remote_package, find_remote_files, &files);
+
+	/* the transfers point to themselves, so they can only be set up once
+	 * the array is done growing */
+	for (size_t i = 0; i < files.transfers.num; i++) {
+		struct http_transfer *transfer = &files.transfers.array[i];
+		char *full_url = get_path(info->remote_url, transfer->name);
+		transfer_init(info, transfer, full_url, info->header);
+		bfree(full_url);
+	}
+
+	run_transfers(info, files.transfers.array, files.transfers.num);
+
+	for (size_t i = 0; i < files.transfers.num; i++) {
+		struct http_transfer *transfer = &files.transfers.array[i];
+		update_remote_file(info, transfer);
+		transfer_free(info, transfer);
+	}
+
+	da_free(files.transfers);
+}
+
+/* the validators are only worth sending if the cached package is the one they
+ * were saved alongside */
+static struct curl_slist *package_header(struct update_info *info)
+{
+	struct curl_slist *header = NULL;
+	struct dstr line = {0};
+	obs_data_t *meta;
+
+	dstr_copy(&line, "User-Agent: ");
+	dstr_cat(&line, info->user_agent);
+	header = curl_slist_append(header, line.array);
+
+	meta = info->cache_package ?
+		get_package(info->cache, PACKAGE_META_FILE) : NULL;
+
+	if (meta) {
+		const char *etag = obs_data_get_string(meta, "etag");
+		const char *modified = obs_data_get_string(meta,
+				"last_modified");
+
+		if (*etag) {
+			dstr_printf(&line, "If-None-Match: %s", etag);
+			header = curl_slist_append(header, line.array);
+		}
+		if (*modified) {
+			dstr_printf(&line, "If-Modified-Since: %s", modified);
+			header = curl_slist_append(header, line.array);
+		}
+
+		obs_data_release(meta);
+	}
+
+	dstr_free(&line);
+	return header;
+}
+
+static void save_package_meta(struct update_info *info,
+		struct http_transfer *transfer)
+{
+	char *path = get_path(info->cache, PACKAGE_META_FILE);
+	obs_data_t *meta;
+
+	if (dstr_is_empty(&transfer->etag) &&
+	    dstr_is_empty(&transfer->last_modified)) {
+		os_unlink(path);
+		bfree(path);
+		return;
+	}
+
+	meta = obs_data_create();
+	obs_data_set_string(meta, "etag",
+			transfer->etag.array ? transfer->etag.array : "");
+	obs_data_set_string(meta, "last_modified",
+			transfer->last_modified.array ?
+			transfer->last_modified.array : "");
+	obs_data_save_json(meta, path);
+	obs_data_release(meta);
+	bfree(path);
 }
 
 static void update_remote_version(struct update_info *info, int cur_version)
 {
+	struct http_transfer transfer = {0};
 	int remote_version;
 
-	if (!do_http_request(info, info->url))
-		return;
+	transfer.header = package_header(info);
+	if (!transfer_init(info, &transfer, info->url, transfer.header))
+		goto finish;
+
+	run_transfers(info, &transfer, 1);
+	if (!transfer_succeeded(info, &transfer, info->url))
+		goto finish;
+
+	if (transfer.response_code == 304) {
+		info("Package is up to date (version %d)", cur_version);
+		goto finish;
+	}
 
-	if (!info->file_data.array || info->file_data.array[0] != '{') {
+	if (!transfer.file_data.array || transfer.file_data.array[0] != '{') {
 		warn("Remote package does not exist or is not valid json");
-		return;
+		goto finish;
 	}
 
 	info->remote_package = obs_data_create_from_json(
-			(char*)info->file_data.array);
+			(char*)transfer.file_data.array);
 	if (!info->remote_package) {
 		warn("Failed to initialize remote package json");
-		return;
+		goto finish;
 	}
 
 	remote_version = (int)obs_data_get_int(info->remote_package, "version");
-	if (remote_version <= cur_version)
-		return;
+	if (remote_version <= cur_version) {
+		save_package_meta(info, &transfer);
+		goto finish;
+	}
 
-	write_file_data(info, info->temp, "package.json");
+	write_file_data(&transfer, info->temp, "package.json");
 
 	info->remote_url = obs_data_get_string(info->remote_package, "url");
 	if (!info->remote_url) {
 		warn("No remote url in package file");
-		return;
+		goto finish;
 	}
 
 	/* download new files */
-	enum_files(info->remote_package, update_remote_files, info);
+	update_remote_files(info);
 
 	replace_file(info->temp, info->cache, "package.json");
+	save_package_meta(info, &transfer);
 
 	info("Successfully updated package (version %d)", remote_version);
-	return;
+
+finish:
+	transfer_free(info, &transfer);
 }
 
 static void *update_thread(void *data)
@@ -0,0 +1,404 @@
+/*
+ * Copyright (c) 2016 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "shmem-ring.h"
+
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define snprintf _snprintf
+#endif
+
+#define NAME_PREFIX "obs-ring-"
+
+struct ipc_ring {
+	struct ipc_ring_header *header;
+	uint8_t                *slots;
+	size_t                 stride;
+	size_t                 size;
+	bool                   producer;
+	char                   name[256];
+
+#ifdef _WIN32
+	HANDLE                 map;
+#endif
+};
+
+#ifdef _WIN32
+static inline uint64_t load_u64(volatile uint64_t *ptr)
+{
+	return (uint64_t)InterlockedCompareExchange64(
+			(volatile LONG64*)ptr, 0, 0);
+}
+
+static inline void store_u64(volatile uint64_t *ptr, uint64_t val)
+{
+	InterlockedExchange64((volatile LONG64*)ptr, (LONG64)val);
+}
+
+static inline void read_fence(void)  {MemoryBarrier();}
+static inline void write_fence(void) {MemoryBarrier();}
+#else
+static inline uint64_t load_u64(volatile uint64_t *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static inline void store_u64(volatile uint64_t *ptr, uint64_t val)
+{
+	__atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+}
+
+static inline void read_fence(void)  {__atomic_thread_fence(__ATOMIC_ACQUIRE);}
+static inline void write_fence(void) {__atomic_thread_fence(__ATOMIC_RELEASE);}
+#endif
+
+static inline size_t slot_stride(uint32_t slot_size)
+{
+	size_t stride = sizeof(struct ipc_ring_slot) + slot_size;
+	return (stride + IPC_RING_ALIGN - 1) & ~(size_t)(IPC_RING_ALIGN - 1);
+}
+
+static inline size_t header_size(void)
+{
+	size_t size = sizeof(struct ipc_ring_header);
+	return (size + IPC_RING_ALIGN - 1) & ~(size_t)(IPC_RING_ALIGN - 1);
+}
+
+static inline struct ipc_ring_slot *get_slot(ipc_ring_t *ring, uint64_t pos)
+{
+	size_t idx = (size_t)(pos % ring->header->slot_count);
+	return (struct ipc_ring_slot*)(ring->slots + idx * ring->stride);
+}
+
+static inline uint8_t *slot_payload(struct ipc_ring_slot *slot)
+{
+	return (uint8_t*)slot + sizeof(struct ipc_ring_slot);
+}
+
+static bool make_name(ipc_ring_t *ring, const char *name)
+{
+	int len;
+
+	if (!name || !*name || strchr(name, '/') || strchr(name, '\\'))
+		return false;
+
+#ifdef _WIN32
+	len = snprintf(ring->name, sizeof(ring->name), NAME_PREFIX "%s", name);
+#else
+	len = snprintf(ring->name, sizeof(ring->name), "/" NAME_PREFIX "%s",
+			name);
+#endif
+	return len > 0 && (size_t)len < sizeof(ring->name);
+}
+
+/* ------------------------------------------------------------------------- */
+
+#ifdef _WIN32
+static bool map_create(ipc_ring_t *ring)
+{
+	ring->map = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL,
+			PAGE_READWRITE, (DWORD)((uint64_t)ring->size >> 32),
+			(DWORD)ring->size, ring->name);
+	if (!ring->map)
+		return false;
+
+	/* someone else is already publishing under this name */
+	if (GetLastError() == ERROR_ALREADY_EXISTS)
+		return false;
+
+	ring->header = MapViewOfFile(ring->map, FILE_MAP_ALL_ACCESS, 0, 0,
+			ring->size);
+	return ring->header != NULL;
+}
+
+static bool map_open(ipc_ring_t *ring)
+{
+	MEMORY_BASIC_INFORMATION mbi;
+
+	ring->map = OpenFileMappingA(FILE_MAP_READ, false, ring->name);
+	if (!ring->map)
+		return false;
+
+	ring->header = MapViewOfFile(ring->map, FILE_MAP_READ, 0, 0, 0);
+	if (!ring->header)
+		return false;
+
+	if (!VirtualQuery(ring->header, &mbi, sizeof(mbi)))
+		return false;
+
+	ring->size = mbi.RegionSize;
+	return true;
+}
+
+static void map_free(ipc_ring_t *ring)
+{
+	if (ring->header)
+		UnmapViewOfFile(ring->header);
+	if (ring->map)
+		CloseHandle(ring->map);
+}
+#else
+static bool map_create(ipc_ring_t *ring)
+{
+	void *ptr;
+	int fd;
+
+	/* remove what a producer that crashed may have left behind */
+	shm_unlink(ring->name);
+
+	fd = shm_open(ring->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd == -1)
+		return false;
+
+	if (ftruncate(fd, (off_t)ring->size) != 0) {
+		close(fd);
+		shm_unlink(ring->name);
+		return false;
+	}
+
+	ptr = mmap(NULL, ring->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+			0);
+	close(fd);
+
+	if (ptr == MAP_FAILED) {
+		shm_unlink(ring->name);
+		return false;
+	}
+
+	ring->header = ptr;
+	return true;
+}
+
+static bool map_open(ipc_ring_t *ring)
+{
+	struct stat st;
+	void *ptr;
+	int fd;
+
+	fd = shm_open(ring->name, O_RDONLY, 0);
+	if (fd == -1)
+		return false;
+
+	if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+		close(fd);
+		return false;
+	}
+
+	ring->size = (size_t)st.st_size;
+
+	ptr = mmap(NULL, ring->size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (ptr == MAP_FAILED)
+		return false;
+
+	ring->header = ptr;
+	return true;
+}
+
+static void map_free(ipc_ring_t *ring)
+{
+	if (ring->header)
+		munmap(ring->header, ring->size);
+	if (ring->producer)
+		shm_unlink(ring->name);
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+ipc_ring_t *ipc_ring_create(const char *name, uint32_t slot_count,
+		uint32_t slot_size, const void *info, size_t info_size)
+{
+	struct ipc_ring_header *header;
+	ipc_ring_t *ring;
+
+	if (!slot_count || !slot_size || info_size > IPC_RING_INFO_SIZE)
+		return NULL;
+
+	ring = calloc(1, sizeof(*ring));
+	if (!ring)
+		return NULL;
+
+	ring->producer = true;
+	ring->stride = slot_stride(slot_size);
+	ring->size = header_size() + ring->stride * slot_count;
+
+	if (!make_name(ring, name) || !map_create(ring)) {
+		ipc_ring_free(ring);
+		return NULL;
+	}
+
+	header = ring->header;
+	memset(header, 0, sizeof(*header));
+	header->slot_count = slot_count;
+	header->slot_size = slot_size;
+	header->info_size = (uint32_t)info_size;
+	if (info_size)
+		memcpy(header->info, info, info_size);
+
+	ring->slots = (uint8_t*)header + header_size();
+
+	/* readers check the magic first, so everything else has to be
+	 * visible before it is */
+	header->version = IPC_RING_VERSION;
+	write_fence();
+	header->magic = IPC_RING_MAGIC;
+	return ring;
+}
+
+ipc_ring_t *ipc_ring_open(const char *name)
+{
+	struct ipc_ring_header *header;
+	ipc_ring_t *ring;
+
+	ring = calloc(1, sizeof(*ring));
+	if (!ring)
+		return NULL;
+
+	if (!make_name(ring, name) || !map_open(ring))
+		goto fail;
+	if (ring->size < header_size())
+		goto fail;
+
+	header = ring->header;
+	if (header->magic != IPC_RING_MAGIC)
+		goto fail;
+
+	read_fence();
+
+	if (header->version != IPC_RING_VERSION ||
+	    !header->slot_count || !header->slot_size ||
+	    header->info_size > IPC_RING_INFO_SIZE)
+		goto fail;
+
+	ring->stride = slot_stride(header->slot_size);
+	if (ring->size < header_size() + ring->stride * header->slot_count)
+		goto fail;
+
+	ring->slots = (uint8_t*)header + header_size();
+	return ring;
+
+fail:
+	ipc_ring_free(ring);
+	return NULL;
+}
+
+void ipc_ring_free(ipc_ring_t *ring)
+{
+	if (!ring)
+		return;
+
+	map_free(ring);
+	free(ring);
+}
+
+void *ipc_ring_write_begin(ipc_ring_t *ring)
+{
+	uint64_t pos = ring->header->write_pos;
+	struct ipc_ring_slot *slot = get_slot(ring, pos);
+
+	store_u64(&slot->seq, pos * 2 + 1);
+	write_fence();
+	return slot_payload(slot);
+}
+
+void ipc_ring_write_end(ipc_ring_t *ring, uint32_t size, uint64_t timestamp)
+{
+	uint64_t pos = ring->header->write_pos;
+	struct ipc_ring_slot *slot = get_slot(ring, pos);
+
+	slot->timestamp = timestamp;
+	slot->size = size < ring->header->slot_size ?
+		size : ring->header->slot_size;
+
+	store_u64(&slot->seq, pos * 2 + 2);
+	store_u64(&ring->header->write_pos, pos + 1);
+}
+
+size_t ipc_ring_read(ipc_ring_t *ring, uint64_t *pos, void *data,
+		size_t size, uint64_t *timestamp)
+{
+	struct ipc_ring_header *header = ring->header;
+
+	for (;;) {
+		uint64_t write_pos = load_u64(&header->write_pos);
+		uint64_t cur = *pos;
+		struct ipc_ring_slot *slot;
+		uint64_t seq;
+		uint64_t frame_ts;
+		uint32_t frame_size;
+
+		if (cur >= write_pos)
+			return 0;
+
+		/* the slot after the newest one may be being written already */
+		if (write_pos - cur >= header->slot_count)
+			cur = write_pos - header->slot_count + 1;
+
+		*pos = cur + 1;
+
+		slot = get_slot(ring, cur);
+		seq = load_u64(&slot->seq);
+		if (seq != cur * 2 + 2)
+			continue;
+
+		frame_size = slot->size;
+		frame_ts = slot->timestamp;
+		if (!frame_size || frame_size > header->slot_size ||
+		    frame_size > size)
+			continue;
+
+		memcpy(data, slot_payload(slot), frame_size);
+
+		read_fence();
+		if (load_u64(&slot->seq) != seq)
+			continue;
+
+		if (timestamp)
+			*timestamp = frame_ts;
+		return frame_size;
+	}
+}
+
+uint64_t ipc_ring_write_pos(ipc_ring_t *ring)
+{
+	return load_u64(&ring->header->write_pos);
+}
+
+uint32_t ipc_ring_slot_size(ipc_ring_t *ring)
+{
+	return ring->header->slot_size;
+}
+
+const void *ipc_ring_info(ipc_ring_t *ring, size_t *size)
+{
+	if (size)
+		*size = ring->header->info_size;
+	return ring->header->info;
+}
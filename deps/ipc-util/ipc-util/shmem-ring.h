@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2016 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#elif _MSC_VER
+#ifndef inline
+#define inline __inline
+#endif
+#endif
+
+/*
+ * Single producer, multiple consumer ring of fixed size slots in named shared
+ * memory.  The producer never waits for consumers: it always writes the next
+ * slot, and a consumer that falls a whole ring behind skips ahead to the
+ * oldest slot still in the ring.
+ *
+ * Memory layout, all values in native byte order:
+ *
+ *   struct ipc_ring_header
+ *   slot_count * (struct ipc_ring_slot + slot_size bytes of payload), each
+ *   slot starting at a multiple of IPC_RING_ALIGN
+ *
+ * A slot's sequence number is 2 * pos + 1 while the pos-th frame is being
+ * written into it, and 2 * pos + 2 once it's published, and write_pos is the
+ * number of frames published so far.  Readers check the sequence number
+ * again after copying a slot out to detect that it was overwritten while
+ * they were reading it.
+ */
+
+#define IPC_RING_MAGIC     0x5253424f /* "OBSR" */
+#define IPC_RING_VERSION   1
+#define IPC_RING_ALIGN     64
+#define IPC_RING_INFO_SIZE 256
+
+struct ipc_ring_header {
+	uint32_t          magic;
+	uint32_t          version;
+	uint32_t          slot_count;
+	uint32_t          slot_size;
+	uint32_t          info_size;
+	uint32_t          reserved;
+	volatile uint64_t write_pos;
+
+	/* description of the payload, written once before anything is
+	 * published, see struct ipc_av_video_info/ipc_av_audio_info */
+	uint8_t           info[IPC_RING_INFO_SIZE];
+};
+
+struct ipc_ring_slot {
+	volatile uint64_t seq;
+	uint64_t          timestamp;
+	uint32_t          size;
+	uint32_t          reserved;
+};
+
+/* ------------------------------------------------------------------------- */
+/* raw audio/video payloads, as published by the shared memory output */
+
+#define IPC_AV_VIDEO_NV12 1
+#define IPC_AV_VIDEO_I420 2
+
+/* colorspace values */
+#define IPC_AV_CS_601     1
+#define IPC_AV_CS_709     2
+
+/* one frame per slot, planes packed one after another with no padding
+ * between rows, timestamps in nanoseconds on the same clock as audio */
+struct ipc_av_video_info {
+	uint32_t format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t fps_num;
+	uint32_t fps_den;
+	uint32_t colorspace;
+	uint32_t full_range;
+	uint32_t planes;
+	uint32_t linesize[4];
+	uint32_t plane_offset[4];
+};
+
+/* one packet of 32-bit float planar audio per slot.  the slot size divided
+ * by channels * sizeof(float) is the number of frames in it, and plane i
+ * starts at i * frames * sizeof(float).  the timestamp is the time of the
+ * first frame. */
+struct ipc_av_audio_info {
+	uint32_t samples_per_sec;
+	uint32_t channels;
+};
+
+/* ------------------------------------------------------------------------- */
+
+struct ipc_ring;
+typedef struct ipc_ring ipc_ring_t;
+
+/* producer */
+ipc_ring_t *ipc_ring_create(const char *name, uint32_t slot_count,
+		uint32_t slot_size, const void *info, size_t info_size);
+
+/* returns slot_size bytes to write the next frame to */
+void *ipc_ring_write_begin(ipc_ring_t *ring);
+void ipc_ring_write_end(ipc_ring_t *ring, uint32_t size, uint64_t timestamp);
+
+/* consumer, opens an existing ring for reading */
+ipc_ring_t *ipc_ring_open(const char *name);
+
+/* copies the frame at *pos (0 for the first one ever published) into data
+ * and advances *pos past it.  returns the size of the frame, or 0 if there
+ * is no new frame yet.  if the frame at *pos was already overwritten, *pos
+ * skips ahead to the oldest one still available; a data buffer smaller than
+ * slot_size may cause frames to be skipped.  the frame's timestamp is
+ * stored in timestamp if it isn't NULL. */
+size_t ipc_ring_read(ipc_ring_t *ring, uint64_t *pos, void *data,
+		size_t size, uint64_t *timestamp);
+
+/* position of the next frame to be published, to start reading live */
+uint64_t ipc_ring_write_pos(ipc_ring_t *ring);
+
+uint32_t ipc_ring_slot_size(ipc_ring_t *ring);
+const void *ipc_ring_info(ipc_ring_t *ring, size_t *size);
+
+/* the producer also removes the ring's name, consumers that still have it
+ * open can keep reading what's in it */
+void ipc_ring_free(ipc_ring_t *ring);
+
+#ifdef __cplusplus
+}
+#endif
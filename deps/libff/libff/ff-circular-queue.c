@@ -15,6 +15,7 @@
  */
 
 #include "ff-circular-queue.h"
+#include "ff-threading.h"
 
 static void *queue_fetch_or_alloc(struct ff_circular_queue *cq,
 		int index)
@@ -54,6 +55,10 @@ bool ff_circular_queue_init(struct ff_circular_queue *cq, int item_size,
 	cq->capacity = capacity;
 	cq->abort = false;
 
+	// a full queue wakes its writer once it has drained to half, so the
+	// writer refills it in bursts instead of waking up for every item
+	cq->wake_size = capacity / 2;
+
 	cq->slots = av_mallocz(capacity * sizeof(void *));
 
 	if (cq->slots == NULL)
@@ -100,11 +105,20 @@ void ff_circular_queue_free(struct ff_circular_queue *cq)
 
 void ff_circular_queue_wait_write(struct ff_circular_queue *cq)
 {
+	if (cq->size < cq->capacity)
+		return;
+
 	queue_lock(cq);
 
+	// announce the wait before checking the size again, the reader
+	// checks for waiters after updating the size
+	ff_atomic_inc_long(&cq->writer_waiting);
+
 	while (cq->size >= cq->capacity && !cq->abort)
 		queue_wait(cq);
 
+	ff_atomic_dec_long(&cq->writer_waiting);
+
 	queue_unlock(cq);
 }
 
@@ -118,9 +132,7 @@ void ff_circular_queue_advance_write(struct ff_circular_queue *cq, void *item)
 	cq->slots[cq->write_index] = item;
 	cq->write_index = (cq->write_index + 1) % cq->capacity;
 
-	queue_lock(cq);
-	++cq->size;
-	queue_unlock(cq);
+	ff_atomic_inc_long(&cq->size);
 }
 
 void *ff_circular_queue_peek_read(struct ff_circular_queue *cq)
@@ -130,11 +142,16 @@ void *ff_circular_queue_peek_read(struct ff_circular_queue *cq)
 
 void ff_circular_queue_advance_read(struct ff_circular_queue *cq)
 {
+	long size;
+
 	cq->read_index = (cq->read_index + 1) % cq->capacity;
-	queue_lock(cq);
-	--cq->size;
-	queue_signal(cq);
-	queue_unlock(cq);
+	size = ff_atomic_dec_long(&cq->size);
+
+	if (cq->writer_waiting && size <= cq->wake_size) {
+		queue_lock(cq);
+		queue_signal(cq);
+		queue_unlock(cq);
+	}
 }
 
 
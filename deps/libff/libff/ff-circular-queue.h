@@ -24,6 +24,9 @@ extern "C" {
 #include <libavutil/mem.h>
 #include <stdbool.h>
 
+/* single producer, single consumer.  the indices are only touched by their
+ * own side and the size is updated atomically, the mutex and condition are
+ * only used to put the writer to sleep while the queue is full */
 struct ff_circular_queue {
 	pthread_mutex_t mutex;
 	pthread_cond_t cond;
@@ -32,7 +35,9 @@ struct ff_circular_queue {
 
 	int item_size;
 	int capacity;
-	int size;
+	int wake_size;
+	volatile long size;
+	volatile long writer_waiting;
 
 	int write_index;
 	int read_index;
@@ -90,6 +90,25 @@ bool ff_clock_start(struct ff_clock *clock, enum ff_av_sync_type sync_type,
 	return !release && !aborted;
 }
 
+bool ff_clock_try_start(struct ff_clock *clock,
+		enum ff_av_sync_type sync_type, bool *orphaned)
+{
+	bool started;
+
+	pthread_mutex_lock(&clock->mutex);
+	if (clock->sync_type == sync_type && !clock->started) {
+		clock->start_time = av_gettime();
+		clock->started = true;
+		pthread_cond_signal(&clock->cond);
+	}
+
+	started = clock->started;
+	*orphaned = !started && clock->retain == 1;
+	pthread_mutex_unlock(&clock->mutex);
+
+	return started;
+}
+
 struct ff_clock *ff_clock_init(void)
 {
 	struct ff_clock *clock = av_mallocz(sizeof(struct ff_clock));
@@ -60,6 +60,12 @@ int64_t ff_clock_start_time(struct ff_clock *clock);
 bool ff_clock_start(struct ff_clock *clock, enum ff_av_sync_type sync_type,
 		const bool *abort);
 
+// Like ff_clock_start, but returns false instead of waiting for the master
+// clock to start.  orphaned is set if the caller holds the only reference,
+// in which case the clock can never be started.
+bool ff_clock_try_start(struct ff_clock *clock,
+		enum ff_av_sync_type sync_type, bool *orphaned);
+
 #ifdef __cplusplus
 }
 #endif
@@ -26,7 +26,7 @@ extern void *ff_video_decoder_thread(void *opaque_video_decoder);
 
 struct ff_decoder *ff_decoder_init(AVCodecContext *codec_context,
 		AVStream *stream, unsigned int packet_queue_size,
-		unsigned int frame_queue_size)
+		unsigned int frame_queue_size, bool polled_refresh)
 {
 	bool success;
 
@@ -54,8 +54,12 @@ struct ff_decoder *ff_decoder_init(AVCodecContext *codec_context,
 	decoder->predicted_pts = 0;
 	decoder->first_frame = true;
 
-	success = ff_timer_init(&decoder->refresh_timer, ff_decoder_refresh,
-			decoder);
+	if (polled_refresh)
+		success = ff_timer_init_polled(&decoder->refresh_timer,
+				ff_decoder_refresh, decoder);
+	else
+		success = ff_timer_init(&decoder->refresh_timer,
+				ff_decoder_refresh, decoder);
 	if (!success)
 		goto fail2;
 
@@ -141,6 +145,12 @@ void ff_decoder_schedule_refresh(struct ff_decoder *decoder, int delay)
 	ff_timer_schedule(&decoder->refresh_timer, 1000*delay);
 }
 
+void ff_decoder_poll(struct ff_decoder *decoder)
+{
+	if (decoder != NULL)
+		ff_timer_poll(&decoder->refresh_timer);
+}
+
 double ff_decoder_clock(void *opaque)
 {
 	struct ff_decoder *decoder = opaque;
@@ -178,7 +188,15 @@ void ff_decoder_refresh(void *opaque)
 	struct ff_frame *frame;
 
 	if (decoder && decoder->stream) {
-		if (decoder->frame_queue.size == 0) {
+		if (decoder->hold != NULL && *decoder->hold) {
+			// preloaded and waiting to be played, keep the frame
+			// timing anchored to now so the first frame is shown
+			// the moment playback starts
+			decoder->timer_next_wake =
+				(double)av_gettime() / 1000000.0;
+			ff_decoder_schedule_refresh(decoder, 1);
+
+		} else if (decoder->frame_queue.size == 0) {
 			if (!decoder->eof) {
 				// We expected a frame, but there were none
 				// available
@@ -196,11 +214,28 @@ void ff_decoder_refresh(void *opaque)
 		} else {
 			double pts_diff;
 			double delay_until_next_wake;
+			double min_delay = decoder->refresh_timer.threaded
+					? 0.010L : 0.0L;
 			bool late_first_frame = false;
 
 			frame = ff_circular_queue_peek_read(
 					&decoder->frame_queue);
 
+			// A polled refresh must not block whoever is
+			// polling, so wait for the master clock by trying
+			// again on the next poll instead
+			if (!decoder->refresh_timer.threaded) {
+				bool orphaned;
+
+				if (!ff_clock_try_start(frame->clock,
+						decoder->natural_sync_clock,
+						&orphaned) && !orphaned) {
+					ff_decoder_schedule_refresh(decoder,
+							1);
+					return;
+				}
+			}
+
 			// Get frame clock and start it if needed
 			ff_clock_t *clock = ff_clock_move(&frame->clock);
 			if (!ff_clock_start(clock, decoder->natural_sync_clock,
@@ -266,8 +301,11 @@ void ff_decoder_refresh(void *opaque)
 			// compute the amount of time until next refresh
 			delay_until_next_wake = decoder->timer_next_wake -
 					(av_gettime() / 1000000.0L);
-			if (delay_until_next_wake < 0.010L) {
-				delay_until_next_wake = 0.010L;
+			// polls only come as often as the caller makes
+			// them, so catch up on frames that are already due
+			// instead of spacing them out
+			if (delay_until_next_wake < min_delay) {
+				delay_until_next_wake = min_delay;
 			}
 
 			if (delay_until_next_wake > pts_diff)
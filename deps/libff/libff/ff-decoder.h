@@ -24,6 +24,12 @@
 
 #include <stdbool.h>
 
+/* hardware device contexts and the decoder hw config API (FFmpeg 4.0) */
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(58, 18, 100)
+#include <libavutil/hwcontext.h>
+#define FF_HW_DEVICE_DECODE 1
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -49,6 +55,7 @@ struct ff_decoder {
 	int64_t start_pts;
 
 	bool hwaccel_decoder;
+	const bool *hold;          // owned by the demuxer, see is_preloading
 	enum AVDiscard frame_drop;
 	struct ff_clock *clock;
 	enum ff_av_sync_type natural_sync_clock;
@@ -62,7 +69,7 @@ typedef struct ff_decoder ff_decoder_t;
 
 struct ff_decoder *ff_decoder_init(AVCodecContext *codec_context,
 		AVStream *stream, unsigned int packet_queue_size,
-		unsigned int frame_queue_size);
+		unsigned int frame_queue_size, bool polled_refresh);
 bool ff_decoder_start(struct ff_decoder *decoder);
 void ff_decoder_free(struct ff_decoder *decoder);
 
@@ -74,6 +81,10 @@ double ff_decoder_clock(void *opaque);
 void ff_decoder_schedule_refresh(struct ff_decoder *decoder, int delay);
 void ff_decoder_refresh(void *opaque);
 
+// Presents any frames that are due, only needed if the decoder was created
+// with polled_refresh
+void ff_decoder_poll(struct ff_decoder *decoder);
+
 double ff_decoder_get_best_effort_pts(struct ff_decoder *decoder,
 		AVFrame *frame);
 
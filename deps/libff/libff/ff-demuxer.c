@@ -20,6 +20,9 @@
 #include <libavutil/time.h>
 #include <libavdevice/avdevice.h>
 #include <libavfilter/avfilter.h>
+#ifdef FF_HW_DEVICE_DECODE
+#include <libavutil/pixdesc.h>
+#endif
 
 #include <assert.h>
 
@@ -28,6 +31,11 @@
 #define AUDIO_FRAME_QUEUE_SIZE 1
 #define VIDEO_FRAME_QUEUE_SIZE 1
 
+// When tick driven, frames that became due between two ticks are presented
+// together, so the decoders need to be able to get that far ahead
+#define TICK_AUDIO_FRAME_QUEUE_SIZE 16
+#define TICK_VIDEO_FRAME_QUEUE_SIZE 3
+
 #define AUDIO_PACKET_QUEUE_SIZE (5 * 16 * 1024)
 #define VIDEO_PACKET_QUEUE_SIZE (5 * 256 * 1024)
 
@@ -65,6 +73,10 @@ bool ff_demuxer_open(struct ff_demuxer *demuxer, char *input,
 	if (input_format != NULL)
 		demuxer->input_format = av_strdup(input_format);
 
+	// when preloading, the input is opened and the first frames are
+	// decoded right away, but nothing is presented until playing
+	demuxer->hold = demuxer->options.is_preloading;
+
 	ret = pthread_create(&demuxer->demuxer_thread, NULL, demux_thread,
 			demuxer);
 	return ret == 0;
@@ -96,6 +108,28 @@ void ff_demuxer_free(struct ff_demuxer *demuxer)
 	av_free(demuxer);
 }
 
+void ff_demuxer_play(struct ff_demuxer *demuxer)
+{
+	demuxer->hold = false;
+}
+
+void ff_demuxer_tick(struct ff_demuxer *demuxer)
+{
+	if (!demuxer->decoders_ready)
+		return;
+
+	ff_decoder_poll(demuxer->audio_decoder);
+	ff_decoder_poll(demuxer->video_decoder);
+}
+
+static inline int frame_queue_size(struct ff_demuxer *demuxer, int size,
+		int tick_size)
+{
+	if (demuxer->options.is_tick_driven && size < tick_size)
+		return tick_size;
+	return size;
+}
+
 void ff_demuxer_set_callbacks(struct ff_callbacks *callbacks,
 		ff_callback_frame frame,
 		ff_callback_format format,
@@ -156,6 +190,87 @@ static bool set_clock_sync_type(struct ff_demuxer *demuxer)
 	return true;
 }
 
+#ifdef FF_HW_DEVICE_DECODE
+static const enum AVHWDeviceType hw_priority[] = {
+#if defined(_WIN32)
+	AV_HWDEVICE_TYPE_D3D11VA,
+	AV_HWDEVICE_TYPE_DXVA2,
+#elif defined(__APPLE__)
+	AV_HWDEVICE_TYPE_VIDEOTOOLBOX,
+#else
+	AV_HWDEVICE_TYPE_VAAPI,
+	AV_HWDEVICE_TYPE_VDPAU,
+#endif
+	AV_HWDEVICE_TYPE_NONE
+};
+
+static bool find_hw_config(const AVCodec *codec, enum AVHWDeviceType type,
+		enum AVPixelFormat *hw_format)
+{
+	for (int i = 0;; i++) {
+		const AVCodecHWConfig *config = avcodec_get_hw_config(codec, i);
+		if (config == NULL)
+			return false;
+
+		int method = AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX;
+
+		if ((config->methods & method) && config->device_type == type) {
+			*hw_format = config->pix_fmt;
+			return true;
+		}
+	}
+}
+
+static enum AVPixelFormat get_hw_device_format(struct AVCodecContext *s,
+		const enum AVPixelFormat *fmt)
+{
+	AVHWDeviceContext *device = (AVHWDeviceContext*)s->hw_device_ctx->data;
+	enum AVPixelFormat hw_format;
+	const enum AVPixelFormat *f;
+
+	if (find_hw_config(s->codec, device->type, &hw_format)) {
+		for (f = fmt; *f != AV_PIX_FMT_NONE; f++)
+			if (*f == hw_format)
+				return *f;
+	}
+
+	// the hardware can't decode this stream (profile, size, ...), use
+	// the first software format instead
+	for (f = fmt; *f != AV_PIX_FMT_NONE; f++) {
+		const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(*f);
+		if (desc && (desc->flags & AV_PIX_FMT_FLAG_HWACCEL) == 0)
+			return *f;
+	}
+
+	return AV_PIX_FMT_NONE;
+}
+
+static bool init_hw_device(AVCodecContext *codec_context, AVCodec *codec)
+{
+	const enum AVHWDeviceType *type;
+
+	for (type = hw_priority; *type != AV_HWDEVICE_TYPE_NONE; type++) {
+		enum AVPixelFormat hw_format;
+		AVBufferRef *device = NULL;
+
+		if (!find_hw_config(codec, *type, &hw_format))
+			continue;
+		if (av_hwdevice_ctx_create(&device, *type, NULL, NULL, 0) < 0)
+			continue;
+
+		// owned by the codec context, released by avcodec_close
+		codec_context->hw_device_ctx = device;
+		codec_context->get_format = get_hw_device_format;
+
+		av_log(NULL, AV_LOG_INFO, "using %s hardware decoding for "
+				"codec %s", av_hwdevice_get_type_name(*type),
+				codec->name);
+		return true;
+	}
+
+	return false;
+}
+#else
 AVHWAccel *find_hwaccel_codec(AVCodecContext *codec_context)
 {
 	AVHWAccel *hwaccel = NULL;
@@ -182,6 +297,7 @@ enum AVPixelFormat get_hwaccel_format(struct AVCodecContext *s,
 	// for now force output to common denominator
 	return AV_PIX_FMT_YUV420P;
 }
+#endif
 
 static bool initialize_decoder(struct ff_demuxer *demuxer,
 		AVCodecContext *codec_context, AVStream *stream,
@@ -192,9 +308,13 @@ static bool initialize_decoder(struct ff_demuxer *demuxer,
 		demuxer->audio_decoder = ff_decoder_init(
 				codec_context, stream,
 				demuxer->options.audio_packet_queue_size,
-				demuxer->options.audio_frame_queue_size);
+				frame_queue_size(demuxer,
+					demuxer->options.audio_frame_queue_size,
+					TICK_AUDIO_FRAME_QUEUE_SIZE),
+				demuxer->options.is_tick_driven);
 
 		demuxer->audio_decoder->hwaccel_decoder = hwaccel_decoder;
+		demuxer->audio_decoder->hold = &demuxer->hold;
 		demuxer->audio_decoder->frame_drop =
 				demuxer->options.frame_drop;
 		demuxer->audio_decoder->natural_sync_clock =
@@ -215,9 +335,13 @@ static bool initialize_decoder(struct ff_demuxer *demuxer,
 		demuxer->video_decoder = ff_decoder_init(
 				codec_context, stream,
 				demuxer->options.video_packet_queue_size,
-				demuxer->options.video_frame_queue_size);
+				frame_queue_size(demuxer,
+					demuxer->options.video_frame_queue_size,
+					TICK_VIDEO_FRAME_QUEUE_SIZE),
+				demuxer->options.is_tick_driven);
 
 		demuxer->video_decoder->hwaccel_decoder = hwaccel_decoder;
+		demuxer->video_decoder->hold = &demuxer->hold;
 		demuxer->video_decoder->frame_drop =
 				demuxer->options.frame_drop;
 		demuxer->video_decoder->natural_sync_clock =
@@ -248,6 +372,7 @@ static bool find_decoder(struct ff_demuxer *demuxer, AVStream *stream)
 	int ret;
 
 	bool hwaccel_decoder = false;
+	bool single_thread = false;
 	codec_context = stream->codec;
 
 	// enable reference counted frames since we may have a buffer size
@@ -259,9 +384,33 @@ static bool find_decoder(struct ff_demuxer *demuxer, AVStream *stream)
 			|| codec_context->codec_id == AV_CODEC_ID_TIFF
 			|| codec_context->codec_id == AV_CODEC_ID_JPEG2000
 			|| codec_context->codec_id == AV_CODEC_ID_WEBP)
-		codec_context->thread_count = 1;
+		single_thread = true;
+
+	codec_context->thread_count = 1;
 
 	if (demuxer->options.is_hw_decoding) {
+#ifdef FF_HW_DEVICE_DECODE
+		AVCodec *hw_codec =
+			avcodec_find_decoder(codec_context->codec_id);
+
+		if (hw_codec != NULL &&
+		    init_hw_device(codec_context, hw_codec)) {
+			ret = avcodec_open2(codec_context, hw_codec,
+					&options_dict);
+			if (ret < 0) {
+				av_log(NULL, AV_LOG_WARNING,
+                                                "unable to open hardware "
+                                                "decoder for codec with id %d",
+                                                codec_context->codec_id);
+				av_buffer_unref(&codec_context->hw_device_ctx);
+				codec_context->get_format =
+						avcodec_default_get_format;
+			} else {
+				codec = hw_codec;
+				hwaccel_decoder = true;
+			}
+		}
+#else
 		AVHWAccel *hwaccel = find_hwaccel_codec(codec_context);
 
 		if (hwaccel) {
@@ -291,6 +440,7 @@ static bool find_decoder(struct ff_demuxer *demuxer, AVStream *stream)
 				}
 			}
 		}
+#endif
 	}
 
 	if (codec == NULL) {
@@ -301,6 +451,15 @@ static bool find_decoder(struct ff_demuxer *demuxer, AVStream *stream)
                                                      codec_context->codec_id);
 			return false;
 		}
+
+		// software decoding of large h264/hevc streams needs more than
+		// one core, use as many frame and slice threads as there are
+		if (!single_thread) {
+			codec_context->thread_count = 0;
+			codec_context->thread_type =
+				FF_THREAD_FRAME | FF_THREAD_SLICE;
+		}
+
 		if (avcodec_open2(codec_context, codec, &options_dict) < 0) {
 			av_log(NULL, AV_LOG_WARNING, "unable to open decoder"
                                                      " with codec id %d",
@@ -550,6 +709,9 @@ static void *demux_thread(void *opaque)
 	if (!find_and_initialize_stream_decoders(demuxer))
 		goto fail;
 
+	// the decoders don't change from here on until the demuxer is freed
+	demuxer->decoders_ready = true;
+
 	ff_demuxer_reset(demuxer);
 
 	while (!demuxer->abort) {
@@ -39,6 +39,8 @@ struct ff_demuxer_options
 	int video_frame_queue_size;
 	bool is_hw_decoding;
 	bool is_looping;
+	bool is_preloading;
+	bool is_tick_driven;
 	enum AVDiscard frame_drop;
 };
 
@@ -65,6 +67,8 @@ struct ff_demuxer {
 	int seek_flags;
 	bool seek_flush;
 
+	bool hold;
+	volatile bool decoders_ready;
 	bool abort;
 
 	char *input;
@@ -76,6 +80,12 @@ typedef struct ff_demuxer ff_demuxer_t;
 struct ff_demuxer *ff_demuxer_init();
 bool ff_demuxer_open(struct ff_demuxer *demuxer, char *input, char *input_format);
 void ff_demuxer_free(struct ff_demuxer *demuxer);
+void ff_demuxer_play(struct ff_demuxer *demuxer);
+
+// With is_tick_driven set, frames are only presented from this function,
+// which has to be called regularly (e.g. once per output frame) and never
+// blocks.  Otherwise every decoder presents frames from a timer thread.
+void ff_demuxer_tick(struct ff_demuxer *demuxer);
 
 void ff_demuxer_set_callbacks(struct ff_callbacks *callbacks,
 		ff_callback_frame frame,
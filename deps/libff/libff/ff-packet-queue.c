@@ -48,8 +48,16 @@ void packet_queue_abort(struct ff_packet_queue *q)
 
 void packet_queue_free(struct ff_packet_queue *q)
 {
+	struct ff_packet_list *packet;
+
 	packet_queue_flush(q);
 
+	for (packet = q->free_packets; packet != NULL;
+			packet = q->free_packets) {
+		q->free_packets = packet->next;
+		av_freep(&packet);
+	}
+
 	pthread_mutex_destroy(&q->mutex);
 	pthread_cond_destroy(&q->cond);
 
@@ -64,16 +72,24 @@ int packet_queue_put(struct ff_packet_queue *q, struct ff_packet *packet)
 			&& av_dup_packet(&packet->base) < 0)
 		return FF_PACKET_FAIL;
 
-	new_packet = av_malloc(sizeof(struct ff_packet_list));
+	pthread_mutex_lock(&q->mutex);
 
-	if (new_packet == NULL)
-		return FF_PACKET_FAIL;
+	// list entries are recycled, the queue would otherwise allocate and
+	// free one for every packet
+	new_packet = q->free_packets;
+	if (new_packet != NULL) {
+		q->free_packets = new_packet->next;
+	} else {
+		new_packet = av_malloc(sizeof(struct ff_packet_list));
+		if (new_packet == NULL) {
+			pthread_mutex_unlock(&q->mutex);
+			return FF_PACKET_FAIL;
+		}
+	}
 
 	new_packet->packet = *packet;
 	new_packet->next = NULL;
 
-	pthread_mutex_lock(&q->mutex);
-
 	if (q->last_packet == NULL)
 		q->first_packet = new_packet;
 	else
@@ -84,7 +100,9 @@ int packet_queue_put(struct ff_packet_queue *q, struct ff_packet *packet)
 	q->count++;
 	q->total_size += new_packet->packet.base.size;
 
-	pthread_cond_signal(&q->cond);
+	// only wake the reader if it is actually waiting for a packet
+	if (q->waiting)
+		pthread_cond_signal(&q->cond);
 	pthread_mutex_unlock(&q->mutex);
 
 	return FF_PACKET_SUCCESS;
@@ -115,7 +133,8 @@ int packet_queue_get(struct ff_packet_queue *q, struct ff_packet *packet,
 			q->count--;
 			q->total_size -= potential_packet->packet.base.size;
 			*packet = potential_packet->packet;
-			av_free(potential_packet);
+			potential_packet->next = q->free_packets;
+			q->free_packets = potential_packet;
 			return_status = FF_PACKET_SUCCESS;
 			break;
 
@@ -124,7 +143,9 @@ int packet_queue_get(struct ff_packet_queue *q, struct ff_packet *packet,
 			break;
 
 		} else {
+			q->waiting = true;
 			pthread_cond_wait(&q->cond, &q->mutex);
+			q->waiting = false;
 			if (q->abort) {
 				return_status = FF_PACKET_FAIL;
 				break;
@@ -149,7 +170,8 @@ void packet_queue_flush(struct ff_packet_queue *q)
 		av_free_packet(&packet->packet.base);
 		if (packet->packet.clock != NULL)
 			ff_clock_release(&packet->packet.clock);
-		av_freep(&packet);
+		packet->next = q->free_packets;
+		q->free_packets = packet;
 	}
 
 	q->last_packet = q->first_packet = NULL;
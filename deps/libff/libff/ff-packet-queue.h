@@ -43,11 +43,13 @@ struct ff_packet_list {
 struct ff_packet_queue {
 	struct ff_packet_list *first_packet;
 	struct ff_packet_list *last_packet;
+	struct ff_packet_list *free_packets;
 	pthread_mutex_t mutex;
 	pthread_cond_t cond;
 	struct ff_packet flush_packet;
 	int count;
 	unsigned int total_size;
+	bool waiting;
 	bool abort;
 };
 
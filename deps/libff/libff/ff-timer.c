@@ -21,6 +21,10 @@
 #include <string.h>
 #include <assert.h>
 
+// Upper bound on callbacks per poll, so a timer that keeps scheduling
+// itself right away can't hold up the polling thread
+#define MAX_POLLED_CALLBACKS 32
+
 static void *timer_thread(void *opaque)
 {
 	struct ff_timer *timer = (struct ff_timer *)opaque;
@@ -74,8 +78,8 @@ static void *timer_thread(void *opaque)
 	return NULL;
 }
 
-bool ff_timer_init(struct ff_timer *timer, ff_timer_callback callback,
-		void *opaque)
+static bool timer_init(struct ff_timer *timer, ff_timer_callback callback,
+		void *opaque, bool threaded)
 {
 	memset(timer, 0, sizeof(struct ff_timer));
 	timer->abort = false;
@@ -92,9 +96,11 @@ bool ff_timer_init(struct ff_timer *timer, ff_timer_callback callback,
 	if (pthread_cond_init(&timer->cond, NULL) != 0)
 		goto fail2;
 
-	if (pthread_create(&timer->timer_thread, NULL, timer_thread, timer) != 0)
+	if (threaded && pthread_create(&timer->timer_thread, NULL,
+				timer_thread, timer) != 0)
 		goto fail3;
 
+	timer->threaded = threaded;
 	return true;
 
 fail3:
@@ -107,6 +113,37 @@ fail:
 	return false;
 }
 
+bool ff_timer_init(struct ff_timer *timer, ff_timer_callback callback,
+		void *opaque)
+{
+	return timer_init(timer, callback, opaque, true);
+}
+
+bool ff_timer_init_polled(struct ff_timer *timer, ff_timer_callback callback,
+		void *opaque)
+{
+	return timer_init(timer, callback, opaque, false);
+}
+
+void ff_timer_poll(struct ff_timer *timer)
+{
+	for (int i = 0; i < MAX_POLLED_CALLBACKS; i++) {
+		bool callback;
+
+		pthread_mutex_lock(&timer->mutex);
+		callback = !timer->abort && timer->needs_wake &&
+				timer->next_wake <= (uint64_t)av_gettime();
+		if (callback)
+			timer->needs_wake = false;
+		pthread_mutex_unlock(&timer->mutex);
+
+		if (!callback)
+			break;
+
+		timer->callback(timer->opaque);
+	}
+}
+
 void ff_timer_free(struct ff_timer *timer)
 {
 	void *thread_result;
@@ -118,7 +155,8 @@ void ff_timer_free(struct ff_timer *timer)
 	pthread_cond_signal(&timer->cond);
 	pthread_mutex_unlock(&timer->mutex);
 
-	pthread_join(timer->timer_thread, &thread_result);
+	if (timer->threaded)
+		pthread_join(timer->timer_thread, &thread_result);
 
 	pthread_mutex_destroy(&timer->mutex);
 	pthread_mutexattr_destroy(&timer->mutexattr);
@@ -35,6 +35,7 @@ struct ff_timer {
 	pthread_cond_t cond;
 
 	pthread_t timer_thread;
+	bool threaded;
 	uint64_t next_wake;
 	bool needs_wake;
 
@@ -46,6 +47,13 @@ typedef struct ff_timer ff_timer_t;
 bool ff_timer_init(struct ff_timer *timer,
 		ff_timer_callback callback, void *opaque);
 void ff_timer_free(struct ff_timer *timer);
+
+// A polled timer has no thread of its own, its callback is only called from
+// ff_timer_poll once the scheduled time has passed
+bool ff_timer_init_polled(struct ff_timer *timer,
+		ff_timer_callback callback, void *opaque);
+void ff_timer_poll(struct ff_timer *timer);
+
 void ff_timer_schedule(struct ff_timer *timer, uint64_t microseconds);
 
 #ifdef __cplusplus
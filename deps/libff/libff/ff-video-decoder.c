@@ -47,7 +47,7 @@ static bool queue_frame(struct ff_decoder *decoder, AVFrame *frame,
 	call_initialize = (queue_frame->frame == NULL
 			|| queue_frame->frame->width != codec->width
 			|| queue_frame->frame->height != codec->height
-			|| queue_frame->frame->format != codec->pix_fmt);
+			|| queue_frame->frame->format != frame->format);
 
 	if (queue_frame->frame != NULL)
 		av_frame_free(&queue_frame->frame);
@@ -72,6 +72,9 @@ void *ff_video_decoder_thread(void *opaque_video_decoder)
 	struct ff_packet packet = {0};
 	int complete;
 	AVFrame *frame = av_frame_alloc();
+#ifdef FF_HW_DEVICE_DECODE
+	AVFrame *sw_frame = av_frame_alloc();
+#endif
 	int ret;
 	bool key_frame;
 
@@ -124,6 +127,26 @@ void *ff_video_decoder_thread(void *opaque_video_decoder)
 			double best_effort_pts =
 				ff_decoder_get_best_effort_pts(decoder, frame);
 
+#ifdef FF_HW_DEVICE_DECODE
+			// hardware surfaces can't be handed out as they are,
+			// read them back in their native layout (usually nv12)
+			if (frame->hw_frames_ctx != NULL) {
+				if (av_hwframe_transfer_data(sw_frame, frame,
+							0) < 0) {
+					av_log(NULL, AV_LOG_WARNING,
+							"unable to read back "
+							"hardware frame");
+					av_frame_unref(frame);
+					av_free_packet(&packet.base);
+					continue;
+				}
+
+				av_frame_copy_props(sw_frame, frame);
+				av_frame_unref(frame);
+				av_frame_move_ref(frame, sw_frame);
+			}
+#endif
+
 			queue_frame(decoder, frame, best_effort_pts);
 			av_frame_unref(frame);
 		}
@@ -134,6 +157,9 @@ void *ff_video_decoder_thread(void *opaque_video_decoder)
 	if (decoder->clock != NULL)
 		ff_clock_release(&decoder->clock);
 
+#ifdef FF_HW_DEVICE_DECODE
+	av_frame_free(&sw_frame);
+#endif
 	av_frame_free(&frame);
 	return NULL;
 }
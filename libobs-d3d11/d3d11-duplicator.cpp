@@ -147,7 +147,69 @@ EXPORT void gs_duplicator_destroy(gs_duplicator_t *duplicator)
 	delete duplicator;
 }
 
-static inline void copy_texture(gs_duplicator_t *d, ID3D11Texture2D *tex)
+static inline void copy_rect(gs_duplicator_t *d, ID3D11Texture2D *tex,
+		const RECT &rect)
+{
+	D3D11_BOX box;
+	box.left   = rect.left;
+	box.top    = rect.top;
+	box.front  = 0;
+	box.right  = rect.right;
+	box.bottom = rect.bottom;
+	box.back   = 1;
+
+	d->device->context->CopySubresourceRegion(d->texture->texture, 0,
+			rect.left, rect.top, 0, tex, 0, &box);
+}
+
+/*
+ * Copies only the parts of the desktop that changed since the last frame.
+ * The acquired image is already the final desktop, so the destination of a
+ * move rect can simply be copied like a dirty rect.  Returns false if the
+ * change list isn't available, in which case the whole frame is copied.
+ */
+static bool copy_changed_rects(gs_duplicator_t *d, ID3D11Texture2D *tex,
+		const DXGI_OUTDUPL_FRAME_INFO &info)
+{
+	UINT size = info.TotalMetadataBufferSize;
+	UINT move_size = 0;
+	UINT dirty_size = 0;
+	HRESULT hr;
+
+	if (!size)
+		return false;
+
+	if (d->metadata.size() < size)
+		d->metadata.resize(size);
+
+	hr = d->duplicator->GetFrameMoveRects(size,
+			(DXGI_OUTDUPL_MOVE_RECT*)d->metadata.data(),
+			&move_size);
+	if (FAILED(hr))
+		return false;
+
+	const DXGI_OUTDUPL_MOVE_RECT *moves =
+		(const DXGI_OUTDUPL_MOVE_RECT*)d->metadata.data();
+	UINT num_moves = move_size / sizeof(DXGI_OUTDUPL_MOVE_RECT);
+
+	hr = d->duplicator->GetFrameDirtyRects(size - move_size,
+			(RECT*)(d->metadata.data() + move_size), &dirty_size);
+	if (FAILED(hr))
+		return false;
+
+	const RECT *dirty = (const RECT*)(d->metadata.data() + move_size);
+	UINT num_dirty = dirty_size / sizeof(RECT);
+
+	for (UINT i = 0; i < num_moves; i++)
+		copy_rect(d, tex, moves[i].DestinationRect);
+	for (UINT i = 0; i < num_dirty; i++)
+		copy_rect(d, tex, dirty[i]);
+
+	return true;
+}
+
+static inline void copy_texture(gs_duplicator_t *d, ID3D11Texture2D *tex,
+		const DXGI_OUTDUPL_FRAME_INFO &info)
 {
 	D3D11_TEXTURE2D_DESC desc;
 	tex->GetDesc(&desc);
@@ -161,11 +223,15 @@ static inline void copy_texture(gs_duplicator_t *d, ID3D11Texture2D *tex)
 				desc.Width, desc.Height,
 				ConvertDXGITextureFormat(desc.Format), 1,
 				nullptr, 0);
+
+		if (!!d->texture)
+			d->device->context->CopyResource(d->texture->texture,
+					tex);
+		return;
 	}
 
-	if (!!d->texture)
-		d->device->context->CopyResource(d->texture->texture,
-				tex);
+	if (!copy_changed_rects(d, tex, info))
+		d->device->context->CopyResource(d->texture->texture, tex);
 }
 
 EXPORT bool gs_duplicator_update_frame(gs_duplicator_t *d)
@@ -188,6 +254,12 @@ EXPORT bool gs_duplicator_update_frame(gs_duplicator_t *d)
 		return true;
 	}
 
+	/* only the mouse changed, the texture is still current */
+	if (info.AccumulatedFrames == 0 && !!d->texture) {
+		d->duplicator->ReleaseFrame();
+		return true;
+	}
+
 	hr = res->QueryInterface(__uuidof(ID3D11Texture2D),
 			(void**)tex.Assign());
 	if (FAILED(hr)) {
@@ -197,7 +269,7 @@ EXPORT bool gs_duplicator_update_frame(gs_duplicator_t *d)
 		return true;
 	}
 
-	copy_texture(d, tex);
+	copy_texture(d, tex, info);
 	d->duplicator->ReleaseFrame();
 	return true;
 }
@@ -17,6 +17,8 @@
 
 #include "d3d11-subsystem.hpp"
 #include "d3d11-shaderprocessor.hpp"
+#include <util/crc32.h>
+#include <util/platform.h>
 #include <graphics/vec2.h>
 #include <graphics/vec3.h>
 #include <graphics/matrix3.h>
@@ -48,7 +50,7 @@ gs_vertex_shader::gs_vertex_shader(gs_device_t *device, const char *file,
 {
 	vector<D3D11_INPUT_ELEMENT_DESC> inputs;
 	ShaderProcessor    processor(device);
-	ComPtr<ID3D10Blob> shaderBlob;
+	vector<uint8_t>    data;
 	string             outputString;
 	HRESULT            hr;
 
@@ -59,16 +61,16 @@ gs_vertex_shader::gs_vertex_shader(gs_device_t *device, const char *file,
 	GetBuffersExpected(inputs);
 	BuildConstantBuffer();
 
-	Compile(outputString.c_str(), file, "vs_4_0", shaderBlob.Assign());
+	Compile(outputString.c_str(), file, "vs_4_0", data);
 
-	hr = device->device->CreateVertexShader(shaderBlob->GetBufferPointer(),
-			shaderBlob->GetBufferSize(), NULL, shader.Assign());
+	hr = device->device->CreateVertexShader(data.data(), data.size(),
+			NULL, shader.Assign());
 	if (FAILED(hr))
 		throw HRError("Failed to create vertex shader", hr);
 
 	hr = device->device->CreateInputLayout(inputs.data(),
-			(UINT)inputs.size(), shaderBlob->GetBufferPointer(),
-			shaderBlob->GetBufferSize(), layout.Assign());
+			(UINT)inputs.size(), data.data(), data.size(),
+			layout.Assign());
 	if (FAILED(hr))
 		throw HRError("Failed to create input layout", hr);
 
@@ -81,7 +83,7 @@ gs_pixel_shader::gs_pixel_shader(gs_device_t *device, const char *file,
 	: gs_shader(device, GS_SHADER_PIXEL)
 {
 	ShaderProcessor    processor(device);
-	ComPtr<ID3D10Blob> shaderBlob;
+	vector<uint8_t>    data;
 	string             outputString;
 	HRESULT            hr;
 
@@ -91,10 +93,10 @@ gs_pixel_shader::gs_pixel_shader(gs_device_t *device, const char *file,
 	processor.BuildSamplers(samplers);
 	BuildConstantBuffer();
 
-	Compile(outputString.c_str(), file, "ps_4_0", shaderBlob.Assign());
+	Compile(outputString.c_str(), file, "ps_4_0", data);
 
-	hr = device->device->CreatePixelShader(shaderBlob->GetBufferPointer(),
-			shaderBlob->GetBufferSize(), NULL, shader.Assign());
+	hr = device->device->CreatePixelShader(data.data(), data.size(),
+			NULL, shader.Assign());
 	if (FAILED(hr))
 		throw HRError("Failed to create vertex shader", hr);
 }
@@ -177,25 +179,125 @@ void gs_shader::BuildConstantBuffer()
 		gs_shader_set_default(&params[i]);
 }
 
+/*
+ * Compiled shaders are cached on disk, keyed by the generated HLSL, the
+ * target profile and the compiler version.  The file stores the HLSL as well,
+ * so a CRC collision can never load the wrong shader.
+ */
+
+#define SHADER_CACHE_MAGIC 0x43534433 /* "3DSC" */
+
+struct ShaderCacheHeader {
+	uint32_t magic;
+	uint32_t compilerVer;
+	uint32_t sourceSize;
+	uint32_t dataSize;
+};
+
+static string GetShaderCacheFile(gs_device_t *device, const char *source,
+		size_t size, const char *target)
+{
+	char name[64];
+
+	sprintf(name, "/d3d11-%08X-%s.bin",
+			calc_crc32(0, source, size), target);
+	return device->shaderCachePath + name;
+}
+
+static bool LoadCachedShader(gs_device_t *device, const string &path,
+		const char *source, size_t size, vector<uint8_t> &data)
+{
+	ShaderCacheHeader header;
+	string            cachedSource;
+	bool              success = false;
+
+	FILE *f = os_fopen(path.c_str(), "rb");
+	if (!f)
+		return false;
+
+	if (fread(&header, sizeof(header), 1, f) != 1 ||
+	    header.magic       != SHADER_CACHE_MAGIC ||
+	    header.compilerVer != (uint32_t)device->d3dCompilerVer ||
+	    header.sourceSize  != size ||
+	    !header.dataSize)
+		goto finish;
+
+	cachedSource.resize(size);
+	if (fread(&cachedSource[0], 1, size, f) != size ||
+	    memcmp(cachedSource.data(), source, size) != 0)
+		goto finish;
+
+	data.resize(header.dataSize);
+	success = fread(data.data(), 1, data.size(), f) == data.size();
+
+finish:
+	fclose(f);
+	return success;
+}
+
+static void SaveCachedShader(gs_device_t *device, const string &path,
+		const char *source, size_t size, const vector<uint8_t> &data)
+{
+	ShaderCacheHeader header;
+	string            tempPath = path + ".tmp";
+	bool              success;
+
+	header.magic       = SHADER_CACHE_MAGIC;
+	header.compilerVer = (uint32_t)device->d3dCompilerVer;
+	header.sourceSize  = (uint32_t)size;
+	header.dataSize    = (uint32_t)data.size();
+
+	FILE *f = os_fopen(tempPath.c_str(), "wb");
+	if (!f)
+		return;
+
+	success = fwrite(&header, sizeof(header), 1, f) == 1 &&
+	          fwrite(source, 1, size, f) == size &&
+	          fwrite(data.data(), 1, data.size(), f) == data.size();
+	fclose(f);
+
+	if (!success || os_rename(tempPath.c_str(), path.c_str()) != 0)
+		os_unlink(tempPath.c_str());
+}
+
 void gs_shader::Compile(const char *shaderString, const char *file,
-		const char *target, ID3D10Blob **shader)
+		const char *target, vector<uint8_t> &data)
 {
 	ComPtr<ID3D10Blob> errorsBlob;
+	ComPtr<ID3D10Blob> shaderBlob;
+	string cacheFile;
 	HRESULT hr;
 
 	if (!shaderString)
 		throw "No shader string specified";
 
-	hr = device->d3dCompile(shaderString, strlen(shaderString), file, NULL,
+	size_t size = strlen(shaderString);
+	bool useCache = !device->shaderCachePath.empty();
+
+	if (useCache) {
+		cacheFile = GetShaderCacheFile(device, shaderString, size,
+				target);
+		if (LoadCachedShader(device, cacheFile, shaderString, size,
+					data))
+			return;
+	}
+
+	hr = device->d3dCompile(shaderString, size, file, NULL,
 			NULL, "main", target,
 			D3D10_SHADER_OPTIMIZATION_LEVEL1, 0,
-			shader, errorsBlob.Assign());
+			shaderBlob.Assign(), errorsBlob.Assign());
 	if (FAILED(hr)) {
 		if (errorsBlob != NULL && errorsBlob->GetBufferSize())
 			throw ShaderError(errorsBlob, hr);
 		else
 			throw HRError("Failed to compile shader", hr);
 	}
+
+	uint8_t *ptr = (uint8_t*)shaderBlob->GetBufferPointer();
+	data.assign(ptr, ptr + shaderBlob->GetBufferSize());
+
+	if (useCache)
+		SaveCachedShader(device, cacheFile, shaderString, size, data);
 }
 
 inline void gs_shader::UpdateParam(vector<uint8_t> &constData,
@@ -97,7 +97,8 @@ void gs_swap_chain::Resize(uint32_t cx, uint32_t cy)
 		if (cy == 0) cy = clientRect.bottom;
 	}
 
-	hr = swap->ResizeBuffers(numBuffers, cx, cy, target.dxgiFormat, 0);
+	hr = swap->ResizeBuffers(numBuffers, cx, cy, target.dxgiFormat,
+			swapFlags);
 	if (FAILED(hr))
 		throw HRError("Failed to resize swap buffers", hr);
 
@@ -119,6 +120,68 @@ void gs_swap_chain::Init(const gs_init_data *data)
 	InitZStencilBuffer(data->cx, data->cy);
 }
 
+static inline bool flip_format_supported(DXGI_FORMAT format)
+{
+	switch (format) {
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R10G10B10A2_UNORM:
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* frame latency waitable objects need Windows 8.1 */
+bool gs_swap_chain::CreateFlipSwapChain(const gs_init_data *data)
+{
+	DXGI_SWAP_CHAIN_DESC1 desc = {};
+	DXGI_FORMAT format = ConvertGSTextureFormat(data->format);
+	ComPtr<IDXGISwapChain1> swap1;
+	HRESULT hr;
+
+	if (GetWinVer() < 0x603 || !flip_format_supported(format))
+		return false;
+
+	ComQIPtr<IDXGIFactory2> factory2(device->factory);
+	if (!factory2)
+		return false;
+
+	if (numBuffers < 2)
+		numBuffers = 2;
+	swapFlags  = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+
+	desc.Width            = data->cx;
+	desc.Height           = data->cy;
+	desc.Format           = format;
+	desc.SampleDesc.Count = 1;
+	desc.BufferUsage      = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+	desc.BufferCount      = numBuffers;
+	desc.SwapEffect       = DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL;
+	desc.Flags            = swapFlags;
+
+	hr = factory2->CreateSwapChainForHwnd(device->device, hwnd, &desc,
+			nullptr, nullptr, swap1.Assign());
+	if (FAILED(hr)) {
+		blog(LOG_WARNING, "Failed to create flip model swap chain "
+				"(%08lX), falling back to blit model", hr);
+		numBuffers = data->num_backbuffers;
+		swapFlags  = 0;
+		return false;
+	}
+
+	ComQIPtr<IDXGISwapChain2> swap2(swap1);
+	if (swap2) {
+		swap2->SetMaximumFrameLatency(1);
+		frameLatencyWait = swap2->GetFrameLatencyWaitableObject();
+	}
+
+	swap = swap1.Get();
+	flip = true;
+	return true;
+}
+
 gs_swap_chain::gs_swap_chain(gs_device *device, const gs_init_data *data)
 	: device     (device),
 	  numBuffers (data->num_backbuffers),
@@ -127,15 +190,23 @@ gs_swap_chain::gs_swap_chain(gs_device *device, const gs_init_data *data)
 	HRESULT hr;
 	DXGI_SWAP_CHAIN_DESC swapDesc;
 
-	make_swap_desc(swapDesc, data);
-	hr = device->factory->CreateSwapChain(device->device, &swapDesc,
-			swap.Assign());
-	if (FAILED(hr))
-		throw HRError("Failed to create swap chain", hr);
+	if (!CreateFlipSwapChain(data)) {
+		make_swap_desc(swapDesc, data);
+		hr = device->factory->CreateSwapChain(device->device,
+				&swapDesc, swap.Assign());
+		if (FAILED(hr))
+			throw HRError("Failed to create swap chain", hr);
+	}
 
 	Init(data);
 }
 
+gs_swap_chain::~gs_swap_chain()
+{
+	if (frameLatencyWait)
+		CloseHandle(frameLatencyWait);
+}
+
 void gs_device::InitCompiler()
 {
 	char d3dcompiler[40] = {};
@@ -149,6 +220,7 @@ void gs_device::InitCompiler()
 			d3dCompile = (pD3DCompile)GetProcAddress(module,
 					"D3DCompile");
 			if (d3dCompile) {
+				d3dCompilerVer = ver;
 				return;
 			}
 
@@ -196,8 +268,12 @@ void gs_device::InitDevice(uint32_t adapterIdx, IDXGIAdapter *adapter)
 	//createFlags |= D3D11_CREATE_DEVICE_DEBUG;
 #endif
 
-	adapterName = (adapter->GetDesc(&desc) == S_OK) ? desc.Description :
-		L"<unknown>";
+	if (adapter->GetDesc(&desc) == S_OK) {
+		adapterName = desc.Description;
+		adapterLuid = desc.AdapterLuid;
+	} else {
+		adapterName = L"<unknown>";
+	}
 
 	char *adapterNameUTF8;
 	os_wcs_to_utf8_ptr(adapterName.c_str(), 0, &adapterNameUTF8);
@@ -217,6 +293,73 @@ void gs_device::InitDevice(uint32_t adapterIdx, IDXGIAdapter *adapter)
 			(unsigned int)levelUsed);
 }
 
+static inline bool SameLuid(const LUID &a, const LUID &b)
+{
+	return a.LowPart == b.LowPart && a.HighPart == b.HighPart;
+}
+
+/* shared handles created on another adapter can't be opened by the main
+ * device, so try a device on each of the other adapters.  those devices are
+ * created on first use and kept around for later captures */
+gs_adapter_device *gs_device::OpenSharedOnAdapter(uint32_t handle,
+		ID3D11Texture2D **texture)
+{
+	ComPtr<IDXGIAdapter1> adapter;
+	HRESULT hr;
+	UINT i = 0;
+
+	while (factory->EnumAdapters1(i++, adapter.Assign()) == S_OK) {
+		gs_adapter_device *adapterDevice = nullptr;
+		DXGI_ADAPTER_DESC desc;
+
+		if (FAILED(adapter->GetDesc(&desc)))
+			continue;
+		if (SameLuid(desc.AdapterLuid, adapterLuid))
+			continue;
+
+		for (gs_adapter_device &existing : adapterDevices) {
+			if (SameLuid(existing.luid, desc.AdapterLuid)) {
+				adapterDevice = &existing;
+				break;
+			}
+		}
+
+		if (!adapterDevice) {
+			gs_adapter_device newDevice;
+			D3D_FEATURE_LEVEL levelUsed;
+
+			hr = D3D11CreateDevice(adapter, D3D_DRIVER_TYPE_UNKNOWN,
+					NULL, D3D11_CREATE_DEVICE_BGRA_SUPPORT,
+					featureLevels,
+					sizeof(featureLevels) /
+					sizeof(D3D_FEATURE_LEVEL),
+					D3D11_SDK_VERSION,
+					newDevice.device.Assign(), &levelUsed,
+					newDevice.context.Assign());
+			if (FAILED(hr))
+				continue;
+
+			newDevice.luid = desc.AdapterLuid;
+			adapterDevices.push_back(newDevice);
+			adapterDevice = &adapterDevices.back();
+
+			char *name;
+			os_wcs_to_utf8_ptr(desc.Description, 0, &name);
+			blog(LOG_INFO, "Created secondary D3D11 device on "
+			               "adapter %s for shared textures", name);
+			bfree(name);
+		}
+
+		hr = adapterDevice->device->OpenSharedResource(
+				(HANDLE)(uintptr_t)handle,
+				__uuidof(ID3D11Texture2D), (void**)texture);
+		if (SUCCEEDED(hr))
+			return adapterDevice;
+	}
+
+	return nullptr;
+}
+
 static inline void ConvertStencilSide(D3D11_DEPTH_STENCILOP_DESC &desc,
 		const StencilSide &side)
 {
@@ -549,6 +692,11 @@ void device_leave_context(gs_device_t *device)
 	UNUSED_PARAMETER(device);
 }
 
+void device_set_shader_cache_path(gs_device_t *device, const char *path)
+{
+	device->shaderCachePath = path ? path : "";
+}
+
 gs_swapchain_t *device_swapchain_create(gs_device_t *device,
 		const struct gs_init_data *data)
 {
@@ -711,6 +859,33 @@ gs_stagesurf_t *device_stagesurface_create(gs_device_t *device, uint32_t width,
 	return surf;
 }
 
+gs_timer_t *device_timer_create(gs_device_t *device)
+{
+	gs_timer *timer = NULL;
+	try {
+		timer = new gs_timer(device);
+	} catch (HRError error) {
+		blog(LOG_ERROR, "device_timer_create (D3D11): %s (%08lX)",
+				error.str, error.hr);
+	}
+
+	return timer;
+}
+
+gs_timer_range_t *device_timer_range_create(gs_device_t *device)
+{
+	gs_timer_range *range = NULL;
+	try {
+		range = new gs_timer_range(device);
+	} catch (HRError error) {
+		blog(LOG_ERROR, "device_timer_range_create (D3D11): %s "
+		                "(%08lX)",
+				error.str, error.hr);
+	}
+
+	return range;
+}
+
 gs_samplerstate_t *device_samplerstate_create(gs_device_t *device,
 		const struct gs_sampler_info *info)
 {
@@ -1330,7 +1505,18 @@ void device_clear(gs_device_t *device, uint32_t clear_flags,
 void device_present(gs_device_t *device)
 {
 	if (device->curSwapChain) {
-		device->curSwapChain->swap->Present(0, 0);
+		gs_swap_chain *swap = device->curSwapChain;
+		UINT flags = 0;
+
+		/* with a waitable object, gs_swapchain_ready has already taken
+		 * a frame from it, so the present must go through: a frame
+		 * dropped with DXGI_ERROR_WAS_STILL_DRAWING would never give
+		 * it back.  without one, a flip model swap chain that is still
+		 * busy drops the frame instead of blocking */
+		if (swap->flip && !swap->frameLatencyWait)
+			flags = DXGI_PRESENT_DO_NOT_WAIT;
+
+		swap->swap->Present(0, flags);
 	} else {
 		blog(LOG_WARNING, "device_present (D3D11): No active swap");
 	}
@@ -1622,6 +1808,15 @@ void gs_swapchain_destroy(gs_swapchain_t *swapchain)
 	delete swapchain;
 }
 
+bool gs_swapchain_ready(gs_swapchain_t *swapchain)
+{
+	if (!swapchain->frameLatencyWait)
+		return true;
+
+	return WaitForSingleObject(swapchain->frameLatencyWait, 0) ==
+		WAIT_OBJECT_0;
+}
+
 void gs_texture_destroy(gs_texture_t *tex)
 {
 	delete tex;
@@ -1783,12 +1978,97 @@ bool gs_stagesurface_map(gs_stagesurf_t *stagesurf, uint8_t **data,
 	return true;
 }
 
+bool gs_stagesurface_try_map(gs_stagesurf_t *stagesurf, uint8_t **data,
+		uint32_t *linesize)
+{
+	D3D11_MAPPED_SUBRESOURCE map;
+	HRESULT hr;
+
+	hr = stagesurf->device->context->Map(stagesurf->texture, 0,
+			D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &map);
+	if (hr == DXGI_ERROR_WAS_STILL_DRAWING)
+		return false;
+	if (FAILED(hr))
+		return false;
+
+	*data = (uint8_t*)map.pData;
+	*linesize = map.RowPitch;
+	return true;
+}
+
 void gs_stagesurface_unmap(gs_stagesurf_t *stagesurf)
 {
 	stagesurf->device->context->Unmap(stagesurf->texture, 0);
 }
 
 
+void gs_timer_destroy(gs_timer_t *timer)
+{
+	delete timer;
+}
+
+void gs_timer_begin(gs_timer_t *timer)
+{
+	timer->device->context->End(timer->queryBegin);
+}
+
+void gs_timer_end(gs_timer_t *timer)
+{
+	timer->device->context->End(timer->queryEnd);
+}
+
+bool gs_timer_get_data(gs_timer_t *timer, uint64_t *ticks)
+{
+	ID3D11DeviceContext *context = timer->device->context;
+	UINT64 begin, end;
+	HRESULT hr;
+
+	hr = context->GetData(timer->queryBegin, &begin, sizeof(begin),
+			D3D11_ASYNC_GETDATA_DONOTFLUSH);
+	if (hr != S_OK)
+		return false;
+
+	hr = context->GetData(timer->queryEnd, &end, sizeof(end),
+			D3D11_ASYNC_GETDATA_DONOTFLUSH);
+	if (hr != S_OK)
+		return false;
+
+	*ticks = end > begin ? end - begin : 0;
+	return true;
+}
+
+void gs_timer_range_destroy(gs_timer_range_t *range)
+{
+	delete range;
+}
+
+void gs_timer_range_begin(gs_timer_range_t *range)
+{
+	range->device->context->Begin(range->queryDisjoint);
+}
+
+void gs_timer_range_end(gs_timer_range_t *range)
+{
+	range->device->context->End(range->queryDisjoint);
+}
+
+bool gs_timer_range_get_data(gs_timer_range_t *range, bool *disjoint,
+		uint64_t *frequency)
+{
+	D3D11_QUERY_DATA_TIMESTAMP_DISJOINT data;
+	HRESULT hr;
+
+	hr = range->device->context->GetData(range->queryDisjoint, &data,
+			sizeof(data), D3D11_ASYNC_GETDATA_DONOTFLUSH);
+	if (hr != S_OK)
+		return false;
+
+	*disjoint = !!data.Disjoint;
+	*frequency = data.Frequency;
+	return true;
+}
+
+
 void gs_zstencil_destroy(gs_zstencil_t *zstencil)
 {
 	delete zstencil;
@@ -1971,3 +2251,13 @@ extern "C" EXPORT gs_texture_t *device_texture_open_shared(gs_device_t *device,
 
 	return texture;
 }
+
+extern "C" EXPORT void gs_texture_update_shared(gs_texture_t *tex)
+{
+	if (tex->type != GS_TEXTURE_2D)
+		return;
+
+	gs_texture_2d *tex2d = static_cast<gs_texture_2d*>(tex);
+	if (tex2d->remoteTexture)
+		tex2d->UpdateCrossAdapter();
+}
@@ -26,6 +26,7 @@
 #include <windows.h>
 #include <dxgi.h>
 #include <dxgi1_2.h>
+#include <dxgi1_3.h>
 #include <d3d11.h>
 #include <d3dcompiler.h>
 
@@ -77,6 +78,7 @@ static inline DXGI_FORMAT ConvertGSTextureFormat(gs_color_format format)
 	case GS_DXT1:        return DXGI_FORMAT_BC1_UNORM;
 	case GS_DXT3:        return DXGI_FORMAT_BC2_UNORM;
 	case GS_DXT5:        return DXGI_FORMAT_BC3_UNORM;
+	case GS_R8G8:        return DXGI_FORMAT_R8G8_UNORM;
 	}
 
 	return DXGI_FORMAT_UNKNOWN;
@@ -102,6 +104,7 @@ static inline gs_color_format ConvertDXGITextureFormat(DXGI_FORMAT format)
 	case DXGI_FORMAT_BC1_UNORM:          return GS_DXT1;
 	case DXGI_FORMAT_BC2_UNORM:          return GS_DXT3;
 	case DXGI_FORMAT_BC3_UNORM:          return GS_DXT5;
+	case DXGI_FORMAT_R8G8_UNORM:         return GS_R8G8;
 	}
 
 	return GS_UNKNOWN;
@@ -290,6 +293,14 @@ struct gs_texture_2d : gs_texture {
 	bool            genMipmaps = false;
 	uint32_t        sharedHandle = 0;
 
+	/* shared textures that belong to another adapter are opened on a
+	 * device for that adapter and copied over through staging textures */
+	ComPtr<ID3D11DeviceContext>      remoteContext;
+	ComPtr<ID3D11Texture2D>          remoteTexture;
+	ComPtr<ID3D11Texture2D>          remoteStaging[2];
+	int                              remoteStagingIdx = 0;
+	bool                             remoteStagingReady = false;
+
 	void InitSRD(vector<D3D11_SUBRESOURCE_DATA> &srd, const uint8_t **data);
 	void InitTexture(const uint8_t **data);
 	void InitResourceView();
@@ -305,6 +316,9 @@ struct gs_texture_2d : gs_texture {
 			const uint8_t **data, uint32_t flags,
 			gs_texture_type type, bool gdiCompatible, bool shared);
 
+	void InitCrossAdapter(const D3D11_TEXTURE2D_DESC &desc);
+	void UpdateCrossAdapter();
+
 	gs_texture_2d(gs_device_t *device, uint32_t handle);
 };
 
@@ -343,6 +357,23 @@ struct gs_stage_surface {
 			gs_color_format colorFormat);
 };
 
+struct gs_timer {
+	ComPtr<ID3D11Query> queryBegin;
+	ComPtr<ID3D11Query> queryEnd;
+
+	gs_device           *device;
+
+	gs_timer(gs_device_t *device);
+};
+
+struct gs_timer_range {
+	ComPtr<ID3D11Query> queryDisjoint;
+
+	gs_device           *device;
+
+	gs_timer_range(gs_device_t *device);
+};
+
 struct gs_sampler_state {
 	ComPtr<ID3D11SamplerState> state;
 	gs_device_t                *device;
@@ -392,7 +423,7 @@ struct gs_shader {
 
 	void BuildConstantBuffer();
 	void Compile(const char *shaderStr, const char *file,
-			const char *target, ID3D10Blob **shader);
+			const char *target, vector<uint8_t> &data);
 
 	inline gs_shader(gs_device_t *device, gs_shader_type type)
 		: device       (device),
@@ -447,6 +478,7 @@ struct gs_duplicator {
 	ComPtr<IDXGIOutputDuplication> duplicator;
 	gs_texture_2d *texture;
 	gs_device_t *device;
+	vector<uint8_t> metadata;
 
 	gs_duplicator(gs_device_t *device, int monitor_idx);
 	~gs_duplicator();
@@ -478,10 +510,18 @@ struct gs_swap_chain {
 	gs_zstencil_buffer             zs;
 	ComPtr<IDXGISwapChain>         swap;
 
+	/* flip model swap chains signal frameLatencyWait once they can take
+	 * another frame, and are presented without waiting when they don't
+	 * have one */
+	bool                           flip = false;
+	UINT                           swapFlags = 0;
+	HANDLE                         frameLatencyWait = NULL;
+
 	void InitTarget(uint32_t cx, uint32_t cy);
 	void InitZStencilBuffer(uint32_t cx, uint32_t cy);
 	void Resize(uint32_t cx, uint32_t cy);
 	void Init(const gs_init_data *data);
+	bool CreateFlipSwapChain(const gs_init_data *data);
 
 	inline gs_swap_chain()
 		: device     (NULL),
@@ -491,6 +531,7 @@ struct gs_swap_chain {
 	}
 
 	gs_swap_chain(gs_device *device, const gs_init_data *data);
+	~gs_swap_chain();
 };
 
 struct BlendState {
@@ -610,10 +651,18 @@ struct mat4float {
 	float mat[16];
 };
 
+struct gs_adapter_device {
+	LUID                        luid;
+	ComPtr<ID3D11Device>        device;
+	ComPtr<ID3D11DeviceContext> context;
+};
+
 struct gs_device {
 	ComPtr<IDXGIFactory1>       factory;
 	ComPtr<ID3D11Device>        device;
 	ComPtr<ID3D11DeviceContext> context;
+	LUID                        adapterLuid = {};
+	vector<gs_adapter_device>   adapterDevices;
 
 	gs_texture_2d               *curRenderTarget = nullptr;
 	gs_zstencil_buffer          *curZStencilBuffer = nullptr;
@@ -641,6 +690,8 @@ struct gs_device {
 	D3D11_PRIMITIVE_TOPOLOGY    curToplogy;
 
 	pD3DCompile                 d3dCompile = nullptr;
+	int                         d3dCompilerVer = 0;
+	string                      shaderCachePath;
 
 	gs_rect                     viewport;
 
@@ -654,6 +705,9 @@ struct gs_device {
 	void InitFactory(uint32_t adapterIdx, IDXGIAdapter1 **adapter);
 	void InitDevice(uint32_t adapterIdx, IDXGIAdapter *adapter);
 
+	gs_adapter_device *OpenSharedOnAdapter(uint32_t handle,
+			ID3D11Texture2D **texture);
+
 	ID3D11DepthStencilState *AddZStencilState();
 	ID3D11RasterizerState   *AddRasterState();
 	ID3D11BlendState        *AddBlendState();
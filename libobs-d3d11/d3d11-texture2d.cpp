@@ -18,32 +18,47 @@
 #include <util/base.h>
 #include "d3d11-subsystem.hpp"
 
+/* rows of compressed formats are rows of 4x4 blocks, and every level is
+ * sized from the level above so textures needn't be a power of two */
+static inline uint32_t RowPitch(gs_color_format format, uint32_t width)
+{
+	uint32_t bpp = gs_get_format_bpp(format);
+
+	if (gs_is_compressed_format(format))
+		return (width + 3) / 4 * bpp * 2;
+	return width * bpp / 8;
+}
+
+static inline uint32_t RowCount(gs_color_format format, uint32_t height)
+{
+	return gs_is_compressed_format(format) ? (height + 3) / 4 : height;
+}
+
 void gs_texture_2d::InitSRD(vector<D3D11_SUBRESOURCE_DATA> &srd,
 		const uint8_t **data)
 {
-	uint32_t rowSizeBytes  = width  * gs_get_format_bpp(format);
-	uint32_t texSizeBytes  = height * rowSizeBytes / 8;
 	size_t   textures      = type == GS_TEXTURE_2D ? 1 : 6;
 	uint32_t actual_levels = levels;
 
 	if (!actual_levels)
 		actual_levels = gs_get_total_levels(width, height);
 
-	rowSizeBytes /= 8;
-
 	for (size_t i = 0; i < textures; i++) {
-		uint32_t newRowSize = rowSizeBytes;
-		uint32_t newTexSize = texSizeBytes;
+		uint32_t levelWidth  = width;
+		uint32_t levelHeight = height;
 
 		for (uint32_t j = 0; j < actual_levels; j++) {
+			uint32_t rowSize = RowPitch(format, levelWidth);
+
 			D3D11_SUBRESOURCE_DATA newSRD;
 			newSRD.pSysMem          = *data;
-			newSRD.SysMemPitch      = newRowSize;
-			newSRD.SysMemSlicePitch = newTexSize;
+			newSRD.SysMemPitch      = rowSize;
+			newSRD.SysMemSlicePitch = rowSize *
+				RowCount(format, levelHeight);
 			srd.push_back(newSRD);
 
-			newRowSize /= 2;
-			newTexSize /= 4;
+			if (levelWidth  > 1) levelWidth  /= 2;
+			if (levelHeight > 1) levelHeight /= 2;
 			data++;
 		}
 	}
@@ -97,15 +112,18 @@ void gs_texture_2d::InitResourceView()
 	D3D11_SHADER_RESOURCE_VIEW_DESC resourceDesc;
 	HRESULT hr;
 
+	/* uploaded mipmap chains are sampled just like generated ones */
+	UINT mipLevels = (genMipmaps || levels != 1) ? (UINT)-1 : 1;
+
 	memset(&resourceDesc, 0, sizeof(resourceDesc));
 	resourceDesc.Format = dxgiFormat;
 
 	if (type == GS_TEXTURE_CUBE) {
 		resourceDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
-		resourceDesc.TextureCube.MipLevels = genMipmaps ? -1 : 1;
+		resourceDesc.TextureCube.MipLevels = mipLevels;
 	} else {
 		resourceDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-		resourceDesc.Texture2D.MipLevels = genMipmaps ? -1 : 1;
+		resourceDesc.Texture2D.MipLevels = mipLevels;
 	}
 
 	hr = device->device->CreateShaderResourceView(texture, &resourceDesc,
@@ -166,14 +184,23 @@ gs_texture_2d::gs_texture_2d(gs_device_t *device, uint32_t handle)
 	: isShared        (true),
 	  sharedHandle    (handle)
 {
+	D3D11_TEXTURE2D_DESC desc;
 	HRESULT hr;
+
 	hr = device->device->OpenSharedResource((HANDLE)(uintptr_t)handle,
 			__uuidof(ID3D11Texture2D), (void**)texture.Assign());
-	if (FAILED(hr))
-		throw HRError("Failed to open resource", hr);
-
-	D3D11_TEXTURE2D_DESC desc;
-	texture->GetDesc(&desc);
+	if (FAILED(hr)) {
+		gs_adapter_device *adapterDevice = device->OpenSharedOnAdapter(
+				handle, remoteTexture.Assign());
+		if (!adapterDevice)
+			throw HRError("Failed to open resource", hr);
+
+		remoteContext = adapterDevice->context;
+		remoteTexture->GetDesc(&desc);
+		InitCrossAdapter(desc);
+	} else {
+		texture->GetDesc(&desc);
+	}
 
 	this->type       = GS_TEXTURE_2D;
 	this->format     = ConvertDXGITextureFormat(desc.Format);
@@ -194,3 +221,66 @@ gs_texture_2d::gs_texture_2d(gs_device_t *device, uint32_t handle)
 	if (FAILED(hr))
 		throw HRError("Failed to create shader resource view", hr);
 }
+
+/* creates a local copy of a shared texture that lives on another adapter,
+ * along with the staging textures used to bring its contents over */
+void gs_texture_2d::InitCrossAdapter(const D3D11_TEXTURE2D_DESC &desc)
+{
+	D3D11_TEXTURE2D_DESC td = {};
+	ComPtr<ID3D11Device> remoteDevice;
+	HRESULT hr;
+
+	td.Width            = desc.Width;
+	td.Height           = desc.Height;
+	td.MipLevels        = 1;
+	td.ArraySize        = 1;
+	td.Format           = desc.Format;
+	td.SampleDesc.Count = 1;
+	td.Usage            = D3D11_USAGE_DEFAULT;
+	td.BindFlags        = D3D11_BIND_SHADER_RESOURCE;
+
+	hr = device->device->CreateTexture2D(&td, nullptr, texture.Assign());
+	if (FAILED(hr))
+		throw HRError("Failed to create cross-adapter texture", hr);
+
+	td.Usage            = D3D11_USAGE_STAGING;
+	td.BindFlags        = 0;
+	td.CPUAccessFlags   = D3D11_CPU_ACCESS_READ;
+
+	remoteTexture->GetDevice(remoteDevice.Assign());
+
+	for (size_t i = 0; i < 2; i++) {
+		hr = remoteDevice->CreateTexture2D(&td, nullptr,
+				remoteStaging[i].Assign());
+		if (FAILED(hr))
+			throw HRError("Failed to create cross-adapter staging "
+			              "texture", hr);
+	}
+
+	blog(LOG_INFO, "gs_texture_open_shared: shared texture belongs to "
+	               "another adapter, copying through system memory");
+}
+
+/* the copy into a staging texture is read back on the next update rather
+ * than right away, so neither GPU has to wait on the other */
+void gs_texture_2d::UpdateCrossAdapter()
+{
+	D3D11_MAPPED_SUBRESOURCE map;
+	int prev = remoteStagingIdx ^ 1;
+
+	remoteContext->CopyResource(remoteStaging[remoteStagingIdx],
+			remoteTexture);
+
+	if (remoteStagingReady) {
+		HRESULT hr = remoteContext->Map(remoteStaging[prev], 0,
+				D3D11_MAP_READ, 0, &map);
+		if (SUCCEEDED(hr)) {
+			device->context->UpdateSubresource(texture, 0, nullptr,
+					map.pData, map.RowPitch, 0);
+			remoteContext->Unmap(remoteStaging[prev], 0);
+		}
+	}
+
+	remoteStagingIdx   = prev;
+	remoteStagingReady = true;
+}
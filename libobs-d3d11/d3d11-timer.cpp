@@ -0,0 +1,46 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "d3d11-subsystem.hpp"
+
+static void CreateQuery(gs_device_t *device, D3D11_QUERY type,
+		ID3D11Query **query)
+{
+	D3D11_QUERY_DESC qd;
+	HRESULT hr;
+
+	memset(&qd, 0, sizeof(qd));
+	qd.Query = type;
+
+	hr = device->device->CreateQuery(&qd, query);
+	if (FAILED(hr))
+		throw HRError("Failed to create query", hr);
+}
+
+gs_timer::gs_timer(gs_device_t *device)
+	: device (device)
+{
+	CreateQuery(device, D3D11_QUERY_TIMESTAMP, queryBegin.Assign());
+	CreateQuery(device, D3D11_QUERY_TIMESTAMP, queryEnd.Assign());
+}
+
+gs_timer_range::gs_timer_range(gs_device_t *device)
+	: device (device)
+{
+	CreateQuery(device, D3D11_QUERY_TIMESTAMP_DISJOINT,
+			queryDisjoint.Assign());
+}
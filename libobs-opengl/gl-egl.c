@@ -0,0 +1,305 @@
+/******************************************************************************
+    Copyright (C) 2016 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/* Headless EGL backend.  The context is created without any window system
+ * and made current without a surface (EGL_KHR_surfaceless_context), so all
+ * rendering goes to textures.  Swap chains are not supported, which is fine
+ * for libobs in headless mode where no displays are created.
+ *
+ * The adapter index selects an EGL device when EGL_EXT_device_enumeration
+ * is available, otherwise the Mesa surfaceless platform or the default
+ * display is used. */
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <string.h>
+
+#include "gl-subsystem.h"
+
+static const EGLint ctx_attribs[] = {
+#ifdef _DEBUG
+	EGL_CONTEXT_FLAGS_KHR, EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR,
+#endif
+	EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR,
+	EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+	EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+	EGL_CONTEXT_MINOR_VERSION_KHR, 2,
+	EGL_NONE
+};
+
+static const EGLint config_attribs[] = {
+	EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+	EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+	EGL_RED_SIZE, 8,
+	EGL_GREEN_SIZE, 8,
+	EGL_BLUE_SIZE, 8,
+	EGL_ALPHA_SIZE, 8,
+	EGL_NONE
+};
+
+struct gl_windowinfo {
+	int unused;
+};
+
+struct gl_platform {
+	EGLDisplay display;
+	EGLContext context;
+};
+
+static inline bool has_extension(const char *extensions, const char *name)
+{
+	size_t len = strlen(name);
+	const char *pos = extensions;
+
+	while (pos && (pos = strstr(pos, name)) != NULL) {
+		if ((pos == extensions || pos[-1] == ' ') &&
+		    (pos[len] == ' ' || pos[len] == 0))
+			return true;
+		pos += len;
+	}
+
+	return false;
+}
+
+static EGLDisplay get_device_display(uint32_t adapter)
+{
+	PFNEGLQUERYDEVICESEXTPROC query_devices;
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display;
+	EGLDeviceEXT devices[16];
+	EGLint num_devices = 0;
+
+	query_devices = (PFNEGLQUERYDEVICESEXTPROC)
+		eglGetProcAddress("eglQueryDevicesEXT");
+	get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+		eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (!query_devices || !get_platform_display)
+		return EGL_NO_DISPLAY;
+
+	if (!query_devices(16, devices, &num_devices) ||
+	    adapter >= (uint32_t)num_devices)
+		return EGL_NO_DISPLAY;
+
+	return get_platform_display(EGL_PLATFORM_DEVICE_EXT,
+			devices[adapter], NULL);
+}
+
+static EGLDisplay get_surfaceless_display(void)
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display;
+
+	get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+		eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (!get_platform_display)
+		return EGL_NO_DISPLAY;
+
+	return get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+			EGL_DEFAULT_DISPLAY, NULL);
+}
+
+static EGLDisplay open_headless_display(uint32_t adapter)
+{
+	const char *client_exts = eglQueryString(EGL_NO_DISPLAY,
+			EGL_EXTENSIONS);
+	EGLDisplay display = EGL_NO_DISPLAY;
+	EGLint major, minor;
+
+	if (has_extension(client_exts, "EGL_EXT_device_enumeration") &&
+	    has_extension(client_exts, "EGL_EXT_platform_device"))
+		display = get_device_display(adapter);
+
+	if (display == EGL_NO_DISPLAY &&
+	    has_extension(client_exts, "EGL_MESA_platform_surfaceless"))
+		display = get_surfaceless_display();
+
+	if (display == EGL_NO_DISPLAY)
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	if (display == EGL_NO_DISPLAY) {
+		blog(LOG_ERROR, "Unable to get an EGL display");
+		return EGL_NO_DISPLAY;
+	}
+
+	if (!eglInitialize(display, &major, &minor)) {
+		blog(LOG_ERROR, "Unable to initialize EGL: 0x%X",
+				eglGetError());
+		return EGL_NO_DISPLAY;
+	}
+
+	blog(LOG_INFO, "EGL version: %d.%d (%s)", major, minor,
+			eglQueryString(display, EGL_VENDOR));
+	return display;
+}
+
+static bool gl_context_create(struct gl_platform *plat)
+{
+	const char *exts = eglQueryString(plat->display, EGL_EXTENSIONS);
+	EGLConfig config;
+	EGLint num_configs = 0;
+
+	if (!has_extension(exts, "EGL_KHR_create_context")) {
+		blog(LOG_ERROR, "EGL_KHR_create_context not supported!");
+		return false;
+	}
+	if (!has_extension(exts, "EGL_KHR_surfaceless_context")) {
+		blog(LOG_ERROR, "EGL_KHR_surfaceless_context not supported!");
+		return false;
+	}
+
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		blog(LOG_ERROR, "Failed to bind the OpenGL API");
+		return false;
+	}
+
+	if (!eglChooseConfig(plat->display, config_attribs, &config, 1,
+				&num_configs) || !num_configs) {
+		blog(LOG_ERROR, "Failed to find an EGL config");
+		return false;
+	}
+
+	plat->context = eglCreateContext(plat->display, config,
+			EGL_NO_CONTEXT, ctx_attribs);
+	if (plat->context == EGL_NO_CONTEXT) {
+		blog(LOG_ERROR, "Failed to create OpenGL context: 0x%X",
+				eglGetError());
+		return false;
+	}
+
+	return true;
+}
+
+static void *get_proc_address(const char *name)
+{
+	return (void*)eglGetProcAddress(name);
+}
+
+extern struct gl_windowinfo *gl_windowinfo_create(
+		const struct gs_init_data *info)
+{
+	UNUSED_PARAMETER(info);
+	blog(LOG_ERROR, "Swap chains are not supported by the headless EGL "
+	                "backend");
+	return NULL;
+}
+
+extern void gl_windowinfo_destroy(struct gl_windowinfo *info)
+{
+	bfree(info);
+}
+
+extern struct gl_platform *gl_platform_create(gs_device_t *device,
+		uint32_t adapter)
+{
+	struct gl_platform *plat = bzalloc(sizeof(struct gl_platform));
+
+	plat->display = open_headless_display(adapter);
+	if (plat->display == EGL_NO_DISPLAY)
+		goto fail_display;
+
+	if (!gl_context_create(plat))
+		goto fail_context;
+
+	if (!eglMakeCurrent(plat->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+				plat->context)) {
+		blog(LOG_ERROR, "Failed to make context current.");
+		goto fail_make_current;
+	}
+
+	gladLoadGLLoader(get_proc_address);
+	if (!GLVersion.major) {
+		blog(LOG_ERROR, "Failed to load OpenGL entry functions.");
+		goto fail_make_current;
+	}
+
+	blog(LOG_INFO, "OpenGL version: %s", glGetString(GL_VERSION));
+
+	device->plat = plat;
+	return plat;
+
+fail_make_current:
+	eglMakeCurrent(plat->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+			EGL_NO_CONTEXT);
+	eglDestroyContext(plat->display, plat->context);
+fail_context:
+	eglTerminate(plat->display);
+fail_display:
+	bfree(plat);
+	return NULL;
+}
+
+extern void gl_platform_destroy(struct gl_platform *plat)
+{
+	if (!plat)
+		return;
+
+	eglMakeCurrent(plat->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+			EGL_NO_CONTEXT);
+	eglDestroyContext(plat->display, plat->context);
+	eglTerminate(plat->display);
+	bfree(plat);
+}
+
+extern bool gl_platform_init_swapchain(struct gs_swap_chain *swap)
+{
+	UNUSED_PARAMETER(swap);
+	return false;
+}
+
+extern void gl_platform_cleanup_swapchain(struct gs_swap_chain *swap)
+{
+	UNUSED_PARAMETER(swap);
+}
+
+extern void device_enter_context(gs_device_t *device)
+{
+	struct gl_platform *plat = device->plat;
+
+	if (!eglMakeCurrent(plat->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+				plat->context))
+		blog(LOG_ERROR, "Failed to make context current.");
+}
+
+extern void device_leave_context(gs_device_t *device)
+{
+	struct gl_platform *plat = device->plat;
+
+	if (!eglMakeCurrent(plat->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+				EGL_NO_CONTEXT))
+		blog(LOG_ERROR, "Failed to reset current context.");
+}
+
+extern void gl_getclientsize(const struct gs_swap_chain *swap,
+			     uint32_t *width, uint32_t *height)
+{
+	*width  = swap->info.cx;
+	*height = swap->info.cy;
+}
+
+extern void gl_update(gs_device_t *device)
+{
+	UNUSED_PARAMETER(device);
+}
+
+extern void device_load_swapchain(gs_device_t *device, gs_swapchain_t *swap)
+{
+	device->cur_swap = swap;
+}
+
+extern void device_present(gs_device_t *device)
+{
+	UNUSED_PARAMETER(device);
+}
@@ -26,6 +26,13 @@ bool gl_init_face(GLenum target, GLenum type, uint32_t num_levels,
 	const uint8_t **data = p_data ? *p_data : NULL;
 	uint32_t i;
 
+	/* size the smaller levels from the units of the first one, so the
+	 * chain doesn't have to be a power of two.  compressed formats are
+	 * stored in 4x4 blocks */
+	uint32_t units = compressed ?
+		((width + 3) / 4) * ((height + 3) / 4) : width * height;
+	uint32_t unit_size = units ? size / units : 0;
+
 	for (i = 0; i < num_levels; i++) {
 		if (compressed) {
 			glCompressedTexImage2D(target, i, internal_format,
@@ -44,12 +51,15 @@ bool gl_init_face(GLenum target, GLenum type, uint32_t num_levels,
 		if (data)
 			data++;
 
-		size   /= 4;
 		width  /= 2;
 		height /= 2;
 
 		if (width  == 0) width  = 1;
 		if (height == 0) height = 1;
+
+		size = compressed ?
+			((width + 3) / 4) * ((height + 3) / 4) * unit_size :
+			width * height * unit_size;
 	}
 
 	if (data)
@@ -148,6 +158,30 @@ bool gl_create_buffer(GLenum target, GLuint *buffer, GLsizeiptr size,
 	return success;
 }
 
+bool gl_create_persistent_buffer(GLenum target, GLuint *buffer,
+		GLsizeiptr size, void **ptr)
+{
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+		GL_MAP_COHERENT_BIT;
+	bool success;
+
+	if (!gl_gen_buffers(1, buffer))
+		return false;
+	if (!gl_bind_buffer(target, *buffer))
+		return false;
+
+	glBufferStorage(target, size, NULL, flags);
+	success = gl_success("glBufferStorage");
+
+	if (success) {
+		*ptr = glMapBufferRange(target, 0, size, flags);
+		success = gl_success("glMapBufferRange") && *ptr;
+	}
+
+	gl_bind_buffer(target, 0);
+	return success;
+}
+
 bool update_buffer(GLenum target, GLuint buffer, void *data, size_t size)
 {
 	void *ptr;
@@ -159,3 +159,33 @@ extern bool gl_create_buffer(GLenum target, GLuint *buffer, GLsizeiptr size,
 
 extern bool update_buffer(GLenum target, GLuint buffer, void *data,
 		size_t size);
+
+/* requires ARB_buffer_storage, the buffer stays mapped until deleted */
+extern bool gl_create_persistent_buffer(GLenum target, GLuint *buffer,
+		GLsizeiptr size, void **ptr);
+
+static inline bool gl_wait_fence(GLsync *fence)
+{
+	GLenum ret;
+
+	if (!*fence)
+		return true;
+
+	ret = glClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+			1000000000ULL);
+	glDeleteSync(*fence);
+	*fence = NULL;
+
+	if (ret == GL_TIMEOUT_EXPIRED)
+		blog(LOG_WARNING, "gl_wait_fence: timed out");
+	return gl_success("glClientWaitSync") && ret != GL_WAIT_FAILED;
+}
+
+static inline void gl_delete_fence(GLsync *fence)
+{
+	if (*fence) {
+		glDeleteSync(*fence);
+		gl_success("glDeleteSync");
+		*fence = NULL;
+	}
+}
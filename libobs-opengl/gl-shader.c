@@ -16,12 +16,15 @@
 ******************************************************************************/
 
 #include <assert.h>
+#include <stdio.h>
 
 #include <graphics/vec2.h>
 #include <graphics/vec3.h>
 #include <graphics/vec4.h>
 #include <graphics/matrix3.h>
 #include <graphics/matrix4.h>
+#include <util/crc32.h>
+#include <util/platform.h>
 #include "gl-subsystem.h"
 #include "gl-shaderparser.h"
 
@@ -225,6 +228,9 @@ static bool gl_shader_init(struct gs_shader *shader,
 
 	gl_get_shader_info(shader->obj, file, error_string);
 
+	if (success && shader->device->shader_cache_path)
+		shader->source = bstrdup(glsp->gl_string.array);
+
 	if (success)
 		success = gl_add_params(shader, glsp);
 	/* Only vertex shaders actually require input attributes */
@@ -335,6 +341,7 @@ void gs_shader_destroy(gs_shader_t *shader)
 	da_free(shader->samplers);
 	da_free(shader->params);
 	da_free(shader->attribs);
+	bfree(shader->source);
 	bfree(shader);
 }
 
@@ -590,27 +597,170 @@ static inline bool assign_program_params(struct gs_program *program)
 	return true;
 }
 
-struct gs_program *gs_program_create(struct gs_device *device)
+/*
+ * Linked program binaries are cached on disk by the GLSL of both shaders and
+ * a hash of the driver strings.  The file stores both sources as well, so a
+ * CRC collision can never load the wrong program.
+ */
+
+#define PROGRAM_CACHE_MAGIC 0x43534C47 /* "GLSC" */
+
+struct program_cache_header {
+	uint32_t magic;
+	uint32_t driver_hash;
+	uint32_t binary_format;
+	uint32_t vertex_size;
+	uint32_t pixel_size;
+	uint32_t binary_size;
+};
+
+static inline bool program_cacheable(const struct gs_program *program)
 {
-	struct gs_program *program = bzalloc(sizeof(*program));
-	int linked = false;
+	return program->device->shader_cache_path &&
+		program->vertex_shader->source &&
+		program->pixel_shader->source;
+}
 
-	program->device        = device;
-	program->vertex_shader = device->cur_vertex_shader;
-	program->pixel_shader  = device->cur_pixel_shader;
+static char *get_program_cache_file(const struct gs_program *program)
+{
+	const char *vs = program->vertex_shader->source;
+	const char *ps = program->pixel_shader->source;
+	struct dstr path = {0};
+	uint32_t crc;
 
-	program->obj = glCreateProgram();
-	if (!gl_success("glCreateProgram"))
-		goto error_detach_neither;
+	crc = calc_crc32(0, vs, strlen(vs));
+	crc = calc_crc32(crc, ps, strlen(ps));
+
+	dstr_printf(&path, "%s/gl-%08X.bin",
+			program->device->shader_cache_path, crc);
+	return path.array;
+}
+
+static bool read_matching_source(FILE *f, const char *source, size_t size)
+{
+	char *cached = bmalloc(size);
+	bool match = fread(cached, 1, size, f) == size &&
+		memcmp(cached, source, size) == 0;
+
+	bfree(cached);
+	return match;
+}
+
+static bool load_program_binary(struct gs_program *program, const char *file)
+{
+	const char *vs = program->vertex_shader->source;
+	const char *ps = program->pixel_shader->source;
+	struct program_cache_header header;
+	uint8_t *binary = NULL;
+	int linked = GL_FALSE;
+	FILE *f;
+
+	f = os_fopen(file, "rb");
+	if (!f)
+		return false;
+
+	if (fread(&header, sizeof(header), 1, f) != 1 ||
+	    header.magic       != PROGRAM_CACHE_MAGIC ||
+	    header.driver_hash != program->device->driver_hash ||
+	    header.vertex_size != strlen(vs) ||
+	    header.pixel_size  != strlen(ps) ||
+	    !header.binary_size)
+		goto finish;
+
+	if (!read_matching_source(f, vs, header.vertex_size) ||
+	    !read_matching_source(f, ps, header.pixel_size))
+		goto finish;
+
+	binary = bmalloc(header.binary_size);
+	if (fread(binary, 1, header.binary_size, f) != header.binary_size)
+		goto finish;
+
+	glProgramBinary(program->obj, header.binary_format, binary,
+			header.binary_size);
+	if (!gl_success("glProgramBinary"))
+		goto finish;
+
+	/* drivers reject binaries after updates they don't report in their
+	 * version string, the program is just linked normally then */
+	glGetProgramiv(program->obj, GL_LINK_STATUS, &linked);
+	if (!gl_success("glGetProgramiv"))
+		linked = GL_FALSE;
+
+finish:
+	bfree(binary);
+	fclose(f);
+	return linked != GL_FALSE;
+}
+
+static void save_program_binary(struct gs_program *program, const char *file)
+{
+	const char *vs = program->vertex_shader->source;
+	const char *ps = program->pixel_shader->source;
+	struct program_cache_header header;
+	struct dstr temp_file = {0};
+	GLint size = 0;
+	GLenum format = 0;
+	uint8_t *binary;
+	bool success;
+	FILE *f;
+
+	glGetProgramiv(program->obj, GL_PROGRAM_BINARY_LENGTH, &size);
+	if (!gl_success("glGetProgramiv") || size <= 0)
+		return;
+
+	binary = bmalloc(size);
+	glGetProgramBinary(program->obj, size, &size, &format, binary);
+	if (!gl_success("glGetProgramBinary") || size <= 0) {
+		bfree(binary);
+		return;
+	}
+
+	header.magic         = PROGRAM_CACHE_MAGIC;
+	header.driver_hash   = program->device->driver_hash;
+	header.binary_format = (uint32_t)format;
+	header.vertex_size   = (uint32_t)strlen(vs);
+	header.pixel_size    = (uint32_t)strlen(ps);
+	header.binary_size   = (uint32_t)size;
+
+	dstr_printf(&temp_file, "%s.tmp", file);
+
+	f = os_fopen(temp_file.array, "wb");
+	if (f) {
+		success = fwrite(&header, sizeof(header), 1, f) == 1 &&
+			fwrite(vs, 1, header.vertex_size, f) ==
+				header.vertex_size &&
+			fwrite(ps, 1, header.pixel_size, f) ==
+				header.pixel_size &&
+			fwrite(binary, 1, header.binary_size, f) ==
+				header.binary_size;
+		fclose(f);
+
+		if (!success || os_rename(temp_file.array, file) != 0)
+			os_unlink(temp_file.array);
+	}
+
+	dstr_free(&temp_file);
+	bfree(binary);
+}
+
+static bool link_program(struct gs_program *program)
+{
+	int linked = false;
 
 	glAttachShader(program->obj, program->vertex_shader->obj);
 	if (!gl_success("glAttachShader (vertex)"))
-		goto error_detach_neither;
+		return false;
 
 	glAttachShader(program->obj, program->pixel_shader->obj);
 	if (!gl_success("glAttachShader (pixel)"))
 		goto error_detach_vertex;
 
+	if (program_cacheable(program)) {
+		glProgramParameteri(program->obj,
+				GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		gl_success("glProgramParameteri");
+	}
+
 	glLinkProgram(program->obj);
 	if (!gl_success("glLinkProgram"))
 		goto error;
@@ -624,24 +774,13 @@ struct gs_program *gs_program_create(struct gs_device *device)
 		goto error;
 	}
 
-	if (!assign_program_attribs(program))
-		goto error;
-	if (!assign_program_params(program))
-		goto error;
-
 	glDetachShader(program->obj, program->vertex_shader->obj);
 	gl_success("glDetachShader (vertex)");
 
 	glDetachShader(program->obj, program->pixel_shader->obj);
 	gl_success("glDetachShader (pixel)");
 
-	program->next = device->first_program;
-	program->prev_next = &device->first_program;
-	device->first_program = program;
-	if (program->next)
-		program->next->prev_next = &program->next;
-
-	return program;
+	return true;
 
 error:
 	glDetachShader(program->obj, program->pixel_shader->obj);
@@ -650,8 +789,48 @@ error:
 error_detach_vertex:
 	glDetachShader(program->obj, program->vertex_shader->obj);
 	gl_success("glDetachShader (vertex)");
+	return false;
+}
+
+struct gs_program *gs_program_create(struct gs_device *device)
+{
+	struct gs_program *program = bzalloc(sizeof(*program));
+	char *cache_file = NULL;
+
+	program->device        = device;
+	program->vertex_shader = device->cur_vertex_shader;
+	program->pixel_shader  = device->cur_pixel_shader;
+
+	program->obj = glCreateProgram();
+	if (!gl_success("glCreateProgram"))
+		goto error;
+
+	if (program_cacheable(program))
+		cache_file = get_program_cache_file(program);
+
+	if (!cache_file || !load_program_binary(program, cache_file)) {
+		if (!link_program(program))
+			goto error;
+		if (cache_file)
+			save_program_binary(program, cache_file);
+	}
+
+	if (!assign_program_attribs(program))
+		goto error;
+	if (!assign_program_params(program))
+		goto error;
 
-error_detach_neither:
+	program->next = device->first_program;
+	program->prev_next = &device->first_program;
+	device->first_program = program;
+	if (program->next)
+		program->next->prev_next = &program->next;
+
+	bfree(cache_file);
+	return program;
+
+error:
+	bfree(cache_file);
 	gs_program_destroy(program);
 	return NULL;
 }
@@ -17,6 +17,13 @@
 
 #include "gl-subsystem.h"
 
+/* rows are packed with the default GL_PACK_ALIGNMENT of 4 */
+static inline uint32_t get_linesize(const struct gs_stage_surface *surf)
+{
+	uint32_t linesize = surf->width * surf->bytes_per_pixel;
+	return (linesize + 3) & 0xFFFFFFFC;
+}
+
 static bool create_pixel_pack_buffer(struct gs_stage_surface *surf)
 {
 	GLsizeiptr size;
@@ -28,9 +35,7 @@ static bool create_pixel_pack_buffer(struct gs_stage_surface *surf)
 	if (!gl_bind_buffer(GL_PIXEL_PACK_BUFFER, surf->pack_buffer))
 		return false;
 
-	size  = surf->width * surf->bytes_per_pixel;
-	size  = (size+3) & 0xFFFFFFFC; /* align width to 4-byte boundry */
-	size *= surf->height;
+	size  = (GLsizeiptr)get_linesize(surf) * surf->height;
 
 	glBufferData(GL_PIXEL_PACK_BUFFER, size, 0, GL_DYNAMIC_READ);
 	if (!gl_success("glBufferData"))
@@ -71,6 +76,8 @@ void gs_stagesurface_destroy(gs_stagesurf_t *stagesurf)
 		if (stagesurf->pack_buffer)
 			gl_delete_buffers(1, &stagesurf->pack_buffer);
 
+		gl_delete_fence(&stagesurf->fence);
+
 		bfree(stagesurf);
 	}
 }
@@ -106,6 +113,16 @@ static bool can_stage(struct gs_stage_surface *dst, struct gs_texture_2d *src)
 	return true;
 }
 
+static inline void fence_staged_copy(struct gs_stage_surface *dst)
+{
+	gl_delete_fence(&dst->fence);
+
+	if (dst->device->fences) {
+		dst->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		gl_success("glFenceSync");
+	}
+}
+
 #ifdef __APPLE__
 
 /* Apparently for mac, PBOs won't do an asynchronous transfer unless you use
@@ -141,6 +158,7 @@ void device_stage_texture(gs_device_t *device, gs_stagesurf_t *dst,
 	if (!gl_success("glReadPixels"))
 		goto failed_unbind_all;
 
+	fence_staged_copy(dst);
 	success = true;
 
 failed_unbind_all:
@@ -172,6 +190,8 @@ void device_stage_texture(gs_device_t *device, gs_stagesurf_t *dst,
 	if (!gl_success("glGetTexImage"))
 		goto failed;
 
+	fence_staged_copy(dst);
+
 	gl_bind_texture(GL_TEXTURE_2D, 0);
 	gl_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
 	return;
@@ -213,8 +233,9 @@ bool gs_stagesurface_map(gs_stagesurf_t *stagesurf, uint8_t **data,
 		goto fail;
 
 	gl_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+	gl_delete_fence(&stagesurf->fence);
 
-	*linesize = stagesurf->bytes_per_pixel * stagesurf->width;
+	*linesize = get_linesize(stagesurf);
 	return true;
 
 fail:
@@ -222,6 +243,21 @@ fail:
 	return false;
 }
 
+bool gs_stagesurface_try_map(gs_stagesurf_t *stagesurf, uint8_t **data,
+		uint32_t *linesize)
+{
+	if (stagesurf->fence) {
+		GLenum ret = glClientWaitSync(stagesurf->fence,
+				GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (!gl_success("glClientWaitSync"))
+			return false;
+		if (ret == GL_TIMEOUT_EXPIRED)
+			return false;
+	}
+
+	return gs_stagesurface_map(stagesurf, data, linesize);
+}
+
 void gs_stagesurface_unmap(gs_stagesurf_t *stagesurf)
 {
 	if (!gl_bind_buffer(GL_PIXEL_PACK_BUFFER, stagesurf->pack_buffer))
@@ -16,6 +16,7 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+#include <util/crc32.h>
 #include <graphics/matrix3.h>
 #include "gl-subsystem.h"
 
@@ -142,6 +143,12 @@ static bool gl_init_extensions(struct gs_device* device)
 	else
 		device->copy_type = COPY_TYPE_FBO_BLIT;
 
+	device->fences = GLAD_GL_VERSION_3_2 || GLAD_GL_ARB_sync;
+	device->buffer_storage = device->fences &&
+		(GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage);
+	device->timer_queries = GLAD_GL_VERSION_3_3 ||
+		GLAD_GL_ARB_timer_query;
+
 	return true;
 }
 
@@ -246,10 +253,39 @@ void device_destroy(gs_device_t *device)
 		da_free(device->proj_stack);
 		da_free(device->fbos);
 		gl_platform_destroy(device->plat);
+		bfree(device->shader_cache_path);
 		bfree(device);
 	}
 }
 
+static inline uint32_t hash_gl_string(uint32_t crc, GLenum name)
+{
+	const char *str = (const char*)glGetString(name);
+	return str ? calc_crc32(crc, str, strlen(str)) : crc;
+}
+
+void device_set_shader_cache_path(gs_device_t *device, const char *path)
+{
+	GLint num_formats = 0;
+
+	bfree(device->shader_cache_path);
+	device->shader_cache_path = NULL;
+
+	if (!path || !*path)
+		return;
+	if (!GLAD_GL_VERSION_4_1 && !GLAD_GL_ARB_get_program_binary)
+		return;
+
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+	if (!gl_success("glGetIntegerv") || num_formats <= 0)
+		return;
+
+	device->driver_hash = hash_gl_string(0, GL_VENDOR);
+	device->driver_hash = hash_gl_string(device->driver_hash, GL_RENDERER);
+	device->driver_hash = hash_gl_string(device->driver_hash, GL_VERSION);
+	device->shader_cache_path = bstrdup(path);
+}
+
 gs_swapchain_t *device_swapchain_create(gs_device_t *device,
 		const struct gs_init_data *info)
 {
@@ -1325,6 +1361,35 @@ void device_projection_pop(gs_device_t *device)
 	da_pop_back(device->proj_stack);
 }
 
+void gl_swapchain_presented(struct gs_swap_chain *swap)
+{
+	gl_delete_fence(&swap->present_fence);
+
+	swap->present_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	gl_success("glFenceSync");
+}
+
+/* swapping doesn't block with a swap interval of 0, but drivers still stall
+ * once too many frames are queued.  the fence after the last swap tells
+ * whether the previous frame has been processed yet. */
+bool gs_swapchain_ready(gs_swapchain_t *swapchain)
+{
+	GLenum ret;
+
+	if (!swapchain->present_fence)
+		return true;
+
+	ret = glClientWaitSync(swapchain->present_fence,
+			GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (!gl_success("glClientWaitSync") || ret == GL_WAIT_FAILED)
+		return true;
+	if (ret == GL_TIMEOUT_EXPIRED)
+		return false;
+
+	gl_delete_fence(&swapchain->present_fence);
+	return true;
+}
+
 void gs_swapchain_destroy(gs_swapchain_t *swapchain)
 {
 	if (!swapchain)
@@ -1333,6 +1398,7 @@ void gs_swapchain_destroy(gs_swapchain_t *swapchain)
 	if (swapchain->device->cur_swap == swapchain)
 		device_load_swapchain(swapchain->device, NULL);
 
+	gl_delete_fence(&swapchain->present_fence);
 	gl_platform_cleanup_swapchain(swapchain);
 
 	gl_windowinfo_destroy(swapchain->wi);
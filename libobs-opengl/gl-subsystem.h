@@ -56,6 +56,7 @@ static inline GLint convert_gs_format(enum gs_color_format format)
 	case GS_DXT1:        return GL_RGB;
 	case GS_DXT3:        return GL_RGBA;
 	case GS_DXT5:        return GL_RGBA;
+	case GS_R8G8:        return GL_RG;
 	case GS_UNKNOWN:     return 0;
 	}
 
@@ -82,6 +83,7 @@ static inline GLint convert_gs_internal_format(enum gs_color_format format)
 	case GS_DXT1:        return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
 	case GS_DXT3:        return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
 	case GS_DXT5:        return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case GS_R8G8:        return GL_RG8;
 	case GS_UNKNOWN:     return 0;
 	}
 
@@ -108,6 +110,7 @@ static inline GLenum get_gl_format_type(enum gs_color_format format)
 	case GS_DXT1:        return GL_UNSIGNED_BYTE;
 	case GS_DXT3:        return GL_UNSIGNED_BYTE;
 	case GS_DXT5:        return GL_UNSIGNED_BYTE;
+	case GS_R8G8:        return GL_UNSIGNED_BYTE;
 	case GS_UNKNOWN:     return 0;
 	}
 
@@ -331,6 +334,9 @@ struct gs_shader {
 	enum gs_shader_type  type;
 	GLuint               obj;
 
+	/* GLSL, only kept when program binaries are cached */
+	char                 *source;
+
 	struct gs_shader_param  *viewproj;
 	struct gs_shader_param  *world;
 
@@ -361,6 +367,8 @@ extern struct gs_program *gs_program_create(struct gs_device *device);
 extern void gs_program_destroy(struct gs_program *program);
 extern void program_update_params(struct gs_program *shader);
 
+#define VB_SEGMENTS 3
+
 struct gs_vertex_buffer {
 	GLuint               vao;
 	GLuint               vertex_buffer;
@@ -370,6 +378,19 @@ struct gs_vertex_buffer {
 	DARRAY(GLuint)       uv_buffers;
 	DARRAY(size_t)       uv_sizes;
 
+	/* with ARB_buffer_storage, dynamic buffers are persistently mapped
+	 * rings of VB_SEGMENTS copies of their data.  Each flush writes the
+	 * next copy once a fence says the GPU is done drawing from it, so
+	 * updates never stall on in-flight draws. */
+	bool                 persistent;
+	size_t               segment;
+	GLsync               fences[VB_SEGMENTS];
+	void                 *vertex_map;
+	void                 *normal_map;
+	void                 *tangent_map;
+	void                 *color_map;
+	DARRAY(void*)        uv_maps;
+
 	gs_device_t          *device;
 	size_t               num;
 	bool                 dynamic;
@@ -417,6 +438,7 @@ struct gs_texture_2d {
 	uint32_t             height;
 	bool                 gen_mipmaps;
 	GLuint               unpack_buffer;
+	GLsizeiptr           unpack_size;
 };
 
 struct gs_texture_cube {
@@ -437,6 +459,20 @@ struct gs_stage_surface {
 	GLint                gl_internal_format;
 	GLenum               gl_type;
 	GLuint               pack_buffer;
+
+	/* signaled once the last staged copy has finished */
+	GLsync               fence;
+};
+
+struct gs_timer {
+	gs_device_t          *device;
+	GLuint               queries[2];
+};
+
+/* GL timestamps are always in nanoseconds and can't be disjoint, so ranges
+ * need no queries of their own */
+struct gs_timer_range {
+	gs_device_t          *device;
 };
 
 struct gs_zstencil_buffer {
@@ -450,8 +486,14 @@ struct gs_swap_chain {
 	gs_device_t             *device;
 	struct gl_windowinfo *wi;
 	struct gs_init_data  info;
+
+	/* inserted after each swap, see gs_swapchain_ready */
+	GLsync               present_fence;
 };
 
+/* called by the platform's device_present after swapping buffers */
+extern void gl_swapchain_presented(struct gs_swap_chain *swap);
+
 struct fbo_info {
 	GLuint               fbo;
 	uint32_t             width;
@@ -476,6 +518,9 @@ static inline void fbo_info_destroy(struct fbo_info *fbo)
 struct gs_device {
 	struct gl_platform   *plat;
 	enum copy_type       copy_type;
+	bool                 fences;
+	bool                 buffer_storage;
+	bool                 timer_queries;
 
 	gs_texture_t         *cur_render_target;
 	gs_zstencil_t        *cur_zstencil_buffer;
@@ -491,6 +536,11 @@ struct gs_device {
 
 	struct gs_program    *first_program;
 
+	/* set if linked programs are cached on disk, the driver hash is part
+	 * of the key so that driver updates don't load stale binaries */
+	char                 *shader_cache_path;
+	uint32_t             driver_hash;
+
 	enum gs_cull_mode    cur_cull_mode;
 	struct gs_rect       cur_viewport;
 
@@ -67,6 +67,7 @@ static bool create_pixel_unpack_buffer(struct gs_texture_2d *tex)
 	glBufferData(GL_PIXEL_UNPACK_BUFFER, size, 0, GL_DYNAMIC_DRAW);
 	if (!gl_success("glBufferData"))
 		success = false;
+	tex->unpack_size = size;
 
 	if (!gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0))
 		success = false;
@@ -179,6 +180,13 @@ bool gs_texture_map(gs_texture_t *tex, uint8_t **ptr, uint32_t *linesize)
 	if (!gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, tex2d->unpack_buffer))
 		goto fail;
 
+	/* orphan the old storage so the map doesn't have to wait for a
+	 * previous upload from this buffer to finish */
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, tex2d->unpack_size, 0,
+			GL_DYNAMIC_DRAW);
+	if (!gl_success("glBufferData"))
+		goto fail;
+
 	*ptr = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
 	if (!gl_success("glMapBuffer"))
 		goto fail;
@@ -18,51 +18,74 @@
 #include <graphics/vec3.h>
 #include "gl-subsystem.h"
 
-static bool create_buffers(struct gs_vertex_buffer *vb)
+static bool create_stream(struct gs_vertex_buffer *vb, GLuint *buffer,
+		void **map, size_t size, const void *data)
 {
 	GLenum usage = vb->dynamic ? GL_STREAM_DRAW : GL_STATIC_DRAW;
+
+	if (!vb->persistent)
+		return gl_create_buffer(GL_ARRAY_BUFFER, buffer,
+				(GLsizeiptr)size, data, usage);
+
+	if (!gl_create_persistent_buffer(GL_ARRAY_BUFFER, buffer,
+				(GLsizeiptr)(size * VB_SEGMENTS), map))
+		return false;
+
+	memcpy(*map, data, size);
+	return true;
+}
+
+static bool create_buffers(struct gs_vertex_buffer *vb)
+{
 	size_t i;
 
-	if (!gl_create_buffer(GL_ARRAY_BUFFER, &vb->vertex_buffer,
+	if (!create_stream(vb, &vb->vertex_buffer, &vb->vertex_map,
 				vb->data->num * sizeof(struct vec3),
-				vb->data->points, usage))
+				vb->data->points))
 		return false;
 
 	if (vb->data->normals) {
-		if (!gl_create_buffer(GL_ARRAY_BUFFER, &vb->normal_buffer,
+		if (!create_stream(vb, &vb->normal_buffer, &vb->normal_map,
 					vb->data->num * sizeof(struct vec3),
-					vb->data->normals, usage))
+					vb->data->normals))
 			return false;
 	}
 
 	if (vb->data->tangents) {
-		if (!gl_create_buffer(GL_ARRAY_BUFFER, &vb->tangent_buffer,
+		if (!create_stream(vb, &vb->tangent_buffer, &vb->tangent_map,
 					vb->data->num * sizeof(struct vec3),
-					vb->data->tangents, usage))
+					vb->data->tangents))
 			return false;
 	}
 
 	if (vb->data->colors) {
-		if (!gl_create_buffer(GL_ARRAY_BUFFER, &vb->color_buffer,
+		if (!create_stream(vb, &vb->color_buffer, &vb->color_map,
 					vb->data->num * sizeof(uint32_t),
-					vb->data->colors, usage))
+					vb->data->colors))
 			return false;
 	}
 
 	da_reserve(vb->uv_buffers, vb->data->num_tex);
 	da_reserve(vb->uv_sizes,   vb->data->num_tex);
+	da_reserve(vb->uv_maps,    vb->data->num_tex);
 
 	for (i = 0; i < vb->data->num_tex; i++) {
-		GLuint tex_buffer;
+		GLuint tex_buffer = 0;
+		void *tex_map = NULL;
 		struct gs_tvertarray *tv = vb->data->tvarray+i;
 		size_t size = vb->data->num * sizeof(float) * tv->width;
+		bool success;
 
-		if (!gl_create_buffer(GL_ARRAY_BUFFER, &tex_buffer, size,
-					tv->array, usage))
-			return false;
+		success = create_stream(vb, &tex_buffer, &tex_map, size,
+				tv->array);
 
+		/* pushed even on failure so the buffer gets deleted */
 		da_push_back(vb->uv_buffers, &tex_buffer);
 		da_push_back(vb->uv_sizes,   &tv->width);
+		da_push_back(vb->uv_maps,    &tex_map);
+
+		if (!success)
+			return false;
 	}
 
 	if (!vb->dynamic) {
@@ -84,6 +107,7 @@ gs_vertbuffer_t *device_vertexbuffer_create(gs_device_t *device,
 	vb->data    = data;
 	vb->num     = data->num;
 	vb->dynamic = flags & GS_DYNAMIC;
+	vb->persistent = vb->dynamic && device->buffer_storage;
 
 	if (!create_buffers(vb)) {
 		blog(LOG_ERROR, "device_vertexbuffer_create (GL) failed");
@@ -112,6 +136,10 @@ void gs_vertexbuffer_destroy(gs_vertbuffer_t *vb)
 		if (vb->vao)
 			gl_delete_vertex_arrays(1, &vb->vao);
 
+		for (size_t i = 0; i < VB_SEGMENTS; i++)
+			gl_delete_fence(&vb->fences[i]);
+
+		da_free(vb->uv_maps);
 		da_free(vb->uv_sizes);
 		da_free(vb->uv_buffers);
 		gs_vbdata_destroy(vb->data);
@@ -120,6 +148,29 @@ void gs_vertexbuffer_destroy(gs_vertbuffer_t *vb)
 	}
 }
 
+/* fences the copy that was drawn from so far and waits until the GPU is done
+ * with the copy that is about to be overwritten */
+static bool next_segment(struct gs_vertex_buffer *vb)
+{
+	gl_delete_fence(&vb->fences[vb->segment]);
+	vb->fences[vb->segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	if (!gl_success("glFenceSync"))
+		return false;
+
+	vb->segment = (vb->segment + 1) % VB_SEGMENTS;
+	return gl_wait_fence(&vb->fences[vb->segment]);
+}
+
+static bool update_stream(struct gs_vertex_buffer *vb, GLuint buffer,
+		void *map, void *data, size_t size)
+{
+	if (!vb->persistent)
+		return update_buffer(GL_ARRAY_BUFFER, buffer, data, size);
+
+	memcpy((uint8_t*)map + vb->segment * size, data, size);
+	return true;
+}
+
 void gs_vertexbuffer_flush(gs_vertbuffer_t *vb)
 {
 	size_t i;
@@ -129,27 +180,30 @@ void gs_vertexbuffer_flush(gs_vertbuffer_t *vb)
 		goto failed;
 	}
 
-	if (!update_buffer(GL_ARRAY_BUFFER, vb->vertex_buffer,
+	if (vb->persistent && !next_segment(vb))
+		goto failed;
+
+	if (!update_stream(vb, vb->vertex_buffer, vb->vertex_map,
 				vb->data->points,
 				vb->data->num * sizeof(struct vec3)))
 		goto failed;
 
 	if (vb->normal_buffer) {
-		if (!update_buffer(GL_ARRAY_BUFFER, vb->normal_buffer,
+		if (!update_stream(vb, vb->normal_buffer, vb->normal_map,
 					vb->data->normals,
 					vb->data->num * sizeof(struct vec3)))
 			goto failed;
 	}
 
 	if (vb->tangent_buffer) {
-		if (!update_buffer(GL_ARRAY_BUFFER, vb->tangent_buffer,
+		if (!update_stream(vb, vb->tangent_buffer, vb->tangent_map,
 					vb->data->tangents,
 					vb->data->num * sizeof(struct vec3)))
 			goto failed;
 	}
 
 	if (vb->color_buffer) {
-		if (!update_buffer(GL_ARRAY_BUFFER, vb->color_buffer,
+		if (!update_stream(vb, vb->color_buffer, vb->color_map,
 					vb->data->colors,
 					vb->data->num * sizeof(uint32_t)))
 			goto failed;
@@ -157,10 +211,11 @@ void gs_vertexbuffer_flush(gs_vertbuffer_t *vb)
 
 	for (i = 0; i < vb->data->num_tex; i++) {
 		GLuint buffer = vb->uv_buffers.array[i];
+		void *map = vb->uv_maps.array[i];
 		struct gs_tvertarray *tv = vb->data->tvarray+i;
 		size_t size = vb->data->num * tv->width * sizeof(float);
 
-		if (!update_buffer(GL_ARRAY_BUFFER, buffer, tv->array, size))
+		if (!update_stream(vb, buffer, map, tv->array, size))
 			goto failed;
 	}
 
@@ -177,10 +232,11 @@ struct gs_vb_data *gs_vertexbuffer_get_data(const gs_vertbuffer_t *vb)
 
 static inline GLuint get_vb_buffer(struct gs_vertex_buffer *vb,
 		enum attrib_type type, size_t index, GLint *width,
-		GLenum *gl_type)
+		GLenum *gl_type, size_t *size)
 {
 	*gl_type = GL_FLOAT;
 	*width   = 4;
+	*size    = vb->num * sizeof(struct vec3);
 
 	if (type == ATTRIB_POSITION) {
 		return vb->vertex_buffer;
@@ -190,12 +246,14 @@ static inline GLuint get_vb_buffer(struct gs_vertex_buffer *vb,
 		return vb->tangent_buffer;
 	} else if (type == ATTRIB_COLOR) {
 		*gl_type = GL_UNSIGNED_BYTE;
+		*size    = vb->num * sizeof(uint32_t);
 		return vb->color_buffer;
 	} else if (type == ATTRIB_TEXCOORD) {
 		if (vb->uv_buffers.num <= index)
 			return 0;
 
 		*width = (GLint)vb->uv_sizes.array[index];
+		*size  = vb->num * sizeof(float) * vb->uv_sizes.array[index];
 		return vb->uv_buffers.array[index];
 	}
 
@@ -208,9 +266,12 @@ static bool load_vb_buffer(struct shader_attrib *attrib,
 	GLenum type;
 	GLint width;
 	GLuint buffer;
+	size_t size;
+	size_t offset;
 	bool success = true;
 
-	buffer = get_vb_buffer(vb, attrib->type, attrib->index, &width, &type);
+	buffer = get_vb_buffer(vb, attrib->type, attrib->index, &width, &type,
+			&size);
 	if (!buffer) {
 		blog(LOG_ERROR, "Vertex buffer does not have the required "
 		                "inputs for vertex shader");
@@ -220,7 +281,10 @@ static bool load_vb_buffer(struct shader_attrib *attrib,
 	if (!gl_bind_buffer(GL_ARRAY_BUFFER, buffer))
 		return false;
 
-	glVertexAttribPointer(id, width, type, GL_TRUE, 0, 0);
+	offset = vb->persistent ? vb->segment * size : 0;
+
+	glVertexAttribPointer(id, width, type, GL_TRUE, 0,
+			(const GLvoid*)offset);
 	if (!gl_success("glVertexAttribPointer"))
 		success = false;
 
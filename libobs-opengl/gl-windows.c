@@ -565,6 +565,8 @@ void device_present(gs_device_t *device)
 				"returned %lu", GetLastError());
 		blog(LOG_ERROR, "device_present (GL) failed");
 	}
+
+	gl_swapchain_presented(device->cur_swap);
 }
 
 extern void gl_getclientsize(const struct gs_swap_chain *swap,
@@ -79,6 +79,9 @@ struct gl_windowinfo {
 
 	/* We can't fetch screen without a request so we cache it. */
 	int screen;
+
+	/* The swap interval is set the first time the window is current. */
+	bool swap_interval_set;
 };
 
 struct gl_platform {
@@ -265,7 +268,7 @@ static void gl_context_destroy(struct gl_platform *plat)
 extern struct gl_windowinfo *gl_windowinfo_create(const struct gs_init_data *info)
 {
 	UNUSED_PARAMETER(info);
-	return bmalloc(sizeof(struct gl_windowinfo));
+	return bzalloc(sizeof(struct gl_windowinfo));
 }
 
 extern void gl_windowinfo_destroy(struct gl_windowinfo *info)
@@ -537,6 +540,22 @@ extern void gl_update(gs_device_t *device)
 	);
 }
 
+/* displays must never wait for vertical sync, the video thread presents
+ * them between frames */
+static void set_swap_interval(Display *display, struct gl_windowinfo *wi)
+{
+	if (wi->swap_interval_set)
+		return;
+
+	wi->swap_interval_set = true;
+
+	if (GLAD_GLX_EXT_swap_control)
+		glXSwapIntervalEXT(display, wi->window, 0);
+	else
+		blog(LOG_INFO, "GLX_EXT_swap_control not supported, displays "
+				"may wait for vertical sync");
+}
+
 extern void device_load_swapchain(gs_device_t *device, gs_swapchain_t *swap)
 {
 	if (device->cur_swap == swap)
@@ -551,6 +570,8 @@ extern void device_load_swapchain(gs_device_t *device, gs_swapchain_t *swap)
 		XID window = swap->wi->window;
 		if (!glXMakeContextCurrent(dpy, window, window, ctx)) {
 			blog(LOG_ERROR, "Failed to make context current.");
+		} else {
+			set_swap_interval(dpy, swap->wi);
 		}
 	} else {
 		GLXPbuffer pbuf = device->plat->pbuffer;
@@ -568,4 +589,5 @@ extern void device_present(gs_device_t *device)
 	/* TODO: Handle XCB events. */
 
 	glXSwapBuffers(display, window);
+	gl_swapchain_presented(device->cur_swap);
 }
@@ -47,6 +47,7 @@ struct calldata {
 	size_t  size;     /* size of the stack, in bytes */
 	size_t  capacity; /* capacity of the stack, in bytes */
 	uint8_t *stack;
+	bool    fixed;    /* stack is owned by the caller and never grows */
 };
 
 typedef struct calldata calldata_t;
@@ -56,9 +57,26 @@ static inline void calldata_init(struct calldata *data)
 	memset(data, 0, sizeof(struct calldata));
 }
 
+/*
+ * Uses a caller provided buffer (usually on the stack) instead of allocating.
+ * Parameters that don't fit are dropped with an error, so size the buffer
+ * for the signal: each parameter takes two size_t values plus its name and
+ * data, and the stack ends with one more size_t.
+ */
+static inline void calldata_init_fixed(struct calldata *data, uint8_t *stack,
+		size_t size)
+{
+	data->stack    = stack;
+	data->capacity = size;
+	data->fixed    = true;
+	data->size     = sizeof(size_t);
+	memset(stack, 0, sizeof(size_t));
+}
+
 static inline void calldata_free(struct calldata *data)
 {
-	bfree(data->stack);
+	if (!data->fixed)
+		bfree(data->stack);
 }
 
 EXPORT bool calldata_get_data(const calldata_t *data, const char *name,
@@ -16,43 +16,91 @@
 
 #include "../util/darray.h"
 #include "../util/threading.h"
+#include "../util/platform.h"
 
 #include "decl.h"
 #include "signal.h"
 
+#define SIGNAL_BUCKETS 32
+
 struct signal_callback {
 	signal_callback_t callback;
 	void              *data;
-	bool              remove;
+};
+
+/*
+ * Callback arrays are copy-on-write: connect and disconnect build a new
+ * array and swap it in, so dispatch just loads the current one and runs it
+ * without taking a lock.  Replaced arrays are retired and freed once no
+ * dispatch is in progress.
+ */
+struct signal_callback_list {
+	volatile long          active;
+	size_t                 num;
+	struct signal_callback *array;
 };
 
 struct signal_info {
 	struct decl_info               func;
-	DARRAY(struct signal_callback) callbacks;
+	uint32_t                       hash;
+	struct signal_callback_list    *volatile callbacks;
 	pthread_mutex_t                mutex;
-	bool                           signalling;
+	volatile long                  dispatching;
+	DARRAY_SMALL(struct signal_callback_list*, 4) retired;
 
 	struct signal_info             *next;
 };
 
+struct dispatch_frame {
+	struct signal_callback_list *list;
+	struct dispatch_frame       *prev;
+};
+
+/* dispatches running on this thread, so a callback can disconnect itself */
+#ifdef _MSC_VER
+static __declspec(thread) struct dispatch_frame *current_frame = NULL;
+#else
+static __thread struct dispatch_frame *current_frame = NULL;
+#endif
+
+static inline uint32_t signal_hash(const char *name)
+{
+	uint32_t hash = 2166136261U;
+
+	while (*name) {
+		hash ^= (uint8_t)*(name++);
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+static struct signal_callback_list *callback_list_create(size_t num)
+{
+	struct signal_callback_list *list;
+
+	list = bmalloc(sizeof(struct signal_callback_list) +
+			sizeof(struct signal_callback) * num);
+	list->active = 0;
+	list->num    = num;
+	list->array  = (struct signal_callback*)(list + 1);
+	return list;
+}
+
 static inline struct signal_info *signal_info_create(struct decl_info *info)
 {
-	pthread_mutexattr_t attr;
 	struct signal_info *si;
 
-	if (pthread_mutexattr_init(&attr) != 0)
-		return NULL;
-	if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) != 0)
-		return NULL;
-
 	si = bmalloc(sizeof(struct signal_info));
 
-	si->func       = *info;
-	si->next       = NULL;
-	si->signalling = false;
-	da_init(si->callbacks);
+	si->func        = *info;
+	si->hash        = signal_hash(info->name);
+	si->callbacks   = NULL;
+	si->dispatching = 0;
+	si->next        = NULL;
+	da_small_init(si->retired);
 
-	if (pthread_mutex_init(&si->mutex, &attr) != 0) {
+	if (pthread_mutex_init(&si->mutex, NULL) != 0) {
 		blog(LOG_ERROR, "Could not create signal");
 
 		decl_info_free(&si->func);
@@ -63,21 +111,34 @@ static inline struct signal_info *signal_info_create(struct decl_info *info)
 	return si;
 }
 
+static inline void free_retired(struct signal_info *si)
+{
+	for (size_t i = 0; i < si->retired.num; i++)
+		bfree(si->retired.array[i]);
+	da_resize(si->retired, 0);
+}
+
 static inline void signal_info_destroy(struct signal_info *si)
 {
 	if (si) {
+		free_retired(si);
+		da_small_free(si->retired);
+		bfree(si->callbacks);
 		pthread_mutex_destroy(&si->mutex);
 		decl_info_free(&si->func);
-		da_free(si->callbacks);
 		bfree(si);
 	}
 }
 
-static inline size_t signal_get_callback_idx(struct signal_info *si,
+static inline size_t signal_get_callback_idx(
+		struct signal_callback_list *list,
 		signal_callback_t callback, void *data)
 {
-	for (size_t i = 0; i < si->callbacks.num; i++) {
-		struct signal_callback *sc = si->callbacks.array+i;
+	if (!list)
+		return DARRAY_INVALID;
+
+	for (size_t i = 0; i < list->num; i++) {
+		struct signal_callback *sc = list->array+i;
 
 		if (sc->callback == callback && sc->data == data)
 			return i;
@@ -86,27 +147,59 @@ static inline size_t signal_get_callback_idx(struct signal_info *si,
 	return DARRAY_INVALID;
 }
 
+/* call with the signal's mutex held */
+static void replace_callbacks(struct signal_info *si,
+		struct signal_callback_list *list)
+{
+	struct signal_callback_list *old;
+
+	old = os_atomic_exchange_ptr((void *volatile*)&si->callbacks, list);
+	if (old)
+		da_small_push_back(si->retired, &old);
+
+	/* the swap is a full barrier, so any dispatch that starts from here
+	 * on sees the new array */
+	if (os_atomic_load_long(&si->dispatching) == 0)
+		free_retired(si);
+}
+
+static inline long thread_dispatch_count(struct signal_callback_list *list)
+{
+	struct dispatch_frame *frame = current_frame;
+	long count = 0;
+
+	while (frame) {
+		if (frame->list == list)
+			count++;
+		frame = frame->prev;
+	}
+
+	return count;
+}
+
 struct signal_handler {
-	struct signal_info *first;
+	struct signal_info *volatile buckets[SIGNAL_BUCKETS];
 	pthread_mutex_t    mutex;
 };
 
+/* signals are only ever added, and are fully built before being published
+ * as a bucket head, so lookups don't need the handler mutex */
 static struct signal_info *getsignal(signal_handler_t *handler,
-		const char *name, struct signal_info **p_last)
+		const char *name)
 {
-	struct signal_info *signal, *last= NULL;
+	uint32_t hash = signal_hash(name);
+	struct signal_info *signal;
+
+	signal = os_atomic_load_ptr((void *const volatile*)
+			&handler->buckets[hash & (SIGNAL_BUCKETS - 1)]);
 
-	signal = handler->first;
 	while (signal != NULL) {
-		if (strcmp(signal->func.name, name) == 0)
+		if (signal->hash == hash && strcmp(signal->func.name, name) == 0)
 			break;
 
-		last = signal;
 		signal = signal->next;
 	}
 
-	if (p_last)
-		*p_last = last;
 	return signal;
 }
 
@@ -114,8 +207,7 @@ static struct signal_info *getsignal(signal_handler_t *handler,
 
 signal_handler_t *signal_handler_create(void)
 {
-	struct signal_handler *handler = bmalloc(sizeof(struct signal_handler));
-	handler->first = NULL;
+	struct signal_handler *handler = bzalloc(sizeof(struct signal_handler));
 
 	if (pthread_mutex_init(&handler->mutex, NULL) != 0) {
 		blog(LOG_ERROR, "Couldn't create signal handler!");
@@ -129,11 +221,13 @@ signal_handler_t *signal_handler_create(void)
 void signal_handler_destroy(signal_handler_t *handler)
 {
 	if (handler) {
-		struct signal_info *sig = handler->first;
-		while (sig != NULL) {
-			struct signal_info *next = sig->next;
-			signal_info_destroy(sig);
-			sig = next;
+		for (size_t i = 0; i < SIGNAL_BUCKETS; i++) {
+			struct signal_info *sig = handler->buckets[i];
+			while (sig != NULL) {
+				struct signal_info *next = sig->next;
+				signal_info_destroy(sig);
+				sig = next;
+			}
 		}
 
 		pthread_mutex_destroy(&handler->mutex);
@@ -144,7 +238,7 @@ void signal_handler_destroy(signal_handler_t *handler)
 bool signal_handler_add(signal_handler_t *handler, const char *signal_decl)
 {
 	struct decl_info func = {0};
-	struct signal_info *sig, *last;
+	struct signal_info *sig;
 	bool success = true;
 
 	if (!parse_decl_string(&func, signal_decl)) {
@@ -154,17 +248,23 @@ bool signal_handler_add(signal_handler_t *handler, const char *signal_decl)
 
 	pthread_mutex_lock(&handler->mutex);
 
-	sig = getsignal(handler, func.name, &last);
+	sig = getsignal(handler, func.name);
 	if (sig) {
 		blog(LOG_WARNING, "Signal declaration '%s' exists", func.name);
 		decl_info_free(&func);
 		success = false;
 	} else {
 		sig = signal_info_create(&func);
-		if (!last)
-			handler->first = sig;
-		else
-			last->next = sig;
+		if (sig) {
+			size_t idx = sig->hash & (SIGNAL_BUCKETS - 1);
+
+			sig->next = handler->buckets[idx];
+			os_atomic_exchange_ptr(
+					(void *volatile*)&handler->buckets[idx],
+					sig);
+		} else {
+			success = false;
+		}
 	}
 
 	pthread_mutex_unlock(&handler->mutex);
@@ -172,56 +272,43 @@ bool signal_handler_add(signal_handler_t *handler, const char *signal_decl)
 	return success;
 }
 
-void signal_handler_connect(signal_handler_t *handler, const char *signal,
-		signal_callback_t callback, void *data)
+signal_t *signal_handler_get_signal(signal_handler_t *handler,
+		const char *signal)
 {
-	struct signal_info *sig, *last;
-	struct signal_callback cb_data = {callback, data, false};
-	size_t idx;
-
-	if (!handler)
-		return;
+	return handler ? getsignal(handler, signal) : NULL;
+}
 
-	pthread_mutex_lock(&handler->mutex);
-	sig = getsignal(handler, signal, &last);
-	pthread_mutex_unlock(&handler->mutex);
+void signal_connect(signal_t *sig, signal_callback_t callback, void *data)
+{
+	struct signal_callback_list *old, *list;
+	size_t num;
 
-	if (!sig) {
-		blog(LOG_WARNING, "signal_handler_connect: "
-		                  "signal '%s' not found", signal);
+	if (!sig)
 		return;
-	}
-
-	/* -------------- */
 
 	pthread_mutex_lock(&sig->mutex);
 
-	idx = signal_get_callback_idx(sig, callback, data);
-	if (idx == DARRAY_INVALID)
-		da_push_back(sig->callbacks, &cb_data);
-	
-	pthread_mutex_unlock(&sig->mutex);
-}
+	old = sig->callbacks;
+	if (signal_get_callback_idx(old, callback, data) == DARRAY_INVALID) {
+		num  = old ? old->num : 0;
+		list = callback_list_create(num + 1);
 
-static inline struct signal_info *getsignal_locked(signal_handler_t *handler,
-		const char *name)
-{
-	struct signal_info *sig;
-
-	if (!handler)
-		return NULL;
+		if (num)
+			memcpy(list->array, old->array,
+					sizeof(struct signal_callback) * num);
+		list->array[num].callback = callback;
+		list->array[num].data     = data;
 
-	pthread_mutex_lock(&handler->mutex);
-	sig = getsignal(handler, name, NULL);
-	pthread_mutex_unlock(&handler->mutex);
+		replace_callbacks(sig, list);
+	}
 
-	return sig;
+	pthread_mutex_unlock(&sig->mutex);
 }
 
-void signal_handler_disconnect(signal_handler_t *handler, const char *signal,
-		signal_callback_t callback, void *data)
+void signal_disconnect(signal_t *sig, signal_callback_t callback, void *data)
 {
-	struct signal_info *sig = getsignal_locked(handler, signal);
+	struct signal_callback_list *old, *list = NULL;
+	long own;
 	size_t idx;
 
 	if (!sig)
@@ -229,39 +316,113 @@ void signal_handler_disconnect(signal_handler_t *handler, const char *signal,
 
 	pthread_mutex_lock(&sig->mutex);
 
-	idx = signal_get_callback_idx(sig, callback, data);
-	if (idx != DARRAY_INVALID) {
-		if (sig->signalling)
-			sig->callbacks.array[idx].remove = true;
-		else
-			da_erase(sig->callbacks, idx);
+	old = sig->callbacks;
+	idx = signal_get_callback_idx(old, callback, data);
+	if (idx == DARRAY_INVALID) {
+		pthread_mutex_unlock(&sig->mutex);
+		return;
 	}
-	
+
+	if (old->num > 1) {
+		list = callback_list_create(old->num - 1);
+		memcpy(list->array, old->array,
+				sizeof(struct signal_callback) * idx);
+		memcpy(list->array + idx, old->array + idx + 1,
+				sizeof(struct signal_callback) *
+				(old->num - idx - 1));
+	}
+
+	/* count ourselves as a dispatch so the old array stays around */
+	os_atomic_inc_long(&sig->dispatching);
+	replace_callbacks(sig, list);
+
 	pthread_mutex_unlock(&sig->mutex);
+
+	/* callers usually free the callback data next, so wait for other
+	 * threads to finish running the old array.  dispatches of it on this
+	 * thread are further up the stack and can't be waited for. */
+	own = thread_dispatch_count(old);
+	while (os_atomic_load_long(&old->active) > own)
+		os_sleep_ms(0);
+
+	os_atomic_dec_long(&sig->dispatching);
 }
 
-void signal_handler_signal(signal_handler_t *handler, const char *signal,
-		calldata_t *params)
+void signal_emit(signal_t *sig, calldata_t *params)
 {
-	struct signal_info *sig = getsignal_locked(handler, signal);
+	struct signal_callback_list *list;
+	struct dispatch_frame frame;
 
 	if (!sig)
 		return;
 
-	pthread_mutex_lock(&sig->mutex);
-	sig->signalling = true;
+	os_atomic_inc_long(&sig->dispatching);
+
+	/* the array is only counted as active once it's confirmed to still
+	 * be current, otherwise a disconnect could miss this dispatch */
+	for (;;) {
+		list = os_atomic_load_ptr(
+				(void *const volatile*)&sig->callbacks);
+		if (!list)
+			break;
 
-	for (size_t i = 0; i < sig->callbacks.num; i++) {
-		struct signal_callback *cb = sig->callbacks.array+i;
-		cb->callback(cb->data, params);
+		os_atomic_inc_long(&list->active);
+		if (os_atomic_load_ptr((void *const volatile*)&sig->callbacks)
+				== list)
+			break;
+		os_atomic_dec_long(&list->active);
 	}
 
-	for (size_t i = sig->callbacks.num; i > 0; i--) {
-		struct signal_callback *cb = sig->callbacks.array+i-1;
-		if (cb->remove)
-			da_erase(sig->callbacks, i-1);
+	if (list) {
+		frame.list    = list;
+		frame.prev    = current_frame;
+		current_frame = &frame;
+
+		for (size_t i = 0; i < list->num; i++) {
+			struct signal_callback *cb = list->array+i;
+			cb->callback(cb->data, params);
+		}
+
+		current_frame = frame.prev;
+		os_atomic_dec_long(&list->active);
 	}
 
-	sig->signalling = false;
-	pthread_mutex_unlock(&sig->mutex);
+	os_atomic_dec_long(&sig->dispatching);
+}
+
+bool signal_has_callbacks(signal_t *sig)
+{
+	return sig && os_atomic_load_ptr(
+			(void *const volatile*)&sig->callbacks) != NULL;
+}
+
+void signal_handler_connect(signal_handler_t *handler, const char *signal,
+		signal_callback_t callback, void *data)
+{
+	struct signal_info *sig;
+
+	if (!handler)
+		return;
+
+	sig = getsignal(handler, signal);
+	if (!sig) {
+		blog(LOG_WARNING, "signal_handler_connect: "
+		                  "signal '%s' not found", signal);
+		return;
+	}
+
+	signal_connect(sig, callback, data);
+}
+
+void signal_handler_disconnect(signal_handler_t *handler, const char *signal,
+		signal_callback_t callback, void *data)
+{
+	signal_disconnect(signal_handler_get_signal(handler, signal),
+			callback, data);
+}
+
+void signal_handler_signal(signal_handler_t *handler, const char *signal,
+		calldata_t *params)
+{
+	signal_emit(signal_handler_get_signal(handler, signal), params);
 }
@@ -32,7 +32,9 @@ extern "C" {
  */
 
 struct signal_handler;
+struct signal_info;
 typedef struct signal_handler signal_handler_t;
+typedef struct signal_info signal_t;
 typedef void (*signal_callback_t)(void*, calldata_t*);
 
 EXPORT signal_handler_t *signal_handler_create(void);
@@ -63,6 +65,28 @@ EXPORT void signal_handler_disconnect(signal_handler_t *handler,
 EXPORT void signal_handler_signal(signal_handler_t *handler, const char *signal,
 		calldata_t *params);
 
+/*
+ * Pre-resolved signals
+ *
+ *   A signal stays valid for as long as its handler, so code that fires a
+ * signal often can look it up once and skip the name lookup afterwards.
+ * Dispatch takes no locks.  Disconnecting waits for the callback to finish
+ * running on other threads, so its data can be freed right after.
+ */
+
+EXPORT signal_t *signal_handler_get_signal(signal_handler_t *handler,
+		const char *signal);
+
+EXPORT void signal_connect(signal_t *signal, signal_callback_t callback,
+		void *data);
+EXPORT void signal_disconnect(signal_t *signal, signal_callback_t callback,
+		void *data);
+
+EXPORT void signal_emit(signal_t *signal, calldata_t *params);
+
+/* lets hot paths skip building parameters that nothing would receive */
+EXPORT bool signal_has_callbacks(signal_t *signal);
+
 #ifdef __cplusplus
 }
 #endif
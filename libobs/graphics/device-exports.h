@@ -33,6 +33,8 @@ EXPORT int device_create(gs_device_t **device, uint32_t adapter);
 EXPORT void device_destroy(gs_device_t *device);
 EXPORT void device_enter_context(gs_device_t *device);
 EXPORT void device_leave_context(gs_device_t *device);
+EXPORT void device_set_shader_cache_path(gs_device_t *device,
+		const char *path);
 EXPORT gs_swapchain_t *device_swapchain_create(gs_device_t *device,
 		const struct gs_init_data *data);
 EXPORT void device_resize(gs_device_t *device, uint32_t x, uint32_t y);
@@ -57,6 +59,8 @@ EXPORT gs_stagesurf_t *device_stagesurface_create(gs_device_t *device,
 		enum gs_color_format color_format);
 EXPORT gs_samplerstate_t *device_samplerstate_create(gs_device_t *device,
 		const struct gs_sampler_info *info);
+EXPORT gs_timer_t *device_timer_create(gs_device_t *device);
+EXPORT gs_timer_range_t *device_timer_range_create(gs_device_t *device);
 EXPORT gs_shader_t *device_vertexshader_create(gs_device_t *device,
 		const char *shader, const char *file,
 		char **error_string);
@@ -23,6 +23,9 @@
 
 void gs_effect_actually_destroy(gs_effect_t *effect)
 {
+	/* pending sprites may still reference the effect's passes */
+	gs_sprite_batch_flush();
+
 	effect_free(effect);
 	bfree(effect);
 }
@@ -235,6 +238,78 @@ static inline void clear_tex_params(struct darray *in_params)
 	}
 }
 
+static void get_pass_values(struct darray *pass_params, struct darray *dst)
+{
+	struct pass_shaderparam *params = pass_params->array;
+
+	for (size_t i = 0; i < pass_params->num; i++) {
+		struct gs_effect_param *eparam = params[i].eparam;
+		const struct darray *val = eparam->cur_val.num ?
+			&eparam->cur_val.da : &eparam->default_val.da;
+		size_t size = val->num;
+
+		darray_push_back_array(sizeof(uint8_t), dst, &size,
+				sizeof(size));
+		darray_push_back_array(sizeof(uint8_t), dst, val->array,
+				val->num);
+	}
+}
+
+void effect_pass_get_values(struct gs_effect_pass *pass, struct darray *dst)
+{
+	dst->num = 0;
+	get_pass_values(&pass->vertshader_params.da, dst);
+	get_pass_values(&pass->pixelshader_params.da, dst);
+}
+
+static const uint8_t *set_pass_values(struct darray *pass_params,
+		const uint8_t *values)
+{
+	struct pass_shaderparam *params = pass_params->array;
+
+	for (size_t i = 0; i < pass_params->num; i++) {
+		size_t size;
+
+		memcpy(&size, values, sizeof(size));
+		values += sizeof(size);
+
+		if (size)
+			gs_shader_set_val(params[i].sparam, values, size);
+		values += size;
+	}
+
+	return values;
+}
+
+void effect_pass_set_values(struct gs_effect_pass *pass,
+		const struct darray *values)
+{
+	const uint8_t *cur = values->array;
+
+	cur = set_pass_values(&pass->vertshader_params.da, cur);
+	set_pass_values(&pass->pixelshader_params.da, cur);
+}
+
+static inline void invalidate_params(struct darray *shaderparams)
+{
+	struct pass_shaderparam *params = shaderparams->array;
+
+	for (size_t i = 0; i < shaderparams->num; i++)
+		params[i].eparam->changed = true;
+}
+
+void effect_pass_invalidate(struct gs_effect_pass *pass)
+{
+	invalidate_params(&pass->vertshader_params.da);
+	invalidate_params(&pass->pixelshader_params.da);
+}
+
+void effect_pass_clear_textures(struct gs_effect_pass *pass)
+{
+	clear_tex_params(&pass->vertshader_params.da);
+	clear_tex_params(&pass->pixelshader_params.da);
+}
+
 void gs_technique_end_pass(gs_technique_t *tech)
 {
 	if (!tech) return;
@@ -243,8 +318,7 @@ void gs_technique_end_pass(gs_technique_t *tech)
 	if (!pass)
 		return;
 
-	clear_tex_params(&pass->vertshader_params.da);
-	clear_tex_params(&pass->pixelshader_params.da);
+	effect_pass_clear_textures(pass);
 	tech->effect->cur_pass = NULL;
 }
 
@@ -281,6 +355,19 @@ gs_eparam_t *gs_effect_get_param_by_name(const gs_effect_t *effect,
 	return NULL;
 }
 
+gs_eparam_t *gs_effect_get_param_ref(const gs_effect_t *effect,
+		struct gs_eparam_ref *ref, const char *name)
+{
+	if (!effect || !ref) return NULL;
+
+	if (ref->effect_id != effect->id) {
+		ref->param     = gs_effect_get_param_by_name(effect, name);
+		ref->effect_id = effect->id;
+	}
+
+	return ref->param;
+}
+
 gs_eparam_t *gs_effect_get_viewproj_matrix(const gs_effect_t *effect)
 {
 	return effect ? effect->view_proj : NULL;
@@ -138,6 +138,7 @@ static inline void effect_technique_free(struct gs_effect_technique *t)
 struct gs_effect {
 	bool processing;
 	bool cached;
+	uint64_t id;
 	char *effect_path, *effect_dir;
 
 	DARRAY(struct gs_effect_param) params;
@@ -178,6 +179,14 @@ static inline void effect_free(gs_effect_t *effect)
 }
 
 EXPORT void effect_upload_params(gs_effect_t *effect, bool changed_only);
+
+/* used by sprite batching to draw a pass with earlier parameter values */
+EXPORT void effect_pass_get_values(struct gs_effect_pass *pass,
+		struct darray *dst);
+EXPORT void effect_pass_set_values(struct gs_effect_pass *pass,
+		const struct darray *values);
+EXPORT void effect_pass_invalidate(struct gs_effect_pass *pass);
+EXPORT void effect_pass_clear_textures(struct gs_effect_pass *pass);
 EXPORT void effect_upload_shader_params(gs_effect_t *effect,
 		gs_shader_t *shader, struct darray *pass_params,
 		bool changed_only);
@@ -48,6 +48,7 @@ bool load_graphics_imports(struct gs_exports *exports, void *module,
 	GRAPHICS_IMPORT(device_destroy);
 	GRAPHICS_IMPORT(device_enter_context);
 	GRAPHICS_IMPORT(device_leave_context);
+	GRAPHICS_IMPORT_OPTIONAL(device_set_shader_cache_path);
 	GRAPHICS_IMPORT(device_swapchain_create);
 	GRAPHICS_IMPORT(device_resize);
 	GRAPHICS_IMPORT(device_get_size);
@@ -108,6 +109,7 @@ bool load_graphics_imports(struct gs_exports *exports, void *module,
 	GRAPHICS_IMPORT(device_projection_pop);
 
 	GRAPHICS_IMPORT(gs_swapchain_destroy);
+	GRAPHICS_IMPORT_OPTIONAL(gs_swapchain_ready);
 
 	GRAPHICS_IMPORT(gs_texture_destroy);
 	GRAPHICS_IMPORT(gs_texture_get_width);
@@ -133,6 +135,7 @@ bool load_graphics_imports(struct gs_exports *exports, void *module,
 	GRAPHICS_IMPORT(gs_stagesurface_get_height);
 	GRAPHICS_IMPORT(gs_stagesurface_get_color_format);
 	GRAPHICS_IMPORT(gs_stagesurface_map);
+	GRAPHICS_IMPORT_OPTIONAL(gs_stagesurface_try_map);
 	GRAPHICS_IMPORT(gs_stagesurface_unmap);
 
 	GRAPHICS_IMPORT(gs_zstencil_destroy);
@@ -149,6 +152,17 @@ bool load_graphics_imports(struct gs_exports *exports, void *module,
 	GRAPHICS_IMPORT(gs_indexbuffer_get_num_indices);
 	GRAPHICS_IMPORT(gs_indexbuffer_get_type);
 
+	GRAPHICS_IMPORT_OPTIONAL(device_timer_create);
+	GRAPHICS_IMPORT_OPTIONAL(device_timer_range_create);
+	GRAPHICS_IMPORT_OPTIONAL(gs_timer_destroy);
+	GRAPHICS_IMPORT_OPTIONAL(gs_timer_begin);
+	GRAPHICS_IMPORT_OPTIONAL(gs_timer_end);
+	GRAPHICS_IMPORT_OPTIONAL(gs_timer_get_data);
+	GRAPHICS_IMPORT_OPTIONAL(gs_timer_range_destroy);
+	GRAPHICS_IMPORT_OPTIONAL(gs_timer_range_begin);
+	GRAPHICS_IMPORT_OPTIONAL(gs_timer_range_end);
+	GRAPHICS_IMPORT_OPTIONAL(gs_timer_range_get_data);
+
 	GRAPHICS_IMPORT(gs_shader_destroy);
 	GRAPHICS_IMPORT(gs_shader_get_num_params);
 	GRAPHICS_IMPORT(gs_shader_get_param_by_idx);
@@ -186,6 +200,7 @@ bool load_graphics_imports(struct gs_exports *exports, void *module,
 	GRAPHICS_IMPORT_OPTIONAL(gs_texture_get_dc);
 	GRAPHICS_IMPORT_OPTIONAL(gs_texture_release_dc);
 	GRAPHICS_IMPORT_OPTIONAL(device_texture_open_shared);
+	GRAPHICS_IMPORT_OPTIONAL(gs_texture_update_shared);
 #endif
 
 	return success;
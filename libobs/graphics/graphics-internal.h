@@ -34,6 +34,8 @@ struct gs_exports {
 	void (*device_destroy)(gs_device_t *device);
 	void (*device_enter_context)(gs_device_t *device);
 	void (*device_leave_context)(gs_device_t *device);
+	void (*device_set_shader_cache_path)(gs_device_t *device,
+			const char *path);
 	gs_swapchain_t *(*device_swapchain_create)(gs_device_t *device,
 			const struct gs_init_data *data);
 	void (*device_resize)(gs_device_t *device, uint32_t x, uint32_t y);
@@ -150,6 +152,7 @@ struct gs_exports {
 	void (*device_projection_pop)(gs_device_t *device);
 
 	void     (*gs_swapchain_destroy)(gs_swapchain_t *swapchain);
+	bool     (*gs_swapchain_ready)(gs_swapchain_t *swapchain);
 
 	void     (*gs_texture_destroy)(gs_texture_t *tex);
 	uint32_t (*gs_texture_get_width)(const gs_texture_t *tex);
@@ -181,6 +184,8 @@ struct gs_exports {
 			const gs_stagesurf_t *stagesurf);
 	bool     (*gs_stagesurface_map)(gs_stagesurf_t *stagesurf,
 			uint8_t **data, uint32_t *linesize);
+	bool     (*gs_stagesurface_try_map)(gs_stagesurf_t *stagesurf,
+			uint8_t **data, uint32_t *linesize);
 	void     (*gs_stagesurface_unmap)(gs_stagesurf_t *stagesurf);
 
 	void (*gs_zstencil_destroy)(gs_zstencil_t *zstencil);
@@ -200,6 +205,18 @@ struct gs_exports {
 	enum gs_index_type (*gs_indexbuffer_get_type)(
 			const gs_indexbuffer_t *indexbuffer);
 
+	gs_timer_t *(*device_timer_create)(gs_device_t *device);
+	gs_timer_range_t *(*device_timer_range_create)(gs_device_t *device);
+	void (*gs_timer_destroy)(gs_timer_t *timer);
+	void (*gs_timer_begin)(gs_timer_t *timer);
+	void (*gs_timer_end)(gs_timer_t *timer);
+	bool (*gs_timer_get_data)(gs_timer_t *timer, uint64_t *ticks);
+	void (*gs_timer_range_destroy)(gs_timer_range_t *range);
+	void (*gs_timer_range_begin)(gs_timer_range_t *range);
+	void (*gs_timer_range_end)(gs_timer_range_t *range);
+	bool (*gs_timer_range_get_data)(gs_timer_range_t *range,
+			bool *disjoint, uint64_t *frequency);
+
 	void (*gs_shader_destroy)(gs_shader_t *shader);
 	int (*gs_shader_get_num_params)(const gs_shader_t *shader);
 	gs_sparam_t *(*gs_shader_get_param_by_idx)(gs_shader_t *shader,
@@ -255,6 +272,7 @@ struct gs_exports {
 
 	gs_texture_t *(*device_texture_open_shared)(gs_device_t *device,
 				uint32_t handle);
+	void (*gs_texture_update_shared)(gs_texture_t *tex);
 #endif
 };
 
@@ -266,6 +284,43 @@ struct blend_state {
 	enum gs_blend_type dest_a;
 };
 
+/* consecutive sprite draws that use the same effect pass and parameter
+ * values, drawn together as one triangle list */
+struct sprite_batch {
+	long                   depth;
+	struct gs_effect_pass  *pass;
+	DARRAY(uint8_t)        values;
+	DARRAY(uint8_t)        cur_values;
+	uint32_t               num_verts;
+	gs_vertbuffer_t        *vertbuffer;
+};
+
+/* unused render targets, see gs_render_target_acquire */
+struct render_target_entry {
+	gs_texture_t           *tex;
+	enum gs_color_format   format;
+	uint32_t               cx;
+	uint32_t               cy;
+	uint64_t               release_time;
+};
+
+struct gs_memory_tracker {
+	volatile long          refs;
+	volatile int64_t       bytes;
+};
+
+/* kept sorted by resource so destroying one doesn't need a linear search */
+struct gs_memory_entry {
+	const void             *resource;
+	uint64_t               size;
+	gs_memory_tracker_t    *tracker;
+};
+
+struct gs_effect_failure {
+	char *path;
+	char *errors;
+};
+
 struct graphics_subsystem {
 	void                   *module;
 	gs_device_t            *device;
@@ -280,6 +335,11 @@ struct graphics_subsystem {
 	struct gs_effect       *cur_effect;
 
 	gs_vertbuffer_t        *sprite_buffer;
+	struct sprite_batch    sprite_batch;
+
+	/* restored after a sprite batch is drawn */
+	gs_vertbuffer_t        *cur_vertbuffer;
+	gs_indexbuffer_t       *cur_indexbuffer;
 
 	bool                   using_immediate;
 	struct gs_vb_data      *vbd;
@@ -291,10 +351,26 @@ struct graphics_subsystem {
 
 	pthread_mutex_t        effect_mutex;
 	struct gs_effect       *first_effect;
+	uint64_t               last_effect_id;
+
+	/* effect files that failed to load, so that every further filter
+	 * instance doesn't read and parse them again */
+	DARRAY(struct gs_effect_failure) failed_effects;
 
 	pthread_mutex_t        mutex;
 	volatile long          ref;
 
 	struct blend_state     cur_blend_state;
 	DARRAY(struct blend_state) blend_state_stack;
+
+	DARRAY(struct render_target_entry) render_target_pool;
+	DARRAY(gs_texrender_t*) transient_texrenders;
+
+	DARRAY(struct gs_memory_entry) memory_entries;
 };
+
+/* transient texture renders give their target back to the pool when they
+ * haven't been rendered since their last reset */
+extern void texrender_add_transient(gs_texrender_t *texrender);
+extern void texrender_remove_transient(gs_texrender_t *texrender);
+extern bool texrender_release_unused(gs_texrender_t *texrender);
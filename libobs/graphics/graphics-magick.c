@@ -14,9 +14,10 @@ void gs_free_image_deps()
 	MagickCoreTerminus();
 }
 
-gs_texture_t *gs_texture_create_from_file(const char *file)
+uint8_t *gs_create_texture_file_data(const char *file,
+		enum gs_color_format *format, uint32_t *cx, uint32_t *cy)
 {
-	gs_texture_t  *tex = NULL;
+	uint8_t       *data = NULL;
 	ImageInfo     *info;
 	ExceptionInfo *exception;
 	Image         *image;
@@ -30,21 +31,25 @@ gs_texture_t *gs_texture_create_from_file(const char *file)
 	strcpy(info->filename, file);
 	image = ReadImage(info, exception);
 	if (image) {
-		size_t  cx    = image->magick_columns;
-		size_t  cy    = image->magick_rows;
-		uint8_t *data = malloc(cx * cy * 4);
+		size_t  w     = image->magick_columns;
+		size_t  h     = image->magick_rows;
+
+		data = bmalloc(w * h * 4);
 
-		ExportImagePixels(image, 0, 0, cx, cy, "BGRA", CharPixel,
+		ExportImagePixels(image, 0, 0, w, h, "BGRA", CharPixel,
 				data, exception);
-		if (exception->severity == UndefinedException)
-			tex = gs_texture_create(cx, cy, GS_BGRA, 1,
-					(const uint8_t**)&data, 0);
-		else
+		if (exception->severity == UndefinedException) {
+			*format = GS_BGRA;
+			*cx     = (uint32_t)w;
+			*cy     = (uint32_t)h;
+		} else {
 			blog(LOG_WARNING, "magickcore warning/error getting "
 			                  "pixels from file '%s': %s", file,
 			                  exception->reason);
+			bfree(data);
+			data = NULL;
+		}
 
-		free(data);
 		DestroyImage(image);
 
 	} else if (exception->severity != UndefinedException) {
@@ -55,5 +60,22 @@ gs_texture_t *gs_texture_create_from_file(const char *file)
 	DestroyImageInfo(info);
 	DestroyExceptionInfo(exception);
 
+	return data;
+}
+
+gs_texture_t *gs_texture_create_from_file(const char *file)
+{
+	enum gs_color_format format;
+	uint32_t             cx;
+	uint32_t             cy;
+	uint8_t              *data = gs_create_texture_file_data(file, &format,
+			&cx, &cy);
+	gs_texture_t         *tex = NULL;
+
+	if (data) {
+		tex = gs_texture_create(cx, cy, format, 1,
+				(const uint8_t**)&data, 0);
+		bfree(data);
+	}
 	return tex;
 }
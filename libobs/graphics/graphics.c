@@ -30,11 +30,86 @@
 
 #ifdef _MSC_VER
 static __declspec(thread) graphics_t *thread_graphics = NULL;
+static __declspec(thread) gs_memory_tracker_t *thread_memory_tracker = NULL;
 #else /* assume GCC or that other compiler we dare not mention */
 static __thread graphics_t *thread_graphics = NULL;
+static __thread gs_memory_tracker_t *thread_memory_tracker = NULL;
 #endif
 
+static volatile int64_t total_memory_usage = 0;
+
 #define IMMEDIATE_COUNT 512
+#define SPRITE_BATCH_VERTS (6 * 64)
+
+/* the memory of graphics objects is charged to this tag rather than to
+ * whichever source or module creates them */
+static int graphics_tag = BMEM_TAG_UNTAGGED;
+
+static inline int graphics_mem_tag(void)
+{
+	return bmem_tag(&graphics_tag, "graphics objects");
+}
+
+/* the pass of a batch has usually ended by the time the batch is drawn, so
+ * its shaders and parameter values are loaded again just for the draw, and
+ * whatever was loaded before is restored afterwards */
+static void sprite_batch_draw(graphics_t *graphics)
+{
+	struct sprite_batch   *batch      = &graphics->sprite_batch;
+	struct gs_effect_pass *pass       = batch->pass;
+	struct gs_effect      *cur_effect = graphics->cur_effect;
+	gs_device_t           *device     = graphics->device;
+	gs_shader_t           *vs;
+	gs_shader_t           *ps;
+
+	vs = graphics->exports.device_get_vertex_shader(device);
+	ps = graphics->exports.device_get_pixel_shader(device);
+
+	graphics->cur_effect = NULL;
+	if (vs != pass->vertshader)
+		graphics->exports.device_load_vertexshader(device,
+				pass->vertshader);
+	if (ps != pass->pixelshader)
+		graphics->exports.device_load_pixelshader(device,
+				pass->pixelshader);
+	effect_pass_set_values(pass, &batch->values.da);
+
+	graphics->exports.gs_vertexbuffer_flush(batch->vertbuffer);
+	graphics->exports.device_load_vertexbuffer(device, batch->vertbuffer);
+	graphics->exports.device_load_indexbuffer(device, NULL);
+
+	/* vertices are already transformed */
+	gs_matrix_push();
+	gs_matrix_identity();
+	graphics->exports.device_draw(device, GS_TRIS, 0, batch->num_verts);
+	gs_matrix_pop();
+
+	effect_pass_clear_textures(pass);
+	effect_pass_invalidate(pass);
+
+	if (vs != pass->vertshader)
+		graphics->exports.device_load_vertexshader(device, vs);
+	if (ps != pass->pixelshader)
+		graphics->exports.device_load_pixelshader(device, ps);
+	graphics->exports.device_load_vertexbuffer(device,
+			graphics->cur_vertbuffer);
+	graphics->exports.device_load_indexbuffer(device,
+			graphics->cur_indexbuffer);
+
+	if (cur_effect && cur_effect->cur_pass)
+		effect_pass_invalidate(cur_effect->cur_pass);
+	graphics->cur_effect = cur_effect;
+
+	batch->num_verts = 0;
+	batch->pass      = NULL;
+}
+
+/* called before anything that changes state a pending batch depends on */
+static inline void flush_sprite_batch(graphics_t *graphics)
+{
+	if (graphics->sprite_batch.num_verts)
+		sprite_batch_draw(graphics);
+}
 
 void gs_enum_adapters(
 		bool (*callback)(void *param, const char *name, uint32_t id),
@@ -106,6 +181,27 @@ static bool graphics_init_sprite_vb(struct graphics_subsystem *graphics)
 	return true;
 }
 
+static bool graphics_init_sprite_batch(struct graphics_subsystem *graphics)
+{
+	struct gs_vb_data *vbd;
+
+	vbd = gs_vbdata_create();
+	vbd->num     = SPRITE_BATCH_VERTS;
+	vbd->points  = bzalloc(sizeof(struct vec3) * SPRITE_BATCH_VERTS);
+	vbd->num_tex = 1;
+	vbd->tvarray = bmalloc(sizeof(struct gs_tvertarray));
+	vbd->tvarray[0].width = 2;
+	vbd->tvarray[0].array =
+		bzalloc(sizeof(struct vec2) * SPRITE_BATCH_VERTS);
+
+	graphics->sprite_batch.vertbuffer = graphics->exports.
+		device_vertexbuffer_create(graphics->device, vbd, GS_DYNAMIC);
+	if (!graphics->sprite_batch.vertbuffer)
+		return false;
+
+	return true;
+}
+
 static bool graphics_init(struct graphics_subsystem *graphics)
 {
 	struct matrix4 top_mat;
@@ -119,6 +215,8 @@ static bool graphics_init(struct graphics_subsystem *graphics)
 		return false;
 	if (!graphics_init_sprite_vb(graphics))
 		return false;
+	if (!graphics_init_sprite_batch(graphics))
+		return false;
 	if (pthread_mutex_init(&graphics->mutex, NULL) != 0)
 		return false;
 	if (pthread_mutex_init(&graphics->effect_mutex, NULL) != 0)
@@ -196,8 +294,14 @@ void gs_destroy(graphics_t *graphics)
 			effect = next;
 		}
 
+		for (size_t i = 0; i < graphics->render_target_pool.num; i++)
+			graphics->exports.gs_texture_destroy(
+				graphics->render_target_pool.array[i].tex);
+
 		graphics->exports.gs_vertexbuffer_destroy(
 				graphics->sprite_buffer);
+		graphics->exports.gs_vertexbuffer_destroy(
+				graphics->sprite_batch.vertbuffer);
 		graphics->exports.gs_vertexbuffer_destroy(
 				graphics->immediate_vertbuffer);
 		graphics->exports.device_destroy(graphics->device);
@@ -207,9 +311,33 @@ void gs_destroy(graphics_t *graphics)
 
 	pthread_mutex_destroy(&graphics->mutex);
 	pthread_mutex_destroy(&graphics->effect_mutex);
+	for (size_t i = 0; i < graphics->failed_effects.num; i++) {
+		bfree(graphics->failed_effects.array[i].path);
+		bfree(graphics->failed_effects.array[i].errors);
+	}
+	da_free(graphics->failed_effects);
 	da_free(graphics->matrix_stack);
 	da_free(graphics->viewport_stack);
 	da_free(graphics->blend_state_stack);
+	da_free(graphics->sprite_batch.values);
+	da_free(graphics->sprite_batch.cur_values);
+	da_free(graphics->render_target_pool);
+	da_free(graphics->transient_texrenders);
+
+	/* whatever is left went down with the device */
+	for (size_t i = 0; i < graphics->memory_entries.num; i++) {
+		struct gs_memory_entry *entry =
+			graphics->memory_entries.array + i;
+		os_atomic_add_int64(&total_memory_usage,
+				-(int64_t)entry->size);
+		if (entry->tracker) {
+			os_atomic_add_int64(&entry->tracker->bytes,
+					-(int64_t)entry->size);
+			gs_memory_tracker_release(entry->tracker);
+		}
+	}
+	da_free(graphics->memory_entries);
+
 	if (graphics->module)
 		os_dlclose(graphics->module);
 	bfree(graphics);
@@ -242,6 +370,8 @@ void gs_leave_context(void)
 		if (!os_atomic_dec_long(&thread_graphics->ref)) {
 			graphics_t *graphics = thread_graphics;
 
+			flush_sprite_batch(graphics);
+
 			graphics->exports.device_leave_context(
 					graphics->device);
 			pthread_mutex_unlock(&graphics->mutex);
@@ -267,6 +397,17 @@ int gs_get_device_type(void)
 		thread_graphics->exports.device_get_type() : -1;
 }
 
+void gs_set_shader_cache_path(const char *path)
+{
+	graphics_t *graphics = thread_graphics;
+
+	if (!graphics || !graphics->exports.device_set_shader_cache_path)
+		return;
+
+	graphics->exports.device_set_shader_cache_path(graphics->device,
+			path);
+}
+
 static inline struct matrix4 *top_matrix(graphics_t *graphics)
 {
 	return graphics ? 
@@ -663,20 +804,60 @@ gs_effect_t *gs_get_effect(void)
 
 static inline struct gs_effect *find_cached_effect(const char *filename)
 {
-	struct gs_effect *effect = thread_graphics->first_effect;
+	struct gs_effect *effect;
+
+	pthread_mutex_lock(&thread_graphics->effect_mutex);
 
+	effect = thread_graphics->first_effect;
 	while (effect) {
 		if (strcmp(effect->effect_path, filename) == 0)
 			break;
 		effect = effect->next;
 	}
 
+	pthread_mutex_unlock(&thread_graphics->effect_mutex);
 	return effect;
 }
 
+static bool find_failed_effect(const char *filename, char **error_string)
+{
+	struct gs_effect_failure *failure = NULL;
+
+	pthread_mutex_lock(&thread_graphics->effect_mutex);
+
+	for (size_t i = 0; i < thread_graphics->failed_effects.num; i++) {
+		struct gs_effect_failure *cur =
+			thread_graphics->failed_effects.array + i;
+
+		if (strcmp(cur->path, filename) == 0) {
+			failure = cur;
+			break;
+		}
+	}
+
+	if (failure && error_string)
+		*error_string = bstrdup(failure->errors);
+
+	pthread_mutex_unlock(&thread_graphics->effect_mutex);
+	return failure != NULL;
+}
+
+static void add_failed_effect(const char *filename, const char *errors)
+{
+	struct gs_effect_failure failure;
+
+	failure.path   = bstrdup(filename);
+	failure.errors = bstrdup(errors);
+
+	pthread_mutex_lock(&thread_graphics->effect_mutex);
+	da_push_back(thread_graphics->failed_effects, &failure);
+	pthread_mutex_unlock(&thread_graphics->effect_mutex);
+}
+
 gs_effect_t *gs_effect_create_from_file(const char *file, char **error_string)
 {
 	char *file_string;
+	char *errors = NULL;
 	gs_effect_t *effect = NULL;
 
 	if (!thread_graphics || !file)
@@ -686,15 +867,27 @@ gs_effect_t *gs_effect_create_from_file(const char *file, char **error_string)
 	if (effect)
 		return effect;
 
+	if (find_failed_effect(file, error_string))
+		return NULL;
+
 	file_string = os_quick_read_utf8_file(file);
 	if (!file_string) {
 		blog(LOG_ERROR, "Could not load effect file '%s'", file);
+		add_failed_effect(file, NULL);
 		return NULL;
 	}
 
-	effect = gs_effect_create(file_string, file, error_string);
+	effect = gs_effect_create(file_string, file, &errors);
 	bfree(file_string);
 
+	if (!effect)
+		add_failed_effect(file, errors);
+
+	if (error_string)
+		*error_string = errors;
+	else
+		bfree(errors);
+
 	return effect;
 }
 
@@ -710,6 +903,7 @@ gs_effect_t *gs_effect_create(const char *effect_string, const char *filename,
 
 	effect->graphics = thread_graphics;
 	effect->effect_path = bstrdup(filename);
+	effect->id = ++thread_graphics->last_effect_id;
 
 	ep_init(&parser);
 	success = ep_parse(&parser, effect, effect_string, filename);
@@ -843,6 +1037,90 @@ static inline void build_sprite_rect(struct gs_vb_data *data, gs_texture_t *tex,
 	build_sprite(data, fcx, fcy, start_u, end_u, start_v, end_v);
 }
 
+static bool sprite_batch_add(graphics_t *graphics, gs_texture_t *tex,
+		float fcx, float fcy, uint32_t flip)
+{
+	static const size_t   order[6] = {0, 1, 2, 2, 1, 3};
+	struct sprite_batch   *batch   = &graphics->sprite_batch;
+	struct gs_effect      *effect  = graphics->cur_effect;
+	struct vec3           points[4];
+	struct vec2           uvs[4];
+	struct gs_tvertarray  tvarray  = {2, uvs};
+	struct gs_vb_data     quad;
+	struct gs_vb_data     *data;
+	struct vec2           *batch_uvs;
+	struct matrix4        world;
+
+	if (!effect || !effect->cur_pass)
+		return false;
+
+	effect_pass_get_values(effect->cur_pass, &batch->cur_values.da);
+
+	if (batch->num_verts) {
+		bool same_values = batch->values.num == batch->cur_values.num &&
+			memcmp(batch->values.array, batch->cur_values.array,
+					batch->values.num) == 0;
+
+		if (batch->pass != effect->cur_pass || !same_values ||
+		    batch->num_verts + 6 > SPRITE_BATCH_VERTS)
+			sprite_batch_draw(graphics);
+	}
+
+	if (!batch->num_verts) {
+		batch->pass = effect->cur_pass;
+		da_copy(batch->values, batch->cur_values);
+	}
+
+	memset(&quad, 0, sizeof(quad));
+	quad.points  = points;
+	quad.num_tex = 1;
+	quad.tvarray = &tvarray;
+
+	if (gs_texture_is_rect(tex))
+		build_sprite_rect(&quad, tex, fcx, fcy, flip);
+	else
+		build_sprite_norm(&quad, fcx, fcy, flip);
+
+	gs_matrix_get(&world);
+
+	data = graphics->exports.gs_vertexbuffer_get_data(batch->vertbuffer);
+	batch_uvs = data->tvarray[0].array;
+
+	for (size_t i = 0; i < 6; i++) {
+		uint32_t idx = batch->num_verts++;
+
+		vec3_transform(data->points + idx, points + order[i], &world);
+		vec2_copy(batch_uvs + idx, uvs + order[i]);
+	}
+
+	return true;
+}
+
+void gs_sprite_batch_begin(void)
+{
+	graphics_t *graphics = thread_graphics;
+	if (!graphics) return;
+
+	graphics->sprite_batch.depth++;
+}
+
+void gs_sprite_batch_end(void)
+{
+	graphics_t *graphics = thread_graphics;
+	if (!graphics || !graphics->sprite_batch.depth) return;
+
+	if (--graphics->sprite_batch.depth == 0)
+		flush_sprite_batch(graphics);
+}
+
+void gs_sprite_batch_flush(void)
+{
+	graphics_t *graphics = thread_graphics;
+	if (!graphics) return;
+
+	flush_sprite_batch(graphics);
+}
+
 void gs_draw_sprite(gs_texture_t *tex, uint32_t flip, uint32_t width,
 		uint32_t height)
 {
@@ -862,6 +1140,10 @@ void gs_draw_sprite(gs_texture_t *tex, uint32_t flip, uint32_t width,
 	fcx = width  ? (float)width  : (float)gs_texture_get_width(tex);
 	fcy = height ? (float)height : (float)gs_texture_get_height(tex);
 
+	if (graphics->sprite_batch.depth &&
+	    sprite_batch_add(graphics, tex, fcx, fcy, flip))
+		return;
+
 	data = gs_vertexbuffer_get_data(graphics->sprite_buffer);
 	if (gs_texture_is_rect(tex))
 		build_sprite_rect(data, tex, fcx, fcy, flip);
@@ -875,6 +1157,93 @@ void gs_draw_sprite(gs_texture_t *tex, uint32_t flip, uint32_t width,
 	gs_draw(GS_TRISTRIP, 0, 0);
 }
 
+static inline void build_subsprite_norm(struct gs_vb_data *data,
+		float fsub_x, float fsub_y, float fsub_cx, float fsub_cy,
+		float fcx, float fcy, uint32_t flip)
+{
+	float start_u, end_u;
+	float start_v, end_v;
+
+	if ((flip & GS_FLIP_U) == 0) {
+		start_u = fsub_x / fcx;
+		end_u   = (fsub_x + fsub_cx) / fcx;
+	} else {
+		start_u = (fsub_x + fsub_cx) / fcx;
+		end_u   = fsub_x / fcx;
+	}
+
+	if ((flip & GS_FLIP_V) == 0) {
+		start_v = fsub_y / fcy;
+		end_v   = (fsub_y + fsub_cy) / fcy;
+	} else {
+		start_v = (fsub_y + fsub_cy) / fcy;
+		end_v   = fsub_y / fcy;
+	}
+
+	build_sprite(data, fsub_cx, fsub_cy, start_u, end_u, start_v, end_v);
+}
+
+static inline void build_subsprite_rect(struct gs_vb_data *data,
+		float fsub_x, float fsub_y, float fsub_cx, float fsub_cy,
+		uint32_t flip)
+{
+	float start_u, end_u;
+	float start_v, end_v;
+
+	if ((flip & GS_FLIP_U) == 0) {
+		start_u = fsub_x;
+		end_u   = fsub_x + fsub_cx;
+	} else {
+		start_u = fsub_x + fsub_cx;
+		end_u   = fsub_x;
+	}
+
+	if ((flip & GS_FLIP_V) == 0) {
+		start_v = fsub_y;
+		end_v   = fsub_y + fsub_cy;
+	} else {
+		start_v = fsub_y + fsub_cy;
+		end_v   = fsub_y;
+	}
+
+	build_sprite(data, fsub_cx, fsub_cy, start_u, end_u, start_v, end_v);
+}
+
+void gs_draw_sprite_subregion(gs_texture_t *tex, uint32_t flip,
+		uint32_t sub_x, uint32_t sub_y, uint32_t sub_cx,
+		uint32_t sub_cy)
+{
+	graphics_t *graphics = thread_graphics;
+	float fcx, fcy;
+	struct gs_vb_data *data;
+
+	assert(tex);
+	if (!tex || !thread_graphics)
+		return;
+
+	if (gs_get_texture_type(tex) != GS_TEXTURE_2D) {
+		blog(LOG_ERROR, "A sprite must be a 2D texture");
+		return;
+	}
+
+	fcx = (float)gs_texture_get_width(tex);
+	fcy = (float)gs_texture_get_height(tex);
+
+	data = gs_vertexbuffer_get_data(graphics->sprite_buffer);
+	if (gs_texture_is_rect(tex))
+		build_subsprite_rect(data, (float)sub_x, (float)sub_y,
+				(float)sub_cx, (float)sub_cy, flip);
+	else
+		build_subsprite_norm(data, (float)sub_x, (float)sub_y,
+				(float)sub_cx, (float)sub_cy, fcx, fcy, flip);
+
+	gs_vertexbuffer_flush(graphics->sprite_buffer);
+	gs_load_vertexbuffer(graphics->sprite_buffer);
+	gs_load_indexbuffer(NULL);
+
+	gs_draw(GS_TRISTRIP, 0, 0);
+}
+
 void gs_draw_cube_backdrop(gs_texture_t *cubetex, const struct quat *rot,
 		float left, float right, float top, float bottom, float znear)
 {
@@ -989,6 +1358,7 @@ void gs_perspective(float angle, float aspect, float near, float far)
 	float xmin, xmax, ymin, ymax;
 
 	if (!graphics) return;
+	flush_sprite_batch(graphics);
 
 	ymax = near * tanf(RAD(angle)*0.5f);
 	ymin = -ymax;
@@ -1099,6 +1469,190 @@ uint32_t gs_get_height(void)
 	return graphics->exports.device_get_height(graphics->device);
 }
 
+/* ------------------------------------------------------------------------- */
+
+gs_memory_tracker_t *gs_memory_tracker_create(void)
+{
+	gs_memory_tracker_t *tracker = bzalloc(sizeof(gs_memory_tracker_t));
+	tracker->refs = 1;
+	return tracker;
+}
+
+void gs_memory_tracker_release(gs_memory_tracker_t *tracker)
+{
+	if (tracker && os_atomic_dec_long(&tracker->refs) == 0)
+		bfree(tracker);
+}
+
+uint64_t gs_memory_tracker_get_bytes(gs_memory_tracker_t *tracker)
+{
+	return tracker ? (uint64_t)os_atomic_add_int64(&tracker->bytes, 0) : 0;
+}
+
+gs_memory_tracker_t *gs_set_memory_tracker(gs_memory_tracker_t *tracker)
+{
+	gs_memory_tracker_t *prev = thread_memory_tracker;
+	thread_memory_tracker = tracker;
+	return prev;
+}
+
+uint64_t gs_get_memory_usage(void)
+{
+	return (uint64_t)os_atomic_add_int64(&total_memory_usage, 0);
+}
+
+static size_t find_memory_entry(graphics_t *graphics, const void *resource)
+{
+	size_t lo = 0;
+	size_t hi = graphics->memory_entries.num;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if ((uintptr_t)graphics->memory_entries.array[mid].resource <
+		    (uintptr_t)resource)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static inline bool memory_entry_exists(graphics_t *graphics, size_t idx,
+		const void *resource)
+{
+	return idx < graphics->memory_entries.num &&
+		graphics->memory_entries.array[idx].resource == resource;
+}
+
+static void charge_memory(struct gs_memory_entry *entry,
+		gs_memory_tracker_t *tracker)
+{
+	if (entry->tracker == tracker)
+		return;
+
+	if (entry->tracker) {
+		os_atomic_add_int64(&entry->tracker->bytes,
+				-(int64_t)entry->size);
+		gs_memory_tracker_release(entry->tracker);
+	}
+
+	entry->tracker = tracker;
+
+	if (tracker) {
+		os_atomic_inc_long(&tracker->refs);
+		os_atomic_add_int64(&tracker->bytes, (int64_t)entry->size);
+	}
+}
+
+static void track_memory(graphics_t *graphics, const void *resource,
+		uint64_t size)
+{
+	struct gs_memory_entry *entry;
+	size_t idx;
+
+	if (!resource || !size)
+		return;
+
+	idx = find_memory_entry(graphics, resource);
+	if (memory_entry_exists(graphics, idx, resource))
+		return;
+
+	entry = da_insert_new(graphics->memory_entries, idx);
+	entry->resource = resource;
+	entry->size     = size;
+	entry->tracker  = NULL;
+
+	os_atomic_add_int64(&total_memory_usage, (int64_t)size);
+	charge_memory(entry, thread_memory_tracker);
+}
+
+static void untrack_memory(graphics_t *graphics, const void *resource)
+{
+	size_t idx = find_memory_entry(graphics, resource);
+	struct gs_memory_entry *entry;
+
+	if (!memory_entry_exists(graphics, idx, resource))
+		return;
+
+	entry = graphics->memory_entries.array + idx;
+	os_atomic_add_int64(&total_memory_usage, -(int64_t)entry->size);
+	charge_memory(entry, NULL);
+	da_erase(graphics->memory_entries, idx);
+}
+
+static void recharge_memory(graphics_t *graphics, const void *resource,
+		gs_memory_tracker_t *tracker)
+{
+	size_t idx = find_memory_entry(graphics, resource);
+
+	if (memory_entry_exists(graphics, idx, resource))
+		charge_memory(graphics->memory_entries.array + idx, tracker);
+}
+
+static uint64_t texture_memory_size(uint32_t width, uint32_t height,
+		uint32_t depth, enum gs_color_format format, uint32_t levels)
+{
+	uint64_t bpp  = gs_get_format_bpp(format);
+	uint64_t size = 0;
+
+	if (!levels)
+		levels = gs_get_total_levels(width, height) + 1;
+
+	for (uint32_t i = 0; i < levels; i++) {
+		size += (uint64_t)width * height * depth * bpp / 8;
+
+		if (width > 1)  width  /= 2;
+		if (height > 1) height /= 2;
+		if (depth > 1)  depth  /= 2;
+	}
+
+	return size;
+}
+
+static inline uint64_t zstencil_memory_size(uint32_t width, uint32_t height,
+		enum gs_zstencil_format format)
+{
+	uint64_t bytes;
+
+	switch (format) {
+	case GS_Z16:        bytes = 2; break;
+	case GS_Z24_S8:     bytes = 4; break;
+	case GS_Z32F:       bytes = 4; break;
+	case GS_Z32F_S8X24: bytes = 8; break;
+	default:            bytes = 0;
+	}
+
+	return (uint64_t)width * height * bytes;
+}
+
+static uint64_t vertexbuffer_memory_size(const struct gs_vb_data *data)
+{
+	uint64_t vertex_size = 0;
+
+	if (!data)
+		return 0;
+
+	if (data->points)   vertex_size += sizeof(struct vec3);
+	if (data->normals)  vertex_size += sizeof(struct vec3);
+	if (data->tangents) vertex_size += sizeof(struct vec3);
+	if (data->colors)   vertex_size += sizeof(uint32_t);
+
+	for (size_t i = 0; i < data->num_tex; i++)
+		vertex_size += data->tvarray[i].width * sizeof(float);
+
+	return vertex_size * data->num;
+}
+
+static inline uint64_t shared_texture_memory_size(gs_texture_t *tex)
+{
+	return texture_memory_size(gs_texture_get_width(tex),
+			gs_texture_get_height(tex), 1,
+			gs_texture_get_color_format(tex), 1);
+}
+
+/* ------------------------------------------------------------------------- */
+
 static inline bool is_pow2(uint32_t size)
 {
 	return size >= 2 && (size & (size-1)) == 0;
@@ -1109,13 +1663,17 @@ gs_texture_t *gs_texture_create(uint32_t width, uint32_t height,
 		const uint8_t **data, uint32_t flags)
 {
 	graphics_t *graphics = thread_graphics;
+	gs_texture_t *obj;
+	int prev_tag;
 	bool pow2tex = is_pow2(width) && is_pow2(height);
 	bool uses_mipmaps = (flags & GS_BUILD_MIPMAPS || levels != 1);
 
 	if (!graphics)
 		return NULL;
 
-	if (uses_mipmaps && !pow2tex) {
+	/* mipmap chains that come with their data can be any size, only
+	 * generated ones have to be a power of two */
+	if (uses_mipmaps && !pow2tex && (!data || flags & GS_BUILD_MIPMAPS)) {
 		blog(LOG_WARNING, "Cannot use mipmaps with a "
 		                  "non-power-of-two texture.  Disabling "
 		                  "mipmaps for this texture.");
@@ -1132,8 +1690,15 @@ gs_texture_t *gs_texture_create(uint32_t width, uint32_t height,
 		levels = 1;
 	}
 
-	return graphics->exports.device_texture_create(graphics->device,
+	prev_tag = bmem_set_thread_tag(graphics_mem_tag());
+	obj = graphics->exports.device_texture_create(graphics->device,
 			width, height, color_format, levels, data, flags);
+	bmem_set_thread_tag(prev_tag);
+
+	track_memory(graphics, obj, texture_memory_size(width, height, 1,
+				color_format,
+				(flags & GS_BUILD_MIPMAPS) ? 0 : levels));
+	return obj;
 }
 
 gs_texture_t *gs_cubetexture_create(uint32_t size,
@@ -1141,6 +1706,8 @@ gs_texture_t *gs_cubetexture_create(uint32_t size,
 		const uint8_t **data, uint32_t flags)
 {
 	graphics_t *graphics = thread_graphics;
+	gs_texture_t *obj;
+	int prev_tag;
 	bool pow2tex = is_pow2(size);
 	bool uses_mipmaps = (flags & GS_BUILD_MIPMAPS || levels != 1);
 
@@ -1165,8 +1732,15 @@ gs_texture_t *gs_cubetexture_create(uint32_t size,
 		data   = NULL;
 	}
 
-	return graphics->exports.device_cubetexture_create(graphics->device,
+	prev_tag = bmem_set_thread_tag(graphics_mem_tag());
+	obj = graphics->exports.device_cubetexture_create(graphics->device,
 			size, color_format, levels, data, flags);
+	bmem_set_thread_tag(prev_tag);
+
+	track_memory(graphics, obj, 6 * texture_memory_size(size, size, 1,
+				color_format,
+				(flags & GS_BUILD_MIPMAPS) ? 0 : levels));
+	return obj;
 }
 
 gs_texture_t *gs_voltexture_create(uint32_t width, uint32_t height,
@@ -1174,80 +1748,139 @@ gs_texture_t *gs_voltexture_create(uint32_t width, uint32_t height,
 		uint32_t levels, const uint8_t **data, uint32_t flags)
 {
 	graphics_t *graphics = thread_graphics;
+	gs_texture_t *obj;
+	int prev_tag;
 	if (!graphics) return NULL;
 
-	return graphics->exports.device_voltexture_create(graphics->device,
+	prev_tag = bmem_set_thread_tag(graphics_mem_tag());
+	obj = graphics->exports.device_voltexture_create(graphics->device,
 			width, height, depth, color_format, levels, data,
 			flags);
+	bmem_set_thread_tag(prev_tag);
+
+	track_memory(graphics, obj, texture_memory_size(width, height, depth,
+				color_format,
+				(flags & GS_BUILD_MIPMAPS) ? 0 : levels));
+	return obj;
 }
 
 gs_zstencil_t *gs_zstencil_create(uint32_t width, uint32_t height,
 		enum gs_zstencil_format format)
 {
 	graphics_t *graphics = thread_graphics;
+	gs_zstencil_t *obj;
+	int prev_tag;
 	if (!graphics) return NULL;
 
-	return graphics->exports.device_zstencil_create(graphics->device,
+	prev_tag = bmem_set_thread_tag(graphics_mem_tag());
+	obj = graphics->exports.device_zstencil_create(graphics->device,
 			width, height, format);
+	bmem_set_thread_tag(prev_tag);
+
+	track_memory(graphics, obj, zstencil_memory_size(width, height,
+				format));
+	return obj;
 }
 
 gs_stagesurf_t *gs_stagesurface_create(uint32_t width, uint32_t height,
 		enum gs_color_format color_format)
 {
 	graphics_t *graphics = thread_graphics;
+	gs_stagesurf_t *obj;
+	int prev_tag;
 	if (!graphics) return NULL;
 
-	return graphics->exports.device_stagesurface_create(graphics->device,
+	prev_tag = bmem_set_thread_tag(graphics_mem_tag());
+	obj = graphics->exports.device_stagesurface_create(graphics->device,
 			width, height, color_format);
+	bmem_set_thread_tag(prev_tag);
+
+	track_memory(graphics, obj, texture_memory_size(width, height, 1,
+				color_format, 1));
+	return obj;
 }
 
 gs_samplerstate_t *gs_samplerstate_create(const struct gs_sampler_info *info)
 {
 	graphics_t *graphics = thread_graphics;
+	gs_samplerstate_t *obj;
+	int prev_tag;
 	if (!graphics) return NULL;
 
-	return graphics->exports.device_samplerstate_create(graphics->device,
+	prev_tag = bmem_set_thread_tag(graphics_mem_tag());
+	obj = graphics->exports.device_samplerstate_create(graphics->device,
 			info);
+	bmem_set_thread_tag(prev_tag);
+	return obj;
 }
 
 gs_shader_t *gs_vertexshader_create(const char *shader, const char *file,
 		char **error_string)
 {
 	graphics_t *graphics = thread_graphics;
+	gs_shader_t *obj;
+	int prev_tag;
 	if (!graphics) return NULL;
 
-	return graphics->exports.device_vertexshader_create(graphics->device,
+	prev_tag = bmem_set_thread_tag(graphics_mem_tag());
+	obj = graphics->exports.device_vertexshader_create(graphics->device,
 			shader, file, error_string);
+	bmem_set_thread_tag(prev_tag);
+	return obj;
 }
 
 gs_shader_t *gs_pixelshader_create(const char *shader,
 		const char *file, char **error_string)
 {
 	graphics_t *graphics = thread_graphics;
+	gs_shader_t *obj;
+	int prev_tag;
 	if (!graphics) return NULL;
 
-	return graphics->exports.device_pixelshader_create(graphics->device,
+	prev_tag = bmem_set_thread_tag(graphics_mem_tag());
+	obj = graphics->exports.device_pixelshader_create(graphics->device,
 			shader, file, error_string);
+	bmem_set_thread_tag(prev_tag);
+	return obj;
 }
 
 gs_vertbuffer_t *gs_vertexbuffer_create(struct gs_vb_data *data,
 		uint32_t flags)
 {
 	graphics_t *graphics = thread_graphics;
+	gs_vertbuffer_t *obj;
+	uint64_t size;
+	int prev_tag;
 	if (!graphics) return NULL;
 
-	return graphics->exports.device_vertexbuffer_create(graphics->device,
+	/* the device takes ownership of the data */
+	size = vertexbuffer_memory_size(data);
+
+	prev_tag = bmem_set_thread_tag(graphics_mem_tag());
+	obj = graphics->exports.device_vertexbuffer_create(graphics->device,
 			data, flags);
+	bmem_set_thread_tag(prev_tag);
+
+	track_memory(graphics, obj, size);
+	return obj;
 }
 
 gs_indexbuffer_t *gs_indexbuffer_create(enum gs_index_type type,
 		void *indices, size_t num, uint32_t flags)
 {
 	graphics_t *graphics = thread_graphics;
+	gs_indexbuffer_t *obj;
+	int prev_tag;
 	if (!graphics) return NULL;
 
-	return graphics->exports.device_indexbuffer_create(graphics->device,
+	prev_tag = bmem_set_thread_tag(graphics_mem_tag());
+	obj = graphics->exports.device_indexbuffer_create(graphics->device,
 			type, indices, num, flags);
+	bmem_set_thread_tag(prev_tag);
+
+	track_memory(graphics, obj, (uint64_t)num *
+			(type == GS_UNSIGNED_SHORT ? 2 : 4));
+	return obj;
 }
 
 enum gs_texture_type gs_get_texture_type(const gs_texture_t *texture)
@@ -1263,6 +1896,7 @@ void gs_load_vertexbuffer(gs_vertbuffer_t *vertbuffer)
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
 
+	graphics->cur_vertbuffer = vertbuffer;
 	graphics->exports.device_load_vertexbuffer(graphics->device,
 			vertbuffer);
 }
@@ -1272,6 +1906,7 @@ void gs_load_indexbuffer(gs_indexbuffer_t *indexbuffer)
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
 
+	graphics->cur_indexbuffer = indexbuffer;
 	graphics->exports.device_load_indexbuffer(graphics->device,
 			indexbuffer);
 }
@@ -1356,6 +1991,7 @@ void gs_set_render_target(gs_texture_t *tex, gs_zstencil_t *zstencil)
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.device_set_render_target(graphics->device, tex,
 			zstencil);
@@ -1366,6 +2002,7 @@ void gs_set_cube_render_target(gs_texture_t *cubetex, int side,
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.device_set_cube_render_target(graphics->device,
 			cubetex, side, zstencil);
@@ -1375,6 +2012,7 @@ void gs_copy_texture(gs_texture_t *dst, gs_texture_t *src)
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.device_copy_texture(graphics->device, dst, src);
 }
@@ -1385,6 +2023,7 @@ void gs_copy_texture_region(gs_texture_t *dst, uint32_t dst_x, uint32_t dst_y,
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.device_copy_texture_region(graphics->device,
 			dst, dst_x, dst_y,
@@ -1395,6 +2034,7 @@ void gs_stage_texture(gs_stagesurf_t *dst, gs_texture_t *src)
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.device_stage_texture(graphics->device, dst, src);
 }
@@ -1403,6 +2043,7 @@ void gs_begin_scene(void)
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.device_begin_scene(graphics->device);
 }
@@ -1412,6 +2053,7 @@ void gs_draw(enum gs_draw_mode draw_mode, uint32_t start_vert,
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.device_draw(graphics->device, draw_mode,
 			start_vert, num_verts);
@@ -1421,6 +2063,7 @@ void gs_end_scene(void)
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.device_end_scene(graphics->device);
 }
@@ -1429,6 +2072,7 @@ void gs_load_swapchain(gs_swapchain_t *swapchain)
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.device_load_swapchain(graphics->device, swapchain);
 }
@@ -1437,6 +2081,8 @@ void gs_clear(uint32_t clear_flags, const struct vec4 *color, float depth,
 		uint8_t stencil)
 {
 	graphics_t *graphics = thread_graphics;
+	flush_sprite_batch(graphics);
+
 	graphics->exports.device_clear(graphics->device, clear_flags, color,
 			depth, stencil);
 }
@@ -1445,6 +2091,7 @@ void gs_present(void)
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.device_present(graphics->device);
 }
@@ -1453,6 +2100,7 @@ void gs_flush(void)
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.device_flush(graphics->device);
 }
@@ -1461,6 +2109,7 @@ void gs_set_cull_mode(enum gs_cull_mode mode)
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.device_set_cull_mode(graphics->device, mode);
 }
@@ -1478,6 +2127,9 @@ void gs_enable_blending(bool enable)
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
 
+	if (graphics->cur_blend_state.enabled != enable)
+		flush_sprite_batch(graphics);
+
 	graphics->cur_blend_state.enabled = enable;
 	graphics->exports.device_enable_blending(graphics->device, enable);
 }
@@ -1486,6 +2138,7 @@ void gs_enable_depth_test(bool enable)
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.device_enable_depth_test(graphics->device, enable);
 }
@@ -1494,6 +2147,7 @@ void gs_enable_stencil_test(bool enable)
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.device_enable_stencil_test(graphics->device, enable);
 }
@@ -1502,6 +2156,7 @@ void gs_enable_stencil_write(bool enable)
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.device_enable_stencil_write(graphics->device, enable);
 }
@@ -1510,6 +2165,7 @@ void gs_enable_color(bool red, bool green, bool blue, bool alpha)
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.device_enable_color(graphics->device, red, green,
 			blue, alpha);
@@ -1520,6 +2176,12 @@ void gs_blend_function(enum gs_blend_type src, enum gs_blend_type dest)
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
 
+	if (graphics->cur_blend_state.src_c  != src ||
+	    graphics->cur_blend_state.dest_c != dest ||
+	    graphics->cur_blend_state.src_a  != src ||
+	    graphics->cur_blend_state.dest_a != dest)
+		flush_sprite_batch(graphics);
+
 	graphics->cur_blend_state.src_c  = src;
 	graphics->cur_blend_state.dest_c = dest;
 	graphics->cur_blend_state.src_a  = src;
@@ -1534,6 +2196,12 @@ void gs_blend_function_separate(
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
 
+	if (graphics->cur_blend_state.src_c  != src_c ||
+	    graphics->cur_blend_state.dest_c != dest_c ||
+	    graphics->cur_blend_state.src_a  != src_a ||
+	    graphics->cur_blend_state.dest_a != dest_a)
+		flush_sprite_batch(graphics);
+
 	graphics->cur_blend_state.src_c  = src_c;
 	graphics->cur_blend_state.dest_c = dest_c;
 	graphics->cur_blend_state.src_a  = src_a;
@@ -1546,6 +2214,7 @@ void gs_depth_function(enum gs_depth_test test)
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.device_depth_function(graphics->device, test);
 }
@@ -1554,6 +2223,7 @@ void gs_stencil_function(enum gs_stencil_side side, enum gs_depth_test test)
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.device_stencil_function(graphics->device, side, test);
 }
@@ -1563,6 +2233,7 @@ void gs_stencil_op(enum gs_stencil_side side, enum gs_stencil_op_type fail,
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.device_stencil_op(graphics->device, side, fail, zfail,
 			zpass);
@@ -1572,6 +2243,7 @@ void gs_set_viewport(int x, int y, int width, int height)
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.device_set_viewport(graphics->device, x, y, width,
 			height);
@@ -1589,6 +2261,7 @@ void gs_set_scissor_rect(const struct gs_rect *rect)
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.device_set_scissor_rect(graphics->device, rect);
 }
@@ -1598,6 +2271,7 @@ void gs_ortho(float left, float right, float top, float bottom, float znear,
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.device_ortho(graphics->device, left, right, top,
 			bottom, znear, zfar);
@@ -1608,6 +2282,7 @@ void gs_frustum(float left, float right, float top, float bottom, float znear,
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.device_frustum(graphics->device, left, right, top,
 			bottom, znear, zfar);
@@ -1625,6 +2300,7 @@ void gs_projection_pop(void)
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.device_projection_pop(graphics->device);
 }
@@ -1637,10 +2313,22 @@ void gs_swapchain_destroy(gs_swapchain_t *swapchain)
 	graphics->exports.gs_swapchain_destroy(swapchain);
 }
 
+bool gs_swapchain_ready(gs_swapchain_t *swapchain)
+{
+	graphics_t *graphics = thread_graphics;
+	if (!graphics || !swapchain) return false;
+
+	if (!graphics->exports.gs_swapchain_ready)
+		return true;
+
+	return graphics->exports.gs_swapchain_ready(swapchain);
+}
+
 void gs_shader_destroy(gs_shader_t *shader)
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics || !shader) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.gs_shader_destroy(shader);
 }
@@ -1782,11 +2470,105 @@ void gs_shader_set_default(gs_sparam_t *param)
 	graphics->exports.gs_shader_set_default(param);
 }
 
+/* ------------------------------------------------------------------------- */
+
+#define RENDER_TARGET_POOL_MAX    16
+#define RENDER_TARGET_EXPIRE_NS   2000000000ULL
+
+gs_texture_t *gs_render_target_acquire(enum gs_color_format format,
+		uint32_t cx, uint32_t cy)
+{
+	graphics_t *graphics = thread_graphics;
+	if (!graphics) return NULL;
+
+	for (size_t i = graphics->render_target_pool.num; i > 0; i--) {
+		struct render_target_entry *entry =
+			graphics->render_target_pool.array + (i - 1);
+
+		if (entry->format == format && entry->cx == cx &&
+		    entry->cy == cy) {
+			gs_texture_t *tex = entry->tex;
+			da_erase(graphics->render_target_pool, i - 1);
+			recharge_memory(graphics, tex, thread_memory_tracker);
+			return tex;
+		}
+	}
+
+	return gs_texture_create(cx, cy, format, 1, NULL, GS_RENDER_TARGET);
+}
+
+void gs_render_target_release(gs_texture_t *tex)
+{
+	graphics_t *graphics = thread_graphics;
+	struct render_target_entry *entry;
+
+	if (!graphics || !tex) return;
+
+	/* the oldest entries are at the front */
+	if (graphics->render_target_pool.num == RENDER_TARGET_POOL_MAX) {
+		gs_texture_destroy(graphics->render_target_pool.array[0].tex);
+		da_erase(graphics->render_target_pool, 0);
+	}
+
+	/* pooled targets aren't charged to anyone */
+	recharge_memory(graphics, tex, NULL);
+
+	entry = da_push_back_new(graphics->render_target_pool);
+	entry->tex          = tex;
+	entry->format       = gs_texture_get_color_format(tex);
+	entry->cx           = gs_texture_get_width(tex);
+	entry->cy           = gs_texture_get_height(tex);
+	entry->release_time = os_gettime_ns();
+}
+
+void gs_render_target_pool_update(void)
+{
+	graphics_t *graphics = thread_graphics;
+	uint64_t   expire_time;
+
+	if (!graphics) return;
+
+	for (size_t i = graphics->transient_texrenders.num; i > 0; i--) {
+		gs_texrender_t *texrender =
+			graphics->transient_texrenders.array[i - 1];
+
+		if (texrender_release_unused(texrender))
+			da_erase(graphics->transient_texrenders, i - 1);
+	}
+
+	expire_time = os_gettime_ns() - RENDER_TARGET_EXPIRE_NS;
+
+	while (graphics->render_target_pool.num &&
+	       graphics->render_target_pool.array[0].release_time <
+	       expire_time) {
+		gs_texture_destroy(graphics->render_target_pool.array[0].tex);
+		da_erase(graphics->render_target_pool, 0);
+	}
+}
+
+void texrender_add_transient(gs_texrender_t *texrender)
+{
+	graphics_t *graphics = thread_graphics;
+	if (!graphics) return;
+
+	da_push_back(graphics->transient_texrenders, &texrender);
+}
+
+void texrender_remove_transient(gs_texrender_t *texrender)
+{
+	graphics_t *graphics = thread_graphics;
+	if (!graphics) return;
+
+	da_erase_item(graphics->transient_texrenders, &texrender);
+}
+
 void gs_texture_destroy(gs_texture_t *tex)
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics || !tex) return;
+	flush_sprite_batch(graphics);
 
+	untrack_memory(graphics, tex);
 	graphics->exports.gs_texture_destroy(tex);
 }
 
@@ -1818,6 +2600,7 @@ bool gs_texture_map(gs_texture_t *tex, uint8_t **ptr, uint32_t *linesize)
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics || !tex) return false;
+	flush_sprite_batch(graphics);
 
 	return graphics->exports.gs_texture_map(tex, ptr, linesize);
 }
@@ -1853,6 +2636,7 @@ void gs_cubetexture_destroy(gs_texture_t *cubetex)
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics || !cubetex) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.gs_cubetexture_destroy(cubetex);
 }
@@ -1878,6 +2662,7 @@ void gs_voltexture_destroy(gs_texture_t *voltex)
 {
 	graphics_t *graphics = thread_graphics;
 	if (!graphics || !voltex) return;
+	flush_sprite_batch(graphics);
 
 	graphics->exports.gs_voltexture_destroy(voltex);
 }
@@ -1919,6 +2704,7 @@ void gs_stagesurface_destroy(gs_stagesurf_t *stagesurf)
 	graphics_t *graphics = thread_graphics;
 	if (!graphics || !stagesurf) return;
 
+	untrack_memory(graphics, stagesurf);
 	graphics->exports.gs_stagesurface_destroy(stagesurf);
 }
 
@@ -1956,6 +2742,20 @@ bool gs_stagesurface_map(gs_stagesurf_t *stagesurf, uint8_t **data,
 	return graphics->exports.gs_stagesurface_map(stagesurf, data, linesize);
 }
 
+bool gs_stagesurface_try_map(gs_stagesurf_t *stagesurf, uint8_t **data,
+		uint32_t *linesize)
+{
+	graphics_t *graphics = thread_graphics;
+	if (!graphics || !stagesurf) return false;
+
+	if (!graphics->exports.gs_stagesurface_try_map)
+		return graphics->exports.gs_stagesurface_map(stagesurf, data,
+				linesize);
+
+	return graphics->exports.gs_stagesurface_try_map(stagesurf, data,
+			linesize);
+}
+
 void gs_stagesurface_unmap(gs_stagesurf_t *stagesurf)
 {
 	graphics_t *graphics = thread_graphics;
@@ -1968,6 +2768,7 @@ void gs_zstencil_destroy(gs_zstencil_t *zstencil)
 {
 	if (!thread_graphics || !zstencil) return;
 
+	untrack_memory(thread_graphics, zstencil);
 	thread_graphics->exports.gs_zstencil_destroy(zstencil);
 }
 
@@ -1983,6 +2784,9 @@ void gs_vertexbuffer_destroy(gs_vertbuffer_t *vertbuffer)
 	graphics_t *graphics = thread_graphics;
 	if (!graphics || !vertbuffer) return;
 
+	if (graphics->cur_vertbuffer == vertbuffer)
+		graphics->cur_vertbuffer = NULL;
+	untrack_memory(graphics, vertbuffer);
 	graphics->exports.gs_vertexbuffer_destroy(vertbuffer);
 }
 
@@ -2005,6 +2809,9 @@ void gs_indexbuffer_destroy(gs_indexbuffer_t *indexbuffer)
 	graphics_t *graphics = thread_graphics;
 	if (!graphics || !indexbuffer) return;
 
+	if (graphics->cur_indexbuffer == indexbuffer)
+		graphics->cur_indexbuffer = NULL;
+	untrack_memory(graphics, indexbuffer);
 	graphics->exports.gs_indexbuffer_destroy(indexbuffer);
 }
 
@@ -2037,6 +2844,97 @@ enum gs_index_type gs_indexbuffer_get_type(const gs_indexbuffer_t *indexbuffer)
 	return thread_graphics->exports.gs_indexbuffer_get_type(indexbuffer);
 }
 
+/* the other timer functions are only called with objects from the create
+ * functions, which only succeed if the subsystem exports all of them */
+static inline bool timers_supported(graphics_t *graphics)
+{
+	return graphics && graphics->exports.device_timer_create &&
+		graphics->exports.device_timer_range_create &&
+		graphics->exports.gs_timer_destroy &&
+		graphics->exports.gs_timer_begin &&
+		graphics->exports.gs_timer_end &&
+		graphics->exports.gs_timer_get_data &&
+		graphics->exports.gs_timer_range_destroy &&
+		graphics->exports.gs_timer_range_begin &&
+		graphics->exports.gs_timer_range_end &&
+		graphics->exports.gs_timer_range_get_data;
+}
+
+gs_timer_t *gs_timer_create(void)
+{
+	graphics_t *graphics = thread_graphics;
+	if (!timers_supported(graphics)) return NULL;
+
+	return graphics->exports.device_timer_create(graphics->device);
+}
+
+void gs_timer_destroy(gs_timer_t *timer)
+{
+	if (!thread_graphics || !timer) return;
+
+	thread_graphics->exports.gs_timer_destroy(timer);
+}
+
+void gs_timer_begin(gs_timer_t *timer)
+{
+	if (!thread_graphics || !timer) return;
+
+	thread_graphics->exports.gs_timer_begin(timer);
+}
+
+void gs_timer_end(gs_timer_t *timer)
+{
+	if (!thread_graphics || !timer) return;
+
+	thread_graphics->exports.gs_timer_end(timer);
+}
+
+bool gs_timer_get_data(gs_timer_t *timer, uint64_t *ticks)
+{
+	if (!thread_graphics || !timer || !ticks) return false;
+
+	return thread_graphics->exports.gs_timer_get_data(timer, ticks);
+}
+
+gs_timer_range_t *gs_timer_range_create(void)
+{
+	graphics_t *graphics = thread_graphics;
+	if (!timers_supported(graphics)) return NULL;
+
+	return graphics->exports.device_timer_range_create(graphics->device);
+}
+
+void gs_timer_range_destroy(gs_timer_range_t *range)
+{
+	if (!thread_graphics || !range) return;
+
+	thread_graphics->exports.gs_timer_range_destroy(range);
+}
+
+void gs_timer_range_begin(gs_timer_range_t *range)
+{
+	if (!thread_graphics || !range) return;
+
+	thread_graphics->exports.gs_timer_range_begin(range);
+}
+
+void gs_timer_range_end(gs_timer_range_t *range)
+{
+	if (!thread_graphics || !range) return;
+
+	thread_graphics->exports.gs_timer_range_end(range);
+}
+
+bool gs_timer_range_get_data(gs_timer_range_t *range, bool *disjoint,
+		uint64_t *frequency)
+{
+	if (!thread_graphics || !range || !disjoint || !frequency)
+		return false;
+
+	return thread_graphics->exports.gs_timer_range_get_data(range,
+			disjoint, frequency);
+}
+
 #ifdef __APPLE__
 
 /** Platform specific functions */
@@ -2057,6 +2955,7 @@ bool gs_texture_rebind_iosurface(gs_texture_t *texture, void *iosurf)
 	if (!graphics || !iosurf ||
 	    !graphics->exports.gs_texture_rebind_iosurface)
 		return false;
+	flush_sprite_batch(graphics);
 
 	return graphics->exports.gs_texture_rebind_iosurface(texture, iosurf);
 }
@@ -2120,6 +3019,7 @@ bool gs_duplicator_update_frame(gs_duplicator_t *duplicator)
 	if (!thread_graphics->exports.gs_duplicator_get_texture)
 		return true;
 
+	flush_sprite_batch(thread_graphics);
 	return thread_graphics->exports.gs_duplicator_update_frame(duplicator);
 }
 
@@ -2137,12 +3037,16 @@ gs_texture_t *gs_duplicator_get_texture(gs_duplicator_t *duplicator)
 gs_texture_t *gs_texture_create_gdi(uint32_t width, uint32_t height)
 {
 	graphics_t *graphics = thread_graphics;
+	gs_texture_t *tex = NULL;
 	if (!graphics) return NULL;
 
 	if (graphics->exports.device_texture_create_gdi)
-		return graphics->exports.device_texture_create_gdi(
+		tex = graphics->exports.device_texture_create_gdi(
 				graphics->device, width, height);
-	return NULL;
+
+	track_memory(graphics, tex, texture_memory_size(width, height, 1,
+				GS_BGRA, 1));
+	return tex;
 }
 
 void *gs_texture_get_dc(gs_texture_t *gdi_tex)
@@ -2150,6 +3054,8 @@ void *gs_texture_get_dc(gs_texture_t *gdi_tex)
 	if (!thread_graphics || !gdi_tex)
 		return NULL;
 
+	flush_sprite_batch(thread_graphics);
+
 	if (thread_graphics->exports.gs_texture_get_dc)
 		return thread_graphics->exports.gs_texture_get_dc(gdi_tex);
 	return NULL;
@@ -2167,13 +3073,27 @@ void gs_texture_release_dc(gs_texture_t *gdi_tex)
 gs_texture_t *gs_texture_open_shared(uint32_t handle)
 {
 	graphics_t *graphics = thread_graphics;
+	gs_texture_t *tex = NULL;
+
 	if (!graphics)
 		return NULL;
 
 	if (graphics->exports.device_texture_open_shared)
-		return graphics->exports.device_texture_open_shared(
+		tex = graphics->exports.device_texture_open_shared(
 				graphics->device, handle);
-	return NULL;
+
+	if (tex)
+		track_memory(graphics, tex, shared_texture_memory_size(tex));
+	return tex;
+}
+
+void gs_texture_update_shared(gs_texture_t *tex)
+{
+	if (!thread_graphics || !tex)
+		return;
+
+	if (thread_graphics->exports.gs_texture_update_shared)
+		thread_graphics->exports.gs_texture_update_shared(tex);
 }
 
 #endif
@@ -71,7 +71,8 @@ enum gs_color_format {
 	GS_R32F,
 	GS_DXT1,
 	GS_DXT3,
-	GS_DXT5
+	GS_DXT5,
+	GS_R8G8
 };
 
 enum gs_zstencil_format {
@@ -257,6 +258,8 @@ struct graphics_subsystem;
 
 typedef struct gs_texture          gs_texture_t;
 typedef struct gs_stage_surface    gs_stagesurf_t;
+typedef struct gs_timer            gs_timer_t;
+typedef struct gs_timer_range      gs_timer_range_t;
 typedef struct gs_zstencil_buffer  gs_zstencil_t;
 typedef struct gs_vertex_buffer    gs_vertbuffer_t;
 typedef struct gs_index_buffer     gs_indexbuffer_t;
@@ -366,6 +369,40 @@ EXPORT gs_eparam_t *gs_effect_get_param_by_idx(const gs_effect_t *effect,
 EXPORT gs_eparam_t *gs_effect_get_param_by_name(const gs_effect_t *effect,
 		const char *name);
 
+/**
+ * Cached parameter handle, for looking up parameters by name in render code
+ * without searching the effect on every call.  Zero-initialize it; it can be
+ * used with any number of effects, but only remembers the last one.
+ */
+struct gs_eparam_ref {
+	uint64_t    effect_id;
+	gs_eparam_t *param;
+};
+
+/**
+ * Returns the named parameter of the effect, only searching for it the first
+ * time the reference is used with that effect.  Effects never reuse an ID, so
+ * a reference can't return a parameter of a destroyed effect.
+ */
+EXPORT gs_eparam_t *gs_effect_get_param_ref(const gs_effect_t *effect,
+		struct gs_eparam_ref *ref, const char *name);
+
+/**
+ * Declares a static reference for the named parameter, and a function to get
+ * it, for code that always sets the same parameter of whichever effect is
+ * current:
+ *
+ *   GS_EFFECT_PARAM_GETTER(get_image_param, "image")
+ *   ...
+ *   gs_effect_set_texture(get_image_param(effect), tex);
+ */
+#define GS_EFFECT_PARAM_GETTER(func, name) \
+	static inline gs_eparam_t *func(const gs_effect_t *effect) \
+	{ \
+		static struct gs_eparam_ref ref; \
+		return gs_effect_get_param_ref(effect, &ref, name); \
+	}
+
 /** Helper function to simplify effect usage.  Use with a while loop that
  * contains drawing functions.  Automatically handles techniques, passes, and
  * unloading. */
@@ -397,6 +434,16 @@ EXPORT void gs_effect_set_default(gs_eparam_t *param);
 
 EXPORT gs_texrender_t *gs_texrender_create(enum gs_color_format format,
 		enum gs_zstencil_format zsformat);
+
+/**
+ * Creates a texture render that only borrows its render target for a frame
+ *
+ *   The target goes back to the render target pool if the texture render
+ * hasn't been rendered again since its last gs_texrender_reset call, so the
+ * texture is only valid until the next reset.
+ */
+EXPORT gs_texrender_t *gs_texrender_create_transient(
+		enum gs_color_format format, enum gs_zstencil_format zsformat);
 EXPORT void gs_texrender_destroy(gs_texrender_t *texrender);
 EXPORT bool gs_texrender_begin(gs_texrender_t *texrender, uint32_t cx,
 		uint32_t cy);
@@ -404,6 +451,60 @@ EXPORT void gs_texrender_end(gs_texrender_t *texrender);
 EXPORT void gs_texrender_reset(gs_texrender_t *texrender);
 EXPORT gs_texture_t *gs_texrender_get_texture(const gs_texrender_t *texrender);
 
+/* ---------------------------------------------------
+ * render target pool
+ * --------------------------------------------------- */
+
+/**
+ * Gets a render target texture from the pool, or creates one if none of the
+ * requested format and size is free.  Give it back with
+ * gs_render_target_release instead of destroying it.
+ */
+EXPORT gs_texture_t *gs_render_target_acquire(enum gs_color_format format,
+		uint32_t cx, uint32_t cy);
+EXPORT void gs_render_target_release(gs_texture_t *tex);
+
+/**
+ * Reclaims the targets of transient texture renders that weren't rendered
+ * this frame, and frees pooled targets that haven't been used for a while.
+ * Call once per frame.
+ */
+EXPORT void gs_render_target_pool_update(void);
+
+/* ---------------------------------------------------
+ * video memory accounting
+ * --------------------------------------------------- */
+
+struct gs_memory_tracker;
+typedef struct gs_memory_tracker gs_memory_tracker_t;
+
+/**
+ * Creates a counter for the estimated video memory of the textures, stage
+ * surfaces, z-stencil buffers and vertex/index buffers created while it is
+ * the current tracker of the creating thread.  Render targets taken from the
+ * pool are charged to the tracker that is current when they're acquired.
+ */
+EXPORT gs_memory_tracker_t *gs_memory_tracker_create(void);
+
+/**
+ * Releases a tracker.  Resources still charged to it keep it alive until
+ * they're destroyed.
+ */
+EXPORT void gs_memory_tracker_release(gs_memory_tracker_t *tracker);
+
+/** Gets the bytes currently charged to a tracker, from any thread */
+EXPORT uint64_t gs_memory_tracker_get_bytes(gs_memory_tracker_t *tracker);
+
+/**
+ * Sets the tracker new resources of the calling thread are charged to, and
+ * returns the previous one so it can be restored.  NULL charges nobody.
+ */
+EXPORT gs_memory_tracker_t *gs_set_memory_tracker(
+		gs_memory_tracker_t *tracker);
+
+/** Gets the estimated video memory of all live resources, from any thread */
+EXPORT uint64_t gs_get_memory_usage(void);
+
 /* ---------------------------------------------------
  * graphics subsystem
  * --------------------------------------------------- */
@@ -447,6 +548,12 @@ struct gs_init_data {
 
 EXPORT const char *gs_get_device_name(void);
 EXPORT int gs_get_device_type(void);
+
+/**
+ * Sets the directory compiled shaders are cached in between runs, if the
+ * graphics module supports it.  Set before creating any effects.
+ */
+EXPORT void gs_set_shader_cache_path(const char *path);
 EXPORT void gs_enum_adapters(
 		bool (*callback)(void *param, const char *name, uint32_t id),
 		void *param);
@@ -491,6 +598,13 @@ EXPORT void gs_texcoord2v(const struct vec2 *v, int unit);
 EXPORT input_t *gs_get_input(void);
 EXPORT gs_effect_t *gs_get_effect(void);
 
+/**
+ * Effects are cached by file path: every call with the same path returns the
+ * same effect, which stays loaded until the graphics subsystem is destroyed.
+ * Files that failed to load are remembered as well and fail again without
+ * being parsed, returning the original errors.  Create effects when the
+ * source or filter that uses them is created rather than at module load.
+ */
 EXPORT gs_effect_t *gs_effect_create_from_file(const char *file,
 		char **error_string);
 EXPORT gs_effect_t *gs_effect_create(const char *effect_string,
@@ -503,6 +617,48 @@ EXPORT gs_shader_t *gs_pixelshader_create_from_file(const char *file,
 
 EXPORT gs_texture_t *gs_texture_create_from_file(const char *file);
 
+/**
+ * Decodes an image file to memory without touching the graphics subsystem,
+ * so it can be called from any thread.  The data is freed with bfree and can
+ * be uploaded with gs_texture_create on the graphics thread.
+ */
+EXPORT uint8_t *gs_create_texture_file_data(const char *file,
+		enum gs_color_format *format, uint32_t *cx, uint32_t *cy);
+
+#define GS_TEXDATA_MIPMAPS    (1<<0)
+#define GS_TEXDATA_COMPRESS   (1<<1)
+
+#define GS_TEXDATA_MAX_LEVELS 32
+
+/**
+ * Texture data prepared for upload, for static images that are drawn at
+ * many sizes.  Levels are stored one after another in data[0].
+ */
+struct gs_texture_data {
+	enum gs_color_format format;
+	uint32_t             cx;
+	uint32_t             cy;
+	uint32_t             levels;
+	uint8_t              *data[GS_TEXDATA_MAX_LEVELS];
+};
+
+/**
+ * Prepares texture data without touching the graphics subsystem, so it can
+ * be done on any thread.  GS_TEXDATA_MIPMAPS builds the whole mipmap chain,
+ * of any size, and GS_TEXDATA_COMPRESS compresses to DXT1, or DXT5 if the
+ * image has transparency.  Both only apply to 8 bit RGBA, BGRA and BGRX
+ * data, and compression only to images made of whole 4x4 blocks; the data
+ * is copied as is otherwise.
+ */
+EXPORT bool gs_texture_data_init(struct gs_texture_data *td,
+		const uint8_t *data, enum gs_color_format format,
+		uint32_t cx, uint32_t cy, uint32_t flags);
+EXPORT void gs_texture_data_free(struct gs_texture_data *td);
+
+/** Uploads prepared texture data */
+EXPORT gs_texture_t *gs_texture_create_from_data(
+		const struct gs_texture_data *td);
+
 #define GS_FLIP_U (1<<0)
 #define GS_FLIP_V (1<<1)
 
@@ -516,6 +672,31 @@ EXPORT gs_texture_t *gs_texture_create_from_file(const char *file);
 EXPORT void gs_draw_sprite(gs_texture_t *tex, uint32_t flip, uint32_t width,
 		uint32_t height);
 
+/**
+ * Draws a subregion of a 2D sprite
+ *
+ *   Draws the cx by cy region of the texture starting at x, y, at its actual
+ * size.  This allows drawing a cropped part of a texture without copying it
+ * to another texture first.
+ */
+EXPORT void gs_draw_sprite_subregion(gs_texture_t *tex, uint32_t flip,
+		uint32_t x, uint32_t y, uint32_t cx, uint32_t cy);
+
+/**
+ * Begins or ends a sprite batch
+ *
+ *   Between these calls, consecutive gs_draw_sprite calls that use the same
+ * effect pass with the same parameter values are collected into one vertex
+ * buffer and drawn with a single draw call.  Pending sprites are drawn before
+ * any other draw or state change that could affect them, so batching never
+ * changes the result.  Batches can be nested.
+ */
+EXPORT void gs_sprite_batch_begin(void);
+EXPORT void gs_sprite_batch_end(void);
+
+/** Draws pending batched sprites right away */
+EXPORT void gs_sprite_batch_flush(void);
+
 EXPORT void gs_draw_cube_backdrop(gs_texture_t *cubetex, const struct quat *rot,
 		float left, float right, float top, float bottom, float znear);
 
@@ -659,6 +840,13 @@ EXPORT void gs_projection_pop(void);
 
 EXPORT void     gs_swapchain_destroy(gs_swapchain_t *swapchain);
 
+/**
+ * Returns false if the swap chain is still busy with earlier frames and
+ * presenting to it now could block, in which case the caller should skip
+ * drawing to it this time.  Always true for subsystems that can't tell.
+ */
+EXPORT bool     gs_swapchain_ready(gs_swapchain_t *swapchain);
+
 EXPORT void     gs_texture_destroy(gs_texture_t *tex);
 EXPORT uint32_t gs_texture_get_width(const gs_texture_t *tex);
 EXPORT uint32_t gs_texture_get_height(const gs_texture_t *tex);
@@ -696,6 +884,14 @@ EXPORT enum gs_color_format gs_stagesurface_get_color_format(
 		const gs_stagesurf_t *stagesurf);
 EXPORT bool     gs_stagesurface_map(gs_stagesurf_t *stagesurf, uint8_t **data,
 		uint32_t *linesize);
+
+/**
+ * Maps the surface only if the copy staged to it has finished, otherwise
+ * returns false without waiting.  Subsystems that can't tell whether the copy
+ * is done map the surface like gs_stagesurface_map.
+ */
+EXPORT bool     gs_stagesurface_try_map(gs_stagesurf_t *stagesurf,
+		uint8_t **data, uint32_t *linesize);
 EXPORT void     gs_stagesurface_unmap(gs_stagesurf_t *stagesurf);
 
 EXPORT void     gs_zstencil_destroy(gs_zstencil_t *zstencil);
@@ -715,6 +911,31 @@ EXPORT size_t   gs_indexbuffer_get_num_indices(
 EXPORT enum gs_index_type gs_indexbuffer_get_type(
 		const gs_indexbuffer_t *indexbuffer);
 
+/**
+ * GPU timers.  A timer records a GPU timestamp at gs_timer_begin and
+ * gs_timer_end, and timers may nest.  Timers must be used inside a timer
+ * range, which supplies the tick frequency and says whether the timestamps
+ * within it are usable (they aren't if the GPU changed clocks, for
+ * example).
+ *
+ * Results are only available some time after the commands were submitted;
+ * the get_data functions never wait and return false until then, so read
+ * them a few frames later.  The create functions return NULL if the
+ * subsystem doesn't support timer queries.
+ */
+EXPORT gs_timer_t *gs_timer_create(void);
+EXPORT void gs_timer_destroy(gs_timer_t *timer);
+EXPORT void gs_timer_begin(gs_timer_t *timer);
+EXPORT void gs_timer_end(gs_timer_t *timer);
+EXPORT bool gs_timer_get_data(gs_timer_t *timer, uint64_t *ticks);
+
+EXPORT gs_timer_range_t *gs_timer_range_create(void);
+EXPORT void gs_timer_range_destroy(gs_timer_range_t *range);
+EXPORT void gs_timer_range_begin(gs_timer_range_t *range);
+EXPORT void gs_timer_range_end(gs_timer_range_t *range);
+EXPORT bool gs_timer_range_get_data(gs_timer_range_t *range, bool *disjoint,
+		uint64_t *frequency);
+
 #ifdef __APPLE__
 
 /** platform specific function for creating (GL_TEXTURE_RECTANGLE) textures
@@ -753,6 +974,13 @@ EXPORT void gs_texture_release_dc(gs_texture_t *gdi_tex);
 
 /** creates a windows shared texture from a texture handle */
 EXPORT gs_texture_t *gs_texture_open_shared(uint32_t handle);
+
+/**
+ * Brings a shared texture up to date if it had to be opened on a different
+ * adapter than the one rendering, otherwise does nothing.  Call once per
+ * frame; the contents lag one call behind.
+ */
+EXPORT void gs_texture_update_shared(gs_texture_t *tex);
 #endif
 
 /* inline functions used by modules */
@@ -777,6 +1005,7 @@ static inline uint32_t gs_get_format_bpp(enum gs_color_format format)
 	case GS_DXT1:        return 4;
 	case GS_DXT3:        return 8;
 	case GS_DXT5:        return 8;
+	case GS_R8G8:        return 16;
 	case GS_UNKNOWN:     return 0;
 	}
 
@@ -61,16 +61,23 @@ void matrix4_mul(struct matrix4 *dst, const struct matrix4 *m1,
 		const struct matrix4 *m2)
 {
 	const struct vec4 *m1v = (const struct vec4*)m1;
-	const float *m2f = (const float*)m2;
+	const struct vec4 *m2v = (const struct vec4*)m2;
 	struct vec4 out[4];
-	int i, j;
 
-	for (i = 0; i < 4; i++) {
-		for (j=0; j<4; j++) {
-			struct vec4 temp;
-			vec4_set(&temp, m2f[j], m2f[j+4], m2f[j+8], m2f[j+12]);
-			out[i].ptr[j] = vec4_dot(&m1v[i], &temp);
-		}
+	/* each row of the result is the rows of m2 weighted by the matching
+	 * row of m1, which avoids transposing m2 for dot products */
+	for (int i = 0; i < 4; i++) {
+		__m128 row = m1v[i].m;
+		__m128 x = _mm_shuffle_ps(row, row, _MM_SHUFFLE(0, 0, 0, 0));
+		__m128 y = _mm_shuffle_ps(row, row, _MM_SHUFFLE(1, 1, 1, 1));
+		__m128 z = _mm_shuffle_ps(row, row, _MM_SHUFFLE(2, 2, 2, 2));
+		__m128 w = _mm_shuffle_ps(row, row, _MM_SHUFFLE(3, 3, 3, 3));
+
+		out[i].m = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(x, m2v[0].m),
+			           _mm_mul_ps(y, m2v[1].m)),
+			_mm_add_ps(_mm_mul_ps(z, m2v[2].m),
+			           _mm_mul_ps(w, m2v[3].m)));
 	}
 
 	matrix4_copy(dst, (struct matrix4*)out);
@@ -0,0 +1,403 @@
+/******************************************************************************
+    Copyright (C) 2016 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <string.h>
+
+#include "../util/bmem.h"
+#include "graphics.h"
+
+/*
+ * Mipmap chains are built with a box filter weighted by alpha, so that the
+ * color of fully transparent pixels doesn't bleed into their neighbors.
+ * Compression is a simple bounding box fit, which is fast enough for the
+ * load thread and good enough for overlays and photos.
+ */
+
+static inline bool is_8bit_rgba(enum gs_color_format format)
+{
+	return format == GS_RGBA || format == GS_BGRA || format == GS_BGRX;
+}
+
+static inline uint32_t next_size(uint32_t size)
+{
+	return size > 1 ? size / 2 : 1;
+}
+
+static uint32_t total_levels(uint32_t cx, uint32_t cy)
+{
+	uint32_t size = cx > cy ? cx : cy;
+	uint32_t levels = 1;
+
+	while (size > 1) {
+		size /= 2;
+		levels++;
+	}
+
+	return levels;
+}
+
+static void downsample(uint8_t *dst, const uint8_t *src,
+		uint32_t src_cx, uint32_t src_cy, uint32_t cx, uint32_t cy,
+		bool has_alpha)
+{
+	for (uint32_t y = 0; y < cy; y++) {
+		uint32_t y0 = y * 2;
+		uint32_t y1 = y0 + 1 < src_cy ? y0 + 1 : y0;
+
+		for (uint32_t x = 0; x < cx; x++) {
+			uint32_t x0 = x * 2;
+			uint32_t x1 = x0 + 1 < src_cx ? x0 + 1 : x0;
+			const uint8_t *p[4] = {
+				src + (y0 * src_cx + x0) * 4,
+				src + (y0 * src_cx + x1) * 4,
+				src + (y1 * src_cx + x0) * 4,
+				src + (y1 * src_cx + x1) * 4
+			};
+			uint32_t alpha = p[0][3] + p[1][3] + p[2][3] + p[3][3];
+			uint8_t *out = dst + (y * cx + x) * 4;
+
+			for (int c = 0; c < 3; c++) {
+				uint32_t sum = 0;
+
+				if (has_alpha && alpha) {
+					for (int i = 0; i < 4; i++)
+						sum += p[i][c] * p[i][3];
+					out[c] = (uint8_t)((sum + alpha / 2) /
+							alpha);
+				} else {
+					for (int i = 0; i < 4; i++)
+						sum += p[i][c];
+					out[c] = (uint8_t)((sum + 2) / 4);
+				}
+			}
+
+			out[3] = (uint8_t)((alpha + 2) / 4);
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* BC1 (DXT1) and BC3 (DXT5) */
+
+static inline uint16_t pack_565(const uint8_t *rgb)
+{
+	return (uint16_t)(((rgb[0] >> 3) << 11) | ((rgb[1] >> 2) << 5) |
+	                  (rgb[2] >> 3));
+}
+
+static inline void unpack_565(uint16_t c, int *rgb)
+{
+	int r = (c >> 11) & 0x1F;
+	int g = (c >> 5) & 0x3F;
+	int b = c & 0x1F;
+
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+/* gathers a 4x4 block as rgba, repeating edge pixels of levels that are
+ * smaller than a block */
+static void get_block(uint8_t block[16][4], const uint8_t *src,
+		uint32_t cx, uint32_t cy, uint32_t bx, uint32_t by, bool bgr)
+{
+	for (uint32_t y = 0; y < 4; y++) {
+		uint32_t sy = by + y < cy ? by + y : cy - 1;
+
+		for (uint32_t x = 0; x < 4; x++) {
+			uint32_t sx = bx + x < cx ? bx + x : cx - 1;
+			const uint8_t *p = src + (sy * cx + sx) * 4;
+			uint8_t *out = block[y * 4 + x];
+
+			out[0] = bgr ? p[2] : p[0];
+			out[1] = p[1];
+			out[2] = bgr ? p[0] : p[2];
+			out[3] = p[3];
+		}
+	}
+}
+
+static void encode_color_block(uint8_t *dst, uint8_t block[16][4])
+{
+	uint8_t min[3] = {255, 255, 255};
+	uint8_t max[3] = {0, 0, 0};
+	uint16_t c0, c1;
+	uint32_t indices = 0;
+	int palette[4][3];
+
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < 3; c++) {
+			if (block[i][c] < min[c]) min[c] = block[i][c];
+			if (block[i][c] > max[c]) max[c] = block[i][c];
+		}
+	}
+
+	/* pull the end points in a little, they are rarely hit exactly */
+	for (int c = 0; c < 3; c++) {
+		int inset = (max[c] - min[c]) / 16;
+		min[c] = (uint8_t)(min[c] + inset);
+		max[c] = (uint8_t)(max[c] - inset);
+	}
+
+	c0 = pack_565(max);
+	c1 = pack_565(min);
+
+	/* equal end points would select the three color mode */
+	if (c0 < c1) {
+		uint16_t tmp = c0;
+		c0 = c1;
+		c1 = tmp;
+	}
+
+	if (c0 != c1) {
+		unpack_565(c0, palette[0]);
+		unpack_565(c1, palette[1]);
+
+		for (int c = 0; c < 3; c++) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		for (int i = 0; i < 16; i++) {
+			int best = 0;
+			int best_dist = 0x7FFFFFFF;
+
+			for (int j = 0; j < 4; j++) {
+				int dist = 0;
+
+				for (int c = 0; c < 3; c++) {
+					int d = block[i][c] - palette[j][c];
+					dist += d * d;
+				}
+
+				if (dist < best_dist) {
+					best_dist = dist;
+					best = j;
+				}
+			}
+
+			indices |= (uint32_t)best << (i * 2);
+		}
+	}
+
+	dst[0] = (uint8_t)c0;
+	dst[1] = (uint8_t)(c0 >> 8);
+	dst[2] = (uint8_t)c1;
+	dst[3] = (uint8_t)(c1 >> 8);
+	dst[4] = (uint8_t)indices;
+	dst[5] = (uint8_t)(indices >> 8);
+	dst[6] = (uint8_t)(indices >> 16);
+	dst[7] = (uint8_t)(indices >> 24);
+}
+
+static void encode_alpha_block(uint8_t *dst, uint8_t block[16][4])
+{
+	uint8_t a0 = 0;
+	uint8_t a1 = 255;
+	uint64_t indices = 0;
+	int palette[8];
+
+	for (int i = 0; i < 16; i++) {
+		if (block[i][3] > a0) a0 = block[i][3];
+		if (block[i][3] < a1) a1 = block[i][3];
+	}
+
+	if (a0 != a1) {
+		palette[0] = a0;
+		palette[1] = a1;
+		for (int j = 1; j < 7; j++)
+			palette[j + 1] = ((7 - j) * a0 + j * a1) / 7;
+
+		for (int i = 0; i < 16; i++) {
+			int best = 0;
+			int best_dist = 256;
+
+			for (int j = 0; j < 8; j++) {
+				int dist = block[i][3] - palette[j];
+				if (dist < 0) dist = -dist;
+
+				if (dist < best_dist) {
+					best_dist = dist;
+					best = j;
+				}
+			}
+
+			indices |= (uint64_t)best << (i * 3);
+		}
+	}
+
+	dst[0] = a0;
+	dst[1] = a1;
+	for (int i = 0; i < 6; i++)
+		dst[i + 2] = (uint8_t)(indices >> (i * 8));
+}
+
+static void compress_level(uint8_t *dst, const uint8_t *src,
+		uint32_t cx, uint32_t cy, bool bgr, bool alpha)
+{
+	uint8_t block[16][4];
+
+	for (uint32_t by = 0; by < cy; by += 4) {
+		for (uint32_t bx = 0; bx < cx; bx += 4) {
+			get_block(block, src, cx, cy, bx, by, bgr);
+
+			if (alpha) {
+				encode_alpha_block(dst, block);
+				dst += 8;
+			}
+
+			encode_color_block(dst, block);
+			dst += 8;
+		}
+	}
+}
+
+static inline size_t level_size(enum gs_color_format format,
+		uint32_t cx, uint32_t cy)
+{
+	if (format == GS_DXT1)
+		return (size_t)((cx + 3) / 4) * ((cy + 3) / 4) * 8;
+	if (format == GS_DXT5)
+		return (size_t)((cx + 3) / 4) * ((cy + 3) / 4) * 16;
+	return (size_t)cx * cy * 4;
+}
+
+static bool has_transparency(const uint8_t *data, enum gs_color_format format,
+		uint32_t cx, uint32_t cy)
+{
+	size_t size = (size_t)cx * cy * 4;
+
+	if (format == GS_BGRX)
+		return false;
+
+	for (size_t i = 3; i < size; i += 4) {
+		if (data[i] != 0xFF)
+			return true;
+	}
+
+	return false;
+}
+
+/* ------------------------------------------------------------------------- */
+
+bool gs_texture_data_init(struct gs_texture_data *td, const uint8_t *data,
+		enum gs_color_format format, uint32_t cx, uint32_t cy,
+		uint32_t flags)
+{
+	bool mipmaps  = (flags & GS_TEXDATA_MIPMAPS) != 0;
+	bool compress = (flags & GS_TEXDATA_COMPRESS) != 0;
+	enum gs_color_format out_format = format;
+	uint8_t *levels[GS_TEXDATA_MAX_LEVELS];
+	uint8_t *chain;
+	uint8_t *out;
+	size_t chain_size = 0;
+	size_t out_size = 0;
+	uint32_t num_levels;
+	uint32_t level_cx = cx;
+	uint32_t level_cy = cy;
+
+	memset(td, 0, sizeof(*td));
+
+	if (!data || !cx || !cy)
+		return false;
+
+	/* block compressed base levels have to be made of whole blocks */
+	if (!is_8bit_rgba(format)) {
+		mipmaps  = false;
+		compress = false;
+	}
+	if (cx % 4 != 0 || cy % 4 != 0)
+		compress = false;
+
+	num_levels = mipmaps ? total_levels(cx, cy) : 1;
+
+	if (compress)
+		out_format = has_transparency(data, format, cx, cy) ?
+			GS_DXT5 : GS_DXT1;
+
+	for (uint32_t i = 0; i < num_levels; i++) {
+		chain_size += (size_t)level_cx * level_cy *
+			gs_get_format_bpp(format) / 8;
+		out_size   += level_size(out_format, level_cx, level_cy);
+		level_cx = next_size(level_cx);
+		level_cy = next_size(level_cy);
+	}
+
+	chain = bmalloc(chain_size);
+	levels[0] = chain;
+	memcpy(chain, data, (size_t)cx * cy * gs_get_format_bpp(format) / 8);
+
+	level_cx = cx;
+	level_cy = cy;
+
+	for (uint32_t i = 1; i < num_levels; i++) {
+		uint32_t next_cx = next_size(level_cx);
+		uint32_t next_cy = next_size(level_cy);
+
+		levels[i] = levels[i - 1] + (size_t)level_cx * level_cy * 4;
+		downsample(levels[i], levels[i - 1], level_cx, level_cy,
+				next_cx, next_cy, format != GS_BGRX);
+
+		level_cx = next_cx;
+		level_cy = next_cy;
+	}
+
+	td->format = out_format;
+	td->cx     = cx;
+	td->cy     = cy;
+	td->levels = num_levels;
+
+	if (!compress) {
+		for (uint32_t i = 0; i < num_levels; i++)
+			td->data[i] = levels[i];
+		return true;
+	}
+
+	out = bmalloc(out_size);
+	level_cx = cx;
+	level_cy = cy;
+
+	for (uint32_t i = 0; i < num_levels; i++) {
+		compress_level(out, levels[i], level_cx, level_cy,
+				format != GS_RGBA, out_format == GS_DXT5);
+
+		td->data[i] = out;
+		out += level_size(out_format, level_cx, level_cy);
+		level_cx = next_size(level_cx);
+		level_cy = next_size(level_cy);
+	}
+
+	bfree(chain);
+	return true;
+}
+
+void gs_texture_data_free(struct gs_texture_data *td)
+{
+	if (td) {
+		bfree(td->data[0]);
+		memset(td, 0, sizeof(*td));
+	}
+}
+
+gs_texture_t *gs_texture_create_from_data(const struct gs_texture_data *td)
+{
+	if (!td || !td->data[0])
+		return NULL;
+
+	return gs_texture_create(td->cx, td->cy, td->format, td->levels,
+			(const uint8_t**)td->data, 0);
+}
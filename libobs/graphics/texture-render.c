@@ -22,6 +22,7 @@
 
 #include <assert.h>
 #include "graphics.h"
+#include "graphics-internal.h"
 
 struct gs_texture_render {
 	gs_texture_t  *target, *prev_target;
@@ -33,6 +34,8 @@ struct gs_texture_render {
 	enum gs_zstencil_format zsformat;
 
 	bool rendered;
+	bool transient;
+	bool registered;
 };
 
 gs_texrender_t *gs_texrender_create(enum gs_color_format format,
@@ -46,11 +49,32 @@ gs_texrender_t *gs_texrender_create(enum gs_color_format format,
 	return texrender;
 }
 
+gs_texrender_t *gs_texrender_create_transient(enum gs_color_format format,
+		enum gs_zstencil_format zsformat)
+{
+	gs_texrender_t *texrender = gs_texrender_create(format, zsformat);
+	texrender->transient = true;
+	return texrender;
+}
+
+static void texrender_freebuffer(gs_texrender_t *texrender)
+{
+	gs_render_target_release(texrender->target);
+	gs_zstencil_destroy(texrender->zs);
+
+	texrender->target = NULL;
+	texrender->zs     = NULL;
+	texrender->cx     = 0;
+	texrender->cy     = 0;
+}
+
 void gs_texrender_destroy(gs_texrender_t *texrender)
 {
 	if (texrender) {
-		gs_texture_destroy(texrender->target);
-		gs_zstencil_destroy(texrender->zs);
+		if (texrender->registered)
+			texrender_remove_transient(texrender);
+
+		texrender_freebuffer(texrender);
 		bfree(texrender);
 	}
 }
@@ -61,29 +85,41 @@ static bool texrender_resetbuffer(gs_texrender_t *texrender, uint32_t cx,
 	if (!texrender)
 		return false;
 
-	gs_texture_destroy(texrender->target);
-	gs_zstencil_destroy(texrender->zs);
-
-	texrender->target = NULL;
-	texrender->zs     = NULL;
-	texrender->cx     = cx;
-	texrender->cy     = cy;
+	texrender_freebuffer(texrender);
 
-	texrender->target = gs_texture_create(cx, cy, texrender->format,
-			1, NULL, GS_RENDER_TARGET);
+	texrender->target = gs_render_target_acquire(texrender->format,
+			cx, cy);
 	if (!texrender->target)
 		return false;
 
 	if (texrender->zsformat != GS_ZS_NONE) {
 		texrender->zs = gs_zstencil_create(cx, cy, texrender->zsformat);
 		if (!texrender->zs) {
-			gs_texture_destroy(texrender->target);
+			gs_render_target_release(texrender->target);
 			texrender->target = NULL;
 
 			return false;
 		}
 	}
 
+	texrender->cx = cx;
+	texrender->cy = cy;
+
+	if (texrender->transient && !texrender->registered) {
+		texrender_add_transient(texrender);
+		texrender->registered = true;
+	}
+
+	return true;
+}
+
+bool texrender_release_unused(gs_texrender_t *texrender)
+{
+	if (texrender->rendered)
+		return false;
+
+	texrender_freebuffer(texrender);
+	texrender->registered = false;
 	return true;
 }
 
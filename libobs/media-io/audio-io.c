@@ -25,6 +25,7 @@
 #include "../util/profiler.h"
 
 #include "audio-io.h"
+#include "audio-kernels.h"
 #include "audio-resampler.h"
 
 extern profiler_name_store_t *obs_get_profiler_name_store(void);
@@ -33,26 +34,42 @@ extern profiler_name_store_t *obs_get_profiler_name_store(void);
 
 #define nop() do {int invalid = 0;} while(0)
 
-struct audio_input {
+/* a mix resampled to one conversion, shared by every input of the mix that
+ * asks for that conversion so it's only resampled once per tick */
+struct audio_rendition {
 	struct audio_convert_info conversion;
 	audio_resampler_t         *resampler;
+	long                      refs;
+
+	struct audio_data         data;
+	bool                      valid;
+};
+
+struct audio_input {
+	struct audio_convert_info conversion;
+
+	/* NULL if the input takes the mix as is */
+	struct audio_rendition    *rendition;
 
 	audio_output_callback_t callback;
 	void *param;
 };
 
-static inline void audio_input_free(struct audio_input *input)
-{
-	audio_resampler_destroy(input->resampler);
-}
+/* audio line packets queued for the audio thread, must be a power of two */
+#define AUDIO_LINE_QUEUE_SIZE 64
+#define AUDIO_LINE_QUEUE_MASK (AUDIO_LINE_QUEUE_SIZE - 1)
+
+struct audio_packet {
+	DARRAY(uint8_t)            data[MAX_AV_PLANES];
+	uint32_t                   frames;
+	uint64_t                   timestamp;
+};
 
 struct audio_line {
 	char                       *name;
 
 	struct audio_output        *audio;
 	struct circlebuf           buffers[MAX_AV_PLANES];
-	pthread_mutex_t            mutex;
-	DARRAY(uint8_t)            volume_buffers[MAX_AV_PLANES];
 	uint64_t                   base_timestamp;
 	uint64_t                   last_timestamp;
 
@@ -72,15 +89,37 @@ struct audio_line {
 	 * the circular buffer */
 	bool                       audio_data_out_of_bounds;
 
+	/* single producer/single consumer packet queue.  the thread calling
+	 * audio_line_output only advances queue_write, and the audio thread
+	 * only advances queue_read, so neither ever waits on the other.
+	 * everything above is only touched by the audio thread.  mutex just
+	 * serializes producers in case a source outputs from more than one
+	 * thread */
+	pthread_mutex_t            mutex;
+	struct audio_packet        queue[AUDIO_LINE_QUEUE_SIZE];
+	volatile long              queue_write;
+	volatile long              queue_read;
+
+	/* gets set when the audio thread isn't keeping up with the line */
+	bool                       audio_queue_full;
+
+	/* buffering stats, updated by the audio thread each tick */
+	volatile long              buffered_ms;
+	volatile long              max_buffered_ms;
+	volatile long              dropped_packets;
+
 	struct audio_line          **prev_next;
 	struct audio_line          *next;
 };
 
 static inline void audio_line_destroy_data(struct audio_line *line)
 {
-	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+	for (size_t i = 0; i < MAX_AV_PLANES; i++)
 		circlebuf_free(&line->buffers[i]);
-		da_free(line->volume_buffers[i]);
+
+	for (size_t i = 0; i < AUDIO_LINE_QUEUE_SIZE; i++) {
+		for (size_t j = 0; j < MAX_AV_PLANES; j++)
+			da_free(line->queue[i].data[j]);
 	}
 
 	pthread_mutex_destroy(&line->mutex);
@@ -90,9 +129,22 @@ static inline void audio_line_destroy_data(struct audio_line *line)
 
 struct audio_mix {
 	DARRAY(struct audio_input) inputs;
+	DARRAY(struct audio_rendition*) renditions;
 	DARRAY(uint8_t)            mix_buffers[MAX_AV_PLANES];
 };
 
+static inline void audio_input_free(struct audio_mix *mix,
+		struct audio_input *input)
+{
+	struct audio_rendition *rendition = input->rendition;
+
+	if (rendition && --rendition->refs == 0) {
+		da_erase_item(mix->renditions, &rendition);
+		audio_resampler_destroy(rendition->resampler);
+		bfree(rendition);
+	}
+}
+
 struct audio_output {
 	struct audio_output_info   info;
 	size_t                     block_size;
@@ -110,6 +162,16 @@ struct audio_output {
 	pthread_mutex_t            input_mutex;
 
 	struct audio_mix           mixes[MAX_AUDIO_MIXES];
+
+	/* bits of the mixes that have inputs connected, only changed with
+	 * input_mutex held.  the audio thread samples it once per tick */
+	volatile long              active_mixes;
+
+	/* offline mode, where the thread follows clock_ns instead of wall
+	 * time.  clock_ns only has a single writer */
+	volatile bool              offline;
+	volatile int64_t           clock_ns;
+	os_event_t                 *clock_event;
 };
 
 static inline void audio_output_removeline(struct audio_output *audio,
@@ -211,45 +273,53 @@ static inline size_t min_size(size_t a, size_t b)
 	((val > maxval) ? maxval : ((val < minval) ? minval : val))
 #endif
 
-#define MIX_BUFFER_SIZE 256
-
-/* TODO: optimize mixing */
 static void mix_float(struct audio_output *audio, struct audio_line *line,
-		size_t size, size_t time_offset, size_t plane)
+		size_t size, size_t time_offset, size_t plane,
+		uint32_t mix_mask)
 {
+	struct circlebuf *buf = &line->buffers[plane];
 	float *mixes[MAX_AUDIO_MIXES];
-	float vals[MIX_BUFFER_SIZE];
+	size_t num_mixes = 0;
 
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
-		uint8_t *bytes = audio->mixes[mix_idx].mix_buffers[plane].array;
-		mixes[mix_idx] = (float*)&bytes[time_offset];
+		struct audio_mix *mix = &audio->mixes[mix_idx];
+		uint8_t *bytes = mix->mix_buffers[plane].array;
+
+		if ((mix_mask & (1 << mix_idx)) == 0)
+			continue;
+
+		mixes[num_mixes++] = (float*)&bytes[time_offset];
 	}
 
+	/* mix directly from each contiguous segment of the circular buffer
+	 * rather than popping the data in to a temporary buffer first */
 	while (size) {
-		size_t pop_count = min_size(size, sizeof(vals));
-		size -= pop_count;
+		size_t chunk = min_size(size, buf->capacity - buf->start_pos);
+		const float *src = (const float*)
+			((uint8_t*)buf->data + buf->start_pos);
+		size_t count = chunk / sizeof(float);
 
-		circlebuf_pop_front(&line->buffers[plane], vals, pop_count);
-		pop_count /= sizeof(float);
+		audio_mix_float(mixes, num_mixes, src, count);
 
-		for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
-			/* only include this audio line in this mix if it's set
-			 * via the line's 'mixes' variable */
-			if ((line->mixers & (1 << mix_idx)) == 0)
-				continue;
+		for (size_t mix_idx = 0; mix_idx < num_mixes; mix_idx++)
+			mixes[mix_idx] += count;
 
-			for (size_t i = 0; i < pop_count; i++) {
-				*(mixes[mix_idx]++) += vals[i];
-			}
-		}
+		circlebuf_pop_front(buf, NULL, chunk);
+		size -= chunk;
 	}
 }
 
 static inline bool mix_audio_line(struct audio_output *audio,
-		struct audio_line *line, size_t size, uint64_t timestamp)
+		struct audio_line *line, size_t size, uint64_t timestamp,
+		uint32_t active_mixes)
 {
 	size_t time_offset = (size_t)ts_diff_bytes(audio,
 			line->base_timestamp, timestamp);
+
+	/* only include this audio line in the mixes it's set to via the
+	 * line's 'mixers' variable, and only if they're connected */
+	uint32_t mix_mask = line->mixers & active_mixes;
+
 	if (time_offset > size)
 		return false;
 
@@ -262,36 +332,31 @@ static inline bool mix_audio_line(struct audio_output *audio,
 	for (size_t i = 0; i < audio->planes; i++) {
 		size_t pop_size = min_size(size, line->buffers[i].size);
 
-		mix_float(audio, line, pop_size, time_offset, i);
+		mix_float(audio, line, pop_size, time_offset, i, mix_mask);
 	}
 
 	return true;
 }
 
-static bool resample_audio_output(struct audio_input *input,
-		struct audio_data *data)
+static void resample_audio_output(struct audio_rendition *rendition,
+		const struct audio_data *data)
 {
-	bool success = true;
-
-	if (input->resampler) {
-		uint8_t  *output[MAX_AV_PLANES];
-		uint32_t frames;
-		uint64_t offset;
+	uint8_t  *output[MAX_AV_PLANES];
+	uint32_t frames;
+	uint64_t offset;
 
-		memset(output, 0, sizeof(output));
+	memset(output, 0, sizeof(output));
 
-		success = audio_resampler_resample(input->resampler,
-				output, &frames, &offset,
-				(const uint8_t *const *)data->data,
-				data->frames);
+	rendition->valid = audio_resampler_resample(rendition->resampler,
+			output, &frames, &offset,
+			(const uint8_t *const *)data->data,
+			data->frames);
 
-		for (size_t i = 0; i < MAX_AV_PLANES; i++)
-			data->data[i] = output[i];
-		data->frames     = frames;
-		data->timestamp -= offset;
-	}
-
-	return success;
+	for (size_t i = 0; i < MAX_AV_PLANES; i++)
+		rendition->data.data[i] = output[i];
+	rendition->data.frames    = frames;
+	rendition->data.timestamp = data->timestamp - offset;
+	rendition->data.volume    = data->volume;
 }
 
 static inline void do_audio_output(struct audio_output *audio,
@@ -309,17 +374,27 @@ static inline void do_audio_output(struct audio_output *audio,
 
 	pthread_mutex_lock(&audio->input_mutex);
 
+	for (size_t i = 0; i < mix->renditions.num; i++)
+		resample_audio_output(mix->renditions.array[i], &data);
+
 	for (size_t i = mix->inputs.num; i > 0; i--) {
 		struct audio_input *input = mix->inputs.array+(i-1);
+		struct audio_data input_data = data;
 
-		if (resample_audio_output(input, &data))
-			input->callback(input->param, mix_idx, &data);
+		if (input->rendition) {
+			if (!input->rendition->valid)
+				continue;
+			input_data = input->rendition->data;
+		}
+
+		input->callback(input->param, mix_idx, &input_data);
 	}
 
 	pthread_mutex_unlock(&audio->input_mutex);
 }
 
-static inline void clamp_audio_output(struct audio_output *audio, size_t bytes)
+static inline void clamp_audio_output(struct audio_output *audio, size_t bytes,
+		uint32_t active_mixes)
 {
 	size_t float_size = bytes / sizeof(float);
 
@@ -327,23 +402,155 @@ static inline void clamp_audio_output(struct audio_output *audio, size_t bytes)
 		struct audio_mix *mix = &audio->mixes[mix_idx];
 
 		/* do not process mixing if a specific mix is inactive */
-		if (!mix->inputs.num)
+		if ((active_mixes & (1 << mix_idx)) == 0)
 			continue;
 
 		for (size_t plane = 0; plane < audio->planes; plane++) {
 			float *mix_data = (float*)mix->mix_buffers[plane].array;
-			float *mix_end = &mix_data[float_size];
+			audio_clamp_float(mix_data, float_size);
+		}
+	}
+}
 
-			while (mix_data < mix_end) {
-				float val = *mix_data;
-				val = (val >  1.0f) ?  1.0f : val;
-				val = (val < -1.0f) ? -1.0f : val;
-				*(mix_data++) = val;
-			}
+static int audio_tag = BMEM_TAG_UNTAGGED;
+
+static inline int audio_mem_tag(void)
+{
+	return bmem_tag(&audio_tag, "audio buffers");
+}
+
+static inline size_t audio_line_queued(const struct audio_line *line)
+{
+	return (size_t)((unsigned long)line->queue_write -
+			(unsigned long)line->queue_read);
+}
+
+static void audio_line_place_data_pos(struct audio_line *line,
+		const struct audio_packet *packet, size_t position)
+{
+	size_t total_size = packet->frames * line->audio->block_size;
+
+	for (size_t i = 0; i < line->audio->planes; i++)
+		circlebuf_place(&line->buffers[i], position,
+				packet->data[i].array, total_size);
+}
+
+static inline uint64_t smooth_ts(struct audio_line *line, uint64_t timestamp)
+{
+	if (!line->next_ts_min)
+		return timestamp;
+
+	bool ts_under = (timestamp < line->next_ts_min);
+	uint64_t diff = ts_under ?
+		(line->next_ts_min - timestamp) :
+		(timestamp - line->next_ts_min);
+
+	uint64_t threshold = line->audio->info.ts_smoothing_ns;
+
+#ifdef DEBUG_AUDIO
+	if (diff >= threshold)
+		blog(LOG_DEBUG, "above TS smoothing threshold by %"PRIu64,
+				diff);
+#endif
+
+	return (diff < threshold) ? line->next_ts_min : timestamp;
+}
+
+static bool audio_line_place_data(struct audio_line *line,
+		const struct audio_packet *packet)
+{
+	int64_t pos;
+	uint64_t timestamp = smooth_ts(line, packet->timestamp);
+
+	pos = ts_diff_bytes(line->audio, timestamp, line->base_timestamp);
+
+	if (pos < 0) {
+		return false;
+	}
+
+	line->next_ts_min =
+		timestamp + conv_frames_to_time(line->audio, packet->frames);
+
+#ifdef DEBUG_AUDIO
+	blog(LOG_DEBUG, "data->timestamp: %llu, line->base_timestamp: %llu, "
+			"pos: %lu, bytes: %lu, buf size: %lu",
+			timestamp, line->base_timestamp, pos,
+			packet->frames * line->audio->block_size,
+			line->buffers[0].size);
+#endif
+
+	audio_line_place_data_pos(line, packet, (size_t)pos);
+	return true;
+}
+
+#define MAX_DELAY_NS 6000000000ULL
+
+/* prevent insertation of data too far away from expected audio timing */
+static inline bool valid_timestamp_range(struct audio_line *line, uint64_t ts)
+{
+	uint64_t buffer_ns = 1000000ULL * line->audio->info.buffer_ms;
+	uint64_t max_ts    = line->base_timestamp + buffer_ns + MAX_DELAY_NS;
+
+	return ts >= line->base_timestamp && ts < max_ts;
+}
+
+static void audio_line_insert_packet(struct audio_line *line,
+		const struct audio_packet *packet)
+{
+	bool inserted_audio = false;
+
+	if (!line->buffers[0].size) {
+		line->base_timestamp = packet->timestamp -
+		                       line->audio->info.buffer_ms * 1000000;
+		inserted_audio = audio_line_place_data(line, packet);
+
+	} else if (valid_timestamp_range(line, packet->timestamp)) {
+		inserted_audio = audio_line_place_data(line, packet);
+	}
+
+	if (!inserted_audio) {
+		if (!line->audio_data_out_of_bounds) {
+			blog(LOG_WARNING, "Audio line '%s' currently "
+			                  "receiving out of bounds audio "
+			                  "data.  This can sometimes happen "
+			                  "if there's a pause in the thread.",
+			                  line->name);
+			line->audio_data_out_of_bounds = true;
 		}
+
+	} else if (line->audio_data_out_of_bounds) {
+		blog(LOG_WARNING, "Audio line '%s' no longer receiving "
+		                  "out of bounds audio data.", line->name);
+		line->audio_data_out_of_bounds = false;
+	}
+}
+
+/* moves everything queued by audio_line_output in to the line's buffers */
+static void audio_line_drain_queue(struct audio_line *line)
+{
+	size_t queued = audio_line_queued(line);
+
+	while (queued--) {
+		size_t idx = (size_t)line->queue_read & AUDIO_LINE_QUEUE_MASK;
+
+		audio_line_insert_packet(line, &line->queue[idx]);
+
+		/* hands the packet back to the producer */
+		os_atomic_inc_long(&line->queue_read);
 	}
 }
 
+static inline void update_line_stats(struct audio_line *line)
+{
+	uint64_t frames = line->buffers[0].size / line->audio->block_size;
+	long buffered_ms = (long)(frames * 1000 /
+			line->audio->info.samples_per_sec);
+
+	line->buffered_ms = buffered_ms;
+	if (buffered_ms > line->max_buffered_ms)
+		line->max_buffered_ms = buffered_ms;
+}
+
 static uint64_t mix_and_output(struct audio_output *audio, uint64_t audio_time,
 		uint64_t prev_time)
 {
@@ -351,6 +558,7 @@ static uint64_t mix_and_output(struct audio_output *audio, uint64_t audio_time,
 	uint32_t frames = (uint32_t)ts_diff_frames(audio, audio_time,
 	                                           prev_time);
 	size_t bytes = frames * audio->block_size;
+	uint32_t active_mixes = (uint32_t)audio->active_mixes;
 
 #ifdef DEBUG_AUDIO
 	blog(LOG_DEBUG, "audio_time: %llu, prev_time: %llu, bytes: %lu",
@@ -365,6 +573,9 @@ static uint64_t mix_and_output(struct audio_output *audio, uint64_t audio_time,
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
 		struct audio_mix *mix = &audio->mixes[mix_idx];
 
+		if ((active_mixes & (1 << mix_idx)) == 0)
+			continue;
+
 		for (size_t i = 0; i < audio->planes; i++) {
 			da_resize(mix->mix_buffers[i], bytes);
 			memset(mix->mix_buffers[i].array, 0, bytes);
@@ -375,6 +586,8 @@ static uint64_t mix_and_output(struct audio_output *audio, uint64_t audio_time,
 	while (line) {
 		struct audio_line *next = line->next;
 
+		audio_line_drain_queue(line);
+
 		/* if line marked for removal, destroy and move to the next */
 		if (!line->buffers[0].size) {
 			if (!line->alive) {
@@ -384,8 +597,6 @@ static uint64_t mix_and_output(struct audio_output *audio, uint64_t audio_time,
 			}
 		}
 
-		pthread_mutex_lock(&line->mutex);
-
 		if (line->buffers[0].size && line->base_timestamp < prev_time) {
 			clear_excess_audio_data(line, prev_time);
 			line->base_timestamp = prev_time;
@@ -397,47 +608,80 @@ static uint64_t mix_and_output(struct audio_output *audio, uint64_t audio_time,
 			                  line->name);
 		}
 
-		if (mix_audio_line(audio, line, bytes, prev_time))
+		if (mix_audio_line(audio, line, bytes, prev_time,
+					active_mixes))
 			line->base_timestamp = audio_time;
 
-		pthread_mutex_unlock(&line->mutex);
+		update_line_stats(line);
 
 		line = next;
 	}
 
 	/* clamps audio data to -1.0..1.0 */
-	clamp_audio_output(audio, bytes);
+	clamp_audio_output(audio, bytes, active_mixes);
 
 	/* output */
-	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
-		do_audio_output(audio, i, prev_time, frames);
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+		if ((active_mixes & (1 << i)) != 0)
+			do_audio_output(audio, i, prev_time, frames);
+	}
 
 	return audio_time;
 }
 
-/* sample audio 40 times a second */
+/* sample audio 40 times a second by default */
 #define AUDIO_WAIT_TIME (1000/40)
 
+/* waits until the next mix is due, and returns the current time of the
+ * thread's clock */
+static uint64_t wait_for_tick(struct audio_output *audio, bool offline)
+{
+	if (!offline) {
+		os_sleep_ms(audio->info.tick_ms);
+		return os_gettime_ns();
+	}
+
+	os_event_timedwait(audio->clock_event, audio->info.tick_ms);
+	return (uint64_t)os_atomic_add_int64(&audio->clock_ns, 0);
+}
+
 static void *audio_thread(void *param)
 {
 	struct audio_output *audio = param;
 	uint64_t buffer_time = audio->info.buffer_ms * 1000000;
 	uint64_t prev_time = os_gettime_ns() - buffer_time;
 	uint64_t audio_time;
+	bool was_offline = false;
 
 	os_set_thread_name("audio-io: audio thread");
+	if (!os_apply_thread_settings(&audio->info.thread_settings))
+		blog(LOG_WARNING, "audio-io: Could not apply all thread "
+		                  "settings");
+
+	bmem_set_thread_tag(audio_mem_tag());
 
 	const char *audio_thread_name =
 		profile_store_name(obs_get_profiler_name_store(),
 				"audio_thread(%s)", audio->info.name);
 	
 	while (os_event_try(audio->stop_event) == EAGAIN) {
-		os_sleep_ms(AUDIO_WAIT_TIME);
+		bool offline = audio->offline;
+
+		audio_time = wait_for_tick(audio, offline) - buffer_time;
+
+		/* the clock was switched, so carry on from the new clock's
+		 * time rather than mixing across the jump */
+		if (offline != was_offline) {
+			was_offline = offline;
+			prev_time   = audio_time;
+			continue;
+		}
+		if (audio_time <= prev_time)
+			continue;
 
 		profile_start(audio_thread_name);
 		pthread_mutex_lock(&audio->line_mutex);
 
-		audio_time = os_gettime_ns() - buffer_time;
 		audio_time = mix_and_output(audio, audio_time, prev_time);
 		prev_time  = audio_time;
 
@@ -467,34 +711,79 @@ static size_t audio_get_input_idx(const audio_t *audio, size_t mix_idx,
 	return DARRAY_INVALID;
 }
 
+static inline bool conversion_equal(const struct audio_convert_info *a,
+		const struct audio_convert_info *b)
+{
+	return a->format          == b->format          &&
+	       a->samples_per_sec == b->samples_per_sec &&
+	       a->speakers        == b->speakers;
+}
+
+static struct audio_rendition *audio_rendition_create(
+		struct audio_output *audio,
+		const struct audio_convert_info *conversion)
+{
+	struct audio_rendition *rendition;
+
+	struct resample_info from = {
+		.format          = audio->info.format,
+		.samples_per_sec = audio->info.samples_per_sec,
+		.speakers        = audio->info.speakers
+	};
+
+	struct resample_info to = {
+		.format          = conversion->format,
+		.samples_per_sec = conversion->samples_per_sec,
+		.speakers        = conversion->speakers
+	};
+
+	audio_resampler_t *resampler = audio_resampler_create(&to, &from);
+	if (!resampler) {
+		blog(LOG_ERROR, "audio_input_init: Failed to "
+		                "create resampler");
+		return NULL;
+	}
+
+	rendition = bzalloc(sizeof(struct audio_rendition));
+	rendition->conversion = *conversion;
+	rendition->resampler  = resampler;
+	return rendition;
+}
+
 static inline bool audio_input_init(struct audio_input *input,
-		struct audio_output *audio)
-{
-	if (input->conversion.format          != audio->info.format          ||
-	    input->conversion.samples_per_sec != audio->info.samples_per_sec ||
-	    input->conversion.speakers        != audio->info.speakers) {
-		struct resample_info from = {
-			.format          = audio->info.format,
-			.samples_per_sec = audio->info.samples_per_sec,
-			.speakers        = audio->info.speakers
-		};
-
-		struct resample_info to = {
-			.format          = input->conversion.format,
-			.samples_per_sec = input->conversion.samples_per_sec,
-			.speakers        = input->conversion.speakers
-		};
-
-		input->resampler = audio_resampler_create(&to, &from);
-		if (!input->resampler) {
-			blog(LOG_ERROR, "audio_input_init: Failed to "
-			                "create resampler");
-			return false;
+		struct audio_output *audio, struct audio_mix *mix)
+{
+	struct audio_convert_info output_info = {
+		.format          = audio->info.format,
+		.samples_per_sec = audio->info.samples_per_sec,
+		.speakers        = audio->info.speakers
+	};
+
+	input->rendition = NULL;
+
+	if (conversion_equal(&input->conversion, &output_info))
+		return true;
+
+	for (size_t i = 0; i < mix->renditions.num; i++) {
+		struct audio_rendition *rendition = mix->renditions.array[i];
+
+		if (conversion_equal(&rendition->conversion,
+					&input->conversion)) {
+			input->rendition = rendition;
+			break;
 		}
-	} else {
-		input->resampler = NULL;
 	}
 
+	if (!input->rendition) {
+		input->rendition = audio_rendition_create(audio,
+				&input->conversion);
+		if (!input->rendition)
+			return false;
+
+		da_push_back(mix->renditions, &input->rendition);
+	}
+
+	input->rendition->refs++;
 	return true;
 }
 
@@ -531,9 +820,11 @@ bool audio_output_connect(audio_t *audio, size_t mi,
 			input.conversion.samples_per_sec =
 				audio->info.samples_per_sec;
 
-		success = audio_input_init(&input, audio);
-		if (success)
+		success = audio_input_init(&input, audio, mix);
+		if (success) {
 			da_push_back(mix->inputs, &input);
+			audio->active_mixes |= (1 << mi);
+		}
 	}
 
 	pthread_mutex_unlock(&audio->input_mutex);
@@ -551,8 +842,11 @@ void audio_output_disconnect(audio_t *audio, size_t mix_idx,
 	size_t idx = audio_get_input_idx(audio, mix_idx, callback, param);
 	if (idx != DARRAY_INVALID) {
 		struct audio_mix *mix = &audio->mixes[mix_idx];
-		audio_input_free(mix->inputs.array+idx);
+		audio_input_free(mix, mix->inputs.array+idx);
 		da_erase(mix->inputs, idx);
+
+		if (!mix->inputs.num)
+			audio->active_mixes &= ~(1 << mix_idx);
 	}
 
 	pthread_mutex_unlock(&audio->input_mutex);
@@ -578,6 +872,10 @@ int audio_output_open(audio_t **audio, struct audio_output_info *info)
 		goto fail;
 
 	memcpy(&out->info, info, sizeof(struct audio_output_info));
+	if (!out->info.tick_ms)
+		out->info.tick_ms = AUDIO_WAIT_TIME;
+	if (!out->info.ts_smoothing_ns)
+		out->info.ts_smoothing_ns = TS_SMOOTHING_THRESHOLD;
 	pthread_mutex_init_value(&out->line_mutex);
 	out->channels   = get_audio_channels(info->speakers);
 	out->planes     = planar ? out->channels : 1;
@@ -594,6 +892,8 @@ int audio_output_open(audio_t **audio, struct audio_output_info *info)
 		goto fail;
 	if (os_event_init(&out->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
 		goto fail;
+	if (os_event_init(&out->clock_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
 	if (pthread_create(&out->thread, NULL, audio_thread, out) != 0)
 		goto fail;
 
@@ -630,19 +930,41 @@ void audio_output_close(audio_t *audio)
 		struct audio_mix *mix = &audio->mixes[mix_idx];
 
 		for (size_t i = 0; i < mix->inputs.num; i++)
-			audio_input_free(mix->inputs.array+i);
+			audio_input_free(mix, mix->inputs.array+i);
 
 		for (size_t i = 0; i < MAX_AV_PLANES; i++)
 			da_free(mix->mix_buffers[i]);
 
 		da_free(mix->inputs);
+		da_free(mix->renditions);
 	}
 
+	os_event_destroy(audio->clock_event);
 	os_event_destroy(audio->stop_event);
 	pthread_mutex_destroy(&audio->line_mutex);
 	bfree(audio);
 }
 
+void audio_output_set_offline(audio_t *audio, bool offline)
+{
+	if (!audio)
+		return;
+
+	audio->offline = offline;
+	os_event_signal(audio->clock_event);
+}
+
+void audio_output_advance(audio_t *audio, uint64_t time)
+{
+	if (!audio)
+		return;
+
+	os_atomic_add_int64(&audio->clock_ns,
+			(int64_t)time - audio->clock_ns);
+	if (audio->offline)
+		os_event_signal(audio->clock_event);
+}
+
 audio_line_t *audio_output_create_line(audio_t *audio, const char *name,
 		uint32_t mixers)
 {
@@ -681,28 +1003,18 @@ const struct audio_output_info *audio_output_get_info(const audio_t *audio)
 	return audio ? &audio->info : NULL;
 }
 
+/* the audio thread owns the line's buffers, so it removes the line once
+ * everything queued has been mixed */
 void audio_line_destroy(struct audio_line *line)
 {
-	if (line) {
-		if (!line->buffers[0].size)
-			audio_output_removeline(line->audio, line);
-		else
-			line->alive = false;
-	}
+	if (line)
+		line->alive = false;
 }
 
 bool audio_output_active(const audio_t *audio)
 {
 	if (!audio) return false;
-
-	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
-		const struct audio_mix *mix = &audio->mixes[mix_idx];
-
-		if (mix->inputs.num != 0)
-			return true;
-	}
-
-	return false;
+	return audio->active_mixes != 0;
 }
 
 size_t audio_output_get_block_size(const audio_t *audio)
@@ -725,140 +1037,163 @@ uint32_t audio_output_get_sample_rate(const audio_t *audio)
 	return audio ? audio->info.samples_per_sec : 0;
 }
 
-/* TODO: optimize these two functions */
-static inline void mul_vol_float(float *array, float volume, size_t count)
-{
-	for (size_t i = 0; i < count; i++)
-		array[i] *= volume;
-}
-
-static void audio_line_place_data_pos(struct audio_line *line,
-		const struct audio_data *data, size_t position)
+static void audio_line_copy_packet(struct audio_line *line,
+		struct audio_packet *packet, const struct audio_data *data)
 {
 	bool   planar     = line->audio->planes > 1;
 	size_t total_num  = data->frames * (planar ? 1 : line->audio->channels);
 	size_t total_size = data->frames * line->audio->block_size;
 
 	for (size_t i = 0; i < line->audio->planes; i++) {
-		da_copy_array(line->volume_buffers[i], data->data[i],
-				total_size);
+		da_copy_array(packet->data[i], data->data[i], total_size);
 
-		uint8_t *array = line->volume_buffers[i].array;
+		uint8_t *array = packet->data[i].array;
 
 		switch (line->audio->info.format) {
 		case AUDIO_FORMAT_FLOAT:
 		case AUDIO_FORMAT_FLOAT_PLANAR:
-			mul_vol_float((float*)array, data->volume, total_num);
+			audio_mul_float((float*)array, data->volume, total_num);
 			break;
 		default:
-			blog(LOG_ERROR, "audio_line_place_data_pos: "
+			blog(LOG_ERROR, "audio_line_copy_packet: "
 			                "Unsupported or unknown format");
 			break;
 		}
+	}
 
-		circlebuf_place(&line->buffers[i], position,
-				line->volume_buffers[i].array, total_size);
+	packet->frames    = data->frames;
+	packet->timestamp = data->timestamp;
+}
+
+/* checks that a packet is free for the producer, mutex must be locked */
+static inline bool audio_line_reserve(struct audio_line *line)
+{
+	if (audio_line_queued(line) == AUDIO_LINE_QUEUE_SIZE) {
+		/* drop the packet rather than wait on the audio thread.  the
+		 * gap is filled in by timestamp placement like any other */
+		os_atomic_inc_long(&line->dropped_packets);
+
+		if (!line->audio_queue_full) {
+			blog(LOG_WARNING, "Audio line '%s' queue is full, "
+			                  "dropping audio data.", line->name);
+			line->audio_queue_full = true;
+		}
+		return false;
 	}
+
+	if (line->audio_queue_full) {
+		blog(LOG_WARNING, "Audio line '%s' queue no longer "
+		                  "full.", line->name);
+		line->audio_queue_full = false;
+	}
+	return true;
 }
 
-static inline uint64_t smooth_ts(struct audio_line *line, uint64_t timestamp)
+void audio_line_output(audio_line_t *line, const struct audio_data *data)
 {
-	if (!line->next_ts_min)
-		return timestamp;
+	if (!line || !data) return;
 
-	bool ts_under = (timestamp < line->next_ts_min);
-	uint64_t diff = ts_under ?
-		(line->next_ts_min - timestamp) :
-		(timestamp - line->next_ts_min);
+	pthread_mutex_lock(&line->mutex);
 
-#ifdef DEBUG_AUDIO
-	if (diff >= TS_SMOOTHING_THRESHOLD)
-		blog(LOG_DEBUG, "above TS smoothing threshold by %"PRIu64,
-				diff);
-#endif
+	if (audio_line_reserve(line)) {
+		size_t idx = (size_t)line->queue_write & AUDIO_LINE_QUEUE_MASK;
+
+		int prev_tag = bmem_set_thread_tag(audio_mem_tag());
+		audio_line_copy_packet(line, &line->queue[idx], data);
+		bmem_set_thread_tag(prev_tag);
+
+		/* publishes the packet to the audio thread */
+		os_atomic_inc_long(&line->queue_write);
+	}
 
-	return (diff < TS_SMOOTHING_THRESHOLD) ? line->next_ts_min : timestamp;
+	pthread_mutex_unlock(&line->mutex);
 }
 
-static bool audio_line_place_data(struct audio_line *line,
-		const struct audio_data *data)
+bool audio_line_acquire(audio_line_t *line, uint32_t frames,
+		uint8_t *data[MAX_AV_PLANES])
 {
-	int64_t pos;
-	uint64_t timestamp = smooth_ts(line, data->timestamp);
+	struct audio_packet *packet;
+	size_t total_size;
 
-	pos = ts_diff_bytes(line->audio, timestamp, line->base_timestamp);
+	if (!line || !frames || !data) return false;
 
-	if (pos < 0) {
+	pthread_mutex_lock(&line->mutex);
+
+	if (!audio_line_reserve(line)) {
+		pthread_mutex_unlock(&line->mutex);
 		return false;
 	}
 
-	line->next_ts_min =
-		timestamp + conv_frames_to_time(line->audio, data->frames);
+	packet     = &line->queue[(size_t)line->queue_write &
+		AUDIO_LINE_QUEUE_MASK];
+	total_size = frames * line->audio->block_size;
 
-#ifdef DEBUG_AUDIO
-	blog(LOG_DEBUG, "data->timestamp: %llu, line->base_timestamp: %llu, "
-			"pos: %lu, bytes: %lu, buf size: %lu",
-			timestamp, line->base_timestamp, pos,
-			data->frames * line->audio->block_size,
-			line->buffers[0].size);
-#endif
+	int prev_tag = bmem_set_thread_tag(audio_mem_tag());
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		if (i < line->audio->planes) {
+			da_resize(packet->data[i], total_size);
+			data[i] = packet->data[i].array;
+		} else {
+			data[i] = NULL;
+		}
+	}
+	bmem_set_thread_tag(prev_tag);
 
-	audio_line_place_data_pos(line, data, (size_t)pos);
+	packet->frames = frames;
+
+	/* the mutex stays locked until the packet is committed or discarded,
+	 * so no other producer can take the same packet */
 	return true;
 }
 
-#define MAX_DELAY_NS 6000000000ULL
-
-/* prevent insertation of data too far away from expected audio timing */
-static inline bool valid_timestamp_range(struct audio_line *line, uint64_t ts)
+void audio_line_commit(audio_line_t *line, const struct audio_data *data)
 {
-	uint64_t buffer_ns = 1000000ULL * line->audio->info.buffer_ms;
-	uint64_t max_ts    = line->base_timestamp + buffer_ns + MAX_DELAY_NS;
+	struct audio_packet *packet;
+	bool planar;
+	size_t total_num;
 
-	return ts >= line->base_timestamp && ts < max_ts;
-}
+	if (!line) return;
 
-void audio_line_output(audio_line_t *line, const struct audio_data *data)
-{
-	bool inserted_audio = false;
+	packet = &line->queue[(size_t)line->queue_write &
+		AUDIO_LINE_QUEUE_MASK];
 
-	if (!line || !data) return;
+	if (data && data->frames && data->frames <= packet->frames) {
+		planar    = line->audio->planes > 1;
+		total_num = data->frames *
+			(planar ? 1 : line->audio->channels);
 
-	pthread_mutex_lock(&line->mutex);
+		/* the samples are already in the packet, so the volume is
+		 * applied in place rather than while copying */
+		for (size_t i = 0; i < line->audio->planes; i++)
+			audio_mul_float((float*)packet->data[i].array,
+					data->volume, total_num);
 
-	if (!line->buffers[0].size) {
-		line->base_timestamp = data->timestamp -
-		                       line->audio->info.buffer_ms * 1000000;
-		inserted_audio = audio_line_place_data(line, data);
+		packet->frames    = data->frames;
+		packet->timestamp = data->timestamp;
 
-	} else if (valid_timestamp_range(line, data->timestamp)) {
-		inserted_audio = audio_line_place_data(line, data);
+		/* publishes the packet to the audio thread */
+		os_atomic_inc_long(&line->queue_write);
 	}
 
-	if (!inserted_audio) {
-		if (!line->audio_data_out_of_bounds) {
-			blog(LOG_WARNING, "Audio line '%s' currently "
-			                  "receiving out of bounds audio "
-			                  "data.  This can sometimes happen "
-			                  "if there's a pause in the thread.",
-			                  line->name);
-			line->audio_data_out_of_bounds = true;
-		}
+	pthread_mutex_unlock(&line->mutex);
+}
 
-		/*blog(LOG_DEBUG, "Bad timestamp for audio line '%s', "
-		                "data->timestamp: %"PRIu64", "
-		                "line->base_timestamp: %"PRIu64".  This can "
-		                "sometimes happen when there's a pause in "
-		                "the threads.", line->name, data->timestamp,
-		                line->base_timestamp);*/
+void audio_line_discard(audio_line_t *line)
+{
+	if (line)
+		pthread_mutex_unlock(&line->mutex);
+}
 
-	} else if (line->audio_data_out_of_bounds) {
-		blog(LOG_WARNING, "Audio line '%s' no longer receiving "
-		                  "out of bounds audio data.", line->name);
-		line->audio_data_out_of_bounds = false;
-	}
+bool audio_line_get_stats(const audio_line_t *line,
+		struct audio_line_stats *stats)
+{
+	if (!line || !stats)
+		return false;
 
-	pthread_mutex_unlock(&line->mutex);
+	stats->buffered_ms     = (uint32_t)line->buffered_ms;
+	stats->max_buffered_ms = (uint32_t)line->max_buffered_ms;
+	stats->dropped_packets = (uint32_t)line->dropped_packets;
+	return true;
 }
 
 void audio_line_set_mixers(audio_line_t *line, uint32_t mixers)
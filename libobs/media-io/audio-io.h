@@ -19,6 +19,7 @@
 
 #include "media-io-defs.h"
 #include "../util/c99defs.h"
+#include "../util/threading.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -78,6 +79,25 @@ struct audio_output_info {
 	enum audio_format   format;
 	enum speaker_layout speakers;
 	uint64_t            buffer_ms;
+
+	/* how often the audio thread mixes, 0 for the default of 25ms */
+	uint32_t            tick_ms;
+
+	/* timestamp jitter smoothed out of audio lines, 0 for the default of
+	 * TS_SMOOTHING_THRESHOLD */
+	uint64_t            ts_smoothing_ns;
+
+	/* scheduling settings of the mixing thread */
+	struct os_thread_settings thread_settings;
+};
+
+struct audio_line_stats {
+	/* duration of audio currently waiting to be mixed */
+	uint32_t            buffered_ms;
+	/* most audio that has been waiting to be mixed at once */
+	uint32_t            max_buffered_ms;
+	/* packets dropped because the audio thread wasn't keeping up */
+	uint32_t            dropped_packets;
 };
 
 struct audio_convert_info {
@@ -192,6 +212,16 @@ EXPORT uint32_t audio_output_get_sample_rate(const audio_t *audio);
 EXPORT const struct audio_output_info *audio_output_get_info(
 		const audio_t *audio);
 
+/*
+ * Offline mode mixes against a clock that is moved forward with
+ * audio_output_advance instead of wall time, so that audio can be produced
+ * faster (or slower) than real time.  Set the clock before enabling it.  The
+ * thread picks up mixing from the new clock's time whenever the mode
+ * changes, and the clock must only be moved from one thread.
+ */
+EXPORT void audio_output_set_offline(audio_t *audio, bool offline);
+EXPORT void audio_output_advance(audio_t *audio, uint64_t time);
+
 EXPORT audio_line_t *audio_output_create_line(audio_t *audio, const char *name,
 		uint32_t mixers);
 EXPORT void audio_line_set_mixers(audio_line_t *line, uint32_t mixers);
@@ -199,6 +229,22 @@ EXPORT uint32_t audio_line_get_mixers(audio_line_t *line);
 EXPORT void audio_line_destroy(audio_line_t *line);
 EXPORT void audio_line_output(audio_line_t *line, const struct audio_data *data);
 
+/*
+ * Lets the producer write audio in the output format straight into the next
+ * queued packet instead of having it copied by audio_line_output.  On
+ * success data points to buffers of at least the given number of frames,
+ * and the line is locked for other producers until the packet is committed
+ * with audio_line_commit (which may use fewer frames) or handed back with
+ * audio_line_discard.  Returns false if the queue is full.
+ */
+EXPORT bool audio_line_acquire(audio_line_t *line, uint32_t frames,
+		uint8_t *data[MAX_AV_PLANES]);
+EXPORT void audio_line_commit(audio_line_t *line,
+		const struct audio_data *data);
+EXPORT void audio_line_discard(audio_line_t *line);
+EXPORT bool audio_line_get_stats(const audio_line_t *line,
+		struct audio_line_stats *stats);
+
 
 #ifdef __cplusplus
 }
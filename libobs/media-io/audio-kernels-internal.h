@@ -0,0 +1,122 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <math.h>
+
+#include "../util/c99defs.h"
+#include "cpu-features.h"
+
+typedef void (*audio_mul_func_t)(float *data, float mul, size_t count);
+typedef void (*audio_clamp_func_t)(float *data, size_t count);
+typedef void (*audio_sum_and_max_sq_func_t)(const float *data,
+		size_t count, float *sum_sq, float *max_sq);
+typedef void (*audio_downmix_func_t)(float *data[], size_t planes,
+		size_t frames);
+typedef void (*audio_mul_buffer_func_t)(float *data, const float *gains,
+		size_t count);
+typedef void (*audio_max_abs_func_t)(float *levels, const float *data,
+		size_t count);
+
+struct audio_kernel_funcs {
+	const char                  *name;
+
+	audio_mul_func_t            mul;
+	audio_clamp_func_t          clamp;
+	audio_sum_and_max_sq_func_t sum_and_max_sq;
+	audio_downmix_func_t        downmix;
+	audio_mul_buffer_func_t     mul_buffer;
+	audio_max_abs_func_t        max_abs;
+};
+
+#if defined(MEDIA_IO_X86)
+extern void audio_kernels_init_sse2(struct audio_kernel_funcs *funcs);
+extern void audio_kernels_init_avx2(struct audio_kernel_funcs *funcs);
+#elif defined(MEDIA_IO_ARM)
+extern void audio_kernels_init_neon(struct audio_kernel_funcs *funcs);
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* scalar helpers, also used by the vector kernels for leftover samples */
+
+static inline void audio_mul_float_c(float *data, float mul, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		data[i] *= mul;
+}
+
+static inline void audio_clamp_float_c(float *data, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		float val = data[i];
+		val = (val >  1.0f) ?  1.0f : val;
+		val = (val < -1.0f) ? -1.0f : val;
+		data[i] = val;
+	}
+}
+
+static inline void audio_sum_and_max_sq_float_c(const float *data,
+		size_t count, float *sum_sq, float *max_sq)
+{
+	float s = *sum_sq;
+	float m = *max_sq;
+
+	for (size_t i = 0; i < count; i++) {
+		const float pow = data[i] * data[i];
+		s += pow;
+		m  = (m > pow) ? m : pow;
+	}
+
+	*sum_sq = s;
+	*max_sq = m;
+}
+
+static inline void audio_mul_float_buffer_c(float *data, const float *gains,
+		size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		data[i] *= gains[i];
+}
+
+static inline void audio_max_abs_float_c(float *levels, const float *data,
+		size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		float val = fabsf(data[i]);
+		levels[i] = (levels[i] > val) ? levels[i] : val;
+	}
+}
+
+/* downmixes frames [start, frames) */
+static inline void audio_downmix_planar_float_c(float *data[], size_t planes,
+		size_t start, size_t frames)
+{
+	const float planes_i = 1.0f / (float)planes;
+
+	for (size_t frame = start; frame < frames; frame++) {
+		float val = data[0][frame];
+
+		for (size_t plane = 1; plane < planes; plane++)
+			val += data[plane][frame];
+
+		val *= planes_i;
+
+		for (size_t plane = 0; plane < planes; plane++)
+			data[plane][frame] = val;
+	}
+}
@@ -0,0 +1,147 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "audio-kernels-internal.h"
+
+#ifdef MEDIA_IO_ARM
+
+#include <arm_neon.h>
+
+static inline float hsum_neon(float32x4_t val)
+{
+	float32x2_t sums = vadd_f32(vget_low_f32(val), vget_high_f32(val));
+	return vget_lane_f32(vpadd_f32(sums, sums), 0);
+}
+
+static inline float hmax_neon(float32x4_t val)
+{
+	float32x2_t maxs = vmax_f32(vget_low_f32(val), vget_high_f32(val));
+	return vget_lane_f32(vpmax_f32(maxs, maxs), 0);
+}
+
+static void mul_float_neon(float *data, float mul, size_t count)
+{
+	const float32x4_t mul_v = vdupq_n_f32(mul);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		float32x4_t val = vld1q_f32(data + i);
+		vst1q_f32(data + i, vmulq_f32(val, mul_v));
+	}
+
+	audio_mul_float_c(data + i, mul, count - i);
+}
+
+static void clamp_float_neon(float *data, size_t count)
+{
+	const float32x4_t one     = vdupq_n_f32(1.0f);
+	const float32x4_t neg_one = vdupq_n_f32(-1.0f);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		float32x4_t val = vld1q_f32(data + i);
+		val = vmaxq_f32(val, neg_one);
+		vst1q_f32(data + i, vminq_f32(val, one));
+	}
+
+	audio_clamp_float_c(data + i, count - i);
+}
+
+static void sum_and_max_sq_float_neon(const float *data, size_t count,
+		float *sum_sq, float *max_sq)
+{
+	float32x4_t sum_v = vdupq_n_f32(0.0f);
+	float32x4_t max_v = vdupq_n_f32(*max_sq);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		float32x4_t val = vld1q_f32(data + i);
+		float32x4_t pow = vmulq_f32(val, val);
+		sum_v = vaddq_f32(sum_v, pow);
+		max_v = vmaxq_f32(max_v, pow);
+	}
+
+	*sum_sq += hsum_neon(sum_v);
+	*max_sq  = hmax_neon(max_v);
+
+	audio_sum_and_max_sq_float_c(data + i, count - i, sum_sq, max_sq);
+}
+
+static void downmix_planar_float_neon(float *data[], size_t planes,
+		size_t frames)
+{
+	const float32x4_t planes_i = vdupq_n_f32(1.0f / (float)planes);
+	size_t frame = 0;
+
+	for (; frame + 4 <= frames; frame += 4) {
+		float32x4_t val = vld1q_f32(data[0] + frame);
+
+		for (size_t plane = 1; plane < planes; plane++) {
+			const float *src = data[plane] + frame;
+			val = vaddq_f32(val, vld1q_f32(src));
+		}
+
+		val = vmulq_f32(val, planes_i);
+
+		for (size_t plane = 0; plane < planes; plane++)
+			vst1q_f32(data[plane] + frame, val);
+	}
+
+	audio_downmix_planar_float_c(data, planes, frame, frames);
+}
+
+static void mul_float_buffer_neon(float *data, const float *gains,
+		size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		float32x4_t val  = vld1q_f32(data + i);
+		float32x4_t gain = vld1q_f32(gains + i);
+		vst1q_f32(data + i, vmulq_f32(val, gain));
+	}
+
+	audio_mul_float_buffer_c(data + i, gains + i, count - i);
+}
+
+static void max_abs_float_neon(float *levels, const float *data,
+		size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		float32x4_t val = vld1q_f32(data + i);
+		val = vabsq_f32(val);
+		val = vmaxq_f32(vld1q_f32(levels + i), val);
+		vst1q_f32(levels + i, val);
+	}
+
+	audio_max_abs_float_c(levels + i, data + i, count - i);
+}
+
+void audio_kernels_init_neon(struct audio_kernel_funcs *funcs)
+{
+	funcs->name           = "NEON";
+	funcs->mul            = mul_float_neon;
+	funcs->clamp          = clamp_float_neon;
+	funcs->sum_and_max_sq = sum_and_max_sq_float_neon;
+	funcs->downmix        = downmix_planar_float_neon;
+	funcs->mul_buffer     = mul_float_buffer_neon;
+	funcs->max_abs        = max_abs_float_neon;
+}
+
+#endif
@@ -0,0 +1,153 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "audio-kernels-internal.h"
+
+#ifdef MEDIA_IO_X86
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+static inline float hsum_sse2(__m128 val)
+{
+	__m128 shuf = _mm_shuffle_ps(val, val, _MM_SHUFFLE(2, 3, 0, 1));
+	__m128 sums = _mm_add_ps(val, shuf);
+	shuf = _mm_movehl_ps(shuf, sums);
+	return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+}
+
+static inline float hmax_sse2(__m128 val)
+{
+	__m128 shuf = _mm_shuffle_ps(val, val, _MM_SHUFFLE(2, 3, 0, 1));
+	__m128 maxs = _mm_max_ps(val, shuf);
+	shuf = _mm_movehl_ps(shuf, maxs);
+	return _mm_cvtss_f32(_mm_max_ss(maxs, shuf));
+}
+
+static void mul_float_sse2(float *data, float mul, size_t count)
+{
+	const __m128 mul_v = _mm_set1_ps(mul);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 val = _mm_loadu_ps(data + i);
+		_mm_storeu_ps(data + i, _mm_mul_ps(val, mul_v));
+	}
+
+	audio_mul_float_c(data + i, mul, count - i);
+}
+
+static void clamp_float_sse2(float *data, size_t count)
+{
+	const __m128 one     = _mm_set1_ps(1.0f);
+	const __m128 neg_one = _mm_set1_ps(-1.0f);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 val = _mm_loadu_ps(data + i);
+		val = _mm_max_ps(val, neg_one);
+		_mm_storeu_ps(data + i, _mm_min_ps(val, one));
+	}
+
+	audio_clamp_float_c(data + i, count - i);
+}
+
+static void sum_and_max_sq_float_sse2(const float *data, size_t count,
+		float *sum_sq, float *max_sq)
+{
+	__m128 sum_v = _mm_set1_ps(0.0f);
+	__m128 max_v = _mm_set1_ps(*max_sq);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 val = _mm_loadu_ps(data + i);
+		__m128 pow = _mm_mul_ps(val, val);
+		sum_v = _mm_add_ps(sum_v, pow);
+		max_v = _mm_max_ps(max_v, pow);
+	}
+
+	*sum_sq += hsum_sse2(sum_v);
+	*max_sq  = hmax_sse2(max_v);
+
+	audio_sum_and_max_sq_float_c(data + i, count - i, sum_sq, max_sq);
+}
+
+static void downmix_planar_float_sse2(float *data[], size_t planes,
+		size_t frames)
+{
+	const __m128 planes_i = _mm_set1_ps(1.0f / (float)planes);
+	size_t frame = 0;
+
+	for (; frame + 4 <= frames; frame += 4) {
+		__m128 val = _mm_loadu_ps(data[0] + frame);
+
+		for (size_t plane = 1; plane < planes; plane++) {
+			const float *src = data[plane] + frame;
+			val = _mm_add_ps(val, _mm_loadu_ps(src));
+		}
+
+		val = _mm_mul_ps(val, planes_i);
+
+		for (size_t plane = 0; plane < planes; plane++)
+			_mm_storeu_ps(data[plane] + frame, val);
+	}
+
+	audio_downmix_planar_float_c(data, planes, frame, frames);
+}
+
+static void mul_float_buffer_sse2(float *data, const float *gains,
+		size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 val  = _mm_loadu_ps(data + i);
+		__m128 gain = _mm_loadu_ps(gains + i);
+		_mm_storeu_ps(data + i, _mm_mul_ps(val, gain));
+	}
+
+	audio_mul_float_buffer_c(data + i, gains + i, count - i);
+}
+
+static void max_abs_float_sse2(float *levels, const float *data,
+		size_t count)
+{
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 val = _mm_loadu_ps(data + i);
+		val = _mm_and_ps(val, abs_mask);
+		val = _mm_max_ps(_mm_loadu_ps(levels + i), val);
+		_mm_storeu_ps(levels + i, val);
+	}
+
+	audio_max_abs_float_c(levels + i, data + i, count - i);
+}
+
+void audio_kernels_init_sse2(struct audio_kernel_funcs *funcs)
+{
+	funcs->name           = "SSE2";
+	funcs->mul            = mul_float_sse2;
+	funcs->clamp          = clamp_float_sse2;
+	funcs->sum_and_max_sq = sum_and_max_sq_float_sse2;
+	funcs->downmix        = downmix_planar_float_sse2;
+	funcs->mul_buffer     = mul_float_buffer_sse2;
+	funcs->max_abs        = max_abs_float_sse2;
+}
+
+#endif
@@ -0,0 +1,146 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <math.h>
+
+#include "../util/threading.h"
+#include "../util/base.h"
+#include "audio-kernels.h"
+#include "audio-kernels-internal.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AUDIO_MIX_SSE 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define AUDIO_MIX_NEON 1
+#include <arm_neon.h>
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* scalar kernels */
+
+static void downmix_planar_float_c(float *data[], size_t planes,
+		size_t frames)
+{
+	audio_downmix_planar_float_c(data, planes, 0, frames);
+}
+
+/* ------------------------------------------------------------------------- */
+/* runtime kernel selection */
+
+static struct audio_kernel_funcs funcs = {
+	.name           = "scalar",
+	.mul            = audio_mul_float_c,
+	.clamp          = audio_clamp_float_c,
+	.sum_and_max_sq = audio_sum_and_max_sq_float_c,
+	.downmix        = downmix_planar_float_c,
+	.mul_buffer     = audio_mul_float_buffer_c,
+	.max_abs        = audio_max_abs_float_c,
+};
+
+static pthread_once_t funcs_once = PTHREAD_ONCE_INIT;
+
+static void init_funcs(void)
+{
+#ifdef MEDIA_IO_X86
+	if (media_cpu_has_sse2())
+		audio_kernels_init_sse2(&funcs);
+	if (media_cpu_has_avx2())
+		audio_kernels_init_avx2(&funcs);
+#elif defined(MEDIA_IO_ARM)
+	if (media_cpu_has_neon())
+		audio_kernels_init_neon(&funcs);
+#endif
+
+	blog(LOG_INFO, "audio-kernels: using %s kernels", funcs.name);
+}
+
+static inline const struct audio_kernel_funcs *get_funcs(void)
+{
+	pthread_once(&funcs_once, init_funcs);
+	return &funcs;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void audio_mul_float(float *data, float mul, size_t count)
+{
+	get_funcs()->mul(data, mul, count);
+}
+
+void audio_clamp_float(float *data, size_t count)
+{
+	get_funcs()->clamp(data, count);
+}
+
+void audio_sum_and_max_sq_float(const float *data, size_t count,
+		float *sum_sq, float *max_sq)
+{
+	get_funcs()->sum_and_max_sq(data, count, sum_sq, max_sq);
+}
+
+void audio_mul_float_buffer(float *data, const float *gains, size_t count)
+{
+	get_funcs()->mul_buffer(data, gains, count);
+}
+
+void audio_max_abs_float(float *levels, const float *data, size_t count)
+{
+	get_funcs()->max_abs(levels, data, count);
+}
+
+void audio_downmix_planar_float(float *data[], size_t planes, size_t frames)
+{
+	if (planes > 1)
+		get_funcs()->downmix(data, planes, frames);
+}
+
+/* ------------------------------------------------------------------------- */
+/* mixing, loads each source sample only once no matter how many mixes it
+ * goes to */
+
+void audio_mix_float(float *mixes[], size_t num_mixes, const float *src,
+		size_t count)
+{
+	size_t i = 0;
+
+#if defined(AUDIO_MIX_SSE)
+	for (; i + 4 <= count; i += 4) {
+		__m128 val = _mm_loadu_ps(src + i);
+
+		for (size_t mix_idx = 0; mix_idx < num_mixes; mix_idx++) {
+			float *mix = mixes[mix_idx] + i;
+			_mm_storeu_ps(mix, _mm_add_ps(_mm_loadu_ps(mix), val));
+		}
+	}
+#elif defined(AUDIO_MIX_NEON)
+	for (; i + 4 <= count; i += 4) {
+		float32x4_t val = vld1q_f32(src + i);
+
+		for (size_t mix_idx = 0; mix_idx < num_mixes; mix_idx++) {
+			float *mix = mixes[mix_idx] + i;
+			vst1q_f32(mix, vaddq_f32(vld1q_f32(mix), val));
+		}
+	}
+#endif
+
+	for (; i < count; i++) {
+		for (size_t mix_idx = 0; mix_idx < num_mixes; mix_idx++)
+			mixes[mix_idx][i] += src[i];
+	}
+}
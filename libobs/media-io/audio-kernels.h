@@ -0,0 +1,79 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "../util/c99defs.h"
+#include <math.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Vectorized per-sample float audio helpers.  The fastest version the CPU
+ * supports is selected the first time any of them is called.
+ */
+
+/** Multiplies count samples by mul */
+EXPORT void audio_mul_float(float *data, float mul, size_t count);
+
+/** Clamps count samples to -1.0..1.0 */
+EXPORT void audio_clamp_float(float *data, size_t count);
+
+/**
+ * Adds the squares of count samples to *sum_sq, and raises *max_sq to the
+ * largest square found
+ */
+EXPORT void audio_sum_and_max_sq_float(const float *data, size_t count,
+		float *sum_sq, float *max_sq);
+
+/**
+ * Averages the planes of planar float audio, and writes the mono result
+ * back to each of them
+ */
+EXPORT void audio_downmix_planar_float(float *data[], size_t planes,
+		size_t frames);
+
+/** Multiplies each of count samples by the matching entry of gains */
+EXPORT void audio_mul_float_buffer(float *data, const float *gains,
+		size_t count);
+
+/** Raises each of count levels to the absolute value of the matching sample */
+EXPORT void audio_max_abs_float(float *levels, const float *data,
+		size_t count);
+
+/** Adds count samples of src to each of the num_mixes buffers in mixes */
+EXPORT void audio_mix_float(float *mixes[], size_t num_mixes,
+		const float *src, size_t count);
+
+/** Returns the RMS level of count samples */
+static inline float audio_rms_float(const float *data, size_t count)
+{
+	float sum_sq = 0.0f;
+	float max_sq = 0.0f;
+
+	if (!count)
+		return 0.0f;
+
+	audio_sum_and_max_sq_float(data, count, &sum_sq, &max_sq);
+	return sqrtf(sum_sq / (float)count);
+}
+
+#ifdef __cplusplus
+}
+#endif
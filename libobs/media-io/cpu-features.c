@@ -0,0 +1,88 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "cpu-features.h"
+
+#if defined(MEDIA_IO_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#elif defined(MEDIA_IO_X86)
+#include <cpuid.h>
+#elif defined(MEDIA_IO_ARM) && defined(__linux__) && !defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+#ifdef MEDIA_IO_X86
+static void get_cpuid(int leaf, int subleaf, uint32_t regs[4])
+{
+#ifdef _MSC_VER
+	__cpuidex((int*)regs, leaf, subleaf);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static uint64_t get_xcr0(void)
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	uint32_t eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+bool media_cpu_has_sse2(void)
+{
+	uint32_t regs[4];
+	get_cpuid(1, 0, regs);
+	return (regs[3] & (1 << 26)) != 0;
+}
+
+bool media_cpu_has_avx2(void)
+{
+	uint32_t regs[4];
+
+	get_cpuid(0, 0, regs);
+	if (regs[0] < 7)
+		return false;
+
+	/* the OS must also save the YMM registers on context switches */
+	get_cpuid(1, 0, regs);
+	if (!(regs[2] & (1 << 27)) || (get_xcr0() & 0x6) != 0x6)
+		return false;
+
+	get_cpuid(7, 0, regs);
+	return (regs[1] & (1 << 5)) != 0;
+}
+
+#elif defined(MEDIA_IO_ARM)
+bool media_cpu_has_neon(void)
+{
+#if defined(__aarch64__) || defined(_M_ARM)
+	return true;
+#elif defined(__linux__)
+	return (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+#elif defined(__ARM_NEON)
+	return true;
+#else
+	return false;
+#endif
+}
+#endif
@@ -0,0 +1,34 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "../util/c99defs.h"
+
+/*
+ * CPU feature checks shared by the runtime-selected media-io kernels
+ */
+
+#if defined(__i386__) || defined(__x86_64__) || \
+    defined(_M_IX86) || defined(_M_X64)
+#define MEDIA_IO_X86 1
+extern bool media_cpu_has_sse2(void);
+extern bool media_cpu_has_avx2(void);
+#elif defined(__aarch64__) || defined(__arm__) || defined(_M_ARM)
+#define MEDIA_IO_ARM 1
+extern bool media_cpu_has_neon(void);
+#endif
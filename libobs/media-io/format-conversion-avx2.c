@@ -0,0 +1,199 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "format-conversion-internal.h"
+
+#ifdef FORMAT_CONVERSION_X86
+
+#include <immintrin.h>
+
+/* processes 8 pixels of two lines at a time, leftover pixels are handled by
+ * the scalar helpers */
+
+static FORCE_INLINE void pack_lines_avx2(uint8_t *dst0, uint8_t *dst1,
+		__m256i line1, __m256i line2)
+{
+	__m256i pack = _mm256_packs_epi32(line1, line2);
+	pack = _mm256_permute4x64_epi64(pack, _MM_SHUFFLE(3, 1, 2, 0));
+	pack = _mm256_packus_epi16(pack, pack);
+
+	_mm_storel_epi64((__m128i*)dst0, _mm256_castsi256_si128(pack));
+	_mm_storel_epi64((__m128i*)dst1, _mm256_extracti128_si256(pack, 1));
+}
+
+/* returns the 2x2 averaged chroma of 8 pixels as 4 16bit UV pairs */
+static FORCE_INLINE __m128i avg_chroma_avx2(__m256i line1, __m256i line2,
+		__m256i uv_mask)
+{
+	__m256i sum = _mm256_add_epi16(
+			_mm256_and_si256(line1, uv_mask),
+			_mm256_and_si256(line2, uv_mask));
+	sum = _mm256_add_epi16(sum,
+			_mm256_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+	sum = _mm256_srli_epi16(sum, 2);
+	sum = _mm256_shuffle_epi32(sum, _MM_SHUFFLE(3, 1, 2, 0));
+	sum = _mm256_permute4x64_epi64(sum, _MM_SHUFFLE(3, 1, 2, 0));
+	return _mm256_castsi256_si128(sum);
+}
+
+static FORCE_INLINE __m256i get_lum_avx2(__m256i line)
+{
+	return _mm256_and_si256(_mm256_srli_epi32(line, 8),
+			_mm256_set1_epi32(0xFF));
+}
+
+static void compress_uyvx_to_i420_avx2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint32_t width      = min_uint32(in_linesize,
+			out_linesize[0]);
+	uint32_t width_simd = width & ~7;
+	__m256i  uv_mask    = _mm256_set1_epi16(0x00FF);
+
+	for (uint32_t y = start_y; y < end_y; y += 2) {
+		const uint8_t *line = input + y * in_linesize;
+		uint8_t *lum0 = output[0] + y * out_linesize[0];
+		uint8_t *lum1 = lum0 + out_linesize[0];
+		uint8_t *u    = output[1] + (y>>1) * out_linesize[1];
+		uint8_t *v    = output[2] + (y>>1) * out_linesize[2];
+		uint32_t x;
+
+		for (x = 0; x < width_simd; x += 8) {
+			const uint8_t *img = line + x*4;
+			__m256i line1 = _mm256_loadu_si256((const __m256i*)img);
+			__m256i line2 = _mm256_loadu_si256(
+					(const __m256i*)(img + in_linesize));
+			__m128i uv;
+
+			pack_lines_avx2(lum0 + x, lum1 + x,
+					get_lum_avx2(line1),
+					get_lum_avx2(line2));
+
+			/* U0 V0 U1 V1 U2 V2 U3 V3 -> U0-U3 V0-V3 */
+			uv = avg_chroma_avx2(line1, line2, uv_mask);
+			uv = _mm_shufflelo_epi16(uv, _MM_SHUFFLE(3, 1, 2, 0));
+			uv = _mm_shufflehi_epi16(uv, _MM_SHUFFLE(3, 1, 2, 0));
+			uv = _mm_shuffle_epi32(uv, _MM_SHUFFLE(3, 1, 2, 0));
+			uv = _mm_packus_epi16(uv, uv);
+
+			*(uint32_t*)(u + (x>>1)) =
+				(uint32_t)_mm_cvtsi128_si32(uv);
+			*(uint32_t*)(v + (x>>1)) =
+				(uint32_t)_mm_cvtsi128_si32(
+						_mm_srli_si128(uv, 4));
+		}
+
+		compress_uyvx_to_i420_rows(input, in_linesize, y, x, width,
+				output, out_linesize);
+	}
+}
+
+static void compress_uyvx_to_nv12_avx2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint32_t width      = min_uint32(in_linesize,
+			out_linesize[0]);
+	uint32_t width_simd = width & ~7;
+	__m256i  uv_mask    = _mm256_set1_epi16(0x00FF);
+
+	for (uint32_t y = start_y; y < end_y; y += 2) {
+		const uint8_t *line = input + y * in_linesize;
+		uint8_t *lum0 = output[0] + y * out_linesize[0];
+		uint8_t *lum1 = lum0 + out_linesize[0];
+		uint8_t *uv_plane = output[1] + (y>>1) * out_linesize[1];
+		uint32_t x;
+
+		for (x = 0; x < width_simd; x += 8) {
+			const uint8_t *img = line + x*4;
+			__m256i line1 = _mm256_loadu_si256((const __m256i*)img);
+			__m256i line2 = _mm256_loadu_si256(
+					(const __m256i*)(img + in_linesize));
+			__m128i uv;
+
+			pack_lines_avx2(lum0 + x, lum1 + x,
+					get_lum_avx2(line1),
+					get_lum_avx2(line2));
+
+			uv = avg_chroma_avx2(line1, line2, uv_mask);
+			uv = _mm_packus_epi16(uv, uv);
+			_mm_storel_epi64((__m128i*)(uv_plane + x), uv);
+		}
+
+		compress_uyvx_to_nv12_rows(input, in_linesize, y, x, width,
+				output, out_linesize);
+	}
+}
+
+static void convert_uyvx_to_i444_avx2(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint32_t width      = min_uint32(in_linesize,
+			out_linesize[0]);
+	uint32_t width_simd = width & ~7;
+	__m256i  mask       = _mm256_set1_epi32(0xFF);
+
+	for (uint32_t y = start_y; y < end_y; y += 2) {
+		const uint8_t *line = input + y * in_linesize;
+		uint8_t *lum0 = output[0] + y * out_linesize[0];
+		uint8_t *u0   = output[1] + y * out_linesize[1];
+		uint8_t *v0   = output[2] + y * out_linesize[2];
+		uint8_t *lum1 = lum0 + out_linesize[0];
+		uint8_t *u1   = u0   + out_linesize[1];
+		uint8_t *v1   = v0   + out_linesize[2];
+		uint32_t x;
+
+		for (x = 0; x < width_simd; x += 8) {
+			const uint8_t *img = line + x*4;
+			__m256i line1 = _mm256_loadu_si256((const __m256i*)img);
+			__m256i line2 = _mm256_loadu_si256(
+					(const __m256i*)(img + in_linesize));
+
+			pack_lines_avx2(lum0 + x, lum1 + x,
+					get_lum_avx2(line1),
+					get_lum_avx2(line2));
+			pack_lines_avx2(u0 + x, u1 + x,
+					_mm256_and_si256(line1, mask),
+					_mm256_and_si256(line2, mask));
+			pack_lines_avx2(v0 + x, v1 + x,
+					_mm256_and_si256(
+						_mm256_srli_epi32(line1, 16),
+						mask),
+					_mm256_and_si256(
+						_mm256_srli_epi32(line2, 16),
+						mask));
+		}
+
+		convert_uyvx_to_i444_rows(input, in_linesize, y, x, width,
+				output, out_linesize);
+	}
+}
+
+void format_conversion_init_avx2(struct format_conversion_funcs *funcs)
+{
+	funcs->name                  = "AVX2";
+	funcs->compress_uyvx_to_i420 = compress_uyvx_to_i420_avx2;
+	funcs->compress_uyvx_to_nv12 = compress_uyvx_to_nv12_avx2;
+	funcs->convert_uyvx_to_i444  = convert_uyvx_to_i444_avx2;
+}
+
+#endif
@@ -0,0 +1,203 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "../util/c99defs.h"
+#include "cpu-features.h"
+
+/*
+ * Conversion kernels are selected once at runtime depending on what the CPU
+ * supports.  Each instruction set fills in whichever functions it has a
+ * faster version of, on top of the scalar versions.
+ */
+
+typedef void (*compress_uyvx_func_t)(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[]);
+
+typedef void (*decompress_planar_func_t)(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize);
+
+typedef void (*decompress_packed_func_t)(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize,
+		bool leading_lum);
+
+struct format_conversion_funcs {
+	const char               *name;
+
+	compress_uyvx_func_t     compress_uyvx_to_i420;
+	compress_uyvx_func_t     compress_uyvx_to_nv12;
+	compress_uyvx_func_t     convert_uyvx_to_i444;
+	decompress_planar_func_t decompress_420;
+	decompress_planar_func_t decompress_nv12;
+	decompress_packed_func_t decompress_422;
+};
+
+#if defined(MEDIA_IO_X86)
+#define FORMAT_CONVERSION_X86 1
+extern void format_conversion_init_sse2(struct format_conversion_funcs *funcs);
+extern void format_conversion_init_avx2(struct format_conversion_funcs *funcs);
+#elif defined(MEDIA_IO_ARM)
+#define FORMAT_CONVERSION_ARM 1
+extern void format_conversion_init_neon(struct format_conversion_funcs *funcs);
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* scalar helpers, also used by the vector kernels for leftover pixels */
+
+#define uyvx_u(px) ((uint8_t)(px))
+#define uyvx_y(px) ((uint8_t)((px) >> 8))
+#define uyvx_v(px) ((uint8_t)((px) >> 16))
+
+static inline uint8_t avg_uyvx_u(uint32_t p0, uint32_t p1, uint32_t p2,
+		uint32_t p3)
+{
+	return (uint8_t)((uyvx_u(p0) + uyvx_u(p1) +
+	                  uyvx_u(p2) + uyvx_u(p3)) >> 2);
+}
+
+static inline uint8_t avg_uyvx_v(uint32_t p0, uint32_t p1, uint32_t p2,
+		uint32_t p3)
+{
+	return (uint8_t)((uyvx_v(p0) + uyvx_v(p1) +
+	                  uyvx_v(p2) + uyvx_v(p3)) >> 2);
+}
+
+/* converts pixels [x, width) of rows y and y+1 */
+static inline void compress_uyvx_to_i420_rows(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t y, uint32_t x, uint32_t width,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	const uint32_t *line1 = (const uint32_t*)(input + y * in_linesize);
+	const uint32_t *line2 = (const uint32_t*)(input + (y+1) * in_linesize);
+	uint8_t *lum0 = output[0] + y * out_linesize[0];
+	uint8_t *lum1 = lum0 + out_linesize[0];
+	uint8_t *u    = output[1] + (y>>1) * out_linesize[1];
+	uint8_t *v    = output[2] + (y>>1) * out_linesize[2];
+
+	for (; x < width; x += 2) {
+		uint32_t p0 = line1[x], p1 = line1[x+1];
+		uint32_t p2 = line2[x], p3 = line2[x+1];
+
+		lum0[x] = uyvx_y(p0); lum0[x+1] = uyvx_y(p1);
+		lum1[x] = uyvx_y(p2); lum1[x+1] = uyvx_y(p3);
+
+		u[x>>1] = avg_uyvx_u(p0, p1, p2, p3);
+		v[x>>1] = avg_uyvx_v(p0, p1, p2, p3);
+	}
+}
+
+static inline void compress_uyvx_to_nv12_rows(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t y, uint32_t x, uint32_t width,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	const uint32_t *line1 = (const uint32_t*)(input + y * in_linesize);
+	const uint32_t *line2 = (const uint32_t*)(input + (y+1) * in_linesize);
+	uint8_t *lum0 = output[0] + y * out_linesize[0];
+	uint8_t *lum1 = lum0 + out_linesize[0];
+	uint8_t *uv   = output[1] + (y>>1) * out_linesize[1];
+
+	for (; x < width; x += 2) {
+		uint32_t p0 = line1[x], p1 = line1[x+1];
+		uint32_t p2 = line2[x], p3 = line2[x+1];
+
+		lum0[x] = uyvx_y(p0); lum0[x+1] = uyvx_y(p1);
+		lum1[x] = uyvx_y(p2); lum1[x+1] = uyvx_y(p3);
+
+		uv[x]   = avg_uyvx_u(p0, p1, p2, p3);
+		uv[x+1] = avg_uyvx_v(p0, p1, p2, p3);
+	}
+}
+
+static inline void convert_uyvx_to_i444_rows(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t y, uint32_t x, uint32_t width,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	for (uint32_t i = 0; i < 2; i++) {
+		const uint32_t *line = (const uint32_t*)
+			(input + (y+i) * in_linesize);
+		uint8_t *lum = output[0] + (y+i) * out_linesize[0];
+		uint8_t *u   = output[1] + (y+i) * out_linesize[1];
+		uint8_t *v   = output[2] + (y+i) * out_linesize[2];
+
+		for (uint32_t cur_x = x; cur_x < width; cur_x++) {
+			uint32_t px = line[cur_x];
+
+			lum[cur_x] = uyvx_y(px);
+			u[cur_x]   = uyvx_u(px);
+			v[cur_x]   = uyvx_v(px);
+		}
+	}
+}
+
+/* decompresses chroma samples [x, width_d2) of chroma row y */
+static inline void decompress_420_rows(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t y, uint32_t x, uint32_t width_d2,
+		uint8_t *output, uint32_t out_linesize)
+{
+	const uint8_t *chroma0 = input[1] + y * in_linesize[1];
+	const uint8_t *chroma1 = input[2] + y * in_linesize[2];
+	const uint8_t *lum0 = input[0] + y * 2 * in_linesize[0];
+	const uint8_t *lum1 = lum0 + in_linesize[0];
+	uint32_t *output0 = (uint32_t*)(output + y * 2 * out_linesize);
+	uint32_t *output1 = (uint32_t*)((uint8_t*)output0 + out_linesize);
+
+	for (; x < width_d2; x++) {
+		uint32_t out = (chroma0[x] << 8) | (chroma1[x] << 16);
+
+		output0[x*2]   = lum0[x*2]   | out;
+		output0[x*2+1] = lum0[x*2+1] | out;
+		output1[x*2]   = lum1[x*2]   | out;
+		output1[x*2+1] = lum1[x*2+1] | out;
+	}
+}
+
+static inline void decompress_nv12_rows(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t y, uint32_t x, uint32_t width_d2,
+		uint8_t *output, uint32_t out_linesize)
+{
+	const uint8_t *chroma = input[1] + y * in_linesize[1];
+	const uint8_t *lum0 = input[0] + y * 2 * in_linesize[0];
+	const uint8_t *lum1 = lum0 + in_linesize[0];
+	uint32_t *output0 = (uint32_t*)(output + y * 2 * out_linesize);
+	uint32_t *output1 = (uint32_t*)((uint8_t*)output0 + out_linesize);
+
+	for (; x < width_d2; x++) {
+		uint32_t out = (chroma[x*2] << 8) | (chroma[x*2+1] << 16);
+
+		output0[x*2]   = lum0[x*2]   | out;
+		output0[x*2+1] = lum0[x*2+1] | out;
+		output1[x*2]   = lum1[x*2]   | out;
+		output1[x*2+1] = lum1[x*2+1] | out;
+	}
+}
+
+static inline uint32_t min_uint32(uint32_t a, uint32_t b)
+{
+	return a < b ? a : b;
+}
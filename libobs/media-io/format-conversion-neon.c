@@ -0,0 +1,235 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "format-conversion-internal.h"
+
+#if defined(FORMAT_CONVERSION_ARM) && \
+    (defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(__aarch64__))
+
+#include <arm_neon.h>
+
+/* processes 16 pixels of two lines at a time, leftover pixels are handled by
+ * the scalar helpers.  vld4 conveniently deinterleaves UYVX in to planes. */
+
+static FORCE_INLINE uint8x8_t avg_chroma_neon(uint8x16_t line1,
+		uint8x16_t line2)
+{
+	uint16x8_t sum = vpaddlq_u8(line1);
+	sum = vpadalq_u8(sum, line2);
+	return vshrn_n_u16(sum, 2);
+}
+
+static void compress_uyvx_to_i420_neon(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint32_t width      = min_uint32(in_linesize,
+			out_linesize[0]);
+	uint32_t width_simd = width & ~15;
+
+	for (uint32_t y = start_y; y < end_y; y += 2) {
+		const uint8_t *line = input + y * in_linesize;
+		uint8_t *lum0 = output[0] + y * out_linesize[0];
+		uint8_t *lum1 = lum0 + out_linesize[0];
+		uint8_t *u    = output[1] + (y>>1) * out_linesize[1];
+		uint8_t *v    = output[2] + (y>>1) * out_linesize[2];
+		uint32_t x;
+
+		for (x = 0; x < width_simd; x += 16) {
+			uint8x16x4_t line1 = vld4q_u8(line + x*4);
+			uint8x16x4_t line2 = vld4q_u8(line + x*4 + in_linesize);
+
+			vst1q_u8(lum0 + x, line1.val[1]);
+			vst1q_u8(lum1 + x, line2.val[1]);
+			vst1_u8(u + (x>>1),
+				avg_chroma_neon(line1.val[0], line2.val[0]));
+			vst1_u8(v + (x>>1),
+				avg_chroma_neon(line1.val[2], line2.val[2]));
+		}
+
+		compress_uyvx_to_i420_rows(input, in_linesize, y, x, width,
+				output, out_linesize);
+	}
+}
+
+static void compress_uyvx_to_nv12_neon(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint32_t width      = min_uint32(in_linesize,
+			out_linesize[0]);
+	uint32_t width_simd = width & ~15;
+
+	for (uint32_t y = start_y; y < end_y; y += 2) {
+		const uint8_t *line = input + y * in_linesize;
+		uint8_t *lum0 = output[0] + y * out_linesize[0];
+		uint8_t *lum1 = lum0 + out_linesize[0];
+		uint8_t *uv_plane = output[1] + (y>>1) * out_linesize[1];
+		uint32_t x;
+
+		for (x = 0; x < width_simd; x += 16) {
+			uint8x16x4_t line1 = vld4q_u8(line + x*4);
+			uint8x16x4_t line2 = vld4q_u8(line + x*4 + in_linesize);
+			uint8x8x2_t  uv;
+
+			vst1q_u8(lum0 + x, line1.val[1]);
+			vst1q_u8(lum1 + x, line2.val[1]);
+
+			uv.val[0] = avg_chroma_neon(line1.val[0], line2.val[0]);
+			uv.val[1] = avg_chroma_neon(line1.val[2], line2.val[2]);
+			vst2_u8(uv_plane + x, uv);
+		}
+
+		compress_uyvx_to_nv12_rows(input, in_linesize, y, x, width,
+				output, out_linesize);
+	}
+}
+
+static void convert_uyvx_to_i444_neon(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	uint32_t width      = min_uint32(in_linesize,
+			out_linesize[0]);
+	uint32_t width_simd = width & ~15;
+
+	for (uint32_t y = start_y; y < end_y; y++) {
+		const uint8_t *line = input + y * in_linesize;
+		uint8_t *lum = output[0] + y * out_linesize[0];
+		uint8_t *u   = output[1] + y * out_linesize[1];
+		uint8_t *v   = output[2] + y * out_linesize[2];
+		uint32_t x;
+
+		for (x = 0; x < width_simd; x += 16) {
+			uint8x16x4_t px = vld4q_u8(line + x*4);
+
+			vst1q_u8(lum + x, px.val[1]);
+			vst1q_u8(u   + x, px.val[0]);
+			vst1q_u8(v   + x, px.val[2]);
+		}
+
+		for (; x < width; x++) {
+			uint32_t val = ((const uint32_t*)line)[x];
+
+			lum[x] = uyvx_y(val);
+			u[x]   = uyvx_u(val);
+			v[x]   = uyvx_v(val);
+		}
+	}
+}
+
+/* writes 16 YUVX pixels, each chroma sample being used for two pixels */
+static FORCE_INLINE void expand_yuvx_neon(uint8_t *out, uint8x16_t lum,
+		uint8x8_t u, uint8x8_t v)
+{
+	uint8x8x2_t  u2 = vzip_u8(u, u);
+	uint8x8x2_t  v2 = vzip_u8(v, v);
+	uint8x16x4_t px;
+
+	px.val[0] = lum;
+	px.val[1] = vcombine_u8(u2.val[0], u2.val[1]);
+	px.val[2] = vcombine_u8(v2.val[0], v2.val[1]);
+	px.val[3] = vdupq_n_u8(0);
+	vst4q_u8(out, px);
+}
+
+static void decompress_420_neon(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize)
+{
+	uint32_t width_d2 =
+		min_uint32(in_linesize[0], out_linesize) / 2;
+	uint32_t width_d2_simd = width_d2 & ~7;
+
+	for (uint32_t y = start_y/2; y < end_y/2; y++) {
+		const uint8_t *chroma0 = input[1] + y * in_linesize[1];
+		const uint8_t *chroma1 = input[2] + y * in_linesize[2];
+		const uint8_t *lum0 = input[0] + y * 2 * in_linesize[0];
+		const uint8_t *lum1 = lum0 + in_linesize[0];
+		uint8_t *output0 = output + y * 2 * out_linesize;
+		uint8_t *output1 = output0 + out_linesize;
+		uint32_t x;
+
+		for (x = 0; x < width_d2_simd; x += 8) {
+			uint8x8_t u = vld1_u8(chroma0 + x);
+			uint8x8_t v = vld1_u8(chroma1 + x);
+
+			expand_yuvx_neon(output0 + x*8, vld1q_u8(lum0 + x*2),
+					u, v);
+			expand_yuvx_neon(output1 + x*8, vld1q_u8(lum1 + x*2),
+					u, v);
+		}
+
+		decompress_420_rows(input, in_linesize, y, x, width_d2,
+				output, out_linesize);
+	}
+}
+
+static void decompress_nv12_neon(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize)
+{
+	uint32_t width_d2 =
+		min_uint32(in_linesize[0], out_linesize) / 2;
+	uint32_t width_d2_simd = width_d2 & ~7;
+
+	for (uint32_t y = start_y/2; y < end_y/2; y++) {
+		const uint8_t *chroma = input[1] + y * in_linesize[1];
+		const uint8_t *lum0 = input[0] + y * 2 * in_linesize[0];
+		const uint8_t *lum1 = lum0 + in_linesize[0];
+		uint8_t *output0 = output + y * 2 * out_linesize;
+		uint8_t *output1 = output0 + out_linesize;
+		uint32_t x;
+
+		for (x = 0; x < width_d2_simd; x += 8) {
+			uint8x8x2_t uv = vld2_u8(chroma + x*2);
+
+			expand_yuvx_neon(output0 + x*8, vld1q_u8(lum0 + x*2),
+					uv.val[0], uv.val[1]);
+			expand_yuvx_neon(output1 + x*8, vld1q_u8(lum1 + x*2),
+					uv.val[0], uv.val[1]);
+		}
+
+		decompress_nv12_rows(input, in_linesize, y, x, width_d2,
+				output, out_linesize);
+	}
+}
+
+void format_conversion_init_neon(struct format_conversion_funcs *funcs)
+{
+	funcs->name                  = "NEON";
+	funcs->compress_uyvx_to_i420 = compress_uyvx_to_i420_neon;
+	funcs->compress_uyvx_to_nv12 = compress_uyvx_to_nv12_neon;
+	funcs->convert_uyvx_to_i444  = convert_uyvx_to_i444_neon;
+	funcs->decompress_420        = decompress_420_neon;
+	funcs->decompress_nv12       = decompress_nv12_neon;
+}
+
+#else
+
+/* NEON not available at compile time, keep the scalar kernels */
+void format_conversion_init_neon(struct format_conversion_funcs *funcs)
+{
+	UNUSED_PARAMETER(funcs);
+}
+
+#endif
@@ -15,263 +15,77 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+#include "../util/threading.h"
+#include "../util/base.h"
 #include "format-conversion.h"
-#include <xmmintrin.h>
-#include <emmintrin.h>
-
-/* ...surprisingly, if I don't use a macro to force inlining, it causes the
- * CPU usage to boost by a tremendous amount in debug builds. */
-
-#define get_m128_32_0(val) (*((uint32_t*)&val))
-#define get_m128_32_1(val) (*(((uint32_t*)&val)+1))
-
-#define pack_shift(lum_plane, lum_pos0, lum_pos1, line1, line2, mask, sh)     \
-do {                                                                          \
-	__m128i pack_val = _mm_packs_epi32(                                   \
-			_mm_srli_si128(_mm_and_si128(line1, mask), sh),       \
-			_mm_srli_si128(_mm_and_si128(line2, mask), sh));      \
-	pack_val = _mm_packus_epi16(pack_val, pack_val);                      \
-                                                                              \
-	*(uint32_t*)(lum_plane+lum_pos0) = get_m128_32_0(pack_val);           \
-	*(uint32_t*)(lum_plane+lum_pos1) = get_m128_32_1(pack_val);           \
-} while (false)
-
-#define pack_val(lum_plane, lum_pos0, lum_pos1, line1, line2, mask)           \
-do {                                                                          \
-	__m128i pack_val = _mm_packs_epi32(                                   \
-			_mm_and_si128(line1, mask),                           \
-			_mm_and_si128(line2, mask));                          \
-	pack_val = _mm_packus_epi16(pack_val, pack_val);                      \
-                                                                              \
-	*(uint32_t*)(lum_plane+lum_pos0) = get_m128_32_0(pack_val);           \
-	*(uint32_t*)(lum_plane+lum_pos1) = get_m128_32_1(pack_val);           \
-} while (false)
-
-#define pack_ch_1plane(uv_plane, chroma_pos, line1, line2, uv_mask)           \
-do {                                                                          \
-	__m128i add_val = _mm_add_epi64(                                      \
-			_mm_and_si128(line1, uv_mask),                        \
-			_mm_and_si128(line2, uv_mask));                       \
-	__m128i avg_val = _mm_add_epi64(                                      \
-			add_val,                                              \
-			_mm_shuffle_epi32(add_val, _MM_SHUFFLE(2, 3, 0, 1))); \
-	avg_val = _mm_srai_epi16(avg_val, 2);                                 \
-	avg_val = _mm_shuffle_epi32(avg_val, _MM_SHUFFLE(3, 1, 2, 0));        \
-	avg_val = _mm_packus_epi16(avg_val, avg_val);                         \
-                                                                              \
-	*(uint32_t*)(uv_plane+chroma_pos) = get_m128_32_0(avg_val);           \
-} while (false)
-
-#define pack_ch_2plane(u_plane, v_plane, chroma_pos, line1, line2, uv_mask)   \
-do {                                                                          \
-	uint32_t packed_vals;                                                 \
-                                                                              \
-	__m128i add_val = _mm_add_epi64(                                      \
-			_mm_and_si128(line1, uv_mask),                        \
-			_mm_and_si128(line2, uv_mask));                       \
-	__m128i avg_val = _mm_add_epi64(                                      \
-			add_val,                                              \
-			_mm_shuffle_epi32(add_val, _MM_SHUFFLE(2, 3, 0, 1))); \
-	avg_val = _mm_srai_epi16(avg_val, 2);                                 \
-	avg_val = _mm_shuffle_epi32(avg_val, _MM_SHUFFLE(3, 1, 2, 0));        \
-	avg_val = _mm_shufflelo_epi16(avg_val, _MM_SHUFFLE(3, 1, 2, 0));      \
-	avg_val = _mm_packus_epi16(avg_val, avg_val);                         \
-                                                                              \
-	packed_vals = get_m128_32_0(avg_val);                                 \
-                                                                              \
-	*(uint16_t*)(u_plane+chroma_pos) = (uint16_t)(packed_vals);           \
-	*(uint16_t*)(v_plane+chroma_pos) = (uint16_t)(packed_vals>>16);       \
-} while (false)
-
-
-static FORCE_INLINE uint32_t min_uint32(uint32_t a, uint32_t b)
-{
-	return a < b ? a : b;
-}
+#include "format-conversion-internal.h"
 
-void compress_uyvx_to_i420(
+/* ------------------------------------------------------------------------- */
+/* scalar kernels */
+
+static void compress_uyvx_to_i420_c(
 		const uint8_t *input, uint32_t in_linesize,
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output[], const uint32_t out_linesize[])
 {
-	uint8_t  *lum_plane   = output[0];
-	uint8_t  *u_plane     = output[1];
-	uint8_t  *v_plane     = output[2];
-	uint32_t width        = min_uint32(in_linesize, out_linesize[0]);
-	uint32_t y;
+	uint32_t width = min_uint32(in_linesize, out_linesize[0]);
 
-	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
-	__m128i uv_mask  = _mm_set1_epi16(0x00FF);
-
-	for (y = start_y; y < end_y; y += 2) {
-		uint32_t y_pos        = y      * in_linesize;
-		uint32_t chroma_y_pos = (y>>1) * out_linesize[1];
-		uint32_t lum_y_pos    = y      * out_linesize[0];
-		uint32_t x;
-
-		for (x = 0; x < width; x += 4) {
-			const uint8_t *img = input + y_pos + x*4;
-			uint32_t lum_pos0  = lum_y_pos + x;
-			uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
-
-			__m128i line1 = _mm_load_si128((const __m128i*)img);
-			__m128i line2 = _mm_load_si128(
-					(const __m128i*)(img + in_linesize));
-
-			pack_shift(lum_plane, lum_pos0, lum_pos1,
-					line1, line2, lum_mask, 1);
-			pack_ch_2plane(u_plane, v_plane,
-					chroma_y_pos + (x>>1),
-					line1, line2, uv_mask);
-		}
-	}
+	for (uint32_t y = start_y; y < end_y; y += 2)
+		compress_uyvx_to_i420_rows(input, in_linesize, y, 0, width,
+				output, out_linesize);
 }
 
-void compress_uyvx_to_nv12(
+static void compress_uyvx_to_nv12_c(
 		const uint8_t *input, uint32_t in_linesize,
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output[], const uint32_t out_linesize[])
 {
-	uint8_t *lum_plane    = output[0];
-	uint8_t *chroma_plane = output[1];
-	uint32_t width        = min_uint32(in_linesize, out_linesize[0]);
-	uint32_t y;
-
-	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
-	__m128i uv_mask  = _mm_set1_epi16(0x00FF);
-
-	for (y = start_y; y < end_y; y += 2) {
-		uint32_t y_pos        = y      * in_linesize;
-		uint32_t chroma_y_pos = (y>>1) * out_linesize[1];
-		uint32_t lum_y_pos    = y      * out_linesize[0];
-		uint32_t x;
-
-		for (x = 0; x < width; x += 4) {
-			const uint8_t *img = input + y_pos + x*4;
-			uint32_t lum_pos0  = lum_y_pos + x;
-			uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
+	uint32_t width = min_uint32(in_linesize, out_linesize[0]);
 
-			__m128i line1 = _mm_load_si128((const __m128i*)img);
-			__m128i line2 = _mm_load_si128(
-					(const __m128i*)(img + in_linesize));
-
-			pack_shift(lum_plane, lum_pos0, lum_pos1,
-					line1, line2, lum_mask, 1);
-			pack_ch_1plane(chroma_plane, chroma_y_pos + x,
-					line1, line2, uv_mask);
-		}
-	}
+	for (uint32_t y = start_y; y < end_y; y += 2)
+		compress_uyvx_to_nv12_rows(input, in_linesize, y, 0, width,
+				output, out_linesize);
 }
 
-void convert_uyvx_to_i444(
+static void convert_uyvx_to_i444_c(
 		const uint8_t *input, uint32_t in_linesize,
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output[], const uint32_t out_linesize[])
 {
-	uint8_t  *lum_plane   = output[0];
-	uint8_t  *u_plane     = output[1];
-	uint8_t  *v_plane     = output[2];
-	uint32_t width        = min_uint32(in_linesize, out_linesize[0]);
-	uint32_t y;
+	uint32_t width = min_uint32(in_linesize, out_linesize[0]);
 
-	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
-	__m128i u_mask   = _mm_set1_epi32(0x000000FF);
-	__m128i v_mask   = _mm_set1_epi32(0x00FF0000);
-
-	for (y = start_y; y < end_y; y += 2) {
-		uint32_t y_pos        = y      * in_linesize;
-		uint32_t lum_y_pos    = y      * out_linesize[0];
-		uint32_t x;
-
-		for (x = 0; x < width; x += 4) {
-			const uint8_t *img = input + y_pos + x*4;
-			uint32_t lum_pos0  = lum_y_pos + x;
-			uint32_t lum_pos1  = lum_pos0 + out_linesize[0];
-
-			__m128i line1 = _mm_load_si128((const __m128i*)img);
-			__m128i line2 = _mm_load_si128(
-					(const __m128i*)(img + in_linesize));
-
-			pack_shift(lum_plane, lum_pos0, lum_pos1,
-					line1, line2, lum_mask, 1);
-			pack_val(u_plane, lum_pos0, lum_pos1,
-					line1, line2, u_mask);
-			pack_shift(v_plane, lum_pos0, lum_pos1,
-					line1, line2, v_mask, 2);
-		}
-	}
+	for (uint32_t y = start_y; y < end_y; y += 2)
+		convert_uyvx_to_i444_rows(input, in_linesize, y, 0, width,
+				output, out_linesize);
 }
 
-void decompress_420(
+static void decompress_420_c(
 		const uint8_t *const input[], const uint32_t in_linesize[],
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output, uint32_t out_linesize)
 {
-	uint32_t start_y_d2 = start_y/2;
-	uint32_t width_d2   = min_uint32(in_linesize[0], out_linesize)/2;
-	uint32_t height_d2  = end_y/2;
-	uint32_t y;
-
-	for (y = start_y_d2; y < height_d2; y++) {
-		const uint8_t *chroma0 = input[1] + y * in_linesize[1];
-		const uint8_t *chroma1 = input[2] + y * in_linesize[2];
-		register const uint8_t *lum0, *lum1;
-		register uint32_t *output0, *output1;
-		uint32_t x;
-
-		lum0 = input[0] + y * 2 * in_linesize[0];
-		lum1 = lum0 + in_linesize[0];
-		output0 = (uint32_t*)(output + y * 2 * in_linesize[0]);
-		output1 = (uint32_t*)((uint8_t*)output0 + in_linesize[0]);
+	uint32_t width_d2 =
+		min_uint32(in_linesize[0], out_linesize) / 2;
 
-		for (x = 0; x < width_d2; x++) {
-			uint32_t out;
-			out = (*(chroma0++) << 8) | (*(chroma1++) << 16);
-
-			*(output0++) = *(lum0++) | out;
-			*(output0++) = *(lum0++) | out;
-
-			*(output1++) = *(lum1++) | out;
-			*(output1++) = *(lum1++) | out;
-		}
-	}
+	for (uint32_t y = start_y/2; y < end_y/2; y++)
+		decompress_420_rows(input, in_linesize, y, 0, width_d2,
+				output, out_linesize);
 }
 
-void decompress_nv12(
+static void decompress_nv12_c(
 		const uint8_t *const input[], const uint32_t in_linesize[],
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output, uint32_t out_linesize)
 {
-	uint32_t start_y_d2 = start_y/2;
-	uint32_t width_d2   = min_uint32(in_linesize[0], out_linesize)/2;
-	uint32_t height_d2  = end_y/2;
-	uint32_t y;
+	uint32_t width_d2 =
+		min_uint32(in_linesize[0], out_linesize) / 2;
 
-	for (y = start_y_d2; y < height_d2; y++) {
-		const uint16_t *chroma;
-		register const uint8_t *lum0, *lum1;
-		register uint32_t *output0, *output1;
-		uint32_t x;
-
-		chroma = (const uint16_t*)(input[1] + y * in_linesize[1]);
-		lum0 = input[0] + y * 2 * in_linesize[0];
-		lum1 = lum0 + in_linesize[0];
-		output0 = (uint32_t*)(output + y * 2 * out_linesize);
-		output1 = (uint32_t*)((uint8_t*)output0 + out_linesize);
-
-		for (x = 0; x < width_d2; x++) {
-			uint32_t out = *(chroma++) << 8;
-
-			*(output0++) = *(lum0++) | out;
-			*(output0++) = *(lum0++) | out;
-
-			*(output1++) = *(lum1++) | out;
-			*(output1++) = *(lum1++) | out;
-		}
-	}
+	for (uint32_t y = start_y/2; y < end_y/2; y++)
+		decompress_nv12_rows(input, in_linesize, y, 0, width_d2,
+				output, out_linesize);
 }
 
-void decompress_422(
+static void decompress_422_c(
 		const uint8_t *input, uint32_t in_linesize,
 		uint32_t start_y, uint32_t end_y,
 		uint8_t *output, uint32_t out_linesize,
@@ -322,3 +136,96 @@ void decompress_422(
 		}
 	}
 }
+
+/* ------------------------------------------------------------------------- */
+/* runtime kernel selection */
+
+static struct format_conversion_funcs funcs = {
+	.name                  = "scalar",
+	.compress_uyvx_to_i420 = compress_uyvx_to_i420_c,
+	.compress_uyvx_to_nv12 = compress_uyvx_to_nv12_c,
+	.convert_uyvx_to_i444  = convert_uyvx_to_i444_c,
+	.decompress_420        = decompress_420_c,
+	.decompress_nv12       = decompress_nv12_c,
+	.decompress_422        = decompress_422_c,
+};
+
+static pthread_once_t funcs_once = PTHREAD_ONCE_INIT;
+
+static void init_funcs(void)
+{
+#ifdef FORMAT_CONVERSION_X86
+	if (media_cpu_has_sse2())
+		format_conversion_init_sse2(&funcs);
+	if (media_cpu_has_avx2())
+		format_conversion_init_avx2(&funcs);
+#elif defined(FORMAT_CONVERSION_ARM)
+	if (media_cpu_has_neon())
+		format_conversion_init_neon(&funcs);
+#endif
+
+	blog(LOG_INFO, "format-conversion: using %s kernels", funcs.name);
+}
+
+static inline const struct format_conversion_funcs *get_funcs(void)
+{
+	pthread_once(&funcs_once, init_funcs);
+	return &funcs;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void compress_uyvx_to_i420(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	get_funcs()->compress_uyvx_to_i420(input, in_linesize,
+			start_y, end_y, output, out_linesize);
+}
+
+void compress_uyvx_to_nv12(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	get_funcs()->compress_uyvx_to_nv12(input, in_linesize,
+			start_y, end_y, output, out_linesize);
+}
+
+void convert_uyvx_to_i444(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output[], const uint32_t out_linesize[])
+{
+	get_funcs()->convert_uyvx_to_i444(input, in_linesize,
+			start_y, end_y, output, out_linesize);
+}
+
+void decompress_420(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize)
+{
+	get_funcs()->decompress_420(input, in_linesize,
+			start_y, end_y, output, out_linesize);
+}
+
+void decompress_nv12(
+		const uint8_t *const input[], const uint32_t in_linesize[],
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize)
+{
+	get_funcs()->decompress_nv12(input, in_linesize,
+			start_y, end_y, output, out_linesize);
+}
+
+void decompress_422(
+		const uint8_t *input, uint32_t in_linesize,
+		uint32_t start_y, uint32_t end_y,
+		uint8_t *output, uint32_t out_linesize,
+		bool leading_lum)
+{
+	get_funcs()->decompress_422(input, in_linesize,
+			start_y, end_y, output, out_linesize, leading_lum);
+}
@@ -22,3 +22,7 @@
 /* time threshold in nanoseconds to ensure audio timing is as seamless as
  * possible */
 #define TS_SMOOTHING_THRESHOLD 50000000ULL
+
+/* tighter threshold for low-latency audio, where the whole buffer may be
+ * shorter than the regular threshold */
+#define TS_SMOOTHING_THRESHOLD_LOW_LATENCY 10000000ULL
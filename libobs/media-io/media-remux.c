@@ -19,18 +19,116 @@
 
 #include "../util/base.h"
 #include "../util/bmem.h"
+#include "../util/darray.h"
 #include "../util/platform.h"
+#include "../util/threading.h"
 
 #include <libavformat/avformat.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 
+/* avio's own file buffers are small, which makes remuxing large recordings
+ * a lot of tiny reads and writes */
+#define REMUX_BUFFER_SIZE (1024 * 1024)
+
 struct media_remux_job {
 	int64_t in_size;
 	AVFormatContext *ifmt_ctx, *ofmt_ctx;
+
+	AVIOContext *in_pb;
+	FILE *in_file, *out_file;
+	uint64_t bytes_read;
 };
 
+static int read_callback(void *opaque, uint8_t *buf, int buf_size)
+{
+	media_remux_job_t job = opaque;
+	size_t size = fread(buf, 1, (size_t)buf_size, job->in_file);
+
+	if (!size)
+		return ferror(job->in_file) ? AVERROR(EIO) : AVERROR_EOF;
+
+	job->bytes_read += size;
+	return (int)size;
+}
+
+static int write_callback(void *opaque, uint8_t *buf, int buf_size)
+{
+	media_remux_job_t job = opaque;
+	size_t size = fwrite(buf, 1, (size_t)buf_size, job->out_file);
+
+	return size == (size_t)buf_size ? buf_size : AVERROR(EIO);
+}
+
+static int64_t seek_file(FILE *file, int64_t size, int64_t offset,
+		int whence)
+{
+	if (whence & AVSEEK_SIZE)
+		return size;
+	if (os_fseeki64(file, offset, whence & ~AVSEEK_FORCE) != 0)
+		return -1;
+	return os_ftelli64(file);
+}
+
+static int64_t read_seek_callback(void *opaque, int64_t offset, int whence)
+{
+	media_remux_job_t job = opaque;
+	return seek_file(job->in_file, job->in_size, offset, whence);
+}
+
+static int64_t write_seek_callback(void *opaque, int64_t offset, int whence)
+{
+	media_remux_job_t job = opaque;
+
+	/* the total size isn't known while writing */
+	if (whence & AVSEEK_SIZE)
+		return -1;
+	return seek_file(job->out_file, 0, offset, whence);
+}
+
+/* the file is read and written through avio's buffer alone, so the stdio
+ * buffer is turned off rather than copying everything twice */
+static AVIOContext *open_buffered_file(media_remux_job_t job, FILE **file,
+		const char *filename, bool write)
+{
+	AVIOContext *pb;
+	uint8_t *buf;
+
+	*file = os_fopen(filename, write ? "wb" : "rb");
+	if (!*file)
+		return NULL;
+
+	setvbuf(*file, NULL, _IONBF, 0);
+
+	buf = av_malloc(REMUX_BUFFER_SIZE);
+	if (!buf)
+		return NULL;
+
+	pb = write ?
+		avio_alloc_context(buf, REMUX_BUFFER_SIZE, 1, job, NULL,
+				write_callback, write_seek_callback) :
+		avio_alloc_context(buf, REMUX_BUFFER_SIZE, 0, job,
+				read_callback, NULL, read_seek_callback);
+	if (!pb)
+		av_free(buf);
+	return pb;
+}
+
+static void close_buffered_file(AVIOContext **pb, FILE **file)
+{
+	if (*pb) {
+		if ((*pb)->write_flag)
+			avio_flush(*pb);
+		av_freep(&(*pb)->buffer);
+		av_freep(pb);
+	}
+	if (*file) {
+		fclose(*file);
+		*file = NULL;
+	}
+}
+
 static inline void init_size(media_remux_job_t job, const char *in_filename)
 {
 #ifdef _MSC_VER
@@ -45,7 +143,22 @@ static inline void init_size(media_remux_job_t job, const char *in_filename)
 
 static inline bool init_input(media_remux_job_t job, const char *in_filename)
 {
-	int ret = avformat_open_input(&job->ifmt_ctx, in_filename, NULL, NULL);
+	int ret;
+
+	job->ifmt_ctx = avformat_alloc_context();
+	if (!job->ifmt_ctx)
+		return false;
+
+	job->in_pb = open_buffered_file(job, &job->in_file, in_filename,
+			false);
+	if (!job->in_pb) {
+		blog(LOG_ERROR, "media_remux: Could not open input file '%s'",
+				in_filename);
+		return false;
+	}
+
+	job->ifmt_ctx->pb = job->in_pb;
+	ret = avformat_open_input(&job->ifmt_ctx, in_filename, NULL, NULL);
 	if (ret < 0) {
 		blog(LOG_ERROR, "media_remux: Could not open input file '%s'",
 				in_filename);
@@ -103,9 +216,9 @@ static inline bool init_output(media_remux_job_t job, const char *out_filename)
 #endif
 
 	if (!(job->ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-		ret = avio_open(&job->ofmt_ctx->pb, out_filename,
-				AVIO_FLAG_WRITE);
-		if (ret < 0) {
+		job->ofmt_ctx->pb = open_buffered_file(job, &job->out_file,
+				out_filename, true);
+		if (!job->ofmt_ctx->pb) {
 			blog(LOG_ERROR, "media_remux: Failed to open output"
 					" file '%s'", out_filename);
 			return false;
@@ -240,12 +353,329 @@ void media_remux_job_destroy(media_remux_job_t job)
 	if (!job)
 		return;
 
+	/* neither context frees custom io itself */
 	avformat_close_input(&job->ifmt_ctx);
+	close_buffered_file(&job->in_pb, &job->in_file);
 
-	if (job->ofmt_ctx && !(job->ofmt_ctx->oformat->flags & AVFMT_NOFILE))
-		avio_close(job->ofmt_ctx->pb);
+	if (job->ofmt_ctx)
+		close_buffered_file(&job->ofmt_ctx->pb, &job->out_file);
 
 	avformat_free_context(job->ofmt_ctx);
 
 	bfree(job);
 }
+
+/* ------------------------------------------------------------------------- */
+/* batches */
+
+struct batch_entry {
+	char                       *in_filename;
+	char                       *out_filename;
+	bool                       cancel;
+	struct media_remux_status  status;
+};
+
+struct media_remux_batch {
+	pthread_mutex_t            mutex;
+	DARRAY(struct batch_entry) entries;
+	DARRAY(pthread_t)          threads;
+	size_t                     max_jobs;
+	bool                       cancel;
+
+	media_remux_batch_callback *callback;
+	void                       *data;
+};
+
+struct batch_job {
+	media_remux_batch_t        *batch;
+	media_remux_job_t          job;
+	size_t                     idx;
+	uint64_t                   start_ts;
+	bool                       canceled;
+};
+
+media_remux_batch_t *media_remux_batch_create(size_t max_jobs,
+		media_remux_batch_callback *callback, void *data)
+{
+	struct media_remux_batch *batch = bzalloc(sizeof(*batch));
+
+	if (pthread_mutex_init(&batch->mutex, NULL) != 0) {
+		bfree(batch);
+		return NULL;
+	}
+
+	batch->max_jobs = max_jobs ? max_jobs : 1;
+	batch->callback = callback;
+	batch->data     = data;
+	return batch;
+}
+
+size_t media_remux_batch_add(media_remux_batch_t *batch,
+		const char *in_filename, const char *out_filename)
+{
+	struct batch_entry entry = {0};
+	size_t idx;
+
+	if (!batch || !in_filename || !out_filename)
+		return (size_t)-1;
+
+	entry.in_filename  = bstrdup(in_filename);
+	entry.out_filename = bstrdup(out_filename);
+	entry.status.state = MEDIA_REMUX_PENDING;
+
+	pthread_mutex_lock(&batch->mutex);
+	idx = da_push_back(batch->entries, &entry);
+	pthread_mutex_unlock(&batch->mutex);
+	return idx;
+}
+
+static void notify(media_remux_batch_t *batch, size_t idx)
+{
+	struct media_remux_status status;
+
+	if (!batch->callback)
+		return;
+
+	pthread_mutex_lock(&batch->mutex);
+	status = batch->entries.array[idx].status;
+	pthread_mutex_unlock(&batch->mutex);
+
+	batch->callback(batch->data, idx, &status);
+}
+
+static bool batch_progress(void *data, float percent)
+{
+	struct batch_job *bj = data;
+	media_remux_batch_t *batch = bj->batch;
+	uint64_t elapsed = os_gettime_ns() - bj->start_ts;
+	struct media_remux_status *status;
+
+	pthread_mutex_lock(&batch->mutex);
+	status = &batch->entries.array[bj->idx].status;
+	status->percent    = percent;
+	status->bytes_read = bj->job->bytes_read;
+	if (elapsed)
+		status->bytes_per_sec = (uint64_t)((double)bj->job->bytes_read *
+				1000000000.0 / (double)elapsed);
+	bj->canceled = batch->cancel || batch->entries.array[bj->idx].cancel;
+	pthread_mutex_unlock(&batch->mutex);
+
+	notify(batch, bj->idx);
+	return !bj->canceled;
+}
+
+static bool next_pending_job(media_remux_batch_t *batch, size_t *idx)
+{
+	bool found = false;
+
+	pthread_mutex_lock(&batch->mutex);
+	for (size_t i = 0; !batch->cancel && i < batch->entries.num; i++) {
+		struct batch_entry *entry = batch->entries.array+i;
+
+		if (entry->status.state == MEDIA_REMUX_PENDING) {
+			entry->status.state = MEDIA_REMUX_RUNNING;
+			*idx = i;
+			found = true;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&batch->mutex);
+
+	return found;
+}
+
+static void run_batch_job(media_remux_batch_t *batch, size_t idx)
+{
+	struct batch_job bj = {batch, NULL, idx, os_gettime_ns(), false};
+	enum media_remux_state state = MEDIA_REMUX_FAILED;
+	const char *in_filename;
+	const char *out_filename;
+	bool created = false;
+
+	/* the strings themselves never move, only the array does */
+	pthread_mutex_lock(&batch->mutex);
+	in_filename  = batch->entries.array[idx].in_filename;
+	out_filename = batch->entries.array[idx].out_filename;
+	pthread_mutex_unlock(&batch->mutex);
+
+	if (media_remux_job_create(&bj.job, in_filename, out_filename)) {
+		bool success;
+
+		/* opening the output is the last step of creating the job,
+		 * anything that failed before it left the file untouched */
+		created = true;
+
+		success = media_remux_job_process(bj.job, batch_progress,
+				&bj);
+		media_remux_job_destroy(bj.job);
+
+		if (bj.canceled)
+			state = MEDIA_REMUX_CANCELED;
+		else if (success)
+			state = MEDIA_REMUX_DONE;
+	}
+
+	/* a partial file is of no use to anyone, but a file that was already
+	 * there when the job failed to start isn't ours to delete */
+	if (created && state != MEDIA_REMUX_DONE)
+		os_unlink(out_filename);
+
+	pthread_mutex_lock(&batch->mutex);
+	batch->entries.array[idx].status.state = state;
+	if (state == MEDIA_REMUX_DONE)
+		batch->entries.array[idx].status.percent = 100.0f;
+	pthread_mutex_unlock(&batch->mutex);
+
+	blog(state == MEDIA_REMUX_DONE ? LOG_INFO : LOG_WARNING,
+			"media_remux: '%s' %s", in_filename,
+			state == MEDIA_REMUX_DONE     ? "remuxed" :
+			state == MEDIA_REMUX_CANCELED ? "canceled" : "failed");
+
+	notify(batch, idx);
+}
+
+static void *batch_thread(void *data)
+{
+	media_remux_batch_t *batch = data;
+	size_t idx;
+
+	os_set_thread_name("media-remux: batch thread");
+
+	while (next_pending_job(batch, &idx))
+		run_batch_job(batch, idx);
+
+	return NULL;
+}
+
+static void join_threads(media_remux_batch_t *batch)
+{
+	for (size_t i = 0; i < batch->threads.num; i++)
+		pthread_join(batch->threads.array[i], NULL);
+	da_free(batch->threads);
+}
+
+bool media_remux_batch_start(media_remux_batch_t *batch)
+{
+	size_t pending = 0;
+
+	if (!batch)
+		return false;
+
+	join_threads(batch);
+
+	pthread_mutex_lock(&batch->mutex);
+	batch->cancel = false;
+	for (size_t i = 0; i < batch->entries.num; i++) {
+		struct batch_entry *entry = batch->entries.array+i;
+
+		if (entry->status.state == MEDIA_REMUX_CANCELED) {
+			entry->status.state = MEDIA_REMUX_PENDING;
+			entry->cancel = false;
+		}
+		if (entry->status.state == MEDIA_REMUX_PENDING) {
+			entry->status.percent       = 0.0f;
+			entry->status.bytes_read    = 0;
+			entry->status.bytes_per_sec = 0;
+			pending++;
+		}
+	}
+	pthread_mutex_unlock(&batch->mutex);
+
+	for (size_t i = 0; i < pending && i < batch->max_jobs; i++) {
+		pthread_t thread;
+
+		if (pthread_create(&thread, NULL, batch_thread, batch) != 0)
+			break;
+		da_push_back(batch->threads, &thread);
+	}
+
+	return batch->threads.num > 0 || !pending;
+}
+
+void media_remux_batch_cancel(media_remux_batch_t *batch)
+{
+	if (!batch)
+		return;
+
+	pthread_mutex_lock(&batch->mutex);
+	batch->cancel = true;
+	pthread_mutex_unlock(&batch->mutex);
+
+	join_threads(batch);
+}
+
+void media_remux_batch_cancel_job(media_remux_batch_t *batch, size_t idx)
+{
+	bool notify_now = false;
+
+	if (!batch)
+		return;
+
+	pthread_mutex_lock(&batch->mutex);
+	if (idx < batch->entries.num) {
+		struct batch_entry *entry = batch->entries.array+idx;
+
+		entry->cancel = true;
+		if (entry->status.state == MEDIA_REMUX_PENDING) {
+			entry->status.state = MEDIA_REMUX_CANCELED;
+			notify_now = true;
+		}
+	}
+	pthread_mutex_unlock(&batch->mutex);
+
+	if (notify_now)
+		notify(batch, idx);
+}
+
+bool media_remux_batch_wait(media_remux_batch_t *batch)
+{
+	bool success = true;
+
+	if (!batch)
+		return false;
+
+	join_threads(batch);
+
+	pthread_mutex_lock(&batch->mutex);
+	for (size_t i = 0; i < batch->entries.num; i++)
+		if (batch->entries.array[i].status.state != MEDIA_REMUX_DONE)
+			success = false;
+	pthread_mutex_unlock(&batch->mutex);
+
+	return success;
+}
+
+bool media_remux_batch_get_status(media_remux_batch_t *batch, size_t idx,
+		struct media_remux_status *status)
+{
+	bool found = false;
+
+	if (!batch || !status)
+		return false;
+
+	pthread_mutex_lock(&batch->mutex);
+	if (idx < batch->entries.num) {
+		*status = batch->entries.array[idx].status;
+		found = true;
+	}
+	pthread_mutex_unlock(&batch->mutex);
+
+	return found;
+}
+
+void media_remux_batch_destroy(media_remux_batch_t *batch)
+{
+	if (!batch)
+		return;
+
+	media_remux_batch_cancel(batch);
+
+	for (size_t i = 0; i < batch->entries.num; i++) {
+		bfree(batch->entries.array[i].in_filename);
+		bfree(batch->entries.array[i].out_filename);
+	}
+	da_free(batch->entries);
+
+	pthread_mutex_destroy(&batch->mutex);
+	bfree(batch);
+}
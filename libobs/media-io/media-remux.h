@@ -24,6 +24,28 @@ typedef struct media_remux_job *media_remux_job_t;
 
 typedef bool (media_remux_progress_callback)(void *data, float percent);
 
+struct media_remux_batch;
+typedef struct media_remux_batch media_remux_batch_t;
+
+enum media_remux_state {
+	MEDIA_REMUX_PENDING,
+	MEDIA_REMUX_RUNNING,
+	MEDIA_REMUX_DONE,
+	MEDIA_REMUX_FAILED,
+	MEDIA_REMUX_CANCELED,
+};
+
+struct media_remux_status {
+	enum media_remux_state state;
+	float                  percent;
+	uint64_t               bytes_read;
+	uint64_t               bytes_per_sec;
+};
+
+/* called from the batch's threads whenever a job progresses or finishes */
+typedef void (media_remux_batch_callback)(void *data, size_t idx,
+		const struct media_remux_status *status);
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -34,6 +56,25 @@ EXPORT bool media_remux_job_process(media_remux_job_t job,
 		media_remux_progress_callback callback, void *data);
 EXPORT void media_remux_job_destroy(media_remux_job_t job);
 
+/*
+ * Batches remux a list of files, running up to max_jobs of them at once.
+ * Canceled jobs have their partial output removed; starting the batch again
+ * resumes it, redoing canceled and pending jobs and skipping finished ones.
+ * A batch should only be started, canceled and destroyed from one thread.
+ */
+EXPORT media_remux_batch_t *media_remux_batch_create(size_t max_jobs,
+		media_remux_batch_callback *callback, void *data);
+EXPORT size_t media_remux_batch_add(media_remux_batch_t *batch,
+		const char *in_filename, const char *out_filename);
+EXPORT bool media_remux_batch_start(media_remux_batch_t *batch);
+EXPORT void media_remux_batch_cancel(media_remux_batch_t *batch);
+EXPORT void media_remux_batch_cancel_job(media_remux_batch_t *batch,
+		size_t idx);
+EXPORT bool media_remux_batch_wait(media_remux_batch_t *batch);
+EXPORT bool media_remux_batch_get_status(media_remux_batch_t *batch,
+		size_t idx, struct media_remux_status *status);
+EXPORT void media_remux_batch_destroy(media_remux_batch_t *batch);
+
 #ifdef __cplusplus
 }
 #endif
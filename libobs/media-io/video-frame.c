@@ -20,6 +20,13 @@
 #define ALIGN_SIZE(size, align) \
 	size = (((size)+(align-1)) & (~(align-1)))
 
+static int frame_tag = BMEM_TAG_UNTAGGED;
+
+static inline void *frame_alloc(size_t size)
+{
+	return bmalloc_tagged(size, bmem_tag(&frame_tag, "video frames"));
+}
+
 /* messy code alarm */
 void video_frame_init(struct video_frame *frame, enum video_format format,
 		uint32_t width, uint32_t height)
@@ -46,7 +53,7 @@ void video_frame_init(struct video_frame *frame, enum video_format format,
 		offsets[1] = size;
 		size += (width/2) * (height/2);
 		ALIGN_SIZE(size, alignment);
-		frame->data[0] = bmalloc(size);
+		frame->data[0] = frame_alloc(size);
 		frame->data[1] = (uint8_t*)frame->data[0] + offsets[0];
 		frame->data[2] = (uint8_t*)frame->data[0] + offsets[1];
 		frame->linesize[0] = width;
@@ -60,7 +67,7 @@ void video_frame_init(struct video_frame *frame, enum video_format format,
 		offsets[0] = size;
 		size += (width/2) * (height/2) * 2;
 		ALIGN_SIZE(size, alignment);
-		frame->data[0] = bmalloc(size);
+		frame->data[0] = frame_alloc(size);
 		frame->data[1] = (uint8_t*)frame->data[0] + offsets[0];
 		frame->linesize[0] = width;
 		frame->linesize[1] = width;
@@ -71,7 +78,7 @@ void video_frame_init(struct video_frame *frame, enum video_format format,
 	case VIDEO_FORMAT_UYVY:
 		size = width * height * 2;
 		ALIGN_SIZE(size, alignment);
-		frame->data[0] = bmalloc(size);
+		frame->data[0] = frame_alloc(size);
 		frame->linesize[0] = width*2;
 		break;
 
@@ -80,14 +87,14 @@ void video_frame_init(struct video_frame *frame, enum video_format format,
 	case VIDEO_FORMAT_BGRX:
 		size = width * height * 4;
 		ALIGN_SIZE(size, alignment);
-		frame->data[0] = bmalloc(size);
+		frame->data[0] = frame_alloc(size);
 		frame->linesize[0] = width*4;
 		break;
 
 	case VIDEO_FORMAT_I444:
 		size = width * height;
 		ALIGN_SIZE(size, alignment);
-		frame->data[0] = bmalloc(size * 3);
+		frame->data[0] = frame_alloc(size * 3);
 		frame->data[1] = (uint8_t*)frame->data[0] + size;
 		frame->data[2] = (uint8_t*)frame->data[1] + size;
 		frame->linesize[0] = width;
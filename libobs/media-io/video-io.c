@@ -30,131 +30,372 @@
 extern profiler_name_store_t *obs_get_profiler_name_store(void);
 
 #define MAX_CONVERT_BUFFERS 3
-#define MAX_CACHE_SIZE 16
+#define MAX_CACHE_SIZE 64
+
+/* frame data is pooled and refcounted so that inputs such as encoders can
+ * keep a frame after their callback returns.  once an input holds on to a
+ * cache entry's buffer, the entry simply takes a new one from the pool, so
+ * the pool grows to the cache size plus however many frames the inputs
+ * delay by, rather than the cache itself having to be that deep */
+struct video_frame_pool {
+	pthread_mutex_t                    mutex;
+	DARRAY(struct video_frame_buffer*) free;
+	volatile long                      refs;
+	bool                               closed;
+
+	enum video_format                  format;
+	uint32_t                           width;
+	uint32_t                           height;
+};
+
+struct video_frame_buffer {
+	struct video_frame                 frame;
+	volatile long                      refs;
+	struct video_frame_pool            *pool;
+};
 
 struct cached_frame_info {
 	struct video_data frame;
-	int count;
+	volatile long count;
+
+	/* timestamp the frame was queued with, and how many times it has been
+	 * repeated since, so repeats land exactly on the frame clock */
+	uint64_t timestamp;
+	uint64_t repeats;
+
+	/* pooled frame data, shared with any inputs still holding it */
+	struct video_frame_buffer *buffer;
+
+	/* if set, the frame references external data rather than the cache
+	 * buffer, and release is called once all inputs are done with it */
+	void (*release)(void *param);
+	void *release_param;
 };
 
-struct video_input {
+/* a scaled version of the output, shared by all inputs that use the same
+ * conversion so that each distinct conversion is only scaled once per
+ * frame */
+struct video_rendition {
 	struct video_scale_info   conversion;
 	video_scaler_t            *scaler;
 	struct video_frame        frame[MAX_CONVERT_BUFFERS];
 	int                       cur_frame;
+	long                      refs;
+
+	struct video_data         data;
+	bool                      valid;
+
+	/* wanted by an input this frame / skipped a changed frame */
+	bool                      wanted;
+	bool                      stale;
+};
+
+struct video_input {
+	struct video_scale_info   conversion;
+	struct video_rendition    *rendition;
+	struct video_timing       timing;
+
+	/* frame decimation, see video_scale_info::frame_divisor */
+	uint32_t                  frame_count;
+	bool                      due;
+	bool                      skipped_change;
 
 	void (*callback)(void *param, struct video_data *frame);
 	void *param;
 };
 
-static inline void video_input_free(struct video_input *input)
+static inline void video_rendition_destroy(struct video_rendition *rendition)
 {
 	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
-		video_frame_free(&input->frame[i]);
-	video_scaler_destroy(input->scaler);
+		video_frame_free(&rendition->frame[i]);
+	video_scaler_destroy(rendition->scaler);
+	bfree(rendition);
 }
 
 struct video_output {
 	struct video_output_info   info;
 
 	pthread_t                  thread;
-	pthread_mutex_t            data_mutex;
 	bool                       stop;
 
 	os_sem_t                   *update_semaphore;
 	uint64_t                   frame_time;
 	uint32_t                   skipped_frames;
+	uint32_t                   duplicated_frames;
 	uint32_t                   total_frames;
 
 	bool                       initialized;
 
 	pthread_mutex_t            input_mutex;
 	DARRAY(struct video_input) inputs;
-
-	size_t                     available_frames;
-	size_t                     first_added;
-	size_t                     last_added;
-	struct cached_frame_info   cache[MAX_CACHE_SIZE];
+	DARRAY(struct video_rendition*) renditions;
+	struct video_timing        callback_timing;
+
+	/* single producer/single consumer frame ring.  write_idx is only
+	 * touched by the thread locking frames, read_idx only by the video
+	 * thread, and queued_frames is updated atomically by both */
+	struct cached_frame_info   *cache;
+	struct video_frame_pool    *pool;
+	size_t                     write_idx;
+	size_t                     read_idx;
+	volatile long              queued_frames;
+
+	/* in offline mode the producer waits for a free slot rather than
+	 * merging frames, and slot_event is signalled when one is freed */
+	volatile bool              offline;
+	os_event_t                 *slot_event;
+
+	/* pooled buffer of the newest queued frame, which can be queued
+	 * again by video_output_repeat_frame.  NULL if the newest frame was
+	 * queued by reference.  only touched by the producer */
+	struct video_frame_buffer  *last_buffer;
 };
 
 /* ------------------------------------------------------------------------- */
 
-static inline bool scale_video_output(struct video_input *input,
-		struct video_data *data)
+static struct video_frame_pool *video_frame_pool_create(
+		const struct video_output_info *info)
 {
-	bool success = true;
+	struct video_frame_pool *pool = bzalloc(sizeof(*pool));
 
-	if (input->scaler) {
-		struct video_frame *frame;
+	if (pthread_mutex_init(&pool->mutex, NULL) != 0) {
+		bfree(pool);
+		return NULL;
+	}
 
-		if (++input->cur_frame == MAX_CONVERT_BUFFERS)
-			input->cur_frame = 0;
+	pool->refs   = 1;
+	pool->format = info->format;
+	pool->width  = info->width;
+	pool->height = info->height;
+	return pool;
+}
 
-		frame = &input->frame[input->cur_frame];
+static void video_frame_pool_release(struct video_frame_pool *pool)
+{
+	if (os_atomic_dec_long(&pool->refs) == 0) {
+		pthread_mutex_destroy(&pool->mutex);
+		da_free(pool->free);
+		bfree(pool);
+	}
+}
 
-		success = video_scaler_scale(input->scaler,
-				frame->data, frame->linesize,
-				(const uint8_t * const*)data->data,
-				data->linesize);
+static inline void video_frame_buffer_free(struct video_frame_buffer *buffer)
+{
+	video_frame_free(&buffer->frame);
+	bfree(buffer);
+}
 
-		if (success) {
-			for (size_t i = 0; i < MAX_AV_PLANES; i++) {
-				data->data[i]     = frame->data[i];
-				data->linesize[i] = frame->linesize[i];
-			}
-		} else {
-			blog(LOG_WARNING, "video-io: Could not scale frame!");
-		}
+/* buffers still held by inputs when the pool is closed are freed when
+ * they're released */
+static void video_frame_pool_close(struct video_frame_pool *pool)
+{
+	if (!pool)
+		return;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->closed = true;
+
+	for (size_t i = 0; i < pool->free.num; i++) {
+		video_frame_buffer_free(pool->free.array[i]);
+		os_atomic_dec_long(&pool->refs);
 	}
 
-	return success;
+	da_free(pool->free);
+	pthread_mutex_unlock(&pool->mutex);
+
+	video_frame_pool_release(pool);
+}
+
+static struct video_frame_buffer *video_frame_pool_get(
+		struct video_frame_pool *pool)
+{
+	struct video_frame_buffer *buffer = NULL;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	if (pool->free.num) {
+		buffer = pool->free.array[pool->free.num - 1];
+		da_pop_back(pool->free);
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (!buffer) {
+		buffer = bzalloc(sizeof(*buffer));
+		buffer->pool = pool;
+		video_frame_init(&buffer->frame, pool->format,
+				pool->width, pool->height);
+		os_atomic_inc_long(&pool->refs);
+	}
+
+	buffer->refs = 1;
+	return buffer;
+}
+
+void video_frame_buffer_addref(struct video_frame_buffer *buffer)
+{
+	if (buffer)
+		os_atomic_inc_long(&buffer->refs);
+}
+
+void video_frame_buffer_release(struct video_frame_buffer *buffer)
+{
+	struct video_frame_pool *pool;
+
+	if (!buffer || os_atomic_dec_long(&buffer->refs) != 0)
+		return;
+
+	pool = buffer->pool;
+
+	pthread_mutex_lock(&pool->mutex);
+	if (!pool->closed) {
+		da_push_back(pool->free, &buffer);
+		buffer = NULL;
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (buffer) {
+		video_frame_buffer_free(buffer);
+		video_frame_pool_release(pool);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline void scale_video_output(struct video_rendition *rendition,
+		const struct video_data *data)
+{
+	struct video_frame *frame;
+
+	if (++rendition->cur_frame == MAX_CONVERT_BUFFERS)
+		rendition->cur_frame = 0;
+
+	frame = &rendition->frame[rendition->cur_frame];
+	rendition->data = *data;
+	rendition->data.buffer = NULL;
+
+	rendition->valid = video_scaler_scale(rendition->scaler,
+			frame->data, frame->linesize,
+			(const uint8_t * const*)data->data,
+			data->linesize);
+
+	if (rendition->valid) {
+		for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+			rendition->data.data[i]     = frame->data[i];
+			rendition->data.linesize[i] = frame->linesize[i];
+		}
+	} else {
+		blog(LOG_WARNING, "video-io: Could not scale frame!");
+	}
 }
 
 static inline bool video_output_cur_frame(struct video_output *video)
 {
-	struct cached_frame_info *frame_info;
+	struct cached_frame_info *frame_info = &video->cache[video->read_idx];
+	void (*release)(void *param) = NULL;
+	void *release_param = NULL;
+	uint64_t start_time;
+	bool duplicate;
 	bool complete;
 
 	/* -------------------------------- */
 
-	pthread_mutex_lock(&video->data_mutex);
+	pthread_mutex_lock(&video->input_mutex);
 
-	frame_info = &video->cache[video->first_added];
+	duplicate = frame_info->frame.duplicate;
 
-	pthread_mutex_unlock(&video->data_mutex);
+	for (size_t i = 0; i < video->inputs.num; i++) {
+		struct video_input *input = video->inputs.array+i;
+		uint32_t divisor = input->conversion.frame_divisor;
 
-	/* -------------------------------- */
+		input->due = divisor <= 1 || input->frame_count++ % divisor == 0;
+		if (input->due && input->rendition)
+			input->rendition->wanted = true;
+	}
 
-	pthread_mutex_lock(&video->input_mutex);
+	for (size_t i = 0; i < video->renditions.num; i++) {
+		struct video_rendition *rendition = video->renditions.array[i];
+
+		/* only scale for inputs that take this frame, but remember
+		 * that one was skipped so the last scaled frame isn't reused
+		 * as if it were still current */
+		if (!rendition->wanted) {
+			if (!duplicate)
+				rendition->stale = true;
+			continue;
+		}
+
+		/* the last scaled frame is still valid for repeats */
+		if (!duplicate || !rendition->valid || rendition->stale)
+			scale_video_output(rendition, &frame_info->frame);
+
+		rendition->wanted = false;
+		rendition->stale  = false;
+	}
+
+	start_time = os_gettime_ns();
 
 	for (size_t i = 0; i < video->inputs.num; i++) {
 		struct video_input *input = video->inputs.array+i;
-		struct video_data frame = frame_info->frame;
+		struct video_data frame;
+		uint64_t input_start;
 
-		if (scale_video_output(input, &frame))
-			input->callback(input->param, &frame);
+		if (!input->due) {
+			if (!duplicate)
+				input->skipped_change = true;
+			continue;
+		}
+
+		if (input->rendition) {
+			if (!input->rendition->valid)
+				continue;
+			frame = input->rendition->data;
+			frame.timestamp = frame_info->frame.timestamp;
+		} else {
+			frame = frame_info->frame;
+		}
+
+		/* a repeat after skipped frames still differs from the last
+		 * frame this input got */
+		frame.duplicate = duplicate && !input->skipped_change;
+		input->skipped_change = false;
+
+		input_start = os_gettime_ns();
+		input->callback(input->param, &frame);
+		video_timing_add(&input->timing,
+				os_gettime_ns() - input_start,
+				video->frame_time);
 	}
 
+	video_timing_add(&video->callback_timing,
+			os_gettime_ns() - start_time, video->frame_time);
+
 	pthread_mutex_unlock(&video->input_mutex);
 
 	/* -------------------------------- */
 
-	pthread_mutex_lock(&video->data_mutex);
-
-	frame_info->frame.timestamp += video->frame_time;
-	complete = --frame_info->count == 0;
+	frame_info->frame.timestamp = frame_info->timestamp +
+		video_output_get_frame_offset(video, ++frame_info->repeats);
+	frame_info->frame.duplicate = true;
+	complete = os_atomic_dec_long(&frame_info->count) == 0;
 
 	if (complete) {
-		if (++video->first_added == video->info.cache_size)
-			video->first_added = 0;
+		release       = frame_info->release;
+		release_param = frame_info->release_param;
+		frame_info->release       = NULL;
+		frame_info->release_param = NULL;
 
-		if (++video->available_frames == video->info.cache_size)
-			video->last_added = video->first_added;
-	}
+		if (++video->read_idx == video->info.cache_size)
+			video->read_idx = 0;
 
-	pthread_mutex_unlock(&video->data_mutex);
+		/* hands the slot back to the producer */
+		os_atomic_dec_long(&video->queued_frames);
+		if (video->offline)
+			os_event_signal(video->slot_event);
 
-	/* -------------------------------- */
+		if (release)
+			release(release_param);
+	}
 
 	return complete;
 }
@@ -164,6 +405,9 @@ static void *video_thread(void *param)
 	struct video_output *video = param;
 
 	os_set_thread_name("video-io: video thread");
+	if (!os_apply_thread_settings(&video->info.thread_settings))
+		blog(LOG_WARNING, "video-io: Could not apply all thread "
+		                  "settings");
 
 	const char *video_thread_name =
 		profile_store_name(obs_get_profiler_name_store(),
@@ -176,7 +420,7 @@ static void *video_thread(void *param)
 		profile_start(video_thread_name);
 		while (!video->stop && !video_output_cur_frame(video)) {
 			video->total_frames++;
-			video->skipped_frames++;
+			video->duplicated_frames++;
 		}
 
 		video->total_frames++;
@@ -196,20 +440,30 @@ static inline bool valid_video_params(const struct video_output_info *info)
 	       info->fps_num != 0;
 }
 
-static inline void init_cache(struct video_output *video)
+static inline bool init_cache(struct video_output *video)
 {
 	if (video->info.cache_size > MAX_CACHE_SIZE)
 		video->info.cache_size = MAX_CACHE_SIZE;
+	else if (video->info.cache_size == 0)
+		video->info.cache_size = 1;
+
+	video->pool = video_frame_pool_create(&video->info);
+	if (!video->pool)
+		return false;
+
+	video->cache = bzalloc(sizeof(struct cached_frame_info) *
+			video->info.cache_size);
 
 	for (size_t i = 0; i < video->info.cache_size; i++) {
-		struct video_frame *frame;
-		frame = (struct video_frame*)&video->cache[i];
+		struct cached_frame_info *cfi = &video->cache[i];
 
-		video_frame_init(frame, video->info.format,
-				video->info.width, video->info.height);
+		cfi->buffer = video_frame_pool_get(video->pool);
+		memcpy(&cfi->frame, &cfi->buffer->frame,
+				sizeof(struct video_frame));
+		cfi->frame.buffer = cfi->buffer;
 	}
 
-	video->available_frames = video->info.cache_size;
+	return true;
 }
 
 int video_output_open(video_t **video, struct video_output_info *info)
@@ -229,21 +483,21 @@ int video_output_open(video_t **video, struct video_output_info *info)
 		(double)info->fps_num);
 	out->initialized = false;
 
+	if (!init_cache(out))
+		goto fail;
 	if (pthread_mutexattr_init(&attr) != 0)
 		goto fail;
 	if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) != 0)
 		goto fail;
-	if (pthread_mutex_init(&out->data_mutex, &attr) != 0)
-		goto fail;
 	if (pthread_mutex_init(&out->input_mutex, &attr) != 0)
 		goto fail;
 	if (os_sem_init(&out->update_semaphore, 0) != 0)
 		goto fail;
+	if (os_event_init(&out->slot_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
 	if (pthread_create(&out->thread, NULL, video_thread, out) != 0)
 		goto fail;
 
-	init_cache(out);
-
 	out->initialized = true;
 	*video = out;
 	return VIDEO_OUTPUT_SUCCESS;
@@ -260,15 +514,23 @@ void video_output_close(video_t *video)
 
 	video_output_stop(video);
 
-	for (size_t i = 0; i < video->inputs.num; i++)
-		video_input_free(&video->inputs.array[i]);
+	for (size_t i = 0; i < video->renditions.num; i++)
+		video_rendition_destroy(video->renditions.array[i]);
+	da_free(video->renditions);
 	da_free(video->inputs);
 
-	for (size_t i = 0; i < video->info.cache_size; i++)
-		video_frame_free((struct video_frame*)&video->cache[i]);
+	for (size_t i = 0; video->cache && i < video->info.cache_size; i++) {
+		struct cached_frame_info *cfi = &video->cache[i];
+
+		if (cfi->release)
+			cfi->release(cfi->release_param);
+		video_frame_buffer_release(cfi->buffer);
+	}
 
+	bfree(video->cache);
+	video_frame_pool_close(video->pool);
 	os_sem_destroy(video->update_semaphore);
-	pthread_mutex_destroy(&video->data_mutex);
+	os_event_destroy(video->slot_event);
 	pthread_mutex_destroy(&video->input_mutex);
 	bfree(video);
 }
@@ -286,42 +548,98 @@ static size_t video_get_input_idx(const video_t *video,
 	return DARRAY_INVALID;
 }
 
+/* the frame divisor is left out, it's applied per input so inputs taking
+ * different frame rates can still share the same scaled frames */
+static inline bool scale_info_equal(const struct video_scale_info *a,
+		const struct video_scale_info *b)
+{
+	return a->format     == b->format &&
+	       a->width      == b->width &&
+	       a->height     == b->height &&
+	       a->range      == b->range &&
+	       a->colorspace == b->colorspace;
+}
+
+static struct video_rendition *video_rendition_create(
+		struct video_output *video,
+		const struct video_scale_info *conversion)
+{
+	struct video_rendition *rendition;
+	struct video_scale_info from = {
+		.format = video->info.format,
+		.width  = video->info.width,
+		.height = video->info.height,
+	};
+	int ret;
+
+	rendition = bzalloc(sizeof(struct video_rendition));
+	rendition->conversion = *conversion;
+
+	ret = video_scaler_create(&rendition->scaler, conversion, &from,
+			VIDEO_SCALE_FAST_BILINEAR);
+	if (ret != VIDEO_SCALER_SUCCESS) {
+		if (ret == VIDEO_SCALER_BAD_CONVERSION)
+			blog(LOG_ERROR, "video_input_init: Bad "
+			                "scale conversion type");
+		else
+			blog(LOG_ERROR, "video_input_init: Failed to "
+			                "create scaler");
+
+		bfree(rendition);
+		return NULL;
+	}
+
+	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
+		video_frame_init(&rendition->frame[i],
+				conversion->format,
+				conversion->width,
+				conversion->height);
+
+	return rendition;
+}
+
 static inline bool video_input_init(struct video_input *input,
 		struct video_output *video)
 {
-	if (input->conversion.width  != video->info.width ||
-	    input->conversion.height != video->info.height ||
-	    input->conversion.format != video->info.format) {
-		struct video_scale_info from = {
-			.format = video->info.format,
-			.width  = video->info.width,
-			.height = video->info.height,
-		};
-
-		int ret = video_scaler_create(&input->scaler,
-				&input->conversion, &from,
-				VIDEO_SCALE_FAST_BILINEAR);
-		if (ret != VIDEO_SCALER_SUCCESS) {
-			if (ret == VIDEO_SCALER_BAD_CONVERSION)
-				blog(LOG_ERROR, "video_input_init: Bad "
-				                "scale conversion type");
-			else
-				blog(LOG_ERROR, "video_input_init: Failed to "
-				                "create scaler");
+	struct video_rendition *rendition;
 
-			return false;
-		}
+	if (input->conversion.width  == video->info.width &&
+	    input->conversion.height == video->info.height &&
+	    input->conversion.format == video->info.format)
+		return true;
+
+	for (size_t i = 0; i < video->renditions.num; i++) {
+		rendition = video->renditions.array[i];
 
-		for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
-			video_frame_init(&input->frame[i],
-					input->conversion.format,
-					input->conversion.width,
-					input->conversion.height);
+		if (scale_info_equal(&rendition->conversion,
+					&input->conversion)) {
+			rendition->refs++;
+			input->rendition = rendition;
+			return true;
+		}
 	}
 
+	rendition = video_rendition_create(video, &input->conversion);
+	if (!rendition)
+		return false;
+
+	rendition->refs = 1;
+	input->rendition = rendition;
+	da_push_back(video->renditions, &rendition);
 	return true;
 }
 
+static inline void video_input_free(struct video_output *video,
+		struct video_input *input)
+{
+	struct video_rendition *rendition = input->rendition;
+
+	if (rendition && --rendition->refs == 0) {
+		da_erase_item(video->renditions, &rendition);
+		video_rendition_destroy(rendition);
+	}
+}
+
 bool video_output_connect(video_t *video,
 		const struct video_scale_info *conversion,
 		void (*callback)(void *param, struct video_data *frame),
@@ -375,7 +693,7 @@ void video_output_disconnect(video_t *video,
 
 	size_t idx = video_get_input_idx(video, callback, param);
 	if (idx != DARRAY_INVALID) {
-		video_input_free(video->inputs.array+idx);
+		video_input_free(video, video->inputs.array+idx);
 		da_erase(video->inputs, idx);
 	}
 
@@ -393,50 +711,153 @@ const struct video_output_info *video_output_get_info(const video_t *video)
 	return video ? &video->info : NULL;
 }
 
+/* adds to the repeat count of the newest queued frame, unless the video
+ * thread has already finished with it (in which case a slot is about to be
+ * handed back and the frame can be queued normally) */
+static bool duplicate_last_frame(struct video_output *video, long count)
+{
+	size_t last = video->write_idx ?
+		video->write_idx - 1 : video->info.cache_size - 1;
+	volatile long *last_count = &video->cache[last].count;
+
+	while (video->queued_frames == (long)video->info.cache_size) {
+		long cur = *last_count;
+		if (cur <= 0)
+			continue;
+		if (os_atomic_compare_swap_long(last_count, cur, cur + count))
+			return true;
+	}
+
+	return false;
+}
+
+/* offline mode never drops or merges frames, so wait for the video thread to
+ * hand back a slot instead */
+static bool wait_for_free_slot(struct video_output *video)
+{
+	while (os_atomic_load_long(&video->queued_frames) ==
+			(long)video->info.cache_size) {
+		if (video->stop)
+			return false;
+		os_event_timedwait(video->slot_event, 10);
+	}
+
+	return true;
+}
+
+static struct cached_frame_info *lock_cached_frame(struct video_output *video,
+		int count, uint64_t timestamp, bool duplicate)
+{
+	struct cached_frame_info *cfi;
+
+	if (video->offline) {
+		if (!wait_for_free_slot(video))
+			return NULL;
+
+	} else if (duplicate_last_frame(video, count)) {
+		video->skipped_frames += count;
+		return NULL;
+	}
+
+	cfi = &video->cache[video->write_idx];
+	cfi->frame.timestamp = timestamp;
+	cfi->frame.duplicate = duplicate;
+	cfi->timestamp = timestamp;
+	cfi->repeats = 0;
+	cfi->count = count;
+	return cfi;
+}
+
+static inline void queue_cached_frame(struct video_output *video)
+{
+	if (++video->write_idx == video->info.cache_size)
+		video->write_idx = 0;
+
+	os_atomic_inc_long(&video->queued_frames);
+	os_sem_post(video->update_semaphore);
+}
+
 bool video_output_lock_frame(video_t *video, struct video_frame *frame,
 		int count, uint64_t timestamp)
 {
 	struct cached_frame_info *cfi;
-	bool locked;
 
 	if (!video) return false;
 
-	pthread_mutex_lock(&video->data_mutex);
+	cfi = lock_cached_frame(video, count, timestamp, false);
+	if (cfi) {
+		/* an input is still holding on to the last frame written to
+		 * this entry, so give the entry a different buffer */
+		if (cfi->buffer->refs > 1) {
+			video_frame_buffer_release(cfi->buffer);
+			cfi->buffer = video_frame_pool_get(video->pool);
+		}
 
-	if (video->available_frames == 0) {
-		video->cache[video->last_added].count += count;
-		locked = false;
+		memcpy(&cfi->frame, &cfi->buffer->frame,
+				sizeof(struct video_frame));
+		memcpy(frame, &cfi->buffer->frame, sizeof(*frame));
+		cfi->frame.buffer = cfi->buffer;
+		video->last_buffer = cfi->buffer;
+	}
 
-	} else {
-		if (video->available_frames != video->info.cache_size) {
-			if (++video->last_added == video->info.cache_size)
-				video->last_added = 0;
-		}
+	return cfi != NULL;
+}
+
+bool video_output_push_frame_ref(video_t *video,
+		const struct video_frame *frame, int count, uint64_t timestamp,
+		bool duplicate, void (*release)(void *param), void *param)
+{
+	struct cached_frame_info *cfi;
 
-		cfi = &video->cache[video->last_added];
-		cfi->frame.timestamp = timestamp;
-		cfi->count = count;
+	if (!video || !frame || !release) return false;
 
-		memcpy(frame, &cfi->frame, sizeof(*frame));
+	cfi = lock_cached_frame(video, count, timestamp, duplicate);
+	if (cfi) {
+		memcpy(&cfi->frame, frame, sizeof(*frame));
+		cfi->frame.buffer  = NULL;
+		cfi->release       = release;
+		cfi->release_param = param;
+		video->last_buffer = NULL;
 
-		locked = true;
+		queue_cached_frame(video);
 	}
 
-	pthread_mutex_unlock(&video->data_mutex);
+	return cfi != NULL;
+}
 
-	return locked;
+/* the entry shares the buffer of the newest frame, which stays valid because
+ * entries only ever get a new buffer when they're locked again, and an entry
+ * holding a buffer that is also used elsewhere always gets a new one */
+bool video_output_repeat_frame(video_t *video, int count, uint64_t timestamp)
+{
+	struct video_frame_buffer *buffer;
+	struct cached_frame_info *cfi;
+
+	if (!video || !video->last_buffer) return false;
+
+	buffer = video->last_buffer;
+
+	cfi = lock_cached_frame(video, count, timestamp, true);
+	if (cfi) {
+		video_frame_buffer_addref(buffer);
+		video_frame_buffer_release(cfi->buffer);
+		cfi->buffer = buffer;
+
+		memcpy(&cfi->frame, &buffer->frame,
+				sizeof(struct video_frame));
+		cfi->frame.buffer = buffer;
+
+		queue_cached_frame(video);
+	}
+
+	return true;
 }
 
 void video_output_unlock_frame(video_t *video)
 {
 	if (!video) return;
 
-	pthread_mutex_lock(&video->data_mutex);
-
-	video->available_frames--;
-	os_sem_post(video->update_semaphore);
-
-	pthread_mutex_unlock(&video->data_mutex);
+	queue_cached_frame(video);
 }
 
 uint64_t video_output_get_frame_time(const video_t *video)
@@ -444,6 +865,22 @@ uint64_t video_output_get_frame_time(const video_t *video)
 	return video ? video->frame_time : 0;
 }
 
+/* split at whole multiples of fps_num, which are exact, so that the product
+ * can't overflow for any realistic frame count */
+uint64_t video_output_get_frame_offset(const video_t *video, uint64_t frames)
+{
+	uint64_t num, den;
+
+	if (!video)
+		return 0;
+
+	num = video->info.fps_num;
+	den = video->info.fps_den;
+
+	return frames / num * den * 1000000000ULL +
+		frames % num * den * 1000000000ULL / num;
+}
+
 void video_output_stop(video_t *video)
 {
 	void *thread_ret;
@@ -459,6 +896,15 @@ void video_output_stop(video_t *video)
 	}
 }
 
+void video_output_set_offline(video_t *video, bool offline)
+{
+	if (!video)
+		return;
+
+	video->offline = offline;
+	os_event_signal(video->slot_event);
+}
+
 bool video_output_stopped(video_t *video)
 {
 	if (!video)
@@ -495,7 +941,49 @@ uint32_t video_output_get_skipped_frames(const video_t *video)
 	return video->skipped_frames;
 }
 
+uint32_t video_output_get_duplicated_frames(const video_t *video)
+{
+	return video->duplicated_frames;
+}
+
 uint32_t video_output_get_total_frames(const video_t *video)
 {
 	return video->total_frames;
 }
+
+void video_output_add_skipped_frames(video_t *video, uint32_t count)
+{
+	if (video)
+		video->skipped_frames += count;
+}
+
+bool video_output_get_callback_timing(video_t *video,
+		struct video_timing *timing)
+{
+	if (!video || !timing)
+		return false;
+
+	pthread_mutex_lock(&video->input_mutex);
+	*timing = video->callback_timing;
+	pthread_mutex_unlock(&video->input_mutex);
+	return true;
+}
+
+bool video_output_get_input_timing(video_t *video,
+		void (*callback)(void *param, struct video_data *frame),
+		void *param, struct video_timing *timing)
+{
+	size_t idx;
+
+	if (!video || !callback || !timing)
+		return false;
+
+	pthread_mutex_lock(&video->input_mutex);
+
+	idx = video_get_input_idx(video, callback, param);
+	if (idx != DARRAY_INVALID)
+		*timing = video->inputs.array[idx].timing;
+
+	pthread_mutex_unlock(&video->input_mutex);
+	return idx != DARRAY_INVALID;
+}
@@ -18,6 +18,7 @@
 #pragma once
 
 #include "media-io-defs.h"
+#include "../util/threading.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -63,10 +64,22 @@ enum video_range_type {
 	VIDEO_RANGE_FULL
 };
 
+struct video_frame_buffer;
+
 struct video_data {
 	uint8_t           *data[MAX_AV_PLANES];
 	uint32_t          linesize[MAX_AV_PLANES];
 	uint64_t          timestamp;
+
+	/* same image as the previous frame sent to this input, either because
+	 * nothing changed or because the output fell behind, so encoders can
+	 * signal a repeat rather than encoding it again */
+	bool              duplicate;
+
+	/* refcounted buffer holding the frame data, if any.  inputs that need
+	 * the data after their callback returns take a reference with
+	 * video_frame_buffer_addref rather than copying it */
+	struct video_frame_buffer *buffer;
 };
 
 struct video_output_info {
@@ -81,6 +94,9 @@ struct video_output_info {
 
 	enum video_colorspace colorspace;
 	enum video_range_type range;
+
+	/* scheduling settings of the thread that outputs the frames */
+	struct os_thread_settings thread_settings;
 };
 
 static inline bool format_is_yuv(enum video_format format)
@@ -135,8 +151,50 @@ struct video_scale_info {
 	uint32_t              height;
 	enum video_range_type range;
 	enum video_colorspace colorspace;
+
+	/* only every frame_divisor-th frame is delivered, 0 or 1 for all */
+	uint32_t              frame_divisor;
 };
 
+#define VIDEO_TIMING_WINDOW 120
+
+/** Rolling timing statistics for a stage of the video pipeline */
+struct video_timing {
+	uint64_t          count;         /**< Number of samples */
+	uint64_t          over_budget;   /**< Samples longer than a frame */
+	uint64_t          last_ns;       /**< Most recent sample */
+	uint64_t          avg_ns;        /**< Moving average, 1/16 weight */
+
+	/** Maximum of the last one to two windows of samples */
+	uint64_t          max_ns;
+	/** Maximum of the current, incomplete window of samples */
+	uint64_t          window_max_ns;
+};
+
+static inline void video_timing_add(struct video_timing *timing,
+		uint64_t ns, uint64_t budget_ns)
+{
+	if (timing->count++)
+		timing->avg_ns = timing->avg_ns - (timing->avg_ns >> 4) +
+			(ns >> 4);
+	else
+		timing->avg_ns = ns;
+
+	if (ns > budget_ns)
+		timing->over_budget++;
+	if (ns > timing->max_ns)
+		timing->max_ns = ns;
+	if (ns > timing->window_max_ns)
+		timing->window_max_ns = ns;
+
+	if (timing->count % VIDEO_TIMING_WINDOW == 0) {
+		timing->max_ns = timing->window_max_ns;
+		timing->window_max_ns = 0;
+	}
+
+	timing->last_ns = ns;
+}
+
 EXPORT enum video_format video_format_from_fourcc(uint32_t fourcc);
 
 EXPORT bool video_format_get_parameters(enum video_colorspace color_space,
@@ -165,8 +223,55 @@ EXPORT const struct video_output_info *video_output_get_info(
 EXPORT bool video_output_lock_frame(video_t *video, struct video_frame *frame,
 		int count, uint64_t timestamp);
 EXPORT void video_output_unlock_frame(video_t *video);
+
+/**
+ * Queues a frame by reference rather than copying it in to the frame cache.
+ * The frame data must remain valid until release is called, which happens
+ * once the last input has been given the frame (or when the output is
+ * closed).  Set duplicate if the image is the same as the previous frame's.
+ * Returns false if the frame cache is full, in which case the frame is
+ * counted as a duplicate of the last frame and release is not called.
+ */
+EXPORT bool video_output_push_frame_ref(video_t *video,
+		const struct video_frame *frame, int count, uint64_t timestamp,
+		bool duplicate, void (*release)(void *param), void *param);
+
+/**
+ * Queues the last frame again, flagged as a duplicate, for a frame whose
+ * image didn't change.  Nothing is copied or scaled.  Returns false if the
+ * last frame was queued by reference and is no longer available, in which
+ * case the frame has to be queued normally.
+ */
+EXPORT bool video_output_repeat_frame(video_t *video, int count,
+		uint64_t timestamp);
+
+/**
+ * References to the pooled buffer of a frame given to an input.  The buffer
+ * won't be reused until every reference has been released, and may outlive
+ * the video output.
+ */
+EXPORT void video_frame_buffer_addref(struct video_frame_buffer *buffer);
+EXPORT void video_frame_buffer_release(struct video_frame_buffer *buffer);
+
+/**
+ * Returns the frame interval in nanoseconds, rounded down.  Don't add it up
+ * to get the time of a frame, use video_output_get_frame_offset instead.
+ */
 EXPORT uint64_t video_output_get_frame_time(const video_t *video);
+
+/**
+ * Returns the exact time of the given frame number relative to frame 0, in
+ * nanoseconds: frames * fps_den * 1000000000 / fps_num, rounded down.  Frame
+ * timestamps follow this clock, so it doesn't drift against audio however
+ * long the video runs, even at rates such as 29.97 or 59.94.
+ */
+EXPORT uint64_t video_output_get_frame_offset(const video_t *video,
+		uint64_t frames);
 EXPORT void video_output_stop(video_t *video);
+
+/* in offline mode locking or pushing a frame waits for the outputs to catch
+ * up instead of skipping frames, so every frame rendered is delivered */
+EXPORT void video_output_set_offline(video_t *video, bool offline);
 EXPORT bool video_output_stopped(video_t *video);
 
 EXPORT enum video_format video_output_get_format(const video_t *video);
@@ -175,8 +280,22 @@ EXPORT uint32_t video_output_get_height(const video_t *video);
 EXPORT double video_output_get_frame_rate(const video_t *video);
 
 EXPORT uint32_t video_output_get_skipped_frames(const video_t *video);
+EXPORT uint32_t video_output_get_duplicated_frames(const video_t *video);
 EXPORT uint32_t video_output_get_total_frames(const video_t *video);
 
+/** Counts frames skipped by a video output derived from this one, so that
+ * they show up in the skipped frames of this output.  Must be called from
+ * the thread that outputs the frames */
+EXPORT void video_output_add_skipped_frames(video_t *video, uint32_t count);
+
+/** Gets the time spent calling all inputs of each frame */
+EXPORT bool video_output_get_callback_timing(video_t *video,
+		struct video_timing *timing);
+/** Gets the time spent in the callback of a connected input */
+EXPORT bool video_output_get_input_timing(video_t *video,
+		void (*callback)(void *param, struct video_data *frame),
+		void *param, struct video_timing *timing);
+
 
 #ifdef __cplusplus
 }
@@ -16,13 +16,78 @@
 ******************************************************************************/
 
 #include "../util/bmem.h"
+#include "../util/darray.h"
+#include "../util/threading.h"
+#include "../util/task-pool.h"
 #include "video-scaler.h"
 
 #include <libswscale/swscale.h>
 
+extern os_task_pool_t *obs_get_task_pool(void);
+
+/*
+ * Frames that keep their height (format conversions and horizontal-only
+ * scaling) are cut in to horizontal slices that are scaled in parallel on
+ * the libobs task pool, each slice with its own SwsContext.  Vertical
+ * scaling needs rows from across slice boundaries, so it stays single
+ * threaded.
+ *
+ * SwsContexts are expensive to set up and can't be shared between threads,
+ * so the ones no longer in use are kept in a small process-wide cache and
+ * handed to the next scaler that needs the exact same conversion.
+ */
+
+#define MAX_SLICES          8
+#define MIN_SLICE_HEIGHT    64
+#define MAX_CACHED_CONTEXTS 16
+
+struct scaler_key {
+	int                src_width;
+	int                src_height;
+	enum AVPixelFormat src_format;
+	int                src_range;
+	enum video_colorspace src_colorspace;
+
+	int                dst_width;
+	int                dst_height;
+	enum AVPixelFormat dst_format;
+	int                dst_range;
+	enum video_colorspace dst_colorspace;
+
+	int                flags;
+};
+
+struct cached_context {
+	struct scaler_key  key;
+	struct SwsContext  *swscale;
+};
+
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DARRAY(struct cached_context) context_cache;
+
+struct video_scaler;
+
+struct scaler_slice {
+	struct video_scaler *scaler;
+	struct scaler_key   key;
+	struct SwsContext   *swscale;
+	int                 y;
+	bool                success;
+};
+
 struct video_scaler {
-	struct SwsContext *swscale;
-	int src_height;
+	enum video_format   src_format;
+	enum video_format   dst_format;
+
+	struct scaler_slice slices[MAX_SLICES];
+	size_t              num_slices;
+	os_task_group_t     *group;
+
+	/* the frame being scaled, set for the duration of video_scaler_scale */
+	uint8_t             **output;
+	const uint32_t      *out_linesize;
+	const uint8_t *const *input;
+	const uint32_t      *in_linesize;
 };
 
 static inline enum AVPixelFormat get_ffmpeg_video_format(
@@ -81,6 +146,118 @@ static inline int get_ffmpeg_range_type(enum video_range_type type)
 
 #define FIXED_1_0 (1<<16)
 
+static inline bool keys_equal(const struct scaler_key *a,
+		const struct scaler_key *b)
+{
+	return memcmp(a, b, sizeof(*a)) == 0;
+}
+
+static struct SwsContext *create_context(const struct scaler_key *key)
+{
+	struct SwsContext *swscale;
+	int ret;
+
+	swscale = sws_getContext(
+			key->src_width, key->src_height, key->src_format,
+			key->dst_width, key->dst_height, key->dst_format,
+			key->flags, NULL, NULL, NULL);
+	if (!swscale)
+		return NULL;
+
+	ret = sws_setColorspaceDetails(swscale,
+			get_ffmpeg_coeffs(key->src_colorspace), key->src_range,
+			get_ffmpeg_coeffs(key->dst_colorspace), key->dst_range,
+			0, FIXED_1_0, FIXED_1_0);
+	if (ret < 0) {
+		blog(LOG_DEBUG, "video_scaler_create: "
+		                "sws_setColorspaceDetails failed, ignoring");
+	}
+
+	return swscale;
+}
+
+static struct SwsContext *acquire_context(const struct scaler_key *key)
+{
+	struct SwsContext *swscale = NULL;
+
+	pthread_mutex_lock(&cache_mutex);
+
+	for (size_t i = context_cache.num; i > 0; i--) {
+		struct cached_context *cached = context_cache.array + i - 1;
+
+		if (keys_equal(&cached->key, key)) {
+			swscale = cached->swscale;
+			da_erase(context_cache, i - 1);
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&cache_mutex);
+
+	return swscale ? swscale : create_context(key);
+}
+
+/* the oldest context is dropped once the cache is full */
+static void release_context(const struct scaler_key *key,
+		struct SwsContext *swscale)
+{
+	struct SwsContext *evicted = NULL;
+	struct cached_context cached;
+
+	if (!swscale)
+		return;
+
+	memset(&cached, 0, sizeof(cached));
+	cached.key     = *key;
+	cached.swscale = swscale;
+
+	pthread_mutex_lock(&cache_mutex);
+
+	if (context_cache.num == MAX_CACHED_CONTEXTS) {
+		evicted = context_cache.array[0].swscale;
+		da_erase(context_cache, 0);
+	}
+
+	da_push_back(context_cache, &cached);
+
+	pthread_mutex_unlock(&cache_mutex);
+
+	sws_freeContext(evicted);
+}
+
+void video_scaler_clear_cache(void)
+{
+	pthread_mutex_lock(&cache_mutex);
+
+	for (size_t i = 0; i < context_cache.num; i++)
+		sws_freeContext(context_cache.array[i].swscale);
+	da_free(context_cache);
+
+	pthread_mutex_unlock(&cache_mutex);
+}
+
+static inline bool subsampled_vertically(enum video_format format)
+{
+	return format == VIDEO_FORMAT_I420 || format == VIDEO_FORMAT_NV12;
+}
+
+static inline size_t get_num_slices(const struct video_scale_info *dst,
+		const struct video_scale_info *src, os_task_pool_t *pool)
+{
+	size_t slices;
+
+	if (!pool || src->height != dst->height)
+		return 1;
+
+	slices = os_task_pool_threads(pool) + 1;
+	if (slices > MAX_SLICES)
+		slices = MAX_SLICES;
+	if (slices > src->height / MIN_SLICE_HEIGHT)
+		slices = src->height / MIN_SLICE_HEIGHT;
+
+	return slices ? slices : 1;
+}
+
 int video_scaler_create(video_scaler_t **scaler_out,
 		const struct video_scale_info *dst,
 		const struct video_scale_info *src,
@@ -88,13 +265,10 @@ int video_scaler_create(video_scaler_t **scaler_out,
 {
 	enum AVPixelFormat format_src = get_ffmpeg_video_format(src->format);
 	enum AVPixelFormat format_dst = get_ffmpeg_video_format(dst->format);
-	int                scale_type = get_ffmpeg_scale_type(type);
-	const int          *coeff_src = get_ffmpeg_coeffs(src->colorspace);
-	const int          *coeff_dst = get_ffmpeg_coeffs(dst->colorspace);
-	int                range_src  = get_ffmpeg_range_type(src->range);
-	int                range_dst  = get_ffmpeg_range_type(dst->range);
+	os_task_pool_t     *pool      = obs_get_task_pool();
 	struct video_scaler *scaler;
-	int ret;
+	struct scaler_key  key;
+	int                slice_height;
 
 	if (!scaler_out)
 		return VIDEO_SCALER_FAILED;
@@ -103,26 +277,55 @@ int video_scaler_create(video_scaler_t **scaler_out,
 	    format_dst == AV_PIX_FMT_NONE)
 		return VIDEO_SCALER_BAD_CONVERSION;
 
+	memset(&key, 0, sizeof(key));
+	key.src_width      = (int)src->width;
+	key.src_format     = format_src;
+	key.src_range      = get_ffmpeg_range_type(src->range);
+	key.src_colorspace = src->colorspace;
+	key.dst_width      = (int)dst->width;
+	key.dst_format     = format_dst;
+	key.dst_range      = get_ffmpeg_range_type(dst->range);
+	key.dst_colorspace = dst->colorspace;
+	key.flags          = get_ffmpeg_scale_type(type);
+
 	scaler = bzalloc(sizeof(struct video_scaler));
-	scaler->src_height = src->height;
-
-	scaler->swscale = sws_getCachedContext(NULL,
-			src->width, src->height, format_src,
-			dst->width, dst->height, format_dst,
-			scale_type, NULL, NULL, NULL);
-	if (!scaler->swscale) {
-		blog(LOG_ERROR, "video_scaler_create: Could not create "
-		                "swscale");
-		goto fail;
+	scaler->src_format = src->format;
+	scaler->dst_format = dst->format;
+	scaler->num_slices = get_num_slices(dst, src, pool);
+
+	/* slices start on even rows so 4:2:0 chroma rows line up */
+	slice_height = ((int)src->height / (int)scaler->num_slices) & ~1;
+
+	for (size_t i = 0; i < scaler->num_slices; i++) {
+		struct scaler_slice *slice = &scaler->slices[i];
+		bool last = i == scaler->num_slices - 1;
+
+		slice->scaler = scaler;
+		slice->y      = (int)i * slice_height;
+		slice->key    = key;
+
+		if (scaler->num_slices == 1) {
+			slice->key.src_height = (int)src->height;
+			slice->key.dst_height = (int)dst->height;
+		} else {
+			int height = last ?
+				(int)src->height - slice->y : slice_height;
+			slice->key.src_height = height;
+			slice->key.dst_height = height;
+		}
+
+		slice->swscale = acquire_context(&slice->key);
+		if (!slice->swscale) {
+			blog(LOG_ERROR, "video_scaler_create: Could not "
+			                "create swscale");
+			goto fail;
+		}
 	}
 
-	ret = sws_setColorspaceDetails(scaler->swscale,
-			coeff_src, range_src,
-			coeff_dst, range_dst,
-			0, FIXED_1_0, FIXED_1_0);
-	if (ret < 0) {
-		blog(LOG_DEBUG, "video_scaler_create: "
-		                "sws_setColorspaceDetails failed, ignoring");
+	if (scaler->num_slices > 1) {
+		scaler->group = os_task_group_create(pool);
+		if (!scaler->group)
+			goto fail;
 	}
 
 	*scaler_out = scaler;
@@ -136,27 +339,77 @@ fail:
 void video_scaler_destroy(video_scaler_t *scaler)
 {
 	if (scaler) {
-		sws_freeContext(scaler->swscale);
+		os_task_group_destroy(scaler->group);
+
+		for (size_t i = 0; i < scaler->num_slices; i++)
+			release_context(&scaler->slices[i].key,
+					scaler->slices[i].swscale);
 		bfree(scaler);
 	}
 }
 
+static inline int plane_row(enum video_format format, size_t plane, int y)
+{
+	return plane > 0 && subsampled_vertically(format) ? y / 2 : y;
+}
+
+static void scale_slice(void *param)
+{
+	struct scaler_slice *slice = param;
+	struct video_scaler *scaler = slice->scaler;
+	const uint8_t *input[MAX_AV_PLANES];
+	uint8_t *output[MAX_AV_PLANES];
+	int ret;
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		input[i] = scaler->input[i] ? scaler->input[i] +
+			(size_t)plane_row(scaler->src_format, i, slice->y) *
+			scaler->in_linesize[i] : NULL;
+		output[i] = scaler->output[i] ? scaler->output[i] +
+			(size_t)plane_row(scaler->dst_format, i, slice->y) *
+			scaler->out_linesize[i] : NULL;
+	}
+
+	ret = sws_scale(slice->swscale,
+			input, (const int *)scaler->in_linesize,
+			0, slice->key.src_height,
+			output, (const int *)scaler->out_linesize);
+	slice->success = ret > 0;
+
+	if (!slice->success)
+		blog(LOG_ERROR, "video_scaler_scale: sws_scale failed: %d",
+				ret);
+}
+
+static const char *scale_slice_name = "video_scaler_scale slice";
+
 bool video_scaler_scale(video_scaler_t *scaler,
 		uint8_t *output[], const uint32_t out_linesize[],
 		const uint8_t *const input[], const uint32_t in_linesize[])
 {
+	bool success = true;
+
 	if (!scaler)
 		return false;
 
-	int ret = sws_scale(scaler->swscale,
-			input, (const int *)in_linesize,
-			0, scaler->src_height,
-			output, (const int *)out_linesize);
-	if (ret <= 0) {
-		blog(LOG_ERROR, "video_scaler_scale: sws_scale failed: %d",
-				ret);
-		return false;
-	}
+	scaler->output       = output;
+	scaler->out_linesize = out_linesize;
+	scaler->input        = input;
+	scaler->in_linesize  = in_linesize;
+
+	/* the calling thread takes the last slice itself */
+	for (size_t i = 0; i + 1 < scaler->num_slices; i++)
+		os_task_group_queue(scaler->group, scale_slice,
+				&scaler->slices[i], OS_TASK_PRIORITY_HIGH,
+				scale_slice_name);
+
+	scale_slice(&scaler->slices[scaler->num_slices - 1]);
+
+	if (scaler->group)
+		os_task_group_wait(scaler->group);
+
+	for (size_t i = 0; i < scaler->num_slices; i++)
+		success = success && scaler->slices[i].success;
 
-	return true;
+	return success;
 }
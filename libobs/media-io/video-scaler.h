@@ -41,6 +41,9 @@ EXPORT bool video_scaler_scale(video_scaler_t *scaler,
 		uint8_t *output[], const uint32_t out_linesize[],
 		const uint8_t *const input[], const uint32_t in_linesize[]);
 
+/* frees the swscale contexts kept around for reuse by later scalers */
+EXPORT void video_scaler_clear_cache(void);
+
 #ifdef __cplusplus
 }
 #endif
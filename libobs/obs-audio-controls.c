@@ -20,6 +20,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "util/threading.h"
 #include "util/bmem.h"
 #include "media-io/audio-math.h"
+#include "media-io/audio-kernels.h"
 #include "obs.h"
 #include "obs-internal.h"
 
@@ -50,6 +51,7 @@ struct obs_fader {
 struct obs_volmeter {
 	pthread_mutex_t        mutex;
 	signal_handler_t       *signals;
+	signal_t               *levels_updated;
 	obs_fader_conversion_t pos_to_db;
 	obs_fader_conversion_t db_to_pos;
 	obs_source_t           *source;
@@ -70,6 +72,14 @@ struct obs_volmeter {
 	float                  vol_peak;
 	float                  vol_mag;
 	float                  vol_max;
+
+	/* latest levels kept for obs_volmeter_get_levels when polled */
+	bool                   polled;
+	bool                   levels_pending;
+	float                  level;
+	float                  magnitude;
+	float                  peak;
+	bool                   muted;
 };
 
 static const char *fader_signals[] = {
@@ -195,8 +205,9 @@ static void signal_volume_changed(signal_handler_t *sh,
 		struct obs_fader *fader, const float db)
 {
 	struct calldata data;
+	uint8_t stack[128];
 
-	calldata_init(&data);
+	calldata_init_fixed(&data, stack, sizeof(stack));
 
 	calldata_set_ptr  (&data, "fader", fader);
 	calldata_set_float(&data, "db",    db);
@@ -206,14 +217,18 @@ static void signal_volume_changed(signal_handler_t *sh,
 	calldata_free(&data);
 }
 
-static void signal_levels_updated(signal_handler_t *sh,
+static void signal_levels_updated(signal_t *sig,
 		struct obs_volmeter *volmeter,
 		const float level, const float magnitude, const float peak,
 		bool muted)
 {
 	struct calldata data;
+	uint8_t stack[256];
+
+	if (!signal_has_callbacks(sig))
+		return;
 
-	calldata_init(&data);
+	calldata_init_fixed(&data, stack, sizeof(stack));
 
 	calldata_set_ptr  (&data, "volmeter",  volmeter);
 	calldata_set_float(&data, "level",     level);
@@ -221,7 +236,7 @@ static void signal_levels_updated(signal_handler_t *sh,
 	calldata_set_float(&data, "peak",      peak);
 	calldata_set_bool (&data, "muted",     muted);
 
-	signal_handler_signal(sh, "levels_updated", &data);
+	signal_emit(sig, &data);
 
 	calldata_free(&data);
 }
@@ -280,22 +295,12 @@ static void volmeter_source_destroyed(void *vptr, calldata_t *calldata)
 static void volmeter_sum_and_max(float *data[MAX_AV_PLANES], size_t frames,
 		float *sum, float *max)
 {
-	float s  = *sum;
-	float m  = *max;
-
 	for (size_t plane = 0; plane < MAX_AV_PLANES; plane++) {
 		if (!data[plane])
 			break;
 
-		for (float *c = data[plane]; c < data[plane] + frames; ++c) {
-			const float pow = *c * *c;
-			s += pow;
-			m  = (m > pow) ? m : pow;
-		}
+		audio_sum_and_max_sq_float(data[plane], frames, sum, max);
 	}
-
-	*sum = s;
-	*max = m;
 }
 
 /**
@@ -378,8 +383,10 @@ static void volmeter_source_data_received(void *vptr, calldata_t *calldata)
 {
 	struct obs_volmeter *volmeter = (struct obs_volmeter *) vptr;
 	bool updated = false;
+	bool signal = false;
+	bool muted = calldata_bool(calldata, "muted");
 	float mul, level, mag, peak;
-	signal_handler_t *sh;
+	signal_t *sig;
 
 	pthread_mutex_lock(&volmeter->mutex);
 
@@ -393,14 +400,23 @@ static void volmeter_source_data_received(void *vptr, calldata_t *calldata)
 		mag   = volmeter->db_to_pos(mul_to_db(volmeter->vol_mag * mul));
 		peak  = volmeter->db_to_pos(
 				mul_to_db(volmeter->vol_peak * mul));
-		sh    = volmeter->signals;
+		sig   = volmeter->levels_updated;
+
+		if (volmeter->polled) {
+			volmeter->level          = level;
+			volmeter->magnitude      = mag;
+			volmeter->peak           = peak;
+			volmeter->muted          = muted;
+			volmeter->levels_pending = true;
+		} else {
+			signal = true;
+		}
 	}
 
 	pthread_mutex_unlock(&volmeter->mutex);
 
-	if (updated)
-		signal_levels_updated(sh, volmeter, level, mag, peak,
-				calldata_bool(calldata, "muted"));
+	if (signal)
+		signal_levels_updated(sig, volmeter, level, mag, peak, muted);
 }
 
 static void volmeter_update_audio_settings(obs_volmeter_t *volmeter)
@@ -622,6 +638,8 @@ obs_volmeter_t *obs_volmeter_create(enum obs_fader_type type)
 		goto fail;
 	if (!signal_handler_add_array(volmeter->signals, volmeter_signals))
 		goto fail;
+	volmeter->levels_updated = signal_handler_get_signal(volmeter->signals,
+			"levels_updated");
 
 	/* set conversion functions */
 	switch(type) {
@@ -768,3 +786,38 @@ unsigned int obs_volmeter_get_peak_hold(obs_volmeter_t *volmeter)
 
 	return peakhold;
 }
+
+void obs_volmeter_set_polled(obs_volmeter_t *volmeter, bool polled)
+{
+	if (!volmeter)
+		return;
+
+	pthread_mutex_lock(&volmeter->mutex);
+	volmeter->polled         = polled;
+	volmeter->levels_pending = false;
+	pthread_mutex_unlock(&volmeter->mutex);
+}
+
+bool obs_volmeter_get_levels(obs_volmeter_t *volmeter, float *level,
+		float *magnitude, float *peak, bool *muted)
+{
+	bool pending;
+
+	if (!volmeter)
+		return false;
+
+	pthread_mutex_lock(&volmeter->mutex);
+
+	pending = volmeter->levels_pending;
+	if (pending) {
+		if (level)     *level     = volmeter->level;
+		if (magnitude) *magnitude = volmeter->magnitude;
+		if (peak)      *peak      = volmeter->peak;
+		if (muted)     *muted     = volmeter->muted;
+		volmeter->levels_pending = false;
+	}
+
+	pthread_mutex_unlock(&volmeter->mutex);
+
+	return pending;
+}
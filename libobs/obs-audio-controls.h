@@ -251,6 +251,30 @@ EXPORT void obs_volmeter_set_peak_hold(obs_volmeter_t *volmeter,
  */
 EXPORT unsigned int obs_volmeter_get_peak_hold(obs_volmeter_t *volmeter);
 
+/**
+ * @brief Switch the volume meter between signalled and polled levels
+ * @param volmeter pointer to the volume meter object
+ * @param polled true to poll levels with obs_volmeter_get_levels
+ *
+ * Levels are still computed on the audio thread as data arrives, but a polled
+ * volume meter does not emit levels_updated.  This lets a UI with many meters
+ * collect all of them once per update interval instead of handling a signal
+ * for every audio buffer of every source.
+ */
+EXPORT void obs_volmeter_set_polled(obs_volmeter_t *volmeter, bool polled);
+
+/**
+ * @brief Get the latest levels of a polled volume meter
+ * @param volmeter pointer to the volume meter object
+ * @param level the current level
+ * @param magnitude the current magnitude
+ * @param peak the current peak hold level
+ * @param muted whether the source was muted
+ * @return true if the levels changed since the last call
+ */
+EXPORT bool obs_volmeter_get_levels(obs_volmeter_t *volmeter, float *level,
+		float *magnitude, float *peak, bool *muted);
+
 #ifdef __cplusplus
 }
 #endif
@@ -15,7 +15,7 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
-#include "obs.h"
+#include "obs-internal.h"
 #include "obs-avc.h"
 #include "util/array-serializer.h"
 
@@ -102,20 +102,30 @@ static inline int get_drop_priority(int priority)
 	return OBS_NAL_PRIORITY_HIGHEST;
 }
 
-static void serialize_avc_data(struct serializer *s, const uint8_t *data,
-		size_t size, bool *is_keyframe, int *priority)
+/* gets the size of the AVCC conversion along with the keyframe state and
+ * priority.  the size only differs from the original if there are 3-byte
+ * start codes to expand, or stray data before the first start code */
+static size_t scan_avc_data(const uint8_t *data, size_t size,
+		bool *four_byte_codes, bool *is_keyframe, int *priority)
 {
-	const uint8_t *nal_start, *nal_end;
+	const uint8_t *nal_start, *nal_end, *start_code;
 	const uint8_t *end = data+size;
+	size_t avcc_size = 0;
 	int type;
 
 	nal_start = obs_avc_find_startcode(data, end);
+	*four_byte_codes = nal_start == data;
+
 	while (true) {
+		start_code = nal_start;
 		while (nal_start < end && !*(nal_start++));
 
 		if (nal_start == end)
 			break;
 
+		if (nal_start - start_code != 4)
+			*four_byte_codes = false;
+
 		type = nal_start[0] & 0x1F;
 
 		if (type == OBS_NAL_SLICE_IDR || type == OBS_NAL_SLICE) {
@@ -126,27 +136,159 @@ static void serialize_avc_data(struct serializer *s, const uint8_t *data,
 		}
 
 		nal_end = obs_avc_find_startcode(nal_start, end);
-		s_wb32(s, (uint32_t)(nal_end - nal_start));
-		s_write(s, nal_start, nal_end - nal_start);
+		avcc_size += 4 + (nal_end - nal_start);
 		nal_start = nal_end;
 	}
+
+	return avcc_size;
 }
 
-void obs_parse_avc_packet(struct encoder_packet *avc_packet,
+static inline void write_nal_size(uint8_t *out, size_t size)
+{
+	out[0] = (uint8_t)(size >> 24);
+	out[1] = (uint8_t)(size >> 16);
+	out[2] = (uint8_t)(size >> 8);
+	out[3] = (uint8_t)size;
+}
+
+static void patch_avc_start_codes(uint8_t *data, size_t size)
+{
+	uint8_t *nal_start, *nal_end;
+	uint8_t *end = data+size;
+
+	nal_start = data;
+	while (nal_start < end) {
+		nal_end = (uint8_t*)obs_avc_find_startcode(nal_start + 4, end);
+		write_nal_size(nal_start, nal_end - nal_start - 4);
+		nal_start = nal_end;
+	}
+}
+
+bool obs_avc_convert_to_avcc_inplace(uint8_t *data, size_t size)
+{
+	bool four_byte_codes;
+
+	if (!data || !size)
+		return false;
+
+	scan_avc_data(data, size, &four_byte_codes, NULL, NULL);
+	if (!four_byte_codes)
+		return false;
+
+	patch_avc_start_codes(data, size);
+	return true;
+}
+
+static void write_avcc_data(uint8_t *out, const uint8_t *data, size_t size)
+{
+	const uint8_t *nal_start, *nal_end;
+	const uint8_t *end = data+size;
+
+	nal_start = obs_avc_find_startcode(data, end);
+	while (true) {
+		while (nal_start < end && !*(nal_start++));
+
+		if (nal_start == end)
+			break;
+
+		nal_end = obs_avc_find_startcode(nal_start, end);
+		write_nal_size(out, nal_end - nal_start);
+		memcpy(out + 4, nal_start, nal_end - nal_start);
+		out += 4 + (nal_end - nal_start);
+		nal_start = nal_end;
+	}
+}
+
+/* the output is allocated once at its final size.  x264 and most hardware
+ * encoders only use 4-byte start codes, in which case the conversion is
+ * the same size as the original and the lengths are just patched over the
+ * start codes of a straight copy */
+static void parse_avc_packet(struct encoder_packet *avc_packet,
 		const struct encoder_packet *src)
 {
-	struct array_output_data output;
-	struct serializer s;
+	bool    four_byte_codes;
+	size_t  avcc_size;
+	uint8_t *data;
 
-	array_output_serializer_init(&s, &output);
 	*avc_packet = *src;
 
-	serialize_avc_data(&s, src->data, src->size, &avc_packet->keyframe,
-			&avc_packet->priority);
+	avcc_size = scan_avc_data(src->data, src->size, &four_byte_codes,
+			&avc_packet->keyframe, &avc_packet->priority);
+	data = bmalloc(avcc_size ? avcc_size : 1);
+
+	if (four_byte_codes) {
+		memcpy(data, src->data, avcc_size);
+		patch_avc_start_codes(data, avcc_size);
+	} else {
+		write_avcc_data(data, src->data, src->size);
+	}
+
+	avc_packet->data          = data;
+	avc_packet->size          = avcc_size;
+	avc_packet->drop_priority = get_drop_priority(avc_packet->priority);
+	avc_packet->buffer        = NULL;
+}
+
+void obs_avc_set_packet_priority(struct encoder_packet *packet)
+{
+	bool four_byte_codes;
+
+	scan_avc_data(packet->data, packet->size, &four_byte_codes,
+			NULL, &packet->priority);
+	packet->drop_priority = get_drop_priority(packet->priority);
+}
 
-	avc_packet->data          = output.bytes.array;
-	avc_packet->size          = output.bytes.num;
+static void ref_cached_avc_packet(struct encoder_packet *avc_packet,
+		const struct encoder_packet *src)
+{
+	struct encoder_packet_buffer *avc = src->buffer->avc;
+
+	os_atomic_inc_long(&avc->refs);
+
+	*avc_packet               = *src;
+	avc_packet->data          = avc->data;
+	avc_packet->size          = src->buffer->avc_size;
+	avc_packet->keyframe      = src->buffer->avc_keyframe;
+	avc_packet->priority      = src->buffer->avc_priority;
 	avc_packet->drop_priority = get_drop_priority(avc_packet->priority);
+	avc_packet->buffer        = avc;
+}
+
+void obs_parse_avc_packet(struct encoder_packet *avc_packet,
+		const struct encoder_packet *src)
+{
+	struct encoder_packet_buffer *buffer = src->buffer;
+
+	if (!buffer) {
+		parse_avc_packet(avc_packet, src);
+		return;
+	}
+
+	/* the compare-swap doubles as a barrier so that the cached data is
+	 * visible once the state reads as ready */
+	if (os_atomic_compare_swap_long(&buffer->avc_state,
+				PACKET_AVC_READY, PACKET_AVC_READY)) {
+		ref_cached_avc_packet(avc_packet, src);
+		return;
+	}
+
+	parse_avc_packet(avc_packet, src);
+
+	/* only the first output to get here caches its conversion; any other
+	 * output parsing at the same time just keeps its own copy */
+	if (!os_atomic_compare_swap_long(&buffer->avc_state,
+				PACKET_AVC_NONE, PACKET_AVC_PARSING))
+		return;
+
+	avc_packet->buffer = encoder_packet_buffer_create(avc_packet->data);
+
+	buffer->avc          = avc_packet->buffer;
+	buffer->avc_size     = avc_packet->size;
+	buffer->avc_keyframe = avc_packet->keyframe;
+	buffer->avc_priority = avc_packet->priority;
+	os_atomic_inc_long(&buffer->avc->refs);
+
+	os_atomic_inc_long(&buffer->avc_state);
 }
 
 static inline bool has_start_code(const uint8_t *data)
@@ -221,3 +363,53 @@ size_t obs_parse_avc_header(uint8_t **header, const uint8_t *data, size_t size)
 	*header = output.bytes.array;
 	return output.bytes.num;
 }
+
+/* writes data while inserting emulation prevention bytes, so that it can't
+ * be mistaken for a start code */
+static void write_escaped(struct serializer *s, const uint8_t *data,
+		size_t size, int *zeros)
+{
+	for (size_t i = 0; i < size; i++) {
+		if (*zeros == 2 && data[i] <= 3) {
+			s_w8(s, 3);
+			*zeros = 0;
+		}
+
+		s_w8(s, data[i]);
+		*zeros = data[i] == 0 ? *zeros + 1 : 0;
+	}
+}
+
+size_t obs_avc_make_user_data_sei(uint8_t **sei, const uint8_t *uuid,
+		const uint8_t *payload, size_t size)
+{
+	struct array_output_data output;
+	struct serializer s;
+	size_t payload_size = 16 + size;
+	uint8_t header[2] = {5, 0};
+	int zeros = 0;
+
+	array_output_serializer_init(&s, &output);
+
+	s_wb32(&s, 1);
+	s_w8(&s, OBS_NAL_SEI);
+
+	/* payload type 5 is user data unregistered, and the size is coded
+	 * as 255 for every full 255 bytes followed by the rest */
+	write_escaped(&s, header, 1, &zeros);
+	for (; payload_size >= 255; payload_size -= 255) {
+		header[1] = 255;
+		write_escaped(&s, header + 1, 1, &zeros);
+	}
+	header[1] = (uint8_t)payload_size;
+	write_escaped(&s, header + 1, 1, &zeros);
+
+	write_escaped(&s, uuid, 16, &zeros);
+	write_escaped(&s, payload, size, &zeros);
+
+	/* rbsp trailing bits */
+	s_w8(&s, 0x80);
+
+	*sei = output.bytes.array;
+	return output.bytes.num;
+}
@@ -53,9 +53,38 @@ EXPORT const uint8_t *obs_avc_find_startcode(const uint8_t *p,
 		const uint8_t *end);
 EXPORT void obs_parse_avc_packet(struct encoder_packet *avc_packet,
 		const struct encoder_packet *src);
+
+/**
+ * Converts Annex B data to AVCC in place by writing each NAL's length over
+ * its start code.  Returns false without modifying the data if any start
+ * code isn't 4 bytes long, as those would need the data to grow.
+ */
+EXPORT bool obs_avc_convert_to_avcc_inplace(uint8_t *data, size_t size);
+
+/** Sets the packet's priority and drop priority from its NAL headers */
+EXPORT void obs_avc_set_packet_priority(struct encoder_packet *packet);
 EXPORT size_t obs_parse_avc_header(uint8_t **header, const uint8_t *data,
 		size_t size);
 
+/**
+ * Creates an Annex B user data unregistered SEI NAL carrying the given UUID
+ * and payload.  Returns the size of the NAL, which is allocated with bmalloc.
+ */
+EXPORT size_t obs_avc_make_user_data_sei(uint8_t **sei, const uint8_t *uuid,
+		const uint8_t *payload, size_t size);
+
+/**
+ * UUID of the latency SEI libobs adds to video packets when enabled with
+ * obs_encoder_set_latency_sei.  The payload after the UUID is four 64-bit
+ * big endian wall clock times, in nanoseconds since the Unix epoch, of when
+ * the frame was rendered, reached the encoder, started encoding and came out
+ * of the encoder.
+ */
+#define OBS_LATENCY_SEI_UUID \
+	"\x6f\x62\x73\x2d\x6c\x61\x74\x65" \
+	"\x6e\x63\x79\x2d\x73\x65\x69\x31"
+#define OBS_LATENCY_SEI_UUID_SIZE 16
+
 #ifdef __cplusplus
 }
 #endif
@@ -1340,3 +1340,127 @@ bool obs_hotkeys_platform_is_pressed(obs_hotkeys_platform_t *plat,
 
 	return false;
 }
+
+/*
+ * A listen-only event tap on the hotkey thread's run loop.  Creating the tap
+ * fails unless the user has allowed input monitoring for the app, in which
+ * case the hotkey thread keeps polling.
+ */
+struct obs_hotkeys_listener {
+	CFRunLoopRef       run_loop;
+	CFMachPortRef      tap;
+	CFRunLoopSourceRef tap_source;
+	CFRunLoopSourceRef wake_source;
+	bool               input;
+};
+
+static CGEventRef listener_tap(CGEventTapProxy proxy, CGEventType type,
+		CGEventRef event, void *param)
+{
+	struct obs_hotkeys_listener *listener = param;
+	UNUSED_PARAMETER(proxy);
+
+	/* taps that take too long get disabled by the system */
+	if (type == kCGEventTapDisabledByTimeout ||
+	    type == kCGEventTapDisabledByUserInput) {
+		CGEventTapEnable(listener->tap, true);
+		return event;
+	}
+
+	listener->input = true;
+	return event;
+}
+
+static void listener_wake(void *param)
+{
+	UNUSED_PARAMETER(param);
+}
+
+struct obs_hotkeys_listener *obs_hotkeys_platform_listen_init(void)
+{
+	struct obs_hotkeys_listener *listener;
+	CFRunLoopSourceContext wake_context = {0};
+	CGEventMask mask =
+		CGEventMaskBit(kCGEventKeyDown) |
+		CGEventMaskBit(kCGEventKeyUp) |
+		CGEventMaskBit(kCGEventFlagsChanged) |
+		CGEventMaskBit(kCGEventLeftMouseDown) |
+		CGEventMaskBit(kCGEventLeftMouseUp) |
+		CGEventMaskBit(kCGEventRightMouseDown) |
+		CGEventMaskBit(kCGEventRightMouseUp) |
+		CGEventMaskBit(kCGEventOtherMouseDown) |
+		CGEventMaskBit(kCGEventOtherMouseUp);
+
+	listener = bzalloc(sizeof(struct obs_hotkeys_listener));
+	listener->run_loop = CFRunLoopGetCurrent();
+
+	listener->tap = CGEventTapCreate(kCGSessionEventTap,
+			kCGTailAppendEventTap, kCGEventTapOptionListenOnly,
+			mask, listener_tap, listener);
+	if (!listener->tap) {
+		blog(LOG_INFO, "hotkeys-cocoa: Could not create event tap, "
+		               "input monitoring is probably not allowed");
+		goto fail;
+	}
+
+	listener->tap_source = CFMachPortCreateRunLoopSource(
+			kCFAllocatorDefault, listener->tap, 0);
+	if (!listener->tap_source)
+		goto fail;
+
+	wake_context.info    = listener;
+	wake_context.perform = listener_wake;
+	listener->wake_source = CFRunLoopSourceCreate(kCFAllocatorDefault, 0,
+			&wake_context);
+	if (!listener->wake_source)
+		goto fail;
+
+	CFRunLoopAddSource(listener->run_loop, listener->tap_source,
+			kCFRunLoopDefaultMode);
+	CFRunLoopAddSource(listener->run_loop, listener->wake_source,
+			kCFRunLoopDefaultMode);
+	CGEventTapEnable(listener->tap, true);
+	return listener;
+
+fail:
+	obs_hotkeys_platform_listen_free(listener);
+	return NULL;
+}
+
+void obs_hotkeys_platform_listen_free(struct obs_hotkeys_listener *listener)
+{
+	if (!listener)
+		return;
+
+	if (listener->wake_source) {
+		CFRunLoopSourceInvalidate(listener->wake_source);
+		CFRelease(listener->wake_source);
+	}
+	if (listener->tap_source) {
+		CFRunLoopSourceInvalidate(listener->tap_source);
+		CFRelease(listener->tap_source);
+	}
+	if (listener->tap) {
+		CGEventTapEnable(listener->tap, false);
+		CFMachPortInvalidate(listener->tap);
+		CFRelease(listener->tap);
+	}
+
+	bfree(listener);
+}
+
+bool obs_hotkeys_platform_listen_wait(struct obs_hotkeys_listener *listener,
+		uint32_t timeout_ms)
+{
+	listener->input = false;
+
+	/* returns after the first source that fires, or the timeout */
+	CFRunLoopRunInMode(kCFRunLoopDefaultMode, timeout_ms / 1000.0, true);
+	return listener->input;
+}
+
+void obs_hotkeys_platform_listen_wake(struct obs_hotkeys_listener *listener)
+{
+	CFRunLoopSourceSignal(listener->wake_source);
+	CFRunLoopWakeUp(listener->run_loop);
+}
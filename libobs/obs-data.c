@@ -20,6 +20,8 @@
 #include "util/dstr.h"
 #include "util/darray.h"
 #include "util/platform.h"
+#include "util/array-serializer.h"
+#include "util/file-serializer.h"
 #include "graphics/vec2.h"
 #include "graphics/vec3.h"
 #include "graphics/vec4.h"
@@ -32,6 +34,8 @@ struct obs_data_item {
 	volatile long        ref;
 	struct obs_data      *parent;
 	struct obs_data_item *next;
+	struct obs_data_item *hash_next;
+	uint32_t             hash;
 	enum obs_data_type   type;
 	size_t               name_len;
 	size_t               data_len;
@@ -45,7 +49,15 @@ struct obs_data_item {
 struct obs_data {
 	volatile long        ref;
 	char                 *json;
+	uint8_t              *binary;
+	size_t               binary_size;
 	struct obs_data_item *first_item;
+
+	/* name index, only built once an object has enough items for the
+	 * list search to matter */
+	size_t               num_items;
+	size_t               num_buckets;
+	struct obs_data_item **buckets;
 };
 
 struct obs_data_array {
@@ -61,6 +73,101 @@ struct obs_data_number {
 	};
 };
 
+static int data_tag = BMEM_TAG_UNTAGGED;
+
+static inline int data_mem_tag(void)
+{
+	return bmem_tag(&data_tag, "obs_data");
+}
+
+/* ------------------------------------------------------------------------- */
+/* Name index */
+
+#define INDEX_MIN_ITEMS 16
+
+static inline uint32_t name_hash(const char *name)
+{
+	uint32_t hash = 2166136261U;
+
+	while (*name) {
+		hash ^= (uint8_t)*(name++);
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+static inline struct obs_data_item **index_bucket(struct obs_data *data,
+		uint32_t hash)
+{
+	return data->buckets + (hash & (data->num_buckets - 1));
+}
+
+static void index_rebuild(struct obs_data *data, size_t num_buckets)
+{
+	struct obs_data_item *item = data->first_item;
+
+	bfree(data->buckets);
+	data->buckets = bzalloc_tagged(sizeof(struct obs_data_item*) *
+			num_buckets, data_mem_tag());
+	data->num_buckets = num_buckets;
+
+	while (item) {
+		struct obs_data_item **bucket = index_bucket(data, item->hash);
+		item->hash_next = *bucket;
+		*bucket = item;
+		item = item->next;
+	}
+}
+
+/* call after the item is linked in to the list */
+static void index_add(struct obs_data *data, struct obs_data_item *item)
+{
+	data->num_items++;
+
+	if (data->buckets && data->num_items <= data->num_buckets) {
+		struct obs_data_item **bucket = index_bucket(data, item->hash);
+		item->hash_next = *bucket;
+		*bucket = item;
+
+	} else if (data->num_items >= INDEX_MIN_ITEMS) {
+		size_t num_buckets = data->num_buckets ?
+			data->num_buckets * 2 : INDEX_MIN_ITEMS * 2;
+		index_rebuild(data, num_buckets);
+	}
+}
+
+static void index_remove(struct obs_data *data, struct obs_data_item *item)
+{
+	data->num_items--;
+
+	if (data->buckets) {
+		struct obs_data_item **prev = index_bucket(data, item->hash);
+
+		while (*prev && *prev != item)
+			prev = &(*prev)->hash_next;
+		if (*prev)
+			*prev = item->hash_next;
+	}
+
+	item->hash_next = NULL;
+}
+
+/* items are reallocated when their data grows, only compares the old
+ * pointer value */
+static void index_replace(struct obs_data *data, struct obs_data_item *old,
+		struct obs_data_item *item)
+{
+	if (data->buckets) {
+		struct obs_data_item **prev = index_bucket(data, item->hash);
+
+		while (*prev && *prev != old)
+			prev = &(*prev)->hash_next;
+		if (*prev)
+			*prev = item;
+	}
+}
+
 /* ------------------------------------------------------------------------- */
 /* Item structure, designed to be one allocation only */
 
@@ -267,11 +374,12 @@ static struct obs_data_item *obs_data_item_create(const char *name,
 	name_size = get_name_align_size(name);
 	total_size = name_size + sizeof(struct obs_data_item) + size;
 
-	item = bzalloc(total_size);
+	item = bzalloc_tagged(total_size, data_mem_tag());
 
 	item->capacity = total_size;
 	item->type     = type;
 	item->name_len = name_size;
+	item->hash     = name_hash(name);
 	item->ref      = 1;
 
 	if (default_data) {
@@ -321,6 +429,7 @@ static inline void obs_data_item_detach(struct obs_data_item *item)
 	if (prev_next) {
 		*prev_next = item->next;
 		item->next = NULL;
+		index_remove(item->parent, item);
 	}
 }
 
@@ -330,8 +439,10 @@ static inline void obs_data_item_reattach(struct obs_data_item *old_ptr,
 	struct obs_data_item **prev_next = get_item_prev_next(new_ptr->parent,
 			old_ptr);
 
-	if (prev_next)
+	if (prev_next) {
 		*prev_next = new_ptr;
+		index_replace(new_ptr->parent, old_ptr, new_ptr);
+	}
 }
 
 static struct obs_data_item *obs_data_item_ensure_capacity(
@@ -612,11 +723,269 @@ static json_t *obs_data_to_json(obs_data_t *data)
 	return json;
 }
 
+/* ------------------------------------------------------------------------- */
+/*
+ *   Binary format, a compact alternative to json for data that is written and
+ * read back by the same machine (values are stored in native byte order).
+ *
+ *   [char[4]  "OBSD"]
+ *   [uint32_t version]
+ *   [object]
+ *
+ *   object: [uint32_t count] followed by count items
+ *   item:   [uint8_t type] [string name] [value]
+ *   string: [uint32_t size] [char[] text], size includes the null terminator
+ *   array:  [uint32_t count] followed by count objects
+ *
+ *   Only user values are stored, like json.
+ */
+
+#define BINARY_MAGIC     "OBSD"
+#define BINARY_VERSION   1
+#define BINARY_MAX_DEPTH 128
+
+enum binary_type {
+	BINARY_STRING = 1,
+	BINARY_INT,
+	BINARY_DOUBLE,
+	BINARY_BOOL,
+	BINARY_OBJECT,
+	BINARY_ARRAY
+};
+
+static inline void write_u32(struct serializer *s, uint32_t val)
+{
+	s_write(s, &val, sizeof(val));
+}
+
+static inline void write_string(struct serializer *s, const char *str)
+{
+	uint32_t size = (uint32_t)strlen(str) + 1;
+	write_u32(s, size);
+	s_write(s, str, size);
+}
+
+static void write_binary_obj(struct serializer *s, obs_data_t *data);
+
+static inline void write_binary_array(struct serializer *s,
+		obs_data_array_t *array)
+{
+	size_t count = obs_data_array_count(array);
+
+	write_u32(s, (uint32_t)count);
+
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t *obj = obs_data_array_item(array, i);
+		write_binary_obj(s, obj);
+		obs_data_release(obj);
+	}
+}
+
+static inline void write_binary_item(struct serializer *s,
+		obs_data_item_t *item)
+{
+	enum obs_data_type type = obs_data_item_gettype(item);
+	uint8_t code;
+
+	if (type == OBS_DATA_STRING) {
+		code = BINARY_STRING;
+		s_write(s, &code, 1);
+		write_string(s, get_item_name(item));
+		write_string(s, obs_data_item_get_string(item));
+
+	} else if (type == OBS_DATA_NUMBER) {
+		bool is_int = obs_data_item_numtype(item) == OBS_DATA_NUM_INT;
+
+		code = is_int ? BINARY_INT : BINARY_DOUBLE;
+		s_write(s, &code, 1);
+		write_string(s, get_item_name(item));
+
+		if (is_int) {
+			int64_t val = obs_data_item_get_int(item);
+			s_write(s, &val, sizeof(val));
+		} else {
+			double val = obs_data_item_get_double(item);
+			s_write(s, &val, sizeof(val));
+		}
+
+	} else if (type == OBS_DATA_BOOLEAN) {
+		uint8_t val = obs_data_item_get_bool(item);
+
+		code = BINARY_BOOL;
+		s_write(s, &code, 1);
+		write_string(s, get_item_name(item));
+		s_write(s, &val, 1);
+
+	} else if (type == OBS_DATA_OBJECT) {
+		obs_data_t *obj = obs_data_item_get_obj(item);
+
+		code = BINARY_OBJECT;
+		s_write(s, &code, 1);
+		write_string(s, get_item_name(item));
+		write_binary_obj(s, obj);
+		obs_data_release(obj);
+
+	} else if (type == OBS_DATA_ARRAY) {
+		obs_data_array_t *array = obs_data_item_get_array(item);
+
+		code = BINARY_ARRAY;
+		s_write(s, &code, 1);
+		write_string(s, get_item_name(item));
+		write_binary_array(s, array);
+		obs_data_array_release(array);
+	}
+}
+
+static void write_binary_obj(struct serializer *s, obs_data_t *data)
+{
+	struct obs_data_item *item;
+	uint32_t count = 0;
+
+	for (item = data ? data->first_item : NULL; item; item = item->next)
+		if (obs_data_item_has_user_value(item) &&
+		    item->type != OBS_DATA_NULL)
+			count++;
+
+	write_u32(s, count);
+
+	for (item = data ? data->first_item : NULL; item; item = item->next)
+		if (obs_data_item_has_user_value(item) &&
+		    item->type != OBS_DATA_NULL)
+			write_binary_item(s, item);
+}
+
+struct binary_reader {
+	const uint8_t *pos;
+	const uint8_t *end;
+	bool          error;
+};
+
+static inline bool read_bytes(struct binary_reader *r, void *out, size_t size)
+{
+	if (r->error || (size_t)(r->end - r->pos) < size) {
+		r->error = true;
+		return false;
+	}
+
+	memcpy(out, r->pos, size);
+	r->pos += size;
+	return true;
+}
+
+static inline uint32_t read_u32(struct binary_reader *r)
+{
+	uint32_t val = 0;
+	read_bytes(r, &val, sizeof(val));
+	return val;
+}
+
+/* strings are referenced in place rather than copied */
+static inline const char *read_string(struct binary_reader *r)
+{
+	uint32_t size = read_u32(r);
+	const char *str = (const char*)r->pos;
+
+	if (r->error || !size || (size_t)(r->end - r->pos) < size ||
+	    str[size - 1] != 0) {
+		r->error = true;
+		return NULL;
+	}
+
+	r->pos += size;
+	return str;
+}
+
+static bool read_binary_obj(struct binary_reader *r, obs_data_t *data,
+		int depth);
+
+static inline void read_binary_array(struct binary_reader *r,
+		obs_data_t *data, const char *name, int depth)
+{
+	obs_data_array_t *array = obs_data_array_create();
+	uint32_t count = read_u32(r);
+
+	for (uint32_t i = 0; i < count && !r->error; i++) {
+		obs_data_t *obj = obs_data_create();
+
+		if (read_binary_obj(r, obj, depth + 1))
+			obs_data_array_push_back(array, obj);
+		obs_data_release(obj);
+	}
+
+	obs_data_set_array(data, name, array);
+	obs_data_array_release(array);
+}
+
+static void read_binary_item(struct binary_reader *r, obs_data_t *data,
+		int depth)
+{
+	uint8_t code = 0;
+	const char *name;
+
+	read_bytes(r, &code, 1);
+	name = read_string(r);
+	if (r->error)
+		return;
+
+	if (code == BINARY_STRING) {
+		const char *val = read_string(r);
+		if (val)
+			obs_data_set_string(data, name, val);
+
+	} else if (code == BINARY_INT) {
+		int64_t val;
+		if (read_bytes(r, &val, sizeof(val)))
+			obs_data_set_int(data, name, val);
+
+	} else if (code == BINARY_DOUBLE) {
+		double val;
+		if (read_bytes(r, &val, sizeof(val)))
+			obs_data_set_double(data, name, val);
+
+	} else if (code == BINARY_BOOL) {
+		uint8_t val;
+		if (read_bytes(r, &val, 1))
+			obs_data_set_bool(data, name, val != 0);
+
+	} else if (code == BINARY_OBJECT) {
+		obs_data_t *obj = obs_data_create();
+
+		if (read_binary_obj(r, obj, depth + 1))
+			obs_data_set_obj(data, name, obj);
+		obs_data_release(obj);
+
+	} else if (code == BINARY_ARRAY) {
+		read_binary_array(r, data, name, depth);
+
+	} else {
+		r->error = true;
+	}
+}
+
+static bool read_binary_obj(struct binary_reader *r, obs_data_t *data,
+		int depth)
+{
+	uint32_t count;
+
+	if (depth > BINARY_MAX_DEPTH) {
+		r->error = true;
+		return false;
+	}
+
+	count = read_u32(r);
+
+	for (uint32_t i = 0; i < count && !r->error; i++)
+		read_binary_item(r, data, depth);
+
+	return !r->error;
+}
+
 /* ------------------------------------------------------------------------- */
 
 obs_data_t *obs_data_create()
 {
-	struct obs_data *data = bzalloc(sizeof(struct obs_data));
+	struct obs_data *data = bzalloc_tagged(sizeof(struct obs_data),
+			data_mem_tag());
 	data->ref = 1;
 
 	return data;
@@ -687,6 +1056,63 @@ obs_data_t *obs_data_create_from_json_file_safe(const char *json_file,
 	return file_data;
 }
 
+obs_data_t *obs_data_create_from_binary(const void *binary, size_t size)
+{
+	struct binary_reader r = {binary, (const uint8_t*)binary + size, false};
+	obs_data_t *data;
+	char magic[4];
+	uint32_t version;
+
+	if (!binary)
+		return NULL;
+
+	read_bytes(&r, magic, sizeof(magic));
+	version = read_u32(&r);
+
+	if (r.error || memcmp(magic, BINARY_MAGIC, sizeof(magic)) != 0 ||
+	    version != BINARY_VERSION) {
+		blog(LOG_ERROR, "obs-data.c: [obs_data_create_from_binary] "
+		                "Invalid header");
+		return NULL;
+	}
+
+	data = obs_data_create();
+
+	if (!read_binary_obj(&r, data, 0)) {
+		blog(LOG_ERROR, "obs-data.c: [obs_data_create_from_binary] "
+		                "Data truncated or corrupt");
+		obs_data_release(data);
+		data = NULL;
+	}
+
+	return data;
+}
+
+obs_data_t *obs_data_create_from_binary_file(const char *file)
+{
+	FILE *f = os_fopen(file, "rb");
+	obs_data_t *data = NULL;
+	uint8_t *binary;
+	int64_t size;
+
+	if (!f)
+		return NULL;
+
+	size = os_fgetsize(f);
+	if (size > 0 && (uint64_t)size <= SIZE_MAX) {
+		binary = bmalloc((size_t)size);
+
+		if (fread(binary, 1, (size_t)size, f) == (size_t)size)
+			data = obs_data_create_from_binary(binary,
+					(size_t)size);
+
+		bfree(binary);
+	}
+
+	fclose(f);
+	return data;
+}
+
 void obs_data_addref(obs_data_t *data)
 {
 	if (data)
@@ -705,6 +1131,8 @@ static inline void obs_data_destroy(struct obs_data *data)
 
 	/* NOTE: don't use bfree for json text, allocated by json */
 	free(data->json);
+	bfree(data->binary);
+	bfree(data->buckets);
 	bfree(data);
 }
 
@@ -756,11 +1184,91 @@ bool obs_data_save_json_safe(obs_data_t *data, const char *file,
 	return false;
 }
 
+const uint8_t *obs_data_get_binary(obs_data_t *data, size_t *size)
+{
+	struct array_output_data output;
+	struct serializer s;
+
+	if (!data) return NULL;
+
+	bfree(data->binary);
+
+	array_output_serializer_init(&s, &output);
+	s_write(&s, BINARY_MAGIC, 4);
+	write_u32(&s, BINARY_VERSION);
+	write_binary_obj(&s, data);
+
+	data->binary      = output.bytes.array;
+	data->binary_size = output.bytes.num;
+
+	if (size)
+		*size = data->binary_size;
+	return data->binary;
+}
+
+static bool save_binary(obs_data_t *data, const char *file,
+		const char *temp_ext)
+{
+	struct serializer s;
+	size_t size;
+	const uint8_t *binary = obs_data_get_binary(data, &size);
+	bool success;
+
+	if (!binary)
+		return false;
+
+	if (temp_ext) {
+		if (!file_output_serializer_init_safe(&s, file, temp_ext))
+			return false;
+	} else {
+		if (!file_output_serializer_init(&s, file))
+			return false;
+	}
+
+	success = s_write(&s, binary, size) == size;
+	file_output_serializer_free(&s);
+	return success;
+}
+
+bool obs_data_save_binary(obs_data_t *data, const char *file)
+{
+	return save_binary(data, file, NULL);
+}
+
+bool obs_data_save_binary_safe(obs_data_t *data, const char *file,
+		const char *temp_ext)
+{
+	if (!temp_ext || !*temp_ext) {
+		blog(LOG_ERROR, "obs_data_save_binary_safe: invalid "
+		                "temporary extension specified");
+		return false;
+	}
+
+	return save_binary(data, file, temp_ext);
+}
+
 static struct obs_data_item *get_item(struct obs_data *data, const char *name)
 {
 	if (!data) return NULL;
 
-	struct obs_data_item *item = data->first_item;
+	struct obs_data_item *item;
+
+	if (data->buckets) {
+		uint32_t hash = name_hash(name);
+
+		item = *index_bucket(data, hash);
+		while (item) {
+			if (item->hash == hash &&
+			    strcmp(get_item_name(item), name) == 0)
+				return item;
+
+			item = item->hash_next;
+		}
+
+		return NULL;
+	}
+
+	item = data->first_item;
 
 	while (item) {
 		if (strcmp(get_item_name(item), name) == 0)
@@ -805,6 +1313,8 @@ static void set_item_data(struct obs_data *data, struct obs_data_item **item,
 		if (!prev)
 			data->first_item = new_item;
 
+		index_add(data, new_item);
+
 		obs_data_item_release(&prev);
 		obs_data_item_release(&next);
 
@@ -1237,7 +1747,8 @@ obs_data_array_t *obs_data_get_autoselect_array(obs_data_t *data,
 
 obs_data_array_t *obs_data_array_create()
 {
-	struct obs_data_array *array = bzalloc(sizeof(struct obs_data_array));
+	struct obs_data_array *array = bzalloc_tagged(
+			sizeof(struct obs_data_array), data_mem_tag());
 	array->ref = 1;
 
 	return array;
@@ -73,6 +73,19 @@ EXPORT bool obs_data_save_json(obs_data_t *data, const char *file);
 EXPORT bool obs_data_save_json_safe(obs_data_t *data, const char *file,
 		const char *temp_ext, const char *backup_ext);
 
+/*
+ * Compact binary form, much faster to save and load than json.  Values are
+ * stored in native byte order, so use it for data read back on the same
+ * machine such as caches, and json for anything meant to be portable.
+ */
+EXPORT obs_data_t *obs_data_create_from_binary(const void *binary,
+		size_t size);
+EXPORT obs_data_t *obs_data_create_from_binary_file(const char *file);
+EXPORT const uint8_t *obs_data_get_binary(obs_data_t *data, size_t *size);
+EXPORT bool obs_data_save_binary(obs_data_t *data, const char *file);
+EXPORT bool obs_data_save_binary_safe(obs_data_t *data, const char *file,
+		const char *temp_ext);
+
 EXPORT void obs_data_apply(obs_data_t *target, obs_data_t *apply_data);
 
 EXPORT void obs_data_erase(obs_data_t *data, const char *name);
@@ -48,7 +48,15 @@ bool obs_display_init(struct obs_display *display,
 
 obs_display_t *obs_display_create(const struct gs_init_data *graphics_data)
 {
-	struct obs_display *display = bzalloc(sizeof(struct obs_display));
+	struct obs_display *display;
+
+	if (obs->video.headless) {
+		blog(LOG_WARNING, "obs_display_create: Displays are not "
+		                  "available in headless mode");
+		return NULL;
+	}
+
+	display = bzalloc(sizeof(struct obs_display));
 
 	gs_enter_context(obs->video.graphics);
 
@@ -172,10 +180,18 @@ static inline void render_display_end()
 	gs_present();
 }
 
+static const char *render_display_name = "render_display";
 void render_display(struct obs_display *display)
 {
 	if (!display || !display->enabled) return;
 
+	/* a display that is slow to present, such as a projector on a low
+	 * refresh rate monitor, misses this frame rather than holding up the
+	 * video thread */
+	if (display->swap && !gs_swapchain_ready(display->swap))
+		return;
+
+	gpu_timing_start(render_display_name);
 	render_display_begin(display);
 
 	pthread_mutex_lock(&display->draw_callbacks_mutex);
@@ -190,6 +206,7 @@ void render_display(struct obs_display *display)
 	pthread_mutex_unlock(&display->draw_callbacks_mutex);
 
 	render_display_end();
+	gpu_timing_end();
 }
 
 void obs_display_set_enabled(obs_display_t *display, bool enable)
@@ -17,6 +17,7 @@
 
 #include "obs.h"
 #include "obs-internal.h"
+#include "obs-avc.h"
 
 struct obs_encoder_info *find_encoder(const char *id)
 {
@@ -27,7 +28,7 @@ struct obs_encoder_info *find_encoder(const char *id)
 			return info;
 	}
 
-	return NULL;
+	return obs_load_deferred_type(id) ? find_encoder(id) : NULL;
 }
 
 const char *obs_encoder_get_display_name(const char *id)
@@ -36,6 +37,15 @@ const char *obs_encoder_get_display_name(const char *id)
 	return ei ? ei->get_name(ei->type_data) : NULL;
 }
 
+#define DEFAULT_VIDEO_QUEUE_DEPTH 3
+#define DEFAULT_AUDIO_QUEUE_DEPTH 16
+#define MAX_AUDIO_ENCODER_THREADS 4
+
+static const char *encoder_signals[] = {
+	"void overloaded(ptr encoder, bool overloaded)",
+	NULL
+};
+
 static bool init_encoder(struct obs_encoder *encoder, const char *name,
 		obs_data_t *settings, obs_data_t *hotkey_data)
 {
@@ -43,6 +53,8 @@ static bool init_encoder(struct obs_encoder *encoder, const char *name,
 
 	pthread_mutex_init_value(&encoder->callbacks_mutex);
 	pthread_mutex_init_value(&encoder->outputs_mutex);
+	pthread_mutex_init_value(&encoder->queue_mutex);
+	pthread_mutex_init_value(&encoder->stats_mutex);
 
 	if (pthread_mutexattr_init(&attr) != 0)
 		return false;
@@ -55,6 +67,12 @@ static bool init_encoder(struct obs_encoder *encoder, const char *name,
 		return false;
 	if (pthread_mutex_init(&encoder->outputs_mutex, NULL) != 0)
 		return false;
+	if (pthread_mutex_init(&encoder->queue_mutex, NULL) != 0)
+		return false;
+	if (pthread_mutex_init(&encoder->stats_mutex, NULL) != 0)
+		return false;
+
+	signal_handler_add_array(encoder->context.signals, encoder_signals);
 
 	if (encoder->info.get_defaults)
 		encoder->info.get_defaults(encoder->context.settings);
@@ -75,6 +93,7 @@ static struct obs_encoder *create_encoder(const char *id,
 
 	encoder = bzalloc(sizeof(struct obs_encoder));
 	encoder->mixer_idx = mixer_idx;
+	encoder->frame_rate_divisor = 1;
 
 	if (!ei) {
 		blog(LOG_ERROR, "Encoder ID '%s' not found", id);
@@ -83,7 +102,9 @@ static struct obs_encoder *create_encoder(const char *id,
 		encoder->info.type    = type;
 		encoder->owns_info_id = true;
 	} else {
-		encoder->info = *ei;
+		encoder->info   = *ei;
+		encoder->is_avc = type == OBS_ENCODER_VIDEO && ei->codec &&
+			astrcmpi(ei->codec, "h264") == 0;
 	}
 
 	success = init_encoder(encoder, name, settings, hotkey_data);
@@ -93,6 +114,8 @@ static struct obs_encoder *create_encoder(const char *id,
 		return NULL;
 	}
 
+	encoder->context.mem_tag = obs_get_type_mem_tag(id);
+
 	encoder->control = bzalloc(sizeof(obs_weak_encoder_t));
 	encoder->control->encoder = encoder;
 
@@ -151,6 +174,7 @@ static inline void get_video_info(struct obs_encoder *encoder,
 	info->range      = voi->range;
 	info->width      = obs_encoder_get_width(encoder);
 	info->height     = obs_encoder_get_height(encoder);
+	info->frame_divisor = encoder->frame_rate_divisor;
 
 	if (encoder->info.get_video_info)
 		encoder->info.get_video_info(encoder->context.data, info);
@@ -169,8 +193,177 @@ static inline bool has_scaling(const struct obs_encoder *encoder)
 		 video_height != encoder->scaled_height);
 }
 
+static void *encoder_thread(void *data);
+static void *encoder_pool_thread(void *data);
+static bool encoder_pool_add(struct obs_encoder_pool *pool,
+		struct obs_encoder *encoder);
+static void encoder_pool_remove(struct obs_encoder_pool *pool,
+		struct obs_encoder *encoder);
+
+static inline size_t default_queue_depth(const struct obs_encoder *encoder)
+{
+	return encoder->info.type == OBS_ENCODER_VIDEO ?
+		DEFAULT_VIDEO_QUEUE_DEPTH : DEFAULT_AUDIO_QUEUE_DEPTH;
+}
+
+static void free_queue(struct obs_encoder *encoder)
+{
+	size_t depth = encoder->queue_depth ?
+		encoder->queue_depth : default_queue_depth(encoder);
+
+	if (encoder->queue) {
+		for (size_t i = 0; i < depth; i++) {
+			video_frame_buffer_release(encoder->queue[i].ref);
+			bfree(encoder->queue[i].buffer);
+		}
+		bfree(encoder->queue);
+		encoder->queue = NULL;
+	}
+
+	os_sem_destroy(encoder->queue_sem);
+	os_event_destroy(encoder->queue_space_event);
+	encoder->queue_sem = NULL;
+	encoder->queue_space_event = NULL;
+}
+
+/* halve the histogram after this many samples */
+#define ENCODE_TIME_DECAY_SAMPLES 1024
+#define BITRATE_WINDOW_NS 1000000000ULL
+
+static inline size_t encode_time_bucket(uint64_t ns)
+{
+	uint64_t us = ns / 1000;
+	size_t msb = 0;
+	size_t idx;
+
+	if (us < 8)
+		return (size_t)us;
+
+	while ((us >> msb) > 1)
+		msb++;
+
+	idx = msb * 4 + (size_t)((us >> (msb - 2)) & 3);
+	return idx < ENCODE_TIME_BUCKETS ? idx : ENCODE_TIME_BUCKETS - 1;
+}
+
+/* upper bound of the bucket, in nanoseconds */
+static inline uint64_t encode_time_bucket_ns(size_t idx)
+{
+	size_t msb = idx / 4;
+
+	if (idx < 8)
+		return (uint64_t)idx * 1000;
+
+	return (((uint64_t)(idx % 4 + 5) << (msb - 2)) - 1) * 1000;
+}
+
+static void reset_stats(struct obs_encoder *encoder)
+{
+	pthread_mutex_lock(&encoder->stats_mutex);
+	memset(encoder->encode_times, 0, sizeof(encoder->encode_times));
+	encoder->encode_time_samples  = 0;
+	encoder->encode_time_max      = 0;
+	encoder->frames_submitted     = 0;
+	encoder->packets_received     = 0;
+	encoder->bytes_out            = 0;
+	encoder->bitrate_window_ts    = 0;
+	encoder->bitrate_window_bytes = 0;
+	encoder->bitrate              = 0;
+	pthread_mutex_unlock(&encoder->stats_mutex);
+}
+
+static void start_encoder_thread(struct obs_encoder *encoder)
+{
+	size_t depth = encoder->queue_depth ?
+		encoder->queue_depth : default_queue_depth(encoder);
+
+	encoder->queue             = bzalloc(sizeof(*encoder->queue) * depth);
+	encoder->queue_read        = 0;
+	encoder->queue_count       = 0;
+	encoder->thread_stop       = false;
+	encoder->encode_failed     = false;
+	encoder->overloaded        = false;
+	encoder->overloaded_frames = 0;
+	reset_stats(encoder);
+
+	if (os_event_init(&encoder->queue_space_event,
+				OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+
+	if (encoder->info.type == OBS_ENCODER_AUDIO) {
+		struct obs_encoder_pool *pool = &obs->data.audio_encoder_pool;
+
+		if (!encoder_pool_add(pool, encoder))
+			goto fail;
+
+	} else {
+		if (os_sem_init(&encoder->queue_sem, 0) != 0)
+			goto fail;
+		if (pthread_create(&encoder->thread, NULL, encoder_thread,
+					encoder) != 0)
+			goto fail;
+	}
+
+	encoder->thread_active = true;
+	return;
+
+fail:
+	blog(LOG_WARNING, "encoder '%s': Failed to create encoder thread, "
+	                  "encoding on the %s thread instead",
+	                  encoder->context.name,
+	                  encoder->info.type == OBS_ENCODER_VIDEO ?
+	                  "video" : "audio");
+	free_queue(encoder);
+}
+
+static void stop_encoder_thread(struct obs_encoder *encoder)
+{
+	void *thread_ret;
+
+	if (!encoder->thread_active)
+		return;
+
+	pthread_mutex_lock(&encoder->queue_mutex);
+	encoder->thread_stop = true;
+	pthread_mutex_unlock(&encoder->queue_mutex);
+
+	if (encoder->pooled) {
+		encoder_pool_remove(&obs->data.audio_encoder_pool, encoder);
+	} else {
+		os_sem_post(encoder->queue_sem);
+		pthread_join(encoder->thread, &thread_ret);
+	}
+
+	encoder->thread_active = false;
+
+	free_queue(encoder);
+}
+
+static inline void group_encoder_started(struct obs_encoder_group *group)
+{
+	if (group) {
+		pthread_mutex_lock(&group->mutex);
+		group->active++;
+		pthread_mutex_unlock(&group->mutex);
+	}
+}
+
+/* the group starts over with whichever encoder runs next */
+static inline void group_encoder_stopped(struct obs_encoder_group *group)
+{
+	if (group) {
+		pthread_mutex_lock(&group->mutex);
+		if (--group->active == 0)
+			group->start_ts = 0;
+		pthread_mutex_unlock(&group->mutex);
+	}
+}
+
 static void add_connection(struct obs_encoder *encoder)
 {
+	start_encoder_thread(encoder);
+	group_encoder_started(encoder->group);
+
 	if (encoder->info.type == OBS_ENCODER_AUDIO) {
 		struct audio_convert_info audio_info = {0};
 		get_audio_info(encoder, &audio_info);
@@ -179,10 +372,21 @@ static void add_connection(struct obs_encoder *encoder)
 				&audio_info, receive_audio, encoder);
 	} else {
 		struct video_scale_info info = {0};
-		get_video_info(encoder, &info);
+		video_t *video = encoder->media;
 
-		video_output_connect(encoder->media, &info, receive_video,
-			encoder);
+		get_video_info(encoder, &info);
+		encoder->queue_format = info.format;
+		encoder->queue_height = info.height;
+
+		/* scaled sizes are rendered on the GPU when possible, leaving
+		 * video-io to handle only format changes */
+		if (has_scaling(encoder))
+			encoder->scaled_video = obs_acquire_scaled_video(
+					info.width, info.height);
+		if (encoder->scaled_video)
+			video = encoder->scaled_video;
+
+		video_output_connect(video, &info, receive_video, encoder);
 	}
 
 	encoder->active = true;
@@ -190,12 +394,22 @@ static void add_connection(struct obs_encoder *encoder)
 
 static void remove_connection(struct obs_encoder *encoder)
 {
-	if (encoder->info.type == OBS_ENCODER_AUDIO)
+	if (encoder->info.type == OBS_ENCODER_AUDIO) {
 		audio_output_disconnect(encoder->media, encoder->mixer_idx,
 				receive_audio, encoder);
-	else
+	} else if (encoder->scaled_video) {
+		video_output_disconnect(encoder->scaled_video, receive_video,
+				encoder);
+		obs_release_scaled_video(encoder->scaled_video);
+		encoder->scaled_video = NULL;
+	} else {
 		video_output_disconnect(encoder->media, receive_video,
 				encoder);
+	}
+
+	/* nothing feeds the queue anymore, so the thread can be stopped */
+	stop_encoder_thread(encoder);
+	group_encoder_stopped(encoder->group);
 
 	obs_encoder_shutdown(encoder);
 	encoder->active = false;
@@ -204,12 +418,16 @@ static void remove_connection(struct obs_encoder *encoder)
 static inline void free_audio_buffers(struct obs_encoder *encoder)
 {
 	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
-		circlebuf_free(&encoder->audio_input_buffer[i]);
+		ringbuf_free(&encoder->audio_input_buffer[i]);
 		bfree(encoder->audio_output_buffer[i]);
 		encoder->audio_output_buffer[i] = NULL;
 	}
 }
 
+static void obs_encoder_group_release(struct obs_encoder_group *group);
+
+/* outputs are detached right away, the rest (the encoder's own destroy
+ * callback in particular) is left to the janitor */
 static void obs_encoder_actually_destroy(obs_encoder_t *encoder)
 {
 	if (encoder) {
@@ -221,15 +439,29 @@ static void obs_encoder_actually_destroy(obs_encoder_t *encoder)
 		da_free(encoder->outputs);
 		pthread_mutex_unlock(&encoder->outputs_mutex);
 
+		if (!obs_janitor_queue(OBS_DESTROY_ENCODER, encoder))
+			obs_encoder_teardown(encoder);
+	}
+}
+
+void obs_encoder_teardown(struct obs_encoder *encoder)
+{
+	if (encoder) {
 		blog(LOG_INFO, "encoder '%s' destroyed", encoder->context.name);
 
 		free_audio_buffers(encoder);
 
 		if (encoder->context.data)
-			encoder->info.destroy(encoder->context.data);
-		da_free(encoder->callbacks);
+			CONTEXT_CALL(&encoder->context,
+					encoder->info.destroy(
+						encoder->context.data));
+		da_small_free(encoder->callbacks);
+		da_free(encoder->shared_followers);
+		obs_encoder_group_release(encoder->group);
 		pthread_mutex_destroy(&encoder->callbacks_mutex);
 		pthread_mutex_destroy(&encoder->outputs_mutex);
+		pthread_mutex_destroy(&encoder->queue_mutex);
+		pthread_mutex_destroy(&encoder->stats_mutex);
 		obs_context_data_free(&encoder->context);
 		if (encoder->owns_info_id)
 			bfree((void*)encoder->info.id);
@@ -247,7 +479,8 @@ void obs_encoder_destroy(obs_encoder_t *encoder)
 		obs_context_data_remove(&encoder->context);
 
 		pthread_mutex_lock(&encoder->callbacks_mutex);
-		destroy = encoder->callbacks.num == 0;
+		destroy = encoder->callbacks.num == 0 &&
+			encoder->shared_followers.num == 0;
 		if (!destroy)
 			encoder->destroy_on_stop = true;
 		pthread_mutex_unlock(&encoder->callbacks_mutex);
@@ -312,18 +545,43 @@ obs_properties_t *obs_encoder_properties(const obs_encoder_t *encoder)
 
 void obs_encoder_update(obs_encoder_t *encoder, obs_data_t *settings)
 {
+	bool shared;
+
 	if (!encoder) return;
 
 	obs_data_apply(encoder->context.settings, settings);
 
+	/* the outputs sharing the encoder didn't ask for the change */
+	pthread_mutex_lock(&encoder->callbacks_mutex);
+	shared = encoder->shared_followers.num != 0;
+	pthread_mutex_unlock(&encoder->callbacks_mutex);
+
+	if (shared) {
+		blog(LOG_INFO, "encoder '%s' is shared with other outputs, "
+		               "the new settings apply once it restarts",
+		               encoder->context.name);
+		return;
+	}
+
 	if (encoder->info.update && encoder->context.data)
-		encoder->info.update(encoder->context.data,
-				encoder->context.settings);
+		CONTEXT_CALL(&encoder->context,
+				encoder->info.update(encoder->context.data,
+					encoder->context.settings));
+}
+
+/* the encoder that actually encodes for this one */
+static inline const struct obs_encoder *get_encoding(
+		const struct obs_encoder *encoder)
+{
+	return encoder && encoder->shared_source ?
+		encoder->shared_source : encoder;
 }
 
 bool obs_encoder_get_extra_data(const obs_encoder_t *encoder,
 		uint8_t **extra_data, size_t *size)
 {
+	encoder = get_encoding(encoder);
+
 	if (encoder && encoder->info.get_extra_data && encoder->context.data)
 		return encoder->info.get_extra_data(encoder->context.data,
 				extra_data, size);
@@ -331,6 +589,18 @@ bool obs_encoder_get_extra_data(const obs_encoder_t *encoder,
 	return false;
 }
 
+bool obs_encoder_get_sei(const obs_encoder_t *encoder, uint8_t **sei,
+		size_t *size)
+{
+	encoder = get_encoding(encoder);
+
+	if (encoder && encoder->info.get_sei_data && encoder->context.data)
+		return encoder->info.get_sei_data(encoder->context.data, sei,
+				size);
+
+	return false;
+}
+
 obs_data_t *obs_encoder_get_settings(const obs_encoder_t *encoder)
 {
 	if (!encoder) return NULL;
@@ -343,9 +613,14 @@ static inline void reset_audio_buffers(struct obs_encoder *encoder)
 {
 	free_audio_buffers(encoder);
 
-	for (size_t i = 0; i < encoder->planes; i++)
+	/* room for a frame that is still short plus one more tick of audio,
+	 * which buffer_audio grows if a tick turns out to be larger */
+	for (size_t i = 0; i < encoder->planes; i++) {
 		encoder->audio_output_buffer[i] =
 			bmalloc(encoder->framesize_bytes);
+		ringbuf_reserve(&encoder->audio_input_buffer[i],
+				encoder->framesize_bytes * 2);
+	}
 }
 
 static void intitialize_audio_encoder(struct obs_encoder *encoder)
@@ -373,8 +648,9 @@ bool obs_encoder_initialize(obs_encoder_t *encoder)
 	obs_encoder_shutdown(encoder);
 
 	if (encoder->info.create)
-		encoder->context.data = encoder->info.create(
-				encoder->context.settings, encoder);
+		CONTEXT_CALL(&encoder->context,
+				encoder->context.data = encoder->info.create(
+					encoder->context.settings, encoder));
 	if (!encoder->context.data)
 		return false;
 
@@ -390,7 +666,8 @@ bool obs_encoder_initialize(obs_encoder_t *encoder)
 void obs_encoder_shutdown(obs_encoder_t *encoder)
 {
 	if (encoder->context.data) {
-		encoder->info.destroy(encoder->context.data);
+		CONTEXT_CALL(&encoder->context,
+				encoder->info.destroy(encoder->context.data));
 		encoder->context.data = NULL;
 	}
 }
@@ -410,6 +687,114 @@ static inline size_t get_callback_idx(
 	return DARRAY_INVALID;
 }
 
+static bool settings_match(obs_data_t *a, obs_data_t *b)
+{
+	const char *json_a = obs_data_get_json(a);
+	const char *json_b = obs_data_get_json(b);
+
+	return json_a && json_b && strcmp(json_a, json_b) == 0;
+}
+
+/* whether the encoders would produce the same packets */
+static bool encoders_match(struct obs_encoder *a, struct obs_encoder *b)
+{
+	if (a->info.type != b->info.type || a->media != b->media ||
+	    a->group != b->group || strcmp(a->info.id, b->info.id) != 0)
+		return false;
+
+	if (a->info.type == OBS_ENCODER_AUDIO) {
+		if (a->mixer_idx != b->mixer_idx)
+			return false;
+
+	} else if (obs_encoder_get_width(a)  != obs_encoder_get_width(b)  ||
+	           obs_encoder_get_height(a) != obs_encoder_get_height(b) ||
+	           a->preferred_format   != b->preferred_format ||
+	           a->frame_rate_divisor != b->frame_rate_divisor ||
+	           a->variable_framerate != b->variable_framerate) {
+		return false;
+	}
+
+	return settings_match(a->context.settings, b->context.settings);
+}
+
+/* makes the encoder follow a running encoder that matches it.  the list
+ * lock keeps the source from being destroyed, and the source is only
+ * joined while it's still running */
+static bool join_shared_source(struct obs_encoder *encoder)
+{
+	struct obs_encoder *source;
+	bool joined = false;
+
+	pthread_mutex_lock(&obs->data.encoders_mutex);
+
+	source = obs->data.first_encoder;
+	while (source && !joined) {
+		if (source != encoder && source->active &&
+		    !source->shared_source && !source->encode_failed &&
+		    encoders_match(encoder, source)) {
+			pthread_mutex_lock(&source->callbacks_mutex);
+			if (source->callbacks.num ||
+			    source->shared_followers.num) {
+				da_push_back(source->shared_followers,
+						&encoder);
+				encoder->shared_source = source;
+				joined = true;
+			}
+			pthread_mutex_unlock(&source->callbacks_mutex);
+		}
+
+		if (!joined)
+			source = (struct obs_encoder*)source->context.next;
+	}
+
+	pthread_mutex_unlock(&obs->data.encoders_mutex);
+
+	if (joined) {
+		blog(LOG_INFO, "encoder '%s' has the same settings as '%s', "
+		               "sharing its output instead of encoding",
+		               encoder->context.name, source->context.name);
+
+		/* its own instance isn't needed while shared */
+		obs_encoder_shutdown(encoder);
+		encoder->start_ts = 0;
+		encoder->active   = true;
+	}
+
+	return joined;
+}
+
+static void stop_connection(struct obs_encoder *encoder);
+
+static void leave_shared_source(struct obs_encoder *encoder)
+{
+	struct obs_encoder *source = encoder->shared_source;
+	bool idle;
+
+	pthread_mutex_lock(&source->callbacks_mutex);
+	da_erase_item(source->shared_followers, &encoder);
+	idle = source->callbacks.num == 0 &&
+		source->shared_followers.num == 0;
+	pthread_mutex_unlock(&source->callbacks_mutex);
+
+	encoder->shared_source = NULL;
+	encoder->active        = false;
+
+	/* the source was only kept running for this encoder */
+	if (idle)
+		stop_connection(source);
+}
+
+static void stop_connection(struct obs_encoder *encoder)
+{
+	if (encoder->shared_source)
+		leave_shared_source(encoder);
+	else
+		remove_connection(encoder);
+
+	if (encoder->destroy_on_stop)
+		obs_encoder_actually_destroy(encoder);
+}
+
 void obs_encoder_start(obs_encoder_t *encoder,
 		void (*new_packet)(void *param, struct encoder_packet *packet),
 		void *param)
@@ -425,12 +810,13 @@ void obs_encoder_start(obs_encoder_t *encoder,
 
 	size_t idx = get_callback_idx(encoder, new_packet, param);
 	if (idx == DARRAY_INVALID)
-		da_push_back(encoder->callbacks, &cb);
+		da_small_push_back(encoder->callbacks, &cb);
 
 	pthread_mutex_unlock(&encoder->callbacks_mutex);
 
-	if (first) {
+	if (first && !join_shared_source(encoder)) {
 		encoder->cur_pts = 0;
+		encoder->held_frames = 0;
 		add_connection(encoder);
 	}
 }
@@ -449,17 +835,14 @@ void obs_encoder_stop(obs_encoder_t *encoder,
 	idx = get_callback_idx(encoder, new_packet, param);
 	if (idx != DARRAY_INVALID) {
 		da_erase(encoder->callbacks, idx);
-		last = (encoder->callbacks.num == 0);
+		last = encoder->callbacks.num == 0 &&
+			encoder->shared_followers.num == 0;
 	}
 
 	pthread_mutex_unlock(&encoder->callbacks_mutex);
 
-	if (last) {
-		remove_connection(encoder);
-
-		if (encoder->destroy_on_stop)
-			obs_encoder_actually_destroy(encoder);
-	}
+	if (last)
+		stop_connection(encoder);
 }
 
 const char *obs_encoder_get_codec(const obs_encoder_t *encoder)
@@ -501,6 +884,65 @@ void obs_encoder_set_scaled_size(obs_encoder_t *encoder, uint32_t width,
 	encoder->scaled_height = height;
 }
 
+void obs_encoder_set_latency_sei(obs_encoder_t *encoder, bool enable)
+{
+	if (!encoder || encoder->info.type != OBS_ENCODER_VIDEO)
+		return;
+
+	encoder->latency_sei = enable;
+}
+
+bool obs_encoder_latency_sei(const obs_encoder_t *encoder)
+{
+	return encoder && encoder->info.type == OBS_ENCODER_VIDEO ?
+		encoder->latency_sei : false;
+}
+
+void obs_encoder_set_frame_rate_divisor(obs_encoder_t *encoder,
+		uint32_t divisor)
+{
+	if (!encoder || encoder->info.type != OBS_ENCODER_VIDEO)
+		return;
+
+	if (encoder->active) {
+		blog(LOG_WARNING, "encoder '%s': Cannot set the frame rate "
+		                  "divisor while the encoder is active",
+		                  obs_encoder_get_name(encoder));
+		return;
+	}
+
+	encoder->frame_rate_divisor = divisor ? divisor : 1;
+
+	if (encoder->media) {
+		const struct video_output_info *voi;
+		voi = video_output_get_info(encoder->media);
+		encoder->timebase_num = voi->fps_den *
+			encoder->frame_rate_divisor;
+	}
+}
+
+uint32_t obs_encoder_get_frame_rate_divisor(const obs_encoder_t *encoder)
+{
+	if (!encoder || encoder->info.type != OBS_ENCODER_VIDEO)
+		return 0;
+
+	return encoder->frame_rate_divisor;
+}
+
+void obs_encoder_get_frame_rate(const obs_encoder_t *encoder,
+		uint32_t *fps_num, uint32_t *fps_den)
+{
+	*fps_num = 0;
+	*fps_den = 1;
+
+	if (!encoder || !encoder->media ||
+	    encoder->info.type != OBS_ENCODER_VIDEO)
+		return;
+
+	*fps_num = encoder->timebase_den;
+	*fps_den = encoder->timebase_num;
+}
+
 uint32_t obs_encoder_get_width(const obs_encoder_t *encoder)
 {
 	if (!encoder || !encoder->media ||
@@ -544,7 +986,7 @@ void obs_encoder_set_video(obs_encoder_t *encoder, video_t *video)
 	voi = video_output_get_info(video);
 
 	encoder->media        = video;
-	encoder->timebase_num = voi->fps_den;
+	encoder->timebase_num = voi->fps_den * encoder->frame_rate_divisor;
 	encoder->timebase_den = voi->fps_num;
 }
 
@@ -570,85 +1012,445 @@ audio_t *obs_encoder_audio(const obs_encoder_t *encoder)
 		encoder->media : NULL;
 }
 
-bool obs_encoder_active(const obs_encoder_t *encoder)
+void obs_encoder_set_queue_depth(obs_encoder_t *encoder, size_t depth)
 {
-	return encoder ? encoder->active : false;
+	if (!encoder)
+		return;
+
+	if (encoder->active) {
+		blog(LOG_WARNING, "encoder '%s': Cannot set the queue depth "
+		                  "while the encoder is active",
+		                  obs_encoder_get_name(encoder));
+		return;
+	}
+
+	encoder->queue_depth = depth;
 }
 
-static inline bool get_sei(const struct obs_encoder *encoder,
-		uint8_t **sei, size_t *size)
+size_t obs_encoder_get_queue_depth(const obs_encoder_t *encoder)
 {
-	if (encoder->info.get_sei_data)
-		return encoder->info.get_sei_data(encoder->context.data, sei,
-				size);
-	return false;
+	if (!encoder)
+		return 0;
+
+	return encoder->queue_depth ?
+		encoder->queue_depth : default_queue_depth(encoder);
 }
 
-static void send_first_video_packet(struct obs_encoder *encoder,
-		struct encoder_callback *cb, struct encoder_packet *packet)
+void obs_encoder_set_variable_framerate(obs_encoder_t *encoder, bool vfr)
 {
-	struct encoder_packet first_packet;
-	DARRAY(uint8_t)       data;
-	uint8_t               *sei;
-	size_t                size;
-
-	/* always wait for first keyframe */
-	if (!packet->keyframe)
+	if (!encoder || encoder->info.type != OBS_ENCODER_VIDEO)
 		return;
 
-	da_init(data);
-
-	if (!get_sei(encoder, &sei, &size)) {
-		cb->new_packet(cb->param, packet);
-		cb->sent_first_packet = true;
+	if (encoder->active) {
+		blog(LOG_WARNING, "encoder '%s': Cannot change the framerate "
+		                  "mode while the encoder is active",
+		                  obs_encoder_get_name(encoder));
 		return;
 	}
 
-	da_push_back_array(data, sei, size);
-	da_push_back_array(data, packet->data, packet->size);
+	encoder->variable_framerate = vfr;
+}
 
-	first_packet      = *packet;
-	first_packet.data = data.array;
-	first_packet.size = data.num;
+bool obs_encoder_variable_framerate(const obs_encoder_t *encoder)
+{
+	return encoder ? encoder->variable_framerate : false;
+}
 
-	cb->new_packet(cb->param, &first_packet);
-	cb->sent_first_packet = true;
+obs_encoder_group_t *obs_encoder_group_create(uint32_t keyint)
+{
+	struct obs_encoder_group *group;
 
-	da_free(data);
+	if (!keyint)
+		return NULL;
+
+	group = bzalloc(sizeof(*group));
+	if (pthread_mutex_init(&group->mutex, NULL) != 0) {
+		bfree(group);
+		return NULL;
+	}
+
+	group->refs   = 1;
+	group->keyint = keyint;
+	return group;
 }
 
-static inline void send_packet(struct obs_encoder *encoder,
-		struct encoder_callback *cb, struct encoder_packet *packet)
+static void obs_encoder_group_release(struct obs_encoder_group *group)
 {
-	/* include SEI in first video packet */
-	if (encoder->info.type == OBS_ENCODER_VIDEO && !cb->sent_first_packet)
-		send_first_video_packet(encoder, cb, packet);
-	else
-		cb->new_packet(cb->param, packet);
+	if (group && os_atomic_dec_long(&group->refs) == 0) {
+		pthread_mutex_destroy(&group->mutex);
+		bfree(group);
+	}
 }
 
-static void full_stop(struct obs_encoder *encoder)
+void obs_encoder_group_destroy(obs_encoder_group_t *group)
 {
-	if (encoder) {
-		pthread_mutex_lock(&encoder->callbacks_mutex);
-		da_free(encoder->callbacks);
-		remove_connection(encoder);
-		pthread_mutex_unlock(&encoder->callbacks_mutex);
-	}
+	obs_encoder_group_release(group);
 }
 
-static const char *do_encode_name = "do_encode";
-static inline void do_encode(struct obs_encoder *encoder,
-		struct encoder_frame *frame)
+void obs_encoder_set_group(obs_encoder_t *encoder,
+		obs_encoder_group_t *group)
 {
-	profile_start(do_encode_name);
-	if (!encoder->profile_encoder_encode_name)
-		encoder->profile_encoder_encode_name =
-			profile_store_name(obs_get_profiler_name_store(),
-					"encode(%s)", encoder->context.name);
+	if (!encoder || encoder->info.type != OBS_ENCODER_VIDEO)
+		return;
 
-	struct encoder_packet pkt = {0};
+	if (encoder->active) {
+		blog(LOG_WARNING, "encoder '%s': Cannot change the group "
+		                  "while the encoder is active",
+		                  obs_encoder_get_name(encoder));
+		return;
+	}
+
+	if (group)
+		os_atomic_inc_long(&group->refs);
+	obs_encoder_group_release(encoder->group);
+	encoder->group = group;
+}
+
+obs_encoder_group_t *obs_encoder_get_group(const obs_encoder_t *encoder)
+{
+	return encoder ? encoder->group : NULL;
+}
+
+uint32_t obs_encoder_get_group_keyint(const obs_encoder_t *encoder)
+{
+	return encoder && encoder->group ? encoder->group->keyint : 0;
+}
+
+uint32_t obs_encoder_get_overloaded_frames(const obs_encoder_t *encoder)
+{
+	encoder = get_encoding(encoder);
+	return encoder ? encoder->overloaded_frames : 0;
+}
+
+static uint64_t encode_time_percentile(const uint32_t *buckets,
+		uint64_t total, uint64_t percent)
+{
+	uint64_t target = (total * percent + 99) / 100;
+	uint64_t count = 0;
+
+	for (size_t i = 0; i < ENCODE_TIME_BUCKETS; i++) {
+		count += buckets[i];
+		if (count >= target)
+			return encode_time_bucket_ns(i);
+	}
+
+	return 0;
+}
+
+bool obs_encoder_get_stats(const obs_encoder_t *encoder,
+		struct obs_encoder_stats *stats)
+{
+	struct obs_encoder *enc = (struct obs_encoder*)encoder;
+	uint32_t buckets[ENCODE_TIME_BUCKETS];
+	uint64_t total = 0;
+
+	if (!obs_encoder_valid(encoder, "obs_encoder_get_stats") || !stats)
+		return false;
+
+	enc = (struct obs_encoder*)get_encoding(encoder);
+
+	memset(stats, 0, sizeof(*stats));
+
+	pthread_mutex_lock(&enc->stats_mutex);
+	memcpy(buckets, enc->encode_times, sizeof(buckets));
+	stats->encode_time_max_ns = enc->encode_time_max;
+	stats->frames_encoded     = enc->frames_submitted;
+	stats->bytes_out          = enc->bytes_out;
+	stats->bitrate            = enc->bitrate;
+	if (enc->frames_submitted > enc->packets_received)
+		stats->frames_in_flight = (uint32_t)(enc->frames_submitted -
+				enc->packets_received);
+	pthread_mutex_unlock(&enc->stats_mutex);
+
+	pthread_mutex_lock(&enc->queue_mutex);
+	stats->queue_count = (uint32_t)enc->queue_count;
+	pthread_mutex_unlock(&enc->queue_mutex);
+
+	stats->queue_depth       = (uint32_t)obs_encoder_get_queue_depth(enc);
+	stats->overloaded_frames = enc->overloaded_frames;
+
+	for (size_t i = 0; i < ENCODE_TIME_BUCKETS; i++)
+		total += buckets[i];
+
+	if (total) {
+		stats->encode_time_p50_ns =
+			encode_time_percentile(buckets, total, 50);
+		stats->encode_time_p90_ns =
+			encode_time_percentile(buckets, total, 90);
+		stats->encode_time_p99_ns =
+			encode_time_percentile(buckets, total, 99);
+	}
+
+	return true;
+}
+
+bool obs_encoder_active(const obs_encoder_t *encoder)
+{
+	return encoder ? encoder->active : false;
+}
+
+static inline bool get_sei(const struct obs_encoder *encoder,
+		uint8_t **sei, size_t *size)
+{
+	encoder = get_encoding(encoder);
+
+	if (encoder->info.get_sei_data)
+		return encoder->info.get_sei_data(encoder->context.data, sei,
+				size);
+	return false;
+}
+
+static void send_first_video_packet(struct obs_encoder *encoder,
+		struct encoder_callback *cb, struct encoder_packet *packet)
+{
+	struct encoder_packet first_packet;
+	DARRAY(uint8_t)       data;
+	uint8_t               *sei;
+	size_t                size;
+
+	/* always wait for first keyframe */
+	if (!packet->keyframe)
+		return;
+
+	da_init(data);
+
+	if (!get_sei(encoder, &sei, &size)) {
+		cb->new_packet(cb->param, packet);
+		cb->sent_first_packet = true;
+		return;
+	}
+
+	da_push_back_array(data, sei, size);
+	da_push_back_array(data, packet->data, packet->size);
+
+	first_packet        = *packet;
+	first_packet.data   = data.array;
+	first_packet.size   = data.num;
+	first_packet.buffer = NULL;
+
+	cb->new_packet(cb->param, &first_packet);
+	cb->sent_first_packet = true;
+
+	da_free(data);
+}
+
+static inline void send_packet(struct obs_encoder *encoder,
+		struct encoder_callback *cb, struct encoder_packet *packet)
+{
+	/* include SEI in first video packet */
+	if (encoder->info.type == OBS_ENCODER_VIDEO && !cb->sent_first_packet)
+		send_first_video_packet(encoder, cb, packet);
+	else
+		cb->new_packet(cb->param, packet);
+}
+
+/* the callbacks mutex must not be held while removing the connection, as
+ * that waits for the encoder thread, which locks it to send packets */
+static void full_stop(struct obs_encoder *encoder)
+{
+	if (encoder) {
+		pthread_mutex_lock(&encoder->callbacks_mutex);
+		da_small_free(encoder->callbacks);
+
+		/* the encoders sharing this one stop along with it */
+		for (size_t i = 0; i < encoder->shared_followers.num; i++) {
+			struct obs_encoder *follower =
+				encoder->shared_followers.array[i];
+
+			pthread_mutex_lock(&follower->callbacks_mutex);
+			da_small_free(follower->callbacks);
+			pthread_mutex_unlock(&follower->callbacks_mutex);
+
+			follower->shared_source = NULL;
+			follower->active        = false;
+		}
+		da_free(encoder->shared_followers);
+
+		pthread_mutex_unlock(&encoder->callbacks_mutex);
+
+		remove_connection(encoder);
+	}
+}
+
+/* a follower that joins a running encoder starts mid-GOP, so its video
+ * starts at the next keyframe, and its audio once it's past the start of
+ * the paired video.  returns false for packets before the start */
+static bool start_shared_packet(struct obs_encoder *follower,
+		const struct encoder_packet *pkt)
+{
+	uint64_t ts = (uint64_t)pkt->dts_usec * 1000;
+
+	if (follower->start_ts)
+		return true;
+
+	if (pkt->type == OBS_ENCODER_VIDEO) {
+		if (!pkt->keyframe)
+			return false;
+
+	} else if (follower->paired_encoder) {
+		uint64_t v_start_ts = follower->paired_encoder->start_ts;
+
+		if (!v_start_ts || ts < v_start_ts)
+			return false;
+	}
+
+	follower->start_ts = ts;
+	return true;
+}
+
+/* the packet is passed on as the follower's own, and the follower's start
+ * is where its outputs first get a packet from it, which is what a paired
+ * audio encoder needs to line up with */
+static void send_shared_packet(struct obs_encoder *follower,
+		const struct encoder_packet *packet)
+{
+	struct encoder_packet pkt = *packet;
+	pkt.encoder = follower;
+
+	if (!start_shared_packet(follower, &pkt))
+		return;
+
+	pthread_mutex_lock(&follower->callbacks_mutex);
+
+	for (size_t i = follower->callbacks.num; i > 0; i--) {
+		struct encoder_callback *cb;
+		cb = follower->callbacks.array+(i-1);
+		send_packet(follower, cb, &pkt);
+	}
+
+	pthread_mutex_unlock(&follower->callbacks_mutex);
+}
+
+static inline size_t frame_timing_slot(const struct obs_encoder *encoder,
+		int64_t pts)
+{
+	int64_t frame = pts / (int64_t)encoder->timebase_num;
+	int64_t slot  = frame % FRAME_TIMING_SLOTS;
+	return (size_t)(slot < 0 ? slot + FRAME_TIMING_SLOTS : slot);
+}
+
+static inline struct encoder_frame_timing *find_frame_timing(
+		struct obs_encoder *encoder, int64_t pts)
+{
+	size_t slot = frame_timing_slot(encoder, pts);
+
+	if (encoder->frame_timing_pts[slot] != pts ||
+	    !encoder->frame_timing[slot].render_ns)
+		return NULL;
+	return &encoder->frame_timing[slot];
+}
+
+static inline void start_frame_timing(struct obs_encoder *encoder,
+		const struct video_data *frame)
+{
+	size_t slot = frame_timing_slot(encoder, encoder->cur_pts);
+	struct encoder_frame_timing *timing = &encoder->frame_timing[slot];
+
+	memset(timing, 0, sizeof(*timing));
+	timing->render_ns  = frame->timestamp;
+	timing->receive_ns = os_gettime_ns();
+	encoder->frame_timing_pts[slot] = encoder->cur_pts;
+}
+
+static inline void put_be64(uint8_t *p, uint64_t val)
+{
+	for (size_t i = 0; i < 8; i++)
+		p[i] = (uint8_t)(val >> (56 - i * 8));
+}
+
+/* puts a latency SEI in front of the packet's first slice, after the access
+ * unit delimiter if there is one.  dst holds the new data */
+static void add_latency_sei(struct encoder_packet *pkt, struct darray *dst)
+{
+	const struct encoder_frame_timing *timing = &pkt->timing;
+	const uint8_t *data = pkt->data;
+	const uint8_t *end  = data + pkt->size;
+	const uint8_t *insert = obs_avc_find_startcode(data, end);
+	uint64_t offset = os_get_epoch_ns() - os_gettime_ns();
+	uint8_t payload[32];
+	uint8_t *sei;
+	size_t size;
+
+	put_be64(payload,      timing->render_ns  + offset);
+	put_be64(payload + 8,  timing->receive_ns + offset);
+	put_be64(payload + 16, timing->encode_ns  + offset);
+	put_be64(payload + 24, timing->encoded_ns + offset);
+
+	size = obs_avc_make_user_data_sei(&sei,
+			(const uint8_t*)OBS_LATENCY_SEI_UUID, payload,
+			sizeof(payload));
+
+	/* skip the start code, then check the NAL type */
+	if (insert < end) {
+		const uint8_t *nal = insert;
+		while (nal < end && !*nal)
+			nal++;
+		if (nal + 1 < end && (nal[1] & 0x1F) == OBS_NAL_AUD)
+			insert = obs_avc_find_startcode(nal + 1, end);
+	}
+
+	darray_push_back_array(1, dst, data, insert - data);
+	darray_push_back_array(1, dst, sei, size);
+	darray_push_back_array(1, dst, insert, end - insert);
+	bfree(sei);
+
+	pkt->data = dst->array;
+	pkt->size = dst->num;
+}
+
+static void update_stats(struct obs_encoder *encoder, uint64_t start,
+		uint64_t end, const struct encoder_packet *pkt)
+{
+	uint64_t ns = end - start;
+
+	pthread_mutex_lock(&encoder->stats_mutex);
+
+	if (++encoder->encode_time_samples == ENCODE_TIME_DECAY_SAMPLES) {
+		for (size_t i = 0; i < ENCODE_TIME_BUCKETS; i++)
+			encoder->encode_times[i] /= 2;
+		encoder->encode_time_samples = 0;
+	}
+
+	encoder->encode_times[encode_time_bucket(ns)]++;
+	if (ns > encoder->encode_time_max)
+		encoder->encode_time_max = ns;
+
+	encoder->frames_submitted++;
+
+	if (pkt) {
+		encoder->packets_received++;
+		encoder->bytes_out += pkt->size;
+		encoder->bitrate_window_bytes += pkt->size;
+	}
+
+	if (!encoder->bitrate_window_ts) {
+		encoder->bitrate_window_ts = end;
+
+	} else if (end - encoder->bitrate_window_ts >= BITRATE_WINDOW_NS) {
+		uint64_t elapsed = end - encoder->bitrate_window_ts;
+
+		encoder->bitrate = encoder->bitrate_window_bytes * 8 *
+			1000000000ULL / elapsed;
+		encoder->bitrate_window_ts    = end;
+		encoder->bitrate_window_bytes = 0;
+	}
+
+	pthread_mutex_unlock(&encoder->stats_mutex);
+}
+
+static const char *do_encode_name = "do_encode";
+static inline void do_encode(struct obs_encoder *encoder,
+		struct encoder_frame *frame)
+{
+	profile_start(do_encode_name);
+	if (!encoder->profile_encoder_encode_name)
+		encoder->profile_encoder_encode_name =
+			profile_store_name(obs_get_profiler_name_store(),
+					"encode(%s)", encoder->context.name);
+
+	struct encoder_packet pkt = {0};
 	bool received = false;
+	uint64_t start, end;
 	bool success;
 
 	pkt.timebase_num = encoder->timebase_num;
@@ -656,35 +1458,533 @@ static inline void do_encode(struct obs_encoder *encoder,
 	pkt.encoder = encoder;
 
 	profile_start(encoder->profile_encoder_encode_name);
-	success = encoder->info.encode(encoder->context.data, frame, &pkt,
-			&received);
+	start = os_gettime_ns();
+
+	if (encoder->info.type == OBS_ENCODER_VIDEO) {
+		struct encoder_frame_timing *timing;
+		timing = find_frame_timing(encoder, frame->pts);
+		if (timing)
+			timing->encode_ns = start;
+	}
+
+	CONTEXT_CALL(&encoder->context,
+			success = encoder->info.encode(encoder->context.data,
+				frame, &pkt, &received));
+	end = os_gettime_ns();
 	profile_end(encoder->profile_encoder_encode_name);
 	if (!success) {
-		full_stop(encoder);
 		blog(LOG_ERROR, "Error encoding with encoder '%s'",
 				encoder->context.name);
+
+		/* the thread can't stop itself, so the thread feeding the
+		 * encoder does it once it sees the flag */
+		encoder->encode_failed = true;
+		if (!encoder->thread_active)
+			full_stop(encoder);
+
+		profile_end(do_encode_name);
 		return;
 	}
 
+	update_stats(encoder, start, end, received ? &pkt : NULL);
+
 	if (received) {
+		struct encoder_packet shared;
+		DARRAY(uint8_t)       sei_data;
+
+		da_init(sei_data);
+
 		/* we use system time here to ensure sync with other encoders,
 		 * you do not want to use relative timestamps here */
 		pkt.dts_usec = encoder->start_ts / 1000 + packet_dts_usec(&pkt);
+		pkt.buffer = NULL;
+
+		/* worked out once here so outputs don't each have to scan the
+		 * NALs again to find out what they can drop */
+		if (encoder->is_avc)
+			obs_avc_set_packet_priority(&pkt);
+
+		if (encoder->info.type == OBS_ENCODER_VIDEO) {
+			struct encoder_frame_timing *timing;
+			timing = find_frame_timing(encoder, pkt.pts);
+			if (timing) {
+				pkt.timing = *timing;
+				pkt.timing.encoded_ns = end;
+			}
+
+			if (encoder->latency_sei && encoder->is_avc && timing)
+				add_latency_sei(&pkt, &sei_data.da);
+		}
+
+		/* copy the encoder's data once into a refcounted buffer so
+		 * that every output referencing it shares the same data */
+		obs_encoder_packet_ref(&shared, &pkt);
+		da_free(sei_data);
 
 		pthread_mutex_lock(&encoder->callbacks_mutex);
 
 		for (size_t i = encoder->callbacks.num; i > 0; i--) {
 			struct encoder_callback *cb;
 			cb = encoder->callbacks.array+(i-1);
-			send_packet(encoder, cb, &pkt);
+			send_packet(encoder, cb, &shared);
 		}
 
+		for (size_t i = 0; i < encoder->shared_followers.num; i++)
+			send_shared_packet(encoder->shared_followers.array[i],
+					&shared);
+
 		pthread_mutex_unlock(&encoder->callbacks_mutex);
+
+		obs_encoder_packet_release(&shared);
 	}
 
 	profile_end(do_encode_name);
 }
 
+/* ------------------------------------------------------------------------- */
+/* encoder thread */
+
+/* encodes the oldest queued frame, if any, and hands its slot back.
+ * frames are still taken off the queue after a failure or once stopping
+ * so that a waiting audio thread never gets stuck */
+static void process_queued_frame(struct obs_encoder *encoder)
+{
+	size_t depth = encoder->queue_depth ?
+		encoder->queue_depth : default_queue_depth(encoder);
+	struct encoder_queued_frame *queued = NULL;
+	struct encoder_frame        frame;
+	bool                        stop;
+
+	pthread_mutex_lock(&encoder->queue_mutex);
+	stop = encoder->thread_stop;
+	if (encoder->queue_count)
+		queued = encoder->queue + encoder->queue_read;
+	pthread_mutex_unlock(&encoder->queue_mutex);
+
+	if (!queued)
+		return;
+
+	if (!stop && !encoder->encode_failed) {
+		memset(&frame, 0, sizeof(frame));
+
+		for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+			frame.data[i]     = queued->data[i];
+			frame.linesize[i] = queued->linesize[i];
+		}
+
+		frame.frames    = queued->frames;
+		frame.pts       = queued->pts;
+		frame.duplicate = queued->duplicate;
+		frame.buffer    = queued->ref;
+		frame.force_keyframe = queued->force_keyframe;
+
+		do_encode(encoder, &frame);
+	}
+
+	video_frame_buffer_release(queued->ref);
+	queued->ref = NULL;
+
+	pthread_mutex_lock(&encoder->queue_mutex);
+	if (++encoder->queue_read == depth)
+		encoder->queue_read = 0;
+	encoder->queue_count--;
+	pthread_mutex_unlock(&encoder->queue_mutex);
+
+	os_event_signal(encoder->queue_space_event);
+}
+
+static void *encoder_thread(void *data)
+{
+	struct obs_encoder *encoder = data;
+
+	os_set_thread_name("libobs: encoder thread");
+	obs_apply_thread_settings(OBS_THREAD_ROLE_ENCODER);
+
+	while (os_sem_wait(encoder->queue_sem) == 0) {
+		bool stop;
+
+		pthread_mutex_lock(&encoder->queue_mutex);
+		stop = encoder->thread_stop;
+		pthread_mutex_unlock(&encoder->queue_mutex);
+
+		if (stop)
+			break;
+
+		process_queued_frame(encoder);
+		profile_reenable_thread();
+	}
+
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+/* audio encoder pool */
+
+bool obs_encoder_pool_init(struct obs_encoder_pool *pool)
+{
+	memset(pool, 0, sizeof(*pool));
+	pthread_mutex_init_value(&pool->mutex);
+
+	if (pthread_mutex_init(&pool->mutex, NULL) != 0)
+		return false;
+	if (os_sem_init(&pool->sem, 0) != 0)
+		return false;
+
+	return true;
+}
+
+void obs_encoder_pool_free(struct obs_encoder_pool *pool)
+{
+	void *thread_ret;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->stop = true;
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (size_t i = 0; i < pool->threads.num; i++)
+		os_sem_post(pool->sem);
+	for (size_t i = 0; i < pool->threads.num; i++)
+		pthread_join(pool->threads.array[i], &thread_ret);
+
+	da_free(pool->threads);
+	da_free(pool->ready);
+	os_sem_destroy(pool->sem);
+	pthread_mutex_destroy(&pool->mutex);
+}
+
+/* threads are only added as encoders become active, so a single track
+ * still only uses a single thread */
+static bool encoder_pool_add(struct obs_encoder_pool *pool,
+		struct obs_encoder *encoder)
+{
+	bool success = true;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	if (pool->threads.num < MAX_AUDIO_ENCODER_THREADS &&
+	    pool->threads.num <= pool->active_encoders) {
+		pthread_t thread;
+
+		if (pthread_create(&thread, NULL, encoder_pool_thread,
+					pool) == 0)
+			da_push_back(pool->threads, &thread);
+		else
+			success = pool->threads.num > 0;
+	}
+
+	if (success) {
+		pool->active_encoders++;
+		encoder->pooled         = true;
+		encoder->pool_scheduled = false;
+		encoder->pool_busy      = false;
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+	return success;
+}
+
+/* waits for any worker that's still busy with the encoder, it won't be
+ * scheduled again after that as nothing feeds it anymore */
+static void encoder_pool_remove(struct obs_encoder_pool *pool,
+		struct obs_encoder *encoder)
+{
+	while (true) {
+		pthread_mutex_lock(&pool->mutex);
+
+		if (!encoder->pool_busy) {
+			da_erase_item(pool->ready, &encoder);
+			pool->active_encoders--;
+			encoder->pooled         = false;
+			encoder->pool_scheduled = false;
+			pthread_mutex_unlock(&pool->mutex);
+			break;
+		}
+
+		pthread_mutex_unlock(&pool->mutex);
+		os_sleep_ms(1);
+	}
+}
+
+static inline bool has_queued_frames(struct obs_encoder *encoder)
+{
+	bool queued;
+
+	pthread_mutex_lock(&encoder->queue_mutex);
+	queued = encoder->queue_count > 0;
+	pthread_mutex_unlock(&encoder->queue_mutex);
+
+	return queued;
+}
+
+static void encoder_pool_schedule(struct obs_encoder_pool *pool,
+		struct obs_encoder *encoder)
+{
+	pthread_mutex_lock(&pool->mutex);
+
+	if (!encoder->pool_scheduled) {
+		encoder->pool_scheduled = true;
+		da_push_back(pool->ready, &encoder);
+		os_sem_post(pool->sem);
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+/* each pass encodes a single frame and then requeues the encoder behind the
+ * others, so one track can't starve the rest */
+static void *encoder_pool_thread(void *data)
+{
+	struct obs_encoder_pool *pool = data;
+
+	os_set_thread_name("libobs: audio encoder thread");
+	obs_apply_thread_settings(OBS_THREAD_ROLE_ENCODER);
+
+	while (os_sem_wait(pool->sem) == 0) {
+		struct obs_encoder *encoder = NULL;
+
+		pthread_mutex_lock(&pool->mutex);
+
+		if (pool->stop) {
+			pthread_mutex_unlock(&pool->mutex);
+			break;
+		}
+
+		if (pool->ready.num) {
+			encoder = pool->ready.array[0];
+			encoder->pool_busy = true;
+			da_erase(pool->ready, 0);
+		}
+
+		pthread_mutex_unlock(&pool->mutex);
+
+		if (!encoder)
+			continue;
+
+		process_queued_frame(encoder);
+
+		pthread_mutex_lock(&pool->mutex);
+		encoder->pool_busy = false;
+
+		if (has_queued_frames(encoder)) {
+			da_push_back(pool->ready, &encoder);
+			os_sem_post(pool->sem);
+		} else {
+			encoder->pool_scheduled = false;
+		}
+
+		pthread_mutex_unlock(&pool->mutex);
+		profile_reenable_thread();
+	}
+
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void set_overloaded(struct obs_encoder *encoder, bool overloaded)
+{
+	struct calldata params = {0};
+
+	if (encoder->overloaded == overloaded)
+		return;
+
+	encoder->overloaded = overloaded;
+
+	if (overloaded)
+		blog(LOG_WARNING, "encoder '%s': Encoder is overloaded, "
+		                  "dropping frames", encoder->context.name);
+	else
+		blog(LOG_INFO, "encoder '%s': Encoder caught up, %u"
+		               " frames dropped so far",
+		               encoder->context.name,
+		               encoder->overloaded_frames);
+
+	calldata_set_ptr(&params, "encoder", encoder);
+	calldata_set_bool(&params, "overloaded", overloaded);
+	signal_handler_signal(encoder->context.signals, "overloaded", &params);
+	calldata_free(&params);
+}
+
+/* returns the next free slot.  only the one feeding thread ever reserves
+ * slots, so the slot stays free until it's committed */
+static struct encoder_queued_frame *reserve_queued_frame(
+		struct obs_encoder *encoder, bool wait, bool *empty)
+{
+	size_t depth = encoder->queue_depth ?
+		encoder->queue_depth : default_queue_depth(encoder);
+	struct encoder_queued_frame *queued = NULL;
+
+	pthread_mutex_lock(&encoder->queue_mutex);
+
+	while (encoder->queue_count == depth && wait &&
+	       !encoder->thread_stop) {
+		pthread_mutex_unlock(&encoder->queue_mutex);
+		os_event_wait(encoder->queue_space_event);
+		pthread_mutex_lock(&encoder->queue_mutex);
+	}
+
+	if (empty)
+		*empty = encoder->queue_count == 0;
+
+	if (encoder->queue_count < depth) {
+		size_t idx = (encoder->queue_read + encoder->queue_count) %
+			depth;
+		queued = encoder->queue + idx;
+	}
+
+	pthread_mutex_unlock(&encoder->queue_mutex);
+	return queued;
+}
+
+static void commit_queued_frame(struct obs_encoder *encoder)
+{
+	pthread_mutex_lock(&encoder->queue_mutex);
+	encoder->queue_count++;
+	pthread_mutex_unlock(&encoder->queue_mutex);
+
+	if (encoder->pooled)
+		encoder_pool_schedule(&obs->data.audio_encoder_pool, encoder);
+	else
+		os_sem_post(encoder->queue_sem);
+}
+
+static inline void reserve_queued_buffer(struct encoder_queued_frame *queued,
+		size_t size)
+{
+	if (queued->capacity < size) {
+		bfree(queued->buffer);
+		queued->buffer   = bmalloc(size);
+		queued->capacity = size;
+	}
+}
+
+static inline uint32_t plane_height(enum video_format format, size_t plane,
+		uint32_t height)
+{
+	switch (format) {
+	case VIDEO_FORMAT_I420:
+		return plane == 0 ? height : (plane < 3 ? (height + 1) / 2 : 0);
+	case VIDEO_FORMAT_NV12:
+		return plane == 0 ? height : (plane < 2 ? (height + 1) / 2 : 0);
+	case VIDEO_FORMAT_I444:
+		return plane < 3 ? height : 0;
+	case VIDEO_FORMAT_NONE:
+		return 0;
+	default:
+		return plane == 0 ? height : 0;
+	}
+}
+
+/* unless the frame is in a pooled buffer that can be referenced, it only
+ * stays valid for the duration of the video-io callback, so it has to be
+ * copied before the encoder thread can use it */
+static void queue_video_frame(struct obs_encoder *encoder,
+		struct video_data *frame, bool force_keyframe)
+{
+	struct encoder_queued_frame *queued;
+	enum video_format format = encoder->queue_format;
+	uint32_t height = encoder->queue_height;
+	size_t   size   = 0;
+	uint8_t  *ptr;
+	bool     empty;
+
+	queued = reserve_queued_frame(encoder, false, &empty);
+	if (!queued) {
+		encoder->overloaded_frames++;
+		set_overloaded(encoder, true);
+		return;
+	}
+
+	if (empty)
+		set_overloaded(encoder, false);
+
+	queued->frames    = 1;
+	queued->pts       = encoder->cur_pts;
+	queued->duplicate = frame->duplicate;
+	queued->force_keyframe = force_keyframe;
+
+	if (frame->buffer) {
+		video_frame_buffer_addref(frame->buffer);
+		queued->ref = frame->buffer;
+
+		for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+			queued->data[i]     = frame->data[i];
+			queued->linesize[i] = frame->linesize[i];
+		}
+
+		commit_queued_frame(encoder);
+		return;
+	}
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++)
+		size += frame->linesize[i] * plane_height(format, i, height);
+
+	reserve_queued_buffer(queued, size);
+	ptr = queued->buffer;
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		size_t plane_size = frame->linesize[i] *
+			plane_height(format, i, height);
+
+		queued->data[i]     = plane_size ? ptr : NULL;
+		queued->linesize[i] = plane_size ? frame->linesize[i] : 0;
+
+		if (plane_size) {
+			memcpy(ptr, frame->data[i], plane_size);
+			ptr += plane_size;
+		}
+	}
+
+	commit_queued_frame(encoder);
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* the first frame is always encoded, and after that at least one frame a
+ * second, so the gaps stay bounded for players and the last frame of a
+ * recording doesn't end up covering an arbitrarily long time */
+static inline bool hold_video_frame(struct obs_encoder *encoder,
+		const struct video_data *frame, bool force_keyframe)
+{
+	uint32_t max_held = encoder->timebase_den / encoder->timebase_num;
+
+	if (!encoder->variable_framerate || !frame->duplicate ||
+	    force_keyframe ||
+	    !encoder->cur_pts || encoder->held_frames >= max_held) {
+		encoder->held_frames = 0;
+		return false;
+	}
+
+	encoder->held_frames++;
+	return true;
+}
+
+/* places the frame on the group's schedule, which counts frames from the
+ * first frame any encoder of the group got.  returns false for frames before
+ * the encoder's start, which is the group's next keyframe */
+static bool group_video_frame(struct obs_encoder *encoder,
+		const struct video_data *frame, bool *force_keyframe)
+{
+	struct obs_encoder_group *group = encoder->group;
+	uint64_t frame_ns = 1000000000ULL * encoder->timebase_num /
+		encoder->timebase_den;
+	uint64_t start_ts, idx;
+
+	pthread_mutex_lock(&group->mutex);
+	if (!group->start_ts)
+		group->start_ts = frame->timestamp;
+	start_ts = group->start_ts;
+	pthread_mutex_unlock(&group->mutex);
+
+	if (frame->timestamp < start_ts || !frame_ns)
+		return false;
+
+	idx = (frame->timestamp - start_ts + frame_ns / 2) / frame_ns;
+	*force_keyframe = idx % group->keyint == 0;
+
+	return encoder->start_ts || *force_keyframe;
+}
+
 static const char *receive_video_name = "receive_video";
 static void receive_video(void *param, struct video_data *frame)
 {
@@ -692,24 +1992,48 @@ static void receive_video(void *param, struct video_data *frame)
 
 	struct obs_encoder    *encoder  = param;
 	struct encoder_frame  enc_frame;
+	bool                  force_keyframe = false;
 
-	memset(&enc_frame, 0, sizeof(struct encoder_frame));
-
-	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
-		enc_frame.data[i]     = frame->data[i];
-		enc_frame.linesize[i] = frame->linesize[i];
+	if (encoder->encode_failed) {
+		full_stop(encoder);
+		goto end;
 	}
 
+	if (encoder->group &&
+	    !group_video_frame(encoder, frame, &force_keyframe))
+		goto end;
+
 	if (!encoder->start_ts)
 		encoder->start_ts = frame->timestamp;
 
-	enc_frame.frames = 1;
-	enc_frame.pts    = encoder->cur_pts;
+	start_frame_timing(encoder, frame);
 
-	do_encode(encoder, &enc_frame);
+	if (hold_video_frame(encoder, frame, force_keyframe)) {
+		/* nothing to encode */
+
+	} else if (encoder->thread_active) {
+		queue_video_frame(encoder, frame, force_keyframe);
+
+	} else {
+		memset(&enc_frame, 0, sizeof(struct encoder_frame));
+
+		for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+			enc_frame.data[i]     = frame->data[i];
+			enc_frame.linesize[i] = frame->linesize[i];
+		}
+
+		enc_frame.frames    = 1;
+		enc_frame.pts       = encoder->cur_pts;
+		enc_frame.duplicate = frame->duplicate;
+		enc_frame.buffer    = frame->buffer;
+		enc_frame.force_keyframe = force_keyframe;
+
+		do_encode(encoder, &enc_frame);
+	}
 
 	encoder->cur_pts += encoder->timebase_num;
 
+end:
 	profile_end(receive_video_name);
 }
 
@@ -752,10 +2076,13 @@ static bool buffer_audio(struct obs_encoder *encoder, struct audio_data *data)
 	size -= offset_size;
 
 	/* push in to the circular buffer */
-	if (size)
-		for (size_t i = 0; i < encoder->planes; i++)
-			circlebuf_push_back(&encoder->audio_input_buffer[i],
-					data->data[i] + offset_size, size);
+	for (size_t i = 0; size && i < encoder->planes; i++) {
+		struct ringbuf *rb = &encoder->audio_input_buffer[i];
+
+		if (ringbuf_space(rb) < size)
+			ringbuf_reserve(rb, ringbuf_size(rb) + size);
+		ringbuf_push_back(rb, data->data[i] + offset_size, size);
+	}
 
 	profile_end(buffer_audio_name);
 	return true;
@@ -765,14 +2092,55 @@ fail:
 	return false;
 }
 
+/* audio waits for room in the queue rather than dropping, since any gap in
+ * the audio would be audible */
+static void queue_audio_data(struct obs_encoder *encoder)
+{
+	struct encoder_queued_frame *queued;
+	size_t size = encoder->framesize_bytes;
+
+	queued = reserve_queued_frame(encoder, true, NULL);
+	if (!queued) {
+		for (size_t i = 0; i < encoder->planes; i++)
+			ringbuf_pop_front(&encoder->audio_input_buffer[i],
+					NULL, size);
+		return;
+	}
+
+	reserve_queued_buffer(queued, size * encoder->planes);
+	memset(queued->data, 0, sizeof(queued->data));
+	memset(queued->linesize, 0, sizeof(queued->linesize));
+
+	for (size_t i = 0; i < encoder->planes; i++) {
+		queued->data[i]     = queued->buffer + size * i;
+		queued->linesize[i] = (uint32_t)size;
+
+		ringbuf_pop_front(&encoder->audio_input_buffer[i],
+				queued->data[i], size);
+	}
+
+	queued->frames    = (uint32_t)encoder->framesize;
+	queued->pts       = encoder->cur_pts;
+	queued->duplicate = false;
+	queued->force_keyframe = false;
+
+	commit_queued_frame(encoder);
+}
+
 static void send_audio_data(struct obs_encoder *encoder)
 {
 	struct encoder_frame  enc_frame;
 
+	if (encoder->thread_active) {
+		queue_audio_data(encoder);
+		encoder->cur_pts += encoder->framesize;
+		return;
+	}
+
 	memset(&enc_frame, 0, sizeof(struct encoder_frame));
 
 	for (size_t i = 0; i < encoder->planes; i++) {
-		circlebuf_pop_front(&encoder->audio_input_buffer[i],
+		ringbuf_pop_front(&encoder->audio_input_buffer[i],
 				encoder->audio_output_buffer[i],
 				encoder->framesize_bytes);
 
@@ -795,10 +2163,16 @@ static void receive_audio(void *param, size_t mix_idx, struct audio_data *data)
 
 	struct obs_encoder *encoder = param;
 
+	if (encoder->encode_failed) {
+		full_stop(encoder);
+		goto end;
+	}
+
 	if (!buffer_audio(encoder, data))
 		goto end;
 
-	while (encoder->audio_input_buffer[0].size >= encoder->framesize_bytes)
+	while (ringbuf_size(&encoder->audio_input_buffer[0]) >=
+			encoder->framesize_bytes)
 		send_audio_data(encoder);
 
 	UNUSED_PARAMETER(mix_idx);
@@ -827,19 +2201,67 @@ void obs_encoder_remove_output(struct obs_encoder *encoder,
 	pthread_mutex_unlock(&encoder->outputs_mutex);
 }
 
-void obs_duplicate_encoder_packet(struct encoder_packet *dst,
+static int packet_tag = BMEM_TAG_UNTAGGED;
+
+static inline int packet_mem_tag(void)
+{
+	return bmem_tag(&packet_tag, "packets");
+}
+
+/* takes ownership of data, which must have been allocated with bmalloc */
+struct encoder_packet_buffer *encoder_packet_buffer_create(uint8_t *data)
+{
+	struct encoder_packet_buffer *buffer =
+		bzalloc_tagged(sizeof(*buffer), packet_mem_tag());
+	buffer->refs = 1;
+	buffer->data = data;
+	return buffer;
+}
+
+static void encoder_packet_buffer_release(struct encoder_packet_buffer *buffer)
+{
+	if (os_atomic_dec_long(&buffer->refs) == 0) {
+		if (buffer->avc)
+			encoder_packet_buffer_release(buffer->avc);
+		bfree(buffer->data);
+		bfree(buffer);
+	}
+}
+
+void obs_encoder_packet_ref(struct encoder_packet *dst,
 		const struct encoder_packet *src)
 {
 	*dst = *src;
-	dst->data = bmemdup(src->data, src->size);
+
+	if (src->buffer) {
+		os_atomic_inc_long(&src->buffer->refs);
+	} else {
+		dst->data   = bmalloc_tagged(src->size, packet_mem_tag());
+		dst->buffer = encoder_packet_buffer_create(dst->data);
+		memcpy(dst->data, src->data, src->size);
+	}
 }
 
-void obs_free_encoder_packet(struct encoder_packet *packet)
+void obs_encoder_packet_release(struct encoder_packet *packet)
 {
-	bfree(packet->data);
+	if (packet->buffer)
+		encoder_packet_buffer_release(packet->buffer);
+	else
+		bfree(packet->data);
 	memset(packet, 0, sizeof(struct encoder_packet));
 }
 
+void obs_duplicate_encoder_packet(struct encoder_packet *dst,
+		const struct encoder_packet *src)
+{
+	obs_encoder_packet_ref(dst, src);
+}
+
+void obs_free_encoder_packet(struct encoder_packet *packet)
+{
+	obs_encoder_packet_release(packet);
+}
+
 void obs_encoder_set_preferred_video_format(obs_encoder_t *encoder,
 		enum video_format format)
 {
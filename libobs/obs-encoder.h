@@ -35,6 +35,15 @@ enum obs_encoder_type {
 	OBS_ENCODER_VIDEO  /**< The encoder provides a video codec */
 };
 
+/** Times a video frame passed through each stage, from os_gettime_ns */
+struct encoder_frame_timing {
+	uint64_t              render_ns;   /**< Frame was rendered */
+	uint64_t              receive_ns;  /**< Encoder received the frame */
+	uint64_t              encode_ns;   /**< Encoding started */
+	uint64_t              encoded_ns;  /**< Packet came out of the encoder */
+	uint64_t              output_ns;   /**< Packet was given to the output */
+};
+
 /** Encoder output packet */
 struct encoder_packet {
 	uint8_t               *data;        /**< Packet data */
@@ -77,6 +86,20 @@ struct encoder_packet {
 
 	/** Encoder from which the track originated from */
 	obs_encoder_t         *encoder;
+
+	/**
+	 * Shared packet buffer
+	 *
+	 * Set by libobs when the data is refcounted, in which case the data
+	 * must be treated as read-only.  Encoders should leave this NULL.
+	 */
+	struct encoder_packet_buffer *buffer;
+
+	/**
+	 * When the frame of a video packet passed through each stage, set by
+	 * libobs.  All zero if unknown.
+	 */
+	struct encoder_frame_timing timing;
 };
 
 /** Encoder input frame */
@@ -92,6 +115,28 @@ struct encoder_frame {
 
 	/** Presentation timestamp */
 	int64_t               pts;
+
+	/**
+	 * Video only:  Same image as the previous frame, either because
+	 * nothing changed or because the video output fell behind.
+	 * Encoders may encode a skip or repeat instead of the full frame.
+	 */
+	bool                  duplicate;
+
+	/**
+	 * Video only:  Refcounted buffer the frame data lives in, or NULL.
+	 * Encoders that still need the data after encode returns (for
+	 * example for lookahead) can take a reference with
+	 * video_frame_buffer_addref instead of copying the frame.
+	 */
+	struct video_frame_buffer *buffer;
+
+	/**
+	 * Video only:  The frame must be encoded as a keyframe.  Set for
+	 * encoders in a group, whose keyframes follow the group's schedule
+	 * (see obs_encoder_set_group).
+	 */
+	bool                  force_keyframe;
 };
 
 /**
@@ -0,0 +1,234 @@
+/******************************************************************************
+    Copyright (C) 2013-2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "obs-internal.h"
+
+static const char *gpu_frame_name = "gpu_frame";
+
+static inline struct gpu_timing_frame *cur_frame(struct obs_gpu_timing *timing)
+{
+	return &timing->frames[timing->cur_frame];
+}
+
+/* other threads can render with the graphics context between the video
+ * thread's passes, that work must not end up in the video thread's frame */
+static inline bool timing_this_thread(struct obs_gpu_timing *timing)
+{
+	return timing->active &&
+		pthread_equal(pthread_self(), obs->video.video_thread);
+}
+
+static bool read_frame(struct gpu_timing_frame *frame)
+{
+	bool disjoint;
+	uint64_t frequency;
+
+	if (!gs_timer_range_get_data(frame->range, &disjoint, &frequency))
+		return false;
+	if (disjoint || !frequency)
+		return false;
+
+	for (size_t i = 0; i < frame->calls.num; i++) {
+		struct gpu_timing_call *call = frame->calls.array + i;
+		uint64_t ticks;
+
+		if (!gs_timer_get_data(call->timer, &ticks))
+			return false;
+
+		call->time_ns = (uint64_t)((double)ticks * 1000000000.0 /
+				(double)frequency);
+	}
+
+	return true;
+}
+
+void gpu_timing_frame_begin(void)
+{
+	struct obs_gpu_timing *timing = &obs->video.gpu_timing;
+	struct gpu_timing_frame *frame;
+
+	if (timing->unsupported || timing->active || !profile_thread_enabled())
+		return;
+
+	frame = cur_frame(timing);
+
+	/* results that still aren't available this many frames later are
+	 * dropped rather than waited for */
+	if (frame->pending && read_frame(frame) && frame->calls.num) {
+		struct gpu_timing_call end_of_frame = {0};
+
+		da_push_back_array(timing->results, frame->calls.array,
+				frame->calls.num);
+		da_push_back(timing->results, &end_of_frame);
+	}
+	frame->pending = false;
+
+	if (!frame->range) {
+		frame->range = gs_timer_range_create();
+		if (!frame->range) {
+			blog(LOG_INFO, "GPU timer queries are not supported, "
+			               "GPU times will not be profiled");
+			timing->unsupported = true;
+			return;
+		}
+	}
+
+	da_resize(frame->calls, 0);
+	gs_timer_range_begin(frame->range);
+	timing->active = true;
+}
+
+void gpu_timing_frame_end(void)
+{
+	struct obs_gpu_timing *timing = &obs->video.gpu_timing;
+	struct gpu_timing_frame *frame;
+
+	if (!timing->active)
+		return;
+
+	frame = cur_frame(timing);
+	gs_timer_range_end(frame->range);
+	frame->pending = true;
+
+	da_resize(timing->open_calls, 0);
+	timing->active = false;
+	timing->cur_frame = (timing->cur_frame + 1) % GPU_TIMING_FRAMES;
+}
+
+void gpu_timing_start(const char *name)
+{
+	struct obs_gpu_timing *timing = &obs->video.gpu_timing;
+	struct gpu_timing_frame *frame;
+	struct gpu_timing_call *call;
+	size_t idx = DARRAY_INVALID;
+
+	if (!timing_this_thread(timing))
+		return;
+
+	frame = cur_frame(timing);
+
+	if (frame->calls.num < GPU_TIMING_MAX_CALLS) {
+		if (frame->calls.num == frame->timers.num) {
+			gs_timer_t *timer = gs_timer_create();
+			if (timer)
+				da_push_back(frame->timers, &timer);
+		}
+
+		if (frame->calls.num < frame->timers.num) {
+			idx = frame->calls.num;
+			call = da_push_back_new(frame->calls);
+			call->name  = name;
+			call->depth = timing->open_calls.num;
+			call->timer = frame->timers.array[idx];
+
+			gs_timer_begin(call->timer);
+		}
+	}
+
+	/* pushed even if not timed so that gpu_timing_end stays balanced */
+	da_push_back(timing->open_calls, &idx);
+}
+
+void gpu_timing_end(void)
+{
+	struct obs_gpu_timing *timing = &obs->video.gpu_timing;
+	size_t idx;
+
+	if (!timing_this_thread(timing) || !timing->open_calls.num)
+		return;
+
+	idx = timing->open_calls.array[timing->open_calls.num - 1];
+	da_pop_back(timing->open_calls);
+
+	if (idx != DARRAY_INVALID)
+		gs_timer_end(cur_frame(timing)->calls.array[idx].timer);
+}
+
+static inline void end_calls(struct gpu_timing_call **stack, size_t *depth,
+		size_t new_depth)
+{
+	while (*depth > new_depth) {
+		struct gpu_timing_call *call = stack[--(*depth)];
+		profile_end_at(call->name, call->time_ns);
+	}
+}
+
+/*
+ * Replays a frame's GPU times as a separate profiler root, returns the number
+ * of calls used including the end of frame entry.  The profiler only keeps
+ * durations, so every call is started at 0 and ended at its GPU time.
+ */
+static size_t report_frame(struct gpu_timing_call *calls, size_t num)
+{
+	struct gpu_timing_call *stack[GPU_TIMING_MAX_CALLS];
+	uint64_t total = 0;
+	size_t depth = 0;
+	size_t i;
+
+	profile_start_at(gpu_frame_name, 0);
+
+	for (i = 0; i < num && calls[i].name; i++) {
+		struct gpu_timing_call *call = calls + i;
+
+		end_calls(stack, &depth, call->depth);
+		if (call->depth != depth)
+			continue;
+
+		if (!depth)
+			total += call->time_ns;
+
+		profile_start_at(call->name, 0);
+		stack[depth++] = call;
+	}
+
+	end_calls(stack, &depth, 0);
+	profile_end_at(gpu_frame_name, total);
+
+	return i < num ? i + 1 : i;
+}
+
+/* must be called outside of any profiler scope of the video thread, or the
+ * GPU frames would end up as children of that scope */
+void gpu_timing_report(void)
+{
+	struct obs_gpu_timing *timing = &obs->video.gpu_timing;
+	size_t i = 0;
+
+	while (i < timing->results.num)
+		i += report_frame(timing->results.array + i,
+				timing->results.num - i);
+
+	da_resize(timing->results, 0);
+}
+
+void gpu_timing_free(struct obs_gpu_timing *timing)
+{
+	for (size_t i = 0; i < GPU_TIMING_FRAMES; i++) {
+		struct gpu_timing_frame *frame = &timing->frames[i];
+
+		for (size_t j = 0; j < frame->timers.num; j++)
+			gs_timer_destroy(frame->timers.array[j]);
+
+		gs_timer_range_destroy(frame->range);
+		da_free(frame->timers);
+		da_free(frame->calls);
+	}
+
+	da_free(timing->open_calls);
+	da_free(timing->results);
+	memset(timing, 0, sizeof(*timing));
+}
@@ -90,6 +90,18 @@ static void hotkey_signal(const char *signal, obs_hotkey_t *hotkey)
 	calldata_free(&data);
 }
 
+/* source hotkeys are saved with the source, see obs_save_source.  the weak
+ * reference stays valid until the hotkey is unregistered, which happens
+ * before the source is destroyed */
+static inline void mark_bindings_changed(obs_hotkey_t *hotkey)
+{
+	if (hotkey->registerer_type == OBS_HOTKEY_REGISTERER_SOURCE) {
+		struct obs_weak_source *weak = hotkey->registerer;
+		if (weak)
+			obs_source_mark_save_changed(weak->source);
+	}
+}
+
 static inline void fixup_pointers(void);
 static inline void load_bindings(obs_hotkey_t *hotkey, obs_data_array_t *data);
 
@@ -458,29 +470,25 @@ static inline void enum_bindings(obs_hotkey_binding_internal_enum_func func,
 	}
 }
 
-struct obs_hotkey_internal_find_forward {
-	obs_hotkey_id id;
-	bool          found;
-	size_t        idx;
-};
-
-static inline bool find_id_helper(void *data, size_t idx, obs_hotkey_t *hotkey)
-{
-	struct obs_hotkey_internal_find_forward *find = data;
-	if (hotkey->id != find->id)
-		return true;
-
-	find->idx   = idx;
-	find->found = true;
-	return false;
-}
-
+/* hotkeys are only ever appended with the next id and erased in place, so
+ * the array stays sorted by id */
 static inline bool find_id(obs_hotkey_id id, size_t *idx)
 {
-	struct obs_hotkey_internal_find_forward find = {id, false, 0};
-	enum_hotkeys(find_id_helper, &find);
-	*idx = find.idx;
-	return find.found;
+	const size_t num    = obs->hotkeys.hotkeys.num;
+	obs_hotkey_t *array = obs->hotkeys.hotkeys.array;
+	size_t lo = 0;
+	size_t hi = num;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (array[mid].id < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	*idx = lo;
+	return lo < num && array[lo].id == id;
 }
 
 static inline bool pointer_fixup_func(void *data,
@@ -510,30 +518,24 @@ static inline void fixup_pointers(void)
 	enum_bindings(pointer_fixup_func, NULL);
 }
 
-struct obs_hotkey_internal_find_pair_forward {
-	obs_hotkey_pair_id id;
-	bool               found;
-	size_t             idx;
-};
-
-static inline bool find_pair_id_helper(size_t idx, obs_hotkey_pair_t *pair,
-		void *data)
-{
-	struct obs_hotkey_internal_find_pair_forward *find = data;
-	if (pair->pair_id != find->id)
-		return true;
-
-	find->idx   = idx;
-	find->found = true;
-	return false;
-}
-
+/* same as the hotkeys, pairs are kept sorted by id */
 static inline bool find_pair_id(obs_hotkey_pair_id id, size_t *idx)
 {
-	struct obs_hotkey_internal_find_pair_forward find = {id, false, 0};
-	enum_hotkey_pairs(find_pair_id_helper, &find);
-	*idx = find.idx;
-	return find.found;
+	const size_t num         = obs->hotkeys.hotkey_pairs.num;
+	obs_hotkey_pair_t *array = obs->hotkeys.hotkey_pairs.array;
+	size_t lo = 0;
+	size_t hi = num;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (array[mid].pair_id < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	*idx = lo;
+	return lo < num && array[lo].pair_id == id;
 }
 
 static inline bool pair_pointer_fixup_func(size_t idx,
@@ -620,6 +622,7 @@ static inline void load_bindings(obs_hotkey_t *hotkey, obs_data_array_t *data)
 		obs_data_release(item);
 	}
 
+	mark_bindings_changed(hotkey);
 	hotkey_signal("hotkey_bindings_changed", hotkey);
 }
 
@@ -639,6 +642,7 @@ void obs_hotkey_load_bindings(obs_hotkey_id id,
 		for (size_t i = 0; i < num; i++)
 			create_binding(hotkey, combinations[i]);
 
+		mark_bindings_changed(hotkey);
 		hotkey_signal("hotkey_bindings_changed", hotkey);
 	}
 	unlock();
@@ -877,45 +881,60 @@ obs_data_t *obs_hotkeys_save_source(obs_source_t *source)
 	return result;
 }
 
-struct binding_find_data {
-	obs_hotkey_id id;
-	size_t *idx;
-	bool found;
-};
+static inline void release_pressed_binding(obs_hotkey_binding_t *binding);
 
-static inline bool binding_finder(void *data,
-		size_t idx, obs_hotkey_binding_t *binding)
+static int cmp_hotkey_id(const void *a, const void *b)
 {
-	struct binding_find_data *find = data;
-	if (binding->hotkey_id != find->id)
-		return true;
-
-	*find->idx  = idx;
-	find->found = true;
-	return false;
+	obs_hotkey_id id_a = *(const obs_hotkey_id*)a;
+	obs_hotkey_id id_b = *(const obs_hotkey_id*)b;
+	return id_a < id_b ? -1 : (id_a > id_b ? 1 : 0);
 }
 
-static inline bool find_binding(obs_hotkey_id id, size_t *idx)
+static inline bool ids_contain(const obs_hotkey_id *ids, size_t count,
+		obs_hotkey_id id)
 {
-	struct binding_find_data data = {id, idx, false};
-	enum_bindings(binding_finder, &data);
-	return data.found;
+	return bsearch(&id, ids, count, sizeof(*ids), cmp_hotkey_id) != NULL;
 }
 
-static inline void release_pressed_binding(obs_hotkey_binding_t *binding);
+/* ids are added to a context in the order they were registered, so they're
+ * already sorted unless the id counter wrapped around */
+static inline void sort_ids(obs_hotkey_id *ids, size_t count)
+{
+	for (size_t i = 1; i < count; i++) {
+		if (ids[i - 1] > ids[i]) {
+			qsort(ids, count, sizeof(*ids), cmp_hotkey_id);
+			return;
+		}
+	}
+}
 
-static inline void remove_bindings(obs_hotkey_id id)
+/* removes the bindings of all hotkeys in the sorted ids array in one pass */
+static void remove_bindings_of(const obs_hotkey_id *ids, size_t count)
 {
-	size_t idx;
-	while (find_binding(id, &idx)) {
-		obs_hotkey_binding_t *binding =
-			&obs->hotkeys.bindings.array[idx];
+	const size_t         num    = obs->hotkeys.bindings.num;
+	obs_hotkey_binding_t *array = obs->hotkeys.bindings.array;
+	size_t kept = 0;
+
+	for (size_t i = 0; i < num; i++) {
+		obs_hotkey_binding_t *binding = &array[i];
+
+		if (!ids_contain(ids, count, binding->hotkey_id)) {
+			if (kept != i)
+				array[kept] = *binding;
+			kept++;
+			continue;
+		}
 
 		if (binding->pressed)
 			release_pressed_binding(binding);
-
-		da_erase(obs->hotkeys.bindings, idx);
 	}
+
+	da_resize(obs->hotkeys.bindings, kept);
+}
+
+static inline void remove_bindings(obs_hotkey_id id)
+{
+	remove_bindings_of(&id, 1);
 }
 
 static void release_registerer(obs_hotkey_t *hotkey)
@@ -944,31 +963,55 @@ static void release_registerer(obs_hotkey_t *hotkey)
 	hotkey->registerer = NULL;
 }
 
-static inline bool unregister_hotkey(obs_hotkey_id id)
+/* unregisters all hotkeys in the sorted ids array with a single pass over the
+ * bindings and the hotkeys, so releasing a context with many hotkeys doesn't
+ * erase them one at a time.  returns true if binding pointers need to be
+ * fixed up */
+static bool unregister_hotkeys(const obs_hotkey_id *ids, size_t count)
 {
-	if (id >= obs->hotkeys.next_id)
+	if (!count)
 		return false;
 
-	size_t idx;
-	if (!find_id(id, &idx))
-		return false;
+	/* bindings go first, releasing a pressed binding calls its hotkey */
+	remove_bindings_of(ids, count);
 
-	obs_hotkey_t *hotkey = &obs->hotkeys.hotkeys.array[idx];
+	const size_t num    = obs->hotkeys.hotkeys.num;
+	obs_hotkey_t *array = obs->hotkeys.hotkeys.array;
+	size_t kept = 0;
 
-	hotkey_signal("hotkey_unregister", hotkey);
+	for (size_t i = 0; i < num; i++) {
+		obs_hotkey_t *hotkey = &array[i];
+		if (!ids_contain(ids, count, hotkey->id))
+			continue;
 
-	release_registerer(hotkey);
+		hotkey_signal("hotkey_unregister", hotkey);
 
-	bfree(hotkey->name);
-	bfree(hotkey->description);
+		release_registerer(hotkey);
 
-	if (hotkey->registerer_type == OBS_HOTKEY_REGISTERER_SOURCE)
-		obs_weak_source_release(hotkey->registerer);
+		bfree(hotkey->name);
+		bfree(hotkey->description);
+	}
+
+	/* compacted separately so nothing moves while signals are emitted */
+	for (size_t i = 0; i < num; i++) {
+		if (ids_contain(ids, count, array[i].id))
+			continue;
 
-	da_erase(obs->hotkeys.hotkeys, idx);
-	remove_bindings(id);
+		if (kept != i)
+			array[kept] = array[i];
+		kept++;
+	}
+
+	da_resize(obs->hotkeys.hotkeys, kept);
+	return kept != num;
+}
+
+static inline bool unregister_hotkey(obs_hotkey_id id)
+{
+	if (id >= obs->hotkeys.next_id)
+		return false;
 
-	return obs->hotkeys.hotkeys.num >= idx;
+	return unregister_hotkeys(&id, 1);
 }
 
 static inline bool unregister_hotkey_pair(obs_hotkey_pair_id id)
@@ -982,9 +1025,10 @@ static inline bool unregister_hotkey_pair(obs_hotkey_pair_id id)
 
 	obs_hotkey_pair_t *pair = &obs->hotkeys.hotkey_pairs.array[idx];
 
-	bool need_fixup = unregister_hotkey(pair->id[0]);
-	need_fixup = unregister_hotkey(pair->id[1]) || need_fixup;
-	if (need_fixup)
+	obs_hotkey_id ids[2] = {pair->id[0], pair->id[1]};
+	sort_ids(ids, 2);
+
+	if (unregister_hotkeys(ids, 2))
 		fixup_pointers();
 
 	da_erase(obs->hotkeys.hotkey_pairs, idx);
@@ -1016,12 +1060,9 @@ static void context_release_hotkeys(struct obs_context_data *context)
 	if (!context->hotkeys.num)
 		goto cleanup;
 
-	bool need_fixup = false;
-	for (size_t i = 0; i < context->hotkeys.num; i++)
-		need_fixup = unregister_hotkey(context->hotkeys.array[i]) ||
-			need_fixup;
+	sort_ids(context->hotkeys.array, context->hotkeys.num);
 
-	if (need_fixup)
+	if (unregister_hotkeys(context->hotkeys.array, context->hotkeys.num))
 		fixup_pointers();
 
 cleanup:
@@ -1030,17 +1071,55 @@ cleanup:
 
 static void context_release_hotkey_pairs(struct obs_context_data *context)
 {
+	DARRAY(obs_hotkey_id) ids;
+	obs_hotkey_pair_t *array;
+	size_t num;
+	size_t kept = 0;
+
 	if (!context->hotkey_pairs.num)
 		goto cleanup;
 
-	bool need_fixup = false;
-	for (size_t i = 0; i < context->hotkey_pairs.num; i++)
-		need_fixup =
-			unregister_hotkey_pair(context->hotkey_pairs.array[i])
-			|| need_fixup;
+	da_init(ids);
+
+	const obs_hotkey_pair_id *pair_ids = context->hotkey_pairs.array;
+	const size_t pair_count            = context->hotkey_pairs.num;
+
+	sort_ids(context->hotkey_pairs.array, pair_count);
+
+	num   = obs->hotkeys.hotkey_pairs.num;
+	array = obs->hotkeys.hotkey_pairs.array;
+
+	for (size_t i = 0; i < num; i++) {
+		obs_hotkey_pair_t *pair = &array[i];
+		if (!ids_contain(pair_ids, pair_count, pair->pair_id))
+			continue;
+
+		da_push_back(ids, &pair->id[0]);
+		da_push_back(ids, &pair->id[1]);
+	}
+
+	/* the pairs have to stay in place until their hotkeys are gone,
+	 * releasing a pressed binding calls into its pair */
+	sort_ids(ids.array, ids.num);
+
+	if (unregister_hotkeys(ids.array, ids.num))
+		fixup_pointers();
+
+	da_free(ids);
 
-	if (need_fixup)
+	for (size_t i = 0; i < num; i++) {
+		if (ids_contain(pair_ids, pair_count, array[i].pair_id))
+			continue;
+
+		if (kept != i)
+			array[kept] = array[i];
+		kept++;
+	}
+
+	if (kept != num) {
+		da_resize(obs->hotkeys.hotkey_pairs, kept);
 		fixup_pair_pointers();
+	}
 
 cleanup:
 	da_free(context->hotkey_pairs);
@@ -1121,10 +1200,22 @@ static inline bool modifiers_match(obs_hotkey_binding_t *binding,
 		(strict_modifiers && modifiers == modifiers_);
 }
 
+/* many bindings share the same few keys, so each key is only asked from the
+ * platform once per pass */
 static inline bool is_pressed(obs_key_t key)
 {
-	return obs_hotkeys_platform_is_pressed(obs->hotkeys.platform_context,
-			key);
+	int8_t *state;
+
+	if (key < 0 || key >= OBS_KEY_LAST_VALUE)
+		return obs_hotkeys_platform_is_pressed(
+				obs->hotkeys.platform_context, key);
+
+	state = &obs->hotkeys.key_states[key];
+	if (*state < 0)
+		*state = obs_hotkeys_platform_is_pressed(
+				obs->hotkeys.platform_context, key) ? 1 : 0;
+
+	return *state > 0;
 }
 
 static inline void press_released_binding(obs_hotkey_binding_t *binding)
@@ -1271,6 +1362,9 @@ static inline bool query_hotkey(void *data,
 static inline void query_hotkeys()
 {
 	uint32_t modifiers = 0;
+
+	memset(obs->hotkeys.key_states, -1, sizeof(obs->hotkeys.key_states));
+
 	if (is_pressed(OBS_KEY_SHIFT))
 		modifiers |= INTERACT_SHIFT_KEY;
 	if (is_pressed(OBS_KEY_CONTROL))
@@ -1288,16 +1382,58 @@ static inline void query_hotkeys()
 	enum_bindings(query_hotkey, &param);
 }
 
+#define HOTKEY_POLL_INTERVAL_MS   25
+
+/* when listening for input, still check now and then in case the state
+ * changed without an event (bindings changing while a key is held, or an
+ * event lost while the system was busy) */
+#define HOTKEY_LISTEN_INTERVAL_MS 1000
+
+static bool wait_for_input(struct obs_hotkeys_listener *listener)
+{
+	if (listener) {
+		obs_hotkeys_platform_listen_wait(listener,
+				HOTKEY_LISTEN_INTERVAL_MS);
+		return os_event_try(obs->hotkeys.stop_event) == EAGAIN;
+	}
+
+	return os_event_timedwait(obs->hotkeys.stop_event,
+			HOTKEY_POLL_INTERVAL_MS) == ETIMEDOUT;
+}
+
 void *obs_hotkey_thread(void *arg)
 {
+	struct obs_hotkeys_listener *listener;
+	const char *hotkey_thread_name;
+
 	UNUSED_PARAMETER(arg);
 
-	const char *hotkey_thread_name =
-		profile_store_name(obs_get_profiler_name_store(),
-				"obs_hotkey_thread(%g ms)", 25.);
-	profile_register_root(hotkey_thread_name, (uint64_t)25000000);
+	os_set_thread_name("libobs: hotkey thread");
+
+	listener = obs_hotkeys_platform_listen_init();
+	if (listener)
+		blog(LOG_INFO, "hotkeys: Waiting for input events");
+	else
+		blog(LOG_INFO, "hotkeys: Polling every %d ms",
+				HOTKEY_POLL_INTERVAL_MS);
+
+	/* stop_hotkeys wakes the listener with the mutex held */
+	pthread_mutex_lock(&obs->hotkeys.mutex);
+	obs->hotkeys.listener = listener;
+	pthread_mutex_unlock(&obs->hotkeys.mutex);
+
+	if (listener) {
+		hotkey_thread_name = "obs_hotkey_thread(events)";
+	} else {
+		hotkey_thread_name = profile_store_name(
+				obs_get_profiler_name_store(),
+				"obs_hotkey_thread(%g ms)",
+				(double)HOTKEY_POLL_INTERVAL_MS);
+		profile_register_root(hotkey_thread_name,
+				HOTKEY_POLL_INTERVAL_MS * 1000000ULL);
+	}
 
-	while (os_event_timedwait(obs->hotkeys.stop_event, 25) == ETIMEDOUT) {
+	while (wait_for_input(listener)) {
 		if (!lock())
 			continue;
 
@@ -1309,6 +1445,12 @@ void *obs_hotkey_thread(void *arg)
 
 		profile_reenable_thread();
 	}
+
+	pthread_mutex_lock(&obs->hotkeys.mutex);
+	obs->hotkeys.listener = NULL;
+	pthread_mutex_unlock(&obs->hotkeys.mutex);
+
+	obs_hotkeys_platform_listen_free(listener);
 	return NULL;
 }
 
@@ -20,10 +20,12 @@
 #include "util/c99defs.h"
 #include "util/darray.h"
 #include "util/circlebuf.h"
+#include "util/ringbuf.h"
 #include "util/dstr.h"
 #include "util/threading.h"
 #include "util/platform.h"
 #include "util/profiler.h"
+#include "util/task-pool.h"
 #include "callback/signal.h"
 #include "callback/proc.h"
 
@@ -36,6 +38,25 @@
 #include "obs.h"
 
 #define NUM_TEXTURES 2
+#define MIN_READBACK_FRAMES 2
+#define MAX_READBACK_FRAMES 6
+#define MAX_CONVERSION_SLICES 16
+#define MAX_PACING_SPIN_US 2000
+#define MAX_TICK_THREADS 8
+#define DEFAULT_FRAME_CACHE_SIZE 6
+#define MIN_FRAME_CACHE_SIZE 2
+#define MAX_FRAME_CACHE_SIZE 64
+#define DEFAULT_ASYNC_UPLOADS 2
+#define MAX_ASYNC_UPLOADS 4
+#define ENCODE_TIME_BUCKETS 80
+#define FRAME_TIMING_SLOTS 64
+#define LOW_LATENCY_AUDIO_TICK_MS 5
+#define LOW_LATENCY_AUDIO_BUFFER_MS 100
+
+/* with low latency video, interleaved packets are sent once they're this
+ * much older than the newest packet of their own type, even without a newer
+ * packet of the opposing type */
+#define LOW_LATENCY_INTERLEAVE_USEC 30000
 #define MICROSECOND_DEN 1000000
 
 static inline int64_t packet_dts_usec(struct encoder_packet *packet)
@@ -93,6 +114,18 @@ struct obs_module {
 	void *module;
 	bool loaded;
 
+	/* listed in the module manifest, only opened once one of its types is
+	 * needed, see obs_load_deferred_type */
+	bool deferred;
+	uint64_t load_time_ns;
+
+	/* ids of the types the module registers */
+	DARRAY(char*) type_ids;
+
+	/* allocation tag everything the module allocates from its own
+	 * callbacks is charged to, see bmem_register_tag */
+	int mem_tag;
+
 	bool        (*load)(void);
 	void        (*unload)(void);
 	void        (*set_locale)(const char *locale);
@@ -108,6 +141,20 @@ struct obs_module {
 
 extern void free_module(struct obs_module *mod);
 
+/* loads the deferred module that registers a type id, returns false if
+ * there is none */
+extern bool obs_load_deferred_type(const char *id);
+extern void obs_load_deferred_modules(void);
+
+/* the allocation tag of the module a source/output/encoder/service type
+ * was registered by, BMEM_TAG_UNTAGGED for the types of libobs itself */
+struct obs_type_mem_tag {
+	const char *id;
+	int        tag;
+};
+
+extern int obs_get_type_mem_tag(const char *id);
+
 struct obs_module_path {
 	char *bin;
 	char *data;
@@ -170,6 +217,20 @@ void obs_hotkeys_platform_free(struct obs_core_hotkeys *hotkeys);
 bool obs_hotkeys_platform_is_pressed(obs_hotkeys_platform_t *context,
 		obs_key_t key);
 
+/*
+ * Lets the hotkey thread sleep until there is keyboard or mouse button input
+ * instead of polling.  Platforms return NULL from listen_init if they can't
+ * (or aren't allowed to) listen, and the thread falls back to polling.
+ * init, wait and free are called from the hotkey thread, wake from any thread.
+ */
+struct obs_hotkeys_listener;
+struct obs_hotkeys_listener *obs_hotkeys_platform_listen_init(void);
+void obs_hotkeys_platform_listen_free(struct obs_hotkeys_listener *listener);
+/* returns true if there was input before the timeout */
+bool obs_hotkeys_platform_listen_wait(struct obs_hotkeys_listener *listener,
+		uint32_t timeout_ms);
+void obs_hotkeys_platform_listen_wake(struct obs_hotkeys_listener *listener);
+
 const char *obs_get_hotkey_translation(obs_key_t key, const char *def);
 
 struct obs_context_data;
@@ -196,6 +257,12 @@ void obs_hotkey_name_map_free(void);
 struct obs_view {
 	pthread_mutex_t                 channels_mutex;
 	obs_source_t                    *channels[MAX_CHANNELS];
+
+	/* render of the current frame for obs_view_render_cached, graphics
+	 * thread only.  cache_time is the video time it was rendered at */
+	gs_texture_t                    *cache_texture;
+	uint64_t                        cache_time;
+	bool                            cache_valid;
 };
 
 extern bool obs_view_init(struct obs_view *view);
@@ -231,39 +298,253 @@ struct obs_vframe_info {
 	int count;
 };
 
+/* frame timings only queue up while frames are in flight to the cpu, so a
+ * small fixed queue is plenty, see push_vframe_info */
+#define VFRAME_INFO_QUEUE_SIZE 64
+#define VFRAME_INFO_QUEUE_BYTES \
+	(VFRAME_INFO_QUEUE_SIZE * sizeof(struct obs_vframe_info))
+
+struct obs_convert_worker {
+	pthread_t                       thread;
+	os_sem_t                        *start_sem;
+	uint32_t                        start_y;
+	uint32_t                        end_y;
+};
+
+#define MAX_CONVERSION_PLANES 3
+
+/* a plane of the frame read back from the GPU.  with GPU conversion each
+ * plane is rendered to its own texture with the technique, otherwise the
+ * output texture is the only plane. */
+struct obs_conversion_plane {
+	const char                      *tech;
+	enum gs_color_format            format;
+	uint32_t                        width;
+	uint32_t                        height;
+};
+
+struct obs_conversion_layout {
+	size_t                          num_planes;
+	struct obs_conversion_plane     planes[MAX_CONVERSION_PLANES];
+};
+
+/* the staging surfaces a frame is read back through, one per plane */
+struct obs_readback {
+	gs_stagesurf_t                  *surfaces[MAX_CONVERSION_PLANES];
+	size_t                          num_surfaces;
+};
+
+extern struct obs_readback *obs_readback_create(
+		const struct obs_conversion_layout *layout);
+extern void obs_readback_destroy(struct obs_readback *readback);
+extern void obs_readback_unmap(struct obs_readback *readback);
+
+/* an extra output resolution requested by scaled encoders.  it is scaled
+ * (and converted) from the main render texture on the GPU, and has its own
+ * video output which the encoders connect to */
+struct obs_scaled_video {
+	uint32_t                        width;
+	uint32_t                        height;
+	long                            refs;
+	video_t                         *video;
+
+	gs_texture_t                    *output_textures[NUM_TEXTURES];
+	gs_texture_t  *convert_textures[NUM_TEXTURES][MAX_CONVERSION_PLANES];
+	struct obs_readback             *readbacks[MAX_READBACK_FRAMES];
+	bool                            textures_output[NUM_TEXTURES];
+	bool                            textures_converted[NUM_TEXTURES];
+	bool                            textures_copied[MAX_READBACK_FRAMES];
+	struct obs_readback             *mapped_readback;
+	struct obs_conversion_layout    layout;
+
+	/* the texture rendered before this was created has no timestamp
+	 * queued for it, so it must not be used */
+	bool                            started;
+	struct ringbuf                  vframe_info_buffer;
+	struct video_data               frame;
+	bool                            frame_ready;
+	bool                            last_frame_output;
+
+	/* skipped frames of the output already added to the main output */
+	uint32_t                        skipped_frames;
+};
+
+/* parameters of the format conversion effect, resolved when it's loaded */
+struct obs_conversion_params {
+	gs_eparam_t                     *image;
+	gs_eparam_t                     *width;
+	gs_eparam_t                     *height;
+	gs_eparam_t                     *width_i;
+	gs_eparam_t                     *height_i;
+	gs_eparam_t                     *width_d2;
+	gs_eparam_t                     *height_d2;
+	gs_eparam_t                     *width_d2_i;
+	gs_eparam_t                     *height_d2_i;
+	gs_eparam_t                     *input_width;
+	gs_eparam_t                     *input_height;
+	gs_eparam_t                     *input_width_i;
+	gs_eparam_t                     *input_height_i;
+	gs_eparam_t                     *input_width_i_d2;
+	gs_eparam_t                     *input_height_i_d2;
+	gs_eparam_t                     *u_plane_offset;
+	gs_eparam_t                     *v_plane_offset;
+};
+
+/*
+ * GPU timing of the video thread's render passes, reported to the profiler.
+ * Timer results are read GPU_TIMING_FRAMES frames after they were issued so
+ * the video thread never waits for them.
+ */
+#define GPU_TIMING_FRAMES    4
+#define GPU_TIMING_MAX_CALLS 512
+
+struct gpu_timing_call {
+	const char                      *name;
+	size_t                          depth;
+	gs_timer_t                      *timer;
+	uint64_t                        time_ns;
+};
+
+struct gpu_timing_frame {
+	gs_timer_range_t                *range;
+	DARRAY(gs_timer_t*)             timers;
+	DARRAY(struct gpu_timing_call)  calls;
+	bool                            pending;
+};
+
+struct obs_gpu_timing {
+	struct gpu_timing_frame         frames[GPU_TIMING_FRAMES];
+	size_t                          cur_frame;
+	DARRAY(size_t)                  open_calls;
+	DARRAY(struct gpu_timing_call)  results;
+	bool                            active;
+	bool                            unsupported;
+};
+
+extern void gpu_timing_frame_begin(void);
+extern void gpu_timing_frame_end(void);
+extern void gpu_timing_start(const char *name);
+extern void gpu_timing_end(void);
+extern void gpu_timing_report(void);
+extern void gpu_timing_free(struct obs_gpu_timing *timing);
+
+struct obs_draw_crop {
+	bool                            active;
+	struct obs_source_crop          crop;
+	uint32_t                        cx;
+	uint32_t                        cy;
+};
+
 struct obs_core_video {
 	graphics_t                      *graphics;
-	gs_stagesurf_t                  *copy_surfaces[NUM_TEXTURES];
+	struct obs_readback             *readbacks[MAX_READBACK_FRAMES];
 	gs_texture_t                    *render_textures[NUM_TEXTURES];
 	gs_texture_t                    *output_textures[NUM_TEXTURES];
-	gs_texture_t                    *convert_textures[NUM_TEXTURES];
+	gs_texture_t  *convert_textures[NUM_TEXTURES][MAX_CONVERSION_PLANES];
 	bool                            textures_rendered[NUM_TEXTURES];
 	bool                            textures_output[NUM_TEXTURES];
-	bool                            textures_copied[NUM_TEXTURES];
+	bool                            textures_copied[MAX_READBACK_FRAMES];
 	bool                            textures_converted[NUM_TEXTURES];
-	struct circlebuf                vframe_info_buffer;
+	struct ringbuf                  vframe_info_buffer;
 	gs_effect_t                     *default_effect;
 	gs_effect_t                     *default_rect_effect;
 	gs_effect_t                     *opaque_effect;
 	gs_effect_t                     *solid_effect;
 	gs_effect_t                     *conversion_effect;
+	struct obs_conversion_params    conversion_params;
 	gs_effect_t                     *bicubic_effect;
 	gs_effect_t                     *lanczos_effect;
 	gs_effect_t                     *bilinear_lowres_effect;
-	gs_stagesurf_t                  *mapped_surface;
+	struct obs_readback             *mapped_readback;
 	int                             cur_texture;
-
+	int                             cur_surface;
+
+	/* crop applied to the draws of the source being drawn by
+	 * obs_source_video_render_crop, graphics thread only */
+	struct obs_draw_crop            draw_crop;
+
+	/* main view channels as of the last frame, to detect changes */
+	obs_source_t                    *rendered_channels[MAX_CHANNELS];
+
+	/* bit n is set if the render texture of n frames ago was reused, so
+	 * the frame downloaded once it reaches the end of the pipeline can be
+	 * queued as a repeat, see frame_unchanged */
+	uint64_t                        unchanged_renders;
+	bool                            last_frame_output;
+	uint32_t                        readback_frames;
+
+	/* readbacks passed to video-io by reference; released readbacks are
+	 * unmapped and moved to the free list on the graphics thread */
+	bool                            zero_copy_readback;
+	pthread_mutex_t                 held_surfaces_mutex;
+	DARRAY(struct obs_readback*)    released_readbacks;
+	DARRAY(struct obs_readback*)    free_readbacks;
+
+	/* video_time is the time of the current frame.  frames are timed
+	 * from clock_start by clock_frames whole frames, rather than by
+	 * adding up a rounded interval, so the clock doesn't drift */
 	uint64_t                        video_time;
+	uint64_t                        clock_start;
+	uint64_t                        clock_frames;
+	uint64_t                        pacing_spin_ns;
+	uint64_t                        preview_interval_ns;
+	bool                            headless;
+	bool                            low_latency;
+
+	/* how long sources have to go unused before they're suspended, or 0 to
+	 * never suspend them */
+	uint64_t                        suspend_delay_ns;
+
+	/* offline rendering.  offline_render is the requested mode, which the
+	 * video thread applies between frames and reports in offline_active.
+	 * clock_ns is the time returned by obs_get_clock_ns while offline */
+	volatile bool                   offline_render;
+	volatile bool                   offline_active;
+	volatile int64_t                clock_ns;
+
+	/* set by obs_signal_next_frame, the video thread emits
+	 * "frame_rendered" after the next frame and clears it */
+	volatile long                   signal_next_frame;
+	pthread_mutex_t                 frame_timing_mutex;
+	struct obs_video_frame_timing   frame_timing;
+	struct obs_video_pipeline_timing pipeline_timing;
+	struct obs_gpu_timing           gpu_timing;
 	video_t                         *video;
 	pthread_t                       video_thread;
 	bool                            thread_initialized;
 
+	/* CPU conversion slices, the video thread converts the last slice
+	 * itself, the others are converted by conversion_slices-1 workers */
+	uint32_t                        conversion_slices;
+	struct obs_convert_worker       convert_workers[MAX_CONVERSION_SLICES];
+	size_t                          num_convert_workers;
+	os_sem_t                        *convert_done_sem;
+	volatile bool                   convert_stop;
+	struct video_frame              *convert_output;
+	const struct video_data         *convert_input;
+	const struct video_output_info  *convert_info;
+
+	/* tick callbacks of sources with OBS_SOURCE_THREADED_TICK, shared
+	 * out between the tick threads and the video thread */
+	uint32_t                        tick_threads;
+	pthread_t                       tick_workers[MAX_TICK_THREADS];
+	size_t                          num_tick_workers;
+	os_sem_t                        *tick_start_sem;
+	os_sem_t                        *tick_done_sem;
+	volatile bool                   tick_stop;
+	DARRAY(struct obs_source*)      threaded_ticks;
+	volatile long                   next_threaded_tick;
+	float                           tick_seconds;
+
 	bool                            gpu_conversion;
-	const char                      *conversion_tech;
-	uint32_t                        conversion_height;
-	uint32_t                        plane_offsets[3];
-	uint32_t                        plane_sizes[3];
-	uint32_t                        plane_linewidth[3];
+	struct obs_conversion_layout    layout;
+
+	pthread_mutex_t                 scaled_mutex;
+	DARRAY(struct obs_scaled_video*) scaled_videos;
+	/* created since the last frame started.  they're only added to
+	 * scaled_videos at the start of a frame, so that the frame timings
+	 * they're given always match the textures they render */
+	DARRAY(struct obs_scaled_video*) new_scaled_videos;
 
 	uint32_t                        output_width;
 	uint32_t                        output_height;
@@ -276,12 +557,94 @@ struct obs_core_video {
 struct obs_core_audio {
 	/* TODO: sound output subsystem */
 	audio_t                         *audio;
+	bool                            low_latency;
 
 	float                           user_volume;
 	float                           present_volume;
 };
 
 /* user sources, output channels, and displays */
+/*
+ * Audio encoders share a small pool of worker threads rather than each
+ * getting their own.  An encoder with queued frames sits in the ready list
+ * once, and is only ever worked on by one thread at a time, so each
+ * track's packets still come out in order.
+ */
+struct obs_encoder_pool {
+	pthread_mutex_t                 mutex;
+	os_sem_t                        *sem;
+	DARRAY(struct obs_encoder*)     ready;
+	DARRAY(pthread_t)               threads;
+	size_t                          active_encoders;
+	bool                            stop;
+};
+
+extern bool obs_encoder_pool_init(struct obs_encoder_pool *pool);
+extern void obs_encoder_pool_free(struct obs_encoder_pool *pool);
+
+/* ------------------------------------------------------------------------- */
+/* janitor */
+
+enum obs_destroy_type {
+	OBS_DESTROY_SOURCE,
+	OBS_DESTROY_ENCODER,
+};
+
+struct obs_destroy_item {
+	enum obs_destroy_type           type;
+	void                            *object;
+};
+
+enum obs_gs_free_type {
+	OBS_GS_FREE_TEXTURE,
+	OBS_GS_FREE_TEXRENDER,
+	OBS_GS_FREE_EFFECT,
+};
+
+struct obs_gs_free {
+	enum obs_gs_free_type           type;
+	void                            *object;
+};
+
+/* sources and encoders are torn down on the janitor thread, so whichever
+ * thread drops the last reference (the video thread, an audio callback, the
+ * UI) never waits on a plugin's destroy callback.  the graphics objects
+ * they leave behind are freed by the video thread at the end of its next
+ * frame, or right away while it isn't running. */
+struct obs_janitor {
+	pthread_t                       thread;
+	bool                            thread_initialized;
+	os_sem_t                        *sem;
+	volatile bool                   stop;
+	pthread_mutex_t                 mutex;
+	DARRAY(struct obs_destroy_item) queue;
+
+	pthread_mutex_t                 gs_mutex;
+	DARRAY(struct obs_gs_free)      gs_frees;
+	bool                            gs_thread_active;
+};
+
+extern bool obs_janitor_init(struct obs_janitor *janitor);
+extern void obs_janitor_stop(struct obs_janitor *janitor);
+extern void obs_janitor_free(struct obs_janitor *janitor);
+
+/* returns false if the object has to be destroyed by the caller, either
+ * because the janitor isn't running or the caller is the janitor */
+extern bool obs_janitor_queue(enum obs_destroy_type type, void *object);
+
+extern void obs_janitor_gs_free(enum obs_gs_free_type type, void *object);
+
+/* video thread only, in or out of the graphics context respectively */
+extern void obs_janitor_gs_begin(void);
+extern void obs_janitor_gs_flush(void);
+extern void obs_janitor_gs_end(void);
+
+/* the list of all sources as of its last change, never modified once it's
+ * published */
+struct obs_source_snapshot {
+	DARRAY(struct obs_source*)      sources;
+};
+
 struct obs_core_data {
 	pthread_mutex_t                 user_sources_mutex;
 	DARRAY(struct obs_source*)      user_sources;
@@ -293,6 +656,18 @@ struct obs_core_data {
 	struct obs_service              *first_service;
 
 	pthread_mutex_t                 sources_mutex;
+
+	/* the video thread walks a snapshot of the sources rather than the
+	 * list, so it never waits on sources_mutex.  replaced snapshots are
+	 * freed at the end of the walk, and a source isn't destroyed until
+	 * any walk that might still see it is over.  source_walk_seq is odd
+	 * while a walk is in progress. */
+	pthread_mutex_t                 snapshot_mutex;
+	struct obs_source_snapshot      *source_snapshot;
+	DARRAY(struct obs_source_snapshot*) retired_snapshots;
+	DARRAY(struct obs_source*)      deferred_destroys;
+	volatile long                   source_walk_seq;
+
 	pthread_mutex_t                 displays_mutex;
 	pthread_mutex_t                 outputs_mutex;
 	pthread_mutex_t                 encoders_mutex;
@@ -300,10 +675,19 @@ struct obs_core_data {
 
 	struct obs_view                 main_view;
 
+	struct obs_encoder_pool         audio_encoder_pool;
+
+	/* transitions that are currently active, and whether the set of
+	 * active sources changed since base volumes were last calculated */
 	volatile long                   active_transitions;
+	volatile long                   base_volume_dirty;
 
 	long long                       unnamed_index;
 
+	/* source save generations are taken from this, so they are unique
+	 * across all sources */
+	volatile long                   save_generation;
+
 	volatile bool                   valid;
 };
 
@@ -327,6 +711,10 @@ struct obs_core_hotkeys {
 	void                            *router_func_data;
 
 	obs_hotkeys_platform_t          *platform_context;
+	struct obs_hotkeys_listener     *listener;
+
+	/* key states queried during the current pass, -1 if not queried */
+	int8_t                          key_states[OBS_KEY_LAST_VALUE];
 
 	pthread_once_t                  name_map_init_token;
 	struct obs_hotkey_name_map      *name_map;
@@ -346,12 +734,17 @@ struct obs_core {
 	struct obs_module               *first_module;
 	DARRAY(struct obs_module_path)  module_paths;
 
+	/* recursive, as loading a module can look up the types of another */
+	pthread_mutex_t                 module_mutex;
+	volatile long                   deferred_modules;
+
 	DARRAY(struct obs_source_info)  input_types;
 	DARRAY(struct obs_source_info)  filter_types;
 	DARRAY(struct obs_source_info)  transition_types;
 	DARRAY(struct obs_output_info)  output_types;
 	DARRAY(struct obs_encoder_info) encoder_types;
 	DARRAY(struct obs_service_info) service_types;
+	DARRAY(struct obs_type_mem_tag) type_mem_tags;
 	DARRAY(struct obs_modal_ui)     modal_ui_callbacks;
 	DARRAY(struct obs_modeless_ui)  modeless_ui_callbacks;
 
@@ -363,17 +756,32 @@ struct obs_core {
 	bool                            name_store_owned;
 	profiler_name_store_t           *name_store;
 
+	/* shared with plugins through obs_get_task_pool */
+	os_task_pool_t                  *task_pool;
+
+	pthread_mutex_t                 thread_settings_mutex;
+	struct os_thread_settings       thread_settings[OBS_THREAD_ROLE_COUNT];
+
 	/* segmented into multiple sub-structures to keep things a bit more
 	 * clean and organized */
 	struct obs_core_video           video;
 	struct obs_core_audio           audio;
 	struct obs_core_data            data;
 	struct obs_core_hotkeys         hotkeys;
+
+	struct obs_janitor              janitor;
 };
 
 extern struct obs_core *obs;
 
 extern void *obs_video_thread(void *param);
+extern void *obs_convert_thread(void *param);
+extern void *obs_tick_thread(void *param);
+
+/* returns the GPU scaled video output for the given size, creating it if
+ * needed.  each call must be paired with obs_release_scaled_video */
+extern video_t *obs_acquire_scaled_video(uint32_t width, uint32_t height);
+extern void obs_release_scaled_video(video_t *video);
 
 
 /* ------------------------------------------------------------------------- */
@@ -396,8 +804,24 @@ struct obs_context_data {
 	pthread_mutex_t                 *mutex;
 	struct obs_context_data         *next;
 	struct obs_context_data         **prev_next;
+
+	int                             mem_tag;
+	gs_memory_tracker_t             *vram_tracker;
 };
 
+/* makes a plugin callback of a context, charging whatever it allocates on
+ * this thread to the module that registered the context's type, and any
+ * graphics resources it creates to the context itself */
+#define CONTEXT_CALL(context, call)                                       \
+	do {                                                              \
+		int prev_tag_ = bmem_set_thread_tag((context)->mem_tag);  \
+		gs_memory_tracker_t *prev_vram_ =                         \
+			gs_set_memory_tracker((context)->vram_tracker);   \
+		call;                                                     \
+		gs_set_memory_tracker(prev_vram_);                        \
+		bmem_set_thread_tag(prev_tag_);                           \
+	} while (false)
+
 extern bool obs_context_data_init(
 		struct obs_context_data *context,
 		obs_data_t              *settings,
@@ -412,6 +836,12 @@ extern void obs_context_data_remove(struct obs_context_data *context);
 extern void obs_context_data_setname(struct obs_context_data *context,
 		const char *name);
 
+extern void obs_source_snapshot_update(void);
+extern struct obs_source_snapshot *obs_source_walk_begin(void);
+extern void obs_source_walk_end(void);
+extern bool obs_source_walk_defer_destroy(struct obs_source *source);
+extern void obs_source_walk_wait(void);
+
 
 /* ------------------------------------------------------------------------- */
 /* ref-counting  */
@@ -464,6 +894,17 @@ struct async_frame {
 	bool used;
 };
 
+/* audio waiting for its filters to be run on the task pool, must be a power
+ * of two */
+#define AUDIO_DSP_QUEUE_SIZE 16
+#define AUDIO_DSP_QUEUE_MASK (AUDIO_DSP_QUEUE_SIZE - 1)
+
+struct audio_dsp_packet {
+	struct obs_source_audio audio;
+	DARRAY(uint8_t)         data[MAX_AV_PLANES];
+	uint64_t                queued_time;
+};
+
 struct obs_weak_source {
 	struct obs_weak_ref ref;
 	struct obs_source *source;
@@ -484,19 +925,44 @@ struct obs_source {
 	/* signals to call the source update in the video thread */
 	bool                            defer_update;
 
+	/* tracks whether the video of the source changed since the last
+	 * tick.  video_changes is incremented for any change made outside of
+	 * the video thread, and compared against on each tick */
+	volatile long                   video_changes;
+	long                            last_video_changes;
+	bool                            video_dirty;
+
+	/* the source was suspended after not being used since last_used_time,
+	 * see obs_set_source_suspend_delay */
+	uint64_t                        last_used_time;
+	bool                            suspended;
+
+	/* changed to a new value of obs->data.save_generation whenever
+	 * something obs_save_source writes out changes, so a saved copy can
+	 * be reused while the generation stays the same */
+	volatile long                   save_generation;
+
 	/* ensures show/hide are only called once */
 	volatile long                   show_refs;
 
 	/* ensures activate/deactivate are only called once */
 	volatile long                   activate_refs;
 
+	/* ensures prepare/unprepare are only called once, see
+	 * obs_source_prepare */
+	volatile long                   prepare_refs;
+
 	/* used to indicate that the source has been removed and all
 	 * references to it should be released (not exactly how I would prefer
 	 * to handle things but it's the best option) */
 	bool                            removed;
 
+	/* destroyed during a source walk, destruction waits for it to end */
+	volatile bool                   destroy_pending;
+
 	bool                            active;
 	bool                            showing;
+	bool                            prepared;
 
 	/* used to temporarily disable sources if needed */
 	bool                            enabled;
@@ -518,13 +984,43 @@ struct obs_source {
 	pthread_mutex_t                 audio_mutex;
 	struct obs_audio_data           audio_data;
 	size_t                          audio_storage_size;
+
+	/* buffer handed out by obs_source_audio_acquire, either a packet of
+	 * the audio line itself, or audio_pool when the audio still has to go
+	 * through filters or resampling */
+	struct obs_audio_data           acquired_audio;
+	bool                            audio_acquired;
+	bool                            audio_acquired_line;
+	DARRAY(uint8_t)                 audio_pool[MAX_AV_PLANES];
+
+	/* with OBS_SOURCE_FLAG_OFFLOAD_AUDIO_FILTERS audio is queued here and
+	 * filtered on the task pool, one task per source at a time so the
+	 * filters still see the audio in order.  guarded by audio_dsp_mutex */
+	pthread_mutex_t                 audio_dsp_mutex;
+	struct audio_dsp_packet         audio_dsp_queue[AUDIO_DSP_QUEUE_SIZE];
+	size_t                          audio_dsp_read;
+	size_t                          audio_dsp_count;
+	bool                            audio_dsp_scheduled;
+	bool                            audio_dsp_queue_full;
+	uint64_t                        audio_dsp_latency;
+	uint64_t                        audio_dsp_max_latency;
+	uint32_t                        audio_dsp_dropped;
+
 	float                           base_volume;
 	float                           user_volume;
 	float                           present_volume;
 	int64_t                         sync_offset;
 
+	/* signals fired on every audio packet, resolved once at creation */
+	signal_t                        *audio_data_signal;
+	signal_t                        *volume_signal;
+
 	/* async video data */
 	gs_texture_t                    *async_texture;
+	gs_texture_t                    *async_textures[MAX_ASYNC_UPLOADS];
+	uint32_t                        async_upload_count;
+	uint32_t                        async_upload_idx;
+	uint32_t                        async_uploads;
 	gs_texrender_t                  *async_convert_texrender;
 	struct obs_source_frame         *cur_async_frame;
 	bool                            async_gpu_conversion;
@@ -540,6 +1036,15 @@ struct obs_source {
 	bool                            async_active;
 	DARRAY(struct async_frame)      async_cache;
 	DARRAY(struct obs_source_frame*)async_frames;
+
+	/* arrival jitter of queued frames, which decides how many frames are
+	 * held back before presenting, see queue_async_frame */
+	uint64_t                        async_last_arrival;
+	uint64_t                        async_last_queued_ts;
+	uint64_t                        async_frame_interval;
+	uint64_t                        async_jitter;
+	uint32_t                        async_jitter_depth;
+	uint64_t                        async_excess_start;
 	pthread_mutex_t                 async_mutex;
 	uint32_t                        async_width;
 	uint32_t                        async_height;
@@ -551,12 +1056,29 @@ struct obs_source {
 	/* filters */
 	struct obs_source               *filter_parent;
 	struct obs_source               *filter_target;
-	DARRAY(struct obs_source*)      filters;
+	DARRAY_SMALL(struct obs_source*, 4) filters;
 	pthread_mutex_t                 filter_mutex;
 	gs_texrender_t                  *filter_texrender;
 	enum obs_allow_direct_render    allow_direct;
 	bool                            rendering_filter;
 
+	/* per-frame render cache */
+	bool                            render_cache;
+	bool                            rendering_cache;
+	gs_texrender_t                  *cache_texrender;
+
+	/* every pixel is drawn with full alpha, used for scene occlusion */
+	volatile bool                   opaque;
+
+	/* effect for a run of fused filters starting at this filter */
+	gs_effect_t                     *fused_effect;
+	struct dstr                     fused_key;
+	bool                            fused_failed;
+
+	/* profiler name for GPU timing, made from context.name */
+	const char                      *gpu_timing_name;
+	const char                      *gpu_timing_name_src;
+
 	/* sources specific hotkeys */
 	obs_hotkey_pair_id              mute_unmute_key;
 	obs_hotkey_id                   push_to_mute_key;
@@ -580,6 +1102,7 @@ extern bool obs_source_init(struct obs_source *source,
 		const struct obs_source_info *info);
 
 extern void obs_source_destroy(struct obs_source *source);
+extern void obs_source_teardown(struct obs_source *source);
 
 enum view_type {
 	MAIN_VIEW,
@@ -589,6 +1112,12 @@ enum view_type {
 extern void obs_source_activate(obs_source_t *source, enum view_type type);
 extern void obs_source_deactivate(obs_source_t *source, enum view_type type);
 extern void obs_source_video_tick(obs_source_t *source, float seconds);
+
+/* everything obs_source_video_tick does except calling the source's own
+ * video_tick callback */
+extern void obs_source_video_tick_state(obs_source_t *source);
+extern void obs_source_mark_video_changed(obs_source_t *source);
+extern void obs_source_mark_save_changed(obs_source_t *source);
 extern float obs_source_get_target_volume(obs_source_t *source,
 		obs_source_t *target);
 
@@ -606,10 +1135,31 @@ struct delay_data {
 	enum delay_msg msg;
 	uint64_t ts;
 	struct encoder_packet packet;
+	bool spilled;
+	uint64_t spill_offset;
 };
 
 typedef void (*encoded_callback_t)(void *data, struct encoder_packet *packet);
 
+/*
+ * Packets waiting to be interleaved are kept in one FIFO per stream (video
+ * plus each audio track), each of which is already in DTS order.  Sending
+ * merges them by picking the stream head with the lowest DTS, with ties
+ * broken by arrival order.
+ */
+#define INTERLEAVE_VIDEO_STREAM 0
+#define INTERLEAVE_STREAMS      (MAX_AUDIO_MIXES + 1)
+
+struct interleaved_packet {
+	struct encoder_packet           packet;
+	uint64_t                        order;
+};
+
+struct interleave_stream {
+	DARRAY_SMALL(struct interleaved_packet, 4) packets;
+	size_t                          head;
+};
+
 struct obs_weak_output {
 	struct obs_weak_ref ref;
 	struct obs_output *output;
@@ -630,7 +1180,25 @@ struct obs_output {
 	int64_t                         highest_audio_ts;
 	int64_t                         highest_video_ts;
 	pthread_mutex_t                 interleaved_mutex;
-	DARRAY(struct encoder_packet)   interleaved_packets;
+
+	/* video latency sums, see obs_output_get_latency */
+	pthread_mutex_t                 latency_mutex;
+	uint64_t                        latency_frames;
+	uint64_t                        latency_sent_frames;
+	uint64_t                        latency_render_sum;
+	uint64_t                        latency_queue_sum;
+	uint64_t                        latency_encode_sum;
+	uint64_t                        latency_interleave_sum;
+	uint64_t                        latency_send_sum;
+	uint64_t                        latency_total_sum;
+	uint64_t                        latency_sent_total_sum;
+	uint64_t                        latency_max_total;
+	uint64_t                        latency_max_sent_total;
+
+	struct interleave_stream        interleaved_streams[
+		INTERLEAVE_STREAMS];
+	size_t                          interleaved_count;
+	uint64_t                        interleaved_order;
 
 	int                             reconnect_retry_sec;
 	int                             reconnect_retry_max;
@@ -641,8 +1209,48 @@ struct obs_output {
 	os_event_t                      *reconnect_stop_event;
 	volatile bool                   reconnect_thread_active;
 
+	/* without a delay, the encoders keep running while reconnecting and
+	 * the packets since the latest video keyframe are held here, so the
+	 * new connection can start from them right away instead of waiting
+	 * for the encoders to restart.  guarded by hold_mutex */
+	pthread_mutex_t                 hold_mutex;
+	struct circlebuf                hold_packets; /* encoder_packet */
+	bool                            holding;
+	bool                            hold_wait_keyframe;
+	bool                            hold_resume;
+
+	/* encoded packets are queued here by the encoder threads and handed
+	 * to the output on its own delivery thread, so that a slow output
+	 * never holds up an encoder.  the encoder threads are serialized with
+	 * inbound_push_mutex, the delivery thread pops without a lock */
+	struct ringbuf                  inbound; /* struct inbound_packet */
+	pthread_mutex_t                 inbound_push_mutex;
+	os_sem_t                        *inbound_sem;
+	os_event_t                      *inbound_space_event;
+	os_event_t                      *inbound_drained_event;
+	pthread_t                       inbound_thread;
+	bool                            inbound_thread_active;
+	volatile bool                   inbound_stop;
+	volatile bool                   inbound_closing;
+	volatile long                   inbound_gen;
+	volatile long                   inbound_queued;
+	volatile long                   inbound_delivered;
+	encoded_callback_t              inbound_callback;
+	enum obs_output_queue_policy    inbound_policy;
+	size_t                          inbound_capacity;
+	bool                            inbound_wait_keyframe;
+
+	/* packet queue stats since the last start, guarded by
+	 * inbound_stats_mutex */
+	pthread_mutex_t                 inbound_stats_mutex;
+	uint64_t                        inbound_packets;
+	uint64_t                        inbound_dropped;
+	uint64_t                        inbound_blocked_ns;
+	size_t                          inbound_max_depth;
+
 	uint32_t                        starting_frame_count;
 	uint32_t                        starting_skipped_frame_count;
+	uint32_t                        starting_duplicated_frame_count;
 
 	int                             total_frames;
 
@@ -669,6 +1277,12 @@ struct obs_output {
 	encoded_callback_t              delay_callback;
 	struct circlebuf                delay_data; /* struct delay_data */
 	pthread_mutex_t                 delay_mutex;
+	struct circlebuf                delay_spill; /* struct delay_data */
+	FILE                            *delay_spill_file;
+	uint64_t                        delay_spill_size;
+	uint64_t                        delay_spill_read;
+	uint64_t                        delay_spill_write;
+	bool                            delay_spill_wrapped;
 	uint32_t                        delay_sec;
 	uint32_t                        delay_flags;
 	uint32_t                        delay_cur_flags;
@@ -688,6 +1302,7 @@ static inline void do_output_signal(struct obs_output *output,
 
 extern void process_delay(void *data, struct encoder_packet *packet);
 extern void obs_output_cleanup_delay(obs_output_t *output);
+extern void obs_output_delay_spill_start(obs_output_t *output);
 extern bool obs_output_delay_start(obs_output_t *output);
 extern void obs_output_delay_stop(obs_output_t *output);
 extern bool obs_output_actual_start(obs_output_t *output);
@@ -709,12 +1324,67 @@ struct obs_weak_encoder {
 	struct obs_encoder *encoder;
 };
 
+/*
+ * Refcounted encoder packet data.  The AVCC conversion used by the FLV based
+ * outputs is cached here the first time it's requested so that every output
+ * sharing the packet doesn't have to parse it again.
+ */
+struct encoder_packet_buffer {
+	volatile long                   refs;
+	uint8_t                         *data;
+
+	volatile long                   avc_state;
+	struct encoder_packet_buffer    *avc;
+	size_t                          avc_size;
+	int                             avc_priority;
+	bool                            avc_keyframe;
+};
+
+enum {
+	PACKET_AVC_NONE,
+	PACKET_AVC_PARSING,
+	PACKET_AVC_READY
+};
+
+extern struct encoder_packet_buffer *encoder_packet_buffer_create(
+		uint8_t *data);
+
 struct encoder_callback {
 	bool sent_first_packet;
 	void (*new_packet)(void *param, struct encoder_packet *packet);
 	void *param;
 };
 
+/* a frame waiting to be encoded on the encoder's thread.  the data is copied
+ * out of the video/audio thread's buffers into memory owned by the slot */
+struct obs_encoder_group {
+	/* held by the group's creator and each of its encoders */
+	volatile long                   refs;
+
+	uint32_t                        keyint;
+
+	/* timestamp of the frame the group started at, and how many of its
+	 * encoders are running, guarded by mutex */
+	pthread_mutex_t                 mutex;
+	uint64_t                        start_ts;
+	size_t                          active;
+};
+
+struct encoder_queued_frame {
+	uint8_t                         *data[MAX_AV_PLANES];
+	uint32_t                        linesize[MAX_AV_PLANES];
+	uint8_t                         *buffer;
+	size_t                          capacity;
+
+	/* set instead of copying when the video frame is in a pooled buffer */
+	struct video_frame_buffer       *ref;
+
+	uint32_t                        frames;
+	int64_t                         pts;
+	bool                            duplicate;
+	bool                            force_keyframe;
+};
+
 struct obs_encoder {
 	struct obs_context_data         context;
 	struct obs_encoder_info         info;
@@ -732,6 +1402,12 @@ struct obs_encoder {
 	uint32_t                        scaled_height;
 	enum video_format               preferred_format;
 
+	/* packet priorities are set from the NAL headers for H.264 */
+	bool                            is_avc;
+
+	/* GPU scaled video output used instead of media when scaling */
+	video_t                         *scaled_video;
+
 	bool                            active;
 
 	/* indicates ownership of the info.id buffer */
@@ -740,9 +1416,18 @@ struct obs_encoder {
 	uint32_t                        timebase_num;
 	uint32_t                        timebase_den;
 
+	/* video encoders only take every frame_rate_divisor-th frame */
+	uint32_t                        frame_rate_divisor;
+
+	/* stage times of recent video frames, by pts, to match them up with
+	 * the packets coming out of the encoder */
+	struct encoder_frame_timing     frame_timing[FRAME_TIMING_SLOTS];
+	int64_t                         frame_timing_pts[FRAME_TIMING_SLOTS];
+	bool                            latency_sei;
+
 	int64_t                         cur_pts;
 
-	struct circlebuf                audio_input_buffer[MAX_AV_PLANES];
+	struct ringbuf                  audio_input_buffer[MAX_AV_PLANES];
 	uint8_t                         *audio_output_buffer[MAX_AV_PLANES];
 
 	/* if a video encoder is paired with an audio encoder, make it start
@@ -762,9 +1447,69 @@ struct obs_encoder {
 	void                            *media;
 
 	pthread_mutex_t                 callbacks_mutex;
-	DARRAY(struct encoder_callback) callbacks;
+	DARRAY_SMALL(struct encoder_callback, 4) callbacks;
+
+	/* an encoder started with the same settings, media and size as a
+	 * running one doesn't encode anything itself; it passes on the
+	 * packets of that encoder, its shared_source.  an encoder's followers
+	 * are guarded by its callbacks_mutex, and it keeps running as long as
+	 * it has any */
+	struct obs_encoder              *shared_source;
+	DARRAY(struct obs_encoder*)     shared_followers;
+
+	struct obs_encoder_group        *group;
 
 	const char                      *profile_encoder_encode_name;
+
+	/* frames are encoded on the encoder's own thread (or the audio
+	 * encoder pool) rather than on the video/audio thread, so encoders
+	 * don't serialize behind each other.  queue_count is the number of
+	 * filled slots starting at queue_read, all guarded by queue_mutex */
+	pthread_t                       thread;
+	bool                            thread_active;
+	bool                            thread_stop;
+
+	/* guarded by the pool's mutex */
+	bool                            pooled;
+	bool                            pool_scheduled;
+	bool                            pool_busy;
+
+	os_sem_t                        *queue_sem;
+	os_event_t                      *queue_space_event;
+	pthread_mutex_t                 queue_mutex;
+	struct encoder_queued_frame     *queue;
+	size_t                          queue_depth;
+	size_t                          queue_read;
+	size_t                          queue_count;
+	enum video_format               queue_format;
+	uint32_t                        queue_height;
+
+	/* set on the encoder thread, the encoder is then stopped from the
+	 * thread that feeds it */
+	volatile bool                   encode_failed;
+
+	bool                            overloaded;
+	uint32_t                        overloaded_frames;
+
+	/* with a variable framerate, video frames flagged as duplicates are
+	 * not encoded.  the pts still advances, so the next packet's
+	 * timestamp covers the held frames */
+	bool                            variable_framerate;
+	uint32_t                        held_frames;
+
+	/* encode times are kept as a log scale histogram of microseconds,
+	 * four buckets per doubling, which is halved every so often so that
+	 * it follows recent load.  all guarded by stats_mutex */
+	pthread_mutex_t                 stats_mutex;
+	uint32_t                        encode_times[ENCODE_TIME_BUCKETS];
+	uint32_t                        encode_time_samples;
+	uint64_t                        encode_time_max;
+	uint64_t                        frames_submitted;
+	uint64_t                        packets_received;
+	uint64_t                        bytes_out;
+	uint64_t                        bitrate_window_ts;
+	uint64_t                        bitrate_window_bytes;
+	uint64_t                        bitrate;
 };
 
 extern struct obs_encoder_info *find_encoder(const char *id);
@@ -785,6 +1530,7 @@ extern void obs_encoder_remove_output(struct obs_encoder *encoder,
 		struct obs_output *output);
 
 void obs_encoder_destroy(obs_encoder_t *encoder);
+extern void obs_encoder_teardown(struct obs_encoder *encoder);
 
 /* ------------------------------------------------------------------------- */
 /* services */
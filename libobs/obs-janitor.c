@@ -0,0 +1,228 @@
+/******************************************************************************
+    Copyright (C) 2013-2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "obs-internal.h"
+
+static const char *janitor_destroy_name = "obs_janitor_destroy";
+static const char *janitor_gs_flush_name = "obs_janitor_gs_flush";
+
+static void destroy_item(struct obs_destroy_item *item)
+{
+	switch (item->type) {
+	case OBS_DESTROY_SOURCE:
+		obs_source_teardown(item->object);
+		break;
+	case OBS_DESTROY_ENCODER:
+		obs_encoder_teardown(item->object);
+		break;
+	}
+}
+
+/* destroys everything queued so far, returns false if nothing was queued */
+static bool destroy_queued(struct obs_janitor *janitor)
+{
+	DARRAY(struct obs_destroy_item) items;
+
+	da_init(items);
+
+	pthread_mutex_lock(&janitor->mutex);
+	da_move(items, janitor->queue);
+	pthread_mutex_unlock(&janitor->mutex);
+
+	if (!items.num)
+		return false;
+
+	profile_start(janitor_destroy_name);
+	for (size_t i = 0; i < items.num; i++)
+		destroy_item(items.array + i);
+	profile_end(janitor_destroy_name);
+
+	da_free(items);
+	return true;
+}
+
+static void *janitor_thread(void *param)
+{
+	struct obs_janitor *janitor = param;
+
+	os_set_thread_name("libobs: janitor thread");
+
+	while (os_sem_wait(janitor->sem) == 0) {
+		/* more can be queued while destroying */
+		while (destroy_queued(janitor))
+			;
+
+		if (janitor->stop)
+			break;
+	}
+
+	return NULL;
+}
+
+bool obs_janitor_init(struct obs_janitor *janitor)
+{
+	pthread_mutex_init_value(&janitor->mutex);
+	pthread_mutex_init_value(&janitor->gs_mutex);
+
+	if (pthread_mutex_init(&janitor->mutex, NULL) != 0)
+		return false;
+	if (pthread_mutex_init(&janitor->gs_mutex, NULL) != 0)
+		return false;
+	if (os_sem_init(&janitor->sem, 0) != 0)
+		return false;
+	if (pthread_create(&janitor->thread, NULL, janitor_thread,
+				janitor) != 0)
+		return false;
+
+	janitor->thread_initialized = true;
+	return true;
+}
+
+/* destroys whatever is still queued before the thread exits, anything
+ * released afterwards is destroyed by the thread that releases it */
+void obs_janitor_stop(struct obs_janitor *janitor)
+{
+	if (janitor->thread_initialized) {
+		pthread_mutex_lock(&janitor->mutex);
+		janitor->stop = true;
+		os_sem_post(janitor->sem);
+		pthread_mutex_unlock(&janitor->mutex);
+
+		pthread_join(janitor->thread, NULL);
+		janitor->thread_initialized = false;
+	}
+}
+
+void obs_janitor_free(struct obs_janitor *janitor)
+{
+	obs_janitor_stop(janitor);
+
+	da_free(janitor->queue);
+	da_free(janitor->gs_frees);
+	os_sem_destroy(janitor->sem);
+	pthread_mutex_destroy(&janitor->mutex);
+	pthread_mutex_destroy(&janitor->gs_mutex);
+	janitor->sem = NULL;
+}
+
+bool obs_janitor_queue(enum obs_destroy_type type, void *object)
+{
+	struct obs_janitor *janitor = &obs->janitor;
+	struct obs_destroy_item item = {type, object};
+	bool queued = false;
+
+	pthread_mutex_lock(&janitor->mutex);
+
+	/* the post is made under the mutex, so the semaphore can't be
+	 * destroyed under it */
+	if (janitor->thread_initialized && !janitor->stop &&
+	    !pthread_equal(pthread_self(), janitor->thread)) {
+		da_push_back(janitor->queue, &item);
+		os_sem_post(janitor->sem);
+		queued = true;
+	}
+
+	pthread_mutex_unlock(&janitor->mutex);
+	return queued;
+}
+
+/* ------------------------------------------------------------------------- */
+/* graphics objects */
+
+static void gs_free_item(struct obs_gs_free *item)
+{
+	switch (item->type) {
+	case OBS_GS_FREE_TEXTURE:
+		gs_texture_destroy(item->object);
+		break;
+	case OBS_GS_FREE_TEXRENDER:
+		gs_texrender_destroy(item->object);
+		break;
+	case OBS_GS_FREE_EFFECT:
+		gs_effect_destroy(item->object);
+		break;
+	}
+}
+
+void obs_janitor_gs_free(enum obs_gs_free_type type, void *object)
+{
+	struct obs_janitor *janitor = &obs->janitor;
+	struct obs_gs_free item = {type, object};
+	bool queued = false;
+
+	if (!object)
+		return;
+
+	pthread_mutex_lock(&janitor->gs_mutex);
+	if (janitor->gs_thread_active) {
+		da_push_back(janitor->gs_frees, &item);
+		queued = true;
+	}
+	pthread_mutex_unlock(&janitor->gs_mutex);
+
+	if (!queued) {
+		gs_enter_context(obs->video.graphics);
+		gs_free_item(&item);
+		gs_leave_context();
+	}
+}
+
+void obs_janitor_gs_begin(void)
+{
+	struct obs_janitor *janitor = &obs->janitor;
+
+	pthread_mutex_lock(&janitor->gs_mutex);
+	janitor->gs_thread_active = true;
+	pthread_mutex_unlock(&janitor->gs_mutex);
+}
+
+void obs_janitor_gs_flush(void)
+{
+	struct obs_janitor *janitor = &obs->janitor;
+	DARRAY(struct obs_gs_free) items;
+
+	da_init(items);
+
+	pthread_mutex_lock(&janitor->gs_mutex);
+	da_move(items, janitor->gs_frees);
+	pthread_mutex_unlock(&janitor->gs_mutex);
+
+	if (!items.num)
+		return;
+
+	profile_start(janitor_gs_flush_name);
+	gs_enter_context(obs->video.graphics);
+
+	for (size_t i = 0; i < items.num; i++)
+		gs_free_item(items.array + i);
+
+	gs_leave_context();
+	profile_end(janitor_gs_flush_name);
+
+	da_free(items);
+}
+
+void obs_janitor_gs_end(void)
+{
+	struct obs_janitor *janitor = &obs->janitor;
+
+	pthread_mutex_lock(&janitor->gs_mutex);
+	janitor->gs_thread_active = false;
+	pthread_mutex_unlock(&janitor->gs_mutex);
+
+	obs_janitor_gs_flush();
+}
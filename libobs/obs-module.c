@@ -16,6 +16,7 @@
 ******************************************************************************/
 
 #include "util/platform.h"
+#include "util/threading.h"
 #include "util/dstr.h"
 
 #include "obs-defs.h"
@@ -75,6 +76,44 @@ static inline char *get_module_name(const char *file)
 extern void reset_win32_symbol_paths(void);
 #endif
 
+static int open_module_image(struct obs_module *mod, const char *path)
+{
+	int errorcode;
+
+	mod->module = os_dlopen(path);
+	if (!mod->module) {
+		blog(LOG_WARNING, "Module '%s' not found", path);
+		return MODULE_FILE_NOT_FOUND;
+	}
+
+	errorcode = load_module_exports(mod, path);
+	if (errorcode != MODULE_SUCCESS)
+		mod->module = NULL;
+	return errorcode;
+}
+
+static inline void init_module_paths(struct obs_module *mod,
+		const char *path, const char *data_path)
+{
+	mod->bin_path  = bstrdup(path);
+	mod->file      = strrchr(mod->bin_path, '/');
+	mod->file      = (!mod->file) ? mod->bin_path : (mod->file + 1);
+	mod->mod_name  = get_module_name(mod->file);
+	mod->data_path = bstrdup(data_path);
+	mod->mem_tag   = bmem_register_tag(mod->mod_name);
+}
+
+static void set_module_pointer(struct obs_module *mod)
+{
+	mod->set_pointer(mod);
+
+	if (mod->set_locale) {
+		int prev_tag = bmem_set_thread_tag(mod->mem_tag);
+		mod->set_locale(obs->locale);
+		bmem_set_thread_tag(prev_tag);
+	}
+}
+
 int obs_open_module(obs_module_t **module, const char *path,
 		const char *data_path)
 {
@@ -86,22 +125,12 @@ int obs_open_module(obs_module_t **module, const char *path,
 
 	blog(LOG_INFO, "---------------------------------");
 
-	mod.module = os_dlopen(path);
-	if (!mod.module) {
-		blog(LOG_WARNING, "Module '%s' not found", path);
-		return MODULE_FILE_NOT_FOUND;
-	}
-
-	errorcode = load_module_exports(&mod, path);
+	errorcode = open_module_image(&mod, path);
 	if (errorcode != MODULE_SUCCESS)
 		return errorcode;
 
-	mod.bin_path  = bstrdup(path);
-	mod.file      = strrchr(mod.bin_path, '/');
-	mod.file      = (!mod.file) ? mod.bin_path : (mod.file + 1);
-	mod.mod_name  = get_module_name(mod.file);
-	mod.data_path = bstrdup(data_path);
-	mod.next      = obs->first_module;
+	init_module_paths(&mod, path, data_path);
+	mod.next = obs->first_module;
 
 	if (mod.file) {
 		blog(LOG_INFO, "Loading module: %s", mod.file);
@@ -109,14 +138,46 @@ int obs_open_module(obs_module_t **module, const char *path,
 
 	*module = bmemdup(&mod, sizeof(mod));
 	obs->first_module = (*module);
-	mod.set_pointer(*module);
-
-	if (mod.set_locale)
-		mod.set_locale(obs->locale);
+	set_module_pointer(*module);
 
 	return MODULE_SUCCESS;
 }
 
+static void free_type_ids(struct obs_module *mod)
+{
+	for (size_t i = 0; i < mod->type_ids.num; i++)
+		bfree(mod->type_ids.array[i]);
+	da_resize(mod->type_ids, 0);
+}
+
+struct type_counts {
+	size_t count[6];
+};
+
+#define TYPE_LISTS(x) \
+	x(0, input_types) x(1, filter_types) x(2, transition_types) \
+	x(3, output_types) x(4, encoder_types) x(5, service_types)
+
+static inline void get_type_counts(struct type_counts *counts)
+{
+#define GET_COUNT(idx, list) counts->count[idx] = obs->list.num;
+	TYPE_LISTS(GET_COUNT)
+#undef GET_COUNT
+}
+
+/* remembers the types a module registered, for the manifest */
+static void add_new_type_ids(struct obs_module *module,
+		const struct type_counts *prev)
+{
+#define ADD_IDS(idx, list) \
+	for (size_t i = prev->count[idx]; i < obs->list.num; i++) { \
+		char *id = bstrdup(obs->list.array[i].id); \
+		da_push_back(module->type_ids, &id); \
+	}
+	TYPE_LISTS(ADD_IDS)
+#undef ADD_IDS
+}
+
 bool obs_init_module(obs_module_t *module)
 {
 	if (!module || !obs)
@@ -129,7 +190,17 @@ bool obs_init_module(obs_module_t *module)
 				"obs_init_module(%s)", module->file);
 	profile_start(profile_name);
 
+	struct type_counts counts;
+	get_type_counts(&counts);
+
+	/* types registered while loading remember the tag, see
+	 * register_type_mem_tag */
+	int prev_tag = bmem_set_thread_tag(module->mem_tag);
 	module->loaded = module->load();
+	bmem_set_thread_tag(prev_tag);
+
+	add_new_type_ids(module, &counts);
+
 	if (!module->loaded)
 		blog(LOG_WARNING, "Failed to initialize module '%s'",
 				module->file);
@@ -213,11 +284,240 @@ void obs_add_module_path(const char *bin, const char *data)
 	da_push_back(obs->module_paths, &omp);
 }
 
+/* ------------------------------------------------------------------------- */
+/*
+ *   Module manifest, lists the types each deferrable module registered the
+ * last time it was loaded:
+ *
+ *   {
+ *       "api_version": LIBOBS_API_VER,
+ *       "modules": [
+ *           {"path": "...", "size": 1234, "types": [{"id": "..."}, ...]}
+ *       ]
+ *   }
+ *
+ *   An entry only applies while the binary at that path keeps the same size,
+ *   otherwise the module is loaded normally and its entry is refreshed.
+ */
+
+static int64_t get_file_size(const char *path)
+{
+	FILE *file = os_fopen(path, "rb");
+	int64_t size;
+
+	if (!file)
+		return -1;
+
+	size = os_fgetsize(file);
+	fclose(file);
+	return size;
+}
+
+static obs_data_t *find_manifest_entry(obs_data_t *manifest,
+		const char *path)
+{
+	obs_data_array_t *modules;
+	obs_data_t *entry = NULL;
+	size_t count;
+
+	if (!manifest)
+		return NULL;
+
+	modules = obs_data_get_array(manifest, "modules");
+	count   = obs_data_array_count(modules);
+
+	for (size_t i = 0; i < count && !entry; i++) {
+		obs_data_t *item = obs_data_array_item(modules, i);
+
+		if (strcmp(obs_data_get_string(item, "path"), path) == 0)
+			entry = item;
+		else
+			obs_data_release(item);
+	}
+
+	obs_data_array_release(modules);
+	return entry;
+}
+
+static bool defer_module(obs_data_t *manifest,
+		const struct obs_module_info *info)
+{
+	obs_data_t *entry = find_manifest_entry(manifest, info->bin_path);
+	obs_data_array_t *types;
+	struct obs_module *mod;
+	size_t count;
+
+	if (!entry)
+		return false;
+
+	types = obs_data_get_array(entry, "types");
+	count = obs_data_array_count(types);
+
+	if (!count || obs_data_get_int(entry, "size") !=
+			get_file_size(info->bin_path)) {
+		obs_data_array_release(types);
+		obs_data_release(entry);
+		return false;
+	}
+
+	mod = bzalloc(sizeof(struct obs_module));
+	init_module_paths(mod, info->bin_path, info->data_path);
+	mod->deferred = true;
+
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t *type = obs_data_array_item(types, i);
+		char *id = bstrdup(obs_data_get_string(type, "id"));
+
+		da_push_back(mod->type_ids, &id);
+		obs_data_release(type);
+	}
+
+	mod->next = obs->first_module;
+	obs->first_module = mod;
+	os_atomic_inc_long(&obs->deferred_modules);
+
+	obs_data_array_release(types);
+	obs_data_release(entry);
+	return true;
+}
+
+static void save_manifest(const char *manifest_file)
+{
+	obs_data_t *manifest = obs_data_create();
+	obs_data_array_t *modules = obs_data_array_create();
+
+	for (struct obs_module *mod = obs->first_module; mod; mod = mod->next) {
+		obs_data_array_t *types;
+		obs_data_t *entry;
+		bool deferrable = mod->deferred;
+
+		if (!deferrable && mod->loaded && mod->module)
+			deferrable = os_dlsym(mod->module,
+					"obs_module_deferrable") != NULL;
+		if (!deferrable || !mod->type_ids.num)
+			continue;
+
+		entry = obs_data_create();
+		types = obs_data_array_create();
+
+		for (size_t i = 0; i < mod->type_ids.num; i++) {
+			obs_data_t *type = obs_data_create();
+			obs_data_set_string(type, "id", mod->type_ids.array[i]);
+			obs_data_array_push_back(types, type);
+			obs_data_release(type);
+		}
+
+		obs_data_set_string(entry, "path", mod->bin_path);
+		obs_data_set_int(entry, "size", get_file_size(mod->bin_path));
+		obs_data_set_array(entry, "types", types);
+		obs_data_array_push_back(modules, entry);
+
+		obs_data_array_release(types);
+		obs_data_release(entry);
+	}
+
+	obs_data_set_int(manifest, "api_version", LIBOBS_API_VER);
+	obs_data_set_array(manifest, "modules", modules);
+
+	if (!obs_data_save_json_safe(manifest, manifest_file, "tmp", NULL))
+		blog(LOG_WARNING, "Failed to save module manifest '%s'",
+				manifest_file);
+
+	obs_data_array_release(modules);
+	obs_data_release(manifest);
+}
+
+static bool load_deferred_module(struct obs_module *mod)
+{
+	uint64_t start = os_gettime_ns();
+	int code;
+
+	mod->deferred = false;
+	os_atomic_dec_long(&obs->deferred_modules);
+
+	free_type_ids(mod);
+
+	code = open_module_image(mod, mod->bin_path);
+	if (code != MODULE_SUCCESS) {
+		blog(LOG_WARNING, "Failed to load deferred module '%s': %d",
+				mod->file, code);
+		return false;
+	}
+
+	set_module_pointer(mod);
+	obs_init_module(mod);
+
+	mod->load_time_ns = os_gettime_ns() - start;
+	blog(LOG_INFO, "Loaded deferred module '%s' in %.1f ms", mod->file,
+			(double)mod->load_time_ns / 1000000.0);
+	return mod->loaded;
+}
+
+static inline bool module_has_type(struct obs_module *mod, const char *id)
+{
+	for (size_t i = 0; i < mod->type_ids.num; i++)
+		if (strcmp(mod->type_ids.array[i], id) == 0)
+			return true;
+	return false;
+}
+
+bool obs_load_deferred_type(const char *id)
+{
+	struct obs_module *mod;
+	bool success = false;
+
+	if (!obs || !id || !os_atomic_load_long(&obs->deferred_modules))
+		return false;
+
+	pthread_mutex_lock(&obs->module_mutex);
+
+	for (mod = obs->first_module; mod; mod = mod->next) {
+		if (mod->deferred && module_has_type(mod, id)) {
+			success = load_deferred_module(mod);
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&obs->module_mutex);
+	return success;
+}
+
+void obs_load_deferred_modules(void)
+{
+	if (!obs || !os_atomic_load_long(&obs->deferred_modules))
+		return;
+
+	pthread_mutex_lock(&obs->module_mutex);
+
+	for (struct obs_module *mod = obs->first_module; mod; mod = mod->next)
+		if (mod->deferred)
+			load_deferred_module(mod);
+
+	pthread_mutex_unlock(&obs->module_mutex);
+}
+
+/* ------------------------------------------------------------------------- */
+
 static void load_all_callback(void *param, const struct obs_module_info *info)
 {
+	obs_data_t *manifest = param;
 	obs_module_t *module;
+	uint64_t start;
+
+	if (defer_module(manifest, info))
+		return;
 
+	start = os_gettime_ns();
+
+	const char *file = strrchr(info->bin_path, '/');
+	const char *profile_name =
+		profile_store_name(obs_get_profiler_name_store(),
+				"obs_open_module(%s)",
+				file ? file + 1 : info->bin_path);
+	profile_start(profile_name);
 	int code = obs_open_module(&module, info->bin_path, info->data_path);
+	profile_end(profile_name);
+
 	if (code != MODULE_SUCCESS) {
 		blog(LOG_DEBUG, "Failed to load module file '%s': %d",
 				info->bin_path, code);
@@ -225,8 +525,28 @@ static void load_all_callback(void *param, const struct obs_module_info *info)
 	}
 
 	obs_init_module(module);
+	module->load_time_ns = os_gettime_ns() - start;
+}
+
+static void log_module_load_times(uint64_t total_ns)
+{
+	size_t deferred = 0;
 
-	UNUSED_PARAMETER(param);
+	blog(LOG_INFO, "---------------------------------");
+	blog(LOG_INFO, "Module load times:");
+
+	for (struct obs_module *mod = obs->first_module; mod; mod = mod->next) {
+		if (mod->deferred) {
+			blog(LOG_INFO, "    %s: deferred", mod->file);
+			deferred++;
+		} else {
+			blog(LOG_INFO, "    %s: %.1f ms", mod->file,
+					(double)mod->load_time_ns / 1000000.0);
+		}
+	}
+
+	blog(LOG_INFO, "Loaded modules in %.1f ms, %u deferred",
+			(double)total_ns / 1000000.0, (unsigned)deferred);
 }
 
 static const char *obs_load_all_modules_name = "obs_load_all_modules";
@@ -234,16 +554,47 @@ static const char *obs_load_all_modules_name = "obs_load_all_modules";
 static const char *reset_win32_symbol_paths_name = "reset_win32_symbol_paths";
 #endif
 
-void obs_load_all_modules(void)
+static void load_all_modules(const char *manifest_file)
 {
+	obs_data_t *manifest = NULL;
+	uint64_t start = os_gettime_ns();
+
+	if (manifest_file && os_file_exists(manifest_file)) {
+		manifest = obs_data_create_from_json_file(manifest_file);
+
+		if (manifest && obs_data_get_int(manifest, "api_version") !=
+				LIBOBS_API_VER) {
+			obs_data_release(manifest);
+			manifest = NULL;
+		}
+	}
+
 	profile_start(obs_load_all_modules_name);
-	obs_find_modules(load_all_callback, NULL);
+	pthread_mutex_lock(&obs->module_mutex);
+	obs_find_modules(load_all_callback, manifest);
+	pthread_mutex_unlock(&obs->module_mutex);
 #ifdef _WIN32
 	profile_start(reset_win32_symbol_paths_name);
 	reset_win32_symbol_paths();
 	profile_end(reset_win32_symbol_paths_name);
 #endif
 	profile_end(obs_load_all_modules_name);
+
+	log_module_load_times(os_gettime_ns() - start);
+
+	if (manifest_file)
+		save_manifest(manifest_file);
+	obs_data_release(manifest);
+}
+
+void obs_load_all_modules(void)
+{
+	load_all_modules(NULL);
+}
+
+void obs_load_all_modules_deferred(const char *manifest_file)
+{
+	load_all_modules(manifest_file);
 }
 
 static inline void make_data_dir(struct dstr *parsed_data_dir,
@@ -413,23 +764,30 @@ void free_module(struct obs_module *mod)
 		return;
 
 	if (mod->module) {
+		int prev_tag = bmem_set_thread_tag(mod->mem_tag);
+
 		if (mod->free_locale)
 			mod->free_locale();
 
 		if (mod->loaded && mod->unload)
 			mod->unload();
 
+		bmem_set_thread_tag(prev_tag);
+
 		/* there is no real reason to close the dynamic libraries,
 		 * and sometimes this can cause issues. */
 		/* os_dlclose(mod->module); */
 	}
 
+	free_type_ids(mod);
+	da_free(mod->type_ids);
 	bfree(mod->mod_name);
 	bfree(mod->bin_path);
 	bfree(mod->data_path);
 	bfree(mod);
 }
 
+static const char *obs_module_load_locale_name = "obs_module_load_locale";
 lookup_t *obs_module_load_locale(obs_module_t *module,
 		const char *default_locale, const char *locale)
 {
@@ -441,13 +799,17 @@ lookup_t *obs_module_load_locale(obs_module_t *module,
 		return NULL;
 	}
 
+	profile_start(obs_module_load_locale_name);
+
 	dstr_copy(&str, "locale/");
 	dstr_cat(&str, default_locale);
 	dstr_cat(&str, ".ini");
 
+	/* modules look up most of their strings only when their properties
+	 * are shown, if at all, so the files aren't parsed until then */
 	char *file = obs_find_module_file(module, str.array);
 	if (file)
-		lookup = text_lookup_create(file);
+		lookup = text_lookup_create_deferred(file);
 
 	bfree(file);
 
@@ -466,16 +828,46 @@ lookup_t *obs_module_load_locale(obs_module_t *module,
 
 	file = obs_find_module_file(module, str.array);
 
-	if (!text_lookup_add(lookup, file))
+	if (!text_lookup_add_deferred(lookup, file))
 		blog(LOG_WARNING, "Failed to load '%s' text for module: '%s'",
 				locale, module->file);
 
 	bfree(file);
 cleanup:
 	dstr_free(&str);
+	profile_end(obs_module_load_locale_name);
 	return lookup;
 }
 
+/* types are registered from obs_module_load, which runs with the tag of the
+ * module that is being loaded */
+static void register_type_mem_tag(const char *id)
+{
+	struct obs_type_mem_tag *item;
+	int tag = bmem_get_thread_tag();
+
+	if (tag == BMEM_TAG_UNTAGGED)
+		return;
+
+	item = da_push_back_new(obs->type_mem_tags);
+	item->id  = id;
+	item->tag = tag;
+}
+
+int obs_get_type_mem_tag(const char *id)
+{
+	if (!obs || !id)
+		return BMEM_TAG_UNTAGGED;
+
+	for (size_t i = 0; i < obs->type_mem_tags.num; i++) {
+		struct obs_type_mem_tag *item = &obs->type_mem_tags.array[i];
+		if (strcmp(item->id, id) == 0)
+			return item->tag;
+	}
+
+	return BMEM_TAG_UNTAGGED;
+}
+
 #define REGISTER_OBS_DEF(size_var, structure, dest, info)                 \
 	do {                                                              \
 		struct structure data = {0};                              \
@@ -577,6 +969,7 @@ void obs_register_source_s(const struct obs_source_info *info, size_t size)
 	}
 
 	darray_push_back(sizeof(struct obs_source_info), array, &data);
+	register_type_mem_tag(info->id);
 	return;
 
 error:
@@ -613,6 +1006,7 @@ void obs_register_output_s(const struct obs_output_info *info, size_t size)
 #undef CHECK_REQUIRED_VAL_
 
 	REGISTER_OBS_DEF(size, obs_output_info, obs->output_types, info);
+	register_type_mem_tag(info->id);
 	return;
 
 error:
@@ -639,6 +1033,7 @@ void obs_register_encoder_s(const struct obs_encoder_info *info, size_t size)
 #undef CHECK_REQUIRED_VAL_
 
 	REGISTER_OBS_DEF(size, obs_encoder_info, obs->encoder_types, info);
+	register_type_mem_tag(info->id);
 	return;
 
 error:
@@ -661,6 +1056,7 @@ void obs_register_service_s(const struct obs_service_info *info, size_t size)
 #undef CHECK_REQUIRED_VAL_
 
 	REGISTER_OBS_DEF(size, obs_service_info, obs->service_types, info);
+	register_type_mem_tag(info->id);
 	return;
 
 error:
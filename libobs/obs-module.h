@@ -84,6 +84,15 @@ bool obs_module_load(void)
 	MODULE_EXPORT uint32_t obs_module_ver(void); \
 	uint32_t obs_module_ver(void) {return LIBOBS_API_VER;}
 
+/**
+ * Optional: Declares that the module only registers types in
+ * obs_module_load.  With obs_load_all_modules_deferred, libobs can then wait
+ * to open the module until one of its types is first used.
+ */
+#define OBS_MODULE_DEFERRABLE() \
+	MODULE_EXPORT bool obs_module_deferrable(void); \
+	bool obs_module_deferrable(void) {return true;}
+
 /**
  * Required: Called when the module is loaded.  Use this function to load all
  * the sources/encoders/outputs/services for your module, or anything else that
@@ -33,6 +33,13 @@
 #include "util/dstr.h"
 #include "obs-internal.h"
 
+#if HAVE_XINPUT2
+#include <X11/extensions/XInput2.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
+#endif
+
 const char *get_module_extension(void)
 {
 	return ".so";
@@ -780,6 +787,175 @@ bool obs_hotkeys_platform_is_pressed(obs_hotkeys_platform_t *context,
 	}
 }
 
+#if HAVE_XINPUT2
+
+/*
+ * XInput2 raw events are sent to the root window whichever window has focus,
+ * without grabbing anything away from other clients.  The listener has its
+ * own connection so that its events don't mix with the key state queries.
+ */
+struct obs_hotkeys_listener {
+	Display *display;
+	int     wake_pipe[2];
+};
+
+static bool select_raw_events(Display *display)
+{
+	unsigned char mask_bits[XIMaskLen(XI_LASTEVENT)] = {0};
+	XIEventMask mask;
+	int opcode, event, error;
+
+	/* raw events are only sent regardless of grabs since 2.1 */
+	int major = 2, minor = 1;
+
+	if (!XQueryExtension(display, "XInputExtension", &opcode, &event,
+				&error))
+		return false;
+	if (XIQueryVersion(display, &major, &minor) != Success)
+		return false;
+
+	XISetMask(mask_bits, XI_RawKeyPress);
+	XISetMask(mask_bits, XI_RawKeyRelease);
+	XISetMask(mask_bits, XI_RawButtonPress);
+	XISetMask(mask_bits, XI_RawButtonRelease);
+
+	mask.deviceid = XIAllMasterDevices;
+	mask.mask_len = sizeof(mask_bits);
+	mask.mask     = mask_bits;
+
+	XISelectEvents(display, DefaultRootWindow(display), &mask, 1);
+	XFlush(display);
+	return true;
+}
+
+struct obs_hotkeys_listener *obs_hotkeys_platform_listen_init(void)
+{
+	struct obs_hotkeys_listener *listener;
+	Display *display = XOpenDisplay(NULL);
+
+	if (!display)
+		return NULL;
+
+	if (!select_raw_events(display)) {
+		blog(LOG_INFO, "hotkeys: XInput 2.1 not available");
+		XCloseDisplay(display);
+		return NULL;
+	}
+
+	listener = bzalloc(sizeof(struct obs_hotkeys_listener));
+	listener->display = display;
+
+	if (pipe(listener->wake_pipe) != 0) {
+		XCloseDisplay(display);
+		bfree(listener);
+		return NULL;
+	}
+
+	fcntl(listener->wake_pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(listener->wake_pipe[1], F_SETFL, O_NONBLOCK);
+	return listener;
+}
+
+void obs_hotkeys_platform_listen_free(struct obs_hotkeys_listener *listener)
+{
+	if (!listener)
+		return;
+
+	close(listener->wake_pipe[0]);
+	close(listener->wake_pipe[1]);
+	XCloseDisplay(listener->display);
+	bfree(listener);
+}
+
+/* only raw events were selected, so any generic event is input */
+static bool drain_events(Display *display)
+{
+	bool input = false;
+
+	while (XPending(display)) {
+		XEvent event;
+		XNextEvent(display, &event);
+
+		if (event.type == GenericEvent)
+			input = true;
+	}
+
+	return input;
+}
+
+static inline void drain_wake_pipe(int fd)
+{
+	char buf[16];
+	while (read(fd, buf, sizeof(buf)) > 0);
+}
+
+bool obs_hotkeys_platform_listen_wait(struct obs_hotkeys_listener *listener,
+		uint32_t timeout_ms)
+{
+	uint64_t end = os_gettime_ns() + timeout_ms * 1000000ULL;
+	struct pollfd fds[2] = {
+		{ConnectionNumber(listener->display), POLLIN, 0},
+		{listener->wake_pipe[0], POLLIN, 0}
+	};
+
+	if (drain_events(listener->display))
+		return true;
+
+	for (;;) {
+		uint64_t now = os_gettime_ns();
+		int ret;
+
+		if (now >= end)
+			return false;
+
+		ret = poll(fds, 2, (int)((end - now) / 1000000));
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return false;
+
+		if (fds[1].revents) {
+			drain_wake_pipe(listener->wake_pipe[0]);
+			return false;
+		}
+		if (drain_events(listener->display))
+			return true;
+	}
+}
+
+void obs_hotkeys_platform_listen_wake(struct obs_hotkeys_listener *listener)
+{
+	ssize_t ret = write(listener->wake_pipe[1], "", 1);
+	UNUSED_PARAMETER(ret);
+}
+
+#else
+
+struct obs_hotkeys_listener *obs_hotkeys_platform_listen_init(void)
+{
+	return NULL;
+}
+
+void obs_hotkeys_platform_listen_free(struct obs_hotkeys_listener *listener)
+{
+	UNUSED_PARAMETER(listener);
+}
+
+bool obs_hotkeys_platform_listen_wait(struct obs_hotkeys_listener *listener,
+		uint32_t timeout_ms)
+{
+	UNUSED_PARAMETER(listener);
+	UNUSED_PARAMETER(timeout_ms);
+	return false;
+}
+
+void obs_hotkeys_platform_listen_wake(struct obs_hotkeys_listener *listener)
+{
+	UNUSED_PARAMETER(listener);
+}
+
+#endif
+
 static bool get_key_translation(struct dstr *dstr, xcb_keycode_t keycode)
 {
 	xcb_connection_t *connection;
@@ -18,6 +18,157 @@
 #include <inttypes.h>
 #include "obs-internal.h"
 
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+/* spilled packets are read back into memory this long before they are due */
+#define SPILL_READAHEAD_NS 2000000000ULL
+
+#ifdef _WIN32
+static FILE *open_spill_file(void)
+{
+	wchar_t dir[MAX_PATH];
+	wchar_t path[MAX_PATH];
+
+	if (!GetTempPathW(MAX_PATH, dir))
+		return NULL;
+	if (!GetTempFileNameW(dir, L"obs", 0, path))
+		return NULL;
+
+	/* "D" deletes the file once it is closed */
+	return _wfopen(path, L"w+bD");
+}
+#else
+static FILE *open_spill_file(void)
+{
+	return tmpfile();
+}
+#endif
+
+void obs_output_delay_spill_start(obs_output_t *output)
+{
+	output->delay_spill_file    = open_spill_file();
+	output->delay_spill_size    = 0;
+	output->delay_spill_read    = 0;
+	output->delay_spill_write   = 0;
+	output->delay_spill_wrapped = false;
+
+	if (!output->delay_spill_file)
+		blog(LOG_WARNING, "Output '%s': Failed to create delay spill "
+		                  "file, keeping the delay in memory",
+		                  output->context.name);
+}
+
+/* the spill file is used as a ring: it grows until enough of its start has
+ * been read back, then writing wraps around behind the reader.  if the
+ * writer catches up with the reader the packet simply stays in memory */
+static bool spill_alloc(struct obs_output *output, size_t size,
+		uint64_t *offset)
+{
+	uint64_t read_pos  = output->delay_spill_read;
+	uint64_t write_pos = output->delay_spill_write;
+
+	if (output->delay_spill_wrapped) {
+		if (write_pos + size > read_pos)
+			return false;
+
+	} else if (write_pos + size > output->delay_spill_size &&
+	           read_pos >= size &&
+	           read_pos >= output->delay_spill_size / 4) {
+		output->delay_spill_wrapped = true;
+		write_pos = 0;
+	}
+
+	*offset = write_pos;
+	output->delay_spill_write = write_pos + size;
+	if (output->delay_spill_write > output->delay_spill_size)
+		output->delay_spill_size = output->delay_spill_write;
+	return true;
+}
+
+static bool spill_packet(struct obs_output *output, struct delay_data *dd,
+		const struct encoder_packet *packet)
+{
+	FILE *file = output->delay_spill_file;
+	uint64_t offset;
+
+	if (!packet->size || !spill_alloc(output, packet->size, &offset))
+		return false;
+
+	if (os_fseeki64(file, (int64_t)offset, SEEK_SET) != 0 ||
+	    fwrite(packet->data, 1, packet->size, file) != packet->size)
+		return false;
+
+	dd->packet        = *packet;
+	dd->packet.data   = NULL;
+	dd->packet.buffer = NULL;
+	dd->spilled       = true;
+	dd->spill_offset  = offset;
+	return true;
+}
+
+static bool read_spilled_packet(struct obs_output *output,
+		struct delay_data *dd)
+{
+	struct encoder_packet *packet = &dd->packet;
+	FILE *file = output->delay_spill_file;
+	uint8_t *data = bmalloc(packet->size);
+	bool success;
+
+	success = os_fseeki64(file, (int64_t)dd->spill_offset, SEEK_SET) == 0 &&
+	          fread(data, 1, packet->size, file) == packet->size;
+
+	/* reading from before the last read means the reader wrapped too */
+	if (dd->spill_offset < output->delay_spill_read)
+		output->delay_spill_wrapped = false;
+	output->delay_spill_read = dd->spill_offset + packet->size;
+
+	if (!success) {
+		blog(LOG_ERROR, "Output '%s': Failed to read delayed packet "
+		                "back from the spill file",
+		                output->context.name);
+		bfree(data);
+		return false;
+	}
+
+	packet->data   = data;
+	packet->buffer = encoder_packet_buffer_create(data);
+	dd->spilled    = false;
+	return true;
+}
+
+/* once spilling, everything goes through the spill queue so that packets and
+ * messages stay in order */
+static inline void push_delay_data(struct obs_output *output,
+		struct delay_data *dd)
+{
+	struct circlebuf *queue = output->delay_spill_file ?
+		&output->delay_spill : &output->delay_data;
+
+	circlebuf_push_back(queue, dd, sizeof(*dd));
+}
+
+/* moves everything that is due within the read-ahead window to the in-memory
+ * queue.  this goes by the active delay, so a delay that keeps growing while
+ * preserving on disconnect keeps its packets on disk */
+static void load_spilled_data(struct obs_output *output, uint64_t t)
+{
+	struct delay_data dd;
+
+	while (output->delay_spill.size) {
+		circlebuf_peek_front(&output->delay_spill, &dd, sizeof(dd));
+		if (dd.ts + output->active_delay_ns > t + SPILL_READAHEAD_NS)
+			break;
+
+		circlebuf_pop_front(&output->delay_spill, NULL, sizeof(dd));
+		if (dd.spilled && !read_spilled_packet(output, &dd))
+			continue;
+
+		circlebuf_push_back(&output->delay_data, &dd, sizeof(dd));
+	}
+}
+
 static inline void push_packet(struct obs_output *output,
 		struct encoder_packet *packet, uint64_t t)
 {
@@ -25,10 +176,12 @@ static inline void push_packet(struct obs_output *output,
 
 	dd.msg = DELAY_MSG_PACKET;
 	dd.ts  = t;
-	obs_duplicate_encoder_packet(&dd.packet, packet);
 
 	pthread_mutex_lock(&output->delay_mutex);
-	circlebuf_push_back(&output->delay_data, &dd, sizeof(dd));
+	if (!output->delay_spill_file || !spill_packet(output, &dd, packet))
+		obs_duplicate_encoder_packet(&dd.packet, packet);
+	push_delay_data(output, &dd);
+	load_spilled_data(output, t);
 	pthread_mutex_unlock(&output->delay_mutex);
 }
 
@@ -51,16 +204,29 @@ static inline void process_delay_data(struct obs_output *output,
 	}
 }
 
-void obs_output_cleanup_delay(obs_output_t *output)
+static void free_delay_queue(struct circlebuf *queue)
 {
 	struct delay_data dd;
 
-	while (output->delay_data.size) {
-		circlebuf_pop_front(&output->delay_data, &dd, sizeof(dd));
+	while (queue->size) {
+		circlebuf_pop_front(queue, &dd, sizeof(dd));
 		if (dd.msg == DELAY_MSG_PACKET) {
 			obs_free_encoder_packet(&dd.packet);
 		}
 	}
+}
+
+void obs_output_cleanup_delay(obs_output_t *output)
+{
+	pthread_mutex_lock(&output->delay_mutex);
+	free_delay_queue(&output->delay_data);
+	free_delay_queue(&output->delay_spill);
+
+	if (output->delay_spill_file) {
+		fclose(output->delay_spill_file);
+		output->delay_spill_file = NULL;
+	}
+	pthread_mutex_unlock(&output->delay_mutex);
 
 	output->active_delay_ns = 0;
 	output->delay_restart_refs = 0;
@@ -136,7 +302,7 @@ bool obs_output_delay_start(obs_output_t *output)
 	}
 
 	pthread_mutex_lock(&output->delay_mutex);
-	circlebuf_push_back(&output->delay_data, &dd, sizeof(dd));
+	push_delay_data(output, &dd);
 	pthread_mutex_unlock(&output->delay_mutex);
 
 	if (output->delay_active) {
@@ -161,7 +327,7 @@ void obs_output_delay_stop(obs_output_t *output)
 	};
 
 	pthread_mutex_lock(&output->delay_mutex);
-	circlebuf_push_back(&output->delay_data, &dd, sizeof(dd));
+	push_delay_data(output, &dd);
 	pthread_mutex_unlock(&output->delay_mutex);
 
 	do_output_signal(output, "stopping");
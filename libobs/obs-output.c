@@ -29,7 +29,7 @@ const struct obs_output_info *find_output(const char *id)
 		if (strcmp(obs->output_types.array[i].id, id) == 0)
 			return obs->output_types.array+i;
 
-	return NULL;
+	return obs_load_deferred_type(id) ? find_output(id) : NULL;
 }
 
 const char *obs_output_get_display_name(const char *id)
@@ -61,6 +61,228 @@ static bool init_output_handlers(struct obs_output *output, const char *name,
 	return true;
 }
 
+/* ------------------------------------------------------------------------- */
+/* packet queue */
+
+#define DEFAULT_PACKET_QUEUE_CAPACITY 1024
+
+struct inbound_packet {
+	struct encoder_packet packet;
+	encoded_callback_t    callback;
+	long                  gen;
+};
+
+static inline size_t inbound_depth(struct obs_output *output)
+{
+	return ringbuf_spsc_size(&output->inbound) /
+		sizeof(struct inbound_packet);
+}
+
+static inline bool on_inbound_thread(const struct obs_output *output)
+{
+	return output->inbound_thread_active &&
+		pthread_equal(pthread_self(), output->inbound_thread);
+}
+
+static void deliver_inbound_packet(struct obs_output *output)
+{
+	struct inbound_packet item;
+
+	if (!ringbuf_spsc_pop_front(&output->inbound, &item, sizeof(item)))
+		return;
+
+	os_event_signal(output->inbound_space_event);
+
+	/* anything queued before the capture was last ended is discarded */
+	if (item.gen == os_atomic_load_long(&output->inbound_gen))
+		item.callback(output, &item.packet);
+
+	obs_encoder_packet_release(&item.packet);
+
+	os_atomic_inc_long(&output->inbound_delivered);
+	os_event_signal(output->inbound_drained_event);
+}
+
+static void *inbound_thread(void *data)
+{
+	struct obs_output *output = data;
+
+	os_set_thread_name("libobs: output packet thread");
+	obs_apply_thread_settings(OBS_THREAD_ROLE_OUTPUT);
+
+	while (os_sem_wait(output->inbound_sem) == 0) {
+		if (output->inbound_stop)
+			break;
+
+		deliver_inbound_packet(output);
+	}
+
+	return NULL;
+}
+
+static bool init_inbound(struct obs_output *output)
+{
+	bool service = (output->info.flags & OBS_OUTPUT_SERVICE) != 0;
+
+	output->inbound_capacity = DEFAULT_PACKET_QUEUE_CAPACITY;
+	output->inbound_policy   = service ?
+		OBS_OUTPUT_QUEUE_DROP : OBS_OUTPUT_QUEUE_BLOCK;
+
+	ringbuf_reserve(&output->inbound,
+			output->inbound_capacity * sizeof(struct inbound_packet));
+
+	if (os_sem_init(&output->inbound_sem, 0) != 0)
+		return false;
+	if (os_event_init(&output->inbound_space_event,
+				OS_EVENT_TYPE_AUTO) != 0)
+		return false;
+	if (os_event_init(&output->inbound_drained_event,
+				OS_EVENT_TYPE_AUTO) != 0)
+		return false;
+	if (pthread_create(&output->inbound_thread, NULL, inbound_thread,
+				output) != 0)
+		return false;
+
+	output->inbound_thread_active = true;
+	return true;
+}
+
+static void free_inbound(struct obs_output *output)
+{
+	struct inbound_packet item;
+
+	if (output->inbound_thread_active) {
+		output->inbound_stop = true;
+		os_sem_post(output->inbound_sem);
+		pthread_join(output->inbound_thread, NULL);
+		output->inbound_thread_active = false;
+	}
+
+	while (ringbuf_pop_front(&output->inbound, &item, sizeof(item)))
+		obs_encoder_packet_release(&item.packet);
+
+	ringbuf_free(&output->inbound);
+	os_sem_destroy(output->inbound_sem);
+	os_event_destroy(output->inbound_space_event);
+	os_event_destroy(output->inbound_drained_event);
+}
+
+/* called with inbound_push_mutex held.  the wait is given up once the
+ * capture is ending, as stopping an encoder needs its callbacks mutex,
+ * which the encoder thread holds while sending the packet here */
+static bool wait_inbound_space(struct obs_output *output)
+{
+	uint64_t start = 0;
+
+	while (inbound_depth(output) >= output->inbound_capacity) {
+		if (output->inbound_closing || output->inbound_stop)
+			return false;
+		if (!start)
+			start = os_gettime_ns();
+
+		os_event_timedwait(output->inbound_space_event, 10);
+	}
+
+	if (start) {
+		uint64_t blocked = os_gettime_ns() - start;
+
+		pthread_mutex_lock(&output->inbound_stats_mutex);
+		output->inbound_blocked_ns += blocked;
+		pthread_mutex_unlock(&output->inbound_stats_mutex);
+	}
+
+	return true;
+}
+
+/* called with inbound_push_mutex held */
+static bool accept_inbound_packet(struct obs_output *output,
+		const struct encoder_packet *packet)
+{
+	bool video = packet->type == OBS_ENCODER_VIDEO;
+
+	/* after video has been dropped, the next packets depend on it */
+	if (video && output->inbound_wait_keyframe) {
+		if (!packet->keyframe)
+			return false;
+		output->inbound_wait_keyframe = false;
+	}
+
+	if (output->inbound_policy == OBS_OUTPUT_QUEUE_BLOCK)
+		return wait_inbound_space(output);
+	if (inbound_depth(output) < output->inbound_capacity)
+		return true;
+
+	if (video)
+		output->inbound_wait_keyframe = true;
+	return false;
+}
+
+/* the encoded callback the encoders are actually started with, the packet
+ * is handed to output->inbound_callback on the delivery thread */
+static void queue_packet(void *data, struct encoder_packet *packet)
+{
+	struct obs_output *output = data;
+	struct inbound_packet item;
+	size_t depth;
+	bool queued;
+
+	pthread_mutex_lock(&output->inbound_push_mutex);
+
+	queued = accept_inbound_packet(output, packet);
+	if (queued) {
+		obs_encoder_packet_ref(&item.packet, packet);
+		item.callback = output->inbound_callback;
+		item.gen      = os_atomic_load_long(&output->inbound_gen);
+
+		ringbuf_spsc_push_back(&output->inbound, &item, sizeof(item));
+		os_atomic_inc_long(&output->inbound_queued);
+		os_sem_post(output->inbound_sem);
+	}
+
+	depth = inbound_depth(output);
+
+	pthread_mutex_unlock(&output->inbound_push_mutex);
+
+	pthread_mutex_lock(&output->inbound_stats_mutex);
+	if (queued)
+		output->inbound_packets++;
+	else
+		output->inbound_dropped++;
+	if (depth > output->inbound_max_depth)
+		output->inbound_max_depth = depth;
+	pthread_mutex_unlock(&output->inbound_stats_mutex);
+}
+
+static void open_inbound(struct obs_output *output,
+		encoded_callback_t encoded_callback)
+{
+	output->inbound_callback      = encoded_callback;
+	output->inbound_wait_keyframe = false;
+	output->inbound_closing       = false;
+
+	pthread_mutex_lock(&output->inbound_stats_mutex);
+	output->inbound_packets    = 0;
+	output->inbound_dropped    = 0;
+	output->inbound_blocked_ns = 0;
+	output->inbound_max_depth  = 0;
+	pthread_mutex_unlock(&output->inbound_stats_mutex);
+}
+
+/* once the encoders have stopped, waits until what is still queued has been
+ * delivered, so that nothing reaches the output after its capture has
+ * ended.  the delivery thread itself can't wait for that, so when the
+ * capture is ended from there what is left is discarded instead */
+static void close_inbound(struct obs_output *output)
+{
+	if (!on_inbound_thread(output)) {
+		while (os_atomic_load_long(&output->inbound_delivered) !=
+		       os_atomic_load_long(&output->inbound_queued))
+			os_event_timedwait(output->inbound_drained_event, 10);
+	}
+
+	os_atomic_inc_long(&output->inbound_gen);
+}
+
 obs_output_t *obs_output_create(const char *id, const char *name,
 		obs_data_t *settings, obs_data_t *hotkey_data)
 {
@@ -71,11 +293,23 @@ obs_output_t *obs_output_create(const char *id, const char *name,
 	output = bzalloc(sizeof(struct obs_output));
 	pthread_mutex_init_value(&output->interleaved_mutex);
 	pthread_mutex_init_value(&output->delay_mutex);
+	pthread_mutex_init_value(&output->hold_mutex);
+	pthread_mutex_init_value(&output->latency_mutex);
+	pthread_mutex_init_value(&output->inbound_push_mutex);
+	pthread_mutex_init_value(&output->inbound_stats_mutex);
 
 	if (pthread_mutex_init(&output->interleaved_mutex, NULL) != 0)
 		goto fail;
+	if (pthread_mutex_init(&output->latency_mutex, NULL) != 0)
+		goto fail;
 	if (pthread_mutex_init(&output->delay_mutex, NULL) != 0)
 		goto fail;
+	if (pthread_mutex_init(&output->hold_mutex, NULL) != 0)
+		goto fail;
+	if (pthread_mutex_init(&output->inbound_push_mutex, NULL) != 0)
+		goto fail;
+	if (pthread_mutex_init(&output->inbound_stats_mutex, NULL) != 0)
+		goto fail;
 	if (!init_output_handlers(output, name, settings, hotkey_data))
 		goto fail;
 
@@ -87,6 +321,7 @@ obs_output_t *obs_output_create(const char *id, const char *name,
 	} else {
 		output->info = *info;
 	}
+	output->context.mem_tag = obs_get_type_mem_tag(id);
 	output->video    = obs_get_video();
 	output->audio    = obs_get_audio();
 	if (output->info.get_defaults)
@@ -97,9 +332,14 @@ obs_output_t *obs_output_create(const char *id, const char *name,
 	if (ret < 0)
 		goto fail;
 
+	if ((output->info.flags & OBS_OUTPUT_ENCODED) != 0 &&
+	    !init_inbound(output))
+		goto fail;
+
 	if (info)
-		output->context.data = info->create(output->context.settings,
-				output);
+		CONTEXT_CALL(&output->context,
+				output->context.data = info->create(
+					output->context.settings, output));
 	if (!output->context.data)
 		blog(LOG_ERROR, "Failed to create output '%s'!", name);
 
@@ -122,11 +362,32 @@ fail:
 	return NULL;
 }
 
+static inline size_t stream_size(const struct interleave_stream *stream)
+{
+	return stream->packets.num - stream->head;
+}
+
+static inline struct interleaved_packet *stream_packet(
+		struct interleave_stream *stream, size_t idx)
+{
+	return stream->packets.array + stream->head + idx;
+}
+
 static inline void free_packets(struct obs_output *output)
 {
-	for (size_t i = 0; i < output->interleaved_packets.num; i++)
-		obs_free_encoder_packet(output->interleaved_packets.array+i);
-	da_free(output->interleaved_packets);
+	for (size_t i = 0; i < INTERLEAVE_STREAMS; i++) {
+		struct interleave_stream *stream =
+			&output->interleaved_streams[i];
+
+		for (size_t j = 0; j < stream_size(stream); j++)
+			obs_free_encoder_packet(
+					&stream_packet(stream, j)->packet);
+
+		da_small_free(stream->packets);
+		stream->head = 0;
+	}
+
+	output->interleaved_count = 0;
 }
 
 void obs_output_destroy(obs_output_t *output)
@@ -141,10 +402,13 @@ void obs_output_destroy(obs_output_t *output)
 		if (output->service)
 			output->service->output = NULL;
 
+		free_inbound(output);
 		free_packets(output);
 
 		if (output->context.data)
-			output->info.destroy(output->context.data);
+			CONTEXT_CALL(&output->context,
+					output->info.destroy(
+						output->context.data));
 
 		if (output->video_encoder) {
 			obs_encoder_remove_output(output->video_encoder,
@@ -161,9 +425,17 @@ void obs_output_destroy(obs_output_t *output)
 
 		pthread_mutex_destroy(&output->interleaved_mutex);
 		pthread_mutex_destroy(&output->delay_mutex);
+		pthread_mutex_destroy(&output->hold_mutex);
+		pthread_mutex_destroy(&output->latency_mutex);
+		pthread_mutex_destroy(&output->inbound_push_mutex);
+		pthread_mutex_destroy(&output->inbound_stats_mutex);
 		os_event_destroy(output->reconnect_stop_event);
 		obs_context_data_free(&output->context);
 		circlebuf_free(&output->delay_data);
+		circlebuf_free(&output->delay_spill);
+		circlebuf_free(&output->hold_packets);
+		if (output->delay_spill_file)
+			fclose(output->delay_spill_file);
 		if (output->owns_info_id)
 			bfree((void*)output->info.id);
 		bfree(output);
@@ -175,6 +447,23 @@ const char *obs_output_get_name(const obs_output_t *output)
 	return output ? output->context.name : NULL;
 }
 
+static void reset_latency(struct obs_output *output)
+{
+	pthread_mutex_lock(&output->latency_mutex);
+	output->latency_frames         = 0;
+	output->latency_sent_frames    = 0;
+	output->latency_send_sum       = 0;
+	output->latency_total_sum      = 0;
+	output->latency_sent_total_sum = 0;
+	output->latency_max_total      = 0;
+	output->latency_max_sent_total = 0;
+	output->latency_render_sum     = 0;
+	output->latency_queue_sum      = 0;
+	output->latency_encode_sum     = 0;
+	output->latency_interleave_sum = 0;
+	pthread_mutex_unlock(&output->latency_mutex);
+}
+
 bool obs_output_actual_start(obs_output_t *output)
 {
 	bool success = false;
@@ -182,18 +471,25 @@ bool obs_output_actual_start(obs_output_t *output)
 	output->stopped = false;
 
 	if (output->context.data)
-		success = output->info.start(output->context.data);
+		CONTEXT_CALL(&output->context,
+				success = output->info.start(
+					output->context.data));
 
 	if (success && output->video) {
 		output->starting_frame_count =
 			video_output_get_total_frames(output->video);
 		output->starting_skipped_frame_count =
 			video_output_get_skipped_frames(output->video);
+		output->starting_duplicated_frame_count =
+			video_output_get_duplicated_frames(output->video);
 	}
 
 	if (output->delay_restart_refs)
 		os_atomic_dec_long(&output->delay_restart_refs);
 
+	if (success)
+		reset_latency(output);
+
 	return success;
 }
 
@@ -223,9 +519,13 @@ static void log_frame_info(struct obs_output *output)
 {
 	uint32_t video_frames  = video_output_get_total_frames(output->video);
 	uint32_t video_skipped = video_output_get_skipped_frames(output->video);
+	uint32_t video_duplicated =
+		video_output_get_duplicated_frames(output->video);
 
 	uint32_t total   = video_frames  - output->starting_frame_count;
 	uint32_t skipped = video_skipped - output->starting_skipped_frame_count;
+	uint32_t duplicated = video_duplicated -
+		output->starting_duplicated_frame_count;
 
 	int dropped = obs_output_get_frames_dropped(output);
 
@@ -241,6 +541,12 @@ static void log_frame_info(struct obs_output *output)
 				output->context.name,
 				skipped, percentage_skipped);
 
+	if (duplicated)
+		blog(LOG_INFO, "Output '%s': Number of duplicated frames: "
+				"%"PRIu32" (%g%%)",
+				output->context.name, duplicated,
+				(double)duplicated / (double)total * 100.0);
+
 	if (dropped) {
 		double percentage_dropped;
 		percentage_dropped = (double)dropped / (double)total * 100.0;
@@ -261,7 +567,12 @@ void obs_output_actual_stop(obs_output_t *output, bool force)
 		pthread_join(output->reconnect_thread, NULL);
 
 	if (output->context.data)
-		output->info.stop(output->context.data);
+		CONTEXT_CALL(&output->context,
+				output->info.stop(output->context.data));
+
+	/* the output isn't connected, so nothing else stops the encoders */
+	if (output->holding)
+		obs_output_end_data_capture(output);
 
 	if (output->video)
 		log_frame_info(output);
@@ -352,8 +663,9 @@ void obs_output_update(obs_output_t *output, obs_data_t *settings)
 	obs_data_apply(output->context.settings, settings);
 
 	if (output->info.update)
-		output->info.update(output->context.data,
-				output->context.settings);
+		CONTEXT_CALL(&output->context,
+				output->info.update(output->context.data,
+					output->context.settings));
 }
 
 obs_data_t *obs_output_get_settings(const obs_output_t *output)
@@ -545,6 +857,157 @@ int obs_output_get_total_frames(const obs_output_t *output)
 	return output ? output->total_frames : 0;
 }
 
+static inline uint64_t stage_ns(uint64_t from, uint64_t to)
+{
+	return to > from ? to - from : 0;
+}
+
+/* stamps the time a video packet is handed to the output and adds up how
+ * long it took to get there */
+static void record_output_latency(struct obs_output *output,
+		struct encoder_packet *packet)
+{
+	struct encoder_frame_timing *timing = &packet->timing;
+	uint64_t total;
+
+	if (packet->type != OBS_ENCODER_VIDEO || !timing->render_ns)
+		return;
+
+	timing->output_ns = os_gettime_ns();
+	total = stage_ns(timing->render_ns, timing->output_ns);
+
+	pthread_mutex_lock(&output->latency_mutex);
+	output->latency_render_sum += stage_ns(timing->render_ns,
+			timing->receive_ns);
+	output->latency_queue_sum += stage_ns(timing->receive_ns,
+			timing->encode_ns);
+	output->latency_encode_sum += stage_ns(timing->encode_ns,
+			timing->encoded_ns);
+	output->latency_interleave_sum += stage_ns(timing->encoded_ns,
+			timing->output_ns);
+	output->latency_total_sum += total;
+	if (total > output->latency_max_total)
+		output->latency_max_total = total;
+	output->latency_frames++;
+	pthread_mutex_unlock(&output->latency_mutex);
+}
+
+void obs_output_packet_sent(obs_output_t *output,
+		const struct encoder_packet *packet)
+{
+	const struct encoder_frame_timing *timing;
+	uint64_t now, total;
+
+	if (!output || !packet || packet->type != OBS_ENCODER_VIDEO)
+		return;
+
+	timing = &packet->timing;
+	if (!timing->render_ns || !timing->output_ns)
+		return;
+
+	now   = os_gettime_ns();
+	total = stage_ns(timing->render_ns, now);
+
+	pthread_mutex_lock(&output->latency_mutex);
+	output->latency_send_sum       += stage_ns(timing->output_ns, now);
+	output->latency_sent_total_sum += total;
+	if (total > output->latency_max_sent_total)
+		output->latency_max_sent_total = total;
+	output->latency_sent_frames++;
+	pthread_mutex_unlock(&output->latency_mutex);
+}
+
+bool obs_output_get_latency(const obs_output_t *output,
+		struct obs_output_latency *latency)
+{
+	struct obs_output *out = (struct obs_output*)output;
+	uint64_t frames;
+
+	if (!obs_output_valid(output, "obs_output_get_latency") || !latency)
+		return false;
+
+	memset(latency, 0, sizeof(*latency));
+
+	pthread_mutex_lock(&out->latency_mutex);
+
+	frames = out->latency_frames;
+	latency->frames = frames;
+
+	if (frames) {
+		latency->render_ns     = out->latency_render_sum / frames;
+		latency->queue_ns      = out->latency_queue_sum / frames;
+		latency->encode_ns     = out->latency_encode_sum / frames;
+		latency->interleave_ns = out->latency_interleave_sum / frames;
+		latency->total_ns      = out->latency_total_sum / frames;
+		latency->max_total_ns  = out->latency_max_total;
+	}
+
+	/* outputs that report sends are measured all the way to the network */
+	if (out->latency_sent_frames) {
+		uint64_t sent = out->latency_sent_frames;
+
+		latency->send_ns      = out->latency_send_sum / sent;
+		latency->total_ns     = out->latency_sent_total_sum / sent;
+		latency->max_total_ns = out->latency_max_sent_total;
+	}
+
+	pthread_mutex_unlock(&out->latency_mutex);
+	return true;
+}
+
+void obs_output_set_packet_queue(obs_output_t *output, size_t capacity,
+		enum obs_output_queue_policy policy)
+{
+	if (!obs_output_valid(output, "obs_output_set_packet_queue"))
+		return;
+	if ((output->info.flags & OBS_OUTPUT_ENCODED) == 0)
+		return;
+
+	if (obs_output_active(output) || output->delay_active) {
+		blog(LOG_WARNING, "output '%s': Cannot set the packet queue "
+		                  "while the output is active",
+		                  obs_output_get_name(output));
+		return;
+	}
+
+	if (!capacity)
+		capacity = DEFAULT_PACKET_QUEUE_CAPACITY;
+
+	pthread_mutex_lock(&output->inbound_push_mutex);
+	ringbuf_reserve(&output->inbound,
+			capacity * sizeof(struct inbound_packet));
+	output->inbound_capacity = capacity;
+	output->inbound_policy   = policy;
+	pthread_mutex_unlock(&output->inbound_push_mutex);
+}
+
+bool obs_output_get_packet_queue_stats(const obs_output_t *output,
+		struct obs_output_packet_queue_stats *stats)
+{
+	struct obs_output *out = (struct obs_output*)output;
+
+	if (!obs_output_valid(output, "obs_output_get_packet_queue_stats") ||
+	    !stats)
+		return false;
+
+	memset(stats, 0, sizeof(*stats));
+
+	if ((out->info.flags & OBS_OUTPUT_ENCODED) == 0)
+		return false;
+
+	pthread_mutex_lock(&out->inbound_stats_mutex);
+	stats->packets    = out->inbound_packets;
+	stats->dropped    = out->inbound_dropped;
+	stats->blocked_ns = out->inbound_blocked_ns;
+	stats->max_depth  = out->inbound_max_depth;
+	pthread_mutex_unlock(&out->inbound_stats_mutex);
+
+	stats->depth    = inbound_depth(out);
+	stats->capacity = out->inbound_capacity;
+	stats->policy   = out->inbound_policy;
+	return true;
+}
+
 void obs_output_set_preferred_size(obs_output_t *output, uint32_t width,
 		uint32_t height)
 {
@@ -796,23 +1259,112 @@ static inline bool has_higher_opposing_ts(struct obs_output *output,
 		return output->highest_video_ts > packet->dts_usec;
 }
 
-static inline void send_interleaved(struct obs_output *output)
+/* lets a packet out when the opposing type has fallen behind for longer
+ * than the low latency deadline, instead of waiting for it to catch up */
+static inline bool interleave_deadline_passed(struct obs_output *output,
+		struct encoder_packet *packet)
+{
+	int64_t highest = packet->type == OBS_ENCODER_VIDEO ?
+		output->highest_video_ts : output->highest_audio_ts;
+
+	return obs->video.low_latency &&
+		highest - packet->dts_usec >= LOW_LATENCY_INTERLEAVE_USEC;
+}
+
+static inline size_t get_stream_index(const struct encoder_packet *packet)
+{
+	return packet->type == OBS_ENCODER_VIDEO ?
+		INTERLEAVE_VIDEO_STREAM : packet->track_idx + 1;
+}
+
+static inline bool packet_before(const struct interleaved_packet *a,
+		const struct interleaved_packet *b)
+{
+	if (a->packet.dts_usec != b->packet.dts_usec)
+		return a->packet.dts_usec < b->packet.dts_usec;
+	return a->order < b->order;
+}
+
+/* returns the packet that comes first out of all the streams.  if
+ * skip_stream is a valid stream index, the head of that stream is ignored
+ * (used to find the packet after the first one) */
+static struct interleaved_packet *first_interleaved_packet(
+		struct obs_output *output, size_t skip_stream,
+		size_t *stream_idx)
+{
+	struct interleaved_packet *first = NULL;
+
+	for (size_t i = 0; i < INTERLEAVE_STREAMS; i++) {
+		struct interleave_stream *stream =
+			&output->interleaved_streams[i];
+		size_t offset = (i == skip_stream) ? 1 : 0;
+		struct interleaved_packet *packet;
+
+		if (stream_size(stream) <= offset)
+			continue;
+
+		packet = stream_packet(stream, offset);
+		if (!first || packet_before(packet, first)) {
+			first = packet;
+			*stream_idx = i;
+		}
+	}
+
+	return first;
+}
+
+static void pop_interleaved_packet(struct obs_output *output,
+		size_t stream_idx, struct encoder_packet *out)
 {
-	struct encoder_packet out = output->interleaved_packets.array[0];
+	struct interleave_stream *stream =
+		&output->interleaved_streams[stream_idx];
+
+	*out = stream_packet(stream, 0)->packet;
+	stream->head++;
+	output->interleaved_count--;
+
+	/* only move the remaining packets down once at least half of the
+	 * array has been consumed, so popping stays amortized O(1) */
+	if (stream->head == stream->packets.num) {
+		da_resize(stream->packets, 0);
+		stream->head = 0;
+
+	} else if (stream->head >= 32 &&
+	           stream->head * 2 >= stream->packets.num) {
+		da_erase_range(stream->packets, 0, stream->head);
+		stream->head = 0;
+	}
+}
+
+static inline bool send_interleaved(struct obs_output *output)
+{
+	struct interleaved_packet *first;
+	struct encoder_packet out;
+	size_t stream_idx;
+
+	first = first_interleaved_packet(output, INTERLEAVE_STREAMS,
+			&stream_idx);
+	if (!first)
+		return false;
 
 	/* do not send an interleaved packet if there's no packet of the
 	 * opposing type of a higher timstamp in the interleave buffer.
 	 * this ensures that the timestamps are monotonic */
-	if (!has_higher_opposing_ts(output, &out))
-		return;
+	if (!has_higher_opposing_ts(output, &first->packet) &&
+	    !interleave_deadline_passed(output, &first->packet))
+		return false;
 
-	if (out.type == OBS_ENCODER_VIDEO)
+	if (first->packet.type == OBS_ENCODER_VIDEO)
 		output->total_frames++;
 
-	da_erase(output->interleaved_packets, 0);
+	pop_interleaved_packet(output, stream_idx, &out);
+	record_output_latency(output, &out);
 	if (!output->stopped)
-		output->info.encoded_packet(output->context.data, &out);
+		CONTEXT_CALL(&output->context,
+				output->info.encoded_packet(
+					output->context.data, &out));
 	obs_free_encoder_packet(&out);
+	return true;
 }
 
 static inline void set_higher_ts(struct obs_output *output,
@@ -827,22 +1379,26 @@ static inline void set_higher_ts(struct obs_output *output,
 	}
 }
 
-static bool can_prune_interleaved_packet(struct obs_output *output, size_t idx)
+static bool can_prune_interleaved_packet(struct obs_output *output,
+		size_t *stream_idx)
 {
 	struct encoder_packet *packet;
 	struct encoder_packet *next;
+	size_t next_idx;
 
-	if (idx >= (output->interleaved_packets.num - 1))
+	if (output->interleaved_count < 2)
 		return false;
 
-	packet = &output->interleaved_packets.array[idx];
+	packet = &first_interleaved_packet(output, INTERLEAVE_STREAMS,
+			stream_idx)->packet;
 
 	/* audio packets will almost always come before video packets,
 	 * so it should only ever be necessary to prune audio packets */
 	if (packet->type != OBS_ENCODER_AUDIO)
 		return false;
 
-	next = &output->interleaved_packets.array[idx + 1];
+	next = &first_interleaved_packet(output, *stream_idx,
+			&next_idx)->packet;
 
 	if (next->type == OBS_ENCODER_VIDEO &&
 	    next->dts_usec == packet->dts_usec)
@@ -853,40 +1409,25 @@ static bool can_prune_interleaved_packet(struct obs_output *output, size_t idx)
 
 static void prune_interleaved_packets(struct obs_output *output)
 {
-	size_t start_idx = 0;
+	size_t stream_idx;
 
-	while (can_prune_interleaved_packet(output, start_idx))
-		start_idx++;
+	while (can_prune_interleaved_packet(output, &stream_idx)) {
+		struct encoder_packet packet;
 
-	if (start_idx) {
-		for (size_t i = 0; i < start_idx; i++) {
-			struct encoder_packet *packet =
-				&output->interleaved_packets.array[i];
-			obs_free_encoder_packet(packet);
-		}
-
-		da_erase_range(output->interleaved_packets, 0, start_idx);
+		pop_interleaved_packet(output, stream_idx, &packet);
+		obs_free_encoder_packet(&packet);
 	}
 }
 
 static struct encoder_packet *find_first_packet_type(struct obs_output *output,
 		enum obs_encoder_type type, size_t audio_idx)
 {
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-
-		if (packet->type == type) {
-			if (type == OBS_ENCODER_AUDIO &&
-			    packet->track_idx != audio_idx) {
-				continue;
-			}
+	size_t stream_idx = (type == OBS_ENCODER_VIDEO) ?
+		INTERLEAVE_VIDEO_STREAM : audio_idx + 1;
+	struct interleave_stream *stream =
+		&output->interleaved_streams[stream_idx];
 
-			return packet;
-		}
-	}
-
-	return NULL;
+	return stream_size(stream) ? &stream_packet(stream, 0)->packet : NULL;
 }
 
 static bool initialize_interleaved_packets(struct obs_output *output)
@@ -920,11 +1461,18 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 	output->highest_audio_ts -= audio[0]->dts_usec;
 	output->highest_video_ts -= video->dts_usec;
 
-	/* apply new offsets to all existing packet DTS/PTS values */
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		apply_interleaved_packet_offset(output, packet);
+	/* apply new offsets to all existing packet DTS/PTS values.  every
+	 * packet in a stream gets the same offset, so each stream stays in
+	 * order and the merge picks up the new order between streams */
+	for (size_t i = 0; i < INTERLEAVE_STREAMS; i++) {
+		struct interleave_stream *stream =
+			&output->interleaved_streams[i];
+
+		for (size_t j = 0; j < stream_size(stream); j++) {
+			struct encoder_packet *packet =
+				&stream_packet(stream, j)->packet;
+			apply_interleaved_packet_offset(output, packet);
+		}
 	}
 
 	return true;
@@ -933,41 +1481,131 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 static inline void insert_interleaved_packet(struct obs_output *output,
 		struct encoder_packet *out)
 {
-	size_t idx;
-	for (idx = 0; idx < output->interleaved_packets.num; idx++) {
-		struct encoder_packet *cur_packet;
-		cur_packet = output->interleaved_packets.array + idx;
+	struct interleave_stream *stream =
+		&output->interleaved_streams[get_stream_index(out)];
+	struct interleaved_packet item;
+	size_t idx = stream->packets.num;
 
-		if (out->dts_usec < cur_packet->dts_usec)
-			break;
+	item.packet = *out;
+	item.order  = output->interleaved_order++;
+
+	/* encoders output packets in DTS order, so this almost always just
+	 * appends to the end of the stream */
+	while (idx > stream->head &&
+	       out->dts_usec < stream->packets.array[idx - 1].packet.dts_usec)
+		idx--;
+
+	da_small_insert(stream->packets, idx, &item);
+	output->interleaved_count++;
+}
+
+/* ------------------------------------------------------------------------- */
+/* reconnect holding */
+
+/* held packets are dropped after this long without a keyframe */
+#define MAX_HOLD_USEC 10000000LL
+
+static void free_held_packets(struct obs_output *output)
+{
+	struct encoder_packet packet;
+
+	while (output->hold_packets.size) {
+		circlebuf_pop_front(&output->hold_packets, &packet,
+				sizeof(packet));
+		obs_free_encoder_packet(&packet);
+	}
+}
+
+/* returns false if the packet should be sent on as usual */
+static bool push_held_packet(struct obs_output *output,
+		struct encoder_packet *packet)
+{
+	bool keyframe = packet->type == OBS_ENCODER_VIDEO && packet->keyframe;
+	struct encoder_packet held;
+
+	if (keyframe) {
+		free_held_packets(output);
+		output->hold_wait_keyframe = false;
+
+		/* reconnected before there was a keyframe to start from */
+		if (output->hold_resume) {
+			output->holding     = false;
+			output->hold_resume = false;
+			return false;
+		}
+	}
+
+	if (output->hold_wait_keyframe)
+		return true;
+
+	if (output->hold_packets.size) {
+		circlebuf_peek_front(&output->hold_packets, &held,
+				sizeof(held));
+
+		if (packet->dts_usec - held.dts_usec > MAX_HOLD_USEC) {
+			free_held_packets(output);
+			output->hold_wait_keyframe = true;
+			return true;
+		}
 	}
 
-	da_insert(output->interleaved_packets, idx, out);
+	obs_duplicate_encoder_packet(&held, packet);
+	circlebuf_push_back(&output->hold_packets, &held, sizeof(held));
+	return true;
+}
+
+static bool hold_packet(struct obs_output *output,
+		struct encoder_packet *packet)
+{
+	bool held = false;
+
+	pthread_mutex_lock(&output->hold_mutex);
+	if (output->holding)
+		held = push_held_packet(output, packet);
+	pthread_mutex_unlock(&output->hold_mutex);
+
+	return held;
 }
 
-static void resort_interleaved_packets(struct obs_output *output)
+static bool begin_holding(struct obs_output *output)
 {
-	DARRAY(struct encoder_packet) old_array;
+	bool encoded = (output->info.flags & OBS_OUTPUT_ENCODED) != 0;
 
-	old_array.da = output->interleaved_packets.da;
-	memset(&output->interleaved_packets, 0,
-			sizeof(output->interleaved_packets));
+	if (!encoded || !output->active || output->active_delay_ns ||
+	    !output->video_encoder)
+		return false;
+
+	pthread_mutex_lock(&output->hold_mutex);
+	if (!output->holding) {
+		output->holding            = true;
+		output->hold_wait_keyframe = true;
+		output->hold_resume        = false;
 
-	for (size_t i = 0; i < old_array.num; i++)
-		insert_interleaved_packet(output, &old_array.array[i]);
+		blog(LOG_INFO, "Output '%s': Keeping the encoders running "
+		               "while reconnecting", output->context.name);
+	}
+	pthread_mutex_unlock(&output->hold_mutex);
 
-	da_free(old_array);
+	return true;
 }
 
-static void interleave_packets(void *data, struct encoder_packet *packet)
+static void stop_holding(struct obs_output *output)
+{
+	pthread_mutex_lock(&output->hold_mutex);
+	free_held_packets(output);
+	output->holding     = false;
+	output->hold_resume = false;
+	pthread_mutex_unlock(&output->hold_mutex);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void do_interleave_packets(struct obs_output *output,
+		struct encoder_packet *packet)
 {
-	struct obs_output     *output = data;
 	struct encoder_packet out;
 	bool                  was_started;
 
-	if (packet->type == OBS_ENCODER_AUDIO)
-		packet->track_idx = get_track_index(output, packet);
-
 	pthread_mutex_lock(&output->interleaved_mutex);
 
 	was_started = output->received_audio && output->received_video;
@@ -990,10 +1628,12 @@ static void interleave_packets(void *data, struct encoder_packet *packet)
 	if (output->received_audio && output->received_video) {
 		if (!was_started) {
 			prune_interleaved_packets(output);
-			if (initialize_interleaved_packets(output)) {
-				resort_interleaved_packets(output);
+			if (initialize_interleaved_packets(output))
 				send_interleaved(output);
-			}
+		} else if (obs->video.low_latency) {
+			/* everything past the deadline goes out right away */
+			while (send_interleaved(output))
+				;
 		} else {
 			send_interleaved(output);
 		}
@@ -1002,15 +1642,26 @@ static void interleave_packets(void *data, struct encoder_packet *packet)
 	pthread_mutex_unlock(&output->interleaved_mutex);
 }
 
-static void default_encoded_callback(void *param, struct encoder_packet *packet)
+static void interleave_packets(void *data, struct encoder_packet *packet)
 {
-	struct obs_output *output = param;
+	struct obs_output *output = data;
 
 	if (packet->type == OBS_ENCODER_AUDIO)
 		packet->track_idx = get_track_index(output, packet);
 
+	if (!hold_packet(output, packet))
+		do_interleave_packets(output, packet);
+}
+
+static void do_default_encoded(struct obs_output *output,
+		struct encoder_packet *packet)
+{
+	record_output_latency(output, packet);
+
 	if (!output->stopped)
-		output->info.encoded_packet(output->context.data, packet);
+		CONTEXT_CALL(&output->context,
+				output->info.encoded_packet(
+					output->context.data, packet));
 	if (output->active_delay_ns)
 		obs_free_encoder_packet(packet);
 
@@ -1018,11 +1669,24 @@ static void default_encoded_callback(void *param, struct encoder_packet *packet)
 		output->total_frames++;
 }
 
+static void default_encoded_callback(void *param, struct encoder_packet *packet)
+{
+	struct obs_output *output = param;
+
+	if (packet->type == OBS_ENCODER_AUDIO)
+		packet->track_idx = get_track_index(output, packet);
+
+	if (!hold_packet(output, packet))
+		do_default_encoded(output, packet);
+}
+
 static void default_raw_video_callback(void *param, struct video_data *frame)
 {
 	struct obs_output *output = param;
 	if (!output->stopped)
-		output->info.raw_video(output->context.data, frame);
+		CONTEXT_CALL(&output->context,
+				output->info.raw_video(output->context.data,
+					frame));
 	output->total_frames++;
 }
 
@@ -1031,7 +1695,9 @@ static void default_raw_audio_callback(void *param, size_t mix_idx,
 {
 	struct obs_output *output = param;
 	if (!output->stopped)
-		output->info.raw_audio(output->context.data, frames);
+		CONTEXT_CALL(&output->context,
+				output->info.raw_audio(output->context.data,
+					frames));
 
 	UNUSED_PARAMETER(mix_idx);
 }
@@ -1087,18 +1753,25 @@ static void hook_data_capture(struct obs_output *output, bool encoded,
 			encoded_callback = process_delay;
 			output->delay_active = true;
 
+			if (output->delay_cur_flags & OBS_OUTPUT_DELAY_SPILL)
+				obs_output_delay_spill_start(output);
+
 			blog(LOG_INFO, "Output '%s': %"PRIu32" second delay "
-			               "active, preserve on disconnect is %s",
+			               "active, preserve on disconnect is %s, "
+			               "spill to disk is %s",
 			               output->context.name,
 			               output->delay_sec,
-			               preserve_active(output) ? "on" : "off");
+			               preserve_active(output) ? "on" : "off",
+			               output->delay_spill_file ? "on" : "off");
 		}
 
+		open_inbound(output, encoded_callback);
+
 		if (has_video)
 			obs_encoder_start(output->video_encoder,
-					encoded_callback, output);
+					queue_packet, output);
 		if (has_audio)
-			start_audio_encoders(output, encoded_callback);
+			start_audio_encoders(output, queue_packet);
 	} else {
 		if (has_video)
 			video_output_connect(output->video,
@@ -1162,6 +1835,7 @@ bool obs_output_can_begin_data_capture(const obs_output_t *output,
 
 	if (!output) return false;
 	if (output->delay_active) return true;
+	if (output->holding) return true;
 	if (output->active) return false;
 
 	convert_flags(output, flags, &encoded, &has_video, &has_audio,
@@ -1207,7 +1881,7 @@ bool obs_output_initialize_encoders(obs_output_t *output, uint32_t flags)
 	size_t num_mixes = num_audio_mixes(output);
 
 	if (!output) return false;
-	if (output->active) return output->delay_active;
+	if (output->active) return output->delay_active || output->holding;
 
 	convert_flags(output, flags, &encoded, &has_video, &has_audio,
 			&has_service);
@@ -1250,12 +1924,58 @@ static bool begin_delayed_capture(obs_output_t *output)
 	return true;
 }
 
+/* sends what was held from the latest keyframe on, then goes back to
+ * sending packets as they come.  the delivery thread waits on hold_mutex in
+ * the meantime, so nothing gets out of order */
+static bool resume_held_capture(obs_output_t *output)
+{
+	bool encoded, has_video, has_audio, has_service;
+	struct encoder_packet packet;
+
+	convert_flags(output, 0, &encoded, &has_video, &has_audio,
+			&has_service);
+
+	pthread_mutex_lock(&output->hold_mutex);
+
+	pthread_mutex_lock(&output->interleaved_mutex);
+	reset_packet_data(output);
+	pthread_mutex_unlock(&output->interleaved_mutex);
+
+	if (output->hold_wait_keyframe) {
+		output->hold_resume = true;
+	} else {
+		while (output->hold_packets.size) {
+			circlebuf_pop_front(&output->hold_packets, &packet,
+					sizeof(packet));
+
+			if (has_video && has_audio)
+				do_interleave_packets(output, &packet);
+			else
+				do_default_encoded(output, &packet);
+
+			obs_free_encoder_packet(&packet);
+		}
+
+		output->holding = false;
+	}
+
+	pthread_mutex_unlock(&output->hold_mutex);
+
+	if (output->reconnecting) {
+		signal_reconnect_success(output);
+		output->reconnecting = false;
+	}
+
+	return true;
+}
+
 bool obs_output_begin_data_capture(obs_output_t *output, uint32_t flags)
 {
 	bool encoded, has_video, has_audio, has_service;
 
 	if (!output) return false;
 	if (output->delay_active) return begin_delayed_capture(output);
+	if (output->holding) return resume_held_capture(output);
 	if (output->active) return false;
 
 	output->total_frames   = 0;
@@ -1303,7 +2023,6 @@ static inline void stop_audio_encoders(obs_output_t *output,
 void obs_output_end_data_capture(obs_output_t *output)
 {
 	bool encoded, has_video, has_audio, has_service;
-	encoded_callback_t encoded_callback;
 
 	if (!output) return;
 
@@ -1312,23 +2031,24 @@ void obs_output_end_data_capture(obs_output_t *output)
 		return;
 	}
 
+	if (output->holding)
+		stop_holding(output);
+
 	if (!output->active) return;
 
 	convert_flags(output, 0, &encoded, &has_video, &has_audio,
 			&has_service);
 
 	if (encoded) {
-		if (output->active_delay_ns)
-			encoded_callback = process_delay;
-		else
-			encoded_callback = (has_video && has_audio) ?
-				interleave_packets : default_encoded_callback;
+		output->inbound_closing = true;
 
 		if (has_video)
 			obs_encoder_stop(output->video_encoder,
-					encoded_callback, output);
+					queue_packet, output);
 		if (has_audio)
-			stop_audio_encoders(output, encoded_callback);
+			stop_audio_encoders(output, queue_packet);
+
+		close_inbound(output);
 	} else {
 		if (has_video)
 			video_output_disconnect(output->video,
@@ -1383,6 +2103,8 @@ static void output_reconnect(struct obs_output *output)
 			output->delay_active = false;
 			obs_output_end_data_capture(output);
 		}
+		if (output->holding)
+			obs_output_end_data_capture(output);
 		signal_stop(output, OBS_OUTPUT_DISCONNECTED);
 		return;
 	}
@@ -1403,6 +2125,8 @@ static void output_reconnect(struct obs_output *output)
 	if (ret < 0) {
 		blog(LOG_WARNING, "Failed to create reconnect thread");
 		output->reconnecting = false;
+		if (output->holding)
+			obs_output_end_data_capture(output);
 		signal_stop(output, OBS_OUTPUT_DISCONNECTED);
 	} else {
 		blog(LOG_INFO, "Output '%s':  Reconnecting in %d seconds..",
@@ -1415,13 +2139,18 @@ static void output_reconnect(struct obs_output *output)
 
 void obs_output_signal_stop(obs_output_t *output, int code)
 {
+	bool reconnect;
+
 	if (!output)
 		return;
 
-	obs_output_end_data_capture(output);
+	reconnect = (output->reconnecting && code != OBS_OUTPUT_SUCCESS) ||
+	            code == OBS_OUTPUT_DISCONNECTED;
+
+	if (!reconnect || !begin_holding(output))
+		obs_output_end_data_capture(output);
 
-	if ((output->reconnecting && code != OBS_OUTPUT_SUCCESS) ||
-	    code == OBS_OUTPUT_DISCONNECTED) {
+	if (reconnect) {
 		output_reconnect(output);
 	} else {
 		if (output->delay_active) {
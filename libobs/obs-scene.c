@@ -223,15 +223,66 @@ static void calculate_bounds_data(struct obs_scene_item *item,
 			(int)-width_diff, (int)-height_diff);
 }
 
+static inline uint32_t crop_size(uint32_t size, int start, int end)
+{
+	int total = start + end;
+	return total > 0 && (uint32_t)total >= size ? 0 :
+		size - (uint32_t)total;
+}
+
+static inline uint32_t item_cropped_width(struct obs_scene_item *item)
+{
+	return crop_size(obs_source_get_width(item->source),
+			item->crop.left, item->crop.right);
+}
+
+static inline uint32_t item_cropped_height(struct obs_scene_item *item)
+{
+	return crop_size(obs_source_get_height(item->source),
+			item->crop.top, item->crop.bottom);
+}
+
+static inline bool item_cropped(const struct obs_scene_item *item)
+{
+	return item->crop.left || item->crop.top ||
+	       item->crop.right || item->crop.bottom;
+}
+
+static inline bool vec2_equal(const struct vec2 *a, const struct vec2 *b)
+{
+	return a->x == b->x && a->y == b->y;
+}
+
+/* equivalent to scaling, translating by -origin, rotating and translating by
+ * pos one after another, without the full matrix multiplications */
+static void build_item_transform(struct matrix4 *dst, const struct vec2 *scale,
+		const struct vec2 *origin, const struct matrix4 *rot,
+		const struct vec2 *pos)
+{
+	struct vec4 temp;
+
+	vec4_mulf(&dst->x, &rot->x, scale->x);
+	vec4_mulf(&dst->y, &rot->y, scale->y);
+	vec4_copy(&dst->z, &rot->z);
+
+	vec4_set(&dst->t, pos->x, pos->y, 0.0f, 1.0f);
+	vec4_mulf(&temp, &rot->x, origin->x);
+	vec4_sub(&dst->t, &dst->t, &temp);
+	vec4_mulf(&temp, &rot->y, origin->y);
+	vec4_sub(&dst->t, &dst->t, &temp);
+}
+
 static void update_item_transform(struct obs_scene_item *item)
 {
-	uint32_t        width         = obs_source_get_width(item->source);
-	uint32_t        height        = obs_source_get_height(item->source);
+	uint32_t        width         = item_cropped_width(item);
+	uint32_t        height        = item_cropped_height(item);
 	uint32_t        cx            = width;
 	uint32_t        cy            = height;
 	struct vec2     base_origin;
 	struct vec2     origin;
 	struct vec2     scale         = item->scale;
+	struct matrix4  rot;
+	struct axisang  aa;
 	struct calldata params        = {0};
 
 	vec2_zero(&base_origin);
@@ -248,15 +299,11 @@ static void update_item_transform(struct obs_scene_item *item)
 
 	add_alignment(&origin, item->align, (int)cx, (int)cy);
 
-	matrix4_identity(&item->draw_transform);
-	matrix4_scale3f(&item->draw_transform, &item->draw_transform,
-			scale.x, scale.y, 1.0f);
-	matrix4_translate3f(&item->draw_transform, &item->draw_transform,
-			-origin.x, -origin.y, 0.0f);
-	matrix4_rotate_aa4f(&item->draw_transform, &item->draw_transform,
-			0.0f, 0.0f, 1.0f, RAD(item->rot));
-	matrix4_translate3f(&item->draw_transform, &item->draw_transform,
-			item->pos.x, item->pos.y, 0.0f);
+	axisang_set(&aa, 0.0f, 0.0f, 1.0f, RAD(item->rot));
+	matrix4_from_axisang(&rot, &aa);
+
+	build_item_transform(&item->draw_transform, &scale, &origin, &rot,
+			&item->pos);
 
 	/* ----------------------- */
 
@@ -269,20 +316,16 @@ static void update_item_transform(struct obs_scene_item *item)
 
 	add_alignment(&base_origin, item->align, (int)scale.x, (int)scale.y);
 
-	matrix4_identity(&item->box_transform);
-	matrix4_scale3f(&item->box_transform, &item->box_transform,
-			scale.x, scale.y, 1.0f);
-	matrix4_translate3f(&item->box_transform, &item->box_transform,
-			-base_origin.x, -base_origin.y, 0.0f);
-	matrix4_rotate_aa4f(&item->box_transform, &item->box_transform,
-			0.0f, 0.0f, 1.0f, RAD(item->rot));
-	matrix4_translate3f(&item->box_transform, &item->box_transform,
-			item->pos.x, item->pos.y, 0.0f);
+	build_item_transform(&item->box_transform, &scale, &base_origin, &rot,
+			&item->pos);
 
 	/* ----------------------- */
 
-	item->last_width  = width;
-	item->last_height = height;
+	item->last_width  = obs_source_get_width(item->source);
+	item->last_height = obs_source_get_height(item->source);
+
+	obs_source_mark_video_changed(item->parent->source);
+	obs_source_mark_save_changed(item->parent->source);
 
 	calldata_set_ptr(&params, "scene", item->parent);
 	calldata_set_ptr(&params, "item", item);
@@ -299,17 +342,198 @@ static inline bool source_size_changed(struct obs_scene_item *item)
 	return item->last_width != width || item->last_height != height;
 }
 
-static void scene_video_render(void *data, gs_effect_t *effect)
+static bool scene_video_unchanged(void *data)
 {
 	struct obs_scene *scene = data;
 	struct obs_scene_item *item;
+	bool unchanged = true;
 
 	pthread_mutex_lock(&scene->mutex);
 
 	item = scene->first_item;
+	while (item) {
+		if (obs_source_removed(item->source) ||
+		    source_size_changed(item)) {
+			unchanged = false;
+			break;
+		}
+
+		if (item->visible &&
+		    !obs_source_video_unchanged(item->source)) {
+			unchanged = false;
+			break;
+		}
+
+		item = item->next;
+	}
+
+	pthread_mutex_unlock(&scene->mutex);
+
+	return unchanged;
+}
+
+#define MAX_OCCLUDERS 8
+
+static inline void get_item_bounds(struct obs_scene_item *item,
+		struct bounds *b)
+{
+	struct bounds size;
+
+	vec3_zero(&size.min);
+	vec3_set(&size.max,
+			(float)item_cropped_width(item),
+			(float)item_cropped_height(item), 0.0f);
+	bounds_transform(b, &size, &item->draw_transform);
+}
+
+/* only unrotated (or quarter-turned) items fill their bounding box */
+static inline bool item_axis_aligned(struct obs_scene_item *item)
+{
+	const struct matrix4 *m = &item->draw_transform;
+
+	return (fabsf(m->x.y) < EPSILON && fabsf(m->y.x) < EPSILON) ||
+	       (fabsf(m->x.x) < EPSILON && fabsf(m->y.y) < EPSILON);
+}
+
+static inline bool world_matrix_identity(void)
+{
+	struct matrix4 m, identity;
+
+	gs_matrix_get(&m);
+	matrix4_identity(&identity);
+	return memcmp(&m, &identity, sizeof(m)) == 0;
+}
+
+/*
+ * Walks the items from the top down and marks the ones that can't be seen:
+ * items that don't touch the scene's area and items completely inside the
+ * area covered by an opaque item above them.
+ *
+ * Scenes don't clip their items, so a nested scene (drawn with a world
+ * transform) can show items outside of its own area; only occlusion is
+ * tested there.
+ */
+static void cull_items(struct obs_scene_item *last)
+{
+	struct bounds occluders[MAX_OCCLUDERS];
+	size_t        num_occluders = 0;
+	struct bounds viewport;
+	bool          test_viewport = world_matrix_identity();
+
+	vec3_zero(&viewport.min);
+	vec3_set(&viewport.max, (float)obs->video.base_width,
+			(float)obs->video.base_height, 0.0f);
+
+	for (struct obs_scene_item *item = last; item; item = item->prev) {
+		struct bounds b;
+
+		item->culled = false;
+		if (!item->visible)
+			continue;
+
+		get_item_bounds(item, &b);
+
+		if (test_viewport) {
+			if (!bounds_intersects(&viewport, &b, 0.0f)) {
+				item->culled = true;
+				continue;
+			}
+
+			vec3_max(&b.min, &b.min, &viewport.min);
+			vec3_min(&b.max, &b.max, &viewport.max);
+		}
+
+		for (size_t i = 0; i < num_occluders; i++) {
+			if (bounds_inside(&occluders[i], &b)) {
+				item->culled = true;
+				break;
+			}
+		}
+
+		if (!item->culled && num_occluders < MAX_OCCLUDERS &&
+		    obs_source_opaque(item->source) &&
+		    item_axis_aligned(item))
+			bounds_copy(&occluders[num_occluders++], &b);
+	}
+}
+
+/* for sources that can only be cropped after being rendered to a texture */
+static void render_item_texture_cropped(struct obs_scene_item *item)
+{
+	static struct gs_eparam_ref image_ref;
+	uint32_t       width  = obs_source_get_width(item->source);
+	uint32_t       height = obs_source_get_height(item->source);
+	uint32_t       cx     = item_cropped_width(item);
+	uint32_t       cy     = item_cropped_height(item);
+	gs_effect_t    *effect;
+	gs_technique_t *tech;
+	gs_texture_t   *tex;
+	size_t         passes;
+
+	if (!width || !height || !cx || !cy)
+		return;
+
+	if (!item->crop_render)
+		item->crop_render = gs_texrender_create_transient(GS_RGBA,
+				GS_ZS_NONE);
+
+	gs_texrender_reset(item->crop_render);
 
 	gs_blend_state_push();
-	gs_reset_blend_state();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+
+	if (gs_texrender_begin(item->crop_render, width, height)) {
+		struct vec4 clear_color;
+
+		vec4_zero(&clear_color);
+		gs_clear(GS_CLEAR_COLOR, &clear_color, 0.0f, 0);
+		gs_ortho(0.0f, (float)width, 0.0f, (float)height,
+				-100.0f, 100.0f);
+
+		obs_source_video_render(item->source);
+		gs_texrender_end(item->crop_render);
+	}
+
+	gs_blend_state_pop();
+
+	tex = gs_texrender_get_texture(item->crop_render);
+	if (!tex)
+		return;
+
+	effect = obs_get_default_effect();
+	tech   = gs_effect_get_technique(effect, "Draw");
+
+	gs_effect_set_texture(gs_effect_get_param_ref(effect, &image_ref,
+				"image"), tex);
+
+	passes = gs_technique_begin(tech);
+	for (size_t i = 0; i < passes; i++) {
+		gs_technique_begin_pass(tech, i);
+		gs_draw_sprite_subregion(tex, 0,
+				(uint32_t)item->crop.left,
+				(uint32_t)item->crop.top, cx, cy);
+		gs_technique_end_pass(tech);
+	}
+	gs_technique_end(tech);
+}
+
+static inline void render_item(struct obs_scene_item *item)
+{
+	if (!item_cropped(item))
+		obs_source_video_render(item->source);
+	else if (!obs_source_video_render_crop(item->source, &item->crop))
+		render_item_texture_cropped(item);
+}
+
+static void scene_video_render(void *data, gs_effect_t *effect)
+{
+	struct obs_scene *scene = data;
+	struct obs_scene_item *item;
+	struct obs_scene_item *last = NULL;
+
+	pthread_mutex_lock(&scene->mutex);
+
+	item = scene->first_item;
 
 	while (item) {
 		if (obs_source_removed(item->source)) {
@@ -323,16 +547,28 @@ static void scene_video_render(void *data, gs_effect_t *effect)
 		if (source_size_changed(item))
 			update_item_transform(item);
 
-		if (item->visible) {
+		last = item;
+		item = item->next;
+	}
+
+	cull_items(last);
+
+	gs_blend_state_push();
+	gs_reset_blend_state();
+
+	/* lets items that draw the same texture the same way share a draw */
+	gs_sprite_batch_begin();
+
+	for (item = scene->first_item; item; item = item->next) {
+		if (item->visible && !item->culled) {
 			gs_matrix_push();
 			gs_matrix_mul(&item->draw_transform);
-			obs_source_video_render(item->source);
+			render_item(item);
 			gs_matrix_pop();
 		}
-
-		item = item->next;
 	}
 
+	gs_sprite_batch_end();
 	gs_blend_state_pop();
 
 	pthread_mutex_unlock(&scene->mutex);
@@ -378,6 +614,11 @@ static void scene_load_item(struct obs_scene *scene, obs_data_t *item_data)
 		(uint32_t)obs_data_get_int(item_data, "bounds_align");
 	obs_data_get_vec2(item_data, "bounds", &item->bounds);
 
+	item->crop.left   = (int)obs_data_get_int(item_data, "crop_left");
+	item->crop.top    = (int)obs_data_get_int(item_data, "crop_top");
+	item->crop.right  = (int)obs_data_get_int(item_data, "crop_right");
+	item->crop.bottom = (int)obs_data_get_int(item_data, "crop_bottom");
+
 	obs_source_release(source);
 
 	update_item_transform(item);
@@ -418,6 +659,10 @@ static void scene_save_item(obs_data_array_t *array,
 	obs_data_set_int   (item_data, "bounds_type",  (int)item->bounds_type);
 	obs_data_set_int   (item_data, "bounds_align", (int)item->bounds_align);
 	obs_data_set_vec2 (item_data, "bounds",       &item->bounds);
+	obs_data_set_int   (item_data, "crop_left",    item->crop.left);
+	obs_data_set_int   (item_data, "crop_top",     item->crop.top);
+	obs_data_set_int   (item_data, "crop_right",   item->crop.right);
+	obs_data_set_int   (item_data, "crop_bottom",  item->crop.bottom);
 
 	obs_data_array_push_back(array, item_data);
 	obs_data_release(item_data);
@@ -459,7 +704,8 @@ const struct obs_source_info scene_info =
 {
 	.id            = "scene",
 	.type          = OBS_SOURCE_TYPE_INPUT,
-	.output_flags  = OBS_SOURCE_VIDEO | OBS_SOURCE_CUSTOM_DRAW,
+	.output_flags  = OBS_SOURCE_VIDEO | OBS_SOURCE_CUSTOM_DRAW |
+	                 OBS_SOURCE_THREADED_CREATE,
 	.get_name      = scene_getname,
 	.create        = scene_create,
 	.destroy       = scene_destroy,
@@ -468,7 +714,8 @@ const struct obs_source_info scene_info =
 	.get_height    = scene_getheight,
 	.load          = scene_load,
 	.save          = scene_save,
-	.enum_sources  = scene_enum_sources
+	.enum_sources  = scene_enum_sources,
+	.video_unchanged = scene_video_unchanged
 };
 
 obs_scene_t *obs_scene_create(const char *name)
@@ -505,6 +752,7 @@ obs_scene_t *obs_scene_duplicate(obs_scene_t *scene, const char *name)
 			new_item->bounds_type = item->bounds_type;
 			new_item->bounds_align = item->bounds_align;
 			new_item->bounds = item->bounds;
+			new_item->crop = item->crop;
 		}
 
 		item = item->next;
@@ -715,6 +963,9 @@ obs_sceneitem_t *obs_scene_add(obs_scene_t *scene, obs_source_t *source)
 
 	pthread_mutex_unlock(&scene->mutex);
 
+	obs_source_mark_video_changed(scene->source);
+	obs_source_mark_save_changed(scene->source);
+
 	init_hotkeys(scene, item, obs_source_get_name(source));
 
 	calldata_set_ptr(&params, "scene", scene);
@@ -730,6 +981,11 @@ static void obs_sceneitem_destroy(obs_sceneitem_t *item)
 {
 	if (item) {
 		obs_hotkey_pair_unregister(item->toggle_visibility);
+		if (item->crop_render) {
+			obs_enter_graphics();
+			gs_texrender_destroy(item->crop_render);
+			obs_leave_graphics();
+		}
 		if (item->source)
 			obs_source_release(item->source);
 		bfree(item);
@@ -780,6 +1036,9 @@ void obs_sceneitem_remove(obs_sceneitem_t *item)
 
 	pthread_mutex_unlock(&scene->mutex);
 
+	obs_source_mark_video_changed(scene->source);
+	obs_source_mark_save_changed(scene->source);
+
 	obs_sceneitem_release(item);
 }
 
@@ -818,7 +1077,7 @@ bool obs_sceneitem_selected(const obs_sceneitem_t *item)
 
 void obs_sceneitem_set_pos(obs_sceneitem_t *item, const struct vec2 *pos)
 {
-	if (item) {
+	if (item && !vec2_equal(&item->pos, pos)) {
 		vec2_copy(&item->pos, pos);
 		update_item_transform(item);
 	}
@@ -826,7 +1085,7 @@ void obs_sceneitem_set_pos(obs_sceneitem_t *item, const struct vec2 *pos)
 
 void obs_sceneitem_set_rot(obs_sceneitem_t *item, float rot)
 {
-	if (item) {
+	if (item && item->rot != rot) {
 		item->rot = rot;
 		update_item_transform(item);
 	}
@@ -834,7 +1093,7 @@ void obs_sceneitem_set_rot(obs_sceneitem_t *item, float rot)
 
 void obs_sceneitem_set_scale(obs_sceneitem_t *item, const struct vec2 *scale)
 {
-	if (item) {
+	if (item && !vec2_equal(&item->scale, scale)) {
 		vec2_copy(&item->scale, scale);
 		update_item_transform(item);
 	}
@@ -842,7 +1101,7 @@ void obs_sceneitem_set_scale(obs_sceneitem_t *item, const struct vec2 *scale)
 
 void obs_sceneitem_set_alignment(obs_sceneitem_t *item, uint32_t alignment)
 {
-	if (item) {
+	if (item && item->align != alignment) {
 		item->align = alignment;
 		update_item_transform(item);
 	}
@@ -855,6 +1114,9 @@ static inline void signal_reorder(struct obs_scene_item *item)
 
 	command = "reorder";
 
+	obs_source_mark_video_changed(item->parent->source);
+	obs_source_mark_save_changed(item->parent->source);
+
 	calldata_set_ptr(&params, "scene", item->parent);
 
 	signal_handler_signal(item->parent->source->context.signals,
@@ -941,7 +1203,7 @@ void obs_sceneitem_set_order_position(obs_sceneitem_t *item,
 void obs_sceneitem_set_bounds_type(obs_sceneitem_t *item,
 		enum obs_bounds_type type)
 {
-	if (item) {
+	if (item && item->bounds_type != type) {
 		item->bounds_type = type;
 		update_item_transform(item);
 	}
@@ -950,7 +1212,7 @@ void obs_sceneitem_set_bounds_type(obs_sceneitem_t *item,
 void obs_sceneitem_set_bounds_alignment(obs_sceneitem_t *item,
 		uint32_t alignment)
 {
-	if (item) {
+	if (item && item->bounds_align != alignment) {
 		item->bounds_align = alignment;
 		update_item_transform(item);
 	}
@@ -958,7 +1220,7 @@ void obs_sceneitem_set_bounds_alignment(obs_sceneitem_t *item,
 
 void obs_sceneitem_set_bounds(obs_sceneitem_t *item, const struct vec2 *bounds)
 {
-	if (item) {
+	if (item && !vec2_equal(&item->bounds, bounds)) {
 		item->bounds = *bounds;
 		update_item_transform(item);
 	}
@@ -1016,10 +1278,22 @@ void obs_sceneitem_get_info(const obs_sceneitem_t *item,
 	}
 }
 
+static inline bool transform_info_unchanged(const struct obs_scene_item *item,
+		const struct obs_transform_info *info)
+{
+	return vec2_equal(&item->pos, &info->pos) &&
+	       item->rot          == info->rot &&
+	       vec2_equal(&item->scale, &info->scale) &&
+	       item->align        == info->alignment &&
+	       item->bounds_type  == info->bounds_type &&
+	       item->bounds_align == info->bounds_alignment &&
+	       vec2_equal(&item->bounds, &info->bounds);
+}
+
 void obs_sceneitem_set_info(obs_sceneitem_t *item,
 		const struct obs_transform_info *info)
 {
-	if (item && info) {
+	if (item && info && !transform_info_unchanged(item, info)) {
 		item->pos          = info->pos;
 		item->rot          = info->rot;
 		item->scale        = info->scale;
@@ -1062,6 +1336,9 @@ void obs_sceneitem_set_visible(obs_sceneitem_t *item, bool visible)
 	if (!item->parent)
 		return;
 
+	obs_source_mark_video_changed(item->parent->source);
+	obs_source_mark_save_changed(item->parent->source);
+
 	calldata_set_ptr(&cd, "scene", item->parent);
 	calldata_set_ptr(&cd, "item", item);
 	calldata_set_bool(&cd, "visible", visible);
@@ -1072,6 +1349,34 @@ void obs_sceneitem_set_visible(obs_sceneitem_t *item, bool visible)
 	calldata_free(&cd);
 }
 
+void obs_sceneitem_set_crop(obs_sceneitem_t *item,
+		const struct obs_source_crop *crop)
+{
+	struct obs_source_crop new_crop;
+
+	if (!item || !crop)
+		return;
+
+	new_crop.left   = crop->left   > 0 ? crop->left   : 0;
+	new_crop.top    = crop->top    > 0 ? crop->top    : 0;
+	new_crop.right  = crop->right  > 0 ? crop->right  : 0;
+	new_crop.bottom = crop->bottom > 0 ? crop->bottom : 0;
+
+	if (memcmp(&item->crop, &new_crop, sizeof(new_crop)) == 0)
+		return;
+
+	item->crop = new_crop;
+
+	update_item_transform(item);
+}
+
+void obs_sceneitem_get_crop(const obs_sceneitem_t *item,
+		struct obs_source_crop *crop)
+{
+	if (item && crop)
+		*crop = item->crop;
+}
+
 static bool sceneitems_match(obs_scene_t *scene, obs_sceneitem_t * const *items,
 		size_t size, bool *order_matches)
 {
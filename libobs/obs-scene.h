@@ -20,6 +20,7 @@
 #include "obs.h"
 #include "obs-internal.h"
 #include "graphics/matrix4.h"
+#include "graphics/bounds.h"
 
 /* how obs scene! */
 
@@ -45,6 +46,15 @@ struct obs_scene_item {
 	struct matrix4        box_transform;
 	struct matrix4        draw_transform;
 
+	/* crop_render is only used for sources that can't be cropped through
+	 * their texture coordinates */
+	struct obs_source_crop crop;
+	gs_texrender_t        *crop_render;
+
+	/* set by the scene each frame when the item is off-screen or covered
+	 * by opaque items above it */
+	bool                  culled;
+
 	enum obs_bounds_type  bounds_type;
 	uint32_t              bounds_align;
 	struct vec2           bounds;
@@ -24,7 +24,7 @@ const struct obs_service_info *find_service(const char *id)
 		if (strcmp(obs->service_types.array[i].id, id) == 0)
 			return obs->service_types.array+i;
 
-	return NULL;
+	return obs_load_deferred_type(id) ? find_service(id) : NULL;
 }
 
 const char *obs_service_get_display_name(const char *id)
@@ -61,9 +61,12 @@ obs_service_t *obs_service_create(const char *id, const char *name,
 		service->info = *info;
 	}
 
+	service->context.mem_tag = obs_get_type_mem_tag(id);
+
 	if (info)
-		service->context.data = service->info.create(
-				service->context.settings, service);
+		CONTEXT_CALL(&service->context,
+				service->context.data = service->info.create(
+					service->context.settings, service));
 	if (!service->context.data)
 		blog(LOG_ERROR, "Failed to create service '%s'!", name);
 
@@ -81,7 +84,8 @@ obs_service_t *obs_service_create(const char *id, const char *name,
 static void actually_destroy_service(struct obs_service *service)
 {
 	if (service->context.data)
-		service->info.destroy(service->context.data);
+		CONTEXT_CALL(&service->context,
+				service->info.destroy(service->context.data));
 
 	if (service->output)
 		service->output->service = NULL;
@@ -166,8 +170,9 @@ void obs_service_update(obs_service_t *service, obs_data_t *settings)
 	obs_data_apply(service->context.settings, settings);
 
 	if (service->info.update)
-		service->info.update(service->context.data,
-				service->context.settings);
+		CONTEXT_CALL(&service->context,
+				service->info.update(service->context.data,
+					service->context.settings));
 }
 
 obs_data_t *obs_service_get_settings(const obs_service_t *service)
@@ -20,6 +20,7 @@
 #include "media-io/format-conversion.h"
 #include "media-io/video-frame.h"
 #include "media-io/audio-io.h"
+#include "media-io/audio-kernels.h"
 #include "util/threading.h"
 #include "util/platform.h"
 #include "callback/calldata.h"
@@ -45,7 +46,7 @@ const struct obs_source_info *find_source(struct darray *list, const char *id)
 			return info;
 	}
 
-	return NULL;
+	return obs_load_deferred_type(id) ? find_source(list, id) : NULL;
 }
 
 static const struct obs_source_info *get_source_info(enum obs_source_type type,
@@ -104,8 +105,14 @@ bool obs_source_init_context(struct obs_source *source,
 				hotkey_data))
 		return false;
 
-	return signal_handler_add_array(source->context.signals,
-			source_signals);
+	if (!signal_handler_add_array(source->context.signals, source_signals))
+		return false;
+
+	source->audio_data_signal = signal_handler_get_signal(
+			source->context.signals, "audio_data");
+	source->volume_signal = signal_handler_get_signal(
+			source->context.signals, "volume");
+	return true;
 }
 
 const char *obs_source_get_display_name(enum obs_source_type type,
@@ -125,9 +132,11 @@ bool obs_source_init(struct obs_source *source,
 	source->present_volume = 1.0f;
 	source->base_volume = 0.0f;
 	source->sync_offset = 0;
+	source->async_uploads = DEFAULT_ASYNC_UPLOADS;
 	pthread_mutex_init_value(&source->filter_mutex);
 	pthread_mutex_init_value(&source->async_mutex);
 	pthread_mutex_init_value(&source->audio_mutex);
+	pthread_mutex_init_value(&source->audio_dsp_mutex);
 
 	if (pthread_mutexattr_init(&attr) != 0)
 		return false;
@@ -137,6 +146,8 @@ bool obs_source_init(struct obs_source *source,
 		return false;
 	if (pthread_mutex_init(&source->audio_mutex, NULL) != 0)
 		return false;
+	if (pthread_mutex_init(&source->audio_dsp_mutex, NULL) != 0)
+		return false;
 	if (pthread_mutex_init(&source->async_mutex, NULL) != 0)
 		return false;
 
@@ -156,6 +167,7 @@ bool obs_source_init(struct obs_source *source,
 	obs_context_data_insert(&source->context,
 			&obs->data.sources_mutex,
 			&obs->data.first_source);
+	obs_source_snapshot_update();
 	return true;
 }
 
@@ -252,9 +264,25 @@ static inline void obs_source_dosignal(struct obs_source *source,
 	calldata_free(&data);
 }
 
+/* the name store keeps every name until shutdown, so sources only get their
+ * own profiler entry while tracing (the startup timeline, for example) */
+static inline const char *source_create_profile_name(const char *id,
+		const char *name)
+{
+	if (!profiler_trace_active())
+		return NULL;
+
+	return profile_store_name(obs_get_profiler_name_store(),
+			"obs_source_create(%s: %s)", id, name);
+}
+
 obs_source_t *obs_source_create(enum obs_source_type type, const char *id,
 		const char *name, obs_data_t *settings, obs_data_t *hotkey_data)
 {
+	const char *profile_name = source_create_profile_name(id, name);
+	if (profile_name)
+		profile_start(profile_name);
+
 	struct obs_source *source = bzalloc(sizeof(struct obs_source));
 
 	const struct obs_source_info *info = get_source_info(type, id);
@@ -275,6 +303,9 @@ obs_source_t *obs_source_create(enum obs_source_type type, const char *id,
 	if (!obs_source_init_context(source, settings, name, hotkey_data))
 		goto fail;
 
+	source->context.mem_tag = obs_get_type_mem_tag(id);
+	source->context.vram_tracker = gs_memory_tracker_create();
+
 	if (info && info->get_defaults)
 		info->get_defaults(source->context.settings);
 
@@ -286,24 +317,31 @@ obs_source_t *obs_source_create(enum obs_source_type type, const char *id,
 	/* allow the source to be created even if creation fails so that the
 	 * user's data doesn't become lost */
 	if (info)
-		source->context.data = info->create(source->context.settings,
-				source);
+		CONTEXT_CALL(&source->context,
+				source->context.data = info->create(
+					source->context.settings, source));
 	if (!source->context.data)
 		blog(LOG_ERROR, "Failed to create source '%s'!", name);
 
+	source->last_used_time = obs->video.video_time;
+
 	blog(LOG_INFO, "source '%s' (%s) created", name, id);
+	obs_source_mark_save_changed(source);
 	obs_source_dosignal(source, "source_create", NULL);
 
 	source->flags = source->default_flags;
 	source->enabled = true;
 
-	if (info && info->type == OBS_SOURCE_TYPE_TRANSITION)
-		os_atomic_inc_long(&obs->data.active_transitions);
+	if (profile_name)
+		profile_end(profile_name);
 	return source;
 
 fail:
 	blog(LOG_ERROR, "obs_source_create failed");
 	obs_source_destroy(source);
+
+	if (profile_name)
+		profile_end(profile_name);
 	return NULL;
 }
 
@@ -335,14 +373,30 @@ static inline void obs_source_frame_decref(struct obs_source_frame *frame)
 static bool obs_source_filter_remove_refless(obs_source_t *source,
 		obs_source_t *filter);
 
+static void wait_for_audio_dsp(obs_source_t *source);
+
 void obs_source_destroy(struct obs_source *source)
 {
-	size_t i;
-
 	if (!source)
 		return;
+	if (obs_source_walk_defer_destroy(source))
+		return;
+
+	/* skipped by the video thread until the janitor gets to it */
+	source->destroy_pending = true;
+
+	if (!obs_janitor_queue(OBS_DESTROY_SOURCE, source))
+		obs_source_teardown(source);
+}
+
+void obs_source_teardown(struct obs_source *source)
+{
+	size_t i;
+
+	wait_for_audio_dsp(source);
 
-	if (source->info.type == OBS_SOURCE_TYPE_TRANSITION)
+	if (source->info.type == OBS_SOURCE_TYPE_TRANSITION &&
+	    source->activate_refs > 0)
 		os_atomic_dec_long(&obs->data.active_transitions);
 
 	if (source->filter_parent)
@@ -352,13 +406,16 @@ void obs_source_destroy(struct obs_source *source)
 		obs_source_filter_remove(source, source->filters.array[0]);
 
 	obs_context_data_remove(&source->context);
+	obs_source_snapshot_update();
+	obs_source_walk_wait();
 
 	blog(LOG_INFO, "source '%s' destroyed", source->context.name);
 
 	obs_source_dosignal(source, "source_destroy", "destroy");
 
 	if (source->context.data) {
-		source->info.destroy(source->context.data);
+		CONTEXT_CALL(&source->context,
+				source->info.destroy(source->context.data));
 		source->context.data = NULL;
 	}
 
@@ -369,23 +426,34 @@ void obs_source_destroy(struct obs_source *source)
 	for (i = 0; i < source->async_cache.num; i++)
 		obs_source_frame_decref(source->async_cache.array[i].frame);
 
-	gs_enter_context(obs->video.graphics);
-	gs_texrender_destroy(source->async_convert_texrender);
-	gs_texture_destroy(source->async_texture);
-	gs_texrender_destroy(source->filter_texrender);
-	gs_leave_context();
+	obs_janitor_gs_free(OBS_GS_FREE_TEXRENDER,
+			source->async_convert_texrender);
+	for (i = 0; i < source->async_upload_count; i++)
+		obs_janitor_gs_free(OBS_GS_FREE_TEXTURE,
+				source->async_textures[i]);
+	obs_janitor_gs_free(OBS_GS_FREE_TEXRENDER, source->filter_texrender);
+	obs_janitor_gs_free(OBS_GS_FREE_TEXRENDER, source->cache_texrender);
+	obs_janitor_gs_free(OBS_GS_FREE_EFFECT, source->fused_effect);
 
-	for (i = 0; i < MAX_AV_PLANES; i++)
+	for (i = 0; i < MAX_AV_PLANES; i++) {
 		bfree(source->audio_data.data[i]);
+		da_free(source->audio_pool[i]);
+	}
+	for (i = 0; i < AUDIO_DSP_QUEUE_SIZE; i++) {
+		for (size_t j = 0; j < MAX_AV_PLANES; j++)
+			da_free(source->audio_dsp_queue[i].data[j]);
+	}
 
 	audio_line_destroy(source->audio_line);
 	audio_resampler_destroy(source->resampler);
 
 	da_free(source->async_cache);
 	da_free(source->async_frames);
-	da_free(source->filters);
+	da_small_free(source->filters);
+	dstr_free(&source->fused_key);
 	pthread_mutex_destroy(&source->filter_mutex);
 	pthread_mutex_destroy(&source->audio_mutex);
+	pthread_mutex_destroy(&source->audio_dsp_mutex);
 	pthread_mutex_destroy(&source->async_mutex);
 	obs_context_data_free(&source->context);
 
@@ -479,10 +547,10 @@ void obs_source_remove(obs_source_t *source)
 	size_t id;
 	bool   exists;
 
-	pthread_mutex_lock(&data->sources_mutex);
+	pthread_mutex_lock(&data->user_sources_mutex);
 
 	if (!source || source->removed) {
-		pthread_mutex_unlock(&data->sources_mutex);
+		pthread_mutex_unlock(&data->user_sources_mutex);
 		return;
 	}
 
@@ -497,7 +565,7 @@ void obs_source_remove(obs_source_t *source)
 		obs_source_release(source);
 	}
 
-	pthread_mutex_unlock(&data->sources_mutex);
+	pthread_mutex_unlock(&data->user_sources_mutex);
 
 	if (exists)
 		obs_source_dosignal(source, "source_remove", "remove");
@@ -573,8 +641,9 @@ uint32_t obs_get_source_output_flags(enum obs_source_type type, const char *id)
 static void obs_source_deferred_update(obs_source_t *source)
 {
 	if (source->context.data && source->info.update)
-		source->info.update(source->context.data,
-				source->context.settings);
+		CONTEXT_CALL(&source->context,
+				source->info.update(source->context.data,
+					source->context.settings));
 
 	source->defer_update = false;
 }
@@ -586,11 +655,14 @@ void obs_source_update(obs_source_t *source, obs_data_t *settings)
 	if (settings)
 		obs_data_apply(source->context.settings, settings);
 
+	obs_source_mark_save_changed(source);
+
 	if (source->info.output_flags & OBS_SOURCE_VIDEO) {
 		source->defer_update = true;
 	} else if (source->context.data && source->info.update) {
-		source->info.update(source->context.data,
-				source->context.settings);
+		CONTEXT_CALL(&source->context,
+				source->info.update(source->context.data,
+					source->context.settings));
 	}
 }
 
@@ -707,10 +779,40 @@ static void hide_source(obs_source_t *source)
 	obs_source_dosignal(source, "source_hide", "hide");
 }
 
+/* base volumes only have to be recalculated when a source goes active or
+ * inactive, or while a transition is active and mixing its children */
+static void activation_changed(obs_source_t *source, bool active)
+{
+	if (source->info.type == OBS_SOURCE_TYPE_TRANSITION) {
+		if (active)
+			os_atomic_inc_long(&obs->data.active_transitions);
+		else
+			os_atomic_dec_long(&obs->data.active_transitions);
+	}
+
+	os_atomic_set_long(&obs->data.base_volume_dirty, 1);
+}
+
+static inline long inc_activate_refs(obs_source_t *source)
+{
+	long refs = os_atomic_inc_long(&source->activate_refs);
+	if (refs == 1)
+		activation_changed(source, true);
+	return refs;
+}
+
+static inline long dec_activate_refs(obs_source_t *source)
+{
+	long refs = os_atomic_dec_long(&source->activate_refs);
+	if (refs == 0)
+		activation_changed(source, false);
+	return refs;
+}
+
 static void activate_tree(obs_source_t *parent, obs_source_t *child,
 		void *param)
 {
-	os_atomic_inc_long(&child->activate_refs);
+	inc_activate_refs(child);
 
 	UNUSED_PARAMETER(parent);
 	UNUSED_PARAMETER(param);
@@ -719,7 +821,7 @@ static void activate_tree(obs_source_t *parent, obs_source_t *child,
 static void deactivate_tree(obs_source_t *parent, obs_source_t *child,
 		void *param)
 {
-	os_atomic_dec_long(&child->activate_refs);
+	dec_activate_refs(child);
 
 	UNUSED_PARAMETER(parent);
 	UNUSED_PARAMETER(param);
@@ -750,7 +852,7 @@ void obs_source_activate(obs_source_t *source, enum view_type type)
 	}
 
 	if (type == MAIN_VIEW) {
-		if (os_atomic_inc_long(&source->activate_refs) == 1) {
+		if (inc_activate_refs(source) == 1) {
 			obs_source_enum_tree(source, activate_tree, NULL);
 		}
 	}
@@ -765,22 +867,142 @@ void obs_source_deactivate(obs_source_t *source, enum view_type type)
 	}
 
 	if (type == MAIN_VIEW) {
-		if (os_atomic_dec_long(&source->activate_refs) == 0) {
+		if (dec_activate_refs(source) == 0) {
 			obs_source_enum_tree(source, deactivate_tree, NULL);
 		}
 	}
 }
 
+static void prepare_tree(obs_source_t *parent, obs_source_t *child,
+		void *param)
+{
+	os_atomic_inc_long(&child->prepare_refs);
+
+	UNUSED_PARAMETER(parent);
+	UNUSED_PARAMETER(param);
+}
+
+static void unprepare_tree(obs_source_t *parent, obs_source_t *child,
+		void *param)
+{
+	os_atomic_dec_long(&child->prepare_refs);
+
+	UNUSED_PARAMETER(parent);
+	UNUSED_PARAMETER(param);
+}
+
+void obs_source_prepare(obs_source_t *source)
+{
+	if (!source) return;
+
+	if (os_atomic_inc_long(&source->prepare_refs) == 1) {
+		obs_source_enum_tree(source, prepare_tree, NULL);
+	}
+}
+
+void obs_source_unprepare(obs_source_t *source)
+{
+	if (!source) return;
+
+	if (os_atomic_dec_long(&source->prepare_refs) == 0) {
+		obs_source_enum_tree(source, unprepare_tree, NULL);
+	}
+}
+
+static void prepare_source(obs_source_t *source)
+{
+	if (source->context.data && source->info.prepare)
+		source->info.prepare(source->context.data);
+}
+
+static void unprepare_source(obs_source_t *source)
+{
+	if (source->context.data && source->info.unprepare)
+		source->info.unprepare(source->context.data);
+}
+
 static inline struct obs_source_frame *get_closest_frame(obs_source_t *source,
 		uint64_t sys_time);
 static void remove_async_frame(obs_source_t *source,
 		struct obs_source_frame *frame);
 
-void obs_source_video_tick(obs_source_t *source, float seconds)
+void obs_source_mark_video_changed(obs_source_t *source)
 {
-	bool now_showing, now_active;
+	if (source)
+		os_atomic_inc_long(&source->video_changes);
+}
 
-	if (!source) return;
+uint64_t obs_source_get_vram_usage(const obs_source_t *source)
+{
+	return source ?
+		gs_memory_tracker_get_bytes(source->context.vram_tracker) : 0;
+}
+
+/* filters are saved as part of the source they're on, so their parent
+ * changes along with them */
+void obs_source_mark_save_changed(obs_source_t *source)
+{
+	obs_source_t *parent;
+
+	if (!source)
+		return;
+
+	source->save_generation =
+		os_atomic_inc_long(&obs->data.save_generation);
+
+	parent = source->filter_parent;
+	if (parent)
+		parent->save_generation =
+			os_atomic_inc_long(&obs->data.save_generation);
+}
+
+static void suspend_source(obs_source_t *source)
+{
+	blog(LOG_DEBUG, "source '%s' suspended", source->context.name);
+
+	source->suspended = true;
+	CONTEXT_CALL(&source->context,
+			source->info.suspend(source->context.data));
+}
+
+static void resume_source(obs_source_t *source)
+{
+	blog(LOG_DEBUG, "source '%s' resumed", source->context.name);
+
+	if (source->info.resume)
+		CONTEXT_CALL(&source->context,
+				source->info.resume(source->context.data));
+	source->suspended = false;
+	source->video_dirty = true;
+}
+
+static inline void update_suspend_state(obs_source_t *source, bool in_use)
+{
+	uint64_t delay = obs->video.suspend_delay_ns;
+	uint64_t now = obs->video.video_time;
+
+	if (in_use) {
+		source->last_used_time = now;
+		if (source->suspended)
+			resume_source(source);
+
+	} else if (delay && !source->suspended && source->info.suspend &&
+	           source->context.data &&
+	           source->info.type != OBS_SOURCE_TYPE_FILTER &&
+	           now - source->last_used_time >= delay) {
+		suspend_source(source);
+	}
+}
+
+void obs_source_video_tick_state(obs_source_t *source)
+{
+	bool now_showing, now_active, now_prepared;
+	long video_changes;
+
+	video_changes = source->video_changes;
+	source->video_dirty = video_changes != source->last_video_changes ||
+		source->defer_update;
+	source->last_video_changes = video_changes;
 
 	if ((source->info.output_flags & OBS_SOURCE_ASYNC) != 0) {
 		uint64_t sys_time = obs->video.video_time;
@@ -793,19 +1015,45 @@ void obs_source_video_tick(obs_source_t *source, float seconds)
 
 		source->cur_async_frame = get_closest_frame(source, sys_time);
 		source->last_sys_timestamp = sys_time;
+		if (source->cur_async_frame)
+			source->video_dirty = true;
 		pthread_mutex_unlock(&source->async_mutex);
 	}
 
-	if (source->defer_update)
+	now_showing = !!source->show_refs;
+	now_active = !!source->activate_refs;
+	now_prepared = !!source->prepare_refs;
+
+	/* resumes before prepare/show/activate are called */
+	update_suspend_state(source,
+			now_showing || now_active || now_prepared);
+
+	if (source->defer_update && !source->suspended)
 		obs_source_deferred_update(source);
 
 	/* reset the filter render texture information once every frame */
 	if (source->filter_texrender)
 		gs_texrender_reset(source->filter_texrender);
+	if (source->cache_texrender)
+		gs_texrender_reset(source->cache_texrender);
+
+	/* call prepare/unprepare if the reference changed.  prepare comes
+	 * first so a source that's prepared and shown on the same tick loads
+	 * once, from prepare */
+	if (now_prepared != source->prepared) {
+		if (now_prepared) {
+			prepare_source(source);
+		} else {
+			unprepare_source(source);
+		}
+
+		source->prepared = now_prepared;
+	}
 
 	/* call show/hide if the reference changed */
-	now_showing = !!source->show_refs;
 	if (now_showing != source->showing) {
+		source->video_dirty = true;
+
 		if (now_showing) {
 			show_source(source);
 		} else {
@@ -816,8 +1064,9 @@ void obs_source_video_tick(obs_source_t *source, float seconds)
 	}
 
 	/* call activate/deactivate if the reference changed */
-	now_active = !!source->activate_refs;
 	if (now_active != source->active) {
+		source->video_dirty = true;
+
 		if (now_active) {
 			activate_source(source);
 		} else {
@@ -827,12 +1076,27 @@ void obs_source_video_tick(obs_source_t *source, float seconds)
 		source->active = now_active;
 	}
 
-	if (source->context.data && source->info.video_tick)
-		source->info.video_tick(source->context.data, seconds);
-
 	source->async_rendered = false;
 }
 
+void obs_source_video_tick(obs_source_t *source, float seconds)
+{
+	gs_memory_tracker_t *prev_vram;
+
+	if (!source) return;
+
+	/* async textures and show/hide callbacks are charged to the source */
+	prev_vram = gs_set_memory_tracker(source->context.vram_tracker);
+	obs_source_video_tick_state(source);
+	gs_set_memory_tracker(prev_vram);
+
+	if (source->context.data && source->info.video_tick &&
+	    !source->suspended)
+		CONTEXT_CALL(&source->context,
+				source->info.video_tick(source->context.data,
+					seconds));
+}
+
 /* unless the value is 3+ hours worth of frames, this won't overflow */
 static inline uint64_t conv_frames_to_time(size_t frames)
 {
@@ -867,14 +1131,18 @@ static void source_signal_audio_data(obs_source_t *source,
 		struct audio_data *in, bool muted)
 {
 	struct calldata data;
+	uint8_t stack[128];
 
-	calldata_init(&data);
+	if (!signal_has_callbacks(source->audio_data_signal))
+		return;
+
+	calldata_init_fixed(&data, stack, sizeof(stack));
 
 	calldata_set_ptr(&data, "source", source);
 	calldata_set_ptr(&data, "data",   in);
 	calldata_set_bool(&data, "muted", muted);
 
-	signal_handler_signal(source->context.signals, "audio_data", &data);
+	signal_emit(source->audio_data_signal, &data);
 
 	calldata_free(&data);
 }
@@ -884,12 +1152,21 @@ static inline uint64_t uint64_diff(uint64_t ts1, uint64_t ts2)
 	return (ts1 < ts2) ?  (ts2 - ts1) : (ts1 - ts2);
 }
 
-static void source_output_audio_line(obs_source_t *source,
-		const struct audio_data *data)
+static inline uint64_t ts_smoothing_threshold(void)
+{
+	const struct audio_output_info *info =
+		audio_output_get_info(obs->audio.audio);
+	return info ? info->ts_smoothing_ns : TS_SMOOTHING_THRESHOLD;
+}
+
+/* adjusts the timing and volume of audio about to be sent to the audio line,
+ * returns whether the source is muted */
+static bool prepare_audio_line_data(obs_source_t *source,
+		struct audio_data *data)
 {
 	struct audio_data in = *data;
 	uint64_t diff;
-	uint64_t os_time = os_gettime_ns();
+	uint64_t os_time = obs_get_clock_ns();
 
 	/* detects 'directly' set timestamps as long as they're within
 	 * a certain threshold */
@@ -907,7 +1184,7 @@ static void source_output_audio_line(obs_source_t *source,
 		if (diff > MAX_TS_VAR)
 			handle_ts_jump(source, source->next_audio_ts_min,
 					in.timestamp, diff, os_time);
-		else if (diff < TS_SMOOTHING_THRESHOLD)
+		else if (diff < ts_smoothing_threshold())
 			in.timestamp = source->next_audio_ts_min;
 	}
 
@@ -939,6 +1216,16 @@ static void source_output_audio_line(obs_source_t *source,
 	if (muted)
 		in.volume = 0.0f;
 
+	*data = in;
+	return muted;
+}
+
+static void source_output_audio_line(obs_source_t *source,
+		const struct audio_data *data)
+{
+	struct audio_data in = *data;
+	bool muted = prepare_audio_line_data(source, &in);
+
 	audio_line_output(source->audio_line, &in);
 	source_signal_audio_data(source, &in, muted);
 }
@@ -1046,21 +1333,55 @@ static inline enum gs_color_format convert_video_format(
 	return GS_BGRX;
 }
 
+static inline void free_async_textures(struct obs_source *source)
+{
+	for (uint32_t i = 0; i < source->async_upload_count; i++) {
+		gs_texture_destroy(source->async_textures[i]);
+		source->async_textures[i] = NULL;
+	}
+
+	source->async_texture      = NULL;
+	source->async_upload_count = 0;
+	source->async_upload_idx   = 0;
+}
+
+/* frames are uploaded to a ring of textures so that writing the next frame
+ * never has to wait for the GPU to finish reading the one being drawn */
+static bool create_async_textures(struct obs_source *source, uint32_t cx,
+		uint32_t cy, enum gs_color_format format)
+{
+	uint32_t count = source->async_uploads;
+
+	for (uint32_t i = 0; i < count; i++) {
+		source->async_textures[i] = gs_texture_create(cx, cy, format,
+				1, NULL, GS_DYNAMIC);
+		if (!source->async_textures[i])
+			return false;
+
+		source->async_upload_count = i + 1;
+	}
+
+	source->async_texture = source->async_textures[0];
+	return true;
+}
+
 static inline bool set_async_texture_size(struct obs_source *source,
 		const struct obs_source_frame *frame)
 {
 	enum convert_type cur = get_convert_type(frame->format);
+	uint32_t uploads = source->async_uploads;
 
 	if (source->async_width  == frame->width  &&
 	    source->async_height == frame->height &&
-	    source->async_format == frame->format)
+	    source->async_format == frame->format &&
+	    source->async_upload_count == uploads)
 		return true;
 
 	source->async_width  = frame->width;
 	source->async_height = frame->height;
 	source->async_format = frame->format;
 
-	gs_texture_destroy(source->async_texture);
+	free_async_textures(source);
 	gs_texrender_destroy(source->async_convert_texrender);
 	source->async_convert_texrender = NULL;
 
@@ -1070,23 +1391,29 @@ static inline bool set_async_texture_size(struct obs_source *source,
 		source->async_convert_texrender =
 			gs_texrender_create(GS_BGRX, GS_ZS_NONE);
 
-		source->async_texture = gs_texture_create(
+		if (!create_async_textures(source,
 				source->async_convert_width,
 				source->async_convert_height,
-				source->async_texture_format,
-				1, NULL, GS_DYNAMIC);
+				source->async_texture_format))
+			goto fail;
 
 	} else {
 		enum gs_color_format format = convert_video_format(
 				frame->format);
 		source->async_gpu_conversion = false;
 
-		source->async_texture = gs_texture_create(
-				frame->width, frame->height,
-				format, 1, NULL, GS_DYNAMIC);
+		if (!create_async_textures(source,
+				frame->width, frame->height, format))
+			goto fail;
 	}
 
-	return !!source->async_texture;
+	return true;
+
+fail:
+	/* make sure the next frame tries again */
+	free_async_textures(source);
+	source->async_width = 0;
+	return false;
 }
 
 static void upload_raw_frame(gs_texture_t *tex,
@@ -1145,16 +1472,9 @@ static const char *select_conversion_technique(enum video_format format)
 	return NULL;
 }
 
-static inline void set_eparam(gs_effect_t *effect, const char *name, float val)
-{
-	gs_eparam_t *param = gs_effect_get_param_by_name(effect, name);
-	gs_effect_set_float(param, val);
-}
-
 static bool update_async_texrender(struct obs_source *source,
-		const struct obs_source_frame *frame)
+		const struct obs_source_frame *frame, gs_texture_t *tex)
 {
-	gs_texture_t   *tex       = source->async_texture;
 	gs_texrender_t *texrender = source->async_convert_texrender;
 
 	gs_texrender_reset(texrender);
@@ -1168,6 +1488,7 @@ static bool update_async_texrender(struct obs_source *source,
 	float convert_height = (float)source->async_convert_height;
 
 	gs_effect_t *conv = obs->video.conversion_effect;
+	const struct obs_conversion_params *p = &obs->video.conversion_params;
 	gs_technique_t *tech = gs_effect_get_technique(conv,
 			select_conversion_technique(frame->format));
 
@@ -1177,24 +1498,25 @@ static bool update_async_texrender(struct obs_source *source,
 	gs_technique_begin(tech);
 	gs_technique_begin_pass(tech, 0);
 
-	gs_effect_set_texture(gs_effect_get_param_by_name(conv, "image"), tex);
-	set_eparam(conv, "width",  (float)cx);
-	set_eparam(conv, "height", (float)cy);
-	set_eparam(conv, "width_i",  1.0f / cx);
-	set_eparam(conv, "height_i", 1.0f / cy);
-	set_eparam(conv, "width_d2",  cx * 0.5f);
-	set_eparam(conv, "height_d2", cy * 0.5f);
-	set_eparam(conv, "width_d2_i",  1.0f / (cx * 0.5f));
-	set_eparam(conv, "height_d2_i", 1.0f / (cy * 0.5f));
-	set_eparam(conv, "input_width",  convert_width);
-	set_eparam(conv, "input_height", convert_height);
-	set_eparam(conv, "input_width_i",  1.0f / convert_width);
-	set_eparam(conv, "input_height_i", 1.0f / convert_height);
-	set_eparam(conv, "input_width_i_d2",  (1.0f / convert_width)  * 0.5f);
-	set_eparam(conv, "input_height_i_d2", (1.0f / convert_height) * 0.5f);
-	set_eparam(conv, "u_plane_offset",
+	gs_effect_set_texture(p->image, tex);
+	gs_effect_set_float(p->width,  (float)cx);
+	gs_effect_set_float(p->height, (float)cy);
+	gs_effect_set_float(p->width_i,  1.0f / cx);
+	gs_effect_set_float(p->height_i, 1.0f / cy);
+	gs_effect_set_float(p->width_d2,  cx * 0.5f);
+	gs_effect_set_float(p->height_d2, cy * 0.5f);
+	gs_effect_set_float(p->width_d2_i,  1.0f / (cx * 0.5f));
+	gs_effect_set_float(p->height_d2_i, 1.0f / (cy * 0.5f));
+	gs_effect_set_float(p->input_width,  convert_width);
+	gs_effect_set_float(p->input_height, convert_height);
+	gs_effect_set_float(p->input_width_i,  1.0f / convert_width);
+	gs_effect_set_float(p->input_height_i, 1.0f / convert_height);
+	gs_effect_set_float(p->input_width_i_d2, (1.0f / convert_width) * 0.5f);
+	gs_effect_set_float(p->input_height_i_d2,
+			(1.0f / convert_height) * 0.5f);
+	gs_effect_set_float(p->u_plane_offset,
 			(float)source->async_plane_offset[0]);
-	set_eparam(conv, "v_plane_offset",
+	gs_effect_set_float(p->v_plane_offset,
 			(float)source->async_plane_offset[1]);
 
 	gs_ortho(0.f, (float)cx, 0.f, (float)cy, -100.f, 100.f);
@@ -1209,10 +1531,9 @@ static bool update_async_texrender(struct obs_source *source,
 	return true;
 }
 
-static bool update_async_texture(struct obs_source *source,
-		const struct obs_source_frame *frame)
+static bool upload_async_texture(struct obs_source *source,
+		const struct obs_source_frame *frame, gs_texture_t *tex)
 {
-	gs_texture_t      *tex       = source->async_texture;
 	gs_texrender_t    *texrender = source->async_convert_texrender;
 	enum convert_type type      = get_convert_type(frame->format);
 	uint8_t           *ptr;
@@ -1228,7 +1549,7 @@ static bool update_async_texture(struct obs_source *source,
 			sizeof frame->color_range_max);
 
 	if (source->async_gpu_conversion && texrender)
-		return update_async_texrender(source, frame);
+		return update_async_texrender(source, frame, tex);
 
 	if (type == CONVERT_NONE) {
 		gs_texture_set_image(tex, frame->data[0], frame->linesize[0],
@@ -1261,10 +1582,85 @@ static bool update_async_texture(struct obs_source *source,
 	return true;
 }
 
+static bool update_async_texture(struct obs_source *source,
+		const struct obs_source_frame *frame)
+{
+	uint32_t idx = (source->async_upload_idx + 1) %
+		source->async_upload_count;
+	gs_texture_t *tex = source->async_textures[idx];
+
+	if (!upload_async_texture(source, frame, tex))
+		return false;
+
+	source->async_upload_idx = idx;
+	source->async_texture    = tex;
+	return true;
+}
+
+/*
+ * Draws the part of a sprite that lies inside the current draw crop, moved to
+ * where the cropped image starts.  The sprite is x, y, cx, cy in the
+ * uncropped source, which may be scaled relative to the texture.
+ */
+static void draw_sprite_cropped(gs_texture_t *tex, uint32_t flip, int x, int y,
+		uint32_t cx, uint32_t cy)
+{
+	const struct obs_draw_crop *dc = &obs->video.draw_crop;
+	uint32_t tex_cx = gs_texture_get_width(tex);
+	uint32_t tex_cy = gs_texture_get_height(tex);
+	uint32_t sub_x, sub_y, sub_cx, sub_cy;
+	float    x0, y0, x1, y1;
+	float    scale_x, scale_y;
+
+	if (!cx) cx = tex_cx;
+	if (!cy) cy = tex_cy;
+	if (!cx || !cy)
+		return;
+
+	x0 = fmaxf((float)x, (float)dc->crop.left);
+	y0 = fmaxf((float)y, (float)dc->crop.top);
+	x1 = fminf((float)x + (float)cx, (float)dc->cx - dc->crop.right);
+	y1 = fminf((float)y + (float)cy, (float)dc->cy - dc->crop.bottom);
+
+	if (x1 <= x0 || y1 <= y0)
+		return;
+
+	scale_x = (float)tex_cx / (float)cx;
+	scale_y = (float)tex_cy / (float)cy;
+
+	sub_x  = (uint32_t)((x0 - (float)x) * scale_x + 0.5f);
+	sub_y  = (uint32_t)((y0 - (float)y) * scale_y + 0.5f);
+	sub_cx = (uint32_t)((x1 - x0) * scale_x + 0.5f);
+	sub_cy = (uint32_t)((y1 - y0) * scale_y + 0.5f);
+
+	if (!sub_cx || !sub_cy)
+		return;
+	if (sub_x + sub_cx > tex_cx)
+		sub_cx = tex_cx - sub_x;
+	if (sub_y + sub_cy > tex_cy)
+		sub_cy = tex_cy - sub_y;
+
+	/* flipped sprites show the mirrored part of the texture */
+	if ((flip & GS_FLIP_U) != 0)
+		sub_x = tex_cx - sub_x - sub_cx;
+	if ((flip & GS_FLIP_V) != 0)
+		sub_y = tex_cy - sub_y - sub_cy;
+
+	gs_matrix_push();
+	gs_matrix_translate3f(x0 - (float)dc->crop.left,
+			y0 - (float)dc->crop.top, 0.0f);
+	gs_matrix_scale3f((x1 - x0) / (float)sub_cx,
+			(y1 - y0) / (float)sub_cy, 1.0f);
+	gs_draw_sprite_subregion(tex, flip, sub_x, sub_y, sub_cx, sub_cy);
+	gs_matrix_pop();
+}
+
 static inline void obs_source_draw_texture(struct obs_source *source,
 		gs_effect_t *effect, float *color_matrix,
 		float const *color_range_min, float const *color_range_max)
 {
+	static struct gs_eparam_ref range_min_ref, range_max_ref;
+	static struct gs_eparam_ref matrix_ref, image_ref;
 	gs_texture_t *tex = source->async_texture;
 	gs_eparam_t  *param;
 
@@ -1273,25 +1669,32 @@ static inline void obs_source_draw_texture(struct obs_source *source,
 
 	if (color_range_min) {
 		size_t const size = sizeof(float) * 3;
-		param = gs_effect_get_param_by_name(effect, "color_range_min");
+		param = gs_effect_get_param_ref(effect, &range_min_ref,
+				"color_range_min");
 		gs_effect_set_val(param, color_range_min, size);
 	}
 
 	if (color_range_max) {
 		size_t const size = sizeof(float) * 3;
-		param = gs_effect_get_param_by_name(effect, "color_range_max");
+		param = gs_effect_get_param_ref(effect, &range_max_ref,
+				"color_range_max");
 		gs_effect_set_val(param, color_range_max, size);
 	}
 
 	if (color_matrix) {
-		param = gs_effect_get_param_by_name(effect, "color_matrix");
+		param = gs_effect_get_param_ref(effect, &matrix_ref,
+				"color_matrix");
 		gs_effect_set_val(param, color_matrix, sizeof(float) * 16);
 	}
 
-	param = gs_effect_get_param_by_name(effect, "image");
+	param = gs_effect_get_param_ref(effect, &image_ref, "image");
 	gs_effect_set_texture(param, tex);
 
-	gs_draw_sprite(tex, source->async_flip ? GS_FLIP_V : 0, 0, 0);
+	if (obs->video.draw_crop.active)
+		draw_sprite_cropped(tex, source->async_flip ? GS_FLIP_V : 0,
+				0, 0, 0, 0);
+	else
+		gs_draw_sprite(tex, source->async_flip ? GS_FLIP_V : 0, 0, 0);
 }
 
 static void obs_source_draw_async_texture(struct obs_source *source)
@@ -1324,7 +1727,10 @@ static void obs_source_draw_async_texture(struct obs_source *source)
 static inline struct obs_source_frame *filter_async_video(obs_source_t *source,
 		struct obs_source_frame *in);
 
-static void obs_source_render_async_video(obs_source_t *source)
+/* uploads the frame due for this render, once per frame.  this draws to the
+ * conversion texrender for some formats, so it can't happen while a filter's
+ * technique has already begun */
+static void obs_source_update_async_video(obs_source_t *source)
 {
 	if (!source->async_rendered) {
 		struct obs_source_frame *frame = obs_source_get_frame(source);
@@ -1335,7 +1741,7 @@ static void obs_source_render_async_video(obs_source_t *source)
 		source->async_rendered = true;
 		if (frame) {
 			source->timing_adjust =
-				os_gettime_ns() - frame->timestamp;
+				obs_get_clock_ns() - frame->timestamp;
 			source->timing_set = true;
 
 			if (!set_async_texture_size(source, frame))
@@ -1346,6 +1752,11 @@ static void obs_source_render_async_video(obs_source_t *source)
 
 		obs_source_release_frame(source, frame);
 	}
+}
+
+static void obs_source_render_async_video(obs_source_t *source)
+{
+	obs_source_update_async_video(source);
 
 	if (source->async_texture && source->async_active)
 		obs_source_draw_async_texture(source);
@@ -1369,7 +1780,9 @@ static void obs_source_default_render(obs_source_t *source, bool color_matrix)
 	for (i = 0; i < passes; i++) {
 		gs_technique_begin_pass(tech, i);
 		if (source->context.data)
-			source->info.video_render(source->context.data, effect);
+			CONTEXT_CALL(&source->context,
+					source->info.video_render(
+						source->context.data, effect));
 		gs_technique_end_pass(tech);
 	}
 	gs_technique_end(tech);
@@ -1387,72 +1800,229 @@ static inline void obs_source_main_render(obs_source_t *source)
 	if (default_effect)
 		obs_source_default_render(source, color_matrix);
 	else if (source->context.data)
-		source->info.video_render(source->context.data,
-				custom_draw ? NULL : gs_get_effect());
+		CONTEXT_CALL(&source->context,
+				source->info.video_render(source->context.data,
+					custom_draw ? NULL : gs_get_effect()));
 }
 
 static bool ready_async_frame(obs_source_t *source, uint64_t sys_time);
 
-void obs_source_video_render(obs_source_t *source)
+bool obs_source_video_unchanged(obs_source_t *source)
 {
-	if (!source) return;
-
-	if (source->info.type != OBS_SOURCE_TYPE_FILTER &&
-	    (source->info.output_flags & OBS_SOURCE_VIDEO) == 0)
-		return;
-
-	if (!source->context.data || !source->enabled) {
-		if (source->filter_parent)
-			obs_source_skip_video_filter(source);
-		return;
-	}
-
-	if (source->filters.num && !source->rendering_filter)
-		obs_source_render_filters(source);
-
-	else if (source->info.video_render)
-		obs_source_main_render(source);
+	bool unchanged;
 
-	else if (source->filter_target)
-		obs_source_video_render(source->filter_target);
+	if (!source || !source->context.data)
+		return true;
+	if (source->video_dirty)
+		return false;
 
+	/* sources without a render callback only draw their async texture or
+	 * pass through to their target, which can't change without the
+	 * source being marked as dirty */
+	if (source->info.video_unchanged)
+		unchanged = source->info.video_unchanged(source->context.data);
 	else
-		obs_source_render_async_video(source);
-}
+		unchanged = !source->info.video_render;
 
-static uint32_t get_base_width(const obs_source_t *source)
-{
-	bool is_filter = (source->info.type == OBS_SOURCE_TYPE_FILTER);
+	if (!unchanged)
+		return false;
 
-	if (source->info.get_width && (!is_filter || source->enabled)) {
-		return source->info.get_width(source->context.data);
+	pthread_mutex_lock(&source->filter_mutex);
 
-	} else if (source->info.type == OBS_SOURCE_TYPE_FILTER) {
-		return get_base_width(source->filter_target);
+	for (size_t i = 0; i < source->filters.num; i++) {
+		if (!obs_source_video_unchanged(source->filters.array[i])) {
+			unchanged = false;
+			break;
+		}
 	}
 
-	return source->async_active ? source->async_width : 0;
+	pthread_mutex_unlock(&source->filter_mutex);
+
+	return unchanged;
 }
 
-static uint32_t get_base_height(const obs_source_t *source)
+static void render_video(obs_source_t *source);
+static bool obs_source_render_fused(obs_source_t *filter);
+
+static void obs_source_draw_cache(obs_source_t *source)
 {
-	bool is_filter = (source->info.type == OBS_SOURCE_TYPE_FILTER);
+	gs_texture_t   *tex      = gs_texrender_get_texture(
+			source->cache_texrender);
+	static struct gs_eparam_ref image_ref;
+	gs_effect_t    *effect   = gs_get_effect();
+	bool           def_draw  = (!effect);
+	gs_technique_t *tech     = NULL;
 
-	if (source->info.get_height && (!is_filter || source->enabled)) {
-		return source->info.get_height(source->context.data);
+	if (!tex)
+		return;
 
-	} else if (is_filter) {
-		return get_base_height(source->filter_target);
+	if (def_draw) {
+		effect = obs_get_default_effect();
+		tech = gs_effect_get_technique(effect, "Draw");
+		gs_technique_begin(tech);
+		gs_technique_begin_pass(tech, 0);
 	}
 
-	return source->async_active ? source->async_height : 0;
+	gs_effect_set_texture(gs_effect_get_param_ref(effect, &image_ref,
+				"image"), tex);
+	gs_draw_sprite(tex, 0, 0, 0);
+
+	if (def_draw) {
+		gs_technique_end_pass(tech);
+		gs_technique_end(tech);
+	}
 }
 
-static uint32_t get_recurse_width(obs_source_t *source)
+/* the cache texrender is reset in every video tick, so only the first render
+ * of a frame renders the source, the others just draw the result again */
+static void obs_source_render_cached(obs_source_t *source)
 {
-	uint32_t width;
+	uint32_t cx = obs_source_get_width(source);
+	uint32_t cy = obs_source_get_height(source);
 
-	pthread_mutex_lock(&source->filter_mutex);
+	if (!cx || !cy)
+		return;
+
+	if (!source->cache_texrender)
+		source->cache_texrender = gs_texrender_create_transient(
+				GS_RGBA, GS_ZS_NONE);
+
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
+
+	if (gs_texrender_begin(source->cache_texrender, cx, cy)) {
+		struct vec4 clear_color;
+
+		vec4_zero(&clear_color);
+		gs_clear(GS_CLEAR_COLOR, &clear_color, 0.0f, 0);
+		gs_ortho(0.0f, (float)cx, 0.0f, (float)cy, -100.0f, 100.0f);
+
+		source->rendering_cache = true;
+		render_video(source);
+		source->rendering_cache = false;
+
+		gs_texrender_end(source->cache_texrender);
+	}
+
+	gs_blend_state_pop();
+
+	obs_source_draw_cache(source);
+}
+
+/* source names can change, and the profiler keeps name pointers forever, so
+ * a copy is stored in the profiler's name store (again after a rename) */
+static const char *gpu_timing_name(obs_source_t *source)
+{
+	const char *name = source->context.name;
+
+	if (source->gpu_timing_name_src != name) {
+		source->gpu_timing_name = profile_store_name(
+				obs_get_profiler_name_store(), "%s",
+				name ? name : "(unnamed source)");
+		source->gpu_timing_name_src = name;
+	}
+
+	return source->gpu_timing_name;
+}
+
+static void source_video_render(obs_source_t *source)
+{
+	if (!source->context.data || !source->enabled) {
+		if (source->filter_parent)
+			obs_source_skip_video_filter(source);
+		return;
+	}
+
+	if (source->info.get_fusion_snippet && obs_source_render_fused(source))
+		return;
+
+	if (source->render_cache && !source->rendering_cache &&
+	    !source->rendering_filter)
+		obs_source_render_cached(source);
+	else
+		render_video(source);
+}
+
+void obs_source_video_render(obs_source_t *source)
+{
+	gs_memory_tracker_t *prev_vram;
+	bool timed;
+
+	if (!source) return;
+
+	if (source->info.type != OBS_SOURCE_TYPE_FILTER &&
+	    (source->info.output_flags & OBS_SOURCE_VIDEO) == 0)
+		return;
+
+	/* a source can be drawn in the frame it's shown again, before the
+	 * next tick resumes it */
+	if (source->suspended)
+		return;
+
+	/* filters render through here as well, so they're timed as children
+	 * of the source they filter */
+	timed = obs->video.gpu_timing.active;
+	if (timed)
+		gpu_timing_start(gpu_timing_name(source));
+
+	/* render targets of libobs itself, such as the filter and async
+	 * texture renders, are charged to the source being drawn */
+	prev_vram = gs_set_memory_tracker(source->context.vram_tracker);
+	source_video_render(source);
+	gs_set_memory_tracker(prev_vram);
+
+	if (timed)
+		gpu_timing_end();
+}
+
+static void render_video(obs_source_t *source)
+{
+	if (source->filters.num && !source->rendering_filter)
+		obs_source_render_filters(source);
+
+	else if (source->info.video_render)
+		obs_source_main_render(source);
+
+	else if (source->filter_target)
+		obs_source_video_render(source->filter_target);
+
+	else
+		obs_source_render_async_video(source);
+}
+
+static uint32_t get_base_width(const obs_source_t *source)
+{
+	bool is_filter = (source->info.type == OBS_SOURCE_TYPE_FILTER);
+
+	if (source->info.get_width && (!is_filter || source->enabled)) {
+		return source->info.get_width(source->context.data);
+
+	} else if (source->info.type == OBS_SOURCE_TYPE_FILTER) {
+		return get_base_width(source->filter_target);
+	}
+
+	return source->async_active ? source->async_width : 0;
+}
+
+static uint32_t get_base_height(const obs_source_t *source)
+{
+	bool is_filter = (source->info.type == OBS_SOURCE_TYPE_FILTER);
+
+	if (source->info.get_height && (!is_filter || source->enabled)) {
+		return source->info.get_height(source->context.data);
+
+	} else if (is_filter) {
+		return get_base_height(source->filter_target);
+	}
+
+	return source->async_active ? source->async_height : 0;
+}
+
+static uint32_t get_recurse_width(obs_source_t *source)
+{
+	uint32_t width;
+
+	pthread_mutex_lock(&source->filter_mutex);
 
 	width = (source->filters.num) ?
 		get_base_width(source->filters.array[0]) :
@@ -1541,10 +2111,13 @@ void obs_source_filter_add(obs_source_t *source, obs_source_t *filter)
 	filter->filter_target = !source->filters.num ?
 		source : source->filters.array[0];
 
-	da_insert(source->filters, 0, &filter);
+	da_small_insert(source->filters, 0, &filter);
 
 	pthread_mutex_unlock(&source->filter_mutex);
 
+	obs_source_mark_video_changed(source);
+	obs_source_mark_save_changed(source);
+
 	calldata_set_ptr(&cd, "source", source);
 	calldata_set_ptr(&cd, "filter", filter);
 
@@ -1577,6 +2150,9 @@ static bool obs_source_filter_remove_refless(obs_source_t *source,
 
 	pthread_mutex_unlock(&source->filter_mutex);
 
+	obs_source_mark_video_changed(source);
+	obs_source_mark_save_changed(source);
+
 	calldata_set_ptr(&cd, "source", source);
 	calldata_set_ptr(&cd, "filter", filter);
 
@@ -1692,8 +2268,11 @@ void obs_source_filter_set_order(obs_source_t *source, obs_source_t *filter,
 	success = move_filter_dir(source, filter, movement);
 	pthread_mutex_unlock(&source->filter_mutex);
 
-	if (success)
+	if (success) {
+		obs_source_mark_video_changed(source);
+		obs_source_mark_save_changed(source);
 		obs_source_dosignal(source, NULL, "reorder_filters");
+	}
 }
 
 obs_data_t *obs_source_get_settings(const obs_source_t *source)
@@ -1718,8 +2297,9 @@ static inline struct obs_source_frame *filter_async_video(obs_source_t *source,
 			continue;
 
 		if (filter->context.data && filter->info.filter_video) {
-			in = filter->info.filter_video(filter->context.data,
-					in);
+			CONTEXT_CALL(&filter->context,
+					in = filter->info.filter_video(
+						filter->context.data, in));
 			if (!in)
 				break;
 		}
@@ -1796,14 +2376,14 @@ static void copy_frame_data(struct obs_source_frame *dst,
 }
 
 static inline bool async_texture_changed(struct obs_source *source,
-		const struct obs_source_frame *frame)
+		enum video_format format, uint32_t width, uint32_t height)
 {
 	enum convert_type prev, cur;
 	prev = get_convert_type(source->async_cache_format);
-	cur  = get_convert_type(frame->format);
+	cur  = get_convert_type(format);
 
-	return source->async_cache_width  != frame->width ||
-	       source->async_cache_height != frame->height ||
+	return source->async_cache_width  != width ||
+	       source->async_cache_height != height ||
 	       prev != cur;
 }
 
@@ -1835,26 +2415,81 @@ static void clean_cache(obs_source_t *source)
 }
 
 #define MAX_ASYNC_FRAMES 30
+#define MAX_JITTER_DEPTH 8
 
-static inline struct obs_source_frame *cache_video(struct obs_source *source,
-		const struct obs_source_frame *frame)
+/* frames are held back by twice the average arrival jitter, which covers
+ * nearly all late frames without adding more latency than needed */
+static inline void update_jitter_depth(struct obs_source *source)
 {
-	struct obs_source_frame *new_frame = NULL;
+	uint64_t interval = source->async_frame_interval;
+	uint64_t depth;
 
-	pthread_mutex_lock(&source->async_mutex);
+	if (!interval)
+		return;
+
+	depth = (source->async_jitter * 2 + interval - 1) / interval;
+	source->async_jitter_depth = depth > MAX_JITTER_DEPTH ?
+		MAX_JITTER_DEPTH : (uint32_t)depth;
+}
+
+static inline void smooth_estimate(uint64_t *estimate, uint64_t val)
+{
+	int64_t diff = (int64_t)val - (int64_t)*estimate;
+	*estimate = (uint64_t)((int64_t)*estimate + diff / 16);
+}
+
+/* measures how irregularly frames arrive compared to their timestamps
+ * before queuing them.  async_mutex must be locked */
+static void queue_async_frame(struct obs_source *source,
+		struct obs_source_frame *frame)
+{
+	uint64_t now = os_gettime_ns();
+
+	if (source->async_last_arrival &&
+	    frame->timestamp > source->async_last_queued_ts) {
+		uint64_t ts_delta = frame->timestamp -
+			source->async_last_queued_ts;
+		uint64_t arrival_delta = now - source->async_last_arrival;
+
+		/* gaps in delivery and timestamp jumps aren't jitter */
+		if (ts_delta < MAX_TS_VAR && arrival_delta < MAX_TS_VAR) {
+			if (!source->async_frame_interval)
+				source->async_frame_interval = ts_delta;
+			else
+				smooth_estimate(&source->async_frame_interval,
+						ts_delta);
+
+			smooth_estimate(&source->async_jitter,
+					uint64_diff(arrival_delta, ts_delta));
+			update_jitter_depth(source);
+		}
+	}
+
+	source->async_last_arrival   = now;
+	source->async_last_queued_ts = frame->timestamp;
+
+	da_push_back(source->async_frames, &frame);
+}
+
+/* returns an unused frame from the cache with an extra reference held for
+ * the writer, or NULL if too many frames are queued.  async_mutex must be
+ * locked */
+static struct obs_source_frame *get_cached_frame(struct obs_source *source,
+		enum video_format format, uint32_t width, uint32_t height)
+{
+	struct obs_source_frame *new_frame = NULL;
 
 	if (source->async_frames.num >= MAX_ASYNC_FRAMES) {
 		free_async_cache(source);
 		source->last_frame_ts = 0;
-		pthread_mutex_unlock(&source->async_mutex);
 		return NULL;
 	}
 
-	if (async_texture_changed(source, frame)) {
+	if (async_texture_changed(source, format, width, height)) {
 		free_async_cache(source);
-		source->async_cache_width  = frame->width;
-		source->async_cache_height = frame->height;
-		source->async_cache_format = frame->format;
+		source->async_cache_width  = width;
+		source->async_cache_height = height;
+		source->async_cache_format = format;
 	}
 
 	for (size_t i = 0; i < source->async_cache.num; i++) {
@@ -1872,8 +2507,7 @@ static inline struct obs_source_frame *cache_video(struct obs_source *source,
 	if (!new_frame) {
 		struct async_frame new_af;
 
-		new_frame = obs_source_frame_create(frame->format,
-				frame->width, frame->height);
+		new_frame = obs_source_frame_create(format, width, height);
 		new_af.frame = new_frame;
 		new_af.used = true;
 		new_af.unused_count = 0;
@@ -1883,9 +2517,22 @@ static inline struct obs_source_frame *cache_video(struct obs_source *source,
 	}
 
 	os_atomic_inc_long(&new_frame->refs);
+	return new_frame;
+}
+
+static inline struct obs_source_frame *cache_video(struct obs_source *source,
+		const struct obs_source_frame *frame)
+{
+	struct obs_source_frame *new_frame;
 
+	pthread_mutex_lock(&source->async_mutex);
+	new_frame = get_cached_frame(source, frame->format,
+			frame->width, frame->height);
 	pthread_mutex_unlock(&source->async_mutex);
 
+	if (!new_frame)
+		return NULL;
+
 	copy_frame_data(new_frame, frame);
 
 	if (os_atomic_dec_long(&new_frame->refs) == 0) {
@@ -1914,12 +2561,196 @@ void obs_source_output_video(obs_source_t *source,
 
 	if (output) {
 		pthread_mutex_lock(&source->async_mutex);
-		da_push_back(source->async_frames, &output);
+		queue_async_frame(source, output);
 		pthread_mutex_unlock(&source->async_mutex);
 		source->async_active = true;
 	}
 }
 
+void obs_source_output_video_ref(obs_source_t *source,
+		const struct obs_source_frame *frame,
+		void (*release)(void *param), void *param)
+{
+	struct obs_source_frame *new_frame;
+	struct async_frame new_af;
+	bool queued = false;
+
+	if (!source || !frame) {
+		if (release)
+			release(param);
+		return;
+	}
+
+	new_frame = bmalloc(sizeof(*new_frame));
+	*new_frame = *frame;
+	new_frame->refs = 1;
+	new_frame->release = release;
+	new_frame->release_param = param;
+
+	pthread_mutex_lock(&source->async_mutex);
+
+	if (source->async_frames.num >= MAX_ASYNC_FRAMES) {
+		free_async_cache(source);
+		source->last_frame_ts = 0;
+
+	} else {
+		if (async_texture_changed(source, frame->format,
+					frame->width, frame->height)) {
+			free_async_cache(source);
+			source->async_cache_width  = frame->width;
+			source->async_cache_height = frame->height;
+			source->async_cache_format = frame->format;
+		}
+
+		new_af.frame = new_frame;
+		new_af.used = true;
+		new_af.unused_count = 0;
+
+		da_push_back(source->async_cache, &new_af);
+		queue_async_frame(source, new_frame);
+		queued = true;
+	}
+
+	pthread_mutex_unlock(&source->async_mutex);
+
+	if (queued)
+		source->async_active = true;
+	else
+		obs_source_frame_destroy(new_frame);
+}
+
+struct obs_source_frame *obs_source_frame_acquire(obs_source_t *source,
+		enum video_format format, uint32_t width, uint32_t height)
+{
+	struct obs_source_frame *frame;
+
+	if (!obs_source_valid(source, "obs_source_frame_acquire"))
+		return NULL;
+	if (format == VIDEO_FORMAT_NONE || !width || !height)
+		return NULL;
+
+	pthread_mutex_lock(&source->async_mutex);
+	frame = get_cached_frame(source, format, width, height);
+	pthread_mutex_unlock(&source->async_mutex);
+
+	if (frame) {
+		frame->timestamp  = 0;
+		frame->full_range = false;
+		frame->flip       = false;
+	}
+
+	return frame;
+}
+
+void obs_source_frame_submit(obs_source_t *source,
+		struct obs_source_frame *frame)
+{
+	if (!source || !frame)
+		return;
+
+	pthread_mutex_lock(&source->async_mutex);
+
+	/* the cache may have been flushed while the frame was being filled,
+	 * in which case the writer holds the last reference */
+	if (os_atomic_dec_long(&frame->refs) == 0) {
+		obs_source_frame_destroy(frame);
+		frame = NULL;
+	} else {
+		queue_async_frame(source, frame);
+	}
+
+	pthread_mutex_unlock(&source->async_mutex);
+
+	if (frame)
+		source->async_active = true;
+}
+
+void obs_source_frame_discard(obs_source_t *source,
+		struct obs_source_frame *frame)
+{
+	if (!source || !frame)
+		return;
+
+	pthread_mutex_lock(&source->async_mutex);
+
+	if (os_atomic_dec_long(&frame->refs) == 0)
+		obs_source_frame_destroy(frame);
+	else
+		remove_async_frame(source, frame);
+
+	pthread_mutex_unlock(&source->async_mutex);
+}
+
+void obs_source_set_render_cache(obs_source_t *source, bool enable)
+{
+	if (!obs_source_valid(source, "obs_source_set_render_cache"))
+		return;
+	if (source->info.type == OBS_SOURCE_TYPE_FILTER)
+		return;
+
+	source->render_cache = enable;
+
+	if (!enable && source->cache_texrender) {
+		obs_enter_graphics();
+		gs_texrender_destroy(source->cache_texrender);
+		source->cache_texrender = NULL;
+		obs_leave_graphics();
+	}
+}
+
+bool obs_source_render_cache_enabled(const obs_source_t *source)
+{
+	return obs_source_valid(source, "obs_source_render_cache_enabled") ?
+		source->render_cache : false;
+}
+
+void obs_source_set_opaque(obs_source_t *source, bool opaque)
+{
+	if (!obs_source_valid(source, "obs_source_set_opaque"))
+		return;
+
+	source->opaque = opaque;
+}
+
+bool obs_source_opaque(const obs_source_t *source)
+{
+	if (!obs_source_valid(source, "obs_source_opaque"))
+		return false;
+
+	/* filters may change or add transparency */
+	return source->opaque && !source->filters.num;
+}
+
+void obs_source_set_async_uploads(obs_source_t *source, uint32_t count)
+{
+	if (!obs_source_valid(source, "obs_source_set_async_uploads"))
+		return;
+
+	if (count < 1)
+		count = 1;
+	else if (count > MAX_ASYNC_UPLOADS)
+		count = MAX_ASYNC_UPLOADS;
+
+	source->async_uploads = count;
+}
+
+uint32_t obs_source_get_async_uploads(const obs_source_t *source)
+{
+	return obs_source_valid(source, "obs_source_get_async_uploads") ?
+		source->async_uploads : 0;
+}
+
+void obs_source_flush_async_video(obs_source_t *source)
+{
+	if (!source)
+		return;
+
+	pthread_mutex_lock(&source->async_mutex);
+	free_async_cache(source);
+	source->last_frame_ts = 0;
+	pthread_mutex_unlock(&source->async_mutex);
+}
+
 static inline struct obs_audio_data *filter_async_audio(obs_source_t *source,
 		struct obs_audio_data *in)
 {
@@ -1931,8 +2762,9 @@ static inline struct obs_audio_data *filter_async_audio(obs_source_t *source,
 			continue;
 
 		if (filter->context.data && filter->info.filter_audio) {
-			in = filter->info.filter_audio(filter->context.data,
-					in);
+			CONTEXT_CALL(&filter->context,
+					in = filter->info.filter_audio(
+						filter->context.data, in));
 			if (!in)
 				return NULL;
 		}
@@ -1970,123 +2802,484 @@ static inline void reset_resampler(obs_source_t *source,
 	source->resampler = audio_resampler_create(&output_info,
 			&source->sample_info);
 
-	source->audio_failed = source->resampler == NULL;
-	if (source->resampler == NULL)
-		blog(LOG_ERROR, "creation of resampler failed");
+	source->audio_failed = source->resampler == NULL;
+	if (source->resampler == NULL)
+		blog(LOG_ERROR, "creation of resampler failed");
+}
+
+static int audio_tag = BMEM_TAG_UNTAGGED;
+
+static void copy_audio_data(obs_source_t *source,
+		const uint8_t *const data[], uint32_t frames, uint64_t ts)
+{
+	size_t planes    = audio_output_get_planes(obs->audio.audio);
+	size_t blocksize = audio_output_get_block_size(obs->audio.audio);
+	size_t size      = (size_t)frames * blocksize;
+	bool   resize    = source->audio_storage_size < size;
+
+	source->audio_data.frames    = frames;
+	source->audio_data.timestamp = ts;
+
+	for (size_t i = 0; i < planes; i++) {
+		/* ensure audio storage capacity */
+		if (resize) {
+			bfree(source->audio_data.data[i]);
+			source->audio_data.data[i] = bmalloc_tagged(size,
+					bmem_tag(&audio_tag, "audio buffers"));
+		}
+
+		memcpy(source->audio_data.data[i], data[i], size);
+	}
+
+	if (resize)
+		source->audio_storage_size = size;
+}
+
+/* TODO: SSE optimization */
+static void downmix_to_mono_planar(struct obs_source *source, uint32_t frames)
+{
+	size_t channels = audio_output_get_channels(obs->audio.audio);
+	float **data = (float**)source->audio_data.data;
+
+	audio_downmix_planar_float(data, channels, frames);
+}
+
+/* resamples/remixes new audio to the designated main audio output format */
+static void process_audio(obs_source_t *source,
+		const struct obs_source_audio *audio)
+{
+	uint32_t frames = audio->frames;
+	bool mono_output;
+
+	if (source->sample_info.samples_per_sec != audio->samples_per_sec ||
+	    source->sample_info.format          != audio->format          ||
+	    source->sample_info.speakers        != audio->speakers)
+		reset_resampler(source, audio);
+
+	if (source->audio_failed)
+		return;
+
+	if (source->resampler) {
+		uint8_t  *output[MAX_AV_PLANES];
+		uint64_t offset;
+
+		memset(output, 0, sizeof(output));
+
+		audio_resampler_resample(source->resampler,
+				output, &frames, &offset,
+				audio->data, audio->frames);
+
+		copy_audio_data(source, (const uint8_t *const *)output, frames,
+				audio->timestamp - offset);
+	} else {
+		copy_audio_data(source, audio->data, audio->frames,
+				audio->timestamp);
+	}
+
+	mono_output = audio_output_get_channels(obs->audio.audio) == 1;
+
+	if (!mono_output && (source->flags & OBS_SOURCE_FLAG_FORCE_MONO) != 0)
+		downmix_to_mono_planar(source, frames);
+}
+
+static inline bool has_audio_filters(const obs_source_t *source)
+{
+	for (size_t i = 0; i < source->filters.num; i++) {
+		const struct obs_source *filter = source->filters.array[i];
+
+		if (filter->enabled && filter->info.filter_audio)
+			return true;
+	}
+
+	return false;
+}
+
+/* audio already in the output format that nothing needs to modify can be
+ * sent on from the caller's buffers without being copied */
+static inline bool can_pass_through_audio(const obs_source_t *source,
+		const struct obs_source_audio *audio)
+{
+	bool mono_output = audio_output_get_channels(obs->audio.audio) == 1;
+
+	if (source->sample_info.samples_per_sec != audio->samples_per_sec ||
+	    source->sample_info.format          != audio->format          ||
+	    source->sample_info.speakers        != audio->speakers)
+		return false;
+	if (source->resampler || source->audio_failed)
+		return false;
+	if (!mono_output && (source->flags & OBS_SOURCE_FLAG_FORCE_MONO) != 0)
+		return false;
+
+	return !has_audio_filters(source);
+}
+
+static void output_audio_filtered(obs_source_t *source,
+		const struct obs_source_audio *audio)
+{
+	struct obs_audio_data *output;
+	struct obs_audio_data passthrough;
+
+	pthread_mutex_lock(&source->filter_mutex);
+
+	if (can_pass_through_audio(source, audio)) {
+		for (size_t i = 0; i < MAX_AV_PLANES; i++)
+			passthrough.data[i] = (uint8_t*)audio->data[i];
+
+		passthrough.frames    = audio->frames;
+		passthrough.timestamp = audio->timestamp;
+		output = &passthrough;
+	} else {
+		process_audio(source, audio);
+		output = filter_async_audio(source, &source->audio_data);
+	}
+
+	if (output) {
+		struct audio_data data;
+
+		for (int i = 0; i < MAX_AV_PLANES; i++)
+			data.data[i] = output->data[i];
+
+		data.frames    = output->frames;
+		data.timestamp = output->timestamp;
+
+		pthread_mutex_lock(&source->audio_mutex);
+		source_output_audio_line(source, &data);
+		pthread_mutex_unlock(&source->audio_mutex);
+	}
+
+	pthread_mutex_unlock(&source->filter_mutex);
+}
+
+/* a task filters at most this many packets before it requeues itself, so a
+ * source with a steady stream of audio doesn't occupy a thread for good */
+#define AUDIO_DSP_BATCH 4
+
+static void audio_dsp_task(void *param);
+
+static inline void schedule_audio_dsp(obs_source_t *source)
+{
+	if (!source->audio_dsp_scheduled) {
+		source->audio_dsp_scheduled = true;
+		os_task_pool_queue(obs->task_pool, audio_dsp_task, source,
+				OS_TASK_PRIORITY_HIGH, "audio filters");
+	}
+}
+
+static void copy_audio_dsp_packet(struct audio_dsp_packet *packet,
+		const struct obs_source_audio *audio)
+{
+	size_t planes = get_audio_planes(audio->format, audio->speakers);
+	size_t size   = get_audio_size(audio->format, audio->speakers,
+			audio->frames);
+
+	packet->audio = *audio;
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		if (i < planes && audio->data[i]) {
+			da_copy_array(packet->data[i], audio->data[i], size);
+			packet->audio.data[i] = packet->data[i].array;
+		} else {
+			packet->audio.data[i] = NULL;
+		}
+	}
+
+	packet->queued_time = os_gettime_ns();
+}
+
+/* returns false if the audio should be filtered on the calling thread.  once
+ * audio is queued, everything after it is queued too until the queue is
+ * empty again, so audio is never filtered out of order */
+static bool queue_audio_dsp(obs_source_t *source,
+		const struct obs_source_audio *audio)
+{
+	bool offload = (source->flags &
+			OBS_SOURCE_FLAG_OFFLOAD_AUDIO_FILTERS) != 0;
+	bool filters = false;
+	size_t idx;
+
+	if (offload) {
+		pthread_mutex_lock(&source->filter_mutex);
+		filters = has_audio_filters(source);
+		pthread_mutex_unlock(&source->filter_mutex);
+	}
+
+	pthread_mutex_lock(&source->audio_dsp_mutex);
+
+	if (!source->audio_dsp_count && !(offload && filters)) {
+		pthread_mutex_unlock(&source->audio_dsp_mutex);
+		return false;
+	}
+
+	if (source->audio_dsp_count == AUDIO_DSP_QUEUE_SIZE) {
+		source->audio_dsp_dropped++;
+
+		if (!source->audio_dsp_queue_full) {
+			blog(LOG_WARNING, "Source '%s' audio filters aren't "
+					"keeping up, dropping audio",
+					source->context.name);
+			source->audio_dsp_queue_full = true;
+		}
+
+		pthread_mutex_unlock(&source->audio_dsp_mutex);
+		return true;
+	}
+
+	source->audio_dsp_queue_full = false;
+
+	idx = (source->audio_dsp_read + source->audio_dsp_count) &
+		AUDIO_DSP_QUEUE_MASK;
+	copy_audio_dsp_packet(&source->audio_dsp_queue[idx], audio);
+	source->audio_dsp_count++;
+
+	schedule_audio_dsp(source);
+
+	pthread_mutex_unlock(&source->audio_dsp_mutex);
+	return true;
+}
+
+static inline void update_audio_dsp_latency(obs_source_t *source,
+		uint64_t latency)
+{
+	int64_t diff = (int64_t)latency - (int64_t)source->audio_dsp_latency;
+	source->audio_dsp_latency =
+		(uint64_t)((int64_t)source->audio_dsp_latency + diff / 16);
+
+	if (latency > source->audio_dsp_max_latency)
+		source->audio_dsp_max_latency = latency;
+}
+
+/* the packet at the front stays queued while it's being filtered, so the
+ * producer can't reuse it until it's done */
+static void audio_dsp_task(void *param)
+{
+	obs_source_t *source = param;
+
+	for (size_t i = 0; i < AUDIO_DSP_BATCH; i++) {
+		struct audio_dsp_packet *packet;
+
+		pthread_mutex_lock(&source->audio_dsp_mutex);
+		if (!source->audio_dsp_count) {
+			source->audio_dsp_scheduled = false;
+			pthread_mutex_unlock(&source->audio_dsp_mutex);
+			return;
+		}
+		packet = &source->audio_dsp_queue[source->audio_dsp_read];
+		pthread_mutex_unlock(&source->audio_dsp_mutex);
+
+		output_audio_filtered(source, &packet->audio);
+
+		pthread_mutex_lock(&source->audio_dsp_mutex);
+		update_audio_dsp_latency(source,
+				os_gettime_ns() - packet->queued_time);
+		source->audio_dsp_read = (source->audio_dsp_read + 1) &
+			AUDIO_DSP_QUEUE_MASK;
+		source->audio_dsp_count--;
+		pthread_mutex_unlock(&source->audio_dsp_mutex);
+	}
+
+	pthread_mutex_lock(&source->audio_dsp_mutex);
+	source->audio_dsp_scheduled = false;
+	if (source->audio_dsp_count)
+		schedule_audio_dsp(source);
+	pthread_mutex_unlock(&source->audio_dsp_mutex);
 }
 
-static void copy_audio_data(obs_source_t *source,
-		const uint8_t *const data[], uint32_t frames, uint64_t ts)
+/* nothing new is queued once the source is being destroyed, as new audio
+ * is only queued behind audio that's already waiting */
+static void wait_for_audio_dsp(obs_source_t *source)
 {
-	size_t planes    = audio_output_get_planes(obs->audio.audio);
-	size_t blocksize = audio_output_get_block_size(obs->audio.audio);
-	size_t size      = (size_t)frames * blocksize;
-	bool   resize    = source->audio_storage_size < size;
+	while (true) {
+		bool scheduled;
 
-	source->audio_data.frames    = frames;
-	source->audio_data.timestamp = ts;
+		pthread_mutex_lock(&source->audio_dsp_mutex);
+		source->flags &= ~OBS_SOURCE_FLAG_OFFLOAD_AUDIO_FILTERS;
+		scheduled = source->audio_dsp_scheduled;
+		pthread_mutex_unlock(&source->audio_dsp_mutex);
 
-	for (size_t i = 0; i < planes; i++) {
-		/* ensure audio storage capacity */
-		if (resize) {
-			bfree(source->audio_data.data[i]);
-			source->audio_data.data[i] = bmalloc(size);
-		}
+		if (!scheduled)
+			break;
 
-		memcpy(source->audio_data.data[i], data[i], size);
+		os_sleep_ms(1);
 	}
+}
 
-	if (resize)
-		source->audio_storage_size = size;
+void obs_source_output_audio(obs_source_t *source,
+		const struct obs_source_audio *audio)
+{
+	if (!source || !audio)
+		return;
+
+	if (!queue_audio_dsp(source, audio))
+		output_audio_filtered(source, audio);
 }
 
-/* TODO: SSE optimization */
-static void downmix_to_mono_planar(struct obs_source *source, uint32_t frames)
+bool obs_source_get_audio_filter_stats(const obs_source_t *source,
+		struct obs_source_audio_filter_stats *stats)
 {
-	size_t channels = audio_output_get_channels(obs->audio.audio);
-	const float channels_i = 1.0f / (float)channels;
-	float **data = (float**)source->audio_data.data;
+	if (!source || !stats)
+		return false;
+	if ((source->flags & OBS_SOURCE_FLAG_OFFLOAD_AUDIO_FILTERS) == 0)
+		return false;
 
-	for (size_t channel = 1; channel < channels; channel++) {
-		for (uint32_t frame = 0; frame < frames; frame++)
-			data[0][frame] += data[channel][frame];
-	}
+	/* read without the mutex, the values are only informational */
+	stats->queued_packets  = (uint32_t)source->audio_dsp_count;
+	stats->latency_ms      = (uint32_t)(source->audio_dsp_latency /
+			1000000);
+	stats->max_latency_ms  = (uint32_t)(source->audio_dsp_max_latency /
+			1000000);
+	stats->dropped_packets = source->audio_dsp_dropped;
+	return true;
+}
+
+static inline void get_mix_format(struct obs_source_audio *audio)
+{
+	const struct audio_output_info *info =
+		audio_output_get_info(obs->audio.audio);
 
-	for (uint32_t frame = 0; frame < frames; frame++)
-		data[0][frame] *= channels_i;
+	memset(audio, 0, sizeof(*audio));
+	audio->format          = info->format;
+	audio->speakers        = info->speakers;
+	audio->samples_per_sec = info->samples_per_sec;
+}
+
+static void acquire_pooled_audio(obs_source_t *source, uint32_t frames)
+{
+	size_t planes = audio_output_get_planes(obs->audio.audio);
+	size_t size   = frames * audio_output_get_block_size(obs->audio.audio);
 
-	for (size_t channel = 1; channel < channels; channel++) {
-		for (uint32_t frame = 0; frame < frames; frame++)
-			data[channel][frame] = data[0][frame];
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		if (i < planes) {
+			da_resize(source->audio_pool[i], size);
+			source->acquired_audio.data[i] =
+				source->audio_pool[i].array;
+		} else {
+			source->acquired_audio.data[i] = NULL;
+		}
 	}
 }
 
-/* resamples/remixes new audio to the designated main audio output format */
-static void process_audio(obs_source_t *source,
-		const struct obs_source_audio *audio)
+struct obs_audio_data *obs_source_audio_acquire(obs_source_t *source,
+		uint32_t frames)
 {
-	uint32_t frames = audio->frames;
-	bool mono_output;
+	struct obs_source_audio format;
+	bool to_line = false;
 
-	if (source->sample_info.samples_per_sec != audio->samples_per_sec ||
-	    source->sample_info.format          != audio->format          ||
-	    source->sample_info.speakers        != audio->speakers)
-		reset_resampler(source, audio);
+	if (!obs_source_valid(source, "obs_source_audio_acquire"))
+		return NULL;
+	if ((source->info.output_flags & OBS_SOURCE_AUDIO) == 0 || !frames)
+		return NULL;
+	if (source->audio_acquired) {
+		blog(LOG_WARNING, "obs_source_audio_acquire: audio of source "
+				"'%s' is already acquired",
+				source->context.name);
+		return NULL;
+	}
 
-	if (source->audio_failed)
-		return;
+	get_mix_format(&format);
 
-	if (source->resampler) {
-		uint8_t  *output[MAX_AV_PLANES];
-		uint64_t offset;
+	pthread_mutex_lock(&source->filter_mutex);
 
-		memset(output, 0, sizeof(output));
+	if (source->sample_info.samples_per_sec != format.samples_per_sec ||
+	    source->sample_info.format          != format.format          ||
+	    source->sample_info.speakers        != format.speakers)
+		reset_resampler(source, &format);
 
-		audio_resampler_resample(source->resampler,
-				output, &frames, &offset,
-				audio->data, audio->frames);
+	/* audio_mutex is held until the audio is submitted, like it is
+	 * while obs_source_output_audio sends audio to the line */
+	if (can_pass_through_audio(source, &format) &&
+	    !source->audio_dsp_count) {
+		pthread_mutex_lock(&source->audio_mutex);
 
-		copy_audio_data(source, (const uint8_t *const *)output, frames,
-				audio->timestamp - offset);
-	} else {
-		copy_audio_data(source, audio->data, audio->frames,
-				audio->timestamp);
+		to_line = audio_line_acquire(source->audio_line, frames,
+				source->acquired_audio.data);
+		if (!to_line)
+			pthread_mutex_unlock(&source->audio_mutex);
 	}
 
-	mono_output = audio_output_get_channels(obs->audio.audio) == 1;
+	pthread_mutex_unlock(&source->filter_mutex);
 
-	if (!mono_output && (source->flags & OBS_SOURCE_FLAG_FORCE_MONO) != 0)
-		downmix_to_mono_planar(source, frames);
+	if (!to_line)
+		acquire_pooled_audio(source, frames);
+
+	source->acquired_audio.frames    = frames;
+	source->acquired_audio.timestamp = 0;
+	source->audio_acquired           = true;
+	source->audio_acquired_line      = to_line;
+	return &source->acquired_audio;
 }
 
-void obs_source_output_audio(obs_source_t *source,
-		const struct obs_source_audio *audio)
+static inline bool valid_acquired_audio(const obs_source_t *source,
+		const struct obs_audio_data *audio, const char *f)
 {
-	struct obs_audio_data *output;
+	if (audio != &source->acquired_audio || !source->audio_acquired) {
+		blog(LOG_WARNING, "%s: audio of source '%s' wasn't acquired",
+				f, source->context.name);
+		return false;
+	}
+
+	return true;
+}
+
+void obs_source_audio_submit(obs_source_t *source,
+		struct obs_audio_data *audio)
+{
+	struct obs_source_audio output;
 
 	if (!source || !audio)
 		return;
+	if (!valid_acquired_audio(source, audio, "obs_source_audio_submit"))
+		return;
 
-	process_audio(source, audio);
+	source->audio_acquired = false;
 
-	pthread_mutex_lock(&source->filter_mutex);
-	output = filter_async_audio(source, &source->audio_data);
+	if (audio->frames > source->acquired_audio.frames)
+		audio->frames = source->acquired_audio.frames;
 
-	if (output) {
+	if (source->audio_acquired_line) {
 		struct audio_data data;
+		bool muted;
 
-		for (int i = 0; i < MAX_AV_PLANES; i++)
-			data.data[i] = output->data[i];
+		for (size_t i = 0; i < MAX_AV_PLANES; i++)
+			data.data[i] = audio->data[i];
 
-		data.frames    = output->frames;
-		data.timestamp = output->timestamp;
+		data.frames    = audio->frames;
+		data.timestamp = audio->timestamp;
+
+		muted = prepare_audio_line_data(source, &data);
+
+		/* volume is applied to the packet in place when it's
+		 * committed, so the unscaled audio is signalled first */
+		source_signal_audio_data(source, &data, muted);
+		audio_line_commit(source->audio_line, &data);
 
-		pthread_mutex_lock(&source->audio_mutex);
-		source_output_audio_line(source, &data);
 		pthread_mutex_unlock(&source->audio_mutex);
+		return;
 	}
 
-	pthread_mutex_unlock(&source->filter_mutex);
+	get_mix_format(&output);
+	for (size_t i = 0; i < MAX_AV_PLANES; i++)
+		output.data[i] = audio->data[i];
+
+	output.frames    = audio->frames;
+	output.timestamp = audio->timestamp;
+
+	obs_source_output_audio(source, &output);
+}
+
+void obs_source_audio_discard(obs_source_t *source,
+		struct obs_audio_data *audio)
+{
+	if (!source || !audio)
+		return;
+	if (!valid_acquired_audio(source, audio, "obs_source_audio_discard"))
+		return;
+
+	source->audio_acquired = false;
+
+	if (source->audio_acquired_line) {
+		audio_line_discard(source->audio_line);
+		pthread_mutex_unlock(&source->audio_mutex);
+	}
 }
 
 static inline bool frame_out_of_bounds(const obs_source_t *source, uint64_t ts)
@@ -2097,6 +3290,8 @@ static inline bool frame_out_of_bounds(const obs_source_t *source, uint64_t ts)
 		return ((ts - source->last_frame_ts) > MAX_TS_VAR);
 }
 
+/* frames output by reference are not reused, they go back to their owner as
+ * soon as they are no longer needed */
 static void remove_async_frame(obs_source_t *source,
 		struct obs_source_frame *frame)
 {
@@ -2104,12 +3299,36 @@ static void remove_async_frame(obs_source_t *source,
 		struct async_frame *f = &source->async_cache.array[i];
 
 		if (f->frame == frame) {
-			f->used = false;
+			if (frame->release) {
+				da_erase(source->async_cache, i);
+				obs_source_frame_decref(frame);
+			} else {
+				f->used = false;
+			}
 			break;
 		}
 	}
 }
 
+#define JITTER_TRIM_NS 1000000000ULL
+
+/* late frames stall the presentation clock, which leaves frames queued up
+ * once delivery becomes regular again.  when more frames than needed have
+ * been queued for a while, one frame is skipped to reduce the latency. */
+static inline void trim_jitter_buffer(obs_source_t *source, uint64_t sys_time)
+{
+	if (source->async_frames.num <= source->async_jitter_depth + 1) {
+		source->async_excess_start = 0;
+
+	} else if (!source->async_excess_start) {
+		source->async_excess_start = sys_time;
+
+	} else if (sys_time - source->async_excess_start > JITTER_TRIM_NS) {
+		source->last_frame_ts += source->async_frame_interval;
+		source->async_excess_start = 0;
+	}
+}
+
 /* #define DEBUG_ASYNC_FRAMES 1 */
 
 static bool ready_async_frame(obs_source_t *source, uint64_t sys_time)
@@ -2151,6 +3370,8 @@ static bool ready_async_frame(obs_source_t *source, uint64_t sys_time)
 		source->last_frame_ts += sys_offset;
 	}
 
+	trim_jitter_buffer(source, sys_time);
+
 	while (source->last_frame_ts > next_frame->timestamp) {
 
 		/* this tries to reduce the needless frame duplication, also
@@ -2203,9 +3424,17 @@ static bool ready_async_frame(obs_source_t *source, uint64_t sys_time)
 static inline struct obs_source_frame *get_closest_frame(obs_source_t *source,
 		uint64_t sys_time)
 {
+	bool unbuffered = (source->flags & OBS_SOURCE_FLAG_UNBUFFERED) != 0;
+
 	if (!source->async_frames.num)
 		return NULL;
 
+	/* hold back enough frames to absorb the measured jitter before the
+	 * first frame is presented */
+	if (!source->last_frame_ts && !unbuffered &&
+	    source->async_frames.num <= source->async_jitter_depth)
+		return NULL;
+
 	if (!source->last_frame_ts || ready_async_frame(source, sys_time)) {
 		struct obs_source_frame *frame = source->async_frames.array[0];
 		da_erase(source->async_frames, 0);
@@ -2279,6 +3508,7 @@ void obs_source_set_name(obs_source_t *source, const char *name)
 		struct calldata data;
 		char *prev_name = bstrdup(source->context.name);
 		obs_context_data_setname(&source->context, name);
+		obs_source_mark_save_changed(source);
 
 		calldata_init(&data);
 		calldata_set_ptr(&data, "source", source);
@@ -2320,9 +3550,11 @@ static inline void render_filter_bypass(obs_source_t *target,
 static inline void render_filter_tex(gs_texture_t *tex, gs_effect_t *effect,
 		uint32_t width, uint32_t height, bool use_matrix)
 {
+	static struct gs_eparam_ref image_ref;
 	const char  *tech_name = use_matrix ? "DrawMatrix" : "Draw";
 	gs_technique_t *tech    = gs_effect_get_technique(effect, tech_name);
-	gs_eparam_t    *image   = gs_effect_get_param_by_name(effect, "image");
+	gs_eparam_t    *image   = gs_effect_get_param_ref(effect, &image_ref,
+			"image");
 	size_t      passes, i;
 
 	gs_effect_set_texture(image, tex);
@@ -2336,28 +3568,41 @@ static inline void render_filter_tex(gs_texture_t *tex, gs_effect_t *effect,
 	gs_technique_end(tech);
 }
 
+/* async frames are drawn by libobs itself with whatever effect is current,
+ * so they can be drawn through the filter's effect too, as long as the
+ * filter handles the YUV of the frame in its DrawMatrix technique */
 static inline bool can_bypass(obs_source_t *target, obs_source_t *parent,
 		uint32_t parent_flags,
 		enum obs_allow_direct_render allow_direct)
 {
-	return (target == parent) &&
-		(allow_direct == OBS_ALLOW_DIRECT_RENDERING) &&
-		((parent_flags & OBS_SOURCE_CUSTOM_DRAW) == 0) &&
-		((parent_flags & OBS_SOURCE_ASYNC) == 0);
+	if (target != parent || allow_direct == OBS_NO_DIRECT_RENDERING ||
+	    (parent_flags & OBS_SOURCE_CUSTOM_DRAW) != 0)
+		return false;
+
+	if ((parent_flags & OBS_SOURCE_ASYNC) == 0)
+		return true;
+
+	return allow_direct == OBS_ALLOW_DIRECT_YUV_RENDERING &&
+		!parent->info.video_render;
+}
+
+static inline bool bypass_uses_matrix(obs_source_t *target,
+		uint32_t target_flags)
+{
+	if ((target_flags & OBS_SOURCE_ASYNC) != 0)
+		return format_is_yuv(target->async_format);
+	return (target_flags & OBS_SOURCE_COLOR_MATRIX) != 0;
 }
 
-void obs_source_process_filter_begin(obs_source_t *filter,
+static void process_filter_begin(obs_source_t *filter, obs_source_t *target,
 		enum gs_color_format format,
 		enum obs_allow_direct_render allow_direct)
 {
-	obs_source_t *target, *parent;
+	obs_source_t *parent;
 	uint32_t     target_flags, parent_flags;
 	int          cx, cy;
 	bool         use_matrix;
 
-	if (!filter) return;
-
-	target       = obs_filter_get_target(filter);
 	parent       = obs_filter_get_parent(filter);
 	target_flags = target->info.output_flags;
 	parent_flags = parent->info.output_flags;
@@ -2372,12 +3617,14 @@ void obs_source_process_filter_begin(obs_source_t *filter,
 	 * using the filter effect instead of rendering to texture to reduce
 	 * the total number of passes */
 	if (can_bypass(target, parent, parent_flags, allow_direct)) {
+		if ((parent_flags & OBS_SOURCE_ASYNC) != 0)
+			obs_source_update_async_video(target);
 		return;
 	}
 
 	if (!filter->filter_texrender)
-		filter->filter_texrender = gs_texrender_create(format,
-				GS_ZS_NONE);
+		filter->filter_texrender = gs_texrender_create_transient(
+				format, GS_ZS_NONE);
 
 	gs_blend_state_push();
 	gs_blend_function(GS_BLEND_ONE, GS_BLEND_ZERO);
@@ -2402,28 +3649,270 @@ void obs_source_process_filter_begin(obs_source_t *filter,
 	gs_blend_state_pop();
 }
 
-void obs_source_process_filter_end(obs_source_t *filter, gs_effect_t *effect,
-		uint32_t width, uint32_t height)
+void obs_source_process_filter_begin(obs_source_t *filter,
+		enum gs_color_format format,
+		enum obs_allow_direct_render allow_direct)
 {
-	obs_source_t *target, *parent;
+	if (!filter) return;
+
+	process_filter_begin(filter, obs_filter_get_target(filter), format,
+			allow_direct);
+}
+
+static void process_filter_end(obs_source_t *filter, obs_source_t *target,
+		gs_effect_t *effect, uint32_t width, uint32_t height)
+{
+	obs_source_t *parent;
 	gs_texture_t *texture;
 	uint32_t     target_flags, parent_flags;
 	bool         use_matrix;
 
-	if (!filter) return;
-
-	target       = obs_filter_get_target(filter);
 	parent       = obs_filter_get_parent(filter);
 	target_flags = target->info.output_flags;
 	parent_flags = parent->info.output_flags;
 	use_matrix   = !!(target_flags & OBS_SOURCE_COLOR_MATRIX);
 
 	if (can_bypass(target, parent, parent_flags, filter->allow_direct)) {
-		render_filter_bypass(target, effect, use_matrix);
+		render_filter_bypass(target, effect,
+				bypass_uses_matrix(target, target_flags));
 	} else {
 		texture = gs_texrender_get_texture(filter->filter_texrender);
-		render_filter_tex(texture, effect, width, height, use_matrix);
+		if (texture)
+			render_filter_tex(texture, effect, width, height,
+					use_matrix);
+	}
+}
+
+void obs_source_process_filter_end(obs_source_t *filter, gs_effect_t *effect,
+		uint32_t width, uint32_t height)
+{
+	if (!filter) return;
+
+	process_filter_end(filter, obs_filter_get_target(filter), effect,
+			width, height);
+}
+
+/* ------------------------------------------------------------------------- */
+/* filter fusion */
+
+#define MAX_FUSED_FILTERS 8
+
+static const char *fused_effect_header =
+"uniform float4x4 ViewProj;\n"
+"uniform float4x4 color_matrix;\n"
+"uniform float3 color_range_min = {0.0, 0.0, 0.0};\n"
+"uniform float3 color_range_max = {1.0, 1.0, 1.0};\n"
+"uniform texture2d image;\n"
+"\n"
+"sampler_state def_sampler {\n"
+"\tFilter   = Linear;\n"
+"\tAddressU = Clamp;\n"
+"\tAddressV = Clamp;\n"
+"};\n"
+"\n"
+"struct VertInOut {\n"
+"\tfloat4 pos : POSITION;\n"
+"\tfloat2 uv  : TEXCOORD0;\n"
+"};\n"
+"\n"
+"VertInOut VSDefault(VertInOut vert_in)\n"
+"{\n"
+"\tVertInOut vert_out;\n"
+"\tvert_out.pos = mul(float4(vert_in.pos.xyz, 1.0), ViewProj);\n"
+"\tvert_out.uv  = vert_in.uv;\n"
+"\treturn vert_out;\n"
+"}\n"
+"\n";
+
+static const char *fused_effect_footer =
+"float4 PSDrawBare(VertInOut vert_in) : TARGET\n"
+"{\n"
+"\treturn FusedProcess(image.Sample(def_sampler, vert_in.uv));\n"
+"}\n"
+"\n"
+"float4 PSDrawMatrix(VertInOut vert_in) : TARGET\n"
+"{\n"
+"\tfloat4 yuv = image.Sample(def_sampler, vert_in.uv);\n"
+"\tyuv.xyz = clamp(yuv.xyz, color_range_min, color_range_max);\n"
+"\treturn FusedProcess(saturate(mul(float4(yuv.xyz, 1.0),\n"
+"\t\t\tcolor_matrix)));\n"
+"}\n"
+"\n"
+"technique Draw\n"
+"{\n"
+"\tpass\n"
+"\t{\n"
+"\t\tvertex_shader = VSDefault(vert_in);\n"
+"\t\tpixel_shader  = PSDrawBare(vert_in);\n"
+"\t}\n"
+"}\n"
+"\n"
+"technique DrawMatrix\n"
+"{\n"
+"\tpass\n"
+"\t{\n"
+"\t\tvertex_shader = VSDefault(vert_in);\n"
+"\t\tpixel_shader  = PSDrawMatrix(vert_in);\n"
+"\t}\n"
+"}\n";
+
+static inline void get_fused_prefix(char *prefix, size_t size, size_t idx)
+{
+	snprintf(prefix, size, "f%d_", (int)idx);
+}
+
+static inline bool filter_fusible(const obs_source_t *filter)
+{
+	return filter->info.type == OBS_SOURCE_TYPE_FILTER &&
+		filter->context.data &&
+		filter->info.get_fusion_snippet &&
+		filter->info.update_fused_params;
+}
+
+/* collects the enabled fusible filters starting at the filter, outermost
+ * first, and returns the source that the innermost one draws from */
+static size_t get_fused_filters(obs_source_t *filter, obs_source_t **stages,
+		obs_source_t **target)
+{
+	size_t num = 0;
+
+	while (filter && num < MAX_FUSED_FILTERS) {
+		if (filter->info.type == OBS_SOURCE_TYPE_FILTER &&
+		    (!filter->enabled || !filter->context.data)) {
+			filter = filter->filter_target;
+			continue;
+		}
+
+		if (!filter_fusible(filter))
+			break;
+
+		stages[num++] = filter;
+		filter = filter->filter_target;
+	}
+
+	*target = filter;
+	return num;
+}
+
+static void build_fused_key(struct dstr *key, obs_source_t **stages,
+		size_t num)
+{
+	dstr_free(key);
+
+	for (size_t i = 0; i < num; i++) {
+		const char *snippet =
+			stages[i]->info.get_fusion_snippet(
+					stages[i]->context.data);
+
+		dstr_cat(key, snippet ? snippet : "");
+		dstr_cat_ch(key, '\n');
+	}
+}
+
+static gs_effect_t *create_fused_effect(obs_source_t **stages, size_t num)
+{
+	struct dstr shader = {0};
+	struct dstr snippet = {0};
+	char        prefix[16];
+	char        *errors = NULL;
+	gs_effect_t *effect;
+
+	dstr_copy(&shader, fused_effect_header);
+
+	for (size_t i = 0; i < num; i++) {
+		get_fused_prefix(prefix, sizeof(prefix), i);
+		dstr_copy(&snippet, stages[i]->info.get_fusion_snippet(
+					stages[i]->context.data));
+		dstr_replace(&snippet, "$", prefix);
+		dstr_cat_dstr(&shader, &snippet);
+		dstr_cat(&shader, "\n");
+	}
+
+	/* the innermost filter is applied first, and the result is clamped
+	 * between stages just as an 8-bit intermediate texture would be */
+	dstr_cat(&shader, "float4 FusedProcess(float4 rgba)\n{\n");
+	for (size_t i = num; i > 0; i--) {
+		get_fused_prefix(prefix, sizeof(prefix), i - 1);
+		dstr_catf(&shader, "\trgba = saturate(%sprocess(rgba));\n",
+				prefix);
+	}
+	dstr_cat(&shader, "\treturn rgba;\n}\n\n");
+	dstr_cat(&shader, fused_effect_footer);
+
+	effect = gs_effect_create(shader.array, "fused-filters", &errors);
+	if (!effect)
+		blog(LOG_WARNING, "Failed to fuse %d filters starting at "
+		                  "'%s', falling back to separate passes: %s",
+		                  (int)num, obs_source_get_name(stages[0]),
+		                  errors ? errors : "(unknown error)");
+
+	bfree(errors);
+	dstr_free(&snippet);
+	dstr_free(&shader);
+	return effect;
+}
+
+/* draws a run of per-pixel filters in one pass, returns false if the filter
+ * has to be rendered normally */
+static bool obs_source_render_fused(obs_source_t *filter)
+{
+	obs_source_t *stages[MAX_FUSED_FILTERS];
+	obs_source_t *target;
+	struct dstr  key = {0};
+	char         prefix[16];
+	size_t       num;
+
+	if (!filter_fusible(filter) || !filter->filter_parent)
+		return false;
+
+	num = get_fused_filters(filter, stages, &target);
+	if (num < 2 || !target)
+		return false;
+
+	build_fused_key(&key, stages, num);
+
+	if (!filter->fused_key.array || dstr_cmp(&key, filter->fused_key.array)
+			!= 0) {
+		gs_effect_destroy(filter->fused_effect);
+		dstr_move(&filter->fused_key, &key);
+		filter->fused_effect = create_fused_effect(stages, num);
+		filter->fused_failed = !filter->fused_effect;
 	}
+
+	dstr_free(&key);
+
+	if (filter->fused_failed)
+		return false;
+
+	process_filter_begin(filter, target, GS_RGBA,
+			OBS_ALLOW_DIRECT_YUV_RENDERING);
+
+	for (size_t i = 0; i < num; i++) {
+		get_fused_prefix(prefix, sizeof(prefix), i);
+		stages[i]->info.update_fused_params(stages[i]->context.data,
+				filter->fused_effect, prefix);
+	}
+
+	process_filter_end(filter, target, filter->fused_effect,
+			get_base_width(target), get_base_height(target));
+	return true;
+}
+
+gs_eparam_t *obs_filter_get_fused_param(gs_effect_t *effect,
+		const char *prefix, const char *name)
+{
+	struct dstr  param_name = {0};
+	gs_eparam_t *param;
+
+	if (!effect || !prefix || !name)
+		return NULL;
+
+	dstr_copy(&param_name, prefix);
+	dstr_cat(&param_name, name);
+	param = gs_effect_get_param_by_name(effect, param_name.array);
+	dstr_free(&param_name);
+
+	return param;
 }
 
 void obs_source_skip_video_filter(obs_source_t *filter)
@@ -2455,6 +3944,61 @@ void obs_source_skip_video_filter(obs_source_t *filter)
 	}
 }
 
+static inline bool crop_drawable(const obs_source_t *source)
+{
+	uint32_t flags = source->info.output_flags;
+
+	if (source->info.type == OBS_SOURCE_TYPE_FILTER ||
+	    !source->context.data)
+		return false;
+
+	/* filters and the render cache draw through their own textures */
+	if (!source->rendering_filter && (source->filters.num ||
+	     (source->render_cache && !source->rendering_cache)))
+		return false;
+
+	if ((flags & OBS_SOURCE_UV_CROP) != 0)
+		return true;
+
+	return (flags & OBS_SOURCE_ASYNC) != 0 &&
+		(flags & OBS_SOURCE_CUSTOM_DRAW) == 0;
+}
+
+bool obs_source_video_render_crop(obs_source_t *source,
+		const struct obs_source_crop *crop)
+{
+	struct obs_draw_crop prev;
+	uint32_t flags;
+	bool custom_draw, async;
+
+	if (!source || !crop || !crop_drawable(source))
+		return false;
+
+	flags       = source->info.output_flags;
+	custom_draw = (flags & OBS_SOURCE_CUSTOM_DRAW) != 0;
+	async       = (flags & OBS_SOURCE_ASYNC) != 0;
+
+	prev = obs->video.draw_crop;
+	obs->video.draw_crop.active = true;
+	obs->video.draw_crop.crop   = *crop;
+	obs->video.draw_crop.cx     = get_base_width(source);
+	obs->video.draw_crop.cy     = get_base_height(source);
+
+	if (!source->enabled) {
+		/* disabled sources draw nothing */
+	} else if (!custom_draw && !async) {
+		obs_source_default_render(source,
+				(flags & OBS_SOURCE_COLOR_MATRIX) != 0);
+	} else if (source->info.video_render) {
+		obs_source_main_render(source);
+	} else {
+		obs_source_render_async_video(source);
+	}
+
+	obs->video.draw_crop = prev;
+	return true;
+}
+
 signal_handler_t *obs_source_get_signal_handler(const obs_source_t *source)
 {
 	return source ? source->context.signals : NULL;
@@ -2468,17 +4012,21 @@ proc_handler_t *obs_source_get_proc_handler(const obs_source_t *source)
 void obs_source_set_volume(obs_source_t *source, float volume)
 {
 	if (source) {
-		struct calldata data = {0};
+		struct calldata data;
+		uint8_t stack[128];
+
+		calldata_init_fixed(&data, stack, sizeof(stack));
 		calldata_set_ptr(&data, "source", source);
 		calldata_set_float(&data, "volume", volume);
 
-		signal_handler_signal(source->context.signals, "volume", &data);
+		signal_emit(source->volume_signal, &data);
 		signal_handler_signal(obs->signals, "source_volume", &data);
 
 		volume = (float)calldata_float(&data, "volume");
 		calldata_free(&data);
 
 		source->user_volume = volume;
+		obs_source_mark_save_changed(source);
 	}
 }
 
@@ -2520,6 +4068,7 @@ void obs_source_set_sync_offset(obs_source_t *source, int64_t offset)
 
 		source->sync_offset = calldata_int(&data, "offset");
 		calldata_free(&data);
+		obs_source_mark_save_changed(source);
 	}
 }
 
@@ -2528,6 +4077,34 @@ int64_t obs_source_get_sync_offset(const obs_source_t *source)
 	return source ? source->sync_offset : 0;
 }
 
+bool obs_source_get_audio_buffer_stats(const obs_source_t *source,
+		struct audio_line_stats *stats)
+{
+	return source ? audio_line_get_stats(source->audio_line, stats) : false;
+}
+
+bool obs_source_get_async_video_stats(const obs_source_t *source,
+		struct obs_source_async_stats *stats)
+{
+	uint32_t flags;
+
+	if (!source || !stats)
+		return false;
+
+	flags = source->info.output_flags;
+	if ((flags & OBS_SOURCE_ASYNC_VIDEO) != OBS_SOURCE_ASYNC_VIDEO)
+		return false;
+
+	/* read without the async mutex, the values are only informational */
+	stats->jitter_depth  = (source->flags & OBS_SOURCE_FLAG_UNBUFFERED) ?
+		0 : source->async_jitter_depth;
+	stats->queued_frames = (uint32_t)source->async_frames.num;
+	stats->buffered_ms   = (uint32_t)(stats->queued_frames *
+			source->async_frame_interval / 1000000);
+	stats->jitter_ms     = (uint32_t)(source->async_jitter / 1000000);
+	return true;
+}
+
 struct source_enum_data {
 	obs_source_enum_proc_t enum_callback;
 	void *param;
@@ -2608,6 +4185,9 @@ bool obs_source_add_child(obs_source_t *parent, obs_source_t *child)
 		obs_source_activate(child, type);
 	}
 
+	if (parent->prepare_refs)
+		obs_source_prepare(child);
+
 	return true;
 }
 
@@ -2620,6 +4200,9 @@ void obs_source_remove_child(obs_source_t *parent, obs_source_t *child)
 		type = (i < parent->activate_refs) ? MAIN_VIEW : AUX_VIEW;
 		obs_source_deactivate(child, type);
 	}
+
+	if (parent->prepare_refs)
+		obs_source_unprepare(child);
 }
 
 void obs_source_save(obs_source_t *source)
@@ -2644,6 +4227,16 @@ bool obs_source_showing(const obs_source_t *source)
 	return source ? source->show_refs != 0 : false;
 }
 
+bool obs_source_suspended(const obs_source_t *source)
+{
+	return source ? source->suspended : false;
+}
+
+bool obs_source_prepared(const obs_source_t *source)
+{
+	return source ? source->prepare_refs != 0 : false;
+}
+
 static inline void signal_flags_updated(obs_source_t *source)
 {
 	struct calldata data = {0};
@@ -2662,6 +4255,7 @@ void obs_source_set_flags(obs_source_t *source, uint32_t flags)
 
 	if (flags != source->flags) {
 		source->flags = flags;
+		obs_source_mark_save_changed(source);
 		signal_flags_updated(source);
 	}
 }
@@ -2699,6 +4293,7 @@ void obs_source_set_audio_mixers(obs_source_t *source, uint32_t mixers)
 	calldata_free(&data);
 
 	audio_line_set_mixers(source->audio_line, mixers);
+	obs_source_mark_save_changed(source);
 }
 
 uint32_t obs_source_get_audio_mixers(const obs_source_t *source)
@@ -2713,6 +4308,7 @@ void obs_source_draw_set_color_matrix(const struct matrix4 *color_matrix,
 		const struct vec3 *color_range_min,
 		const struct vec3 *color_range_max)
 {
+	static struct gs_eparam_ref matrix_ref, range_min_ref, range_max_ref;
 	struct vec3 color_range_min_def;
 	struct vec3 color_range_max_def;
 
@@ -2741,9 +4337,11 @@ void obs_source_draw_set_color_matrix(const struct matrix4 *color_matrix,
 	if (!color_range_max)
 		color_range_max = &color_range_max_def;
 
-	matrix = gs_effect_get_param_by_name(effect, "color_matrix");
-	range_min = gs_effect_get_param_by_name(effect, "color_range_min");
-	range_max = gs_effect_get_param_by_name(effect, "color_range_max");
+	matrix = gs_effect_get_param_ref(effect, &matrix_ref, "color_matrix");
+	range_min = gs_effect_get_param_ref(effect, &range_min_ref,
+			"color_range_min");
+	range_max = gs_effect_get_param_ref(effect, &range_max_ref,
+			"color_range_max");
 
 	gs_effect_set_matrix4(matrix, color_matrix);
 	gs_effect_set_val(range_min, color_range_min, sizeof(float)*3);
@@ -2753,6 +4351,7 @@ void obs_source_draw_set_color_matrix(const struct matrix4 *color_matrix,
 void obs_source_draw(gs_texture_t *texture, int x, int y, uint32_t cx,
 		uint32_t cy, bool flip)
 {
+	static struct gs_eparam_ref image_ref;
 	gs_effect_t *effect = gs_get_effect();
 	bool change_pos = (x != 0 || y != 0);
 	gs_eparam_t *image;
@@ -2767,9 +4366,15 @@ void obs_source_draw(gs_texture_t *texture, int x, int y, uint32_t cx,
 		return;
 	}
 
-	image = gs_effect_get_param_by_name(effect, "image");
+	image = gs_effect_get_param_ref(effect, &image_ref, "image");
 	gs_effect_set_texture(image, texture);
 
+	if (obs->video.draw_crop.active) {
+		draw_sprite_cropped(texture, flip ? GS_FLIP_V : 0, x, y,
+				cx, cy);
+		return;
+	}
+
 	if (change_pos) {
 		gs_matrix_push();
 		gs_matrix_translate3f((float)x, (float)y, 0.0f);
@@ -2908,6 +4513,8 @@ void obs_source_set_enabled(obs_source_t *source, bool enabled)
 		return;
 
 	source->enabled = enabled;
+	obs_source_mark_video_changed(source);
+	obs_source_mark_save_changed(source);
 
 	calldata_set_ptr(&data, "source", source);
 	calldata_set_bool(&data, "enabled", enabled);
@@ -2930,6 +4537,7 @@ void obs_source_set_muted(obs_source_t *source, bool muted)
 		return;
 
 	source->muted = muted;
+	obs_source_mark_save_changed(source);
 
 	calldata_set_ptr(&data, "source", source);
 	calldata_set_bool(&data, "muted", muted);
@@ -2987,6 +4595,7 @@ void obs_source_enable_push_to_mute(obs_source_t *source, bool enabled)
 				enabled ? "enabled" : "disabled");
 
 	source->push_to_mute_enabled = enabled;
+	obs_source_mark_save_changed(source);
 
 	if (changed)
 		source_signal_push_to_changed(source, "push_to_mute_changed",
@@ -3012,6 +4621,7 @@ void obs_source_set_push_to_mute_delay(obs_source_t *source, uint64_t delay)
 
 	pthread_mutex_lock(&source->audio_mutex);
 	source->push_to_mute_delay = delay;
+	obs_source_mark_save_changed(source);
 
 	source_signal_push_to_delay(source, "push_to_mute_delay", delay);
 	pthread_mutex_unlock(&source->audio_mutex);
@@ -3041,6 +4651,7 @@ void obs_source_enable_push_to_talk(obs_source_t *source, bool enabled)
 				enabled ? "enabled" : "disabled");
 
 	source->push_to_talk_enabled = enabled;
+	obs_source_mark_save_changed(source);
 
 	if (changed)
 		source_signal_push_to_changed(source, "push_to_talk_changed",
@@ -3066,6 +4677,7 @@ void obs_source_set_push_to_talk_delay(obs_source_t *source, uint64_t delay)
 
 	pthread_mutex_lock(&source->audio_mutex);
 	source->push_to_talk_delay = delay;
+	obs_source_mark_save_changed(source);
 
 	source_signal_push_to_delay(source, "push_to_talk_delay", delay);
 	pthread_mutex_unlock(&source->audio_mutex);
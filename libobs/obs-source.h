@@ -103,6 +103,38 @@ enum obs_source_type {
  */
 #define OBS_SOURCE_INTERACTION (1<<5)
 
+/**
+ * Source draws all of its video with obs_source_draw.
+ *
+ * This lets a crop filter or a cropped scene item crop the source by
+ * adjusting the texture coordinates of those draws, instead of rendering
+ * the source to an intermediate texture first.  Asynchronous video sources
+ * can always be cropped this way.
+ */
+#define OBS_SOURCE_UV_CROP     (1<<6)
+
+/**
+ * Source's video_tick callback can be called from a tick thread.
+ *
+ * The callback then runs at the same time as the video thread and the ticks
+ * of other sources, so it must only touch the source's own data, and enter
+ * the graphics context itself if it needs it.  All ticks still finish
+ * before the frame is rendered, and show, hide, activate and deactivate are
+ * still called on the video thread before the callback.
+ */
+#define OBS_SOURCE_THREADED_TICK (1<<7)
+
+/**
+ * Source's create callback can be called from a task pool thread.
+ *
+ * When a scene collection is loaded, sources of types with this flag are
+ * created in parallel with each other, so create must not rely on the
+ * thread it's called from or on other sources existing yet.  The
+ * source_create and hotkey_register signals are then also sent from that
+ * thread.  Filters are only created this way if their type has the flag too.
+ */
+#define OBS_SOURCE_THREADED_CREATE (1<<8)
+
 /** @} */
 
 typedef void (*obs_source_enum_proc_t)(obs_source_t *parent,
@@ -383,6 +415,84 @@ struct obs_source_info {
 	 * If defined, called to free private data on shutdown
 	 */
 	void (*free_type_data)(void *type_data);
+
+	/**
+	 * Called after video_tick to check whether the source would render
+	 * exactly what it rendered last frame, which allows the main texture
+	 * to be reused when nothing in the scene changes.  Sources that don't
+	 * implement this are treated as changed every frame.
+	 *
+	 * @param  data  Source data
+	 * @return       true if the video hasn't changed since the last frame
+	 */
+	bool (*video_unchanged)(void *data);
+
+	/**
+	 * (Optional) Returns a per-pixel shader snippet for the filter, which
+	 * lets consecutive fusible filters of a source be drawn in a single
+	 * pass.  The snippet defines "float4 $process(float4 rgba)" along with
+	 * the uniforms it uses, and every '$' in it is replaced by a prefix
+	 * unique to the filter.  While fused, video_render isn't called, so
+	 * fusible filters must not change the size of the image.
+	 *
+	 * @param  data  Filter data
+	 * @return       Snippet, which must stay valid while the filter exists
+	 */
+	const char *(*get_fusion_snippet)(void *data);
+
+	/**
+	 * Sets the uniforms of the snippet when the filter is fused.  Use
+	 * obs_filter_get_fused_param to look them up.
+	 *
+	 * @param  data    Filter data
+	 * @param  effect  Effect the filter was fused into
+	 * @param  prefix  Prefix that replaced '$' in the snippet
+	 */
+	void (*update_fused_params)(void *data, gs_effect_t *effect,
+			const char *prefix);
+
+	/**
+	 * Called from the video thread when the source has been neither
+	 * showing nor active for the delay set with
+	 * obs_set_source_suspend_delay, to release whatever it can recreate
+	 * later: textures, decoders, devices, caches.  Enter the graphics
+	 * context to free graphics objects.  Not used for filters.
+	 *
+	 * While suspended, video_tick and video_render aren't called and
+	 * deferred updates are held back until the source resumes.  Sources
+	 * without OBS_SOURCE_VIDEO get update calls directly and should only
+	 * store the settings.  destroy can be called while suspended.
+	 *
+	 * @param  data  Source data
+	 */
+	void (*suspend)(void *data);
+
+	/**
+	 * Called from the video thread before a suspended source is shown or
+	 * activated again, to recreate what suspend released.
+	 *
+	 * @param  data  Source data
+	 */
+	void (*resume)(void *data);
+
+	/**
+	 * Called from the video thread when the source is about to be
+	 * needed, see obs_source_prepare.  Start loading whatever show or
+	 * activate would otherwise have to load, so they can be instant.
+	 * The source is not showing yet and may never be.
+	 *
+	 * @param  data  Source data
+	 */
+	void (*prepare)(void *data);
+
+	/**
+	 * Called from the video thread when the source is no longer expected
+	 * to be needed.  Release what prepare loaded unless the source is
+	 * showing or active by now.
+	 *
+	 * @param  data  Source data
+	 */
+	void (*unprepare)(void *data);
 };
 
 EXPORT void obs_register_source_s(const struct obs_source_info *info,
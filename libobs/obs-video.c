@@ -50,13 +50,78 @@ static inline void calculate_base_volume(struct obs_core_data *data,
 	}
 }
 
+static inline bool ticks_threaded(struct obs_core_video *video,
+		struct obs_source *source)
+{
+	return video->num_tick_workers &&
+		(source->info.output_flags & OBS_SOURCE_THREADED_TICK) != 0 &&
+		source->context.data && source->info.video_tick;
+}
+
+/* ticks are taken in order by whichever thread gets to them first */
+static void run_threaded_ticks(struct obs_core_video *video)
+{
+	size_t idx;
+
+	while ((idx = (size_t)os_atomic_inc_long(
+				&video->next_threaded_tick) - 1) <
+			video->threaded_ticks.num) {
+		struct obs_source *source = video->threaded_ticks.array[idx];
+		if (!source->destroy_pending)
+			source->info.video_tick(source->context.data,
+					video->tick_seconds);
+	}
+}
+
+void *obs_tick_thread(void *param)
+{
+	struct obs_core_video *video = &obs->video;
+
+	os_set_thread_name("libobs: tick thread");
+
+	while (os_sem_wait(video->tick_start_sem) == 0) {
+		if (video->tick_stop)
+			break;
+
+		run_threaded_ticks(video);
+		os_sem_post(video->tick_done_sem);
+	}
+
+	UNUSED_PARAMETER(param);
+	return NULL;
+}
+
+static void start_threaded_ticks(struct obs_core_video *video)
+{
+	if (!video->threaded_ticks.num)
+		return;
+
+	video->next_threaded_tick = 0;
+	for (size_t i = 0; i < video->num_tick_workers; i++)
+		os_sem_post(video->tick_start_sem);
+}
+
+static void finish_threaded_ticks(struct obs_core_video *video)
+{
+	if (!video->threaded_ticks.num)
+		return;
+
+	run_threaded_ticks(video);
+	for (size_t i = 0; i < video->num_tick_workers; i++)
+		os_sem_wait(video->tick_done_sem);
+
+	da_resize(video->threaded_ticks, 0);
+}
+
 static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 {
-	struct obs_core_data *data = &obs->data;
-	struct obs_view      *view = &data->main_view;
-	struct obs_source    *source;
-	uint64_t             delta_time;
-	float                seconds;
+	struct obs_core_data  *data  = &obs->data;
+	struct obs_core_video *video = &obs->video;
+	struct obs_view       *view  = &data->main_view;
+	struct obs_source_snapshot *snapshot;
+	struct obs_source     *source;
+	uint64_t              delta_time;
+	float                 seconds;
 
 	if (!last_time)
 		last_time = cur_time -
@@ -65,28 +130,51 @@ static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 	delta_time = cur_time - last_time;
 	seconds = (float)((double)delta_time / 1000000000.0);
 
-	pthread_mutex_lock(&data->sources_mutex);
+	snapshot = obs_source_walk_begin();
+	if (!snapshot)
+		goto end;
 
-	/* call the tick function of each source */
-	source = data->first_source;
-	while (source) {
-		obs_source_video_tick(source, seconds);
-		source = (struct obs_source*)source->context.next;
+	/* start the thread-safe ticks first, the tick threads run them while
+	 * this thread ticks everything else.  none of the sources can be
+	 * destroyed until the walk ends. */
+	video->tick_seconds = seconds;
+
+	for (size_t i = 0; i < snapshot->sources.num; i++) {
+		source = snapshot->sources.array[i];
+		if (ticks_threaded(video, source)) {
+			obs_source_video_tick_state(source);
+			if (!source->suspended)
+				da_push_back(video->threaded_ticks, &source);
+		}
 	}
 
-	/* calculate source volumes */
-	pthread_mutex_lock(&view->channels_mutex);
+	start_threaded_ticks(video);
 
-	source = data->first_source;
-	while (source) {
-		calculate_base_volume(data, view, source);
-		source = (struct obs_source*)source->context.next;
+	for (size_t i = 0; i < snapshot->sources.num; i++) {
+		source = snapshot->sources.array[i];
+		if (!source->destroy_pending && !ticks_threaded(video, source))
+			obs_source_video_tick(source, seconds);
 	}
 
-	pthread_mutex_unlock(&view->channels_mutex);
+	finish_threaded_ticks(video);
 
-	pthread_mutex_unlock(&data->sources_mutex);
+	/* calculate source volumes, which only change with the set of active
+	 * sources unless a transition is mixing them */
+	if (os_atomic_load_long(&data->active_transitions) ||
+	    os_atomic_compare_swap_long(&data->base_volume_dirty, 1, 0)) {
+		pthread_mutex_lock(&view->channels_mutex);
 
+		for (size_t i = 0; i < snapshot->sources.num; i++) {
+			source = snapshot->sources.array[i];
+			if (!source->destroy_pending)
+				calculate_base_volume(data, view, source);
+		}
+
+		pthread_mutex_unlock(&view->channels_mutex);
+	}
+
+end:
+	obs_source_walk_end();
 	return cur_time;
 }
 
@@ -125,12 +213,72 @@ static inline void set_render_size(uint32_t width, uint32_t height)
 	gs_set_viewport(0, 0, width, height);
 }
 
-static inline void unmap_last_surface(struct obs_core_video *video)
+static inline void add_stage_time(struct obs_core_video *video,
+		enum obs_video_stage stage, uint64_t start_time)
+{
+	uint64_t budget = video_output_get_frame_time(video->video);
+	uint64_t elapsed = os_gettime_ns() - start_time;
+
+	pthread_mutex_lock(&video->frame_timing_mutex);
+	video_timing_add(&video->pipeline_timing.stages[stage], elapsed,
+			budget);
+	pthread_mutex_unlock(&video->frame_timing_mutex);
+}
+
+static inline void unmap_last_readback(struct obs_core_video *video)
+{
+	if (video->mapped_readback) {
+		obs_readback_unmap(video->mapped_readback);
+		video->mapped_readback = NULL;
+	}
+}
+
+/* called from the video-io thread once all inputs are done with a frame */
+static void release_held_readback(void *param)
+{
+	struct obs_core_video *video = &obs->video;
+	struct obs_readback *readback = param;
+
+	pthread_mutex_lock(&video->held_surfaces_mutex);
+	da_push_back(video->released_readbacks, &readback);
+	pthread_mutex_unlock(&video->held_surfaces_mutex);
+}
+
+static inline void recycle_released_readbacks(struct obs_core_video *video)
 {
-	if (video->mapped_surface) {
-		gs_stagesurface_unmap(video->mapped_surface);
-		video->mapped_surface = NULL;
+	pthread_mutex_lock(&video->held_surfaces_mutex);
+
+	for (size_t i = 0; i < video->released_readbacks.num; i++) {
+		struct obs_readback *readback =
+			video->released_readbacks.array[i];
+
+		obs_readback_unmap(readback);
+		da_push_back(video->free_readbacks, &readback);
 	}
+
+	da_resize(video->released_readbacks, 0);
+
+	pthread_mutex_unlock(&video->held_surfaces_mutex);
+}
+
+static inline struct obs_readback *get_free_readback(
+		struct obs_core_video *video)
+{
+	struct obs_readback *readback;
+
+	if (!video->free_readbacks.num)
+		return obs_readback_create(&video->layout);
+
+	readback = video->free_readbacks.array[video->free_readbacks.num - 1];
+	da_pop_back(video->free_readbacks);
+	return readback;
+}
+
+static inline void stage_readback(struct obs_readback *readback,
+		gs_texture_t **textures)
+{
+	for (size_t i = 0; i < readback->num_surfaces; i++)
+		gs_stage_texture(readback->surfaces[i], textures[i]);
 }
 
 static const char *render_main_texture_name = "render_main_texture";
@@ -138,6 +286,7 @@ static inline void render_main_texture(struct obs_core_video *video,
 		int cur_texture)
 {
 	profile_start(render_main_texture_name);
+	gpu_timing_start(render_main_texture_name);
 
 	struct vec4 clear_color;
 	vec4_set(&clear_color, 0.0f, 0.0f, 0.0f, 1.0f);
@@ -150,17 +299,56 @@ static inline void render_main_texture(struct obs_core_video *video,
 
 	video->textures_rendered[cur_texture] = true;
 
+	gpu_timing_end();
 	profile_end(render_main_texture_name);
 }
 
+/* checks whether the main view would render exactly the same image as last
+ * frame, in which case the last render texture can be reused */
+static bool main_view_unchanged(struct obs_core_video *video)
+{
+	struct obs_view *view = &obs->data.main_view;
+	bool unchanged = true;
+
+	pthread_mutex_lock(&view->channels_mutex);
+
+	for (size_t i = 0; i < MAX_CHANNELS; i++) {
+		struct obs_source *source = view->channels[i];
+
+		if (source != video->rendered_channels[i]) {
+			video->rendered_channels[i] = source;
+			unchanged = false;
+
+		} else if (unchanged && source) {
+			unchanged = !source->removed &&
+				obs_source_video_unchanged(source);
+		}
+	}
+
+	pthread_mutex_unlock(&view->channels_mutex);
+
+	return unchanged;
+}
+
+static inline void reuse_main_texture(struct obs_core_video *video,
+		int cur_texture, int prev_texture)
+{
+	gs_texture_t **textures = video->render_textures;
+	gs_texture_t *texture   = textures[cur_texture];
+
+	textures[cur_texture]  = textures[prev_texture];
+	textures[prev_texture] = texture;
+	video->textures_rendered[cur_texture] = true;
+}
+
 static inline gs_effect_t *get_scale_effect_internal(
-		struct obs_core_video *video)
+		struct obs_core_video *video, uint32_t width, uint32_t height)
 {
 	/* if the dimension is under half the size of the original image,
 	 * bicubic/lanczos can't sample enough pixels to create an accurate
 	 * image, so use the bilinear low resolution effect instead */
-	if (video->output_width  < (video->base_width  / 2) &&
-	    video->output_height < (video->base_height / 2)) {
+	if (width  < (video->base_width  / 2) &&
+	    height < (video->base_height / 2)) {
 		return video->bilinear_lowres_effect;
 	}
 
@@ -190,7 +378,8 @@ static inline gs_effect_t *get_scale_effect(struct obs_core_video *video,
 	} else {
 		/* if the scale method couldn't be loaded, use either bicubic
 		 * or bilinear by default */
-		gs_effect_t *effect = get_scale_effect_internal(video);
+		gs_effect_t *effect = get_scale_effect_internal(video,
+				width, height);
 		if (!effect)
 			effect = !!video->bicubic_effect ?
 				video->bicubic_effect :
@@ -199,14 +388,50 @@ static inline gs_effect_t *get_scale_effect(struct obs_core_video *video,
 	}
 }
 
-static const char *render_output_texture_name = "render_output_texture";
-static inline void render_output_texture(struct obs_core_video *video,
-		int cur_texture, int prev_texture)
+static void scale_pass(gs_technique_t *tech, gs_eparam_t *image,
+		gs_texture_t *texture, gs_texture_t *target)
 {
-	profile_start(render_output_texture_name);
+	uint32_t width  = gs_texture_get_width(target);
+	uint32_t height = gs_texture_get_height(target);
+	size_t   passes, i;
 
-	gs_texture_t *texture = video->render_textures[prev_texture];
-	gs_texture_t *target  = video->output_textures[cur_texture];
+	gs_set_render_target(target, NULL);
+	set_render_size(width, height);
+
+	gs_effect_set_texture(image, texture);
+
+	passes = gs_technique_begin(tech);
+	for (i = 0; i < passes; i++) {
+		gs_technique_begin_pass(tech, i);
+		gs_draw_sprite(texture, 0, width, height);
+		gs_technique_end_pass(tech);
+	}
+	gs_technique_end(tech);
+}
+
+/* bicubic and lanczos are separable, so they're drawn as a horizontal pass
+ * into a target with the base height, then a vertical pass.  the
+ * intermediate target is half float so lanczos' negative lobes and
+ * overshoot survive until the final pass clamps them. */
+static gs_texture_t *get_separable_target(struct obs_core_video *video,
+		gs_effect_t *effect, uint32_t width,
+		gs_technique_t **h_tech, gs_technique_t **v_tech)
+{
+	if (effect != video->lanczos_effect && effect != video->bicubic_effect)
+		return NULL;
+
+	*h_tech = gs_effect_get_technique(effect, "DrawHorizontal");
+	*v_tech = gs_effect_get_technique(effect, "DrawVerticalMatrix");
+	if (!*h_tech || !*v_tech)
+		return NULL;
+
+	return gs_render_target_acquire(GS_RGBA16F, width, video->base_height);
+}
+
+static void scale_texture(struct obs_core_video *video,
+		gs_texture_t *texture, gs_texture_t *target)
+{
+	static struct gs_eparam_ref image_ref, matrix_ref, bres_i_ref;
 	uint32_t     width   = gs_texture_get_width(target);
 	uint32_t     height  = gs_texture_get_height(target);
 	struct vec2  base_i;
@@ -217,146 +442,234 @@ static inline void render_output_texture(struct obs_core_video *video,
 
 	gs_effect_t    *effect  = get_scale_effect(video, width, height);
 	gs_technique_t *tech    = gs_effect_get_technique(effect, "DrawMatrix");
-	gs_eparam_t    *image   = gs_effect_get_param_by_name(effect, "image");
-	gs_eparam_t    *matrix  = gs_effect_get_param_by_name(effect,
-			"color_matrix");
-	gs_eparam_t    *bres_i  = gs_effect_get_param_by_name(effect,
-			"base_dimension_i");
-	size_t      passes, i;
-
-	if (!video->textures_rendered[prev_texture])
-		goto end;
-
-	gs_set_render_target(target, NULL);
-	set_render_size(width, height);
+	gs_eparam_t    *image   = gs_effect_get_param_ref(effect,
+			&image_ref, "image");
+	gs_eparam_t    *matrix  = gs_effect_get_param_ref(effect,
+			&matrix_ref, "color_matrix");
+	gs_eparam_t    *bres_i  = gs_effect_get_param_ref(effect,
+			&bres_i_ref, "base_dimension_i");
+	gs_technique_t *h_tech  = NULL;
+	gs_technique_t *v_tech  = NULL;
+	gs_texture_t   *temp;
+
+	temp = get_separable_target(video, effect, width, &h_tech, &v_tech);
 
 	if (bres_i)
 		gs_effect_set_vec2(bres_i, &base_i);
 
 	gs_effect_set_val(matrix, video->color_matrix, sizeof(float) * 16);
-	gs_effect_set_texture(image, texture);
 
 	gs_enable_blending(false);
-	passes = gs_technique_begin(tech);
-	for (i = 0; i < passes; i++) {
-		gs_technique_begin_pass(tech, i);
-		gs_draw_sprite(texture, 0, width, height);
-		gs_technique_end_pass(tech);
-	}
-	gs_technique_end(tech);
-	gs_enable_blending(true);
-
-	video->textures_output[cur_texture] = true;
 
-end:
-	profile_end(render_output_texture_name);
-}
+	if (temp) {
+		scale_pass(h_tech, image, texture, temp);
+		scale_pass(v_tech, image, temp, target);
+		gs_render_target_release(temp);
+	} else {
+		scale_pass(tech, image, texture, target);
+	}
 
-static inline void set_eparam(gs_effect_t *effect, const char *name, float val)
-{
-	gs_eparam_t *param = gs_effect_get_param_by_name(effect, name);
-	gs_effect_set_float(param, val);
+	gs_enable_blending(true);
 }
 
-static const char *render_convert_texture_name = "render_convert_texture";
-static void render_convert_texture(struct obs_core_video *video,
+static const char *render_output_texture_name = "render_output_texture";
+static inline void render_output_texture(struct obs_core_video *video,
 		int cur_texture, int prev_texture)
 {
-	profile_start(render_convert_texture_name);
-
-	gs_texture_t *texture = video->output_textures[prev_texture];
-	gs_texture_t *target  = video->convert_textures[cur_texture];
-	float        fwidth  = (float)video->output_width;
-	float        fheight = (float)video->output_height;
-	size_t       passes, i;
-
-	gs_effect_t    *effect  = video->conversion_effect;
-	gs_eparam_t    *image   = gs_effect_get_param_by_name(effect, "image");
-	gs_technique_t *tech    = gs_effect_get_technique(effect,
-			video->conversion_tech);
+	profile_start(render_output_texture_name);
+	gpu_timing_start(render_output_texture_name);
 
-	if (!video->textures_output[prev_texture])
-		goto end;
+	if (video->textures_rendered[prev_texture]) {
+		scale_texture(video, video->render_textures[prev_texture],
+				video->output_textures[cur_texture]);
+		video->textures_output[cur_texture] = true;
+	}
 
-	set_eparam(effect, "u_plane_offset", (float)video->plane_offsets[1]);
-	set_eparam(effect, "v_plane_offset", (float)video->plane_offsets[2]);
-	set_eparam(effect, "width",  fwidth);
-	set_eparam(effect, "height", fheight);
-	set_eparam(effect, "width_i",  1.0f / fwidth);
-	set_eparam(effect, "height_i", 1.0f / fheight);
-	set_eparam(effect, "width_d2",  fwidth  * 0.5f);
-	set_eparam(effect, "height_d2", fheight * 0.5f);
-	set_eparam(effect, "width_d2_i",  1.0f / (fwidth  * 0.5f));
-	set_eparam(effect, "height_d2_i", 1.0f / (fheight * 0.5f));
-	set_eparam(effect, "input_height", (float)video->conversion_height);
+	gpu_timing_end();
+	profile_end(render_output_texture_name);
+}
 
-	gs_effect_set_texture(image, texture);
+static void convert_plane(struct obs_core_video *video,
+		gs_texture_t *texture, gs_texture_t *target,
+		const struct obs_conversion_plane *plane)
+{
+	gs_technique_t *tech = gs_effect_get_technique(
+			video->conversion_effect, plane->tech);
+	size_t passes, i;
 
 	gs_set_render_target(target, NULL);
-	set_render_size(video->output_width, video->conversion_height);
+	set_render_size(plane->width, plane->height);
 
-	gs_enable_blending(false);
 	passes = gs_technique_begin(tech);
 	for (i = 0; i < passes; i++) {
 		gs_technique_begin_pass(tech, i);
-		gs_draw_sprite(texture, 0, video->output_width,
-				video->conversion_height);
+		gs_draw_sprite(texture, 0, plane->width, plane->height);
 		gs_technique_end_pass(tech);
 	}
 	gs_technique_end(tech);
+}
+
+static void convert_texture(struct obs_core_video *video,
+		gs_texture_t *texture, gs_texture_t **targets,
+		const struct obs_conversion_layout *layout)
+{
+	gs_effect_set_texture(video->conversion_params.image, texture);
+
+	gs_enable_blending(false);
+	for (size_t i = 0; i < layout->num_planes; i++)
+		convert_plane(video, texture, targets[i], &layout->planes[i]);
 	gs_enable_blending(true);
+}
 
-	video->textures_converted[cur_texture] = true;
+static const char *render_convert_texture_name = "render_convert_texture";
+static void render_convert_texture(struct obs_core_video *video,
+		int cur_texture, int prev_texture)
+{
+	profile_start(render_convert_texture_name);
+	gpu_timing_start(render_convert_texture_name);
 
-end:
+	if (video->textures_output[prev_texture]) {
+		convert_texture(video, video->output_textures[prev_texture],
+				video->convert_textures[cur_texture],
+				&video->layout);
+		video->textures_converted[cur_texture] = true;
+	}
+
+	gpu_timing_end();
 	profile_end(render_convert_texture_name);
 }
 
 static const char *stage_output_texture_name = "stage_output_texture";
 static inline void stage_output_texture(struct obs_core_video *video,
-		int cur_texture, int prev_texture)
+		int prev_texture)
 {
 	profile_start(stage_output_texture_name);
 
-	gs_texture_t   *texture;
-	bool        texture_ready;
-	gs_stagesurf_t *copy = video->copy_surfaces[cur_texture];
+	gs_texture_t        **textures;
+	bool                texture_ready;
+	int                 cur_surface = video->cur_surface;
+	struct obs_readback *readback;
 
 	if (video->gpu_conversion) {
-		texture = video->convert_textures[prev_texture];
+		textures = video->convert_textures[prev_texture];
 		texture_ready = video->textures_converted[prev_texture];
 	} else {
-		texture = video->output_textures[prev_texture];
-		texture_ready = video->output_textures[prev_texture];
+		textures = &video->output_textures[prev_texture];
+		texture_ready = video->textures_output[prev_texture];
 	}
 
-	unmap_last_surface(video);
+	/* the last mapped readback is always the oldest one in the queue,
+	 * which is the one about to be staged to */
+	unmap_last_readback(video);
 
-	if (!texture_ready)
+	/* if the readback is still held by video-io, use a free one instead */
+	readback = video->readbacks[cur_surface];
+	if (!readback)
+		readback = video->readbacks[cur_surface] =
+			get_free_readback(video);
+
+	if (!texture_ready || !readback)
 		goto end;
 
-	gs_stage_texture(copy, texture);
+	stage_readback(readback, textures);
 
-	video->textures_copied[cur_texture] = true;
+	video->textures_copied[cur_surface] = true;
 
 end:
 	profile_end(stage_output_texture_name);
 }
 
+static inline void stage_scaled_texture(struct obs_core_video *video,
+		struct obs_scaled_video *scaled, int prev_texture)
+{
+	int          cur_surface = video->cur_surface;
+	gs_texture_t **textures;
+	bool         texture_ready;
+
+	if (video->gpu_conversion) {
+		textures = scaled->convert_textures[prev_texture];
+		texture_ready = scaled->textures_converted[prev_texture];
+	} else {
+		textures = &scaled->output_textures[prev_texture];
+		texture_ready = scaled->textures_output[prev_texture];
+	}
+
+	if (scaled->mapped_readback) {
+		obs_readback_unmap(scaled->mapped_readback);
+		scaled->mapped_readback = NULL;
+	}
+
+	if (!texture_ready)
+		return;
+
+	stage_readback(scaled->readbacks[cur_surface], textures);
+	scaled->textures_copied[cur_surface] = true;
+}
+
+static const char *render_scaled_videos_name = "render_scaled_videos";
+static void render_scaled_videos(struct obs_core_video *video,
+		int cur_texture, int prev_texture)
+{
+	if (!video->scaled_videos.num)
+		return;
+
+	profile_start(render_scaled_videos_name);
+
+	gs_texture_t *texture = video->render_textures[prev_texture];
+	bool rendered = video->textures_rendered[prev_texture];
+
+	for (size_t i = 0; i < video->scaled_videos.num; i++) {
+		struct obs_scaled_video *scaled = video->scaled_videos.array[i];
+
+		if (scaled->started && rendered) {
+			scale_texture(video, texture,
+					scaled->output_textures[cur_texture]);
+			scaled->textures_output[cur_texture] = true;
+		}
+
+		if (video->gpu_conversion &&
+		    scaled->textures_output[prev_texture]) {
+			convert_texture(video,
+					scaled->output_textures[prev_texture],
+					scaled->convert_textures[cur_texture],
+					&scaled->layout);
+			scaled->textures_converted[cur_texture] = true;
+		}
+
+		stage_scaled_texture(video, scaled, prev_texture);
+		scaled->started = true;
+	}
+
+	profile_end(render_scaled_videos_name);
+}
+
 static inline void render_video(struct obs_core_video *video, int cur_texture,
 		int prev_texture)
 {
+	bool reuse_texture = video->textures_rendered[prev_texture] &&
+		main_view_unchanged(video);
+
+	video->unchanged_renders = (video->unchanged_renders << 1) |
+		(reuse_texture ? 1 : 0);
+
 	gs_begin_scene();
 
 	gs_enable_depth_test(false);
 	gs_set_cull_mode(GS_NEITHER);
 
-	render_main_texture(video, cur_texture);
+	if (!reuse_texture)
+		render_main_texture(video, cur_texture);
 	render_output_texture(video, cur_texture, prev_texture);
 	if (video->gpu_conversion)
 		render_convert_texture(video, cur_texture, prev_texture);
 
-	stage_output_texture(video, cur_texture, prev_texture);
+	stage_output_texture(video, prev_texture);
+	render_scaled_videos(video, cur_texture, prev_texture);
+
+	/* the last render texture has been used for this frame's output, so
+	 * it can now take the place of this frame's render texture */
+	if (reuse_texture)
+		reuse_main_texture(video, cur_texture, prev_texture);
 
 	gs_set_render_target(NULL, NULL);
 	gs_enable_blending(true);
@@ -364,121 +677,137 @@ static inline void render_video(struct obs_core_video *video, int cur_texture,
 	gs_end_scene();
 }
 
-static inline bool download_frame(struct obs_core_video *video,
-		int prev_texture, struct video_data *frame)
+/* maps the oldest staged surface, which was staged readback_frames - 1 frames
+ * ago, giving the GPU that many frames to finish the copy */
+static inline int oldest_surface_idx(struct obs_core_video *video)
 {
-	gs_stagesurf_t *surface = video->copy_surfaces[prev_texture];
+	return (video->cur_surface + 1) % (int)video->readback_frames;
+}
 
-	if (!video->textures_copied[prev_texture])
-		return false;
+/* the oldest surface is staged to again this frame, so if its copy still
+ * isn't done there is nothing to defer to and the map has to wait.  stalls
+ * are counted so that a too shallow readback pipeline shows up in stats. */
+static bool map_staged_surface(struct obs_core_video *video,
+		gs_stagesurf_t *surface, uint8_t **data, uint32_t *linesize)
+{
+	if (gs_stagesurface_try_map(surface, data, linesize))
+		return true;
 
-	if (!gs_stagesurface_map(surface, &frame->data[0], &frame->linesize[0]))
-		return false;
+	pthread_mutex_lock(&video->frame_timing_mutex);
+	video->pipeline_timing.readback_stalls++;
+	pthread_mutex_unlock(&video->frame_timing_mutex);
 
-	video->mapped_surface = surface;
-	return true;
+	return gs_stagesurface_map(surface, data, linesize);
 }
 
-static inline uint32_t calc_linesize(uint32_t pos, uint32_t linesize)
+/* each plane is mapped with its own linesize */
+static bool map_readback(struct obs_core_video *video,
+		struct obs_readback *readback, struct video_data *frame)
 {
-	uint32_t size = pos % linesize;
-	return size ? size : linesize;
+	for (size_t i = 0; i < readback->num_surfaces; i++) {
+		if (!map_staged_surface(video, readback->surfaces[i],
+					&frame->data[i], &frame->linesize[i])) {
+			while (i--)
+				gs_stagesurface_unmap(readback->surfaces[i]);
+			return false;
+		}
+	}
+
+	return true;
 }
 
-static void copy_dealign(
-		uint8_t *dst, uint32_t dst_pos, uint32_t dst_linesize,
-		const uint8_t *src, uint32_t src_pos, uint32_t src_linesize,
-		uint32_t remaining)
+static inline bool download_frame(struct obs_core_video *video,
+		struct video_data *frame)
 {
-	while (remaining) {
-		uint32_t src_remainder = src_pos % src_linesize;
-		uint32_t dst_offset = dst_linesize - src_remainder;
-		uint32_t src_offset = src_linesize - src_remainder;
+	int surface_idx = oldest_surface_idx(video);
+	struct obs_readback *readback = video->readbacks[surface_idx];
 
-		if (remaining < dst_offset) {
-			memcpy(dst + dst_pos, src + src_pos, remaining);
-			src_pos += remaining;
-			dst_pos += remaining;
-			remaining = 0;
-		} else {
-			memcpy(dst + dst_pos, src + src_pos, dst_offset);
-			src_pos += src_offset;
-			dst_pos += dst_offset;
-			remaining -= dst_offset;
-		}
+	if (!video->textures_copied[surface_idx])
+		return false;
+
+	if (!map_readback(video, readback, frame)) {
+		pthread_mutex_lock(&video->frame_timing_mutex);
+		video->pipeline_timing.readback_failures++;
+		pthread_mutex_unlock(&video->frame_timing_mutex);
+		return false;
 	}
-}
 
-static inline uint32_t make_aligned_linesize_offset(uint32_t offset,
-		uint32_t dst_linesize, uint32_t src_linesize)
-{
-	uint32_t remainder = offset % dst_linesize;
-	return (offset / dst_linesize) * src_linesize + remainder;
+	video->mapped_readback = readback;
+	return true;
 }
 
-static void fix_gpu_converted_alignment(struct obs_core_video *video,
-		struct video_frame *output, const struct video_data *input)
+static inline void download_scaled_frames(struct obs_core_video *video)
 {
-	uint32_t src_linesize = input->linesize[0];
-	uint32_t dst_linesize = output->linesize[0] * 4;
-	uint32_t src_pos      = 0;
+	int surface_idx = oldest_surface_idx(video);
 
-	for (size_t i = 0; i < 3; i++) {
-		if (video->plane_linewidth[i] == 0)
-			break;
+	for (size_t i = 0; i < video->scaled_videos.num; i++) {
+		struct obs_scaled_video *scaled = video->scaled_videos.array[i];
+		struct obs_readback *readback = scaled->readbacks[surface_idx];
+
+		scaled->frame_ready = false;
 
-		src_pos = make_aligned_linesize_offset(video->plane_offsets[i],
-				dst_linesize, src_linesize);
+		if (!scaled->textures_copied[surface_idx])
+			continue;
+		if (!map_readback(video, readback, &scaled->frame))
+			continue;
 
-		copy_dealign(output->data[i], 0, dst_linesize,
-				input->data[0], src_pos, src_linesize,
-				video->plane_sizes[i]);
+		scaled->mapped_readback = readback;
+		scaled->frame_ready = true;
 	}
 }
 
-static void set_gpu_converted_data(struct obs_core_video *video,
-		struct video_frame *output, const struct video_data *input,
-		const struct video_output_info *info)
+static inline void copy_plane(uint8_t *dst, uint32_t dst_linesize,
+		const uint8_t *src, uint32_t src_linesize,
+		uint32_t row_size, uint32_t height)
 {
-	if (input->linesize[0] == video->output_width*4) {
-		struct video_frame frame;
-
-		for (size_t i = 0; i < 3; i++) {
-			if (video->plane_linewidth[i] == 0)
-				break;
-
-			frame.linesize[i] = video->plane_linewidth[i];
-			frame.data[i] =
-				input->data[0] + video->plane_offsets[i];
+	/* if the line sizes match, do a single copy */
+	if (src_linesize == dst_linesize) {
+		memcpy(dst, src, (size_t)src_linesize * height);
+	} else {
+		for (uint32_t y = 0; y < height; y++) {
+			memcpy(dst, src, row_size);
+			src += src_linesize;
+			dst += dst_linesize;
 		}
+	}
+}
 
-		video_frame_copy(output, &frame, info->format, info->height);
-
-	} else {
-		fix_gpu_converted_alignment(video, output, input);
+static void copy_gpu_converted_planes(
+		const struct obs_conversion_layout *layout,
+		struct video_frame *output, const struct video_data *input)
+{
+	for (size_t i = 0; i < layout->num_planes; i++) {
+		const struct obs_conversion_plane *plane = &layout->planes[i];
+		uint32_t row_size = plane->width *
+			gs_get_format_bpp(plane->format) / 8;
+
+		copy_plane(output->data[i], output->linesize[i],
+				input->data[i], input->linesize[i],
+				row_size, plane->height);
 	}
 }
 
-static void convert_frame(
+static void convert_frame_slice(
 		struct video_frame *output, const struct video_data *input,
-		const struct video_output_info *info)
+		const struct video_output_info *info,
+		uint32_t start_y, uint32_t end_y)
 {
 	if (info->format == VIDEO_FORMAT_I420) {
 		compress_uyvx_to_i420(
 				input->data[0], input->linesize[0],
-				0, info->height,
+				start_y, end_y,
 				output->data, output->linesize);
 
 	} else if (info->format == VIDEO_FORMAT_NV12) {
 		compress_uyvx_to_nv12(
 				input->data[0], input->linesize[0],
-				0, info->height,
+				start_y, end_y,
 				output->data, output->linesize);
 
 	} else if (info->format == VIDEO_FORMAT_I444) {
 		convert_uyvx_to_i444(
 				input->data[0], input->linesize[0],
-				0, info->height,
+				start_y, end_y,
 				output->data, output->linesize);
 
 	} else {
@@ -486,71 +815,420 @@ static void convert_frame(
 	}
 }
 
+void *obs_convert_thread(void *param)
+{
+	struct obs_convert_worker *worker = param;
+	struct obs_core_video *video = &obs->video;
+
+	os_set_thread_name("libobs: conversion thread");
+
+	while (os_sem_wait(worker->start_sem) == 0) {
+		if (video->convert_stop)
+			break;
+
+		convert_frame_slice(video->convert_output,
+				video->convert_input, video->convert_info,
+				worker->start_y, worker->end_y);
+
+		os_sem_post(video->convert_done_sem);
+	}
+
+	return NULL;
+}
+
+/* slices must start on even lines, as lines are converted in pairs */
+static inline uint32_t get_slice_y(uint32_t height, size_t slice,
+		size_t slices)
+{
+	if (slice == slices)
+		return height;
+	return (uint32_t)((uint64_t)height * slice / slices) & ~1;
+}
+
+static void convert_frame(struct obs_core_video *video,
+		struct video_frame *output, const struct video_data *input,
+		const struct video_output_info *info)
+{
+	size_t workers = video->num_convert_workers;
+	size_t slices  = workers + 1;
+
+	if (!workers) {
+		convert_frame_slice(output, input, info, 0, info->height);
+		return;
+	}
+
+	video->convert_output = output;
+	video->convert_input  = input;
+	video->convert_info   = info;
+
+	for (size_t i = 0; i < workers; i++) {
+		struct obs_convert_worker *worker = &video->convert_workers[i];
+
+		worker->start_y = get_slice_y(info->height, i,     slices);
+		worker->end_y   = get_slice_y(info->height, i + 1, slices);
+		os_sem_post(worker->start_sem);
+	}
+
+	convert_frame_slice(output, input, info,
+			get_slice_y(info->height, workers, slices),
+			info->height);
+
+	for (size_t i = 0; i < workers; i++)
+		os_sem_wait(video->convert_done_sem);
+}
+
 static inline void copy_rgbx_frame(
 		struct video_frame *output, const struct video_data *input,
 		const struct video_output_info *info)
 {
-	uint8_t *in_ptr = input->data[0];
-	uint8_t *out_ptr = output->data[0];
+	copy_plane(output->data[0], output->linesize[0],
+			input->data[0], input->linesize[0],
+			info->width * 4, info->height);
+}
 
-	/* if the line sizes match, do a single copy */
-	if (input->linesize[0] == output->linesize[0]) {
-		memcpy(out_ptr, in_ptr, input->linesize[0] * info->height);
-	} else {
-		for (size_t y = 0; y < info->height; y++) {
-			memcpy(out_ptr, in_ptr, info->width * 4);
-			in_ptr += input->linesize[0];
-			out_ptr += output->linesize[0];
-		}
+static inline void copy_output_frame(struct obs_core_video *video,
+		const struct obs_conversion_layout *layout,
+		struct video_frame *output, const struct video_data *input,
+		const struct video_output_info *info)
+{
+	if (video->gpu_conversion)
+		copy_gpu_converted_planes(layout, output, input);
+	else if (format_is_yuv(info->format))
+		convert_frame(video, output, input, info);
+	else
+		copy_rgbx_frame(output, input, info);
+}
+
+static inline bool get_frame_ref(struct obs_core_video *video,
+		struct video_frame *output, const struct video_data *input,
+		const struct video_output_info *info)
+{
+	memset(output, 0, sizeof(*output));
+
+	/* YUV frames converted on the CPU don't exist until they're copied */
+	if (!video->gpu_conversion && format_is_yuv(info->format))
+		return false;
+
+	for (size_t i = 0; i < video->layout.num_planes; i++) {
+		output->data[i]     = input->data[i];
+		output->linesize[i] = input->linesize[i];
 	}
+
+	return true;
+}
+
+/* whether the frame downloaded this frame has the same image as the one
+ * before it.  a render reaches the download after one frame each for the
+ * output scale, the conversion and the staging of the texture rendered the
+ * frame before, plus the readback_frames - 1 frames it stays staged */
+static inline bool frame_unchanged(struct obs_core_video *video,
+		bool last_frame_output)
+{
+	uint32_t age = video->readback_frames - 1 +
+		(video->gpu_conversion ? 3 : 2);
+
+	return last_frame_output &&
+		(video->unchanged_renders & (1ULL << age)) != 0;
 }
 
-static inline void output_video_data(struct obs_core_video *video,
-		struct video_data *input_frame, int count)
+static inline bool output_video_data_ref(struct obs_core_video *video,
+		struct video_frame *frame, uint64_t timestamp, int count,
+		bool unchanged)
+{
+	int surface_idx = oldest_surface_idx(video);
+	struct obs_readback *readback = video->readbacks[surface_idx];
+
+	if (!video_output_push_frame_ref(video->video, frame, count,
+				timestamp, unchanged,
+				release_held_readback, readback))
+		return false;
+
+	/* the readback now stays mapped until video-io releases it, and is
+	 * replaced in the queue the next time it would be staged to */
+	video->readbacks[surface_idx] = NULL;
+	video->mapped_readback = NULL;
+	return true;
+}
+
+/* unchanged frames repeat the last frame queued to video-io instead of
+ * being copied and converted again, and are flagged as duplicates so that
+ * encoders with a variable framerate can skip them.  returns false if the
+ * image didn't make it in to video-io, so the next frame can't repeat it */
+static inline bool output_video_data(struct obs_core_video *video,
+		struct video_data *input_frame, int count, bool unchanged)
 {
 	const struct video_output_info *info;
 	struct video_frame output_frame;
 	bool locked;
 
+	if (unchanged && video_output_repeat_frame(video->video, count,
+				input_frame->timestamp))
+		return true;
+
 	info = video_output_get_info(video->video);
 
+	if (video->zero_copy_readback &&
+	    get_frame_ref(video, &output_frame, input_frame, info))
+		return output_video_data_ref(video, &output_frame,
+				input_frame->timestamp, count, unchanged);
+
 	locked = video_output_lock_frame(video->video, &output_frame, count,
 			input_frame->timestamp);
 	if (locked) {
-		if (video->gpu_conversion) {
-			set_gpu_converted_data(video, &output_frame,
-					input_frame, info);
-
-		} else if (format_is_yuv(info->format)) {
-			convert_frame(&output_frame, input_frame, info);
-		} else {
-			copy_rgbx_frame(&output_frame, input_frame, info);
+		copy_output_frame(video, &video->layout, &output_frame,
+				input_frame, info);
+		video_output_unlock_frame(video->video);
+	}
+
+	return locked;
+}
+
+/* frames the scaled encoders couldn't keep up with are counted as skipped
+ * frames of the main output as well, which is what the stats report */
+static inline void add_scaled_skipped_frames(struct obs_core_video *video,
+		struct obs_scaled_video *scaled)
+{
+	uint32_t skipped = video_output_get_skipped_frames(scaled->video);
+
+	video_output_add_skipped_frames(video->video,
+			skipped - scaled->skipped_frames);
+	scaled->skipped_frames = skipped;
+}
+
+static void output_scaled_videos(struct obs_core_video *video)
+{
+	for (size_t i = 0; i < video->scaled_videos.num; i++) {
+		struct obs_scaled_video *scaled = video->scaled_videos.array[i];
+		const struct video_output_info *info;
+		struct obs_vframe_info vframe_info;
+		struct video_frame output_frame;
+		bool unchanged;
+
+		/* skips of the last frame, the loop can continue below */
+		add_scaled_skipped_frames(video, scaled);
+
+		unchanged = frame_unchanged(video, scaled->last_frame_output);
+		scaled->last_frame_output = false;
+
+		if (!scaled->frame_ready ||
+		    !ringbuf_pop_front(&scaled->vframe_info_buffer,
+			    &vframe_info, sizeof(vframe_info)))
+			continue;
+
+		if (unchanged && video_output_repeat_frame(scaled->video,
+					vframe_info.count,
+					vframe_info.timestamp)) {
+			scaled->last_frame_output = true;
+			continue;
 		}
 
-		video_output_unlock_frame(video->video);
+		info = video_output_get_info(scaled->video);
+
+		if (video_output_lock_frame(scaled->video, &output_frame,
+					vframe_info.count,
+					vframe_info.timestamp)) {
+			copy_output_frame(video, &scaled->layout,
+					&output_frame, &scaled->frame, info);
+			video_output_unlock_frame(scaled->video);
+			scaled->last_frame_output = true;
+		}
+	}
+}
+
+/* scaled outputs created since the last frame start with this one, which
+ * is the first frame whose timing is queued for them */
+static inline void add_new_scaled_videos(struct obs_core_video *video)
+{
+	if (!video->new_scaled_videos.num)
+		return;
+
+	da_push_back_da(video->scaled_videos, video->new_scaled_videos);
+	da_resize(video->new_scaled_videos, 0);
+}
+
+/* sleeps until pacing_spin_ns before the target, then spins the rest of the
+ * way, as the system sleep can wake up a millisecond or two late */
+static inline bool video_sleepto_ns(struct obs_core_video *video,
+		uint64_t time_target)
+{
+	uint64_t spin_ns = video->pacing_spin_ns;
+	uint64_t t;
+
+	if (!spin_ns)
+		return os_sleepto_ns(time_target);
+
+	t = os_gettime_ns();
+	if (t >= time_target)
+		return false;
+
+	if (time_target - t > spin_ns)
+		os_sleepto_ns(time_target - spin_ns);
+
+	while (os_gettime_ns() < time_target);
+	return true;
+}
+
+static inline void record_frame_timing(struct obs_core_video *video,
+		uint64_t time_target, bool lagged)
+{
+	struct obs_video_frame_timing *timing = &video->frame_timing;
+	uint64_t error = 0;
+	uint64_t bucket;
+
+	if (!lagged) {
+		uint64_t t = os_gettime_ns();
+		if (t > time_target)
+			error = t - time_target;
+	}
+
+	bucket = error / OBS_FRAME_TIMING_BUCKET_NS;
+	if (bucket >= OBS_FRAME_TIMING_BUCKETS)
+		bucket = OBS_FRAME_TIMING_BUCKETS - 1;
+
+	pthread_mutex_lock(&video->frame_timing_mutex);
+
+	timing->frames++;
+	if (lagged) {
+		timing->lagged_frames++;
+	} else {
+		timing->total_error_ns += error;
+		if (error > timing->max_error_ns)
+			timing->max_error_ns = error;
+		timing->histogram[bucket]++;
+	}
+
+	pthread_mutex_unlock(&video->frame_timing_mutex);
+}
+
+/* the queue only backs up while frames can't be downloaded, in which case
+ * the oldest timings are the ones that are no longer needed */
+static inline void push_vframe_info(struct ringbuf *rb,
+		const struct obs_vframe_info *vframe_info)
+{
+	if (!ringbuf_push_back(rb, vframe_info, sizeof(*vframe_info))) {
+		ringbuf_pop_front(rb, NULL, sizeof(*vframe_info));
+		ringbuf_push_back(rb, vframe_info, sizeof(*vframe_info));
 	}
 }
 
+static void push_vframe_infos(struct obs_core_video *video,
+		const struct obs_vframe_info *vframe_info)
+{
+	push_vframe_info(&video->vframe_info_buffer, vframe_info);
+
+	pthread_mutex_lock(&video->scaled_mutex);
+	for (size_t i = 0; i < video->scaled_videos.num; i++) {
+		struct obs_scaled_video *scaled = video->scaled_videos.array[i];
+		push_vframe_info(&scaled->vframe_info_buffer, vframe_info);
+	}
+	pthread_mutex_unlock(&video->scaled_mutex);
+}
+
+static inline uint64_t frame_clock_time(struct obs_core_video *video,
+		uint64_t frame)
+{
+	return video->clock_start +
+		video_output_get_frame_offset(video->video, frame);
+}
+
+/* restarts the frame clock at the given time, as frame 0 */
+static inline void reset_frame_clock(struct obs_core_video *video,
+		uint64_t time)
+{
+	video->video_time   = time;
+	video->clock_start  = time;
+	video->clock_frames = 0;
+}
+
+/* frames that were missed while lagging are counted on the current frame,
+ * which then covers every deadline that has passed */
 static inline void video_sleep(struct obs_core_video *video,
 		uint64_t *p_time, uint64_t interval_ns)
 {
 	struct obs_vframe_info vframe_info;
 	uint64_t cur_time = *p_time;
-	uint64_t t = cur_time + interval_ns;
-	int count;
+	uint64_t frame = video->clock_frames + 1;
+	uint64_t t = frame_clock_time(video, frame);
+	bool slept;
+	int count = 1;
 
-	if (os_sleepto_ns(t)) {
-		*p_time = t;
-		count = 1;
-	} else {
-		count = (int)((os_gettime_ns() - cur_time) / interval_ns);
-		*p_time = cur_time + interval_ns * count;
+	slept = video_sleepto_ns(video, t);
+	record_frame_timing(video, t, !slept);
+
+	if (!slept) {
+		uint64_t now = os_gettime_ns();
+		uint64_t skip = now > t ? (now - t) / interval_ns : 0;
+
+		if (skip && frame_clock_time(video, frame + skip) > now)
+			skip--;
+		while (frame_clock_time(video, frame + skip + 1) <= now)
+			skip++;
+
+		frame += skip;
+		count += (int)skip;
 	}
 
+	video->clock_frames = frame;
+	*p_time = frame_clock_time(video, frame);
+
 	vframe_info.timestamp = cur_time;
 	vframe_info.count = count;
-	circlebuf_push_back(&video->vframe_info_buffer, &vframe_info,
-			sizeof(vframe_info));
+	push_vframe_infos(video, &vframe_info);
+}
+
+/* offline frames don't wait on wall time at all, the clock simply moves on
+ * by one frame, so no frame is ever lagged or repeated */
+static inline void offline_sleep(struct obs_core_video *video,
+		uint64_t *p_time)
+{
+	struct obs_vframe_info vframe_info;
+
+	vframe_info.timestamp = *p_time;
+	vframe_info.count = 1;
+	push_vframe_infos(video, &vframe_info);
+
+	*p_time = frame_clock_time(video, ++video->clock_frames);
+	os_atomic_add_int64(&video->clock_ns,
+			(int64_t)*p_time - video->clock_ns);
+	audio_output_advance(obs->audio.audio, *p_time);
+}
+
+/* switches between real time and offline rendering between frames, when
+ * requested with obs_set_offline_render */
+static void update_offline_render(struct obs_core_video *video,
+		bool *offline)
+{
+	bool requested = video->offline_render;
+
+	if (requested == *offline)
+		return;
+
+	*offline = requested;
+
+	/* the virtual clock may have run ahead of wall time */
+	reset_frame_clock(video, requested ? video->video_time :
+			os_gettime_ns());
+
+	os_atomic_add_int64(&video->clock_ns,
+			(int64_t)video->video_time - video->clock_ns);
+	audio_output_advance(obs->audio.audio, video->video_time);
+	audio_output_set_offline(obs->audio.audio, requested);
+	video_output_set_offline(video->video, requested);
+
+	pthread_mutex_lock(&video->scaled_mutex);
+	for (size_t i = 0; i < video->scaled_videos.num; i++)
+		video_output_set_offline(video->scaled_videos.array[i]->video,
+				requested);
+	for (size_t i = 0; i < video->new_scaled_videos.num; i++)
+		video_output_set_offline(
+				video->new_scaled_videos.array[i]->video,
+				requested);
+	pthread_mutex_unlock(&video->scaled_mutex);
+
+	video->offline_active = requested;
+
+	blog(LOG_INFO, "Offline rendering %s",
+			requested ? "started" : "stopped");
 }
 
 static const char *output_frame_gs_context_name = "gs_context(video->graphics)";
@@ -563,21 +1241,41 @@ static inline void output_frame(void)
 	struct obs_core_video *video = &obs->video;
 	int cur_texture  = video->cur_texture;
 	int prev_texture = cur_texture == 0 ? NUM_TEXTURES-1 : cur_texture-1;
+	struct obs_vframe_info vframe_info;
 	struct video_data frame;
+	uint64_t start_time;
 	bool frame_ready;
+	bool unchanged;
 
 	memset(&frame, 0, sizeof(struct video_data));
 
 	profile_start(output_frame_gs_context_name);
 	gs_enter_context(video->graphics);
 
+	/* held until the scaled frames are output, so none can be released
+	 * while in use */
+	pthread_mutex_lock(&video->scaled_mutex);
+	add_new_scaled_videos(video);
+
+	if (video->zero_copy_readback)
+		recycle_released_readbacks(video);
+
+	gpu_timing_frame_begin();
+
+	start_time = os_gettime_ns();
 	profile_start(output_frame_render_video_name);
 	render_video(video, cur_texture, prev_texture);
+	gpu_timing_frame_end();
+	gs_render_target_pool_update();
 	profile_end(output_frame_render_video_name);
+	add_stage_time(video, OBS_VIDEO_STAGE_RENDER_VIDEO, start_time);
 
+	start_time = os_gettime_ns();
 	profile_start(output_frame_download_frame_name);
-	frame_ready = download_frame(video, prev_texture, &frame);
+	frame_ready = download_frame(video, &frame);
+	download_scaled_frames(video);
 	profile_end(output_frame_download_frame_name);
+	add_stage_time(video, OBS_VIDEO_STAGE_DOWNLOAD_FRAME, start_time);
 
 	profile_start(output_frame_gs_flush_name);
 	gs_flush();
@@ -586,19 +1284,64 @@ static inline void output_frame(void)
 	gs_leave_context();
 	profile_end(output_frame_gs_context_name);
 
-	if (frame_ready) {
-		struct obs_vframe_info vframe_info;
-		circlebuf_pop_front(&video->vframe_info_buffer, &vframe_info,
-				sizeof(vframe_info));
+	start_time = os_gettime_ns();
 
+	unchanged = frame_unchanged(video, video->last_frame_output);
+	video->last_frame_output = false;
+
+	if (frame_ready && ringbuf_pop_front(&video->vframe_info_buffer,
+				&vframe_info, sizeof(vframe_info))) {
 		frame.timestamp = vframe_info.timestamp;
 		profile_start(output_frame_output_video_data_name);
-		output_video_data(video, &frame, vframe_info.count);
+		video->last_frame_output = output_video_data(video, &frame,
+				vframe_info.count, unchanged);
 		profile_end(output_frame_output_video_data_name);
 	}
 
+	output_scaled_videos(video);
+	pthread_mutex_unlock(&video->scaled_mutex);
+
+	add_stage_time(video, OBS_VIDEO_STAGE_OUTPUT_VIDEO_DATA, start_time);
+
 	if (++video->cur_texture == NUM_TEXTURES)
 		video->cur_texture = 0;
+	if (++video->cur_surface == (int)video->readback_frames)
+		video->cur_surface = 0;
+}
+
+/* limits display rendering to the preview framerate.  frames within half
+ * an interval of the next preview time count as due, so that e.g. a 30 fps
+ * preview of 60 fps video draws exactly every other frame */
+static inline bool preview_due(struct obs_core_video *video,
+		uint64_t *next_preview, uint64_t interval)
+{
+	uint64_t time = video->video_time;
+
+	if (video->headless)
+		return false;
+	if (!video->preview_interval_ns)
+		return true;
+	if (time + interval / 2 < *next_preview)
+		return false;
+
+	*next_preview += video->preview_interval_ns;
+	if (*next_preview < time)
+		*next_preview = time + video->preview_interval_ns;
+	return true;
+}
+
+static inline void signal_frame_rendered(void)
+{
+	struct calldata data;
+	uint8_t stack[64];
+
+	if (!os_atomic_load_long(&obs->video.signal_next_frame) ||
+	    !os_atomic_compare_swap_long(&obs->video.signal_next_frame, 1, 0))
+		return;
+
+	calldata_init_fixed(&data, stack, sizeof(stack));
+	calldata_set_int(&data, "timestamp", (long long)os_gettime_ns());
+	signal_handler_signal(obs->signals, "frame_rendered", &data);
 }
 
 static const char *tick_sources_name = "tick_sources";
@@ -608,38 +1351,71 @@ void *obs_video_thread(void *param)
 {
 	uint64_t last_time = 0;
 	uint64_t interval = video_output_get_frame_time(obs->video.video);
+	uint64_t next_preview = 0;
+	bool offline = false;
 
-	obs->video.video_time = os_gettime_ns();
+	reset_frame_clock(&obs->video, os_gettime_ns());
+	obs->video.offline_active = false;
 
 	os_set_thread_name("libobs: graphics thread");
+	obs_apply_thread_settings(OBS_THREAD_ROLE_GRAPHICS);
 
 	const char *video_thread_name =
 		profile_store_name(obs_get_profiler_name_store(),
 			"obs_video_thread(%g ms)", interval / 1000000.);
 	profile_register_root(video_thread_name, interval);
 
+	obs_janitor_gs_begin();
+
 	while (!video_output_stopped(obs->video.video)) {
+		uint64_t start_time;
+
+		update_offline_render(&obs->video, &offline);
+
 		profile_start(video_thread_name);
 
+		start_time = os_gettime_ns();
 		profile_start(tick_sources_name);
 		last_time = tick_sources(obs->video.video_time, last_time);
 		profile_end(tick_sources_name);
-
-		profile_start(render_displays_name);
-		render_displays();
-		profile_end(render_displays_name);
+		add_stage_time(&obs->video, OBS_VIDEO_STAGE_TICK_SOURCES,
+				start_time);
 
 		profile_start(output_frame_name);
 		output_frame();
 		profile_end(output_frame_name);
 
+		/* displays are drawn once the frame has been handed to the
+		 * outputs, so a slow present can't hold up this frame */
+		if (preview_due(&obs->video, &next_preview, interval)) {
+			start_time = os_gettime_ns();
+			profile_start(render_displays_name);
+			render_displays();
+			profile_end(render_displays_name);
+			add_stage_time(&obs->video,
+					OBS_VIDEO_STAGE_RENDER_DISPLAYS,
+					start_time);
+		}
+
 		profile_end(video_thread_name);
 
+		/* graphics objects of sources and encoders torn down by the
+		 * janitor during the frame */
+		obs_janitor_gs_flush();
+
+		signal_frame_rendered();
+		gpu_timing_report();
 		profile_reenable_thread();
 
-		video_sleep(&obs->video, &obs->video.video_time, interval);
+		if (offline)
+			offline_sleep(&obs->video, &obs->video.video_time);
+		else
+			video_sleep(&obs->video, &obs->video.video_time,
+					interval);
 	}
 
+	obs_janitor_gs_end();
+
 	UNUSED_PARAMETER(param);
 	return NULL;
 }
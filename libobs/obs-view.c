@@ -58,6 +58,13 @@ void obs_view_free(struct obs_view *view)
 
 	memset(view->channels, 0, sizeof(view->channels));
 	pthread_mutex_destroy(&view->channels_mutex);
+
+	if (view->cache_texture) {
+		obs_enter_graphics();
+		gs_texture_destroy(view->cache_texture);
+		obs_leave_graphics();
+		view->cache_texture = NULL;
+	}
 }
 
 void obs_view_destroy(obs_view_t *view)
@@ -138,3 +145,71 @@ void obs_view_render(obs_view_t *view)
 
 	pthread_mutex_unlock(&view->channels_mutex);
 }
+
+static bool render_view_cache(struct obs_view *view, uint32_t cx, uint32_t cy)
+{
+	gs_texture_t *prev_target;
+	gs_zstencil_t *prev_zstencil;
+	struct vec4 clear_color;
+
+	if (view->cache_texture &&
+	    (gs_texture_get_width(view->cache_texture) != cx ||
+	     gs_texture_get_height(view->cache_texture) != cy)) {
+		gs_texture_destroy(view->cache_texture);
+		view->cache_texture = NULL;
+	}
+
+	if (!view->cache_texture) {
+		view->cache_texture = gs_texture_create(cx, cy, GS_RGBA, 1,
+				NULL, GS_RENDER_TARGET);
+		if (!view->cache_texture)
+			return false;
+	}
+
+	prev_target   = gs_get_render_target();
+	prev_zstencil = gs_get_zstencil_target();
+	gs_viewport_push();
+	gs_projection_push();
+
+	vec4_set(&clear_color, 0.0f, 0.0f, 0.0f, 1.0f);
+	gs_set_render_target(view->cache_texture, NULL);
+	gs_clear(GS_CLEAR_COLOR, &clear_color, 1.0f, 0);
+	gs_ortho(0.0f, (float)cx, 0.0f, (float)cy, -100.0f, 100.0f);
+	gs_set_viewport(0, 0, cx, cy);
+
+	obs_view_render(view);
+
+	gs_set_render_target(prev_target, prev_zstencil);
+	gs_projection_pop();
+	gs_viewport_pop();
+
+	view->cache_time  = obs->video.video_time;
+	view->cache_valid = true;
+	return true;
+}
+
+void obs_view_render_cached(obs_view_t *view, uint32_t cx, uint32_t cy)
+{
+	gs_effect_t *effect;
+	gs_eparam_t *param;
+
+	if (!view || !cx || !cy) return;
+
+	if (!view->cache_valid || view->cache_time != obs->video.video_time ||
+	    gs_texture_get_width(view->cache_texture) != cx ||
+	    gs_texture_get_height(view->cache_texture) != cy) {
+		if (!render_view_cache(view, cx, cy)) {
+			obs_view_render(view);
+			return;
+		}
+	}
+
+	effect = obs->video.default_effect;
+	param  = gs_effect_get_param_by_name(effect, "image");
+	gs_effect_set_texture(param, view->cache_texture);
+
+	gs_enable_blending(false);
+	while (gs_effect_loop(effect, "Draw"))
+		gs_draw_sprite(view->cache_texture, 0, 0, 0);
+	gs_enable_blending(true);
+}
@@ -399,6 +399,163 @@ bool obs_hotkeys_platform_is_pressed(obs_hotkeys_platform_t *context,
 	return vk_down(obs_key_to_virtual_key(key));
 }
 
+/*
+ * Raw input is delivered to a message-only window on the hotkey thread, even
+ * when another process has focus.  Unlike a low level keyboard hook it can't
+ * hold up everyone else's input if the hotkey thread is busy.
+ */
+struct obs_hotkeys_listener {
+	HWND   window;
+	HANDLE wake_event;
+	bool   input;
+};
+
+#define LISTENER_CLASS L"OBSHotkeyListener"
+
+static LRESULT CALLBACK listener_proc(HWND hwnd, UINT msg, WPARAM wparam,
+		LPARAM lparam)
+{
+	struct obs_hotkeys_listener *listener;
+	RAWINPUT input;
+	UINT size = sizeof(input);
+
+	if (msg != WM_INPUT)
+		return DefWindowProcW(hwnd, msg, wparam, lparam);
+
+	listener = (struct obs_hotkeys_listener*)GetWindowLongPtrW(hwnd,
+			GWLP_USERDATA);
+	if (listener && GetRawInputData((HRAWINPUT)lparam, RID_INPUT, &input,
+				&size, sizeof(RAWINPUTHEADER)) != (UINT)-1) {
+		/* mouse movement doesn't matter, only buttons */
+		if (input.header.dwType == RIM_TYPEKEYBOARD ||
+		    (input.header.dwType == RIM_TYPEMOUSE &&
+		     input.data.mouse.usButtonFlags))
+			listener->input = true;
+	}
+
+	return DefWindowProcW(hwnd, msg, wparam, lparam);
+}
+
+static bool register_listener_class(void)
+{
+	WNDCLASSW wc = {0};
+
+	wc.lpfnWndProc   = listener_proc;
+	wc.hInstance     = GetModuleHandleW(NULL);
+	wc.lpszClassName = LISTENER_CLASS;
+
+	return RegisterClassW(&wc) != 0 ||
+		GetLastError() == ERROR_CLASS_ALREADY_EXISTS;
+}
+
+struct obs_hotkeys_listener *obs_hotkeys_platform_listen_init(void)
+{
+	struct obs_hotkeys_listener *listener;
+	RAWINPUTDEVICE devices[2];
+
+	if (!register_listener_class())
+		return NULL;
+
+	listener = bzalloc(sizeof(struct obs_hotkeys_listener));
+	listener->wake_event = CreateEvent(NULL, false, false, NULL);
+	if (!listener->wake_event)
+		goto fail;
+
+	listener->window = CreateWindowExW(0, LISTENER_CLASS, L"", 0,
+			0, 0, 0, 0, HWND_MESSAGE, NULL,
+			GetModuleHandleW(NULL), NULL);
+	if (!listener->window)
+		goto fail;
+
+	SetWindowLongPtrW(listener->window, GWLP_USERDATA,
+			(LONG_PTR)listener);
+
+	/* generic desktop page: keyboard and mouse */
+	devices[0].usUsagePage = 0x01;
+	devices[0].usUsage     = 0x06;
+	devices[0].dwFlags     = RIDEV_INPUTSINK;
+	devices[0].hwndTarget  = listener->window;
+	devices[1].usUsagePage = 0x01;
+	devices[1].usUsage     = 0x02;
+	devices[1].dwFlags     = RIDEV_INPUTSINK;
+	devices[1].hwndTarget  = listener->window;
+
+	if (!RegisterRawInputDevices(devices, 2, sizeof(RAWINPUTDEVICE))) {
+		blog(LOG_WARNING, "hotkeys: RegisterRawInputDevices failed: "
+		                  "%lu", GetLastError());
+		goto fail;
+	}
+
+	return listener;
+
+fail:
+	obs_hotkeys_platform_listen_free(listener);
+	return NULL;
+}
+
+void obs_hotkeys_platform_listen_free(struct obs_hotkeys_listener *listener)
+{
+	if (!listener)
+		return;
+
+	if (listener->window) {
+		RAWINPUTDEVICE devices[2] = {
+			{0x01, 0x06, RIDEV_REMOVE, NULL},
+			{0x01, 0x02, RIDEV_REMOVE, NULL}
+		};
+
+		RegisterRawInputDevices(devices, 2, sizeof(RAWINPUTDEVICE));
+		DestroyWindow(listener->window);
+	}
+	if (listener->wake_event)
+		CloseHandle(listener->wake_event);
+
+	bfree(listener);
+}
+
+static inline void dispatch_messages(void)
+{
+	MSG msg;
+
+	while (PeekMessageW(&msg, NULL, 0, 0, PM_REMOVE)) {
+		TranslateMessage(&msg);
+		DispatchMessageW(&msg);
+	}
+}
+
+bool obs_hotkeys_platform_listen_wait(struct obs_hotkeys_listener *listener,
+		uint32_t timeout_ms)
+{
+	uint64_t end = os_gettime_ns() + timeout_ms * 1000000ULL;
+
+	listener->input = false;
+
+	for (;;) {
+		uint64_t now = os_gettime_ns();
+		DWORD ret;
+
+		if (now >= end)
+			break;
+
+		ret = MsgWaitForMultipleObjects(1, &listener->wake_event,
+				false, (DWORD)((end - now) / 1000000),
+				QS_ALLINPUT);
+		if (ret != WAIT_OBJECT_0 + 1)
+			break;
+
+		dispatch_messages();
+		if (listener->input)
+			break;
+	}
+
+	return listener->input;
+}
+
+void obs_hotkeys_platform_listen_wake(struct obs_hotkeys_listener *listener)
+{
+	SetEvent(listener->wake_event);
+}
+
 void obs_key_to_str(obs_key_t key, struct dstr *str)
 {
 	wchar_t name[128] = L"";
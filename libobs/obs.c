@@ -19,6 +19,7 @@
 
 #include "graphics/matrix4.h"
 #include "callback/calldata.h"
+#include "media-io/video-scaler.h"
 
 #include "obs.h"
 #include "obs-internal.h"
@@ -39,191 +40,576 @@ static inline void make_video_info(struct video_output_info *vi,
 	vi->height  = ovi->output_height;
 	vi->range   = ovi->range;
 	vi->colorspace = ovi->colorspace;
-	vi->cache_size = 6;
+	vi->cache_size = ovi->frame_cache_size;
+	obs_get_thread_settings(OBS_THREAD_ROLE_VIDEO_OUTPUT,
+			&vi->thread_settings);
 }
 
-#define PIXEL_SIZE 4
+static inline void add_plane(struct obs_conversion_layout *layout,
+		const char *tech, enum gs_color_format format,
+		uint32_t width, uint32_t height)
+{
+	struct obs_conversion_plane *plane =
+		&layout->planes[layout->num_planes++];
+
+	plane->tech   = tech;
+	plane->format = format;
+	plane->width  = width;
+	plane->height = height;
+}
+
+/* returns false if the format isn't converted on the GPU, in which case the
+ * output texture is read back as is */
+static bool calc_conversion_layout(struct obs_conversion_layout *layout,
+		enum video_format format, bool gpu_conversion,
+		uint32_t width, uint32_t height)
+{
+	memset(layout, 0, sizeof(*layout));
+
+	switch (gpu_conversion ? (uint32_t)format : VIDEO_FORMAT_NONE) {
+	case VIDEO_FORMAT_I420:
+		add_plane(layout, "Planar_Y", GS_R8, width, height);
+		add_plane(layout, "Planar_U", GS_R8, width / 2, height / 2);
+		add_plane(layout, "Planar_V", GS_R8, width / 2, height / 2);
+		return true;
+	case VIDEO_FORMAT_NV12:
+		add_plane(layout, "Planar_Y", GS_R8, width, height);
+		add_plane(layout, "NV12_UV", GS_R8G8, width / 2, height / 2);
+		return true;
+	case VIDEO_FORMAT_I444:
+		add_plane(layout, "Planar_Y", GS_R8, width, height);
+		add_plane(layout, "Planar_U", GS_R8, width, height);
+		add_plane(layout, "Planar_V", GS_R8, width, height);
+		return true;
+	}
+
+	add_plane(layout, NULL, GS_RGBA, width, height);
+	return false;
+}
 
-#define GET_ALIGN(val, align) \
-	(((val) + (align-1)) & ~(align-1))
+static bool create_convert_textures(
+		gs_texture_t *textures[NUM_TEXTURES][MAX_CONVERSION_PLANES],
+		const struct obs_conversion_layout *layout)
+{
+	for (size_t i = 0; i < NUM_TEXTURES; i++) {
+		for (size_t j = 0; j < layout->num_planes; j++) {
+			const struct obs_conversion_plane *plane =
+				&layout->planes[j];
+
+			textures[i][j] = gs_texture_create(
+					plane->width, plane->height,
+					plane->format, 1, NULL,
+					GS_RENDER_TARGET);
+
+			if (!textures[i][j])
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static void destroy_convert_textures(
+		gs_texture_t *textures[NUM_TEXTURES][MAX_CONVERSION_PLANES])
+{
+	for (size_t i = 0; i < NUM_TEXTURES; i++) {
+		for (size_t j = 0; j < MAX_CONVERSION_PLANES; j++) {
+			gs_texture_destroy(textures[i][j]);
+			textures[i][j] = NULL;
+		}
+	}
+}
 
-static inline void set_420p_sizes(const struct obs_video_info *ovi)
+struct obs_readback *obs_readback_create(
+		const struct obs_conversion_layout *layout)
+{
+	struct obs_readback *readback = bzalloc(sizeof(struct obs_readback));
+	readback->num_surfaces = layout->num_planes;
+
+	for (size_t i = 0; i < layout->num_planes; i++) {
+		const struct obs_conversion_plane *plane = &layout->planes[i];
+
+		readback->surfaces[i] = gs_stagesurface_create(
+				plane->width, plane->height, plane->format);
+
+		if (!readback->surfaces[i]) {
+			obs_readback_destroy(readback);
+			return NULL;
+		}
+	}
+
+	return readback;
+}
+
+void obs_readback_destroy(struct obs_readback *readback)
+{
+	if (!readback)
+		return;
+
+	for (size_t i = 0; i < readback->num_surfaces; i++)
+		gs_stagesurface_destroy(readback->surfaces[i]);
+	bfree(readback);
+}
+
+void obs_readback_unmap(struct obs_readback *readback)
+{
+	for (size_t i = 0; i < readback->num_surfaces; i++)
+		gs_stagesurface_unmap(readback->surfaces[i]);
+}
+
+static bool obs_init_gpu_conversion(struct obs_video_info *ovi)
 {
 	struct obs_core_video *video = &obs->video;
-	uint32_t chroma_pixels;
-	uint32_t total_bytes;
 
-	chroma_pixels = (ovi->output_width * ovi->output_height / 4);
-	chroma_pixels = GET_ALIGN(chroma_pixels, PIXEL_SIZE);
+	video->gpu_conversion = calc_conversion_layout(&video->layout,
+			ovi->output_format, ovi->gpu_conversion,
+			ovi->output_width, ovi->output_height);
 
-	video->plane_offsets[0] = 0;
-	video->plane_offsets[1] = ovi->output_width * ovi->output_height;
-	video->plane_offsets[2] = video->plane_offsets[1] + chroma_pixels;
+	if (ovi->gpu_conversion && !video->gpu_conversion)
+		blog(LOG_INFO, "GPU conversion not available for format: %u",
+				(unsigned int)ovi->output_format);
 
-	video->plane_linewidth[0] = ovi->output_width;
-	video->plane_linewidth[1] = ovi->output_width/2;
-	video->plane_linewidth[2] = ovi->output_width/2;
+	if (!video->gpu_conversion)
+		return true;
 
-	video->plane_sizes[0] = video->plane_offsets[1];
-	video->plane_sizes[1] = video->plane_sizes[0]/4;
-	video->plane_sizes[2] = video->plane_sizes[1];
+	return create_convert_textures(video->convert_textures,
+			&video->layout);
+}
 
-	total_bytes = video->plane_offsets[2] + chroma_pixels;
+static bool obs_init_textures(struct obs_video_info *ovi)
+{
+	struct obs_core_video *video = &obs->video;
+	size_t i;
 
-	video->conversion_height =
-		(total_bytes/PIXEL_SIZE + ovi->output_width-1) /
-		ovi->output_width;
+	for (i = 0; i < video->readback_frames; i++) {
+		video->readbacks[i] = obs_readback_create(&video->layout);
 
-	video->conversion_height = GET_ALIGN(video->conversion_height, 2);
-	video->conversion_tech = "Planar420";
+		if (!video->readbacks[i])
+			return false;
+	}
+
+	for (i = 0; i < NUM_TEXTURES; i++) {
+		video->render_textures[i] = gs_texture_create(
+				ovi->base_width, ovi->base_height,
+				GS_RGBA, 1, NULL, GS_RENDER_TARGET);
+
+		if (!video->render_textures[i])
+			return false;
+
+		video->output_textures[i] = gs_texture_create(
+				ovi->output_width, ovi->output_height,
+				GS_RGBA, 1, NULL, GS_RENDER_TARGET);
+
+		if (!video->output_textures[i])
+			return false;
+	}
+
+	return true;
 }
 
-static inline void set_nv12_sizes(const struct obs_video_info *ovi)
+static void free_scaled_video(struct obs_scaled_video *scaled)
+{
+	video_output_close(scaled->video);
+
+	gs_enter_context(obs->video.graphics);
+
+	if (scaled->mapped_readback)
+		obs_readback_unmap(scaled->mapped_readback);
+
+	for (size_t i = 0; i < MAX_READBACK_FRAMES; i++)
+		obs_readback_destroy(scaled->readbacks[i]);
+
+	for (size_t i = 0; i < NUM_TEXTURES; i++)
+		gs_texture_destroy(scaled->output_textures[i]);
+	destroy_convert_textures(scaled->convert_textures);
+
+	gs_leave_context();
+
+	ringbuf_free(&scaled->vframe_info_buffer);
+	bfree(scaled);
+}
+
+static bool init_scaled_textures(struct obs_scaled_video *scaled)
 {
 	struct obs_core_video *video = &obs->video;
-	uint32_t chroma_pixels;
-	uint32_t total_bytes;
 
-	chroma_pixels = (ovi->output_width * ovi->output_height / 2);
-	chroma_pixels = GET_ALIGN(chroma_pixels, PIXEL_SIZE);
+	calc_conversion_layout(&scaled->layout,
+			video_output_get_format(video->video),
+			video->gpu_conversion, scaled->width, scaled->height);
 
-	video->plane_offsets[0] = 0;
-	video->plane_offsets[1] = ovi->output_width * ovi->output_height;
+	for (size_t i = 0; i < NUM_TEXTURES; i++) {
+		scaled->output_textures[i] = gs_texture_create(
+				scaled->width, scaled->height,
+				GS_RGBA, 1, NULL, GS_RENDER_TARGET);
 
-	video->plane_linewidth[0] = ovi->output_width;
-	video->plane_linewidth[1] = ovi->output_width;
+		if (!scaled->output_textures[i])
+			return false;
+	}
 
-	video->plane_sizes[0] = video->plane_offsets[1];
-	video->plane_sizes[1] = video->plane_sizes[0]/2;
+	if (video->gpu_conversion &&
+	    !create_convert_textures(scaled->convert_textures,
+			    &scaled->layout))
+		return false;
 
-	total_bytes = video->plane_offsets[1] + chroma_pixels;
+	for (size_t i = 0; i < video->readback_frames; i++) {
+		scaled->readbacks[i] = obs_readback_create(&scaled->layout);
 
-	video->conversion_height =
-		(total_bytes/PIXEL_SIZE + ovi->output_width-1) /
-		ovi->output_width;
+		if (!scaled->readbacks[i])
+			return false;
+	}
 
-	video->conversion_height = GET_ALIGN(video->conversion_height, 2);
-	video->conversion_tech = "NV12";
+	return true;
 }
 
-static inline void set_444p_sizes(const struct obs_video_info *ovi)
+static struct obs_scaled_video *create_scaled_video(uint32_t width,
+		uint32_t height)
 {
 	struct obs_core_video *video = &obs->video;
-	uint32_t chroma_pixels;
-	uint32_t total_bytes;
+	struct obs_scaled_video *scaled;
+	struct video_output_info vi;
+	bool success;
+
+	vi        = *video_output_get_info(video->video);
+	vi.name   = "scaled video";
+	vi.width  = width;
+	vi.height = height;
+
+	scaled = bzalloc(sizeof(struct obs_scaled_video));
+	scaled->width  = width;
+	scaled->height = height;
+	scaled->refs   = 1;
+	ringbuf_reserve(&scaled->vframe_info_buffer, VFRAME_INFO_QUEUE_BYTES);
+
+	if (video_output_open(&scaled->video, &vi) != VIDEO_OUTPUT_SUCCESS) {
+		blog(LOG_WARNING, "Could not open scaled video output "
+		                  "(%"PRIu32"x%"PRIu32")", width, height);
+		bfree(scaled);
+		return NULL;
+	}
+
+	video_output_set_offline(scaled->video, video->offline_active);
+
+	gs_enter_context(video->graphics);
+	success = init_scaled_textures(scaled);
+	gs_leave_context();
+
+	if (!success) {
+		blog(LOG_WARNING, "Could not create scaled video textures "
+		                  "(%"PRIu32"x%"PRIu32")", width, height);
+		free_scaled_video(scaled);
+		return NULL;
+	}
 
-	chroma_pixels = (ovi->output_width * ovi->output_height);
-	chroma_pixels = GET_ALIGN(chroma_pixels, PIXEL_SIZE);
+	blog(LOG_INFO, "GPU scaled video output created: %"PRIu32"x%"PRIu32,
+			width, height);
+	return scaled;
+}
 
-	video->plane_offsets[0] = 0;
-	video->plane_offsets[1] = chroma_pixels;
-	video->plane_offsets[2] = chroma_pixels + chroma_pixels;
+static inline struct obs_scaled_video *find_scaled_video(uint32_t width,
+		uint32_t height)
+{
+	struct obs_core_video *video = &obs->video;
 
-	video->plane_linewidth[0] = ovi->output_width;
-	video->plane_linewidth[1] = ovi->output_width;
-	video->plane_linewidth[2] = ovi->output_width;
+	for (size_t i = 0; i < video->scaled_videos.num; i++) {
+		struct obs_scaled_video *scaled = video->scaled_videos.array[i];
 
-	video->plane_sizes[0] = chroma_pixels;
-	video->plane_sizes[1] = chroma_pixels;
-	video->plane_sizes[2] = chroma_pixels;
+		if (scaled->width == width && scaled->height == height)
+			return scaled;
+	}
 
-	total_bytes = video->plane_offsets[2] + chroma_pixels;
+	for (size_t i = 0; i < video->new_scaled_videos.num; i++) {
+		struct obs_scaled_video *scaled =
+			video->new_scaled_videos.array[i];
 
-	video->conversion_height =
-		(total_bytes/PIXEL_SIZE + ovi->output_width-1) /
-		ovi->output_width;
+		if (scaled->width == width && scaled->height == height)
+			return scaled;
+	}
 
-	video->conversion_height = GET_ALIGN(video->conversion_height, 2);
-	video->conversion_tech = "Planar444";
+	return NULL;
 }
 
-static inline void calc_gpu_conversion_sizes(const struct obs_video_info *ovi)
+video_t *obs_acquire_scaled_video(uint32_t width, uint32_t height)
 {
-	obs->video.conversion_height = 0;
-	memset(obs->video.plane_offsets, 0, sizeof(obs->video.plane_offsets));
-	memset(obs->video.plane_sizes, 0, sizeof(obs->video.plane_sizes));
-	memset(obs->video.plane_linewidth, 0,
-		sizeof(obs->video.plane_linewidth));
+	struct obs_core_video *video = &obs->video;
+	struct obs_scaled_video *scaled;
+	struct obs_scaled_video *created;
 
-	switch ((uint32_t)ovi->output_format) {
-	case VIDEO_FORMAT_I420:
-		set_420p_sizes(ovi);
-		break;
-	case VIDEO_FORMAT_NV12:
-		set_nv12_sizes(ovi);
-		break;
-	case VIDEO_FORMAT_I444:
-		set_444p_sizes(ovi);
-		break;
+	if (!video->video || !video->graphics)
+		return NULL;
+
+	pthread_mutex_lock(&video->scaled_mutex);
+	scaled = find_scaled_video(width, height);
+	if (scaled)
+		scaled->refs++;
+	pthread_mutex_unlock(&video->scaled_mutex);
+
+	if (scaled)
+		return scaled->video;
+
+	/* the graphics thread locks the scaled mutex while in the graphics
+	 * context, so the output must be created without holding it */
+	created = create_scaled_video(width, height);
+	if (!created)
+		return NULL;
+
+	pthread_mutex_lock(&video->scaled_mutex);
+	scaled = find_scaled_video(width, height);
+	if (scaled)
+		scaled->refs++;
+	else
+		da_push_back(video->new_scaled_videos, &created);
+	pthread_mutex_unlock(&video->scaled_mutex);
+
+	if (scaled) {
+		free_scaled_video(created);
+		return scaled->video;
 	}
+
+	return created->video;
 }
 
-static bool obs_init_gpu_conversion(struct obs_video_info *ovi)
+void obs_release_scaled_video(video_t *scaled_video)
 {
 	struct obs_core_video *video = &obs->video;
+	struct obs_scaled_video *to_free = NULL;
+	bool found = false;
 
-	calc_gpu_conversion_sizes(ovi);
+	if (!scaled_video)
+		return;
 
-	if (!video->conversion_height) {
-		blog(LOG_INFO, "GPU conversion not available for format: %u",
-				(unsigned int)ovi->output_format);
-		video->gpu_conversion = false;
-		return true;
+	pthread_mutex_lock(&video->scaled_mutex);
+
+	for (size_t i = 0; i < video->scaled_videos.num; i++) {
+		struct obs_scaled_video *scaled = video->scaled_videos.array[i];
+
+		if (scaled->video == scaled_video) {
+			if (--scaled->refs == 0) {
+				da_erase(video->scaled_videos, i);
+				to_free = scaled;
+			}
+			found = true;
+			break;
+		}
 	}
 
-	for (size_t i = 0; i < NUM_TEXTURES; i++) {
-		video->convert_textures[i] = gs_texture_create(
-				ovi->output_width, video->conversion_height,
-				GS_RGBA, 1, NULL, GS_RENDER_TARGET);
+	/* released before it was used by a frame */
+	for (size_t i = 0; !found && i < video->new_scaled_videos.num; i++) {
+		struct obs_scaled_video *scaled =
+			video->new_scaled_videos.array[i];
+
+		if (scaled->video == scaled_video) {
+			if (--scaled->refs == 0) {
+				da_erase(video->new_scaled_videos, i);
+				to_free = scaled;
+			}
+			found = true;
+		}
+	}
+
+	pthread_mutex_unlock(&video->scaled_mutex);
+
+	if (to_free)
+		free_scaled_video(to_free);
+}
 
-		if (!video->convert_textures[i])
+static inline bool scaled_videos_active(void)
+{
+	struct obs_core_video *video = &obs->video;
+	bool active;
+
+	pthread_mutex_lock(&video->scaled_mutex);
+	active = video->scaled_videos.num != 0 ||
+		video->new_scaled_videos.num != 0;
+	pthread_mutex_unlock(&video->scaled_mutex);
+
+	return active;
+}
+
+static bool obs_init_convert_workers(void)
+{
+	struct obs_core_video *video = &obs->video;
+	size_t workers;
+
+	if (video->gpu_conversion || video->conversion_slices <= 1 ||
+	    !format_is_yuv(video_output_get_format(video->video)))
+		return true;
+
+	if (os_sem_init(&video->convert_done_sem, 0) != 0)
+		return false;
+
+	workers = video->conversion_slices - 1;
+	video->convert_stop = false;
+
+	for (size_t i = 0; i < workers; i++) {
+		struct obs_convert_worker *worker = &video->convert_workers[i];
+
+		if (os_sem_init(&worker->start_sem, 0) != 0)
 			return false;
+		if (pthread_create(&worker->thread, NULL, obs_convert_thread,
+					worker) != 0) {
+			os_sem_destroy(worker->start_sem);
+			worker->start_sem = NULL;
+			return false;
+		}
+
+		video->num_convert_workers++;
 	}
 
 	return true;
 }
 
-static bool obs_init_textures(struct obs_video_info *ovi)
+static void obs_free_convert_workers(void)
 {
 	struct obs_core_video *video = &obs->video;
-	uint32_t output_height = video->gpu_conversion ?
-		video->conversion_height : ovi->output_height;
-	size_t i;
+	void *thread_retval;
 
-	for (i = 0; i < NUM_TEXTURES; i++) {
-		video->copy_surfaces[i] = gs_stagesurface_create(
-				ovi->output_width, output_height, GS_RGBA);
+	video->convert_stop = true;
 
-		if (!video->copy_surfaces[i])
-			return false;
+	for (size_t i = 0; i < video->num_convert_workers; i++) {
+		struct obs_convert_worker *worker = &video->convert_workers[i];
 
-		video->render_textures[i] = gs_texture_create(
-				ovi->base_width, ovi->base_height,
-				GS_RGBA, 1, NULL, GS_RENDER_TARGET);
+		os_sem_post(worker->start_sem);
+		pthread_join(worker->thread, &thread_retval);
+		os_sem_destroy(worker->start_sem);
+		worker->start_sem = NULL;
+	}
 
-		if (!video->render_textures[i])
-			return false;
+	os_sem_destroy(video->convert_done_sem);
+	video->convert_done_sem = NULL;
+	video->num_convert_workers = 0;
+}
 
-		video->output_textures[i] = gs_texture_create(
-				ovi->output_width, ovi->output_height,
-				GS_RGBA, 1, NULL, GS_RENDER_TARGET);
+static bool obs_init_tick_workers(void)
+{
+	struct obs_core_video *video = &obs->video;
 
-		if (!video->output_textures[i])
+	if (!video->tick_threads)
+		return true;
+
+	if (os_sem_init(&video->tick_start_sem, 0) != 0)
+		return false;
+	if (os_sem_init(&video->tick_done_sem, 0) != 0)
+		return false;
+
+	video->tick_stop = false;
+
+	for (size_t i = 0; i < video->tick_threads; i++) {
+		if (pthread_create(&video->tick_workers[i], NULL,
+					obs_tick_thread, NULL) != 0)
 			return false;
+
+		video->num_tick_workers++;
 	}
 
 	return true;
 }
 
+static void obs_free_tick_workers(void)
+{
+	struct obs_core_video *video = &obs->video;
+	void *thread_retval;
+
+	video->tick_stop = true;
+
+	for (size_t i = 0; i < video->num_tick_workers; i++)
+		os_sem_post(video->tick_start_sem);
+	for (size_t i = 0; i < video->num_tick_workers; i++)
+		pthread_join(video->tick_workers[i], &thread_retval);
+
+	os_sem_destroy(video->tick_start_sem);
+	os_sem_destroy(video->tick_done_sem);
+	video->tick_start_sem = NULL;
+	video->tick_done_sem = NULL;
+	video->num_tick_workers = 0;
+
+	da_free(video->threaded_ticks);
+}
+
+#define get_conversion_param(name) \
+	params->name = gs_effect_get_param_by_name(effect, #name)
+
+static void get_conversion_params(gs_effect_t *effect,
+		struct obs_conversion_params *params)
+{
+	get_conversion_param(image);
+	get_conversion_param(width);
+	get_conversion_param(height);
+	get_conversion_param(width_i);
+	get_conversion_param(height_i);
+	get_conversion_param(width_d2);
+	get_conversion_param(height_d2);
+	get_conversion_param(width_d2_i);
+	get_conversion_param(height_d2_i);
+	get_conversion_param(input_width);
+	get_conversion_param(input_height);
+	get_conversion_param(input_width_i);
+	get_conversion_param(input_height_i);
+	get_conversion_param(input_width_i_d2);
+	get_conversion_param(input_height_i_d2);
+	get_conversion_param(u_plane_offset);
+	get_conversion_param(v_plane_offset);
+}
+
+#undef get_conversion_param
+
+/* compiled shaders are kept next to the module configs, in 'shader-cache' */
+static void set_shader_cache_path(void)
+{
+	struct dstr path = {0};
+
+	if (!obs->module_config_path || !*obs->module_config_path)
+		return;
+
+	dstr_copy(&path, obs->module_config_path);
+	if (dstr_end(&path) != '/')
+		dstr_cat_ch(&path, '/');
+	dstr_cat(&path, "shader-cache");
+
+	if (os_mkdirs(path.array) != MKDIR_ERROR)
+		gs_set_shader_cache_path(path.array);
+	else
+		blog(LOG_WARNING, "Failed to create shader cache directory "
+		                  "'%s'", path.array);
+
+	dstr_free(&path);
+}
+
+/* each effect is compiled (or read from the shader cache) here, so each
+ * gets its own profiler entry */
+static gs_effect_t *load_libobs_effect(const char *name)
+{
+	const char *profile_name =
+		profile_store_name(obs_get_profiler_name_store(),
+				"gs_effect_create_from_file(%s)", name);
+	char *filename = find_libobs_data_file(name);
+	gs_effect_t *effect;
+
+	profile_start(profile_name);
+	effect = gs_effect_create_from_file(filename, NULL);
+	profile_end(profile_name);
+
+	bfree(filename);
+	return effect;
+}
+
+static const char *obs_init_graphics_name = "obs_init_graphics";
+static const char *gs_create_name = "gs_create";
 static int obs_init_graphics(struct obs_video_info *ovi)
 {
 	struct obs_core_video *video = &obs->video;
 	bool success = true;
 	int errorcode;
 
+	profile_start(obs_init_graphics_name);
+
+	profile_start(gs_create_name);
 	errorcode = gs_create(&video->graphics, ovi->graphics_module,
 			ovi->adapter);
+	profile_end(gs_create_name);
+
 	if (errorcode != GS_SUCCESS) {
+		profile_end(obs_init_graphics_name);
+
 		switch (errorcode) {
 		case GS_ERROR_MODULE_NOT_FOUND:
 			return OBS_VIDEO_MODULE_NOT_FOUND;
@@ -236,47 +622,27 @@ static int obs_init_graphics(struct obs_video_info *ovi)
 
 	gs_enter_context(video->graphics);
 
-	char *filename = find_libobs_data_file("default.effect");
-	video->default_effect = gs_effect_create_from_file(filename,
-			NULL);
-	bfree(filename);
-
-	if (gs_get_device_type() == GS_DEVICE_OPENGL) {
-		filename = find_libobs_data_file("default_rect.effect");
-		video->default_rect_effect = gs_effect_create_from_file(
-				filename, NULL);
-		bfree(filename);
-	}
+	set_shader_cache_path();
 
-	filename = find_libobs_data_file("opaque.effect");
-	video->opaque_effect = gs_effect_create_from_file(filename,
-			NULL);
-	bfree(filename);
-
-	filename = find_libobs_data_file("solid.effect");
-	video->solid_effect = gs_effect_create_from_file(filename,
-			NULL);
-	bfree(filename);
+	video->default_effect = load_libobs_effect("default.effect");
 
-	filename = find_libobs_data_file("format_conversion.effect");
-	video->conversion_effect = gs_effect_create_from_file(filename,
-			NULL);
-	bfree(filename);
+	if (gs_get_device_type() == GS_DEVICE_OPENGL)
+		video->default_rect_effect =
+			load_libobs_effect("default_rect.effect");
 
-	filename = find_libobs_data_file("bicubic_scale.effect");
-	video->bicubic_effect = gs_effect_create_from_file(filename,
-			NULL);
-	bfree(filename);
+	video->opaque_effect = load_libobs_effect("opaque.effect");
+	video->solid_effect = load_libobs_effect("solid.effect");
+	video->conversion_effect =
+		load_libobs_effect("format_conversion.effect");
 
-	filename = find_libobs_data_file("lanczos_scale.effect");
-	video->lanczos_effect = gs_effect_create_from_file(filename,
-			NULL);
-	bfree(filename);
+	if (video->conversion_effect)
+		get_conversion_params(video->conversion_effect,
+				&video->conversion_params);
 
-	filename = find_libobs_data_file("bilinear_lowres_scale.effect");
-	video->bilinear_lowres_effect = gs_effect_create_from_file(filename,
-			NULL);
-	bfree(filename);
+	video->bicubic_effect = load_libobs_effect("bicubic_scale.effect");
+	video->lanczos_effect = load_libobs_effect("lanczos_scale.effect");
+	video->bilinear_lowres_effect =
+		load_libobs_effect("bilinear_lowres_scale.effect");
 
 	if (!video->default_effect)
 		success = false;
@@ -292,6 +658,7 @@ static int obs_init_graphics(struct obs_video_info *ovi)
 		success = false;
 
 	gs_leave_context();
+	profile_end(obs_init_graphics_name);
 	return success ? OBS_VIDEO_SUCCESS : OBS_VIDEO_FAIL;
 }
 
@@ -330,6 +697,18 @@ static int obs_init_video(struct obs_video_info *ovi)
 	video->output_height  = ovi->output_height;
 	video->gpu_conversion = ovi->gpu_conversion;
 	video->scale_type     = ovi->scale_type;
+	video->readback_frames = ovi->readback_frames;
+	video->zero_copy_readback = ovi->zero_copy_readback;
+	video->conversion_slices = ovi->conversion_slices;
+	video->tick_threads = ovi->tick_threads;
+	video->pacing_spin_ns = (uint64_t)ovi->pacing_spin_us * 1000;
+	video->headless = ovi->headless;
+	video->low_latency = ovi->low_latency;
+	video->preview_interval_ns = ovi->preview_fps ?
+		1000000000ULL / ovi->preview_fps : 0;
+	memset(&video->frame_timing, 0, sizeof(video->frame_timing));
+	memset(&video->pipeline_timing, 0, sizeof(video->pipeline_timing));
+	ringbuf_reserve(&video->vframe_info_buffer, VFRAME_INFO_QUEUE_BYTES);
 
 	set_video_matrix(video, ovi);
 
@@ -345,15 +724,27 @@ static int obs_init_video(struct obs_video_info *ovi)
 		return OBS_VIDEO_FAIL;
 	}
 
+	if (pthread_mutex_init(&video->held_surfaces_mutex, NULL) != 0)
+		return OBS_VIDEO_FAIL;
+	if (pthread_mutex_init(&video->scaled_mutex, NULL) != 0)
+		return OBS_VIDEO_FAIL;
+	if (pthread_mutex_init(&video->frame_timing_mutex, NULL) != 0)
+		return OBS_VIDEO_FAIL;
+
 	gs_enter_context(video->graphics);
 
-	if (ovi->gpu_conversion && !obs_init_gpu_conversion(ovi))
+	if (!obs_init_gpu_conversion(ovi))
 		return OBS_VIDEO_FAIL;
 	if (!obs_init_textures(ovi))
 		return OBS_VIDEO_FAIL;
 
 	gs_leave_context();
 
+	if (!obs_init_convert_workers())
+		return OBS_VIDEO_FAIL;
+	if (!obs_init_tick_workers())
+		return OBS_VIDEO_FAIL;
+
 	errorcode = pthread_create(&video->video_thread, NULL,
 			obs_video_thread, obs);
 	if (errorcode != 0)
@@ -376,6 +767,9 @@ static void stop_video(void)
 		}
 	}
 
+	obs_free_convert_workers();
+	obs_free_tick_workers();
+
 }
 
 static void obs_free_video(void)
@@ -383,6 +777,14 @@ static void obs_free_video(void)
 	struct obs_core_video *video = &obs->video;
 
 	if (video->video) {
+		/* scaled outputs are normally released by their encoders */
+		for (size_t i = 0; i < video->scaled_videos.num; i++)
+			free_scaled_video(video->scaled_videos.array[i]);
+		for (size_t i = 0; i < video->new_scaled_videos.num; i++)
+			free_scaled_video(video->new_scaled_videos.array[i]);
+		da_free(video->scaled_videos);
+		da_free(video->new_scaled_videos);
+
 		video_output_close(video->video);
 		video->video = NULL;
 
@@ -391,26 +793,45 @@ static void obs_free_video(void)
 
 		gs_enter_context(video->graphics);
 
-		if (video->mapped_surface) {
-			gs_stagesurface_unmap(video->mapped_surface);
-			video->mapped_surface = NULL;
+		if (video->mapped_readback) {
+			obs_readback_unmap(video->mapped_readback);
+			video->mapped_readback = NULL;
+		}
+
+		for (size_t i = 0; i < MAX_READBACK_FRAMES; i++) {
+			obs_readback_destroy(video->readbacks[i]);
+			video->readbacks[i] = NULL;
 		}
 
+		/* all held readbacks were released when video-io was closed */
+		for (size_t i = 0; i < video->released_readbacks.num; i++) {
+			struct obs_readback *readback =
+				video->released_readbacks.array[i];
+			obs_readback_unmap(readback);
+			obs_readback_destroy(readback);
+		}
+		for (size_t i = 0; i < video->free_readbacks.num; i++)
+			obs_readback_destroy(video->free_readbacks.array[i]);
+
 		for (size_t i = 0; i < NUM_TEXTURES; i++) {
-			gs_stagesurface_destroy(video->copy_surfaces[i]);
 			gs_texture_destroy(video->render_textures[i]);
-			gs_texture_destroy(video->convert_textures[i]);
 			gs_texture_destroy(video->output_textures[i]);
 
-			video->copy_surfaces[i]    = NULL;
 			video->render_textures[i]  = NULL;
-			video->convert_textures[i] = NULL;
 			video->output_textures[i]  = NULL;
 		}
+		destroy_convert_textures(video->convert_textures);
+
+		gpu_timing_free(&video->gpu_timing);
 
 		gs_leave_context();
 
-		circlebuf_free(&video->vframe_info_buffer);
+		ringbuf_free(&video->vframe_info_buffer);
+		da_free(video->released_readbacks);
+		da_free(video->free_readbacks);
+		pthread_mutex_destroy(&video->held_surfaces_mutex);
+		pthread_mutex_destroy(&video->scaled_mutex);
+		pthread_mutex_destroy(&video->frame_timing_mutex);
 
 		memset(&video->textures_rendered, 0,
 				sizeof(video->textures_rendered));
@@ -421,7 +842,10 @@ static void obs_free_video(void)
 		memset(&video->textures_converted, 0,
 				sizeof(video->textures_converted));
 
+		video->unchanged_renders = 0;
+		video->last_frame_output = false;
 		video->cur_texture = 0;
+		video->cur_surface = 0;
 	}
 }
 
@@ -496,6 +920,8 @@ static bool obs_init_data(void)
 		goto fail;
 	if (pthread_mutex_init(&data->sources_mutex, &attr) != 0)
 		goto fail;
+	if (pthread_mutex_init(&data->snapshot_mutex, NULL) != 0)
+		goto fail;
 	if (pthread_mutex_init(&data->displays_mutex, &attr) != 0)
 		goto fail;
 	if (pthread_mutex_init(&data->outputs_mutex, &attr) != 0)
@@ -506,6 +932,8 @@ static bool obs_init_data(void)
 		goto fail;
 	if (!obs_view_init(&data->main_view))
 		goto fail;
+	if (!obs_encoder_pool_init(&data->audio_encoder_pool))
+		goto fail;
 
 	data->valid = true;
 
@@ -525,6 +953,14 @@ void obs_main_view_free(struct obs_view *view)
 	pthread_mutex_destroy(&view->channels_mutex);
 }
 
+static void free_snapshot(struct obs_source_snapshot *snapshot)
+{
+	if (snapshot) {
+		da_free(snapshot->sources);
+		bfree(snapshot);
+	}
+}
+
 #define FREE_OBS_LINKED_LIST(type) \
 	do { \
 		int unfreed = 0; \
@@ -561,8 +997,18 @@ static void obs_free_data(void)
 	FREE_OBS_LINKED_LIST(display);
 	FREE_OBS_LINKED_LIST(service);
 
+	obs_encoder_pool_free(&data->audio_encoder_pool);
+
+	for (size_t i = 0; i < data->retired_snapshots.num; i++)
+		free_snapshot(data->retired_snapshots.array[i]);
+	free_snapshot(data->source_snapshot);
+	da_free(data->retired_snapshots);
+	da_free(data->deferred_destroys);
+	data->source_snapshot = NULL;
+
 	pthread_mutex_destroy(&data->user_sources_mutex);
 	pthread_mutex_destroy(&data->sources_mutex);
+	pthread_mutex_destroy(&data->snapshot_mutex);
 	pthread_mutex_destroy(&data->displays_mutex);
 	pthread_mutex_destroy(&data->outputs_mutex);
 	pthread_mutex_destroy(&data->encoders_mutex);
@@ -586,6 +1032,8 @@ static const char *obs_signals[] = {
 	"void channel_change(int channel, in out ptr source, ptr prev_source)",
 	"void master_volume(in out float volume)",
 
+	"void frame_rendered(int timestamp)",
+
 	"void hotkey_layout_change()",
 	"void hotkey_register(ptr hotkey)",
 	"void hotkey_unregister(ptr hotkey)",
@@ -658,6 +1106,12 @@ static inline void stop_hotkeys(void)
 
 	if (hotkeys->hotkey_thread_initialized) {
 		os_event_signal(hotkeys->stop_event);
+
+		pthread_mutex_lock(&hotkeys->mutex);
+		if (hotkeys->listener)
+			obs_hotkeys_platform_listen_wake(hotkeys->listener);
+		pthread_mutex_unlock(&hotkeys->mutex);
+
 		pthread_join(hotkeys->hotkey_thread, &thread_ret);
 		hotkeys->hotkey_thread_initialized = false;
 	}
@@ -687,11 +1141,38 @@ extern const struct obs_source_info scene_info;
 
 extern void log_system_info(void);
 
+static bool obs_init_module_mutex(void)
+{
+	pthread_mutexattr_t attr;
+	bool success = false;
+
+	if (pthread_mutexattr_init(&attr) != 0)
+		return false;
+	if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) != 0)
+		goto fail;
+	if (pthread_mutex_init(&obs->module_mutex, &attr) != 0)
+		goto fail;
+
+	success = true;
+
+fail:
+	pthread_mutexattr_destroy(&attr);
+	return success;
+}
+
 static bool obs_init(const char *locale, const char *module_config_path,
 		profiler_name_store_t *store)
 {
 	obs = bzalloc(sizeof(struct obs_core));
 
+	pthread_mutex_init_value(&obs->thread_settings_mutex);
+	if (pthread_mutex_init(&obs->thread_settings_mutex, NULL) != 0)
+		return false;
+
+	pthread_mutex_init_value(&obs->module_mutex);
+	if (!obs_init_module_mutex())
+		return false;
+
 	obs->name_store_owned = !store;
 	obs->name_store = store ? store : profiler_name_store_create();
 	if (!obs->name_store) {
@@ -708,6 +1189,12 @@ static bool obs_init(const char *locale, const char *module_config_path,
 	if (!obs_init_hotkeys())
 		return false;
 
+	obs->task_pool = os_task_pool_create("libobs: task pool", 0);
+	if (!obs->task_pool)
+		return false;
+	if (!obs_janitor_init(&obs->janitor))
+		return false;
+
 	if (module_config_path)
 		obs->module_config_path = bstrdup(module_config_path);
 	obs->locale = bstrdup(locale);
@@ -755,6 +1242,25 @@ void obs_shutdown(void)
 	if (!obs)
 		return;
 
+	stop_video();
+	stop_hotkeys();
+	obs_janitor_stop(&obs->janitor);
+
+	os_task_pool_destroy(obs->task_pool);
+	obs->task_pool = NULL;
+
+	obs_free_data();
+	obs_free_video();
+	video_scaler_clear_cache();
+	obs_free_hotkeys();
+	obs_free_graphics();
+	obs_janitor_free(&obs->janitor);
+	obs_free_audio();
+	proc_handler_destroy(obs->procs);
+	signal_handler_destroy(obs->signals);
+
+	/* teardowns can use the type data, so it's only freed once the
+	 * janitor has drained its queue and every object is destroyed */
 #define FREE_REGISTERED_TYPES(structure, list) \
 	do { \
 		for (size_t i = 0; i < list.num; i++) { \
@@ -776,16 +1282,7 @@ void obs_shutdown(void)
 
 #undef FREE_REGISTERED_TYPES
 
-	stop_video();
-	stop_hotkeys();
-
-	obs_free_data();
-	obs_free_video();
-	obs_free_hotkeys();
-	obs_free_graphics();
-	obs_free_audio();
-	proc_handler_destroy(obs->procs);
-	signal_handler_destroy(obs->signals);
+	da_free(obs->type_mem_tags);
 
 	module = obs->first_module;
 	while (module) {
@@ -802,6 +1299,8 @@ void obs_shutdown(void)
 	if (obs->name_store_owned)
 		profiler_name_store_free(obs->name_store);
 
+	pthread_mutex_destroy(&obs->thread_settings_mutex);
+	pthread_mutex_destroy(&obs->module_mutex);
 	bfree(obs->module_config_path);
 	bfree(obs->locale);
 	bfree(obs);
@@ -860,7 +1359,8 @@ int obs_reset_video(struct obs_video_info *ovi)
 	if (!obs) return OBS_VIDEO_FAIL;
 
 	/* don't allow changing of video settings if active. */
-	if (obs->video.video && video_output_active(obs->video.video))
+	if (obs->video.video && (video_output_active(obs->video.video) ||
+	                         scaled_videos_active()))
 		return OBS_VIDEO_CURRENTLY_ACTIVE;
 
 	if (!size_valid(ovi->output_width, ovi->output_height) ||
@@ -881,6 +1381,30 @@ int obs_reset_video(struct obs_video_info *ovi)
 	ovi->output_width  &= 0xFFFFFFFC;
 	ovi->output_height &= 0xFFFFFFFE;
 
+	if (ovi->conversion_slices > MAX_CONVERSION_SLICES)
+		ovi->conversion_slices = MAX_CONVERSION_SLICES;
+	if (ovi->pacing_spin_us > MAX_PACING_SPIN_US)
+		ovi->pacing_spin_us = MAX_PACING_SPIN_US;
+	if (ovi->tick_threads > MAX_TICK_THREADS)
+		ovi->tick_threads = MAX_TICK_THREADS;
+
+	if (ovi->low_latency) {
+		ovi->readback_frames  = MIN_READBACK_FRAMES;
+		ovi->frame_cache_size = MIN_FRAME_CACHE_SIZE;
+	}
+
+	if (!ovi->frame_cache_size)
+		ovi->frame_cache_size = DEFAULT_FRAME_CACHE_SIZE;
+	else if (ovi->frame_cache_size < MIN_FRAME_CACHE_SIZE)
+		ovi->frame_cache_size = MIN_FRAME_CACHE_SIZE;
+	else if (ovi->frame_cache_size > MAX_FRAME_CACHE_SIZE)
+		ovi->frame_cache_size = MAX_FRAME_CACHE_SIZE;
+
+	if (ovi->readback_frames < MIN_READBACK_FRAMES)
+		ovi->readback_frames = MIN_READBACK_FRAMES;
+	else if (ovi->readback_frames > MAX_READBACK_FRAMES)
+		ovi->readback_frames = MAX_READBACK_FRAMES;
+
 	if (!video->graphics) {
 		int errorcode = obs_init_graphics(ovi);
 		if (errorcode != OBS_VIDEO_SUCCESS) {
@@ -894,11 +1418,19 @@ int obs_reset_video(struct obs_video_info *ovi)
 	               "\tbase resolution:   %dx%d\n"
 	               "\toutput resolution: %dx%d\n"
 	               "\tfps:               %d/%d\n"
-	               "\tformat:            %s",
+	               "\tformat:            %s\n"
+	               "\treadback frames:   %d\n"
+	               "\tpacing spin (us):  %d\n"
+	               "\tframe cache size:  %d\n"
+	               "\tlow latency:       %s",
 	               ovi->base_width, ovi->base_height,
 	               ovi->output_width, ovi->output_height,
 	               ovi->fps_num, ovi->fps_den,
-		       get_video_format_name(ovi->output_format));
+		       get_video_format_name(ovi->output_format),
+		       (int)ovi->readback_frames,
+		       (int)ovi->pacing_spin_us,
+		       (int)ovi->frame_cache_size,
+		       ovi->low_latency ? "true" : "false");
 
 	return obs_init_video(ovi);
 }
@@ -922,17 +1454,34 @@ bool obs_reset_audio(const struct obs_audio_info *oai)
 	ai.format = AUDIO_FORMAT_FLOAT_PLANAR;
 	ai.speakers = oai->speakers;
 	ai.buffer_ms = oai->buffer_ms;
+	ai.tick_ms = 0;
+	ai.ts_smoothing_ns = 0;
+	obs_get_thread_settings(OBS_THREAD_ROLE_AUDIO, &ai.thread_settings);
+
+	if (oai->low_latency) {
+		if (ai.buffer_ms > LOW_LATENCY_AUDIO_BUFFER_MS)
+			ai.buffer_ms = LOW_LATENCY_AUDIO_BUFFER_MS;
+
+		ai.tick_ms = LOW_LATENCY_AUDIO_TICK_MS;
+		ai.ts_smoothing_ns = TS_SMOOTHING_THRESHOLD_LOW_LATENCY;
+	}
 
 	blog(LOG_INFO, "---------------------------------");
 	blog(LOG_INFO, "audio settings reset:\n"
 	               "\tsamples per sec: %d\n"
 	               "\tspeakers:        %d\n"
-	               "\tbuffering (ms):  %d",
+	               "\tbuffering (ms):  %d\n"
+	               "\tlow latency:     %s",
 	               (int)ai.samples_per_sec,
 	               (int)ai.speakers,
-	               (int)ai.buffer_ms);
+	               (int)ai.buffer_ms,
+	               oai->low_latency ? "true" : "false");
 
-	return obs_init_audio(&ai);
+	if (!obs_init_audio(&ai))
+		return false;
+
+	obs->audio.low_latency = oai->low_latency;
+	return true;
 }
 
 bool obs_get_video_info(struct obs_video_info *ovi)
@@ -959,10 +1508,102 @@ bool obs_get_video_info(struct obs_video_info *ovi)
 	ovi->output_format = info->format;
 	ovi->fps_num       = info->fps_num;
 	ovi->fps_den       = info->fps_den;
+	ovi->readback_frames = video->readback_frames;
+	ovi->zero_copy_readback = video->zero_copy_readback;
+	ovi->conversion_slices = video->conversion_slices;
+	ovi->tick_threads = video->tick_threads;
+	ovi->pacing_spin_us = (uint32_t)(video->pacing_spin_ns / 1000);
+	ovi->headless = video->headless;
+	ovi->low_latency = video->low_latency;
+	ovi->preview_fps = video->preview_interval_ns ?
+		(uint32_t)(1000000000ULL / video->preview_interval_ns) : 0;
+	ovi->frame_cache_size = (uint32_t)info->cache_size;
+
+	return true;
+}
+
+bool obs_get_video_frame_timing(struct obs_video_frame_timing *timing)
+{
+	struct obs_core_video *video;
+
+	if (!obs || !obs->video.video || !timing)
+		return false;
+
+	video = &obs->video;
+
+	pthread_mutex_lock(&video->frame_timing_mutex);
+	*timing = video->frame_timing;
+	pthread_mutex_unlock(&video->frame_timing_mutex);
+
+	return true;
+}
+
+bool obs_get_video_pipeline_timing(struct obs_video_pipeline_timing *timing)
+{
+	struct obs_core_video *video;
+
+	if (!obs || !obs->video.video || !timing)
+		return false;
+
+	video = &obs->video;
+
+	pthread_mutex_lock(&video->frame_timing_mutex);
+	*timing = video->pipeline_timing;
+	pthread_mutex_unlock(&video->frame_timing_mutex);
+
+	video_output_get_callback_timing(video->video, &timing->callbacks);
+	return true;
+}
+
+bool obs_set_offline_render(bool offline)
+{
+	struct obs_core_video *video;
+
+	if (!obs || !obs->video.video)
+		return false;
+
+	video = &obs->video;
+	if (video_output_active(video->video) || scaled_videos_active())
+		return false;
+
+	video->offline_render = offline;
+
+	/* the switch happens between frames on the video thread */
+	while (video->thread_initialized && video->offline_active != offline)
+		os_sleep_ms(1);
 
 	return true;
 }
 
+bool obs_offline_render_active(void)
+{
+	return obs ? obs->video.offline_active : false;
+}
+
+uint64_t obs_get_vram_usage(void)
+{
+	return gs_get_memory_usage();
+}
+
+uint64_t obs_get_clock_ns(void)
+{
+	if (obs && obs->video.offline_active)
+		return (uint64_t)os_atomic_add_int64(&obs->video.clock_ns, 0);
+
+	return os_gettime_ns();
+}
+
+void obs_set_source_suspend_delay(uint32_t ms)
+{
+	if (!obs) return;
+	obs->video.suspend_delay_ns = (uint64_t)ms * 1000000ULL;
+}
+
+uint32_t obs_get_source_suspend_delay(void)
+{
+	return obs ? (uint32_t)(obs->video.suspend_delay_ns / 1000000ULL) : 0;
+}
+
 bool obs_get_audio_info(struct obs_audio_info *oai)
 {
 	struct obs_core_audio *audio = &obs->audio;
@@ -976,12 +1617,15 @@ bool obs_get_audio_info(struct obs_audio_info *oai)
 	oai->samples_per_sec = info->samples_per_sec;
 	oai->speakers = info->speakers;
 	oai->buffer_ms = info->buffer_ms;
+	oai->low_latency = audio->low_latency;
 	return true;
 }
 
 bool obs_enum_input_types(size_t idx, const char **id)
 {
 	if (!obs) return false;
+	if (idx == 0)
+		obs_load_deferred_modules();
 
 	if (idx >= obs->input_types.num)
 		return false;
@@ -992,6 +1636,8 @@ bool obs_enum_input_types(size_t idx, const char **id)
 bool obs_enum_filter_types(size_t idx, const char **id)
 {
 	if (!obs) return false;
+	if (idx == 0)
+		obs_load_deferred_modules();
 
 	if (idx >= obs->filter_types.num)
 		return false;
@@ -1002,6 +1648,8 @@ bool obs_enum_filter_types(size_t idx, const char **id)
 bool obs_enum_transition_types(size_t idx, const char **id)
 {
 	if (!obs) return false;
+	if (idx == 0)
+		obs_load_deferred_modules();
 
 	if (idx >= obs->transition_types.num)
 		return false;
@@ -1012,6 +1660,8 @@ bool obs_enum_transition_types(size_t idx, const char **id)
 bool obs_enum_output_types(size_t idx, const char **id)
 {
 	if (!obs) return false;
+	if (idx == 0)
+		obs_load_deferred_modules();
 
 	if (idx >= obs->output_types.num)
 		return false;
@@ -1022,6 +1672,8 @@ bool obs_enum_output_types(size_t idx, const char **id)
 bool obs_enum_encoder_types(size_t idx, const char **id)
 {
 	if (!obs) return false;
+	if (idx == 0)
+		obs_load_deferred_modules();
 
 	if (idx >= obs->encoder_types.num)
 		return false;
@@ -1032,6 +1684,8 @@ bool obs_enum_encoder_types(size_t idx, const char **id)
 bool obs_enum_service_types(size_t idx, const char **id)
 {
 	if (!obs) return false;
+	if (idx == 0)
+		obs_load_deferred_modules();
 
 	if (idx >= obs->service_types.num)
 		return false;
@@ -1128,10 +1782,10 @@ bool obs_add_source(obs_source_t *source)
 	if (!obs) return false;
 	if (!source) return false;
 
-	pthread_mutex_lock(&obs->data.sources_mutex);
+	pthread_mutex_lock(&obs->data.user_sources_mutex);
 	da_push_back(obs->data.user_sources, &source);
 	obs_source_addref(source);
-	pthread_mutex_unlock(&obs->data.sources_mutex);
+	pthread_mutex_unlock(&obs->data.user_sources_mutex);
 
 	calldata_set_ptr(&params, "source", source);
 	signal_handler_signal(obs->signals, "source_add", &params);
@@ -1390,12 +2044,89 @@ proc_handler_t *obs_get_proc_handler(void)
 	return obs->procs;
 }
 
+os_task_pool_t *obs_get_task_pool(void)
+{
+	if (!obs) return NULL;
+	return obs->task_pool;
+}
+
+void obs_signal_next_frame(void)
+{
+	if (!obs) return;
+	os_atomic_set_long(&obs->video.signal_next_frame, 1);
+}
+
+static inline bool valid_thread_role(enum obs_thread_role role)
+{
+	return (int)role >= 0 && role < OBS_THREAD_ROLE_COUNT;
+}
+
+void obs_set_thread_settings(enum obs_thread_role role,
+		const struct os_thread_settings *settings)
+{
+	if (!obs || !settings || !valid_thread_role(role)) return;
+
+	pthread_mutex_lock(&obs->thread_settings_mutex);
+	obs->thread_settings[role] = *settings;
+	pthread_mutex_unlock(&obs->thread_settings_mutex);
+}
+
+void obs_get_thread_settings(enum obs_thread_role role,
+		struct os_thread_settings *settings)
+{
+	if (!settings) return;
+
+	memset(settings, 0, sizeof(*settings));
+	if (!obs || !valid_thread_role(role)) return;
+
+	pthread_mutex_lock(&obs->thread_settings_mutex);
+	*settings = obs->thread_settings[role];
+	pthread_mutex_unlock(&obs->thread_settings_mutex);
+}
+
+void obs_apply_thread_settings(enum obs_thread_role role)
+{
+	struct os_thread_settings settings;
+
+	obs_get_thread_settings(role, &settings);
+	if (!os_apply_thread_settings(&settings))
+		blog(LOG_WARNING, "Could not apply all thread settings for "
+		                  "thread role %d", (int)role);
+}
+
 void obs_render_main_view(void)
 {
 	if (!obs) return;
 	obs_view_render(&obs->data.main_view);
 }
 
+void obs_render_main_texture(void)
+{
+	struct obs_core_video *video;
+	gs_texture_t *texture;
+	gs_effect_t *effect;
+	gs_eparam_t *param;
+	int last_texture;
+
+	if (!obs) return;
+
+	video = &obs->video;
+	last_texture = video->cur_texture == 0 ?
+		NUM_TEXTURES - 1 : video->cur_texture - 1;
+	if (!video->textures_rendered[last_texture])
+		return;
+
+	texture = video->render_textures[last_texture];
+	effect  = video->default_effect;
+	param   = gs_effect_get_param_by_name(effect, "image");
+	gs_effect_set_texture(param, texture);
+
+	gs_enable_blending(false);
+	while (gs_effect_loop(effect, "Draw"))
+		gs_draw_sprite(texture, 0, 0, 0);
+	gs_enable_blending(true);
+}
+
 void obs_set_master_volume(float volume)
 {
 	struct calldata data = {0};
@@ -1512,25 +2243,97 @@ obs_source_t *obs_load_source(obs_data_t *source_data)
 	return obs_load_source_type(source_data, OBS_SOURCE_TYPE_INPUT);
 }
 
+struct source_load {
+	obs_data_t   *data;
+	obs_source_t *source;
+	bool         threaded;
+};
+
+/* a source (and its filters) can only be created off the calling thread if
+ * every type involved allows it.  looks up every type, so that any deferred
+ * modules they need are loaded here rather than from the task pool */
+static bool source_load_threaded(obs_data_t *source_data)
+{
+	const struct obs_source_info *info;
+	obs_data_array_t *filters;
+	bool threaded = true;
+
+	info = find_source(&obs->input_types.da,
+			obs_data_get_string(source_data, "id"));
+	if (!info || (info->output_flags & OBS_SOURCE_THREADED_CREATE) == 0)
+		threaded = false;
+
+	filters = obs_data_get_array(source_data, "filters");
+
+	for (size_t i = 0; i < obs_data_array_count(filters); i++) {
+		obs_data_t *filter_data = obs_data_array_item(filters, i);
+
+		info = find_source(&obs->filter_types.da,
+				obs_data_get_string(filter_data, "id"));
+		if (!info ||
+		    (info->output_flags & OBS_SOURCE_THREADED_CREATE) == 0)
+			threaded = false;
+
+		obs_data_release(filter_data);
+	}
+
+	obs_data_array_release(filters);
+	return threaded;
+}
+
+static void source_load_task(void *param)
+{
+	struct source_load *load = param;
+	load->source = obs_load_source(load->data);
+}
+
+static const char *obs_load_sources_name = "obs_load_sources";
 void obs_load_sources(obs_data_array_t *array)
 {
+	struct source_load *loads;
+	os_task_group_t *group;
 	size_t count;
 	size_t i;
 
 	if (!obs) return;
 
+	profile_start(obs_load_sources_name);
+
 	count = obs_data_array_count(array);
+	loads = bzalloc(sizeof(struct source_load) * (count ? count : 1));
+	group = os_task_group_create(obs->task_pool);
 
-	pthread_mutex_lock(&obs->data.user_sources_mutex);
+	/* sources are created all at once before anything is linked (scenes
+	 * only look up their items on load), so they don't depend on each
+	 * other.  the ones that allow it are created on the task pool while
+	 * this thread creates the rest. */
+	for (i = 0; i < count; i++) {
+		loads[i].data     = obs_data_array_item(array, i);
+		loads[i].threaded = source_load_threaded(loads[i].data) &&
+			group;
+	}
 
 	for (i = 0; i < count; i++) {
-		obs_data_t   *source_data = obs_data_array_item(array, i);
-		obs_source_t *source      = obs_load_source(source_data);
+		if (loads[i].threaded)
+			os_task_group_queue(group, source_load_task, &loads[i],
+					OS_TASK_PRIORITY_NORMAL,
+					"obs_load_source");
+	}
 
-		obs_add_source(source);
+	for (i = 0; i < count; i++) {
+		if (!loads[i].threaded)
+			source_load_task(&loads[i]);
+	}
 
-		obs_source_release(source);
-		obs_data_release(source_data);
+	os_task_group_destroy(group);
+
+	pthread_mutex_lock(&obs->data.user_sources_mutex);
+
+	for (i = 0; i < count; i++) {
+		obs_add_source(loads[i].source);
+
+		obs_source_release(loads[i].source);
+		obs_data_release(loads[i].data);
 	}
 
 	/* tell sources that we want to load */
@@ -1538,6 +2341,9 @@ void obs_load_sources(obs_data_array_t *array)
 		obs_source_load(obs->data.user_sources.array[i]);
 
 	pthread_mutex_unlock(&obs->data.user_sources_mutex);
+
+	bfree(loads);
+	profile_end(obs_load_sources_name);
 }
 
 obs_data_t *obs_save_source(obs_source_t *source)
@@ -1605,6 +2411,11 @@ obs_data_t *obs_save_source(obs_source_t *source)
 	return source_data;
 }
 
+long obs_source_get_save_generation(const obs_source_t *source)
+{
+	return source ? source->save_generation : 0;
+}
+
 obs_data_array_t *obs_save_sources(void)
 {
 	obs_data_array_t *array;
@@ -1692,6 +2503,7 @@ void obs_context_data_free(struct obs_context_data *context)
 	obs_data_release(context->settings);
 	obs_context_data_remove(context);
 	pthread_mutex_destroy(&context->rename_cache_mutex);
+	gs_memory_tracker_release(context->vram_tracker);
 	bfree(context->name);
 
 	for (size_t i = 0; i < context->rename_cache.num; i++)
@@ -1747,6 +2559,131 @@ void obs_context_data_setname(struct obs_context_data *context,
 	pthread_mutex_unlock(&context->rename_cache_mutex);
 }
 
+/* call after adding a source to or removing it from the list */
+void obs_source_snapshot_update(void)
+{
+	struct obs_core_data *data = &obs->data;
+	struct obs_source_snapshot *snapshot;
+	struct obs_source *source;
+
+	snapshot = bzalloc(sizeof(struct obs_source_snapshot));
+
+	/* snapshots are published in the order the list changes */
+	pthread_mutex_lock(&data->sources_mutex);
+
+	source = data->first_source;
+	while (source) {
+		da_push_back(snapshot->sources, &source);
+		source = (struct obs_source*)source->context.next;
+	}
+
+	pthread_mutex_lock(&data->snapshot_mutex);
+	if (data->source_snapshot)
+		da_push_back(data->retired_snapshots, &data->source_snapshot);
+	data->source_snapshot = snapshot;
+	pthread_mutex_unlock(&data->snapshot_mutex);
+
+	pthread_mutex_unlock(&data->sources_mutex);
+}
+
+/* only the video thread walks the sources, its tick threads only touch the
+ * sources it hands them during the walk */
+struct obs_source_snapshot *obs_source_walk_begin(void)
+{
+	struct obs_core_data *data = &obs->data;
+	struct obs_source_snapshot *snapshot;
+
+	os_atomic_inc_long(&data->source_walk_seq);
+
+	pthread_mutex_lock(&data->snapshot_mutex);
+	snapshot = data->source_snapshot;
+	pthread_mutex_unlock(&data->snapshot_mutex);
+
+	return snapshot;
+}
+
+void obs_source_walk_end(void)
+{
+	struct obs_core_data *data = &obs->data;
+	DARRAY(struct obs_source_snapshot*) retired;
+	DARRAY(struct obs_source*) destroys;
+
+	da_init(retired);
+	da_init(destroys);
+
+	pthread_mutex_lock(&data->snapshot_mutex);
+	da_move(retired, data->retired_snapshots);
+	da_move(destroys, data->deferred_destroys);
+	os_atomic_inc_long(&data->source_walk_seq);
+	pthread_mutex_unlock(&data->snapshot_mutex);
+
+	for (size_t i = 0; i < retired.num; i++)
+		free_snapshot(retired.array[i]);
+	for (size_t i = 0; i < destroys.num; i++)
+		obs_source_destroy(destroys.array[i]);
+
+	da_free(retired);
+	da_free(destroys);
+}
+
+static inline bool walk_in_progress(struct obs_core_data *data)
+{
+	return (data->source_walk_seq & 1) != 0;
+}
+
+static bool on_walk_thread(void)
+{
+	struct obs_core_video *video = &obs->video;
+	pthread_t self = pthread_self();
+
+	if (!video->thread_initialized)
+		return false;
+	if (pthread_equal(self, video->video_thread))
+		return true;
+
+	for (size_t i = 0; i < video->num_tick_workers; i++) {
+		if (pthread_equal(self, video->tick_workers[i]))
+			return true;
+	}
+
+	return false;
+}
+
+/* a source released from within the walk can't wait for the walk to end,
+ * so it's skipped for the rest of the walk and destroyed right after it */
+bool obs_source_walk_defer_destroy(struct obs_source *source)
+{
+	struct obs_core_data *data = &obs->data;
+
+	if (!walk_in_progress(data) || !on_walk_thread())
+		return false;
+
+	source->destroy_pending = true;
+
+	pthread_mutex_lock(&data->snapshot_mutex);
+	da_push_back(data->deferred_destroys, &source);
+	pthread_mutex_unlock(&data->snapshot_mutex);
+	return true;
+}
+
+/* waits for a walk that may still see a snapshot from before the last
+ * obs_source_snapshot_update call.  walks started after it can't. */
+void obs_source_walk_wait(void)
+{
+	struct obs_core_data *data = &obs->data;
+	long seq;
+
+	pthread_mutex_lock(&data->snapshot_mutex);
+	seq = data->source_walk_seq;
+	pthread_mutex_unlock(&data->snapshot_mutex);
+
+	if ((seq & 1) == 0)
+		return;
+
+	while (data->source_walk_seq == seq)
+		os_sleep_ms(1);
+}
+
 profiler_name_store_t *obs_get_profiler_name_store(void)
 {
 	if (!obs)
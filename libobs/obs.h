@@ -21,6 +21,8 @@
 #include "util/bmem.h"
 #include "util/profiler.h"
 #include "util/text-lookup.h"
+#include "util/task-pool.h"
+#include "util/threading.h"
 #include "graphics/graphics.h"
 #include "graphics/vec2.h"
 #include "graphics/vec3.h"
@@ -58,6 +60,7 @@ typedef struct obs_scene      obs_scene_t;
 typedef struct obs_scene_item obs_sceneitem_t;
 typedef struct obs_output     obs_output_t;
 typedef struct obs_encoder    obs_encoder_t;
+typedef struct obs_encoder_group obs_encoder_group_t;
 typedef struct obs_service    obs_service_t;
 typedef struct obs_module     obs_module_t;
 typedef struct obs_fader      obs_fader_t;
@@ -104,11 +107,17 @@ enum obs_order_movement {
 /**
  * Used with obs_source_process_filter to specify whether the filter should
  * render the source directly with the specified effect, or whether it should
- * render it to a texture
+ * render it to a texture.
+ *
+ * OBS_ALLOW_DIRECT_YUV_RENDERING also lets asynchronous video sources be
+ * drawn directly.  Their YUV frames then go straight to the DrawMatrix
+ * technique of the effect, along with color_matrix, color_range_min and
+ * color_range_max, instead of being drawn to RGB in a separate pass first.
  */
 enum obs_allow_direct_render {
 	OBS_NO_DIRECT_RENDERING,
 	OBS_ALLOW_DIRECT_RENDERING,
+	OBS_ALLOW_DIRECT_YUV_RENDERING,
 };
 
 enum obs_scale_type {
@@ -132,6 +141,14 @@ enum obs_bounds_type {
 	OBS_BOUNDS_MAX_ONLY,        /**< no scaling, maximum size only */
 };
 
+/** Pixels removed from each side of a source */
+struct obs_source_crop {
+	int                  left;
+	int                  top;
+	int                  right;
+	int                  bottom;
+};
+
 struct obs_transform_info {
 	struct vec2          pos;
 	float                rot;
@@ -172,6 +189,121 @@ struct obs_video_info {
 	enum video_range_type range;       /**< YUV range (if YUV) */
 
 	enum obs_scale_type scale_type;    /**< How to scale if scaling */
+
+	/**
+	 * Number of frames to queue for GPU readback (2-6, 0 for default).
+	 * Higher values add latency, but prevent the video thread from
+	 * stalling while waiting on the GPU to finish a frame.
+	 */
+	uint32_t            readback_frames;
+
+	/**
+	 * Pass mapped readback surfaces directly to video outputs and encoders
+	 * rather than copying them in to the video output cache.  Only
+	 * applies to GPU-converted or RGBA output.
+	 */
+	bool                zero_copy_readback;
+
+	/**
+	 * Number of horizontal slices to split CPU color conversion in to,
+	 * each converted on its own thread (1-16, 0 for single-threaded).
+	 * Only used when GPU conversion is disabled or unavailable.
+	 */
+	uint32_t            conversion_slices;
+
+	/**
+	 * Microseconds before each frame deadline to spin-wait rather than
+	 * sleep, which avoids the wakeup jitter of the system sleep at the
+	 * cost of some CPU time (0-2000, 0 to only sleep).
+	 */
+	uint32_t            pacing_spin_us;
+
+	/**
+	 * Number of frames the video output can queue for its encoders before
+	 * further frames are counted as duplicates (2-64, 0 for the default
+	 * of 6).
+	 */
+	uint32_t            frame_cache_size;
+
+	/**
+	 * Number of threads that run the tick callbacks of sources with
+	 * OBS_SOURCE_THREADED_TICK while the video thread ticks the others
+	 * (0-8, 0 to tick every source on the video thread).
+	 */
+	uint32_t            tick_threads;
+
+	/**
+	 * Runs without displays: obs_display_create fails, no swap chains are
+	 * created and the video thread skips rendering displays.  Combine it
+	 * with a graphics module that can initialize without a window system,
+	 * such as the EGL build of the OpenGL module.
+	 */
+	bool                headless;
+
+	/**
+	 * Most frames per second displays are rendered at, after the output
+	 * frame (0 to render them every frame).
+	 */
+	uint32_t            preview_fps;
+
+	/**
+	 * Keeps as little video buffered as possible: readback_frames and
+	 * frame_cache_size are set to their minimums, outputs interleave on
+	 * a short deadline rather than waiting for the opposing packet type,
+	 * and encoders and outputs that check it tune for latency.
+	 */
+	bool                low_latency;
+};
+
+#define OBS_FRAME_TIMING_BUCKETS   32
+#define OBS_FRAME_TIMING_BUCKET_NS 100000ULL
+
+/**
+ * Video thread frame pacing statistics, collected since video was last reset
+ */
+struct obs_video_frame_timing {
+	uint64_t            frames;         /**< Frames paced */
+	uint64_t            lagged_frames;  /**< Deadlines already missed */
+	uint64_t            total_error_ns; /**< Sum of all wakeup errors */
+	uint64_t            max_error_ns;   /**< Largest wakeup error */
+
+	/**
+	 * Wakeup error histogram, where bucket i counts frames that woke up
+	 * between i and i+1 times OBS_FRAME_TIMING_BUCKET_NS after their
+	 * deadline.  The last bucket also counts everything later than that.
+	 */
+	uint64_t            histogram[OBS_FRAME_TIMING_BUCKETS];
+};
+
+/** Stages of the video thread that are timed */
+enum obs_video_stage {
+	OBS_VIDEO_STAGE_TICK_SOURCES,
+	OBS_VIDEO_STAGE_RENDER_DISPLAYS,
+	OBS_VIDEO_STAGE_RENDER_VIDEO,
+	OBS_VIDEO_STAGE_DOWNLOAD_FRAME,
+	OBS_VIDEO_STAGE_OUTPUT_VIDEO_DATA,
+	OBS_VIDEO_STAGE_COUNT
+};
+
+/**
+ * Per-stage timings of the video pipeline, collected since video was last
+ * reset.  A stage is over budget when it takes longer than a frame.
+ */
+struct obs_video_pipeline_timing {
+	struct video_timing stages[OBS_VIDEO_STAGE_COUNT];
+
+	/** Time spent calling the main video output's inputs each frame */
+	struct video_timing callbacks;
+
+	/** Frames whose readback surface could not be mapped */
+	uint64_t            readback_failures;
+
+	/**
+	 * Frames whose readback copy was still in flight when it was mapped,
+	 * making the video thread wait for the GPU.  If this keeps growing,
+	 * readback_frames is too low for the GPU's latency.
+	 */
+	uint64_t            readback_stalls;
 };
 
 /**
@@ -181,6 +313,26 @@ struct obs_audio_info {
 	uint32_t            samples_per_sec;
 	enum speaker_layout speakers;
 	uint64_t            buffer_ms;
+
+	/**
+	 * Mixes on a shorter tick with tighter timestamp smoothing, and caps
+	 * buffer_ms, to reduce end-to-end audio latency
+	 */
+	bool                low_latency;
+};
+
+/**
+ * Threads that can be given their own scheduling settings with
+ * obs_set_thread_settings, for example to keep encoding off the cores a game
+ * is using.
+ */
+enum obs_thread_role {
+	OBS_THREAD_ROLE_GRAPHICS,     /**< Renders and downloads frames */
+	OBS_THREAD_ROLE_AUDIO,        /**< Mixes audio */
+	OBS_THREAD_ROLE_VIDEO_OUTPUT, /**< Hands raw frames to encoders */
+	OBS_THREAD_ROLE_ENCODER,      /**< Runs encoders */
+	OBS_THREAD_ROLE_OUTPUT,       /**< Sends or writes encoded data */
+	OBS_THREAD_ROLE_COUNT
 };
 
 /**
@@ -233,6 +385,8 @@ struct obs_source_frame {
 
 	/* used internally by libobs */
 	volatile long       refs;
+	void                (*release)(void *param);
+	void                *release_param;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -301,12 +455,80 @@ EXPORT int obs_reset_video(struct obs_video_info *ovi);
  */
 EXPORT bool obs_reset_audio(const struct obs_audio_info *oai);
 
+/**
+ * Sets the priority, CPU affinity and MMCSS task of all threads of a role.
+ *
+ * @note  Threads pick up their settings when they start, so this should be
+ *        called before obs_reset_video/obs_reset_audio and before starting
+ *        outputs.
+ */
+EXPORT void obs_set_thread_settings(enum obs_thread_role role,
+		const struct os_thread_settings *settings);
+EXPORT void obs_get_thread_settings(enum obs_thread_role role,
+		struct os_thread_settings *settings);
+
+/**
+ * Applies the settings of a role to the calling thread.  Outputs call this
+ * with OBS_THREAD_ROLE_OUTPUT from the threads they send or write data on.
+ */
+EXPORT void obs_apply_thread_settings(enum obs_thread_role role);
+
 /** Gets the current video settings, returns false if no video */
 EXPORT bool obs_get_video_info(struct obs_video_info *ovi);
 
 /** Gets the current audio settings, returns false if no audio */
 EXPORT bool obs_get_audio_info(struct obs_audio_info *oai);
 
+/** Gets the video frame pacing statistics, returns false if no video */
+EXPORT bool obs_get_video_frame_timing(struct obs_video_frame_timing *timing);
+
+/**
+ * Gets the per-stage video pipeline timings, returns false if no video.
+ * Timings of individual inputs can be queried with
+ * video_output_get_input_timing.
+ */
+EXPORT bool obs_get_video_pipeline_timing(
+		struct obs_video_pipeline_timing *timing);
+
+/**
+ * Enables or disables offline rendering.  In offline mode the video thread
+ * no longer waits for wall time: each frame moves a virtual clock on by
+ * exactly one frame interval, as fast as rendering and the outputs allow.
+ * Frames are never skipped or duplicated, outputs are waited on instead, so
+ * the output is frame-exact.  Audio mixing and the timing of async sources
+ * follow the same clock.
+ *
+ * Sources that generate their own timestamps must use obs_get_clock_ns to be
+ * driven by the virtual clock.  Sources tied to wall time (capture devices)
+ * will not behave sensibly in offline mode.
+ *
+ * The mode can only be changed while video is not active, and is kept across
+ * video resets.  Set it again after resetting audio.  Returns false if video
+ * is active or not initialized.
+ */
+EXPORT bool obs_set_offline_render(bool offline);
+
+/** Returns true if offline rendering is active */
+EXPORT bool obs_offline_render_active(void);
+
+/**
+ * Returns the current time of the libobs clock in nanoseconds: the virtual
+ * clock while offline rendering, os_gettime_ns otherwise.
+ */
+EXPORT uint64_t obs_get_clock_ns(void);
+
+/** Gets the estimated video memory of all graphics resources libobs knows of */
+EXPORT uint64_t obs_get_vram_usage(void);
+
+/**
+ * Sets how long a source has to be neither showing nor active before it's
+ * suspended, releasing resources until it's used again.  Only sources that
+ * implement obs_source_info.suspend are suspended.  0 (the default) never
+ * suspends sources.
+ */
+EXPORT void obs_set_source_suspend_delay(uint32_t ms);
+EXPORT uint32_t obs_get_source_suspend_delay(void);
+
 /**
  * Opens a plugin module directly from a specific path.
  *
@@ -369,6 +591,18 @@ EXPORT void obs_add_module_path(const char *bin, const char *data);
 /** Automatically loads all modules from module paths (convenience function) */
 EXPORT void obs_load_all_modules(void);
 
+/**
+ * Like obs_load_all_modules, but modules declared with
+ * OBS_MODULE_DEFERRABLE are only opened once one of their types is used, if
+ * the manifest lists them.  The manifest file caches the types of each such
+ * module and is rewritten after loading.  Enumerating types loads all
+ * deferred modules.
+ *
+ * A deferred module is loaded on the thread that first looks up one of its
+ * types, so the frontend should create its objects from one thread.
+ */
+EXPORT void obs_load_all_modules_deferred(const char *manifest_file);
+
 struct obs_module_info {
 	const char *bin_path;
 	const char *data_path;
@@ -547,9 +781,28 @@ EXPORT signal_handler_t *obs_get_signal_handler(void);
 /** Returns the primary obs procedure handler */
 EXPORT proc_handler_t *obs_get_proc_handler(void);
 
+/**
+ * Returns the shared task pool.  Plugins should queue their parallel work
+ * here rather than creating their own worker threads.
+ */
+EXPORT os_task_pool_t *obs_get_task_pool(void);
+
+/**
+ * Emits the "frame_rendered" signal once, after the next frame has been
+ * rendered and handed to the outputs.  The frontend uses it to end its
+ * startup timeline at the first frame of the loaded scene collection.
+ */
+EXPORT void obs_signal_next_frame(void);
+
 /** Renders the main view */
 EXPORT void obs_render_main_view(void);
 
+/**
+ * Draws the main view as last rendered for the outputs, at base size,
+ * without rendering its sources again.  Use it in display draw callbacks.
+ */
+EXPORT void obs_render_main_texture(void);
+
 /** Sets the master user volume */
 EXPORT void obs_set_master_volume(float volume);
 
@@ -565,6 +818,23 @@ EXPORT float obs_get_present_volume(void);
 /** Saves a source to settings data */
 EXPORT obs_data_t *obs_save_source(obs_source_t *source);
 
+/**
+ * Gets a value that changes whenever something obs_save_source writes for the
+ * source changes, including its filters, scene items and hotkeys.  Values are
+ * unique across sources, so saved data can be reused for as long as its
+ * source returns the same value.  Changes a source only makes to its settings
+ * in its own save callback are not tracked.
+ */
+EXPORT long obs_source_get_save_generation(const obs_source_t *source);
+
+/**
+ * Gets the estimated video memory held by the textures, stage surfaces and
+ * buffers the source or filter has created, not counting its filters or the
+ * sources it draws.  Render targets are charged to whichever source is
+ * holding them at the moment.
+ */
+EXPORT uint64_t obs_source_get_vram_usage(const obs_source_t *source);
+
 /** Loads a source from settings data */
 EXPORT obs_source_t *obs_load_source(obs_data_t *data);
 
@@ -600,6 +870,15 @@ EXPORT obs_source_t *obs_view_get_source(obs_view_t *view,
 /** Renders the sources of this view context */
 EXPORT void obs_view_render(obs_view_t *view);
 
+/**
+ * Renders the sources of this view context into a cx x cy texture once per
+ * video frame, and draws that texture at (0, 0) in the current projection.
+ * Further calls in the same frame only draw the texture, so a view shown on
+ * several displays is only rendered once.
+ */
+EXPORT void obs_view_render_cached(obs_view_t *view, uint32_t cx,
+		uint32_t cy);
+
 
 /* ------------------------------------------------------------------------- */
 /* Display context */
@@ -712,6 +991,46 @@ EXPORT void obs_source_update(obs_source_t *source, obs_data_t *settings);
 /** Renders a video source. */
 EXPORT void obs_source_video_render(obs_source_t *source);
 
+/**
+ * Renders a video source cropped, by adjusting the texture coordinates of
+ * its draws.  The cropped image is drawn at 0, 0.  Only sources without
+ * filters that are asynchronous or use OBS_SOURCE_UV_CROP can be drawn this
+ * way (or the parent of a filter, from the filter's video_render).
+ *
+ * @return  false if the source can't be cropped this way, in which case
+ *          nothing is drawn
+ */
+EXPORT bool obs_source_video_render_crop(obs_source_t *source,
+		const struct obs_source_crop *crop);
+
+/**
+ * Enables or disables the per-frame render cache of a source (disabled by
+ * default).  When enabled, the first obs_source_video_render call of each
+ * frame renders the source, filters included, into a texture, and any
+ * further calls in the same frame only draw that texture.  Useful for heavy
+ * sources that are shown in several places at once, such as a scene nested
+ * in several other scenes, or a source shown in projectors.
+ */
+EXPORT void obs_source_set_render_cache(obs_source_t *source, bool enable);
+EXPORT bool obs_source_render_cache_enabled(const obs_source_t *source);
+
+/**
+ * Marks a source as opaque, meaning every pixel inside its width/height is
+ * drawn with full alpha.  Scenes skip drawing items that are completely
+ * covered by an unrotated opaque item above them.  Sources should only set
+ * this while it is actually true (for example, a capture without alpha that
+ * currently has a frame).  Filters on the source cancel the flag.
+ */
+EXPORT void obs_source_set_opaque(obs_source_t *source, bool opaque);
+EXPORT bool obs_source_opaque(const obs_source_t *source);
+
+/**
+ * Returns true if a source (including its filters) would render the same
+ * image as it did last frame.  Sources that contain other sources can use
+ * this to implement their video_unchanged callback.
+ */
+EXPORT bool obs_source_video_unchanged(obs_source_t *source);
+
 /** Gets the width of a source (if it has video) */
 EXPORT uint32_t obs_source_get_width(obs_source_t *source);
 
@@ -783,6 +1102,50 @@ EXPORT void obs_source_set_sync_offset(obs_source_t *source, int64_t offset);
 /** Gets the audio sync offset (in nanoseconds) for a source */
 EXPORT int64_t obs_source_get_sync_offset(const obs_source_t *source);
 
+/**
+ * Gets how much of a source's audio is buffered waiting to be mixed, returns
+ * false if the source has no audio
+ */
+EXPORT bool obs_source_get_audio_buffer_stats(const obs_source_t *source,
+		struct audio_line_stats *stats);
+
+/** Statistics of an async video source's frame queue */
+struct obs_source_async_stats {
+	/* frames held back to absorb irregular frame delivery */
+	uint32_t jitter_depth;
+	/* frames currently queued for display */
+	uint32_t queued_frames;
+	/* duration of the queued frames */
+	uint32_t buffered_ms;
+	/* average deviation of frame arrival from the frame timestamps */
+	uint32_t jitter_ms;
+};
+
+/**
+ * Gets the state of the frame queue of an async video source, returns false
+ * if the source doesn't output async video
+ */
+EXPORT bool obs_source_get_async_video_stats(const obs_source_t *source,
+		struct obs_source_async_stats *stats);
+
+/** Statistics of audio filters run on the task pool */
+struct obs_source_audio_filter_stats {
+	/* packets waiting to be filtered */
+	uint32_t queued_packets;
+	/* average and highest time from output to filtered */
+	uint32_t latency_ms;
+	uint32_t max_latency_ms;
+	/* packets dropped because the filters weren't keeping up */
+	uint32_t dropped_packets;
+};
+
+/**
+ * Gets how the source's offloaded audio filters are keeping up, returns false
+ * if OBS_SOURCE_FLAG_OFFLOAD_AUDIO_FILTERS isn't set
+ */
+EXPORT bool obs_source_get_audio_filter_stats(const obs_source_t *source,
+		struct obs_source_audio_filter_stats *stats);
+
 /** Enumerates child sources used by this source */
 EXPORT void obs_source_enum_sources(obs_source_t *source,
 		obs_source_enum_proc_t enum_callback,
@@ -801,6 +1164,12 @@ EXPORT bool obs_source_active(const obs_source_t *source);
  */
 EXPORT bool obs_source_showing(const obs_source_t *source);
 
+/** Returns true if the source is suspended, see obs_set_source_suspend_delay */
+EXPORT bool obs_source_suspended(const obs_source_t *source);
+
+/** Returns true if the source or one of its parents has been prepared */
+EXPORT bool obs_source_prepared(const obs_source_t *source);
+
 /**
  * Sometimes sources need to be told when to save their settings so they
  * don't have to constantly update and keep track of their settings.  This will
@@ -821,6 +1190,11 @@ EXPORT void obs_source_load(obs_source_t *source);
 #define OBS_SOURCE_FLAG_UNBUFFERED             (1<<0)
 /** Specifies to force audio to mono */
 #define OBS_SOURCE_FLAG_FORCE_MONO             (1<<1)
+/**
+ * Specifies that audio filters are run on the libobs task pool rather than
+ * on the thread that outputs the audio, at the cost of a little latency
+ */
+#define OBS_SOURCE_FLAG_OFFLOAD_AUDIO_FILTERS  (1<<2)
 
 /**
  * Sets source flags.  Note that these are different from the main output
@@ -855,6 +1229,21 @@ EXPORT void obs_source_inc_showing(obs_source_t *source);
  */
 EXPORT void obs_source_dec_showing(obs_source_t *source);
 
+/**
+ * Increments the 'prepared' reference counter of the source and its children
+ * to indicate that they're likely to be shown soon, such as the next scene
+ * in a list.  If the reference counter was 0, will call the 'prepare'
+ * callback, which lets sources load files or open devices ahead of time.
+ * Prepared sources don't count as showing or active, but aren't suspended.
+ */
+EXPORT void obs_source_prepare(obs_source_t *source);
+
+/**
+ * Decrements the 'prepared' reference counter.  If the reference counter is
+ * set to 0, will call the 'unprepare' callback
+ */
+EXPORT void obs_source_unprepare(obs_source_t *source);
+
 /** Enumerates filters assigned to the source */
 EXPORT void obs_source_enum_filters(obs_source_t *source,
 		obs_source_enum_proc_t callback, void *param);
@@ -906,7 +1295,9 @@ EXPORT void obs_source_draw_set_color_matrix(
 		const struct vec3 *color_range_max);
 
 /**
- * Helper function to draw sprites for a source (synchronous video).
+ * Helper function to draw sprites for a source (synchronous video).  While
+ * the source is drawn by obs_source_video_render_crop, the crop is applied
+ * to the sprite.
  *
  * @param  image   The sprite texture to draw.  Assigns to the 'image' variable
  *                 of the current effect.
@@ -923,6 +1314,80 @@ EXPORT void obs_source_draw(gs_texture_t *image, int x, int y,
 EXPORT void obs_source_output_video(obs_source_t *source,
 		const struct obs_source_frame *frame);
 
+/**
+ * Outputs asynchronous video data without copying it.
+ *
+ *   The frame data is used in place until libobs is done with the frame, at
+ * which point release is called with param, from whichever thread let go of
+ * the frame last.  The data must stay valid until then.  release is also
+ * called right away if the frame could not be queued.
+ */
+EXPORT void obs_source_output_video_ref(obs_source_t *source,
+		const struct obs_source_frame *frame,
+		void (*release)(void *param), void *param);
+
+/**
+ * Sets how many textures asynchronous video frames are uploaded into in
+ * turn (1 to 4, 2 by default).  With more than one, a new frame can be
+ * uploaded while the previous one is still being drawn instead of waiting on
+ * the GPU.  A single texture uses the least video memory.
+ */
+EXPORT void obs_source_set_async_uploads(obs_source_t *source,
+		uint32_t count);
+EXPORT uint32_t obs_source_get_async_uploads(const obs_source_t *source);
+
+/**
+ * Drops all queued asynchronous video frames.  Frames output with
+ * obs_source_output_video_ref are released, except any frame that is being
+ * rendered at that moment, which is released as soon as that is done.
+ */
+EXPORT void obs_source_flush_async_video(obs_source_t *source);
+
+/**
+ * Gets a frame from the source's frame pool so that asynchronous video can be
+ * written directly into libobs memory.
+ *
+ *   The format, size and planes are set up, everything else (timestamp, color
+ * info, flip) must be filled in by the caller.  The frame must be handed back
+ * with either obs_source_frame_submit or obs_source_frame_discard.  Returns
+ * NULL if too many frames are already queued, the frame should be dropped in
+ * that case.
+ */
+EXPORT struct obs_source_frame *obs_source_frame_acquire(obs_source_t *source,
+		enum video_format format, uint32_t width, uint32_t height);
+
+/** Queues a frame returned by obs_source_frame_acquire for rendering */
+EXPORT void obs_source_frame_submit(obs_source_t *source,
+		struct obs_source_frame *frame);
+
+/**
+ * Gets a buffer the source's audio can be written to in the audio output's
+ * format (see audio_output_get_info), avoiding copies of the audio on the
+ * way to the mixer.
+ *
+ *   When the audio needs neither filtering nor resampling, the buffer is the
+ * audio line's own packet and the audio is mixed from it as is.  Otherwise
+ * it comes from a pool owned by the source and is processed like audio from
+ * obs_source_output_audio.  Set the timestamp (and optionally fewer frames),
+ * then hand the buffer back with obs_source_audio_submit or
+ * obs_source_audio_discard, from the same thread and without outputting any
+ * other audio for the source in between.
+ */
+EXPORT struct obs_audio_data *obs_source_audio_acquire(obs_source_t *source,
+		uint32_t frames);
+
+/** Outputs the audio written to a buffer from obs_source_audio_acquire */
+EXPORT void obs_source_audio_submit(obs_source_t *source,
+		struct obs_audio_data *audio);
+
+/** Returns a buffer from obs_source_audio_acquire unused */
+EXPORT void obs_source_audio_discard(obs_source_t *source,
+		struct obs_audio_data *audio);
+
+/** Returns a frame from obs_source_frame_acquire to the pool unused */
+EXPORT void obs_source_frame_discard(obs_source_t *source,
+		struct obs_source_frame *frame);
+
 /** Outputs audio data (always asynchronous) */
 EXPORT void obs_source_output_audio(obs_source_t *source,
 		const struct obs_source_audio *audio);
@@ -962,6 +1427,13 @@ EXPORT void obs_source_process_filter_end(obs_source_t *filter,
 /** Skips the filter if the filter is invalid and cannot be rendered */
 EXPORT void obs_source_skip_video_filter(obs_source_t *filter);
 
+/**
+ * Gets a uniform of a fused filter's snippet, for use in the filter's
+ * update_fused_params callback.  The name is given without the '$'.
+ */
+EXPORT gs_eparam_t *obs_filter_get_fused_param(gs_effect_t *effect,
+		const char *prefix, const char *name);
+
 /**
  * Adds a child source.  Must be called by parent sources on child sources
  * when the child is added.  This ensures that the source is properly activated
@@ -1115,6 +1587,16 @@ EXPORT void obs_sceneitem_get_box_transform(const obs_sceneitem_t *item,
 EXPORT bool obs_sceneitem_visible(const obs_sceneitem_t *item);
 EXPORT void obs_sceneitem_set_visible(obs_sceneitem_t *item, bool visible);
 
+/**
+ * Crops the source of a scene item.  The crop is applied to the texture
+ * coordinates of the source's draws when the source supports it (see
+ * obs_source_video_render_crop), and through a texture otherwise.
+ */
+EXPORT void obs_sceneitem_set_crop(obs_sceneitem_t *item,
+		const struct obs_source_crop *crop);
+EXPORT void obs_sceneitem_get_crop(const obs_sceneitem_t *item,
+		struct obs_source_crop *crop);
+
 
 /* ------------------------------------------------------------------------- */
 /* Outputs */
@@ -1162,6 +1644,14 @@ EXPORT void obs_output_stop(obs_output_t *output);
  */
 #define OBS_OUTPUT_DELAY_PRESERVE (1<<0)
 
+/**
+ * Keeps only the next few seconds of delayed packets in memory and writes the
+ * rest to a temporary file, reading them back shortly before they are sent.
+ * Use for long delays, or together with OBS_OUTPUT_DELAY_PRESERVE, where
+ * holding the whole delay in memory would be too expensive.
+ */
+#define OBS_OUTPUT_DELAY_SPILL (1<<1)
+
 /**
  * Sets the current output delay, in seconds (if the output supports delay).
  *
@@ -1280,6 +1770,9 @@ EXPORT obs_service_t *obs_output_get_service(const obs_output_t *output);
 
 /**
  * Sets the reconnect settings.  Set retry_count to 0 to disable reconnecting.
+ *
+ * While an encoded output without a delay is reconnecting its encoders keep
+ * running, and the new connection starts at the latest video keyframe.
  */
 EXPORT void obs_output_set_reconnect_settings(obs_output_t *output,
 		int retry_count, int retry_sec);
@@ -1288,6 +1781,81 @@ EXPORT uint64_t obs_output_get_total_bytes(const obs_output_t *output);
 EXPORT int obs_output_get_frames_dropped(const obs_output_t *output);
 EXPORT int obs_output_get_total_frames(const obs_output_t *output);
 
+/**
+ * Average time video frames spent in each stage on their way through an
+ * output, see obs_output_get_latency
+ */
+struct obs_output_latency {
+	uint64_t frames;        /**< Video packets measured */
+
+	uint64_t render_ns;     /**< Rendering and readback */
+	uint64_t queue_ns;      /**< Waiting for the encoder */
+	uint64_t encode_ns;     /**< Encoding */
+	uint64_t interleave_ns; /**< From the encoder to the output */
+
+	/**
+	 * From the output to the network, only for outputs that report sent
+	 * packets with obs_output_packet_sent
+	 */
+	uint64_t send_ns;
+
+	/** From rendering until sent, or until given to the output */
+	uint64_t total_ns;
+	uint64_t max_total_ns;
+};
+
+/** Gets the latency of an output's video since it was last started */
+EXPORT bool obs_output_get_latency(const obs_output_t *output,
+		struct obs_output_latency *latency);
+
+/**
+ * Called by outputs once a video packet has been sent, so that the send
+ * stage can be measured
+ */
+EXPORT void obs_output_packet_sent(obs_output_t *output,
+		const struct encoder_packet *packet);
+
+/**
+ * What an encoded output's packet queue does with a packet from an encoder
+ * when it is full, see obs_output_set_packet_queue
+ */
+enum obs_output_queue_policy {
+	/** The encoder waits for the output, nothing is lost */
+	OBS_OUTPUT_QUEUE_BLOCK,
+
+	/**
+	 * The packet is dropped, and video is dropped until the next keyframe.
+	 * The default for service outputs, so that a stalled connection never
+	 * holds up the encoders of other outputs.
+	 */
+	OBS_OUTPUT_QUEUE_DROP,
+};
+
+/**
+ * Encoders queue packets for an encoded output, and the output gets them on
+ * a thread of its own.  Sets the number of packets that can be queued and
+ * what happens once that is reached.  Cannot be changed while the output is
+ * active.
+ */
+EXPORT void obs_output_set_packet_queue(obs_output_t *output, size_t capacity,
+		enum obs_output_queue_policy policy);
+
+/** Packet queue stats of an encoded output since it was last started */
+struct obs_output_packet_queue_stats {
+	uint64_t packets;    /**< Packets queued */
+	uint64_t dropped;    /**< Packets dropped, see OBS_OUTPUT_QUEUE_DROP */
+	uint64_t blocked_ns; /**< Time encoders waited by OBS_OUTPUT_QUEUE_BLOCK */
+
+	size_t   depth;      /**< Packets queued right now */
+	size_t   max_depth;  /**< Most packets queued at once */
+	size_t   capacity;
+
+	enum obs_output_queue_policy policy;
+};
+
+EXPORT bool obs_output_get_packet_queue_stats(const obs_output_t *output,
+		struct obs_output_packet_queue_stats *stats);
+
 /**
  * Sets the preferred scaled resolution for this output.  Set width and height
  * to 0 to disable scaling.
@@ -1410,6 +1978,14 @@ EXPORT enum obs_encoder_type obs_get_encoder_type(const char *id);
 /** Returns the codec of the encoder */
 EXPORT const char *obs_encoder_get_codec(const obs_encoder_t *encoder);
 
+/**
+ * Adds a user data unregistered SEI with wall clock stage times to every
+ * video packet of an H.264 encoder, so that players can measure latency.
+ * See OBS_LATENCY_SEI_UUID in obs-avc.h for the format.
+ */
+EXPORT void obs_encoder_set_latency_sei(obs_encoder_t *encoder, bool enable);
+EXPORT bool obs_encoder_latency_sei(const obs_encoder_t *encoder);
+
 /** Returns the type of an encoder */
 EXPORT enum obs_encoder_type obs_encoder_get_type(const obs_encoder_t *encoder);
 
@@ -1421,6 +1997,23 @@ EXPORT enum obs_encoder_type obs_encoder_get_type(const obs_encoder_t *encoder);
 EXPORT void obs_encoder_set_scaled_size(obs_encoder_t *encoder, uint32_t width,
 		uint32_t height);
 
+/**
+ * Makes a video encoder take only every divisor-th frame of its video, e.g.
+ * 2 to encode a 60 FPS canvas at 30 FPS.  0 and 1 take every frame.  If the
+ * encoder is active, this function will trigger a warning, and do nothing.
+ */
+EXPORT void obs_encoder_set_frame_rate_divisor(obs_encoder_t *encoder,
+		uint32_t divisor);
+EXPORT uint32_t obs_encoder_get_frame_rate_divisor(
+		const obs_encoder_t *encoder);
+
+/**
+ * For video encoders, returns the frame rate actually encoded, which is the
+ * video's frame rate divided by the frame rate divisor
+ */
+EXPORT void obs_encoder_get_frame_rate(const obs_encoder_t *encoder,
+		uint32_t *fps_num, uint32_t *fps_den);
+
 /** For video encoders, returns the width of the encoded image */
 EXPORT uint32_t obs_encoder_get_width(const obs_encoder_t *encoder);
 
@@ -1443,6 +2036,95 @@ EXPORT void obs_encoder_set_preferred_video_format(obs_encoder_t *encoder,
 EXPORT enum video_format obs_encoder_get_preferred_video_format(
 		const obs_encoder_t *encoder);
 
+/**
+ * Sets how many frames can wait to be encoded on the encoder's thread.  When
+ * a video encoder's queue is full, new frames are dropped and the encoder's
+ * "overloaded" signal is emitted; audio waits for room instead.  Set to 0 to
+ * use the default.  Triggers a warning and does nothing while the encoder is
+ * active.
+ */
+EXPORT void obs_encoder_set_queue_depth(obs_encoder_t *encoder, size_t depth);
+EXPORT size_t obs_encoder_get_queue_depth(const obs_encoder_t *encoder);
+
+/**
+ * Enables a variable framerate for a video encoder.  Frames whose image is
+ * the same as the previous frame's are then not encoded, and the next packet
+ * simply has a later timestamp, which saves encoding time and space for
+ * mostly static content such as screen recordings.  At least one frame a
+ * second is still encoded.  Outputs and muxers must use the packet
+ * timestamps rather than assume a constant framerate.  Triggers a warning
+ * and does nothing while the encoder is active.
+ */
+EXPORT void obs_encoder_set_variable_framerate(obs_encoder_t *encoder,
+		bool vfr);
+EXPORT bool obs_encoder_variable_framerate(const obs_encoder_t *encoder);
+
+/**
+ * Creates a group for video encoders that encode the same video at different
+ * sizes or bitrates, such as the renditions of an adaptive bitrate ladder.
+ * The encoders of a group start at the same frames, and every keyint frames
+ * from the group's start they all encode a keyframe, so their segments line
+ * up.  Encoders that support it place no keyframes of their own otherwise.
+ * An encoder starting while others of its group are running waits for the
+ * group's next keyframe.
+ */
+EXPORT obs_encoder_group_t *obs_encoder_group_create(uint32_t keyint);
+
+/** Destroys the group once its encoders have left it */
+EXPORT void obs_encoder_group_destroy(obs_encoder_group_t *group);
+
+/**
+ * Adds a video encoder to a group, or removes it with NULL.  Triggers a
+ * warning and does nothing while the encoder is active.
+ */
+EXPORT void obs_encoder_set_group(obs_encoder_t *encoder,
+		obs_encoder_group_t *group);
+EXPORT obs_encoder_group_t *obs_encoder_get_group(
+		const obs_encoder_t *encoder);
+
+/**
+ * Returns the keyframe interval in frames of the encoder's group, or 0 if it
+ * isn't in one.  Encoders use this to leave keyframe placement to the group.
+ */
+EXPORT uint32_t obs_encoder_get_group_keyint(const obs_encoder_t *encoder);
+
+/** Returns the number of video frames dropped because the encoder was busy */
+EXPORT uint32_t obs_encoder_get_overloaded_frames(
+		const obs_encoder_t *encoder);
+
+/** Encoder performance statistics, see obs_encoder_get_stats */
+struct obs_encoder_stats {
+	/** Encode call times over recent frames, and the longest overall */
+	uint64_t encode_time_p50_ns;
+	uint64_t encode_time_p90_ns;
+	uint64_t encode_time_p99_ns;
+	uint64_t encode_time_max_ns;
+
+	/** Frames waiting on the encoder's thread, and how many can wait */
+	uint32_t queue_count;
+	uint32_t queue_depth;
+
+	/** Frames given to the encoder that haven't come out as packets yet */
+	uint32_t frames_in_flight;
+
+	/** Video frames dropped because the encoder's queue was full */
+	uint32_t overloaded_frames;
+
+	uint64_t frames_encoded;
+	uint64_t bytes_out;
+
+	/** Output bitrate over the last second, in bits per second */
+	uint64_t bitrate;
+};
+
+/**
+ * Gets performance statistics for an encoder since it was last started.
+ * Encode time percentiles are accurate to roughly a fifth, which is enough to
+ * tell a struggling encoder from a struggling network.
+ */
+EXPORT bool obs_encoder_get_stats(const obs_encoder_t *encoder,
+		struct obs_encoder_stats *stats);
+
 /** Gets the default settings for an encoder type */
 EXPORT obs_data_t *obs_encoder_defaults(const char *id);
 
@@ -1465,6 +2147,13 @@ EXPORT void obs_encoder_update(obs_encoder_t *encoder, obs_data_t *settings);
 EXPORT bool obs_encoder_get_extra_data(const obs_encoder_t *encoder,
 		uint8_t **extra_data, size_t *size);
 
+/**
+ * Gets the SEI data of this context, if any.  libobs already sends it as
+ * part of the first video packet of every output.
+ */
+EXPORT bool obs_encoder_get_sei(const obs_encoder_t *encoder,
+		uint8_t **sei, size_t *size);
+
 /** Returns the current settings for this encoder */
 EXPORT obs_data_t *obs_encoder_get_settings(const obs_encoder_t *encoder);
 
@@ -1491,12 +2180,27 @@ EXPORT bool obs_encoder_active(const obs_encoder_t *encoder);
 
 EXPORT void *obs_encoder_get_type_data(obs_encoder_t *encoder);
 
-/** Duplicates an encoder packet */
+/**
+ * Duplicates an encoder packet.  If the packet data is already refcounted
+ * the data is shared rather than copied.
+ */
 EXPORT void obs_duplicate_encoder_packet(struct encoder_packet *dst,
 		const struct encoder_packet *src);
 
 EXPORT void obs_free_encoder_packet(struct encoder_packet *packet);
 
+/**
+ * Adds a reference to an encoder packet's data.  If the source packet is not
+ * refcounted, its data is copied into a new refcounted buffer which further
+ * references made from the destination packet will share.  Release with
+ * obs_encoder_packet_release.
+ */
+EXPORT void obs_encoder_packet_ref(struct encoder_packet *dst,
+		const struct encoder_packet *src);
+
+/** Releases a reference to an encoder packet's data */
+EXPORT void obs_encoder_packet_release(struct encoder_packet *packet);
+
 
 /* ------------------------------------------------------------------------- */
 /* Stream Services */
@@ -1597,7 +2301,10 @@ static inline struct obs_source_frame *obs_source_frame_create(
 static inline void obs_source_frame_destroy(struct obs_source_frame *frame)
 {
 	if (frame) {
-		bfree(frame->data[0]);
+		if (frame->release)
+			frame->release(frame->release_param);
+		else
+			bfree(frame->data[0]);
 		bfree(frame);
 	}
 }
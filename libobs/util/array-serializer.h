@@ -26,3 +26,10 @@ struct array_output_data {
 EXPORT void array_output_serializer_init(struct serializer *s,
 		struct array_output_data *data);
 EXPORT void array_output_serializer_free(struct array_output_data *data);
+
+/**
+ * Like array_output_serializer_init, but discards any existing contents
+ * while keeping the allocation so that the data can be reused.
+ */
+EXPORT void array_output_serializer_reset(struct serializer *s,
+		struct array_output_data *data);
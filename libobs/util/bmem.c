@@ -19,72 +19,426 @@
 #include "base.h"
 #include "bmem.h"
 #include "threading.h"
+#include "platform.h"
 
 /*
- * NOTE: totally jacked the mem alignment trick from ffmpeg, credit to them:
- *   http://www.ffmpeg.org/
+ * Every block starts with a header that is as large as the alignment, which
+ * keeps the data aligned and remembers the size, so that freed blocks can be
+ * handed out again.  Blocks of up to MAX_POOLED_SIZE bytes are rounded up to
+ * a power of two and recycled: each thread keeps a small cache of free blocks
+ * for each size class, and hands the overflow to a shared list.  Most of the
+ * hot path churn (packets, calldata, small darrays) then never reaches the
+ * system allocator.  Larger blocks go straight to the system.
+ *
+ * Set OBS_BMEM_NO_POOL in the environment to disable the pools, for example
+ * when looking for memory errors with valgrind or ASan.
+ *
+ * The header also holds the accounting tag of the block, so that frees can
+ * be charged back to the tag the block was allocated with.
  */
 
 #define ALIGNMENT 32
 
-/* TODO: use memalign for non-windows systems */
-#if defined(_WIN32)
-#define ALIGNED_MALLOC 1
-#else
-#define ALIGNMENT_HACK 1
-#endif
+#define MIN_POOLED_SHIFT 5
+#define MAX_POOLED_SHIFT 12
+#define MIN_POOLED_SIZE  ((size_t)1 << MIN_POOLED_SHIFT)
+#define MAX_POOLED_SIZE  ((size_t)1 << MAX_POOLED_SHIFT)
+#define NUM_SIZE_CLASSES (MAX_POOLED_SHIFT - MIN_POOLED_SHIFT + 1)
+#define LARGE_CLASS      NUM_SIZE_CLASSES
+
+/* free bytes a thread keeps per size class before giving half of them to
+ * the shared list, and the most the shared list keeps per size class */
+#define THREAD_CACHE_BYTES (16 * 1024)
+#define SHARED_CACHE_BYTES (1024 * 1024)
+
+union bmem_header {
+	struct {
+		size_t            size;
+		uint32_t          size_class;
+		uint32_t          tag;
+		union bmem_header *next;
+	} info;
+	char pad[ALIGNMENT];
+};
+
+static inline void *header_data(union bmem_header *header)
+{
+	return header + 1;
+}
+
+static inline union bmem_header *data_header(void *ptr)
+{
+	return (union bmem_header*)ptr - 1;
+}
+
+/* ------------------------------------------------------------------------- */
+/* system allocations, aligned to ALIGNMENT */
 
 static void *a_malloc(size_t size)
 {
-#ifdef ALIGNED_MALLOC
+#if defined(_WIN32)
 	return _aligned_malloc(size, ALIGNMENT);
-#elif ALIGNMENT_HACK
+#else
 	void *ptr = NULL;
-	long diff;
-
-	ptr  = malloc(size + ALIGNMENT);
-	diff = ((~(long)ptr) & (ALIGNMENT - 1)) + 1;
-	ptr  = (char *)ptr + diff;
-	((char *)ptr)[-1] = (char)diff;
-
+	if (posix_memalign(&ptr, ALIGNMENT, size) != 0)
+		return NULL;
 	return ptr;
-#else
-	return malloc(size);
 #endif
 }
 
-static void *a_realloc(void *ptr, size_t size)
+static void *a_realloc(void *ptr, size_t old_size, size_t size)
 {
-#ifdef ALIGNED_MALLOC
+#if defined(_WIN32)
+	UNUSED_PARAMETER(old_size);
 	return _aligned_realloc(ptr, size, ALIGNMENT);
-#elif ALIGNMENT_HACK
-	long diff;
-
-	if (!ptr)
-		return a_malloc(size);
-	diff = ((char *)ptr)[-1];
-	ptr = realloc((char*)ptr - diff, size + diff);
-	if (ptr)
-		ptr = (char *)ptr + diff;
-	return ptr;
 #else
-	return realloc(ptr, size);
+	void *new_ptr = realloc(ptr, size);
+	void *aligned;
+
+	if (!new_ptr || ((uintptr_t)new_ptr & (ALIGNMENT - 1)) == 0)
+		return new_ptr;
+
+	/* realloc doesn't keep the alignment, but usually doesn't lose it
+	 * either, so only copy again when it is actually lost */
+	aligned = a_malloc(size);
+	if (aligned)
+		memcpy(aligned, new_ptr, old_size < size ? old_size : size);
+	free(new_ptr);
+	return aligned;
 #endif
 }
 
 static void a_free(void *ptr)
 {
-#ifdef ALIGNED_MALLOC
+#if defined(_WIN32)
 	_aligned_free(ptr);
-#elif ALIGNMENT_HACK
-	if (ptr)
-		free((char *)ptr - ((char*)ptr)[-1]);
 #else
 	free(ptr);
 #endif
 }
 
-static struct base_allocator alloc = {a_malloc, a_realloc, a_free};
+/* ------------------------------------------------------------------------- */
+/* accounting */
+
+struct tag_info {
+	char             name[64];
+	volatile int64_t live_bytes;
+	volatile long    live_allocs;
+	volatile int64_t total_allocs;
+};
+
+static struct tag_info tags[BMEM_MAX_TAGS] = {{"untagged"}};
+static volatile long num_tags = 1;
+static pthread_mutex_t tag_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t start_time = 0;
+
+#ifdef _MSC_VER
+static __declspec(thread) int thread_tag = BMEM_TAG_UNTAGGED;
+#else
+static __thread int thread_tag = BMEM_TAG_UNTAGGED;
+#endif
+
+static inline void charge_alloc(uint32_t tag, size_t size)
+{
+	struct tag_info *info = &tags[tag];
+
+	os_atomic_add_int64(&info->live_bytes, (int64_t)size);
+	os_atomic_inc_long(&info->live_allocs);
+	os_atomic_add_int64(&info->total_allocs, 1);
+}
+
+static inline void charge_free(uint32_t tag, size_t size)
+{
+	struct tag_info *info = &tags[tag];
+
+	os_atomic_add_int64(&info->live_bytes, -(int64_t)size);
+	os_atomic_dec_long(&info->live_allocs);
+}
+
+static inline void charge_resize(uint32_t tag, size_t old_size, size_t size)
+{
+	os_atomic_add_int64(&tags[tag].live_bytes,
+			(int64_t)size - (int64_t)old_size);
+}
+
+/* ------------------------------------------------------------------------- */
+/* size class pools */
+
+struct class_list {
+	union bmem_header *head;
+	size_t            count;
+};
+
+struct thread_cache {
+	struct class_list classes[NUM_SIZE_CLASSES];
+};
+
+struct shared_pool {
+	pthread_mutex_t   mutex;
+	struct class_list list;
+};
+
+static struct shared_pool shared_pools[NUM_SIZE_CLASSES];
+static pthread_once_t pool_init_once = PTHREAD_ONCE_INIT;
+static pthread_key_t thread_cache_key;
+static bool pools_enabled = false;
+
+#ifdef _MSC_VER
+static __declspec(thread) struct thread_cache *thread_cache = NULL;
+#else
+static __thread struct thread_cache *thread_cache = NULL;
+#endif
+
+static inline size_t class_size(uint32_t size_class)
+{
+	return MIN_POOLED_SIZE << size_class;
+}
+
+static inline size_t thread_cache_limit(uint32_t size_class)
+{
+	return THREAD_CACHE_BYTES / class_size(size_class);
+}
+
+static inline size_t shared_cache_limit(uint32_t size_class)
+{
+	return SHARED_CACHE_BYTES / class_size(size_class);
+}
+
+static inline uint32_t get_size_class(size_t size)
+{
+	uint32_t size_class = 0;
+
+	if (size > MAX_POOLED_SIZE || !pools_enabled)
+		return LARGE_CLASS;
+
+	while (class_size(size_class) < size)
+		size_class++;
+	return size_class;
+}
+
+static inline void list_push(struct class_list *list,
+		union bmem_header *header)
+{
+	header->info.next = list->head;
+	list->head = header;
+	list->count++;
+}
+
+static inline union bmem_header *list_pop(struct class_list *list)
+{
+	union bmem_header *header = list->head;
+	if (header) {
+		list->head = header->info.next;
+		list->count--;
+	}
+	return header;
+}
+
+/* moves up to count blocks from one list to another */
+static void list_move(struct class_list *dst, struct class_list *src,
+		size_t count)
+{
+	while (count-- && src->head)
+		list_push(dst, list_pop(src));
+}
+
+static void free_to_shared(uint32_t size_class, struct class_list *list)
+{
+	struct shared_pool *pool = &shared_pools[size_class];
+	size_t limit = shared_cache_limit(size_class);
+	union bmem_header *header;
+
+	pthread_mutex_lock(&pool->mutex);
+	if (pool->list.count < limit)
+		list_move(&pool->list, list, limit - pool->list.count);
+	pthread_mutex_unlock(&pool->mutex);
+
+	/* whatever doesn't fit goes back to the system */
+	while ((header = list_pop(list)) != NULL)
+		a_free(header);
+}
+
+static void thread_cache_destroy(void *param)
+{
+	struct thread_cache *cache = param;
+
+	for (uint32_t i = 0; i < NUM_SIZE_CLASSES; i++)
+		free_to_shared(i, &cache->classes[i]);
+
+	if (thread_cache == cache)
+		thread_cache = NULL;
+	a_free(cache);
+}
+
+static void init_pools(void)
+{
+	start_time = os_gettime_ns();
+
+	if (getenv("OBS_BMEM_NO_POOL"))
+		return;
+	if (pthread_key_create(&thread_cache_key, thread_cache_destroy) != 0)
+		return;
+
+	for (size_t i = 0; i < NUM_SIZE_CLASSES; i++) {
+		if (pthread_mutex_init(&shared_pools[i].mutex, NULL) != 0)
+			return;
+	}
+
+	pools_enabled = true;
+}
+
+static struct thread_cache *get_thread_cache(void)
+{
+	struct thread_cache *cache = thread_cache;
+	if (cache)
+		return cache;
+
+	cache = a_malloc(sizeof(struct thread_cache));
+	if (!cache)
+		return NULL;
+
+	memset(cache, 0, sizeof(*cache));
+	pthread_setspecific(thread_cache_key, cache);
+	thread_cache = cache;
+	return cache;
+}
+
+static union bmem_header *pool_take(uint32_t size_class)
+{
+	struct thread_cache *cache = get_thread_cache();
+	struct class_list *list;
+	struct shared_pool *pool;
+
+	if (!cache)
+		return NULL;
+
+	list = &cache->classes[size_class];
+	if (!list->head) {
+		pool = &shared_pools[size_class];
+
+		pthread_mutex_lock(&pool->mutex);
+		list_move(list, &pool->list,
+				thread_cache_limit(size_class) / 2);
+		pthread_mutex_unlock(&pool->mutex);
+	}
+
+	return list_pop(list);
+}
+
+static bool pool_give(union bmem_header *header)
+{
+	uint32_t size_class = header->info.size_class;
+	struct thread_cache *cache = get_thread_cache();
+	struct class_list *list;
+	struct class_list overflow = {0};
+
+	if (!cache)
+		return false;
+
+	list = &cache->classes[size_class];
+	list_push(list, header);
+
+	if (list->count > thread_cache_limit(size_class)) {
+		list_move(&overflow, list, list->count / 2);
+		free_to_shared(size_class, &overflow);
+	}
+
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void *pool_alloc(size_t size, uint32_t tag)
+{
+	union bmem_header *header = NULL;
+	uint32_t size_class;
+
+	pthread_once(&pool_init_once, init_pools);
+
+	size_class = get_size_class(size);
+	if (size_class != LARGE_CLASS) {
+		header = pool_take(size_class);
+		if (!header)
+			header = a_malloc(sizeof(*header) +
+					class_size(size_class));
+	} else {
+		header = a_malloc(sizeof(*header) + size);
+	}
+
+	if (!header)
+		return NULL;
+
+	header->info.size       = size;
+	header->info.size_class = size_class;
+	header->info.tag        = tag;
+	header->info.next       = NULL;
+
+	charge_alloc(tag, size);
+	return header_data(header);
+}
+
+static void *pool_malloc(size_t size)
+{
+	return pool_alloc(size, (uint32_t)thread_tag);
+}
+
+static void pool_free(void *ptr)
+{
+	union bmem_header *header;
+
+	if (!ptr)
+		return;
+
+	header = data_header(ptr);
+	charge_free(header->info.tag, header->info.size);
+
+	if (header->info.size_class == LARGE_CLASS || !pool_give(header))
+		a_free(header);
+}
+
+static void *pool_realloc(void *ptr, size_t size)
+{
+	union bmem_header *header;
+	void *new_ptr;
+
+	if (!ptr)
+		return pool_malloc(size);
+
+	header = data_header(ptr);
+
+	/* still fits in its size class */
+	if (header->info.size_class != LARGE_CLASS &&
+	    get_size_class(size) == header->info.size_class) {
+		charge_resize(header->info.tag, header->info.size, size);
+		header->info.size = size;
+		return ptr;
+	}
+
+	if (header->info.size_class == LARGE_CLASS &&
+	    get_size_class(size) == LARGE_CLASS) {
+		size_t old_size = header->info.size;
+
+		header = a_realloc(header, sizeof(*header) + old_size,
+				sizeof(*header) + size);
+		if (!header)
+			return NULL;
+
+		charge_resize(header->info.tag, old_size, size);
+		header->info.size = size;
+		return header_data(header);
+	}
+
+	new_ptr = pool_alloc(size, header->info.tag);
+	if (!new_ptr)
+		return NULL;
+
+	memcpy(new_ptr, ptr, header->info.size < size ?
+			header->info.size : size);
+	pool_free(ptr);
+	return new_ptr;
+}
+
+static struct base_allocator alloc = {pool_malloc, pool_realloc, pool_free};
 static long num_allocs = 0;
 
 void base_set_allocator(struct base_allocator *defs)
@@ -145,3 +499,100 @@ void *bmemdup(const void *ptr, size_t size)
 
 	return out;
 }
+
+/* ------------------------------------------------------------------------- */
+
+void *bmalloc_tagged(size_t size, int tag)
+{
+	int prev_tag = bmem_set_thread_tag(tag);
+	void *ptr = bmalloc(size);
+	bmem_set_thread_tag(prev_tag);
+	return ptr;
+}
+
+int bmem_register_tag(const char *name)
+{
+	int tag = BMEM_TAG_UNTAGGED;
+
+	if (!name || !*name)
+		return BMEM_TAG_UNTAGGED;
+
+	pthread_mutex_lock(&tag_mutex);
+
+	for (long i = 1; i < num_tags; i++) {
+		if (strcmp(tags[i].name, name) == 0) {
+			tag = (int)i;
+			break;
+		}
+	}
+
+	if (tag == BMEM_TAG_UNTAGGED && num_tags < BMEM_MAX_TAGS) {
+		tag = (int)num_tags;
+		strncpy(tags[tag].name, name, sizeof(tags[tag].name) - 1);
+		os_atomic_inc_long(&num_tags);
+	}
+
+	pthread_mutex_unlock(&tag_mutex);
+	return tag;
+}
+
+int bmem_set_thread_tag(int tag)
+{
+	int prev_tag = thread_tag;
+
+	if (tag < 0 || tag >= BMEM_MAX_TAGS)
+		tag = BMEM_TAG_UNTAGGED;
+
+	thread_tag = tag;
+	return prev_tag;
+}
+
+int bmem_get_thread_tag(void)
+{
+	return thread_tag;
+}
+
+int bmem_num_tags(void)
+{
+	return (int)num_tags;
+}
+
+bool bmem_get_tag_stats(int tag, struct bmem_tag_stats *stats)
+{
+	struct tag_info *info;
+
+	if (!stats || tag < 0 || tag >= num_tags)
+		return false;
+
+	info = &tags[tag];
+	stats->name         = info->name;
+	stats->live_bytes   = os_atomic_add_int64(&info->live_bytes, 0);
+	stats->live_allocs  = info->live_allocs;
+	stats->total_allocs =
+		(uint64_t)os_atomic_add_int64(&info->total_allocs, 0);
+	return true;
+}
+
+void bmem_log_tag_stats(void)
+{
+	double seconds = (double)(os_gettime_ns() - start_time) / 1e9;
+	struct bmem_tag_stats stats;
+
+	if (!start_time || seconds <= 0.0)
+		return;
+
+	blog(LOG_INFO, "Memory usage by tag:");
+	blog(LOG_INFO, "--------------------");
+
+	for (int i = 0; i < bmem_num_tags(); i++) {
+		if (!bmem_get_tag_stats(i, &stats) || !stats.total_allocs)
+			continue;
+
+		blog(LOG_INFO, "%s: %.1f KB live in %ld allocations, "
+				"%.1f allocations/s",
+				stats.name,
+				(double)stats.live_bytes / 1024.0,
+				stats.live_allocs,
+				(double)stats.total_allocs / seconds);
+	}
+}
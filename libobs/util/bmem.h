@@ -43,6 +43,62 @@ EXPORT long bnum_allocs(void);
 
 EXPORT void *bmemdup(const void *ptr, size_t size);
 
+/*
+ * Allocation accounting.  Each allocation is charged to a tag, usually the
+ * subsystem or module that owns it, which gives the live bytes and the
+ * allocation churn for each part of the program.  The tag is either passed
+ * to bmalloc_tagged, or set for the calling thread with bmem_set_thread_tag,
+ * in which case every allocation the thread makes is charged to it.
+ * Reallocated blocks stay charged to the tag they were allocated with.
+ *
+ * Accounting is done by the default allocator, so nothing is counted after
+ * base_set_allocator has been used to replace it.
+ */
+
+#define BMEM_TAG_UNTAGGED 0
+#define BMEM_MAX_TAGS     256
+
+struct bmem_tag_stats {
+	const char *name;
+	int64_t    live_bytes;
+	long       live_allocs;
+	uint64_t   total_allocs;
+};
+
+/* returns the existing tag if the name is already registered, or
+ * BMEM_TAG_UNTAGGED if there are no free tags left */
+EXPORT int bmem_register_tag(const char *name);
+
+/* returns the previous tag of the thread, to restore it with afterwards */
+EXPORT int bmem_set_thread_tag(int tag);
+EXPORT int bmem_get_thread_tag(void);
+
+EXPORT int bmem_num_tags(void);
+EXPORT bool bmem_get_tag_stats(int tag, struct bmem_tag_stats *stats);
+
+/* logs the statistics of every tag that has seen any allocations, together
+ * with the average number of allocations per second since startup */
+EXPORT void bmem_log_tag_stats(void);
+
+EXPORT void *bmalloc_tagged(size_t size, int tag);
+
+static inline void *bzalloc_tagged(size_t size, int tag)
+{
+	void *mem = bmalloc_tagged(size, tag);
+	if (mem)
+		memset(mem, 0, size);
+	return mem;
+}
+
+/* registers a tag the first time it is used, caching it in *tag, which
+ * must start out as BMEM_TAG_UNTAGGED */
+static inline int bmem_tag(int *tag, const char *name)
+{
+	if (*tag == BMEM_TAG_UNTAGGED)
+		*tag = bmem_register_tag(name);
+	return *tag;
+}
+
 static inline void *bzalloc(size_t size)
 {
 	void *mem = bmalloc(size);
@@ -19,12 +19,129 @@
 #include <wchar.h>
 #include "config-file.h"
 #include "platform.h"
+#include "threading.h"
 #include "base.h"
 #include "bmem.h"
 #include "darray.h"
 #include "lexer.h"
 #include "dstr.h"
 
+/*
+ * Case-insensitive open addressing index over a darray of sections or items.
+ * Slots hold array index + 1 (0 is an empty slot), and the table is kept at
+ * most half full.  Both struct config_section and struct config_item start
+ * with their name, which is what the index hashes and compares.
+ */
+struct config_index {
+	size_t *slots;
+	size_t size;
+};
+
+#define INDEX_MIN_SIZE 16
+
+static inline uint32_t name_hash(const char *name)
+{
+	uint32_t hash = 2166136261U;
+
+	while (*name) {
+		char ch = *(name++);
+		if (ch >= 'A' && ch <= 'Z')
+			ch += 'a' - 'A';
+
+		hash ^= (uint8_t)ch;
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+static inline const char *index_name(const struct darray *array,
+		size_t element_size, size_t idx)
+{
+	return *(const char**)darray_item(element_size, array, idx);
+}
+
+static size_t index_find(const struct config_index *index,
+		const struct darray *array, size_t element_size,
+		const char *name)
+{
+	size_t mask, pos;
+
+	if (!index->size || !name)
+		return DARRAY_INVALID;
+
+	mask = index->size - 1;
+	pos  = name_hash(name) & mask;
+
+	while (index->slots[pos]) {
+		size_t idx = index->slots[pos] - 1;
+		if (astrcmpi(index_name(array, element_size, idx), name) == 0)
+			return idx;
+
+		pos = (pos + 1) & mask;
+	}
+
+	return DARRAY_INVALID;
+}
+
+/* duplicate names keep the first entry, matching a linear search */
+static void index_insert(struct config_index *index,
+		const struct darray *array, size_t element_size, size_t idx)
+{
+	const char *name = index_name(array, element_size, idx);
+	size_t mask = index->size - 1;
+	size_t pos  = name_hash(name) & mask;
+
+	while (index->slots[pos]) {
+		size_t cur = index->slots[pos] - 1;
+		if (astrcmpi(index_name(array, element_size, cur), name) == 0)
+			return;
+
+		pos = (pos + 1) & mask;
+	}
+
+	index->slots[pos] = idx + 1;
+}
+
+static void index_rebuild(struct config_index *index,
+		const struct darray *array, size_t element_size)
+{
+	size_t size = INDEX_MIN_SIZE;
+
+	while (size < array->num * 2)
+		size *= 2;
+
+	if (size != index->size) {
+		bfree(index->slots);
+		index->slots = bmalloc(size * sizeof(size_t));
+		index->size  = size;
+	}
+
+	memset(index->slots, 0, size * sizeof(size_t));
+
+	for (size_t i = 0; i < array->num; i++)
+		index_insert(index, array, element_size, i);
+}
+
+/* call after pushing a new entry on to the back of the array */
+static inline void index_add(struct config_index *index,
+		const struct darray *array, size_t element_size)
+{
+	if (array->num * 2 > index->size)
+		index_rebuild(index, array, element_size);
+	else
+		index_insert(index, array, element_size, array->num - 1);
+}
+
+static inline void index_free(struct config_index *index)
+{
+	bfree(index->slots);
+	index->slots = NULL;
+	index->size  = 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
 struct config_item {
 	char *name;
 	char *value;
@@ -39,6 +156,7 @@ static inline void config_item_free(struct config_item *item)
 struct config_section {
 	char *name;
 	struct darray items; /* struct config_item */
+	struct config_index index;
 };
 
 static inline void config_section_free(struct config_section *section)
@@ -50,13 +168,80 @@ static inline void config_section_free(struct config_section *section)
 		config_item_free(items+i);
 
 	darray_free(&section->items);
+	index_free(&section->index);
 	bfree(section->name);
 }
 
+static inline struct config_item *section_find_item(
+		const struct config_section *section, const char *name)
+{
+	size_t idx = index_find(&section->index, &section->items,
+			sizeof(struct config_item), name);
+	return idx != DARRAY_INVALID ?
+		darray_item(sizeof(struct config_item), &section->items, idx) :
+		NULL;
+}
+
+static inline struct config_item *section_add_item(
+		struct config_section *section, const char *name, size_t len,
+		char *value)
+{
+	struct config_item *item = darray_push_back_new(
+			sizeof(struct config_item), &section->items);
+	item->name  = bstrdup_n(name, len);
+	item->value = value;
+
+	index_add(&section->index, &section->items,
+			sizeof(struct config_item));
+	return item;
+}
+
+struct config_sections {
+	struct darray array; /* struct config_section */
+	struct config_index index;
+};
+
+static struct config_section *find_section(
+		const struct config_sections *sections, const char *name)
+{
+	size_t idx = index_find(&sections->index, &sections->array,
+			sizeof(struct config_section), name);
+	return idx != DARRAY_INVALID ?
+		darray_item(sizeof(struct config_section), &sections->array,
+				idx) :
+		NULL;
+}
+
+/* takes ownership of name */
+static struct config_section *add_section(struct config_sections *sections,
+		char *name)
+{
+	struct config_section *section = darray_push_back_new(
+			sizeof(struct config_section), &sections->array);
+	section->name = name;
+	index_add(&sections->index, &sections->array,
+			sizeof(struct config_section));
+	return section;
+}
+
+static void config_sections_free(struct config_sections *sections)
+{
+	struct config_section *array = sections->array.array;
+
+	for (size_t i = 0; i < sections->array.num; i++)
+		config_section_free(array+i);
+
+	darray_free(&sections->array);
+	index_free(&sections->index);
+}
+
 struct config_data {
 	char *file;
-	struct darray sections; /* struct config_section */
-	struct darray defaults; /* struct config_section */
+	struct config_sections sections;
+	struct config_sections defaults;
+
+	/* set when user values change, cleared when saved */
+	bool changed;
 };
 
 config_t *config_create(const char *file)
@@ -117,19 +302,16 @@ static bool config_parse_string(struct lexer *lex, struct strref *ref,
 	return success;
 }
 
-static void config_add_item(struct darray *items, struct strref *name,
-		struct strref *value)
+static void config_add_item(struct config_section *section,
+		struct strref *name, struct strref *value)
 {
-	struct config_item item;
 	struct dstr item_value;
 	dstr_init_copy_strref(&item_value, value);
 	dstr_replace(&item_value, "\\n", "\n");
 	dstr_replace(&item_value, "\\r", "\r");
 	dstr_replace(&item_value, "\\\\", "\\");
 
-	item.name  = bstrdup_n(name->array,  name->len);
-	item.value = item_value.array;
-	darray_push_back(sizeof(struct config_item), items, &item);
+	section_add_item(section, name->array, name->len, item_value.array);
 }
 
 static void config_parse_section(struct config_section *section,
@@ -168,11 +350,12 @@ static void config_parse_section(struct config_section *section,
 		config_parse_string(lex, &value, 0);
 
 		if (!strref_is_empty(&value))
-			config_add_item(&section->items, &name, &value);
+			config_add_item(section, &name, &value);
 	}
 }
 
-static void parse_config_data(struct darray *sections, struct lexer *lex)
+static void parse_config_data(struct config_sections *sections,
+		struct lexer *lex)
 {
 	struct strref section_name;
 	struct base_token token;
@@ -181,6 +364,7 @@ static void parse_config_data(struct darray *sections, struct lexer *lex)
 
 	while (lexer_getbasetoken(lex, &token, PARSE_WHITESPACE)) {
 		struct config_section *section;
+		char *name;
 
 		while (token.type == BASETOKEN_WHITESPACE) {
 			if (!lexer_getbasetoken(lex, &token, PARSE_WHITESPACE))
@@ -202,15 +386,20 @@ static void parse_config_data(struct darray *sections, struct lexer *lex)
 		if (!section_name.len)
 			return;
 
-		section = darray_push_back_new(sizeof(struct config_section),
-				sections);
-		section->name = bstrdup_n(section_name.array,
-				section_name.len);
+		/* repeated section names are merged in to the first one */
+		name = bstrdup_n(section_name.array, section_name.len);
+		section = find_section(sections, name);
+		if (section)
+			bfree(name);
+		else
+			section = add_section(sections, name);
+
 		config_parse_section(section, lex);
 	}
 }
 
-static int config_parse_file(struct darray *sections, const char *file,
+static int config_parse_file(struct config_sections *sections,
+		const char *file,
 		bool always_open)
 {
 	char *file_data;
@@ -292,34 +481,23 @@ int config_open_defaults(config_t *config, const char *file)
 	return config_parse_file(&config->defaults, file, false);
 }
 
-int config_save(config_t *config)
+static void config_serialize(const config_t *config, struct dstr *str)
 {
-	FILE *f;
-	struct dstr str, tmp;
+	const struct darray *sections = &config->sections.array;
+	struct dstr tmp;
 	size_t i, j;
 
-	if (!config)
-		return CONFIG_ERROR;
-	if (!config->file)
-		return CONFIG_ERROR;
-
-	dstr_init(&str);
 	dstr_init(&tmp);
 
-	f = os_fopen(config->file, "wb");
-	if (!f)
-		return CONFIG_FILENOTFOUND;
-
-	for (i = 0; i < config->sections.num; i++) {
+	for (i = 0; i < sections->num; i++) {
 		struct config_section *section = darray_item(
-				sizeof(struct config_section),
-				&config->sections, i);
+				sizeof(struct config_section), sections, i);
 
-		if (i) dstr_cat(&str, "\n");
+		if (i) dstr_cat(str, "\n");
 
-		dstr_cat(&str, "[");
-		dstr_cat(&str, section->name);
-		dstr_cat(&str, "]\n");
+		dstr_cat(str, "[");
+		dstr_cat(str, section->name);
+		dstr_cat(str, "]\n");
 
 		for (j = 0; j < section->items.num; j++) {
 			struct config_item *item = darray_item(
@@ -331,54 +509,51 @@ int config_save(config_t *config)
 			dstr_replace(&tmp, "\r", "\\r");
 			dstr_replace(&tmp, "\n", "\\n");
 
-			dstr_cat(&str, item->name);
-			dstr_cat(&str, "=");
-			dstr_cat(&str, tmp.array);
-			dstr_cat(&str, "\n");
+			dstr_cat(str, item->name);
+			dstr_cat(str, "=");
+			dstr_cat(str, tmp.array);
+			dstr_cat(str, "\n");
 		}
 	}
 
+	dstr_free(&tmp);
+}
+
+static int write_file(const char *file, const struct dstr *str)
+{
+	FILE *f = os_fopen(file, "wb");
+	if (!f)
+		return CONFIG_FILENOTFOUND;
+
 #ifdef _WIN32
 	fwrite("\xEF\xBB\xBF", 1, 3, f);
 #endif
-	fwrite(str.array, 1, str.len, f);
+	if (str->len)
+		fwrite(str->array, 1, str->len, f);
 	fclose(f);
 
-	dstr_free(&tmp);
-	dstr_free(&str);
-
 	return CONFIG_SUCCESS;
 }
 
-int config_save_safe(config_t *config, const char *temp_ext,
-		const char *backup_ext)
+static int write_file_safe(const char *file, const struct dstr *str,
+		const char *temp_ext, const char *backup_ext)
 {
 	struct dstr temp_file = {0};
 	struct dstr backup_file = {0};
-	char *file = config->file;
 	int ret;
 
-	if (!temp_ext || !*temp_ext) {
-		blog(LOG_ERROR, "config_save_safe: invalid "
-		                "temporary extension specified");
-		return CONFIG_ERROR;
-	}
-
-	dstr_copy(&temp_file, config->file);
+	dstr_copy(&temp_file, file);
 	if (*temp_ext != '.')
 		dstr_cat(&temp_file, ".");
 	dstr_cat(&temp_file, temp_ext);
 
-	config->file = temp_file.array;
-	ret = config_save(config);
-	config->file = file;
-
+	ret = write_file(temp_file.array, str);
 	if (ret != CONFIG_SUCCESS) {
 		goto cleanup;
 	}
 
 	if (backup_ext && *backup_ext) {
-		dstr_copy(&backup_file, config->file);
+		dstr_copy(&backup_file, file);
 		if (*backup_ext != '.')
 			dstr_cat(&backup_file, ".");
 		dstr_cat(&backup_file, backup_ext);
@@ -397,106 +572,317 @@ cleanup:
 	return ret;
 }
 
-void config_close(config_t *config)
+/* ------------------------------------------------------------------------- */
+/* asynchronous saving */
+
+struct save_job {
+	char *file;
+	char *temp_ext;
+	char *backup_ext;
+	struct dstr data;
+};
+
+/* write_mutex is held by whoever is currently writing a file and is always
+ * taken before save_mutex, which protects the job queue */
+static pthread_mutex_t write_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t save_mutex  = PTHREAD_MUTEX_INITIALIZER;
+
+static DARRAY(struct save_job) save_jobs;
+static bool save_thread_active = false;
+
+static inline void save_job_free(struct save_job *job)
 {
-	struct config_section *defaults, *sections;
-	size_t i;
+	bfree(job->file);
+	bfree(job->temp_ext);
+	bfree(job->backup_ext);
+	dstr_free(&job->data);
+}
 
-	if (!config) return;
+static inline void save_job_set_exts(struct save_job *job,
+		const char *temp_ext, const char *backup_ext)
+{
+	bfree(job->temp_ext);
+	bfree(job->backup_ext);
+	job->temp_ext   = bstrdup(temp_ext);
+	job->backup_ext = bstrdup(backup_ext);
+}
+
+static void *save_thread(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+
+	os_set_thread_name("config file save thread");
+
+	for (;;) {
+		struct save_job job;
+
+		pthread_mutex_lock(&write_mutex);
+		pthread_mutex_lock(&save_mutex);
+
+		if (!save_jobs.num) {
+			da_free(save_jobs);
+			save_thread_active = false;
+			pthread_mutex_unlock(&save_mutex);
+			pthread_mutex_unlock(&write_mutex);
+			break;
+		}
+
+		job = save_jobs.array[0];
+		da_erase(save_jobs, 0);
+		pthread_mutex_unlock(&save_mutex);
+
+		if (write_file_safe(job.file, &job.data, job.temp_ext,
+					job.backup_ext) != CONFIG_SUCCESS)
+			blog(LOG_WARNING, "Failed to save config file '%s'",
+					job.file);
+
+		pthread_mutex_unlock(&write_mutex);
+		save_job_free(&job);
+	}
+
+	return NULL;
+}
+
+/* takes ownership of data; a job still waiting for the same file is
+ * replaced rather than written twice */
+static void queue_save(const char *file, struct dstr *data,
+		const char *temp_ext, const char *backup_ext)
+{
+	struct save_job *job = NULL;
+
+	pthread_mutex_lock(&save_mutex);
+
+	for (size_t i = 0; i < save_jobs.num; i++) {
+		if (strcmp(save_jobs.array[i].file, file) == 0) {
+			job = save_jobs.array + i;
+			dstr_free(&job->data);
+			break;
+		}
+	}
+
+	if (!job) {
+		job = da_push_back_new(save_jobs);
+		job->file = bstrdup(file);
+	}
+
+	save_job_set_exts(job, temp_ext, backup_ext);
+	job->data = *data;
+
+	if (!save_thread_active) {
+		pthread_t thread;
+
+		if (pthread_create(&thread, NULL, save_thread, NULL) == 0) {
+			pthread_detach(thread);
+			save_thread_active = true;
+		} else {
+			blog(LOG_WARNING, "queue_save: failed to create "
+			                  "save thread, saves will be "
+			                  "written on config_wait_saves");
+		}
+	}
+
+	pthread_mutex_unlock(&save_mutex);
+}
+
+/* a synchronous save supersedes any queued save of the same file; must be
+ * called with write_mutex held */
+static void cancel_queued_saves(const char *file)
+{
+	pthread_mutex_lock(&save_mutex);
+
+	for (size_t i = save_jobs.num; i > 0; i--) {
+		struct save_job *job = save_jobs.array + (i - 1);
+
+		if (strcmp(job->file, file) == 0) {
+			save_job_free(job);
+			da_erase(save_jobs, i - 1);
+		}
+	}
+
+	pthread_mutex_unlock(&save_mutex);
+}
+
+void config_wait_saves(void)
+{
+	bool run_inline = false;
+
+	pthread_mutex_lock(&save_mutex);
+	if (!save_thread_active && save_jobs.num) {
+		save_thread_active = true;
+		run_inline = true;
+	}
+	pthread_mutex_unlock(&save_mutex);
+
+	if (run_inline) {
+		save_thread(NULL);
+		return;
+	}
+
+	for (;;) {
+		bool active;
 
-	defaults = config->defaults.array;
-	sections = config->sections.array;
+		pthread_mutex_lock(&save_mutex);
+		active = save_thread_active;
+		pthread_mutex_unlock(&save_mutex);
 
-	for (i = 0; i < config->defaults.num; i++)
-		config_section_free(defaults+i);
-	for (i = 0; i < config->sections.num; i++)
-		config_section_free(sections+i);
+		if (!active)
+			break;
+
+		os_sleep_ms(1);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+int config_save(config_t *config)
+{
+	struct dstr str = {0};
+	int ret;
+
+	if (!config)
+		return CONFIG_ERROR;
+	if (!config->file)
+		return CONFIG_ERROR;
+	if (!config->changed)
+		return CONFIG_SUCCESS;
+
+	config_serialize(config, &str);
+
+	pthread_mutex_lock(&write_mutex);
+	cancel_queued_saves(config->file);
+	ret = write_file(config->file, &str);
+	pthread_mutex_unlock(&write_mutex);
 
-	darray_free(&config->defaults);
-	darray_free(&config->sections);
+	if (ret == CONFIG_SUCCESS)
+		config->changed = false;
+
+	dstr_free(&str);
+	return ret;
+}
+
+int config_save_safe(config_t *config, const char *temp_ext,
+		const char *backup_ext)
+{
+	struct dstr str = {0};
+	int ret;
+
+	if (!config || !config->file)
+		return CONFIG_ERROR;
+
+	if (!temp_ext || !*temp_ext) {
+		blog(LOG_ERROR, "config_save_safe: invalid "
+		                "temporary extension specified");
+		return CONFIG_ERROR;
+	}
+
+	if (!config->changed)
+		return CONFIG_SUCCESS;
+
+	config_serialize(config, &str);
+
+	pthread_mutex_lock(&write_mutex);
+	cancel_queued_saves(config->file);
+	ret = write_file_safe(config->file, &str, temp_ext, backup_ext);
+	pthread_mutex_unlock(&write_mutex);
+
+	if (ret == CONFIG_SUCCESS)
+		config->changed = false;
+
+	dstr_free(&str);
+	return ret;
+}
+
+int config_save_safe_async(config_t *config, const char *temp_ext,
+		const char *backup_ext)
+{
+	struct dstr str = {0};
+
+	if (!config || !config->file)
+		return CONFIG_ERROR;
+
+	if (!temp_ext || !*temp_ext) {
+		blog(LOG_ERROR, "config_save_safe_async: invalid "
+		                "temporary extension specified");
+		return CONFIG_ERROR;
+	}
+
+	if (!config->changed)
+		return CONFIG_SUCCESS;
+
+	config_serialize(config, &str);
+	queue_save(config->file, &str, temp_ext, backup_ext);
+
+	config->changed = false;
+	return CONFIG_SUCCESS;
+}
+
+void config_close(config_t *config)
+{
+	if (!config) return;
+
+	config_sections_free(&config->defaults);
+	config_sections_free(&config->sections);
 	bfree(config->file);
 	bfree(config);
 }
 
 size_t config_num_sections(config_t *config)
 {
-	return config->sections.num;
+	return config->sections.array.num;
 }
 
 const char *config_get_section(config_t *config, size_t idx)
 {
 	struct config_section *section;
 
-	if (idx >= config->sections.num)
+	if (idx >= config->sections.array.num)
 		return NULL;
 
-	section = darray_item(sizeof(struct config_section), &config->sections,
-			idx);
+	section = darray_item(sizeof(struct config_section),
+			&config->sections.array, idx);
 
 	return section->name;
 }
 
-static const struct config_item *config_find_item(const struct darray *sections,
+static const struct config_item *config_find_item(
+		const struct config_sections *sections,
 		const char *section, const char *name)
 {
-	size_t i, j;
-
-	for (i = 0; i < sections->num; i++) {
-		const struct config_section *sec = darray_item(
-				sizeof(struct config_section), sections, i);
-
-		if (astrcmpi(sec->name, section) == 0) {
-			for (j = 0; j < sec->items.num; j++) {
-				struct config_item *item = darray_item(
-						sizeof(struct config_item),
-						&sec->items, j);
-
-				if (astrcmpi(item->name, name) == 0)
-					return item;
-			}
-		}
-	}
-
-	return NULL;
+	const struct config_section *sec = find_section(sections, section);
+	return sec ? section_find_item(sec, name) : NULL;
 }
 
-static void config_set_item(struct darray *sections, const char *section,
-		const char *name, char *value)
+/* takes ownership of value, returns true if the stored value changed */
+static bool config_set_item(struct config_sections *sections,
+		const char *section, const char *name, char *value)
 {
-	struct config_section *sec = NULL;
-	struct config_section *array = sections->array;
+	struct config_section *sec = find_section(sections, section);
 	struct config_item *item;
-	size_t i, j;
-
-	for (i = 0; i < sections->num; i++) {
-		struct config_section *cur_sec = array+i;
-		struct config_item *items = cur_sec->items.array;
-
-		if (astrcmpi(cur_sec->name, section) == 0) {
-			for (j = 0; j < cur_sec->items.num; j++) {
-				item = items+j;
 
-				if (astrcmpi(item->name, name) == 0) {
-					bfree(item->value);
-					item->value = value;
-					return;
-				}
-			}
+	if (!sec)
+		sec = add_section(sections, bstrdup(section));
 
-			sec = cur_sec;
-			break;
-		}
+	item = section_find_item(sec, name);
+	if (!item) {
+		section_add_item(sec, name, strlen(name), value);
+		return true;
 	}
 
-	if (!sec) {
-		sec = darray_push_back_new(sizeof(struct config_section),
-				sections);
-		sec->name = bstrdup(section);
+	if (item->value && strcmp(item->value, value) == 0) {
+		bfree(value);
+		return false;
 	}
 
-	item = darray_push_back_new(sizeof(struct config_item), &sec->items);
-	item->name  = bstrdup(name);
+	bfree(item->value);
 	item->value = value;
+	return true;
+}
+
+static inline void config_set_user_item(config_t *config, const char *section,
+		const char *name, char *value)
+{
+	if (config_set_item(&config->sections, section, name, value))
+		config->changed = true;
 }
 
 void config_set_string(config_t *config, const char *section,
@@ -504,7 +890,7 @@ void config_set_string(config_t *config, const char *section,
 {
 	if (!value)
 		value = "";
-	config_set_item(&config->sections, section, name, bstrdup(value));
+	config_set_user_item(config, section, name, bstrdup(value));
 }
 
 void config_set_int(config_t *config, const char *section,
@@ -513,7 +899,7 @@ void config_set_int(config_t *config, const char *section,
 	struct dstr str;
 	dstr_init(&str);
 	dstr_printf(&str, "%"PRId64, value);
-	config_set_item(&config->sections, section, name, str.array);
+	config_set_user_item(config, section, name, str.array);
 }
 
 void config_set_uint(config_t *config, const char *section,
@@ -522,14 +908,14 @@ void config_set_uint(config_t *config, const char *section,
 	struct dstr str;
 	dstr_init(&str);
 	dstr_printf(&str, "%"PRIu64, value);
-	config_set_item(&config->sections, section, name, str.array);
+	config_set_user_item(config, section, name, str.array);
 }
 
 void config_set_bool(config_t *config, const char *section,
 		const char *name, bool value)
 {
 	char *str = bstrdup(value ? "true" : "false");
-	config_set_item(&config->sections, section, name, str);
+	config_set_user_item(config, section, name, str);
 }
 
 void config_set_double(config_t *config, const char *section,
@@ -537,7 +923,7 @@ void config_set_double(config_t *config, const char *section,
 {
 	char *str = bzalloc(64);
 	os_dtostr(value, str, 64);
-	config_set_item(&config->sections, section, name, str);
+	config_set_user_item(config, section, name, str);
 }
 
 void config_set_default_string(config_t *config, const char *section,
@@ -661,30 +1047,24 @@ double config_get_double(const config_t *config, const char *section,
 bool config_remove_value(config_t *config, const char *section,
 		const char *name)
 {
-	struct darray *sections = &config->sections;
-
-	for (size_t i = 0; i < sections->num; i++) {
-		struct config_section *sec = darray_item(
-				sizeof(struct config_section), sections, i);
+	struct config_section *sec = find_section(&config->sections, section);
+	size_t idx;
 
-		if (astrcmpi(sec->name, section) != 0)
-			continue;
+	if (!sec)
+		return false;
 
-		for (size_t j = 0; j < sec->items.num; j++) {
-			struct config_item *item = darray_item(
-					sizeof(struct config_item),
-					&sec->items, j);
+	idx = index_find(&sec->index, &sec->items, sizeof(struct config_item),
+			name);
+	if (idx == DARRAY_INVALID)
+		return false;
 
-			if (astrcmpi(item->name, name) == 0) {
-				config_item_free(item);
-				darray_erase(sizeof(struct config_item),
-						&sec->items, j);
-				return true;
-			}
-		}
-	}
+	config_item_free(darray_item(sizeof(struct config_item), &sec->items,
+				idx));
+	darray_erase(sizeof(struct config_item), &sec->items, idx);
+	index_rebuild(&sec->index, &sec->items, sizeof(struct config_item));
 
-	return false;
+	config->changed = true;
+	return true;
 }
 
 const char *config_get_default_string(const config_t *config,
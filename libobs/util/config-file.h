@@ -48,6 +48,21 @@ EXPORT int config_open_string(config_t **config, const char *str);
 EXPORT int config_save(config_t *config);
 EXPORT int config_save_safe(config_t *config, const char *temp_ext,
 		const char *backup_ext);
+
+/*
+ * Saves are skipped if no user values have changed since the config was
+ * opened or last saved.
+ *
+ * config_save_safe_async serializes the config on the calling thread and
+ * writes it out on a separate thread in the same way as config_save_safe.  A
+ * later save of the same file replaces any that have not been written yet.
+ * Call config_wait_saves before exiting to make sure all queued saves have
+ * been written.
+ */
+EXPORT int config_save_safe_async(config_t *config, const char *temp_ext,
+		const char *backup_ext);
+EXPORT void config_wait_saves(void);
+
 EXPORT void config_close(config_t *config);
 
 EXPORT size_t config_num_sections(config_t *config);
@@ -524,6 +524,100 @@ static inline void darray_swap(const size_t element_size,
 #define da_swap_item(v, idx1, idx2) \
 	darray_swap(sizeof(v.array), &v.da, idx1, idx2)
 
+/*
+ * Small dynamic arrays, which store up to N items inside the structure
+ * itself and only allocate once they outgrow it.  Meant for arrays that
+ * usually hold a handful of items but change often.
+ *
+ * DARRAY_SMALL(type, N) has the same array/num/capacity/da members as
+ * DARRAY(type), so the da_ macros that never grow or free the array (da_end,
+ * da_find, da_erase, da_erase_item, da_erase_range, da_pop_back,
+ * da_move_item, da_swap_item, and da_resize to a smaller size) can be used
+ * on it as is.  Everything else has to go through the da_small_ macros.
+ *
+ * While the items are inline, array points inside the structure, so a
+ * small array that isn't empty must not be copied or moved by value.  A
+ * zeroed small array is a valid empty one.
+ */
+
+static inline void darray_small_free(struct darray *dst, void *small_array)
+{
+	if (dst->array != small_array)
+		bfree(dst->array);
+	dst->array    = NULL;
+	dst->num      = 0;
+	dst->capacity = 0;
+}
+
+static inline void darray_small_ensure_capacity(const size_t element_size,
+		struct darray *dst, void *small_array,
+		const size_t small_capacity, const size_t new_size)
+{
+	size_t new_cap;
+	void *ptr;
+	if (new_size <= dst->capacity)
+		return;
+
+	if (!dst->capacity && new_size <= small_capacity) {
+		dst->array    = small_array;
+		dst->capacity = small_capacity;
+		return;
+	}
+
+	new_cap = (!dst->capacity) ? new_size : dst->capacity*2;
+	if (new_size > new_cap)
+		new_cap = new_size;
+	ptr = bmalloc(element_size*new_cap);
+	if (dst->num)
+		memcpy(ptr, dst->array, element_size*dst->num);
+	if (dst->array != small_array)
+		bfree(dst->array);
+	dst->array = ptr;
+	dst->capacity = new_cap;
+}
+
+#define DARRAY_SMALL(type, n)              \
+	struct {                           \
+		DARRAY(type);              \
+		type small_array[n];       \
+	}
+
+#define da_small_capacity(v) \
+	(sizeof(v.small_array) / sizeof(*v.small_array))
+
+/* once there's room, the regular darray functions don't reallocate */
+#define da_small_grow(v, size) \
+	darray_small_ensure_capacity(sizeof(*v.array), &v.da, v.small_array, \
+			da_small_capacity(v), size)
+
+#define da_small_init(v) darray_init(&v.da)
+
+#define da_small_free(v) darray_small_free(&v.da, v.small_array)
+
+#define da_small_reserve(v, capacity) da_small_grow(v, capacity)
+
+#define da_small_resize(v, size) \
+	(da_small_grow(v, size), da_resize(v, size))
+
+#define da_small_copy_array(dst, src_array, n) \
+	(da_small_grow(dst, n), da_copy_array(dst, src_array, n))
+
+#define da_small_push_back(v, item) \
+	(da_small_grow(v, v.num + 1), da_push_back(v, item))
+
+#define da_small_push_back_new(v) \
+	(da_small_grow(v, v.num + 1), da_push_back_new(v))
+
+#define da_small_push_back_array(dst, src_array, n) \
+	(da_small_grow(dst, dst.num + (n)), \
+	 da_push_back_array(dst, src_array, n))
+
+#define da_small_insert(v, idx, item) \
+	(da_small_grow(v, v.num + 1), da_insert(v, idx, item))
+
+#define da_small_insert_new(v, idx) \
+	(da_small_grow(v, v.num + 1), da_insert_new(v, idx))
+
 #ifdef __cplusplus
 }
 #endif
@@ -14,7 +14,20 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#elif defined(__APPLE__) || defined(__linux__)
+#include <fcntl.h>
+#endif
+
 #include "dstr.h"
+#include "circlebuf.h"
+#include "threading.h"
 #include "file-serializer.h"
 #include "platform.h"
 
@@ -172,3 +185,311 @@ void file_output_serializer_free(struct serializer *s)
 		bfree(out);
 	}
 }
+
+/* ------------------------------------------------------------------------- */
+
+#define BUFFERED_WRITE_CHUNK_SIZE (1024 * 1024)
+
+struct buffered_file_output_data {
+	FILE                    *file;
+	pthread_t               thread;
+	pthread_mutex_t         mutex;
+	os_event_t              *data_event;
+	os_event_t              *space_event;
+
+	struct circlebuf        buffer;
+	size_t                  buffer_size;
+	uint8_t                 *chunk;
+	int64_t                 pos;
+	bool                    writing;
+	bool                    stop;
+	bool                    failed;
+
+	size_t                  high_watermark;
+	bool                    above_watermark;
+	file_output_watermark_t watermark_callback;
+	void                    *watermark_param;
+};
+
+/* reserves space on disk without changing the file size, so a file that is
+ * not filled up completely doesn't need to be truncated afterwards */
+static void preallocate_file(FILE *file, uint64_t size)
+{
+#ifdef _WIN32
+	FILE_ALLOCATION_INFO info;
+	HANDLE handle = (HANDLE)_get_osfhandle(_fileno(file));
+
+	info.AllocationSize.QuadPart = (LONGLONG)size;
+	SetFileInformationByHandle(handle, FileAllocationInfo, &info,
+			sizeof(info));
+#elif defined(__APPLE__)
+	fstore_t store = {
+		.fst_flags   = F_ALLOCATECONTIG,
+		.fst_posmode = F_PEOFPOSMODE,
+		.fst_length  = (off_t)size
+	};
+
+	if (fcntl(fileno(file), F_PREALLOCATE, &store) == -1) {
+		store.fst_flags = F_ALLOCATEALL;
+		fcntl(fileno(file), F_PREALLOCATE, &store);
+	}
+#elif defined(__linux__)
+	fallocate(fileno(file), FALLOC_FL_KEEP_SIZE, 0, (off_t)size);
+#else
+	UNUSED_PARAMETER(file);
+	UNUSED_PARAMETER(size);
+#endif
+}
+
+static inline void check_watermark(struct buffered_file_output_data *out,
+		bool *notify, bool *full)
+{
+	if (!out->high_watermark || !out->watermark_callback)
+		return;
+
+	if (!out->above_watermark && out->buffer.size >= out->high_watermark) {
+		out->above_watermark = true;
+		*notify = true;
+		*full = true;
+
+	} else if (out->above_watermark &&
+	           out->buffer.size < out->high_watermark / 2) {
+		out->above_watermark = false;
+		*notify = true;
+		*full = false;
+	}
+}
+
+static void *buffered_file_output_thread(void *data)
+{
+	struct buffered_file_output_data *out = data;
+
+	os_set_thread_name("buffered file output");
+
+	for (;;) {
+		bool notify = false;
+		bool full = false;
+		bool stop;
+		size_t size;
+
+		pthread_mutex_lock(&out->mutex);
+
+		size = out->buffer.size;
+		if (size > BUFFERED_WRITE_CHUNK_SIZE)
+			size = BUFFERED_WRITE_CHUNK_SIZE;
+
+		if (size)
+			circlebuf_pop_front(&out->buffer, out->chunk, size);
+
+		out->writing = size != 0;
+		stop = out->stop;
+		check_watermark(out, &notify, &full);
+
+		pthread_mutex_unlock(&out->mutex);
+
+		os_event_signal(out->space_event);
+
+		if (notify)
+			out->watermark_callback(out->watermark_param, full);
+
+		if (!size) {
+			if (stop)
+				break;
+
+			os_event_wait(out->data_event);
+			continue;
+		}
+
+		if (fwrite(out->chunk, 1, size, out->file) != size) {
+			pthread_mutex_lock(&out->mutex);
+			out->failed = true;
+			pthread_mutex_unlock(&out->mutex);
+		}
+	}
+
+	return NULL;
+}
+
+static size_t buffered_file_output_write(void *sdata, const void *data,
+		size_t size)
+{
+	struct buffered_file_output_data *out = sdata;
+	const uint8_t *bytes = data;
+	size_t total = size;
+
+	while (size) {
+		bool notify = false;
+		bool full = false;
+		size_t space;
+
+		pthread_mutex_lock(&out->mutex);
+
+		if (out->failed) {
+			pthread_mutex_unlock(&out->mutex);
+			return total - size;
+		}
+
+		space = out->buffer_size - out->buffer.size;
+		if (space > size)
+			space = size;
+
+		if (space) {
+			circlebuf_push_back(&out->buffer, bytes, space);
+			check_watermark(out, &notify, &full);
+		}
+
+		pthread_mutex_unlock(&out->mutex);
+
+		if (notify)
+			out->watermark_callback(out->watermark_param, full);
+
+		if (!space) {
+			os_event_wait(out->space_event);
+			continue;
+		}
+
+		os_event_signal(out->data_event);
+		out->pos += space;
+		bytes += space;
+		size -= space;
+	}
+
+	return total;
+}
+
+/* waits until the writer thread has written everything and gone idle */
+static void buffered_file_output_flush(struct buffered_file_output_data *out)
+{
+	for (;;) {
+		bool idle;
+
+		pthread_mutex_lock(&out->mutex);
+		idle = !out->buffer.size && !out->writing;
+		pthread_mutex_unlock(&out->mutex);
+
+		if (idle)
+			break;
+
+		os_event_signal(out->data_event);
+		os_event_wait(out->space_event);
+	}
+}
+
+static int64_t buffered_file_output_seek(void *sdata, int64_t offset,
+		enum serialize_seek_type seek_type)
+{
+	struct buffered_file_output_data *out = sdata;
+
+	buffered_file_output_flush(out);
+
+	/* the writer thread is idle until more data is pushed, so the file
+	 * can be used directly from here */
+	out->pos = file_input_seek(out->file, offset, seek_type);
+	return out->pos;
+}
+
+static int64_t buffered_file_output_get_pos(void *sdata)
+{
+	struct buffered_file_output_data *out = sdata;
+	return out->pos;
+}
+
+static void buffered_file_output_data_free(
+		struct buffered_file_output_data *out)
+{
+	pthread_mutex_destroy(&out->mutex);
+	os_event_destroy(out->data_event);
+	os_event_destroy(out->space_event);
+	circlebuf_free(&out->buffer);
+	bfree(out->chunk);
+	bfree(out);
+}
+
+bool buffered_file_output_serializer_init(struct serializer *s,
+		const char *path, size_t buffer_size, uint64_t prealloc_size)
+{
+	struct buffered_file_output_data *out;
+	FILE *file;
+
+	file = os_fopen(path, "wb");
+	if (!file)
+		return false;
+
+	if (prealloc_size)
+		preallocate_file(file, prealloc_size);
+
+	if (buffer_size < BUFFERED_WRITE_CHUNK_SIZE)
+		buffer_size = BUFFERED_WRITE_CHUNK_SIZE;
+
+	out = bzalloc(sizeof(*out));
+	out->file = file;
+	out->buffer_size = buffer_size;
+	out->chunk = bmalloc(BUFFERED_WRITE_CHUNK_SIZE);
+	circlebuf_reserve(&out->buffer, buffer_size);
+	pthread_mutex_init_value(&out->mutex);
+
+	if (pthread_mutex_init(&out->mutex, NULL) != 0)
+		goto fail;
+	if (os_event_init(&out->data_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+	if (os_event_init(&out->space_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+	if (pthread_create(&out->thread, NULL, buffered_file_output_thread,
+				out) != 0)
+		goto fail;
+
+	s->data = out;
+	s->read = NULL;
+	s->write = buffered_file_output_write;
+	s->seek = buffered_file_output_seek;
+	s->get_pos = buffered_file_output_get_pos;
+	return true;
+
+fail:
+	fclose(file);
+	buffered_file_output_data_free(out);
+	return false;
+}
+
+void buffered_file_output_serializer_set_watermark(struct serializer *s,
+		size_t high_watermark, file_output_watermark_t callback,
+		void *param)
+{
+	struct buffered_file_output_data *out = s->data;
+
+	pthread_mutex_lock(&out->mutex);
+	out->high_watermark = high_watermark;
+	out->watermark_callback = callback;
+	out->watermark_param = param;
+	pthread_mutex_unlock(&out->mutex);
+}
+
+bool buffered_file_output_serializer_failed(struct serializer *s)
+{
+	struct buffered_file_output_data *out = s->data;
+	bool failed;
+
+	pthread_mutex_lock(&out->mutex);
+	failed = out->failed;
+	pthread_mutex_unlock(&out->mutex);
+
+	return failed;
+}
+
+void buffered_file_output_serializer_free(struct serializer *s)
+{
+	struct buffered_file_output_data *out = s->data;
+
+	if (out) {
+		pthread_mutex_lock(&out->mutex);
+		out->stop = true;
+		pthread_mutex_unlock(&out->mutex);
+
+		os_event_signal(out->data_event);
+		pthread_join(out->thread, NULL);
+
+		fclose(out->file);
+		buffered_file_output_data_free(out);
+		s->data = NULL;
+	}
+}
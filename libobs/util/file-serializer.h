@@ -25,3 +25,25 @@ EXPORT bool file_output_serializer_init(struct serializer *s, const char *path);
 EXPORT bool file_output_serializer_init_safe(struct serializer *s,
 		const char *path, const char *temp_ext);
 EXPORT void file_output_serializer_free(struct serializer *s);
+
+/*
+ * Buffered file output.  Writes are copied into a RAM buffer of up to
+ * buffer_size bytes and written to disk in large sequential chunks from a
+ * separate thread, so the writing thread only blocks when the buffer is
+ * full.  If prealloc_size is non-zero, that much disk space is reserved up
+ * front without changing the size of the file.  Seeking waits for all
+ * buffered data to be written first.
+ *
+ * The watermark callback is called with full = true once the buffered data
+ * reaches high_watermark bytes, and with full = false once it drains below
+ * half of that again.  It can be called from either thread.
+ */
+typedef void (*file_output_watermark_t)(void *param, bool full);
+
+EXPORT bool buffered_file_output_serializer_init(struct serializer *s,
+		const char *path, size_t buffer_size, uint64_t prealloc_size);
+EXPORT void buffered_file_output_serializer_set_watermark(
+		struct serializer *s, size_t high_watermark,
+		file_output_watermark_t callback, void *param);
+EXPORT bool buffered_file_output_serializer_failed(struct serializer *s);
+EXPORT void buffered_file_output_serializer_free(struct serializer *s);
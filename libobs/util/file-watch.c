@@ -0,0 +1,574 @@
+/*
+ * Copyright (c) 2015 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/inotify.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string.h>
+
+#include "file-watch.h"
+#include "threading.h"
+#include "platform.h"
+#include "darray.h"
+#include "bmem.h"
+#include "base.h"
+
+/* files that can't be watched through the OS are checked this often */
+#define POLL_INTERVAL_MS 1000
+#define POLL_INTERVAL_NS (POLL_INTERVAL_MS * 1000000ULL)
+
+struct file_info {
+	bool    exists;
+	int64_t size;
+	int64_t mtime;
+};
+
+struct watch_dir {
+	char             *path;
+	long             refs;
+	bool             notify;
+#if defined(_WIN32)
+	HANDLE           handle;
+#elif defined(__linux__)
+	int              wd;
+#endif
+};
+
+struct os_file_watch {
+	char               *path;
+	const char         *name;
+	struct watch_dir   *dir;
+	struct file_info   info;
+	bool               dirty;
+
+	os_file_watch_cb_t callback;
+	void               *param;
+};
+
+/* thread_mutex serializes starting and stopping the thread, watch_mutex
+ * protects the watch and directory lists and is the only one the thread
+ * takes */
+static pthread_mutex_t thread_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t watch_mutex  = PTHREAD_MUTEX_INITIALIZER;
+
+static DARRAY(struct os_file_watch*) watches;
+static DARRAY(struct watch_dir*)     dirs;
+
+static pthread_t     watch_thread;
+static bool          thread_active = false;
+static volatile bool stop_thread   = false;
+
+/* ------------------------------------------------------------------------- */
+
+#if defined(_WIN32)
+
+static HANDLE wake_event = NULL;
+
+/* handles being waited on can't be closed from another thread, so closing is
+ * left to the watch thread */
+static DARRAY(HANDLE) retired_handles;
+
+static void get_file_info(const char *path, struct file_info *info)
+{
+	struct _stat64 st;
+	wchar_t *wpath = NULL;
+
+	os_utf8_to_wcs_ptr(path, 0, &wpath);
+	info->exists = wpath && _wstat64(wpath, &st) == 0;
+	info->size   = info->exists ? (int64_t)st.st_size : 0;
+	info->mtime  = info->exists ? (int64_t)st.st_mtime : 0;
+	bfree(wpath);
+}
+
+static bool backend_init(void)
+{
+	wake_event = CreateEvent(NULL, false, false, NULL);
+	return wake_event != NULL;
+}
+
+static void backend_free(void)
+{
+	for (size_t i = 0; i < retired_handles.num; i++)
+		FindCloseChangeNotification(retired_handles.array[i]);
+	da_free(retired_handles);
+
+	CloseHandle(wake_event);
+	wake_event = NULL;
+}
+
+static void backend_wake(void)
+{
+	SetEvent(wake_event);
+}
+
+static size_t count_notify_dirs(void)
+{
+	size_t count = 0;
+
+	for (size_t i = 0; i < dirs.num; i++)
+		if (dirs.array[i]->notify)
+			count++;
+	return count;
+}
+
+static void dir_watch_start(struct watch_dir *dir)
+{
+	const DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME |
+	                     FILE_NOTIFY_CHANGE_SIZE |
+	                     FILE_NOTIFY_CHANGE_LAST_WRITE;
+	wchar_t *wpath = NULL;
+
+	/* one wait slot is taken by the wake event, any directory past the
+	 * limit is polled */
+	if (count_notify_dirs() >= MAXIMUM_WAIT_OBJECTS - 1)
+		return;
+
+	os_utf8_to_wcs_ptr(dir->path, 0, &wpath);
+	if (wpath) {
+		dir->handle = FindFirstChangeNotificationW(wpath, false,
+				filter);
+		dir->notify = dir->handle != INVALID_HANDLE_VALUE;
+		bfree(wpath);
+	}
+
+	if (dir->notify)
+		backend_wake();
+}
+
+static void dir_watch_stop(struct watch_dir *dir)
+{
+	if (dir->notify) {
+		da_push_back(retired_handles, &dir->handle);
+		backend_wake();
+	}
+}
+
+static void mark_dir_dirty(struct watch_dir *dir)
+{
+	for (size_t i = 0; i < watches.num; i++)
+		if (watches.array[i]->dir == dir)
+			watches.array[i]->dirty = true;
+}
+
+static void wait_for_changes(void)
+{
+	HANDLE handles[MAXIMUM_WAIT_OBJECTS];
+	struct watch_dir *wait_dirs[MAXIMUM_WAIT_OBJECTS];
+	DWORD count = 0;
+	DWORD ret;
+
+	pthread_mutex_lock(&watch_mutex);
+
+	for (size_t i = 0; i < retired_handles.num; i++)
+		FindCloseChangeNotification(retired_handles.array[i]);
+	da_resize(retired_handles, 0);
+
+	handles[count++] = wake_event;
+	for (size_t i = 0; i < dirs.num; i++) {
+		struct watch_dir *dir = dirs.array[i];
+
+		if (dir->notify && count < MAXIMUM_WAIT_OBJECTS) {
+			wait_dirs[count] = dir;
+			handles[count++] = dir->handle;
+		}
+	}
+
+	pthread_mutex_unlock(&watch_mutex);
+
+	ret = WaitForMultipleObjects(count, handles, false, POLL_INTERVAL_MS);
+	if (ret <= WAIT_OBJECT_0 || ret >= WAIT_OBJECT_0 + count)
+		return;
+
+	/* a directory may have been released while waiting, but it's only
+	 * compared against, never dereferenced */
+	pthread_mutex_lock(&watch_mutex);
+	for (DWORD i = ret - WAIT_OBJECT_0; i < count; i++) {
+		if (i == ret - WAIT_OBJECT_0 ||
+		    WaitForSingleObject(handles[i], 0) == WAIT_OBJECT_0) {
+			FindNextChangeNotification(handles[i]);
+			mark_dir_dirty(wait_dirs[i]);
+		}
+	}
+	pthread_mutex_unlock(&watch_mutex);
+}
+
+#elif defined(__linux__)
+
+static int inotify_fd = -1;
+static int wake_pipe[2] = {-1, -1};
+
+static void get_file_info(const char *path, struct file_info *info)
+{
+	struct stat st;
+
+	info->exists = stat(path, &st) == 0;
+	info->size   = info->exists ? (int64_t)st.st_size : 0;
+	info->mtime  = info->exists ? (int64_t)st.st_mtime : 0;
+}
+
+static bool backend_init(void)
+{
+	inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotify_fd == -1)
+		return false;
+
+	if (pipe(wake_pipe) == -1) {
+		close(inotify_fd);
+		inotify_fd = -1;
+		return false;
+	}
+
+	fcntl(wake_pipe[0], F_SETFL, O_NONBLOCK);
+	return true;
+}
+
+static void backend_free(void)
+{
+	close(inotify_fd);
+	close(wake_pipe[0]);
+	close(wake_pipe[1]);
+	inotify_fd = -1;
+	wake_pipe[0] = wake_pipe[1] = -1;
+}
+
+static void backend_wake(void)
+{
+	char c = 0;
+	if (write(wake_pipe[1], &c, 1) != 1)
+		blog(LOG_DEBUG, "file watch: Failed to wake watch thread");
+}
+
+static void dir_watch_start(struct watch_dir *dir)
+{
+	/* editors often save by renaming a new file over the old one, so the
+	 * directory is watched rather than the file itself */
+	const uint32_t mask = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB |
+	                      IN_CREATE | IN_DELETE |
+	                      IN_MOVED_FROM | IN_MOVED_TO;
+
+	dir->wd = inotify_add_watch(inotify_fd, dir->path, mask);
+	dir->notify = dir->wd != -1;
+}
+
+static void dir_watch_stop(struct watch_dir *dir)
+{
+	if (dir->notify)
+		inotify_rm_watch(inotify_fd, dir->wd);
+}
+
+static void mark_dirty(const struct inotify_event *event)
+{
+	for (size_t i = 0; i < watches.num; i++) {
+		struct os_file_watch *watch = watches.array[i];
+
+		if (!watch->dir->notify || watch->dir->wd != event->wd)
+			continue;
+
+		/* the directory itself went away, fall back to polling */
+		if (event->mask & IN_IGNORED) {
+			watch->dir->notify = false;
+			watch->dirty = true;
+
+		} else if (!event->len ||
+		           strcmp(watch->name, event->name) == 0) {
+			watch->dirty = true;
+		}
+	}
+}
+
+static void wait_for_changes(void)
+{
+	char buf[4096]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+	struct pollfd fds[2] = {
+		{.fd = inotify_fd,   .events = POLLIN},
+		{.fd = wake_pipe[0], .events = POLLIN}
+	};
+	ssize_t len;
+
+	if (poll(fds, 2, POLL_INTERVAL_MS) <= 0)
+		return;
+
+	while (read(wake_pipe[0], buf, sizeof(buf)) > 0);
+
+	pthread_mutex_lock(&watch_mutex);
+
+	while ((len = read(inotify_fd, buf, sizeof(buf))) > 0) {
+		for (char *p = buf; p < buf + len;) {
+			struct inotify_event *event = (struct inotify_event*)p;
+			mark_dirty(event);
+			p += sizeof(struct inotify_event) + event->len;
+		}
+	}
+
+	pthread_mutex_unlock(&watch_mutex);
+}
+
+#else
+
+static os_event_t *wake_event = NULL;
+
+static void get_file_info(const char *path, struct file_info *info)
+{
+	struct stat st;
+
+	info->exists = stat(path, &st) == 0;
+	info->size   = info->exists ? (int64_t)st.st_size : 0;
+	info->mtime  = info->exists ? (int64_t)st.st_mtime : 0;
+}
+
+static bool backend_init(void)
+{
+	return os_event_init(&wake_event, OS_EVENT_TYPE_AUTO) == 0;
+}
+
+static void backend_free(void)
+{
+	os_event_destroy(wake_event);
+	wake_event = NULL;
+}
+
+static void backend_wake(void)
+{
+	os_event_signal(wake_event);
+}
+
+/* no notification backend here yet, everything is polled */
+static void dir_watch_start(struct watch_dir *dir)
+{
+	dir->notify = false;
+}
+
+static void dir_watch_stop(struct watch_dir *dir)
+{
+	UNUSED_PARAMETER(dir);
+}
+
+static void wait_for_changes(void)
+{
+	os_event_timedwait(wake_event, POLL_INTERVAL_MS);
+}
+
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+static inline bool file_info_changed(const struct file_info *a,
+		const struct file_info *b)
+{
+	return a->exists != b->exists || a->size != b->size ||
+	       a->mtime != b->mtime;
+}
+
+static void check_watch(struct os_file_watch *watch)
+{
+	struct file_info info;
+
+	get_file_info(watch->path, &info);
+
+	if (file_info_changed(&watch->info, &info)) {
+		watch->info = info;
+		watch->callback(watch->param, watch->path);
+	}
+}
+
+static void *file_watch_thread(void *unused)
+{
+	uint64_t last_poll = os_gettime_ns();
+
+	os_set_thread_name("libobs: file watch thread");
+
+	while (!stop_thread) {
+		uint64_t now;
+		bool poll_all;
+
+		wait_for_changes();
+		if (stop_thread)
+			break;
+
+		now = os_gettime_ns();
+		poll_all = now - last_poll >= POLL_INTERVAL_NS;
+		if (poll_all)
+			last_poll = now;
+
+		pthread_mutex_lock(&watch_mutex);
+
+		for (size_t i = 0; i < watches.num; i++) {
+			struct os_file_watch *watch = watches.array[i];
+
+			if (watch->dirty || (poll_all && !watch->dir->notify)) {
+				watch->dirty = false;
+				check_watch(watch);
+			}
+		}
+
+		pthread_mutex_unlock(&watch_mutex);
+	}
+
+	UNUSED_PARAMETER(unused);
+	return NULL;
+}
+
+static bool start_thread(void)
+{
+	if (!backend_init()) {
+		blog(LOG_WARNING, "file watch: Failed to initialize");
+		return false;
+	}
+
+	stop_thread = false;
+	if (pthread_create(&watch_thread, NULL, file_watch_thread, NULL) != 0) {
+		blog(LOG_WARNING, "file watch: Failed to create thread");
+		backend_free();
+		return false;
+	}
+
+	return true;
+}
+
+static void end_thread(void)
+{
+	stop_thread = true;
+	backend_wake();
+	pthread_join(watch_thread, NULL);
+	backend_free();
+}
+
+/* ------------------------------------------------------------------------- */
+
+static char *get_dir_path(const char *path, const char **name)
+{
+	const char *slash = strrchr(path, '/');
+#ifdef _WIN32
+	const char *backslash = strrchr(path, '\\');
+	if (!slash || (backslash && backslash > slash))
+		slash = backslash;
+#endif
+
+	if (!slash) {
+		*name = path;
+		return bstrdup(".");
+	}
+
+	*name = slash + 1;
+	return slash == path ? bstrdup("/") : bstrdup_n(path, slash - path);
+}
+
+static struct watch_dir *get_dir(const char *path)
+{
+	struct watch_dir *dir;
+
+	for (size_t i = 0; i < dirs.num; i++) {
+		dir = dirs.array[i];
+
+		if (strcmp(dir->path, path) == 0) {
+			dir->refs++;
+			return dir;
+		}
+	}
+
+	dir = bzalloc(sizeof(struct watch_dir));
+	dir->path = bstrdup(path);
+	dir->refs = 1;
+	dir_watch_start(dir);
+
+	da_push_back(dirs, &dir);
+	return dir;
+}
+
+static void release_dir(struct watch_dir *dir)
+{
+	if (--dir->refs > 0)
+		return;
+
+	dir_watch_stop(dir);
+	da_erase_item(dirs, &dir);
+	bfree(dir->path);
+	bfree(dir);
+}
+
+os_file_watch_t *os_file_watch_add(const char *path,
+		os_file_watch_cb_t callback, void *param)
+{
+	struct os_file_watch *watch;
+	char *dir_path;
+
+	if (!path || !*path || !callback)
+		return NULL;
+
+	pthread_mutex_lock(&thread_mutex);
+
+	if (!thread_active)
+		thread_active = start_thread();
+	if (!thread_active) {
+		pthread_mutex_unlock(&thread_mutex);
+		return NULL;
+	}
+
+	watch = bzalloc(sizeof(struct os_file_watch));
+	watch->path     = bstrdup(path);
+	watch->callback = callback;
+	watch->param    = param;
+	get_file_info(watch->path, &watch->info);
+
+	dir_path = get_dir_path(watch->path, &watch->name);
+
+	pthread_mutex_lock(&watch_mutex);
+	watch->dir = get_dir(dir_path);
+	da_push_back(watches, &watch);
+	pthread_mutex_unlock(&watch_mutex);
+
+	pthread_mutex_unlock(&thread_mutex);
+
+	bfree(dir_path);
+	return watch;
+}
+
+void os_file_watch_remove(os_file_watch_t *watch)
+{
+	bool last;
+
+	if (!watch)
+		return;
+
+	pthread_mutex_lock(&thread_mutex);
+
+	pthread_mutex_lock(&watch_mutex);
+	da_erase_item(watches, &watch);
+	release_dir(watch->dir);
+	last = watches.num == 0;
+	pthread_mutex_unlock(&watch_mutex);
+
+	if (last) {
+		end_thread();
+		da_free(watches);
+		da_free(dirs);
+		thread_active = false;
+	}
+
+	pthread_mutex_unlock(&thread_mutex);
+
+	bfree(watch->path);
+	bfree(watch);
+}
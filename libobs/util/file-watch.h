@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2015 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "c99defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Watches files for changes, so that callers don't have to keep polling them
+ * with stat.  All watches are checked from one shared thread: with inotify on
+ * linux, directory change notifications on windows, and elsewhere by checking
+ * the files once a second.  The callback is called from that thread whenever
+ * the file's size or modification time changes, or it is created or removed.
+ *
+ * The callback is called with the watch list locked, so it should only note
+ * the change and must not add or remove watches.  Once os_file_watch_remove
+ * has returned, the callback is not called anymore.
+ */
+
+struct os_file_watch;
+typedef struct os_file_watch os_file_watch_t;
+
+typedef void (*os_file_watch_cb_t)(void *param, const char *path);
+
+EXPORT os_file_watch_t *os_file_watch_add(const char *path,
+		os_file_watch_cb_t callback, void *param);
+EXPORT void os_file_watch_remove(os_file_watch_t *watch);
+
+#ifdef __cplusplus
+}
+#endif
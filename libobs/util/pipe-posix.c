@@ -15,6 +15,7 @@
  */
 
 #include <stdio.h>
+#include <poll.h>
 #include <sys/wait.h>
 
 #include "bmem.h"
@@ -85,3 +86,23 @@ size_t os_process_pipe_write(os_process_pipe_t *pp, const uint8_t *data,
 
 	return fwrite(data, 1, len, pp->file);
 }
+
+bool os_process_pipe_alive(os_process_pipe_t *pp)
+{
+	struct pollfd pfd = {0};
+
+	if (!pp) {
+		return false;
+	}
+
+	/* popen doesn't give the pid, but the pipe is closed along with the
+	 * process */
+	pfd.fd = fileno(pp->file);
+	pfd.events = pp->read_pipe ? POLLIN : POLLOUT;
+
+	if (poll(&pfd, 1, 0) < 0) {
+		return true;
+	}
+
+	return (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) == 0;
+}
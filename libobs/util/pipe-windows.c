@@ -179,3 +179,12 @@ size_t os_process_pipe_write(os_process_pipe_t *pp, const uint8_t *data,
 
 	return 0;
 }
+
+bool os_process_pipe_alive(os_process_pipe_t *pp)
+{
+	if (!pp) {
+		return false;
+	}
+
+	return WaitForSingleObject(pp->process, 0) == WAIT_TIMEOUT;
+}
@@ -29,3 +29,6 @@ EXPORT size_t os_process_pipe_read(os_process_pipe_t *pp, uint8_t *data,
 		size_t len);
 EXPORT size_t os_process_pipe_write(os_process_pipe_t *pp, const uint8_t *data,
 		size_t len);
+
+/** Returns false once the process has exited or closed its end of the pipe */
+EXPORT bool os_process_pipe_alive(os_process_pipe_t *pp);
@@ -22,9 +22,11 @@
 #include <dlfcn.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/time.h>
 
 #include <CoreServices/CoreServices.h>
 #include <mach/mach.h>
+#include <pthread.h>
 #include <mach/mach_time.h>
 
 #include <IOKit/pwr_mgt/IOPMLib.h>
@@ -69,6 +71,14 @@ uint64_t os_gettime_ns(void)
 	return f();
 }
 
+uint64_t os_get_epoch_ns(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000000ULL +
+		(uint64_t)tv.tv_usec * 1000ULL;
+}
+
 /* gets the location ~/Library/Application Support/[name] */
 int os_get_config_path(char *dst, size_t size, const char *name)
 {
@@ -205,6 +215,44 @@ void os_cpu_usage_info_destroy(os_cpu_usage_info_t *info)
 		bfree(info);
 }
 
+uint64_t os_thread_cpu_self(void)
+{
+	return (uint64_t)pthread_mach_thread_np(pthread_self());
+}
+
+/* the send right keeps the port name from being reused by another thread
+ * while this one is registered */
+uint64_t os_thread_cpu_open(uint64_t id)
+{
+	UNUSED_PARAMETER(id);
+	return (uint64_t)mach_thread_self();
+}
+
+bool os_thread_cpu_time(uint64_t id, uint64_t handle, uint64_t *cpu_time_ns)
+{
+	thread_basic_info_data_t info;
+	mach_msg_type_number_t   count = THREAD_BASIC_INFO_COUNT;
+	kern_return_t            kern_ret;
+	time_value_t             cur_time;
+
+	kern_ret = thread_info((thread_act_t)handle, THREAD_BASIC_INFO,
+			(thread_info_t)&info, &count);
+	if (kern_ret != KERN_SUCCESS)
+		return false;
+
+	add_time_value(&cur_time, &info.user_time, &info.system_time);
+	*cpu_time_ns = (uint64_t)cur_time.seconds * 1000000000ULL +
+		(uint64_t)cur_time.microseconds * 1000ULL;
+
+	UNUSED_PARAMETER(id);
+	return true;
+}
+
+void os_thread_cpu_close(uint64_t handle)
+{
+	mach_port_deallocate(mach_task_self(), (mach_port_t)handle);
+}
+
 os_performance_token_t *os_request_high_performance(const char *reason)
 {
 	@autoreleasepool {
@@ -29,6 +29,9 @@
 
 #if !defined(__APPLE__)
 #include <sys/times.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
 #include <sys/wait.h>
 #include <signal.h>
 #include <spawn.h>
@@ -121,8 +124,93 @@ void os_cpu_usage_info_destroy(os_cpu_usage_info_t *info)
 		bfree(info);
 }
 
+#if defined(__linux__)
+
+uint64_t os_thread_cpu_self(void)
+{
+	return (uint64_t)syscall(SYS_gettid);
+}
+
+uint64_t os_thread_cpu_open(uint64_t id)
+{
+	return id;
+}
+
+/* utime and stime are the 14th and 15th fields of the thread's stat.  the
+ * command name before them can contain spaces and parentheses itself, so
+ * start after its last closing parenthesis. */
+bool os_thread_cpu_time(uint64_t id, uint64_t handle, uint64_t *cpu_time_ns)
+{
+	char          path[64];
+	char          buf[512];
+	unsigned long utime, stime;
+	long          ticks = sysconf(_SC_CLK_TCK);
+	const char    *fields;
+	size_t        len;
+	FILE          *f;
+
+	snprintf(path, sizeof(path), "/proc/self/task/%llu/stat",
+			(unsigned long long)id);
+
+	f = fopen(path, "r");
+	if (!f)
+		return false;
+
+	len = fread(buf, 1, sizeof(buf) - 1, f);
+	fclose(f);
+	buf[len] = 0;
+
+	fields = strrchr(buf, ')');
+	if (!fields || ticks <= 0)
+		return false;
+
+	if (sscanf(fields + 1, " %*c %*d %*d %*d %*d %*d %*u "
+				"%*u %*u %*u %*u %lu %lu",
+				&utime, &stime) != 2)
+		return false;
+
+	*cpu_time_ns = (uint64_t)(utime + stime) * 1000000000ULL /
+		(uint64_t)ticks;
+
+	UNUSED_PARAMETER(handle);
+	return true;
+}
+
+#else
+
+uint64_t os_thread_cpu_self(void)
+{
+	return 0;
+}
+
+uint64_t os_thread_cpu_open(uint64_t id)
+{
+	return id;
+}
+
+bool os_thread_cpu_time(uint64_t id, uint64_t handle, uint64_t *cpu_time_ns)
+{
+	UNUSED_PARAMETER(id);
+	UNUSED_PARAMETER(handle);
+	UNUSED_PARAMETER(cpu_time_ns);
+	return false;
+}
+
 #endif
 
+void os_thread_cpu_close(uint64_t handle)
+{
+	UNUSED_PARAMETER(handle);
+}
+
+#endif
+
+int os_get_logical_cores(void)
+{
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	return cores > 0 ? (int)cores : 1;
+}
+
 bool os_sleepto_ns(uint64_t time_target)
 {
 	uint64_t current = os_gettime_ns();
@@ -159,6 +247,13 @@ uint64_t os_gettime_ns(void)
 	return ((uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec);
 }
 
+uint64_t os_get_epoch_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ((uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec);
+}
+
 /* should return $HOME/.[name], or when using XDG,
  * should return $HOME/.config/[name] as default */
 int os_get_config_path(char *dst, size_t size, const char *name)
@@ -160,6 +160,54 @@ void os_cpu_usage_info_destroy(os_cpu_usage_info_t *info)
 		bfree(info);
 }
 
+uint64_t os_thread_cpu_self(void)
+{
+	return (uint64_t)GetCurrentThreadId();
+}
+
+/* the open handle keeps the thread id from being reused while the thread is
+ * registered */
+uint64_t os_thread_cpu_open(uint64_t id)
+{
+	HANDLE thread = OpenThread(THREAD_QUERY_LIMITED_INFORMATION, FALSE,
+			(DWORD)id);
+	return (uint64_t)(uintptr_t)thread;
+}
+
+bool os_thread_cpu_time(uint64_t id, uint64_t handle, uint64_t *cpu_time_ns)
+{
+	HANDLE          thread = (HANDLE)(uintptr_t)handle;
+	union time_data kernel_time, user_time;
+	FILETIME        dummy;
+	DWORD           exit_code;
+
+	if (!thread)
+		return false;
+	if (!GetExitCodeThread(thread, &exit_code) || exit_code != STILL_ACTIVE)
+		return false;
+	if (!GetThreadTimes(thread, &dummy, &dummy, &kernel_time.ft,
+				&user_time.ft))
+		return false;
+
+	*cpu_time_ns = (kernel_time.val + user_time.val) * 100;
+
+	UNUSED_PARAMETER(id);
+	return true;
+}
+
+void os_thread_cpu_close(uint64_t handle)
+{
+	if (handle)
+		CloseHandle((HANDLE)(uintptr_t)handle);
+}
+
+int os_get_logical_cores(void)
+{
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	return (int)si.dwNumberOfProcessors;
+}
+
 bool os_sleepto_ns(uint64_t time_target)
 {
 	uint64_t t = os_gettime_ns();
@@ -207,6 +255,20 @@ uint64_t os_gettime_ns(void)
 	return (uint64_t)time_val;
 }
 
+/* FILETIME counts 100 ns intervals since 1601 */
+#define EPOCH_FILETIME 116444736000000000ULL
+
+uint64_t os_get_epoch_ns(void)
+{
+	FILETIME       ft;
+	ULARGE_INTEGER val;
+
+	GetSystemTimeAsFileTime(&ft);
+	val.LowPart  = ft.dwLowDateTime;
+	val.HighPart = ft.dwHighDateTime;
+	return (val.QuadPart - EPOCH_FILETIME) * 100;
+}
+
 /* returns %appdata%\[name] on windows */
 int os_get_config_path(char *dst, size_t size, const char *name)
 {
@@ -24,6 +24,8 @@
 #include "bmem.h"
 #include "utf8.h"
 #include "dstr.h"
+#include "darray.h"
+#include "threading.h"
 
 FILE *os_wfopen(const wchar_t *path, const char *mode)
 {
@@ -590,3 +592,217 @@ int os_mkdirs(const char *dir)
 	dstr_free(&dir_str);
 	return ret;
 }
+
+/* ------------------------------------------------------------------------- */
+/* per-thread cpu accounting */
+
+/* implemented in the platform files.  id identifies the thread, handle is
+ * what is needed to sample it; on most platforms they are the same. */
+extern uint64_t os_thread_cpu_self(void);
+extern uint64_t os_thread_cpu_open(uint64_t id);
+extern bool     os_thread_cpu_time(uint64_t id, uint64_t handle,
+		uint64_t *cpu_time_ns);
+extern void     os_thread_cpu_close(uint64_t handle);
+
+struct thread_cpu_entry {
+	uint64_t serial;
+	uint64_t id;
+	uint64_t handle;
+	uint64_t start_time;
+	char     name[OS_THREAD_CPU_NAME_SIZE];
+};
+
+struct thread_cpu_sample {
+	uint64_t serial;
+	uint64_t cpu_time_ns;
+};
+
+struct os_thread_cpu_info {
+	uint64_t                                last_time;
+	DARRAY(struct thread_cpu_sample)        samples;
+	DARRAY(struct thread_cpu_sample)        new_samples;
+	DARRAY(struct os_thread_cpu_usage)      usage;
+};
+
+/* a fixed table, so the registry never shows up as leaked memory; threads
+ * that have exited are pruned whenever it is sampled or runs full */
+#define MAX_THREAD_CPU_ENTRIES 256
+
+static pthread_mutex_t thread_cpu_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct thread_cpu_entry thread_cpu_entries[MAX_THREAD_CPU_ENTRIES];
+static size_t thread_cpu_count = 0;
+static uint64_t thread_cpu_serial = 0;
+
+static size_t find_thread_cpu_entry(uint64_t id)
+{
+	for (size_t i = 0; i < thread_cpu_count; i++) {
+		if (thread_cpu_entries[i].id == id)
+			return i;
+	}
+
+	return DARRAY_INVALID;
+}
+
+static void remove_thread_cpu_entry(size_t idx)
+{
+	os_thread_cpu_close(thread_cpu_entries[idx].handle);
+
+	thread_cpu_entries[idx] = thread_cpu_entries[--thread_cpu_count];
+}
+
+static void prune_thread_cpu_entries(void)
+{
+	size_t i = 0;
+
+	while (i < thread_cpu_count) {
+		struct thread_cpu_entry *entry = &thread_cpu_entries[i];
+		uint64_t cpu_time;
+
+		if (!os_thread_cpu_time(entry->id, entry->handle, &cpu_time))
+			remove_thread_cpu_entry(i);
+		else
+			i++;
+	}
+}
+
+void os_thread_cpu_register(const char *name)
+{
+	uint64_t id = os_thread_cpu_self();
+	struct thread_cpu_entry *entry;
+	size_t idx;
+
+	if (!id)
+		return;
+
+	pthread_mutex_lock(&thread_cpu_mutex);
+
+	/* threads that rename themselves keep their accounting */
+	idx = find_thread_cpu_entry(id);
+	if (idx == DARRAY_INVALID) {
+		if (thread_cpu_count == MAX_THREAD_CPU_ENTRIES)
+			prune_thread_cpu_entries();
+		if (thread_cpu_count == MAX_THREAD_CPU_ENTRIES)
+			goto unlock;
+
+		idx = thread_cpu_count++;
+		entry = &thread_cpu_entries[idx];
+		entry->serial = ++thread_cpu_serial;
+		entry->id     = id;
+		entry->handle = os_thread_cpu_open(id);
+		entry->start_time = os_gettime_ns();
+	}
+
+	entry = &thread_cpu_entries[idx];
+	strncpy(entry->name, name ? name : "", OS_THREAD_CPU_NAME_SIZE - 1);
+	entry->name[OS_THREAD_CPU_NAME_SIZE - 1] = 0;
+
+unlock:
+	pthread_mutex_unlock(&thread_cpu_mutex);
+}
+
+void os_thread_cpu_unregister(void)
+{
+	uint64_t id = os_thread_cpu_self();
+	size_t idx;
+
+	pthread_mutex_lock(&thread_cpu_mutex);
+
+	idx = find_thread_cpu_entry(id);
+	if (idx != DARRAY_INVALID)
+		remove_thread_cpu_entry(idx);
+
+	pthread_mutex_unlock(&thread_cpu_mutex);
+}
+
+os_thread_cpu_info_t *os_thread_cpu_info_start(void)
+{
+	struct os_thread_cpu_info *info = bzalloc(sizeof(*info));
+	const struct os_thread_cpu_usage *usage;
+
+	os_thread_cpu_info_query(info, &usage);
+	return info;
+}
+
+static bool find_thread_cpu_sample(struct os_thread_cpu_info *info,
+		uint64_t serial, uint64_t *cpu_time_ns)
+{
+	for (size_t i = 0; i < info->samples.num; i++) {
+		if (info->samples.array[i].serial == serial) {
+			*cpu_time_ns = info->samples.array[i].cpu_time_ns;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+size_t os_thread_cpu_info_query(os_thread_cpu_info_t *info,
+		const struct os_thread_cpu_usage **usage)
+{
+	uint64_t cur_time = os_gettime_ns();
+	uint64_t last_time;
+	size_t i = 0;
+
+	if (!info) {
+		*usage = NULL;
+		return 0;
+	}
+
+	last_time = info->last_time;
+	info->last_time = cur_time;
+
+	da_resize(info->new_samples, 0);
+	da_resize(info->usage, 0);
+
+	pthread_mutex_lock(&thread_cpu_mutex);
+
+	while (i < thread_cpu_count) {
+		struct thread_cpu_entry *entry = &thread_cpu_entries[i];
+		struct thread_cpu_sample *sample;
+		struct os_thread_cpu_usage *out;
+		uint64_t cpu_time, last_cpu_time = 0;
+		uint64_t since = last_time;
+
+		if (!os_thread_cpu_time(entry->id, entry->handle, &cpu_time)) {
+			remove_thread_cpu_entry(i);
+			continue;
+		}
+
+		sample = da_push_back_new(info->new_samples);
+		sample->serial      = entry->serial;
+		sample->cpu_time_ns = cpu_time;
+
+		out = da_push_back_new(info->usage);
+		memcpy(out->name, entry->name, OS_THREAD_CPU_NAME_SIZE);
+		out->cpu_time_ns = cpu_time;
+
+		/* threads that started since the last query count from when
+		 * they registered */
+		if (!find_thread_cpu_sample(info, entry->serial,
+					&last_cpu_time))
+			since = entry->start_time;
+
+		if (last_time && cur_time > since && cpu_time >= last_cpu_time)
+			out->percent = (double)(cpu_time - last_cpu_time) *
+				100.0 / (double)(cur_time - since);
+
+		i++;
+	}
+
+	pthread_mutex_unlock(&thread_cpu_mutex);
+
+	da_move(info->samples, info->new_samples);
+
+	*usage = info->usage.array;
+	return info->usage.num;
+}
+
+void os_thread_cpu_info_destroy(os_thread_cpu_info_t *info)
+{
+	if (info) {
+		da_free(info->samples);
+		da_free(info->new_samples);
+		da_free(info->usage);
+		bfree(info);
+	}
+}
@@ -82,6 +82,40 @@ EXPORT os_cpu_usage_info_t *os_cpu_usage_info_start(void);
 EXPORT double              os_cpu_usage_info_query(os_cpu_usage_info_t *info);
 EXPORT void                os_cpu_usage_info_destroy(os_cpu_usage_info_t *info);
 
+/**
+ * Adds the calling thread to per-thread CPU accounting under the given name.
+ * os_set_thread_name already does this, so this is only needed for threads
+ * that should not be renamed, such as the UI thread.  Threads are dropped
+ * from accounting once they exit or call os_thread_cpu_unregister.
+ */
+EXPORT void os_thread_cpu_register(const char *name);
+EXPORT void os_thread_cpu_unregister(void);
+
+#define OS_THREAD_CPU_NAME_SIZE 64
+
+struct os_thread_cpu_usage {
+	char     name[OS_THREAD_CPU_NAME_SIZE];
+	/** percentage of one core used since the previous query */
+	double   percent;
+	/** total CPU time the thread has used */
+	uint64_t cpu_time_ns;
+};
+
+struct os_thread_cpu_info;
+typedef struct os_thread_cpu_info os_thread_cpu_info_t;
+
+EXPORT os_thread_cpu_info_t *os_thread_cpu_info_start(void);
+
+/**
+ * Samples every registered thread and returns how many there are.  The
+ * array stays valid until the next query or until info is destroyed.
+ */
+EXPORT size_t os_thread_cpu_info_query(os_thread_cpu_info_t *info,
+		const struct os_thread_cpu_usage **usage);
+EXPORT void os_thread_cpu_info_destroy(os_thread_cpu_info_t *info);
+
+EXPORT int os_get_logical_cores(void);
+
 typedef const void os_performance_token_t;
 EXPORT os_performance_token_t *os_request_high_performance(const char *reason);
 EXPORT void                   os_end_high_performance(os_performance_token_t *);
@@ -96,6 +130,13 @@ EXPORT void os_sleep_ms(uint32_t duration);
 
 EXPORT uint64_t os_gettime_ns(void);
 
+/**
+ * Returns the wall clock time in nanoseconds since the Unix epoch.  Unlike
+ * os_gettime_ns it can jump, so only use it to label times for other
+ * machines.
+ */
+EXPORT uint64_t os_get_epoch_ns(void);
+
 EXPORT int os_get_config_path(char *dst, size_t size, const char *name);
 EXPORT char *os_get_config_path_ptr(const char *name);
 
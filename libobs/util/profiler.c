@@ -370,7 +370,242 @@ static void merge_context(profile_call *context)
 	free_call_context(prev_call);
 }
 
-void profile_start(const char *name)
+bool profile_thread_enabled(void)
+{
+	return thread_enabled;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Tracing */
+
+/* While tracing, each thread appends its begin/end events to its own fixed
+ * size ring buffer instead of building and merging call trees, so the only
+ * shared write is the buffer's own event counter.  Buffers are only ever
+ * added to the list (under trace_mutex), and are dumped or aggregated when a
+ * trace or snapshot is requested. */
+
+#define TRACE_EVENTS_PER_THREAD (1 << 16)
+#define TRACE_THREAD_NAME_SIZE  64
+
+enum trace_event_type {
+	TRACE_EVENT_BEGIN,
+	TRACE_EVENT_END,
+};
+
+struct trace_event {
+	const char *name;
+	uint64_t time_ns;
+	enum trace_event_type type;
+};
+
+struct trace_buffer {
+	struct trace_buffer *next;
+	uint64_t thread_id;
+	char thread_name[TRACE_THREAD_NAME_SIZE];
+
+	/* events before start belong to a previous trace */
+	volatile long generation;
+	volatile int64_t start;
+	volatile int64_t written;
+	struct trace_event *events;
+};
+
+static volatile long trace_active = 0;
+static volatile long trace_generation = 0;
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_buffer *trace_buffers = NULL;
+static uint64_t trace_next_thread_id = 1;
+
+/* bumped when the buffers are freed so threads don't keep using theirs */
+static volatile long trace_epoch = 0;
+
+#ifdef _MSC_VER
+static __declspec(thread) struct trace_buffer *thread_trace = NULL;
+static __declspec(thread) long thread_trace_epoch = 0;
+static __declspec(thread) bool thread_tracing = false;
+static __declspec(thread) size_t thread_trace_depth = 0;
+static __declspec(thread) char thread_name[TRACE_THREAD_NAME_SIZE];
+#else
+static __thread struct trace_buffer *thread_trace = NULL;
+static __thread long thread_trace_epoch = 0;
+static __thread bool thread_tracing = false;
+static __thread size_t thread_trace_depth = 0;
+static __thread char thread_name[TRACE_THREAD_NAME_SIZE];
+#endif
+
+void profiler_trace_start(void)
+{
+	os_atomic_inc_long(&trace_generation);
+	os_atomic_set_long(&trace_active, 1);
+}
+
+void profiler_trace_stop(void)
+{
+	os_atomic_set_long(&trace_active, 0);
+}
+
+bool profiler_trace_active(void)
+{
+	return os_atomic_load_long(&trace_active) != 0;
+}
+
+void profile_set_thread_name(const char *name)
+{
+	if (!name)
+		return;
+
+	strncpy(thread_name, name, TRACE_THREAD_NAME_SIZE - 1);
+	thread_name[TRACE_THREAD_NAME_SIZE - 1] = 0;
+
+	if (thread_trace && thread_trace_epoch ==
+			os_atomic_load_long(&trace_epoch))
+		memcpy(thread_trace->thread_name, thread_name,
+				TRACE_THREAD_NAME_SIZE);
+}
+
+static struct trace_buffer *trace_buffer_create(void)
+{
+	struct trace_buffer *buf = bzalloc(sizeof(struct trace_buffer));
+	buf->events = bmalloc(TRACE_EVENTS_PER_THREAD *
+			sizeof(struct trace_event));
+	memcpy(buf->thread_name, thread_name, TRACE_THREAD_NAME_SIZE);
+
+	pthread_mutex_lock(&trace_mutex);
+	buf->thread_id = trace_next_thread_id++;
+	buf->next = trace_buffers;
+	trace_buffers = buf;
+	pthread_mutex_unlock(&trace_mutex);
+
+	return buf;
+}
+
+static void trace_record(const char *name, uint64_t time_ns,
+		enum trace_event_type type)
+{
+	struct trace_buffer *buf = thread_trace;
+	long generation;
+	int64_t pos;
+
+	if (!os_atomic_load_long(&trace_active))
+		return;
+
+	if (!buf || thread_trace_epoch != os_atomic_load_long(&trace_epoch)) {
+		thread_trace_epoch = os_atomic_load_long(&trace_epoch);
+		buf = thread_trace = trace_buffer_create();
+	}
+
+	generation = os_atomic_load_long(&trace_generation);
+	if (buf->generation != generation) {
+		buf->start = buf->written;
+		os_atomic_set_long(&buf->generation, generation);
+	}
+
+	pos = buf->written;
+	buf->events[pos % TRACE_EVENTS_PER_THREAD] = (struct trace_event){
+		.name    = name,
+		.time_ns = time_ns,
+		.type    = type,
+	};
+
+	os_atomic_add_int64(&buf->written, 1);
+}
+
+/* the tracing state of a thread is only picked when it has no calls open,
+ * so a call tree never ends up split between both modes */
+static bool trace_start_call(const char *name, uint64_t time_ns)
+{
+	if (!thread_context && !thread_trace_depth)
+		thread_tracing = os_atomic_load_long(&trace_active) != 0;
+	if (!thread_tracing)
+		return false;
+
+	thread_trace_depth++;
+	trace_record(name, time_ns, TRACE_EVENT_BEGIN);
+	return true;
+}
+
+static bool trace_end_call(const char *name, uint64_t time_ns)
+{
+	if (!thread_tracing)
+		return false;
+
+	if (thread_trace_depth) {
+		thread_trace_depth--;
+		trace_record(name, time_ns, TRACE_EVENT_END);
+	}
+
+	return true;
+}
+
+/* copies out the events of the current trace that weren't overwritten while
+ * copying */
+static void trace_buffer_copy(struct trace_buffer *buf,
+		struct darray *events)
+{
+	long generation = os_atomic_load_long(&trace_generation);
+	int64_t start, end, first, valid;
+
+	darray_resize(sizeof(struct trace_event), events, 0);
+
+	if (os_atomic_load_long(&buf->generation) != generation)
+		return;
+
+	start = buf->start;
+	end   = os_atomic_add_int64(&buf->written, 0);
+	first = end - TRACE_EVENTS_PER_THREAD;
+	if (first < start)
+		first = start;
+
+	for (int64_t i = first; i < end; i++)
+		darray_push_back(sizeof(struct trace_event), events,
+				&buf->events[i % TRACE_EVENTS_PER_THREAD]);
+
+	if (os_atomic_load_long(&buf->generation) != generation) {
+		darray_resize(sizeof(struct trace_event), events, 0);
+		return;
+	}
+
+	valid = os_atomic_add_int64(&buf->written, 0) -
+		TRACE_EVENTS_PER_THREAD;
+	if (valid >= end)
+		darray_resize(sizeof(struct trace_event), events, 0);
+	else if (valid > first)
+		darray_erase_range(sizeof(struct trace_event), events, 0,
+				(size_t)(valid - first));
+}
+
+static inline struct trace_buffer *trace_buffers_head(void)
+{
+	struct trace_buffer *head;
+
+	pthread_mutex_lock(&trace_mutex);
+	head = trace_buffers;
+	pthread_mutex_unlock(&trace_mutex);
+
+	return head;
+}
+
+static void free_trace_buffers(void)
+{
+	struct trace_buffer *buf;
+
+	os_atomic_set_long(&trace_active, 0);
+
+	pthread_mutex_lock(&trace_mutex);
+	buf = trace_buffers;
+	trace_buffers = NULL;
+	os_atomic_inc_long(&trace_epoch);
+	pthread_mutex_unlock(&trace_mutex);
+
+	while (buf) {
+		struct trace_buffer *next = buf->next;
+		bfree(buf->events);
+		bfree(buf);
+		buf = next;
+	}
+}
+
+static void start_call(const char *name, bool at, uint64_t time_ns)
 {
 	if (!thread_enabled)
 		return;
@@ -394,12 +629,27 @@ void profile_start(const char *name)
 	}
 
 	thread_context = call;
-	call->start_time = os_gettime_ns();
+	call->start_time = at ? time_ns : os_gettime_ns();
 }
 
-void profile_end(const char *name)
+void profile_start(const char *name)
+{
+	if (trace_start_call(name, os_gettime_ns()))
+		return;
+
+	start_call(name, false, 0);
+}
+
+void profile_start_at(const char *name, uint64_t time_ns)
+{
+	if (trace_start_call(name, time_ns))
+		return;
+
+	start_call(name, true, time_ns);
+}
+
+static void end_call(const char *name, uint64_t end)
 {
-	uint64_t end = os_gettime_ns();
 	if (!thread_enabled)
 		return;
 
@@ -425,7 +675,7 @@ void profile_end(const char *name)
 			return;
 
 		while (call->name != name) {
-			profile_end(call->name);
+			end_call(call->name, end);
 			call = call->parent;
 		}
 	}
@@ -443,6 +693,24 @@ void profile_end(const char *name)
 	merge_context(call);
 }
 
+void profile_end(const char *name)
+{
+	uint64_t end = os_gettime_ns();
+
+	if (trace_end_call(name, end))
+		return;
+
+	end_call(name, end);
+}
+
+void profile_end_at(const char *name, uint64_t time_ns)
+{
+	if (trace_end_call(name, time_ns))
+		return;
+
+	end_call(name, time_ns);
+}
+
 static int profiler_time_entry_compare(const void *first, const void *second)
 {
 	int64_t diff = ((profiler_time_entry*)second)->time_delta -
@@ -826,6 +1094,8 @@ void profiler_free(void)
 	}
 
 	da_free(old_root_entries);
+
+	free_trace_buffers();
 }
 
 
@@ -927,6 +1197,126 @@ static void sort_snapshot_entry(profiler_snapshot_entry_t *entry)
 		sort_snapshot_entry(&entry->children.array[i]);
 }
 
+static profiler_snapshot_entry_t *get_snapshot_child(struct darray *entries,
+		const char *name)
+{
+	profiler_snapshot_entry_t *array = entries->array;
+	profiler_snapshot_entry_t *entry;
+
+	for (size_t i = 0; i < entries->num; i++) {
+		if (array[i].name == name)
+			return &array[i];
+	}
+
+	entry = darray_push_back_new(sizeof(profiler_snapshot_entry_t),
+			entries);
+	entry->name = name;
+	return entry;
+}
+
+static void add_snapshot_time(profiler_snapshot_entry_t *entry,
+		uint64_t usec)
+{
+	profiler_time_entry time = {usec, 1};
+	da_push_back(entry->times, &time);
+
+	if (!entry->overall_count || usec < entry->min_time)
+		entry->min_time = usec;
+	if (usec > entry->max_time)
+		entry->max_time = usec;
+	entry->overall_count++;
+}
+
+struct trace_frame {
+	profiler_snapshot_entry_t *entry;
+	uint64_t start_time;
+};
+
+/* rebuilds call trees from a thread's events, beginnings of calls that got
+ * overwritten in the ring are skipped */
+static void add_trace_to_snapshot(profiler_snapshot_t *snap,
+		const struct darray *events)
+{
+	const struct trace_event *array = events->array;
+	DARRAY(struct trace_frame) stack = {0};
+
+	for (size_t i = 0; i < events->num; i++) {
+		const struct trace_event *event = &array[i];
+
+		if (event->type == TRACE_EVENT_BEGIN) {
+			struct darray *children = stack.num ?
+				&stack.array[stack.num - 1].entry->children.da :
+				&snap->roots.da;
+			struct trace_frame frame = {
+				get_snapshot_child(children, event->name),
+				event->time_ns
+			};
+			da_push_back(stack, &frame);
+
+		} else if (stack.num) {
+			struct trace_frame *frame =
+				&stack.array[stack.num - 1];
+			add_snapshot_time(frame->entry, diff_ns_to_usec(
+					frame->start_time, event->time_ns));
+			da_pop_back(stack);
+		}
+	}
+
+	da_free(stack);
+}
+
+static int profiler_time_entry_compare_delta(const void *first,
+		const void *second)
+{
+	uint64_t a = ((profiler_time_entry*)first)->time_delta;
+	uint64_t b = ((profiler_time_entry*)second)->time_delta;
+	return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+/* traced times are added one call at a time, merge equal times */
+static void compact_snapshot_entry(profiler_snapshot_entry_t *entry)
+{
+	size_t num = 0;
+
+	qsort(entry->times.array, entry->times.num,
+			sizeof(profiler_time_entry),
+			profiler_time_entry_compare_delta);
+
+	for (size_t i = 0; i < entry->times.num; i++) {
+		profiler_time_entry *time = &entry->times.array[i];
+
+		if (num && entry->times.array[num - 1].time_delta ==
+				time->time_delta)
+			entry->times.array[num - 1].count += time->count;
+		else
+			entry->times.array[num++] = *time;
+	}
+
+	entry->times.num = num;
+
+	for (size_t i = 0; i < entry->children.num; i++)
+		compact_snapshot_entry(&entry->children.array[i]);
+}
+
+static void add_traces_to_snapshot(profiler_snapshot_t *snap)
+{
+	struct trace_buffer *buf = trace_buffers_head();
+	DARRAY(struct trace_event) events = {0};
+
+	if (!buf)
+		return;
+
+	for (; buf; buf = buf->next) {
+		trace_buffer_copy(buf, &events.da);
+		add_trace_to_snapshot(snap, &events.da);
+	}
+
+	da_free(events);
+
+	for (size_t i = 0; i < snap->roots.num; i++)
+		compact_snapshot_entry(&snap->roots.array[i]);
+}
+
 profiler_snapshot_t *profile_snapshot_create(void)
 {
 	profiler_snapshot_t *snap = bzalloc(sizeof(profiler_snapshot_t));
@@ -941,6 +1331,8 @@ profiler_snapshot_t *profile_snapshot_create(void)
 	}
 	pthread_mutex_unlock(&root_mutex);
 
+	add_traces_to_snapshot(snap);
+
 	for (size_t i = 0; i < snap->roots.num; i++)
 		sort_snapshot_entry(&snap->roots.array[i]);
 
@@ -1173,3 +1565,120 @@ uint64_t profiler_snapshot_entry_overall_between_calls_count(
 {
 	return entry ? entry->overall_between_calls_count : 0;
 }
+
+/* ------------------------------------------------------------------------- */
+/* Trace export */
+
+static void json_cat_string(struct dstr *buffer, const char *str)
+{
+	dstr_cat_ch(buffer, '"');
+
+	for (; str && *str; str++) {
+		unsigned char ch = (unsigned char)*str;
+
+		if (ch == '"' || ch == '\\') {
+			dstr_cat_ch(buffer, '\\');
+			dstr_cat_ch(buffer, (char)ch);
+		} else if (ch < 0x20) {
+			dstr_catf(buffer, "\\u%04x", ch);
+		} else {
+			dstr_cat_ch(buffer, (char)ch);
+		}
+	}
+
+	dstr_cat_ch(buffer, '"');
+}
+
+static inline void json_flush(FILE *f, struct dstr *buffer, bool force)
+{
+	if (buffer->len && (force || buffer->len >= 65536)) {
+		fwrite(buffer->array, 1, buffer->len, f);
+		dstr_resize(buffer, 0);
+	}
+}
+
+static void dump_trace_thread(FILE *f, struct dstr *buffer,
+		const struct trace_buffer *buf, const struct darray *events,
+		uint64_t base_time, bool *first)
+{
+	const struct trace_event *array = events->array;
+	size_t depth = 0;
+
+	dstr_catf(buffer, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\","
+			"\"pid\":1,\"tid\":%"PRIu64",\"args\":{\"name\":",
+			*first ? "" : ",", buf->thread_id);
+	if (*buf->thread_name)
+		json_cat_string(buffer, buf->thread_name);
+	else
+		dstr_catf(buffer, "\"thread %"PRIu64"\"", buf->thread_id);
+	dstr_cat(buffer, "}}");
+	*first = false;
+
+	for (size_t i = 0; i < events->num; i++) {
+		const struct trace_event *event = &array[i];
+		uint64_t ts = event->time_ns - base_time;
+
+		if (event->type == TRACE_EVENT_END) {
+			if (!depth)
+				continue;
+			depth--;
+		} else {
+			depth++;
+		}
+
+		dstr_cat(buffer, ",\n{\"name\":");
+		json_cat_string(buffer, event->name);
+		dstr_catf(buffer, ",\"ph\":\"%c\",\"pid\":1,"
+				"\"tid\":%"PRIu64",\"ts\":%"PRIu64".%03u}",
+				event->type == TRACE_EVENT_BEGIN ? 'B' : 'E',
+				buf->thread_id, ts / 1000,
+				(unsigned)(ts % 1000));
+
+		json_flush(f, buffer, false);
+	}
+}
+
+bool profiler_trace_dump_json(const char *filename)
+{
+	DARRAY(struct darray) threads = {0};
+	struct trace_buffer *head = trace_buffers_head();
+	struct dstr buffer = {0};
+	uint64_t base_time = UINT64_MAX;
+	bool first = true;
+	size_t idx = 0;
+	FILE *f;
+
+	f = os_fopen(filename, "wb");
+	if (!f)
+		return false;
+
+	for (struct trace_buffer *buf = head; buf; buf = buf->next) {
+		struct darray *events = da_push_back_new(threads);
+		const struct trace_event *array;
+
+		trace_buffer_copy(buf, events);
+
+		array = events->array;
+		if (events->num && array[0].time_ns < base_time)
+			base_time = array[0].time_ns;
+	}
+
+	dstr_cat(&buffer, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+	for (struct trace_buffer *buf = head; buf; buf = buf->next, idx++) {
+		struct darray *events = &threads.array[idx];
+
+		if (events->num)
+			dump_trace_thread(f, &buffer, buf, events, base_time,
+					&first);
+		darray_free(events);
+	}
+
+	dstr_cat(&buffer, "\n]}\n");
+	json_flush(f, &buffer, true);
+
+	fclose(f);
+	dstr_free(&buffer);
+	da_free(threads);
+	return true;
+}
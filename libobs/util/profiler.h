@@ -20,8 +20,17 @@ EXPORT void profile_register_root(const char *name,
 EXPORT void profile_start(const char *name);
 EXPORT void profile_end(const char *name);
 
+/* like profile_start/profile_end, but with times measured elsewhere (on the
+ * GPU, for example) instead of the current time */
+EXPORT void profile_start_at(const char *name, uint64_t time_ns);
+EXPORT void profile_end_at(const char *name, uint64_t time_ns);
+
 EXPORT void profile_reenable_thread(void);
 
+/* false if the profiler was stopped while this thread was profiling, until
+ * profile_reenable_thread is called */
+EXPORT bool profile_thread_enabled(void);
+
 /* ------------------------------------------------------------------------- */
 /* Profiler control */
 
@@ -33,6 +42,23 @@ EXPORT void profiler_print_time_between_calls(profiler_snapshot_t *snap);
 
 EXPORT void profiler_free(void);
 
+/* ------------------------------------------------------------------------- */
+/* Tracing */
+
+/* While tracing, profile_start/profile_end only record timestamped events in
+ * to a fixed size ring buffer per thread, which is cheap enough to leave on
+ * in production.  The events are merged in to snapshots when they are
+ * created, and can be exported in the Chrome/Perfetto trace event format.
+ * Threads switch modes only when they have no calls open. */
+EXPORT void profiler_trace_start(void);
+EXPORT void profiler_trace_stop(void);
+EXPORT bool profiler_trace_active(void);
+
+EXPORT bool profiler_trace_dump_json(const char *filename);
+
+/* called by os_set_thread_name, used to label threads in traces */
+EXPORT void profile_set_thread_name(const char *name);
+
 /* ------------------------------------------------------------------------- */
 /* Profiler name storage */
 
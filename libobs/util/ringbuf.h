@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2015 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "c99defs.h"
+#include <string.h>
+
+#include "bmem.h"
+#include "threading.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Fixed capacity circular buffer.  The capacity is always a power of two and
+ * the read and write positions run freely, so that indexing is just a mask
+ * and full/empty never need a special case.  Unlike circlebuf, nothing ever
+ * grows by itself: pushing more than there is space for fails, and the
+ * capacity is only changed explicitly with ringbuf_reserve, which is meant
+ * to be done up front rather than mid-stream.
+ *
+ * The ringbuf_spsc_* functions may be used by one producer thread and one
+ * consumer thread at the same time without any lock.  The plain functions
+ * are for buffers used by only one thread (or under a lock).
+ */
+
+struct ringbuf {
+	uint8_t       *data;
+	size_t        capacity;
+	size_t        mask;
+
+	volatile long read_pos;
+	volatile long write_pos;
+};
+
+static inline void ringbuf_init(struct ringbuf *rb)
+{
+	memset(rb, 0, sizeof(struct ringbuf));
+}
+
+static inline void ringbuf_free(struct ringbuf *rb)
+{
+	bfree(rb->data);
+	memset(rb, 0, sizeof(struct ringbuf));
+}
+
+static inline size_t ringbuf_distance(long from, long to)
+{
+	return (size_t)((unsigned long)to - (unsigned long)from);
+}
+
+static inline size_t ringbuf_size(const struct ringbuf *rb)
+{
+	return ringbuf_distance(rb->read_pos, rb->write_pos);
+}
+
+static inline size_t ringbuf_space(const struct ringbuf *rb)
+{
+	return rb->capacity - ringbuf_size(rb);
+}
+
+static inline void ringbuf_copy_in(struct ringbuf *rb, long pos,
+		const void *data, size_t size)
+{
+	size_t offset = (size_t)pos & rb->mask;
+	size_t first  = rb->capacity - offset;
+
+	if (first >= size) {
+		memcpy(rb->data + offset, data, size);
+	} else {
+		memcpy(rb->data + offset, data, first);
+		memcpy(rb->data, (const uint8_t*)data + first, size - first);
+	}
+}
+
+static inline void ringbuf_copy_out(const struct ringbuf *rb, long pos,
+		void *data, size_t size)
+{
+	size_t offset = (size_t)pos & rb->mask;
+	size_t first  = rb->capacity - offset;
+
+	if (first >= size) {
+		memcpy(data, rb->data + offset, size);
+	} else {
+		memcpy(data, rb->data + offset, first);
+		memcpy((uint8_t*)data + first, rb->data, size - first);
+	}
+}
+
+/** Changes the capacity to at least the given size, keeping the contents.
+ *  Not safe while another thread uses the buffer. */
+static inline void ringbuf_reserve(struct ringbuf *rb, size_t capacity)
+{
+	size_t size = ringbuf_size(rb);
+	size_t new_capacity = 1;
+	uint8_t *data;
+
+	while (new_capacity < capacity)
+		new_capacity <<= 1;
+	if (new_capacity <= rb->capacity)
+		return;
+
+	data = (uint8_t*)bmalloc(new_capacity);
+	if (size)
+		ringbuf_copy_out(rb, rb->read_pos, data, size);
+	bfree(rb->data);
+
+	rb->data      = data;
+	rb->capacity  = new_capacity;
+	rb->mask      = new_capacity - 1;
+	rb->read_pos  = 0;
+	rb->write_pos = (long)size;
+}
+
+static inline void ringbuf_clear(struct ringbuf *rb)
+{
+	rb->read_pos = rb->write_pos;
+}
+
+static inline bool ringbuf_push_back(struct ringbuf *rb, const void *data,
+		size_t size)
+{
+	if (ringbuf_space(rb) < size)
+		return false;
+
+	ringbuf_copy_in(rb, rb->write_pos, data, size);
+	rb->write_pos = (long)((unsigned long)rb->write_pos + size);
+	return true;
+}
+
+static inline bool ringbuf_peek_front(const struct ringbuf *rb, void *data,
+		size_t size)
+{
+	if (ringbuf_size(rb) < size)
+		return false;
+
+	ringbuf_copy_out(rb, rb->read_pos, data, size);
+	return true;
+}
+
+/** Pops size bytes, into data unless it is NULL. */
+static inline bool ringbuf_pop_front(struct ringbuf *rb, void *data,
+		size_t size)
+{
+	if (ringbuf_size(rb) < size)
+		return false;
+
+	if (data)
+		ringbuf_copy_out(rb, rb->read_pos, data, size);
+	rb->read_pos = (long)((unsigned long)rb->read_pos + size);
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* single producer, single consumer */
+
+/** Bytes available to the consumer, a lower bound while the producer runs */
+static inline size_t ringbuf_spsc_size(struct ringbuf *rb)
+{
+	return ringbuf_distance(os_atomic_load_long(&rb->read_pos),
+			os_atomic_load_long(&rb->write_pos));
+}
+
+/** Producer only.  The data is published once it has been copied in. */
+static inline bool ringbuf_spsc_push_back(struct ringbuf *rb,
+		const void *data, size_t size)
+{
+	long read_pos  = os_atomic_load_long(&rb->read_pos);
+	long write_pos = rb->write_pos;
+
+	if (rb->capacity - ringbuf_distance(read_pos, write_pos) < size)
+		return false;
+
+	ringbuf_copy_in(rb, write_pos, data, size);
+	os_atomic_set_long(&rb->write_pos,
+			(long)((unsigned long)write_pos + size));
+	return true;
+}
+
+/** Consumer only.  The space is handed back once it has been copied out. */
+static inline bool ringbuf_spsc_pop_front(struct ringbuf *rb, void *data,
+		size_t size)
+{
+	long write_pos = os_atomic_load_long(&rb->write_pos);
+	long read_pos  = rb->read_pos;
+
+	if (ringbuf_distance(read_pos, write_pos) < size)
+		return false;
+
+	if (data)
+		ringbuf_copy_out(rb, read_pos, data, size);
+	os_atomic_set_long(&rb->read_pos,
+			(long)((unsigned long)read_pos + size));
+	return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
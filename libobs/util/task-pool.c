@@ -0,0 +1,403 @@
+/*
+ * Copyright (c) 2015 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "task-pool.h"
+#include "threading.h"
+#include "platform.h"
+#include "profiler.h"
+#include "darray.h"
+#include "bmem.h"
+#include "base.h"
+
+/* how often a worker waiting on a group checks for new tasks to help with */
+#define GROUP_HELP_INTERVAL_MS 1
+
+struct task {
+	os_task_t            func;
+	void                 *param;
+	const char           *profile_name;
+	struct os_task_group *group;
+};
+
+struct task_queue {
+	pthread_mutex_t      mutex;
+	DARRAY(struct task)  tasks[OS_TASK_PRIORITY_COUNT];
+};
+
+struct task_worker {
+	struct os_task_pool  *pool;
+	struct task_queue    queue;
+	size_t               index;
+	pthread_t            thread;
+	bool                 thread_created;
+};
+
+struct os_task_pool {
+	char                 *name;
+	struct task_worker   *workers;
+	size_t               num_workers;
+
+	/* tasks queued from threads outside of the pool */
+	struct task_queue    shared;
+
+	/* posted once for each queued task.  tasks run by a worker waiting
+	 * on a group don't take a count, so workers can wake up and find
+	 * nothing to do, which is harmless */
+	os_sem_t             *sem;
+	volatile bool        stop;
+};
+
+struct os_task_group {
+	struct os_task_pool  *pool;
+	pthread_mutex_t      mutex;
+	long                 pending;
+	os_event_t           *done;
+};
+
+#ifdef _MSC_VER
+static __declspec(thread) struct task_worker *current_worker = NULL;
+#else
+static __thread struct task_worker *current_worker = NULL;
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+static bool task_queue_init(struct task_queue *queue)
+{
+	for (size_t i = 0; i < OS_TASK_PRIORITY_COUNT; i++)
+		da_init(queue->tasks[i]);
+	return pthread_mutex_init(&queue->mutex, NULL) == 0;
+}
+
+static void task_queue_free(struct task_queue *queue)
+{
+	for (size_t i = 0; i < OS_TASK_PRIORITY_COUNT; i++)
+		da_free(queue->tasks[i]);
+	pthread_mutex_destroy(&queue->mutex);
+}
+
+static void task_queue_push(struct task_queue *queue, const struct task *task,
+		enum os_task_priority priority)
+{
+	pthread_mutex_lock(&queue->mutex);
+	da_push_back(queue->tasks[priority], task);
+	pthread_mutex_unlock(&queue->mutex);
+}
+
+/* the owning worker takes its newest task, which is the one most likely to
+ * still have its data in the cache */
+static bool task_queue_pop_newest(struct task_queue *queue, size_t priority,
+		struct task *task)
+{
+	bool found = false;
+
+	pthread_mutex_lock(&queue->mutex);
+	if (queue->tasks[priority].num) {
+		size_t last = queue->tasks[priority].num - 1;
+		*task = queue->tasks[priority].array[last];
+		da_pop_back(queue->tasks[priority]);
+		found = true;
+	}
+	pthread_mutex_unlock(&queue->mutex);
+
+	return found;
+}
+
+/* everyone else takes the oldest task, which for tasks that split
+ * themselves up tends to be the largest piece of work */
+static bool task_queue_pop_oldest(struct task_queue *queue, size_t priority,
+		struct task *task)
+{
+	bool found = false;
+
+	pthread_mutex_lock(&queue->mutex);
+	if (queue->tasks[priority].num) {
+		*task = queue->tasks[priority].array[0];
+		da_erase(queue->tasks[priority], 0);
+		found = true;
+	}
+	pthread_mutex_unlock(&queue->mutex);
+
+	return found;
+}
+
+static bool take_task(struct os_task_pool *pool, struct task_worker *self,
+		struct task *task)
+{
+	size_t priority = OS_TASK_PRIORITY_COUNT;
+
+	while (priority-- > 0) {
+		if (task_queue_pop_newest(&self->queue, priority, task))
+			return true;
+		if (task_queue_pop_oldest(&pool->shared, priority, task))
+			return true;
+
+		for (size_t i = 1; i < pool->num_workers; i++) {
+			size_t idx = (self->index + i) % pool->num_workers;
+			struct task_worker *victim = &pool->workers[idx];
+
+			if (task_queue_pop_oldest(&victim->queue, priority,
+						task))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+static void group_task_done(struct os_task_group *group)
+{
+	pthread_mutex_lock(&group->mutex);
+	if (--group->pending == 0)
+		os_event_signal(group->done);
+	pthread_mutex_unlock(&group->mutex);
+}
+
+static void run_task(struct task *task)
+{
+	if (task->profile_name)
+		profile_start(task->profile_name);
+
+	task->func(task->param);
+
+	if (task->profile_name)
+		profile_end(task->profile_name);
+
+	if (task->group)
+		group_task_done(task->group);
+}
+
+static void *task_worker_thread(void *param)
+{
+	struct task_worker  *self = param;
+	struct os_task_pool *pool = self->pool;
+	struct task         task;
+
+	os_set_thread_name(pool->name);
+	current_worker = self;
+
+	for (;;) {
+		os_sem_wait(pool->sem);
+
+		while (take_task(pool, self, &task))
+			run_task(&task);
+
+		if (pool->stop)
+			break;
+	}
+
+	current_worker = NULL;
+	return NULL;
+}
+
+static void queue_task(struct os_task_pool *pool, const struct task *task,
+		enum os_task_priority priority)
+{
+	struct task_worker *worker = current_worker;
+
+	if ((int)priority < OS_TASK_PRIORITY_LOW ||
+	    (int)priority > OS_TASK_PRIORITY_HIGH)
+		priority = OS_TASK_PRIORITY_NORMAL;
+
+	if (worker && worker->pool == pool)
+		task_queue_push(&worker->queue, task, priority);
+	else
+		task_queue_push(&pool->shared, task, priority);
+
+	os_sem_post(pool->sem);
+}
+
+/* ------------------------------------------------------------------------- */
+
+os_task_pool_t *os_task_pool_create(const char *name, size_t threads)
+{
+	struct os_task_pool *pool = bzalloc(sizeof(struct os_task_pool));
+
+	if (!threads) {
+		int cores = os_get_logical_cores();
+		threads = cores > 1 ? (size_t)(cores - 1) : 1;
+	}
+
+	pool->name = bstrdup(name ? name : "task pool");
+	pool->num_workers = threads;
+	pool->workers = bzalloc(sizeof(struct task_worker) * threads);
+
+	if (!task_queue_init(&pool->shared))
+		goto fail;
+	if (os_sem_init(&pool->sem, 0) != 0)
+		goto fail;
+
+	for (size_t i = 0; i < threads; i++) {
+		struct task_worker *worker = &pool->workers[i];
+
+		worker->pool = pool;
+		worker->index = i;
+		if (!task_queue_init(&worker->queue))
+			goto fail;
+	}
+
+	for (size_t i = 0; i < threads; i++) {
+		struct task_worker *worker = &pool->workers[i];
+
+		if (pthread_create(&worker->thread, NULL, task_worker_thread,
+					worker) != 0)
+			goto fail;
+		worker->thread_created = true;
+	}
+
+	return pool;
+
+fail:
+	blog(LOG_ERROR, "os_task_pool_create: Failed to create task pool "
+	                "'%s'", pool->name);
+	os_task_pool_destroy(pool);
+	return NULL;
+}
+
+void os_task_pool_destroy(os_task_pool_t *pool)
+{
+	if (!pool)
+		return;
+
+	pool->stop = true;
+
+	for (size_t i = 0; i < pool->num_workers; i++)
+		if (pool->workers[i].thread_created)
+			os_sem_post(pool->sem);
+
+	for (size_t i = 0; i < pool->num_workers; i++)
+		if (pool->workers[i].thread_created)
+			pthread_join(pool->workers[i].thread, NULL);
+
+	for (size_t i = 0; i < pool->num_workers; i++)
+		task_queue_free(&pool->workers[i].queue);
+
+	task_queue_free(&pool->shared);
+	os_sem_destroy(pool->sem);
+	bfree(pool->workers);
+	bfree(pool->name);
+	bfree(pool);
+}
+
+size_t os_task_pool_threads(os_task_pool_t *pool)
+{
+	return pool ? pool->num_workers : 0;
+}
+
+void os_task_pool_queue(os_task_pool_t *pool, os_task_t task, void *param,
+		enum os_task_priority priority, const char *profile_name)
+{
+	struct task new_task = {task, param, profile_name, NULL};
+
+	if (!pool || !task)
+		return;
+
+	queue_task(pool, &new_task, priority);
+}
+
+/* ------------------------------------------------------------------------- */
+
+os_task_group_t *os_task_group_create(os_task_pool_t *pool)
+{
+	struct os_task_group *group;
+
+	if (!pool)
+		return NULL;
+
+	group = bzalloc(sizeof(struct os_task_group));
+	group->pool = pool;
+
+	if (pthread_mutex_init(&group->mutex, NULL) != 0)
+		goto fail_mutex;
+	if (os_event_init(&group->done, OS_EVENT_TYPE_MANUAL) != 0)
+		goto fail_event;
+
+	os_event_signal(group->done);
+	return group;
+
+fail_event:
+	pthread_mutex_destroy(&group->mutex);
+fail_mutex:
+	bfree(group);
+	return NULL;
+}
+
+void os_task_group_destroy(os_task_group_t *group)
+{
+	if (!group)
+		return;
+
+	os_task_group_wait(group);
+
+	os_event_destroy(group->done);
+	pthread_mutex_destroy(&group->mutex);
+	bfree(group);
+}
+
+void os_task_group_queue(os_task_group_t *group, os_task_t task,
+		void *param, enum os_task_priority priority,
+		const char *profile_name)
+{
+	struct task new_task = {task, param, profile_name, group};
+
+	if (!group || !task)
+		return;
+
+	pthread_mutex_lock(&group->mutex);
+	if (group->pending++ == 0)
+		os_event_reset(group->done);
+	pthread_mutex_unlock(&group->mutex);
+
+	queue_task(group->pool, &new_task, priority);
+}
+
+static inline bool group_pending(struct os_task_group *group)
+{
+	bool pending;
+
+	pthread_mutex_lock(&group->mutex);
+	pending = group->pending > 0;
+	pthread_mutex_unlock(&group->mutex);
+
+	return pending;
+}
+
+void os_task_group_wait(os_task_group_t *group)
+{
+	struct task_worker *worker = current_worker;
+	struct task        task;
+
+	if (!group)
+		return;
+
+	/* threads outside of the pool just block, so that they don't end up
+	 * running some other long task they didn't ask for */
+	if (!worker || worker->pool != group->pool) {
+		while (group_pending(group))
+			os_event_wait(group->done);
+		return;
+	}
+
+	/* a worker has to keep running tasks, otherwise a pool where every
+	 * worker waits on a group could never finish any of them */
+	while (group_pending(group)) {
+		if (take_task(group->pool, worker, &task))
+			run_task(&task);
+		else
+			os_event_timedwait(group->done,
+					GROUP_HELP_INTERVAL_MS);
+	}
+}
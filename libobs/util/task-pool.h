@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2015 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "c99defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A fixed set of worker threads that run queued tasks, so that work which can
+ * be split up doesn't need its own threads.  Each worker keeps its own queue
+ * and runs the tasks it queued itself newest first; a worker that runs out of
+ * tasks takes the oldest task from the shared queue or from another worker.
+ * Higher priority tasks are always picked before lower priority ones.
+ *
+ * Tasks can be collected in a group, which can then be waited on.  When a
+ * task waits on a group it keeps running other tasks in the meantime, so
+ * tasks can safely split themselves up further and wait for the parts.
+ *
+ * If a profile name is given, the task is run within a profiler section of
+ * that name.  As with the profiler, the name must stay valid for as long as
+ * the profiler is in use.
+ */
+
+struct os_task_pool;
+struct os_task_group;
+typedef struct os_task_pool  os_task_pool_t;
+typedef struct os_task_group os_task_group_t;
+
+typedef void (*os_task_t)(void *param);
+
+enum os_task_priority {
+	OS_TASK_PRIORITY_LOW,
+	OS_TASK_PRIORITY_NORMAL,
+	OS_TASK_PRIORITY_HIGH
+};
+
+#define OS_TASK_PRIORITY_COUNT (OS_TASK_PRIORITY_HIGH + 1)
+
+/* threads can be 0 to use one thread per logical core, minus one */
+EXPORT os_task_pool_t *os_task_pool_create(const char *name, size_t threads);
+
+/* waits for all queued tasks to finish */
+EXPORT void os_task_pool_destroy(os_task_pool_t *pool);
+
+EXPORT size_t os_task_pool_threads(os_task_pool_t *pool);
+
+EXPORT void os_task_pool_queue(os_task_pool_t *pool, os_task_t task,
+		void *param, enum os_task_priority priority,
+		const char *profile_name);
+
+EXPORT os_task_group_t *os_task_group_create(os_task_pool_t *pool);
+
+/* waits for the group's tasks to finish first */
+EXPORT void os_task_group_destroy(os_task_group_t *group);
+
+EXPORT void os_task_group_queue(os_task_group_t *group, os_task_t task,
+		void *param, enum os_task_priority priority,
+		const char *profile_name);
+
+/* waits until all tasks queued in the group so far (and the tasks they
+ * queue in the group) have finished */
+EXPORT void os_task_group_wait(os_task_group_t *group);
+
+#ifdef __cplusplus
+}
+#endif
@@ -15,9 +15,11 @@
  */
 
 #include "dstr.h"
+#include "darray.h"
 #include "text-lookup.h"
 #include "lexer.h"
 #include "platform.h"
+#include "threading.h"
 
 /* ------------------------------------------------------------------------- */
 
@@ -100,6 +102,13 @@ static struct text_node *text_node_byname(struct text_node *node,
 struct text_lookup {
 	struct dstr language;
 	struct text_node *top;
+
+	/* files added with text_lookup_add_deferred that haven't been parsed
+	 * yet, they're parsed in order on the first lookup */
+	pthread_mutex_t mutex;
+	DARRAY(char*) deferred;
+	volatile long num_deferred;
+	int mem_tag;
 };
 
 static void lookup_createsubnode(const char *lookup_val,
@@ -358,19 +367,44 @@ static inline bool lookup_getstring(const char *lookup_val,
 
 /* ------------------------------------------------------------------------- */
 
-lookup_t *text_lookup_create(const char *path)
+static inline struct text_lookup *lookup_new(void)
 {
 	struct text_lookup *lookup = bzalloc(sizeof(struct text_lookup));
 
-	if (!text_lookup_add(lookup, path)) {
+	if (pthread_mutex_init(&lookup->mutex, NULL) != 0) {
 		bfree(lookup);
+		return NULL;
+	}
+
+	lookup->mem_tag = bmem_get_thread_tag();
+	return lookup;
+}
+
+lookup_t *text_lookup_create(const char *path)
+{
+	struct text_lookup *lookup = lookup_new();
+
+	if (lookup && !text_lookup_add(lookup, path)) {
+		text_lookup_destroy(lookup);
 		lookup = NULL;
 	}
 
 	return lookup;
 }
 
-bool text_lookup_add(lookup_t *lookup, const char *path)
+lookup_t *text_lookup_create_deferred(const char *path)
+{
+	struct text_lookup *lookup = lookup_new();
+
+	if (lookup && !text_lookup_add_deferred(lookup, path)) {
+		text_lookup_destroy(lookup);
+		lookup = NULL;
+	}
+
+	return lookup;
+}
+
+static bool lookup_parse_file(lookup_t *lookup, const char *path)
 {
 	struct dstr file_str;
 	char *temp = NULL;
@@ -397,12 +431,76 @@ bool text_lookup_add(lookup_t *lookup, const char *path)
 	return true;
 }
 
+/* must be called with the mutex held */
+static void lookup_parse_deferred(lookup_t *lookup)
+{
+	int prev_tag;
+
+	/* charged to whoever created the lookup rather than whichever thread
+	 * happened to ask for the first string */
+	prev_tag = bmem_set_thread_tag(lookup->mem_tag);
+
+	for (size_t i = 0; i < lookup->deferred.num; i++) {
+		char *path = lookup->deferred.array[i];
+
+		if (!lookup_parse_file(lookup, path))
+			blog(LOG_WARNING, "Failed to load text from '%s'",
+					path);
+		bfree(path);
+	}
+
+	da_free(lookup->deferred);
+	os_atomic_set_long(&lookup->num_deferred, 0);
+
+	bmem_set_thread_tag(prev_tag);
+}
+
+bool text_lookup_add(lookup_t *lookup, const char *path)
+{
+	bool success;
+
+	if (!lookup || !path)
+		return false;
+
+	/* strings from later files replace earlier ones, so anything still
+	 * deferred has to be parsed first */
+	pthread_mutex_lock(&lookup->mutex);
+	lookup_parse_deferred(lookup);
+	success = lookup_parse_file(lookup, path);
+	pthread_mutex_unlock(&lookup->mutex);
+
+	return success;
+}
+
+bool text_lookup_add_deferred(lookup_t *lookup, const char *path)
+{
+	char *file;
+
+	if (!lookup || !path || !os_file_exists(path))
+		return false;
+
+	file = bstrdup(path);
+
+	pthread_mutex_lock(&lookup->mutex);
+	da_push_back(lookup->deferred, &file);
+	os_atomic_set_long(&lookup->num_deferred,
+			(long)lookup->deferred.num);
+	pthread_mutex_unlock(&lookup->mutex);
+
+	return true;
+}
+
 void text_lookup_destroy(lookup_t *lookup)
 {
 	if (lookup) {
+		for (size_t i = 0; i < lookup->deferred.num; i++)
+			bfree(lookup->deferred.array[i]);
+		da_free(lookup->deferred);
+
 		dstr_free(&lookup->language);
 		text_node_destroy(lookup->top);
 
+		pthread_mutex_destroy(&lookup->mutex);
 		bfree(lookup);
 	}
 }
@@ -410,7 +508,14 @@ void text_lookup_destroy(lookup_t *lookup)
 bool text_lookup_getstr(lookup_t *lookup, const char *lookup_val,
 		const char **out)
 {
-	if (lookup)
-		return lookup_getstring(lookup_val, out, lookup->top);
-	return false;
+	if (!lookup)
+		return false;
+
+	if (os_atomic_load_long(&lookup->num_deferred)) {
+		pthread_mutex_lock(&lookup->mutex);
+		lookup_parse_deferred(lookup);
+		pthread_mutex_unlock(&lookup->mutex);
+	}
+
+	return lookup_getstring(lookup_val, out, lookup->top);
 }
@@ -38,6 +38,11 @@ typedef struct text_lookup lookup_t;
 EXPORT lookup_t *text_lookup_create(const char *path);
 EXPORT bool text_lookup_add(lookup_t *lookup, const char *path);
 EXPORT void text_lookup_destroy(lookup_t *lookup);
+
+/* only checks that the file exists, it's parsed on the first lookup */
+EXPORT lookup_t *text_lookup_create_deferred(const char *path);
+EXPORT bool text_lookup_add_deferred(lookup_t *lookup, const char *path);
+
 EXPORT bool text_lookup_getstr(lookup_t *lookup, const char *lookup_val,
 		const char **out);
 
@@ -30,8 +30,18 @@
 #include <pthread_np.h>
 #endif
 
+#if defined(__linux__)
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <sched.h>
+
 #include "bmem.h"
 #include "threading.h"
+#include "profiler.h"
+#include "platform.h"
 
 struct os_event_data {
 	pthread_mutex_t mutex;
@@ -261,8 +271,36 @@ bool os_atomic_compare_swap_long(volatile long *val, long old_val, long new_val)
 	return __sync_bool_compare_and_swap(val, old_val, new_val);
 }
 
+long os_atomic_load_long(const volatile long *val)
+{
+	return __atomic_load_n(val, __ATOMIC_ACQUIRE);
+}
+
+void os_atomic_set_long(volatile long *val, long new_val)
+{
+	__atomic_store_n(val, new_val, __ATOMIC_RELEASE);
+}
+
+void *os_atomic_load_ptr(void *const volatile *val)
+{
+	return __atomic_load_n(val, __ATOMIC_SEQ_CST);
+}
+
+void *os_atomic_exchange_ptr(void *volatile *val, void *new_val)
+{
+	return __atomic_exchange_n(val, new_val, __ATOMIC_SEQ_CST);
+}
+
+int64_t os_atomic_add_int64(volatile int64_t *val, int64_t add)
+{
+	return __sync_add_and_fetch(val, add);
+}
+
 void os_set_thread_name(const char *name)
 {
+	profile_set_thread_name(name);
+	os_thread_cpu_register(name);
+
 #if defined(__APPLE__)
 	pthread_setname_np(name);
 #elif defined(__FreeBSD__)
@@ -271,3 +309,82 @@ void os_set_thread_name(const char *name)
 	pthread_setname_np(pthread_self(), name);
 #endif
 }
+
+/* linux ignores the static priority for SCHED_OTHER, but applies nice
+ * values to single threads */
+#if defined(__linux__)
+static inline int get_nice_value(enum os_thread_priority priority)
+{
+	switch (priority) {
+	case OS_THREAD_PRIORITY_BELOW_NORMAL: return 5;
+	case OS_THREAD_PRIORITY_ABOVE_NORMAL: return -5;
+	case OS_THREAD_PRIORITY_HIGH:         return -10;
+	default:                              return 0;
+	}
+}
+#endif
+
+static inline int get_sched_priority(int policy,
+		enum os_thread_priority priority)
+{
+	int min = sched_get_priority_min(policy);
+	int max = sched_get_priority_max(policy);
+	int mid = (min + max) / 2;
+	int step = (max - min) / 4;
+
+	switch (priority) {
+	case OS_THREAD_PRIORITY_BELOW_NORMAL: return mid - step;
+	case OS_THREAD_PRIORITY_ABOVE_NORMAL: return mid + step;
+	case OS_THREAD_PRIORITY_HIGH:         return max;
+	case OS_THREAD_PRIORITY_REALTIME:     return min + step;
+	default:                              return mid;
+	}
+}
+
+bool os_set_thread_priority(enum os_thread_priority priority)
+{
+	struct sched_param param = {0};
+	int policy = SCHED_OTHER;
+
+	if (priority == OS_THREAD_PRIORITY_DEFAULT)
+		return true;
+
+	if (priority == OS_THREAD_PRIORITY_REALTIME)
+		policy = SCHED_RR;
+
+	param.sched_priority = get_sched_priority(policy, priority);
+	if (pthread_setschedparam(pthread_self(), policy, &param) != 0)
+		return false;
+
+#if defined(__linux__)
+	if (policy == SCHED_OTHER) {
+		id_t tid = (id_t)syscall(SYS_gettid);
+		return setpriority(PRIO_PROCESS, tid,
+				get_nice_value(priority)) == 0;
+	}
+#endif
+	return true;
+}
+
+bool os_set_thread_affinity(uint64_t mask)
+{
+#if defined(__linux__)
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	for (int i = 0; i < 64; i++) {
+		if (mask & (1ULL << i))
+			CPU_SET(i, &set);
+	}
+
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+	UNUSED_PARAMETER(mask);
+	return false;
+#endif
+}
+
+bool os_set_thread_mmcss_task(enum os_mmcss_task task)
+{
+	return task == OS_MMCSS_TASK_NONE;
+}
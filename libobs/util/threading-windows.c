@@ -16,9 +16,12 @@
 
 #include "bmem.h"
 #include "threading.h"
+#include "profiler.h"
+#include "platform.h"
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#include <errno.h>
 
 #ifdef __MINGW32__
 #include <excpt.h>
@@ -35,6 +38,88 @@
 #endif
 #endif
 
+static inline PSRWLOCK mutex_srw(os_win32_mutex_t *mutex)
+{
+	return (PSRWLOCK)&mutex->srw;
+}
+
+int os_win32_mutex_init(os_win32_mutex_t *mutex,
+		const pthread_mutexattr_t *attr)
+{
+	int type = PTHREAD_MUTEX_DEFAULT;
+
+	if (attr)
+		pthread_mutexattr_gettype(attr, &type);
+
+	InitializeSRWLock(mutex_srw(mutex));
+	mutex->owner     = 0;
+	mutex->recursion = 0;
+	mutex->recursive = type == PTHREAD_MUTEX_RECURSIVE;
+	return 0;
+}
+
+int os_win32_mutex_destroy(os_win32_mutex_t *mutex)
+{
+	UNUSED_PARAMETER(mutex);
+	return 0;
+}
+
+/* the owner can only ever equal the calling thread's id if the calling
+ * thread set it, so reading it without the lock is safe */
+int os_win32_mutex_lock(os_win32_mutex_t *mutex)
+{
+	if (mutex->recursive) {
+		DWORD thread_id = GetCurrentThreadId();
+
+		if (mutex->owner == thread_id) {
+			mutex->recursion++;
+			return 0;
+		}
+
+		AcquireSRWLockExclusive(mutex_srw(mutex));
+		mutex->owner     = thread_id;
+		mutex->recursion = 1;
+		return 0;
+	}
+
+	AcquireSRWLockExclusive(mutex_srw(mutex));
+	return 0;
+}
+
+int os_win32_mutex_trylock(os_win32_mutex_t *mutex)
+{
+	if (mutex->recursive) {
+		DWORD thread_id = GetCurrentThreadId();
+
+		if (mutex->owner == thread_id) {
+			mutex->recursion++;
+			return 0;
+		}
+
+		if (!TryAcquireSRWLockExclusive(mutex_srw(mutex)))
+			return EBUSY;
+
+		mutex->owner     = thread_id;
+		mutex->recursion = 1;
+		return 0;
+	}
+
+	return TryAcquireSRWLockExclusive(mutex_srw(mutex)) ? 0 : EBUSY;
+}
+
+int os_win32_mutex_unlock(os_win32_mutex_t *mutex)
+{
+	if (mutex->recursive) {
+		if (--mutex->recursion > 0)
+			return 0;
+
+		mutex->owner = 0;
+	}
+
+	ReleaseSRWLockExclusive(mutex_srw(mutex));
+	return 0;
+}
+
 struct os_event_data {
 	HANDLE handle;
 };
@@ -181,6 +266,32 @@ bool os_atomic_compare_swap_long(volatile long *val, long old_val, long new_val)
 	return InterlockedCompareExchange(val, new_val, old_val) == old_val;
 }
 
+long os_atomic_load_long(const volatile long *val)
+{
+	return InterlockedOr((volatile long*)val, 0);
+}
+
+void os_atomic_set_long(volatile long *val, long new_val)
+{
+	InterlockedExchange(val, new_val);
+}
+
+void *os_atomic_load_ptr(void *const volatile *val)
+{
+	return InterlockedCompareExchangePointer((void *volatile*)val,
+			NULL, NULL);
+}
+
+void *os_atomic_exchange_ptr(void *volatile *val, void *new_val)
+{
+	return InterlockedExchangePointer(val, new_val);
+}
+
+int64_t os_atomic_add_int64(volatile int64_t *val, int64_t add)
+{
+	return InterlockedExchangeAdd64((volatile LONG64*)val, add) + add;
+}
+
 #define VC_EXCEPTION 0x406D1388
 
 #pragma pack(push,8)
@@ -197,6 +308,9 @@ struct vs_threadname_info {
 
 void os_set_thread_name(const char *name)
 {
+	profile_set_thread_name(name);
+	os_thread_cpu_register(name);
+
 #ifdef __MINGW32__
 	UNUSED_PARAMETER(name);
 #else
@@ -221,3 +335,112 @@ void os_set_thread_name(const char *name)
 	}
 #endif
 }
+
+bool os_set_thread_priority(enum os_thread_priority priority)
+{
+	int value;
+
+	switch (priority) {
+	case OS_THREAD_PRIORITY_DEFAULT:
+		return true;
+	case OS_THREAD_PRIORITY_BELOW_NORMAL:
+		value = THREAD_PRIORITY_BELOW_NORMAL; break;
+	case OS_THREAD_PRIORITY_ABOVE_NORMAL:
+		value = THREAD_PRIORITY_ABOVE_NORMAL; break;
+	case OS_THREAD_PRIORITY_HIGH:
+		value = THREAD_PRIORITY_HIGHEST; break;
+	case OS_THREAD_PRIORITY_REALTIME:
+		value = THREAD_PRIORITY_TIME_CRITICAL; break;
+	default:
+		value = THREAD_PRIORITY_NORMAL;
+	}
+
+	return !!SetThreadPriority(GetCurrentThread(), value);
+}
+
+bool os_set_thread_affinity(uint64_t mask)
+{
+	DWORD_PTR process_mask, system_mask;
+
+	if (!GetProcessAffinityMask(GetCurrentProcess(), &process_mask,
+				&system_mask))
+		return false;
+
+	/* cores the process isn't allowed on can't be set for a thread */
+	mask &= (uint64_t)process_mask;
+	if (!mask)
+		return false;
+
+	return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)mask) != 0;
+}
+
+typedef HANDLE (WINAPI *set_mm_thread_characteristics_w_t)(
+		LPCWSTR task_name,
+		LPDWORD task_index);
+typedef BOOL (WINAPI *revert_mm_thread_characteristics_t)(
+		HANDLE handle);
+
+static set_mm_thread_characteristics_w_t set_mm_thread_characteristics = NULL;
+static revert_mm_thread_characteristics_t revert_mm_thread_characteristics =
+	NULL;
+static bool avrt_initialized = false;
+
+#ifdef _MSC_VER
+static __declspec(thread) HANDLE mmcss_handle = NULL;
+#else
+static __thread HANDLE mmcss_handle = NULL;
+#endif
+
+static void initialize_avrt_functions(void)
+{
+	HMODULE avrt = LoadLibraryW(L"avrt");
+
+	if (avrt) {
+		set_mm_thread_characteristics =
+			(set_mm_thread_characteristics_w_t)GetProcAddress(avrt,
+					"AvSetMmThreadCharacteristicsW");
+		revert_mm_thread_characteristics =
+			(revert_mm_thread_characteristics_t)GetProcAddress(avrt,
+					"AvRevertMmThreadCharacteristics");
+	}
+
+	avrt_initialized = true;
+}
+
+static const wchar_t *get_mmcss_task_name(enum os_mmcss_task task)
+{
+	switch (task) {
+	case OS_MMCSS_TASK_AUDIO:        return L"Audio";
+	case OS_MMCSS_TASK_PRO_AUDIO:    return L"Pro Audio";
+	case OS_MMCSS_TASK_CAPTURE:      return L"Capture";
+	case OS_MMCSS_TASK_PLAYBACK:     return L"Playback";
+	case OS_MMCSS_TASK_DISTRIBUTION: return L"Distribution";
+	case OS_MMCSS_TASK_GAMES:        return L"Games";
+	case OS_MMCSS_TASK_NONE:         break;
+	}
+
+	return NULL;
+}
+
+bool os_set_thread_mmcss_task(enum os_mmcss_task task)
+{
+	const wchar_t *name = get_mmcss_task_name(task);
+	DWORD index = 0;
+
+	if (!avrt_initialized)
+		initialize_avrt_functions();
+	if (!set_mm_thread_characteristics ||
+	    !revert_mm_thread_characteristics)
+		return task == OS_MMCSS_TASK_NONE;
+
+	if (mmcss_handle) {
+		revert_mm_thread_characteristics(mmcss_handle);
+		mmcss_handle = NULL;
+	}
+
+	if (!name)
+		return true;
+
+	mmcss_handle = set_mm_thread_characteristics(name, &index);
+	return mmcss_handle != NULL;
+}
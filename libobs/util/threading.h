@@ -37,6 +37,46 @@
 extern "C" {
 #endif
 
+#ifdef _WIN32
+/*
+ * Native windows mutexes, which are a slim reader/writer lock plus owner
+ * tracking for the recursive ones.  They are much cheaper to lock than the
+ * pthread emulation's mutexes, and need no cleanup, so the static
+ * initializer works without any lazy setup.  Unlike pthread mutexes they
+ * can't be used with pthread condition variables, which libobs doesn't use.
+ */
+struct os_win32_mutex {
+	void          *srw;
+	unsigned long owner;
+	long          recursion;
+	int           recursive;
+};
+
+typedef struct os_win32_mutex os_win32_mutex_t;
+
+#define OS_WIN32_MUTEX_INITIALIZER {NULL, 0, 0, 0}
+
+EXPORT int os_win32_mutex_init(os_win32_mutex_t *mutex,
+		const pthread_mutexattr_t *attr);
+EXPORT int os_win32_mutex_destroy(os_win32_mutex_t *mutex);
+EXPORT int os_win32_mutex_lock(os_win32_mutex_t *mutex);
+EXPORT int os_win32_mutex_trylock(os_win32_mutex_t *mutex);
+EXPORT int os_win32_mutex_unlock(os_win32_mutex_t *mutex);
+
+/* libobs itself uses the native mutexes under the pthread names.  none of
+ * its mutexes are shared with modules, which keep the pthread ones. */
+#ifdef LIBOBS_EXPORTS
+#undef PTHREAD_MUTEX_INITIALIZER
+#define PTHREAD_MUTEX_INITIALIZER OS_WIN32_MUTEX_INITIALIZER
+#define pthread_mutex_t           os_win32_mutex_t
+#define pthread_mutex_init        os_win32_mutex_init
+#define pthread_mutex_destroy     os_win32_mutex_destroy
+#define pthread_mutex_lock        os_win32_mutex_lock
+#define pthread_mutex_trylock     os_win32_mutex_trylock
+#define pthread_mutex_unlock      os_win32_mutex_unlock
+#endif
+#endif
+
 /* this may seem strange, but you can't use it unless it's an initializer */
 static inline void pthread_mutex_init_value(pthread_mutex_t *mutex)
 {
@@ -76,8 +116,80 @@ EXPORT long os_atomic_dec_long(volatile long *val);
 EXPORT bool os_atomic_compare_swap_long(volatile long *val,
 		long old_val, long new_val);
 
+/* a load that later reads can't move before, and a store that earlier
+ * writes can't move after, for handing data between threads */
+EXPORT long os_atomic_load_long(const volatile long *val);
+EXPORT void os_atomic_set_long(volatile long *val, long new_val);
+
+/* full barrier pointer loads and swaps, for publishing shared structures */
+EXPORT void *os_atomic_load_ptr(void *const volatile *val);
+EXPORT void *os_atomic_exchange_ptr(void *volatile *val, void *new_val);
+
+/* long is only 32 bits wide on windows, use this for 64 bit counters */
+EXPORT int64_t os_atomic_add_int64(volatile int64_t *val, int64_t add);
+
 EXPORT void os_set_thread_name(const char *name);
 
+/*
+ * Scheduling settings for the calling thread.  Raising the priority above
+ * normal may need extra permissions (CAP_SYS_NICE or an rtprio limit on
+ * linux), so these return false when the system refuses.
+ */
+
+enum os_thread_priority {
+	OS_THREAD_PRIORITY_DEFAULT,
+	OS_THREAD_PRIORITY_BELOW_NORMAL,
+	OS_THREAD_PRIORITY_NORMAL,
+	OS_THREAD_PRIORITY_ABOVE_NORMAL,
+	OS_THREAD_PRIORITY_HIGH,
+
+	/* time critical on windows, SCHED_RR elsewhere */
+	OS_THREAD_PRIORITY_REALTIME
+};
+
+/* multimedia class scheduler tasks, windows only */
+enum os_mmcss_task {
+	OS_MMCSS_TASK_NONE,
+	OS_MMCSS_TASK_AUDIO,
+	OS_MMCSS_TASK_PRO_AUDIO,
+	OS_MMCSS_TASK_CAPTURE,
+	OS_MMCSS_TASK_PLAYBACK,
+	OS_MMCSS_TASK_DISTRIBUTION,
+	OS_MMCSS_TASK_GAMES
+};
+
+struct os_thread_settings {
+	enum os_thread_priority priority;
+
+	/* one bit per logical core, 0 to leave the affinity alone */
+	uint64_t                affinity;
+
+	enum os_mmcss_task      mmcss_task;
+};
+
+EXPORT bool os_set_thread_priority(enum os_thread_priority priority);
+EXPORT bool os_set_thread_affinity(uint64_t mask);
+
+/* OS_MMCSS_TASK_NONE unregisters the thread again */
+EXPORT bool os_set_thread_mmcss_task(enum os_mmcss_task task);
+
+/* applies everything that isn't left at its default, returns false if any
+ * of it failed */
+static inline bool os_apply_thread_settings(
+		const struct os_thread_settings *settings)
+{
+	bool success = true;
+
+	if (settings->priority != OS_THREAD_PRIORITY_DEFAULT)
+		success &= os_set_thread_priority(settings->priority);
+	if (settings->affinity)
+		success &= os_set_thread_affinity(settings->affinity);
+	if (settings->mmcss_task != OS_MMCSS_TASK_NONE)
+		success &= os_set_thread_mmcss_task(settings->mmcss_task);
+
+	return success;
+}
+
 
 #ifdef __cplusplus
 }
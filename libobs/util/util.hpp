@@ -96,6 +96,12 @@ public:
 		return config_save_safe(config, temp_ext, backup_ext);
 	}
 
+	inline int SaveSafeAsync(const char *temp_ext,
+			const char *backup_ext = nullptr)
+	{
+		return config_save_safe_async(config, temp_ext, backup_ext);
+	}
+
 	inline void Close()
 	{
 		config_close(config);
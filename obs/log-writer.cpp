@@ -0,0 +1,317 @@
+/******************************************************************************
+    Copyright (C) 2016 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <util/base.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#include "log-writer.hpp"
+#include "obs-app.hpp"
+
+using namespace std;
+
+#define MAX_REPEATED_LINES 30
+#define MAX_CHAR_VARIATION (255 * 3)
+#define REPEAT_WINDOW_NS   1000000000ULL
+#define WRITER_IDLE_MS     100
+
+static inline int sum_chars(const char *str)
+{
+	int val = 0;
+	for (; *str != 0; str++)
+		val += *str;
+
+	return val;
+}
+
+static inline size_t site_index(const char *msg)
+{
+	uintptr_t val = reinterpret_cast<uintptr_t>(msg);
+	return (size_t)((val >> 4) ^ (val >> 12)) & (LOG_SITE_COUNT - 1);
+}
+
+LogWriter::LogWriter(fstream &file_, output_t output_)
+	: file     (file_),
+	  output   (output_),
+	  head     (0),
+	  dropped  (0),
+	  sleeping (false)
+{
+	/* record memory is left uninitialized so only the part of the ring
+	 * that is actually used gets touched.  it isn't allocated with bmalloc
+	 * because it outlives the final memory leak count. */
+	records   = static_cast<Record*>(malloc(sizeof(Record) *
+				LOG_RING_SIZE));
+	sequences = new atomic<size_t>[LOG_RING_SIZE];
+
+	for (size_t i = 0; i < LOG_RING_SIZE; i++)
+		sequences[i].store(i, memory_order_relaxed);
+
+	for (Site &site : sites) {
+		site.msg.store(nullptr, memory_order_relaxed);
+		site.charSum.store(0, memory_order_relaxed);
+		site.windowStart.store(0, memory_order_relaxed);
+		site.count.store(0, memory_order_relaxed);
+		site.suppressed.store(0, memory_order_relaxed);
+	}
+
+	thread = std::thread(&LogWriter::Run, this);
+}
+
+LogWriter::~LogWriter()
+{
+	{
+		lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		wake.notify_one();
+	}
+
+	thread.join();
+
+	delete[] sequences;
+	free(records);
+}
+
+/* a call site may log this many similar lines per window, anything past that
+ * is only counted and reported once the run ends.  races between threads
+ * logging from the same site only make the count slightly inexact. */
+bool LogWriter::Allow(const char *msg, const char *str, uint64_t now)
+{
+	Site &site = sites[site_index(msg)];
+	int newSum = sum_chars(str);
+
+	bool similar = site.msg.load(memory_order_relaxed) == msg &&
+		abs(newSum - site.charSum.load(memory_order_relaxed)) <
+		MAX_CHAR_VARIATION;
+	bool expired = now - site.windowStart.load(memory_order_relaxed) >=
+		REPEAT_WINDOW_NS;
+
+	if (similar && !expired) {
+		if (site.count.fetch_add(1, memory_order_relaxed) <
+				MAX_REPEATED_LINES)
+			return true;
+
+		site.suppressed.fetch_add(1, memory_order_relaxed);
+		return false;
+	}
+
+	long suppressed = site.suppressed.exchange(0, memory_order_relaxed);
+
+	site.msg.store(msg, memory_order_relaxed);
+	site.charSum.store(newSum, memory_order_relaxed);
+	site.windowStart.store(now, memory_order_relaxed);
+	site.count.store(0, memory_order_relaxed);
+
+	if (suppressed) {
+		char report[128];
+		snprintf(report, sizeof(report),
+				"Last log entry repeated for %ld more lines",
+				suppressed);
+		Push(LOG_INFO, report);
+	}
+
+	return true;
+}
+
+/* bounded multi-producer queue: each slot's sequence says whether it is free
+ * for the producer at that position or filled for the consumer */
+void LogWriter::Push(int level, const char *str)
+{
+	size_t pos = head.load(memory_order_relaxed);
+	Record *record;
+
+	for (;;) {
+		atomic<size_t> &seq = sequences[pos & (LOG_RING_SIZE - 1)];
+		intptr_t diff = (intptr_t)seq.load(memory_order_acquire) -
+			(intptr_t)pos;
+
+		if (diff == 0) {
+			if (head.compare_exchange_weak(pos, pos + 1,
+						memory_order_relaxed))
+				break;
+		} else if (diff < 0) {
+			dropped.fetch_add(1, memory_order_relaxed);
+			return;
+		} else {
+			pos = head.load(memory_order_relaxed);
+		}
+	}
+
+	record = &records[pos & (LOG_RING_SIZE - 1)];
+	record->time  = clock::now();
+	record->level = level;
+	strncpy(record->text, str, LOG_RECORD_SIZE - 1);
+	record->text[LOG_RECORD_SIZE - 1] = 0;
+
+	sequences[pos & (LOG_RING_SIZE - 1)].store(pos + 1,
+			memory_order_release);
+
+	if (sleeping.load(memory_order_relaxed))
+		wake.notify_one();
+}
+
+void LogWriter::Write(int level, const char *msg, const char *str)
+{
+	if (Allow(msg, str, os_gettime_ns()))
+		Push(level, str);
+}
+
+bool LogWriter::Empty() const
+{
+	return sequences[tail & (LOG_RING_SIZE - 1)].load(
+			memory_order_acquire) != tail + 1;
+}
+
+static inline void LogString(fstream &logFile, const char *timeString,
+		char *str)
+{
+	logFile << timeString << str << endl;
+}
+
+static inline void LogStringChunk(fstream &logFile, const string &time,
+		char *str)
+{
+	char *nextLine = str;
+	string timeString = time;
+	timeString += ": ";
+
+	while (*nextLine) {
+		char *nextLine = strchr(str, '\n');
+		if (!nextLine)
+			break;
+
+		if (nextLine != str && nextLine[-1] == '\r') {
+			nextLine[-1] = 0;
+		} else {
+			nextLine[0] = 0;
+		}
+
+		LogString(logFile, timeString.c_str(), str);
+		nextLine++;
+		str = nextLine;
+	}
+
+	LogString(logFile, timeString.c_str(), str);
+}
+
+void LogWriter::WriteLine(clock::time_point time, int level, const char *str)
+{
+	char text[128];
+	strncpy(text, str, sizeof(text) - 1);
+	text[sizeof(text) - 1] = 0;
+
+	output(level, text);
+	if (level <= LOG_INFO)
+		LogStringChunk(file, TimeString(time), text);
+}
+
+void LogWriter::Drain()
+{
+	while (!Empty()) {
+		size_t idx = tail & (LOG_RING_SIZE - 1);
+		Record *record = &records[idx];
+
+		output(record->level, record->text);
+		if (record->level <= LOG_INFO)
+			LogStringChunk(file, TimeString(record->time),
+					record->text);
+
+		sequences[idx].store(tail + LOG_RING_SIZE,
+				memory_order_release);
+		tail++;
+	}
+
+	long lost = dropped.exchange(0, memory_order_relaxed);
+	if (lost) {
+		char report[128];
+		snprintf(report, sizeof(report),
+				"%ld log entries were dropped because the "
+				"log writer fell behind", lost);
+		WriteLine(clock::now(), LOG_WARNING, report);
+	}
+}
+
+/* runs that end without the call site logging again would otherwise never
+ * be reported */
+void LogWriter::ReportSuppressed(uint64_t now)
+{
+	for (Site &site : sites) {
+		if (!site.suppressed.load(memory_order_relaxed))
+			continue;
+		if (now - site.windowStart.load(memory_order_relaxed) <
+				REPEAT_WINDOW_NS)
+			continue;
+
+		long suppressed = site.suppressed.exchange(0,
+				memory_order_relaxed);
+		if (!suppressed)
+			continue;
+
+		char report[128];
+		snprintf(report, sizeof(report),
+				"Last log entry repeated for %ld more lines",
+				suppressed);
+		WriteLine(clock::now(), LOG_INFO, report);
+	}
+}
+
+void LogWriter::Run()
+{
+	os_set_thread_name("log writer");
+
+	unique_lock<std::mutex> lock(mutex);
+
+	for (;;) {
+		lock.unlock();
+		Drain();
+		ReportSuppressed(os_gettime_ns());
+		lock.lock();
+
+		written = tail;
+		flushed.notify_all();
+
+		if (stopping && Empty())
+			break;
+
+		sleeping = true;
+		wake.wait_for(lock, chrono::milliseconds(WRITER_IDLE_MS),
+				[this] ()
+				{
+					return stopping || flushRequested ||
+						!Empty();
+				});
+		sleeping = false;
+		flushRequested = false;
+	}
+}
+
+void LogWriter::Flush()
+{
+	size_t target = head.load(memory_order_acquire);
+
+	unique_lock<std::mutex> lock(mutex);
+	flushRequested = true;
+	wake.notify_one();
+
+	flushed.wait(lock, [&] ()
+	{
+		return (intptr_t)(written - target) >= 0 || stopping;
+	});
+}
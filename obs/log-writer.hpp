@@ -0,0 +1,105 @@
+/******************************************************************************
+    Copyright (C) 2016 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <stdint.h>
+
+#define LOG_RING_SIZE   1024
+#define LOG_RECORD_SIZE 4096
+#define LOG_SITE_COUNT  256
+
+/*
+ * Writes log lines from a background thread.
+ *
+ * Threads that log only format their message and copy it into a fixed ring
+ * of records, which never blocks: when the ring is full the line is dropped
+ * and counted instead.  Records keep the time they were logged at; the
+ * writer thread passes each one to the output callback and writes the ones
+ * up to LOG_INFO to the log file.  Runs of similar lines from the same call
+ * site are limited to a burst per second, replacing the old repeated entry
+ * detection.
+ */
+class LogWriter {
+public:
+	typedef void (*output_t)(int log_level, const char *str);
+
+private:
+	typedef std::chrono::system_clock clock;
+
+	struct Record {
+		clock::time_point time;
+		int               level;
+		char              text[LOG_RECORD_SIZE];
+	};
+
+	struct Site {
+		std::atomic<const char*> msg;
+		std::atomic<int>         charSum;
+		std::atomic<uint64_t>    windowStart;
+		std::atomic<long>        count;
+		std::atomic<long>        suppressed;
+	};
+
+	std::fstream             &file;
+	output_t                 output;
+
+	Record                   *records;
+	std::atomic<size_t>      *sequences;
+	std::atomic<size_t>      head;
+	size_t                   tail = 0;
+	std::atomic<long>        dropped;
+
+	Site                     sites[LOG_SITE_COUNT];
+
+	std::mutex               mutex;
+	std::condition_variable  wake;
+	std::condition_variable  flushed;
+	std::atomic<bool>        sleeping;
+	size_t                   written = 0;
+	bool                     flushRequested = false;
+	bool                     stopping = false;
+	std::thread              thread;
+
+	bool Allow(const char *msg, const char *str, uint64_t now);
+	void Push(int level, const char *str);
+	bool Empty() const;
+	void Drain();
+	void ReportSuppressed(uint64_t now);
+	void WriteLine(clock::time_point time, int level, const char *str);
+	void Run();
+
+public:
+	LogWriter(std::fstream &file, output_t output);
+	~LogWriter();
+
+	/**
+	 * Queues a formatted line.  msg is the unformatted message, which
+	 * identifies the call site for rate limiting.  Safe to call from any
+	 * thread, including real-time ones; it never blocks.
+	 */
+	void Write(int level, const char *msg, const char *str);
+
+	/** Waits until everything queued so far is in the log file */
+	void Flush();
+};
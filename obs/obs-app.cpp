@@ -37,6 +37,7 @@
 #include "window-basic-settings.hpp"
 #include "window-license-agreement.hpp"
 #include "crash-report.hpp"
+#include "log-writer.hpp"
 #include "platform.hpp"
 
 #include <fstream>
@@ -52,11 +53,13 @@
 using namespace std;
 
 static log_handler_t def_log_handler;
+static unique_ptr<LogWriter> logWriter;
 
 static string currentLogFile;
 static string lastLogFile;
 
 static bool portable_mode = false;
+static bool headless_mode = false;
 
 QObject *CreateShortcutFilter()
 {
@@ -171,14 +174,13 @@ QObject *CreateShortcutFilter()
 	});
 }
 
-string CurrentTimeString()
+string TimeString(std::chrono::system_clock::time_point tp)
 {
 	using namespace std::chrono;
 
 	struct tm  tstruct;
 	char       buf[80];
 
-	auto tp = system_clock::now();
 	auto now = system_clock::to_time_t(tp);
 	tstruct = *localtime(&now);
 
@@ -197,6 +199,11 @@ string CurrentTimeString()
 	return buf;
 }
 
+string CurrentTimeString()
+{
+	return TimeString(std::chrono::system_clock::now());
+}
+
 string CurrentDateTimeString()
 {
 	time_t     now = time(0);
@@ -207,108 +214,35 @@ string CurrentDateTimeString()
 	return buf;
 }
 
-static inline void LogString(fstream &logFile, const char *timeString,
-		char *str)
-{
-	logFile << timeString << str << endl;
-}
-
-static inline void LogStringChunk(fstream &logFile, char *str)
-{
-	char *nextLine = str;
-	string timeString = CurrentTimeString();
-	timeString += ": ";
-
-	while (*nextLine) {
-		char *nextLine = strchr(str, '\n');
-		if (!nextLine)
-			break;
-
-		if (nextLine != str && nextLine[-1] == '\r') {
-			nextLine[-1] = 0;
-		} else {
-			nextLine[0] = 0;
-		}
-
-		LogString(logFile, timeString.c_str(), str);
-		nextLine++;
-		str = nextLine;
-	}
-
-	LogString(logFile, timeString.c_str(), str);
-}
-
-#define MAX_REPEATED_LINES 30
-#define MAX_CHAR_VARIATION (255 * 3)
-
-static inline int sum_chars(const char *str)
+#ifndef _WIN32
+static void def_log_output(int log_level, const char *format, ...)
 {
-	int val = 0;
-	for (; *str != 0; str++)
-		val += *str;
-
-	return val;
+	va_list args;
+	va_start(args, format);
+	def_log_handler(log_level, format, args, nullptr);
+	va_end(args);
 }
-
-static inline bool too_many_repeated_entries(fstream &logFile, const char *msg,
-		const char *output_str)
-{
-	static mutex log_mutex;
-	static const char *last_msg_ptr = nullptr;
-	static int last_char_sum = 0;
-	static char cmp_str[4096];
-	static int rep_count = 0;
-
-	int new_sum = sum_chars(output_str);
-
-	lock_guard<mutex> guard(log_mutex);
-
-	if (last_msg_ptr == msg) {
-		int diff = std::abs(new_sum - last_char_sum);
-		if (diff < MAX_CHAR_VARIATION) {
-			return (rep_count++ >= MAX_REPEATED_LINES);
-		}
-	}
-
-	if (rep_count > MAX_REPEATED_LINES) {
-		logFile << CurrentTimeString() <<
-			": Last log entry repeated for " <<
-			to_string(rep_count - MAX_REPEATED_LINES) <<
-			" more lines" << endl;
-	}
-
-	last_msg_ptr = msg;
-	strcpy(cmp_str, output_str);
-	last_char_sum = new_sum;
-	rep_count = 0;
-
-	return false;
-}
-
-static void do_log(int log_level, const char *msg, va_list args, void *param)
-{
-	fstream &logFile = *static_cast<fstream*>(param);
-	char str[4096];
-
-#ifndef _WIN32
-	va_list args2;
-	va_copy(args2, args);
 #endif
 
-	vsnprintf(str, 4095, msg, args);
-
+/* called from the log writer thread */
+static void log_output(int log_level, const char *str)
+{
 #ifdef _WIN32
 	OutputDebugStringA(str);
 	OutputDebugStringA("\n");
+	UNUSED_PARAMETER(log_level);
 #else
-	def_log_handler(log_level, msg, args2, nullptr);
+	def_log_output(log_level, "%s", str);
 #endif
+}
 
-	if (too_many_repeated_entries(logFile, msg, str))
-		return;
+static void do_log(int log_level, const char *msg, va_list args, void *param)
+{
+	LogWriter *writer = static_cast<LogWriter*>(param);
+	char str[LOG_RECORD_SIZE];
 
-	if (log_level <= LOG_INFO)
-		LogStringChunk(logFile, str);
+	vsnprintf(str, sizeof(str), msg, args);
+	writer->Write(log_level, msg, str);
 
 #ifdef _WIN32
 	if (log_level <= LOG_ERROR && IsDebuggerPresent())
@@ -316,6 +250,12 @@ static void do_log(int log_level, const char *msg, va_list args, void *param)
 #endif
 }
 
+void FlushLog()
+{
+	if (logWriter)
+		logWriter->Flush();
+}
+
 #define DEFAULT_LANG "en-US"
 
 bool OBSApp::InitGlobalConfigDefaults()
@@ -643,6 +583,10 @@ const char *OBSApp::GetRenderModule() const
 	const char *renderer = config_get_string(globalConfig, "Video",
 			"Renderer");
 
+	/* the EGL module needs no window system at all */
+	if (headless_mode && *DL_OPENGL_EGL)
+		return DL_OPENGL_EGL;
+
 	return (astrcmpi(renderer, "Direct3D 11") == 0) ?
 		DL_D3D11 : DL_OPENGL;
 }
@@ -657,12 +601,24 @@ static bool StartupOBS(const char *locale, profiler_name_store_t *store)
 	return obs_startup(locale, path, store);
 }
 
+bool OBSApp::IsHeadless() const
+{
+	return headless_mode;
+}
+
 bool OBSApp::OBSInit()
 {
 	ProfileScope("OBSApp::OBSInit");
 
 	bool licenseAccepted = config_get_bool(globalConfig, "General",
 			"LicenseAccepted");
+
+	if (headless_mode && !licenseAccepted) {
+		blog(LOG_ERROR, "The license has to be accepted before running "
+		                "headless");
+		return false;
+	}
+
 	OBSLicenseAgreement agreement(nullptr);
 
 	if (licenseAccepted || agreement.exec() == QDialog::Accepted) {
@@ -938,7 +894,8 @@ static void create_log_file(fstream &logFile)
 
 	if (logFile.is_open()) {
 		delete_oldest_file("obs-studio/logs");
-		base_set_log_handler(do_log, &logFile);
+		logWriter.reset(new LogWriter(logFile, log_output));
+		base_set_log_handler(do_log, logWriter.get());
 	} else {
 		blog(LOG_ERROR, "Failed to open log file");
 	}
@@ -972,28 +929,101 @@ ProfilerSnapshot GetSnapshot()
 	return ProfilerSnapshot{profile_snapshot_create(), SnapshotRelease};
 }
 
-static void SaveProfilerData(const ProfilerSnapshot &snap)
+/* profiler data is named after the log file of the same session */
+static char *GetProfilerDataPath(const char *extension)
 {
 	if (currentLogFile.empty())
-		return;
+		return nullptr;
 
 	auto pos = currentLogFile.rfind('.');
 	if (pos == currentLogFile.npos)
-		return;
+		return nullptr;
 
 #define LITERAL_SIZE(x) x, (sizeof(x) - 1)
 	ostringstream dst;
 	dst.write(LITERAL_SIZE("obs-studio/profiler_data/"));
 	dst.write(currentLogFile.c_str(), pos);
-	dst.write(LITERAL_SIZE(".csv.gz"));
+	dst << extension;
 #undef LITERAL_SIZE
 
-	BPtr<char> path = GetConfigPathPtr(dst.str().c_str());
+	return GetConfigPathPtr(dst.str().c_str());
+}
+
+static void SaveProfilerData(const ProfilerSnapshot &snap)
+{
+	BPtr<char> path = GetProfilerDataPath(".csv.gz");
+	if (!path)
+		return;
+
 	if (!profiler_snapshot_dump_csv_gz(snap.get(), path))
 		blog(LOG_WARNING, "Could not save profiler data to '%s'",
 				static_cast<const char*>(path));
 }
 
+/* ------------------------------------------------------------------------- */
+/* Startup timeline
+ *
+ * Everything from the start of run_program to the first frame rendered with
+ * the scene collection loaded is traced, and saved in the Chrome/Perfetto
+ * trace event format next to the profiler data of the session, so startup
+ * regressions can be compared between releases.  Tracing only records
+ * timestamps, and the trace is also merged into the snapshot printed at
+ * exit. */
+
+static uint64_t startup_time = 0;
+static const char *startup_first_frame_name = "startup_first_frame";
+
+static void SaveStartupTimeline()
+{
+	BPtr<char> path = GetProfilerDataPath("-startup.json");
+	if (!path)
+		return;
+
+	if (!profiler_trace_dump_json(path))
+		blog(LOG_WARNING, "Could not save startup timeline to '%s'",
+				static_cast<const char*>(path));
+}
+
+void OBSApp::WaitForStartupFrame()
+{
+	startupInitEnd = os_gettime_ns();
+
+	signal_handler_connect(obs_get_signal_handler(), "frame_rendered",
+			OBSApp::FrameRendered, this);
+	obs_signal_next_frame();
+}
+
+void OBSApp::FrameRendered(void *data, calldata_t *params)
+{
+	OBSApp *app = static_cast<OBSApp*>(data);
+	qulonglong timestamp = (qulonglong)calldata_int(params, "timestamp");
+
+	QMetaObject::invokeMethod(app, "StartupFrameRendered",
+			Qt::QueuedConnection,
+			Q_ARG(qulonglong, timestamp));
+}
+
+void OBSApp::StartupFrameRendered(qulonglong timestamp)
+{
+	if (!startupInitEnd)
+		return;
+
+	signal_handler_disconnect(obs_get_signal_handler(), "frame_rendered",
+			OBSApp::FrameRendered, this);
+
+	/* the time between the end of initialization and the first frame
+	 * (showing the window, the first tick of every source) */
+	profile_start_at(startup_first_frame_name, startupInitEnd);
+	profile_end_at(startup_first_frame_name, timestamp);
+	startupInitEnd = 0;
+
+	profiler_trace_stop();
+	SaveStartupTimeline();
+
+	blog(LOG_INFO, "Startup: first frame rendered after %.1f ms",
+			(double)(timestamp - startup_time) / 1000000.0);
+}
+
 static auto ProfilerFree = [](void *)
 {
 	profiler_stop();
@@ -1002,6 +1032,7 @@ static auto ProfilerFree = [](void *)
 
 	profiler_print(snap.get());
 	profiler_print_time_between_calls(snap.get());
+	bmem_log_tag_stats();
 
 	SaveProfilerData(snap);
 
@@ -1015,11 +1046,17 @@ static int run_program(fstream &logFile, int argc, char *argv[])
 
 	auto profilerNameStore = CreateNameStore();
 
+	os_thread_cpu_register("obs: UI thread");
+
 	std::unique_ptr<void, decltype(ProfilerFree)>
 		prof_release(static_cast<void*>(&ProfilerFree),
 				ProfilerFree);
 
+	startup_time = os_gettime_ns();
+
+	/* traced until the first frame, see StartupFrameRendered */
 	profiler_start();
+	profiler_trace_start();
 	profile_register_root(run_program_init, 0);
 
 	auto PrintInitProfile = [&]()
@@ -1040,6 +1077,12 @@ static int run_program(fstream &logFile, int argc, char *argv[])
 
 	QCoreApplication::addLibraryPath(".");
 
+#if !defined(_WIN32) && !defined(__APPLE__)
+	/* no windows are ever shown, so don't require a display server */
+	if (headless_mode && !getenv("QT_QPA_PLATFORM"))
+		setenv("QT_QPA_PLATFORM", "offscreen", 1);
+#endif
+
 	OBSApp program(argc, argv, profilerNameStore.get());
 	try {
 		program.AppInit();
@@ -1057,6 +1100,8 @@ static int run_program(fstream &logFile, int argc, char *argv[])
 		prof.Stop();
 		PrintInitProfile();
 
+		program.WaitForStartupFrame();
+
 		return program.exec();
 
 	} catch (const char *error) {
@@ -1428,6 +1473,9 @@ int main(int argc, char *argv[])
 	for (int i = 1; i < argc; i++) {
 		if (arg_is(argv[i], "--portable", "-p")) {
 			portable_mode = true;
+
+		} else if (arg_is(argv[i], "--headless", nullptr)) {
+			headless_mode = true;
 		}
 	}
 
@@ -1447,8 +1495,10 @@ int main(int argc, char *argv[])
 
 	curl_global_init(CURL_GLOBAL_ALL);
 	int ret = run_program(logFile, argc, argv);
+	config_wait_saves();
 
 	blog(LOG_INFO, "Number of memory leaks: %ld", bnum_allocs());
 	base_set_log_handler(nullptr, nullptr);
+	logWriter.reset();
 	return ret;
 }
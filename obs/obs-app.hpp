@@ -27,12 +27,15 @@
 #include <string>
 #include <memory>
 #include <vector>
+#include <chrono>
 
 #include "window-main.hpp"
 
+std::string TimeString(std::chrono::system_clock::time_point tp);
 std::string CurrentTimeString();
 std::string CurrentDateTimeString();
 std::string GenerateTimeDateFilename(const char *extension);
+void FlushLog();
 QObject *CreateShortcutFilter();
 
 struct BaseLexer {
@@ -64,17 +67,24 @@ private:
 	OBSContext                     obsContext;
 	QPointer<OBSMainWindow>        mainWindow;
 	profiler_name_store_t          *profilerNameStore = nullptr;
+	uint64_t                       startupInitEnd = 0;
 
 	bool InitGlobalConfig();
 	bool InitGlobalConfigDefaults();
 	bool InitLocale();
 	bool InitTheme();
 
+	static void FrameRendered(void *data, calldata_t *params);
+
+private slots:
+	void StartupFrameRendered(qulonglong timestamp);
+
 public:
 	OBSApp(int &argc, char **argv, profiler_name_store_t *store);
 
 	void AppInit();
 	bool OBSInit();
+	void WaitForStartupFrame();
 
 	inline QMainWindow *GetMainWindow() const {return mainWindow.data();}
 
@@ -109,6 +119,7 @@ public:
 	const char *OutputAudioSource() const;
 
 	const char *GetRenderModule() const;
+	bool IsHeadless() const;
 };
 
 int GetConfigPath(char *path, size_t size, const char *name);
@@ -0,0 +1,189 @@
+/******************************************************************************
+    Copyright (C) 2016 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "scene-collection-saver.hpp"
+
+SceneCollectionSaver::SceneCollectionSaver()
+{
+	start();
+}
+
+SceneCollectionSaver::~SceneCollectionSaver()
+{
+	{
+		QMutexLocker locker(&mutex);
+		exiting = true;
+		jobReady.wakeAll();
+	}
+
+	wait();
+}
+
+/* the returned JSON stays valid until newCache is changed again.  sources
+ * that are gone simply don't make it into the new cache, and a new source
+ * that reuses an old address can't match the old entry because generations
+ * are never reused */
+const std::string &SceneCollectionSaver::SourceJson(obs_source_t *source,
+		SourceCache &newCache)
+{
+	long generation = obs_source_get_save_generation(source);
+
+	auto it = cache.find(source);
+	if (it != cache.end() && it->second.generation == generation) {
+		CachedSource &entry = newCache[source];
+		entry.generation = generation;
+		entry.json.swap(it->second.json);
+		cache.erase(it);
+		return entry.json;
+	}
+
+	auto existing = newCache.find(source);
+	if (existing != newCache.end() &&
+	    existing->second.generation == generation)
+		return existing->second.json;
+
+	obs_data_t *data = obs_save_source(source);
+	CachedSource &entry = newCache[source];
+
+	/* saving can change the generation, e.g. when a source writes its
+	 * settings back, so read it afterwards */
+	entry.generation = obs_source_get_save_generation(source);
+	entry.json = obs_data_get_json(data);
+	obs_data_release(data);
+
+	return entry.json;
+}
+
+void SceneCollectionSaver::Save(obs_data_t *header,
+		const std::vector<std::pair<const char*, obs_source_t*>> &objects,
+		const char *path, bool wait)
+{
+	struct EnumData {
+		SceneCollectionSaver *saver;
+		SourceCache          *newCache;
+		SaveJob              *job;
+	};
+
+	SourceCache newCache;
+	SaveJob job;
+	job.header = header;
+	job.path   = path;
+
+	for (auto &object : objects)
+		job.objects.emplace_back(object.first,
+				SourceJson(object.second, newCache));
+
+	EnumData data = {this, &newCache, &job};
+
+	obs_enum_sources([] (void *param, obs_source_t *source)
+	{
+		EnumData *data = reinterpret_cast<EnumData*>(param);
+		data->job->sources.push_back(
+				data->saver->SourceJson(source,
+					*data->newCache));
+		return true;
+	}, &data);
+
+	cache.swap(newCache);
+
+	if (wait) {
+		WaitIdle(job.path);
+		WriteJob(job);
+		return;
+	}
+
+	QMutexLocker locker(&mutex);
+	pending    = std::move(job);
+	hasPending = true;
+	jobReady.wakeOne();
+}
+
+void SceneCollectionSaver::WaitIdle(const std::string &path)
+{
+	QMutexLocker locker(&mutex);
+
+	/* an unwritten save of the same file is older than the caller's, so
+	 * it can be dropped; saves of other files still have to happen */
+	if (hasPending && pending.path == path) {
+		pending    = SaveJob();
+		hasPending = false;
+	}
+
+	while (hasPending || writing)
+		jobDone.wait(&mutex);
+}
+
+void SceneCollectionSaver::Flush()
+{
+	QMutexLocker locker(&mutex);
+
+	while (hasPending || writing)
+		jobDone.wait(&mutex);
+}
+
+void SceneCollectionSaver::WriteJob(const SaveJob &job)
+{
+	obs_data_t *saveData = job.header;
+	obs_data_array_t *sourcesArray = obs_data_array_create();
+
+	for (auto &object : job.objects) {
+		obs_data_t *data =
+			obs_data_create_from_json(object.second.c_str());
+		obs_data_set_obj(saveData, object.first.c_str(), data);
+		obs_data_release(data);
+	}
+
+	for (auto &json : job.sources) {
+		obs_data_t *data = obs_data_create_from_json(json.c_str());
+		obs_data_array_push_back(sourcesArray, data);
+		obs_data_release(data);
+	}
+
+	obs_data_set_array(saveData, "sources", sourcesArray);
+	obs_data_array_release(sourcesArray);
+
+	if (!obs_data_save_json_safe(saveData, job.path.c_str(), "tmp", "bak"))
+		blog(LOG_ERROR, "Could not save scene data to %s",
+				job.path.c_str());
+}
+
+void SceneCollectionSaver::run()
+{
+	QMutexLocker locker(&mutex);
+
+	for (;;) {
+		while (!hasPending && !exiting)
+			jobReady.wait(&mutex);
+
+		/* finish the last save before exiting */
+		if (!hasPending)
+			break;
+
+		SaveJob job = std::move(pending);
+		pending    = SaveJob();
+		hasPending = false;
+		writing    = true;
+
+		locker.unlock();
+		WriteJob(job);
+		job = SaveJob();
+		locker.relock();
+
+		writing = false;
+		jobDone.wakeAll();
+	}
+}
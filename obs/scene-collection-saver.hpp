@@ -0,0 +1,90 @@
+/******************************************************************************
+    Copyright (C) 2016 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <obs.hpp>
+#include <string>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+
+/*
+ * Writes scene collections from a background thread.
+ *
+ * Sources are still saved on the UI thread, as their save callbacks expect,
+ * but only when their save generation has changed since the last save; the
+ * JSON of unchanged sources is reused.  Putting the file together, turning it
+ * into JSON and writing it happens on the saver's thread, so the UI only pays
+ * for what actually changed.
+ */
+class SceneCollectionSaver : public QThread {
+	Q_OBJECT
+
+	struct CachedSource {
+		long        generation;
+		std::string json;
+	};
+
+	typedef std::unordered_map<obs_source_t*, CachedSource> SourceCache;
+
+	struct SaveJob {
+		OBSData                  header;
+		std::vector<std::string> sources;
+		std::vector<std::pair<std::string, std::string>> objects;
+		std::string              path;
+	};
+
+	SourceCache    cache;
+
+	QMutex         mutex;
+	QWaitCondition jobReady;
+	QWaitCondition jobDone;
+	SaveJob        pending;
+	bool           hasPending = false;
+	bool           writing = false;
+	bool           exiting = false;
+
+	const std::string &SourceJson(obs_source_t *source,
+			SourceCache &newCache);
+	static void WriteJob(const SaveJob &job);
+	void WaitIdle(const std::string &path);
+
+	void run() override;
+
+public:
+	SceneCollectionSaver();
+	~SceneCollectionSaver();
+
+	/**
+	 * Saves all sources along with header, which must not be used
+	 * elsewhere afterwards.  objects are extra sources stored under the
+	 * given names in the header, such as the audio devices.  With wait
+	 * the file is written before returning, otherwise it is written in
+	 * the background and superseded by any later save.
+	 */
+	void Save(obs_data_t *header,
+			const std::vector<std::pair<const char*,
+				obs_source_t*>> &objects,
+			const char *path, bool wait);
+
+	/** Waits for any background save to finish */
+	void Flush();
+};
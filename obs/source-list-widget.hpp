@@ -12,6 +12,9 @@ public:
 	inline SourceListWidget(QWidget *parent = nullptr)
 		: QListWidget(parent)
 	{
+		/* rows are painted by VisibilityItemDelegate and all share
+		 * one height, which lets the view skip measuring every row */
+		setUniformItemSizes(true);
 	}
 
 	bool IgnoreReorder() const { return ignoreReorder; }
@@ -1,262 +1,216 @@
 #include "visibility-item-widget.hpp"
-#include "visibility-checkbox.hpp"
 #include "qt-wrappers.hpp"
 #include "obs-app.hpp"
+#include <QApplication>
 #include <QListWidget>
-#include <QLineEdit>
-#include <QHBoxLayout>
-#include <QMessageBox>
-#include <QLabel>
-
-VisibilityItemWidget::VisibilityItemWidget(obs_source_t *source_)
-	: source        (source_),
-	  enabledSignal (obs_source_get_signal_handler(source), "enable",
-	                 OBSSourceEnabled, this),
-	  renamedSignal (obs_source_get_signal_handler(source), "rename",
-	                 OBSSourceRenamed, this)
-{
-	const char *name = obs_source_get_name(source);
-	bool enabled = obs_source_enabled(source);
-
-	vis = new VisibilityCheckBox();
-	vis->setSizePolicy(QSizePolicy::Maximum, QSizePolicy::Maximum);
-	/* Fix for non-apple systems where the spacing would be too big */
-#ifndef __APPLE__
-	vis->setMaximumSize(16, 16);
-#endif
-	vis->setChecked(enabled);
-
-	label = new QLabel(QT_UTF8(name));
-	label->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Preferred);
+#include <QMouseEvent>
+#include <QPainter>
+#include <algorithm>
 
-	QHBoxLayout *itemLayout = new QHBoxLayout();
-	itemLayout->addWidget(vis);
-	itemLayout->addWidget(label);
-	itemLayout->setContentsMargins(5, 2, 5, 2);
+Q_DECLARE_METATYPE(OBSSceneItem);
+Q_DECLARE_METATYPE(OBSSource);
 
-	setLayout(itemLayout);
-	setStyleSheet("background-color: rgba(255, 255, 255, 0);");
+#define ITEM_MARGIN_X 5
+#define ITEM_MARGIN_Y 2
+#define ITEM_SPACING  6
+#define CHECK_SIZE    16
 
-	connect(vis, SIGNAL(clicked(bool)),
-			this, SLOT(VisibilityClicked(bool)));
+VisibilityItemDelegate::VisibilityItemDelegate(QObject *parent)
+	: QStyledItemDelegate(parent)
+{
+	checkedImage =
+		QPixmap::fromImage(QImage(":/res/images/visible_mask.png"));
+	uncheckedImage =
+		QPixmap::fromImage(QImage(":/res/images/invisible_mask.png"));
 }
 
-VisibilityItemWidget::VisibilityItemWidget(obs_sceneitem_t *item_)
-	: item          (item_),
-	  source        (obs_sceneitem_get_source(item)),
-	  renamedSignal (obs_source_get_signal_handler(source), "rename",
-	                 OBSSourceRenamed, this)
+static QPixmap TintPixmap(const QPixmap &pixmap, const QColor &color)
 {
-	const char *name = obs_source_get_name(source);
-	bool enabled = obs_sceneitem_visible(item);
-	obs_scene_t *scene = obs_sceneitem_get_scene(item);
-	obs_source_t *sceneSource = obs_scene_get_source(scene);
-
-	vis = new VisibilityCheckBox();
-	vis->setSizePolicy(QSizePolicy::Maximum, QSizePolicy::Maximum);
-	/* Fix for non-apple systems where the spacing would be too big */
-#ifndef __APPLE__
-	vis->setMaximumSize(16, 16);
-#endif
-	vis->setChecked(enabled);
-
-	label = new QLabel(QT_UTF8(name));
-	label->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Preferred);
-
-	QHBoxLayout *itemLayout = new QHBoxLayout();
-	itemLayout->addWidget(vis);
-	itemLayout->addWidget(label);
-	itemLayout->setContentsMargins(5, 2, 5, 2);
-
-	setLayout(itemLayout);
-	setStyleSheet("background-color: rgba(255, 255, 255, 0);");
+	QImage image(pixmap.size(), QImage::Format_ARGB32);
 
-	signal_handler_t *signal = obs_source_get_signal_handler(sceneSource);
-	signal_handler_connect(signal, "remove", OBSSceneRemove, this);
-	signal_handler_connect(signal, "item_remove", OBSSceneItemRemove,
-			this);
-	signal_handler_connect(signal, "item_visible", OBSSceneItemVisible,
-			this);
+	QPainter draw(&image);
+	draw.setCompositionMode(QPainter::CompositionMode_Source);
+	draw.drawPixmap(0, 0, pixmap.width(), pixmap.height(), pixmap);
+	draw.setCompositionMode(QPainter::CompositionMode_SourceIn);
+	draw.fillRect(QRectF(QPointF(0.0f, 0.0f), pixmap.size()), color);
+	draw.end();
 
-	connect(vis, SIGNAL(clicked(bool)),
-			this, SLOT(VisibilityClicked(bool)));
+	return QPixmap::fromImage(image);
 }
 
-VisibilityItemWidget::~VisibilityItemWidget()
+/* the masks only need to be re-tinted when the text color changes, which in
+ * practice means when the selection moves, so keep the last pair around */
+const QPixmap &VisibilityItemDelegate::GetTinted(bool checked,
+		const QColor &color) const
 {
-	DisconnectItemSignals();
+	if (color != tintColor || tintedChecked.isNull()) {
+		tintedChecked   = TintPixmap(checkedImage, color);
+		tintedUnchecked = TintPixmap(uncheckedImage, color);
+		tintColor       = color;
+	}
+
+	return checked ? tintedChecked : tintedUnchecked;
 }
 
-void VisibilityItemWidget::DisconnectItemSignals()
+QRect VisibilityItemDelegate::CheckRect(
+		const QStyleOptionViewItem &option) const
 {
-	if (!item || sceneRemoved)
-		return;
-
-	obs_scene_t *scene = obs_sceneitem_get_scene(item);
-	obs_source_t *sceneSource = obs_scene_get_source(scene);
-	signal_handler_t *signal = obs_source_get_signal_handler(sceneSource);
-
-	signal_handler_disconnect(signal, "remove", OBSSceneRemove, this);
-	signal_handler_disconnect(signal, "item_remove", OBSSceneItemRemove,
-			this);
-	signal_handler_disconnect(signal, "item_visible", OBSSceneItemVisible,
-			this);
+	const QRect &rect = option.rect;
+	int y = rect.y() + (rect.height() - CHECK_SIZE) / 2;
 
-	sceneRemoved = true;
+	return QRect(rect.x() + ITEM_MARGIN_X, y, CHECK_SIZE, CHECK_SIZE);
 }
 
-void VisibilityItemWidget::OBSSceneRemove(void *param, calldata_t *data)
+QColor VisibilityItemDelegate::TextColor(
+		const QStyleOptionViewItem &option) const
 {
-	VisibilityItemWidget *window =
-		reinterpret_cast<VisibilityItemWidget*>(param);
+	bool selected = option.state.testFlag(QStyle::State_Selected);
+	bool active = option.state.testFlag(QStyle::State_Active);
 
-	window->DisconnectItemSignals();
+	QPalette palette = option.palette;
+#if defined(_WIN32) || defined(__APPLE__)
+	QPalette::ColorGroup group = active ?
+		QPalette::Active : QPalette::Inactive;
+#else
+	QPalette::ColorGroup group = QPalette::Active;
+#endif
 
-	UNUSED_PARAMETER(data);
-}
+#ifdef _WIN32
+	QPalette::ColorRole highlightRole = QPalette::WindowText;
+#else
+	QPalette::ColorRole highlightRole = QPalette::HighlightedText;
+#endif
 
-void VisibilityItemWidget::OBSSceneItemRemove(void *param, calldata_t *data)
-{
-	VisibilityItemWidget *window =
-		reinterpret_cast<VisibilityItemWidget*>(param);
-	obs_sceneitem_t *item = (obs_sceneitem_t*)calldata_ptr(data, "item");
+	QPalette::ColorRole role;
 
-	if (item == window->item)
-		window->DisconnectItemSignals();
-}
+	if (selected && active)
+		role = highlightRole;
+	else
+		role = QPalette::WindowText;
 
-void VisibilityItemWidget::OBSSceneItemVisible(void *param, calldata_t *data)
-{
-	VisibilityItemWidget *window =
-		reinterpret_cast<VisibilityItemWidget*>(param);
-	obs_sceneitem_t *curItem = (obs_sceneitem_t*)calldata_ptr(data, "item");
-	bool enabled = calldata_bool(data, "visible");
-
-	if (window->item == curItem)
-		QMetaObject::invokeMethod(window, "SourceEnabled",
-				Q_ARG(bool, enabled));
+	return palette.color(group, role);
 }
 
-void VisibilityItemWidget::OBSSourceEnabled(void *param, calldata_t *data)
+void VisibilityItemDelegate::paint(QPainter *painter,
+		const QStyleOptionViewItem &option,
+		const QModelIndex &index) const
 {
-	VisibilityItemWidget *window =
-		reinterpret_cast<VisibilityItemWidget*>(param);
-	bool enabled = calldata_bool(data, "enabled");
+	QStyleOptionViewItem opt = option;
+	initStyleOption(&opt, index);
 
-	QMetaObject::invokeMethod(window, "SourceEnabled",
-			Q_ARG(bool, enabled));
-}
+	QString text = opt.text;
+	bool checked = index.data(Qt::CheckStateRole).toInt() == Qt::Checked;
 
-void VisibilityItemWidget::OBSSourceRenamed(void *param, calldata_t *data)
-{
-	VisibilityItemWidget *window =
-		reinterpret_cast<VisibilityItemWidget*>(param);
-	const char *name = calldata_string(data, "new_name");
+	/* let the style draw the background and selection only */
+	opt.text = QString();
+	opt.features &= ~QStyleOptionViewItem::HasCheckIndicator;
 
-	QMetaObject::invokeMethod(window, "SourceRenamed",
-			Q_ARG(QString, QT_UTF8(name)));
-}
+	const QWidget *widget = opt.widget;
+	QStyle *style = widget ? widget->style() : QApplication::style();
+	style->drawControl(QStyle::CE_ItemViewItem, &opt, painter, widget);
 
-void VisibilityItemWidget::VisibilityClicked(bool visible)
-{
-	if (item)
-		obs_sceneitem_set_visible(item, visible);
-	else
-		obs_source_set_enabled(source, visible);
-}
+	QColor color = TextColor(option);
+	QRect checkRect = CheckRect(option);
+	const QPixmap &pixmap = GetTinted(checked, color);
 
-void VisibilityItemWidget::SourceEnabled(bool enabled)
-{
-	if (vis->isChecked() != enabled)
-		vis->setChecked(enabled);
-}
+	painter->save();
+	painter->drawPixmap(checkRect.topLeft(), pixmap);
 
-void VisibilityItemWidget::SourceRenamed(QString name)
-{
-	if (label && name != label->text())
-		label->setText(name);
+	QRect textRect = option.rect.adjusted(
+			ITEM_MARGIN_X + CHECK_SIZE + ITEM_SPACING, 0,
+			-ITEM_MARGIN_X, 0);
+	QString elided = opt.fontMetrics.elidedText(text, Qt::ElideRight,
+			textRect.width());
+
+	painter->setFont(opt.font);
+	painter->setPen(color);
+	painter->drawText(textRect, Qt::AlignLeft | Qt::AlignVCenter, elided);
+	painter->restore();
 }
 
-void VisibilityItemWidget::SetColor(const QColor &color,
-		bool active_, bool selected_)
+QSize VisibilityItemDelegate::sizeHint(const QStyleOptionViewItem &option,
+		const QModelIndex &index) const
 {
-	/* Do not update unless the state has actually changed */
-	if (active_ == active && selected_ == selected)
-		return;
-
-	QPalette pal = vis->palette();
-	pal.setColor(QPalette::WindowText, color);
-	vis->setPalette(pal);
+	QStyleOptionViewItem opt = option;
+	initStyleOption(&opt, index);
 
-	label->setStyleSheet(QString("color: %1;").arg(color.name()));
+	int textWidth = opt.fontMetrics.width(opt.text);
+	int height = std::max(CHECK_SIZE, opt.fontMetrics.height());
 
-	active = active_;
-	selected = selected_;
+	return QSize(ITEM_MARGIN_X * 2 + CHECK_SIZE + ITEM_SPACING + textWidth,
+			height + ITEM_MARGIN_Y * 2);
 }
 
-VisibilityItemDelegate::VisibilityItemDelegate(QObject *parent)
-	: QStyledItemDelegate(parent)
+void VisibilityItemDelegate::updateEditorGeometry(QWidget *editor,
+		const QStyleOptionViewItem &option,
+		const QModelIndex &index) const
 {
+	QStyledItemDelegate::updateEditorGeometry(editor, option, index);
+
+	/* keep the toggle visible while the name is being edited */
+	QRect rect = editor->geometry();
+	rect.setLeft(option.rect.x() + ITEM_MARGIN_X + CHECK_SIZE +
+			ITEM_SPACING / 2);
+	editor->setGeometry(rect);
 }
 
-void VisibilityItemDelegate::paint(QPainter *painter,
+bool VisibilityItemDelegate::editorEvent(QEvent *event,
+		QAbstractItemModel *model,
 		const QStyleOptionViewItem &option,
-		const QModelIndex &index) const
+		const QModelIndex &index)
 {
-	QStyledItemDelegate::paint(painter, option, index);
+	QEvent::Type type = event->type();
 
-	QObject *parentObj = parent();
-	QListWidget *list = qobject_cast<QListWidget*>(parentObj);
-	if (!list)
-		return;
+	if (type != QEvent::MouseButtonPress &&
+	    type != QEvent::MouseButtonRelease &&
+	    type != QEvent::MouseButtonDblClick)
+		return QStyledItemDelegate::editorEvent(event, model, option,
+				index);
 
-	QListWidgetItem *item = list->item(index.row());
-	VisibilityItemWidget *widget =
-		qobject_cast<VisibilityItemWidget*>(list->itemWidget(item));
-	if (!widget)
-		return;
+	QMouseEvent *mouseEvent = static_cast<QMouseEvent*>(event);
+	if (mouseEvent->button() != Qt::LeftButton ||
+	    !CheckRect(option).contains(mouseEvent->pos()))
+		return QStyledItemDelegate::editorEvent(event, model, option,
+				index);
 
-	bool selected = option.state.testFlag(QStyle::State_Selected);
-	bool active = option.state.testFlag(QStyle::State_Active);
+	/* swallow presses and double clicks on the toggle so they neither
+	 * select the row nor start editing; toggle on release */
+	if (type != QEvent::MouseButtonRelease)
+		return true;
 
-	QPalette palette = list->palette();
-#if defined(_WIN32) || defined(__APPLE__)
-	QPalette::ColorGroup group = active ?
-		QPalette::Active : QPalette::Inactive;
-#else
-	QPalette::ColorGroup group = QPalette::Active;
-#endif
+	bool visible = index.data(Qt::CheckStateRole).toInt() != Qt::Checked;
+	QVariant ref = index.data(Qt::UserRole);
 
-#ifdef _WIN32
-	QPalette::ColorRole highlightRole = QPalette::WindowText;
-#else
-	QPalette::ColorRole highlightRole = QPalette::HighlightedText;
-#endif
+	/* the state itself is updated from the resulting signal */
+	if (ref.canConvert<OBSSceneItem>())
+		obs_sceneitem_set_visible(ref.value<OBSSceneItem>(), visible);
+	else if (ref.canConvert<OBSSource>())
+		obs_source_set_enabled(ref.value<OBSSource>(), visible);
 
-	QPalette::ColorRole role;
-
-	if (selected && active)
-		role = highlightRole;
-	else
-		role = QPalette::WindowText;
+	return true;
+}
 
-	widget->SetColor(palette.color(group, role), active, selected);
+void SetVisibilityItemState(QListWidgetItem *item, bool visible)
+{
+	item->setData(Qt::CheckStateRole, visible ? Qt::Checked : Qt::Unchecked);
 }
 
 void SetupVisibilityItem(QListWidget *list, QListWidgetItem *item,
 		obs_source_t *source)
 {
-	VisibilityItemWidget *baseWidget = new VisibilityItemWidget(source);
+	item->setText(QT_UTF8(obs_source_get_name(source)));
+	SetVisibilityItemState(item, obs_source_enabled(source));
 
-	item->setSizeHint(baseWidget->sizeHint());
-	list->setItemWidget(item, baseWidget);
+	UNUSED_PARAMETER(list);
 }
 
 void SetupVisibilityItem(QListWidget *list, QListWidgetItem *item,
 		obs_sceneitem_t *sceneItem)
 {
-	VisibilityItemWidget *baseWidget = new VisibilityItemWidget(sceneItem);
+	obs_source_t *source = obs_sceneitem_get_source(sceneItem);
+
+	item->setText(QT_UTF8(obs_source_get_name(source)));
+	SetVisibilityItemState(item, obs_sceneitem_visible(sceneItem));
 
-	item->setSizeHint(baseWidget->sizeHint());
-	list->setItemWidget(item, baseWidget);
+	UNUSED_PARAMETER(list);
 }
@@ -1,64 +1,50 @@
 #pragma once
 
-#include <QWidget>
+#include <QPixmap>
 #include <QStyledItemDelegate>
 #include <obs.hpp>
 
-class QLabel;
-class QLineEdit;
 class QListWidget;
 class QListWidgetItem;
-class VisibilityCheckBox;
 
-class VisibilityItemWidget : public QWidget {
+/* Paints the visibility toggle and name of a list item directly instead of
+ * creating a widget per row, so only the rows that are actually visible in
+ * the view cost anything.  The state is read from Qt::CheckStateRole and the
+ * name from Qt::DisplayRole; both are set by SetupVisibilityItem and kept up
+ * to date by the window owning the list. */
+class VisibilityItemDelegate : public QStyledItemDelegate {
 	Q_OBJECT
 
-private:
-	OBSSceneItem item;
-	OBSSource source;
-	QLabel *label = nullptr;
-	VisibilityCheckBox *vis = nullptr;
-	QString oldName;
-
-	OBSSignal sceneRemoveSignal;
-	OBSSignal enabledSignal;
-	OBSSignal renamedSignal;
-	bool sceneRemoved = false;
-
-	bool active = false;
-	bool selected = false;
-
-	static void OBSSceneRemove(void *param, calldata_t *data);
-	static void OBSSceneItemRemove(void *param, calldata_t *data);
-	static void OBSSceneItemVisible(void *param, calldata_t *data);
-	static void OBSSourceEnabled(void *param, calldata_t *data);
-	static void OBSSourceRenamed(void *param, calldata_t *data);
+	QPixmap checkedImage;
+	QPixmap uncheckedImage;
 
-	void DisconnectItemSignals();
+	mutable QColor  tintColor;
+	mutable QPixmap tintedChecked;
+	mutable QPixmap tintedUnchecked;
 
-private slots:
-	void VisibilityClicked(bool visible);
-	void SourceEnabled(bool enabled);
-	void SourceRenamed(QString name);
-
-public:
-	VisibilityItemWidget(obs_source_t *source);
-	VisibilityItemWidget(obs_sceneitem_t *item);
-	~VisibilityItemWidget();
-
-	void SetColor(const QColor &color, bool active, bool selected);
-};
-
-class VisibilityItemDelegate : public QStyledItemDelegate {
-	Q_OBJECT
+	const QPixmap &GetTinted(bool checked, const QColor &color) const;
+	QRect CheckRect(const QStyleOptionViewItem &option) const;
+	QColor TextColor(const QStyleOptionViewItem &option) const;
 
 public:
 	VisibilityItemDelegate(QObject *parent = nullptr);
 
 	void paint(QPainter *painter, const QStyleOptionViewItem &option,
 			const QModelIndex &index) const override;
+	QSize sizeHint(const QStyleOptionViewItem &option,
+			const QModelIndex &index) const override;
+	void updateEditorGeometry(QWidget *editor,
+			const QStyleOptionViewItem &option,
+			const QModelIndex &index) const override;
+
+protected:
+	bool editorEvent(QEvent *event, QAbstractItemModel *model,
+			const QStyleOptionViewItem &option,
+			const QModelIndex &index) override;
 };
 
+void SetVisibilityItemState(QListWidgetItem *item, bool visible);
+
 void SetupVisibilityItem(QListWidget *list, QListWidgetItem *item,
 		obs_source_t *source);
 void SetupVisibilityItem(QListWidget *list, QListWidgetItem *item,
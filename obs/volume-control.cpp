@@ -10,12 +10,21 @@
 #include <QSlider>
 #include <QLabel>
 #include <QPainter>
-#include <QTimer>
+#include <QGuiApplication>
+#include <QScreen>
+#include <algorithm>
 #include <string>
 #include <math.h>
 
 using namespace std;
 
+#define LEVEL_UPDATE_MS 50
+#define LEVEL_RESET_NS  1000000000ULL
+
+/* one timer polls every volume meter, so all of them are updated and
+ * repainted together instead of once per audio buffer of each source */
+VolumeMeterTimer *VolControl::levelTimer = nullptr;
+
 void VolControl::OBSVolumeChanged(void *data, calldata_t *calldata)
 {
 	Q_UNUSED(calldata);
@@ -24,21 +33,6 @@ void VolControl::OBSVolumeChanged(void *data, calldata_t *calldata)
 	QMetaObject::invokeMethod(volControl, "VolumeChanged");
 }
 
-void VolControl::OBSVolumeLevel(void *data, calldata_t *calldata)
-{
-	VolControl *volControl = static_cast<VolControl*>(data);
-	float peak      = calldata_float(calldata, "level");
-	float mag       = calldata_float(calldata, "magnitude");
-	float peakHold  = calldata_float(calldata, "peak");
-	bool  muted     = calldata_bool (calldata, "muted");
-
-	QMetaObject::invokeMethod(volControl, "VolumeLevel",
-		Q_ARG(float, mag),
-		Q_ARG(float, peak),
-		Q_ARG(float, peakHold),
-		Q_ARG(bool,  muted));
-}
-
 void VolControl::OBSVolumeMuted(void *data, calldata_t *calldata)
 {
 	VolControl *volControl = static_cast<VolControl*>(data);
@@ -68,6 +62,18 @@ void VolControl::VolumeLevel(float mag, float peak, float peakHold, bool muted)
 	volMeter->setLevels(mag, peak, peakHold);
 }
 
+void VolControl::PollLevels(uint64_t now)
+{
+	float peak, mag, peakHold;
+	bool  muted;
+
+	if (obs_volmeter_get_levels(obs_volmeter, &peak, &mag, &peakHold,
+				&muted))
+		VolumeLevel(mag, peak, peakHold, muted);
+	else
+		volMeter->checkReset(now);
+}
+
 void VolControl::VolumeMuted(bool muted)
 {
 	if (mute->isChecked() != muted)
@@ -177,8 +183,9 @@ VolControl::VolControl(OBSSource source_, bool showConfig)
 	signal_handler_connect(obs_fader_get_signal_handler(obs_fader),
 			"volume_changed", OBSVolumeChanged, this);
 
-	signal_handler_connect(obs_volmeter_get_signal_handler(obs_volmeter),
-			"levels_updated", OBSVolumeLevel, this);
+	if (!levelTimer)
+		levelTimer = new VolumeMeterTimer();
+	levelTimer->AddVolControl(this);
 
 	signal_handler_connect(obs_source_get_signal_handler(source),
 			"mute", OBSVolumeMuted, this);
@@ -189,6 +196,8 @@ VolControl::VolControl(OBSSource source_, bool showConfig)
 			this, SLOT(SetMuted(bool)));
 
 	obs_fader_attach_source(obs_fader, source);
+	obs_volmeter_set_polled(obs_volmeter, true);
+	obs_volmeter_set_update_interval(obs_volmeter, LEVEL_UPDATE_MS);
 	obs_volmeter_attach_source(obs_volmeter, source);
 
 	slider->setStyle(new SliderAbsoluteSetStyle(slider->style()));
@@ -202,14 +211,17 @@ VolControl::~VolControl()
 	signal_handler_disconnect(obs_fader_get_signal_handler(obs_fader),
 			"volume_changed", OBSVolumeChanged, this);
 
-	signal_handler_disconnect(obs_volmeter_get_signal_handler(obs_volmeter),
-			"levels_updated", OBSVolumeLevel, this);
-
 	signal_handler_disconnect(obs_source_get_signal_handler(source),
 			"mute", OBSVolumeMuted, this);
 
 	obs_fader_destroy(obs_fader);
 	obs_volmeter_destroy(obs_volmeter);
+
+	levelTimer->RemoveVolControl(this);
+	if (levelTimer->IsEmpty()) {
+		delete levelTimer;
+		levelTimer = nullptr;
+	}
 }
 
 QColor VolumeMeter::getBkColor() const
@@ -263,31 +275,75 @@ VolumeMeter::VolumeMeter(QWidget *parent)
 	magColor.setRgb(0x20, 0x7D, 0x17);
 	peakColor.setRgb(0x3E, 0xF1, 0x2B);
 	peakHoldColor.setRgb(0x00, 0x00, 0x00);
-	
-	resetTimer = new QTimer(this);
-	connect(resetTimer, SIGNAL(timeout()), this, SLOT(resetState()));
 
-	resetState();
-}
-
-void VolumeMeter::resetState(void)
-{
-	setLevels(0.0f, 0.0f, 0.0f);
-	if (resetTimer->isActive())
-		resetTimer->stop();
+	mag      = 0.0f;
+	peak     = 0.0f;
+	peakHold = 0.0f;
 }
 
 void VolumeMeter::setLevels(float nmag, float npeak, float npeakHold)
 {
+	bool changed = toPixels(nmag)      != toPixels(mag)  ||
+	               toPixels(npeak)     != toPixels(peak) ||
+	               toPixels(npeakHold) != toPixels(peakHold);
+
 	mag      = nmag;
 	peak     = npeak;
 	peakHold = npeakHold;
+	lastLevelTime = os_gettime_ns();
 
-	update();
+	if (changed)
+		update();
+}
+
+/* clears the meter once its source stopped sending audio */
+void VolumeMeter::checkReset(uint64_t now)
+{
+	if (!lastLevelTime || now - lastLevelTime < LEVEL_RESET_NS)
+		return;
+
+	setLevels(0.0f, 0.0f, 0.0f);
+	lastLevelTime = 0;
+}
+
+static int GetRefreshInterval()
+{
+	QScreen *screen = QGuiApplication::primaryScreen();
+	qreal rate = screen ? screen->refreshRate() : 0.0;
+
+	if (rate < 1.0)
+		rate = 60.0;
+
+	return std::max(int(1000.0 / rate), 1);
+}
+
+VolumeMeterTimer::VolumeMeterTimer()
+{
+	setTimerType(Qt::PreciseTimer);
+}
+
+void VolumeMeterTimer::AddVolControl(VolControl *volControl)
+{
+	volControls.push_back(volControl);
+
+	if (!isActive())
+		start(GetRefreshInterval());
+}
+
+void VolumeMeterTimer::RemoveVolControl(VolControl *volControl)
+{
+	volControls.removeOne(volControl);
+}
+
+void VolumeMeterTimer::timerEvent(QTimerEvent *event)
+{
+	Q_UNUSED(event);
+	uint64_t now = os_gettime_ns();
 
-	if (resetTimer->isActive())
-		resetTimer->stop();
-	resetTimer->start(1000);
+	/* the meters only schedule repaints here, so Qt paints all of the
+	 * changed ones in the same pass of the window */
+	for (VolControl *volControl : volControls)
+		volControl->PollLevels(now);
 }
 
 void VolumeMeter::paintEvent(QPaintEvent *event)
@@ -2,8 +2,11 @@
 
 #include <obs.hpp>
 #include <QWidget>
+#include <QTimer>
+#include <QList>
 
 class QPushButton;
+class VolControl;
 
 class VolumeMeter : public QWidget
 {
@@ -16,11 +19,17 @@ class VolumeMeter : public QWidget
 private:
 	float mag, peak, peakHold;
 	QColor bkColor, magColor, peakColor, peakHoldColor;
-	QTimer *resetTimer;
+	uint64_t lastLevelTime = 0;
+
+	inline int toPixels(float level) const
+	{
+		return int((float)size().width() * level);
+	}
 
 public:
 	explicit VolumeMeter(QWidget *parent = 0);
 	void setLevels(float nmag, float npeak, float npeakHold);
+	void checkReset(uint64_t now);
 	QColor getBkColor() const;
 	void setBkColor(QColor c);
 	QColor getMagColor() const;
@@ -32,8 +41,24 @@ public:
 
 protected:
 	void paintEvent(QPaintEvent *event);
-private slots:
-	void resetState();
+};
+
+/* polls the levels of every volume control once per display refresh and
+ * updates them in a single pass, so meters are painted together and only
+ * when they visibly changed */
+class VolumeMeterTimer : public QTimer {
+public:
+	VolumeMeterTimer();
+
+	void AddVolControl(VolControl *volControl);
+	void RemoveVolControl(VolControl *volControl);
+	inline bool IsEmpty() const {return volControls.isEmpty();}
+
+protected:
+	void timerEvent(QTimerEvent *event) override;
+
+private:
+	QList<VolControl*> volControls;
 };
 
 class QLabel;
@@ -56,8 +81,9 @@ private:
 	obs_fader_t     *obs_fader;
 	obs_volmeter_t  *obs_volmeter;
 
+	static VolumeMeterTimer *levelTimer;
+
 	static void OBSVolumeChanged(void *param, calldata_t *calldata);
-	static void OBSVolumeLevel(void *data, calldata_t *calldata);
 	static void OBSVolumeMuted(void *data, calldata_t *calldata);
 
 	void EmitConfigClicked();
@@ -80,6 +106,8 @@ public:
 
 	inline obs_source_t *GetSource() const {return source;}
 
+	void PollLevels(uint64_t now);
+
 	QString GetName() const;
 	void SetName(const QString &newName);
 };
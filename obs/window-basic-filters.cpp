@@ -28,11 +28,14 @@
 #include <QCloseEvent>
 #include <string>
 #include <QMenu>
+#include <QLabel>
+#include <QTimer>
 #include <QVariant>
 
 using namespace std;
 
 Q_DECLARE_METATYPE(OBSSource);
+Q_DECLARE_METATYPE(std::vector<std::shared_ptr<OBSSignal>>);
 
 OBSBasicFilters::OBSBasicFilters(QWidget *parent, OBSSource source_)
 	: QDialog                      (parent),
@@ -110,6 +113,15 @@ OBSBasicFilters::OBSBasicFilters(QWidget *parent, OBSSource source_)
 	};
 
 	connect(ui->preview, &OBSQTDisplay::DisplayCreated, addDrawCallback);
+
+	vramLabel = new QLabel(this);
+	ui->rightLayout->insertWidget(ui->rightLayout->indexOf(ui->preview) + 1,
+			vramLabel);
+
+	QTimer *vramTimer = new QTimer(this);
+	connect(vramTimer, SIGNAL(timeout()), this, SLOT(UpdateVideoMemory()));
+	vramTimer->start(1000);
+	UpdateVideoMemory();
 }
 
 OBSBasicFilters::~OBSBasicFilters()
@@ -137,6 +149,40 @@ inline OBSSource OBSBasicFilters::GetFilter(int row, bool async)
 	return v.value<OBSSource>();
 }
 
+static inline QString MegabytesText(uint64_t bytes)
+{
+	return QString::number(double(bytes) / (1024.0 * 1024.0), 'f', 1);
+}
+
+static uint64_t UpdateListVideoMemory(QListWidget *list)
+{
+	uint64_t total = 0;
+
+	for (int i = 0; i < list->count(); i++) {
+		QListWidgetItem *item = list->item(i);
+		OBSSource filter = item->data(Qt::UserRole).value<OBSSource>();
+		uint64_t bytes = obs_source_get_vram_usage(filter);
+
+		item->setToolTip(QTStr("Basic.Filters.VideoMemory")
+				.arg(MegabytesText(bytes)));
+		total += bytes;
+	}
+
+	return total;
+}
+
+/* shows what the source and its filters hold in video memory, with the
+ * share of each filter in the tooltip of its list item */
+void OBSBasicFilters::UpdateVideoMemory()
+{
+	uint64_t filterBytes = UpdateListVideoMemory(ui->asyncFilters) +
+		UpdateListVideoMemory(ui->effectFilters);
+
+	vramLabel->setText(QTStr("Basic.PropertiesWindow.VideoMemory")
+			.arg(MegabytesText(obs_source_get_vram_usage(source)),
+			     MegabytesText(filterBytes)));
+}
+
 void OBSBasicFilters::UpdatePropertiesView(int row, bool async)
 {
 	delete view;
@@ -171,10 +217,20 @@ void OBSBasicFilters::AddFilter(OBSSource filter)
 
 	item->setFlags(itemFlags | Qt::ItemIsEditable);
 	item->setData(Qt::UserRole, QVariant::fromValue(filter));
+	SetupVisibilityItem(list, item, filter);
+
+	signal_handler_t *handler = obs_source_get_signal_handler(filter);
+
+	std::vector<std::shared_ptr<OBSSignal>> handlers{
+		std::make_shared<OBSSignal>(handler, "enable",
+					OBSBasicFilters::OBSFilterEnabled, this),
+	};
+
+	item->setData(static_cast<int>(QtDataRole::OBSSignals),
+			QVariant::fromValue(handlers));
 
 	list->addItem(item);
 	list->setCurrentItem(item);
-	SetupVisibilityItem(list, item, filter);
 }
 
 void OBSBasicFilters::RemoveFilter(OBSSource filter)
@@ -197,6 +253,23 @@ void OBSBasicFilters::RemoveFilter(OBSSource filter)
 	main->SaveProject();
 }
 
+void OBSBasicFilters::SetFilterEnabled(OBSSource filter, bool enabled)
+{
+	uint32_t flags = obs_source_get_output_flags(filter);
+	bool async = (flags & OBS_SOURCE_ASYNC) != 0;
+	QListWidget *list = async ? ui->asyncFilters : ui->effectFilters;
+
+	for (int i = 0; i < list->count(); i++) {
+		QListWidgetItem *item = list->item(i);
+		QVariant v = item->data(Qt::UserRole);
+
+		if (v.value<OBSSource>() == filter) {
+			SetVisibilityItemState(item, enabled);
+			break;
+		}
+	}
+}
+
 struct FilterOrderInfo {
 	int asyncIdx = 0;
 	int effectIdx = 0;
@@ -222,8 +295,6 @@ void OBSBasicFilters::ReorderFilter(QListWidget *list,
 				listItem = TakeListItem(list, i);
 				if (listItem)  {
 					list->insertItem((int)idx, listItem);
-					SetupVisibilityItem(list,
-							listItem, filterItem);
 
 					if (sel)
 						list->setCurrentRow((int)idx);
@@ -438,6 +509,17 @@ void OBSBasicFilters::SourceRenamed(void *data, calldata_t *params)
 	                "setWindowTitle", Q_ARG(QString, title));
 }
 
+void OBSBasicFilters::OBSFilterEnabled(void *param, calldata_t *data)
+{
+	OBSBasicFilters *window = reinterpret_cast<OBSBasicFilters*>(param);
+	obs_source_t *filter = (obs_source_t*)calldata_ptr(data, "source");
+	bool enabled = calldata_bool(data, "enabled");
+
+	QMetaObject::invokeMethod(window, "SetFilterEnabled",
+			Q_ARG(OBSSource, OBSSource(filter)),
+			Q_ARG(bool, enabled));
+}
+
 void OBSBasicFilters::DrawPreview(void *data, uint32_t cx, uint32_t cy)
 {
 	OBSBasicFilters *window = static_cast<OBSBasicFilters*>(data);
@@ -606,7 +688,6 @@ void OBSBasicFilters::EditItem(QListWidgetItem *item, bool async)
 
 	item->setText(QT_UTF8(name));
 	item->setFlags(flags | Qt::ItemIsEditable);
-	list->removeItemWidget(item);
 	list->editItem(item);
 	item->setFlags(flags);
 }
@@ -667,7 +748,6 @@ void OBSBasicFilters::FilterNameEdited(QWidget *editor, QListWidget *list)
 		obs_source_set_name(filter, name.c_str());
 	}
 
-	listItem->setText(QString());
 	SetupVisibilityItem(list, listItem, filter);
 }
 
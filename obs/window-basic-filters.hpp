@@ -26,6 +26,7 @@
 
 class OBSBasic;
 class QMenu;
+class QLabel;
 
 #include "ui_OBSBasicFilters.h"
 
@@ -38,6 +39,7 @@ private:
 	std::unique_ptr<Ui::OBSBasicFilters> ui;
 	OBSSource source;
 	OBSPropertiesView *view = nullptr;
+	QLabel *vramLabel = nullptr;
 
 	OBSSignal addSignal;
 	OBSSignal removeSignal;
@@ -56,6 +58,7 @@ private:
 	static void OBSSourceReordered(void *param, calldata_t *data);
 	static void SourceRemoved(void *param, calldata_t *data);
 	static void SourceRenamed(void *param, calldata_t *data);
+	static void OBSFilterEnabled(void *param, calldata_t *data);
 	static void DrawPreview(void *data, uint32_t cx, uint32_t cy);
 
 	QMenu *CreateAddFilterPopupMenu(bool async);
@@ -71,9 +74,11 @@ private:
 private slots:
 	void AddFilter(OBSSource filter);
 	void RemoveFilter(OBSSource filter);
+	void SetFilterEnabled(OBSSource filter, bool enabled);
 	void ReorderFilters();
 	void RenameAsyncFilter();
 	void RenameEffectFilter();
+	void UpdateVideoMemory();
 
 	void AddFilterFromAction();
 
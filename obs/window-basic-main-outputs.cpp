@@ -350,6 +350,12 @@ void SimpleOutput::UpdateRecordingSettings_x264_crf(int crf)
 
 void SimpleOutput::UpdateRecordingSettings()
 {
+	bool vfr = config_get_bool(main->Config(), "SimpleOutput", "RecVFR");
+
+	/* only the recording's own encoder, the stream needs a constant
+	 * framerate */
+	obs_encoder_set_variable_framerate(h264Recording, vfr);
+
 	if (astrcmp_n(videoEncoder.c_str(), "x264", 4) == 0) {
 		if (videoQuality == "Small")
 			UpdateRecordingSettings_x264_crf(CalcCRF(23));
@@ -362,6 +368,8 @@ inline void SimpleOutput::SetupOutputs()
 {
 	SimpleOutput::Update();
 	obs_encoder_set_video(h264Streaming, obs_get_video());
+	obs_encoder_set_latency_sei(h264Streaming,
+			config_get_bool(main->Config(), "Output", "LatencySEI"));
 	obs_encoder_set_audio(aacStreaming,  obs_get_audio());
 
 	if (usingRecordingPreset) {
@@ -716,6 +724,7 @@ inline void AdvancedOutput::SetupRecording()
 	const char *rescaleRes = config_get_string(main->Config(), "AdvOut",
 			"RecRescaleRes");
 	int tracks = config_get_int(main->Config(), "AdvOut", "RecTracks");
+	bool vfr = config_get_bool(main->Config(), "AdvOut", "RecVFR");
 	obs_data_t *settings = obs_data_create();
 	unsigned int cx = 0;
 	unsigned int cy = 0;
@@ -732,6 +741,7 @@ inline void AdvancedOutput::SetupRecording()
 		}
 
 		obs_encoder_set_scaled_size(h264Recording, cx, cy);
+		obs_encoder_set_variable_framerate(h264Recording, vfr);
 		obs_encoder_set_video(h264Recording, obs_get_video());
 		obs_output_set_video_encoder(fileOutput, h264Recording);
 	}
@@ -857,6 +867,8 @@ inline void AdvancedOutput::UpdateAudioSettings()
 void AdvancedOutput::SetupOutputs()
 {
 	obs_encoder_set_video(h264Streaming, obs_get_video());
+	obs_encoder_set_latency_sei(h264Streaming,
+			config_get_bool(main->Config(), "Output", "LatencySEI"));
 	if (h264Recording)
 		obs_encoder_set_video(h264Recording, obs_get_video());
 	obs_encoder_set_audio(aacTrack[0], obs_get_audio());
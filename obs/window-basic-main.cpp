@@ -104,6 +104,7 @@ static QList<QKeySequence> DeleteKeys;
 
 OBSBasic::OBSBasic(QWidget *parent)
 	: OBSMainWindow  (parent),
+	  saver          (new SceneCollectionSaver),
 	  ui             (new Ui::OBSBasic)
 {
 	ui->setupUi(this);
@@ -152,6 +153,11 @@ OBSBasic::OBSBasic(QWidget *parent)
 	ui->scenes->setAttribute(Qt::WA_MacShowFocusRect, false);
 	ui->sources->setAttribute(Qt::WA_MacShowFocusRect, false);
 
+	/* needed for itemEntered, used to prepare hovered scenes */
+	ui->scenes->setMouseTracking(true);
+	connect(ui->scenes, SIGNAL(itemEntered(QListWidgetItem*)),
+			this, SLOT(SceneHovered(QListWidgetItem*)));
+
 	connect(windowHandle(), &QWindow::screenChanged, [this]() {
 		struct obs_video_info ovi;
 
@@ -217,41 +223,18 @@ OBSBasic::OBSBasic(QWidget *parent)
 	addNudge(Qt::Key_Right, SLOT(NudgeRight()));
 }
 
-static void SaveAudioDevice(const char *name, int channel, obs_data_t *parent)
-{
-	obs_source_t *source = obs_get_output_source(channel);
-	if (!source)
-		return;
-
-	obs_data_t *data = obs_save_source(source);
-
-	obs_data_set_obj(parent, name, data);
-
-	obs_data_release(data);
-	obs_source_release(source);
-}
-
 static obs_data_t *GenerateSaveData(obs_data_array_t *sceneOrder)
 {
 	obs_data_t       *saveData     = obs_data_create();
-	obs_data_array_t *sourcesArray = obs_save_sources();
 	obs_source_t     *currentScene = obs_get_output_source(0);
 	const char       *sceneName   = obs_source_get_name(currentScene);
 
 	const char *sceneCollection = config_get_string(App()->GlobalConfig(),
 			"Basic", "SceneCollection");
 
-	SaveAudioDevice(DESKTOP_AUDIO_1, 1, saveData);
-	SaveAudioDevice(DESKTOP_AUDIO_2, 2, saveData);
-	SaveAudioDevice(AUX_AUDIO_1,     3, saveData);
-	SaveAudioDevice(AUX_AUDIO_2,     4, saveData);
-	SaveAudioDevice(AUX_AUDIO_3,     5, saveData);
-
 	obs_data_set_string(saveData, "current_scene", sceneName);
 	obs_data_set_array(saveData, "scene_order", sceneOrder);
 	obs_data_set_string(saveData, "name", sceneCollection);
-	obs_data_set_array(saveData, "sources", sourcesArray);
-	obs_data_array_release(sourcesArray);
 	obs_source_release(currentScene);
 
 	return saveData;
@@ -304,16 +287,34 @@ obs_data_array_t *OBSBasic::SaveSceneListOrder()
 	return sceneOrder;
 }
 
-void OBSBasic::Save(const char *file)
+void OBSBasic::Save(const char *file, bool wait)
 {
+	const std::pair<const char*, int> audioDevices[] = {
+		{DESKTOP_AUDIO_1, 1},
+		{DESKTOP_AUDIO_2, 2},
+		{AUX_AUDIO_1,     3},
+		{AUX_AUDIO_2,     4},
+		{AUX_AUDIO_3,     5}
+	};
+
+	std::vector<std::pair<const char*, obs_source_t*>> devices;
+
+	for (auto &device : audioDevices) {
+		obs_source_t *source = obs_get_output_source(device.second);
+		if (source)
+			devices.emplace_back(device.first, source);
+	}
+
 	obs_data_array_t *sceneOrder = SaveSceneListOrder();
 	obs_data_t *saveData  = GenerateSaveData(sceneOrder);
 
-	if (!obs_data_save_json_safe(saveData, file, "tmp", "bak"))
-		blog(LOG_ERROR, "Could not save scene data to %s", file);
+	saver->Save(saveData, devices, file, wait);
 
 	obs_data_release(saveData);
 	obs_data_array_release(sceneOrder);
+
+	for (auto &device : devices)
+		obs_source_release(device.second);
 }
 
 static void LoadAudioDevice(const char *name, int channel, obs_data_t *parent)
@@ -447,7 +448,12 @@ void OBSBasic::Load(const char *file)
 
 	disableSaving++;
 
-	obs_data_t *data = obs_data_create_from_json_file_safe(file, "bak");
+	obs_data_t *data;
+	{
+		ProfileScope("obs_data_create_from_json_file_safe");
+		data = obs_data_create_from_json_file_safe(file, "bak");
+	}
+
 	if (!data) {
 		disableSaving--;
 		blog(LOG_ERROR, "Failed to load '%s', creating default scene",
@@ -642,6 +648,7 @@ bool OBSBasic::InitBasicConfigDefaults()
 			"Stream");
 	config_set_default_string(basicConfig, "SimpleOutput", "RecEncoder",
 			SIMPLE_ENCODER_X264);
+	config_set_default_bool  (basicConfig, "SimpleOutput", "RecVFR", false);
 
 	config_set_default_bool  (basicConfig, "AdvOut", "ApplyServiceSettings",
 			true);
@@ -659,6 +666,7 @@ bool OBSBasic::InitBasicConfigDefaults()
 	config_set_default_uint  (basicConfig, "AdvOut", "RecTracks", (1<<0));
 	config_set_default_string(basicConfig, "AdvOut", "RecEncoder",
 			"none");
+	config_set_default_bool  (basicConfig, "AdvOut", "RecVFR", false);
 
 	config_set_default_bool  (basicConfig, "AdvOut", "FFOutputToFile",
 			true);
@@ -684,6 +692,7 @@ bool OBSBasic::InitBasicConfigDefaults()
 	config_set_default_bool  (basicConfig, "Output", "DelayPreserve", true);
 
 	config_set_default_bool  (basicConfig, "Output", "Reconnect", true);
+	config_set_default_bool  (basicConfig, "Output", "LatencySEI", false);
 	config_set_default_uint  (basicConfig, "Output", "RetryDelay", 10);
 	config_set_default_uint  (basicConfig, "Output", "MaxRetries", 20);
 
@@ -708,6 +717,16 @@ bool OBSBasic::InitBasicConfigDefaults()
 	config_set_default_uint  (basicConfig, "Video", "FPSNum", 30);
 	config_set_default_uint  (basicConfig, "Video", "FPSDen", 1);
 	config_set_default_string(basicConfig, "Video", "ScaleType", "bicubic");
+	config_set_default_uint  (basicConfig, "Video", "ReadbackFrames", 2);
+	config_set_default_bool  (basicConfig, "Video", "ZeroCopyReadback",
+			false);
+	config_set_default_uint  (basicConfig, "Video", "ConversionSlices", 1);
+	config_set_default_uint  (basicConfig, "Video", "TickThreads", 2);
+	config_set_default_uint  (basicConfig, "Video", "PacingSpinUS", 0);
+	config_set_default_uint  (basicConfig, "Video", "FrameCacheSize", 6);
+	config_set_default_uint  (basicConfig, "Video", "PreviewFPS", 0);
+	config_set_default_bool  (basicConfig, "Video", "LowLatency", false);
+	config_set_default_uint  (basicConfig, "Video", "SourceSuspendSec", 0);
 	config_set_default_string(basicConfig, "Video", "ColorFormat", "NV12");
 	config_set_default_string(basicConfig, "Video", "ColorSpace", "601");
 	config_set_default_string(basicConfig, "Video", "ColorRange",
@@ -717,6 +736,7 @@ bool OBSBasic::InitBasicConfigDefaults()
 	config_set_default_string(basicConfig, "Audio", "ChannelSetup",
 			"Stereo");
 	config_set_default_uint  (basicConfig, "Audio", "BufferingTime", 1000);
+	config_set_default_bool  (basicConfig, "Audio", "LowLatency", false);
 
 	return true;
 }
@@ -761,6 +781,77 @@ bool OBSBasic::InitBasicConfig()
 	return InitBasicConfigDefaults();
 }
 
+static enum os_thread_priority GetThreadPriority(const char *str)
+{
+	if (!str)
+		return OS_THREAD_PRIORITY_DEFAULT;
+	else if (astrcmpi(str, "BelowNormal") == 0)
+		return OS_THREAD_PRIORITY_BELOW_NORMAL;
+	else if (astrcmpi(str, "Normal") == 0)
+		return OS_THREAD_PRIORITY_NORMAL;
+	else if (astrcmpi(str, "AboveNormal") == 0)
+		return OS_THREAD_PRIORITY_ABOVE_NORMAL;
+	else if (astrcmpi(str, "High") == 0)
+		return OS_THREAD_PRIORITY_HIGH;
+	else if (astrcmpi(str, "Realtime") == 0)
+		return OS_THREAD_PRIORITY_REALTIME;
+
+	return OS_THREAD_PRIORITY_DEFAULT;
+}
+
+static enum os_mmcss_task GetMMCSSTask(const char *str)
+{
+	if (!str)
+		return OS_MMCSS_TASK_NONE;
+	else if (astrcmpi(str, "Audio") == 0)
+		return OS_MMCSS_TASK_AUDIO;
+	else if (astrcmpi(str, "Pro Audio") == 0)
+		return OS_MMCSS_TASK_PRO_AUDIO;
+	else if (astrcmpi(str, "Capture") == 0)
+		return OS_MMCSS_TASK_CAPTURE;
+	else if (astrcmpi(str, "Playback") == 0)
+		return OS_MMCSS_TASK_PLAYBACK;
+	else if (astrcmpi(str, "Distribution") == 0)
+		return OS_MMCSS_TASK_DISTRIBUTION;
+	else if (astrcmpi(str, "Games") == 0)
+		return OS_MMCSS_TASK_GAMES;
+
+	return OS_MMCSS_TASK_NONE;
+}
+
+/* [Threads] GraphicsPriority=High, EncoderAffinity=0xF0, AudioMMCSS=Pro Audio
+ * and so on.  Not exposed in the settings dialog, these are meant for
+ * machines that also run the game being streamed. */
+void OBSBasic::LoadThreadSettings()
+{
+	static const char *roleNames[OBS_THREAD_ROLE_COUNT] = {
+		"Graphics",
+		"Audio",
+		"VideoOutput",
+		"Encoder",
+		"Output"
+	};
+
+	for (int i = 0; i < OBS_THREAD_ROLE_COUNT; i++) {
+		struct os_thread_settings settings = {};
+		std::string name = roleNames[i];
+
+		const char *priority = config_get_string(basicConfig,
+				"Threads", (name + "Priority").c_str());
+		const char *affinity = config_get_string(basicConfig,
+				"Threads", (name + "Affinity").c_str());
+		const char *mmcss = config_get_string(basicConfig,
+				"Threads", (name + "MMCSS").c_str());
+
+		settings.priority   = GetThreadPriority(priority);
+		settings.affinity   = affinity ? strtoull(affinity, nullptr, 0)
+		                               : 0;
+		settings.mmcss_task = GetMMCSSTask(mmcss);
+
+		obs_set_thread_settings((enum obs_thread_role)i, &settings);
+	}
+}
+
 void OBSBasic::InitOBSCallbacks()
 {
 	ProfileScope("OBSBasic::InitOBSCallbacks");
@@ -848,6 +939,9 @@ void OBSBasic::OBSInit()
 
 	if (!InitBasicConfig())
 		throw "Failed to load basic.ini";
+
+	LoadThreadSettings();
+
 	if (!ResetAudio())
 		throw "Failed to initialize audio";
 
@@ -871,7 +965,13 @@ void OBSBasic::OBSInit()
 	InitHotkeys();
 
 	AddExtraModulePaths();
-	obs_load_all_modules();
+
+	char manifestPath[512];
+	if (GetConfigPath(manifestPath, sizeof(manifestPath),
+				"obs-studio/plugin_manifest.json") > 0)
+		obs_load_all_modules_deferred(manifestPath);
+	else
+		obs_load_all_modules();
 
 	blog(LOG_INFO, MAIN_SEPARATOR);
 
@@ -926,7 +1026,12 @@ void OBSBasic::OBSInit()
 
 	sleepInhibitor = os_inhibit_sleep_create("OBS Video/audio");
 	os_inhibit_sleep_set_active(sleepInhibitor, true);
-	show();
+
+	/* headless instances are only controlled remotely (by plugins such as
+	 * remote control servers), so the window and its previews are never
+	 * created on screen */
+	if (!App()->IsHeadless())
+		show();
 }
 
 void OBSBasic::InitHotkeys()
@@ -1189,7 +1294,7 @@ void OBSBasic::SaveProjectNow()
 		return;
 
 	projectChanged = true;
-	SaveProjectDeferred();
+	SaveProjectDeferred(true);
 }
 
 void OBSBasic::SaveProject()
@@ -1202,7 +1307,7 @@ void OBSBasic::SaveProject()
 			Qt::QueuedConnection);
 }
 
-void OBSBasic::SaveProjectDeferred()
+void OBSBasic::SaveProjectDeferred(bool wait)
 {
 	if (disableSaving)
 		return;
@@ -1230,7 +1335,7 @@ void OBSBasic::SaveProjectDeferred()
 	if (ret <= 0)
 		return;
 
-	Save(savePath);
+	Save(savePath, wait);
 }
 
 OBSScene OBSBasic::GetCurrentScene()
@@ -1253,15 +1358,35 @@ void OBSBasic::UpdateSources(OBSScene scene)
 {
 	ClearListItems(ui->sources);
 
+	std::vector<OBSSceneItem> items;
+
 	obs_scene_enum_items(scene,
 			[] (obs_scene_t *scene, obs_sceneitem_t *item, void *p)
 			{
-				OBSBasic *window = static_cast<OBSBasic*>(p);
-				window->InsertSceneItem(item);
+				auto items = static_cast<
+					std::vector<OBSSceneItem>*>(p);
+				items->emplace_back(item);
 
 				UNUSED_PARAMETER(scene);
 				return true;
-			}, this);
+			}, &items);
+
+	/* build the whole list before the view sees it instead of inserting
+	 * and selecting row by row, which is quadratic for big scenes */
+	ui->sources->setUpdatesEnabled(false);
+
+	for (auto it = items.rbegin(); it != items.rend(); ++it) {
+		QListWidgetItem *listItem = new QListWidgetItem();
+		SetOBSRef(listItem, *it);
+		SetupVisibilityItem(ui->sources, listItem, *it);
+		ui->sources->addItem(listItem);
+	}
+
+	if (!items.empty())
+		ui->sources->setCurrentRow(0,
+				QItemSelectionModel::ClearAndSelect);
+
+	ui->sources->setUpdatesEnabled(true);
 }
 
 void OBSBasic::InsertSceneItem(obs_sceneitem_t *item)
@@ -1270,12 +1395,11 @@ void OBSBasic::InsertSceneItem(obs_sceneitem_t *item)
 
 	QListWidgetItem *listItem = new QListWidgetItem();
 	SetOBSRef(listItem, OBSSceneItem(item));
+	SetupVisibilityItem(ui->sources, listItem, item);
 
 	ui->sources->insertItem(0, listItem);
 	ui->sources->setCurrentRow(0, QItemSelectionModel::ClearAndSelect);
 
-	SetupVisibilityItem(ui->sources, listItem, item);
-
 	/* if the source was just created, open properties dialog */
 	if (sourceSceneRefs[source] == 0 && loaded)
 		CreatePropertiesWindow(source);
@@ -1347,6 +1471,8 @@ void OBSBasic::AddScene(OBSSource source)
 					OBSBasic::SceneItemDeselected, this),
 		std::make_shared<OBSSignal>(handler, "reorder",
 					OBSBasic::SceneReordered, this),
+		std::make_shared<OBSSignal>(handler, "item_visible",
+					OBSBasic::SceneItemVisible, this),
 	};
 
 	item->setData(static_cast<int>(QtDataRole::OBSSignals),
@@ -1394,6 +1520,10 @@ void OBSBasic::RemoveScene(OBSSource source)
 		delete sel;
 	}
 
+	if (preparedHoverScene == source)
+		PrepareScene(preparedHoverScene, nullptr);
+	PrepareNextScene();
+
 	auto DeleteSceneRefs = [&](obs_sceneitem_t *si)
 	{
 		obs_source_t *source = obs_sceneitem_get_source(si);
@@ -1474,10 +1604,51 @@ void OBSBasic::UpdateSceneSelection(OBSSource source)
 			sceneChanging = false;
 
 			UpdateSources(scene);
+			PrepareNextScene();
 		}
 	}
 }
 
+void OBSBasic::PrepareScene(OBSSource &prepared, obs_source_t *scene)
+{
+	if (prepared == scene)
+		return;
+
+	/* prepare the new scene first, so sources shared with the old one
+	 * don't get unloaded in between */
+	obs_source_prepare(scene);
+	obs_source_unprepare(prepared);
+	prepared = scene;
+}
+
+void OBSBasic::PrepareNextScene()
+{
+	int row = ui->scenes->currentRow();
+	QListWidgetItem *item = row >= 0 ? ui->scenes->item(row + 1) : nullptr;
+	obs_source_t *source = nullptr;
+
+	if (item)
+		source = obs_scene_get_source(GetOBSRef<OBSScene>(item));
+
+	PrepareScene(preparedNextScene, source);
+}
+
+void OBSBasic::ClearPreparedScenes()
+{
+	PrepareScene(preparedNextScene, nullptr);
+	PrepareScene(preparedHoverScene, nullptr);
+}
+
+void OBSBasic::SceneHovered(QListWidgetItem *item)
+{
+	obs_source_t *source = nullptr;
+
+	if (item && item != ui->scenes->currentItem())
+		source = obs_scene_get_source(GetOBSRef<OBSScene>(item));
+
+	PrepareScene(preparedHoverScene, source);
+}
+
 static void RenameListValues(QListWidget *listWidget, const QString &newName,
 		const QString &prevName)
 {
@@ -1491,6 +1662,7 @@ static void RenameListValues(QListWidget *listWidget, const QString &newName,
 void OBSBasic::RenameSources(QString newName, QString prevName)
 {
 	RenameListValues(ui->scenes,  newName, prevName);
+	RenameListValues(ui->sources, newName, prevName);
 
 	for (size_t i = 0; i < volumes.size(); i++) {
 		if (volumes[i]->GetName().compare(prevName) == 0)
@@ -1500,6 +1672,22 @@ void OBSBasic::RenameSources(QString newName, QString prevName)
 	SaveProject();
 }
 
+void OBSBasic::SetSceneItemVisible(OBSScene scene, OBSSceneItem item,
+		bool visible)
+{
+	if (scene != GetCurrentScene())
+		return;
+
+	for (int i = 0; i < ui->sources->count(); i++) {
+		QListWidgetItem *witem = ui->sources->item(i);
+
+		if (GetOBSRef<OBSSceneItem>(witem) == item) {
+			SetVisibilityItemState(witem, visible);
+			break;
+		}
+	}
+}
+
 void OBSBasic::SelectSceneItem(OBSScene scene, OBSSceneItem item, bool select)
 {
 	if (scene != GetCurrentScene() || ignoreSelectionUpdate)
@@ -1822,8 +2010,6 @@ void OBSBasic::ReorderSceneItem(obs_sceneitem_t *item, size_t idx)
 				if (listItem)  {
 					ui->sources->insertItem(idx_inv,
 							listItem);
-					SetupVisibilityItem(ui->sources,
-							listItem, item);
 
 					if (sel)
 						ui->sources->setCurrentRow(
@@ -1913,6 +2099,19 @@ void OBSBasic::SceneItemDeselected(void *data, calldata_t *params)
 			Q_ARG(bool, false));
 }
 
+void OBSBasic::SceneItemVisible(void *data, calldata_t *params)
+{
+	OBSBasic *window = static_cast<OBSBasic*>(data);
+
+	obs_scene_t     *scene   = (obs_scene_t*)calldata_ptr(params, "scene");
+	obs_sceneitem_t *item    = (obs_sceneitem_t*)calldata_ptr(params, "item");
+	bool            visible = calldata_bool(params, "visible");
+
+	QMetaObject::invokeMethod(window, "SetSceneItemVisible",
+			Q_ARG(OBSScene, scene), Q_ARG(OBSSceneItem, item),
+			Q_ARG(bool, visible));
+}
+
 void OBSBasic::SourceAdded(void *data, calldata_t *params)
 {
 	OBSBasic *window = static_cast<OBSBasic*>(data);
@@ -2029,7 +2228,7 @@ void OBSBasic::RenderMain(void *data, uint32_t cx, uint32_t cy)
 
 	window->DrawBackdrop(float(ovi.base_width), float(ovi.base_height));
 
-	obs_render_main_view();
+	obs_render_main_texture();
 	gs_load_vertexbuffer(nullptr);
 
 	/* --------------------------------------- */
@@ -2156,6 +2355,26 @@ int OBSBasic::ResetVideo()
 	ovi.adapter        = 0;
 	ovi.gpu_conversion = true;
 	ovi.scale_type     = GetScaleType(basicConfig);
+	ovi.readback_frames = (uint32_t)config_get_uint(basicConfig,
+			"Video", "ReadbackFrames");
+	ovi.zero_copy_readback = config_get_bool(basicConfig,
+			"Video", "ZeroCopyReadback");
+	ovi.conversion_slices = (uint32_t)config_get_uint(basicConfig,
+			"Video", "ConversionSlices");
+	ovi.tick_threads = (uint32_t)config_get_uint(basicConfig,
+			"Video", "TickThreads");
+	ovi.pacing_spin_us = (uint32_t)config_get_uint(basicConfig,
+			"Video", "PacingSpinUS");
+	ovi.frame_cache_size = (uint32_t)config_get_uint(basicConfig,
+			"Video", "FrameCacheSize");
+	ovi.headless = App()->IsHeadless();
+	ovi.preview_fps = (uint32_t)config_get_uint(basicConfig,
+			"Video", "PreviewFPS");
+	ovi.low_latency = config_get_bool(basicConfig, "Video", "LowLatency");
+
+	uint64_t suspendSec = config_get_uint(basicConfig, "Video",
+			"SourceSuspendSec");
+	obs_set_source_suspend_delay((uint32_t)(suspendSec * 1000));
 
 	ret = AttemptToResetVideo(&ovi);
 	if (IS_WIN32 && ret != OBS_VIDEO_SUCCESS) {
@@ -2193,6 +2412,7 @@ bool OBSBasic::ResetAudio()
 		ai.speakers = SPEAKERS_STEREO;
 
 	ai.buffer_ms = config_get_uint(basicConfig, "Audio", "BufferingTime");
+	ai.low_latency = config_get_bool(basicConfig, "Audio", "LowLatency");
 
 	return obs_reset_audio(&ai);
 }
@@ -2269,6 +2489,7 @@ void OBSBasic::ClearSceneData()
 	ClearVolumeControls();
 	ClearListItems(ui->scenes);
 	ClearListItems(ui->sources);
+	ClearPreparedScenes();
 
 	obs_set_output_source(0, nullptr);
 	obs_set_output_source(1, nullptr);
@@ -2409,6 +2630,7 @@ void OBSBasic::on_scenes_currentItemChanged(QListWidgetItem *current,
 
 	/* TODO: allow transitions */
 	obs_set_output_source(0, source);
+	PrepareNextScene();
 
 	UNUSED_PARAMETER(prev);
 }
@@ -2638,7 +2860,6 @@ void OBSBasic::EditSceneItemName()
 
 	item->setText(QT_UTF8(name));
 	item->setFlags(flags | Qt::ItemIsEditable);
-	ui->sources->removeItemWidget(item);
 	ui->sources->editItem(item);
 	item->setFlags(flags);
 }
@@ -2868,6 +3089,7 @@ static BPtr<char> ReadLogFile(const char *log)
 	path += "/";
 	path += log;
 
+	FlushLog();
 	BPtr<char> file = os_quick_read_utf8_file(path.c_str());
 	if (!file)
 		blog(LOG_WARNING, "Failed to read log file %s", path.c_str());
@@ -2960,6 +3182,7 @@ void OBSBasic::on_actionViewCurrentLog_triggered()
 	path += "/";
 	path += log;
 
+	FlushLog();
 	QUrl url = QUrl::fromLocalFile(QT_UTF8(path.c_str()));
 	QDesktopServices::openUrl(url);
 }
@@ -3048,7 +3271,6 @@ void OBSBasic::SceneItemNameEdited(QWidget *editor,
 	RenameListItem(this, ui->sources, source, text);
 
 	QListWidgetItem *listItem = ui->sources->currentItem();
-	listItem->setText(QString());
 	SetupVisibilityItem(ui->sources, listItem, item);
 
 	UNUSED_PARAMETER(endHint);
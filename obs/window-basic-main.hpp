@@ -29,6 +29,7 @@
 #include "window-basic-transform.hpp"
 #include "window-basic-adv-audio.hpp"
 #include "window-basic-filters.hpp"
+#include "scene-collection-saver.hpp"
 
 #include <util/platform.h>
 #include <util/util.hpp>
@@ -81,6 +82,8 @@ private:
 	long disableSaving = 1;
 	bool projectChanged = false;
 
+	std::unique_ptr<SceneCollectionSaver> saver;
+
 	QPointer<QThread> updateCheckThread;
 	QPointer<QThread> logUploadThread;
 
@@ -103,6 +106,11 @@ private:
 	bool          sceneChanging = false;
 	bool          ignoreSelectionUpdate = false;
 
+	/* scenes that are likely to be switched to next, kept prepared so
+	 * their sources have loaded by the time they're shown */
+	OBSSource     preparedNextScene;
+	OBSSource     preparedHoverScene;
+
 	int           previewX = 0,  previewY = 0;
 	int           previewCX = 0, previewCY = 0;
 	float         previewScale = 0.0f;
@@ -122,9 +130,13 @@ private:
 
 	void          ClearVolumeControls();
 
+	void          PrepareScene(OBSSource &prepared, obs_source_t *scene);
+	void          PrepareNextScene();
+	void          ClearPreparedScenes();
+
 	void          UploadLog(const char *file);
 
-	void          Save(const char *file);
+	void          Save(const char *file, bool wait);
 	void          Load(const char *file);
 
 	void          InitHotkeys();
@@ -135,6 +147,7 @@ private:
 
 	bool          InitBasicConfigDefaults();
 	bool          InitBasicConfig();
+	void          LoadThreadSettings();
 
 	void          InitOBSCallbacks();
 
@@ -214,7 +227,7 @@ public slots:
 	void RecordingStart();
 	void RecordingStop(int code);
 
-	void SaveProjectDeferred();
+	void SaveProjectDeferred(bool wait = false);
 	void SaveProject();
 
 private slots:
@@ -223,9 +236,12 @@ private slots:
 	void AddScene(OBSSource source);
 	void RemoveScene(OBSSource source);
 	void UpdateSceneSelection(OBSSource source);
+	void SceneHovered(QListWidgetItem *item);
 	void RenameSources(QString newName, QString prevName);
 
 	void SelectSceneItem(OBSScene scene, OBSSceneItem item, bool select);
+	void SetSceneItemVisible(OBSScene scene, OBSSceneItem item,
+			bool visible);
 
 	void ActivateAudioSource(OBSSource source);
 	void DeactivateAudioSource(OBSSource source);
@@ -245,6 +261,7 @@ private:
 	static void SceneItemRemoved(void *data, calldata_t *params);
 	static void SceneItemSelected(void *data, calldata_t *params);
 	static void SceneItemDeselected(void *data, calldata_t *params);
+	static void SceneItemVisible(void *data, calldata_t *params);
 	static void SourceAdded(void *data, calldata_t *params);
 	static void SourceRemoved(void *data, calldata_t *params);
 	static void SourceActivated(void *data, calldata_t *params);
@@ -23,6 +23,8 @@
 #include "properties-view.hpp"
 
 #include <QCloseEvent>
+#include <QLabel>
+#include <QTimer>
 #include <QScreen>
 #include <QWindow>
 #include <QMessageBox>
@@ -42,7 +44,8 @@ OBSBasicProperties::OBSBasicProperties(QWidget *parent, OBSSource source_)
 	                          "rename", OBSBasicProperties::SourceRenamed,
 	                          this),
 	  oldSettings            (obs_data_create()),
-	  buttonBox              (new QDialogButtonBox(this))
+	  buttonBox              (new QDialogButtonBox(this)),
+	  vramLabel              (new QLabel(this))
 {
 	int cx = (int)config_get_int(App()->GlobalConfig(), "PropertiesWindow",
 			"cx");
@@ -78,6 +81,7 @@ OBSBasicProperties::OBSBasicProperties(QWidget *parent, OBSSource source_)
 	setLayout(new QVBoxLayout(this));
 	layout()->addWidget(preview);
 	layout()->addWidget(view);
+	layout()->addWidget(vramLabel);
 	layout()->addWidget(buttonBox);
 	layout()->setAlignment(buttonBox, Qt::AlignRight | Qt::AlignBottom);
 	layout()->setAlignment(view, Qt::AlignBottom);
@@ -104,6 +108,11 @@ OBSBasicProperties::OBSBasicProperties(QWidget *parent, OBSSource source_)
 	};
 
 	connect(preview.data(), &OBSQTDisplay::DisplayCreated, addDrawCallback);
+
+	QTimer *vramTimer = new QTimer(this);
+	connect(vramTimer, SIGNAL(timeout()), this, SLOT(UpdateVideoMemory()));
+	vramTimer->start(1000);
+	UpdateVideoMemory();
 }
 
 OBSBasicProperties::~OBSBasicProperties()
@@ -112,6 +121,29 @@ OBSBasicProperties::~OBSBasicProperties()
 	main->SaveProject();
 }
 
+static inline QString MegabytesText(uint64_t bytes)
+{
+	return QString::number(double(bytes) / (1024.0 * 1024.0), 'f', 1);
+}
+
+void OBSBasicProperties::UpdateVideoMemory()
+{
+	uint64_t sourceBytes = obs_source_get_vram_usage(source);
+	uint64_t filterBytes = 0;
+
+	auto addFilter = [] (obs_source_t*, obs_source_t *filter, void *param)
+	{
+		uint64_t &bytes = *reinterpret_cast<uint64_t*>(param);
+		bytes += obs_source_get_vram_usage(filter);
+	};
+
+	obs_source_enum_filters(source, addFilter, &filterBytes);
+
+	vramLabel->setText(QTStr("Basic.PropertiesWindow.VideoMemory")
+			.arg(MegabytesText(sourceBytes),
+			     MegabytesText(filterBytes)));
+}
+
 void OBSBasicProperties::SourceRemoved(void *data, calldata_t *params)
 {
 	QMetaObject::invokeMethod(static_cast<OBSBasicProperties*>(data),
@@ -152,10 +184,10 @@ void OBSBasicProperties::on_buttonBox_clicked(QAbstractButton *button)
 		obs_data_clear(settings);
 		obs_data_release(settings);
 
-		if (view->DeferUpdate())
-			obs_data_apply(settings, oldSettings);
-		else
-			obs_source_update(source, oldSettings);
+		/* restore through obs_source_update even when updates are
+		 * deferred, so the cached save data of the source is
+		 * invalidated along with its settings */
+		obs_source_update(source, oldSettings);
 
 		close();
 	}
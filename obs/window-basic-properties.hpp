@@ -24,6 +24,7 @@
 #include <obs.hpp>
 
 class OBSPropertiesView;
+class QLabel;
 class OBSBasic;
 
 class OBSBasicProperties : public QDialog {
@@ -42,6 +43,7 @@ private:
 	OBSData    oldSettings;
 	OBSPropertiesView *view;
 	QDialogButtonBox *buttonBox;
+	QLabel     *vramLabel;
 
 	static void SourceRemoved(void *data, calldata_t *params);
 	static void SourceRenamed(void *data, calldata_t *params);
@@ -53,6 +55,7 @@ private:
 
 private slots:
 	void on_buttonBox_clicked(QAbstractButton *button);
+	void UpdateVideoMemory();
 
 public:
 	OBSBasicProperties(QWidget *parent, OBSSource source_);
@@ -1,5 +1,8 @@
 #include <QLabel>
+#include <algorithm>
+#include <vector>
 #include "obs-app.hpp"
+#include "qt-wrappers.hpp"
 #include "window-basic-main.hpp"
 #include "window-basic-status-bar.hpp"
 #include "window-basic-main-outputs.hpp"
@@ -10,7 +13,8 @@ OBSBasicStatusBar::OBSBasicStatusBar(QWidget *parent)
 	  droppedFrames (new QLabel),
 	  sessionTime   (new QLabel),
 	  cpuUsage      (new QLabel),
-	  kbps          (new QLabel)
+	  kbps          (new QLabel),
+	  perfStats     (new QLabel)
 {
 	sessionTime->setText(QString("00:00:00"));
 	cpuUsage->setText(QString("CPU: 0.0%"));
@@ -20,18 +24,30 @@ OBSBasicStatusBar::OBSBasicStatusBar(QWidget *parent)
 	sessionTime->setAlignment(Qt::AlignRight);
 	cpuUsage->setAlignment(Qt::AlignRight);
 	kbps->setAlignment(Qt::AlignRight);
+	perfStats->setAlignment(Qt::AlignRight);
 
 	delayInfo->setIndent(20);
 	droppedFrames->setIndent(20);
 	sessionTime->setIndent(20);
 	cpuUsage->setIndent(20);
 	kbps->setIndent(10);
+	perfStats->setIndent(20);
 
+	perfStats->setToolTip(QTStr("Basic.StatusBar.Performance.ToolTip"));
+
+	addPermanentWidget(perfStats);
 	addPermanentWidget(droppedFrames);
 	addPermanentWidget(sessionTime);
 	addPermanentWidget(cpuUsage);
 	addPermanentWidget(delayInfo);
 	addPermanentWidget(kbps);
+
+	threadCpuInfo = os_thread_cpu_info_start();
+}
+
+OBSBasicStatusBar::~OBSBasicStatusBar()
+{
+	os_thread_cpu_info_destroy(threadCpuInfo);
 }
 
 void OBSBasicStatusBar::Activate()
@@ -41,6 +57,7 @@ void OBSBasicStatusBar::Activate()
 		connect(refreshTimer, SIGNAL(timeout()),
 				this, SLOT(UpdateStatusBar()));
 		totalSeconds = 0;
+		ResetPerfStats();
 		refreshTimer->start(1000);
 
 		active = true;
@@ -59,6 +76,7 @@ void OBSBasicStatusBar::Deactivate()
 		delayInfo->setText("");
 		droppedFrames->setText("");
 		kbps->setText("");
+		perfStats->setText("");
 
 		delaySecTotal = 0;
 		delaySecStarting = 0;
@@ -139,6 +157,41 @@ void OBSBasicStatusBar::UpdateCPUUsage()
 		QString::number(main->GetCPUUsage(), 'f', 1) + QString("%");
 	cpuUsage->setText(text);
 	cpuUsage->setMinimumWidth(cpuUsage->width());
+
+	UpdateThreadCPUUsage();
+}
+
+#define MAX_TOOLTIP_THREADS 15
+
+/* lists the busiest threads in the CPU tooltip, so it's clear whether the
+ * encoder, the graphics thread or the UI itself is using the CPU */
+void OBSBasicStatusBar::UpdateThreadCPUUsage()
+{
+	const struct os_thread_cpu_usage *usage;
+	size_t count = os_thread_cpu_info_query(threadCpuInfo, &usage);
+
+	std::vector<const struct os_thread_cpu_usage*> threads;
+	threads.reserve(count);
+	for (size_t i = 0; i < count; i++)
+		threads.push_back(&usage[i]);
+
+	std::sort(threads.begin(), threads.end(),
+			[] (const struct os_thread_cpu_usage *a,
+				const struct os_thread_cpu_usage *b)
+	{
+		return a->percent > b->percent;
+	});
+
+	QString text = QTStr("Basic.StatusBar.CPU.ToolTip");
+	for (size_t i = 0; i < threads.size() && i < MAX_TOOLTIP_THREADS;
+			i++) {
+		text += QString("\n") + QT_UTF8(threads[i]->name) +
+			QString(": ") +
+			QString::number(threads[i]->percent, 'f', 1) +
+			QString("%");
+	}
+
+	cpuUsage->setToolTip(text);
 }
 
 void OBSBasicStatusBar::UpdateSessionTime()
@@ -194,6 +247,89 @@ void OBSBasicStatusBar::UpdateDroppedFrames()
 	droppedFrames->setMinimumWidth(droppedFrames->width());
 }
 
+static uint64_t GetSkippedFrames()
+{
+	video_t *video = obs_get_video();
+	return video ? video_output_get_skipped_frames(video) : 0;
+}
+
+static uint64_t GetLaggedFrames()
+{
+	struct obs_video_frame_timing timing;
+	return obs_get_video_frame_timing(&timing) ? timing.lagged_frames : 0;
+}
+
+void OBSBasicStatusBar::ResetPerfStats()
+{
+	skippedFramesBase = GetSkippedFrames();
+	laggedFramesBase  = GetLaggedFrames();
+}
+
+static inline QString FormatMs(uint64_t ns)
+{
+	return QString::number(double(ns) / 1000000.0, 'f', 1);
+}
+
+/* Everything shown here comes from counters libobs keeps anyway, so this
+ * costs a few copies a second.  Render time and GPU wait point at the video
+ * thread, a full encoder queue at the encoder, and skipped frames without
+ * either at the outputs or network. */
+void OBSBasicStatusBar::UpdatePerfStats()
+{
+	struct obs_video_pipeline_timing timing;
+	if (!obs_get_video_pipeline_timing(&timing))
+		return;
+
+	uint64_t renderNs = timing.stages[OBS_VIDEO_STAGE_RENDER_VIDEO].avg_ns;
+	uint64_t gpuWaitNs =
+		timing.stages[OBS_VIDEO_STAGE_DOWNLOAD_FRAME].avg_ns;
+
+	obs_output_t *output = streamOutput ? streamOutput : recordOutput;
+	obs_encoder_t *encoder = output ?
+		obs_output_get_video_encoder(output) : nullptr;
+
+	struct obs_encoder_stats encStats = {};
+	if (encoder)
+		obs_encoder_get_stats(encoder, &encStats);
+
+	uint32_t audioBufferMs = 0;
+	obs_enum_sources([] (void *param, obs_source_t *source)
+	{
+		struct audio_line_stats stats;
+		uint32_t &maxMs = *reinterpret_cast<uint32_t*>(param);
+
+		if (obs_source_get_audio_buffer_stats(source, &stats) &&
+		    stats.buffered_ms > maxMs)
+			maxMs = stats.buffered_ms;
+		return true;
+	}, &audioBufferMs);
+
+	uint32_t videoBufferFrames = 0;
+	obs_enum_sources([] (void *param, obs_source_t *source)
+	{
+		struct obs_source_async_stats stats;
+		uint32_t &maxFrames = *reinterpret_cast<uint32_t*>(param);
+
+		if (obs_source_get_async_video_stats(source, &stats) &&
+		    stats.jitter_depth > maxFrames)
+			maxFrames = stats.jitter_depth;
+		return true;
+	}, &videoBufferFrames);
+
+	uint64_t skipped = GetSkippedFrames() - skippedFramesBase;
+	uint64_t lagged  = GetLaggedFrames() - laggedFramesBase;
+
+	QString text = QTStr("Basic.StatusBar.Performance");
+	text = text.arg(FormatMs(renderNs), FormatMs(gpuWaitNs),
+			QString::number(encStats.queue_count),
+			QString::number(encStats.queue_depth),
+			QString::number(skipped), QString::number(lagged),
+			QString::number(audioBufferMs),
+			QString::number(videoBufferFrames));
+	perfStats->setText(text);
+	perfStats->setMinimumWidth(perfStats->width());
+}
+
 void OBSBasicStatusBar::OBSOutputReconnect(void *data, calldata_t *params)
 {
 	OBSBasicStatusBar *statusBar =
@@ -244,6 +380,7 @@ void OBSBasicStatusBar::UpdateStatusBar()
 	UpdateBandwidth();
 	UpdateSessionTime();
 	UpdateDroppedFrames();
+	UpdatePerfStats();
 }
 
 void OBSBasicStatusBar::StreamDelayStarting(int sec)
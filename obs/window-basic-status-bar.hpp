@@ -17,6 +17,7 @@ private:
 	QLabel *sessionTime;
 	QLabel *cpuUsage;
 	QLabel *kbps;
+	QLabel *perfStats;
 
 	obs_output_t *streamOutput = nullptr;
 	obs_output_t *recordOutput = nullptr;
@@ -35,6 +36,11 @@ private:
 	uint64_t lastBytesSent = 0;
 	uint64_t lastBytesSentTime = 0;
 
+	uint64_t skippedFramesBase = 0;
+	uint64_t laggedFramesBase = 0;
+
+	os_thread_cpu_info_t *threadCpuInfo = nullptr;
+
 	QPointer<QTimer> refreshTimer;
 
 	obs_output_t *GetOutput();
@@ -46,6 +52,9 @@ private:
 	void UpdateBandwidth();
 	void UpdateSessionTime();
 	void UpdateDroppedFrames();
+	void ResetPerfStats();
+	void UpdatePerfStats();
+	void UpdateThreadCPUUsage();
 
 	static void OBSOutputReconnect(void *data, calldata_t *params);
 	static void OBSOutputReconnectSuccess(void *data, calldata_t *params);
@@ -58,6 +67,7 @@ private slots:
 
 public:
 	OBSBasicStatusBar(QWidget *parent);
+	~OBSBasicStatusBar();
 
 	void StreamDelayStarting(int sec);
 	void StreamDelayStopping(int sec);
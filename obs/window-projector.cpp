@@ -1,12 +1,47 @@
 #include <QAction>
 #include <QMouseEvent>
 #include <QMenu>
+#include <map>
 #include "window-projector.hpp"
 #include "display-helpers.hpp"
 #include "qt-wrappers.hpp"
 #include "platform.hpp"
 #include "obs-app.hpp"
 
+/* projectors of the same source share a cached view, so that the source is
+ * only rendered once per frame however many projectors show it.  only used
+ * from the UI thread */
+struct SharedView {
+	obs_view_t *view;
+	int        refs;
+};
+
+static std::map<obs_source_t*, SharedView> sharedViews;
+
+static obs_view_t *AcquireSharedView(obs_source_t *source)
+{
+	SharedView &shared = sharedViews[source];
+
+	if (!shared.refs++) {
+		shared.view = obs_view_create();
+		obs_view_set_source(shared.view, 0, source);
+	}
+
+	return shared.view;
+}
+
+static void ReleaseSharedView(obs_source_t *source)
+{
+	auto it = sharedViews.find(source);
+	if (it == sharedViews.end())
+		return;
+
+	if (--it->second.refs == 0) {
+		obs_view_destroy(it->second.view);
+		sharedViews.erase(it);
+	}
+}
+
 OBSProjector::OBSProjector(QWidget *widget, obs_source_t *source_)
 	: OBSQTDisplay                 (widget,
 	                                Qt::Window | Qt::FramelessWindowHint),
@@ -16,6 +51,9 @@ OBSProjector::OBSProjector(QWidget *widget, obs_source_t *source_)
 {
 	setAttribute(Qt::WA_DeleteOnClose, true);
 
+	if (source)
+		view = AcquireSharedView(source);
+
 	installEventFilter(CreateShortcutFilter());
 
 	auto addDrawCallback = [this] ()
@@ -31,6 +69,11 @@ OBSProjector::~OBSProjector()
 {
 	if (source)
 		obs_source_dec_showing(source);
+
+	if (view) {
+		obs_display_remove_draw_callback(GetDisplay(), OBSRender, this);
+		ReleaseSharedView(source);
+	}
 }
 
 void OBSProjector::Init(int monitor)
@@ -83,10 +126,10 @@ void OBSProjector::OBSRender(void *data, uint32_t cx, uint32_t cy)
 	gs_ortho(0.0f, float(targetCX), 0.0f, float(targetCY), -100.0f, 100.0f);
 	gs_set_viewport(x, y, newCX, newCY);
 
-	if (window->source)
-		obs_source_video_render(window->source);
+	if (window->view)
+		obs_view_render_cached(window->view, targetCX, targetCY);
 	else
-		obs_render_main_view();
+		obs_render_main_texture();
 
 	gs_projection_pop();
 	gs_viewport_pop();
@@ -11,6 +11,7 @@ class OBSProjector : public OBSQTDisplay {
 private:
 	OBSSource source;
 	OBSSignal removedSignal;
+	obs_view_t *view = nullptr;
 
 	static void OBSRender(void *data, uint32_t cx, uint32_t cy);
 	static void OBSSourceRemoved(void *data, calldata_t *params);
@@ -8,6 +8,15 @@
 #define LOG(level, message, ...) blog(level, "%s: " message, \
 		obs_source_get_name(this->decklink->GetSource()), ##__VA_ARGS__)
 
+/* input frames come from a pool owned by the driver, so only a few of them
+ * are kept until libobs is done with them, the rest are copied as before */
+#define MAX_HELD_FRAMES 8
+
+struct HeldFrame {
+	DeckLinkDeviceInstance   *instance;
+	IDeckLinkVideoInputFrame *frame;
+};
+
 DeckLinkDeviceInstance::DeckLinkDeviceInstance(DeckLink *decklink_,
 		DeckLinkDevice *device_) :
 	currentFrame(), currentPacket(), decklink(decklink_), device(device_)
@@ -74,7 +83,33 @@ void DeckLinkDeviceInstance::HandleVideoFrame(
 			currentFrame.color_matrix, currentFrame.color_range_min,
 			currentFrame.color_range_max);
 
-	obs_source_output_video(decklink->GetSource(), &currentFrame);
+	if (os_atomic_inc_long(&heldFrames) > MAX_HELD_FRAMES) {
+		os_atomic_dec_long(&heldFrames);
+		obs_source_output_video(decklink->GetSource(), &currentFrame);
+		return;
+	}
+
+	HeldFrame *held = new HeldFrame;
+	held->instance = this;
+	held->frame    = videoFrame;
+
+	AddRef();
+	videoFrame->AddRef();
+
+	obs_source_output_video_ref(decklink->GetSource(), &currentFrame,
+			ReleaseFrame, held);
+}
+
+void DeckLinkDeviceInstance::ReleaseFrame(void *param)
+{
+	HeldFrame *held = reinterpret_cast<HeldFrame*>(param);
+	DeckLinkDeviceInstance *instance = held->instance;
+
+	held->frame->Release();
+	delete held;
+
+	os_atomic_dec_long(&instance->heldFrames);
+	instance->Release();
 }
 
 bool DeckLinkDeviceInstance::StartCapture(DeckLinkDeviceMode *mode_)
@@ -132,6 +167,10 @@ bool DeckLinkDeviceInstance::StopCapture(void)
 
 	input->StopStreams();
 	input->SetCallback(nullptr);
+
+	/* give held frames back to the driver before the input goes away */
+	obs_source_flush_async_video(decklink->GetSource());
+
 	input->DisableVideoInput();
 	input->DisableAudioInput();
 
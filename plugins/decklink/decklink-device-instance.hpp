@@ -12,6 +12,9 @@ protected:
 	BMDPixelFormat          pixelFormat = bmdFormat8BitYUV;
 	ComPtr<IDeckLinkInput>  input;
 	volatile long           refCount = 1;
+	volatile long           heldFrames = 0;
+
+	static void ReleaseFrame(void *param);
 
 	void HandleAudioPacket(IDeckLinkAudioInputPacket *audioPacket,
 			const uint64_t timestamp);
@@ -5,6 +5,7 @@
 #include <obs-module.h>
 
 OBS_DECLARE_MODULE()
+OBS_MODULE_DEFERRABLE()
 OBS_MODULE_USE_DEFAULT_LOCALE("decklink", "en-US")
 
 static DeckLinkDeviceDiscovery *deviceEnum = nullptr;
@@ -0,0 +1,271 @@
+#include <util/threading.h>
+#include <util/darray.h>
+#include <util/bmem.h>
+
+#include "image-cache.h"
+
+enum image_state {
+	IMAGE_LOADING,
+	IMAGE_LOADED,
+	IMAGE_FAILED
+};
+
+struct image_cache_entry {
+	char                 *file;
+	time_t               timestamp;
+	uint32_t             flags;
+	long                 refs;
+
+	enum image_state     state;
+	struct gs_texture_data data;
+	uint32_t             cx;
+	uint32_t             cy;
+	bool                 opaque;
+	gs_texture_t         *tex;
+};
+
+/* everything below is protected by the cache mutex.  never enter graphics
+ * with it held: the texture is created under it from the render thread */
+static pthread_mutex_t cache_mutex;
+static DARRAY(struct image_cache_entry*) cache;
+static DARRAY(struct image_cache_entry*) load_queue;
+
+static os_sem_t        *load_sem;
+static pthread_t       load_thread;
+static bool            load_thread_active;
+static volatile bool   stop_loading;
+
+static bool image_opaque(const uint8_t *data, enum gs_color_format format,
+		uint32_t cx, uint32_t cy)
+{
+	size_t size = (size_t)cx * (size_t)cy * 4;
+
+	if (format == GS_BGRX)
+		return true;
+	if (format != GS_BGRA && format != GS_RGBA)
+		return false;
+
+	for (size_t i = 3; i < size; i += 4) {
+		if (data[i] != 0xFF)
+			return false;
+	}
+
+	return true;
+}
+
+/* mipmaps and compression are done here as well, so the graphics thread
+ * only has to upload the result */
+static void load_image(struct image_cache_entry *entry)
+{
+	enum gs_color_format format = GS_BGRA;
+	struct gs_texture_data texdata = {0};
+	uint32_t cx = 0;
+	uint32_t cy = 0;
+	uint8_t *data;
+	bool opaque = false;
+	bool success = false;
+
+	data = gs_create_texture_file_data(entry->file, &format, &cx, &cy);
+	if (data) {
+		opaque = image_opaque(data, format, cx, cy);
+		success = gs_texture_data_init(&texdata, data, format, cx, cy,
+				entry->flags);
+		bfree(data);
+	}
+
+	if (!success)
+		blog(LOG_WARNING, "[image_source]: Failed to load image '%s'",
+				entry->file);
+
+	pthread_mutex_lock(&cache_mutex);
+	entry->data   = texdata;
+	entry->cx     = cx;
+	entry->cy     = cy;
+	entry->opaque = opaque;
+	entry->state  = success ? IMAGE_LOADED : IMAGE_FAILED;
+	pthread_mutex_unlock(&cache_mutex);
+}
+
+static void *image_load_thread(void *unused)
+{
+	os_set_thread_name("image-source: load thread");
+
+	while (os_sem_wait(load_sem) == 0 && !stop_loading) {
+		struct image_cache_entry *entry = NULL;
+
+		pthread_mutex_lock(&cache_mutex);
+		if (load_queue.num) {
+			entry = load_queue.array[0];
+			da_erase(load_queue, 0);
+			entry->refs++;
+		}
+		pthread_mutex_unlock(&cache_mutex);
+
+		if (entry) {
+			load_image(entry);
+			image_cache_release(entry);
+		}
+	}
+
+	UNUSED_PARAMETER(unused);
+	return NULL;
+}
+
+void image_cache_init(void)
+{
+	pthread_mutex_init(&cache_mutex, NULL);
+
+	if (os_sem_init(&load_sem, 0) != 0) {
+		blog(LOG_ERROR, "[image_source]: Failed to create semaphore");
+		return;
+	}
+
+	load_thread_active = pthread_create(&load_thread, NULL,
+			image_load_thread, NULL) == 0;
+	if (!load_thread_active)
+		blog(LOG_ERROR, "[image_source]: Failed to create load thread");
+}
+
+void image_cache_free(void)
+{
+	if (load_thread_active) {
+		stop_loading = true;
+		os_sem_post(load_sem);
+		pthread_join(load_thread, NULL);
+		load_thread_active = false;
+	}
+
+	os_sem_destroy(load_sem);
+	load_sem = NULL;
+
+	da_free(load_queue);
+	da_free(cache);
+	pthread_mutex_destroy(&cache_mutex);
+}
+
+image_cache_entry_t *image_cache_acquire(const char *file, time_t timestamp,
+		uint32_t flags)
+{
+	struct image_cache_entry *entry;
+
+	pthread_mutex_lock(&cache_mutex);
+
+	for (size_t i = 0; i < cache.num; i++) {
+		entry = cache.array[i];
+
+		if (entry->timestamp == timestamp && entry->flags == flags &&
+		    strcmp(entry->file, file) == 0) {
+			entry->refs++;
+			pthread_mutex_unlock(&cache_mutex);
+			return entry;
+		}
+	}
+
+	entry = bzalloc(sizeof(*entry));
+	entry->file      = bstrdup(file);
+	entry->timestamp = timestamp;
+	entry->flags     = flags;
+	entry->refs      = 1;
+	entry->state     = IMAGE_LOADING;
+
+	da_push_back(cache, &entry);
+
+	if (load_thread_active) {
+		da_push_back(load_queue, &entry);
+		pthread_mutex_unlock(&cache_mutex);
+		os_sem_post(load_sem);
+	} else {
+		pthread_mutex_unlock(&cache_mutex);
+		load_image(entry);
+	}
+
+	return entry;
+}
+
+void image_cache_release(image_cache_entry_t *entry)
+{
+	bool destroy;
+
+	if (!entry)
+		return;
+
+	pthread_mutex_lock(&cache_mutex);
+	destroy = --entry->refs == 0;
+	if (destroy) {
+		da_erase_item(cache, &entry);
+		da_erase_item(load_queue, &entry);
+	}
+	pthread_mutex_unlock(&cache_mutex);
+
+	if (!destroy)
+		return;
+
+	if (entry->tex) {
+		obs_enter_graphics();
+		gs_texture_destroy(entry->tex);
+		obs_leave_graphics();
+	}
+
+	gs_texture_data_free(&entry->data);
+	bfree(entry->file);
+	bfree(entry);
+}
+
+bool image_cache_loading(image_cache_entry_t *entry)
+{
+	bool loading;
+
+	pthread_mutex_lock(&cache_mutex);
+	loading = entry->state == IMAGE_LOADING;
+	pthread_mutex_unlock(&cache_mutex);
+
+	return loading;
+}
+
+bool image_cache_get_size(image_cache_entry_t *entry,
+		uint32_t *cx, uint32_t *cy)
+{
+	bool loaded;
+
+	pthread_mutex_lock(&cache_mutex);
+	loaded = entry->state == IMAGE_LOADED;
+	if (loaded) {
+		*cx = entry->cx;
+		*cy = entry->cy;
+	}
+	pthread_mutex_unlock(&cache_mutex);
+
+	return loaded;
+}
+
+bool image_cache_opaque(image_cache_entry_t *entry)
+{
+	bool opaque;
+
+	pthread_mutex_lock(&cache_mutex);
+	opaque = entry->state == IMAGE_LOADED && entry->opaque;
+	pthread_mutex_unlock(&cache_mutex);
+
+	return opaque;
+}
+
+gs_texture_t *image_cache_get_texture(image_cache_entry_t *entry)
+{
+	gs_texture_t *tex;
+
+	pthread_mutex_lock(&cache_mutex);
+
+	/* the first source to draw the image uploads it */
+	if (entry->state == IMAGE_LOADED && !entry->tex) {
+		entry->tex = gs_texture_create_from_data(&entry->data);
+		if (!entry->tex)
+			entry->state = IMAGE_FAILED;
+
+		gs_texture_data_free(&entry->data);
+	}
+
+	tex = entry->tex;
+	pthread_mutex_unlock(&cache_mutex);
+
+	return tex;
+}
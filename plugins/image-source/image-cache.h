@@ -0,0 +1,35 @@
+#pragma once
+
+#include <obs-module.h>
+#include <time.h>
+
+/*
+ * Decoded images are shared between all image sources that use the same
+ * file (and modification time).  Files are decoded on a separate thread, and
+ * only the texture upload happens on the graphics thread, the first time the
+ * image is drawn.
+ */
+
+struct image_cache_entry;
+typedef struct image_cache_entry image_cache_entry_t;
+
+extern void image_cache_init(void);
+extern void image_cache_free(void);
+
+/* never returns NULL, the image may still be loading or may have failed.
+ * flags are the GS_TEXDATA_* flags the texture is prepared with */
+extern image_cache_entry_t *image_cache_acquire(const char *file,
+		time_t timestamp, uint32_t flags);
+extern void image_cache_release(image_cache_entry_t *entry);
+
+extern bool image_cache_loading(image_cache_entry_t *entry);
+
+/* returns false if the image hasn't finished loading yet or failed */
+extern bool image_cache_get_size(image_cache_entry_t *entry,
+		uint32_t *cx, uint32_t *cy);
+
+/* true if the image has no transparent pixels */
+extern bool image_cache_opaque(image_cache_entry_t *entry);
+
+/* must be called with the graphics context entered */
+extern gs_texture_t *image_cache_get_texture(image_cache_entry_t *entry);
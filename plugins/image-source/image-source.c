@@ -1,7 +1,10 @@
 #include <obs-module.h>
 #include <util/platform.h>
+#include <util/file-watch.h>
 #include <sys/stat.h>
 
+#include "image-cache.h"
+
 #define blog(log_level, format, ...) \
 	blog(log_level, "[image_source: '%s'] " format, \
 			obs_source_get_name(context->source), ##__VA_ARGS__)
@@ -18,12 +21,20 @@ struct image_source {
 
 	char         *file;
 	bool         persistent;
+	bool         optimize;
 	time_t       file_timestamp;
-	float        update_time_elapsed;
+	os_file_watch_t *watch;
+	volatile bool file_changed;
 
-	gs_texture_t *tex;
+	image_cache_entry_t *image;
+	image_cache_entry_t *next_image;
 	uint32_t     cx;
 	uint32_t     cy;
+
+	/* counts the images swapped in, see image_source_unchanged */
+	long         image_changes;
+	long         last_image_changes;
+	bool         image_changed;
 };
 
 
@@ -40,44 +51,73 @@ static const char *image_source_get_name(void *unused)
 	return obs_module_text("ImageInput");
 }
 
+/* the current image keeps being drawn until the new one has finished loading
+ * in the background */
 static void image_source_load(struct image_source *context)
 {
 	char *file = context->file;
 
-	obs_enter_graphics();
-
-	if (context->tex)
-		gs_texture_destroy(context->tex);
-	context->tex = NULL;
+	image_cache_release(context->next_image);
+	context->next_image = NULL;
 
 	if (file && *file) {
 		debug("loading texture '%s'", file);
 		context->file_timestamp = get_modified_timestamp(file);
-		context->tex = gs_texture_create_from_file(file);
-		context->update_time_elapsed = 0;
-
-		if (context->tex) {
-			context->cx = gs_texture_get_width(context->tex);
-			context->cy = gs_texture_get_height(context->tex);
-		} else {
-			warn("failed to load texture '%s'", file);
-			context->cx = 0;
-			context->cy = 0;
-		}
+		context->next_image = image_cache_acquire(file,
+				context->file_timestamp,
+				context->optimize ?
+				GS_TEXDATA_MIPMAPS | GS_TEXDATA_COMPRESS : 0);
+	} else {
+		image_cache_release(context->image);
+		context->image = NULL;
+		context->image_changes++;
+		context->cx = 0;
+		context->cy = 0;
+		obs_source_set_opaque(context->source, false);
 	}
-
-	obs_leave_graphics();
 }
 
 static void image_source_unload(struct image_source *context)
 {
-	obs_enter_graphics();
+	image_cache_release(context->next_image);
+	image_cache_release(context->image);
+	context->next_image = NULL;
+	context->image = NULL;
+	context->image_changes++;
+	context->cx = 0;
+	context->cy = 0;
+	obs_source_set_opaque(context->source, false);
+}
+
+static void image_source_swap_loaded(struct image_source *context)
+{
+	image_cache_entry_t *image = context->next_image;
 
-	if (context->tex)
-		gs_texture_destroy(context->tex);
-	context->tex = NULL;
+	if (!image || image_cache_loading(image))
+		return;
+
+	image_cache_release(context->image);
+	context->image = image;
+	context->next_image = NULL;
+	context->image_changes++;
 
-	obs_leave_graphics();
+	/* set again once the texture exists */
+	obs_source_set_opaque(context->source, false);
+
+	if (!image_cache_get_size(image, &context->cx, &context->cy)) {
+		warn("failed to load texture '%s'", context->file);
+		context->cx = 0;
+		context->cy = 0;
+	}
+}
+
+/* called from the file watch thread */
+static void image_source_file_changed(void *data, const char *path)
+{
+	struct image_source *context = data;
+	context->file_changed = true;
+
+	UNUSED_PARAMETER(path);
 }
 
 static void image_source_update(void *data, obs_data_t *settings)
@@ -85,14 +125,26 @@ static void image_source_update(void *data, obs_data_t *settings)
 	struct image_source *context = data;
 	const char *file = obs_data_get_string(settings, "file");
 	const bool unload = obs_data_get_bool(settings, "unload");
+	const bool optimize = obs_data_get_bool(settings, "optimize");
+
+	os_file_watch_remove(context->watch);
+	context->watch = NULL;
+	context->file_changed = false;
 
 	if (context->file)
 		bfree(context->file);
 	context->file = bstrdup(file);
 	context->persistent = !unload;
+	context->optimize = optimize;
 
-	/* Load the image if the source is persistent or showing */
-	if (context->persistent || obs_source_showing(context->source))
+	if (file && *file)
+		context->watch = os_file_watch_add(file,
+				image_source_file_changed, context);
+
+	/* Load the image if the source is persistent, showing or about to
+	 * be shown */
+	if (context->persistent || obs_source_showing(context->source) ||
+	    obs_source_prepared(context->source))
 		image_source_load(data);
 	else
 		image_source_unload(data);
@@ -101,13 +153,21 @@ static void image_source_update(void *data, obs_data_t *settings)
 static void image_source_defaults(obs_data_t *settings)
 {
 	obs_data_set_default_bool(settings, "unload", true);
+	obs_data_set_default_bool(settings, "optimize", true);
+}
+
+static inline bool image_source_loaded(struct image_source *context)
+{
+	return context->image || context->next_image;
 }
 
+/* a prepared image has already been loaded (or is loading) in the
+ * background, so showing it doesn't have to start over */
 static void image_source_show(void *data)
 {
 	struct image_source *context = data;
 
-	if (!context->persistent)
+	if (!context->persistent && !image_source_loaded(context))
 		image_source_load(context);
 }
 
@@ -115,10 +175,44 @@ static void image_source_hide(void *data)
 {
 	struct image_source *context = data;
 
-	if (!context->persistent)
+	if (!context->persistent && !obs_source_prepared(context->source))
+		image_source_unload(context);
+}
+
+static void image_source_prepare(void *data)
+{
+	struct image_source *context = data;
+
+	if (!context->persistent && !image_source_loaded(context))
+		image_source_load(context);
+}
+
+static void image_source_unprepare(void *data)
+{
+	struct image_source *context = data;
+
+	if (!context->persistent && !obs_source_showing(context->source))
+		image_source_unload(context);
+}
+
+/* persistent images stay loaded while hidden, until libobs decides they've
+ * been unused for long enough.  the others are already unloaded */
+static void image_source_suspend(void *data)
+{
+	struct image_source *context = data;
+
+	if (context->persistent)
 		image_source_unload(context);
 }
 
+static void image_source_resume(void *data)
+{
+	struct image_source *context = data;
+
+	if (context->persistent)
+		image_source_load(context);
+}
+
 static void *image_source_create(obs_data_t *settings, obs_source_t *source)
 {
 	struct image_source *context = bzalloc(sizeof(struct image_source));
@@ -132,6 +226,7 @@ static void image_source_destroy(void *data)
 {
 	struct image_source *context = data;
 
+	os_file_watch_remove(context->watch);
 	image_source_unload(context);
 
 	if (context->file)
@@ -154,33 +249,53 @@ static uint32_t image_source_getheight(void *data)
 static void image_source_render(void *data, gs_effect_t *effect)
 {
 	struct image_source *context = data;
+	gs_texture_t *tex;
 
-	if (!context->tex)
+	if (!context->image)
 		return;
 
+	tex = image_cache_get_texture(context->image);
+	if (!tex)
+		return;
+
+	obs_source_set_opaque(context->source,
+			image_cache_opaque(context->image));
+
 	gs_reset_blend_state();
-	gs_effect_set_texture(gs_effect_get_param_by_name(effect, "image"),
-			context->tex);
-	gs_draw_sprite(context->tex, 0, context->cx, context->cy);
+	obs_source_draw(tex, 0, 0, context->cx, context->cy, false);
+
+	UNUSED_PARAMETER(effect);
 }
 
 static void image_source_tick(void *data, float seconds)
 {
 	struct image_source *context = data;
-	uint64_t now = os_gettime_ns();
 
-	if (!obs_source_showing(context->source)) return;
+	image_source_swap_loaded(context);
 
-	context->update_time_elapsed += seconds;
+	/* only reload images that are currently loaded, the others are loaded
+	 * fresh when they are shown */
+	if (context->file_changed) {
+		context->file_changed = false;
 
-	if (context->update_time_elapsed >= 1.0f) {
-		time_t t = get_modified_timestamp(context->file);
-		context->update_time_elapsed = 0.0f;
-
-		if (context->file_timestamp < t) {
+		if (image_source_loaded(context))
 			image_source_load(context);
-		}
 	}
+
+	/* show/hide, suspend and updates all happen before the tick */
+	context->image_changed =
+		context->image_changes != context->last_image_changes;
+	context->last_image_changes = context->image_changes;
+
+	UNUSED_PARAMETER(seconds);
+}
+
+/* the image only changes when a new one is swapped in.  its texture is
+ * uploaded by the first draw after that, which the change makes happen */
+static bool image_source_unchanged(void *data)
+{
+	struct image_source *context = data;
+	return !context->image_changed;
 }
 
 
@@ -203,6 +318,8 @@ static obs_properties_t *image_source_properties(void *unused)
 			OBS_PATH_FILE, image_filter, NULL);
 	obs_properties_add_bool(props,
 			"unload", obs_module_text("UnloadWhenNotShowing"));
+	obs_properties_add_bool(props,
+			"optimize", obs_module_text("OptimizeForScaling"));
 
 	return props;
 }
@@ -210,7 +327,9 @@ static obs_properties_t *image_source_properties(void *unused)
 static struct obs_source_info image_source_info = {
 	.id             = "image_source",
 	.type           = OBS_SOURCE_TYPE_INPUT,
-	.output_flags   = OBS_SOURCE_VIDEO,
+	.output_flags   = OBS_SOURCE_VIDEO | OBS_SOURCE_UV_CROP |
+	                  OBS_SOURCE_THREADED_TICK |
+	                  OBS_SOURCE_THREADED_CREATE,
 	.get_name       = image_source_get_name,
 	.create         = image_source_create,
 	.destroy        = image_source_destroy,
@@ -218,10 +337,15 @@ static struct obs_source_info image_source_info = {
 	.get_defaults   = image_source_defaults,
 	.show           = image_source_show,
 	.hide           = image_source_hide,
+	.suspend        = image_source_suspend,
+	.resume         = image_source_resume,
+	.prepare        = image_source_prepare,
+	.unprepare      = image_source_unprepare,
 	.get_width      = image_source_getwidth,
 	.get_height     = image_source_getheight,
 	.video_render   = image_source_render,
 	.video_tick     = image_source_tick,
+	.video_unchanged = image_source_unchanged,
 	.get_properties = image_source_properties
 };
 
@@ -230,6 +354,12 @@ OBS_MODULE_USE_DEFAULT_LOCALE("image-source", "en-US")
 
 bool obs_module_load(void)
 {
+	image_cache_init();
 	obs_register_source(&image_source_info);
 	return true;
 }
+
+void obs_module_unload(void)
+{
+	image_cache_free();
+}
@@ -17,12 +17,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <obs-module.h>
 
 OBS_DECLARE_MODULE()
+OBS_MODULE_DEFERRABLE()
 OBS_MODULE_USE_DEFAULT_LOCALE("linux-xshm", "en-US")
 
 extern struct obs_source_info xshm_input;
 
 extern void xcomposite_load(void);
 extern void xcomposite_unload(void);
+extern void xcb_xcursor_cache_free(void);
 
 bool obs_module_load(void)
 {
@@ -34,4 +36,5 @@ bool obs_module_load(void)
 void obs_module_unload(void)
 {
 	xcomposite_unload();
+	xcb_xcursor_cache_free();
 }
@@ -439,6 +439,11 @@ void XCompcapMain::updateSettings(obs_data_t *settings)
 	glXBindTexImageEXT(xdisp, p->glxpixmap, GLX_FRONT_LEFT_EXT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	if (p->swapRedBlue) {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_BLUE);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
 }
 
 void XCompcapMain::tick(float seconds)
@@ -482,22 +487,6 @@ void XCompcapMain::tick(float seconds)
 		XSync(xdisp, 0);
 	}
 
-	if (p->include_border) {
-		gs_copy_texture_region(
-				p->tex, 0, 0,
-				p->gltex,
-				p->cur_cut_left,
-				p->cur_cut_top,
-				width(), height());
-	} else {
-		gs_copy_texture_region(
-				p->tex, 0, 0,
-				p->gltex,
-				p->cur_cut_left + p->border,
-				p->cur_cut_top + p->border,
-				width(), height());
-	}
-
 	if (p->cursor && p->show_cursor) {
 		xcursor_tick(p->cursor);
 
@@ -522,11 +511,25 @@ void XCompcapMain::render(gs_effect_t *effect)
 	if (!lock.isLocked() || !p->tex)
 		return;
 
+	/* the window pixmap is drawn from directly, so the only copy of the
+	 * window contents is the one the compositor already keeps */
+	gs_texture_t *tex = p->gltex ? p->gltex : p->tex;
+	uint32_t x = 0, y = 0;
+
+	if (p->gltex) {
+		x = p->cur_cut_left;
+		y = p->cur_cut_top;
+		if (!p->include_border) {
+			x += p->border;
+			y += p->border;
+		}
+	}
+
 	gs_eparam_t *image = gs_effect_get_param_by_name(effect, "image");
-	gs_effect_set_texture(image, p->tex);
+	gs_effect_set_texture(image, tex);
 
 	while (gs_effect_loop(effect, "Draw")) {
-		gs_draw_sprite(p->tex, 0, 0, 0);
+		gs_draw_sprite_subregion(tex, 0, x, y, width(), height());
 	}
 
 	if (p->cursor && p->gltex && p->show_cursor && !p->cursor_outside) {
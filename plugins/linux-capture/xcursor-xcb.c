@@ -19,36 +19,130 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <xcb/xfixes.h>
 
 #include <util/bmem.h>
+#include <util/darray.h>
 #include "xcursor-xcb.h"
 
+/* how many cursors that no source is showing are kept around */
+#define MAX_UNUSED_CURSORS 16
+
 /*
- * Create the cursor texture, either by updating if the new cursor has the same
- * size or by creating a new texture if the size is different
+ * Cursor textures are cached by xfixes cursor serial and shared between all
+ * sources, so switching between cursors doesn't keep creating textures.  The
+ * cache is only used from within the graphics context, which serializes
+ * access to it.
+ */
+struct xcb_cached_cursor {
+	uint32_t     serial;
+	gs_texture_t *tex;
+	long         refs;
+	uint64_t     last_used;
+};
+
+static DARRAY(struct xcb_cached_cursor) cursor_cache = {0};
+static uint64_t                         cursor_cache_time = 0;
+
+static struct xcb_cached_cursor *xcb_xcursor_cache_find(uint32_t serial)
+{
+	for (size_t i = 0; i < cursor_cache.num; i++) {
+		if (cursor_cache.array[i].serial == serial)
+			return &cursor_cache.array[i];
+	}
+
+	return NULL;
+}
+
+static void xcb_xcursor_cache_trim(void)
+{
+	size_t unused = 0;
+
+	for (size_t i = 0; i < cursor_cache.num; i++) {
+		if (!cursor_cache.array[i].refs)
+			unused++;
+	}
+
+	while (unused > MAX_UNUSED_CURSORS) {
+		size_t oldest = DARRAY_INVALID;
+
+		for (size_t i = 0; i < cursor_cache.num; i++) {
+			struct xcb_cached_cursor *cc = &cursor_cache.array[i];
+			if (cc->refs)
+				continue;
+			if (oldest == DARRAY_INVALID || cc->last_used <
+					cursor_cache.array[oldest].last_used)
+				oldest = i;
+		}
+
+		gs_texture_destroy(cursor_cache.array[oldest].tex);
+		da_erase(cursor_cache, oldest);
+		unused--;
+	}
+}
+
+static void xcb_xcursor_cache_release(xcb_xcursor_t *data)
+{
+	struct xcb_cached_cursor *cc;
+
+	if (!data->tex)
+		return;
+
+	cc = xcb_xcursor_cache_find(data->last_serial);
+	if (cc && cc->refs) {
+		cc->refs--;
+		cc->last_used = ++cursor_cache_time;
+	}
+
+	data->tex = NULL;
+	xcb_xcursor_cache_trim();
+}
+
+/*
+ * Get the texture for the new cursor, from the cache if it has been shown
+ * before or by creating it
  */
 static void xcb_xcursor_create(xcb_xcursor_t *data,
 		xcb_xfixes_get_cursor_image_reply_t *xc)
 {
-	uint32_t *pixels = xcb_xfixes_get_cursor_image_cursor_image(xc);
-	if (!pixels)
-		return;
+	struct xcb_cached_cursor *cc;
 
-	if (data->tex && data->last_height == xc->width &&
-			data->last_width == xc->height) {
-		gs_texture_set_image(data->tex, (const uint8_t *) pixels,
-			xc->width * sizeof(uint32_t), false);
-	} else {
-		if (data->tex)
-			gs_texture_destroy(data->tex);
+	xcb_xcursor_cache_release(data);
 
-		data->tex = gs_texture_create(xc->width, xc->height,
-			GS_BGRA, 1, (const uint8_t **) &pixels, GS_DYNAMIC);
+	cc = xcb_xcursor_cache_find(xc->cursor_serial);
+	if (!cc) {
+		uint32_t *pixels = xcb_xfixes_get_cursor_image_cursor_image(xc);
+		gs_texture_t *tex;
+
+		if (!pixels)
+			return;
+
+		tex = gs_texture_create(xc->width, xc->height, GS_BGRA, 1,
+				(const uint8_t **) &pixels, 0);
+		if (!tex)
+			return;
+
+		cc = da_push_back_new(cursor_cache);
+		cc->serial = xc->cursor_serial;
+		cc->tex = tex;
 	}
 
+	cc->refs++;
+	cc->last_used = ++cursor_cache_time;
+
+	data->tex         = cc->tex;
 	data->last_serial = xc->cursor_serial;
 	data->last_width  = xc->width;
 	data->last_height = xc->height;
 }
 
+void xcb_xcursor_cache_free(void)
+{
+	obs_enter_graphics();
+	for (size_t i = 0; i < cursor_cache.num; i++)
+		gs_texture_destroy(cursor_cache.array[i].tex);
+	obs_leave_graphics();
+
+	da_free(cursor_cache);
+}
+
 /**
  * We need to check for the xfixes version in order to initialize it ?
  */
@@ -67,8 +161,7 @@ xcb_xcursor_t *xcb_xcursor_init(xcb_connection_t *xcb)
 
 void xcb_xcursor_destroy(xcb_xcursor_t *data)
 {
-	if (data->tex)
-		gs_texture_destroy(data->tex);
+	xcb_xcursor_cache_release(data);
 	bfree(data);
 }
 
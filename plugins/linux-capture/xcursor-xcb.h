@@ -51,6 +51,13 @@ xcb_xcursor_t *xcb_xcursor_init(xcb_connection_t *xcb);
  */
 void xcb_xcursor_destroy(xcb_xcursor_t *data);
 
+/**
+ * Frees the cursor textures shared between all xcursor objects
+ *
+ * Call this when all xcursor objects have been destroyed
+ */
+void xcb_xcursor_cache_free(void);
+
 /**
  * Update the cursor data
  * @param data xcursor object
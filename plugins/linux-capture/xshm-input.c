@@ -19,6 +19,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdlib.h>
 #include <inttypes.h>
 #include <xcb/shm.h>
+#include <xcb/damage.h>
 #include <xcb/xfixes.h>
 #include <xcb/xinerama.h>
 
@@ -48,6 +49,10 @@ struct xshm_data {
 
 	gs_texture_t     *texture;
 
+	xcb_damage_damage_t damage;
+	xcb_xfixes_region_t damage_region;
+	bool             damage_full;
+
 	bool             show_cursor;
 	bool             use_xinerama;
 	bool             advanced;
@@ -83,6 +88,10 @@ static bool xshm_check_extensions(xcb_connection_t *xcb)
 	if (!xcb_get_extension_data(xcb, &xcb_xinerama_id)->present)
 		blog(LOG_INFO, "Missing Xinerama extension !");
 
+	if (!xcb_get_extension_data(xcb, &xcb_damage_id)->present)
+		blog(LOG_INFO, "Missing Damage extension, capturing the "
+				"full screen every frame");
+
 	return ok;
 }
 
@@ -129,6 +138,114 @@ static int_fast32_t xshm_update_geometry(struct xshm_data *data)
 	return 1;
 }
 
+/**
+ * Start tracking damage of the root window
+ *
+ * Without the damage extension every frame is treated as fully damaged.
+ *
+ * @note requires the xfixes version to be queried already, which
+ *       xcb_xcursor_init does
+ */
+static void xshm_damage_init(struct xshm_data *data)
+{
+	xcb_damage_query_version_cookie_t ver_c;
+
+	data->damage_full = true;
+
+	if (!xcb_get_extension_data(data->xcb, &xcb_damage_id)->present)
+		return;
+
+	ver_c = xcb_damage_query_version_unchecked(data->xcb,
+			XCB_DAMAGE_MAJOR_VERSION, XCB_DAMAGE_MINOR_VERSION);
+	free(xcb_damage_query_version_reply(data->xcb, ver_c, NULL));
+
+	data->damage = xcb_generate_id(data->xcb);
+	xcb_damage_create(data->xcb, data->damage, data->xcb_screen->root,
+			XCB_DAMAGE_REPORT_LEVEL_NON_EMPTY);
+
+	data->damage_region = xcb_generate_id(data->xcb);
+	xcb_xfixes_create_region(data->xcb, data->damage_region, 0, NULL);
+}
+
+static void xshm_damage_destroy(struct xshm_data *data)
+{
+	if (data->damage) {
+		xcb_damage_destroy(data->xcb, data->damage);
+		data->damage = 0;
+	}
+	if (data->damage_region) {
+		xcb_xfixes_destroy_region(data->xcb, data->damage_region);
+		data->damage_region = 0;
+	}
+}
+
+/**
+ * Get the rows of the capture area that changed since the last call
+ *
+ * Fetching whole rows keeps the damaged part of the image at the same
+ * place in the shm segment as a full capture would put it.
+ *
+ * @return false if nothing changed
+ */
+static bool xshm_damage_rows(struct xshm_data *data, int_fast32_t *y_start,
+		int_fast32_t *y_end)
+{
+	xcb_xfixes_fetch_region_cookie_t reg_c;
+	xcb_xfixes_fetch_region_reply_t  *reg_r;
+	xcb_generic_event_t              *event;
+	xcb_rectangle_t                  *rects;
+	int                              count;
+
+	*y_start = data->height;
+	*y_end   = 0;
+
+	/* damage notifications are not needed, the region is polled */
+	while ((event = xcb_poll_for_event(data->xcb)) != NULL)
+		free(event);
+
+	if (!data->damage) {
+		*y_start = 0;
+		*y_end   = data->height;
+		return true;
+	}
+
+	xcb_damage_subtract(data->xcb, data->damage, XCB_NONE,
+			data->damage_region);
+	reg_c = xcb_xfixes_fetch_region_unchecked(data->xcb,
+			data->damage_region);
+	reg_r = xcb_xfixes_fetch_region_reply(data->xcb, reg_c, NULL);
+
+	if (data->damage_full || !reg_r) {
+		data->damage_full = false;
+		*y_start = 0;
+		*y_end   = data->height;
+		free(reg_r);
+		return true;
+	}
+
+	rects = xcb_xfixes_fetch_region_rectangles(reg_r);
+	count = xcb_xfixes_fetch_region_rectangles_length(reg_r);
+
+	for (int i = 0; i < count; i++) {
+		int_fast32_t x0 = rects[i].x - data->x_org;
+		int_fast32_t y0 = rects[i].y - data->y_org;
+		int_fast32_t x1 = x0 + rects[i].width;
+		int_fast32_t y1 = y0 + rects[i].height;
+
+		if (x1 <= 0 || y1 <= 0 || x0 >= data->width ||
+		    y0 >= data->height)
+			continue;
+
+		if (y0 < *y_start)
+			*y_start = (y0 < 0) ? 0 : y0;
+		if (y1 > *y_end)
+			*y_end = (y1 > data->height) ? data->height : y1;
+	}
+
+	free(reg_r);
+	return *y_start < *y_end;
+}
+
 /**
  * Returns the name of the plugin
  */
@@ -156,6 +273,9 @@ static void xshm_capture_stop(struct xshm_data *data)
 
 	obs_leave_graphics();
 
+	if (data->xcb)
+		xshm_damage_destroy(data);
+
 	if (data->xshm) {
 		xshm_xcb_detach(data->xshm);
 		data->xshm = NULL;
@@ -205,6 +325,8 @@ static void xshm_capture_start(struct xshm_data *data)
 	data->cursor = xcb_xcursor_init(data->xcb);
 	xcb_xcursor_offset(data->cursor, data->x_org, data->y_org);
 
+	xshm_damage_init(data);
+
 	obs_enter_graphics();
 
 	xshm_resize_texture(data);
@@ -396,26 +518,39 @@ static void xshm_video_tick(void *vptr, float seconds)
 	if (!obs_source_showing(data->source))
 		return;
 
-	xcb_shm_get_image_cookie_t           img_c;
-	xcb_shm_get_image_reply_t            *img_r;
+	xcb_shm_get_image_cookie_t           img_c = {0};
+	xcb_shm_get_image_reply_t            *img_r = NULL;
 	xcb_xfixes_get_cursor_image_cookie_t cur_c;
 	xcb_xfixes_get_cursor_image_reply_t  *cur_r;
-
-	img_c = xcb_shm_get_image_unchecked(data->xcb, data->xcb_screen->root,
-			data->x_org, data->y_org, data->width, data->height,
-			~0, XCB_IMAGE_FORMAT_Z_PIXMAP, data->xshm->seg, 0);
+	int_fast32_t                         y_start, y_end;
+	bool                                 damaged;
+
+	damaged = xshm_damage_rows(data, &y_start, &y_end);
+
+	if (damaged)
+		img_c = xcb_shm_get_image_unchecked(data->xcb,
+				data->xcb_screen->root,
+				data->x_org, data->y_org + y_start,
+				data->width, y_end - y_start,
+				~0, XCB_IMAGE_FORMAT_Z_PIXMAP, data->xshm->seg,
+				y_start * data->width * 4);
 	cur_c = xcb_xfixes_get_cursor_image_unchecked(data->xcb);
 
-	img_r = xcb_shm_get_image_reply(data->xcb, img_c, NULL);
+	if (damaged)
+		img_r = xcb_shm_get_image_reply(data->xcb, img_c, NULL);
 	cur_r = xcb_xfixes_get_cursor_image_reply(data->xcb, cur_c, NULL);
 
-	if (!img_r)
+	/* retry with the full screen next time */
+	if (damaged && !img_r) {
+		data->damage_full = true;
 		goto exit;
+	}
 
 	obs_enter_graphics();
 
-	gs_texture_set_image(data->texture, (void *) data->xshm->data,
-		data->width * 4, false);
+	if (img_r)
+		gs_texture_set_image(data->texture, (void *) data->xshm->data,
+			data->width * 4, false);
 	xcb_xcursor_update(data->cursor, cur_r);
 
 	obs_leave_graphics();
@@ -434,6 +569,7 @@ static void xshm_video_render(void *vptr, gs_effect_t *effect)
 
 	effect = obs_get_opaque_effect();
 
+	obs_source_set_opaque(data->source, data->texture != NULL);
 	if (!data->texture)
 		return;
 
@@ -475,7 +611,8 @@ struct obs_source_info xshm_input = {
 	.id             = "xshm_input",
 	.type           = OBS_SOURCE_TYPE_INPUT,
 	.output_flags   = OBS_SOURCE_VIDEO |
-	                  OBS_SOURCE_CUSTOM_DRAW,
+	                  OBS_SOURCE_CUSTOM_DRAW |
+	                  OBS_SOURCE_THREADED_TICK,
 	.get_name       = xshm_getname,
 	.create         = xshm_create,
 	.destroy        = xshm_destroy,
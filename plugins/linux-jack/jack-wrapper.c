@@ -51,36 +51,186 @@ static enum speaker_layout jack_channels_to_obs_speakers(uint_fast32_t channels)
 	return SPEAKERS_UNKNOWN;
 }
 
+/* how much audio the ring can hold before periods are dropped */
+#define RING_BUFFER_MS 500
+
+struct jack_period {
+	uint64_t       timestamp;
+	jack_nframes_t frames;
+};
+
+static inline uint64_t frames_to_ns(uint64_t frames, uint_fast32_t rate)
+{
+	return frames * 1000000000ULL / rate;
+}
+
+/**
+ * Realtime process callback, only copies into the lock-free ring
+ */
 int jack_process_callback(jack_nframes_t nframes, void* arg)
 {
 	struct jack_data* data = (struct jack_data*)arg;
-	if (data == 0)
+	struct jack_period period;
+	size_t plane_size;
+
+	if (data == 0 || data->ring == NULL)
 		return 0;
 
-	pthread_mutex_lock(&data->jack_mutex);
+	plane_size = nframes * sizeof(jack_default_audio_sample_t);
+	if (jack_ringbuffer_write_space(data->ring) <
+			sizeof(period) + plane_size * data->channels) {
+		os_atomic_inc_long(&data->dropped_periods);
+		return 0;
+	}
 
-	struct obs_source_audio out;
-	out.speakers        = jack_channels_to_obs_speakers(data->channels);
-	out.samples_per_sec = jack_get_sample_rate (data->jack_client);
-	/* format is always 32 bit float for jack */
-	out.format          = AUDIO_FORMAT_FLOAT_PLANAR;
+	/* the buffers hold the period that ended when this cycle started */
+	period.frames    = nframes;
+	period.timestamp = os_gettime_ns() - frames_to_ns(nframes +
+			jack_frames_since_cycle_start(data->jack_client),
+			data->samples_per_sec);
+
+	jack_ringbuffer_write(data->ring, (const char *)&period,
+			sizeof(period));
 
 	for (unsigned int i = 0; i < data->channels; ++i) {
 		jack_default_audio_sample_t *jack_buffer =
 			(jack_default_audio_sample_t *)jack_port_get_buffer(
 				data->jack_ports[i], nframes);
-		out.data[i] = (uint8_t *)jack_buffer;
+		jack_ringbuffer_write(data->ring, (const char *)jack_buffer,
+				plane_size);
 	}
 
-	out.frames    = nframes;
-	out.timestamp = os_gettime_ns() -
-				jack_frames_to_time(data->jack_client, nframes);
+	os_sem_post(data->ring_sem);
+	return 0;
+}
+
+static int jack_xrun_callback(void *arg)
+{
+	struct jack_data* data = (struct jack_data*)arg;
+
+	os_atomic_inc_long(&data->xruns);
+	return 0;
+}
+
+static bool jack_output_period(struct jack_data *data)
+{
+	struct jack_period period;
+	size_t plane_size;
+
+	if (jack_ringbuffer_read_space(data->ring) < sizeof(period))
+		return false;
+
+	jack_ringbuffer_peek(data->ring, (char *)&period, sizeof(period));
+	plane_size = period.frames * sizeof(jack_default_audio_sample_t);
+
+	/* the callback may still be writing the planes of this period */
+	if (jack_ringbuffer_read_space(data->ring) <
+			sizeof(period) + plane_size * data->channels)
+		return false;
+
+	if (period.frames > data->output_frames) {
+		data->output_buf = brealloc(data->output_buf,
+				plane_size * data->channels);
+		data->output_frames = period.frames;
+	}
+
+	jack_ringbuffer_read_advance(data->ring, sizeof(period));
+
+	struct obs_source_audio out = {0};
+	out.speakers        = jack_channels_to_obs_speakers(data->channels);
+	out.samples_per_sec = data->samples_per_sec;
+	/* format is always 32 bit float for jack */
+	out.format          = AUDIO_FORMAT_FLOAT_PLANAR;
+	out.frames          = period.frames;
+	out.timestamp       = period.timestamp;
+
+	for (unsigned int i = 0; i < data->channels; ++i) {
+		char *plane = (char *)data->output_buf + plane_size * i;
+		jack_ringbuffer_read(data->ring, plane, plane_size);
+		out.data[i] = (const uint8_t *)plane;
+	}
 
 	obs_source_output_audio(data->source, &out);
-	pthread_mutex_unlock(&data->jack_mutex);
+	return true;
+}
+
+static void *jack_output_thread(void *arg)
+{
+	struct jack_data *data = (struct jack_data*)arg;
+
+	os_set_thread_name("jack-input: output thread");
+
+	while (os_sem_wait(data->ring_sem) == 0) {
+		if (data->stopping)
+			break;
+
+		while (jack_output_period(data))
+			;
+
+		long dropped = data->dropped_periods;
+		if (dropped != data->dropped_reported) {
+			blog(LOG_WARNING, "Output thread fell behind, "
+					"dropped %ld periods so far",
+					dropped);
+			data->dropped_reported = dropped;
+		}
+	}
+
+	return NULL;
+}
+
+static int_fast32_t jack_start_output(struct jack_data *data)
+{
+	size_t size = data->samples_per_sec * RING_BUFFER_MS / 1000 *
+		sizeof(jack_default_audio_sample_t) * data->channels;
+
+	data->ring = jack_ringbuffer_create(size);
+	if (data->ring == NULL)
+		return -1;
+	if (jack_ringbuffer_mlock(data->ring) != 0)
+		blog(LOG_DEBUG, "Could not lock ring buffer memory");
+
+	if (os_sem_init(&data->ring_sem, 0) != 0)
+		return -1;
+
+	data->stopping = false;
+	if (pthread_create(&data->output_thread, NULL, jack_output_thread,
+				data) != 0)
+		return -1;
+
+	data->output_thread_active = true;
 	return 0;
 }
 
+static void jack_stop_output(struct jack_data *data)
+{
+	if (data->output_thread_active) {
+		data->stopping = true;
+		os_sem_post(data->ring_sem);
+		pthread_join(data->output_thread, NULL);
+		data->output_thread_active = false;
+	}
+
+	if (data->xruns || data->dropped_periods)
+		blog(LOG_INFO, "%ld xruns, %ld dropped periods",
+				data->xruns, data->dropped_periods);
+
+	os_sem_destroy(data->ring_sem);
+	data->ring_sem = NULL;
+
+	if (data->ring) {
+		jack_ringbuffer_free(data->ring);
+		data->ring = NULL;
+	}
+
+	bfree(data->output_buf);
+	data->output_buf       = NULL;
+	data->output_frames    = 0;
+	data->xruns            = 0;
+	data->dropped_periods  = 0;
+	data->dropped_reported = 0;
+}
+
 int_fast32_t jack_init(struct jack_data* data)
 {
 	pthread_mutex_lock(&data->jack_mutex);
@@ -100,6 +250,8 @@ int_fast32_t jack_init(struct jack_data* data)
 		goto error;
 	}
 
+	data->samples_per_sec = jack_get_sample_rate(data->jack_client);
+
 	data->jack_ports = (jack_port_t**)bzalloc(
 		sizeof(jack_port_t*) * data->channels);
 	for (unsigned int i = 0; i < data->channels; ++i) {
@@ -117,12 +269,19 @@ int_fast32_t jack_init(struct jack_data* data)
 		}
 	}
 
+	if (jack_start_output(data) != 0) {
+		blog(LOG_ERROR, "Could not start output thread");
+		goto error;
+	}
+
 	if (jack_set_process_callback(data->jack_client,
 			jack_process_callback, data) != 0) {
 		blog(LOG_ERROR, "jack_set_process_callback Error");
 		goto error;
 	}
 
+	jack_set_xrun_callback(data->jack_client, jack_xrun_callback, data);
+
 	if (jack_activate(data->jack_client) != 0) {
 		blog(LOG_ERROR,
 			"jack_activate Error:"
@@ -144,6 +303,9 @@ void deactivate_jack(struct jack_data* data)
 	pthread_mutex_lock(&data->jack_mutex);
 
 	if (data->jack_client) {
+		/* stops the process callback before anything is freed */
+		jack_deactivate(data->jack_client);
+
 		if (data->jack_ports != NULL) {
 			for (int i = 0; i < data->channels; ++i) {
 				if (data->jack_ports[i] != NULL)
@@ -156,5 +318,8 @@ void deactivate_jack(struct jack_data* data)
 		jack_client_close(data->jack_client);
 		data->jack_client = NULL;
 	}
+
+	jack_stop_output(data);
+
 	pthread_mutex_unlock(&data->jack_mutex);
 }
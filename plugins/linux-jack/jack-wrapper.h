@@ -18,7 +18,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 #include <jack/jack.h>
+#include <jack/ringbuffer.h>
 #include <obs.h>
+#include <util/threading.h>
 #include <pthread.h>
 
 struct jack_data {
@@ -37,6 +39,24 @@ struct jack_data {
 	jack_client_t *jack_client;
 	jack_port_t **jack_ports;
 
+	/*
+	 * The process callback runs on the realtime thread of the JACK graph
+	 * and must never lock or allocate, it only copies the port buffers
+	 * into the ring, which is drained by the output thread.
+	 */
+	jack_ringbuffer_t *ring;
+	os_sem_t *ring_sem;
+	pthread_t output_thread;
+	bool output_thread_active;
+	volatile bool stopping;
+
+	float *output_buf;
+	uint32_t output_frames;
+
+	volatile long xruns;
+	volatile long dropped_periods;
+	long dropped_reported;
+
 	pthread_mutex_t jack_mutex;
 };
 
@@ -30,9 +30,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 struct pulse_data {
 	obs_source_t *source;
 	pa_stream *stream;
+	pulse_loop_t *loop;
 
 	/* user settings */
 	char *device;
+	uint32_t fragsize_ms;
+	uint32_t maxlength_ms;
 
 	/* server info */
 	enum speaker_layout speakers;
@@ -102,6 +105,26 @@ static inline uint64_t get_sample_time(size_t frames, uint_fast32_t rate)
 	return os_gettime_ns() - samples_to_ns(frames, rate);
 }
 
+/**
+ * Get the capture time of the data at the current read index
+ *
+ * The latency of a record stream is how long ago the oldest data that is not
+ * read yet was captured by the source, so this doesn't depend on when the
+ * mainloop got around to calling us.
+ */
+static uint64_t get_stream_time(struct pulse_data *data, size_t frames)
+{
+	pa_usec_t latency;
+	int negative;
+
+	if (pa_stream_get_latency(data->stream, &latency, &negative) < 0)
+		return get_sample_time(frames, data->samples_per_sec);
+	if (negative)
+		latency = 0;
+
+	return os_gettime_ns() - latency * 1000;
+}
+
 #define STARTUP_TIMEOUT_NS (500 * NSEC_PER_MSEC)
 
 /**
@@ -119,19 +142,19 @@ static void pulse_stream_read(pa_stream *p, size_t nbytes, void *userdata)
 	size_t bytes;
 
 	if (!data->stream)
-		goto exit;
+		return;
 
 	pa_stream_peek(data->stream, &frames, &bytes);
 
 	// check if we got data
 	if (!bytes)
-		goto exit;
+		return;
 
 	if (!frames) {
 		blog(LOG_ERROR, "Got audio hole of %u bytes",
 			(unsigned int) bytes);
 		pa_stream_drop(data->stream);
-		goto exit;
+		return;
 	}
 
 	struct obs_source_audio out;
@@ -140,8 +163,7 @@ static void pulse_stream_read(pa_stream *p, size_t nbytes, void *userdata)
 	out.format          = pulse_to_obs_audio_format(data->format);
 	out.data[0]         = (uint8_t *) frames;
 	out.frames          = bytes / data->bytes_per_frame;
-	out.timestamp       = get_sample_time(out.frames,
-	                                      out.samples_per_sec);
+	out.timestamp       = get_stream_time(data, out.frames);
 
 	if (!data->first_ts)
 		data->first_ts = out.timestamp + STARTUP_TIMEOUT_NS;
@@ -153,8 +175,6 @@ static void pulse_stream_read(pa_stream *p, size_t nbytes, void *userdata)
 	data->frames += out.frames;
 
 	pa_stream_drop(data->stream);
-exit:
-	pulse_signal(0);
 }
 
 /**
@@ -226,9 +246,9 @@ skip:
  * We request the default format used by pulse here because the data will be
  * converted and possibly re-sampled by obs anyway.
  *
- * For now we request a buffer length of 25ms although pulse seems to ignore
- * this setting for monitor streams. For "real" input streams this should work
- * fine though.
+ * The fragment size (25ms unless configured otherwise) is how much data pulse
+ * collects before calling us, the maximum length limits how much data the
+ * server buffers for us before dropping it.
  */
 static int_fast32_t pulse_start_recording(struct pulse_data *data)
 {
@@ -256,38 +276,46 @@ static int_fast32_t pulse_start_recording(struct pulse_data *data)
 	data->speakers = pulse_channels_to_obs_speakers(spec.channels);
 	data->bytes_per_frame = pa_frame_size(&spec);
 
-	data->stream = pulse_stream_new(obs_source_get_name(data->source),
-		&spec, NULL);
+	data->loop = pulse_loop_acquire();
+	data->stream = pulse_stream_new(data->loop,
+		obs_source_get_name(data->source), &spec, NULL);
 	if (!data->stream) {
+		pulse_loop_release(data->loop);
+		data->loop = NULL;
 		blog(LOG_ERROR, "Unable to create stream");
 		return -1;
 	}
 
-	pulse_lock();
+	pulse_loop_lock(data->loop);
 	pa_stream_set_read_callback(data->stream, pulse_stream_read,
 		(void *) data);
-	pulse_unlock();
+	pulse_loop_unlock(data->loop);
 
 	pa_buffer_attr attr;
-	attr.fragsize  = pa_usec_to_bytes(25000, &spec);
-	attr.maxlength = (uint32_t) -1;
+	attr.fragsize  = pa_usec_to_bytes(data->fragsize_ms * 1000, &spec);
+	attr.maxlength = (data->maxlength_ms)
+		? pa_usec_to_bytes(data->maxlength_ms * 1000, &spec)
+		: (uint32_t) -1;
 	attr.minreq    = (uint32_t) -1;
 	attr.prebuf    = (uint32_t) -1;
 	attr.tlength   = (uint32_t) -1;
 
-	pa_stream_flags_t flags = PA_STREAM_ADJUST_LATENCY;
+	pa_stream_flags_t flags = PA_STREAM_ADJUST_LATENCY |
+		PA_STREAM_INTERPOLATE_TIMING | PA_STREAM_AUTO_TIMING_UPDATE;
 
-	pulse_lock();
+	pulse_loop_lock(data->loop);
 	int_fast32_t ret = pa_stream_connect_record(data->stream, data->device,
 		&attr, flags);
-	pulse_unlock();
+	pulse_loop_unlock(data->loop);
 	if (ret < 0) {
 		pulse_stop_recording(data);
 		blog(LOG_ERROR, "Unable to connect to stream");
 		return -1;
 	}
 
-	blog(LOG_INFO, "Started recording from '%s'", data->device);
+	blog(LOG_INFO, "Started recording from '%s' (fragment size %"PRIu32
+		" ms, maximum length %"PRIu32" ms)", data->device,
+		data->fragsize_ms, data->maxlength_ms);
 	return 0;
 }
 
@@ -297,13 +325,16 @@ static int_fast32_t pulse_start_recording(struct pulse_data *data)
 static void pulse_stop_recording(struct pulse_data *data)
 {
 	if (data->stream) {
-		pulse_lock();
+		pulse_loop_lock(data->loop);
 		pa_stream_disconnect(data->stream);
 		pa_stream_unref(data->stream);
 		data->stream = NULL;
-		pulse_unlock();
+		pulse_loop_unlock(data->loop);
 	}
 
+	pulse_loop_release(data->loop);
+	data->loop = NULL;
+
 	blog(LOG_INFO, "Stopped recording from '%s'", data->device);
 	blog(LOG_INFO, "Got %"PRIuFAST32" packets with %"PRIuFAST64" frames",
 		data->packets, data->frames);
@@ -347,6 +378,28 @@ skip:
 	pulse_signal(0);
 }
 
+#define LATENCY_NORMAL "normal"
+#define LATENCY_LOW    "low"
+#define LATENCY_CUSTOM "custom"
+
+#define FRAGSIZE_NORMAL_MS 25
+#define FRAGSIZE_LOW_MS    5
+#define MAXLENGTH_LOW_MS   50
+
+static bool latency_changed(obs_properties_t *props, obs_property_t *p,
+	obs_data_t *settings)
+{
+	UNUSED_PARAMETER(p);
+	const char *latency = obs_data_get_string(settings, "latency");
+	bool custom = strcmp(latency, LATENCY_CUSTOM) == 0;
+
+	obs_property_set_visible(obs_properties_get(props, "fragsize"),
+		custom);
+	obs_property_set_visible(obs_properties_get(props, "maxlength"),
+		custom);
+	return true;
+}
+
 /**
  * Get plugin properties
  */
@@ -356,12 +409,29 @@ static obs_properties_t *pulse_properties(bool input)
 	obs_property_t *devices = obs_properties_add_list(props, "device_id",
 		obs_module_text("Device"), OBS_COMBO_TYPE_LIST,
 		OBS_COMBO_FORMAT_STRING);
+	obs_property_t *latency;
 
 	pulse_init();
 	pa_source_info_cb_t cb = (input) ? pulse_input_info : pulse_output_info;
 	pulse_get_source_info_list(cb, (void *) devices);
 	pulse_unref();
 
+	latency = obs_properties_add_list(props, "latency",
+		obs_module_text("Latency"), OBS_COMBO_TYPE_LIST,
+		OBS_COMBO_FORMAT_STRING);
+	obs_property_list_add_string(latency,
+		obs_module_text("Latency.Normal"), LATENCY_NORMAL);
+	obs_property_list_add_string(latency,
+		obs_module_text("Latency.Low"), LATENCY_LOW);
+	obs_property_list_add_string(latency,
+		obs_module_text("Latency.Custom"), LATENCY_CUSTOM);
+	obs_property_set_modified_callback(latency, latency_changed);
+
+	obs_properties_add_int(props, "fragsize",
+		obs_module_text("FragmentSize"), 1, 1000, 1);
+	obs_properties_add_int(props, "maxlength",
+		obs_module_text("MaxLength"), 0, 10000, 1);
+
 	return props;
 }
 
@@ -424,6 +494,10 @@ static void pulse_defaults(obs_data_t *settings, bool input)
 	pulse_get_server_info(cb, (void *) settings);
 
 	pulse_unref();
+
+	obs_data_set_default_string(settings, "latency", LATENCY_NORMAL);
+	obs_data_set_default_int(settings, "fragsize", FRAGSIZE_NORMAL_MS);
+	obs_data_set_default_int(settings, "maxlength", 0);
 }
 
 static void pulse_input_defaults(obs_data_t *settings)
@@ -478,6 +552,9 @@ static void pulse_update(void *vptr, obs_data_t *settings)
 	PULSE_DATA(vptr);
 	bool restart = false;
 	const char *new_device;
+	const char *latency;
+	uint32_t fragsize_ms;
+	uint32_t maxlength_ms;
 
 	new_device = obs_data_get_string(settings, "device_id");
 	if (!data->device || strcmp(data->device, new_device) != 0) {
@@ -487,6 +564,31 @@ static void pulse_update(void *vptr, obs_data_t *settings)
 		restart = true;
 	}
 
+	latency = obs_data_get_string(settings, "latency");
+	if (strcmp(latency, LATENCY_LOW) == 0) {
+		fragsize_ms  = FRAGSIZE_LOW_MS;
+		maxlength_ms = MAXLENGTH_LOW_MS;
+	} else if (strcmp(latency, LATENCY_CUSTOM) == 0) {
+		fragsize_ms  = (uint32_t)obs_data_get_int(settings, "fragsize");
+		maxlength_ms = (uint32_t)obs_data_get_int(settings,
+				"maxlength");
+	} else {
+		fragsize_ms  = FRAGSIZE_NORMAL_MS;
+		maxlength_ms = 0;
+	}
+
+	if (!fragsize_ms)
+		fragsize_ms = FRAGSIZE_NORMAL_MS;
+	if (maxlength_ms && maxlength_ms < fragsize_ms)
+		maxlength_ms = fragsize_ms;
+
+	if (fragsize_ms != data->fragsize_ms ||
+	    maxlength_ms != data->maxlength_ms) {
+		data->fragsize_ms  = fragsize_ms;
+		data->maxlength_ms = maxlength_ms;
+		restart = true;
+	}
+
 	if (!restart)
 		return;
 
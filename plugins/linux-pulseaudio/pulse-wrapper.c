@@ -24,11 +24,26 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "pulse-wrapper.h"
 
+/*
+ * Streams are spread over a few mainloop threads so that a large number of
+ * inputs doesn't serialize all of their callbacks on a single mainloop lock.
+ * The first few streams share the main loop that is also used for the
+ * introspection functions.
+ */
+#define PULSE_STREAMS_PER_LOOP 4
+#define PULSE_STREAM_LOOPS     3
+
+struct pulse_loop {
+	pa_threaded_mainloop *mainloop;
+	pa_context *context;
+	uint_fast32_t streams;
+};
+
 /* global data */
 static uint_fast32_t pulse_refs = 0;
 static pthread_mutex_t pulse_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pa_threaded_mainloop *pulse_mainloop = NULL;
-static pa_context *pulse_context = NULL;
+static struct pulse_loop pulse_main = {0};
+static struct pulse_loop pulse_stream_loops[PULSE_STREAM_LOOPS] = {{0}};
 
 /**
  * context status change callback
@@ -38,10 +53,10 @@ static pa_context *pulse_context = NULL;
  */
 static void pulse_context_state_changed(pa_context *c, void *userdata)
 {
-	UNUSED_PARAMETER(userdata);
 	UNUSED_PARAMETER(c);
+	pulse_loop_t *loop = userdata;
 
-	pulse_signal(0);
+	pa_threaded_mainloop_signal(loop->mainloop, 0);
 }
 
 /**
@@ -61,52 +76,73 @@ static pa_proplist *pulse_properties()
 /**
  * Initialize the pulse audio context with properties and callback
  */
-static void pulse_init_context()
+static void pulse_init_context(pulse_loop_t *loop)
 {
-	pulse_lock();
+	pulse_loop_lock(loop);
 
 	pa_proplist *p = pulse_properties();
-	pulse_context = pa_context_new_with_proplist(
-		pa_threaded_mainloop_get_api(pulse_mainloop), "OBS", p);
+	loop->context = pa_context_new_with_proplist(
+		pa_threaded_mainloop_get_api(loop->mainloop), "OBS", p);
 
-	pa_context_set_state_callback(pulse_context,
-		pulse_context_state_changed, NULL);
+	pa_context_set_state_callback(loop->context,
+		pulse_context_state_changed, loop);
 
-	pa_context_connect(pulse_context, NULL, PA_CONTEXT_NOAUTOSPAWN, NULL);
+	pa_context_connect(loop->context, NULL, PA_CONTEXT_NOAUTOSPAWN, NULL);
 	pa_proplist_free(p);
 
-	pulse_unlock();
+	pulse_loop_unlock(loop);
 }
 
 /**
  * wait for context to be ready
  */
-static int_fast32_t pulse_context_ready()
+static int_fast32_t pulse_context_ready(pulse_loop_t *loop)
 {
-	pulse_lock();
+	pulse_loop_lock(loop);
 
-	if (!PA_CONTEXT_IS_GOOD(pa_context_get_state(pulse_context))) {
-		pulse_unlock();
+	if (!PA_CONTEXT_IS_GOOD(pa_context_get_state(loop->context))) {
+		pulse_loop_unlock(loop);
 		return -1;
 	}
 
-	while (pa_context_get_state(pulse_context) != PA_CONTEXT_READY)
-		pulse_wait();
+	while (pa_context_get_state(loop->context) != PA_CONTEXT_READY)
+		pa_threaded_mainloop_wait(loop->mainloop);
 
-	pulse_unlock();
+	pulse_loop_unlock(loop);
 	return 0;
 }
 
-int_fast32_t pulse_init()
+static void pulse_loop_init(pulse_loop_t *loop)
 {
-	pthread_mutex_lock(&pulse_mutex);
+	loop->mainloop = pa_threaded_mainloop_new();
+	pa_threaded_mainloop_start(loop->mainloop);
 
-	if (pulse_refs == 0) {
-		pulse_mainloop = pa_threaded_mainloop_new();
-		pa_threaded_mainloop_start(pulse_mainloop);
+	pulse_init_context(loop);
+}
 
-		pulse_init_context();
+static void pulse_loop_free(pulse_loop_t *loop)
+{
+	pulse_loop_lock(loop);
+	if (loop->context != NULL) {
+		pa_context_disconnect(loop->context);
+		pa_context_unref(loop->context);
+		loop->context = NULL;
 	}
+	pulse_loop_unlock(loop);
+
+	if (loop->mainloop != NULL) {
+		pa_threaded_mainloop_stop(loop->mainloop);
+		pa_threaded_mainloop_free(loop->mainloop);
+		loop->mainloop = NULL;
+	}
+}
+
+int_fast32_t pulse_init()
+{
+	pthread_mutex_lock(&pulse_mutex);
+
+	if (pulse_refs == 0)
+		pulse_loop_init(&pulse_main);
 
 	pulse_refs++;
 
@@ -119,59 +155,109 @@ void pulse_unref()
 {
 	pthread_mutex_lock(&pulse_mutex);
 
-	if (--pulse_refs == 0) {
-		pulse_lock();
-		if (pulse_context != NULL) {
-			pa_context_disconnect(pulse_context);
-			pa_context_unref(pulse_context);
-			pulse_context = NULL;
+	if (--pulse_refs == 0)
+		pulse_loop_free(&pulse_main);
+
+	pthread_mutex_unlock(&pulse_mutex);
+}
+
+pulse_loop_t *pulse_loop_acquire()
+{
+	pulse_loop_t *loop = &pulse_main;
+
+	pthread_mutex_lock(&pulse_mutex);
+
+	if (pulse_main.streams < PULSE_STREAMS_PER_LOOP)
+		goto found;
+
+	/* prefer running loops with room left, then start a new one, and
+	 * only then pile more streams onto the least busy loop */
+	for (size_t i = 0; i < PULSE_STREAM_LOOPS; i++) {
+		pulse_loop_t *cur = &pulse_stream_loops[i];
+		if (cur->mainloop && cur->streams < PULSE_STREAMS_PER_LOOP) {
+			loop = cur;
+			goto found;
 		}
-		pulse_unlock();
+	}
 
-		if (pulse_mainloop != NULL) {
-			pa_threaded_mainloop_stop(pulse_mainloop);
-			pa_threaded_mainloop_free(pulse_mainloop);
-			pulse_mainloop = NULL;
+	for (size_t i = 0; i < PULSE_STREAM_LOOPS; i++) {
+		pulse_loop_t *cur = &pulse_stream_loops[i];
+		if (!cur->mainloop) {
+			pulse_loop_init(cur);
+			loop = cur;
+			goto found;
 		}
 	}
 
+	for (size_t i = 0; i < PULSE_STREAM_LOOPS; i++) {
+		pulse_loop_t *cur = &pulse_stream_loops[i];
+		if (cur->streams < loop->streams)
+			loop = cur;
+	}
+
+found:
+	loop->streams++;
 	pthread_mutex_unlock(&pulse_mutex);
+	return loop;
+}
+
+void pulse_loop_release(pulse_loop_t *loop)
+{
+	if (!loop)
+		return;
+
+	pthread_mutex_lock(&pulse_mutex);
+
+	if (--loop->streams == 0 && loop != &pulse_main)
+		pulse_loop_free(loop);
+
+	pthread_mutex_unlock(&pulse_mutex);
+}
+
+void pulse_loop_lock(pulse_loop_t *loop)
+{
+	pa_threaded_mainloop_lock(loop->mainloop);
+}
+
+void pulse_loop_unlock(pulse_loop_t *loop)
+{
+	pa_threaded_mainloop_unlock(loop->mainloop);
 }
 
 void pulse_lock()
 {
-	pa_threaded_mainloop_lock(pulse_mainloop);
+	pulse_loop_lock(&pulse_main);
 }
 
 void pulse_unlock()
 {
-	pa_threaded_mainloop_unlock(pulse_mainloop);
+	pulse_loop_unlock(&pulse_main);
 }
 
 void pulse_wait()
 {
-	pa_threaded_mainloop_wait(pulse_mainloop);
+	pa_threaded_mainloop_wait(pulse_main.mainloop);
 }
 
 void pulse_signal(int wait_for_accept)
 {
-	pa_threaded_mainloop_signal(pulse_mainloop, wait_for_accept);
+	pa_threaded_mainloop_signal(pulse_main.mainloop, wait_for_accept);
 }
 
 void pulse_accept()
 {
-	pa_threaded_mainloop_accept(pulse_mainloop);
+	pa_threaded_mainloop_accept(pulse_main.mainloop);
 }
 
 int_fast32_t pulse_get_source_info_list(pa_source_info_cb_t cb, void* userdata)
 {
-	if (pulse_context_ready() < 0)
+	if (pulse_context_ready(&pulse_main) < 0)
 		return -1;
 
 	pulse_lock();
 
 	pa_operation *op = pa_context_get_source_info_list(
-		pulse_context, cb, userdata);
+		pulse_main.context, cb, userdata);
 	while (pa_operation_get_state(op) == PA_OPERATION_RUNNING)
 		pulse_wait();
 	pa_operation_unref(op);
@@ -184,13 +270,13 @@ int_fast32_t pulse_get_source_info_list(pa_source_info_cb_t cb, void* userdata)
 int_fast32_t pulse_get_source_info(pa_source_info_cb_t cb, const char *name,
 	void *userdata)
 {
-	if (pulse_context_ready() < 0)
+	if (pulse_context_ready(&pulse_main) < 0)
 		return -1;
 
 	pulse_lock();
 
 	pa_operation *op = pa_context_get_source_info_by_name(
-		pulse_context, name, cb, userdata);
+		pulse_main.context, name, cb, userdata);
 	while (pa_operation_get_state(op) == PA_OPERATION_RUNNING)
 		pulse_wait();
 	pa_operation_unref(op);
@@ -202,13 +288,13 @@ int_fast32_t pulse_get_source_info(pa_source_info_cb_t cb, const char *name,
 
 int_fast32_t pulse_get_server_info(pa_server_info_cb_t cb, void* userdata)
 {
-	if (pulse_context_ready() < 0)
+	if (pulse_context_ready(&pulse_main) < 0)
 		return -1;
 
 	pulse_lock();
 
 	pa_operation *op = pa_context_get_server_info(
-		pulse_context, cb, userdata);
+		pulse_main.context, cb, userdata);
 	while (pa_operation_get_state(op) == PA_OPERATION_RUNNING)
 		pulse_wait();
 	pa_operation_unref(op);
@@ -217,20 +303,19 @@ int_fast32_t pulse_get_server_info(pa_server_info_cb_t cb, void* userdata)
 	return 0;
 }
 
-pa_stream* pulse_stream_new(const char* name, const pa_sample_spec* ss,
-	const pa_channel_map* map)
+pa_stream* pulse_stream_new(pulse_loop_t *loop, const char* name,
+	const pa_sample_spec* ss, const pa_channel_map* map)
 {
-	if (pulse_context_ready() < 0)
+	if (pulse_context_ready(loop) < 0)
 		return NULL;
 
-	pulse_lock();
+	pulse_loop_lock(loop);
 
 	pa_proplist *p = pulse_properties();
 	pa_stream *s = pa_stream_new_with_proplist(
-		pulse_context, name, ss, map, p);
+		loop->context, name, ss, map, p);
 	pa_proplist_free(p);
 
-	pulse_unlock();
+	pulse_loop_unlock(loop);
 	return s;
 }
-
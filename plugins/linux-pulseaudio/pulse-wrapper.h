@@ -22,6 +22,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
+typedef struct pulse_loop pulse_loop_t;
+
 /**
  * Initialize the pulseaudio mainloop and increase the reference count
  */
@@ -33,6 +35,35 @@ int_fast32_t pulse_init();
  */
 void pulse_unref();
 
+/**
+ * Get a mainloop for a new stream
+ *
+ * Streams are spread over several mainloop threads once there are more than a
+ * few of them, so their callbacks don't all serialize on the same lock. All
+ * calls related to the stream have to lock the loop returned here with
+ * pulse_loop_lock() instead of using pulse_lock().
+ *
+ * @note requires a reference from pulse_init()
+ */
+pulse_loop_t *pulse_loop_acquire();
+
+/**
+ * Release a mainloop from pulse_loop_acquire() after the stream is gone
+ */
+void pulse_loop_release(pulse_loop_t *loop);
+
+/**
+ * Lock a stream mainloop
+ *
+ * @see pulse_lock()
+ */
+void pulse_loop_lock(pulse_loop_t *loop);
+
+/**
+ * Unlock a stream mainloop
+ */
+void pulse_loop_unlock(pulse_loop_t *loop);
+
 /**
  * Lock the mainloop
  *
@@ -127,11 +158,11 @@ int_fast32_t pulse_get_source_info(pa_source_info_cb_t cb, const char *name,
 int_fast32_t pulse_get_server_info(pa_server_info_cb_t cb, void *userdata);
 
 /**
- * Create a new stream with the default properties
+ * Create a new stream with the default properties on the given mainloop
  *
  * @note The function will block until the server context is ready.
  *
  * @warning call without active locks
  */
-pa_stream *pulse_stream_new(const char *name, const pa_sample_spec *ss,
-	const pa_channel_map *map);
+pa_stream *pulse_stream_new(pulse_loop_t *loop, const char *name,
+	const pa_sample_spec *ss, const pa_channel_map *map);
@@ -16,13 +16,22 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include <obs-module.h>
 
+#include "v4l2-devices.h"
+
 OBS_DECLARE_MODULE()
+OBS_MODULE_DEFERRABLE()
 OBS_MODULE_USE_DEFAULT_LOCALE("linux-v4l2", "en-US")
 
 extern struct obs_source_info v4l2_input;
 
 bool obs_module_load(void)
 {
+	v4l2_devices_init();
 	obs_register_source(&v4l2_input);
 	return true;
 }
+
+void obs_module_unload(void)
+{
+	v4l2_devices_free();
+}
@@ -0,0 +1,307 @@
+/*
+Copyright (C) 2016 by Hugh Bailey <obs.jim@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+
+#include <linux/videodev2.h>
+#include <libv4l2.h>
+
+#include <util/threading.h>
+#include <util/bmem.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <obs.h>
+
+#include "v4l2-devices.h"
+
+#if HAVE_UDEV
+#include "v4l2-udev.h"
+#endif
+
+struct v4l2_device {
+	char *name;
+	char *path;
+};
+
+typedef DARRAY(struct v4l2_device) device_array_t;
+
+static const char *device_signals[] = {
+	"void changed()",
+	NULL
+};
+
+/* global data */
+static pthread_mutex_t devices_mutex = PTHREAD_MUTEX_INITIALIZER;
+static device_array_t devices;
+
+static bool devices_initialized = false;
+static volatile bool devices_stopping = false;
+static pthread_t devices_thread;
+static os_event_t *devices_event;
+
+static signal_handler_t *devices_signalhandler = NULL;
+
+static void free_device_array(device_array_t *array)
+{
+	for (size_t i = 0; i < array->num; i++) {
+		bfree(array->array[i].name);
+		bfree(array->array[i].path);
+	}
+
+	da_free((*array));
+}
+
+static bool device_arrays_equal(device_array_t *a, device_array_t *b)
+{
+	if (a->num != b->num)
+		return false;
+
+	for (size_t i = 0; i < a->num; i++) {
+		if (strcmp(a->array[i].name, b->array[i].name) != 0 ||
+		    strcmp(a->array[i].path, b->array[i].path) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Probe a single device node
+ *
+ * @param path  device node to open
+ * @param found array the device is added to if it supports video capture
+ */
+static void probe_device(const char *path, device_array_t *found)
+{
+	int fd;
+	uint32_t caps;
+	struct v4l2_capability video_cap;
+	struct v4l2_device device;
+
+	if ((fd = v4l2_open(path, O_RDWR | O_NONBLOCK)) == -1) {
+		blog(LOG_INFO, "Unable to open %s", path);
+		return;
+	}
+
+	if (v4l2_ioctl(fd, VIDIOC_QUERYCAP, &video_cap) == -1) {
+		blog(LOG_INFO, "Failed to query capabilities for %s", path);
+		v4l2_close(fd);
+		return;
+	}
+
+#ifndef V4L2_CAP_DEVICE_CAPS
+	caps = video_cap.capabilities;
+#else
+	/* ... since Linux 3.3 */
+	caps = (video_cap.capabilities & V4L2_CAP_DEVICE_CAPS)
+		? video_cap.device_caps
+		: video_cap.capabilities;
+#endif
+
+	v4l2_close(fd);
+
+	if (!(caps & V4L2_CAP_VIDEO_CAPTURE)) {
+		blog(LOG_INFO, "%s seems to not support video capture", path);
+		return;
+	}
+
+	device.name = bstrdup((char *) video_cap.card);
+	device.path = bstrdup(path);
+	da_push_back((*found), &device);
+}
+
+/**
+ * Scan for devices, opening each of them, which can take a while
+ *
+ * @param found array the devices are added to
+ */
+static void scan_devices(device_array_t *found)
+{
+	DIR *dirp;
+	struct dirent *dp;
+	struct dstr device;
+
+#ifdef __FreeBSD__
+	dirp = opendir("/dev");
+#else
+	dirp = opendir("/sys/class/video4linux");
+#endif
+	if (!dirp)
+		return;
+
+	dstr_init_copy(&device, "/dev/");
+
+	while ((dp = readdir(dirp)) != NULL) {
+#ifdef __FreeBSD__
+		if (strstr(dp->d_name, "video") == NULL)
+			continue;
+#endif
+
+		if (dp->d_type == DT_DIR)
+			continue;
+
+		dstr_resize(&device, 5);
+		dstr_cat(&device, dp->d_name);
+
+		probe_device(device.array, found);
+	}
+
+	closedir(dirp);
+	dstr_free(&device);
+}
+
+/**
+ * Device scanning thread
+ */
+static void *devices_thread_func(void *vptr)
+{
+	UNUSED_PARAMETER(vptr);
+
+	os_set_thread_name("v4l2: device scan");
+
+	while (os_event_wait(devices_event) == 0 && !devices_stopping) {
+		device_array_t found = {0};
+		bool changed;
+
+		scan_devices(&found);
+
+		pthread_mutex_lock(&devices_mutex);
+		changed = !device_arrays_equal(&devices, &found);
+		if (changed) {
+			free_device_array(&devices);
+			devices = found;
+		}
+		pthread_mutex_unlock(&devices_mutex);
+
+		if (!changed) {
+			free_device_array(&found);
+			continue;
+		}
+
+		for (size_t i = 0; i < found.num; i++)
+			blog(LOG_INFO, "Found device '%s' at %s",
+					found.array[i].name,
+					found.array[i].path);
+
+		signal_handler_signal(devices_signalhandler, "changed", NULL);
+	}
+
+	return NULL;
+}
+
+#if HAVE_UDEV
+/**
+ * Rescan whenever udev reports a video device being added or removed
+ */
+static void device_event(void *vptr, calldata_t *calldata)
+{
+	UNUSED_PARAMETER(vptr);
+	UNUSED_PARAMETER(calldata);
+
+	os_event_signal(devices_event);
+}
+#endif
+
+void v4l2_devices_init(void)
+{
+	if (devices_initialized)
+		return;
+
+	devices_signalhandler = signal_handler_create();
+	if (!devices_signalhandler)
+		return;
+	signal_handler_add_array(devices_signalhandler, device_signals);
+
+	if (os_event_init(&devices_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+
+	devices_stopping = false;
+	if (pthread_create(&devices_thread, NULL, devices_thread_func,
+				NULL) != 0) {
+		os_event_destroy(devices_event);
+		goto fail;
+	}
+
+	devices_initialized = true;
+
+#if HAVE_UDEV
+	v4l2_init_udev();
+	signal_handler_t *sh = v4l2_get_udev_signalhandler();
+
+	signal_handler_connect(sh, "device_added", device_event, NULL);
+	signal_handler_connect(sh, "device_removed", device_event, NULL);
+#endif
+
+	/* initial scan */
+	os_event_signal(devices_event);
+	return;
+
+fail:
+	signal_handler_destroy(devices_signalhandler);
+	devices_signalhandler = NULL;
+}
+
+void v4l2_devices_free(void)
+{
+	if (!devices_initialized)
+		return;
+
+#if HAVE_UDEV
+	signal_handler_t *sh = v4l2_get_udev_signalhandler();
+
+	signal_handler_disconnect(sh, "device_added", device_event, NULL);
+	signal_handler_disconnect(sh, "device_removed", device_event, NULL);
+
+	v4l2_unref_udev();
+#endif
+
+	devices_stopping = true;
+	os_event_signal(devices_event);
+	pthread_join(devices_thread, NULL);
+	os_event_destroy(devices_event);
+
+	signal_handler_destroy(devices_signalhandler);
+	devices_signalhandler = NULL;
+
+	free_device_array(&devices);
+	devices_initialized = false;
+}
+
+void v4l2_devices_refresh(void)
+{
+	if (devices_initialized)
+		os_event_signal(devices_event);
+}
+
+void v4l2_devices_enum(v4l2_device_enum_cb cb, void *param)
+{
+	pthread_mutex_lock(&devices_mutex);
+
+	for (size_t i = 0; i < devices.num; i++) {
+		if (!cb(param, devices.array[i].name, devices.array[i].path))
+			break;
+	}
+
+	pthread_mutex_unlock(&devices_mutex);
+}
+
+signal_handler_t *v4l2_devices_get_signalhandler(void)
+{
+	return devices_signalhandler;
+}
@@ -0,0 +1,78 @@
+/*
+Copyright (C) 2016 by Hugh Bailey <obs.jim@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+
+#include <callback/signal.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Callback for enumerating known devices
+ *
+ * @param param user data passed to v4l2_devices_enum
+ * @param name  name of the device as reported by the driver
+ * @param path  path of the device node
+ * @return false to stop enumerating
+ */
+typedef bool (*v4l2_device_enum_cb)(void *param, const char *name,
+		const char *path);
+
+/**
+ * Start the device registry
+ *
+ * Devices are probed on a background thread, once right away and again
+ * whenever a device is added or removed, so listing them never has to open
+ * a device.
+ */
+void v4l2_devices_init(void);
+
+/**
+ * Stop the device registry and free the device list
+ */
+void v4l2_devices_free(void);
+
+/**
+ * Request a rescan without waiting for it
+ *
+ * Only needed without udev, which otherwise reports device changes.
+ */
+void v4l2_devices_refresh(void);
+
+/**
+ * Enumerate the devices found by the last scan
+ *
+ * @param cb    callback called for every device
+ * @param param user data for the callback
+ */
+void v4l2_devices_enum(v4l2_device_enum_cb cb, void *param);
+
+/**
+ * Get signal handler
+ *
+ * @return signal handler emitting "changed" after every scan that changed
+ *         the device list
+ */
+signal_handler_t *v4l2_devices_get_signalhandler(void);
+
+#ifdef __cplusplus
+}
+#endif
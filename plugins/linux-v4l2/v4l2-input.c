@@ -20,7 +20,6 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <string.h>
 #include <inttypes.h>
 #include <fcntl.h>
-#include <dirent.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/ioctl.h>
@@ -31,16 +30,22 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <util/threading.h>
 #include <util/bmem.h>
+#include <util/darray.h>
 #include <util/dstr.h>
 #include <util/platform.h>
 #include <obs-module.h>
 
 #include "v4l2-helpers.h"
+#include "v4l2-devices.h"
 
 #if HAVE_UDEV
 #include "v4l2-udev.h"
 #endif
 
+#if HAVE_MJPEG
+#include "v4l2-mjpeg.h"
+#endif
+
 /* The new dv timing api was introduced in Linux 3.4
  * Currently we simply disable dv timings when this is not defined */
 #if !defined(VIDIOC_ENUM_DV_TIMINGS) || !defined(V4L2_IN_CAP_DV_TIMINGS)
@@ -63,6 +68,22 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #define blog(level, msg, ...) blog(level, "v4l2-input: " msg, ##__VA_ARGS__)
 
+/* frames are only handed to obs by reference while at least this many
+ * buffers stay queued in the driver, so capture never runs dry */
+#define MIN_QUEUED_BUFFERS 2
+/* how long to wait for obs to give back buffers when stopping */
+#define RELEASE_TIMEOUT_MS 1000
+
+struct v4l2_data;
+
+/**
+ * Parameter for the release callback of a frame that was handed to obs
+ */
+struct v4l2_buffer_ref {
+	struct v4l2_data *data;
+	uint32_t index;
+};
+
 /**
  * Data structure for the v4l2 source
  */
@@ -75,6 +96,7 @@ struct v4l2_data {
 	int dv_timing;
 	int resolution;
 	int framerate;
+	bool hw_decode;
 
 	/* internal data */
 	obs_source_t *source;
@@ -86,6 +108,16 @@ struct v4l2_data {
 	int height;
 	int linesize;
 	struct v4l2_buffer_data buffers;
+
+	/* buffers that are used by obs without being copied */
+	struct v4l2_buffer_ref *buffer_refs;
+	pthread_mutex_t release_mutex;
+	DARRAY(uint32_t) released;
+	volatile long held;
+
+#if HAVE_MJPEG
+	struct v4l2_mjpeg_decoder *mjpeg;
+#endif
 };
 
 /* forward declarations */
@@ -142,6 +174,95 @@ static void v4l2_prep_obs_frame(struct v4l2_data *data,
 	}
 }
 
+/*
+ * Called by obs once it no longer needs a frame, possibly from the graphics
+ * thread.  The buffer is queued again by the capture thread.
+ */
+static void v4l2_release_buffer(void *param)
+{
+	struct v4l2_buffer_ref *ref = param;
+	struct v4l2_data *data = ref->data;
+
+	pthread_mutex_lock(&data->release_mutex);
+	da_push_back(data->released, &ref->index);
+	pthread_mutex_unlock(&data->release_mutex);
+
+	os_atomic_dec_long(&data->held);
+}
+
+/*
+ * Queue the buffers obs gave back
+ */
+static int_fast32_t v4l2_requeue_released(struct v4l2_data *data)
+{
+	struct v4l2_buffer buf;
+	int_fast32_t ret = 0;
+
+	pthread_mutex_lock(&data->release_mutex);
+
+	for (size_t i = 0; i < data->released.num; ++i) {
+		memset(&buf, 0, sizeof(buf));
+		buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf.memory = V4L2_MEMORY_MMAP;
+		buf.index  = data->released.array[i];
+
+		if (v4l2_ioctl(data->dev, VIDIOC_QBUF, &buf) < 0)
+			ret = -1;
+	}
+	da_resize(data->released, 0);
+
+	pthread_mutex_unlock(&data->release_mutex);
+	return ret;
+}
+
+/*
+ * Wait for obs to give back all buffers it still uses
+ *
+ * @return false if some buffers are still in use after the timeout
+ */
+static bool v4l2_wait_for_buffers(struct v4l2_data *data)
+{
+	obs_source_flush_async_video(data->source);
+
+	for (int i = 0; data->held > 0 && i < RELEASE_TIMEOUT_MS; ++i)
+		os_sleep_ms(1);
+
+	pthread_mutex_lock(&data->release_mutex);
+	da_resize(data->released, 0);
+	pthread_mutex_unlock(&data->release_mutex);
+
+	return data->held <= 0;
+}
+
+/**
+ * Check if a pixelformat can be captured
+ */
+static inline bool v4l2_format_supported(uint_fast32_t format)
+{
+#if HAVE_MJPEG
+	if (format == V4L2_PIX_FMT_MJPEG)
+		return true;
+#endif
+	return v4l2_to_obs_video_format(format) != VIDEO_FORMAT_NONE;
+}
+
+#if HAVE_MJPEG
+/*
+ * Decode a MJPEG frame and give the buffer straight back to the driver, obs
+ * gets the decoded copy
+ */
+static int_fast32_t v4l2_output_mjpeg(struct v4l2_data *data,
+		struct v4l2_buffer *buf, uint64_t timestamp)
+{
+	uint8_t *start = (uint8_t *) data->buffers.info[buf->index].start;
+
+	v4l2_mjpeg_decode(data->mjpeg, data->source, start, buf->bytesused,
+			timestamp);
+
+	return v4l2_ioctl(data->dev, VIDIOC_QBUF, buf);
+}
+#endif
+
 /*
  * Worker thread to get video data
  */
@@ -161,11 +282,23 @@ static void *v4l2_thread(void *vptr)
 	if (v4l2_start_capture(data->dev, &data->buffers) < 0)
 		goto exit;
 
+	data->buffer_refs = bzalloc(data->buffers.count *
+			sizeof(struct v4l2_buffer_ref));
+	for (uint_fast32_t i = 0; i < data->buffers.count; ++i) {
+		data->buffer_refs[i].data  = data;
+		data->buffer_refs[i].index = i;
+	}
+
 	frames   = 0;
 	first_ts = 0;
 	v4l2_prep_obs_frame(data, &out, plane_offsets);
 
 	while (os_event_try(data->event) == EAGAIN) {
+		if (v4l2_requeue_released(data) < 0) {
+			blog(LOG_DEBUG, "failed to enqueue buffer");
+			break;
+		}
+
 		FD_ZERO(&fds);
 		FD_SET(data->dev, &fds);
 		tv.tv_sec = 1;
@@ -197,14 +330,36 @@ static void *v4l2_thread(void *vptr)
 			first_ts = out.timestamp;
 		out.timestamp -= first_ts;
 
+#if HAVE_MJPEG
+		if (data->mjpeg) {
+			if (v4l2_output_mjpeg(data, &buf, out.timestamp) < 0) {
+				blog(LOG_DEBUG, "failed to enqueue buffer");
+				break;
+			}
+			frames++;
+			continue;
+		}
+#endif
+
 		start = (uint8_t *) data->buffers.info[buf.index].start;
 		for (uint_fast32_t i = 0; i < MAX_AV_PLANES; ++i)
 			out.data[i] = start + plane_offsets[i];
-		obs_source_output_video(data->source, &out);
 
-		if (v4l2_ioctl(data->dev, VIDIOC_QBUF, &buf) < 0) {
-			blog(LOG_DEBUG, "failed to enqueue buffer");
-			break;
+		/* the buffer is queued again once obs is done with it */
+		if (data->held + 1 + MIN_QUEUED_BUFFERS <=
+				(long)data->buffers.count) {
+			os_atomic_inc_long(&data->held);
+			obs_source_output_video_ref(data->source, &out,
+					v4l2_release_buffer,
+					&data->buffer_refs[buf.index]);
+
+		} else {
+			obs_source_output_video(data->source, &out);
+
+			if (v4l2_ioctl(data->dev, VIDIOC_QBUF, &buf) < 0) {
+				blog(LOG_DEBUG, "failed to enqueue buffer");
+				break;
+			}
 		}
 
 		frames++;
@@ -232,6 +387,7 @@ static void v4l2_defaults(obs_data_t *settings)
 	obs_data_set_default_int(settings, "resolution", -1);
 	obs_data_set_default_int(settings, "framerate", -1);
 	obs_data_set_default_bool(settings, "buffering", true);
+	obs_data_set_default_bool(settings, "hw_decode", true);
 }
 
 /**
@@ -258,98 +414,50 @@ static void v4l2_props_set_enabled(obs_properties_t *props,
 	}
 }
 
+struct device_list_data {
+	obs_property_t *prop;
+	const char *cur_device_name;
+	bool cur_device_found;
+};
+
+static bool add_device(void *vptr, const char *name, const char *path)
+{
+	struct device_list_data *list = vptr;
+
+	obs_property_list_add_string(list->prop, name, path);
+
+	/* check if this is the currently used device */
+	if (list->cur_device_name && !strcmp(list->cur_device_name, path))
+		list->cur_device_found = true;
+
+	return true;
+}
+
 /*
  * List available devices
+ *
+ * The devices come from the device registry, so this never opens them
  */
 static void v4l2_device_list(obs_property_t *prop, obs_data_t *settings)
 {
-	DIR *dirp;
-	struct dirent *dp;
-	struct dstr device;
-	bool cur_device_found;
+	struct device_list_data list;
 	size_t cur_device_index;
-	const char *cur_device_name;
 
-#ifdef __FreeBSD__
-	dirp = opendir("/dev");
-#else
-	dirp = opendir("/sys/class/video4linux");
-#endif
-	if (!dirp)
-		return;
-
-	cur_device_found = false;
-	cur_device_name  = obs_data_get_string(settings, "device_id");
+	list.prop             = prop;
+	list.cur_device_name  = obs_data_get_string(settings, "device_id");
+	list.cur_device_found = false;
 
 	obs_property_list_clear(prop);
 
-	dstr_init_copy(&device, "/dev/");
-
-	while ((dp = readdir(dirp)) != NULL) {
-		int fd;
-		uint32_t caps;
-		struct v4l2_capability video_cap;
-
-#ifdef __FreeBSD__
-		if (strstr(dp->d_name, "video") == NULL)
-			continue;
-#endif
-
-		if (dp->d_type == DT_DIR)
-			continue;
-
-		dstr_resize(&device, 5);
-		dstr_cat(&device, dp->d_name);
-
-		if ((fd = v4l2_open(device.array, O_RDWR | O_NONBLOCK)) == -1) {
-			blog(LOG_INFO, "Unable to open %s", device.array);
-			continue;
-		}
-
-		if (v4l2_ioctl(fd, VIDIOC_QUERYCAP, &video_cap) == -1) {
-			blog(LOG_INFO, "Failed to query capabilities for %s",
-			     device.array);
-			v4l2_close(fd);
-			continue;
-		}
-
-#ifndef V4L2_CAP_DEVICE_CAPS
-		caps = video_cap.capabilities;
-#else
-		/* ... since Linux 3.3 */
-		caps = (video_cap.capabilities & V4L2_CAP_DEVICE_CAPS)
-			? video_cap.device_caps
-			: video_cap.capabilities;
-#endif
-
-		if (!(caps & V4L2_CAP_VIDEO_CAPTURE)) {
-			blog(LOG_INFO, "%s seems to not support video capture",
-			     device.array);
-			v4l2_close(fd);
-			continue;
-		}
-
-		obs_property_list_add_string(prop, (char *) video_cap.card,
-				device.array);
-		blog(LOG_INFO, "Found device '%s' at %s", video_cap.card,
-				device.array);
-
-		/* check if this is the currently used device */
-		if (cur_device_name && !strcmp(cur_device_name, device.array))
-			cur_device_found = true;
-
-		v4l2_close(fd);
-	}
+	v4l2_devices_enum(add_device, &list);
 
 	/* add currently selected device if not present, but disable it ... */
-	if (!cur_device_found && cur_device_name && strlen(cur_device_name)) {
+	if (!list.cur_device_found && list.cur_device_name &&
+	    strlen(list.cur_device_name)) {
 		cur_device_index = obs_property_list_add_string(prop,
-				cur_device_name, cur_device_name);
+				list.cur_device_name, list.cur_device_name);
 		obs_property_list_item_disable(prop, cur_device_index, true);
 	}
-
-	closedir(dirp);
-	dstr_free(&device);
 }
 
 /*
@@ -388,8 +496,7 @@ static void v4l2_format_list(int dev, obs_property_t *prop)
 		if (fmt.flags & V4L2_FMT_FLAG_EMULATED)
 			dstr_cat(&buffer, " (Emulated)");
 
-		if (v4l2_to_obs_video_format(fmt.pixelformat)
-				!= VIDEO_FORMAT_NONE) {
+		if (v4l2_format_supported(fmt.pixelformat)) {
 			obs_property_list_add_int(prop, buffer.array,
 					fmt.pixelformat);
 			blog(LOG_INFO, "Pixelformat: %s (available)",
@@ -723,6 +830,17 @@ static void device_removed(void *vptr, calldata_t *calldata)
 
 #endif
 
+/**
+ * Reload open properties once a device scan has changed the device list
+ */
+static void devices_changed(void *vptr, calldata_t *calldata)
+{
+	UNUSED_PARAMETER(calldata);
+	V4L2_DATA(vptr);
+
+	obs_source_update_properties(data->source);
+}
+
 static obs_properties_t *v4l2_properties(void *vptr)
 {
 	V4L2_DATA(vptr);
@@ -762,10 +880,21 @@ static obs_properties_t *v4l2_properties(void *vptr)
 	obs_properties_add_bool(props,
 			"buffering", obs_module_text("UseBuffering"));
 
+#if HAVE_MJPEG
+	obs_properties_add_bool(props,
+			"hw_decode", obs_module_text("HardwareDecode"));
+#endif
+
 	obs_data_t *settings = obs_source_get_settings(data->source);
 	v4l2_device_list(device_list, settings);
 	obs_data_release(settings);
 
+#if !HAVE_UDEV
+	/* the list shows the last scan, a new one reloads the properties once
+	 * it's done if anything changed */
+	v4l2_devices_refresh();
+#endif
+
 	obs_property_set_modified_callback(device_list, device_selected);
 	obs_property_set_modified_callback(input_list, input_selected);
 	obs_property_set_modified_callback(format_list, format_selected);
@@ -784,7 +913,21 @@ static void v4l2_terminate(struct v4l2_data *data)
 		data->thread = 0;
 	}
 
-	v4l2_destroy_mmap(&data->buffers);
+#if HAVE_MJPEG
+	v4l2_mjpeg_destroy(data->mjpeg);
+	data->mjpeg = NULL;
+#endif
+
+	/* if obs still holds on to buffers, leave them mapped rather than
+	 * risk it reading unmapped memory */
+	if (v4l2_wait_for_buffers(data)) {
+		v4l2_destroy_mmap(&data->buffers);
+		bfree(data->buffer_refs);
+	} else {
+		blog(LOG_WARNING, "Buffers still in use, not unmapping them");
+		memset(&data->buffers, 0, sizeof(data->buffers));
+	}
+	data->buffer_refs = NULL;
 
 	if (data->dev != -1) {
 		v4l2_close(data->dev);
@@ -804,6 +947,12 @@ static void v4l2_destroy(void *vptr)
 	if (data->device_id)
 		bfree(data->device_id);
 
+	pthread_mutex_destroy(&data->release_mutex);
+	da_free(data->released);
+
+	signal_handler_disconnect(v4l2_devices_get_signalhandler(), "changed",
+			devices_changed, data);
+
 #if HAVE_UDEV
 	signal_handler_t *sh = v4l2_get_udev_signalhandler();
 
@@ -874,7 +1023,7 @@ static void v4l2_init(struct v4l2_data *data)
 		blog(LOG_ERROR, "Unable to set format");
 		goto fail;
 	}
-	if (v4l2_to_obs_video_format(data->pixfmt) == VIDEO_FORMAT_NONE) {
+	if (!v4l2_format_supported(data->pixfmt)) {
 		blog(LOG_ERROR, "Selected video format not supported");
 		goto fail;
 	}
@@ -897,6 +1046,16 @@ static void v4l2_init(struct v4l2_data *data)
 		goto fail;
 	}
 
+#if HAVE_MJPEG
+	if (data->pixfmt == V4L2_PIX_FMT_MJPEG) {
+		data->mjpeg = v4l2_mjpeg_create(data->hw_decode);
+		if (!data->mjpeg) {
+			blog(LOG_ERROR, "Failed to create MJPEG decoder");
+			goto fail;
+		}
+	}
+#endif
+
 	/* start the capture thread */
 	if (os_event_init(&data->event, OS_EVENT_TYPE_MANUAL) != 0)
 		goto fail;
@@ -943,6 +1102,7 @@ static void v4l2_update(void *vptr, obs_data_t *settings)
 	data->dv_timing  = obs_data_get_int(settings, "dv_timing");
 	data->resolution = obs_data_get_int(settings, "resolution");
 	data->framerate  = obs_data_get_int(settings, "framerate");
+	data->hw_decode  = obs_data_get_bool(settings, "hw_decode");
 
 	v4l2_update_source_flags(data, settings);
 
@@ -954,6 +1114,7 @@ static void *v4l2_create(obs_data_t *settings, obs_source_t *source)
 	struct v4l2_data *data = bzalloc(sizeof(struct v4l2_data));
 	data->dev = -1;
 	data->source = source;
+	pthread_mutex_init(&data->release_mutex, NULL);
 
 	/* Bitch about build problems ... */
 #ifndef V4L2_CAP_DEVICE_CAPS
@@ -965,6 +1126,9 @@ static void *v4l2_create(obs_data_t *settings, obs_source_t *source)
 
 	v4l2_update(data, settings);
 
+	signal_handler_connect(v4l2_devices_get_signalhandler(), "changed",
+			devices_changed, data);
+
 #if HAVE_UDEV
 	v4l2_init_udev();
 	signal_handler_t *sh = v4l2_get_udev_signalhandler();
@@ -979,7 +1143,7 @@ static void *v4l2_create(obs_data_t *settings, obs_source_t *source)
 struct obs_source_info v4l2_input = {
 	.id             = "v4l2_input",
 	.type           = OBS_SOURCE_TYPE_INPUT,
-	.output_flags   = OBS_SOURCE_ASYNC_VIDEO,
+	.output_flags   = OBS_SOURCE_ASYNC_VIDEO | OBS_SOURCE_THREADED_CREATE,
 	.get_name       = v4l2_getname,
 	.create         = v4l2_create,
 	.destroy        = v4l2_destroy,
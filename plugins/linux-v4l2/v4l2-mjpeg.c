@@ -0,0 +1,286 @@
+/*
+Copyright (C) 2016 by Hugh Bailey <obs.jim@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <util/bmem.h>
+
+#include <libavcodec/avcodec.h>
+
+/* the hardware decode configuration API was added in FFmpeg 4.0 */
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(58, 18, 100)
+#include <libavutil/hwcontext.h>
+#include <libavutil/pixdesc.h>
+#define ENABLE_HW_DECODE 1
+#endif
+
+#include "v4l2-mjpeg.h"
+
+#define blog(level, msg, ...) blog(level, "v4l2-input: " msg, ##__VA_ARGS__)
+
+struct v4l2_mjpeg_decoder {
+	AVCodec            *codec;
+	AVCodecContext     *context;
+	AVFrame            *frame;
+
+#ifdef ENABLE_HW_DECODE
+	AVBufferRef        *hw_device_ctx;
+	enum AVPixelFormat hw_format;
+	AVFrame            *sw_frame;
+#endif
+
+
+	uint8_t            *packet;
+	size_t             packet_size;
+};
+
+#ifdef ENABLE_HW_DECODE
+static enum AVPixelFormat v4l2_mjpeg_get_format(AVCodecContext *ctx,
+		const enum AVPixelFormat *formats)
+{
+	struct v4l2_mjpeg_decoder *decoder = ctx->opaque;
+	const enum AVPixelFormat *f;
+
+	for (f = formats; *f != AV_PIX_FMT_NONE; f++)
+		if (*f == decoder->hw_format)
+			return *f;
+
+	for (f = formats; *f != AV_PIX_FMT_NONE; f++) {
+		const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(*f);
+		if (desc && (desc->flags & AV_PIX_FMT_FLAG_HWACCEL) == 0)
+			return *f;
+	}
+
+	return AV_PIX_FMT_NONE;
+}
+
+static void v4l2_mjpeg_init_hw(struct v4l2_mjpeg_decoder *decoder)
+{
+	const int method = AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX;
+
+	for (int i = 0;; i++) {
+		const AVCodecHWConfig *config =
+			avcodec_get_hw_config(decoder->codec, i);
+		if (!config)
+			return;
+
+		if ((config->methods & method) &&
+		    config->device_type == AV_HWDEVICE_TYPE_VAAPI) {
+			decoder->hw_format = config->pix_fmt;
+			break;
+		}
+	}
+
+	if (av_hwdevice_ctx_create(&decoder->hw_device_ctx,
+			AV_HWDEVICE_TYPE_VAAPI, NULL, NULL, 0) < 0) {
+		blog(LOG_INFO, "VAAPI not available, decoding MJPEG on the "
+				"CPU");
+		return;
+	}
+
+	decoder->context->hw_device_ctx =
+		av_buffer_ref(decoder->hw_device_ctx);
+	decoder->context->opaque = decoder;
+	decoder->context->get_format = v4l2_mjpeg_get_format;
+	blog(LOG_INFO, "Using VAAPI to decode MJPEG");
+}
+#endif
+
+struct v4l2_mjpeg_decoder *v4l2_mjpeg_create(bool use_hw)
+{
+	struct v4l2_mjpeg_decoder *decoder = bzalloc(sizeof(*decoder));
+
+	avcodec_register_all();
+
+	decoder->codec = avcodec_find_decoder(AV_CODEC_ID_MJPEG);
+	if (!decoder->codec) {
+		blog(LOG_ERROR, "MJPEG decoder not found");
+		goto fail;
+	}
+
+	decoder->context = avcodec_alloc_context3(decoder->codec);
+	decoder->frame = av_frame_alloc();
+	if (!decoder->context || !decoder->frame)
+		goto fail;
+
+	/* every frame is a keyframe, so frame threads scale well */
+	decoder->context->thread_count = 0;
+	decoder->context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+#ifdef ENABLE_HW_DECODE
+	if (use_hw)
+		v4l2_mjpeg_init_hw(decoder);
+#else
+	UNUSED_PARAMETER(use_hw);
+#endif
+
+	if (avcodec_open2(decoder->context, decoder->codec, NULL) < 0) {
+		blog(LOG_ERROR, "Failed to open MJPEG decoder");
+		goto fail;
+	}
+
+	return decoder;
+
+fail:
+	v4l2_mjpeg_destroy(decoder);
+	return NULL;
+}
+
+void v4l2_mjpeg_destroy(struct v4l2_mjpeg_decoder *decoder)
+{
+	if (!decoder)
+		return;
+
+	if (decoder->context) {
+		avcodec_close(decoder->context);
+		av_free(decoder->context);
+	}
+	if (decoder->frame)
+		av_frame_free(&decoder->frame);
+#ifdef ENABLE_HW_DECODE
+	if (decoder->sw_frame)
+		av_frame_free(&decoder->sw_frame);
+	if (decoder->hw_device_ctx)
+		av_buffer_unref(&decoder->hw_device_ctx);
+#endif
+
+	bfree(decoder->packet);
+	bfree(decoder);
+}
+
+/*
+ * Interleave planar 4:2:2, which is what most cameras send, into YUY2 since
+ * obs has no planar 4:2:2 format
+ */
+static void v4l2_mjpeg_pack_422(const AVFrame *in,
+		struct obs_source_frame *out)
+{
+	for (int y = 0; y < in->height; ++y) {
+		const uint8_t *lum = in->data[0] + y * in->linesize[0];
+		const uint8_t *u   = in->data[1] + y * in->linesize[1];
+		const uint8_t *v   = in->data[2] + y * in->linesize[2];
+		uint8_t *dst = out->data[0] + y * out->linesize[0];
+
+		for (int x = 0; x < in->width / 2; ++x) {
+			*(dst++) = lum[x * 2];
+			*(dst++) = u[x];
+			*(dst++) = lum[x * 2 + 1];
+			*(dst++) = v[x];
+		}
+	}
+}
+
+static void v4l2_mjpeg_set_info(const AVFrame *in,
+		struct obs_source_frame *out)
+{
+	/* jpeg is full range unless the hardware decoder says otherwise */
+	bool full_range = in->color_range != AVCOL_RANGE_MPEG;
+
+	out->timestamp  = (uint64_t) in->pkt_pts;
+	out->full_range = full_range;
+	video_format_get_parameters(VIDEO_CS_601,
+			full_range ? VIDEO_RANGE_FULL : VIDEO_RANGE_PARTIAL,
+			out->color_matrix, out->color_range_min,
+			out->color_range_max);
+}
+
+static bool v4l2_mjpeg_output(obs_source_t *source, const AVFrame *in)
+{
+	struct obs_source_frame *pooled;
+	struct obs_source_frame out = {0};
+
+	switch (in->format) {
+	case AV_PIX_FMT_YUVJ422P:
+	case AV_PIX_FMT_YUV422P:
+		/* this has to be converted anyway, so write it straight into
+		 * a frame from the source's pool instead of copying twice */
+		pooled = obs_source_frame_acquire(source, VIDEO_FORMAT_YUY2,
+				in->width, in->height);
+		if (pooled) {
+			v4l2_mjpeg_pack_422(in, pooled);
+			v4l2_mjpeg_set_info(in, pooled);
+			obs_source_frame_submit(source, pooled);
+		}
+		return true;
+	case AV_PIX_FMT_YUVJ420P:
+	case AV_PIX_FMT_YUV420P:
+	case AV_PIX_FMT_NV12:
+		out.format = (in->format == AV_PIX_FMT_NV12) ?
+			VIDEO_FORMAT_NV12 : VIDEO_FORMAT_I420;
+		for (size_t i = 0; i < MAX_AV_PLANES; ++i) {
+			out.data[i]     = in->data[i];
+			out.linesize[i] = in->linesize[i];
+		}
+		break;
+	default:
+		blog(LOG_ERROR, "Unsupported MJPEG output format %s",
+				av_get_pix_fmt_name(in->format));
+		return false;
+	}
+
+	out.width  = in->width;
+	out.height = in->height;
+	v4l2_mjpeg_set_info(in, &out);
+	obs_source_output_video(source, &out);
+	return true;
+}
+
+int v4l2_mjpeg_decode(struct v4l2_mjpeg_decoder *decoder,
+		obs_source_t *source, uint8_t *data, size_t size,
+		uint64_t timestamp)
+{
+	size_t padded_size = size + FF_INPUT_BUFFER_PADDING_SIZE;
+	AVFrame *frame = decoder->frame;
+	AVPacket packet;
+	int got_frame = 0;
+	int ret;
+
+	if (decoder->packet_size < padded_size) {
+		decoder->packet = brealloc(decoder->packet, padded_size);
+		decoder->packet_size = padded_size;
+	}
+	memcpy(decoder->packet, data, size);
+	memset(decoder->packet + size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+
+	av_init_packet(&packet);
+	packet.data  = decoder->packet;
+	packet.size  = (int) size;
+	packet.pts   = (int64_t) timestamp;
+	packet.flags = AV_PKT_FLAG_KEY;
+
+	ret = avcodec_decode_video2(decoder->context, frame, &got_frame,
+			&packet);
+	if (ret < 0 || !got_frame)
+		return ret < 0 ? ret : 0;
+
+#ifdef ENABLE_HW_DECODE
+	if (decoder->hw_device_ctx && frame->format == decoder->hw_format) {
+		if (!decoder->sw_frame)
+			decoder->sw_frame = av_frame_alloc();
+		if (!decoder->sw_frame)
+			return -1;
+
+		av_frame_unref(decoder->sw_frame);
+		if (av_hwframe_transfer_data(decoder->sw_frame, frame, 0) < 0)
+			return -1;
+
+		decoder->sw_frame->pkt_pts     = frame->pkt_pts;
+		decoder->sw_frame->color_range = frame->color_range;
+		frame = decoder->sw_frame;
+	}
+#endif
+
+	return v4l2_mjpeg_output(source, frame) ? 1 : -1;
+}
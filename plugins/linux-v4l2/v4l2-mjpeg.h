@@ -0,0 +1,65 @@
+/*
+Copyright (C) 2016 by Hugh Bailey <obs.jim@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <obs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct v4l2_mjpeg_decoder;
+
+/**
+ * Create a decoder for MJPEG frames
+ *
+ * A hardware decoder is used when one is available, otherwise the frames are
+ * decoded on multiple threads.
+ *
+ * @param use_hw try to use a hardware decoder
+ *
+ * @return NULL on error
+ */
+struct v4l2_mjpeg_decoder *v4l2_mjpeg_create(bool use_hw);
+
+/**
+ * Destroy a MJPEG decoder
+ */
+void v4l2_mjpeg_destroy(struct v4l2_mjpeg_decoder *decoder);
+
+/**
+ * Decode a MJPEG frame and output it to a source
+ *
+ * With threaded decoding the output lags the input by a few frames, the
+ * timestamp of the output frame is the one it was passed in with.
+ *
+ * @param decoder the decoder
+ * @param source source to output the decoded frame to
+ * @param data compressed frame
+ * @param size size of the compressed frame
+ * @param timestamp timestamp of the compressed frame
+ *
+ * @return < 0 on error, 0 if there is no output yet, > 0 if a frame was output
+ */
+int v4l2_mjpeg_decode(struct v4l2_mjpeg_decoder *decoder,
+		obs_source_t *source, uint8_t *data, size_t size,
+		uint64_t timestamp);
+
+#ifdef __cplusplus
+}
+#endif
@@ -7,6 +7,7 @@
 
 #include <obs-module.h>
 #include <media-io/video-io.h>
+#include <util/threading.h>
 
 #import "AVCaptureInputPort+PreMavericksCompat.h"
 
@@ -72,8 +73,37 @@ struct av_capture {
 	obs_source_t *source;
 
 	struct obs_source_frame frame;
+
+	/* one reference for the capture plus one per held frame, held frames
+	 * can outlive the capture */
+	volatile long *held_refs;
 };
 
+/* past this, frames are copied again so the capture's pixel buffer pool
+ * can't run dry while libobs is queueing frames */
+#define MAX_HELD_FRAMES 4
+
+struct held_frame {
+	CVPixelBufferRef img;
+	volatile long    *refs;
+};
+
+static inline void release_held_refs(volatile long *refs)
+{
+	if (os_atomic_dec_long(refs) == 0)
+		bfree((void*)refs);
+}
+
+static void release_held_frame(void *param)
+{
+	struct held_frame *held = param;
+
+	CVPixelBufferUnlockBaseAddress(held->img, kCVPixelBufferLock_ReadOnly);
+	CVPixelBufferRelease(held->img);
+	release_held_refs(held->refs);
+	bfree(held);
+}
+
 static inline enum video_format format_from_subtype(FourCharCode subtype)
 {
 	//TODO: uncomment VIDEO_FORMAT_NV12 and VIDEO_FORMAT_ARGB once libobs
@@ -236,10 +266,25 @@ static inline bool update_frame(struct av_capture *capture,
 	if (!update_frame(capture, frame, sampleBuffer))
 		return;
 
-	obs_source_output_video(capture->source, frame);
-
 	CVImageBufferRef img = CMSampleBufferGetImageBuffer(sampleBuffer);
-	CVPixelBufferUnlockBaseAddress(img, kCVPixelBufferLock_ReadOnly);
+
+	/* the pixel buffer stays locked and is used in place until libobs is
+	 * done with the frame instead of being copied into the frame cache */
+	if (os_atomic_inc_long(capture->held_refs) > MAX_HELD_FRAMES + 1) {
+		os_atomic_dec_long(capture->held_refs);
+
+		obs_source_output_video(capture->source, frame);
+		CVPixelBufferUnlockBaseAddress(img,
+				kCVPixelBufferLock_ReadOnly);
+		return;
+	}
+
+	struct held_frame *held = bmalloc(sizeof(struct held_frame));
+	held->img  = CVPixelBufferRetain(img);
+	held->refs = capture->held_refs;
+
+	obs_source_output_video_ref(capture->source, frame,
+			release_held_frame, held);
 }
 @end
 
@@ -283,6 +328,10 @@ static void av_capture_destroy(void *data)
 	remove_device(capture);
 	AVFREE(capture->out);
 
+	obs_source_flush_async_video(capture->source);
+	if (capture->held_refs)
+		release_held_refs(capture->held_refs);
+
 	if (capture->queue)
 		dispatch_release(capture->queue);
 
@@ -572,14 +621,15 @@ static void *av_capture_create(obs_data_t *settings, obs_source_t *source)
 
 	struct av_capture *capture = bzalloc(sizeof(struct av_capture));
 	capture->source = source;
+	capture->held_refs = bzalloc(sizeof(long));
+	*capture->held_refs = 1;
 
 	av_capture_init(capture, settings);
 
 	if (!capture->session) {
 		AVLOG(LOG_ERROR, "No valid session, returning NULL context");
 		av_capture_destroy(capture);
-		bfree(capture);
-		capture = NULL;
+		return NULL;
 	}
 
 	av_capture_enable_buffering(capture,
@@ -1,6 +1,7 @@
 #include <obs-module.h>
 
 OBS_DECLARE_MODULE()
+OBS_MODULE_DEFERRABLE()
 OBS_MODULE_USE_DEFAULT_LOCALE("mac-avcapture", "en-US")
 
 extern struct obs_source_info av_capture_info;
@@ -266,9 +266,20 @@ static inline CFMutableDictionaryRef create_pixbuf_spec(
 {
 	CFMutableDictionaryRef pixbuf_spec = CFDictionaryCreateMutable(
 			kCFAllocatorDefault,
-			3,
+			4,
+			&kCFTypeDictionaryKeyCallBacks,
+			&kCFTypeDictionaryValueCallBacks);
+
+	/* an empty dictionary is enough to have the session's pool hand out
+	 * IOSurface backed buffers, which the hardware encoder can read
+	 * without copying them into its own surfaces first */
+	CFDictionaryRef iosurface_props = CFDictionaryCreate(
+			kCFAllocatorDefault, NULL, NULL, 0,
 			&kCFTypeDictionaryKeyCallBacks,
 			&kCFTypeDictionaryValueCallBacks);
+	CFDictionaryAddValue(pixbuf_spec, kCVPixelBufferIOSurfacePropertiesKey,
+			iosurface_props);
+	CFRelease(iosurface_props);
 
 	CFNumberRef n = CFNumberCreate(NULL, kCFNumberSInt32Type,
 			&enc->vt_pix_fmt);
@@ -794,9 +805,16 @@ static bool vt_h264_encode(void *data, struct encoder_frame *frame,
 		size_t plane_linesize = CVPixelBufferGetBytesPerRowOfPlane(
 				pixbuf, i);
 		size_t plane_height = CVPixelBufferGetHeightOfPlane(pixbuf, i);
+		size_t row_size = frame->linesize[i] < plane_linesize ?
+			frame->linesize[i] : plane_linesize;
+
+		if (plane_linesize == frame->linesize[i]) {
+			memcpy(p, f, plane_linesize * plane_height);
+			continue;
+		}
 
 		for(size_t j = 0; j < plane_height; j++) {
-			memcpy(p, f, frame->linesize[i]);
+			memcpy(p, f, row_size);
 			p += plane_linesize;
 			f += frame->linesize[i];
 		}
@@ -0,0 +1,546 @@
+/*
+ * Copyright (c) 2015 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#define inline __inline
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ffmpeg-mux-shm.h"
+
+#define FFM_SHM_MAGIC   0x4d484646 /* "FFHM" */
+#define WAIT_TIMEOUT_MS 100
+
+/* how long the writer waits for ffmpeg-mux to open the ring at all */
+#define ATTACH_TIMEOUT_WAITS 50
+
+struct ffm_shm_header {
+	uint32_t            magic;
+	uint32_t            reserved;
+	uint64_t            size;
+
+	/* total bytes written and read, the ring offset is pos % size */
+	volatile uint64_t   write_pos;
+	volatile uint64_t   read_pos;
+
+	volatile long       reader_waiting;
+	volatile long       writer_waiting;
+	volatile long       writer_closed;
+	volatile long       reader_closed;
+	volatile long       reader_attached;
+};
+
+struct ffm_shm {
+	struct ffm_shm_header *header;
+	uint8_t               *data;
+	size_t                map_size;
+	bool                  owner;
+	char                  name[64];
+
+	ffm_shm_alive_t       alive;
+	void                  *alive_param;
+
+#ifdef _WIN32
+	HANDLE                map;
+	HANDLE                data_event;
+	HANDLE                space_event;
+#else
+	sem_t                 *data_sem;
+	sem_t                 *space_sem;
+#endif
+};
+
+/* ------------------------------------------------------------------------- */
+/* atomics and signalling */
+
+#ifdef _WIN32
+typedef HANDLE ffm_event_t;
+
+static inline uint64_t load_pos(volatile uint64_t *pos)
+{
+	return (uint64_t)InterlockedCompareExchange64(
+			(volatile LONG64*)pos, 0, 0);
+}
+
+static inline void store_pos(volatile uint64_t *pos, uint64_t val)
+{
+	InterlockedExchange64((volatile LONG64*)pos, (LONG64)val);
+}
+
+static inline long exchange_flag(volatile long *flag, long val)
+{
+	return InterlockedExchange(flag, val);
+}
+
+static inline void signal_event(ffm_event_t event)
+{
+	SetEvent(event);
+}
+
+static inline void wait_event(ffm_event_t event)
+{
+	WaitForSingleObject(event, WAIT_TIMEOUT_MS);
+}
+
+#else
+typedef sem_t *ffm_event_t;
+
+static inline uint64_t load_pos(volatile uint64_t *pos)
+{
+	return __atomic_load_n(pos, __ATOMIC_SEQ_CST);
+}
+
+static inline void store_pos(volatile uint64_t *pos, uint64_t val)
+{
+	__atomic_store_n(pos, val, __ATOMIC_SEQ_CST);
+}
+
+static inline long exchange_flag(volatile long *flag, long val)
+{
+	return __atomic_exchange_n(flag, val, __ATOMIC_SEQ_CST);
+}
+
+static inline void signal_event(ffm_event_t event)
+{
+	sem_post(event);
+}
+
+static inline void wait_event(ffm_event_t event)
+{
+#ifdef __APPLE__
+	/* no sem_timedwait on mac */
+	for (int i = 0; i < WAIT_TIMEOUT_MS; i++) {
+		if (sem_trywait(event) == 0)
+			return;
+		usleep(1000);
+	}
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_nsec += WAIT_TIMEOUT_MS * 1000000L;
+	ts.tv_sec  += ts.tv_nsec / 1000000000L;
+	ts.tv_nsec %= 1000000000L;
+
+	while (sem_timedwait(event, &ts) != 0 && errno == EINTR);
+#endif
+}
+#endif
+
+static inline ffm_event_t data_event(struct ffm_shm *shm)
+{
+#ifdef _WIN32
+	return shm->data_event;
+#else
+	return shm->data_sem;
+#endif
+}
+
+static inline ffm_event_t space_event(struct ffm_shm *shm)
+{
+#ifdef _WIN32
+	return shm->space_event;
+#else
+	return shm->space_sem;
+#endif
+}
+
+/*
+ * Each side only signals when the other side has flagged itself as waiting.
+ * The waiter always re-checks the ring after raising its flag, so a wakeup
+ * can never be lost; at worst the event is left signalled and the next wait
+ * returns straight away.
+ */
+static inline void wake(volatile long *waiting, ffm_event_t event)
+{
+	if (exchange_flag(waiting, 0))
+		signal_event(event);
+}
+
+static inline uint64_t readable(struct ffm_shm_header *header)
+{
+	return load_pos(&header->write_pos) - load_pos(&header->read_pos);
+}
+
+static inline uint64_t writable(struct ffm_shm_header *header)
+{
+	return header->size - readable(header);
+}
+
+/* ------------------------------------------------------------------------- */
+/* mapping */
+
+static void make_name(struct ffm_shm *shm, const char *suffix,
+		char *name, size_t size)
+{
+#ifdef _WIN32
+	snprintf(name, size, "Local\\%s%s", shm->name, suffix);
+#else
+	snprintf(name, size, "/%s%s", shm->name, suffix);
+#endif
+}
+
+#ifdef _WIN32
+static bool map_shm(struct ffm_shm *shm, size_t size)
+{
+	char name[80];
+
+	make_name(shm, "", name, sizeof(name));
+
+	if (shm->owner)
+		shm->map = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL,
+				PAGE_READWRITE, (DWORD)((uint64_t)size >> 32),
+				(DWORD)size, name);
+	else
+		shm->map = OpenFileMappingA(FILE_MAP_ALL_ACCESS, false, name);
+	if (!shm->map)
+		return false;
+
+	shm->header = MapViewOfFile(shm->map, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	if (!shm->header)
+		return false;
+
+	make_name(shm, "d", name, sizeof(name));
+	shm->data_event = shm->owner ?
+		CreateEventA(NULL, false, false, name) :
+		OpenEventA(EVENT_ALL_ACCESS, false, name);
+
+	make_name(shm, "s", name, sizeof(name));
+	shm->space_event = shm->owner ?
+		CreateEventA(NULL, false, false, name) :
+		OpenEventA(EVENT_ALL_ACCESS, false, name);
+
+	return shm->data_event && shm->space_event;
+}
+
+static void unmap_shm(struct ffm_shm *shm)
+{
+	if (shm->header)
+		UnmapViewOfFile(shm->header);
+	if (shm->map)
+		CloseHandle(shm->map);
+	if (shm->data_event)
+		CloseHandle(shm->data_event);
+	if (shm->space_event)
+		CloseHandle(shm->space_event);
+}
+
+#else
+static bool map_shm(struct ffm_shm *shm, size_t size)
+{
+	char name[80];
+	void *map;
+	int fd;
+
+	make_name(shm, "", name, sizeof(name));
+
+	fd = shm->owner ?
+		shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600) :
+		shm_open(name, O_RDWR, 0);
+	if (fd == -1)
+		return false;
+
+	if (shm->owner) {
+		if (ftruncate(fd, (off_t)size) != 0) {
+			close(fd);
+			return false;
+		}
+	} else {
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			close(fd);
+			return false;
+		}
+		size = (size_t)st.st_size;
+	}
+
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED)
+		return false;
+
+	shm->header = map;
+	shm->map_size = size;
+
+	make_name(shm, "d", name, sizeof(name));
+	shm->data_sem = shm->owner ?
+		sem_open(name, O_CREAT | O_EXCL, 0600, 0) :
+		sem_open(name, 0);
+
+	make_name(shm, "s", name, sizeof(name));
+	shm->space_sem = shm->owner ?
+		sem_open(name, O_CREAT | O_EXCL, 0600, 0) :
+		sem_open(name, 0);
+
+	if (shm->data_sem == SEM_FAILED)
+		shm->data_sem = NULL;
+	if (shm->space_sem == SEM_FAILED)
+		shm->space_sem = NULL;
+
+	return shm->data_sem && shm->space_sem;
+}
+
+static void unmap_shm(struct ffm_shm *shm)
+{
+	char name[80];
+
+	if (shm->header)
+		munmap(shm->header, shm->map_size);
+	if (shm->data_sem)
+		sem_close(shm->data_sem);
+	if (shm->space_sem)
+		sem_close(shm->space_sem);
+
+	/* names are removed by the creator; the child has already opened them
+	 * by the time the writer goes away */
+	if (shm->owner) {
+		make_name(shm, "", name, sizeof(name));
+		shm_unlink(name);
+		make_name(shm, "d", name, sizeof(name));
+		sem_unlink(name);
+		make_name(shm, "s", name, sizeof(name));
+		sem_unlink(name);
+	}
+}
+#endif
+
+static struct ffm_shm *ffm_shm_init(const char *name, bool owner, size_t size)
+{
+	struct ffm_shm *shm = calloc(1, sizeof(*shm));
+
+	shm->owner = owner;
+	snprintf(shm->name, sizeof(shm->name), "%s", name);
+
+	if (!map_shm(shm, size)) {
+		ffm_shm_destroy(shm);
+		return NULL;
+	}
+
+	shm->data = (uint8_t*)(shm->header + 1);
+	return shm;
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct ffm_shm *ffm_shm_create(size_t size)
+{
+	static volatile long counter = 0;
+	struct ffm_shm *shm;
+	char name[64];
+	long id;
+
+#ifdef _WIN32
+	id = InterlockedIncrement(&counter);
+	snprintf(name, sizeof(name), "obsffm%lu-%ld",
+			GetCurrentProcessId(), id);
+#else
+	id = __atomic_add_fetch(&counter, 1, __ATOMIC_SEQ_CST);
+	snprintf(name, sizeof(name), "obsffm%ld-%ld", (long)getpid(), id);
+#endif
+
+	shm = ffm_shm_init(name, true, sizeof(struct ffm_shm_header) + size);
+	if (shm) {
+		memset(shm->header, 0, sizeof(*shm->header));
+		shm->header->size  = size;
+		shm->header->magic = FFM_SHM_MAGIC;
+	}
+
+	return shm;
+}
+
+struct ffm_shm *ffm_shm_open(const char *name)
+{
+	struct ffm_shm *shm = ffm_shm_init(name, false, 0);
+
+	if (!shm)
+		return NULL;
+
+	if (shm->header->magic != FFM_SHM_MAGIC) {
+		ffm_shm_destroy(shm);
+		return NULL;
+	}
+
+	exchange_flag(&shm->header->reader_attached, 1);
+
+	return shm;
+}
+
+void ffm_shm_destroy(struct ffm_shm *shm)
+{
+	if (!shm)
+		return;
+
+	if (shm->header && !shm->owner) {
+		exchange_flag(&shm->header->reader_closed, 1);
+		wake(&shm->header->writer_waiting, space_event(shm));
+	}
+
+	unmap_shm(shm);
+	free(shm);
+}
+
+const char *ffm_shm_name(const struct ffm_shm *shm)
+{
+	return shm->name;
+}
+
+void ffm_shm_set_alive_callback(struct ffm_shm *shm, ffm_shm_alive_t alive,
+		void *param)
+{
+	shm->alive       = alive;
+	shm->alive_param = param;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void copy_in(struct ffm_shm *shm, uint64_t pos, const uint8_t *data,
+		size_t size)
+{
+	size_t offset = (size_t)(pos % shm->header->size);
+	size_t first  = (size_t)shm->header->size - offset;
+
+	if (first > size)
+		first = size;
+
+	memcpy(shm->data + offset, data, first);
+	memcpy(shm->data, data + first, size - first);
+}
+
+static void copy_out(struct ffm_shm *shm, uint64_t pos, uint8_t *data,
+		size_t size)
+{
+	size_t offset = (size_t)(pos % shm->header->size);
+	size_t first  = (size_t)shm->header->size - offset;
+
+	if (first > size)
+		first = size;
+
+	memcpy(data, shm->data + offset, first);
+	memcpy(data + first, shm->data, size - first);
+}
+
+bool ffm_shm_write(struct ffm_shm *shm, const void *vdata, size_t size)
+{
+	struct ffm_shm_header *header = shm->header;
+	const uint8_t *data = vdata;
+	int waits = 0;
+
+	while (size > 0) {
+		uint64_t space = writable(header);
+		uint64_t pos;
+
+		if (header->reader_closed)
+			return false;
+
+		if (!space) {
+			/* the process exited before it could open the ring */
+			if (!header->reader_attached &&
+			    ++waits > ATTACH_TIMEOUT_WAITS)
+				return false;
+
+			/* or it exited without getting to close it */
+			if (shm->alive && !shm->alive(shm->alive_param))
+				return false;
+
+			exchange_flag(&header->writer_waiting, 1);
+			if (!writable(header) && !header->reader_closed)
+				wait_event(space_event(shm));
+			exchange_flag(&header->writer_waiting, 0);
+			continue;
+		}
+
+		if (space > size)
+			space = size;
+
+		pos = load_pos(&header->write_pos);
+		copy_in(shm, pos, data, (size_t)space);
+		store_pos(&header->write_pos, pos + space);
+		wake(&header->reader_waiting, data_event(shm));
+
+		data += space;
+		size -= (size_t)space;
+	}
+
+	return true;
+}
+
+void ffm_shm_close(struct ffm_shm *shm)
+{
+	exchange_flag(&shm->header->writer_closed, 1);
+	wake(&shm->header->reader_waiting, data_event(shm));
+}
+
+static inline bool writer_gone(struct ffm_shm *shm)
+{
+	if (shm->header->writer_closed)
+		return true;
+#ifndef _WIN32
+	/* reparented, obs went away without closing the ring */
+	if (getppid() == 1)
+		return true;
+#endif
+	return false;
+}
+
+size_t ffm_shm_read(struct ffm_shm *shm, void *vdata, size_t size)
+{
+	struct ffm_shm_header *header = shm->header;
+	uint8_t *data = vdata;
+	size_t  total = size;
+
+	while (size > 0) {
+		uint64_t avail = readable(header);
+		uint64_t pos;
+
+		if (!avail) {
+			/* anything written before closing is still read */
+			if (writer_gone(shm) && !readable(header))
+				return 0;
+
+			exchange_flag(&header->reader_waiting, 1);
+			if (!readable(header) && !header->writer_closed)
+				wait_event(data_event(shm));
+			exchange_flag(&header->reader_waiting, 0);
+			continue;
+		}
+
+		if (avail > size)
+			avail = size;
+
+		pos = load_pos(&header->read_pos);
+		copy_out(shm, pos, data, (size_t)avail);
+		store_pos(&header->read_pos, pos + avail);
+		wake(&header->writer_waiting, space_event(shm));
+
+		data += avail;
+		size -= (size_t)avail;
+	}
+
+	return total;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2015 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Shared memory byte ring between obs-ffmpeg and the ffmpeg-mux process.
+ * It carries exactly the same stream of ffm_packet_info headers and packet
+ * data as the stdin pipe, but lets the writer queue up to the size of the
+ * ring without waiting on the child.  This file is built into both the
+ * plugin and ffmpeg-mux, so it must not depend on libobs.
+ */
+
+#define FFM_SHM_ARG "--shm"
+
+struct ffm_shm;
+
+typedef bool (*ffm_shm_alive_t)(void *param);
+
+/* writer side.  writes wait for space in short slices, and fail once the
+ * reader has closed the ring or the alive callback says it has gone away
+ * without closing it (e.g. ffmpeg-mux crashed) */
+struct ffm_shm *ffm_shm_create(size_t size);
+const char *ffm_shm_name(const struct ffm_shm *shm);
+void ffm_shm_set_alive_callback(struct ffm_shm *shm, ffm_shm_alive_t alive,
+		void *param);
+bool ffm_shm_write(struct ffm_shm *shm, const void *data, size_t size);
+void ffm_shm_close(struct ffm_shm *shm);
+
+/* reader side, reads return 0 once the writer is closed and all data has
+ * been read, the same way fread does at the end of a pipe */
+struct ffm_shm *ffm_shm_open(const char *name);
+size_t ffm_shm_read(struct ffm_shm *shm, void *data, size_t size);
+
+void ffm_shm_destroy(struct ffm_shm *shm);
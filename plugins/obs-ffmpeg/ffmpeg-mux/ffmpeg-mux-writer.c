@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2015 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#define inline __inline
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#else
+#include <fcntl.h>
+#endif
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ffmpeg-mux-writer.h"
+
+#define WRITE_CHUNK_SIZE (1024 * 1024)
+
+struct ffm_writer {
+	FILE            *file;
+	pthread_t       thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t  data_cond;
+	pthread_cond_t  space_cond;
+
+	/* ring buffer */
+	uint8_t         *buf;
+	size_t          capacity;
+	size_t          start;
+	size_t          size;
+
+	uint8_t         *chunk;
+	int64_t         pos;
+	bool            writing;
+	bool            stop;
+	bool            failed;
+	bool            above_watermark;
+};
+
+static void preallocate_file(FILE *file, uint64_t size)
+{
+#ifdef _WIN32
+	FILE_ALLOCATION_INFO info;
+	HANDLE handle = (HANDLE)_get_osfhandle(_fileno(file));
+
+	info.AllocationSize.QuadPart = (LONGLONG)size;
+	SetFileInformationByHandle(handle, FileAllocationInfo, &info,
+			sizeof(info));
+#elif defined(__APPLE__)
+	fstore_t store = {
+		.fst_flags   = F_ALLOCATEALL,
+		.fst_posmode = F_PEOFPOSMODE,
+		.fst_length  = (off_t)size
+	};
+
+	fcntl(fileno(file), F_PREALLOCATE, &store);
+#elif defined(__linux__)
+	fallocate(fileno(file), FALLOC_FL_KEEP_SIZE, 0, (off_t)size);
+#else
+	(void)file;
+	(void)size;
+#endif
+}
+
+static inline void check_watermark(struct ffm_writer *w)
+{
+	size_t high = w->capacity / 4 * 3;
+
+	if (!w->above_watermark && w->size >= high) {
+		w->above_watermark = true;
+		printf("Write buffer is filling up, disk is not keeping up\n");
+		fflush(stdout);
+
+	} else if (w->above_watermark && w->size < high / 2) {
+		w->above_watermark = false;
+	}
+}
+
+static void *writer_thread(void *data)
+{
+	struct ffm_writer *w = data;
+
+	pthread_mutex_lock(&w->mutex);
+
+	for (;;) {
+		size_t size = w->size;
+		size_t first;
+
+		if (!size) {
+			w->writing = false;
+			pthread_cond_broadcast(&w->space_cond);
+
+			if (w->stop)
+				break;
+
+			pthread_cond_wait(&w->data_cond, &w->mutex);
+			continue;
+		}
+
+		if (size > WRITE_CHUNK_SIZE)
+			size = WRITE_CHUNK_SIZE;
+
+		first = w->capacity - w->start;
+		if (first > size)
+			first = size;
+
+		memcpy(w->chunk, w->buf + w->start, first);
+		memcpy(w->chunk + first, w->buf, size - first);
+		w->start = (w->start + size) % w->capacity;
+		w->size -= size;
+		w->writing = true;
+		check_watermark(w);
+
+		pthread_cond_broadcast(&w->space_cond);
+		pthread_mutex_unlock(&w->mutex);
+
+		bool success = fwrite(w->chunk, 1, size, w->file) == size;
+
+		pthread_mutex_lock(&w->mutex);
+		if (!success)
+			w->failed = true;
+	}
+
+	pthread_mutex_unlock(&w->mutex);
+	return NULL;
+}
+
+size_t ffm_writer_write(struct ffm_writer *w, const void *data, size_t size)
+{
+	const uint8_t *bytes = data;
+	size_t total = size;
+
+	pthread_mutex_lock(&w->mutex);
+
+	while (size && !w->failed) {
+		size_t space = w->capacity - w->size;
+		size_t end, first;
+
+		if (!space) {
+			pthread_cond_wait(&w->space_cond, &w->mutex);
+			continue;
+		}
+
+		if (space > size)
+			space = size;
+
+		end   = (w->start + w->size) % w->capacity;
+		first = w->capacity - end;
+		if (first > space)
+			first = space;
+
+		memcpy(w->buf + end, bytes, first);
+		memcpy(w->buf, bytes + first, space - first);
+		w->size += space;
+		check_watermark(w);
+
+		pthread_cond_signal(&w->data_cond);
+
+		w->pos += space;
+		bytes  += space;
+		size   -= space;
+	}
+
+	if (w->failed)
+		total -= size;
+
+	pthread_mutex_unlock(&w->mutex);
+	return total;
+}
+
+/* waits until everything buffered has been written out */
+static void flush(struct ffm_writer *w)
+{
+	pthread_mutex_lock(&w->mutex);
+	while (w->size || w->writing)
+		pthread_cond_wait(&w->space_cond, &w->mutex);
+	pthread_mutex_unlock(&w->mutex);
+}
+
+int64_t ffm_writer_seek(struct ffm_writer *w, int64_t offset, int origin)
+{
+	flush(w);
+
+	/* the writer thread does not touch the file again until more data
+	 * is pushed, so it can be used directly from here */
+	if (fseeko(w->file, offset, origin) != 0)
+		return -1;
+
+	w->pos = ftello(w->file);
+	return w->pos;
+}
+
+static void writer_free(struct ffm_writer *w)
+{
+	pthread_mutex_destroy(&w->mutex);
+	pthread_cond_destroy(&w->data_cond);
+	pthread_cond_destroy(&w->space_cond);
+	free(w->buf);
+	free(w->chunk);
+	free(w);
+}
+
+struct ffm_writer *ffm_writer_open(const char *path, size_t buffer_size,
+		uint64_t prealloc_size)
+{
+	struct ffm_writer *w;
+	FILE *file;
+
+	file = fopen(path, "wb");
+	if (!file)
+		return NULL;
+
+	if (prealloc_size)
+		preallocate_file(file, prealloc_size);
+
+	if (buffer_size < WRITE_CHUNK_SIZE)
+		buffer_size = WRITE_CHUNK_SIZE;
+
+	w = calloc(1, sizeof(*w));
+	w->file     = file;
+	w->capacity = buffer_size;
+	w->buf      = malloc(buffer_size);
+	w->chunk    = malloc(WRITE_CHUNK_SIZE);
+
+	pthread_mutex_init(&w->mutex, NULL);
+	pthread_cond_init(&w->data_cond, NULL);
+	pthread_cond_init(&w->space_cond, NULL);
+
+	if (!w->buf || !w->chunk ||
+	    pthread_create(&w->thread, NULL, writer_thread, w) != 0) {
+		fclose(file);
+		writer_free(w);
+		return NULL;
+	}
+
+	return w;
+}
+
+bool ffm_writer_close(struct ffm_writer *w)
+{
+	bool success;
+
+	if (!w)
+		return false;
+
+	pthread_mutex_lock(&w->mutex);
+	w->stop = true;
+	pthread_cond_signal(&w->data_cond);
+	pthread_mutex_unlock(&w->mutex);
+
+	pthread_join(w->thread, NULL);
+
+	success = !w->failed;
+	if (fclose(w->file) != 0)
+		success = false;
+
+	writer_free(w);
+	return success;
+}
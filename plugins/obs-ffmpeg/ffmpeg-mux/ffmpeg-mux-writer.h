@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2015 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Buffered file writer for ffmpeg-mux.  Muxed data is copied into a RAM
+ * buffer and written to disk in large sequential chunks from a separate
+ * thread, so a slow disk only stalls the muxer once the buffer is full.
+ * Seeking waits for the buffer to be written out first.  Prints a warning
+ * to stdout whenever the buffer fills past its high watermark.
+ */
+
+struct ffm_writer;
+
+struct ffm_writer *ffm_writer_open(const char *path, size_t buffer_size,
+		uint64_t prealloc_size);
+bool ffm_writer_close(struct ffm_writer *writer);
+
+size_t ffm_writer_write(struct ffm_writer *writer, const void *data,
+		size_t size);
+int64_t ffm_writer_seek(struct ffm_writer *writer, int64_t offset,
+		int origin);
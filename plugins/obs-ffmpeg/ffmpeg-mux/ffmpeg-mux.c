@@ -24,7 +24,10 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "ffmpeg-mux.h"
+#include "ffmpeg-mux-shm.h"
+#include "ffmpeg-mux-writer.h"
 
 #include <libavformat/avformat.h>
 
@@ -73,6 +76,11 @@ struct main_params {
 	int fps_num;
 	int fps_den;
 	char *acodec;
+	int write_buffer_mb;
+	int prealloc_mb;
+	int fragment_ms;
+	int split_sec;
+	int split_mb;
 };
 
 struct audio_params {
@@ -96,7 +104,18 @@ struct ffmpeg_mux {
 	struct header          video_header;
 	struct header          *audio_header;
 	int                    num_audio_streams;
+	struct ffm_writer      *writer;
 	bool                   initialized;
+
+	/* file splitting, the next segment's file is opened ahead of time */
+	char                   *base_file;
+	char                   *cur_file;
+	int                    segment;
+	char                   *next_file;
+	AVIOContext            *next_pb;
+	struct ffm_writer      *next_writer;
+	int64_t                video_offset;
+	int64_t                segment_bytes;
 	char error[4096];
 };
 
@@ -105,11 +124,32 @@ static void header_free(struct header *header)
 	free(header->data);
 }
 
+static void close_pb(AVIOContext **pb, struct ffm_writer **writer,
+		const char *file)
+{
+	if (*writer) {
+		if (*pb) {
+			avio_flush(*pb);
+			av_freep(&(*pb)->buffer);
+			av_freep(pb);
+		}
+
+		if (!ffm_writer_close(*writer))
+			printf("Failed to write '%s'\n", file);
+		*writer = NULL;
+
+	} else if (*pb) {
+		avio_close(*pb);
+		*pb = NULL;
+	}
+}
+
 static void free_avformat(struct ffmpeg_mux *ffm)
 {
 	if (ffm->output) {
 		if ((ffm->output->oformat->flags & AVFMT_NOFILE) == 0)
-			avio_close(ffm->output->pb);
+			close_pb(&ffm->output->pb, &ffm->writer,
+					ffm->params.file);
 
 		avformat_free_context(ffm->output);
 		ffm->output = NULL;
@@ -132,6 +172,15 @@ static void ffmpeg_mux_free(struct ffmpeg_mux *ffm)
 
 	free_avformat(ffm);
 
+	/* the next segment was never written to, don't leave it behind */
+	if (ffm->next_file) {
+		close_pb(&ffm->next_pb, &ffm->next_writer, ffm->next_file);
+		remove(ffm->next_file);
+		free(ffm->next_file);
+	}
+
+	free(ffm->cur_file);
+
 	header_free(&ffm->video_header);
 
 	if (ffm->audio_header) {
@@ -384,11 +433,17 @@ static void ffmpeg_mux_header(struct ffmpeg_mux *ffm, uint8_t *data,
 	}
 }
 
+/* set when obs passes packets through shared memory instead of stdin */
+static struct ffm_shm *shm = NULL;
+
 static size_t safe_read(void *vdata, size_t size)
 {
 	uint8_t *data = vdata;
 	size_t  total = size;
 
+	if (shm)
+		return ffm_shm_read(shm, vdata, size);
+
 	while (size > 0) {
 		size_t in_size = fread(data, 1, size, stdin);
 		if (in_size == 0)
@@ -438,22 +493,114 @@ static inline bool ffmpeg_mux_get_extra_data(struct ffmpeg_mux *ffm)
 	return true;
 }
 
+#define AVIO_BUFFER_SIZE 65536
+
+static int write_callback(void *opaque, uint8_t *buf, int buf_size)
+{
+	struct ffm_writer *writer = opaque;
+	size_t size = ffm_writer_write(writer, buf, (size_t)buf_size);
+
+	return size == (size_t)buf_size ? buf_size : AVERROR(EIO);
+}
+
+static int64_t seek_callback(void *opaque, int64_t offset, int whence)
+{
+	struct ffm_writer *writer = opaque;
+
+	/* the total size isn't known while writing */
+	if (whence & AVSEEK_SIZE)
+		return -1;
+
+	return ffm_writer_seek(writer, offset, whence & ~AVSEEK_FORCE);
+}
+
+/* writes through a separate thread with a large buffer instead of letting
+ * avio write each packet synchronously */
+static int open_buffered_file(struct ffmpeg_mux *ffm, const char *file,
+		AVIOContext **pb, struct ffm_writer **writer)
+{
+	size_t   buffer_size   = (size_t)ffm->params.write_buffer_mb << 20;
+	uint64_t prealloc_size = (uint64_t)ffm->params.prealloc_mb << 20;
+	uint8_t  *avio_buf;
+
+	*writer = ffm_writer_open(file, buffer_size, prealloc_size);
+	if (!*writer)
+		return AVERROR(EIO);
+
+	avio_buf = av_malloc(AVIO_BUFFER_SIZE);
+	*pb = avio_alloc_context(avio_buf, AVIO_BUFFER_SIZE, 1,
+			*writer, NULL, write_callback, seek_callback);
+	if (!*pb) {
+		av_free(avio_buf);
+		ffm_writer_close(*writer);
+		*writer = NULL;
+		return AVERROR(ENOMEM);
+	}
+
+	return 0;
+}
+
+static int open_file(struct ffmpeg_mux *ffm, const char *file,
+		AVIOContext **pb, struct ffm_writer **writer)
+{
+	if (ffm->params.write_buffer_mb > 0)
+		return open_buffered_file(ffm, file, pb, writer);
+
+	return avio_open(pb, file, AVIO_FLAG_WRITE);
+}
+
+static inline bool is_mp4_format(AVOutputFormat *format)
+{
+	return strcmp(format->name, "mp4") == 0 ||
+	       strcmp(format->name, "mov") == 0;
+}
+
+/* fragmented mp4 writes an empty moov up front and then a self-contained
+ * fragment every fragment_ms, so the file stays playable if recording is
+ * interrupted and never needs to be remuxed */
+static void set_fragment_options(struct ffmpeg_mux *ffm, AVDictionary **opts)
+{
+	char duration[32];
+
+	if (ffm->params.fragment_ms <= 0 ||
+	    !is_mp4_format(ffm->output->oformat))
+		return;
+
+	snprintf(duration, sizeof(duration), "%lld",
+			(long long)ffm->params.fragment_ms * 1000);
+
+	av_dict_set(opts, "movflags",
+			"frag_keyframe+empty_moov+default_base_moof", 0);
+	av_dict_set(opts, "frag_duration", duration, 0);
+}
+
 static inline int open_output_file(struct ffmpeg_mux *ffm)
 {
 	AVOutputFormat *format = ffm->output->oformat;
+	AVDictionary *options = NULL;
 	int ret;
 
-	if ((format->flags & AVFMT_NOFILE) == 0) {
-		ret = avio_open(&ffm->output->pb, ffm->params.file,
-				AVIO_FLAG_WRITE);
+	set_fragment_options(ffm, &options);
+
+	if ((format->flags & AVFMT_NOFILE) == 0 && ffm->next_pb) {
+		ffm->output->pb = ffm->next_pb;
+		ffm->writer     = ffm->next_writer;
+		ffm->next_pb     = NULL;
+		ffm->next_writer = NULL;
+
+	} else if ((format->flags & AVFMT_NOFILE) == 0) {
+		ret = open_file(ffm, ffm->params.file, &ffm->output->pb,
+				&ffm->writer);
 		if (ret < 0) {
 			printf("Couldn't open '%s', %s",
 					ffm->params.file, av_err2str(ret));
+			av_dict_free(&options);
 			return FFM_ERROR;
 		}
 	}
 
-	ret = avformat_write_header(ffm->output, NULL);
+	ret = avformat_write_header(ffm->output, &options);
+	av_dict_free(&options);
 	if (ret < 0) {
 		printf("Error opening '%s': %s",
 				ffm->params.file, av_err2str(ret));
@@ -508,6 +655,32 @@ static int ffmpeg_mux_init_internal(struct ffmpeg_mux *ffm, int argc,
 	if (!init_params(&argc, &argv, &ffm->params, &ffm->audio))
 		return FFM_ERROR;
 
+	for (; argc >= 2; argc -= 2, argv += 2) {
+		if (strcmp(argv[0], FFM_WRITE_BUFFER_ARG) == 0) {
+			ffm->params.write_buffer_mb = atoi(argv[1]);
+
+		} else if (strcmp(argv[0], FFM_PREALLOC_ARG) == 0) {
+			ffm->params.prealloc_mb = atoi(argv[1]);
+
+		} else if (strcmp(argv[0], FFM_FRAGMENT_ARG) == 0) {
+			ffm->params.fragment_ms = atoi(argv[1]);
+
+		} else if (strcmp(argv[0], FFM_SPLIT_TIME_ARG) == 0) {
+			ffm->params.split_sec = atoi(argv[1]);
+
+		} else if (strcmp(argv[0], FFM_SPLIT_SIZE_ARG) == 0) {
+			ffm->params.split_mb = atoi(argv[1]);
+
+		} else if (strcmp(argv[0], FFM_SHM_ARG) == 0 && !shm) {
+			shm = ffm_shm_open(argv[1]);
+			if (!shm) {
+				printf("Couldn't open shared memory '%s'\n",
+						argv[1]);
+				return FFM_ERROR;
+			}
+		}
+	}
+
 	if (ffm->params.tracks) {
 		ffm->audio_header =
 			calloc(1, sizeof(struct header) * ffm->params.tracks);
@@ -532,9 +705,126 @@ static int ffmpeg_mux_init(struct ffmpeg_mux *ffm, int argc, char *argv[])
 	}
 
 	ffm->initialized = true;
+	ffm->base_file = ffm->params.file;
 	return ret;
 }
 
+/* ------------------------------------------------------------------------- */
+/* file splitting */
+
+static inline bool splitting(struct ffmpeg_mux *ffm)
+{
+	return ffm->video_stream &&
+		(ffm->params.split_sec > 0 || ffm->params.split_mb > 0) &&
+		(ffm->output->oformat->flags & AVFMT_NOFILE) == 0;
+}
+
+/* "name.ext" becomes "name_002.ext" for the second segment and so on */
+static char *segment_file_name(const char *base, int segment)
+{
+	const char *ext = strrchr(base, '.');
+	const char *slash = strrchr(base, '/');
+	const char *bslash = strrchr(base, '\\');
+	size_t size;
+	char *file;
+
+	if (!ext || (slash && slash > ext) || (bslash && bslash > ext))
+		ext = base + strlen(base);
+
+	size = strlen(base) + 16;
+	file = malloc(size);
+	snprintf(file, size, "%.*s_%03d%s", (int)(ext - base), base,
+			segment + 1, ext);
+	return file;
+}
+
+/* creating a file can take a while, especially when it's preallocated, so
+ * the next one is created right after a segment starts rather than when the
+ * split actually happens */
+static void open_next_segment(struct ffmpeg_mux *ffm)
+{
+	int ret;
+
+	ffm->next_file = segment_file_name(ffm->base_file, ffm->segment + 1);
+
+	ret = open_file(ffm, ffm->next_file, &ffm->next_pb, &ffm->next_writer);
+	if (ret < 0) {
+		printf("Couldn't open '%s' ahead of time, %s\n",
+				ffm->next_file, av_err2str(ret));
+		free(ffm->next_file);
+		ffm->next_file = NULL;
+	}
+}
+
+static inline bool split_due(struct ffmpeg_mux *ffm,
+		struct ffm_packet_info *info)
+{
+	int64_t duration = info->dts - ffm->video_offset;
+
+	if (info->type != FFM_PACKET_VIDEO || !info->keyframe)
+		return false;
+
+	if (ffm->params.split_mb > 0 &&
+	    ffm->segment_bytes >= ((int64_t)ffm->params.split_mb << 20))
+		return true;
+
+	/* video timestamps are in 1/fps_num second units */
+	return ffm->params.split_sec > 0 && duration >=
+		(int64_t)ffm->params.split_sec * ffm->params.fps_num;
+}
+
+/* finishes the current file and continues in the next one at the given
+ * keyframe.  the headers from obs are reused, so the encoders never notice */
+static bool split_file(struct ffmpeg_mux *ffm, struct ffm_packet_info *info)
+{
+	char *file = ffm->next_file;
+	int ret;
+
+	if (!file)
+		file = segment_file_name(ffm->base_file, ffm->segment + 1);
+
+	av_write_trailer(ffm->output);
+	free_avformat(ffm);
+
+	free(ffm->cur_file);
+	ffm->cur_file    = file;
+	ffm->next_file   = NULL;
+	ffm->params.file = file;
+	ffm->segment++;
+
+	ret = ffmpeg_mux_init_context(ffm);
+	if (ret != FFM_SUCCESS) {
+		ffm->initialized = false;
+		return false;
+	}
+
+	ffm->video_offset  = info->dts;
+	ffm->segment_bytes = 0;
+
+	printf("Started writing '%s'\n", file);
+	open_next_segment(ffm);
+	return true;
+}
+
+/* every segment starts at zero.  audio uses the same point in time as the
+ * keyframe the video segment started at, so the tracks stay in sync */
+static inline void offset_packet(struct ffmpeg_mux *ffm,
+		struct ffm_packet_info *info)
+{
+	int64_t offset = ffm->video_offset;
+
+	if (!offset)
+		return;
+
+	if (info->type == FFM_PACKET_AUDIO) {
+		int sample_rate = ffm->audio[info->index].sample_rate;
+		offset = av_rescale(offset, sample_rate, ffm->params.fps_num);
+	}
+
+	info->pts -= offset;
+	info->dts -= offset;
+}
+
 static inline int get_index(struct ffmpeg_mux *ffm,
 		struct ffm_packet_info *info)
 {
@@ -576,6 +866,17 @@ static inline bool ffmpeg_mux_packet(struct ffmpeg_mux *ffm, uint8_t *buf,
 		return true;
 	}
 
+	if (splitting(ffm)) {
+		if (split_due(ffm, info)) {
+			if (!split_file(ffm, info))
+				return false;
+			idx = get_index(ffm, info);
+		}
+
+		offset_packet(ffm, info);
+		ffm->segment_bytes += info->size;
+	}
+
         av_init_packet(&packet);
 
 	packet.data = buf;
@@ -608,14 +909,20 @@ int main(int argc, char *argv[])
 	ret = ffmpeg_mux_init(&ffm, argc, argv);
 	if (ret != FFM_SUCCESS) {
 		puts("Couldn't initialize muxer");
+		ffm_shm_destroy(shm);
 		return ret;
 	}
 
+	if (splitting(&ffm))
+		open_next_segment(&ffm);
+
 	while (!fail && safe_read(&info, sizeof(info)) == sizeof(info)) {
 		resize_buf_resize(&rb, info.size);
 
 		if (safe_read(rb.buf, info.size) == info.size) {
-			ffmpeg_mux_packet(&ffm, rb.buf, &info);
+			if (!ffmpeg_mux_packet(&ffm, rb.buf, &info) &&
+			    !ffm.initialized)
+				fail = true;
 		} else {
 			fail = true;
 		}
@@ -623,5 +930,6 @@ int main(int argc, char *argv[])
 
 	ffmpeg_mux_free(&ffm);
 	resize_buf_free(&rb);
+	ffm_shm_destroy(shm);
 	return 0;
 }
@@ -23,6 +23,13 @@ enum ffm_packet_type {
 	FFM_PACKET_AUDIO
 };
 
+/* optional trailing arguments, each followed by a value */
+#define FFM_WRITE_BUFFER_ARG "--write-buffer"
+#define FFM_PREALLOC_ARG     "--prealloc"
+#define FFM_FRAGMENT_ARG     "--fragment-ms"
+#define FFM_SPLIT_TIME_ARG   "--split-sec"
+#define FFM_SPLIT_SIZE_ARG   "--split-mb"
+
 #define FFM_SUCCESS      0
 #define FFM_ERROR       -1
 #define FFM_UNSUPPORTED -2
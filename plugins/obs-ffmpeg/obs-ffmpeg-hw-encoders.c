@@ -0,0 +1,846 @@
+/******************************************************************************
+    Copyright (C) 2016 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <util/base.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <obs-module.h>
+#include <obs-avc.h>
+
+#include <libavutil/opt.h>
+#include <libavformat/avformat.h>
+
+#include "obs-ffmpeg-formats.h"
+#include "obs-ffmpeg-compat.h"
+
+/* the hardware frame API was added in FFmpeg 3.1 */
+#if defined(__linux__) && \
+    LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(55, 27, 100)
+#include <libavutil/hwcontext.h>
+#define ENABLE_VAAPI 1
+#endif
+
+#define do_log(level, format, ...) \
+	blog(level, "[FFmpeg %s encoder: '%s'] " format, \
+			enc->type->api_name, \
+			obs_encoder_get_name(enc->encoder), ##__VA_ARGS__)
+
+#define warn(format, ...)  do_log(LOG_WARNING, format, ##__VA_ARGS__)
+#define info(format, ...)  do_log(LOG_INFO,    format, ##__VA_ARGS__)
+#define debug(format, ...) do_log(LOG_DEBUG,   format, ##__VA_ARGS__)
+
+enum hw_api {
+	HW_API_NVENC,
+	HW_API_QSV,
+	HW_API_VAAPI
+};
+
+struct hw_encoder_type {
+	const char        *id;
+	const char        *codec;
+	const char        *text;
+	const char        *api_name;
+	enum hw_api       api;
+	enum AVCodecID    codec_id;
+
+	/* the same encoder has been named differently between versions */
+	const char        *ffmpeg_names[3];
+};
+
+struct hw_encoder {
+	obs_encoder_t                *encoder;
+	const struct hw_encoder_type *type;
+
+	AVCodec                      *codec;
+	AVCodecContext               *context;
+	AVFrame                      *vframe;
+
+#ifdef ENABLE_VAAPI
+	AVBufferRef                  *hw_device;
+	AVBufferRef                  *hw_frames;
+	AVFrame                      *hw_frame;
+#endif
+
+	DARRAY(uint8_t)              packet_buffer;
+	DARRAY(uint8_t)              header;
+	DARRAY(uint8_t)              sei;
+
+	int                          height;
+};
+
+static const struct hw_encoder_type nvenc_h264_type = {
+	.id           = "ffmpeg_nvenc",
+	.codec        = "h264",
+	.text         = "NVENC.H264",
+	.api_name     = "NVENC",
+	.api          = HW_API_NVENC,
+	.codec_id     = AV_CODEC_ID_H264,
+	.ffmpeg_names = {"h264_nvenc", "nvenc_h264", "nvenc"}
+};
+
+static const struct hw_encoder_type nvenc_hevc_type = {
+	.id           = "ffmpeg_nvenc_hevc",
+	.codec        = "hevc",
+	.text         = "NVENC.HEVC",
+	.api_name     = "NVENC",
+	.api          = HW_API_NVENC,
+	.codec_id     = AV_CODEC_ID_HEVC,
+	.ffmpeg_names = {"hevc_nvenc", "nvenc_hevc", NULL}
+};
+
+static const struct hw_encoder_type qsv_h264_type = {
+	.id           = "ffmpeg_qsv",
+	.codec        = "h264",
+	.text         = "QSV.H264",
+	.api_name     = "QSV",
+	.api          = HW_API_QSV,
+	.codec_id     = AV_CODEC_ID_H264,
+	.ffmpeg_names = {"h264_qsv", NULL, NULL}
+};
+
+static const struct hw_encoder_type qsv_hevc_type = {
+	.id           = "ffmpeg_qsv_hevc",
+	.codec        = "hevc",
+	.text         = "QSV.HEVC",
+	.api_name     = "QSV",
+	.api          = HW_API_QSV,
+	.codec_id     = AV_CODEC_ID_HEVC,
+	.ffmpeg_names = {"hevc_qsv", NULL, NULL}
+};
+
+#ifdef ENABLE_VAAPI
+static const struct hw_encoder_type vaapi_h264_type = {
+	.id           = "ffmpeg_vaapi",
+	.codec        = "h264",
+	.text         = "VAAPI.H264",
+	.api_name     = "VAAPI",
+	.api          = HW_API_VAAPI,
+	.codec_id     = AV_CODEC_ID_H264,
+	.ffmpeg_names = {"h264_vaapi", NULL, NULL}
+};
+
+static const struct hw_encoder_type vaapi_hevc_type = {
+	.id           = "ffmpeg_vaapi_hevc",
+	.codec        = "hevc",
+	.text         = "VAAPI.HEVC",
+	.api_name     = "VAAPI",
+	.api          = HW_API_VAAPI,
+	.codec_id     = AV_CODEC_ID_HEVC,
+	.ffmpeg_names = {"hevc_vaapi", NULL, NULL}
+};
+#endif
+
+static AVCodec *find_hw_codec(const struct hw_encoder_type *type)
+{
+	for (size_t i = 0; i < 3 && type->ffmpeg_names[i]; i++) {
+		AVCodec *codec =
+			avcodec_find_encoder_by_name(type->ffmpeg_names[i]);
+		if (codec)
+			return codec;
+	}
+
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void hw_destroy(void *data)
+{
+	struct hw_encoder *enc = data;
+
+	if (enc->context)
+		avcodec_close(enc->context);
+	av_freep(&enc->context);
+	if (enc->vframe)
+		av_frame_free(&enc->vframe);
+
+#ifdef ENABLE_VAAPI
+	if (enc->hw_frame)
+		av_frame_free(&enc->hw_frame);
+	av_buffer_unref(&enc->hw_frames);
+	av_buffer_unref(&enc->hw_device);
+#endif
+
+	da_free(enc->packet_buffer);
+	da_free(enc->header);
+	da_free(enc->sei);
+	bfree(enc);
+}
+
+/* SEI is kept separate from the SPS/PPS so outputs can send it in-band with
+ * the first keyframe, the same way obs-x264 provides it */
+static inline bool is_sei_nal(enum AVCodecID codec_id, const uint8_t *nal)
+{
+	if (codec_id == AV_CODEC_ID_HEVC) {
+		int type = (nal[0] >> 1) & 0x3F;
+		return type == 39 || type == 40;
+	}
+
+	return (nal[0] & 0x1F) == OBS_NAL_SEI;
+}
+
+static void load_headers(struct hw_encoder *enc)
+{
+	const uint8_t *data = enc->context->extradata;
+	const uint8_t *end  = data + enc->context->extradata_size;
+	const uint8_t *nal_start, *nal_end, *nal_header;
+
+	if (!data || !enc->context->extradata_size)
+		return;
+
+	nal_start = obs_avc_find_startcode(data, end);
+	while (nal_start < end) {
+		nal_header = nal_start;
+		while (nal_header < end && !*(nal_header++));
+
+		if (nal_header == end)
+			break;
+
+		nal_end = obs_avc_find_startcode(nal_header, end);
+
+		if (is_sei_nal(enc->type->codec_id, nal_header))
+			da_push_back_array(enc->sei, nal_start,
+					nal_end - nal_start);
+		else
+			da_push_back_array(enc->header, nal_start,
+					nal_end - nal_start);
+
+		nal_start = nal_end;
+	}
+
+	/* not annex B, so pass it through as it is */
+	if (!enc->header.num && !enc->sei.num)
+		da_push_back_array(enc->header, data,
+				enc->context->extradata_size);
+}
+
+/* H.264 carries the reference priority directly in nal_ref_idc.  HEVC has
+ * no such field, but the even-numbered VCL types below 16 are the
+ * sub-layer non-reference types, which nothing else depends on */
+static int get_packet_priority(enum AVCodecID codec_id, const uint8_t *data,
+		size_t size)
+{
+	const uint8_t *nal_start, *nal_end;
+	const uint8_t *end = data + size;
+	int priority = OBS_NAL_PRIORITY_DISPOSABLE;
+
+	nal_start = obs_avc_find_startcode(data, end);
+	while (true) {
+		while (nal_start < end && !*(nal_start++));
+
+		if (nal_start == end)
+			break;
+
+		if (codec_id == AV_CODEC_ID_HEVC) {
+			int type = (nal_start[0] >> 1) & 0x3F;
+
+			if (type >= 16 && type <= 21)
+				return OBS_NAL_PRIORITY_HIGHEST;
+			if (type < 16 && (type & 1))
+				priority = OBS_NAL_PRIORITY_HIGH;
+
+		} else {
+			int type = nal_start[0] & 0x1F;
+			int ref_idc = (nal_start[0] >> 5) & 0x3;
+
+			if (type == OBS_NAL_SLICE_IDR)
+				return OBS_NAL_PRIORITY_HIGHEST;
+			if (type == OBS_NAL_SLICE && ref_idc > priority)
+				priority = ref_idc;
+		}
+
+		nal_end = obs_avc_find_startcode(nal_start, end);
+		nal_start = nal_end;
+	}
+
+	return priority;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline void set_opt(struct hw_encoder *enc, const char *name,
+		const char *val)
+{
+	int ret = av_opt_set(enc->context->priv_data, name, val, 0);
+	if (ret < 0)
+		warn("Failed to set %s to '%s': %s", name, val,
+				av_err2str(ret));
+}
+
+static inline void set_opt_int(struct hw_encoder *enc, const char *name,
+		int64_t val)
+{
+	int ret = av_opt_set_int(enc->context->priv_data, name, val, 0);
+	if (ret < 0)
+		warn("Failed to set %s to %d: %s", name, (int)val,
+				av_err2str(ret));
+}
+
+static void set_custom_opts(struct hw_encoder *enc, const char *opts)
+{
+	char **paramlist = strlist_split(opts, ' ', false);
+	char **params = paramlist;
+
+	while (*params) {
+		const char *param  = *(params++);
+		const char *assign = strchr(param, '=');
+
+		if (assign && assign != param && *(assign + 1)) {
+			char *name = bstrdup_n(param, assign - param);
+			set_opt(enc, name, assign + 1);
+			bfree(name);
+		} else {
+			warn("Invalid option: %s", param);
+		}
+	}
+
+	strlist_free(paramlist);
+}
+
+static int get_profile(enum AVCodecID codec_id, const char *profile)
+{
+	if (codec_id == AV_CODEC_ID_HEVC)
+		return astrcmpi(profile, "main10") == 0 ?
+			FF_PROFILE_HEVC_MAIN_10 : FF_PROFILE_HEVC_MAIN;
+
+	if (astrcmpi(profile, "baseline") == 0)
+		return FF_PROFILE_H264_CONSTRAINED_BASELINE;
+	if (astrcmpi(profile, "main") == 0)
+		return FF_PROFILE_H264_MAIN;
+	return FF_PROFILE_H264_HIGH;
+}
+
+static void set_rate_control(struct hw_encoder *enc, obs_data_t *settings)
+{
+	const char *rc  = obs_data_get_string(settings, "rate_control");
+	int bitrate     = (int)obs_data_get_int(settings, "bitrate");
+	int cqp         = (int)obs_data_get_int(settings, "cqp");
+	AVCodecContext *context = enc->context;
+
+	if (astrcmpi(rc, "CQP") == 0) {
+		if (enc->type->api == HW_API_QSV) {
+			context->flags         |= CODEC_FLAG_QSCALE;
+			context->global_quality = cqp * FF_QP2LAMBDA;
+		} else {
+			if (enc->type->api == HW_API_NVENC)
+				set_opt(enc, "rc", "constqp");
+			set_opt_int(enc, "qp", cqp);
+		}
+
+		info("rate control: CQP, qp: %d", cqp);
+		return;
+	}
+
+	context->bit_rate = bitrate * 1000;
+
+	if (astrcmpi(rc, "VBR") == 0) {
+		if (enc->type->api == HW_API_NVENC)
+			set_opt(enc, "rc", "vbr");
+
+	} else {
+		/* every API treats maxrate == bitrate as CBR */
+		context->rc_max_rate    = bitrate * 1000;
+		context->rc_buffer_size = bitrate * 1000;
+
+		if (enc->type->api == HW_API_NVENC)
+			set_opt(enc, "rc", "cbr");
+	}
+
+	info("rate control: %s, bitrate: %d", rc, bitrate);
+}
+
+#ifdef ENABLE_VAAPI
+static bool init_vaapi(struct hw_encoder *enc, obs_data_t *settings)
+{
+	const char *device = obs_data_get_string(settings, "vaapi_device");
+	AVHWFramesContext *frames;
+	int ret;
+
+	ret = av_hwdevice_ctx_create(&enc->hw_device, AV_HWDEVICE_TYPE_VAAPI,
+			device, NULL, 0);
+	if (ret < 0) {
+		warn("Failed to open VAAPI device '%s': %s", device,
+				av_err2str(ret));
+		return false;
+	}
+
+	enc->hw_frames = av_hwframe_ctx_alloc(enc->hw_device);
+	if (!enc->hw_frames) {
+		warn("Failed to create hardware frame context");
+		return false;
+	}
+
+	frames                    = (AVHWFramesContext*)enc->hw_frames->data;
+	frames->format            = AV_PIX_FMT_VAAPI;
+	frames->sw_format         = AV_PIX_FMT_NV12;
+	frames->width             = enc->context->width;
+	frames->height            = enc->context->height;
+	frames->initial_pool_size = 20;
+
+	ret = av_hwframe_ctx_init(enc->hw_frames);
+	if (ret < 0) {
+		warn("Failed to initialize hardware frame context: %s",
+				av_err2str(ret));
+		return false;
+	}
+
+	enc->hw_frame = av_frame_alloc();
+	if (!enc->hw_frame) {
+		warn("Failed to allocate hardware frame");
+		return false;
+	}
+
+	enc->context->pix_fmt       = AV_PIX_FMT_VAAPI;
+	enc->context->hw_frames_ctx = av_buffer_ref(enc->hw_frames);
+	info("device: %s", device);
+	return true;
+}
+#endif
+
+static bool init_codec(struct hw_encoder *enc, obs_data_t *settings)
+{
+	video_t *video = obs_encoder_video(enc->encoder);
+	const struct video_output_info *voi = video_output_get_info(video);
+	const char *preset  = obs_data_get_string(settings, "preset");
+	const char *profile = obs_data_get_string(settings, "profile");
+	const char *opts    = obs_data_get_string(settings, "ffmpeg_opts");
+	int keyint_sec      = (int)obs_data_get_int(settings, "keyint_sec");
+	int bf              = (int)obs_data_get_int(settings, "bf");
+	uint32_t fps_num, fps_den;
+	AVCodecContext *context;
+	int ret;
+
+	obs_encoder_get_frame_rate(enc->encoder, &fps_num, &fps_den);
+
+	enc->context = avcodec_alloc_context3(enc->codec);
+	if (!enc->context) {
+		warn("Failed to create codec context");
+		return false;
+	}
+
+	context               = enc->context;
+	context->width        = (int)obs_encoder_get_width(enc->encoder);
+	context->height       = (int)obs_encoder_get_height(enc->encoder);
+	context->time_base    = (AVRational){fps_den, fps_num};
+	context->pix_fmt      = AV_PIX_FMT_NV12;
+	context->max_b_frames = bf;
+	context->gop_size     = keyint_sec ?
+		keyint_sec * fps_num / fps_den : 250;
+	context->colorspace   = voi->colorspace == VIDEO_CS_709 ?
+		AVCOL_SPC_BT709 : AVCOL_SPC_BT470BG;
+	context->color_range  = voi->range == VIDEO_RANGE_FULL ?
+		AVCOL_RANGE_JPEG : AVCOL_RANGE_MPEG;
+	context->flags       |= CODEC_FLAG_GLOBAL_HEADER;
+
+	enc->height = context->height;
+
+	set_rate_control(enc, settings);
+
+	if (preset && *preset && enc->type->api != HW_API_VAAPI)
+		set_opt(enc, "preset", preset);
+
+	if (profile && *profile) {
+		if (enc->type->api == HW_API_VAAPI)
+			context->profile = get_profile(enc->type->codec_id,
+					profile);
+		else
+			set_opt(enc, "profile", profile);
+	}
+
+	if (opts && *opts)
+		set_custom_opts(enc, opts);
+
+#ifdef ENABLE_VAAPI
+	if (enc->type->api == HW_API_VAAPI && !init_vaapi(enc, settings))
+		return false;
+#endif
+
+	info("settings:\n"
+	     "\tencoder:     %s\n"
+	     "\tpreset:      %s\n"
+	     "\tprofile:     %s\n"
+	     "\twidth:       %d\n"
+	     "\theight:      %d\n"
+	     "\tkeyint:      %d\n"
+	     "\tb-frames:    %d\n"
+	     "\toptions:     %s",
+	     enc->codec->name, preset, profile,
+	     context->width, context->height,
+	     context->gop_size, bf, opts);
+
+	ret = avcodec_open2(context, enc->codec, NULL);
+	if (ret < 0) {
+		warn("Failed to open %s: %s", enc->codec->name,
+				av_err2str(ret));
+		return false;
+	}
+
+	enc->vframe = av_frame_alloc();
+	if (!enc->vframe) {
+		warn("Failed to allocate video frame");
+		return false;
+	}
+
+	load_headers(enc);
+	return true;
+}
+
+static void *hw_create(obs_data_t *settings, obs_encoder_t *encoder,
+		const struct hw_encoder_type *type)
+{
+	struct hw_encoder *enc;
+
+	avcodec_register_all();
+
+	enc          = bzalloc(sizeof(struct hw_encoder));
+	enc->encoder = encoder;
+	enc->type    = type;
+	enc->codec   = find_hw_codec(type);
+
+	blog(LOG_INFO, "---------------------------------");
+
+	if (!enc->codec) {
+		warn("Couldn't find encoder");
+		goto fail;
+	}
+
+	if (init_codec(enc, settings))
+		return enc;
+
+fail:
+	hw_destroy(enc);
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void release_frame_buffer(void *opaque, uint8_t *data)
+{
+	video_frame_buffer_release(opaque);
+	UNUSED_PARAMETER(data);
+}
+
+/* the frame is wrapped rather than copied.  when it's in a pooled buffer,
+ * the AVFrame also references that buffer, so encoders that keep frames
+ * around internally can take their own reference instead of copying */
+static void wrap_frame(struct hw_encoder *enc, struct encoder_frame *frame)
+{
+	AVFrame *vframe = enc->vframe;
+
+	av_frame_unref(vframe);
+
+	vframe->format = AV_PIX_FMT_NV12;
+	vframe->width  = enc->context->width;
+	vframe->height = enc->context->height;
+	vframe->pts    = frame->pts;
+
+	for (size_t i = 0; i < 2; i++) {
+		vframe->data[i]     = frame->data[i];
+		vframe->linesize[i] = (int)frame->linesize[i];
+	}
+
+	if (frame->buffer) {
+		video_frame_buffer_addref(frame->buffer);
+
+		vframe->buf[0] = av_buffer_create(frame->data[0],
+				frame->linesize[0] * enc->height,
+				release_frame_buffer, frame->buffer,
+				AV_BUFFER_FLAG_READONLY);
+		if (!vframe->buf[0])
+			video_frame_buffer_release(frame->buffer);
+	}
+}
+
+#ifdef ENABLE_VAAPI
+static AVFrame *upload_frame(struct hw_encoder *enc)
+{
+	int ret;
+
+	av_frame_unref(enc->hw_frame);
+
+	ret = av_hwframe_get_buffer(enc->hw_frames, enc->hw_frame, 0);
+	if (ret < 0) {
+		warn("Failed to get hardware frame: %s", av_err2str(ret));
+		return NULL;
+	}
+
+	ret = av_hwframe_transfer_data(enc->hw_frame, enc->vframe, 0);
+	if (ret < 0) {
+		warn("Failed to upload frame: %s", av_err2str(ret));
+		return NULL;
+	}
+
+	enc->hw_frame->pts = enc->vframe->pts;
+	return enc->hw_frame;
+}
+#endif
+
+static bool hw_encode(void *data, struct encoder_frame *frame,
+		struct encoder_packet *packet, bool *received_packet)
+{
+	struct hw_encoder *enc = data;
+	AVFrame  *input = enc->vframe;
+	AVPacket av_pkt = {0};
+	int      got_packet;
+	int      ret;
+
+	wrap_frame(enc, frame);
+
+#ifdef ENABLE_VAAPI
+	if (enc->type->api == HW_API_VAAPI) {
+		input = upload_frame(enc);
+		if (!input)
+			return false;
+	}
+#endif
+
+	av_init_packet(&av_pkt);
+
+	ret = avcodec_encode_video2(enc->context, &av_pkt, input,
+			&got_packet);
+	av_frame_unref(enc->vframe);
+
+	if (ret < 0) {
+		warn("avcodec_encode_video2 failed: %s", av_err2str(ret));
+		return false;
+	}
+
+	*received_packet = !!got_packet;
+	if (!got_packet)
+		return true;
+
+	da_resize(enc->packet_buffer, 0);
+	da_push_back_array(enc->packet_buffer, av_pkt.data, av_pkt.size);
+
+	packet->pts          = av_pkt.pts;
+	packet->dts          = av_pkt.dts;
+	packet->data         = enc->packet_buffer.array;
+	packet->size         = av_pkt.size;
+	packet->type         = OBS_ENCODER_VIDEO;
+	packet->keyframe     = !!(av_pkt.flags & AV_PKT_FLAG_KEY);
+	packet->priority     = get_packet_priority(enc->type->codec_id,
+			av_pkt.data, av_pkt.size);
+	packet->timebase_num = enc->context->time_base.num;
+	packet->timebase_den = enc->context->time_base.den;
+
+	av_free_packet(&av_pkt);
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void hw_defaults(obs_data_t *settings)
+{
+	obs_data_set_default_string(settings, "rate_control", "CBR");
+	obs_data_set_default_int   (settings, "bitrate",      2500);
+	obs_data_set_default_int   (settings, "cqp",          23);
+	obs_data_set_default_int   (settings, "keyint_sec",   0);
+	obs_data_set_default_int   (settings, "bf",           2);
+	obs_data_set_default_string(settings, "preset",       "");
+	obs_data_set_default_string(settings, "profile",      "");
+	obs_data_set_default_string(settings, "ffmpeg_opts",  "");
+	obs_data_set_default_string(settings, "vaapi_device",
+			"/dev/dri/renderD128");
+}
+
+static bool rate_control_modified(obs_properties_t *ppts, obs_property_t *p,
+		obs_data_t *settings)
+{
+	const char *rc = obs_data_get_string(settings, "rate_control");
+	bool cqp = astrcmpi(rc, "CQP") == 0;
+
+	p = obs_properties_get(ppts, "bitrate");
+	obs_property_set_visible(p, !cqp);
+	p = obs_properties_get(ppts, "cqp");
+	obs_property_set_visible(p, cqp);
+	return true;
+}
+
+static const char *nvenc_presets[] = {
+	"default", "hq", "hp", "ll", "llhq", "llhp", "slow", "medium", "fast",
+	NULL
+};
+
+static const char *qsv_presets[] = {
+	"veryfast", "faster", "fast", "medium", "slow", "slower", "veryslow",
+	NULL
+};
+
+static obs_properties_t *hw_properties(const struct hw_encoder_type *type)
+{
+	obs_properties_t *props = obs_properties_create();
+	obs_property_t   *list;
+	obs_property_t   *p;
+
+	p = obs_properties_add_list(props, "rate_control",
+			obs_module_text("RateControl"),
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+	obs_property_list_add_string(p, "CBR", "CBR");
+	obs_property_list_add_string(p, "VBR", "VBR");
+	obs_property_list_add_string(p, "CQP", "CQP");
+	obs_property_set_modified_callback(p, rate_control_modified);
+
+	obs_properties_add_int(props, "bitrate",
+			obs_module_text("Bitrate"), 50, 300000, 50);
+	obs_properties_add_int(props, "cqp", "CQP", 1, 51, 1);
+	obs_properties_add_int(props, "keyint_sec",
+			obs_module_text("KeyframeIntervalSec"), 0, 10, 1);
+	obs_properties_add_int(props, "bf", obs_module_text("BFrames"),
+			0, 4, 1);
+
+	if (type->api != HW_API_VAAPI) {
+		const char **presets = type->api == HW_API_NVENC ?
+			nvenc_presets : qsv_presets;
+
+		list = obs_properties_add_list(props, "preset",
+				obs_module_text("Preset"),
+				OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+		obs_property_list_add_string(list,
+				obs_module_text("Default"), "");
+		while (*presets) {
+			obs_property_list_add_string(list, *presets,
+					*presets);
+			presets++;
+		}
+	}
+
+	list = obs_properties_add_list(props, "profile",
+			obs_module_text("Profile"),
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+	obs_property_list_add_string(list, obs_module_text("Default"), "");
+	if (type->codec_id == AV_CODEC_ID_HEVC) {
+		obs_property_list_add_string(list, "main", "main");
+		obs_property_list_add_string(list, "main10", "main10");
+	} else {
+		obs_property_list_add_string(list, "baseline", "baseline");
+		obs_property_list_add_string(list, "main", "main");
+		obs_property_list_add_string(list, "high", "high");
+	}
+
+	if (type->api == HW_API_VAAPI)
+		obs_properties_add_text(props, "vaapi_device",
+				obs_module_text("VAAPI.Device"),
+				OBS_TEXT_DEFAULT);
+
+	obs_properties_add_text(props, "ffmpeg_opts",
+			obs_module_text("FFmpegOpts"), OBS_TEXT_DEFAULT);
+
+	return props;
+}
+
+static bool hw_extra_data(void *data, uint8_t **extra_data, size_t *size)
+{
+	struct hw_encoder *enc = data;
+
+	if (!enc->header.num)
+		return false;
+
+	*extra_data = enc->header.array;
+	*size       = enc->header.num;
+	return true;
+}
+
+static bool hw_sei_data(void *data, uint8_t **sei, size_t *size)
+{
+	struct hw_encoder *enc = data;
+
+	if (!enc->sei.num)
+		return false;
+
+	*sei  = enc->sei.array;
+	*size = enc->sei.num;
+	return true;
+}
+
+static void hw_video_info(void *data, struct video_scale_info *info)
+{
+	UNUSED_PARAMETER(data);
+	info->format = VIDEO_FORMAT_NV12;
+}
+
+/* ------------------------------------------------------------------------- */
+
+#define HW_ENCODER(name) \
+	static const char *name##_getname(void *unused) \
+	{ \
+		UNUSED_PARAMETER(unused); \
+		return obs_module_text(name##_type.text); \
+	} \
+	static void *name##_create(obs_data_t *settings, \
+			obs_encoder_t *encoder) \
+	{ \
+		return hw_create(settings, encoder, &name##_type); \
+	} \
+	static obs_properties_t *name##_properties(void *unused) \
+	{ \
+		UNUSED_PARAMETER(unused); \
+		return hw_properties(&name##_type); \
+	} \
+	static struct obs_encoder_info name##_encoder_info = { \
+		.type           = OBS_ENCODER_VIDEO, \
+		.get_name       = name##_getname, \
+		.create         = name##_create, \
+		.destroy        = hw_destroy, \
+		.encode         = hw_encode, \
+		.get_defaults   = hw_defaults, \
+		.get_properties = name##_properties, \
+		.get_extra_data = hw_extra_data, \
+		.get_sei_data   = hw_sei_data, \
+		.get_video_info = hw_video_info \
+	}
+
+HW_ENCODER(nvenc_h264);
+HW_ENCODER(nvenc_hevc);
+HW_ENCODER(qsv_h264);
+HW_ENCODER(qsv_hevc);
+#ifdef ENABLE_VAAPI
+HW_ENCODER(vaapi_h264);
+HW_ENCODER(vaapi_hevc);
+#endif
+
+static void register_hw_encoder(struct obs_encoder_info *info,
+		const struct hw_encoder_type *type)
+{
+	AVCodec *codec = find_hw_codec(type);
+
+	if (!codec)
+		return;
+
+	info->id    = type->id;
+	info->codec = type->codec;
+	obs_register_encoder(info);
+
+	blog(LOG_INFO, "[obs-ffmpeg] Registered %s (%s)", type->id,
+			codec->name);
+}
+
+/* only encoders that this FFmpeg build was compiled with are registered.
+ * whether the hardware is actually present is only known once one is
+ * created */
+void register_hw_encoders(void)
+{
+	avcodec_register_all();
+
+	register_hw_encoder(&nvenc_h264_encoder_info, &nvenc_h264_type);
+	register_hw_encoder(&nvenc_hevc_encoder_info, &nvenc_hevc_type);
+	register_hw_encoder(&qsv_h264_encoder_info,   &qsv_h264_type);
+	register_hw_encoder(&qsv_hevc_encoder_info,   &qsv_hevc_type);
+#ifdef ENABLE_VAAPI
+	register_hw_encoder(&vaapi_h264_encoder_info, &vaapi_h264_type);
+	register_hw_encoder(&vaapi_hevc_encoder_info, &vaapi_hevc_type);
+#endif
+}
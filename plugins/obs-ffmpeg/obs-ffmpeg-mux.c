@@ -17,9 +17,13 @@
 
 #include <obs-module.h>
 #include <obs-avc.h>
+#include <util/darray.h>
 #include <util/dstr.h>
 #include <util/pipe.h>
+#include <util/threading.h>
+#include <time.h>
 #include "ffmpeg-mux/ffmpeg-mux.h"
+#include "ffmpeg-mux/ffmpeg-mux-shm.h"
 
 #define do_log(level, format, ...) \
 	blog(level, "[ffmpeg muxer: '%s'] " format, \
@@ -31,10 +35,26 @@
 struct ffmpeg_muxer {
 	obs_output_t      *output;
 	os_process_pipe_t *pipe;
+	struct ffm_shm    *shm;
 	struct dstr       path;
 	bool              sent_headers;
 	bool              active;
 	bool              capturing;
+
+	/* replay buffer */
+	DARRAY(struct encoder_packet) packets;
+	size_t            packets_head;
+	pthread_mutex_t   mutex;
+	int64_t           max_time_usec;
+	size_t            max_size;
+	size_t            cur_size;
+	int               keyframes;
+	obs_hotkey_id     hotkey;
+
+	DARRAY(struct encoder_packet) save_packets;
+	pthread_t         save_thread;
+	bool              save_thread_active;
+	volatile long     saving;
 };
 
 static const char *ffmpeg_mux_getname(void *unused)
@@ -47,6 +67,7 @@ static void ffmpeg_mux_destroy(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
 	os_process_pipe_destroy(stream->pipe);
+	ffm_shm_destroy(stream->shm);
 	dstr_free(&stream->path);
 	bfree(stream);
 }
@@ -77,18 +98,18 @@ static void add_video_encoder_params(struct ffmpeg_muxer *stream,
 {
 	obs_data_t *settings = obs_encoder_get_settings(vencoder);
 	int bitrate = (int)obs_data_get_int(settings, "bitrate");
-	video_t *video = obs_get_video();
-	const struct video_output_info *info = video_output_get_info(video);
+	uint32_t fps_num, fps_den;
 
 	obs_data_release(settings);
+	obs_encoder_get_frame_rate(vencoder, &fps_num, &fps_den);
 
 	dstr_catf(cmd, "%s %d %d %d %d %d ",
 			"h264",
 			bitrate,
 			obs_output_get_width(stream->output),
 			obs_output_get_height(stream->output),
-			(int)info->fps_num,
-			(int)info->fps_den);
+			(int)fps_num,
+			(int)fps_den);
 }
 
 static void add_audio_encoder_params(struct dstr *cmd, obs_encoder_t *aencoder)
@@ -112,6 +133,39 @@ static void add_audio_encoder_params(struct dstr *cmd, obs_encoder_t *aencoder)
 	dstr_free(&name);
 }
 
+/* lets ffmpeg-mux write to disk from a separate thread with a large
+ * buffer, so a slow disk doesn't back up into the muxer right away, and
+ * optionally write fragmented mp4 or split the recording into several
+ * files.  splitting happens entirely in ffmpeg-mux at video keyframes, so
+ * the encoders keep running across the cut */
+static void add_writer_params(struct ffmpeg_muxer *stream, struct dstr *cmd)
+{
+	obs_data_t *settings = obs_output_get_settings(stream->output);
+	int write_buffer_mb = (int)obs_data_get_int(settings,
+			"write_buffer_mb");
+	int prealloc_mb = (int)obs_data_get_int(settings, "prealloc_mb");
+	int fragment_ms = (int)obs_data_get_int(settings, "fragment_ms");
+	int split_sec = (int)obs_data_get_int(settings, "split_time_sec");
+	int split_mb = (int)obs_data_get_int(settings, "split_size_mb");
+
+	obs_data_release(settings);
+
+	if (write_buffer_mb > 0)
+		dstr_catf(cmd, "%s %d ", FFM_WRITE_BUFFER_ARG,
+				write_buffer_mb);
+	if (prealloc_mb > 0)
+		dstr_catf(cmd, "%s %d ", FFM_PREALLOC_ARG, prealloc_mb);
+
+	/* only used by mp4/mov, ignored for other formats */
+	if (fragment_ms > 0)
+		dstr_catf(cmd, "%s %d ", FFM_FRAGMENT_ARG, fragment_ms);
+
+	if (split_sec > 0)
+		dstr_catf(cmd, "%s %d ", FFM_SPLIT_TIME_ARG, split_sec);
+	if (split_mb > 0)
+		dstr_catf(cmd, "%s %d ", FFM_SPLIT_SIZE_ARG, split_mb);
+}
+
 static void build_command_line(struct ffmpeg_muxer *stream, struct dstr *cmd)
 {
 	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
@@ -144,6 +198,30 @@ static void build_command_line(struct ffmpeg_muxer *stream, struct dstr *cmd)
 			add_audio_encoder_params(cmd, aencoders[i]);
 		}
 	}
+
+	add_writer_params(stream, cmd);
+
+	if (stream->shm)
+		dstr_catf(cmd, "%s %s", FFM_SHM_ARG, ffm_shm_name(stream->shm));
+}
+
+/* packets go through shared memory when possible so that the output thread
+ * does not block on the pipe every time ffmpeg-mux falls behind a little */
+static void create_shm(struct ffmpeg_muxer *stream, obs_data_t *settings)
+{
+	size_t size_mb = (size_t)obs_data_get_int(settings, "shm_buffer_mb");
+
+	if (!size_mb)
+		return;
+
+	stream->shm = ffm_shm_create(size_mb * 1024 * 1024);
+	if (!stream->shm)
+		warn("Failed to create shared memory, falling back to pipe");
+}
+
+static bool muxer_alive(void *param)
+{
+	return os_process_pipe_alive(param);
 }
 
 static bool ffmpeg_mux_start(void *data)
@@ -162,6 +240,7 @@ static bool ffmpeg_mux_start(void *data)
 	path = obs_data_get_string(settings, "path");
 	dstr_copy(&stream->path, path);
 	dstr_replace(&stream->path, "\"", "\"\"");
+	create_shm(stream, settings);
 	obs_data_release(settings);
 
 	build_command_line(stream, &cmd);
@@ -170,9 +249,15 @@ static bool ffmpeg_mux_start(void *data)
 
 	if (!stream->pipe) {
 		warn("Failed to create process pipe");
+		ffm_shm_destroy(stream->shm);
+		stream->shm = NULL;
 		return false;
 	}
 
+	if (stream->shm)
+		ffm_shm_set_alive_callback(stream->shm, muxer_alive,
+				stream->pipe);
+
 	/* write headers and start capture */
 	stream->active = true;
 	stream->capturing = true;
@@ -187,9 +272,16 @@ static int deactivate(struct ffmpeg_muxer *stream)
 	int ret = -1;
 
 	if (stream->active) {
+		/* ffmpeg-mux drains the ring before it exits */
+		if (stream->shm)
+			ffm_shm_close(stream->shm);
+
 		ret = os_process_pipe_destroy(stream->pipe);
 		stream->pipe = NULL;
 
+		ffm_shm_destroy(stream->shm);
+		stream->shm = NULL;
+
 		stream->active = false;
 		stream->sent_headers = false;
 
@@ -225,7 +317,17 @@ static void signal_failure(struct ffmpeg_muxer *stream)
 	stream->capturing = false;
 }
 
-static bool write_packet(struct ffmpeg_muxer *stream,
+static inline size_t write_data(os_process_pipe_t *pipe, struct ffm_shm *shm,
+		const uint8_t *data, size_t size)
+{
+	if (shm)
+		return ffm_shm_write(shm, data, size) ? size : 0;
+
+	return os_process_pipe_write(pipe, data, size);
+}
+
+static bool write_pipe_packet(struct ffmpeg_muxer *stream,
+		os_process_pipe_t *pipe, struct ffm_shm *shm,
 		struct encoder_packet *packet)
 {
 	bool is_video = packet->type == OBS_ENCODER_VIDEO;
@@ -240,17 +342,25 @@ static bool write_packet(struct ffmpeg_muxer *stream,
 		.keyframe = packet->keyframe
 	};
 
-	ret = os_process_pipe_write(stream->pipe, (const uint8_t*)&info,
-			sizeof(info));
+	ret = write_data(pipe, shm, (const uint8_t*)&info, sizeof(info));
 	if (ret != sizeof(info)) {
 		warn("os_process_pipe_write for info structure failed");
-		signal_failure(stream);
 		return false;
 	}
 
-	ret = os_process_pipe_write(stream->pipe, packet->data, packet->size);
+	ret = write_data(pipe, shm, packet->data, packet->size);
 	if (ret != packet->size) {
 		warn("os_process_pipe_write for packet data failed");
+		return false;
+	}
+
+	return true;
+}
+
+static bool write_packet(struct ffmpeg_muxer *stream,
+		struct encoder_packet *packet)
+{
+	if (!write_pipe_packet(stream, stream->pipe, stream->shm, packet)) {
 		signal_failure(stream);
 		return false;
 	}
@@ -259,6 +369,7 @@ static bool write_packet(struct ffmpeg_muxer *stream,
 }
 
 static bool send_audio_headers(struct ffmpeg_muxer *stream,
+		os_process_pipe_t *pipe, struct ffm_shm *shm,
 		obs_encoder_t *aencoder, size_t idx)
 {
 	struct encoder_packet packet = {
@@ -268,10 +379,11 @@ static bool send_audio_headers(struct ffmpeg_muxer *stream,
 	};
 
 	obs_encoder_get_extra_data(aencoder, &packet.data, &packet.size);
-	return write_packet(stream, &packet);
+	return write_pipe_packet(stream, pipe, shm, &packet);
 }
 
-static bool send_video_headers(struct ffmpeg_muxer *stream)
+static bool send_video_headers(struct ffmpeg_muxer *stream,
+		os_process_pipe_t *pipe, struct ffm_shm *shm)
 {
 	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
 
@@ -281,21 +393,23 @@ static bool send_video_headers(struct ffmpeg_muxer *stream)
 	};
 
 	obs_encoder_get_extra_data(vencoder, &packet.data, &packet.size);
-	return write_packet(stream, &packet);
+	return write_pipe_packet(stream, pipe, shm, &packet);
 }
 
-static bool send_headers(struct ffmpeg_muxer *stream)
+static bool send_headers(struct ffmpeg_muxer *stream, os_process_pipe_t *pipe,
+		struct ffm_shm *shm)
 {
 	obs_encoder_t *aencoder;
 	size_t idx = 0;
 
-	if (!send_video_headers(stream))
+	if (!send_video_headers(stream, pipe, shm))
 		return false;
 
 	do {
 		aencoder = obs_output_get_audio_encoder(stream->output, idx);
 		if (aencoder) {
-			if (!send_audio_headers(stream, aencoder, idx)) {
+			if (!send_audio_headers(stream, pipe, shm, aencoder,
+						idx)) {
 				return false;
 			}
 			idx++;
@@ -313,8 +427,10 @@ static void ffmpeg_mux_data(void *data, struct encoder_packet *packet)
 		return;
 
 	if (!stream->sent_headers) {
-		if (!send_headers(stream))
+		if (!send_headers(stream, stream->pipe, stream->shm)) {
+			signal_failure(stream);
 			return;
+		}
 
 		stream->sent_headers = true;
 	}
@@ -322,6 +438,16 @@ static void ffmpeg_mux_data(void *data, struct encoder_packet *packet)
 	write_packet(stream, packet);
 }
 
+static void ffmpeg_mux_defaults(obs_data_t *defaults)
+{
+	obs_data_set_default_int(defaults, "shm_buffer_mb", 32);
+	obs_data_set_default_int(defaults, "write_buffer_mb", 64);
+	obs_data_set_default_int(defaults, "prealloc_mb", 0);
+	obs_data_set_default_int(defaults, "fragment_ms", 0);
+	obs_data_set_default_int(defaults, "split_time_sec", 0);
+	obs_data_set_default_int(defaults, "split_size_mb", 0);
+}
+
 static obs_properties_t *ffmpeg_mux_properties(void *unused)
 {
 	UNUSED_PARAMETER(unused);
@@ -331,6 +457,15 @@ static obs_properties_t *ffmpeg_mux_properties(void *unused)
 	obs_properties_add_text(props, "path",
 			obs_module_text("FilePath"),
 			OBS_TEXT_DEFAULT);
+	obs_properties_add_int(props, "fragment_ms",
+			obs_module_text("FFmpegMuxer.FragmentDuration"),
+			0, 60000, 100);
+	obs_properties_add_int(props, "split_time_sec",
+			obs_module_text("FFmpegMuxer.SplitTime"),
+			0, 86400, 60);
+	obs_properties_add_int(props, "split_size_mb",
+			obs_module_text("FFmpegMuxer.SplitSize"),
+			0, 1048576, 256);
 	return props;
 }
 
@@ -345,5 +480,406 @@ struct obs_output_info ffmpeg_muxer = {
 	.start          = ffmpeg_mux_start,
 	.stop           = ffmpeg_mux_stop,
 	.encoded_packet = ffmpeg_mux_data,
+	.get_defaults   = ffmpeg_mux_defaults,
 	.get_properties = ffmpeg_mux_properties
 };
+
+/* ------------------------------------------------------------------------- */
+/* replay buffer */
+
+/*
+ * Keeps references to the last few seconds of encoded packets in memory and
+ * only writes them to disk when asked to.  The buffer always starts at a
+ * video keyframe so that whatever is saved can be decoded from its first
+ * packet, and is trimmed a whole GOP at a time from the front, the same way
+ * the output delay pops expired packets.
+ */
+
+static const char *replay_buffer_getname(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("ReplayBuffer");
+}
+
+static inline bool is_keyframe(struct encoder_packet *packet)
+{
+	return packet->type == OBS_ENCODER_VIDEO && packet->keyframe;
+}
+
+static inline size_t num_replay_packets(struct ffmpeg_muxer *stream)
+{
+	return stream->packets.num - stream->packets_head;
+}
+
+static inline struct encoder_packet *replay_packet(
+		struct ffmpeg_muxer *stream, size_t idx)
+{
+	return stream->packets.array + stream->packets_head + idx;
+}
+
+static void free_replay_packets(struct ffmpeg_muxer *stream)
+{
+	for (size_t i = 0; i < num_replay_packets(stream); i++)
+		obs_encoder_packet_release(replay_packet(stream, i));
+
+	da_resize(stream->packets, 0);
+	stream->packets_head = 0;
+	stream->cur_size = 0;
+	stream->keyframes = 0;
+}
+
+static void join_save_thread(struct ffmpeg_muxer *stream)
+{
+	void *thread_ret;
+
+	if (stream->save_thread_active) {
+		pthread_join(stream->save_thread, &thread_ret);
+		stream->save_thread_active = false;
+	}
+}
+
+static void replay_buffer_stop(void *data);
+
+static void replay_buffer_destroy(void *data)
+{
+	struct ffmpeg_muxer *stream = data;
+
+	replay_buffer_stop(stream);
+	join_save_thread(stream);
+
+	if (stream->hotkey)
+		obs_hotkey_unregister(stream->hotkey);
+
+	da_free(stream->packets);
+	da_free(stream->save_packets);
+	pthread_mutex_destroy(&stream->mutex);
+	dstr_free(&stream->path);
+	bfree(stream);
+}
+
+/* pops the oldest GOP, leaving the buffer at the next keyframe */
+static void pop_gop(struct ffmpeg_muxer *stream)
+{
+	do {
+		struct encoder_packet *packet = replay_packet(stream, 0);
+
+		stream->cur_size -= packet->size;
+		obs_encoder_packet_release(packet);
+		stream->packets_head++;
+	} while (num_replay_packets(stream) &&
+	         !is_keyframe(replay_packet(stream, 0)));
+
+	stream->keyframes--;
+
+	/* compact once the popped packets are at least half the array */
+	if (stream->packets_head >= 32 &&
+	    stream->packets_head * 2 >= stream->packets.num) {
+		da_erase_range(stream->packets, 0, stream->packets_head);
+		stream->packets_head = 0;
+	}
+}
+
+static inline bool over_limit(struct ffmpeg_muxer *stream)
+{
+	struct encoder_packet *first;
+	struct encoder_packet *last;
+
+	if (stream->max_size && stream->cur_size > stream->max_size)
+		return true;
+
+	first = replay_packet(stream, 0);
+	last  = da_end(stream->packets);
+	return last->dts_usec - first->dts_usec > stream->max_time_usec;
+}
+
+static void replay_buffer_data(void *data, struct encoder_packet *packet)
+{
+	struct ffmpeg_muxer *stream = data;
+	struct encoder_packet *ref;
+
+	pthread_mutex_lock(&stream->mutex);
+
+	if (!stream->active)
+		goto unlock;
+
+	/* the buffer always starts at a keyframe */
+	if (!num_replay_packets(stream) && !is_keyframe(packet))
+		goto unlock;
+
+	ref = da_push_back_new(stream->packets);
+	obs_encoder_packet_ref(ref, packet);
+	stream->cur_size += ref->size;
+	if (is_keyframe(ref))
+		stream->keyframes++;
+
+	/* never trim the last GOP away, a replay needs at least one */
+	while (stream->keyframes > 1 && over_limit(stream))
+		pop_gop(stream);
+
+unlock:
+	pthread_mutex_unlock(&stream->mutex);
+}
+
+static void generate_replay_path(struct ffmpeg_muxer *stream)
+{
+	obs_data_t *settings = obs_output_get_settings(stream->output);
+	const char *dir      = obs_data_get_string(settings, "directory");
+	const char *format   = obs_data_get_string(settings, "format");
+	time_t     now       = time(NULL);
+	char       name[64];
+
+	strftime(name, sizeof(name), "Replay %Y-%m-%d %H-%M-%S",
+			localtime(&now));
+
+	dstr_copy(&stream->path, dir);
+	dstr_replace(&stream->path, "\\", "/");
+	if (!dstr_is_empty(&stream->path) && dstr_end(&stream->path) != '/')
+		dstr_cat_ch(&stream->path, '/');
+	dstr_catf(&stream->path, "%s.%s", name, format);
+	dstr_replace(&stream->path, "\"", "\"\"");
+
+	obs_data_release(settings);
+}
+
+/* the muxer expects every track to start at zero */
+static void offset_packets(struct ffmpeg_muxer *stream)
+{
+	int64_t video_offset = 0;
+	int64_t audio_offsets[MAX_AUDIO_MIXES] = {0};
+	bool    found_audio[MAX_AUDIO_MIXES] = {false};
+
+	for (size_t i = 0; i < stream->save_packets.num; i++) {
+		struct encoder_packet *packet = stream->save_packets.array + i;
+		int64_t *offset;
+
+		if (packet->type == OBS_ENCODER_VIDEO) {
+			if (i == 0)
+				video_offset = packet->dts;
+			offset = &video_offset;
+		} else {
+			size_t idx = packet->track_idx;
+			if (idx >= MAX_AUDIO_MIXES)
+				continue;
+			if (!found_audio[idx]) {
+				audio_offsets[idx] = packet->dts;
+				found_audio[idx] = true;
+			}
+			offset = &audio_offsets[idx];
+		}
+
+		packet->pts -= *offset;
+		packet->dts -= *offset;
+	}
+}
+
+static void *replay_buffer_save_thread(void *data)
+{
+	struct ffmpeg_muxer *stream = data;
+	os_process_pipe_t *pipe;
+	bool success = false;
+	struct dstr cmd;
+
+	offset_packets(stream);
+	generate_replay_path(stream);
+	build_command_line(stream, &cmd);
+
+	pipe = os_process_pipe_create(cmd.array, "w");
+	dstr_free(&cmd);
+
+	if (!pipe) {
+		warn("Failed to create process pipe");
+		goto free;
+	}
+
+	if (!send_headers(stream, pipe, NULL))
+		goto destroy;
+
+	for (size_t i = 0; i < stream->save_packets.num; i++) {
+		struct encoder_packet *packet = stream->save_packets.array + i;
+		if (!write_pipe_packet(stream, pipe, NULL, packet))
+			goto destroy;
+	}
+
+	success = true;
+
+destroy:
+	os_process_pipe_destroy(pipe);
+
+free:
+	for (size_t i = 0; i < stream->save_packets.num; i++)
+		obs_encoder_packet_release(stream->save_packets.array + i);
+	da_resize(stream->save_packets, 0);
+
+	if (success)
+		info("Wrote replay '%s'", stream->path.array);
+	else
+		warn("Failed to write replay '%s'", stream->path.array);
+
+	os_atomic_dec_long(&stream->saving);
+	return NULL;
+}
+
+static void replay_buffer_save(struct ffmpeg_muxer *stream)
+{
+	bool empty;
+
+	if (!os_atomic_compare_swap_long(&stream->saving, 0, 1)) {
+		warn("Tried to save a replay while one is already being saved");
+		return;
+	}
+
+	join_save_thread(stream);
+
+	/* only references are taken here, the packets themselves are written
+	 * out on a separate thread so that saving never stalls encoding */
+	pthread_mutex_lock(&stream->mutex);
+
+	da_resize(stream->save_packets, num_replay_packets(stream));
+
+	for (size_t i = 0; i < stream->save_packets.num; i++)
+		obs_encoder_packet_ref(stream->save_packets.array + i,
+				replay_packet(stream, i));
+
+	pthread_mutex_unlock(&stream->mutex);
+
+	empty = !stream->save_packets.num;
+	if (!empty)
+		stream->save_thread_active = pthread_create(
+				&stream->save_thread, NULL,
+				replay_buffer_save_thread, stream) == 0;
+
+	if (!stream->save_thread_active) {
+		if (!empty)
+			warn("Failed to create save thread");
+		for (size_t i = 0; i < stream->save_packets.num; i++)
+			obs_encoder_packet_release(
+					stream->save_packets.array + i);
+		da_resize(stream->save_packets, 0);
+		os_atomic_dec_long(&stream->saving);
+	}
+}
+
+static void replay_buffer_save_proc(void *data, calldata_t *cd)
+{
+	replay_buffer_save(data);
+	UNUSED_PARAMETER(cd);
+}
+
+static void replay_buffer_hotkey(void *data, obs_hotkey_id id,
+		obs_hotkey_t *hotkey, bool pressed)
+{
+	UNUSED_PARAMETER(id);
+	UNUSED_PARAMETER(hotkey);
+
+	if (pressed)
+		replay_buffer_save(data);
+}
+
+static void *replay_buffer_create(obs_data_t *settings, obs_output_t *output)
+{
+	struct ffmpeg_muxer *stream = bzalloc(sizeof(*stream));
+	proc_handler_t *ph = obs_output_get_proc_handler(output);
+
+	stream->output = output;
+	pthread_mutex_init_value(&stream->mutex);
+
+	if (pthread_mutex_init(&stream->mutex, NULL) != 0) {
+		bfree(stream);
+		return NULL;
+	}
+
+	stream->hotkey = obs_hotkey_register_output(output,
+			"ReplayBuffer.Save",
+			obs_module_text("ReplayBuffer.Save"),
+			replay_buffer_hotkey, stream);
+
+	proc_handler_add(ph, "void save()", replay_buffer_save_proc, stream);
+
+	UNUSED_PARAMETER(settings);
+	return stream;
+}
+
+static bool replay_buffer_start(void *data)
+{
+	struct ffmpeg_muxer *stream = data;
+	obs_data_t *settings;
+
+	if (!obs_output_can_begin_data_capture(stream->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(stream->output, 0))
+		return false;
+
+	settings = obs_output_get_settings(stream->output);
+	stream->max_time_usec =
+		obs_data_get_int(settings, "max_time_sec") * 1000000LL;
+	stream->max_size =
+		(size_t)obs_data_get_int(settings, "max_size_mb") * 1024 * 1024;
+	obs_data_release(settings);
+
+	pthread_mutex_lock(&stream->mutex);
+	free_replay_packets(stream);
+	stream->active = true;
+	pthread_mutex_unlock(&stream->mutex);
+
+	stream->capturing = true;
+	obs_output_begin_data_capture(stream->output, 0);
+	return true;
+}
+
+static void replay_buffer_stop(void *data)
+{
+	struct ffmpeg_muxer *stream = data;
+
+	if (stream->capturing) {
+		obs_output_end_data_capture(stream->output);
+		stream->capturing = false;
+	}
+
+	pthread_mutex_lock(&stream->mutex);
+	stream->active = false;
+	free_replay_packets(stream);
+	pthread_mutex_unlock(&stream->mutex);
+}
+
+static void replay_buffer_defaults(obs_data_t *defaults)
+{
+	obs_data_set_default_int(defaults, "max_time_sec", 20);
+	obs_data_set_default_int(defaults, "max_size_mb", 512);
+	obs_data_set_default_string(defaults, "format", "mkv");
+}
+
+static obs_properties_t *replay_buffer_properties(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+
+	obs_properties_t *props = obs_properties_create();
+
+	obs_properties_add_path(props, "directory",
+			obs_module_text("ReplayBuffer.Directory"),
+			OBS_PATH_DIRECTORY, NULL, NULL);
+	obs_properties_add_text(props, "format",
+			obs_module_text("ReplayBuffer.Format"),
+			OBS_TEXT_DEFAULT);
+	obs_properties_add_int(props, "max_time_sec",
+			obs_module_text("ReplayBuffer.MaxTime"),
+			1, 21600, 1);
+	obs_properties_add_int(props, "max_size_mb",
+			obs_module_text("ReplayBuffer.MaxSize"),
+			0, 65536, 1);
+	return props;
+}
+
+struct obs_output_info replay_buffer = {
+	.id             = "replay_buffer",
+	.flags          = OBS_OUTPUT_AV |
+	                  OBS_OUTPUT_ENCODED |
+	                  OBS_OUTPUT_MULTI_TRACK,
+	.get_name       = replay_buffer_getname,
+	.create         = replay_buffer_create,
+	.destroy        = replay_buffer_destroy,
+	.start          = replay_buffer_start,
+	.stop           = replay_buffer_stop,
+	.encoded_packet = replay_buffer_data,
+	.get_defaults   = replay_buffer_defaults,
+	.get_properties = replay_buffer_properties
+};
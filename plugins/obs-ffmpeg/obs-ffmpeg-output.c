@@ -30,6 +30,11 @@
 #include "closest-pixel-format.h"
 #include "obs-ffmpeg-compat.h"
 
+/* frames handed to the encode thread come from a fixed pool; when all of them
+ * are queued the encoder has fallen behind, and new frames are dropped so
+ * that it can't hold up the video thread */
+#define VIDEO_FRAME_POOL 8
+
 struct ffmpeg_cfg {
 	const char         *url;
 	const char         *format_name;
@@ -61,8 +66,10 @@ struct ffmpeg_data {
 	struct SwsContext  *swscale;
 
 	int64_t            total_frames;
-	AVPicture          dst_picture;
-	AVFrame            *vframe;
+	AVFrame            *vframes[VIDEO_FRAME_POOL];
+	DARRAY(AVFrame*)   free_vframes;
+	struct circlebuf   queued_vframes;
+	int                dropped_frames;
 	int                frame_size;
 
 	uint64_t           start_timestamp;
@@ -89,13 +96,20 @@ struct ffmpeg_output {
 	bool               connecting;
 	pthread_t          start_thread;
 
+	bool               encode_thread_active;
+	bool               encode_stopping;
+	pthread_mutex_t    video_mutex;
+	pthread_t          encode_thread;
+	os_sem_t           *encode_sem;
+
 	bool               write_thread_active;
 	pthread_mutex_t    write_mutex;
 	pthread_t          write_thread;
 	os_sem_t           *write_sem;
 	os_event_t         *stop_event;
 
-	DARRAY(AVPacket)   packets;
+	/* contains AVPacket */
+	struct circlebuf   packets;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -168,27 +182,31 @@ static bool open_video_codec(struct ffmpeg_data *data)
 		return false;
 	}
 
-	data->vframe = av_frame_alloc();
-	if (!data->vframe) {
-		blog(LOG_WARNING, "Failed to allocate video frame");
-		return false;
-	}
+	for (size_t i = 0; i < VIDEO_FRAME_POOL; i++) {
+		AVFrame *frame = av_frame_alloc();
+		if (!frame) {
+			blog(LOG_WARNING, "Failed to allocate video frame");
+			return false;
+		}
 
-	data->vframe->format = context->pix_fmt;
-	data->vframe->width  = context->width;
-	data->vframe->height = context->height;
-	data->vframe->colorspace = data->config.color_space;
-	data->vframe->color_range = data->config.color_range;
+		data->vframes[i] = frame;
 
-	ret = avpicture_alloc(&data->dst_picture, context->pix_fmt,
-			context->width, context->height);
-	if (ret < 0) {
-		blog(LOG_WARNING, "Failed to allocate dst_picture: %s",
-				av_err2str(ret));
-		return false;
+		frame->format      = context->pix_fmt;
+		frame->width       = context->width;
+		frame->height      = context->height;
+		frame->colorspace  = data->config.color_space;
+		frame->color_range = data->config.color_range;
+
+		ret = av_frame_get_buffer(frame, base_get_alignment());
+		if (ret < 0) {
+			blog(LOG_WARNING, "Failed to allocate video frame "
+			                  "buffer: %s", av_err2str(ret));
+			return false;
+		}
+
+		da_push_back(data->free_vframes, &frame);
 	}
 
-	*((AVPicture*)data->vframe) = data->dst_picture;
 	return true;
 }
 
@@ -405,7 +423,8 @@ static inline bool open_output_file(struct ffmpeg_data *data)
 static void close_video(struct ffmpeg_data *data)
 {
 	avcodec_close(data->video->codec);
-	avpicture_free(&data->dst_picture);
+	circlebuf_free(&data->queued_vframes);
+	da_free(data->free_vframes);
 
 	// This format for some reason derefs video frame
 	// too many times
@@ -413,7 +432,8 @@ static void close_video(struct ffmpeg_data *data)
 	    data->vcodec->id == AV_CODEC_ID_A64_MULTI5)
 		return;
 
-	av_frame_free(&data->vframe);
+	for (size_t i = 0; i < VIDEO_FRAME_POOL; i++)
+		av_frame_free(&data->vframes[i]);
 }
 
 static void close_audio(struct ffmpeg_data *data)
@@ -567,14 +587,19 @@ static void *ffmpeg_output_create(obs_data_t *settings, obs_output_t *output)
 {
 	struct ffmpeg_output *data = bzalloc(sizeof(struct ffmpeg_output));
 	pthread_mutex_init_value(&data->write_mutex);
+	pthread_mutex_init_value(&data->video_mutex);
 	data->output = output;
 
 	if (pthread_mutex_init(&data->write_mutex, NULL) != 0)
 		goto fail;
+	if (pthread_mutex_init(&data->video_mutex, NULL) != 0)
+		goto fail;
 	if (os_event_init(&data->stop_event, OS_EVENT_TYPE_AUTO) != 0)
 		goto fail;
 	if (os_sem_init(&data->write_sem, 0) != 0)
 		goto fail;
+	if (os_sem_init(&data->encode_sem, 0) != 0)
+		goto fail;
 
 	av_log_set_callback(ffmpeg_log_callback);
 
@@ -583,7 +608,9 @@ static void *ffmpeg_output_create(obs_data_t *settings, obs_output_t *output)
 
 fail:
 	pthread_mutex_destroy(&data->write_mutex);
+	pthread_mutex_destroy(&data->video_mutex);
 	os_event_destroy(data->stop_event);
+	os_sem_destroy(data->write_sem);
 	bfree(data);
 	return NULL;
 }
@@ -591,6 +618,12 @@ fail:
 static void ffmpeg_output_stop(void *data);
 static void ffmpeg_deactivate(struct ffmpeg_output *output);
 
+static int ffmpeg_output_dropped_frames(void *data)
+{
+	struct ffmpeg_output *output = data;
+	return output->ff_data.dropped_frames;
+}
+
 static void ffmpeg_output_destroy(void *data)
 {
 	struct ffmpeg_output *output = data;
@@ -602,13 +635,15 @@ static void ffmpeg_output_destroy(void *data)
 		ffmpeg_output_stop(output);
 
 		pthread_mutex_destroy(&output->write_mutex);
+		pthread_mutex_destroy(&output->video_mutex);
 		os_sem_destroy(output->write_sem);
+		os_sem_destroy(output->encode_sem);
 		os_event_destroy(output->stop_event);
 		bfree(data);
 	}
 }
 
-static inline void copy_data(AVPicture *pic, const struct video_data *frame,
+static inline void copy_data(AVFrame *pic, const struct video_data *frame,
 		int height)
 {
 	for (int plane = 0; plane < MAX_AV_PLANES; plane++) {
@@ -632,49 +667,102 @@ static inline void copy_data(AVPicture *pic, const struct video_data *frame,
 	}
 }
 
+static inline void push_packet(struct ffmpeg_output *output,
+		AVPacket *packet)
+{
+	pthread_mutex_lock(&output->write_mutex);
+	circlebuf_push_back(&output->packets, packet, sizeof(*packet));
+	pthread_mutex_unlock(&output->write_mutex);
+	os_sem_post(output->write_sem);
+}
+
+static inline void release_vframe(struct ffmpeg_output *output,
+		AVFrame *vframe)
+{
+	pthread_mutex_lock(&output->video_mutex);
+	da_push_back(output->ff_data.free_vframes, &vframe);
+	pthread_mutex_unlock(&output->video_mutex);
+}
+
+/* converts or copies the frame into a pooled AVFrame, which is the only copy
+ * of it made before the encoder, and queues it for the encode thread */
 static void receive_video(void *param, struct video_data *frame)
 {
 	struct ffmpeg_output *output = param;
 	struct ffmpeg_data   *data   = &output->ff_data;
+	AVFrame *vframe = NULL;
+	int64_t pts;
 
 	// codec doesn't support video or none configured
 	if (!data->video)
 		return;
 
 	AVCodecContext *context = data->video->codec;
-	AVPacket packet = {0};
-	int ret = 0, got_packet;
-
-	av_init_packet(&packet);
 
 	if (!data->start_timestamp)
 		data->start_timestamp = frame->timestamp;
 
+	pthread_mutex_lock(&output->video_mutex);
+	if (data->free_vframes.num) {
+		vframe = data->free_vframes.array[data->free_vframes.num - 1];
+		da_pop_back(data->free_vframes);
+	}
+	pthread_mutex_unlock(&output->video_mutex);
+
+	/* dropped frames still count, so they leave a gap instead of
+	 * shifting everything after them */
+	pts = data->total_frames++;
+
+	if (!vframe) {
+		data->dropped_frames++;
+		return;
+	}
+
+	/* the encoder may still hold a reference to the buffers */
+	if (av_frame_make_writable(vframe) < 0) {
+		release_vframe(output, vframe);
+		data->dropped_frames++;
+		return;
+	}
+
 	if (!!data->swscale)
 		sws_scale(data->swscale, (const uint8_t *const *)frame->data,
 				(const int*)frame->linesize,
-				0, data->config.height, data->dst_picture.data,
-				data->dst_picture.linesize);
+				0, data->config.height, vframe->data,
+				vframe->linesize);
 	else
-		copy_data(&data->dst_picture, frame, context->height);
+		copy_data(vframe, frame, context->height);
+
+	vframe->pts = pts;
+
+	pthread_mutex_lock(&output->video_mutex);
+	circlebuf_push_back(&data->queued_vframes, &vframe, sizeof(vframe));
+	pthread_mutex_unlock(&output->video_mutex);
+	os_sem_post(output->encode_sem);
+}
+
+static void encode_video(struct ffmpeg_output *output, AVFrame *vframe)
+{
+	struct ffmpeg_data *data    = &output->ff_data;
+	AVCodecContext     *context = data->video->codec;
+	AVPacket packet = {0};
+	int ret = 0, got_packet;
+
+	av_init_packet(&packet);
 
 	if (data->output->flags & AVFMT_RAWPICTURE) {
 		packet.flags        |= AV_PKT_FLAG_KEY;
 		packet.stream_index  = data->video->index;
-		packet.data          = data->dst_picture.data[0];
+		packet.data          = vframe->data[0];
 		packet.size          = sizeof(AVPicture);
 
-		pthread_mutex_lock(&output->write_mutex);
-		da_push_back(output->packets, &packet);
-		pthread_mutex_unlock(&output->write_mutex);
-		os_sem_post(output->write_sem);
+		push_packet(output, &packet);
 
 	} else {
-		data->vframe->pts = data->total_frames;
-		ret = avcodec_encode_video2(context, &packet, data->vframe,
+		ret = avcodec_encode_video2(context, &packet, vframe,
 				&got_packet);
 		if (ret < 0) {
-			blog(LOG_WARNING, "receive_video: Error encoding "
+			blog(LOG_WARNING, "encode_video: Error encoding "
 			                  "video: %s", av_err2str(ret));
 			return;
 		}
@@ -688,21 +776,50 @@ static void receive_video(void *param, struct video_data *frame)
 					context->time_base,
 					data->video->time_base);
 
-			pthread_mutex_lock(&output->write_mutex);
-			da_push_back(output->packets, &packet);
-			pthread_mutex_unlock(&output->write_mutex);
-			os_sem_post(output->write_sem);
+			push_packet(output, &packet);
 		} else {
 			ret = 0;
 		}
 	}
 
 	if (ret != 0) {
-		blog(LOG_WARNING, "receive_video: Error writing video: %s",
+		blog(LOG_WARNING, "encode_video: Error writing video: %s",
 				av_err2str(ret));
 	}
+}
+
+/* encodes queued frames until stopped; frames queued before the stop are
+ * still encoded */
+static void *encode_thread(void *data)
+{
+	struct ffmpeg_output *output = data;
+	struct ffmpeg_data   *ff_data = &output->ff_data;
+
+	os_set_thread_name("obs-ffmpeg: encode_thread");
+	obs_apply_thread_settings(OBS_THREAD_ROLE_ENCODER);
+
+	while (os_sem_wait(output->encode_sem) == 0) {
+		AVFrame *vframe = NULL;
+		bool stopping;
+
+		pthread_mutex_lock(&output->video_mutex);
+		if (ff_data->queued_vframes.size)
+			circlebuf_pop_front(&ff_data->queued_vframes, &vframe,
+					sizeof(vframe));
+		stopping = output->encode_stopping;
+		pthread_mutex_unlock(&output->video_mutex);
+
+		if (!vframe) {
+			if (stopping)
+				break;
+			continue;
+		}
+
+		encode_video(output, vframe);
+		release_vframe(output, vframe);
+	}
 
-	data->total_frames++;
+	return NULL;
 }
 
 static void encode_audio(struct ffmpeg_output *output,
@@ -747,10 +864,7 @@ static void encode_audio(struct ffmpeg_output *output,
 			data->audio->time_base);
 	packet.stream_index = data->audio->index;
 
-	pthread_mutex_lock(&output->write_mutex);
-	da_push_back(output->packets, &packet);
-	pthread_mutex_unlock(&output->write_mutex);
-	os_sem_post(output->write_sem);
+	push_packet(output, &packet);
 }
 
 static bool prepare_audio(struct ffmpeg_data *data,
@@ -819,9 +933,8 @@ static int process_packet(struct ffmpeg_output *output)
 	int ret;
 
 	pthread_mutex_lock(&output->write_mutex);
-	if (output->packets.num) {
-		packet = output->packets.array[0];
-		da_erase(output->packets, 0);
+	if (output->packets.size) {
+		circlebuf_pop_front(&output->packets, &packet, sizeof(packet));
 		new_packet = true;
 	}
 	pthread_mutex_unlock(&output->write_mutex);
@@ -831,8 +944,8 @@ static int process_packet(struct ffmpeg_output *output)
 
 	/*blog(LOG_DEBUG, "size = %d, flags = %lX, stream = %d, "
 			"packets queued: %lu",
-			packet.size, packet.flags,
-			packet.stream_index, output->packets.num);*/
+			packet.size, packet.flags, packet.stream_index,
+			output->packets.size / sizeof(AVPacket));*/
 
 	ret = av_interleaved_write_frame(output->ff_data.output, &packet);
 	if (ret < 0) {
@@ -849,6 +962,9 @@ static void *write_thread(void *data)
 {
 	struct ffmpeg_output *output = data;
 
+	os_set_thread_name("obs-ffmpeg: write_thread");
+	obs_apply_thread_settings(OBS_THREAD_ROLE_OUTPUT);
+
 	while (os_sem_wait(output->write_sem) == 0) {
 		/* check to see if shutting down */
 		if (os_event_try(output->stop_event) == 0)
@@ -958,10 +1074,26 @@ static bool try_connect(struct ffmpeg_output *output)
 		return false;
 	}
 
+	output->write_thread_active = true;
+
+	if (output->ff_data.video) {
+		output->encode_stopping = false;
+		ret = pthread_create(&output->encode_thread, NULL,
+				encode_thread, output);
+		if (ret != 0) {
+			blog(LOG_WARNING, "ffmpeg_output_start: failed to "
+			                  "create encode thread.");
+			ffmpeg_deactivate(output);
+			output->active = false;
+			return false;
+		}
+
+		output->encode_thread_active = true;
+	}
+
 	obs_output_set_video_conversion(output->output, NULL);
 	obs_output_set_audio_conversion(output->output, &aci);
 	obs_output_begin_data_capture(output->output, 0);
-	output->write_thread_active = true;
 	return true;
 }
 
@@ -1001,6 +1133,22 @@ static void ffmpeg_output_stop(void *data)
 
 static void ffmpeg_deactivate(struct ffmpeg_output *output)
 {
+	/* finish encoding first so its packets still get written */
+	if (output->encode_thread_active) {
+		pthread_mutex_lock(&output->video_mutex);
+		output->encode_stopping = true;
+		pthread_mutex_unlock(&output->video_mutex);
+
+		os_sem_post(output->encode_sem);
+		pthread_join(output->encode_thread, NULL);
+		output->encode_thread_active = false;
+	}
+
+	if (output->ff_data.dropped_frames)
+		blog(LOG_INFO, "ffmpeg_output: %d frames dropped because the "
+		               "encoder fell behind",
+		               output->ff_data.dropped_frames);
+
 	if (output->write_thread_active) {
 		os_event_signal(output->stop_event);
 		os_sem_post(output->write_sem);
@@ -1010,9 +1158,12 @@ static void ffmpeg_deactivate(struct ffmpeg_output *output)
 
 	pthread_mutex_lock(&output->write_mutex);
 
-	for (size_t i = 0; i < output->packets.num; i++)
-		av_free_packet(output->packets.array+i);
-	da_free(output->packets);
+	while (output->packets.size) {
+		AVPacket packet;
+		circlebuf_pop_front(&output->packets, &packet, sizeof(packet));
+		av_free_packet(&packet);
+	}
+	circlebuf_free(&output->packets);
 
 	pthread_mutex_unlock(&output->write_mutex);
 
@@ -1029,4 +1180,5 @@ struct obs_output_info ffmpeg_output = {
 	.stop      = ffmpeg_output_stop,
 	.raw_video = receive_video,
 	.raw_audio = receive_audio,
+	.get_dropped_frames = ffmpeg_output_dropped_frames,
 };
@@ -16,6 +16,7 @@
 
 #include <obs-module.h>
 #include <util/platform.h>
+#include <util/threading.h>
 
 #include "obs-ffmpeg-compat.h"
 #include "obs-ffmpeg-formats.h"
@@ -36,6 +37,7 @@ static bool video_frame(struct ff_frame *frame, void *opaque);
 static bool video_format(AVCodecContext *codec_context, void *opaque);
 
 struct ffmpeg_source {
+	pthread_mutex_t demuxer_mutex;
 	struct ff_demuxer *demuxer;
 	struct SwsContext *sws_ctx;
 	int sws_width;
@@ -47,6 +49,7 @@ struct ffmpeg_source {
 	bool is_forcing_scale;
 	bool is_hw_decoding;
 	bool is_clear_on_media_end;
+	bool is_preloading;
 };
 
 static bool set_obs_frame_colorprops(struct ff_frame *frame,
@@ -183,6 +186,26 @@ static bool video_frame_scale(struct ff_frame *frame,
 	return true;
 }
 
+static void release_av_frame(void *param)
+{
+	AVFrame *frame = param;
+	av_frame_free(&frame);
+}
+
+/* the decoded frame is referenced rather than copied into the source's frame
+ * cache; libobs lets go of the reference once the frame has been uploaded */
+static void output_av_frame(struct ffmpeg_source *s, AVFrame *frame,
+		struct obs_source_frame *obs_frame)
+{
+	AVFrame *ref = av_frame_clone(frame);
+
+	if (ref)
+		obs_source_output_video_ref(s->source, obs_frame,
+				release_av_frame, ref);
+	else
+		obs_source_output_video(s->source, obs_frame);
+}
+
 static bool video_frame_hwaccel(struct ff_frame *frame,
 		struct ffmpeg_source *s, struct obs_source_frame *obs_frame)
 {
@@ -195,7 +218,7 @@ static bool video_frame_hwaccel(struct ff_frame *frame,
 	if (!set_obs_frame_colorprops(frame, s, obs_frame))
 		return false;
 
-	obs_source_output_video(s->source, obs_frame);
+	output_av_frame(s, frame->frame, obs_frame);
 	return true;
 }
 
@@ -212,7 +235,7 @@ static bool video_frame_direct(struct ff_frame *frame,
 	if (!set_obs_frame_colorprops(frame, s, obs_frame))
 		return false;
 
-	obs_source_output_video(s->source, obs_frame);
+	output_av_frame(s, frame->frame, obs_frame);
 	return true;
 }
 
@@ -348,6 +371,9 @@ static obs_properties_t *ffmpeg_source_getproperties(void *data)
 	obs_properties_add_bool(props, "clear_on_media_end",
 			obs_module_text("ClearOnMediaEnd"));
 
+	obs_properties_add_bool(props, "preload",
+			obs_module_text("Preload"));
+
 	prop = obs_properties_add_bool(props, "advanced",
 			obs_module_text("Advanced"));
 
@@ -418,13 +444,15 @@ static void dump_source_info(struct ffmpeg_source *s, const char *input,
 			"\tis_looping:              %s\n"
 			"\tis_forcing_scale:        %s\n"
 			"\tis_hw_decoding:          %s\n"
-			"\tis_clear_on_media_end:   %s",
+			"\tis_clear_on_media_end:   %s\n"
+			"\tis_preloading:           %s",
 			input ? input : "(null)",
 			input_format ? input_format : "(null)",
 			s->demuxer->options.is_looping ? "yes" : "no",
 			s->is_forcing_scale ? "yes" : "no",
 			s->is_hw_decoding ? "yes" : "no",
-			s->is_clear_on_media_end ? "yes" : "no");
+			s->is_clear_on_media_end ? "yes" : "no",
+			s->is_preloading ? "yes" : "no");
 
 	if (!is_advanced)
 		return;
@@ -465,14 +493,23 @@ static void ffmpeg_source_update(void *data, obs_data_t *settings)
 	s->is_hw_decoding = obs_data_get_bool(settings, "hw_decode");
 	s->is_clear_on_media_end = obs_data_get_bool(settings,
 			"clear_on_media_end");
+	s->is_preloading = obs_data_get_bool(settings, "preload");
+
+	pthread_mutex_lock(&s->demuxer_mutex);
 
 	if (s->demuxer != NULL)
 		ff_demuxer_free(s->demuxer);
 
 	s->demuxer = ff_demuxer_init();
 	s->demuxer->options.is_hw_decoding = s->is_hw_decoding;
+	s->demuxer->options.is_tick_driven = true;
 	s->demuxer->options.is_looping = is_looping;
 
+	/* a preloaded source is opened and decoded ahead of time, but only
+	 * starts playing once it becomes active */
+	s->demuxer->options.is_preloading = s->is_preloading &&
+		!obs_source_active(s->source);
+
 	if (is_advanced) {
 		int audio_buffer_size = (int)obs_data_get_int(settings,
 				"audio_buffer_size");
@@ -514,6 +551,8 @@ static void ffmpeg_source_update(void *data, obs_data_t *settings)
 	dump_source_info(s, input, input_format, is_advanced);
 
 	ff_demuxer_open(s->demuxer, input, input_format);
+
+	pthread_mutex_unlock(&s->demuxer_mutex);
 }
 
 
@@ -530,15 +569,63 @@ static void *ffmpeg_source_create(obs_data_t *settings, obs_source_t *source)
 	struct ffmpeg_source *s = bzalloc(sizeof(struct ffmpeg_source));
 	s->source = source;
 
+	if (pthread_mutex_init(&s->demuxer_mutex, NULL) != 0) {
+		bfree(s);
+		return NULL;
+	}
+
 	ffmpeg_source_update(s, settings);
 	return s;
 }
 
+/* frames are presented from the video tick rather than from timer threads of
+ * every decoder, libobs then shows them according to their timestamps.  the
+ * tick is skipped while the demuxer is being replaced rather than waiting for
+ * its threads to stop. */
+static void ffmpeg_source_tick(void *data, float seconds)
+{
+	struct ffmpeg_source *s = data;
+
+	if (pthread_mutex_trylock(&s->demuxer_mutex) != 0)
+		return;
+
+	if (s->demuxer)
+		ff_demuxer_tick(s->demuxer);
+
+	pthread_mutex_unlock(&s->demuxer_mutex);
+
+	UNUSED_PARAMETER(seconds);
+}
+
+static void ffmpeg_source_activate(void *data)
+{
+	struct ffmpeg_source *s = data;
+
+	if (s->is_preloading)
+		ff_demuxer_play(s->demuxer);
+}
+
+static void ffmpeg_source_deactivate(void *data)
+{
+	struct ffmpeg_source *s = data;
+
+	if (s->is_preloading) {
+		obs_data_t *settings = obs_source_get_settings(s->source);
+
+		/* preload the start again for the next time it is shown, and
+		 * don't let the last frame flash up when that happens */
+		ffmpeg_source_update(s, settings);
+		obs_source_output_video(s->source, NULL);
+		obs_data_release(settings);
+	}
+}
+
 static void ffmpeg_source_destroy(void *data)
 {
 	struct ffmpeg_source *s = data;
 
 	ff_demuxer_free(s->demuxer);
+	pthread_mutex_destroy(&s->demuxer_mutex);
 
 	if (s->sws_ctx != NULL)
 		sws_freeContext(s->sws_ctx);
@@ -551,10 +638,14 @@ static void ffmpeg_source_destroy(void *data)
 struct obs_source_info ffmpeg_source = {
 	.id             = "ffmpeg_source",
 	.type           = OBS_SOURCE_TYPE_INPUT,
-	.output_flags   = OBS_SOURCE_ASYNC_VIDEO | OBS_SOURCE_AUDIO,
+	.output_flags   = OBS_SOURCE_ASYNC_VIDEO | OBS_SOURCE_AUDIO |
+	                  OBS_SOURCE_THREADED_CREATE,
 	.get_name       = ffmpeg_source_getname,
 	.create         = ffmpeg_source_create,
 	.destroy        = ffmpeg_source_destroy,
 	.get_properties = ffmpeg_source_getproperties,
+	.activate       = ffmpeg_source_activate,
+	.deactivate     = ffmpeg_source_deactivate,
+	.video_tick     = ffmpeg_source_tick,
 	.update         = ffmpeg_source_update
 };
@@ -9,8 +9,11 @@ OBS_MODULE_USE_DEFAULT_LOCALE("obs-ffmpeg", "en-US")
 extern struct obs_source_info  ffmpeg_source;
 extern struct obs_output_info  ffmpeg_output;
 extern struct obs_output_info  ffmpeg_muxer;
+extern struct obs_output_info  replay_buffer;
 extern struct obs_encoder_info aac_encoder_info;
 
+extern void register_hw_encoders(void);
+
 static DARRAY(struct log_context {
 	void *context;
 	char str[4096];
@@ -120,7 +123,9 @@ bool obs_module_load(void)
 	obs_register_source(&ffmpeg_source);
 	obs_register_output(&ffmpeg_output);
 	obs_register_output(&ffmpeg_muxer);
+	obs_register_output(&replay_buffer);
 	obs_register_encoder(&aac_encoder_info);
+	register_hw_encoders();
 	return true;
 }
 
@@ -1,5 +1,6 @@
 #include <obs-module.h>
 #include <util/circlebuf.h>
+#include <util/threading.h>
 
 #ifndef SEC_TO_NSEC
 #define SEC_TO_NSEC 1000000000ULL
@@ -10,8 +11,12 @@
 #endif
 
 #define SETTING_DELAY_MS               "delay_ms"
+#define SETTING_MAX_MEMORY_MB          "max_memory_mb"
 
 #define TEXT_DELAY_MS                  obs_module_text("DelayMs")
+#define TEXT_MAX_MEMORY_MB             obs_module_text("MaxMemoryMB")
+
+#define MB_TO_BYTES(mb)                ((uint64_t)(mb) * 1024ULL * 1024ULL)
 
 struct async_delay_data {
 	obs_source_t                   *context;
@@ -19,6 +24,13 @@ struct async_delay_data {
 	/* contains struct obs_source_frame* */
 	struct circlebuf               video_frames;
 
+	/* bytes of frame data held in video_frames, plus the frame count,
+	 * both readable from any thread */
+	volatile int64_t               cached_bytes;
+	volatile long                  cached_frames;
+	uint64_t                       max_bytes;
+	bool                           memory_warned;
+
 	/* stores the audio data */
 	struct circlebuf               audio_frames;
 	struct obs_audio_data          audio_output;
@@ -39,6 +51,97 @@ static const char *async_delay_filter_name(void *unused)
 	return obs_module_text("AsyncDelayFilter");
 }
 
+static size_t frame_data_size(const struct obs_source_frame *frame)
+{
+	size_t size = 0;
+
+	switch (frame->format) {
+	case VIDEO_FORMAT_I420:
+	case VIDEO_FORMAT_NV12:
+		size += frame->linesize[1] * (frame->height / 2);
+		size += frame->linesize[2] * (frame->height / 2);
+		break;
+	case VIDEO_FORMAT_I444:
+		size += frame->linesize[1] * frame->height;
+		size += frame->linesize[2] * frame->height;
+		break;
+	default:
+		break;
+	}
+
+	return size + frame->linesize[0] * frame->height;
+}
+
+static void copy_plane(struct obs_source_frame *dst,
+		const struct obs_source_frame *src, size_t plane,
+		uint32_t lines)
+{
+	uint32_t bytes = dst->linesize[plane] < src->linesize[plane] ?
+		dst->linesize[plane] : src->linesize[plane];
+
+	for (uint32_t y = 0; y < lines; y++)
+		memcpy(dst->data[plane] + y * dst->linesize[plane],
+				src->data[plane] + y * src->linesize[plane],
+				bytes);
+}
+
+/* frames that point into a device's own buffers (the ones with a release
+ * callback) would otherwise be kept from the device for the whole delay, so
+ * they are copied into a packed frame of the same format */
+static struct obs_source_frame *copy_external_frame(
+		const struct obs_source_frame *src)
+{
+	struct obs_source_frame *dst = obs_source_frame_create(src->format,
+			src->width, src->height);
+	if (!dst->data[0]) {
+		obs_source_frame_destroy(dst);
+		return NULL;
+	}
+
+	dst->timestamp  = src->timestamp;
+	dst->full_range = src->full_range;
+	dst->flip       = src->flip;
+	dst->refs       = 1;
+	memcpy(dst->color_matrix, src->color_matrix,
+			sizeof(dst->color_matrix));
+	memcpy(dst->color_range_min, src->color_range_min,
+			sizeof(dst->color_range_min));
+	memcpy(dst->color_range_max, src->color_range_max,
+			sizeof(dst->color_range_max));
+
+	switch (src->format) {
+	case VIDEO_FORMAT_I420:
+		copy_plane(dst, src, 0, src->height);
+		copy_plane(dst, src, 1, src->height / 2);
+		copy_plane(dst, src, 2, src->height / 2);
+		break;
+	case VIDEO_FORMAT_NV12:
+		copy_plane(dst, src, 0, src->height);
+		copy_plane(dst, src, 1, src->height / 2);
+		break;
+	case VIDEO_FORMAT_I444:
+		copy_plane(dst, src, 0, src->height);
+		copy_plane(dst, src, 1, src->height);
+		copy_plane(dst, src, 2, src->height);
+		break;
+	default:
+		copy_plane(dst, src, 0, src->height);
+	}
+
+	return dst;
+}
+
+static inline void account_frame(struct async_delay_data *filter,
+		const struct obs_source_frame *frame, int sign)
+{
+	os_atomic_add_int64(&filter->cached_bytes,
+			sign * (int64_t)frame_data_size(frame));
+	if (sign > 0)
+		os_atomic_inc_long(&filter->cached_frames);
+	else
+		os_atomic_dec_long(&filter->cached_frames);
+}
+
 static void free_video_data(struct async_delay_data *filter,
 		obs_source_t *parent)
 {
@@ -47,8 +150,11 @@ static void free_video_data(struct async_delay_data *filter,
 
 		circlebuf_pop_front(&filter->video_frames, &frame,
 				sizeof(struct obs_source_frame*));
+		account_frame(filter, frame, -1);
 		obs_source_release_frame(parent, frame);
 	}
+
+	filter->memory_warned = false;
 }
 
 static inline void free_audio_packet(struct obs_audio_data *audio)
@@ -78,6 +184,9 @@ static void async_delay_filter_update(void *data, obs_data_t *settings)
 	if (new_interval < filter->interval)
 		free_video_data(filter, obs_filter_get_parent(filter->context));
 
+	filter->max_bytes = MB_TO_BYTES(obs_data_get_int(settings,
+				SETTING_MAX_MEMORY_MB));
+	filter->memory_warned = false;
 	filter->reset_audio = true;
 	filter->reset_video = true;
 	filter->interval = new_interval;
@@ -85,10 +194,21 @@ static void async_delay_filter_update(void *data, obs_data_t *settings)
 	filter->audio_delay_reached = false;
 }
 
+static void async_delay_filter_memory_proc(void *data, calldata_t *cd)
+{
+	struct async_delay_data *filter = data;
+
+	calldata_set_int(cd, "bytes",
+			os_atomic_add_int64(&filter->cached_bytes, 0));
+	calldata_set_int(cd, "frames",
+			os_atomic_load_long(&filter->cached_frames));
+}
+
 static void *async_delay_filter_create(obs_data_t *settings,
 		obs_source_t *context)
 {
 	struct async_delay_data *filter = bzalloc(sizeof(*filter));
+	proc_handler_t *ph = obs_source_get_proc_handler(context);
 	struct obs_audio_info oai;
 
 	filter->context = context;
@@ -97,6 +217,9 @@ static void *async_delay_filter_create(obs_data_t *settings,
 	obs_get_audio_info(&oai);
 	filter->samplerate = oai.samples_per_sec;
 
+	proc_handler_add(ph,
+			"void get_memory_usage(out int bytes, out int frames)",
+			async_delay_filter_memory_proc, filter);
 	return filter;
 }
 
@@ -116,11 +239,18 @@ static obs_properties_t *async_delay_filter_properties(void *data)
 
 	obs_properties_add_int(props, SETTING_DELAY_MS, TEXT_DELAY_MS,
 			0, 6000, 1);
+	obs_properties_add_int(props, SETTING_MAX_MEMORY_MB,
+			TEXT_MAX_MEMORY_MB, 16, 16384, 16);
 
 	UNUSED_PARAMETER(data);
 	return props;
 }
 
+static void async_delay_filter_defaults(obs_data_t *settings)
+{
+	obs_data_set_default_int(settings, SETTING_MAX_MEMORY_MB, 2048);
+}
+
 static void async_delay_filter_remove(void *data, obs_source_t *parent)
 {
 	struct async_delay_data *filter = data;
@@ -145,30 +275,76 @@ static struct obs_source_frame *async_delay_filter_video(void *data,
 	obs_source_t *parent = obs_filter_get_parent(filter->context);
 	struct obs_source_frame *output;
 	uint64_t cur_interval;
+	uint64_t timestamp = frame->timestamp;
+	uint64_t cached;
+	bool dropped = false;
 
 	if (filter->reset_video ||
-	    is_timestamp_jump(frame->timestamp, filter->last_video_ts)) {
+	    is_timestamp_jump(timestamp, filter->last_video_ts)) {
 		free_video_data(filter, parent);
 		filter->video_delay_reached = false;
 		filter->reset_video = false;
 	}
 
-	filter->last_video_ts = frame->timestamp;
+	filter->last_video_ts = timestamp;
+
+	cached = (uint64_t)os_atomic_add_int64(&filter->cached_bytes, 0);
+
+	/* past the memory limit, incoming frames are dropped instead of
+	 * stored; the delay still holds, the output just gets choppier */
+	if (cached + frame_data_size(frame) > filter->max_bytes) {
+		if (!filter->memory_warned) {
+			blog(LOG_WARNING, "[async_delay: '%s'] Delay needs "
+					"more than %d MB, dropping frames",
+					obs_source_get_name(filter->context),
+					(int)(filter->max_bytes /
+						MB_TO_BYTES(1)));
+			filter->memory_warned = true;
+		}
+
+		obs_source_release_frame(parent, frame);
+		dropped = true;
+
+	} else {
+		if (frame->release) {
+			struct obs_source_frame *copy =
+				copy_external_frame(frame);
+			obs_source_release_frame(parent, frame);
+			frame = copy;
+		}
+
+		if (!frame)
+			return NULL;
+
+		account_frame(filter, frame, 1);
+		circlebuf_push_back(&filter->video_frames, &frame,
+				sizeof(struct obs_source_frame*));
+	}
+
+	if (!filter->video_frames.size)
+		return NULL;
 
-	circlebuf_push_back(&filter->video_frames, &frame,
-			sizeof(struct obs_source_frame*));
 	circlebuf_peek_front(&filter->video_frames, &output,
 			sizeof(struct obs_source_frame*));
 
-	cur_interval = frame->timestamp - output->timestamp;
-	if (!filter->video_delay_reached && cur_interval < filter->interval)
+	cur_interval = timestamp - output->timestamp;
+	if ((!filter->video_delay_reached || dropped) &&
+	    cur_interval < filter->interval)
 		return NULL;
 
 	circlebuf_pop_front(&filter->video_frames, NULL,
 			sizeof(struct obs_source_frame*));
-
-	if (!filter->video_delay_reached)
+	account_frame(filter, output, -1);
+
+	if (!filter->video_delay_reached) {
+		blog(LOG_INFO, "[async_delay: '%s'] Delay reached, holding "
+				"%ld frames (%d MB)",
+				obs_source_get_name(filter->context),
+				os_atomic_load_long(&filter->cached_frames),
+				(int)(os_atomic_add_int64(&filter->cached_bytes,
+						0) / MB_TO_BYTES(1)));
 		filter->video_delay_reached = true;
+	}
 
 	return output;
 }
@@ -236,6 +412,7 @@ struct obs_source_info async_delay_filter = {
 	.destroy                       = async_delay_filter_destroy,
 	.update                        = async_delay_filter_update,
 	.get_properties                = async_delay_filter_properties,
+	.get_defaults                  = async_delay_filter_defaults,
 	.filter_video                  = async_delay_filter_video,
 #ifdef DELAY_AUDIO
 	.filter_audio                  = async_delay_filter_audio,
@@ -195,7 +195,7 @@ static void chroma_key_render(void *data, gs_effect_t *effect)
 	struct vec2 pixel_size;
 
 	obs_source_process_filter_begin(filter->context, GS_RGBA,
-			OBS_ALLOW_DIRECT_RENDERING);
+			OBS_ALLOW_DIRECT_YUV_RENDERING);
 
 	vec2_set(&pixel_size, 1.0f / (float)width, 1.0f / (float)height);
 
@@ -34,6 +34,20 @@ struct color_filter_data {
 	float                          gamma;
 };
 
+/* same as color_filter.effect, for fusing with neighbouring filters */
+static const char *color_filter_snippet =
+"uniform float4 $color;\n"
+"uniform float $contrast;\n"
+"uniform float $brightness;\n"
+"uniform float $gamma;\n"
+"\n"
+"float4 $process(float4 rgba)\n"
+"{\n"
+"\trgba *= $color;\n"
+"\treturn float4(pow(rgba.rgb, float3($gamma, $gamma, $gamma)) *\n"
+"\t\t\t$contrast + $brightness, rgba.a);\n"
+"}\n";
+
 static const char *color_filter_name(void *unused)
 {
 	UNUSED_PARAMETER(unused);
@@ -120,7 +134,7 @@ static void color_filter_render(void *data, gs_effect_t *effect)
 	struct color_filter_data *filter = data;
 
 	obs_source_process_filter_begin(filter->context, GS_RGBA,
-			OBS_ALLOW_DIRECT_RENDERING);
+			OBS_ALLOW_DIRECT_YUV_RENDERING);
 
 	gs_effect_set_vec4(filter->color_param, &filter->color);
 	gs_effect_set_float(filter->contrast_param, filter->contrast);
@@ -132,6 +146,27 @@ static void color_filter_render(void *data, gs_effect_t *effect)
 	UNUSED_PARAMETER(effect);
 }
 
+static const char *color_filter_get_snippet(void *data)
+{
+	UNUSED_PARAMETER(data);
+	return color_filter_snippet;
+}
+
+static void color_filter_update_fused(void *data, gs_effect_t *effect,
+		const char *prefix)
+{
+	struct color_filter_data *filter = data;
+
+	gs_effect_set_vec4(obs_filter_get_fused_param(effect, prefix, "color"),
+			&filter->color);
+	gs_effect_set_float(obs_filter_get_fused_param(effect, prefix,
+				"contrast"), filter->contrast);
+	gs_effect_set_float(obs_filter_get_fused_param(effect, prefix,
+				"brightness"), filter->brightness);
+	gs_effect_set_float(obs_filter_get_fused_param(effect, prefix,
+				"gamma"), filter->gamma);
+}
+
 static obs_properties_t *color_filter_properties(void *data)
 {
 	obs_properties_t *props = obs_properties_create();
@@ -169,5 +204,7 @@ struct obs_source_info color_filter = {
 	.video_render                  = color_filter_render,
 	.update                        = color_filter_update,
 	.get_properties                = color_filter_properties,
-	.get_defaults                  = color_filter_defaults
+	.get_defaults                  = color_filter_defaults,
+	.get_fusion_snippet            = color_filter_get_snippet,
+	.update_fused_params           = color_filter_update_fused
 };
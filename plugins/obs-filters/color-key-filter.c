@@ -45,6 +45,25 @@ struct color_key_filter_data {
 	float                          smoothness;
 };
 
+/* same as color_key_filter.effect, for fusing with neighbouring filters */
+static const char *color_key_snippet =
+"uniform float4 $color;\n"
+"uniform float $contrast;\n"
+"uniform float $brightness;\n"
+"uniform float $gamma;\n"
+"uniform float4 $key_color;\n"
+"uniform float $similarity;\n"
+"uniform float $smoothness;\n"
+"\n"
+"float4 $process(float4 rgba)\n"
+"{\n"
+"\trgba *= $color;\n"
+"\tfloat dist = distance($key_color.rgb, rgba.rgb);\n"
+"\trgba.a *= saturate(max(dist - $similarity, 0.0) / $smoothness);\n"
+"\treturn float4(pow(rgba.rgb, float3($gamma, $gamma, $gamma)) *\n"
+"\t\t\t$contrast + $brightness, rgba.a);\n"
+"}\n";
+
 static const char *color_key_name(void *unused)
 {
 	UNUSED_PARAMETER(unused);
@@ -167,7 +186,7 @@ static void color_key_render(void *data, gs_effect_t *effect)
 	struct color_key_filter_data *filter = data;
 
 	obs_source_process_filter_begin(filter->context, GS_RGBA,
-			OBS_ALLOW_DIRECT_RENDERING);
+			OBS_ALLOW_DIRECT_YUV_RENDERING);
 
 	gs_effect_set_vec4(filter->color_param, &filter->color);
 	gs_effect_set_float(filter->contrast_param, filter->contrast);
@@ -182,6 +201,33 @@ static void color_key_render(void *data, gs_effect_t *effect)
 	UNUSED_PARAMETER(effect);
 }
 
+static const char *color_key_get_snippet(void *data)
+{
+	UNUSED_PARAMETER(data);
+	return color_key_snippet;
+}
+
+static void color_key_update_fused(void *data, gs_effect_t *effect,
+		const char *prefix)
+{
+	struct color_key_filter_data *filter = data;
+
+	gs_effect_set_vec4(obs_filter_get_fused_param(effect, prefix, "color"),
+			&filter->color);
+	gs_effect_set_float(obs_filter_get_fused_param(effect, prefix,
+				"contrast"), filter->contrast);
+	gs_effect_set_float(obs_filter_get_fused_param(effect, prefix,
+				"brightness"), filter->brightness);
+	gs_effect_set_float(obs_filter_get_fused_param(effect, prefix,
+				"gamma"), filter->gamma);
+	gs_effect_set_vec4(obs_filter_get_fused_param(effect, prefix,
+				"key_color"), &filter->key_color);
+	gs_effect_set_float(obs_filter_get_fused_param(effect, prefix,
+				"similarity"), filter->similarity);
+	gs_effect_set_float(obs_filter_get_fused_param(effect, prefix,
+				"smoothness"), filter->smoothness);
+}
+
 static bool key_type_changed(obs_properties_t *props, obs_property_t *p,
 		obs_data_t *settings)
 {
@@ -251,5 +297,7 @@ struct obs_source_info color_key_filter = {
 	.video_render                  = color_key_render,
 	.update                        = color_key_update,
 	.get_properties                = color_key_properties,
-	.get_defaults                  = color_key_defaults
+	.get_defaults                  = color_key_defaults,
+	.get_fusion_snippet            = color_key_get_snippet,
+	.update_fused_params           = color_key_update_fused
 };
@@ -127,7 +127,8 @@ static void crop_filter_defaults(obs_data_t *settings)
 }
 
 static void calc_crop_dimensions(struct crop_filter_data *filter,
-		struct vec2 *mul_val, struct vec2 *add_val)
+		struct vec2 *mul_val, struct vec2 *add_val,
+		struct obs_source_crop *crop)
 {
 	obs_source_t *target = obs_filter_get_target(filter->context);
 	uint32_t width;
@@ -173,17 +174,29 @@ static void calc_crop_dimensions(struct crop_filter_data *filter,
 		mul_val->y = (float)filter->height / (float)height;
 		add_val->y = (float)filter->top / (float)height;
 	}
+
+	crop->left   = filter->left;
+	crop->top    = filter->top;
+	crop->right  = (int)width  - filter->left - (int)filter->width;
+	crop->bottom = (int)height - filter->top  - (int)filter->height;
 }
 
 static void crop_filter_render(void *data, gs_effect_t *effect)
 {
 	struct crop_filter_data *filter = data;
+	struct obs_source_crop crop;
 	struct vec2 mul_val;
 	struct vec2 add_val;
 
 	vec2_zero(&mul_val);
 	vec2_zero(&add_val);
-	calc_crop_dimensions(filter, &mul_val, &add_val);
+	calc_crop_dimensions(filter, &mul_val, &add_val, &crop);
+
+	/* sources that can be cropped through their texture coordinates
+	 * don't need the intermediate texture */
+	if (obs_source_video_render_crop(obs_filter_get_target(filter->context),
+				&crop))
+		return;
 
 	obs_source_process_filter_begin(filter->context, GS_RGBA,
 			OBS_NO_DIRECT_RENDERING);
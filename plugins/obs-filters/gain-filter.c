@@ -1,5 +1,6 @@
 #include <obs-module.h>
 #include <media-io/audio-math.h>
+#include <media-io/audio-kernels.h>
 #include <math.h>
 
 #define do_log(level, format, ...) \
@@ -56,11 +57,8 @@ static struct obs_audio_data *gain_filter_audio(void *data,
 	const float multiple = gf->multiple;
 
 	for (size_t c = 0; c < 2; c++) {
-		if (audio->data[c]) {
-			for (size_t i = 0; i < audio->frames; i++) {
-				adata[c][i] *= multiple;
-			}
-		}
+		if (audio->data[c])
+			audio_mul_float(adata[c], multiple, audio->frames);
 	}
 
 	return audio;
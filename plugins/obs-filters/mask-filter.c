@@ -17,6 +17,8 @@
 struct mask_filter_data {
 	obs_source_t                   *context;
 	gs_effect_t                    *effect;
+	struct gs_eparam_ref           target_param;
+	struct gs_eparam_ref           color_param;
 
 	gs_texture_t                   *target;
 	struct vec4                    color;
@@ -36,16 +38,32 @@ static void mask_filter_update(void *data, obs_data_t *settings)
 	const char *effect_file = obs_data_get_string(settings, SETTING_TYPE);
 	uint32_t color = (uint32_t)obs_data_get_int(settings, SETTING_COLOR);
 	int opacity = (int)obs_data_get_int(settings, SETTING_OPACITY);
+	struct gs_texture_data texdata = {0};
 	char *effect_path;
 
 	color |= (uint32_t)(((double)opacity) * 2.55) << 24;
 
 	vec4_from_rgba(&filter->color, color);
 
+	/* decode and build the mipmaps outside of the graphics context.  the
+	 * mask isn't compressed, its edges and gradients are the whole point */
+	if (path && *path) {
+		enum gs_color_format format = GS_BGRA;
+		uint32_t cx = 0, cy = 0;
+		uint8_t *image = gs_create_texture_file_data(path, &format,
+				&cx, &cy);
+
+		if (image) {
+			gs_texture_data_init(&texdata, image, format, cx, cy,
+					GS_TEXDATA_MIPMAPS);
+			bfree(image);
+		}
+	}
+
 	obs_enter_graphics();
 
 	gs_texture_destroy(filter->target);
-	filter->target = (path) ? gs_texture_create_from_file(path) : NULL;
+	filter->target = gs_texture_create_from_data(&texdata);
 
 	effect_path = obs_module_file(effect_file);
 	gs_effect_destroy(filter->effect);
@@ -53,6 +71,8 @@ static void mask_filter_update(void *data, obs_data_t *settings)
 	bfree(effect_path);
 
 	obs_leave_graphics();
+
+	gs_texture_data_free(&texdata);
 }
 
 static void mask_filter_defaults(obs_data_t *settings)
@@ -140,12 +160,14 @@ static void mask_filter_render(void *data, gs_effect_t *effect)
 	}
 
 	obs_source_process_filter_begin(filter->context, GS_RGBA,
-			OBS_ALLOW_DIRECT_RENDERING);
+			OBS_ALLOW_DIRECT_YUV_RENDERING);
 
-	param = gs_effect_get_param_by_name(filter->effect, "target");
+	param = gs_effect_get_param_ref(filter->effect, &filter->target_param,
+			"target");
 	gs_effect_set_texture(param, filter->target);
 
-	param = gs_effect_get_param_by_name(filter->effect, "color");
+	param = gs_effect_get_param_ref(filter->effect, &filter->color_param,
+			"color");
 	gs_effect_set_vec4(param, &filter->color);
 
 	obs_source_process_filter_end(filter->context, filter->effect, 0, 0);
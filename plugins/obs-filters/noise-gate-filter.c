@@ -1,4 +1,5 @@
 #include <media-io/audio-math.h>
+#include <media-io/audio-kernels.h>
 #include <obs-module.h>
 #include <math.h>
 
@@ -104,12 +105,15 @@ static void *noise_gate_create(obs_data_t *settings, obs_source_t *filter)
 	return ng;
 }
 
+/* samples of envelope and gain computed at a time */
+#define GATE_BLOCK_SIZE 256
+
 static struct obs_audio_data *noise_gate_filter_audio(void *data,
 		struct obs_audio_data *audio)
 {
 	struct noise_gate_data *ng = data;
 
-	float *adata[2] = {(float*)audio->data[0], (float*)audio->data[1]};
+	float *adata[MAX_AV_PLANES];
 	const float close_threshold = ng->close_threshold;
 	const float open_threshold = ng->open_threshold;
 	const float sample_rate_i = ng->sample_rate_i;
@@ -119,34 +123,61 @@ static struct obs_audio_data *noise_gate_filter_audio(void *data,
 	const float hold_time = ng->hold_time;
 	const size_t channels = ng->channels;
 
-	for (size_t i = 0; i < audio->frames; i++) {
-		float cur_level = (channels == 2)
-			? fmaxf(fabsf(adata[0][i]), fabsf(adata[1][i]))
-			: fabsf(adata[0][i]);
+	float levels[GATE_BLOCK_SIZE];
+	float gains[GATE_BLOCK_SIZE];
 
-		if (cur_level > open_threshold && !ng->is_open) {
-			ng->is_open = true;
-		}
-		if (ng->level < close_threshold && ng->is_open) {
-			ng->held_time = 0.0f;
-			ng->is_open = false;
-		}
+	for (size_t c = 0; c < MAX_AV_PLANES; c++)
+		adata[c] = (float*)audio->data[c];
+
+	for (size_t start = 0; start < audio->frames;
+			start += GATE_BLOCK_SIZE) {
+		size_t count = audio->frames - start;
+		bool unity = true;
+
+		if (count > GATE_BLOCK_SIZE)
+			count = GATE_BLOCK_SIZE;
+
+		/* peak of the channels for each sample */
+		memset(levels, 0, count * sizeof(float));
+		audio_max_abs_float(levels, adata[0] + start, count);
+		if (channels == 2)
+			audio_max_abs_float(levels, adata[1] + start, count);
 
-		ng->level = fmaxf(ng->level, cur_level) - decay_rate;
+		for (size_t i = 0; i < count; i++) {
+			float cur_level = levels[i];
 
-		if (ng->is_open) {
-			ng->attenuation = fminf(1.0f,
-					ng->attenuation + attack_rate);
-		} else {
-			ng->held_time += sample_rate_i;
-			if (ng->held_time > hold_time) {
-				ng->attenuation = fmaxf(0.0f,
-						ng->attenuation - release_rate);
+			if (cur_level > open_threshold && !ng->is_open) {
+				ng->is_open = true;
 			}
+			if (ng->level < close_threshold && ng->is_open) {
+				ng->held_time = 0.0f;
+				ng->is_open = false;
+			}
+
+			ng->level = fmaxf(ng->level, cur_level) - decay_rate;
+
+			if (ng->is_open) {
+				ng->attenuation = fminf(1.0f,
+						ng->attenuation + attack_rate);
+			} else {
+				ng->held_time += sample_rate_i;
+				if (ng->held_time > hold_time) {
+					ng->attenuation = fmaxf(0.0f,
+							ng->attenuation -
+							release_rate);
+				}
+			}
+
+			gains[i] = ng->attenuation;
+			unity = unity && ng->attenuation == 1.0f;
 		}
 
+		/* a fully open gate leaves the block untouched */
+		if (unity)
+			continue;
+
 		for (size_t c = 0; c < channels; c++)
-			adata[c][i] *= ng->attenuation;
+			audio_mul_float_buffer(adata[c] + start, gains, count);
 	}
 
 	return audio;
@@ -81,7 +81,7 @@ static void sharpness_render(void *data, gs_effect_t *effect)
 	if (!obs_filter_get_target(filter->context)) return;
 
 	obs_source_process_filter_begin(filter->context, GS_RGBA,
-		OBS_ALLOW_DIRECT_RENDERING);
+		OBS_ALLOW_DIRECT_YUV_RENDERING);
 
 	filter->texwidth =(float)obs_source_get_width(
 			obs_filter_get_target(filter->context));
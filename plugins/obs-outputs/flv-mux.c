@@ -42,30 +42,31 @@ static inline double encoder_bitrate(obs_encoder_t *encoder)
 
 #define FLV_INFO_SIZE_OFFSET 42
 
-void write_file_info(FILE *file, int64_t duration_ms, int64_t size)
+void write_file_info(struct serializer *s, int64_t duration_ms, int64_t size)
 {
 	char buf[64];
 	char *enc = buf;
 	char *end = enc + sizeof(buf);
 
-	fseek(file, FLV_INFO_SIZE_OFFSET, SEEK_SET);
+	serializer_seek(s, FLV_INFO_SIZE_OFFSET, SERIALIZE_SEEK_START);
 
 	enc_num_val(&enc, end, "duration", (double)duration_ms / 1000.0);
 	enc_num_val(&enc, end, "fileSize", (double)size);
 
-	fwrite(buf, 1, enc - buf, file);
+	s_write(s, buf, enc - buf);
 }
 
+#define FLV_META_DATA_MAX_SIZE 4096
+
 static bool build_flv_meta_data(obs_output_t *context,
-		uint8_t **output, size_t *size, size_t a_idx)
+		char *buf, size_t *size, size_t a_idx)
 {
 	obs_encoder_t *vencoder = obs_output_get_video_encoder(context);
 	obs_encoder_t *aencoder = obs_output_get_audio_encoder(context, a_idx);
 	video_t       *video    = obs_encoder_video(vencoder);
 	audio_t       *audio    = obs_encoder_audio(aencoder);
-	char buf[4096];
 	char *enc = buf;
-	char *end = enc+sizeof(buf);
+	char *end = enc+FLV_META_DATA_MAX_SIZE;
 	struct dstr encoder_name = {0};
 
 	if (a_idx > 0 && !aencoder)
@@ -125,7 +126,6 @@ static bool build_flv_meta_data(obs_output_t *context,
 	*enc++  = AMF_OBJECT_END;
 
 	*size   = enc-buf;
-	*output = bmemdup(buf, *size);
 	return true;
 }
 
@@ -134,17 +134,15 @@ bool flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 {
 	struct array_output_data data;
 	struct serializer s;
-	uint8_t *meta_data = NULL;
-	size_t  meta_data_size;
+	char     meta_data[FLV_META_DATA_MAX_SIZE];
+	size_t   meta_data_size;
 	uint32_t start_pos;
 
-	array_output_serializer_init(&s, &data);
-
-	if (!build_flv_meta_data(context, &meta_data, &meta_data_size,
-				audio_idx)) {
-		bfree(meta_data);
+	if (!build_flv_meta_data(context, meta_data, &meta_data_size,
+				audio_idx))
 		return false;
-	}
+
+	array_output_serializer_init(&s, &data);
 
 	if (write_header) {
 		s_write(&s, "FLV", 3);
@@ -168,8 +166,6 @@ bool flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 
 	*output = data.bytes.array;
 	*size   = data.bytes.num;
-
-	bfree(meta_data);
 	return true;
 }
 
@@ -245,18 +241,37 @@ static void flv_audio(struct serializer *s, struct encoder_packet *packet,
 	s_wb32(s, (uint32_t)serializer_get_pos(s) + 4 - 1);
 }
 
-void flv_packet_mux(struct encoder_packet *packet,
-		uint8_t **output, size_t *size, bool is_header)
+void flv_packet_mux_buffer(struct encoder_packet *packet,
+		struct array_output_data *output, bool is_header)
 {
-	struct array_output_data data;
 	struct serializer s;
+	size_t size = packet->size + 32;
 
-	array_output_serializer_init(&s, &data);
+	/* don't hold on to the allocation of a rare huge packet (e.g. a
+	 * keyframe after a scene change) for the rest of the output */
+	if (output->bytes.capacity > FLV_MUX_BUFFER_KEEP_SIZE &&
+	    output->bytes.capacity > size)
+		array_output_serializer_free(output);
+
+	array_output_serializer_reset(&s, output);
+
+	/* the tag header, payload and tag size always fit in this, so the
+	 * buffer only ever grows once per larger packet size */
+	if (output->bytes.capacity < size)
+		da_reserve(output->bytes, size);
 
 	if (packet->type == OBS_ENCODER_VIDEO)
 		flv_video(&s, packet, is_header);
 	else
 		flv_audio(&s, packet, is_header);
+}
+
+void flv_packet_mux(struct encoder_packet *packet,
+		uint8_t **output, size_t *size, bool is_header)
+{
+	struct array_output_data data = {0};
+
+	flv_packet_mux_buffer(packet, &data, is_header);
 
 	*output = data.bytes.array;
 	*size   = data.bytes.num;
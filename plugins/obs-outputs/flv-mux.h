@@ -18,6 +18,7 @@
 #pragma once
 
 #include <obs.h>
+#include <util/array-serializer.h>
 
 #define MILLISECOND_DEN   1000
 
@@ -26,9 +27,20 @@ static uint32_t get_ms_time(struct encoder_packet *packet, int64_t val)
 	return (uint32_t)(val * MILLISECOND_DEN / packet->timebase_den);
 }
 
-extern void write_file_info(FILE *file, int64_t duration_ms, int64_t size);
+extern void write_file_info(struct serializer *s, int64_t duration_ms,
+		int64_t size);
 
 extern bool flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 		bool write_header, size_t audio_idx);
 extern void flv_packet_mux(struct encoder_packet *packet,
 		uint8_t **output, size_t *size, bool is_header);
+
+/* allocations up to this size are kept by flv_packet_mux_buffer */
+#define FLV_MUX_BUFFER_KEEP_SIZE (1024 * 1024)
+
+/* muxes into a caller-owned buffer, replacing its contents.  the buffer's
+ * allocation is kept between calls (up to FLV_MUX_BUFFER_KEEP_SIZE) so
+ * steady-state muxing allocates nothing; free it with
+ * array_output_serializer_free when the output stops */
+extern void flv_packet_mux_buffer(struct encoder_packet *packet,
+		struct array_output_data *output, bool is_header);
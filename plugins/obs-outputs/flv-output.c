@@ -20,6 +20,7 @@
 #include <obs-avc.h>
 #include <util/platform.h>
 #include <util/dstr.h>
+#include <util/file-serializer.h>
 #include <util/threading.h>
 #include <inttypes.h>
 #include "flv-mux.h"
@@ -34,10 +35,16 @@
 struct flv_output {
 	obs_output_t *output;
 	struct dstr  path;
-	FILE         *file;
 	bool         active;
 	bool         sent_headers;
 	int64_t      last_packet_ts;
+
+	struct array_output_data mux_buffer;
+
+	/* written to disk on a separate thread, see
+	 * buffered_file_output_serializer_init */
+	struct serializer        file;
+	bool                     write_failed;
 };
 
 static const char *flv_output_getname(void *unused)
@@ -56,6 +63,7 @@ static void flv_output_destroy(void *data)
 		flv_output_stop(data);
 
 	dstr_free(&stream->path);
+	array_output_serializer_free(&stream->mux_buffer);
 	bfree(stream);
 }
 
@@ -73,12 +81,12 @@ static void flv_output_stop(void *data)
 	struct flv_output *stream = data;
 
 	if (stream->active) {
-		if (stream->file)
-			write_file_info(stream->file, stream->last_packet_ts,
-					os_ftelli64(stream->file));
+		write_file_info(&stream->file, stream->last_packet_ts,
+				serializer_get_pos(&stream->file));
 
-		fclose(stream->file);
+		buffered_file_output_serializer_free(&stream->file);
 		obs_output_end_data_capture(stream->output);
+		array_output_serializer_free(&stream->mux_buffer);
 		stream->active = false;
 		stream->sent_headers = false;
 
@@ -89,17 +97,22 @@ static void flv_output_stop(void *data)
 static int write_packet(struct flv_output *stream,
 		struct encoder_packet *packet, bool is_header)
 {
-	uint8_t *data;
-	size_t  size;
-	int     ret = 0;
+	struct array_output_data *buf = &stream->mux_buffer;
+	int ret = 0;
 
 	stream->last_packet_ts = get_ms_time(packet, packet->dts);
 
-	flv_packet_mux(packet, &data, &size, is_header);
-	fwrite(data, 1, size, stream->file);
-	bfree(data);
+	flv_packet_mux_buffer(packet, buf, is_header);
+	s_write(&stream->file, buf->bytes.array, buf->bytes.num);
 	obs_free_encoder_packet(packet);
 
+	if (!stream->write_failed &&
+	    buffered_file_output_serializer_failed(&stream->file)) {
+		warn("Failed to write to '%s'", stream->path.array);
+		stream->write_failed = true;
+		ret = -1;
+	}
+
 	return ret;
 }
 
@@ -109,7 +122,7 @@ static void write_meta_data(struct flv_output *stream)
 	size_t  meta_data_size;
 
 	flv_meta_data(stream->output, &meta_data, &meta_data_size, true, 0);
-	fwrite(meta_data, 1, meta_data_size, stream->file);
+	s_write(&stream->file, meta_data, meta_data_size);
 	bfree(meta_data);
 }
 
@@ -154,11 +167,23 @@ static void write_headers(struct flv_output *stream)
 	write_video_header(stream);
 }
 
+static void flv_output_watermark(void *data, bool full)
+{
+	struct flv_output *stream = data;
+
+	if (full)
+		warn("Disk is not keeping up, write buffer is filling up");
+	else
+		info("Write buffer has drained");
+}
+
 static bool flv_output_start(void *data)
 {
 	struct flv_output *stream = data;
 	obs_data_t *settings;
 	const char *path;
+	size_t buffer_size;
+	uint64_t prealloc_size;
 
 	if (!obs_output_can_begin_data_capture(stream->output, 0))
 		return false;
@@ -169,14 +194,23 @@ static bool flv_output_start(void *data)
 	settings = obs_output_get_settings(stream->output);
 	path = obs_data_get_string(settings, "path");
 	dstr_copy(&stream->path, path);
+	buffer_size = (size_t)obs_data_get_int(settings, "buffer_size_mb") *
+		1024 * 1024;
+	prealloc_size = (uint64_t)obs_data_get_int(settings, "prealloc_mb") *
+		1024 * 1024;
 	obs_data_release(settings);
 
-	stream->file = os_fopen(stream->path.array, "wb");
-	if (!stream->file) {
+	if (!buffered_file_output_serializer_init(&stream->file,
+				stream->path.array, buffer_size,
+				prealloc_size)) {
 		warn("Unable to open FLV file '%s'", stream->path.array);
 		return false;
 	}
 
+	buffered_file_output_serializer_set_watermark(&stream->file,
+			buffer_size / 4 * 3, flv_output_watermark, stream);
+	stream->write_failed = false;
+
 	/* write headers and start capture */
 	stream->active = true;
 	obs_output_begin_data_capture(stream->output, 0);
@@ -204,6 +238,12 @@ static void flv_output_data(void *data, struct encoder_packet *packet)
 	}
 }
 
+static void flv_output_defaults(obs_data_t *defaults)
+{
+	obs_data_set_default_int(defaults, "buffer_size_mb", 64);
+	obs_data_set_default_int(defaults, "prealloc_mb", 0);
+}
+
 static obs_properties_t *flv_output_properties(void *unused)
 {
 	UNUSED_PARAMETER(unused);
@@ -225,5 +265,6 @@ struct obs_output_info flv_output_info = {
 	.start          = flv_output_start,
 	.stop           = flv_output_stop,
 	.encoded_packet = flv_output_data,
+	.get_defaults   = flv_output_defaults,
 	.get_properties = flv_output_properties
 };
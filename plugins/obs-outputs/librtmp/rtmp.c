@@ -379,6 +379,7 @@ RTMP_Init(RTMP *r)
     r->m_inChunkSize = RTMP_DEFAULT_CHUNKSIZE;
     r->m_outChunkSize = RTMP_DEFAULT_CHUNKSIZE;
     r->m_bSendChunkSizeInfo = 1;
+    r->m_bAggregate = 0;
     r->m_nBufferMS = 30000;
     r->m_nClientBW = 2500000;
     r->m_nClientBW2 = 2;
@@ -644,11 +645,63 @@ int RTMP_AddStream(RTMP *r, const char *playpath)
     return idx;
 }
 
-static int
-add_addr_info(struct sockaddr_storage *service, socklen_t *addrlen, AVal *host, int port)
+#define RTMP_MAX_ADDRS          8
+#define RTMP_DNS_CACHE_SIZE     8
+#define RTMP_DNS_CACHE_TTL_MS   60000
+
+/* happy eyeballs (RFC 8305): the next address is tried if the previous one
+ * hasn't connected within RTMP_CONNECT_DELAY_MS, while the earlier attempts
+ * keep going, each for up to RTMP_CONNECT_TIMEOUT_MS (or the link timeout
+ * if that is shorter) */
+#define RTMP_CONNECT_DELAY_MS   250
+#define RTMP_CONNECT_TIMEOUT_MS 10000
+
+typedef struct RTMPAddrList
+{
+    struct sockaddr_storage addrs[RTMP_MAX_ADDRS];
+    socklen_t lens[RTMP_MAX_ADDRS];
+    int count;
+} RTMPAddrList;
+
+/* resolved addresses are kept for a short while so that reconnecting
+ * doesn't have to wait for DNS again */
+typedef struct RTMPDNSCacheEntry
+{
+    char host[256];
+    int port;
+    uint64_t expires;
+    RTMPAddrList list;
+} RTMPDNSCacheEntry;
+
+static RTMPDNSCacheEntry dns_cache[RTMP_DNS_CACHE_SIZE];
+
+#ifdef _WIN32
+static SRWLOCK dns_cache_lock = SRWLOCK_INIT;
+#define dns_cache_lock()   AcquireSRWLockExclusive(&dns_cache_lock)
+#define dns_cache_unlock() ReleaseSRWLockExclusive(&dns_cache_lock)
+#else
+static pthread_mutex_t dns_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define dns_cache_lock()   pthread_mutex_lock(&dns_cache_mutex)
+#define dns_cache_unlock() pthread_mutex_unlock(&dns_cache_mutex)
+#endif
+
+static uint64_t
+get_time_ms(void)
+{
+#ifdef _WIN32
+    return GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+#endif
+}
+
+static char *
+get_hostname(AVal *host)
 {
     char *hostname;
-    int ret = TRUE;
+
     if (host->av_val[host->av_len] || host->av_val[0] == '[')
     {
         int v6 = host->av_val[0] == '[';
@@ -661,9 +714,68 @@ add_addr_info(struct sockaddr_storage *service, socklen_t *addrlen, AVal *host,
         hostname = host->av_val;
     }
 
+    return hostname;
+}
+
+/* keeps the OS preferred order, but alternates between address families so
+ * a broken IPv6 (or IPv4) route only costs one connection attempt delay */
+static void
+add_addrs(RTMPAddrList *list, struct addrinfo *result)
+{
+    struct addrinfo *ptr;
+    int first = AF_UNSPEC;
+    int pass;
+
+    list->count = 0;
+
+    for (ptr = result; ptr != NULL; ptr = ptr->ai_next)
+    {
+        if (ptr->ai_family == AF_INET || ptr->ai_family == AF_INET6)
+        {
+            first = ptr->ai_family;
+            break;
+        }
+    }
+
+    for (pass = 0; first != AF_UNSPEC && list->count < RTMP_MAX_ADDRS; pass++)
+    {
+        int added = FALSE;
+
+        for (int family = 0; family < 2; family++)
+        {
+            int want = family == 0 ? first :
+                       (first == AF_INET ? AF_INET6 : AF_INET);
+            int idx = 0;
+
+            for (ptr = result; ptr != NULL; ptr = ptr->ai_next)
+            {
+                if (ptr->ai_family != want)
+                    continue;
+                if (idx++ != pass)
+                    continue;
+                if (list->count == RTMP_MAX_ADDRS)
+                    break;
+
+                memcpy(&list->addrs[list->count], ptr->ai_addr,
+                       ptr->ai_addrlen);
+                list->lens[list->count++] = (socklen_t)ptr->ai_addrlen;
+                added = TRUE;
+                break;
+            }
+        }
+
+        if (!added)
+            break;
+    }
+}
+
+static int
+resolve_host(const char *hostname, int port, RTMPAddrList *list)
+{
     struct addrinfo hints;
     struct addrinfo *result = NULL;
-    struct addrinfo *ptr = NULL;
+    char portStr[8];
+    int err;
 
     memset(&hints, 0, sizeof(hints));
 
@@ -671,51 +783,132 @@ add_addr_info(struct sockaddr_storage *service, socklen_t *addrlen, AVal *host,
     hints.ai_socktype = SOCK_STREAM;
     hints.ai_protocol = IPPROTO_TCP;
 
-    service->ss_family = AF_UNSPEC;
-    *addrlen = 0;
-
-    char portStr[8];
-
     sprintf(portStr, "%d", port);
 
-    int err = getaddrinfo(hostname, portStr, &hints, &result);
-
+    /* with AF_UNSPEC the A and AAAA queries are sent together */
+    err = getaddrinfo(hostname, portStr, &hints, &result);
     if (err)
     {
 #ifndef _WIN32
 #define gai_strerrorA gai_strerror
 #endif
         RTMP_Log(RTMP_LOGERROR, "Could not resolve %s: %s (%d)", hostname, gai_strerrorA(GetSockError()), GetSockError());
-        ret = FALSE;
-        goto finish;
+        return FALSE;
     }
 
-    // they should come back in OS preferred order
-    for (ptr = result; ptr != NULL; ptr = ptr->ai_next)
+    add_addrs(list, result);
+    freeaddrinfo(result);
+
+    if (!list->count)
     {
-        if (ptr->ai_family == AF_INET || ptr->ai_family == AF_INET6)
-        {
-            memcpy(service, ptr->ai_addr, ptr->ai_addrlen);
-            *addrlen = (socklen_t)ptr->ai_addrlen;
-            break;
-        }
+        RTMP_Log(RTMP_LOGERROR, "Could not resolve server '%s': no valid address found", hostname);
+        return FALSE;
     }
 
-    freeaddrinfo(result);
+    return TRUE;
+}
 
-    if (service->ss_family == AF_UNSPEC || *addrlen == 0)
+static RTMPDNSCacheEntry *
+find_cached(const char *hostname, int port)
+{
+    for (int i = 0; i < RTMP_DNS_CACHE_SIZE; i++)
+    {
+        RTMPDNSCacheEntry *entry = &dns_cache[i];
+        if (entry->port == port && strcmp(entry->host, hostname) == 0)
+            return entry;
+    }
+
+    return NULL;
+}
+
+static int
+lookup_host(AVal *host, int port, RTMPAddrList *list, int *cached)
+{
+    char *hostname = get_hostname(host);
+    RTMPDNSCacheEntry *entry;
+    uint64_t now = get_time_ms();
+    int ret = TRUE;
+
+    *cached = FALSE;
+
+    dns_cache_lock();
+    entry = find_cached(hostname, port);
+    if (entry && entry->expires > now)
+    {
+        *list = entry->list;
+        *cached = TRUE;
+    }
+    dns_cache_unlock();
+
+    if (*cached)
+        goto finish;
+
+    if (!resolve_host(hostname, port, list))
     {
-        RTMP_Log(RTMP_LOGERROR, "Could not resolve server '%s': no valid address found", hostname);
         ret = FALSE;
         goto finish;
     }
 
+    if (strlen(hostname) < sizeof(entry->host))
+    {
+        dns_cache_lock();
+        entry = find_cached(hostname, port);
+
+        /* otherwise replace whichever entry expires first */
+        if (!entry)
+        {
+            entry = &dns_cache[0];
+            for (int i = 1; i < RTMP_DNS_CACHE_SIZE; i++)
+                if (dns_cache[i].expires < entry->expires)
+                    entry = &dns_cache[i];
+        }
+
+        strcpy(entry->host, hostname);
+        entry->port = port;
+        entry->expires = now + RTMP_DNS_CACHE_TTL_MS;
+        entry->list = *list;
+        dns_cache_unlock();
+    }
+
 finish:
     if (hostname != host->av_val)
         free(hostname);
     return ret;
 }
 
+static void
+forget_host(AVal *host, int port)
+{
+    char *hostname = get_hostname(host);
+    RTMPDNSCacheEntry *entry;
+
+    dns_cache_lock();
+    entry = find_cached(hostname, port);
+    if (entry)
+        entry->expires = 0;
+    dns_cache_unlock();
+
+    if (hostname != host->av_val)
+        free(hostname);
+}
+
+static int
+add_addr_info(struct sockaddr_storage *service, socklen_t *addrlen, AVal *host, int port)
+{
+    RTMPAddrList list;
+    int cached;
+
+    service->ss_family = AF_UNSPEC;
+    *addrlen = 0;
+
+    if (!lookup_host(host, port, &list, &cached))
+        return FALSE;
+
+    memcpy(service, &list.addrs[0], list.lens[0]);
+    *addrlen = list.lens[0];
+    return TRUE;
+}
+
 #ifdef _WIN32
 #define E_TIMEDOUT     WSAETIMEDOUT
 #define E_CONNREFUSED  WSAECONNREFUSED
@@ -726,68 +919,70 @@ finish:
 #define E_ACCES        EACCES
 #endif
 
-int
-RTMP_Connect0(RTMP *r, struct sockaddr * service, socklen_t addrlen)
+static void
+log_connect_error(RTMP *r, int err)
 {
-    int on = 1;
-    r->m_sb.sb_timedout = FALSE;
-    r->m_pausing = 0;
-    r->m_fDuration = 0.0;
+    if (err == E_CONNREFUSED)
+        RTMP_Log(RTMP_LOGERROR, "%s is offline. Try a different server (ECONNREFUSED).", r->Link.hostname.av_val);
+    else if (err == E_ACCES)
+        RTMP_Log(RTMP_LOGERROR, "The connection is being blocked by a firewall or other security software (EACCES).");
+    else if (err == E_TIMEDOUT)
+        RTMP_Log(RTMP_LOGERROR, "The connection timed out. Try a different server, or check that the connection is not being blocked by a firewall or other security software (ETIMEDOUT).");
+    else
+        RTMP_Log(RTMP_LOGERROR, "%s, failed to connect socket: %s (%d)",
+                 __FUNCTION__, socketerror(err), err);
+}
+
+static int
+create_socket(RTMP *r, int family)
+{
+    int sock;
 
     //best to be explicit, we need overlapped socket
 #ifdef _WIN32
-    r->m_sb.sb_socket = WSASocket(service->sa_family, SOCK_STREAM, IPPROTO_TCP, NULL, 0, WSA_FLAG_OVERLAPPED);
+    sock = (int)WSASocket(family, SOCK_STREAM, IPPROTO_TCP, NULL, 0, WSA_FLAG_OVERLAPPED);
 #else
-    r->m_sb.sb_socket = socket(service->sa_family, SOCK_STREAM, IPPROTO_TCP);
+    sock = socket(family, SOCK_STREAM, IPPROTO_TCP);
 #endif
 
-    if (r->m_sb.sb_socket != INVALID_SOCKET)
+    if (sock == INVALID_SOCKET)
     {
-        if(r->m_bindIP.addrLen)
-        {
-            if (bind(r->m_sb.sb_socket, (const struct sockaddr *)&r->m_bindIP.addr, r->m_bindIP.addrLen) < 0)
-            {
-                int err = GetSockError();
-                RTMP_Log(RTMP_LOGERROR, "%s, failed to bind socket: %s (%d)",
-                         __FUNCTION__, socketerror(err), err);
-                RTMP_Close(r);
-                return FALSE;
-            }
-        }
+        RTMP_Log(RTMP_LOGERROR, "%s, failed to create socket. Error: %d", __FUNCTION__,
+                 GetSockError());
+        return INVALID_SOCKET;
+    }
 
-        if (connect(r->m_sb.sb_socket, service, addrlen) < 0)
+    if (r->m_bindIP.addrLen)
+    {
+        if (bind(sock, (const struct sockaddr *)&r->m_bindIP.addr, r->m_bindIP.addrLen) < 0)
         {
             int err = GetSockError();
-            if (err == E_CONNREFUSED)
-                RTMP_Log(RTMP_LOGERROR, "%s is offline. Try a different server (ECONNREFUSED).", r->Link.hostname.av_val);
-            else if (err == E_ACCES)
-                RTMP_Log(RTMP_LOGERROR, "The connection is being blocked by a firewall or other security software (EACCES).");
-            else if (err == E_TIMEDOUT)
-                RTMP_Log(RTMP_LOGERROR, "The connection timed out. Try a different server, or check that the connection is not being blocked by a firewall or other security software (ETIMEDOUT).");
-            else
-                RTMP_Log(RTMP_LOGERROR, "%s, failed to connect socket: %s (%d)",
+            RTMP_Log(RTMP_LOGERROR, "%s, failed to bind socket: %s (%d)",
                      __FUNCTION__, socketerror(err), err);
-            RTMP_Close(r);
-            return FALSE;
+            closesocket(sock);
+            return INVALID_SOCKET;
         }
+    }
+
+    return sock;
+}
+
+/* everything after the TCP connection itself is up */
+static int
+finish_connect(RTMP *r)
+{
+    int on = 1;
 
-        if (r->Link.socksport)
+    if (r->Link.socksport)
+    {
+        RTMP_Log(RTMP_LOGDEBUG, "%s ... SOCKS negotiation", __FUNCTION__);
+        if (!SocksNegotiate(r))
         {
-            RTMP_Log(RTMP_LOGDEBUG, "%s ... SOCKS negotiation", __FUNCTION__);
-            if (!SocksNegotiate(r))
-            {
-                RTMP_Log(RTMP_LOGERROR, "%s, SOCKS negotiation failed.", __FUNCTION__);
-                RTMP_Close(r);
-                return FALSE;
-            }
+            RTMP_Log(RTMP_LOGERROR, "%s, SOCKS negotiation failed.", __FUNCTION__);
+            RTMP_Close(r);
+            return FALSE;
         }
     }
-    else
-    {
-        RTMP_Log(RTMP_LOGERROR, "%s, failed to create socket. Error: %d", __FUNCTION__,
-                 GetSockError());
-        return FALSE;
-    }
 
     /* set timeout */
     {
@@ -806,6 +1001,226 @@ RTMP_Connect0(RTMP *r, struct sockaddr * service, socklen_t addrlen)
     return TRUE;
 }
 
+int
+RTMP_Connect0(RTMP *r, struct sockaddr * service, socklen_t addrlen)
+{
+    r->m_sb.sb_timedout = FALSE;
+    r->m_pausing = 0;
+    r->m_fDuration = 0.0;
+
+    r->m_sb.sb_socket = create_socket(r, service->sa_family);
+    if (r->m_sb.sb_socket == INVALID_SOCKET)
+        return FALSE;
+
+    if (connect(r->m_sb.sb_socket, service, addrlen) < 0)
+    {
+        log_connect_error(r, GetSockError());
+        RTMP_Close(r);
+        return FALSE;
+    }
+
+    return finish_connect(r);
+}
+
+static int
+set_nonblocking(int sock, int nonblocking)
+{
+#ifdef _WIN32
+    u_long mode = nonblocking ? 1 : 0;
+    return ioctlsocket(sock, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(sock, F_GETFL, 0);
+    if (flags < 0)
+        return FALSE;
+    flags = nonblocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    return fcntl(sock, F_SETFL, flags) == 0;
+#endif
+}
+
+static int
+connect_in_progress(int err)
+{
+#ifdef _WIN32
+    return err == WSAEWOULDBLOCK;
+#else
+    return err == EINPROGRESS;
+#endif
+}
+
+typedef struct RTMPConnectAttempt
+{
+    int sock;
+    int family;
+    uint64_t deadline;
+} RTMPConnectAttempt;
+
+/* starts a non-blocking connect, returns TRUE if it connected right away */
+static int
+start_attempt(RTMP *r, const RTMPAddrList *list, int idx,
+              RTMPConnectAttempt *attempt, int *err)
+{
+    const struct sockaddr *addr = (const struct sockaddr *)&list->addrs[idx];
+    uint64_t timeout = RTMP_CONNECT_TIMEOUT_MS;
+    int nonblocking;
+
+    if (r->Link.timeout > 0 && (uint64_t)r->Link.timeout * 1000 < timeout)
+        timeout = (uint64_t)r->Link.timeout * 1000;
+
+    attempt->family = addr->sa_family;
+    attempt->deadline = get_time_ms() + timeout;
+    attempt->sock = INVALID_SOCKET;
+
+    /* a bound socket can only reach addresses of its own family */
+    if (r->m_bindIP.addrLen && r->m_bindIP.addr.ss_family != addr->sa_family)
+        return FALSE;
+
+    attempt->sock = create_socket(r, addr->sa_family);
+    if (attempt->sock == INVALID_SOCKET)
+        return FALSE;
+
+    /* without non-blocking mode this is an ordinary blocking connect */
+    nonblocking = set_nonblocking(attempt->sock, TRUE);
+    if (connect(attempt->sock, addr, list->lens[idx]) == 0)
+        return TRUE;
+
+    *err = GetSockError();
+    if (!nonblocking || !connect_in_progress(*err))
+    {
+        closesocket(attempt->sock);
+        attempt->sock = INVALID_SOCKET;
+    }
+    return FALSE;
+}
+
+/* races connections to the addresses in list, and leaves the first one that
+ * connects in r->m_sb.sb_socket */
+static int
+connect_any(RTMP *r, const RTMPAddrList *list)
+{
+    RTMPConnectAttempt attempts[RTMP_MAX_ADDRS];
+    uint64_t nextStart = 0;
+    int started = 0, winner = -1, err = E_TIMEDOUT;
+    int i;
+
+    while (winner < 0)
+    {
+        uint64_t now = get_time_ms();
+        uint64_t wake = UINT64_MAX;
+        struct timeval tv;
+        fd_set wfds, efds;
+        int maxfd = 0, pending = 0;
+
+        for (i = 0; i < started; i++)
+        {
+            if (attempts[i].sock == INVALID_SOCKET)
+                continue;
+
+            if (now >= attempts[i].deadline)
+            {
+                closesocket(attempts[i].sock);
+                attempts[i].sock = INVALID_SOCKET;
+                err = E_TIMEDOUT;
+                nextStart = now;
+                continue;
+            }
+            pending++;
+        }
+
+        if (started < list->count && (!pending || now >= nextStart))
+        {
+            if (start_attempt(r, list, started, &attempts[started], &err))
+            {
+                winner = started++;
+                break;
+            }
+
+            /* a failed attempt moves on to the next address right away */
+            nextStart = attempts[started].sock == INVALID_SOCKET ?
+                        now : now + RTMP_CONNECT_DELAY_MS;
+            started++;
+            continue;
+        }
+
+        if (!pending)
+            break;
+
+        FD_ZERO(&wfds);
+        FD_ZERO(&efds);
+        for (i = 0; i < started; i++)
+        {
+            if (attempts[i].sock == INVALID_SOCKET)
+                continue;
+
+            FD_SET(attempts[i].sock, &wfds);
+            FD_SET(attempts[i].sock, &efds);
+            if (attempts[i].sock > maxfd)
+                maxfd = attempts[i].sock;
+            if (attempts[i].deadline < wake)
+                wake = attempts[i].deadline;
+        }
+        if (started < list->count && nextStart < wake)
+            wake = nextStart;
+
+        wake = wake > now ? wake - now : 0;
+        tv.tv_sec = (long)(wake / 1000);
+        tv.tv_usec = (long)(wake % 1000) * 1000;
+
+        if (select(maxfd + 1, NULL, &wfds, &efds, &tv) < 0)
+        {
+            err = GetSockError();
+            if (err == EINTR)
+                continue;
+            break;
+        }
+
+        for (i = 0; i < started && winner < 0; i++)
+        {
+            int sockerr = 0;
+            socklen_t len = sizeof(sockerr);
+
+            if (attempts[i].sock == INVALID_SOCKET)
+                continue;
+            if (!FD_ISSET(attempts[i].sock, &wfds) &&
+                    !FD_ISSET(attempts[i].sock, &efds))
+                continue;
+
+            if (getsockopt(attempts[i].sock, SOL_SOCKET, SO_ERROR,
+                           (char *)&sockerr, &len) < 0)
+                sockerr = GetSockError();
+
+            if (!sockerr)
+            {
+                winner = i;
+                break;
+            }
+
+            RTMP_Log(RTMP_LOGDEBUG, "%s, connection attempt %d failed: %s (%d)",
+                     __FUNCTION__, i, socketerror(sockerr), sockerr);
+            closesocket(attempts[i].sock);
+            attempts[i].sock = INVALID_SOCKET;
+            err = sockerr;
+            nextStart = now;
+        }
+    }
+
+    for (i = 0; i < started; i++)
+        if (i != winner && attempts[i].sock != INVALID_SOCKET)
+            closesocket(attempts[i].sock);
+
+    if (winner < 0)
+    {
+        log_connect_error(r, err);
+        return FALSE;
+    }
+
+    set_nonblocking(attempts[winner].sock, FALSE);
+    r->m_sb.sb_socket = attempts[winner].sock;
+
+    RTMP_Log(RTMP_LOGINFO, "%s, connected over %s", __FUNCTION__,
+             attempts[winner].family == AF_INET6 ? "IPv6" : "IPv4");
+    return TRUE;
+}
+
 int
 RTMP_TLS_Accept(RTMP *r, void *ctx)
 {
@@ -885,8 +1300,9 @@ RTMP_Connect(RTMP *r, RTMPPacket *cp)
 #ifdef _WIN32
     HOSTENT *h;
 #endif
-    struct sockaddr_storage service;
-    socklen_t addrlen = 0;
+    RTMPAddrList list;
+    AVal *host;
+    int port, cached;
     if (!r->Link.hostname.av_len)
         return FALSE;
 
@@ -900,22 +1316,31 @@ RTMP_Connect(RTMP *r, RTMPPacket *cp)
     }
 #endif
 
-    memset(&service, 0, sizeof(service));
+    /* Connect via SOCKS or directly */
+    host = r->Link.socksport ? &r->Link.sockshost : &r->Link.hostname;
+    port = r->Link.socksport ? r->Link.socksport : r->Link.port;
 
-    if (r->Link.socksport)
+    r->m_sb.sb_timedout = FALSE;
+    r->m_pausing = 0;
+    r->m_fDuration = 0.0;
+
+    if (!lookup_host(host, port, &list, &cached))
+        return FALSE;
+
+    if (!connect_any(r, &list))
     {
-        /* Connect via SOCKS */
-        if (!add_addr_info(&service, &addrlen, &r->Link.sockshost, r->Link.socksport))
+        /* the cached addresses may have gone stale, resolve again */
+        if (!cached)
             return FALSE;
-    }
-    else
-    {
-        /* Connect directly */
-        if (!add_addr_info(&service, &addrlen, &r->Link.hostname, r->Link.port))
+
+        forget_host(host, port);
+        if (!lookup_host(host, port, &list, &cached))
+            return FALSE;
+        if (!connect_any(r, &list))
             return FALSE;
     }
 
-    if (!RTMP_Connect0(r, (struct sockaddr *)&service, addrlen))
+    if (!finish_connect(r))
         return FALSE;
 
     r->m_bSendCounter = TRUE;
@@ -5222,3 +5647,401 @@ RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx)
     }
     return size+s2;
 }
+
+/* scatter-gather writes used by RTMP_WriteBatch */
+
+#define RTMP_BATCH_MAX_IOV 64
+
+/* limits for aggregate messages, which are kept to small audio tags */
+#define RTMP_AGGREGATE_MAX_TAGS 16
+#define RTMP_AGGREGATE_MAX_SIZE 16384
+
+#ifdef _WIN32
+typedef WSABUF RTMPIOVec;
+#define RTMPIOVec_Set(v, b, l) ((v)->buf = (char *)(b), (v)->len = (ULONG)(l))
+#define RTMPIOVec_Base(v) ((v)->buf)
+#define RTMPIOVec_Len(v) ((v)->len)
+#else
+typedef struct iovec RTMPIOVec;
+#define RTMPIOVec_Set(v, b, l) ((v)->iov_base = (void *)(b), (v)->iov_len = (l))
+#define RTMPIOVec_Base(v) ((char *)(v)->iov_base)
+#define RTMPIOVec_Len(v) ((v)->iov_len)
+#endif
+
+static int
+WriteV(RTMP *r, RTMPIOVec *iov, int cnt)
+{
+    while (cnt > 0)
+    {
+        size_t nBytes;
+#ifdef _WIN32
+        DWORD sent = 0;
+        if (WSASend(r->m_sb.sb_socket, iov, cnt, &sent, 0, NULL, NULL) != 0)
+            sent = (DWORD)-1;
+        nBytes = sent;
+        if (sent == (DWORD)-1)
+#else
+        ssize_t sent = writev(r->m_sb.sb_socket, iov, cnt);
+        nBytes = (size_t)sent;
+        if (sent < 0)
+#endif
+        {
+            int sockerr = GetSockError();
+            RTMP_Log(RTMP_LOGERROR, "%s, RTMP send error %d", __FUNCTION__,
+                     sockerr);
+
+            if (sockerr == EINTR && !RTMP_ctrlC)
+                continue;
+
+            RTMP_Close(r);
+            return FALSE;
+        }
+
+        if (nBytes == 0)
+            return FALSE;
+
+        /* skip past everything that was written, and adjust the first
+         * partially written buffer if any */
+        while (cnt > 0 && nBytes >= (size_t)RTMPIOVec_Len(iov))
+        {
+            nBytes -= RTMPIOVec_Len(iov);
+            iov++;
+            cnt--;
+        }
+        if (cnt > 0)
+            RTMPIOVec_Set(iov, RTMPIOVec_Base(iov) + nBytes,
+                          RTMPIOVec_Len(iov) - nBytes);
+    }
+
+    return TRUE;
+}
+
+static int
+CanWriteV(RTMP *r)
+{
+    if (r->Link.protocol & RTMP_FEATURE_HTTP)
+        return FALSE;
+    if (r->m_bCustomSend && r->m_customSendFunc)
+        return FALSE;
+#ifdef CRYPTO
+    if (r->Link.rc4keyOut)
+        return FALSE;
+#ifndef NO_SSL
+    if (r->m_sb.sb_ssl)
+        return FALSE;
+#endif
+#endif
+#ifdef RTMP_NETSTACK_DUMP
+    return FALSE;
+#else
+    return TRUE;
+#endif
+}
+
+/* encodes the first chunk header of a packet into buf (which must hold at
+ * least RTMP_MAX_HEADER_SIZE bytes) in the same way as RTMP_SendPacket, and
+ * returns its size.  *cont receives the continuation chunk header. */
+static int
+EncodeChunkHeader(RTMP *r, RTMPPacket *packet, char *buf, char *cont,
+                  int *contSize)
+{
+    const RTMPPacket *prevPacket = r->m_vecChannelsOut[packet->m_nChannel];
+    char *hptr = buf, *hend = buf + RTMP_MAX_HEADER_SIZE, c;
+    uint32_t last = 0, t;
+    int nSize, cSize = 0;
+
+    if (prevPacket && packet->m_headerType != RTMP_PACKET_SIZE_LARGE)
+    {
+        if (prevPacket->m_nBodySize == packet->m_nBodySize
+                && prevPacket->m_packetType == packet->m_packetType
+                && packet->m_headerType == RTMP_PACKET_SIZE_MEDIUM)
+            packet->m_headerType = RTMP_PACKET_SIZE_SMALL;
+
+        if (prevPacket->m_nTimeStamp == packet->m_nTimeStamp
+                && packet->m_headerType == RTMP_PACKET_SIZE_SMALL)
+            packet->m_headerType = RTMP_PACKET_SIZE_MINIMUM;
+        last = prevPacket->m_nTimeStamp;
+    }
+
+    nSize = packetSize[packet->m_headerType];
+    t = packet->m_nTimeStamp - last;
+
+    if (packet->m_nChannel > 319)
+        cSize = 2;
+    else if (packet->m_nChannel > 63)
+        cSize = 1;
+
+    c = packet->m_headerType << 6;
+    if (cSize == 0)
+        c |= packet->m_nChannel;
+    else if (cSize == 2)
+        c |= 1;
+
+    *hptr++ = c;
+    cont[0] = (0xc0 | c);
+    if (cSize)
+    {
+        int tmp = packet->m_nChannel - 64;
+        *hptr++ = cont[1] = tmp & 0xff;
+        if (cSize == 2)
+            *hptr++ = cont[2] = tmp >> 8;
+    }
+    *contSize = 1 + cSize;
+
+    if (nSize > 1)
+        hptr = AMF_EncodeInt24(hptr, hend, t > 0xffffff ? 0xffffff : t);
+
+    if (nSize > 4)
+    {
+        hptr = AMF_EncodeInt24(hptr, hend, packet->m_nBodySize);
+        *hptr++ = packet->m_packetType;
+    }
+
+    if (nSize > 8)
+        hptr += EncodeInt32LE(hptr, packet->m_nInfoField2);
+
+    if (nSize > 1 && t >= 0xffffff)
+        hptr = AMF_EncodeInt32(hptr, hend, t);
+
+    return (int)(hptr - buf);
+}
+
+static int
+SetChannelOut(RTMP *r, const RTMPPacket *packet)
+{
+    if (packet->m_nChannel >= r->m_channelsAllocatedOut)
+    {
+        int n = packet->m_nChannel + 10;
+        RTMPPacket **packets = realloc(r->m_vecChannelsOut, sizeof(RTMPPacket*) * n);
+        if (!packets)
+        {
+            free(r->m_vecChannelsOut);
+            r->m_vecChannelsOut = NULL;
+            r->m_channelsAllocatedOut = 0;
+            return FALSE;
+        }
+        r->m_vecChannelsOut = packets;
+        memset(r->m_vecChannelsOut + r->m_channelsAllocatedOut, 0, sizeof(RTMPPacket*) * (n - r->m_channelsAllocatedOut));
+        r->m_channelsAllocatedOut = n;
+    }
+    return TRUE;
+}
+
+typedef struct RTMPSegment
+{
+    const char *data;
+    int size;
+} RTMPSegment;
+
+/* adds the body of a message, which can be spread over several buffers, to
+ * iov and splits it into chunks.  the first chunk header must already have
+ * been added.  iov is written out whenever it fills up */
+static int
+AddChunkedBody(RTMP *r, RTMPIOVec *iov,
+               char headers[][RTMP_MAX_HEADER_SIZE], int *numIov,
+               const RTMPSegment *segs, int segCount, const char *cont,
+               int contSize)
+{
+    int chunkLeft = r->m_outChunkSize;
+    int s;
+
+    for (s = 0; s < segCount; s++)
+    {
+        const char *buf = segs[s].data;
+        int nSize = segs[s].size;
+
+        while (nSize > 0)
+        {
+            int len;
+
+            if (!chunkLeft)
+            {
+                if (*numIov + 2 > RTMP_BATCH_MAX_IOV)
+                {
+                    if (!WriteV(r, iov, *numIov))
+                        return FALSE;
+                    *numIov = 0;
+                }
+
+                memcpy(headers[*numIov], cont, contSize);
+                RTMPIOVec_Set(&iov[*numIov], headers[*numIov], contSize);
+                (*numIov)++;
+                chunkLeft = r->m_outChunkSize;
+            }
+            else if (*numIov + 1 > RTMP_BATCH_MAX_IOV)
+            {
+                if (!WriteV(r, iov, *numIov))
+                    return FALSE;
+                *numIov = 0;
+            }
+
+            len = nSize < chunkLeft ? nSize : chunkLeft;
+            RTMPIOVec_Set(&iov[*numIov], buf, len);
+            (*numIov)++;
+
+            buf += len;
+            nSize -= len;
+            chunkLeft -= len;
+        }
+    }
+
+    return TRUE;
+}
+
+/* checks that an item is a complete audio/video FLV tag and reads its
+ * header into packet */
+static int
+ReadTagHeader(const RTMPWriteItem *item, RTMPPacket *packet)
+{
+    const char *buf = item->data;
+
+    if (item->size < 11)
+        return FALSE;
+
+    packet->m_packetType = buf[0];
+    packet->m_nBodySize = AMF_DecodeInt24(buf + 1);
+    packet->m_nTimeStamp = AMF_DecodeInt24(buf + 4);
+    packet->m_nTimeStamp |= (uint8_t)buf[7] << 24;
+
+    return (packet->m_packetType == RTMP_PACKET_TYPE_AUDIO ||
+            packet->m_packetType == RTMP_PACKET_TYPE_VIDEO) &&
+           item->size >= 11 + (int)packet->m_nBodySize;
+}
+
+/* number of consecutive audio tags for the same stream starting at items,
+ * which can go into one aggregate message */
+static int
+CountAggregate(RTMP *r, const RTMPWriteItem *items, int count)
+{
+    int n, size = 0;
+
+    if (!r->m_bAggregate)
+        return 1;
+
+    for (n = 0; n < count && n < RTMP_AGGREGATE_MAX_TAGS; n++)
+    {
+        RTMPPacket packet = { 0 };
+
+        if (!ReadTagHeader(&items[n], &packet) ||
+                packet.m_packetType != RTMP_PACKET_TYPE_AUDIO ||
+                items[n].streamIdx != items[0].streamIdx ||
+                size + items[n].size > RTMP_AGGREGATE_MAX_SIZE)
+            break;
+
+        size += items[n].size;
+    }
+
+    return n ? n : 1;
+}
+
+int
+RTMP_WriteBatch(RTMP *r, const RTMPWriteItem *items, int count)
+{
+    RTMPIOVec iov[RTMP_BATCH_MAX_IOV];
+    char headers[RTMP_BATCH_MAX_IOV][RTMP_MAX_HEADER_SIZE];
+    RTMPSegment segs[RTMP_AGGREGATE_MAX_TAGS];
+    int numIov = 0, total = 0, i, j;
+
+    if (!CanWriteV(r))
+    {
+        for (i = 0; i < count; i++)
+        {
+            int ret = RTMP_Write(r, items[i].data, items[i].size,
+                                 items[i].streamIdx);
+            if (ret < 0)
+                return -1;
+            total += ret;
+        }
+        return total;
+    }
+
+    for (i = 0; i < count; i += j)
+    {
+        RTMPPacket packet = { 0 };
+        char cont[3];
+        int contSize, hSize, tags;
+
+        j = 1;
+
+        if (items[i].size < 11)
+            continue;
+
+        /* metadata needs @setDataFrame prepended, leave it to the regular
+         * write path */
+        if (!ReadTagHeader(&items[i], &packet))
+        {
+            int ret;
+
+            if (numIov && !WriteV(r, iov, numIov))
+                return -1;
+            numIov = 0;
+
+            ret = RTMP_Write(r, items[i].data, items[i].size,
+                             items[i].streamIdx);
+            if (ret < 0)
+                return -1;
+            total += ret;
+            continue;
+        }
+
+        /* an aggregate message's body is the complete FLV tags, each
+         * keeping its own timestamp, and the message takes the timestamp
+         * of the first one */
+        tags = CountAggregate(r, items + i, count - i);
+        if (tags > 1)
+        {
+            packet.m_packetType = RTMP_PACKET_TYPE_FLASH_VIDEO;
+            packet.m_nBodySize = 0;
+
+            for (j = 0; j < tags; j++)
+            {
+                segs[j].data = items[i + j].data;
+                segs[j].size = items[i + j].size;
+                packet.m_nBodySize += items[i + j].size;
+            }
+        }
+        else
+        {
+            segs[0].data = items[i].data + 11;
+            segs[0].size = (int)packet.m_nBodySize;
+        }
+
+        packet.m_nChannel = 0x04;	/* source channel */
+        packet.m_nInfoField2 = r->Link.streams[items[i].streamIdx].id;
+        packet.m_headerType = packet.m_nTimeStamp ?
+                              RTMP_PACKET_SIZE_MEDIUM : RTMP_PACKET_SIZE_LARGE;
+
+        if (!SetChannelOut(r, &packet))
+            return -1;
+
+        /* header slots are reused once their iovecs have been written, so
+         * there is always one per iovec pair */
+        if (numIov + 2 > RTMP_BATCH_MAX_IOV)
+        {
+            if (!WriteV(r, iov, numIov))
+                return -1;
+            numIov = 0;
+        }
+
+        hSize = EncodeChunkHeader(r, &packet, headers[numIov], cont,
+                                  &contSize);
+        RTMPIOVec_Set(&iov[numIov], headers[numIov], hSize);
+        numIov++;
+
+        if (!AddChunkedBody(r, iov, headers, &numIov, segs, tags, cont,
+                            contSize))
+            return -1;
+
+        if (!r->m_vecChannelsOut[packet.m_nChannel])
+            r->m_vecChannelsOut[packet.m_nChannel] = malloc(sizeof(RTMPPacket));
+        memcpy(r->m_vecChannelsOut[packet.m_nChannel], &packet, sizeof(RTMPPacket));
+
+        for (j = 0; j < tags; j++)
+            total += items[i + j].size;
+    }
+
+    if (numIov && !WriteV(r, iov, numIov))
+        return -1;
+
+    return total;
+}
@@ -300,6 +300,10 @@ extern "C"
 
         uint8_t m_bSendChunkSizeInfo;
 
+        /* combine consecutive audio tags sent with RTMP_WriteBatch into
+         * aggregate messages */
+        uint8_t m_bAggregate;
+
         int m_numInvokes;
         int m_numCalls;
         RTMP_METHOD *m_methodCalls;	/* remote method calls queue */
@@ -414,6 +418,20 @@ extern "C"
     int RTMP_Read(RTMP *r, char *buf, int size);
     int RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx);
 
+    /* a complete FLV audio/video tag (including the trailing previous
+     * tag size) to send with RTMP_WriteBatch */
+    typedef struct RTMPWriteItem
+    {
+        const char *data;
+        int size;
+        int streamIdx;
+    } RTMPWriteItem;
+
+    /* chunks and sends several FLV tags at once using scatter-gather
+     * writes, without copying the tag data.  returns the number of bytes
+     * consumed, or -1 on error */
+    int RTMP_WriteBatch(RTMP *r, const RTMPWriteItem *items, int count);
+
     /* hashswf.c */
     int RTMP_HashSWF(const char *url, unsigned int *size, unsigned char *hash,
                      int age);
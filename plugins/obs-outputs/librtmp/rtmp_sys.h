@@ -62,11 +62,14 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/times.h>
+#include <sys/uio.h>
 #include <netdb.h>
 #include <unistd.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <pthread.h>
 #define GetSockError()	errno
 #define SetSockError(e)	errno = e
 #undef closesocket
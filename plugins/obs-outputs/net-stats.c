@@ -0,0 +1,152 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <obs.h>
+#include "net-stats.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <mstcpip.h>
+#else
+#include <sys/ioctl.h>
+#include <netinet/tcp.h>
+#ifdef __linux__
+#include <linux/sockios.h>
+#endif
+#define SOCKET_ERROR -1
+#endif
+
+#ifdef _WIN32
+typedef int socklen_t;
+
+static void get_os_stats(SOCKET sock, struct net_stats *stats)
+{
+	ULONG backlog = 0;
+	DWORD bytes = 0;
+
+	if (WSAIoctl(sock, SIO_IDEAL_SEND_BACKLOG_QUERY, NULL, 0,
+				&backlog, sizeof(backlog), &bytes,
+				NULL, NULL) == 0)
+		stats->ideal_backlog = (int64_t)backlog;
+
+#ifdef SIO_TCP_INFO
+	/* windows 10 1703 and up */
+	{
+		DWORD version = 0;
+		TCP_INFO_v0 info;
+
+		if (WSAIoctl(sock, SIO_TCP_INFO, &version, sizeof(version),
+					&info, sizeof(info), &bytes,
+					NULL, NULL) == 0) {
+			stats->rtt_usec     = (int64_t)info.RttUs;
+			stats->queued_bytes = (int64_t)info.BytesInFlight;
+		}
+	}
+#endif
+}
+
+#elif defined(__linux__)
+static void get_os_stats(SOCKET sock, struct net_stats *stats)
+{
+	struct tcp_info info;
+	socklen_t size = sizeof(info);
+	int queued = 0;
+
+	if (getsockopt(sock, IPPROTO_TCP, TCP_INFO, &info, &size) == 0)
+		stats->rtt_usec = (int64_t)info.tcpi_rtt;
+
+	/* everything in the send queue, acked or not */
+	if (ioctl(sock, SIOCOUTQ, &queued) == 0)
+		stats->queued_bytes = (int64_t)queued;
+}
+
+#elif defined(__APPLE__)
+static void get_os_stats(SOCKET sock, struct net_stats *stats)
+{
+	socklen_t size;
+	int queued = 0;
+
+#ifdef TCP_CONNECTION_INFO
+	struct tcp_connection_info info;
+
+	size = sizeof(info);
+	if (getsockopt(sock, IPPROTO_TCP, TCP_CONNECTION_INFO,
+				&info, &size) == 0)
+		stats->rtt_usec = (int64_t)info.tcpi_srtt * 1000;
+#endif
+
+	size = sizeof(queued);
+	if (getsockopt(sock, SOL_SOCKET, SO_NWRITE, &queued, &size) == 0)
+		stats->queued_bytes = (int64_t)queued;
+}
+
+#else
+static void get_os_stats(SOCKET sock, struct net_stats *stats)
+{
+	socklen_t size;
+	int queued = 0;
+
+#ifdef TCP_INFO
+	struct tcp_info info;
+
+	size = sizeof(info);
+	if (getsockopt(sock, IPPROTO_TCP, TCP_INFO, &info, &size) == 0)
+		stats->rtt_usec = (int64_t)info.tcpi_rtt;
+#endif
+
+#ifdef FIONWRITE
+	if (ioctl(sock, FIONWRITE, &queued) == 0)
+		stats->queued_bytes = (int64_t)queued;
+#endif
+
+	UNUSED_PARAMETER(size);
+	UNUSED_PARAMETER(queued);
+}
+#endif
+
+bool net_get_stats(SOCKET sock, struct net_stats *stats)
+{
+	stats->rtt_usec      = -1;
+	stats->queued_bytes  = -1;
+	stats->ideal_backlog = -1;
+
+	if (sock == (SOCKET)-1)
+		return false;
+
+	get_os_stats(sock, stats);
+	return stats->rtt_usec      != -1 ||
+	       stats->queued_bytes  != -1 ||
+	       stats->ideal_backlog != -1;
+}
+
+int net_get_sndbuf(SOCKET sock)
+{
+	int size = 0;
+	socklen_t int_size = sizeof(size);
+
+	if (getsockopt(sock, SOL_SOCKET, SO_SNDBUF, (char*)&size,
+				&int_size) == SOCKET_ERROR)
+		return -1;
+	return size;
+}
+
+bool net_set_sndbuf(SOCKET sock, int size)
+{
+	return setsockopt(sock, SOL_SOCKET, SO_SNDBUF, (const char*)&size,
+			sizeof(size)) == 0;
+}
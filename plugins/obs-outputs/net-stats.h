@@ -0,0 +1,33 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "librtmp/rtmp.h"
+
+/* what the OS knows about a connected TCP socket.  values that the
+ * platform can't report are left at -1 */
+struct net_stats {
+	int64_t rtt_usec;      /* smoothed round trip time */
+	int64_t queued_bytes;  /* accepted by send() but not acked yet */
+	int64_t ideal_backlog; /* send buffer size the OS would suggest */
+};
+
+extern bool net_get_stats(SOCKET sock, struct net_stats *stats);
+
+extern int  net_get_sndbuf(SOCKET sock);
+extern bool net_set_sndbuf(SOCKET sock, int size);
@@ -9,7 +9,10 @@ OBS_DECLARE_MODULE()
 OBS_MODULE_USE_DEFAULT_LOCALE("obs-outputs", "en-US")
 
 extern struct obs_output_info rtmp_output_info;
+extern struct obs_output_info rtmp_multi_output_info;
 extern struct obs_output_info flv_output_info;
+extern struct obs_output_info packet_capture_info;
+extern struct obs_output_info shmem_output_info;
 
 bool obs_module_load(void)
 {
@@ -19,7 +22,10 @@ bool obs_module_load(void)
 #endif
 
 	obs_register_output(&rtmp_output_info);
+	obs_register_output(&rtmp_multi_output_info);
 	obs_register_output(&flv_output_info);
+	obs_register_output(&packet_capture_info);
+	obs_register_output(&shmem_output_info);
 	return true;
 }
 
@@ -0,0 +1,260 @@
+/******************************************************************************
+    Copyright (C) 2016 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <obs-module.h>
+#include <util/dstr.h>
+#include <util/file-serializer.h>
+#include <inttypes.h>
+#include "packet-capture.h"
+
+#define do_log(level, format, ...) \
+	blog(level, "[packet capture: '%s'] " format, \
+			obs_output_get_name(capture->output), ##__VA_ARGS__)
+
+#define warn(format, ...)  do_log(LOG_WARNING, format, ##__VA_ARGS__)
+#define info(format, ...)  do_log(LOG_INFO,    format, ##__VA_ARGS__)
+
+/*
+ * Dumps the interleaved packet stream of whatever encoders it's attached to
+ * into a packet capture file (see packet-capture.h), headers, SEI and
+ * timestamps included.  Meant to run next to the real outputs of a session
+ * so that the stream can be replayed into outputs later on.
+ */
+struct packet_capture {
+	obs_output_t      *output;
+	struct dstr       path;
+	bool              active;
+	bool              wrote_header;
+	bool              write_failed;
+	uint64_t          packets;
+
+	struct serializer file;
+};
+
+static const char *packet_capture_getname(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("PacketCapture");
+}
+
+static void packet_capture_stop(void *data);
+
+static void packet_capture_destroy(void *data)
+{
+	struct packet_capture *capture = data;
+
+	if (capture->active)
+		packet_capture_stop(data);
+
+	dstr_free(&capture->path);
+	bfree(capture);
+}
+
+static void *packet_capture_create(obs_data_t *settings,
+		obs_output_t *output)
+{
+	struct packet_capture *capture = bzalloc(sizeof(*capture));
+	capture->output = output;
+
+	UNUSED_PARAMETER(settings);
+	return capture;
+}
+
+static void packet_capture_stop(void *data)
+{
+	struct packet_capture *capture = data;
+
+	if (capture->active) {
+		buffered_file_output_serializer_free(&capture->file);
+		obs_output_end_data_capture(capture->output);
+		capture->active       = false;
+		capture->wrote_header = false;
+
+		info("Packet capture complete, %" PRIu64 " packets written",
+				capture->packets);
+	}
+}
+
+static void write_blob(struct serializer *s, const uint8_t *data,
+		size_t size)
+{
+	s_wl32(s, (uint32_t)size);
+	if (size)
+		s_write(s, data, size);
+}
+
+static void write_track(struct packet_capture *capture,
+		obs_encoder_t *encoder, size_t track_idx)
+{
+	struct serializer *s = &capture->file;
+	enum obs_encoder_type type = obs_encoder_get_type(encoder);
+	const char *codec = obs_encoder_get_codec(encoder);
+	size_t codec_len = codec ? strlen(codec) : 0;
+	uint8_t *extra_data = NULL;
+	size_t extra_data_size = 0;
+	uint8_t *sei = NULL;
+	size_t sei_size = 0;
+
+	if (codec_len >= 64)
+		codec_len = 63;
+
+	obs_encoder_get_extra_data(encoder, &extra_data, &extra_data_size);
+	if (type == OBS_ENCODER_VIDEO)
+		obs_encoder_get_sei(encoder, &sei, &sei_size);
+
+	s_w8(s, (uint8_t)type);
+	s_w8(s, (uint8_t)track_idx);
+
+	if (type == OBS_ENCODER_VIDEO) {
+		const struct video_output_info *voi =
+			video_output_get_info(obs_encoder_video(encoder));
+
+		s_wl32(s, voi->fps_den);
+		s_wl32(s, voi->fps_num);
+		s_wl32(s, obs_encoder_get_width(encoder));
+		s_wl32(s, obs_encoder_get_height(encoder));
+	} else {
+		audio_t *audio = obs_encoder_audio(encoder);
+
+		s_wl32(s, 1);
+		s_wl32(s, obs_encoder_get_sample_rate(encoder));
+		s_wl32(s, obs_encoder_get_sample_rate(encoder));
+		s_wl32(s, (uint32_t)audio_output_get_channels(audio));
+	}
+
+	s_wl16(s, (uint16_t)codec_len);
+	s_write(s, codec, codec_len);
+	write_blob(s, extra_data, extra_data_size);
+	write_blob(s, sei, sei_size);
+}
+
+static void write_header(struct packet_capture *capture)
+{
+	struct serializer *s = &capture->file;
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(
+			capture->output);
+	obs_encoder_t *aencoders[MAX_AUDIO_MIXES];
+	uint8_t count = vencoder ? 1 : 0;
+
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+		aencoders[i] = obs_output_get_audio_encoder(capture->output,
+				i);
+		if (aencoders[i])
+			count++;
+	}
+
+	s_write(s, PACKET_CAPTURE_MAGIC, PACKET_CAPTURE_MAGIC_SIZE);
+	s_w8(s, PACKET_CAPTURE_VERSION);
+	s_w8(s, count);
+
+	if (vencoder)
+		write_track(capture, vencoder, 0);
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
+		if (aencoders[i])
+			write_track(capture, aencoders[i], i);
+}
+
+static void packet_capture_data(void *data, struct encoder_packet *packet)
+{
+	struct packet_capture *capture = data;
+	struct serializer *s = &capture->file;
+
+	if (!capture->wrote_header) {
+		write_header(capture);
+		capture->wrote_header = true;
+	}
+
+	s_w8(s, (uint8_t)packet->type);
+	s_w8(s, (uint8_t)packet->track_idx);
+	s_w8(s, packet->keyframe ? PACKET_CAPTURE_KEYFRAME : 0);
+	s_w8(s, (uint8_t)packet->priority);
+	s_wl64(s, (uint64_t)packet->pts);
+	s_wl64(s, (uint64_t)packet->dts);
+	s_wl64(s, (uint64_t)packet->dts_usec);
+	write_blob(s, packet->data, packet->size);
+	capture->packets++;
+
+	if (!capture->write_failed &&
+	    buffered_file_output_serializer_failed(s)) {
+		warn("Failed to write to '%s'", capture->path.array);
+		capture->write_failed = true;
+	}
+}
+
+static bool packet_capture_start(void *data)
+{
+	struct packet_capture *capture = data;
+	obs_data_t *settings;
+	size_t buffer_size;
+
+	if (!obs_output_can_begin_data_capture(capture->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(capture->output, 0))
+		return false;
+
+	settings = obs_output_get_settings(capture->output);
+	dstr_copy(&capture->path, obs_data_get_string(settings, "path"));
+	buffer_size = (size_t)obs_data_get_int(settings, "buffer_size_mb") *
+		1024 * 1024;
+	obs_data_release(settings);
+
+	if (!buffered_file_output_serializer_init(&capture->file,
+				capture->path.array, buffer_size, 0)) {
+		warn("Unable to open capture file '%s'", capture->path.array);
+		return false;
+	}
+
+	capture->write_failed = false;
+	capture->packets      = 0;
+	capture->active       = true;
+	obs_output_begin_data_capture(capture->output, 0);
+
+	info("Capturing packets to '%s'...", capture->path.array);
+	return true;
+}
+
+static void packet_capture_defaults(obs_data_t *defaults)
+{
+	obs_data_set_default_int(defaults, "buffer_size_mb", 64);
+}
+
+static obs_properties_t *packet_capture_properties(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+
+	obs_properties_t *props = obs_properties_create();
+
+	obs_properties_add_text(props, "path",
+			obs_module_text("PacketCapture.FilePath"),
+			OBS_TEXT_DEFAULT);
+	return props;
+}
+
+struct obs_output_info packet_capture_info = {
+	.id             = "packet_capture",
+	.flags          = OBS_OUTPUT_AV |
+	                  OBS_OUTPUT_ENCODED |
+	                  OBS_OUTPUT_MULTI_TRACK,
+	.get_name       = packet_capture_getname,
+	.create         = packet_capture_create,
+	.destroy        = packet_capture_destroy,
+	.start          = packet_capture_start,
+	.stop           = packet_capture_stop,
+	.encoded_packet = packet_capture_data,
+	.get_defaults   = packet_capture_defaults,
+	.get_properties = packet_capture_properties
+};
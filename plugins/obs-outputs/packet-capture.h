@@ -0,0 +1,251 @@
+/******************************************************************************
+    Copyright (C) 2016 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <obs.h>
+#include <util/serializer.h>
+
+/*
+ * Encoded packet capture files, as written by the packet_capture output.
+ * They hold the interleaved packet stream exactly as an output receives it,
+ * so it can be replayed into outputs later without running the encoders.
+ *
+ * Everything is little endian:
+ *
+ *   char[7]  "OBSPCAP"
+ *   uint8    version
+ *   uint8    number of tracks, then for each track:
+ *     uint8  type (enum obs_encoder_type)
+ *     uint8  audio track index
+ *     uint32 timebase numerator, denominator
+ *     uint32 width or sample rate
+ *     uint32 height or number of channels
+ *     uint16 codec name length, name
+ *     uint32 extra data size, extra data
+ *     uint32 SEI size, SEI (already part of the first video packet)
+ *
+ *   then packets until the end of the file:
+ *     uint8  type
+ *     uint8  audio track index
+ *     uint8  flags (PACKET_CAPTURE_KEYFRAME)
+ *     uint8  priority
+ *     int64  pts, dts, dts_usec
+ *     uint32 size, data
+ */
+
+#define PACKET_CAPTURE_MAGIC      "OBSPCAP"
+#define PACKET_CAPTURE_MAGIC_SIZE 7
+#define PACKET_CAPTURE_VERSION    1
+
+#define PACKET_CAPTURE_KEYFRAME   (1<<0)
+
+#define PACKET_CAPTURE_MAX_TRACKS (MAX_AUDIO_MIXES + 1)
+
+struct packet_capture_track {
+	enum obs_encoder_type type;
+	uint32_t              track_idx;
+	int32_t               timebase_num;
+	int32_t               timebase_den;
+	uint32_t              width;
+	uint32_t              height;
+	uint32_t              sample_rate;
+	uint32_t              channels;
+	char                  codec[64];
+	uint8_t               *extra_data;
+	size_t                extra_data_size;
+	uint8_t               *sei;
+	size_t                sei_size;
+};
+
+static inline bool packet_capture_read(struct serializer *s, void *data,
+		size_t size)
+{
+	return s_read(s, data, size) == size;
+}
+
+static inline bool packet_capture_read_u8(struct serializer *s, uint8_t *val)
+{
+	return packet_capture_read(s, val, 1);
+}
+
+static inline bool packet_capture_read_u16(struct serializer *s,
+		uint16_t *val)
+{
+	uint8_t b[2];
+	if (!packet_capture_read(s, b, sizeof(b)))
+		return false;
+	*val = (uint16_t)(b[0] | (b[1] << 8));
+	return true;
+}
+
+static inline bool packet_capture_read_u32(struct serializer *s,
+		uint32_t *val)
+{
+	uint16_t lo, hi;
+	if (!packet_capture_read_u16(s, &lo) ||
+	    !packet_capture_read_u16(s, &hi))
+		return false;
+	*val = (uint32_t)lo | ((uint32_t)hi << 16);
+	return true;
+}
+
+static inline bool packet_capture_read_u64(struct serializer *s,
+		uint64_t *val)
+{
+	uint32_t lo, hi;
+	if (!packet_capture_read_u32(s, &lo) ||
+	    !packet_capture_read_u32(s, &hi))
+		return false;
+	*val = (uint64_t)lo | ((uint64_t)hi << 32);
+	return true;
+}
+
+static inline bool packet_capture_read_blob(struct serializer *s,
+		uint8_t **data, size_t *size)
+{
+	uint32_t blob_size;
+
+	if (!packet_capture_read_u32(s, &blob_size))
+		return false;
+
+	*data = blob_size ? bmalloc(blob_size) : NULL;
+	*size = blob_size;
+
+	if (blob_size && !packet_capture_read(s, *data, blob_size)) {
+		bfree(*data);
+		*data = NULL;
+		return false;
+	}
+	return true;
+}
+
+static inline void packet_capture_free_tracks(
+		struct packet_capture_track *tracks, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		bfree(tracks[i].extra_data);
+		bfree(tracks[i].sei);
+	}
+}
+
+/* reads the file header, returns the number of tracks or 0 on failure */
+static inline size_t packet_capture_read_header(struct serializer *s,
+		struct packet_capture_track tracks[PACKET_CAPTURE_MAX_TRACKS])
+{
+	char magic[PACKET_CAPTURE_MAGIC_SIZE];
+	uint8_t version, count, u8;
+	uint16_t codec_len;
+	uint32_t vals[4];
+	size_t i;
+
+	if (!packet_capture_read(s, magic, sizeof(magic)) ||
+	    memcmp(magic, PACKET_CAPTURE_MAGIC, sizeof(magic)) != 0)
+		return 0;
+	if (!packet_capture_read_u8(s, &version) ||
+	    version != PACKET_CAPTURE_VERSION)
+		return 0;
+	if (!packet_capture_read_u8(s, &count) || !count ||
+	    count > PACKET_CAPTURE_MAX_TRACKS)
+		return 0;
+
+	memset(tracks, 0, sizeof(*tracks) * PACKET_CAPTURE_MAX_TRACKS);
+
+	for (i = 0; i < count; i++) {
+		struct packet_capture_track *track = &tracks[i];
+
+		if (!packet_capture_read_u8(s, &u8))
+			goto fail;
+		track->type = (enum obs_encoder_type)u8;
+		if (!packet_capture_read_u8(s, &u8))
+			goto fail;
+		track->track_idx = u8;
+
+		for (size_t j = 0; j < 4; j++)
+			if (!packet_capture_read_u32(s, &vals[j]))
+				goto fail;
+
+		track->timebase_num = (int32_t)vals[0];
+		track->timebase_den = (int32_t)vals[1];
+		if (track->type == OBS_ENCODER_VIDEO) {
+			track->width  = vals[2];
+			track->height = vals[3];
+		} else {
+			track->sample_rate = vals[2];
+			track->channels    = vals[3];
+		}
+
+		if (!packet_capture_read_u16(s, &codec_len) ||
+		    codec_len >= sizeof(track->codec) ||
+		    !packet_capture_read(s, track->codec, codec_len))
+			goto fail;
+		track->codec[codec_len] = 0;
+
+		if (!packet_capture_read_blob(s, &track->extra_data,
+					&track->extra_data_size) ||
+		    !packet_capture_read_blob(s, &track->sei,
+					&track->sei_size))
+			goto fail;
+
+		if (!track->timebase_num || !track->timebase_den)
+			goto fail;
+	}
+
+	return count;
+
+fail:
+	packet_capture_free_tracks(tracks, i + 1);
+	return 0;
+}
+
+/* reads the next packet into a newly allocated buffer.  returns false at
+ * the end of the file */
+static inline bool packet_capture_read_packet(struct serializer *s,
+		struct encoder_packet *packet)
+{
+	uint8_t type, track_idx, flags, priority;
+	uint64_t pts, dts, dts_usec;
+	uint32_t size;
+
+	if (!packet_capture_read_u8(s, &type) ||
+	    !packet_capture_read_u8(s, &track_idx) ||
+	    !packet_capture_read_u8(s, &flags) ||
+	    !packet_capture_read_u8(s, &priority) ||
+	    !packet_capture_read_u64(s, &pts) ||
+	    !packet_capture_read_u64(s, &dts) ||
+	    !packet_capture_read_u64(s, &dts_usec) ||
+	    !packet_capture_read_u32(s, &size))
+		return false;
+
+	memset(packet, 0, sizeof(*packet));
+	packet->type      = (enum obs_encoder_type)type;
+	packet->track_idx = track_idx;
+	packet->keyframe  = (flags & PACKET_CAPTURE_KEYFRAME) != 0;
+	packet->priority  = priority;
+	packet->pts       = (int64_t)pts;
+	packet->dts       = (int64_t)dts;
+	packet->dts_usec  = (int64_t)dts_usec;
+	packet->size      = size;
+	packet->data      = bmalloc(size ? size : 1);
+
+	if (size && !packet_capture_read(s, packet->data, size)) {
+		bfree(packet->data);
+		packet->data = NULL;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,328 @@
+/******************************************************************************
+    Copyright (C) 2016 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <obs-module.h>
+#include <obs-avc.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include "librtmp/rtmp.h"
+#include "flv-mux.h"
+#include "net-stats.h"
+#include "rtmp-probe.h"
+
+#define PROBE_DEFAULT_DURATION_MS 3000
+#define PROBE_MAX_DURATION_MS     10000
+#define PROBE_MAX_SERVERS         32
+#define PROBE_CHUNK_SIZE          65536
+#define PROBE_PACKET_SIZE         (16 * 1024)
+
+/* the suggested bitrate leaves this much of the measured throughput unused,
+ * so that bitrate spikes and cross traffic don't back the stream up */
+#define PROBE_HEADROOM_PERCENT    30
+
+struct probe_server {
+	struct dstr url;
+	const char  *key;
+	uint32_t    duration_ms;
+
+	bool        success;
+	int64_t     rtt_usec;
+	double      kbps;
+};
+
+/* annex-b SPS/PPS, only there so the filler packets have a stream to belong
+ * to */
+static const uint8_t probe_avc_headers[] = {
+	0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0xc0, 0x0d,
+	0xda, 0x05, 0x07, 0xec, 0x04, 0x40, 0x00, 0x00,
+	0x03, 0x00, 0x40, 0x00, 0x00, 0x0f, 0x03, 0xc5,
+	0x0a, 0xa8,
+	0x00, 0x00, 0x00, 0x01, 0x68, 0xce, 0x3c, 0x80
+};
+
+static bool send_flv_packet(RTMP *rtmp, struct encoder_packet *packet,
+		bool is_header, uint64_t *bytes)
+{
+	uint8_t *data;
+	size_t  size;
+	int     ret;
+
+	flv_packet_mux(packet, &data, &size, is_header);
+	ret = RTMP_Write(rtmp, (char*)data, (int)size, 0);
+	bfree(data);
+
+	*bytes += size;
+	return ret >= 0;
+}
+
+static bool send_probe_header(RTMP *rtmp, uint64_t *bytes)
+{
+	struct encoder_packet packet = {
+		.type         = OBS_ENCODER_VIDEO,
+		.timebase_den = 1,
+		.keyframe     = true
+	};
+	bool success;
+
+	packet.size = obs_parse_avc_header(&packet.data, probe_avc_headers,
+			sizeof(probe_avc_headers));
+	success = send_flv_packet(rtmp, &packet, true, bytes);
+	bfree(packet.data);
+	return success;
+}
+
+/* a single filler NAL unit (type 12), all 0xff with a stop bit at the end */
+static uint8_t *create_filler(void)
+{
+	uint8_t *filler = bmalloc(PROBE_PACKET_SIZE);
+
+	memset(filler, 0xff, PROBE_PACKET_SIZE);
+	filler[0] = 0;
+	filler[1] = 0;
+	filler[2] = 0;
+	filler[3] = 1;
+	filler[4] = 0x0c;
+	filler[PROBE_PACKET_SIZE - 1] = 0x80;
+	return filler;
+}
+
+static void push_filler(struct probe_server *server, RTMP *rtmp)
+{
+	uint8_t *filler = create_filler();
+	uint64_t bytes = 0;
+	uint64_t start_ns, end_ns, elapsed_ns;
+	struct net_stats stats;
+
+	struct encoder_packet src = {
+		.data         = filler,
+		.size         = PROBE_PACKET_SIZE,
+		.type         = OBS_ENCODER_VIDEO,
+		.timebase_num = 1,
+		.timebase_den = 1000
+	};
+
+	if (!send_probe_header(rtmp, &bytes))
+		goto finish;
+
+	start_ns = os_gettime_ns();
+	end_ns   = start_ns + (uint64_t)server->duration_ms * 1000000;
+	bytes    = 0;
+
+	while (os_gettime_ns() < end_ns) {
+		struct encoder_packet packet;
+
+		src.dts = src.pts =
+			(int64_t)((os_gettime_ns() - start_ns) / 1000000);
+
+		obs_parse_avc_packet(&packet, &src);
+		if (!send_flv_packet(rtmp, &packet, false, &bytes)) {
+			obs_free_encoder_packet(&packet);
+			goto finish;
+		}
+		obs_free_encoder_packet(&packet);
+	}
+
+	elapsed_ns = os_gettime_ns() - start_ns;
+
+	/* what's still sitting in the send buffer hasn't made it out yet */
+	if (net_get_stats(rtmp->m_sb.sb_socket, &stats)) {
+		if (stats.queued_bytes > 0 &&
+		    (uint64_t)stats.queued_bytes < bytes)
+			bytes -= (uint64_t)stats.queued_bytes;
+		if (server->rtt_usec < 0 && stats.rtt_usec > 0)
+			server->rtt_usec = stats.rtt_usec;
+	}
+
+	server->kbps = (double)bytes * 8.0 * 1000000.0 / (double)elapsed_ns;
+	server->success = true;
+
+finish:
+	bfree(filler);
+}
+
+/* services take a publish with this on the key as a bandwidth test: it is
+ * not broadcast, and doesn't count as the live session for that key */
+static void get_test_key(struct dstr *test_key, const char *key)
+{
+	dstr_copy(test_key, key);
+	dstr_cat(test_key, strchr(key, '?') ?
+			"&bandwidthtest=true" : "?bandwidthtest=true");
+}
+
+static void probe_server(struct probe_server *server)
+{
+	struct net_stats stats;
+	struct dstr test_key = {0};
+
+	/* way too large for the stack */
+	RTMP *rtmp = bmalloc(sizeof(*rtmp));
+
+	server->success = false;
+	server->kbps    = 0.0;
+
+	RTMP_Init(rtmp);
+	if (!RTMP_SetupURL(rtmp, server->url.array))
+		goto finish;
+
+	get_test_key(&test_key, server->key);
+
+	RTMP_EnableWrite(rtmp);
+	RTMP_AddStream(rtmp, test_key.array);
+
+	rtmp->Link.swfUrl          = rtmp->Link.tcUrl;
+	rtmp->m_outChunkSize       = PROBE_CHUNK_SIZE;
+	rtmp->m_bSendChunkSizeInfo = true;
+	rtmp->m_bUseNagle          = false;
+
+	if (!RTMP_Connect(rtmp, NULL))
+		goto finish;
+
+	/* round trip time before the link is loaded */
+	if (net_get_stats(rtmp->m_sb.sb_socket, &stats) && stats.rtt_usec > 0)
+		server->rtt_usec = stats.rtt_usec;
+
+	if (!RTMP_ConnectStream(rtmp, 0))
+		goto finish;
+
+	push_filler(server, rtmp);
+
+finish:
+	RTMP_Close(rtmp);
+	bfree(rtmp);
+	dstr_free(&test_key);
+}
+
+/* one at a time: each server gets the whole uplink, and services that only
+ * allow one publisher per key don't turn the others away */
+static void run_probes(struct probe_server *servers, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		probe_server(&servers[i]);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static size_t load_servers(obs_data_t *settings, struct probe_server *servers,
+		const char *key, uint32_t duration_ms)
+{
+	obs_data_array_t *array = obs_data_get_array(settings, "servers");
+	size_t num = obs_data_array_count(array);
+	size_t count = 0;
+
+	for (size_t i = 0; i < num && count < PROBE_MAX_SERVERS; i++) {
+		obs_data_t *item = obs_data_array_item(array, i);
+		const char *url = obs_data_get_string(item, "server");
+
+		if (url && *url) {
+			struct probe_server *server = &servers[count++];
+
+			memset(server, 0, sizeof(*server));
+			dstr_copy(&server->url, url);
+			server->key         = key;
+			server->duration_ms = duration_ms;
+			server->rtt_usec    = -1;
+		}
+
+		obs_data_release(item);
+	}
+
+	obs_data_array_release(array);
+	return count;
+}
+
+static obs_data_t *build_results(struct probe_server *servers, size_t count,
+		struct probe_server *best)
+{
+	double best_kbps = best ? best->kbps : 0.0;
+
+	obs_data_t *results = obs_data_create();
+	obs_data_array_t *array = obs_data_array_create();
+
+	for (size_t i = 0; i < count; i++) {
+		struct probe_server *server = &servers[i];
+		obs_data_t *item = obs_data_create();
+
+		obs_data_set_string(item, "server", server->url.array);
+		obs_data_set_bool(item, "success", server->success);
+		obs_data_set_int(item, "rtt_ms", server->rtt_usec >= 0 ?
+				server->rtt_usec / 1000 : -1);
+		obs_data_set_int(item, "kbps", (long long)server->kbps);
+		obs_data_array_push_back(array, item);
+		obs_data_release(item);
+	}
+
+	obs_data_set_array(results, "servers", array);
+	obs_data_array_release(array);
+
+	obs_data_set_string(results, "best_server",
+			best ? best->url.array : "");
+	obs_data_set_int(results, "best_kbps", (long long)best_kbps);
+	obs_data_set_int(results, "suggested_bitrate",
+			(long long)(best_kbps *
+				(100 - PROBE_HEADROOM_PERCENT) / 100));
+	return results;
+}
+
+obs_data_t *rtmp_probe(obs_data_t *settings)
+{
+	struct probe_server servers[PROBE_MAX_SERVERS];
+	struct probe_server *best = NULL;
+	const char *key = obs_data_get_string(settings, "key");
+	uint32_t duration_ms;
+	size_t count;
+	obs_data_t *results;
+
+	obs_data_set_default_int(settings, "duration_ms",
+			PROBE_DEFAULT_DURATION_MS);
+	duration_ms = (uint32_t)obs_data_get_int(settings, "duration_ms");
+	if (duration_ms > PROBE_MAX_DURATION_MS)
+		duration_ms = PROBE_MAX_DURATION_MS;
+
+	count = load_servers(settings, servers, key, duration_ms);
+	blog(LOG_INFO, "[rtmp probe] Probing %d servers for %u ms each",
+			(int)count, duration_ms);
+
+	run_probes(servers, count);
+
+	/* rank by throughput, round trip time as the tie-breaker */
+	for (size_t i = 0; i < count; i++) {
+		struct probe_server *server = &servers[i];
+
+		if (!server->success)
+			continue;
+		if (!best || server->kbps > best->kbps ||
+		    (server->kbps == best->kbps &&
+		     server->rtt_usec < best->rtt_usec))
+			best = server;
+	}
+
+	if (best) {
+		blog(LOG_INFO, "[rtmp probe] Best server: %s, %d kbps, "
+				"%d ms round trip", best->url.array,
+				(int)best->kbps,
+				(int)(best->rtt_usec / 1000));
+	} else {
+		blog(LOG_WARNING, "[rtmp probe] Could not reach any server");
+	}
+
+	results = build_results(servers, count, best);
+
+	for (size_t i = 0; i < count; i++)
+		dstr_free(&servers[i].url);
+	return results;
+}
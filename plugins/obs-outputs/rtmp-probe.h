@@ -0,0 +1,44 @@
+/******************************************************************************
+    Copyright (C) 2016 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <obs.h>
+
+/*
+ * Bandwidth probe for picking an ingest server before going live.
+ *
+ * Connects to the given servers one at a time and publishes filler data
+ * (H.264 filler NAL units, which decoders ignore) to each of them for a few
+ * seconds to compare them.  The key is always published in the service's
+ * bandwidth test mode ("bandwidthtest=true" is added to it), so the probe
+ * never goes live.  Takes about duration_ms per server.
+ *
+ * settings:
+ *   "servers"     array of objects with a "server" URL
+  *   "key"         stream key of the service
+ *   "duration_ms" how long to push filler data to each server for
+ *                 (default 3000)
+ *
+ * results:
+ *   "servers"     array of objects with "server", "success", "rtt_ms"
+ *                 and "kbps"
+ *   "best_server" URL of the fastest server, empty if all failed
+ *   "best_kbps"   throughput to it
+ *   "suggested_bitrate"  total bitrate that leaves enough headroom
+ */
+extern obs_data_t *rtmp_probe(obs_data_t *settings);
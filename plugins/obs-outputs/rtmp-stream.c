@@ -25,6 +25,8 @@
 #include "librtmp/rtmp.h"
 #include "librtmp/log.h"
 #include "flv-mux.h"
+#include "net-stats.h"
+#include "rtmp-probe.h"
 
 #define do_log(level, format, ...) \
 	blog(level, "[rtmp stream: '%s'] " format, \
@@ -35,19 +37,67 @@
 #define debug(format, ...) do_log(LOG_DEBUG,   format, ##__VA_ARGS__)
 
 #define OPT_DROP_THRESHOLD "drop_threshold_ms"
+#define OPT_DYN_BITRATE    "dyn_bitrate"
+#define OPT_DESTINATIONS   "destinations"
+#define OPT_CHUNK_SIZE     "chunk_size"
+#define OPT_AGGREGATE      "aggregate_audio"
+
+/* outgoing chunk size sent to the server right after connecting.  every
+ * chunk costs a header, so large video packets go out in few of them */
+#define DEFAULT_CHUNK_SIZE 65536
+
+/* most the send queue may hold with low latency video before dropping */
+#define LOW_LATENCY_DROP_THRESHOLD_USEC 200000
+
+/* maximum number of queued packets sent with a single batched write */
+#define SEND_BATCH_SIZE 32
+
+/* dynamic bitrate: how often the link is evaluated, how long the link has
+ * to stay clear before the bitrate is raised again, and how far down the
+ * bitrate can go relative to the configured bitrate */
+#define DBR_INTERVAL_NS         1000000000ULL
+#define DBR_RECOVER_INTERVAL_NS 5000000000ULL
+#define DBR_MIN_DIVISOR         5
+#define DBR_RECOVER_STEPS       10
+#define DBR_CLEAR_USEC          100000
+
+/* how often the send thread looks at the socket, and the limits for sizing
+ * the send buffer to the measured bandwidth-delay product */
+#define NET_CHECK_INTERVAL_NS   250000000ULL
+#define MIN_SENDBUF_SIZE        65535
+#define MAX_SENDBUF_SIZE        (8 * 1024 * 1024)
+
+/* reconnect delays for the destinations of a multi-destination output */
+#define RECONNECT_RETRY_MIN_MS 2000
+#define RECONNECT_RETRY_MAX_MS 20000
 
 //#define TEST_FRAMEDROPS
 
 struct rtmp_stream {
 	obs_output_t     *output;
 
+	/*
+	 * Packets waiting to be sent.  Dropped packets are freed in place
+	 * and skipped by the send thread, so that dropping never has to
+	 * rebuild the queue.  Every queued video packet is indexed by its
+	 * sequence number in the drop index for its priority.
+	 */
 	pthread_mutex_t  packets_mutex;
-	struct circlebuf packets;
+	DARRAY(struct encoder_packet) packets;
+	size_t           packets_head;
+	uint64_t         packets_first_seq;
+	struct circlebuf drop_index[OBS_NAL_PRIORITY_HIGHEST + 1];
+	int              drop_level;
 	bool             sent_headers;
 
 	bool             connecting;
 	pthread_t        connect_thread;
 
+	/* set for each destination of a multi-destination output.  those
+	 * run connecting, sending and reconnecting on a single thread of
+	 * their own (connect_thread), and don't control data capture */
+	bool             multi_dest;
+
 	bool             active;
 	pthread_t        send_thread;
 
@@ -58,6 +108,9 @@ struct rtmp_stream {
 	struct dstr      username, password;
 	struct dstr      encoder_name;
 
+	int              chunk_size;
+	bool             aggregate;
+
 	/* frame drop variables */
 	int64_t          drop_threshold_usec;
 	int64_t          min_drop_dts_usec;
@@ -68,6 +121,28 @@ struct rtmp_stream {
 	uint64_t         total_bytes_sent;
 	int              dropped_frames;
 
+	/* socket state, measured by the send thread.  net_backlog_ms is how
+	 * long the data sitting in the OS send queue will take to go out at
+	 * the current send rate, and counts towards the buffer duration
+	 * used for frame dropping */
+	volatile long    net_backlog_ms;
+	int64_t          net_rtt_usec;
+	int64_t          net_send_bps;
+	int              net_sndbuf_size;
+	uint64_t         net_last_check_ns;
+	uint64_t         net_last_bytes_sent;
+
+	/* dynamic bitrate variables, only used by the send thread */
+	bool             dbr_enabled;
+	long long        dbr_orig_bitrate;
+	long long        dbr_cur_bitrate;
+	uint64_t         dbr_last_check_ns;
+	uint64_t         dbr_last_change_ns;
+	uint64_t         dbr_last_bytes_sent;
+
+	/* reused by the send thread for every batch */
+	struct array_output_data mux_buffers[SEND_BATCH_SIZE];
+
 	RTMP             rtmp;
 };
 
@@ -85,13 +160,88 @@ static void log_rtmp(int level, const char *format, va_list args)
 	blogva(LOG_INFO, format, args);
 }
 
+static inline size_t num_buffered_packets(struct rtmp_stream *stream)
+{
+	return stream->packets.num - stream->packets_head;
+}
+
+static inline uint64_t end_seq(struct rtmp_stream *stream)
+{
+	return stream->packets_first_seq + stream->packets.num;
+}
+
+static inline uint64_t head_seq(struct rtmp_stream *stream)
+{
+	return stream->packets_first_seq + stream->packets_head;
+}
+
+static inline struct encoder_packet *queued_packet(
+		struct rtmp_stream *stream, uint64_t seq)
+{
+	return stream->packets.array + (seq - stream->packets_first_seq);
+}
+
+static inline bool packet_dropped(const struct encoder_packet *packet)
+{
+	return packet->data == NULL;
+}
+
+/* removes index entries of packets that have already been sent */
+static inline void prune_drop_index(struct rtmp_stream *stream, int priority)
+{
+	struct circlebuf *index = &stream->drop_index[priority];
+	uint64_t seq;
+
+	while (index->size) {
+		circlebuf_peek_front(index, &seq, sizeof(seq));
+		if (seq >= head_seq(stream))
+			break;
+		circlebuf_pop_front(index, NULL, sizeof(seq));
+	}
+}
+
+/* pops the next packet that hasn't been dropped */
+static bool pop_packet(struct rtmp_stream *stream,
+		struct encoder_packet *packet)
+{
+	bool found = false;
+
+	while (!found && stream->packets_head < stream->packets.num) {
+		struct encoder_packet *cur =
+			&stream->packets.array[stream->packets_head++];
+
+		if (!packet_dropped(cur)) {
+			*packet = *cur;
+			found = true;
+		}
+	}
+
+	/* only move the remaining packets down once at least half of the
+	 * array has been sent, so popping stays amortized O(1) */
+	if (stream->packets_head == stream->packets.num) {
+		stream->packets_first_seq += stream->packets.num;
+		stream->packets_head = 0;
+		da_resize(stream->packets, 0);
+
+	} else if (stream->packets_head >= 32 &&
+	           stream->packets_head * 2 >= stream->packets.num) {
+		da_erase_range(stream->packets, 0, stream->packets_head);
+		stream->packets_first_seq += stream->packets_head;
+		stream->packets_head = 0;
+	}
+
+	return found;
+}
+
 static inline void free_packets(struct rtmp_stream *stream)
 {
-	while (stream->packets.size) {
-		struct encoder_packet packet;
-		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
+	struct encoder_packet packet;
+
+	while (pop_packet(stream, &packet))
 		obs_free_encoder_packet(&packet);
-	}
+
+	for (size_t i = 0; i <= OBS_NAL_PRIORITY_HIGHEST; i++)
+		circlebuf_free(&stream->drop_index[i]);
 }
 
 static void rtmp_stream_stop(void *data);
@@ -113,11 +263,24 @@ static void rtmp_stream_destroy(void *data)
 		os_event_destroy(stream->stop_event);
 		os_sem_destroy(stream->send_sem);
 		pthread_mutex_destroy(&stream->packets_mutex);
-		circlebuf_free(&stream->packets);
+		da_free(stream->packets);
+
+		for (size_t i = 0; i < SEND_BATCH_SIZE; i++)
+			array_output_serializer_free(&stream->mux_buffers[i]);
+
 		bfree(stream);
 	}
 }
 
+/* blocks for a few seconds per server, call it from a thread of its own */
+static void rtmp_stream_probe_proc(void *data, calldata_t *cd)
+{
+	obs_data_t *settings = calldata_ptr(cd, "settings");
+
+	calldata_set_ptr(cd, "results", settings ? rtmp_probe(settings) : NULL);
+	UNUSED_PARAMETER(data);
+}
+
 static void *rtmp_stream_create(obs_data_t *settings, obs_output_t *output)
 {
 	struct rtmp_stream *stream = bzalloc(sizeof(struct rtmp_stream));
@@ -177,20 +340,17 @@ static inline void set_rtmp_dstr(AVal *val, struct dstr *str)
 	val->av_len = valid ? (int)str->len : 0;
 }
 
-static inline bool get_next_packet(struct rtmp_stream *stream,
-		struct encoder_packet *packet)
+static inline size_t get_next_packets(struct rtmp_stream *stream,
+		struct encoder_packet *packets, size_t max_packets)
 {
-	bool new_packet = false;
+	size_t count = 0;
 
 	pthread_mutex_lock(&stream->packets_mutex);
-	if (stream->packets.size) {
-		circlebuf_pop_front(&stream->packets, packet,
-				sizeof(struct encoder_packet));
-		new_packet = true;
-	}
+	while (count < max_packets && pop_packet(stream, &packets[count]))
+		count++;
 	pthread_mutex_unlock(&stream->packets_mutex);
 
-	return new_packet;
+	return count;
 }
 
 static int send_packet(struct rtmp_stream *stream,
@@ -213,47 +373,311 @@ static int send_packet(struct rtmp_stream *stream,
 	return ret;
 }
 
+/* muxes the packets and sends all of them with one scatter-gather write
+ * instead of chunking and sending each one separately */
+static int send_packets(struct rtmp_stream *stream,
+		struct encoder_packet *packets, size_t count)
+{
+	RTMPWriteItem items[SEND_BATCH_SIZE];
+	size_t        total = 0;
+	int           ret;
+
+	for (size_t i = 0; i < count; i++) {
+		struct array_output_data *buf = &stream->mux_buffers[i];
+
+		flv_packet_mux_buffer(&packets[i], buf, false);
+		items[i].data      = (const char*)buf->bytes.array;
+		items[i].size      = (int)buf->bytes.num;
+		items[i].streamIdx = (int)packets[i].track_idx;
+		total += buf->bytes.num;
+	}
+
+#ifdef TEST_FRAMEDROPS
+	os_sleep_ms(rand() % 40);
+#endif
+	ret = RTMP_WriteBatch(&stream->rtmp, items, (int)count);
+
+	for (size_t i = 0; i < count; i++) {
+		if (ret >= 0)
+			obs_output_packet_sent(stream->output, &packets[i]);
+		obs_free_encoder_packet(&packets[i]);
+	}
+
+	stream->total_bytes_sent += total;
+	return ret;
+}
+
+static int64_t get_buffered_usec(struct rtmp_stream *stream)
+{
+	int64_t buffered_usec = 0;
+
+	pthread_mutex_lock(&stream->packets_mutex);
+	if (num_buffered_packets(stream)) {
+		struct encoder_packet *first =
+			queued_packet(stream, head_seq(stream));
+		buffered_usec = stream->last_dts_usec - first->dts_usec;
+	}
+	pthread_mutex_unlock(&stream->packets_mutex);
+
+	return buffered_usec + (int64_t)stream->net_backlog_ms * 1000;
+}
+
+static void net_init(struct rtmp_stream *stream)
+{
+	stream->net_backlog_ms      = 0;
+	stream->net_rtt_usec        = -1;
+	stream->net_send_bps        = 0;
+	stream->net_last_check_ns   = os_gettime_ns();
+	stream->net_last_bytes_sent = stream->total_bytes_sent;
+	stream->net_sndbuf_size     =
+		net_get_sndbuf(stream->rtmp.m_sb.sb_socket);
+
+#ifdef _WIN32
+	if (stream->net_sndbuf_size < MIN_SENDBUF_SIZE &&
+	    net_set_sndbuf(stream->rtmp.m_sb.sb_socket, MIN_SENDBUF_SIZE))
+		stream->net_sndbuf_size = MIN_SENDBUF_SIZE;
+#endif
+}
+
+/* enough send buffer to keep the link busy for two round trips, or whatever
+ * the OS suggests if it keeps track of that itself */
+static int net_ideal_sndbuf(struct rtmp_stream *stream,
+		const struct net_stats *stats)
+{
+	int64_t size;
+
+	if (stats->ideal_backlog > 0)
+		size = stats->ideal_backlog;
+	else if (stats->rtt_usec > 0 && stream->net_send_bps > 0)
+		size = stream->net_send_bps / 8 * stats->rtt_usec / 1000000 * 2;
+	else
+		return 0;
+
+	if (size < MIN_SENDBUF_SIZE)
+		size = MIN_SENDBUF_SIZE;
+	if (size > MAX_SENDBUF_SIZE)
+		size = MAX_SENDBUF_SIZE;
+	return (int)size;
+}
+
+static void net_resize_sndbuf(struct rtmp_stream *stream, int size)
+{
+#ifdef __linux__
+	/* setting SO_SNDBUF turns off linux's own send buffer tuning, which
+	 * already follows the congestion window */
+	UNUSED_PARAMETER(stream);
+	UNUSED_PARAMETER(size);
+#else
+	/* only shrink once it's well over, so it doesn't keep flapping */
+	if (!size || (size <= stream->net_sndbuf_size &&
+	              size > stream->net_sndbuf_size / 2))
+		return;
+
+	if (net_set_sndbuf(stream->rtmp.m_sb.sb_socket, size)) {
+		debug("Send buffer resized from %d to %d bytes",
+				stream->net_sndbuf_size, size);
+		stream->net_sndbuf_size = size;
+	}
+#endif
+}
+
+/* tracks the send rate and what is still waiting in the socket, so that
+ * congestion is noticed even while the packet queue itself is empty */
+static void net_check(struct rtmp_stream *stream)
+{
+	uint64_t now = os_gettime_ns();
+	uint64_t elapsed_ns = now - stream->net_last_check_ns;
+	uint64_t bytes_sent;
+	struct net_stats stats;
+	int64_t bps;
+
+	if (elapsed_ns < NET_CHECK_INTERVAL_NS)
+		return;
+
+	bytes_sent = stream->total_bytes_sent - stream->net_last_bytes_sent;
+	bps = (int64_t)(bytes_sent * 8 * 1000000000ULL / elapsed_ns);
+
+	stream->net_last_check_ns   = now;
+	stream->net_last_bytes_sent = stream->total_bytes_sent;
+	stream->net_send_bps = stream->net_send_bps ?
+		(stream->net_send_bps * 3 + bps) / 4 : bps;
+
+	if (!net_get_stats(stream->rtmp.m_sb.sb_socket, &stats))
+		return;
+
+	if (stats.rtt_usec > 0)
+		stream->net_rtt_usec = stats.rtt_usec;
+
+	if (stats.queued_bytes >= 0 && stream->net_send_bps > 0)
+		stream->net_backlog_ms = (long)(stats.queued_bytes * 8 * 1000 /
+				stream->net_send_bps);
+	else
+		stream->net_backlog_ms = 0;
+
+	net_resize_sndbuf(stream, net_ideal_sndbuf(stream, &stats));
+}
+
+static void dbr_set_bitrate(struct rtmp_stream *stream, long long bitrate)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
+	obs_data_t    *settings = obs_data_create();
+
+	obs_data_set_int(settings, "bitrate", bitrate);
+	obs_encoder_update(vencoder, settings);
+	obs_data_release(settings);
+
+	stream->dbr_cur_bitrate = bitrate;
+}
+
+static void dbr_init(struct rtmp_stream *stream)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
+	obs_data_t    *settings;
+
+	stream->dbr_orig_bitrate = 0;
+
+	if (stream->dbr_enabled && vencoder) {
+		settings = obs_encoder_get_settings(vencoder);
+		stream->dbr_orig_bitrate = obs_data_get_int(settings,
+				"bitrate");
+		obs_data_release(settings);
+	}
+
+	/* encoders without a bitrate setting can't be adjusted */
+	if (stream->dbr_orig_bitrate <= 0)
+		stream->dbr_enabled = false;
+
+	stream->dbr_cur_bitrate     = stream->dbr_orig_bitrate;
+	stream->dbr_last_check_ns   = os_gettime_ns();
+	stream->dbr_last_change_ns  = stream->dbr_last_check_ns;
+	stream->dbr_last_bytes_sent = 0;
+}
+
+/* lowers the video bitrate when packets start piling up in the send
+ * queue, before it reaches the point of dropping frames, and slowly raises
+ * it back up once the queue has stayed clear for a while */
+static void dbr_check(struct rtmp_stream *stream)
+{
+	uint64_t  now = os_gettime_ns();
+	uint64_t  elapsed_ns = now - stream->dbr_last_check_ns;
+	uint64_t  bytes_sent;
+	int64_t   buffered_usec;
+	long long sent_kbps;
+	long long bitrate = stream->dbr_cur_bitrate;
+	long long min_bitrate = stream->dbr_orig_bitrate / DBR_MIN_DIVISOR;
+
+	if (!stream->dbr_enabled || elapsed_ns < DBR_INTERVAL_NS)
+		return;
+
+	bytes_sent = stream->total_bytes_sent - stream->dbr_last_bytes_sent;
+	sent_kbps  = (long long)(bytes_sent * 8 * 1000000 / elapsed_ns);
+	buffered_usec = get_buffered_usec(stream);
+
+	stream->dbr_last_check_ns   = now;
+	stream->dbr_last_bytes_sent = stream->total_bytes_sent;
+
+	if (buffered_usec > stream->drop_threshold_usec / 3) {
+		/* congested: go down to what the link actually managed, but
+		 * by no more than half at a time */
+		bitrate = bitrate * 3 / 4;
+		if (sent_kbps < bitrate)
+			bitrate = sent_kbps;
+		if (bitrate < stream->dbr_cur_bitrate / 2)
+			bitrate = stream->dbr_cur_bitrate / 2;
+		if (bitrate < min_bitrate)
+			bitrate = min_bitrate;
+
+	} else if (buffered_usec < DBR_CLEAR_USEC &&
+	           now - stream->dbr_last_change_ns >=
+	           DBR_RECOVER_INTERVAL_NS) {
+		bitrate += stream->dbr_orig_bitrate / DBR_RECOVER_STEPS;
+		if (bitrate > stream->dbr_orig_bitrate)
+			bitrate = stream->dbr_orig_bitrate;
+	}
+
+	if (bitrate != stream->dbr_cur_bitrate) {
+		info("Congestion %s, changing bitrate from %lld to %lld kbps "
+		     "(%" PRId64 " ms buffered, %lld kbps sent)",
+		     bitrate < stream->dbr_cur_bitrate ? "detected" : "cleared",
+		     stream->dbr_cur_bitrate, bitrate,
+		     buffered_usec / 1000, sent_kbps);
+
+		dbr_set_bitrate(stream, bitrate);
+		stream->dbr_last_change_ns = now;
+	}
+}
+
+static void dbr_restore(struct rtmp_stream *stream)
+{
+	if (stream->dbr_enabled &&
+	    stream->dbr_cur_bitrate != stream->dbr_orig_bitrate)
+		dbr_set_bitrate(stream, stream->dbr_orig_bitrate);
+}
+
 static inline void send_headers(struct rtmp_stream *stream);
 
 static bool send_remaining_packets(struct rtmp_stream *stream)
 {
-	struct encoder_packet packet;
+	struct encoder_packet packets[SEND_BATCH_SIZE];
+	size_t count;
 
 	if (!stream->sent_headers)
 		send_headers(stream);
 
-	while (get_next_packet(stream, &packet))
-		if (send_packet(stream, &packet, false, packet.track_idx) < 0)
+	while ((count = get_next_packets(stream, packets, SEND_BATCH_SIZE)))
+		if (send_packets(stream, packets, count) < 0)
 			return false;
 
 	return true;
 }
 
-static void *send_thread(void *data)
+/* sends packets until stopped, returns true if the connection was lost */
+static bool send_loop(struct rtmp_stream *stream)
 {
-	struct rtmp_stream *stream = data;
 	bool disconnected = false;
 
 	while (os_sem_wait(stream->send_sem) == 0) {
-		struct encoder_packet packet;
+		struct encoder_packet packets[SEND_BATCH_SIZE];
+		size_t count;
 
 		if (os_event_try(stream->stop_event) != EAGAIN)
 			break;
-		if (!get_next_packet(stream, &packet))
+
+		/* drain whatever else has been queued up in the meantime as
+		 * well; the semaphore counts for those packets will just
+		 * find the queue empty */
+		count = get_next_packets(stream, packets, SEND_BATCH_SIZE);
+		if (!count)
 			continue;
 
 		if (!stream->sent_headers)
 			send_headers(stream);
 
-		if (send_packet(stream, &packet, false, packet.track_idx) < 0) {
+		if (send_packets(stream, packets, count) < 0) {
 			disconnected = true;
 			break;
 		}
+
+		net_check(stream);
+		dbr_check(stream);
 	}
 
 	if (!disconnected && !send_remaining_packets(stream))
 		disconnected = true;
 
+	return disconnected;
+}
+
+static void *send_thread(void *data)
+{
+	struct rtmp_stream *stream = data;
+	bool disconnected;
+
+	os_set_thread_name("rtmp-stream: send_thread");
+	obs_apply_thread_settings(OBS_THREAD_ROLE_OUTPUT);
+
+	disconnected = send_loop(stream);
+
 	if (disconnected) {
 		info("Disconnected from %s", stream->path.array);
 		free_packets(stream);
@@ -266,6 +690,13 @@ static void *send_thread(void *data)
 		obs_output_signal_stop(stream->output, OBS_OUTPUT_DISCONNECTED);
 	}
 
+	/* don't leave a lowered bitrate in the encoder's settings */
+	dbr_restore(stream);
+
+	/* only used by this thread, no need to keep them while stopped */
+	for (size_t i = 0; i < SEND_BATCH_SIZE; i++)
+		array_output_serializer_free(&stream->mux_buffers[i]);
+
 	stream->active = false;
 	stream->sent_headers = false;
 	return NULL;
@@ -342,37 +773,32 @@ static inline bool reset_semaphore(struct rtmp_stream *stream)
 	return os_sem_init(&stream->send_sem, 0) == 0;
 }
 
-#ifdef _WIN32
-#define socklen_t int
-#endif
-
-#define MIN_SENDBUF_SIZE 65535
-
-static void adjust_sndbuf_size(struct rtmp_stream *stream, int new_size)
-{
-	int cur_sendbuf_size = new_size;
-	socklen_t int_size = sizeof(int);
-
-	getsockopt(stream->rtmp.m_sb.sb_socket, SOL_SOCKET, SO_SNDBUF,
-			(char*)&cur_sendbuf_size, &int_size);
-
-	if (cur_sendbuf_size < new_size) {
-		cur_sendbuf_size = new_size;
-		setsockopt(stream->rtmp.m_sb.sb_socket, SOL_SOCKET, SO_SNDBUF,
-				(const char*)&cur_sendbuf_size, int_size);
-	}
-}
-
 static int init_send(struct rtmp_stream *stream)
 {
 	int ret;
 	size_t idx = 0;
 
-#if defined(_WIN32)
-	adjust_sndbuf_size(stream, MIN_SENDBUF_SIZE);
-#endif
+	net_init(stream);
+
+	/* destinations of a multi-destination output keep their semaphore
+	 * for their whole lifetime since packets can arrive at any time, and
+	 * send from their own thread */
+	if (stream->multi_dest) {
+		pthread_mutex_lock(&stream->packets_mutex);
+		stream->drop_level = OBS_NAL_PRIORITY_DISPOSABLE;
+		stream->min_drop_dts_usec = 0;
+
+		/* capture is already running, so start at a keyframe */
+		stream->min_priority = OBS_NAL_PRIORITY_HIGHEST;
+		stream->active = true;
+		pthread_mutex_unlock(&stream->packets_mutex);
+
+		while (send_meta_data(stream, idx++));
+		return OBS_OUTPUT_SUCCESS;
+	}
 
 	reset_semaphore(stream);
+	dbr_init(stream);
 
 	ret = pthread_create(&stream->send_thread, NULL, send_thread, stream);
 	if (ret != 0) {
@@ -435,9 +861,12 @@ static int try_connect(struct rtmp_stream *stream)
 		RTMP_AddStream(&stream->rtmp, encoder_name);
 	}
 
-	stream->rtmp.m_outChunkSize       = 4096;
+	stream->rtmp.m_outChunkSize       = stream->chunk_size;
 	stream->rtmp.m_bSendChunkSizeInfo = true;
-	stream->rtmp.m_bUseNagle          = true;
+	stream->rtmp.m_bAggregate         = stream->aggregate;
+	/* packets go out as whole batches already, nagle would only hold
+	 * back the end of each one */
+	stream->rtmp.m_bUseNagle          = false;
 
 	if (!RTMP_Connect(&stream->rtmp, NULL))
 		return OBS_OUTPUT_CONNECT_FAILED;
@@ -466,6 +895,39 @@ static void *connect_thread(void *data)
 	return NULL;
 }
 
+static inline bool low_latency_video(void)
+{
+	struct obs_video_info ovi;
+	return obs_get_video_info(&ovi) && ovi.low_latency;
+}
+
+/* with low latency video, drop frames rather than letting a backlog build
+ * up in the send queue */
+static void load_drop_threshold(struct rtmp_stream *stream,
+		obs_data_t *settings)
+{
+	stream->drop_threshold_usec =
+		(int64_t)obs_data_get_int(settings, OPT_DROP_THRESHOLD) * 1000;
+
+	if (low_latency_video() &&
+	    stream->drop_threshold_usec > LOW_LATENCY_DROP_THRESHOLD_USEC)
+		stream->drop_threshold_usec = LOW_LATENCY_DROP_THRESHOLD_USEC;
+}
+
+static void load_chunk_settings(struct rtmp_stream *stream,
+		obs_data_t *settings)
+{
+	stream->chunk_size = (int)obs_data_get_int(settings, OPT_CHUNK_SIZE);
+	stream->aggregate  = obs_data_get_bool(settings, OPT_AGGREGATE);
+
+	if (stream->chunk_size < RTMP_DEFAULT_CHUNKSIZE)
+		stream->chunk_size = RTMP_DEFAULT_CHUNKSIZE;
+
+	/* aggregation holds audio back to bundle it with later packets */
+	if (low_latency_video())
+		stream->aggregate = false;
+}
+
 static bool rtmp_stream_start(void *data)
 {
 	struct rtmp_stream *stream = data;
@@ -479,6 +941,7 @@ static bool rtmp_stream_start(void *data)
 
 	stream->total_bytes_sent = 0;
 	stream->dropped_frames   = 0;
+	stream->drop_level       = OBS_NAL_PRIORITY_DISPOSABLE;
 	stream->min_drop_dts_usec= 0;
 	stream->min_priority     = 0;
 
@@ -487,8 +950,9 @@ static bool rtmp_stream_start(void *data)
 	dstr_copy(&stream->key,      obs_service_get_key(service));
 	dstr_copy(&stream->username, obs_service_get_username(service));
 	dstr_copy(&stream->password, obs_service_get_password(service));
-	stream->drop_threshold_usec =
-		(int64_t)obs_data_get_int(settings, OPT_DROP_THRESHOLD) * 1000;
+	stream->dbr_enabled = obs_data_get_bool(settings, OPT_DYN_BITRATE);
+	load_drop_threshold(stream, settings);
+	load_chunk_settings(stream, settings);
 	obs_data_release(settings);
 
 	return pthread_create(&stream->connect_thread, NULL, connect_thread,
@@ -498,79 +962,142 @@ static bool rtmp_stream_start(void *data)
 static inline bool add_packet(struct rtmp_stream *stream,
 		struct encoder_packet *packet)
 {
-	circlebuf_push_back(&stream->packets, packet,
-			sizeof(struct encoder_packet));
+	uint64_t seq = end_seq(stream);
+
+	da_push_back(stream->packets, packet);
 	stream->last_dts_usec = packet->dts_usec;
+
+	if (packet->type == OBS_ENCODER_VIDEO) {
+		int priority = packet->priority;
+
+		if (priority < OBS_NAL_PRIORITY_DISPOSABLE)
+			priority = OBS_NAL_PRIORITY_DISPOSABLE;
+		else if (priority > OBS_NAL_PRIORITY_HIGHEST)
+			priority = OBS_NAL_PRIORITY_HIGHEST;
+
+		prune_drop_index(stream, priority);
+		circlebuf_push_back(&stream->drop_index[priority], &seq,
+				sizeof(seq));
+	}
+
 	return true;
 }
 
-static inline size_t num_buffered_packets(struct rtmp_stream *stream)
+static inline void drop_queued_packet(struct encoder_packet *packet)
 {
-	return stream->packets.size / sizeof(struct encoder_packet);
+	/* keep the timestamp, the dropped packet may still be at the front
+	 * of the queue when the buffer duration is checked */
+	int64_t dts_usec = packet->dts_usec;
+
+	obs_free_encoder_packet(packet);
+	packet->dts_usec = dts_usec;
 }
 
-static void drop_frames(struct rtmp_stream *stream)
+/*
+ * Drops queued video packets of the given priority and below.  Packets of
+ * disposable and low priority aren't referenced by anything and can all be
+ * dropped.  Dropping higher priority frames breaks the reference chain, so
+ * they're only dropped up to the next queued keyframe; if there isn't one,
+ * incoming packets are dropped until the next keyframe arrives.
+ */
+static int drop_queued_frames(struct rtmp_stream *stream, int max_priority,
+		int *drop_priority)
 {
-	struct circlebuf new_buf            = {0};
-	int              drop_priority      = 0;
-	uint64_t         last_drop_dts_usec = 0;
-	int              num_frames_dropped = 0;
+	struct circlebuf *keyframes =
+		&stream->drop_index[OBS_NAL_PRIORITY_HIGHEST];
+	uint64_t next_keyframe = end_seq(stream);
+	int      num_dropped   = 0;
+	bool     broke_refs    = false;
+	uint64_t seq;
 
-	debug("Previous packet count: %d", (int)num_buffered_packets(stream));
+	prune_drop_index(stream, OBS_NAL_PRIORITY_HIGHEST);
+	if (keyframes->size)
+		circlebuf_peek_front(keyframes, &next_keyframe, sizeof(seq));
 
-	circlebuf_reserve(&new_buf, sizeof(struct encoder_packet) * 8);
+	for (int i = OBS_NAL_PRIORITY_DISPOSABLE; i <= max_priority; i++) {
+		struct circlebuf *index = &stream->drop_index[i];
+		bool breaks_refs = i >= OBS_NAL_PRIORITY_HIGH;
 
-	while (stream->packets.size) {
-		struct encoder_packet packet;
-		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
+		prune_drop_index(stream, i);
 
-		last_drop_dts_usec = packet.dts_usec;
+		while (index->size) {
+			struct encoder_packet *packet;
 
-		/* do not drop audio data or video keyframes */
-		if (packet.type          == OBS_ENCODER_AUDIO ||
-		    packet.drop_priority == OBS_NAL_PRIORITY_HIGHEST) {
-			circlebuf_push_back(&new_buf, &packet, sizeof(packet));
+			circlebuf_peek_front(index, &seq, sizeof(seq));
+			if (breaks_refs && seq >= next_keyframe)
+				break;
 
-		} else {
-			if (drop_priority < packet.drop_priority)
-				drop_priority = packet.drop_priority;
+			circlebuf_pop_front(index, NULL, sizeof(seq));
+			packet = queued_packet(stream, seq);
 
-			num_frames_dropped++;
-			obs_free_encoder_packet(&packet);
+			if (breaks_refs)
+				broke_refs = true;
+			else if (*drop_priority < packet->drop_priority)
+				*drop_priority = packet->drop_priority;
+
+			drop_queued_packet(packet);
+			num_dropped++;
 		}
 	}
 
-	circlebuf_free(&stream->packets);
-	stream->packets           = new_buf;
+	/* without a queued keyframe, everything up to the next one that
+	 * comes in is missing its references */
+	if (broke_refs && next_keyframe == end_seq(stream))
+		*drop_priority = OBS_NAL_PRIORITY_HIGHEST;
+
+	return num_dropped;
+}
+
+static void drop_frames(struct rtmp_stream *stream)
+{
+	int drop_priority      = 0;
+	int num_frames_dropped;
+
+	debug("Previous packet count: %d", (int)num_buffered_packets(stream));
+
+	num_frames_dropped = drop_queued_frames(stream, stream->drop_level,
+			&drop_priority);
+
 	stream->min_priority      = drop_priority;
-	stream->min_drop_dts_usec = last_drop_dts_usec;
+	stream->min_drop_dts_usec = stream->last_dts_usec;
 
 	stream->dropped_frames += num_frames_dropped;
-	debug("New packet count: %d", (int)num_buffered_packets(stream));
+	debug("Dropped %d frames (priority %d and below)",
+			num_frames_dropped, stream->drop_level);
 }
 
 static void check_to_drop_frames(struct rtmp_stream *stream)
 {
-	struct encoder_packet first;
+	struct encoder_packet *first;
 	int64_t buffer_duration_usec;
 
 	if (num_buffered_packets(stream) < 5)
 		return;
 
-	circlebuf_peek_front(&stream->packets, &first, sizeof(first));
+	first = queued_packet(stream, head_seq(stream));
 
 	/* do not drop frames if frames were just dropped within this time */
-	if (first.dts_usec < stream->min_drop_dts_usec)
+	if (first->dts_usec < stream->min_drop_dts_usec)
 		return;
 
 	/* if the amount of time stored in the buffered packets waiting to be
-	 * sent is higher than threshold, drop frames */
-	buffer_duration_usec = stream->last_dts_usec - first.dts_usec;
+	 * sent (and in the socket) is higher than threshold, drop frames.
+	 * start with disposable frames only, and drop more important frames
+	 * each time the buffer is still over the threshold after the
+	 * previous drop */
+	buffer_duration_usec = stream->last_dts_usec - first->dts_usec +
+		(int64_t)stream->net_backlog_ms * 1000;
 
 	if (buffer_duration_usec > stream->drop_threshold_usec) {
 		drop_frames(stream);
 		debug("dropping %" PRId64 " worth of frames",
 				buffer_duration_usec);
+
+		if (stream->drop_level < OBS_NAL_PRIORITY_HIGH)
+			stream->drop_level++;
+
+	} else if (buffer_duration_usec < stream->drop_threshold_usec / 2) {
+		stream->drop_level = OBS_NAL_PRIORITY_DISPOSABLE;
 	}
 }
 
@@ -604,9 +1131,13 @@ static void rtmp_stream_data(void *data, struct encoder_packet *packet)
 
 	pthread_mutex_lock(&stream->packets_mutex);
 
-	added_packet = (packet->type == OBS_ENCODER_VIDEO) ?
-		add_video_packet(stream, &new_packet) :
-		add_packet(stream, &new_packet);
+	/* destinations that are (re)connecting don't buffer anything */
+	if (stream->multi_dest && !stream->active)
+		added_packet = false;
+	else if (packet->type == OBS_ENCODER_VIDEO)
+		added_packet = add_video_packet(stream, &new_packet);
+	else
+		added_packet = add_packet(stream, &new_packet);
 
 	pthread_mutex_unlock(&stream->packets_mutex);
 
@@ -619,6 +1150,18 @@ static void rtmp_stream_data(void *data, struct encoder_packet *packet)
 static void rtmp_stream_defaults(obs_data_t *defaults)
 {
 	obs_data_set_default_int(defaults, OPT_DROP_THRESHOLD, 600);
+	obs_data_set_default_bool(defaults, OPT_DYN_BITRATE, false);
+	obs_data_set_default_int(defaults, OPT_CHUNK_SIZE, DEFAULT_CHUNK_SIZE);
+	obs_data_set_default_bool(defaults, OPT_AGGREGATE, false);
+}
+
+static void add_chunk_properties(obs_properties_t *props)
+{
+	obs_properties_add_int(props, OPT_CHUNK_SIZE,
+			obs_module_text("RTMPStream.ChunkSize"),
+			RTMP_DEFAULT_CHUNKSIZE, 65536, 128);
+	obs_properties_add_bool(props, OPT_AGGREGATE,
+			obs_module_text("RTMPStream.AggregateAudio"));
 }
 
 static obs_properties_t *rtmp_stream_properties(void *unused)
@@ -630,6 +1173,9 @@ static obs_properties_t *rtmp_stream_properties(void *unused)
 	obs_properties_add_int(props, OPT_DROP_THRESHOLD,
 			obs_module_text("RTMPStream.DropThreshold"),
 			200, 10000, 100);
+	obs_properties_add_bool(props, OPT_DYN_BITRATE,
+			obs_module_text("RTMPStream.DynamicBitrate"));
+	add_chunk_properties(props);
 	return props;
 }
 
@@ -645,6 +1191,20 @@ static int rtmp_stream_dropped_frames(void *data)
 	return stream->dropped_frames;
 }
 
+static void *rtmp_stream_output_create(obs_data_t *settings,
+		obs_output_t *output)
+{
+	struct rtmp_stream *stream = rtmp_stream_create(settings, output);
+	proc_handler_t *ph = obs_output_get_proc_handler(output);
+
+	/* the results are a new obs_data_t that the caller releases */
+	if (stream)
+		proc_handler_add(ph,
+				"void probe(in ptr settings, out ptr results)",
+				rtmp_stream_probe_proc, stream);
+	return stream;
+}
+
 struct obs_output_info rtmp_output_info = {
 	.id                 = "rtmp_output",
 	.flags              = OBS_OUTPUT_AV |
@@ -652,7 +1212,7 @@ struct obs_output_info rtmp_output_info = {
 	                      OBS_OUTPUT_SERVICE |
 	                      OBS_OUTPUT_MULTI_TRACK,
 	.get_name           = rtmp_stream_getname,
-	.create             = rtmp_stream_create,
+	.create             = rtmp_stream_output_create,
 	.destroy            = rtmp_stream_destroy,
 	.start              = rtmp_stream_start,
 	.stop               = rtmp_stream_stop,
@@ -662,3 +1222,305 @@ struct obs_output_info rtmp_output_info = {
 	.get_total_bytes    = rtmp_stream_total_bytes_sent,
 	.get_dropped_frames = rtmp_stream_dropped_frames
 };
+
+/* ------------------------------------------------------------------------- */
+/* multi-destination output */
+
+/*
+ * Sends one interleaved packet stream to several RTMP servers.  Every
+ * destination is a regular rtmp_stream with its own queue, socket, drop
+ * policy and reconnect state, fed with references to the same refcounted
+ * packets.  Each destination sends on its own thread, so a slow server only
+ * ever fills up (and drops from) its own queue.
+ */
+struct rtmp_multi_stream {
+	obs_output_t                 *output;
+	DARRAY(struct rtmp_stream *) dests;
+};
+
+static void *destination_thread(void *data)
+{
+	struct rtmp_stream *stream = data;
+	unsigned long retry_ms = RECONNECT_RETRY_MIN_MS;
+
+	while (os_event_try(stream->stop_event) == EAGAIN) {
+		int ret = try_connect(stream);
+
+		if (ret == OBS_OUTPUT_SUCCESS) {
+			bool disconnected = send_loop(stream);
+
+			pthread_mutex_lock(&stream->packets_mutex);
+			stream->active = false;
+			free_packets(stream);
+			pthread_mutex_unlock(&stream->packets_mutex);
+
+			RTMP_Close(&stream->rtmp);
+			stream->sent_headers = false;
+
+			if (!disconnected)
+				break;
+
+			info("Disconnected from %s, reconnecting",
+					stream->path.array);
+			retry_ms = RECONNECT_RETRY_MIN_MS;
+		} else {
+			RTMP_Close(&stream->rtmp);
+			info("Connection to %s failed: %d, retrying in %lu ms",
+					stream->path.array, ret, retry_ms);
+		}
+
+		if (os_event_timedwait(stream->stop_event, retry_ms) == 0)
+			break;
+
+		retry_ms *= 2;
+		if (retry_ms > RECONNECT_RETRY_MAX_MS)
+			retry_ms = RECONNECT_RETRY_MAX_MS;
+	}
+
+	return NULL;
+}
+
+static const char *rtmp_multi_stream_getname(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("RTMPMultiStream");
+}
+
+static void free_destinations(struct rtmp_multi_stream *multi)
+{
+	for (size_t i = 0; i < multi->dests.num; i++)
+		rtmp_stream_destroy(multi->dests.array[i]);
+	da_free(multi->dests);
+}
+
+static void rtmp_multi_stream_stop(void *data);
+
+static void rtmp_multi_stream_destroy(void *data)
+{
+	struct rtmp_multi_stream *multi = data;
+
+	rtmp_multi_stream_stop(multi);
+	free_destinations(multi);
+	bfree(multi);
+}
+
+static void *rtmp_multi_stream_create(obs_data_t *settings,
+		obs_output_t *output)
+{
+	struct rtmp_multi_stream *multi = bzalloc(sizeof(*multi));
+	multi->output = output;
+
+	UNUSED_PARAMETER(settings);
+	return multi;
+}
+
+/* full URLs without a separate key have the key as their last component */
+static void split_url_key(const char *url, struct dstr *server,
+		struct dstr *key)
+{
+	const char *slash = strrchr(url, '/');
+
+	if (slash && slash[1] && slash > strstr(url, "://") + 2) {
+		dstr_ncopy(server, url, slash - url);
+		dstr_copy(key, slash + 1);
+	} else {
+		dstr_copy(server, url);
+		dstr_free(key);
+	}
+}
+
+static void add_destination(struct rtmp_multi_stream *multi,
+		obs_data_t *settings, const char *server, const char *key,
+		const char *username, const char *password)
+{
+	struct rtmp_stream *stream;
+
+	if (!server || !*server)
+		return;
+
+	stream = rtmp_stream_create(settings, multi->output);
+	if (!stream)
+		return;
+
+	if (os_sem_init(&stream->send_sem, 0) != 0) {
+		rtmp_stream_destroy(stream);
+		return;
+	}
+
+	stream->multi_dest = true;
+
+	if (key && *key) {
+		dstr_copy(&stream->path, server);
+		dstr_copy(&stream->key,  key);
+	} else {
+		split_url_key(server, &stream->path, &stream->key);
+	}
+
+	dstr_copy(&stream->username, username);
+	dstr_copy(&stream->password, password);
+	load_drop_threshold(stream, settings);
+	load_chunk_settings(stream, settings);
+
+	da_push_back(multi->dests, &stream);
+}
+
+static void load_destinations(struct rtmp_multi_stream *multi)
+{
+	obs_service_t    *service  = obs_output_get_service(multi->output);
+	obs_data_t       *settings = obs_output_get_settings(multi->output);
+	obs_data_array_t *array    = obs_data_get_array(settings,
+			OPT_DESTINATIONS);
+	size_t           count     = obs_data_array_count(array);
+
+	free_destinations(multi);
+
+	if (service)
+		add_destination(multi, settings,
+				obs_service_get_url(service),
+				obs_service_get_key(service),
+				obs_service_get_username(service),
+				obs_service_get_password(service));
+
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t *item   = obs_data_array_item(array, i);
+		const char *server = obs_data_get_string(item, "server");
+
+		/* editable list items only have a "value" */
+		if (!*server)
+			server = obs_data_get_string(item, "value");
+
+		add_destination(multi, settings, server,
+				obs_data_get_string(item, "key"),
+				obs_data_get_string(item, "username"),
+				obs_data_get_string(item, "password"));
+		obs_data_release(item);
+	}
+
+	obs_data_array_release(array);
+	obs_data_release(settings);
+}
+
+static bool rtmp_multi_stream_start(void *data)
+{
+	struct rtmp_multi_stream *multi = data;
+	obs_output_t *output = multi->output;
+
+	if (!obs_output_can_begin_data_capture(output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(output, 0))
+		return false;
+
+	load_destinations(multi);
+	if (!multi->dests.num) {
+		blog(LOG_WARNING, "[rtmp multi stream: '%s'] No destinations",
+				obs_output_get_name(output));
+		return false;
+	}
+
+	obs_output_begin_data_capture(output, 0);
+
+	for (size_t i = 0; i < multi->dests.num; i++) {
+		struct rtmp_stream *stream = multi->dests.array[i];
+
+		stream->connecting = pthread_create(&stream->connect_thread,
+				NULL, destination_thread, stream) == 0;
+		if (!stream->connecting)
+			warn("Failed to create destination thread");
+	}
+
+	return true;
+}
+
+static void rtmp_multi_stream_stop(void *data)
+{
+	struct rtmp_multi_stream *multi = data;
+	bool was_running = false;
+	void *ret;
+
+	/* signal everything first so that the destinations all wind down at
+	 * the same time rather than one after another */
+	for (size_t i = 0; i < multi->dests.num; i++) {
+		struct rtmp_stream *stream = multi->dests.array[i];
+
+		if (stream->connecting) {
+			os_event_signal(stream->stop_event);
+			os_sem_post(stream->send_sem);
+		}
+	}
+
+	for (size_t i = 0; i < multi->dests.num; i++) {
+		struct rtmp_stream *stream = multi->dests.array[i];
+
+		if (stream->connecting) {
+			pthread_join(stream->connect_thread, &ret);
+			os_event_reset(stream->stop_event);
+			stream->connecting = false;
+			was_running = true;
+		}
+	}
+
+	if (was_running)
+		obs_output_end_data_capture(multi->output);
+}
+
+static void rtmp_multi_stream_data(void *data, struct encoder_packet *packet)
+{
+	struct rtmp_multi_stream *multi = data;
+
+	for (size_t i = 0; i < multi->dests.num; i++)
+		rtmp_stream_data(multi->dests.array[i], packet);
+}
+
+static obs_properties_t *rtmp_multi_stream_properties(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+
+	obs_properties_t *props = obs_properties_create();
+
+	obs_properties_add_int(props, OPT_DROP_THRESHOLD,
+			obs_module_text("RTMPStream.DropThreshold"),
+			200, 10000, 100);
+	add_chunk_properties(props);
+	obs_properties_add_editable_list(props, OPT_DESTINATIONS,
+			obs_module_text("RTMPMultiStream.Destinations"),
+			false, NULL, NULL);
+	return props;
+}
+
+static uint64_t rtmp_multi_stream_total_bytes_sent(void *data)
+{
+	struct rtmp_multi_stream *multi = data;
+	uint64_t total = 0;
+
+	for (size_t i = 0; i < multi->dests.num; i++)
+		total += multi->dests.array[i]->total_bytes_sent;
+	return total;
+}
+
+static int rtmp_multi_stream_dropped_frames(void *data)
+{
+	struct rtmp_multi_stream *multi = data;
+	int dropped = 0;
+
+	for (size_t i = 0; i < multi->dests.num; i++)
+		dropped += multi->dests.array[i]->dropped_frames;
+	return dropped;
+}
+
+struct obs_output_info rtmp_multi_output_info = {
+	.id                 = "rtmp_multi_output",
+	.flags              = OBS_OUTPUT_AV |
+	                      OBS_OUTPUT_ENCODED |
+	                      OBS_OUTPUT_SERVICE |
+	                      OBS_OUTPUT_MULTI_TRACK,
+	.get_name           = rtmp_multi_stream_getname,
+	.create             = rtmp_multi_stream_create,
+	.destroy            = rtmp_multi_stream_destroy,
+	.start              = rtmp_multi_stream_start,
+	.stop               = rtmp_multi_stream_stop,
+	.encoded_packet     = rtmp_multi_stream_data,
+	.get_defaults       = rtmp_stream_defaults,
+	.get_properties     = rtmp_multi_stream_properties,
+	.get_total_bytes    = rtmp_multi_stream_total_bytes_sent,
+	.get_dropped_frames = rtmp_multi_stream_dropped_frames
+};
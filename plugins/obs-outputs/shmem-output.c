@@ -0,0 +1,318 @@
+/******************************************************************************
+    Copyright (C) 2016 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <obs-module.h>
+#include <util/dstr.h>
+#include <ipc-util/shmem-ring.h>
+
+#define do_log(level, format, ...) \
+	blog(level, "[shmem output: '%s'] " format, \
+			obs_output_get_name(out->output), ##__VA_ARGS__)
+
+#define warn(format, ...)  do_log(LOG_WARNING, format, ##__VA_ARGS__)
+#define info(format, ...)  do_log(LOG_INFO,    format, ##__VA_ARGS__)
+
+/* enough for a consumer to fall a few frames behind now and then */
+#define VIDEO_SLOTS 6
+/* audio packets are small, about a second of them at the default mix tick */
+#define AUDIO_SLOTS 48
+/* longest audio packet a slot can hold, anything past it is cut off */
+#define MAX_AUDIO_PACKET_MS 100
+
+/*
+ * Publishes the raw program video and audio into two shared memory rings
+ * ("<name>-video" and "<name>-audio", see ipc-util/shmem-ring.h) for other
+ * processes to read, without encoding anything.
+ */
+struct shmem_output {
+	obs_output_t             *output;
+	bool                     active;
+
+	ipc_ring_t               *video_ring;
+	ipc_ring_t               *audio_ring;
+
+	struct ipc_av_video_info video_info;
+	uint32_t                 video_size;
+	uint32_t                 channels;
+	uint32_t                 audio_slot_frames;
+};
+
+static const char *shmem_output_getname(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("ShmemOutput");
+}
+
+static void *shmem_output_create(obs_data_t *settings, obs_output_t *output)
+{
+	struct shmem_output *out = bzalloc(sizeof(*out));
+	out->output = output;
+
+	UNUSED_PARAMETER(settings);
+	return out;
+}
+
+static void free_rings(struct shmem_output *out)
+{
+	ipc_ring_free(out->video_ring);
+	ipc_ring_free(out->audio_ring);
+	out->video_ring = NULL;
+	out->audio_ring = NULL;
+}
+
+static void shmem_output_stop(void *data)
+{
+	struct shmem_output *out = data;
+
+	if (out->active) {
+		obs_output_end_data_capture(out->output);
+		out->active = false;
+		free_rings(out);
+		info("stopped");
+	}
+}
+
+static void shmem_output_destroy(void *data)
+{
+	struct shmem_output *out = data;
+
+	shmem_output_stop(out);
+	bfree(out);
+}
+
+static void init_video_info(struct shmem_output *out, bool i420,
+		const struct video_output_info *voi)
+{
+	struct ipc_av_video_info *vi = &out->video_info;
+	uint32_t cx = obs_output_get_width(out->output);
+	uint32_t cy = obs_output_get_height(out->output);
+	uint32_t luma = cx * cy;
+
+	memset(vi, 0, sizeof(*vi));
+	vi->format     = i420 ? IPC_AV_VIDEO_I420 : IPC_AV_VIDEO_NV12;
+	vi->width      = cx;
+	vi->height     = cy;
+	vi->fps_num    = voi->fps_num;
+	vi->fps_den    = voi->fps_den;
+	vi->colorspace = voi->colorspace == VIDEO_CS_601 ?
+		IPC_AV_CS_601 : IPC_AV_CS_709;
+	vi->full_range = voi->range == VIDEO_RANGE_FULL;
+
+	vi->linesize[0] = cx;
+	vi->plane_offset[0] = 0;
+
+	if (i420) {
+		vi->planes = 3;
+		vi->linesize[1] = cx / 2;
+		vi->linesize[2] = cx / 2;
+		vi->plane_offset[1] = luma;
+		vi->plane_offset[2] = luma + luma / 4;
+	} else {
+		vi->planes = 2;
+		vi->linesize[1] = cx;
+		vi->plane_offset[1] = luma;
+	}
+
+	out->video_size = luma + luma / 2;
+}
+
+static bool create_rings(struct shmem_output *out, const char *name,
+		uint32_t samples_per_sec)
+{
+	struct ipc_av_audio_info ai = {samples_per_sec, out->channels};
+	struct dstr ring_name = {0};
+
+	dstr_printf(&ring_name, "%s-video", name);
+	out->video_ring = ipc_ring_create(ring_name.array, VIDEO_SLOTS,
+			out->video_size, &out->video_info,
+			sizeof(out->video_info));
+
+	dstr_printf(&ring_name, "%s-audio", name);
+	out->audio_ring = ipc_ring_create(ring_name.array, AUDIO_SLOTS,
+			out->audio_slot_frames * out->channels *
+			(uint32_t)sizeof(float), &ai, sizeof(ai));
+
+	dstr_free(&ring_name);
+
+	if (!out->video_ring || !out->audio_ring) {
+		warn("failed to create shared memory for '%s', is the name "
+				"already in use?", name);
+		free_rings(out);
+		return false;
+	}
+
+	return true;
+}
+
+static bool shmem_output_start(void *data)
+{
+	struct shmem_output *out = data;
+	video_t *video = obs_output_video(out->output);
+	audio_t *audio = obs_output_audio(out->output);
+	const struct video_output_info *voi;
+	const struct audio_output_info *aoi;
+	struct video_scale_info vsi = {0};
+	struct audio_convert_info aci = {0};
+	obs_data_t *settings;
+	const char *name;
+	bool i420;
+	bool success;
+
+	if (!video || !audio)
+		return false;
+	if (!obs_output_can_begin_data_capture(out->output, 0))
+		return false;
+
+	voi = video_output_get_info(video);
+	aoi = audio_output_get_info(audio);
+
+	settings = obs_output_get_settings(out->output);
+	name = obs_data_get_string(settings, "name");
+	i420 = strcmp(obs_data_get_string(settings, "format"), "i420") == 0;
+
+	init_video_info(out, i420, voi);
+
+	out->channels = get_audio_channels(aoi->speakers);
+	out->audio_slot_frames = aoi->samples_per_sec * MAX_AUDIO_PACKET_MS /
+		1000;
+
+	success = create_rings(out, name, aoi->samples_per_sec);
+	obs_data_release(settings);
+
+	if (!success)
+		return false;
+
+	vsi.format     = i420 ? VIDEO_FORMAT_I420 : VIDEO_FORMAT_NV12;
+	vsi.width      = out->video_info.width;
+	vsi.height     = out->video_info.height;
+	vsi.colorspace = voi->colorspace;
+	vsi.range      = voi->range;
+
+	aci.format          = AUDIO_FORMAT_FLOAT_PLANAR;
+	aci.samples_per_sec = aoi->samples_per_sec;
+	aci.speakers        = aoi->speakers;
+
+	obs_output_set_video_conversion(out->output, &vsi);
+	obs_output_set_audio_conversion(out->output, &aci);
+
+	out->active = true;
+	obs_output_begin_data_capture(out->output, 0);
+
+	info("publishing %ux%u %s video and %u channel audio",
+			out->video_info.width, out->video_info.height,
+			i420 ? "I420" : "NV12", out->channels);
+	return true;
+}
+
+static inline void copy_plane(uint8_t *dst, uint32_t dst_linesize,
+		const uint8_t *src, uint32_t src_linesize, uint32_t rows)
+{
+	if (dst_linesize == src_linesize) {
+		memcpy(dst, src, (size_t)dst_linesize * rows);
+		return;
+	}
+
+	for (uint32_t y = 0; y < rows; y++) {
+		memcpy(dst, src, dst_linesize);
+		dst += dst_linesize;
+		src += src_linesize;
+	}
+}
+
+static void shmem_output_video(void *data, struct video_data *frame)
+{
+	struct shmem_output *out = data;
+	const struct ipc_av_video_info *vi = &out->video_info;
+	uint8_t *dst;
+
+	if (!out->video_ring)
+		return;
+
+	dst = ipc_ring_write_begin(out->video_ring);
+
+	for (uint32_t i = 0; i < vi->planes; i++) {
+		uint32_t rows = i == 0 ? vi->height : vi->height / 2;
+		copy_plane(dst + vi->plane_offset[i], vi->linesize[i],
+				frame->data[i], frame->linesize[i], rows);
+	}
+
+	ipc_ring_write_end(out->video_ring, out->video_size,
+			frame->timestamp);
+}
+
+static void shmem_output_audio(void *data, struct audio_data *frames)
+{
+	struct shmem_output *out = data;
+	uint32_t count = frames->frames;
+	size_t plane_size;
+	uint8_t *dst;
+
+	if (!out->audio_ring)
+		return;
+
+	if (count > out->audio_slot_frames)
+		count = out->audio_slot_frames;
+
+	plane_size = count * sizeof(float);
+	dst = ipc_ring_write_begin(out->audio_ring);
+
+	for (uint32_t i = 0; i < out->channels; i++)
+		memcpy(dst + plane_size * i, frames->data[i], plane_size);
+
+	ipc_ring_write_end(out->audio_ring,
+			(uint32_t)(plane_size * out->channels),
+			frames->timestamp);
+}
+
+static void shmem_output_defaults(obs_data_t *defaults)
+{
+	obs_data_set_default_string(defaults, "name", "obs");
+	obs_data_set_default_string(defaults, "format", "nv12");
+}
+
+static obs_properties_t *shmem_output_properties(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+
+	obs_properties_t *props = obs_properties_create();
+	obs_property_t *p;
+
+	obs_properties_add_text(props, "name",
+			obs_module_text("ShmemOutput.Name"), OBS_TEXT_DEFAULT);
+
+	p = obs_properties_add_list(props, "format",
+			obs_module_text("ShmemOutput.Format"),
+			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+	obs_property_list_add_string(p, "NV12", "nv12");
+	obs_property_list_add_string(p, "I420", "i420");
+
+	return props;
+}
+
+struct obs_output_info shmem_output_info = {
+	.id             = "shmem_output",
+	.flags          = OBS_OUTPUT_AV,
+	.get_name       = shmem_output_getname,
+	.create         = shmem_output_create,
+	.destroy        = shmem_output_destroy,
+	.start          = shmem_output_start,
+	.stop           = shmem_output_stop,
+	.raw_video      = shmem_output_video,
+	.raw_audio      = shmem_output_audio,
+	.get_defaults   = shmem_output_defaults,
+	.get_properties = shmem_output_properties
+};
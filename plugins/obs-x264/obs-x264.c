@@ -45,6 +45,9 @@ struct obs_x264 {
 
 	DARRAY(uint8_t)        packet_data;
 
+	/* pooled frames x264 has been given but hasn't output yet */
+	DARRAY(struct video_frame_buffer*) held_frames;
+
 	uint8_t                *extra_data;
 	uint8_t                *sei;
 
@@ -52,6 +55,17 @@ struct obs_x264 {
 	size_t                 sei_size;
 
 	os_performance_token_t *performance_token;
+
+	/* optional preset governor, which steps towards faster presets when
+	 * encoding can't keep up and back again when there's headroom */
+	bool                   auto_preset;
+	char                   *tune;
+	int                    base_preset;
+	int                    cur_preset;
+	int                    max_frame_ref;
+	uint64_t               frame_interval_ns;
+	uint64_t               encode_time_ns;
+	uint32_t               window_frames;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -75,6 +89,10 @@ static void clear_data(struct obs_x264 *obsx264)
 		obsx264->sei        = NULL;
 		obsx264->extra_data = NULL;
 	}
+
+	for (size_t i = 0; i < obsx264->held_frames.num; i++)
+		video_frame_buffer_release(obsx264->held_frames.array[i]);
+	da_free(obsx264->held_frames);
 }
 
 static void obs_x264_destroy(void *data)
@@ -85,6 +103,7 @@ static void obs_x264_destroy(void *data)
 		os_end_high_performance(obsx264->performance_token);
 		clear_data(obsx264);
 		da_free(obsx264->packet_data);
+		bfree(obsx264->tune);
 		bfree(obsx264);
 	}
 }
@@ -103,6 +122,7 @@ static void obs_x264_defaults(obs_data_t *settings)
 	obs_data_set_default_string(settings, "profile",     "");
 	obs_data_set_default_string(settings, "tune",        "");
 	obs_data_set_default_string(settings, "x264opts",    "");
+	obs_data_set_default_bool  (settings, "auto_preset", false);
 }
 
 static inline void add_strings(obs_property_t *list, const char *const *strings)
@@ -125,6 +145,7 @@ static inline void add_strings(obs_property_t *list, const char *const *strings)
 #define TEXT_TUNE       obs_module_text("Tune")
 #define TEXT_NONE       obs_module_text("None")
 #define TEXT_X264_OPTS  obs_module_text("EncoderOptions")
+#define TEXT_AUTO_PRESET obs_module_text("AutoPreset")
 
 static bool use_bufsize_modified(obs_properties_t *ppts, obs_property_t *p,
 		obs_data_t *settings)
@@ -169,6 +190,8 @@ static obs_properties_t *obs_x264_props(void *unused)
 			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
 	add_strings(list, x264_preset_names);
 
+	obs_properties_add_bool(props, "auto_preset", TEXT_AUTO_PRESET);
+
 	list = obs_properties_add_list(props, "profile", TEXT_PROFILE,
 			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
 	obs_property_list_add_string(list, TEXT_NONE, "");
@@ -306,15 +329,62 @@ static inline const char *validate_preset(struct obs_x264 *obsx264,
 	return new_preset ? new_preset : "veryfast";
 }
 
+static inline bool low_latency_video(void)
+{
+	struct obs_video_info ovi;
+	return obs_get_video_info(&ovi) && ovi.low_latency;
+}
+
+/* low latency video adds the zerolatency tune, which turns off lookahead,
+ * B-frames and frame threading so each frame comes out as it goes in */
 static bool reset_x264_params(struct obs_x264 *obsx264,
 		const char *preset, const char *tune)
 {
-	int ret = x264_param_default_preset(&obsx264->params,
-			validate_preset(obsx264, preset),
-			validate(obsx264, tune, "tune", x264_tune_names));
+	struct dstr tunes = {0};
+	int ret;
+
+	tune = validate(obsx264, tune, "tune", x264_tune_names);
+
+	if (low_latency_video() && (!tune || strcmp(tune, "zerolatency"))) {
+		if (tune)
+			dstr_printf(&tunes, "%s,zerolatency", tune);
+		else
+			dstr_copy(&tunes, "zerolatency");
+		tune = tunes.array;
+	}
+
+	ret = x264_param_default_preset(&obsx264->params,
+			validate_preset(obsx264, preset), tune);
+	dstr_free(&tunes);
 	return ret == 0;
 }
 
+static inline int get_preset_idx(const char *preset)
+{
+	for (int i = 0; preset && x264_preset_names[i]; i++) {
+		if (strcmp(x264_preset_names[i], preset) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+static void init_preset_governor(struct obs_x264 *obsx264,
+		const char *preset, const char *tune)
+{
+	video_t *video = obs_encoder_video(obsx264->encoder);
+
+	bfree(obsx264->tune);
+	obsx264->tune = bstrdup(validate(obsx264, tune, "tune",
+				x264_tune_names));
+
+	obsx264->base_preset       = get_preset_idx(preset);
+	obsx264->cur_preset        = obsx264->base_preset;
+	obsx264->frame_interval_ns = video_output_get_frame_time(video);
+	obsx264->encode_time_ns    = 0;
+	obsx264->window_frames     = 0;
+}
+
 static void log_x264(void *param, int level, const char *format, va_list args)
 {
 	struct obs_x264 *obsx264 = param;
@@ -373,24 +443,40 @@ static void update_params(struct obs_x264 *obsx264, obs_data_t *settings,
 	int width        = (int)obs_encoder_get_width(obsx264->encoder);
 	int height       = (int)obs_encoder_get_height(obsx264->encoder);
 	bool use_bufsize = obs_data_get_bool(settings, "use_bufsize");
-	bool vfr         = obs_data_get_bool(settings, "vfr");
+	bool vfr         = obs_data_get_bool(settings, "vfr") ||
+		obs_encoder_variable_framerate(obsx264->encoder);
 	bool cbr         = obs_data_get_bool(settings, "cbr");
+	uint32_t fps_num, fps_den;
+
+	obs_encoder_get_frame_rate(obsx264->encoder, &fps_num, &fps_den);
+
+	uint32_t group_keyint = obs_encoder_get_group_keyint(
+			obsx264->encoder);
 
 	if (keyint_sec)
 		obsx264->params.i_keyint_max =
-			keyint_sec * voi->fps_num / voi->fps_den;
+			keyint_sec * fps_num / fps_den;
+
+	/* in a group the keyframes are forced on the group's schedule, so
+	 * scene cuts mustn't add any that the other encoders don't have */
+	if (group_keyint) {
+		obsx264->params.i_keyint_max         = (int)group_keyint;
+		obsx264->params.i_scenecut_threshold = 0;
+	}
 
 	if (!use_bufsize)
 		buffer_size = bitrate;
 
 	obsx264->params.b_vfr_input          = vfr;
+	obsx264->params.i_timebase_num       = fps_den;
+	obsx264->params.i_timebase_den       = fps_num;
 	obsx264->params.rc.i_vbv_max_bitrate = bitrate;
 	obsx264->params.rc.i_vbv_buffer_size = buffer_size;
 	obsx264->params.rc.i_bitrate         = bitrate;
 	obsx264->params.i_width              = width;
 	obsx264->params.i_height             = height;
-	obsx264->params.i_fps_num            = voi->fps_num;
-	obsx264->params.i_fps_den            = voi->fps_den;
+	obsx264->params.i_fps_num            = fps_num;
+	obsx264->params.i_fps_den            = fps_den;
 	obsx264->params.pf_log               = log_x264;
 	obsx264->params.p_log_private        = obsx264;
 	obsx264->params.i_log_level          = X264_LOG_WARNING;
@@ -447,7 +533,7 @@ static void update_params(struct obs_x264 *obsx264, obs_data_t *settings,
 	     obsx264->params.rc.i_vbv_buffer_size,
 	     (int)obsx264->params.rc.f_rf_constant,
 	     cbr ? " (0 when CBR is enabled)" : "",
-	     voi->fps_num, voi->fps_den,
+	     fps_num, fps_den,
 	     width, height,
 	     obsx264->params.i_keyint_max,
 	     vfr ? "on" : "off",
@@ -477,8 +563,11 @@ static bool update_settings(struct obs_x264 *obsx264, obs_data_t *settings)
 		if (tune    && *tune)    info("tune: %s",    tune);
 
 		success = reset_x264_params(obsx264, preset, tune);
+		init_preset_governor(obsx264, preset, tune);
 	}
 
+	obsx264->auto_preset = obs_data_get_bool(settings, "auto_preset");
+
 	if (success) {
 		update_params(obsx264, settings, paramlist);
 		if (opts && *opts)
@@ -550,10 +639,16 @@ static void *obs_x264_create(obs_data_t *settings, obs_encoder_t *encoder)
 	if (update_settings(obsx264, settings)) {
 		obsx264->context = x264_encoder_open(&obsx264->params);
 
-		if (obsx264->context == NULL)
+		if (obsx264->context == NULL) {
 			warn("x264 failed to load");
-		else
+		} else {
 			load_headers(obsx264);
+			obsx264->max_frame_ref =
+				obsx264->params.i_frame_reference;
+			info("maximum delayed frames: %d",
+					x264_encoder_maximum_delayed_frames(
+						obsx264->context));
+		}
 	} else {
 		warn("bad settings specified");
 	}
@@ -599,6 +694,9 @@ static inline void init_pic_data(struct obs_x264 *obsx264, x264_picture_t *pic,
 	pic->i_pts = frame->pts;
 	pic->img.i_csp = obsx264->params.i_csp;
 
+	if (frame->force_keyframe)
+		pic->i_type = X264_TYPE_IDR;
+
 	if (obsx264->params.i_csp == X264_CSP_NV12)
 		pic->img.i_plane = 2;
 	else if (obsx264->params.i_csp == X264_CSP_I420)
@@ -610,8 +708,104 @@ static inline void init_pic_data(struct obs_x264 *obsx264, x264_picture_t *pic,
 		pic->img.i_stride[i] = (int)frame->linesize[i];
 		pic->img.plane[i]    = frame->data[i];
 	}
+
+	/* the frame is handed back through pic_out once x264 is done with
+	 * it, so keep it referenced until then rather than copying it */
+	if (frame->buffer) {
+		video_frame_buffer_addref(frame->buffer);
+		da_push_back(obsx264->held_frames, &frame->buffer);
+		pic->opaque = frame->buffer;
+	}
 }
 
+static inline void release_held_frame(struct obs_x264 *obsx264,
+		struct video_frame_buffer *buffer)
+{
+	size_t idx = da_find(obsx264->held_frames, &buffer, 0);
+
+	if (idx != DARRAY_INVALID) {
+		da_erase(obsx264->held_frames, idx);
+		video_frame_buffer_release(buffer);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* preset governor */
+
+#define GOVERNOR_WINDOW_FRAMES 60
+#define GOVERNOR_OVERLOADED    0.85
+#define GOVERNOR_HEADROOM      0.50
+
+/* only the analysis settings of a preset can be changed on the fly, so
+ * lookahead, b-frames and threading stay as they were when the encoder was
+ * created.  the reference count can't grow beyond its initial value
+ * either, as the decoded picture buffer size has already been signalled */
+static bool apply_preset(struct obs_x264 *obsx264, int preset, double load)
+{
+	x264_param_t params = obsx264->params;
+	x264_param_t preset_params;
+	int ret;
+
+	ret = x264_param_default_preset(&preset_params,
+			x264_preset_names[preset], obsx264->tune);
+	if (ret != 0)
+		return false;
+
+	params.analyse           = preset_params.analyse;
+	params.i_frame_reference = preset_params.i_frame_reference;
+	if (params.i_frame_reference > obsx264->max_frame_ref)
+		params.i_frame_reference = obsx264->max_frame_ref;
+
+	ret = x264_encoder_reconfig(obsx264->context, &params);
+	if (ret != 0) {
+		warn("Failed to change preset to '%s': %d",
+				x264_preset_names[preset], ret);
+		return false;
+	}
+
+	info("encode time at %d%% of the frame interval, changing preset "
+	     "from '%s' to '%s'", (int)(load * 100.0),
+	     x264_preset_names[obsx264->cur_preset],
+	     x264_preset_names[preset]);
+
+	obsx264->params     = params;
+	obsx264->cur_preset = preset;
+	return true;
+}
+
+static void update_preset_governor(struct obs_x264 *obsx264,
+		uint64_t encode_time_ns)
+{
+	double load;
+	int    preset = obsx264->cur_preset;
+
+	if (!obsx264->auto_preset || obsx264->base_preset < 0 ||
+	    !obsx264->frame_interval_ns)
+		return;
+
+	obsx264->encode_time_ns += encode_time_ns;
+	if (++obsx264->window_frames < GOVERNOR_WINDOW_FRAMES)
+		return;
+
+	load = (double)obsx264->encode_time_ns /
+		(double)obsx264->window_frames /
+		(double)obsx264->frame_interval_ns;
+
+	obsx264->encode_time_ns = 0;
+	obsx264->window_frames  = 0;
+
+	/* never goes slower than the preset the user picked */
+	if (load > GOVERNOR_OVERLOADED && preset > 0)
+		preset--;
+	else if (load < GOVERNOR_HEADROOM && preset < obsx264->base_preset)
+		preset++;
+
+	if (preset != obsx264->cur_preset)
+		apply_preset(obsx264, preset, load);
+}
+
+/* ------------------------------------------------------------------------- */
+
 static bool obs_x264_encode(void *data, struct encoder_frame *frame,
 		struct encoder_packet *packet, bool *received_packet)
 {
@@ -620,6 +814,7 @@ static bool obs_x264_encode(void *data, struct encoder_frame *frame,
 	int             nal_count;
 	int             ret;
 	x264_picture_t  pic, pic_out;
+	uint64_t        start_time;
 
 	if (!frame || !packet || !received_packet)
 		return false;
@@ -627,8 +822,11 @@ static bool obs_x264_encode(void *data, struct encoder_frame *frame,
 	if (frame)
 		init_pic_data(obsx264, &pic, frame);
 
+	start_time = os_gettime_ns();
 	ret = x264_encoder_encode(obsx264->context, &nals, &nal_count,
 			(frame ? &pic : NULL), &pic_out);
+	update_preset_governor(obsx264, os_gettime_ns() - start_time);
+
 	if (ret < 0) {
 		warn("encode failed");
 		return false;
@@ -637,6 +835,9 @@ static bool obs_x264_encode(void *data, struct encoder_frame *frame,
 	*received_packet = (nal_count != 0);
 	parse_packet(obsx264, packet, nals, nal_count, &pic_out);
 
+	if (ret > 0 && pic_out.opaque)
+		release_held_frame(obsx264, pic_out.opaque);
+
 	return true;
 }
 
@@ -1,4 +1,6 @@
+#include <util/threading.h>
 #include <util/platform.h>
+#include <util/crc32.h>
 #include <obs-module.h>
 #include <jansson.h>
 
@@ -127,19 +129,22 @@ static void add_services(obs_property_t *list, json_t *root, bool show_all,
 	}
 }
 
-static json_t *open_json_file(const char *file)
+/* the parsed services list is kept around and shared between properties and
+ * outputs.  it is keyed by the checksum of the file contents, so a file that
+ * was replaced by the updater gets parsed again the next time it's needed */
+static pthread_mutex_t services_mutex = PTHREAD_MUTEX_INITIALIZER;
+static json_t *services_cache = NULL;
+static uint32_t services_crc = 0;
+static size_t services_size = 0;
+
+static json_t *parse_json_data(const char *file_data)
 {
-	char         *file_data = os_quick_read_utf8_file(file);
 	json_error_t error;
 	json_t       *root;
 	json_t       *list;
 	int          format_ver;
 
-	if (!file_data)
-		return NULL;
-
 	root = json_loads(file_data, JSON_REJECT_DUPLICATES, &error);
-	bfree(file_data);
 
 	if (!root) {
 		blog(LOG_WARNING, "rtmp-common.c: [open_json_file] "
@@ -172,6 +177,60 @@ static json_t *open_json_file(const char *file)
 	return list;
 }
 
+static json_t *open_json_file(const char *file)
+{
+	char     *file_data = os_quick_read_utf8_file(file);
+	json_t   *list = NULL;
+	uint32_t crc;
+	size_t   size;
+
+	if (!file_data)
+		return NULL;
+
+	size = strlen(file_data);
+	crc = calc_crc32(0, file_data, size);
+
+	pthread_mutex_lock(&services_mutex);
+
+	if (services_cache && services_crc == crc && services_size == size) {
+		list = json_incref(services_cache);
+
+	} else {
+		list = parse_json_data(file_data);
+		if (list) {
+			if (services_cache)
+				json_decref(services_cache);
+			services_cache = json_incref(list);
+			services_crc   = crc;
+			services_size  = size;
+		}
+	}
+
+	pthread_mutex_unlock(&services_mutex);
+
+	bfree(file_data);
+	return list;
+}
+
+/* jansson reference counts are not necessarily atomic, so every reference to
+ * the shared list has to be released with the lock held */
+static void close_services_file(json_t *root)
+{
+	pthread_mutex_lock(&services_mutex);
+	json_decref(root);
+	pthread_mutex_unlock(&services_mutex);
+}
+
+void rtmp_common_free_cache(void)
+{
+	pthread_mutex_lock(&services_mutex);
+	if (services_cache) {
+		json_decref(services_cache);
+		services_cache = NULL;
+	}
+	pthread_mutex_unlock(&services_mutex);
+}
+
 static json_t *open_services_file(void)
 {
 	char *file;
@@ -205,7 +264,7 @@ static void properties_data_destroy(void *data)
 {
 	json_t *root = data;
 	if (root)
-		json_decref(root);
+		close_services_file(root);
 }
 
 static void fill_servers(obs_property_t *servers_prop, json_t *service,
@@ -389,7 +448,7 @@ static void rtmp_common_apply_settings(void *data,
 	if (root) {
 		initialize_output(service, root, video_settings,
 				audio_settings);
-		json_decref(root);
+		close_services_file(root);
 	}
 }
 
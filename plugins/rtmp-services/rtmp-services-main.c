@@ -16,6 +16,7 @@ OBS_MODULE_USE_DEFAULT_LOCALE("rtmp-services", "en-US")
 
 extern struct obs_service_info rtmp_common_service;
 extern struct obs_service_info rtmp_custom_service;
+extern void rtmp_common_free_cache(void);
 
 static update_info_t *update_info = NULL;
 
@@ -66,4 +67,5 @@ bool obs_module_load(void)
 void obs_module_unload(void)
 {
 	update_info_destroy(update_info);
+	rtmp_common_free_cache();
 }
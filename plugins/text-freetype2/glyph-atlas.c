@@ -0,0 +1,237 @@
+/******************************************************************************
+Copyright (C) 2014 by Nibbles
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <util/darray.h>
+#include <util/threading.h>
+#include "glyph-atlas.h"
+#include "find-font.h"
+
+extern FT_Library ft2_lib;
+extern uint32_t texbuf_w, texbuf_h;
+
+static pthread_mutex_t atlas_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DARRAY(struct glyph_atlas*) atlases;
+
+static const wchar_t *standard_glyphs =
+	L"abcdefghijklmnopqrstuvwxyz"
+	L"ABCDEFGHIJKLMNOPQRSTUVWXYZ1234567890"
+	L"!@#$%^&*()-_=+,<.>/?\\|[]{}`~ \'\"";
+
+static inline bool atlas_matches(struct glyph_atlas *atlas,
+		const char *font_name, const char *font_style,
+		uint16_t font_size, uint32_t font_flags)
+{
+	return atlas->font_size == font_size &&
+	       atlas->font_flags == font_flags &&
+	       strcmp(atlas->font_name, font_name) == 0 &&
+	       strcmp(atlas->font_style, font_style) == 0;
+}
+
+static struct glyph_atlas *glyph_atlas_create(const char *font_name,
+		const char *font_style, uint16_t font_size,
+		uint32_t font_flags)
+{
+	struct glyph_atlas *atlas;
+	const char *path;
+	FT_Long index;
+	FT_Face face;
+
+	path = get_font_path(font_name, font_size, font_style, font_flags,
+			&index);
+	if (!path)
+		return NULL;
+	if (FT_New_Face(ft2_lib, path, index, &face) != 0)
+		return NULL;
+
+	FT_Set_Pixel_Sizes(face, 0, font_size);
+	FT_Select_Charmap(face, FT_ENCODING_UNICODE);
+
+	atlas = bzalloc(sizeof(struct glyph_atlas));
+	atlas->font_name  = bstrdup(font_name);
+	atlas->font_style = bstrdup(font_style);
+	atlas->font_size  = font_size;
+	atlas->font_flags = font_flags;
+	atlas->font_face  = face;
+	atlas->texbuf     = bzalloc(texbuf_w * texbuf_h * 4);
+	atlas->refs       = 1;
+	return atlas;
+}
+
+static void glyph_atlas_destroy(struct glyph_atlas *atlas)
+{
+	obs_enter_graphics();
+	gs_texture_destroy(atlas->tex);
+	obs_leave_graphics();
+
+	for (uint32_t i = 0; i < num_cache_slots; i++)
+		bfree(atlas->glyphs[i]);
+
+	FT_Done_Face(atlas->font_face);
+	bfree(atlas->texbuf);
+	bfree(atlas->font_name);
+	bfree(atlas->font_style);
+	bfree(atlas);
+}
+
+struct glyph_atlas *glyph_atlas_acquire(const char *font_name,
+		const char *font_style, uint16_t font_size,
+		uint32_t font_flags)
+{
+	struct glyph_atlas *atlas = NULL;
+	bool created = false;
+
+	if (!ft2_lib || !font_name || !font_style)
+		return NULL;
+
+	pthread_mutex_lock(&atlas_mutex);
+
+	for (size_t i = 0; i < atlases.num; i++) {
+		if (atlas_matches(atlases.array[i], font_name, font_style,
+					font_size, font_flags)) {
+			atlas = atlases.array[i];
+			atlas->refs++;
+			break;
+		}
+	}
+
+	if (!atlas) {
+		atlas = glyph_atlas_create(font_name, font_style, font_size,
+				font_flags);
+		if (atlas)
+			da_push_back(atlases, &atlas);
+		created = atlas != NULL;
+	}
+
+	pthread_mutex_unlock(&atlas_mutex);
+
+	if (created) {
+		obs_enter_graphics();
+		glyph_atlas_cache(atlas, standard_glyphs);
+		obs_leave_graphics();
+	}
+
+	return atlas;
+}
+
+void glyph_atlas_release(struct glyph_atlas *atlas)
+{
+	bool destroy;
+
+	if (!atlas)
+		return;
+
+	pthread_mutex_lock(&atlas_mutex);
+	destroy = --atlas->refs == 0;
+	if (destroy)
+		da_erase_item(atlases, &atlas);
+	if (!atlases.num)
+		da_free(atlases);
+	pthread_mutex_unlock(&atlas_mutex);
+
+	if (destroy)
+		glyph_atlas_destroy(atlas);
+}
+
+#define glyph_pos x + (y*slot->bitmap.pitch)
+#define buf_pos (dx + x) + ((dy + y) * texbuf_w)
+
+void glyph_atlas_cache(struct glyph_atlas *atlas, const wchar_t *text)
+{
+	FT_GlyphSlot slot;
+	FT_UInt glyph_index = 0;
+
+	if (!atlas || !text)
+		return;
+
+	slot = atlas->font_face->glyph;
+
+	uint32_t dx = atlas->texbuf_x, dy = atlas->texbuf_y;
+	uint8_t alpha;
+
+	int32_t cached_glyphs = 0;
+	size_t len = wcslen(text);
+
+	for (size_t i = 0; i < len; i++) {
+		struct glyph_info *glyph;
+
+		glyph_index = FT_Get_Char_Index(atlas->font_face, text[i]);
+
+		if (atlas->glyphs[glyph_index] != NULL || atlas->full)
+			continue;
+
+		FT_Load_Glyph(atlas->font_face, glyph_index, FT_LOAD_DEFAULT);
+		FT_Render_Glyph(slot, FT_RENDER_MODE_NORMAL);
+
+		uint32_t g_w = slot->bitmap.width;
+		uint32_t g_h = slot->bitmap.rows;
+
+		if (atlas->max_h < g_h) atlas->max_h = g_h;
+
+		if (dx + g_w >= texbuf_w) {
+			dx = 0;
+			dy += atlas->max_h + 1;
+		}
+
+		if (dy + g_h >= texbuf_h) {
+			blog(LOG_WARNING, "FT2-text: Glyph atlas for %s is "
+			                  "full", atlas->font_name);
+			atlas->full = true;
+			break;
+		}
+
+		glyph = bzalloc(sizeof(struct glyph_info));
+		glyph->u = (float)dx / (float)texbuf_w;
+		glyph->u2 = (float)(dx + g_w) / (float)texbuf_w;
+		glyph->v = (float)dy / (float)texbuf_h;
+		glyph->v2 = (float)(dy + g_h) / (float)texbuf_h;
+		glyph->w = g_w;
+		glyph->h = g_h;
+		glyph->yoff = slot->bitmap_top;
+		glyph->xoff = slot->bitmap_left;
+		glyph->xadv = slot->advance.x >> 6;
+		atlas->glyphs[glyph_index] = glyph;
+
+		for (uint32_t y = 0; y < g_h; y++) {
+			for (uint32_t x = 0; x < g_w; x++) {
+				alpha = slot->bitmap.buffer[glyph_pos];
+				atlas->texbuf[buf_pos] =
+					0x00FFFFFF ^ ((uint32_t)alpha << 24);
+			}
+		}
+
+		dx += (g_w + 1);
+		if (dx >= texbuf_w) {
+			dx = 0;
+			dy += atlas->max_h;
+		}
+
+		cached_glyphs++;
+	}
+
+	atlas->texbuf_x = dx;
+	atlas->texbuf_y = dy;
+
+	if (cached_glyphs == 0)
+		return;
+
+	if (!atlas->tex)
+		atlas->tex = gs_texture_create(texbuf_w, texbuf_h, GS_RGBA, 1,
+				(const uint8_t **)&atlas->texbuf, GS_DYNAMIC);
+	else
+		gs_texture_set_image(atlas->tex, (const uint8_t*)atlas->texbuf,
+				texbuf_w * 4, false);
+}
@@ -0,0 +1,63 @@
+/******************************************************************************
+Copyright (C) 2014 by Nibbles
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <obs-module.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#define num_cache_slots 65535
+
+struct glyph_info {
+	float u, v, u2, v2;
+	int32_t w, h, xoff, yoff;
+	int32_t xadv;
+};
+
+/*
+ * Faces and their glyph atlases are shared between all text sources that use
+ * the same font face, style, size and flags.  The face, the glyphs and the
+ * atlas texture must only be used with the graphics context entered, which
+ * also serializes them against rendering.
+ */
+struct glyph_atlas {
+	char     *font_name;
+	char     *font_style;
+	uint16_t font_size;
+	uint32_t font_flags;
+	long     refs;
+
+	FT_Face  font_face;
+	uint32_t max_h;
+
+	struct glyph_info *glyphs[num_cache_slots];
+
+	uint32_t *texbuf;
+	uint32_t texbuf_x, texbuf_y;
+	bool full;
+
+	gs_texture_t *tex;
+};
+
+extern struct glyph_atlas *glyph_atlas_acquire(const char *font_name,
+		const char *font_style, uint16_t font_size,
+		uint32_t font_flags);
+extern void glyph_atlas_release(struct glyph_atlas *atlas);
+
+/* must be called with the graphics context entered */
+extern void glyph_atlas_cache(struct glyph_atlas *atlas, const wchar_t *text);
@@ -55,17 +55,20 @@ gs_vertbuffer_t *create_uv_vbuffer(uint32_t num_verts, bool add_color) {
 	return tmp;
 }
 
+GS_EFFECT_PARAM_GETTER(get_image_param, "image")
+
 void draw_uv_vbuffer(gs_vertbuffer_t *vbuf, gs_texture_t *tex,
-		gs_effect_t *effect, uint32_t num_verts)
+		gs_effect_t *effect, uint32_t num_verts, bool flush)
 {
 	gs_texture_t   *texture = tex;
 	gs_technique_t *tech = gs_effect_get_technique(effect, "Draw");
-	gs_eparam_t    *image = gs_effect_get_param_by_name(effect, "image");
+	gs_eparam_t    *image = get_image_param(effect);
 	size_t      passes;
 
 	if (vbuf == NULL || tex == NULL) return;
 
-	gs_vertexbuffer_flush(vbuf);
+	if (flush)
+		gs_vertexbuffer_flush(vbuf);
 	gs_load_vertexbuffer(vbuf);
 	gs_load_indexbuffer(NULL);
 
@@ -43,6 +43,9 @@ static struct obs_source_info freetype2_source_info = {
 	.get_height = ft2_source_get_height,
 	.video_render = ft2_source_render,
 	.video_tick = ft2_video_tick,
+	.video_unchanged = ft2_source_unchanged,
+	.suspend = ft2_source_suspend,
+	.resume = ft2_source_resume,
 	.get_properties = ft2_source_properties,
 };
 
@@ -149,17 +152,7 @@ static void ft2_source_destroy(void *data)
 {
 	struct ft2_source *srcdata = data;
 
-	if (srcdata->font_face != NULL) {
-		FT_Done_Face(srcdata->font_face);
-		srcdata->font_face = NULL;
-	}
-	
-	for (uint32_t i = 0; i < num_cache_slots; i++) {
-		if (srcdata->cacheglyphs[i] != NULL) {
-			bfree(srcdata->cacheglyphs[i]);
-			srcdata->cacheglyphs[i] = NULL;
-		}
-	}
+	glyph_atlas_release(srcdata->atlas);
 
 	if (srcdata->font_name != NULL)
 		bfree(srcdata->font_name);
@@ -167,19 +160,17 @@ static void ft2_source_destroy(void *data)
 		bfree(srcdata->font_style);
 	if (srcdata->text != NULL)
 		bfree(srcdata->text);
-	if (srcdata->texbuf != NULL)
-		bfree(srcdata->texbuf);
 	if (srcdata->colorbuf != NULL)
 		bfree(srcdata->colorbuf);
+	bfree(srcdata->layout);
+	os_file_watch_remove(srcdata->text_file_watch);
 	if (srcdata->text_file != NULL)
 		bfree(srcdata->text_file);
+	da_free(srcdata->log_text);
+	da_free(srcdata->log_lines);
 
 	obs_enter_graphics();
 
-	if (srcdata->tex != NULL) {
-		gs_texture_destroy(srcdata->tex);
-		srcdata->tex = NULL;
-	}
 	if (srcdata->vbuf != NULL) {
 		gs_vertexbuffer_destroy(srcdata->vbuf);
 		srcdata->vbuf = NULL;
@@ -194,19 +185,62 @@ static void ft2_source_destroy(void *data)
 	bfree(srcdata);
 }
 
+/* the glyph atlas is the big part (a face plus a 2048x2048 texture and its
+ * copy in memory), and is freed once no other text source uses it */
+static void ft2_source_suspend(void *data)
+{
+	struct ft2_source *srcdata = data;
+
+	glyph_atlas_release(srcdata->atlas);
+	srcdata->atlas = NULL;
+	srcdata->changes++;
+
+	obs_enter_graphics();
+	if (srcdata->vbuf != NULL) {
+		gs_vertexbuffer_destroy(srcdata->vbuf);
+		srcdata->vbuf = NULL;
+	}
+	obs_leave_graphics();
+}
+
+static void ft2_source_resume(void *data)
+{
+	struct ft2_source *srcdata = data;
+
+	if (srcdata->font_name == NULL)
+		return;
+
+	srcdata->atlas = glyph_atlas_acquire(srcdata->font_name,
+			srcdata->font_style, srcdata->font_size,
+			srcdata->font_flags);
+	if (srcdata->atlas == NULL)
+		return;
+
+	srcdata->changes++;
+	reset_glyph_layout(srcdata);
+
+	if (srcdata->text != NULL) {
+		cache_glyphs(srcdata, srcdata->text);
+		set_up_vertex_buffer(srcdata);
+	}
+}
+
 static void ft2_source_render(void *data, gs_effect_t *effect)
 {
 	struct ft2_source *srcdata = data;
 	if (srcdata == NULL) return;
 
-	if (srcdata->tex == NULL || srcdata->vbuf == NULL) return;
+	if (srcdata->atlas == NULL || srcdata->atlas->tex == NULL ||
+	    srcdata->vbuf == NULL) return;
 
 	gs_reset_blend_state();
 	if (srcdata->outline_text) draw_outlines(srcdata);
 	if (srcdata->drop_shadow) draw_drop_shadow(srcdata);
 
-	draw_uv_vbuffer(srcdata->vbuf, srcdata->tex,
-		srcdata->draw_effect, (uint32_t)wcslen(srcdata->text) * 6);
+	draw_uv_vbuffer(srcdata->vbuf, srcdata->atlas->tex,
+		srcdata->draw_effect, srcdata->vbuf_glyphs * 6,
+		srcdata->vbuf_dirty);
+	srcdata->vbuf_dirty = false;
 
 	UNUSED_PARAMETER(effect);
 }
@@ -215,40 +249,51 @@ static void ft2_video_tick(void *data, float seconds)
 {
 	struct ft2_source *srcdata = data;
 	if (srcdata == NULL) return;
-	if (!srcdata->from_file || !srcdata->text_file) return;
 
-	if (os_gettime_ns() - srcdata->last_checked >= 1000000000) {
-		time_t t = get_modified_timestamp(srcdata->text_file);
-		srcdata->last_checked = os_gettime_ns();
+	if (srcdata->from_file && srcdata->text_file &&
+	    srcdata->text_file_changed) {
+		srcdata->text_file_changed = false;
 
-		if (srcdata->m_timestamp != t) {
-			if (srcdata->log_mode)
-				read_from_end(srcdata, srcdata->text_file);
-			else
-				load_text_from_file(srcdata,
-					srcdata->text_file);
-			cache_glyphs(srcdata, srcdata->text);
-			set_up_vertex_buffer(srcdata);
-		}
+		if (srcdata->log_mode)
+			read_from_end(srcdata, srcdata->text_file);
+		else
+			load_text_from_file(srcdata, srcdata->text_file);
+		cache_glyphs(srcdata, srcdata->text);
+		set_up_vertex_buffer(srcdata);
 	}
 
+	srcdata->changed = srcdata->changes != srcdata->last_changes;
+	srcdata->last_changes = srcdata->changes;
+
 	UNUSED_PARAMETER(seconds);
 }
 
-static bool init_font(struct ft2_source *srcdata)
+/* the text only changes with the text file or the glyph atlas, everything
+ * else goes through updates */
+static bool ft2_source_unchanged(void *data)
 {
-	FT_Long index;
-	const char *path = get_font_path(srcdata->font_name, srcdata->font_size,
-			srcdata->font_style, srcdata->font_flags, &index);
-	if (!path)
-		return false;
+	struct ft2_source *srcdata = data;
+	return !srcdata->changed;
+}
 
-	if (srcdata->font_face != NULL) {
-		FT_Done_Face(srcdata->font_face);
-		srcdata->font_face = NULL;
-	}
+/* called from the file watch thread */
+static void text_file_changed(void *data, const char *path)
+{
+	struct ft2_source *srcdata = data;
+	srcdata->text_file_changed = true;
+
+	UNUSED_PARAMETER(path);
+}
 
-	return FT_New_Face(ft2_lib, path, index, &srcdata->font_face) == 0;
+static void watch_text_file(struct ft2_source *srcdata, const char *file)
+{
+	os_file_watch_remove(srcdata->text_file_watch);
+	srcdata->text_file_watch = NULL;
+	srcdata->text_file_changed = false;
+
+	if (file)
+		srcdata->text_file_watch = os_file_watch_add(file,
+				text_file_changed, srcdata);
 }
 
 static void ft2_source_update(void *data, obs_data_t *settings)
@@ -296,6 +341,7 @@ static void ft2_source_update(void *data, obs_data_t *settings)
 	if (color[0] != srcdata->color[0] || color[1] != srcdata->color[1]) {
 		srcdata->color[0] = color[0];
 		srcdata->color[1] = color[1];
+		reset_glyph_layout(srcdata);
 		vbuf_needs_update = true;
 	}
 
@@ -343,7 +389,6 @@ static void ft2_source_update(void *data, obs_data_t *settings)
 		bfree(srcdata->font_style);
 		srcdata->font_name = NULL;
 		srcdata->font_style = NULL;
-		srcdata->max_h = 0;
 		vbuf_needs_update = true;
 	}
 
@@ -352,24 +397,16 @@ static void ft2_source_update(void *data, obs_data_t *settings)
 	srcdata->font_size  = font_size;
 	srcdata->font_flags = font_flags;
 
-	if (!init_font(srcdata) || srcdata->font_face == NULL) {
+	reset_glyph_layout(srcdata);
+	glyph_atlas_release(srcdata->atlas);
+	srcdata->atlas = glyph_atlas_acquire(font_name, font_style, font_size,
+			font_flags);
+
+	if (srcdata->atlas == NULL) {
 		blog(LOG_WARNING, "FT2-text: Failed to load font %s",
 			srcdata->font_name);
 		goto error;
 	}
-	else {
-		FT_Set_Pixel_Sizes(srcdata->font_face, 0, srcdata->font_size); 
-		FT_Select_Charmap(srcdata->font_face, FT_ENCODING_UNICODE);
-	}
-
-	if (srcdata->texbuf != NULL) {
-		bfree(srcdata->texbuf);
-		srcdata->texbuf = NULL;
-	}
-	srcdata->texbuf = bzalloc(texbuf_w * texbuf_h * 4);
-
-	if (srcdata->font_face)
-		cache_standard_glyphs(srcdata);
 
 skip_font_load:
 	if (from_file) {
@@ -395,15 +432,18 @@ skip_font_load:
 			bfree(srcdata->text_file);
 
 			srcdata->text_file = bstrdup(tmp);
+			watch_text_file(srcdata, tmp);
+			reset_log_tail(srcdata);
 			if (chat_log_mode)
 				read_from_end(srcdata, tmp);
 			else
 				load_text_from_file(srcdata, tmp);
-			srcdata->last_checked = os_gettime_ns();
 		}
 	}
 	else {
 		const char *tmp = obs_data_get_string(settings, "text");
+
+		watch_text_file(srcdata, NULL);
 		if (!tmp || !*tmp) goto error;
 
 		if (srcdata->text != NULL) {
@@ -414,7 +454,7 @@ skip_font_load:
 		os_utf8_to_wcs_ptr(tmp, strlen(tmp), &srcdata->text);
 	}
 
-	if (srcdata->font_face) {
+	if (srcdata->atlas) {
 		cache_glyphs(srcdata, srcdata->text);
 		set_up_vertex_buffer(srcdata);
 	}
@@ -16,15 +16,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
 #include <obs-module.h>
+#include <util/file-watch.h>
+#include <util/darray.h>
 #include <ft2build.h>
+#include "glyph-atlas.h"
 
-#define num_cache_slots 65535
-#define src_glyph srcdata->cacheglyphs[glyph_index]
+#define src_glyph srcdata->atlas->glyphs[glyph_index]
 
-struct glyph_info {
-	float u, v, u2, v2;
-	int32_t w, h, xoff, yoff;
-	int32_t xadv;
+/* what was last written to each glyph's vertices */
+struct glyph_layout {
+	struct glyph_info *glyph;
+	uint32_t dx, dy;
 };
 
 struct ft2_source {
@@ -38,23 +40,34 @@ struct ft2_source {
 	char *text_file;
 	wchar_t *text;
 	time_t m_timestamp;
-	uint64_t last_checked;
+	os_file_watch_t *text_file_watch;
+	volatile bool text_file_changed;
 
-	uint32_t cx, cy, max_h, custom_width;
-	uint32_t texbuf_x, texbuf_y;
+	/* chat log mode: end of the file read so far, and the text shown
+	 * along with the positions of its line breaks */
+	uint64_t log_offset;
+	bool log_utf16;
+	DARRAY(wchar_t) log_text;
+	DARRAY(size_t) log_lines;
+
+	uint32_t cx, cy, custom_width;
 	uint32_t color[2];
 	uint32_t *colorbuf;
 
 	int32_t cur_scroll, scroll_speed;
 
-	gs_texture_t *tex;
-
-	struct glyph_info *cacheglyphs[num_cache_slots];
+	struct glyph_atlas *atlas;
 
-	FT_Face	font_face;
-
-	uint32_t *texbuf;
 	gs_vertbuffer_t *vbuf;
+	struct glyph_layout *layout;
+	uint32_t vbuf_capacity;
+	uint32_t vbuf_glyphs;
+	bool vbuf_dirty;
+
+	/* counts changes made outside of updates (which libobs tracks),
+	 * see ft2_source_unchanged */
+	long changes, last_changes;
+	bool changed;
 
 	gs_effect_t *draw_effect;
 	bool outline_text, drop_shadow;
@@ -70,6 +83,9 @@ static void ft2_source_destroy(void *data);
 static void ft2_source_update(void *data, obs_data_t *settings);
 static void ft2_source_render(void *data, gs_effect_t *effect);
 static void ft2_video_tick(void *data, float seconds);
+static bool ft2_source_unchanged(void *data);
+static void ft2_source_suspend(void *data);
+static void ft2_source_resume(void *data);
 
 void draw_outlines(struct ft2_source *srcdata);
 void draw_drop_shadow(struct ft2_source *srcdata);
@@ -86,9 +102,10 @@ uint32_t get_ft2_text_width(wchar_t *text, struct ft2_source *srcdata);
 time_t get_modified_timestamp(char *filename);
 void load_text_from_file(struct ft2_source *srcdata, const char *filename);
 void read_from_end(struct ft2_source *srcdata, const char *filename);
+void reset_log_tail(struct ft2_source *srcdata);
 
-void cache_standard_glyphs(struct ft2_source *srcdata);
 void cache_glyphs(struct ft2_source *srcdata, wchar_t *cache_glyphs);
 
+void reset_glyph_layout(struct ft2_source *srcdata);
 void set_up_vertex_buffer(struct ft2_source *srcdata);
 void fill_vertex_buffer(struct ft2_source *srcdata);
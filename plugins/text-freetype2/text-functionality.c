@@ -26,8 +26,6 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 float offsets[16] = { -2.0f, 0.0f, 0.0f, -2.0f, 2.0f, 0.0f, 2.0f, 0.0f,
 	0.0f, 2.0f, 0.0f, 2.0f, -2.0f, 0.0f, -2.0f, 0.0f };
 
-extern uint32_t texbuf_w, texbuf_h;
-
 void draw_outlines(struct ft2_source *srcdata)
 {
 	// Horrible (hopefully temporary) solution for outlines.
@@ -45,14 +43,17 @@ void draw_outlines(struct ft2_source *srcdata)
 	for (int32_t i = 0; i < 8; i++) {
 		gs_matrix_translate3f(offsets[i * 2], offsets[(i * 2) + 1],
 			0.0f);
-		draw_uv_vbuffer(srcdata->vbuf, srcdata->tex,
-			srcdata->draw_effect,
-			(uint32_t)wcslen(srcdata->text) * 6);
+		draw_uv_vbuffer(srcdata->vbuf, srcdata->atlas->tex,
+			srcdata->draw_effect, srcdata->vbuf_glyphs * 6,
+			i == 0);
 	}
 	gs_matrix_identity();
 	gs_matrix_pop();
 
 	vdata->colors = tmp;
+
+	/* the uploaded vertices still have the outline colors */
+	srcdata->vbuf_dirty = true;
 }
 
 void draw_drop_shadow(struct ft2_source *srcdata)
@@ -70,12 +71,50 @@ void draw_drop_shadow(struct ft2_source *srcdata)
 
 	gs_matrix_push();
 	gs_matrix_translate3f(4.0f, 4.0f, 0.0f);
-	draw_uv_vbuffer(srcdata->vbuf, srcdata->tex,
-		srcdata->draw_effect, (uint32_t)wcslen(srcdata->text) * 6);
+	draw_uv_vbuffer(srcdata->vbuf, srcdata->atlas->tex,
+		srcdata->draw_effect, srcdata->vbuf_glyphs * 6, true);
 	gs_matrix_identity();
 	gs_matrix_pop();
 
 	vdata->colors = tmp;
+
+	srcdata->vbuf_dirty = true;
+}
+
+void reset_glyph_layout(struct ft2_source *srcdata)
+{
+	if (srcdata->layout)
+		memset(srcdata->layout, 0,
+			sizeof(struct glyph_layout) * srcdata->vbuf_capacity);
+}
+
+/* the vertex buffer only grows, so texts that keep changing (timers, scores,
+ * chat logs) can reuse it and only rewrite the glyphs that changed */
+static void resize_vertex_buffer(struct ft2_source *srcdata, uint32_t len)
+{
+	uint32_t capacity = srcdata->vbuf_capacity ?
+		srcdata->vbuf_capacity : 64;
+
+	while (capacity < len)
+		capacity *= 2;
+
+	if (srcdata->vbuf != NULL) {
+		gs_vertbuffer_t *tmpvbuf = srcdata->vbuf;
+		srcdata->vbuf = NULL;
+		gs_vertexbuffer_destroy(tmpvbuf);
+	}
+	srcdata->vbuf = create_uv_vbuffer(capacity * 6, true);
+	srcdata->vbuf_capacity = capacity;
+	srcdata->vbuf_glyphs = 0;
+
+	srcdata->colorbuf = brealloc(srcdata->colorbuf,
+			sizeof(uint32_t) * capacity * 6);
+	for (size_t i = 0; i < capacity * 6; i++) {
+		srcdata->colorbuf[i] = 0xFF000000;
+	}
+
+	bfree(srcdata->layout);
+	srcdata->layout = bzalloc(sizeof(struct glyph_layout) * capacity);
 }
 
 void set_up_vertex_buffer(struct ft2_source *srcdata)
@@ -84,29 +123,26 @@ void set_up_vertex_buffer(struct ft2_source *srcdata)
 	uint32_t x = 0, space_pos = 0, word_width = 0;
 	size_t len;
 
-	if (!srcdata->text)
+	if (!srcdata->text || !srcdata->atlas)
 		return;
 
+	srcdata->changes++;
+	obs_enter_graphics();
+
 	if (srcdata->custom_width >= 100)
 		srcdata->cx = srcdata->custom_width;
 	else
 		srcdata->cx = get_ft2_text_width(srcdata->text, srcdata);
-	srcdata->cy = srcdata->max_h;
+	srcdata->cy = srcdata->atlas->max_h;
 
-	obs_enter_graphics();
-	if (srcdata->vbuf != NULL) {
-		gs_vertbuffer_t *tmpvbuf = srcdata->vbuf;
-		srcdata->vbuf = NULL;
-		gs_vertexbuffer_destroy(tmpvbuf);
-	}
-	srcdata->vbuf = create_uv_vbuffer((uint32_t)wcslen(srcdata->text) * 6,
-			true);
+	len = wcslen(srcdata->text);
+
+	if (srcdata->vbuf == NULL || len > srcdata->vbuf_capacity)
+		resize_vertex_buffer(srcdata, (uint32_t)len);
 
 	if (srcdata->custom_width <= 100) goto skip_word_wrap;
 	if (!srcdata->word_wrap) goto skip_word_wrap;
 
-	len = wcslen(srcdata->text);
-
 	for (uint32_t i = 0; i <= len; i++) {
 		if (i == wcslen(srcdata->text)) goto eos_check;
 
@@ -128,9 +164,10 @@ void set_up_vertex_buffer(struct ft2_source *srcdata)
 		if (srcdata->text[i] == L' ')
 			space_pos = i;
 	next_char:;
-		glyph_index = FT_Get_Char_Index(srcdata->font_face,
+		glyph_index = FT_Get_Char_Index(srcdata->atlas->font_face,
 			srcdata->text[i]);
-		word_width += src_glyph->xadv;
+		if (src_glyph != NULL)
+			word_width += src_glyph->xadv;
 	eos_skip:;
 	}
 
@@ -146,34 +183,27 @@ void fill_vertex_buffer(struct ft2_source *srcdata)
 
 	struct vec2 *tvarray = (struct vec2 *)vdata->tvarray[0].array;
 	uint32_t *col = (uint32_t *)vdata->colors;
+	struct glyph_layout *layout;
 
 	FT_UInt glyph_index = 0;
 
-	uint32_t dx = 0, dy = srcdata->max_h, max_y = dy;
+	uint32_t max_h = srcdata->atlas->max_h;
+	uint32_t dx = 0, dy = max_h, max_y = dy;
 	uint32_t cur_glyph = 0;
 	size_t len = wcslen(srcdata->text);
 
-	if (srcdata->colorbuf != NULL) {
-		bfree(srcdata->colorbuf);
-		srcdata->colorbuf = NULL;
-	}
-	srcdata->colorbuf = bzalloc(sizeof(uint32_t)*wcslen(srcdata->text) * 6);
-	for (size_t i = 0; i < len * 6; i++) {
-		srcdata->colorbuf[i] = 0xFF000000;
-	}
-
 	for (size_t i = 0; i < len; i++) {
 	add_linebreak:;
 		if (srcdata->text[i] != L'\n') goto draw_glyph;
 		dx = 0; i++;
-		dy += srcdata->max_h + 4;
+		dy += max_h + 4;
 		if (i == wcslen(srcdata->text)) goto skip_glyph;
 		if (srcdata->text[i] == L'\n') goto add_linebreak;
 	draw_glyph:;
 		// Skip filthy dual byte Windows line breaks
 		if (srcdata->text[i] == L'\r') goto skip_glyph;
 
-		glyph_index = FT_Get_Char_Index(srcdata->font_face,
+		glyph_index = FT_Get_Char_Index(srcdata->atlas->font_face,
 			srcdata->text[i]);
 		if (src_glyph == NULL)
 			goto skip_glyph;
@@ -182,10 +212,14 @@ void fill_vertex_buffer(struct ft2_source *srcdata)
 
 		if (dx + src_glyph->xadv > srcdata->custom_width) {
 			dx = 0;
-			dy += srcdata->max_h + 4;
+			dy += max_h + 4;
 		}
 
 	skip_custom_width:;
+		layout = srcdata->layout + cur_glyph;
+		if (layout->glyph == src_glyph &&
+		    layout->dx == dx && layout->dy == dy)
+			goto skip_unchanged;
 
 		set_v3_rect(vdata->points + (cur_glyph * 6),
 			(float)dx + (float)src_glyph->xoff,
@@ -200,6 +234,13 @@ void fill_vertex_buffer(struct ft2_source *srcdata)
 		set_rect_colors2(col + (cur_glyph * 6),
 			srcdata->color[0],
 			srcdata->color[1]);
+
+		layout->glyph = src_glyph;
+		layout->dx = dx;
+		layout->dy = dy;
+		srcdata->vbuf_dirty = true;
+
+	skip_unchanged:;
 		dx += src_glyph->xadv;
 		if (dy - (float)src_glyph->yoff + src_glyph->h > max_y)
 			max_y = dy - src_glyph->yoff + src_glyph->h;
@@ -207,113 +248,18 @@ void fill_vertex_buffer(struct ft2_source *srcdata)
 	skip_glyph:;
 	}
 
+	srcdata->vbuf_glyphs = cur_glyph;
 	srcdata->cy = max_y;
 }
 
-void cache_standard_glyphs(struct ft2_source *srcdata)
-{
-	for (uint32_t i = 0; i < num_cache_slots; i++) {
-		if (srcdata->cacheglyphs[i] != NULL) {
-			bfree(srcdata->cacheglyphs[i]);
-			srcdata->cacheglyphs[i] = NULL;
-		}
-	}
-
-	srcdata->texbuf_x = 0;
-	srcdata->texbuf_y = 0;
-
-	cache_glyphs(srcdata, L"abcdefghijklmnopqrstuvwxyz" \
-		L"ABCDEFGHIJKLMNOPQRSTUVWXYZ1234567890" \
-		L"!@#$%^&*()-_=+,<.>/?\\|[]{}`~ \'\"\0");
-}
-
-#define glyph_pos x + (y*slot->bitmap.pitch)
-#define buf_pos (dx + x) + ((dy + y) * texbuf_w)
-
 void cache_glyphs(struct ft2_source *srcdata, wchar_t *cache_glyphs)
 {
-	FT_GlyphSlot slot;
-	FT_UInt glyph_index = 0;
-
-	if (!srcdata->font_face || !cache_glyphs)
+	if (!srcdata->atlas)
 		return;
 
-	slot = srcdata->font_face->glyph;
-
-	uint32_t dx = srcdata->texbuf_x, dy = srcdata->texbuf_y;
-	uint8_t alpha;
-
-	int32_t cached_glyphs = 0;
-	size_t len = wcslen(cache_glyphs);
-
-	for (size_t i = 0; i < len; i++) {
-		glyph_index = FT_Get_Char_Index(srcdata->font_face,
-			cache_glyphs[i]);
-
-		if (src_glyph != NULL)
-			goto skip_glyph;
-
-		FT_Load_Glyph(srcdata->font_face, glyph_index, FT_LOAD_DEFAULT);
-		FT_Render_Glyph(slot, FT_RENDER_MODE_NORMAL);
-
-		uint32_t g_w = slot->bitmap.width;
-		uint32_t g_h = slot->bitmap.rows;
-
-		if (srcdata->max_h < g_h) srcdata->max_h = g_h;
-
-		if (dx + g_w >= texbuf_w) {
-			dx = 0;
-			dy += srcdata->max_h + 1;
-		}
-
-		src_glyph = bzalloc(sizeof(struct glyph_info));
-		src_glyph->u = (float)dx / (float)texbuf_w;
-		src_glyph->u2 = (float)(dx + g_w) / (float)texbuf_w;
-		src_glyph->v = (float)dy / (float)texbuf_h;
-		src_glyph->v2 = (float)(dy + g_h) / (float)texbuf_h;
-		src_glyph->w = g_w;
-		src_glyph->h = g_h;
-		src_glyph->yoff = slot->bitmap_top;
-		src_glyph->xoff = slot->bitmap_left;
-		src_glyph->xadv = slot->advance.x >> 6;
-
-		for (uint32_t y = 0; y < g_h; y++) {
-			for (uint32_t x = 0; x < g_w; x++) {
-				alpha = slot->bitmap.buffer[glyph_pos];
-				srcdata->texbuf[buf_pos] =
-					0x00FFFFFF ^ ((uint32_t)alpha << 24);
-			}
-		}
-
-		dx += (g_w + 1);
-		if (dx >= texbuf_w) {
-			dx = 0;
-			dy += srcdata->max_h;
-		}
-
-		cached_glyphs++;
-	skip_glyph:;
-	}
-
-	srcdata->texbuf_x = dx;
-	srcdata->texbuf_y = dy;
-
-	if (cached_glyphs > 0) {
-
-		obs_enter_graphics();
-
-		if (srcdata->tex != NULL) {
-			gs_texture_t *tmp_texture = NULL;
-			tmp_texture = srcdata->tex;
-			srcdata->tex = NULL;
-			gs_texture_destroy(tmp_texture);
-		}
-
-		srcdata->tex = gs_texture_create(texbuf_w, texbuf_h,
-			GS_RGBA, 1, (const uint8_t **)&srcdata->texbuf, 0);
-
-		obs_leave_graphics();
-	}
+	obs_enter_graphics();
+	glyph_atlas_cache(srcdata->atlas, cache_glyphs);
+	obs_leave_graphics();
 }
 
 time_t get_modified_timestamp(char *filename)
@@ -395,94 +341,202 @@ void load_text_from_file(struct ft2_source *srcdata, const char *filename)
 	bfree(tmp_read);
 }
 
-void read_from_end(struct ft2_source *srcdata, const char *filename)
+/* chat log mode shows the text after the last LOG_MODE_LINES + 1 line
+ * breaks.  only what was appended since the last read is read and decoded,
+ * and a list of where the line breaks are lets old lines be dropped without
+ * searching for them. */
+#define LOG_MODE_LINES       6
+#define LOG_TAIL_CHUNK_SIZE  4096
+#define LOG_MAX_APPEND_SIZE  (1024 * 1024)
+
+void reset_log_tail(struct ft2_source *srcdata)
 {
-	FILE *tmp_file = NULL;
-	uint32_t filesize = 0, cur_pos = 0;
-	char *tmp_read = NULL;
-	uint16_t value = 0, line_breaks = 0;
-	size_t bytes_read;
-	char bvalue;
+	srcdata->log_offset = 0;
+	srcdata->log_utf16 = false;
+	da_resize(srcdata->log_text, 0);
+	da_resize(srcdata->log_lines, 0);
+}
 
-	bool utf16 = false;
+static void trim_log_tail(struct ft2_source *srcdata)
+{
+	size_t excess;
+	size_t cut;
 
-	tmp_file = fopen(filename, "rb");
-	if (tmp_file == NULL) {
-		if (!srcdata->file_load_failed) {
-			blog(LOG_WARNING, "Failed to open file %s", filename);
-			srcdata->file_load_failed = true;
-		}
+	if (srcdata->log_lines.num <= LOG_MODE_LINES)
 		return;
-	}
-	bytes_read = fread(&value, 2, 1, tmp_file);
 
-	if (bytes_read == 2 && value == 0xFEFF)
-		utf16 = true;
+	excess = srcdata->log_lines.num - LOG_MODE_LINES;
+	cut = srcdata->log_lines.array[excess - 1] + 1;
 
-	fseek(tmp_file, 0, SEEK_END);
-	filesize = (uint32_t)ftell(tmp_file);
-	cur_pos = filesize;
+	da_erase_range(srcdata->log_text, 0, cut);
+	da_erase_range(srcdata->log_lines, 0, excess);
+
+	for (size_t i = 0; i < srcdata->log_lines.num; i++)
+		srcdata->log_lines.array[i] -= cut;
+}
+
+static inline void append_log_char(struct ft2_source *srcdata, wchar_t ch)
+{
+	if (ch == L'\r')
+		return;
+	if (ch == L'\n')
+		da_push_back(srcdata->log_lines, &srcdata->log_text.num);
+
+	da_push_back(srcdata->log_text, &ch);
+}
+
+/* returns how many bytes make up complete characters, the rest is read again
+ * once the writer has finished the character */
+static size_t utf8_complete_size(const uint8_t *data, size_t size)
+{
+	size_t trailing = 0;
 
-	while (line_breaks <= 6 && cur_pos != 0) {
-		if (!utf16) cur_pos--;
-		else cur_pos -= 2;
-		fseek(tmp_file, cur_pos, SEEK_SET);
+	for (size_t i = size; i > 0 && trailing < 4; i--) {
+		uint8_t ch = data[i - 1];
+		size_t len;
 
-		if (!utf16) {
-			bytes_read = fread(&bvalue, 1, 1, tmp_file);
-			if (bytes_read == 1 && bvalue == '\n')
-				line_breaks++;
+		if ((ch & 0xC0) == 0x80) {
+			trailing++;
+			continue;
 		}
-		else {
-			bytes_read = fread(&value, 2, 1, tmp_file);
-			if (bytes_read == 2 && value == L'\n')
-				line_breaks++;
+
+		len = (ch & 0xE0) == 0xC0 ? 2 :
+		      (ch & 0xF0) == 0xE0 ? 3 :
+		      (ch & 0xF8) == 0xF0 ? 4 : 1;
+		return trailing + 1 >= len ? size : i - 1;
+	}
+
+	return size;
+}
+
+/* decodes the bytes in [start, end) onto the end of the log text and returns
+ * the number of bytes used.  at an arbitrary start offset, continuation bytes
+ * of a character that began earlier are skipped. */
+static size_t append_log_data(struct ft2_source *srcdata, FILE *file,
+		uint64_t start, uint64_t end, bool arbitrary_start)
+{
+	size_t size = (size_t)(end - start);
+	size_t used, skip = 0;
+	uint8_t *data;
+
+	if (!size || os_fseeki64(file, (int64_t)start, SEEK_SET) != 0)
+		return 0;
+
+	data = bmalloc(size + 1);
+	size = fread(data, 1, size, file);
+
+	if (srcdata->log_utf16) {
+		const uint16_t *chars = (const uint16_t*)data;
+
+		used = size & ~(size_t)1;
+		for (size_t i = 0; i < used / 2; i++)
+			append_log_char(srcdata, (wchar_t)chars[i]);
+	} else {
+		if (arbitrary_start)
+			while (skip < size && (data[skip] & 0xC0) == 0x80)
+				skip++;
+
+		used = utf8_complete_size(data, size);
+
+		if (used > skip) {
+			size_t len = used - skip;
+			wchar_t *wide = bmalloc((len + 1) * sizeof(wchar_t));
+
+			len = os_utf8_to_wcs((const char*)data + skip, len,
+					wide, len + 1);
+			for (size_t i = 0; i < len; i++)
+				append_log_char(srcdata, wide[i]);
+			bfree(wide);
+		} else {
+			used = skip;
 		}
 	}
 
-	if (cur_pos != 0)
-		cur_pos += (utf16) ? 2 : 1;
+	bfree(data);
+	return used;
+}
+
+/* reads ever bigger chunks from the end until there are enough lines */
+static void load_log_tail(struct ft2_source *srcdata, FILE *file,
+		uint64_t size)
+{
+	uint64_t data_start = srcdata->log_utf16 ? 2 : 0;
+	uint64_t chunk = LOG_TAIL_CHUNK_SIZE;
 
-	fseek(tmp_file, cur_pos, SEEK_SET);
+	for (;;) {
+		uint64_t start = data_start;
 
-	if (utf16) {
-		if (srcdata->text != NULL) {
-			bfree(srcdata->text);
-			srcdata->text = NULL;
+		if (size - data_start > chunk)
+			start = size - chunk;
+		if (srcdata->log_utf16)
+			start = data_start + ((start - data_start) & ~1ULL);
+
+		da_resize(srcdata->log_text, 0);
+		da_resize(srcdata->log_lines, 0);
+
+		srcdata->log_offset = start + append_log_data(srcdata, file,
+				start, size, start != data_start);
+
+		if (start == data_start ||
+		    srcdata->log_lines.num > LOG_MODE_LINES) {
+			trim_log_tail(srcdata);
+			break;
 		}
-		srcdata->text = bzalloc(filesize - cur_pos);
-		bytes_read = fread(srcdata->text, (filesize - cur_pos), 1,
-				tmp_file);
 
-		remove_cr(srcdata->text);
-		srcdata->m_timestamp =
-			get_modified_timestamp(srcdata->text_file);
-		bfree(tmp_read);
-		fclose(tmp_file);
+		chunk *= 2;
+	}
+}
 
+void read_from_end(struct ft2_source *srcdata, const char *filename)
+{
+	FILE *file;
+	int64_t size;
+	uint16_t bom = 0;
+
+	file = os_fopen(filename, "rb");
+	if (file == NULL) {
+		if (!srcdata->file_load_failed) {
+			blog(LOG_WARNING, "Failed to open file %s", filename);
+			srcdata->file_load_failed = true;
+		}
 		return;
 	}
 
-	tmp_read = bzalloc((filesize - cur_pos) + 1);
-	bytes_read = fread(tmp_read, filesize - cur_pos, 1, tmp_file);
-	fclose(tmp_file);
-
-	if (srcdata->text != NULL) {
-		bfree(srcdata->text);
-		srcdata->text = NULL;
+	size = os_fgetsize(file);
+	if (size < 0)
+		size = 0;
+
+	/* truncated or replaced, or so much was added that only its end is
+	 * going to be shown anyway */
+	if ((uint64_t)size < srcdata->log_offset ||
+	    (uint64_t)size - srcdata->log_offset > LOG_MAX_APPEND_SIZE)
+		reset_log_tail(srcdata);
+
+	if (srcdata->log_offset == 0) {
+		srcdata->log_utf16 = fread(&bom, 2, 1, file) == 1 &&
+			bom == 0xFEFF;
+		load_log_tail(srcdata, file, (uint64_t)size);
+
+	} else if ((uint64_t)size > srcdata->log_offset) {
+		srcdata->log_offset += append_log_data(srcdata, file,
+				srcdata->log_offset, (uint64_t)size, false);
+		trim_log_tail(srcdata);
 	}
-	srcdata->text = bzalloc((strlen(tmp_read) + 1)*sizeof(wchar_t));
-	os_utf8_to_wcs(tmp_read, strlen(tmp_read),
-		srcdata->text, (strlen(tmp_read) + 1));
 
-	remove_cr(srcdata->text);
+	fclose(file);
+
+	bfree(srcdata->text);
+	srcdata->text = bzalloc((srcdata->log_text.num + 1) *
+			sizeof(wchar_t));
+	if (srcdata->log_text.num)
+		memcpy(srcdata->text, srcdata->log_text.array,
+				srcdata->log_text.num * sizeof(wchar_t));
+
 	srcdata->m_timestamp = get_modified_timestamp(srcdata->text_file);
-	bfree(tmp_read);
 }
 
 uint32_t get_ft2_text_width(wchar_t *text, struct ft2_source *srcdata)
 {
-	FT_GlyphSlot slot = srcdata->font_face->glyph;
 	FT_UInt glyph_index = 0;
 	uint32_t w = 0, max_w = 0;
 	size_t len;
@@ -492,12 +546,12 @@ uint32_t get_ft2_text_width(wchar_t *text, struct ft2_source *srcdata)
 
 	len = wcslen(text);
 	for (size_t i = 0; i < len; i++) {
-		glyph_index = FT_Get_Char_Index(srcdata->font_face, text[i]);
-		FT_Load_Glyph(srcdata->font_face, glyph_index, FT_LOAD_DEFAULT);
+		glyph_index = FT_Get_Char_Index(srcdata->atlas->font_face,
+				text[i]);
 
 		if (text[i] == L'\n') w = 0;
-		else {
-			w += slot->advance.x >> 6;
+		else if (src_glyph != NULL) {
+			w += src_glyph->xadv;
 			if (w > max_w) max_w = w;
 		}
 	}
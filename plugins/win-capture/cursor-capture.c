@@ -1,7 +1,29 @@
 #include <windows.h>
 #include <obs.h>
+#include <util/darray.h>
 #include "cursor-capture.h"
 
+/* how many cursors that no source is showing are kept around */
+#define MAX_UNUSED_CURSORS 16
+
+/*
+ * Cursor textures are cached by handle and shared between all sources, so
+ * switching back and forth between cursors (text fields, resize handles,
+ * etc) doesn't keep creating textures.  The cache is only touched from
+ * within the graphics context, which serializes access to it.
+ */
+struct cached_cursor {
+	HCURSOR                        handle;
+	gs_texture_t                   *texture;
+	long                           x_hotspot;
+	long                           y_hotspot;
+	long                           refs;
+	uint64_t                       last_used;
+};
+
+static DARRAY(struct cached_cursor) cursor_cache = {0};
+static uint64_t                      cursor_cache_time = 0;
+
 static uint8_t *get_bitmap_data(HBITMAP hbmp, BITMAP *bmp)
 {
 	if (GetObject(hbmp, sizeof(*bmp), bmp) != 0) {
@@ -131,16 +153,13 @@ static inline uint8_t *cursor_capture_icon_bitmap(ICONINFO *ii,
 	return output;
 }
 
-static inline bool cursor_capture_icon(struct cursor_data *data, HICON icon)
+static bool cursor_create_texture(struct cached_cursor *cc, HICON icon)
 {
 	uint8_t *bitmap;
 	uint32_t height;
 	uint32_t width;
 	ICONINFO ii;
 
-	gs_texture_destroy(data->texture);
-	data->texture = NULL;
-
 	if (!icon) {
 		return false;
 	}
@@ -150,23 +169,109 @@ static inline bool cursor_capture_icon(struct cursor_data *data, HICON icon)
 
 	bitmap = cursor_capture_icon_bitmap(&ii, &width, &height);
 	if (bitmap) {
-		data->texture = gs_texture_create(width, height, GS_BGRA,
+		cc->texture = gs_texture_create(width, height, GS_BGRA,
 				1, (const uint8_t**)&bitmap, 0);
 		bfree(bitmap);
 
-		data->x_hotspot = ii.xHotspot;
-		data->y_hotspot = ii.yHotspot;
+		cc->x_hotspot = ii.xHotspot;
+		cc->y_hotspot = ii.yHotspot;
 	}
 
 	DeleteObject(ii.hbmColor);
 	DeleteObject(ii.hbmMask);
-	return !!data->texture;
+	return !!cc->texture;
+}
+
+static void cursor_cache_trim(void)
+{
+	size_t unused = 0;
+
+	for (size_t i = 0; i < cursor_cache.num; i++) {
+		if (!cursor_cache.array[i].refs)
+			unused++;
+	}
+
+	while (unused > MAX_UNUSED_CURSORS) {
+		size_t oldest = DARRAY_INVALID;
+
+		for (size_t i = 0; i < cursor_cache.num; i++) {
+			struct cached_cursor *cc = &cursor_cache.array[i];
+			if (cc->refs)
+				continue;
+			if (oldest == DARRAY_INVALID || cc->last_used <
+					cursor_cache.array[oldest].last_used)
+				oldest = i;
+		}
+
+		gs_texture_destroy(cursor_cache.array[oldest].texture);
+		da_erase(cursor_cache, oldest);
+		unused--;
+	}
+}
+
+static struct cached_cursor *cursor_cache_find(HCURSOR handle)
+{
+	for (size_t i = 0; i < cursor_cache.num; i++) {
+		if (cursor_cache.array[i].handle == handle)
+			return &cursor_cache.array[i];
+	}
+
+	return NULL;
+}
+
+static struct cached_cursor *cursor_cache_acquire(HCURSOR handle)
+{
+	struct cached_cursor *cc = cursor_cache_find(handle);
+
+	if (!cc) {
+		struct cached_cursor new_cc = {0};
+		HICON icon = CopyIcon(handle);
+
+		new_cc.handle = handle;
+		cursor_create_texture(&new_cc, icon);
+		DestroyIcon(icon);
+
+		/* failed cursors are cached too so they aren't retried on
+		 * every tick, the texture is just NULL */
+		cc = da_push_back_new(cursor_cache);
+		*cc = new_cc;
+	}
+
+	cc->refs++;
+	cc->last_used = ++cursor_cache_time;
+	return cc;
+}
+
+static void cursor_cache_release(HCURSOR handle)
+{
+	struct cached_cursor *cc;
+
+	if (!handle)
+		return;
+
+	cc = cursor_cache_find(handle);
+	if (cc && cc->refs) {
+		cc->refs--;
+		cc->last_used = ++cursor_cache_time;
+	}
+
+	cursor_cache_trim();
+}
+
+void cursor_cache_free(void)
+{
+	obs_enter_graphics();
+	for (size_t i = 0; i < cursor_cache.num; i++)
+		gs_texture_destroy(cursor_cache.array[i].texture);
+	obs_leave_graphics();
+
+	da_free(cursor_cache);
 }
 
 void cursor_capture(struct cursor_data *data)
 {
+	struct cached_cursor *cc;
 	CURSORINFO ci = {0};
-	HICON icon;
 
 	ci.cbSize = sizeof(ci);
 
@@ -178,15 +283,26 @@ void cursor_capture(struct cursor_data *data)
 	memcpy(&data->cursor_pos, &ci.ptScreenPos, sizeof(data->cursor_pos));
 
 	if (data->current_cursor == ci.hCursor) {
+		data->visible = !!data->texture &&
+			(ci.flags & CURSOR_SHOWING) != 0;
 		return;
 	}
 
-	icon = CopyIcon(ci.hCursor);
-	data->visible = cursor_capture_icon(data, icon);
-	data->current_cursor = ci.hCursor;
-	if ((ci.flags & CURSOR_SHOWING) == 0)
+	cursor_cache_release(data->current_cursor);
+	data->current_cursor = NULL;
+	data->texture = NULL;
+
+	if (!ci.hCursor) {
 		data->visible = false;
-	DestroyIcon(icon);
+		return;
+	}
+
+	cc = cursor_cache_acquire(ci.hCursor);
+	data->current_cursor = ci.hCursor;
+	data->texture = cc->texture;
+	data->x_hotspot = cc->x_hotspot;
+	data->y_hotspot = cc->y_hotspot;
+	data->visible = !!data->texture && (ci.flags & CURSOR_SHOWING) != 0;
 }
 
 void cursor_draw(struct cursor_data *data, long x_offset, long y_offset,
@@ -217,6 +333,6 @@ void cursor_draw(struct cursor_data *data, long x_offset, long y_offset,
 
 void cursor_data_free(struct cursor_data *data)
 {
-	gs_texture_destroy(data->texture);
+	cursor_cache_release(data->current_cursor);
 	memset(data, 0, sizeof(*data));
 }
@@ -15,3 +15,4 @@ extern void cursor_capture(struct cursor_data *data);
 extern void cursor_draw(struct cursor_data *data, long x_offset, long y_offset,
 		float x_scale, float y_scale, long width, long height);
 extern void cursor_data_free(struct cursor_data *data);
+extern void cursor_cache_free(void);
@@ -175,12 +175,14 @@ void dc_capture_capture(struct dc_capture *capture, HWND window)
 	capture->textures_written[capture->cur_tex] = true;
 }
 
+GS_EFFECT_PARAM_GETTER(get_image_param, "image")
+
 static void draw_texture(struct dc_capture *capture, int id,
 		gs_effect_t *effect)
 {
 	gs_texture_t   *texture = capture->textures[id];
 	gs_technique_t *tech    = gs_effect_get_technique(effect, "Draw");
-	gs_eparam_t    *image   = gs_effect_get_param_by_name(effect, "image");
+	gs_eparam_t    *image   = get_image_param(effect);
 	size_t      passes;
 
 	gs_effect_set_texture(image, texture);
@@ -199,16 +201,16 @@ static void draw_texture(struct dc_capture *capture, int id,
 	gs_technique_end(tech);
 }
 
-void dc_capture_render(struct dc_capture *capture, gs_effect_t *effect)
+bool dc_capture_render(struct dc_capture *capture, gs_effect_t *effect)
 {
 	int last_tex = (capture->cur_tex > 0) ?
 		capture->cur_tex-1 : capture->num_textures-1;
 
-	if (!capture->valid)
-		return;
+	if (!capture->valid || !capture->textures_written[last_tex])
+		return false;
 
-	if (capture->textures_written[last_tex])
-		draw_texture(capture, last_tex, effect);
+	draw_texture(capture, last_tex, effect);
+	return true;
 }
 
 gs_effect_t *create_opaque_effect(void)
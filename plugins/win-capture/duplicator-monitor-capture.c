@@ -188,10 +188,13 @@ static void duplicator_capture_render(void *data, gs_effect_t *effect)
 	gs_texture_t *texture;
 	int rot;
 
-	if (!capture->duplicator)
+	if (!capture->duplicator) {
+		obs_source_set_opaque(capture->source, false);
 		return;
+	}
 
 	texture = gs_duplicator_get_texture(capture->duplicator);
+	obs_source_set_opaque(capture->source, texture != NULL);
 	if (!texture)
 		return;
 
@@ -0,0 +1,126 @@
+#include "dwm-capture.h"
+
+/* exported by user32 but not declared in any header.  the handle it returns
+ * can be opened as a shared texture, and stays the same until the window is
+ * resized. */
+typedef BOOL (WINAPI *get_dx_shared_surface_t)(HWND window, HANDLE *surface,
+		LUID *adapter, ULONG *format, ULONG *present_flags,
+		ULONGLONG *update_id);
+
+static get_dx_shared_surface_t get_dx_shared_surface = NULL;
+static bool funcs_loaded = false;
+
+static void load_dwm_funcs(void)
+{
+	HMODULE user32;
+
+	if (funcs_loaded)
+		return;
+
+	funcs_loaded = true;
+
+	user32 = GetModuleHandleW(L"user32");
+	if (user32)
+		get_dx_shared_surface = (get_dx_shared_surface_t)
+			GetProcAddress(user32, "DwmGetDxSharedSurface");
+}
+
+bool dwm_capture_available(void)
+{
+	load_dwm_funcs();
+
+	return get_dx_shared_surface &&
+		gs_get_device_type() == GS_DEVICE_DIRECT3D_11 &&
+		gs_shared_texture_available();
+}
+
+void dwm_capture_free(struct dwm_capture *capture)
+{
+	gs_texture_destroy(capture->texture);
+	memset(capture, 0, sizeof(*capture));
+}
+
+static inline uint32_t clamp_offset(LONG offset, uint32_t size)
+{
+	if (offset < 0)
+		return 0;
+	return (uint32_t)offset < size ? (uint32_t)offset : size;
+}
+
+bool dwm_capture_capture(struct dwm_capture *capture, HWND window)
+{
+	HANDLE    handle = NULL;
+	LUID      adapter;
+	ULONG     format;
+	ULONG     present_flags;
+	ULONGLONG update_id;
+	RECT      window_rect;
+	RECT      client_rect;
+	POINT     client_pos = {0, 0};
+	uint32_t  tex_cx, tex_cy;
+
+	if (!get_dx_shared_surface ||
+	    !get_dx_shared_surface(window, &handle, &adapter, &format,
+			    &present_flags, &update_id) ||
+	    !handle) {
+		dwm_capture_free(capture);
+		return false;
+	}
+
+	if (handle != capture->handle) {
+		dwm_capture_free(capture);
+
+		capture->texture = gs_texture_open_shared(
+				(uint32_t)(uintptr_t)handle);
+		if (!capture->texture)
+			return false;
+
+		capture->handle = handle;
+	}
+
+	/* only copies anything when the surface is on another adapter */
+	gs_texture_update_shared(capture->texture);
+
+	if (!GetWindowRect(window, &window_rect) ||
+	    !GetClientRect(window, &client_rect) ||
+	    !ClientToScreen(window, &client_pos))
+		return false;
+
+	tex_cx = gs_texture_get_width(capture->texture);
+	tex_cy = gs_texture_get_height(capture->texture);
+
+	capture->x = clamp_offset(client_pos.x - window_rect.left, tex_cx);
+	capture->y = clamp_offset(client_pos.y - window_rect.top,  tex_cy);
+	capture->width  = clamp_offset(client_rect.right,  tex_cx - capture->x);
+	capture->height = clamp_offset(client_rect.bottom, tex_cy - capture->y);
+	return true;
+}
+
+GS_EFFECT_PARAM_GETTER(get_image_param, "image")
+
+bool dwm_capture_render(struct dwm_capture *capture, gs_effect_t *effect)
+{
+	gs_technique_t *tech;
+	gs_eparam_t    *image;
+	size_t         passes;
+
+	if (!capture->texture || !capture->width || !capture->height)
+		return false;
+
+	tech  = gs_effect_get_technique(effect, "Draw");
+	image = get_image_param(effect);
+
+	gs_effect_set_texture(image, capture->texture);
+
+	passes = gs_technique_begin(tech);
+	for (size_t i = 0; i < passes; i++) {
+		if (gs_technique_begin_pass(tech, i)) {
+			gs_draw_sprite_subregion(capture->texture, 0,
+					capture->x, capture->y,
+					capture->width, capture->height);
+			gs_technique_end_pass(tech);
+		}
+	}
+	gs_technique_end(tech);
+	return true;
+}
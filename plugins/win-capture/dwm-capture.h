@@ -0,0 +1,34 @@
+#pragma once
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include <obs-module.h>
+
+/*
+ * Captures a window by opening the compositor's redirection surface for it
+ * as a shared texture, so the window's contents never pass through the CPU.
+ * The surface covers the whole window including its frame, so only the
+ * client area is drawn.
+ */
+struct dwm_capture {
+	gs_texture_t *texture;
+	HANDLE       handle;
+
+	uint32_t     x, y;
+	uint32_t     width;
+	uint32_t     height;
+};
+
+/* true if the compositor's surfaces can be opened with this device */
+extern bool dwm_capture_available(void);
+
+/* must be called within the graphics context.  returns false when the
+ * window's surface can't be used, in which case the caller falls back to
+ * another method */
+extern bool dwm_capture_capture(struct dwm_capture *capture, HWND window);
+extern void dwm_capture_free(struct dwm_capture *capture);
+
+/* returns false if there was nothing to draw yet */
+extern bool dwm_capture_render(struct dwm_capture *capture,
+		gs_effect_t *effect);
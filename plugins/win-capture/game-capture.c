@@ -106,12 +106,12 @@ struct game_capture {
 	HANDLE                        hook_data_map;
 	HANDLE                        global_hook_info_map;
 	HANDLE                        target_process;
-	HANDLE                        texture_mutexes[2];
+	HANDLE                        texture_mutexes[NUM_SHMEM_TEXTURES];
 
 	union {
 		struct {
 			struct shmem_data *shmem_data;
-			uint8_t *texture_buffers[2];
+			uint8_t *texture_buffers[NUM_SHMEM_TEXTURES];
 		};
 
 		struct shtex_data *shtex_data;
@@ -170,12 +170,20 @@ static inline HANDLE open_process(DWORD desired_access, bool inherit_handle,
 
 static void stop_capture(struct game_capture *gc)
 {
+	obs_source_set_opaque(gc->source, false);
 	ipc_pipe_server_free(&gc->pipe);
 
 	if (gc->hook_stop) {
 		SetEvent(gc->hook_stop);
 	}
 	if (gc->global_hook_info) {
+		if (gc->global_hook_info->type == CAPTURE_TYPE_MEMORY &&
+		    gc->data)
+			info("shared memory capture: %"PRIu32" frames dropped, "
+			     "%"PRIu32" frames late",
+			     gc->global_hook_info->dropped_frames,
+			     gc->global_hook_info->late_frames);
+
 		UnmapViewOfFile(gc->global_hook_info);
 		gc->global_hook_info = NULL;
 	}
@@ -192,8 +200,8 @@ static void stop_capture(struct game_capture *gc)
 	close_handle(&gc->hook_data_map);
 	close_handle(&gc->global_hook_info_map);
 	close_handle(&gc->target_process);
-	close_handle(&gc->texture_mutexes[0]);
-	close_handle(&gc->texture_mutexes[1]);
+	for (size_t i = 0; i < NUM_SHMEM_TEXTURES; i++)
+		close_handle(&gc->texture_mutexes[i]);
 
 	if (gc->texture) {
 		obs_enter_graphics();
@@ -466,8 +474,11 @@ static inline bool init_texture_mutexes(struct game_capture *gc)
 			gc->process_id);
 	gc->texture_mutexes[1] = get_mutex_plus_id(MUTEX_TEXTURE2,
 			gc->process_id);
+	gc->texture_mutexes[2] = get_mutex_plus_id(MUTEX_TEXTURE3,
+			gc->process_id);
 
-	if (!gc->texture_mutexes[0] || !gc->texture_mutexes[1]) {
+	if (!gc->texture_mutexes[0] || !gc->texture_mutexes[1] ||
+	    !gc->texture_mutexes[2]) {
 		warn("failed to create texture mutexes: %lu", GetLastError());
 		return false;
 	}
@@ -506,6 +517,7 @@ static inline void reset_frame_interval(struct game_capture *gc)
 	}
 
 	gc->global_hook_info->frame_interval = interval;
+	gc->global_hook_info->frame_base = os_gettime_ns();
 }
 
 static inline bool init_hook_info(struct game_capture *gc)
@@ -811,8 +823,22 @@ static void get_selected_window(struct game_capture *gc)
 	}
 }
 
+extern bool graphics_offsets_ready(bool *failed);
+
 static void try_hook(struct game_capture *gc)
 {
+	bool offsets_failed;
+
+	/* retried on the next interval until the offsets are known */
+	if (!graphics_offsets_ready(&offsets_failed)) {
+		if (offsets_failed) {
+			warn("error acquiring, the graphics offsets could "
+					"not be loaded");
+			gc->error_acquiring = true;
+		}
+		return;
+	}
+
 	if (gc->config.capture_any_fullscreen) {
 		get_fullscreen_window(gc);
 	} else {
@@ -1119,24 +1145,17 @@ static void copy_shmem_tex(struct game_capture *gc)
 	int cur_texture = gc->shmem_data->last_tex;
 	HANDLE mutex = NULL;
 	uint32_t pitch;
-	int next_texture;
 	uint8_t *data;
 
-	if (cur_texture < 0 || cur_texture > 1)
+	if (cur_texture < 0 || cur_texture >= NUM_SHMEM_TEXTURES)
 		return;
 
-	next_texture = cur_texture == 1 ? 0 : 1;
-
-	if (object_signalled(gc->texture_mutexes[cur_texture])) {
-		mutex = gc->texture_mutexes[cur_texture];
-
-	} else if (object_signalled(gc->texture_mutexes[next_texture])) {
-		mutex = gc->texture_mutexes[next_texture];
-		cur_texture = next_texture;
-
-	} else {
+	/* the hook never writes to the last texture it handed over, so this
+	 * only fails if a newer one was published in the meantime */
+	if (!object_signalled(gc->texture_mutexes[cur_texture]))
 		return;
-	}
+
+	mutex = gc->texture_mutexes[cur_texture];
 
 	if (gs_texture_map(gc->texture, &data, &pitch)) {
 		if (gc->convert_16bit) {
@@ -1177,6 +1196,8 @@ static inline bool init_shmem_capture(struct game_capture *gc)
 		(uint8_t*)gc->data + gc->shmem_data->tex1_offset;
 	gc->texture_buffers[1] =
 		(uint8_t*)gc->data + gc->shmem_data->tex2_offset;
+	gc->texture_buffers[2] =
+		(uint8_t*)gc->data + gc->shmem_data->tex3_offset;
 
 	gc->convert_16bit = is_16bit_format(gc->global_hook_info->format);
 	format = gc->convert_16bit ?
@@ -1197,6 +1218,11 @@ static inline bool init_shmem_capture(struct game_capture *gc)
 	return true;
 }
 
+static void copy_shtex_tex(struct game_capture *gc)
+{
+	gs_texture_update_shared(gc->texture);
+}
+
 static inline bool init_shtex_capture(struct game_capture *gc)
 {
 	obs_enter_graphics();
@@ -1209,6 +1235,8 @@ static inline bool init_shtex_capture(struct game_capture *gc)
 		return false;
 	}
 
+	gc->copy_texture = copy_shtex_tex;
+
 	return true;
 }
 
@@ -1346,6 +1374,9 @@ static inline void game_capture_render_cursor(struct game_capture *gc)
 static void game_capture_render(void *data, gs_effect_t *effect)
 {
 	struct game_capture *gc = data;
+
+	obs_source_set_opaque(gc->source,
+			gc->texture && !gc->config.allow_transparency);
 	if (!gc->texture)
 		return;
 
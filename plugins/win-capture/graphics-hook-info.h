@@ -17,6 +17,9 @@
 
 #define MUTEX_TEXTURE1        "CaptureHook_TextureMutex1"
 #define MUTEX_TEXTURE2        "CaptureHook_TextureMutex2"
+#define MUTEX_TEXTURE3        "CaptureHook_TextureMutex3"
+
+#define NUM_SHMEM_TEXTURES    3
 
 #define SHMEM_HOOK_INFO       "Local\\CaptureHook_HookInfo"
 #define SHMEM_TEXTURE         "Local\\CaptureHook_Texture"
@@ -58,6 +61,7 @@ struct shmem_data {
 	volatile int last_tex;
 	uint32_t tex1_offset;
 	uint32_t tex2_offset;
+	uint32_t tex3_offset;
 };
 
 struct shtex_data {
@@ -92,12 +96,17 @@ struct hook_info {
 
 	/* additional options */
 	uint64_t                       frame_interval;
+	uint64_t                       frame_base;
 	bool                           use_scale;
 	bool                           force_shmem;
 	bool                           capture_overlay;
 
 	/* hook addresses */
 	struct graphics_offsets        offsets;
+
+	/* shared memory capture statistics, written by the hook */
+	volatile uint32_t              dropped_frames;
+	volatile uint32_t              late_frames;
 };
 
 #pragma pack(pop)
@@ -724,10 +724,16 @@ static inline void d3d10_shmem_queue_copy()
 		HRESULT hr;
 
 		if (data.texture_ready[i]) {
-			data.texture_ready[i] = false;
-
+			/* don't stall the present on a copy that hasn't
+			 * finished yet, try again next frame */
 			hr = data.copy_surfaces[i]->Map(0, D3D10_MAP_READ,
-					0, &map);
+					D3D10_MAP_FLAG_DO_NOT_WAIT, &map);
+			if (hr == DXGI_ERROR_WAS_STILL_DRAWING) {
+				shmem_frame_late();
+				break;
+			}
+
+			data.texture_ready[i] = false;
 			if (SUCCEEDED(hr)) {
 				data.texture_mapped[i] = true;
 				shmem_copy_data(i, map.pData);
@@ -766,10 +766,17 @@ static inline void d3d11_shmem_queue_copy()
 		HRESULT hr;
 
 		if (data.texture_ready[i]) {
-			data.texture_ready[i] = false;
-
+			/* don't stall the present on a copy that hasn't
+			 * finished yet, try again next frame */
 			hr = data.context->Map(data.copy_surfaces[i], 0,
-					D3D11_MAP_READ, 0, &map);
+					D3D11_MAP_READ,
+					D3D11_MAP_FLAG_DO_NOT_WAIT, &map);
+			if (hr == DXGI_ERROR_WAS_STILL_DRAWING) {
+				shmem_frame_late();
+				break;
+			}
+
+			data.texture_ready[i] = false;
 			if (SUCCEEDED(hr)) {
 				data.texture_mapped[i] = true;
 				shmem_copy_data(i, map.pData);
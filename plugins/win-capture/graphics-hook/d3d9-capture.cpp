@@ -451,7 +451,11 @@ static bool d3d9_init_format_swapchain(uint32_t &cx, uint32_t &cy, HWND &window)
 	return true;
 }
 
-static void d3d9_init(IDirect3DDevice9 *device)
+#define INIT_SUCCESS         0
+#define INIT_FAILED         -1
+#define INIT_SHTEX_FAILED   -2
+
+static int d3d9_init(IDirect3DDevice9 *device, bool shmem_fallback)
 {
 	IDirect3DDevice9Ex *d3d9ex = nullptr;
 	bool success;
@@ -474,18 +478,27 @@ static void d3d9_init(IDirect3DDevice9 *device)
 
 	if (!d3d9_init_format_backbuffer(cx, cy, window)) {
 		if (!d3d9_init_format_swapchain(cx, cy, window)) {
-			return;
+			return INIT_FAILED;
 		}
 	}
 
-	if (global_hook_info->force_shmem || (!d3d9ex && data.patch == -1)) {
+	if (global_hook_info->force_shmem || shmem_fallback ||
+	    (!d3d9ex && data.patch == -1)) {
 		success = d3d9_shmem_init(cx, cy, window);
 	} else {
 		success = d3d9_shtex_init(cx, cy, window);
+		if (!success) {
+			d3d9_free();
+			return INIT_SHTEX_FAILED;
+		}
 	}
 
-	if (!success)
+	if (!success) {
 		d3d9_free();
+		return INIT_FAILED;
+	}
+
+	return INIT_SUCCESS;
 }
 
 static inline HRESULT get_backbuffer(IDirect3DDevice9 *device,
@@ -523,6 +536,8 @@ static inline void d3d9_shtex_capture(IDirect3DSurface9 *backbuffer)
 
 static inline void d3d9_shmem_capture_queue_copy()
 {
+	bool waiting = false;
+
 	for (int i = 0; i < NUM_BUFFERS; i++) {
 		IDirect3DSurface9 *target = data.copy_surfaces[i];
 		D3DLOCKED_RECT rect;
@@ -532,6 +547,7 @@ static inline void d3d9_shmem_capture_queue_copy()
 			continue;
 		}
 		if (data.queries[i]->GetData(0, 0, 0) != S_OK) {
+			waiting = true;
 			continue;
 		}
 
@@ -542,7 +558,11 @@ static inline void d3d9_shmem_capture_queue_copy()
 			data.texture_mapped[i] = true;
 			shmem_copy_data(i, rect.pBits);
 		}
-		break;
+		return;
+	}
+
+	if (waiting) {
+		shmem_frame_late();
 	}
 }
 
@@ -599,7 +619,13 @@ static void d3d9_capture(IDirect3DDevice9 *device,
 		d3d9_free();
 	}
 	if (capture_should_init()) {
-		d3d9_init(device);
+		/* a D3D9Ex device (or patched d3d9) that can't share its
+		 * texture should still be captured through shared memory */
+		if (d3d9_init(device, false) == INIT_SHTEX_FAILED) {
+			hlog("d3d9 shared texture capture failed, falling "
+			     "back to memory capture");
+			d3d9_init(device, true);
+		}
 	}
 	if (capture_ready()) {
 		if (data.using_shtex)
@@ -86,21 +86,7 @@ static void gl_free(void)
 	capture_free();
 
 	if (data.using_shtex) {
-		if (data.gl_dxobj)
-			jimglDXUnregisterObjectNV(data.gl_device,
-					data.gl_dxobj);
-		if (data.gl_device)
-			jimglDXCloseDeviceNV(data.gl_device);
-		if (data.texture)
-			glDeleteTextures(1, &data.texture);
-		if (data.d3d11_tex)
-			ID3D11Resource_Release(data.d3d11_tex);
-		if (data.d3d11_context)
-			ID3D11DeviceContext_Release(data.d3d11_context);
-		if (data.d3d11_device)
-			ID3D11Device_Release(data.d3d11_device);
-		if (data.dxgi_swap)
-			IDXGISwapChain_Release(data.dxgi_swap);
+		gl_shtex_free_interop();
 		if (data.hwnd)
 			DestroyWindow(data.hwnd);
 	} else {
@@ -261,13 +247,16 @@ static const D3D_FEATURE_LEVEL feature_levels[] =
 	D3D_FEATURE_LEVEL_9_3,
 };
 
-static inline bool gl_shtex_init_d3d11(void)
+static inline bool gl_shtex_init_d3d11(UINT adapter_idx, bool *last_adapter)
 {
 	D3D_FEATURE_LEVEL level_used;
 	IDXGIFactory1 *factory;
 	IDXGIAdapter *adapter;
 	HRESULT hr;
 
+	/* anything failing before there is an adapter ends the search */
+	*last_adapter = true;
+
 	HMODULE d3d11 = load_system_library("d3d11.dll");
 	if (!d3d11) {
 		hlog("gl_shtex_init_d3d11: failed to load D3D11.dll: %d",
@@ -315,14 +304,20 @@ static inline bool gl_shtex_init_d3d11(void)
 		return false;
 	}
 
-	hr = IDXGIFactory1_EnumAdapters1(factory, 0, (IDXGIAdapter1**)&adapter);
+	hr = IDXGIFactory1_EnumAdapters1(factory, adapter_idx,
+			(IDXGIAdapter1**)&adapter);
 	IDXGIFactory1_Release(factory);
 
+	if (hr == DXGI_ERROR_NOT_FOUND) {
+		return false;
+	}
 	if (FAILED(hr)) {
 		hlog_hr("gl_shtex_init_d3d11: failed to create adapter", hr);
 		return false;
 	}
 
+	*last_adapter = false;
+
 	hr = create(adapter, D3D_DRIVER_TYPE_UNKNOWN, NULL, 0, feature_levels,
 			sizeof(feature_levels) / sizeof(D3D_FEATURE_LEVEL),
 			D3D11_SDK_VERSION, &desc, &data.dxgi_swap,
@@ -406,6 +401,56 @@ static inline bool gl_shtex_init_gl_tex(void)
 	return true;
 }
 
+static void gl_shtex_free_interop(void)
+{
+	if (data.gl_dxobj)
+		jimglDXUnregisterObjectNV(data.gl_device, data.gl_dxobj);
+	if (data.gl_device)
+		jimglDXCloseDeviceNV(data.gl_device);
+	if (data.texture)
+		glDeleteTextures(1, &data.texture);
+	if (data.d3d11_tex)
+		ID3D11Resource_Release(data.d3d11_tex);
+	if (data.d3d11_context)
+		ID3D11DeviceContext_Release(data.d3d11_context);
+	if (data.d3d11_device)
+		ID3D11Device_Release(data.d3d11_device);
+	if (data.dxgi_swap)
+		IDXGISwapChain_Release(data.dxgi_swap);
+
+	data.gl_dxobj = NULL;
+	data.gl_device = NULL;
+	data.texture = 0;
+	data.d3d11_tex = NULL;
+	data.d3d11_context = NULL;
+	data.d3d11_device = NULL;
+	data.dxgi_swap = NULL;
+	data.handle = NULL;
+}
+
+/* the first adapter isn't necessarily the one the GL context renders on
+ * (hybrid GPU laptops for example), and the interop only works with the
+ * device of that adapter, so try each of them before giving up */
+static bool gl_shtex_init_interop(void)
+{
+	bool last_adapter = false;
+
+	for (UINT i = 0; !last_adapter; i++) {
+		if (gl_shtex_init_d3d11(i, &last_adapter) &&
+		    gl_shtex_init_d3d11_tex() &&
+		    gl_shtex_init_gl_tex()) {
+			if (i > 0)
+				hlog("gl_shtex_init_interop: using adapter "
+				     "%u", i);
+			return true;
+		}
+
+		gl_shtex_free_interop();
+	}
+
+	return false;
+}
+
 static inline bool gl_init_fbo(void)
 {
 	glGenFramebuffers(1, &data.fbo);
@@ -417,13 +462,7 @@ static bool gl_shtex_init(HWND window)
 	if (!gl_shtex_init_window()) {
 		return false;
 	}
-	if (!gl_shtex_init_d3d11()) {
-		return false;
-	}
-	if (!gl_shtex_init_d3d11_tex()) {
-		return false;
-	}
-	if (!gl_shtex_init_gl_tex()) {
+	if (!gl_shtex_init_interop()) {
 		return false;
 	}
 	if (!gl_init_fbo()) {
@@ -609,12 +648,12 @@ static void gl_shtex_capture(void)
 
 	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &last_fbo);
 	if (gl_error("gl_shtex_capture", "failed to get last fbo")) {
-		return;
+		goto unlock;
 	}
 
 	glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_tex);
 	if (gl_error("gl_shtex_capture", "failed to get last texture")) {
-		return;
+		goto unlock;
 	}
 
 	gl_copy_backbuffer(data.texture);
@@ -622,6 +661,7 @@ static void gl_shtex_capture(void)
 	glBindTexture(GL_TEXTURE_2D, last_tex);
 	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, last_fbo);
 
+unlock:
 	jimglDXUnlockObjectsNV(data.gl_device, 1, &data.gl_dxobj);
 
 	IDXGISwapChain_Present(data.dxgi_swap, 0, 0);
@@ -1,6 +1,7 @@
 #define _CRT_SECURE_NO_WARNINGS
 #include <windows.h>
 #include <psapi.h>
+#include <emmintrin.h>
 #include "graphics-hook.h"
 #include "../obfuscate.h"
 #include "../funchook.h"
@@ -17,11 +18,12 @@ struct thread_data {
 	CRITICAL_SECTION       mutexes[NUM_BUFFERS];
 	CRITICAL_SECTION       data_mutex;
 	void *volatile         cur_data;
-	uint8_t                *shmem_textures[2];
+	uint8_t                *shmem_textures[NUM_SHMEM_TEXTURES];
 	HANDLE                 copy_thread;
 	HANDLE                 copy_event;
 	HANDLE                 stop_event;
 	volatile int           cur_tex;
+	volatile bool          copy_pending;
 	unsigned int           pitch;
 	unsigned int           cy;
 	volatile bool          locked_textures[NUM_BUFFERS];
@@ -32,7 +34,7 @@ HANDLE                         signal_restart                  = NULL;
 HANDLE                         signal_stop                     = NULL;
 HANDLE                         signal_ready                    = NULL;
 HANDLE                         signal_exit                     = NULL;
-HANDLE                         tex_mutexes[2]                  = {NULL, NULL};
+HANDLE                         tex_mutexes[NUM_SHMEM_TEXTURES] = {NULL};
 static HANDLE                  filemap_hook_info               = NULL;
 
 static volatile bool           stop_loop                       = false;
@@ -133,6 +135,11 @@ static inline bool init_mutexes(void)
 		return false;
 	}
 
+	tex_mutexes[2] = init_mutex(MUTEX_TEXTURE3, pid);
+	if (!tex_mutexes[2]) {
+		return false;
+	}
+
 	return true;
 }
 
@@ -227,6 +234,7 @@ static void free_hook(void)
 		global_hook_info = NULL;
 	}
 
+	close_handle(&tex_mutexes[2]);
 	close_handle(&tex_mutexes[1]);
 	close_handle(&tex_mutexes[0]);
 	close_handle(&signal_exit);
@@ -424,14 +432,16 @@ uint64_t os_gettime_ns(void)
 	return (uint64_t)time_val;
 }
 
-static inline int try_lock_shmem_tex(int id)
+/* never write to the texture obs was handed last, it may be reading it.  of
+ * the other two, try the older one first */
+static inline int try_lock_shmem_tex(int last)
 {
-	int next = id == 0 ? 1 : 0;
+	for (int i = 1; i < NUM_SHMEM_TEXTURES; i++) {
+		int id = (last + i) % NUM_SHMEM_TEXTURES;
 
-	if (WaitForSingleObject(tex_mutexes[id], 0) == WAIT_OBJECT_0) {
-		return id;
-	} else if (WaitForSingleObject(tex_mutexes[next], 0) == WAIT_OBJECT_0) {
-		return next;
+		if (WaitForSingleObject(tex_mutexes[id], 0) == WAIT_OBJECT_0) {
+			return id;
+		}
 	}
 
 	return -1;
@@ -501,12 +511,55 @@ bool capture_init_shtex(struct shtex_data **data, HWND window,
 	return true;
 }
 
+/* the shared memory is only read back by obs, so stream the frame past the
+ * cache instead of evicting the game's working set with it */
+static void copy_frame_stream(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	size_t aligned = 0;
+
+	if (((uintptr_t)dst & 15) == 0) {
+		aligned = size & ~(size_t)63;
+
+		if (((uintptr_t)src & 15) == 0) {
+			for (size_t i = 0; i < aligned; i += 64) {
+				const __m128i *in = (const __m128i*)(src + i);
+				__m128i *out = (__m128i*)(dst + i);
+				__m128i a = _mm_load_si128(in);
+				__m128i b = _mm_load_si128(in + 1);
+				__m128i c = _mm_load_si128(in + 2);
+				__m128i d = _mm_load_si128(in + 3);
+				_mm_stream_si128(out, a);
+				_mm_stream_si128(out + 1, b);
+				_mm_stream_si128(out + 2, c);
+				_mm_stream_si128(out + 3, d);
+			}
+		} else {
+			for (size_t i = 0; i < aligned; i += 64) {
+				const __m128i *in = (const __m128i*)(src + i);
+				__m128i *out = (__m128i*)(dst + i);
+				__m128i a = _mm_loadu_si128(in);
+				__m128i b = _mm_loadu_si128(in + 1);
+				__m128i c = _mm_loadu_si128(in + 2);
+				__m128i d = _mm_loadu_si128(in + 3);
+				_mm_stream_si128(out, a);
+				_mm_stream_si128(out + 1, b);
+				_mm_stream_si128(out + 2, c);
+				_mm_stream_si128(out + 3, d);
+			}
+		}
+
+		_mm_sfence();
+	}
+
+	memcpy(dst + aligned, src + aligned, size - aligned);
+}
+
 static DWORD CALLBACK copy_thread(LPVOID unused)
 {
 	uint32_t pitch = thread_data.pitch;
 	uint32_t cy = thread_data.cy;
 	HANDLE events[2] = {NULL, NULL};
-	int shmem_id = 0;
+	int last_id = -1;
 
 	if (!duplicate_handle(&events[0], thread_data.copy_event)) {
 		hlog_hr("copy_thread: Failed to duplicate copy event: %d",
@@ -532,21 +585,25 @@ static DWORD CALLBACK copy_thread(LPVOID unused)
 		EnterCriticalSection(&thread_data.data_mutex);
 		copy_tex = thread_data.cur_tex;
 		cur_data = thread_data.cur_data;
+		thread_data.copy_pending = false;
 		LeaveCriticalSection(&thread_data.data_mutex);
 
 		if (copy_tex < NUM_BUFFERS && !!cur_data) {
 			EnterCriticalSection(&thread_data.mutexes[copy_tex]);
 
-			int lock_id = try_lock_shmem_tex(shmem_id);
+			int lock_id = try_lock_shmem_tex(last_id);
 			if (lock_id != -1) {
-				memcpy(thread_data.shmem_textures[lock_id],
-						cur_data, pitch * cy);
+				copy_frame_stream(
+					thread_data.shmem_textures[lock_id],
+					cur_data, (size_t)pitch * cy);
 
 				unlock_shmem_tex(lock_id);
 				((struct shmem_data*)shmem_info)->last_tex =
 					lock_id;
 
-				shmem_id = lock_id == 0 ? 1 : 0;
+				last_id = lock_id;
+			} else {
+				global_hook_info->dropped_frames++;
 			}
 
 			LeaveCriticalSection(&thread_data.mutexes[copy_tex]);
@@ -567,6 +624,10 @@ finish:
 void shmem_copy_data(size_t idx, void *volatile data)
 {
 	EnterCriticalSection(&thread_data.data_mutex);
+	/* the copy thread never got to the last frame */
+	if (thread_data.copy_pending)
+		global_hook_info->dropped_frames++;
+	thread_data.copy_pending = true;
 	thread_data.cur_tex = (int)idx;
 	thread_data.cur_data = data;
 	thread_data.locked_textures[idx] = true;
@@ -591,6 +652,11 @@ bool shmem_texture_data_lock(int idx)
 	return false;
 }
 
+void shmem_frame_late(void)
+{
+	global_hook_info->late_frames++;
+}
+
 void shmem_texture_data_unlock(int idx)
 {
 	EnterCriticalSection(&thread_data.data_mutex);
@@ -608,6 +674,7 @@ static inline bool init_shmem_thread(uint32_t pitch, uint32_t cy)
 	thread_data.cy = cy;
 	thread_data.shmem_textures[0] = (uint8_t*)data + data->tex1_offset;
 	thread_data.shmem_textures[1] = (uint8_t*)data + data->tex2_offset;
+	thread_data.shmem_textures[2] = (uint8_t*)data + data->tex3_offset;
 
 	thread_data.copy_event = CreateEvent(NULL, false, false, NULL);
 	if (!thread_data.copy_event) {
@@ -650,7 +717,8 @@ bool capture_init_shmem(struct shmem_data **data, HWND window,
 	uint32_t  tex_size       = cy * pitch;
 	uint32_t  aligned_header = ALIGN(sizeof(struct shmem_data), 32);
 	uint32_t  aligned_tex    = ALIGN(tex_size, 32);
-	uint32_t  total_size     = aligned_header + aligned_tex * 2;
+	uint32_t  total_size     = aligned_header +
+		aligned_tex * NUM_SHMEM_TEXTURES;
 	uintptr_t align_pos;
 
 	if (!init_shared_info(total_size)) {
@@ -669,6 +737,7 @@ bool capture_init_shmem(struct shmem_data **data, HWND window,
 	(*data)->last_tex = -1;
 	(*data)->tex1_offset = (uint32_t)align_pos;
 	(*data)->tex2_offset = (*data)->tex1_offset + aligned_tex;
+	(*data)->tex3_offset = (*data)->tex2_offset + aligned_tex;
 
 	global_hook_info->window = (uint32_t)(uintptr_t)window;
 	global_hook_info->type = CAPTURE_TYPE_MEMORY;
@@ -681,6 +750,8 @@ bool capture_init_shmem(struct shmem_data **data, HWND window,
 	global_hook_info->cy = cy;
 	global_hook_info->base_cx = base_cx;
 	global_hook_info->base_cy = base_cy;
+	global_hook_info->dropped_frames = 0;
+	global_hook_info->late_frames = 0;
 
 	if (!init_shmem_thread(pitch, cy)) {
 		return false;
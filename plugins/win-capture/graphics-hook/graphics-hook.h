@@ -33,6 +33,7 @@ static inline bool capture_should_init(void);
 extern void shmem_copy_data(size_t idx, void *volatile data);
 extern bool shmem_texture_data_lock(int idx);
 extern void shmem_texture_data_unlock(int idx);
+extern void shmem_frame_late(void);
 
 extern bool hook_ddraw(void);
 extern bool hook_d3d8(void);
@@ -140,24 +141,38 @@ static inline bool capture_active(void)
 	return active;
 }
 
+/* captures are lined up with obs' video clock (both are QPC based) so that
+ * a game presenting faster than obs renders is copied once per obs frame,
+ * at the same point within each frame */
 static inline bool frame_ready(uint64_t interval)
 {
-	static uint64_t last_time = 0;
-	uint64_t        elapsed;
-	uint64_t        t;
+	static uint64_t last_interval = 0;
+	static uint64_t last_slot = 0;
+	uint64_t        phase;
+	uint64_t        slot;
 
 	if (!interval) {
 		return true;
 	}
 
-	t = os_gettime_ns();
-	elapsed = t - last_time;
+	if (interval != last_interval) {
+		last_interval = interval;
+		last_slot = 0;
+	}
+
+	phase = (uint64_t)InterlockedCompareExchange64(
+			(volatile LONG64*)&global_hook_info->frame_base, 0, 0);
+	phase %= interval;
+
+	slot = (os_gettime_ns() + interval - phase) / interval;
 
-	if (elapsed < interval) {
+	/* the phase is resampled now and then, don't let that jitter cause
+	 * a second capture in the same frame */
+	if (slot <= last_slot) {
 		return false;
 	}
 
-	last_time = (elapsed > interval * 2) ? t : last_time + interval;
+	last_slot = slot;
 	return true;
 }
 
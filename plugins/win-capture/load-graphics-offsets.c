@@ -5,6 +5,7 @@
 #include <util/dstr.h>
 #include <util/config-file.h>
 #include <util/pipe.h>
+#include <util/threading.h>
 
 #include <windows.h>
 #include "graphics-hook-info.h"
@@ -57,17 +58,33 @@ static inline bool load_offsets_from_file(struct graphics_offsets *offsets,
 	return success;
 }
 
-static inline bool config_ver_mismatch(
-		config_t *ver_config,
-		const char *section,
-		struct win_version_info *ver)
+/* the offsets only change with the system's graphics libraries, so they are
+ * cached along with the version, size and write time of each library, and
+ * only recomputed when one of them changes */
+struct dll_info {
+	struct win_version_info ver;
+	uint64_t                size;
+	uint64_t                time;
+};
+
+static const wchar_t *graphics_dlls[] = {L"d3d8.dll", L"d3d9.dll",
+	L"dxgi.dll"};
+static const char *graphics_dll_sections[] = {"d3d8", "d3d9", "dxgi"};
+
+#define GRAPHICS_DLL_COUNT \
+	(sizeof(graphics_dlls) / sizeof(graphics_dlls[0]))
+
+static struct dll_info dll_infos[2][GRAPHICS_DLL_COUNT];
+
+static inline bool config_info_mismatch(config_t *ver_config,
+		const char *section, const struct dll_info *info)
 {
 	struct win_version_info config_ver;
 	bool mismatch = false;
 
 #define get_sub_ver(subver) \
 	config_ver.subver = (int)config_get_int(ver_config, section, #subver); \
-	mismatch |= config_ver.subver != ver->subver;
+	mismatch |= config_ver.subver != info->ver.subver;
 
 	get_sub_ver(major);
 	get_sub_ver(minor);
@@ -76,14 +93,16 @@ static inline bool config_ver_mismatch(
 
 #undef get_sub_ver
 
+	mismatch |= config_get_uint(ver_config, section, "size") != info->size;
+	mismatch |= config_get_uint(ver_config, section, "time") != info->time;
 	return mismatch;
 }
 
-static inline void write_config_ver(config_t *ver_config, const char *section,
-		struct win_version_info *ver)
+static inline void write_config_info(config_t *ver_config, const char *section,
+		const struct dll_info *info)
 {
 #define set_sub_ver(subver) \
-	config_set_int(ver_config, section, #subver, ver->subver);
+	config_set_int(ver_config, section, #subver, info->ver.subver);
 
 	set_sub_ver(major);
 	set_sub_ver(minor);
@@ -91,70 +110,124 @@ static inline void write_config_ver(config_t *ver_config, const char *section,
 	set_sub_ver(revis);
 
 #undef set_sub_ver
+
+	config_set_uint(ver_config, section, "size", info->size);
+	config_set_uint(ver_config, section, "time", info->time);
 }
 
-static bool get_32bit_system_dll_ver(const wchar_t *system_lib,
-		struct win_version_info *ver)
+static bool get_system_dll_info(bool is32bit, const wchar_t *system_lib,
+		struct dll_info *info)
 {
+	WIN32_FILE_ATTRIBUTE_DATA attr;
 	wchar_t path[MAX_PATH];
 	UINT ret;
 
 #ifdef _WIN64
-	ret = GetSystemWow64DirectoryW(path, MAX_PATH);
+	ret = is32bit ?
+		GetSystemWow64DirectoryW(path, MAX_PATH) :
+		GetSystemDirectoryW(path, MAX_PATH);
 #else
 	ret = GetSystemDirectoryW(path, MAX_PATH);
 #endif
 	if (!ret) {
-		blog(LOG_ERROR, "Failed to get windows 32bit system path: "
-		                "%lu", GetLastError());
+		blog(LOG_ERROR, "Failed to get windows %s system path: "
+		                "%lu", is32bit ? "32bit" : "64bit",
+		                GetLastError());
 		return false;
 	}
 
 	wcscat(path, L"\\");
 	wcscat(path, system_lib);
-	return get_dll_ver(path, ver);
+
+	if (!GetFileAttributesExW(path, GetFileExInfoStandard, &attr))
+		return false;
+
+	info->size = ((uint64_t)attr.nFileSizeHigh << 32) |
+		attr.nFileSizeLow;
+	info->time = ((uint64_t)attr.ftLastWriteTime.dwHighDateTime << 32) |
+		attr.ftLastWriteTime.dwLowDateTime;
+	return get_dll_ver(path, &info->ver);
+}
+
+static inline const char *dll_section(struct dstr *section, bool is32bit,
+		size_t idx)
+{
+	dstr_copy(section, graphics_dll_sections[idx]);
+	if (!is32bit)
+		dstr_cat(section, "_64");
+	return section->array;
 }
 
-bool cached_versions_match(void)
+static bool cached_versions_match(void)
 {
-	struct win_version_info d3d8_ver  = {0};
-	struct win_version_info d3d9_ver  = {0};
-	struct win_version_info dxgi_ver = {0};
+	struct dstr section = {0};
 	bool ver_mismatch = false;
 	config_t *config;
 	char *ver_file;
 	int ret;
 
-	ver_mismatch |= !get_32bit_system_dll_ver(L"d3d8.dll", &d3d8_ver);
-	ver_mismatch |= !get_32bit_system_dll_ver(L"d3d9.dll", &d3d9_ver);
-	ver_mismatch |= !get_32bit_system_dll_ver(L"dxgi.dll", &dxgi_ver);
+	for (int bits = 0; bits < 2; bits++) {
+		for (size_t i = 0; i < GRAPHICS_DLL_COUNT; i++) {
+			struct dll_info *info = &dll_infos[bits][i];
+			memset(info, 0, sizeof(*info));
+			ver_mismatch |= !get_system_dll_info(bits == 0,
+					graphics_dlls[i], info);
+		}
+	}
 
 	ver_file = obs_module_config_path("version.ini");
 	if (!ver_file)
 		return false;
 
 	ret = config_open(&config, ver_file, CONFIG_OPEN_ALWAYS);
-	if (ret != CONFIG_SUCCESS)
+	if (ret != CONFIG_SUCCESS) {
+		ver_mismatch = true;
 		goto failed;
+	}
 
-	ver_mismatch |= config_ver_mismatch(config, "d3d8", &d3d8_ver);
-	ver_mismatch |= config_ver_mismatch(config, "d3d9", &d3d9_ver);
-	ver_mismatch |= config_ver_mismatch(config, "dxgi", &dxgi_ver);
-
-	if (ver_mismatch) {
-		write_config_ver(config, "d3d8", &d3d8_ver);
-		write_config_ver(config, "d3d9", &d3d9_ver);
-		write_config_ver(config, "dxgi", &dxgi_ver);
-		config_save_safe(config, "tmp", NULL);
+	for (int bits = 0; bits < 2; bits++) {
+		for (size_t i = 0; i < GRAPHICS_DLL_COUNT; i++)
+			ver_mismatch |= config_info_mismatch(config,
+					dll_section(&section, bits == 0, i),
+					&dll_infos[bits][i]);
 	}
 
 failed:
+	dstr_free(&section);
 	bfree(ver_file);
 	config_close(config);
 	return !ver_mismatch;
 }
 
-bool load_graphics_offsets(bool is32bit)
+/* only written once the offsets were computed, so a failed attempt doesn't
+ * leave a cache behind that claims to be current */
+static void save_cached_versions(void)
+{
+	struct dstr section = {0};
+	config_t *config;
+	char *ver_file;
+
+	ver_file = obs_module_config_path("version.ini");
+	if (!ver_file)
+		return;
+
+	if (config_open(&config, ver_file, CONFIG_OPEN_ALWAYS) ==
+			CONFIG_SUCCESS) {
+		for (int bits = 0; bits < 2; bits++) {
+			for (size_t i = 0; i < GRAPHICS_DLL_COUNT; i++)
+				write_config_info(config,
+					dll_section(&section, bits == 0, i),
+					&dll_infos[bits][i]);
+		}
+
+		config_save_safe(config, "tmp", NULL);
+		config_close(config);
+	}
+
+	dstr_free(&section);
+	bfree(ver_file);
+}
+static bool load_graphics_offsets(bool is32bit)
 {
 	char *offset_exe_path = NULL;
 	struct dstr offset_exe = {0};
@@ -203,7 +276,7 @@ error:
 	return success;
 }
 
-bool load_cached_graphics_offsets(bool is32bit)
+static bool load_cached_graphics_offsets(bool is32bit)
 {
 	char *config_ini = NULL;
 	bool success;
@@ -211,9 +284,75 @@ bool load_cached_graphics_offsets(bool is32bit)
 	config_ini = obs_module_config_path(is32bit ? "32.ini" : "64.ini");
 	success = load_offsets_from_file(is32bit ? &offsets32 : &offsets64,
 			config_ini);
-	if (!success)
-		success = load_graphics_offsets(is32bit);
 
 	bfree(config_ini);
 	return success;
 }
+
+/* ------------------------------------------------------------------------- */
+
+enum offsets_state {
+	OFFSETS_PENDING,
+	OFFSETS_READY,
+	OFFSETS_FAILED
+};
+
+static volatile long offsets_state = OFFSETS_PENDING;
+static pthread_t offsets_thread;
+static bool offsets_thread_active = false;
+static bool offsets_is32bit = false;
+
+/* the helpers start processes and create graphics devices, which takes long
+ * enough that module load shouldn't wait for it */
+static void *offsets_thread_func(void *unused)
+{
+	bool success;
+
+	os_set_thread_name("win-capture: graphics offsets");
+
+	success = load_graphics_offsets(offsets_is32bit);
+	if (success) {
+		load_graphics_offsets(!offsets_is32bit);
+		save_cached_versions();
+	}
+
+	os_atomic_set_long(&offsets_state,
+			success ? OFFSETS_READY : OFFSETS_FAILED);
+
+	UNUSED_PARAMETER(unused);
+	return NULL;
+}
+
+void init_graphics_offsets(bool is32bit)
+{
+	offsets_is32bit = is32bit;
+
+	if (cached_versions_match() &&
+	    load_cached_graphics_offsets(is32bit) &&
+	    load_cached_graphics_offsets(!is32bit)) {
+		os_atomic_set_long(&offsets_state, OFFSETS_READY);
+		return;
+	}
+
+	if (pthread_create(&offsets_thread, NULL, offsets_thread_func,
+				NULL) == 0)
+		offsets_thread_active = true;
+	else
+		offsets_thread_func(NULL);
+}
+
+bool graphics_offsets_ready(bool *failed)
+{
+	long state = os_atomic_load_long(&offsets_state);
+
+	*failed = state == OFFSETS_FAILED;
+	return state == OFFSETS_READY;
+}
+
+void free_graphics_offsets(void)
+{
+	if (offsets_thread_active) {
+		pthread_join(offsets_thread, NULL);
+		offsets_thread_active = false;
+	}
+}
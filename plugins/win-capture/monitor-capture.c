@@ -147,7 +147,10 @@ static void monitor_capture_tick(void *data, float seconds)
 static void monitor_capture_render(void *data, gs_effect_t *effect)
 {
 	struct monitor_capture *capture = data;
-	dc_capture_render(&capture->data, obs_get_opaque_effect());
+	bool drawn = dc_capture_render(&capture->data,
+			obs_get_opaque_effect());
+
+	obs_source_set_opaque(capture->source, drawn);
 
 	UNUSED_PARAMETER(effect);
 }
@@ -11,9 +11,9 @@ extern struct obs_source_info monitor_capture_info;
 extern struct obs_source_info window_capture_info;
 extern struct obs_source_info game_capture_info;
 
-extern bool cached_versions_match(void);
-extern bool load_cached_graphics_offsets(bool is32bit);
-extern bool load_graphics_offsets(bool is32bit);
+extern void init_graphics_offsets(bool is32bit);
+extern void free_graphics_offsets(void);
+extern void cursor_cache_free(void);
 
 /* temporary, will eventually be erased once we figure out how to create both
  * 32bit and 64bit versions of the helpers/hook */
@@ -50,14 +50,16 @@ bool obs_module_load(void)
 
 	obs_register_source(&window_capture_info);
 
-	if (cached_versions_match() && load_cached_graphics_offsets(IS32BIT)) {
-		load_cached_graphics_offsets(!IS32BIT);
-		obs_register_source(&game_capture_info);
-
-	} else if (load_graphics_offsets(IS32BIT)) {
-		load_graphics_offsets(!IS32BIT);
-		obs_register_source(&game_capture_info);
-	}
+	/* the offsets may still be computed in the background when sources
+	 * are created; game capture waits for them before hooking */
+	init_graphics_offsets(IS32BIT);
+	obs_register_source(&game_capture_info);
 
 	return true;
 }
+
+void obs_module_unload(void)
+{
+	free_graphics_offsets();
+	cursor_cache_free();
+}
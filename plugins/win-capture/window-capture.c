@@ -1,6 +1,8 @@
 #include <stdlib.h>
 #include <util/dstr.h>
 #include "dc-capture.h"
+#include "dwm-capture.h"
+#include "cursor-capture.h"
 #include "window-helpers.h"
 
 #define TEXT_WINDOW_CAPTURE obs_module_text("WindowCapture")
@@ -11,6 +13,7 @@
 #define TEXT_MATCH_EXE      obs_module_text("WindowCapture.Priority.Exe")
 #define TEXT_CAPTURE_CURSOR obs_module_text("CaptureCursor")
 #define TEXT_COMPATIBILITY  obs_module_text("Compatibility")
+#define TEXT_DWM_CAPTURE    obs_module_text("WindowCapture.DWM")
 
 struct window_capture {
 	obs_source_t         *source;
@@ -22,8 +25,13 @@ struct window_capture {
 	bool                 cursor;
 	bool                 compatibility;
 	bool                 use_wildcards; /* TODO */
+	bool                 use_dwm;
 
 	struct dc_capture    capture;
+	struct dwm_capture   dwm;
+	struct cursor_data   cursor_data;
+	bool                 dwm_active;
+	bool                 dwm_failed;
 
 	float                resize_timer;
 
@@ -46,6 +54,7 @@ static void update_settings(struct window_capture *wc, obs_data_t *s)
 	wc->cursor        = obs_data_get_bool(s, "cursor");
 	wc->use_wildcards = obs_data_get_bool(s, "use_wildcards");
 	wc->compatibility = obs_data_get_bool(s, "compatibility");
+	wc->use_dwm       = obs_data_get_bool(s, "dwm_capture");
 }
 
 /* ------------------------------------------------------------------------- */
@@ -72,6 +81,8 @@ static void wc_destroy(void *data)
 	if (wc) {
 		obs_enter_graphics();
 		dc_capture_free(&wc->capture);
+		dwm_capture_free(&wc->dwm);
+		cursor_data_free(&wc->cursor_data);
 		obs_leave_graphics();
 
 		bfree(wc->title);
@@ -94,19 +105,20 @@ static void wc_update(void *data, obs_data_t *settings)
 static uint32_t wc_width(void *data)
 {
 	struct window_capture *wc = data;
-	return wc->capture.width;
+	return wc->dwm_active ? wc->dwm.width : wc->capture.width;
 }
 
 static uint32_t wc_height(void *data)
 {
 	struct window_capture *wc = data;
-	return wc->capture.height;
+	return wc->dwm_active ? wc->dwm.height : wc->capture.height;
 }
 
 static void wc_defaults(obs_data_t *defaults)
 {
 	obs_data_set_default_bool(defaults, "cursor", true);
 	obs_data_set_default_bool(defaults, "compatibility", false);
+	obs_data_set_default_bool(defaults, "dwm_capture", true);
 }
 
 static obs_properties_t *wc_properties(void *unused)
@@ -130,16 +142,55 @@ static obs_properties_t *wc_properties(void *unused)
 
 	obs_properties_add_bool(ppts, "compatibility", TEXT_COMPATIBILITY);
 
+	obs_properties_add_bool(ppts, "dwm_capture", TEXT_DWM_CAPTURE);
+
 	return ppts;
 }
 
 #define RESIZE_CHECK_TIME 0.2f
 
+/* the compositor's surface is used directly when possible.  if the window
+ * doesn't have one the source drops back to BitBlt until the window is
+ * found again or the capture is reset. */
+static inline void stop_dwm(struct window_capture *wc)
+{
+	dwm_capture_free(&wc->dwm);
+	wc->dwm_active = false;
+}
+
+static bool capture_dwm(struct window_capture *wc)
+{
+	if (!wc->use_dwm || wc->dwm_failed || !dwm_capture_available()) {
+		if (wc->dwm_active)
+			stop_dwm(wc);
+		return false;
+	}
+
+	if (!dwm_capture_capture(&wc->dwm, wc->window)) {
+		blog(LOG_INFO, "[window-capture: '%s'] could not use the "
+				"window's compositor surface, falling back to "
+				"BitBlt", obs_source_get_name(wc->source));
+		stop_dwm(wc);
+		wc->dwm_failed = true;
+		return false;
+	}
+
+	if (!wc->dwm_active) {
+		dc_capture_free(&wc->capture);
+		wc->dwm_active = true;
+	}
+
+	if (wc->cursor)
+		cursor_capture(&wc->cursor_data);
+	return true;
+}
+
 static void wc_tick(void *data, float seconds)
 {
 	struct window_capture *wc = data;
 	RECT rect;
 	bool reset_capture = false;
+	bool was_dwm;
 
 	if (!obs_source_showing(wc->source))
 		return;
@@ -178,6 +229,17 @@ static void wc_tick(void *data, float seconds)
 	if (reset_capture) {
 		wc->resize_timer = 0.0f;
 		wc->last_rect = rect;
+		wc->dwm_failed = false;
+	}
+
+	was_dwm = wc->dwm_active;
+
+	if (capture_dwm(wc)) {
+		obs_leave_graphics();
+		return;
+	}
+
+	if (reset_capture || was_dwm) {
 		dc_capture_free(&wc->capture);
 		dc_capture_init(&wc->capture, 0, 0, rect.right, rect.bottom,
 				wc->cursor, wc->compatibility);
@@ -187,10 +249,33 @@ static void wc_tick(void *data, float seconds)
 	obs_leave_graphics();
 }
 
+static void wc_render_cursor(struct window_capture *wc)
+{
+	gs_effect_t *effect = obs_get_default_effect();
+	POINT p = {0};
+
+	ClientToScreen(wc->window, &p);
+
+	while (gs_effect_loop(effect, "Draw"))
+		cursor_draw(&wc->cursor_data, -p.x, -p.y, 1.0f, 1.0f,
+				wc->dwm.width, wc->dwm.height);
+}
+
 static void wc_render(void *data, gs_effect_t *effect)
 {
 	struct window_capture *wc = data;
-	dc_capture_render(&wc->capture, obs_get_opaque_effect());
+	bool drawn;
+
+	if (wc->dwm_active) {
+		drawn = dwm_capture_render(&wc->dwm, obs_get_opaque_effect());
+		if (drawn && wc->cursor)
+			wc_render_cursor(wc);
+	} else {
+		drawn = dc_capture_render(&wc->capture,
+				obs_get_opaque_effect());
+	}
+
+	obs_source_set_opaque(wc->source, drawn);
 
 	UNUSED_PARAMETER(effect);
 }
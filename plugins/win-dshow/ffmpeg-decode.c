@@ -18,7 +18,91 @@
 #include "ffmpeg-decode.h"
 #include <obs-avc.h>
 
-int ffmpeg_decode_init(struct ffmpeg_decode *decode, enum AVCodecID id)
+#ifdef ENABLE_HW_DECODE
+#include <libavutil/pixdesc.h>
+#endif
+
+#ifdef ENABLE_HW_DECODE
+static const enum AVHWDeviceType hw_priority[] = {
+#ifdef _WIN32
+	AV_HWDEVICE_TYPE_D3D11VA,
+	AV_HWDEVICE_TYPE_DXVA2,
+	AV_HWDEVICE_TYPE_QSV,
+#else
+	AV_HWDEVICE_TYPE_VAAPI,
+#endif
+	AV_HWDEVICE_TYPE_NONE
+};
+
+static bool has_hw_type(const AVCodec *codec, enum AVHWDeviceType type,
+		enum AVPixelFormat *hw_format)
+{
+	for (int i = 0;; i++) {
+		const AVCodecHWConfig *config = avcodec_get_hw_config(codec, i);
+		if (!config)
+			break;
+
+		if (config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX &&
+		    config->device_type == type) {
+			*hw_format = config->pix_fmt;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static enum AVPixelFormat get_hw_format(AVCodecContext *ctx,
+		const enum AVPixelFormat *formats)
+{
+	struct ffmpeg_decode *decode = ctx->opaque;
+	const enum AVPixelFormat *f;
+
+	for (f = formats; *f != AV_PIX_FMT_NONE; f++)
+		if (*f == decode->hw_format)
+			return *f;
+
+	/* the stream can't be decoded by the hardware, fall back to the first
+	 * software format */
+	for (f = formats; *f != AV_PIX_FMT_NONE; f++) {
+		const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(*f);
+		if (desc && (desc->flags & AV_PIX_FMT_FLAG_HWACCEL) == 0)
+			return *f;
+	}
+
+	return AV_PIX_FMT_NONE;
+}
+
+static void init_hw_decoder(struct ffmpeg_decode *decode)
+{
+	const enum AVHWDeviceType *type = hw_priority;
+
+	for (; *type != AV_HWDEVICE_TYPE_NONE; type++) {
+		enum AVPixelFormat hw_format;
+		AVBufferRef *hw_ctx = NULL;
+
+		if (!has_hw_type(decode->codec, *type, &hw_format))
+			continue;
+
+		if (av_hwdevice_ctx_create(&hw_ctx, *type, NULL, NULL, 0) < 0)
+			continue;
+
+		decode->hw_device_ctx = hw_ctx;
+		decode->hw_format = hw_format;
+		decode->decoder->hw_device_ctx = av_buffer_ref(hw_ctx);
+		decode->decoder->opaque = decode;
+		decode->decoder->get_format = get_hw_format;
+
+		blog(LOG_INFO, "Using %s hardware decoding for %s",
+				av_hwdevice_get_type_name(*type),
+				decode->codec->name);
+		return;
+	}
+}
+#endif
+
+int ffmpeg_decode_init(struct ffmpeg_decode *decode, enum AVCodecID id,
+		bool use_hw)
 {
 	int ret;
 
@@ -31,6 +115,19 @@ int ffmpeg_decode_init(struct ffmpeg_decode *decode, enum AVCodecID id)
 
 	decode->decoder = avcodec_alloc_context3(decode->codec);
 
+	/* frame threading adds a frame of latency per thread, which is only
+	 * worth it for intra-only streams that are expensive to decode */
+	decode->decoder->thread_count = 0;
+	decode->decoder->thread_type = (id == AV_CODEC_ID_MJPEG) ?
+		FF_THREAD_FRAME | FF_THREAD_SLICE : FF_THREAD_SLICE;
+
+#ifdef ENABLE_HW_DECODE
+	if (use_hw)
+		init_hw_decoder(decode);
+#else
+	UNUSED_PARAMETER(use_hw);
+#endif
+
 	ret = avcodec_open2(decode->decoder, decode->codec, NULL);
 	if (ret < 0) {
 		ffmpeg_decode_free(decode);
@@ -51,7 +148,17 @@ void ffmpeg_decode_free(struct ffmpeg_decode *decode)
 	}
 
 	if (decode->frame)
-		av_free(decode->frame);
+		av_frame_free(&decode->frame);
+
+#ifdef ENABLE_HW_DECODE
+	if (decode->sw_frame)
+		av_frame_free(&decode->sw_frame);
+	if (decode->hw_device_ctx)
+		av_buffer_unref(&decode->hw_device_ctx);
+#endif
+
+	if (decode->packed_buffer)
+		bfree(decode->packed_buffer);
 
 	if (decode->packet_buffer)
 		bfree(decode->packet_buffer);
@@ -64,6 +171,7 @@ static inline enum video_format convert_pixel_format(int f)
 	switch (f) {
 	case AV_PIX_FMT_NONE:    return VIDEO_FORMAT_NONE;
 	case AV_PIX_FMT_YUV420P: return VIDEO_FORMAT_I420;
+	case AV_PIX_FMT_YUVJ420P: return VIDEO_FORMAT_I420;
 	case AV_PIX_FMT_NV12:    return VIDEO_FORMAT_NV12;
 	case AV_PIX_FMT_YUYV422: return VIDEO_FORMAT_YUY2;
 	case AV_PIX_FMT_UYVY422: return VIDEO_FORMAT_UYVY;
@@ -101,6 +209,7 @@ static inline void copy_data(struct ffmpeg_decode *decode, uint8_t *data,
 	if (decode->packet_size < new_size) {
 		decode->packet_buffer = brealloc(decode->packet_buffer,
 				new_size);
+		decode->packet_size = new_size;
 	}
 
 	memset(decode->packet_buffer + size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
@@ -152,6 +261,42 @@ int ffmpeg_decode_audio(struct ffmpeg_decode *decode,
 	return len;
 }
 
+/* libobs has no planar 4:2:2 format, so interleave it into YUY2, which is
+ * cheap compared to decoding it */
+static void pack_yuv422(struct ffmpeg_decode *decode, const AVFrame *in,
+		struct obs_source_frame *frame)
+{
+	uint32_t linesize = (uint32_t)in->width * 2;
+	size_t size = (size_t)linesize * in->height;
+	uint8_t *dst;
+
+	if (decode->packed_size < size) {
+		decode->packed_buffer = brealloc(decode->packed_buffer, size);
+		decode->packed_size = size;
+	}
+
+	dst = decode->packed_buffer;
+
+	for (int y = 0; y < in->height; y++) {
+		const uint8_t *lum = in->data[0] + y * in->linesize[0];
+		const uint8_t *u   = in->data[1] + y * in->linesize[1];
+		const uint8_t *v   = in->data[2] + y * in->linesize[2];
+		uint8_t *out = dst + y * linesize;
+
+		for (int x = 0; x < in->width / 2; x++) {
+			*(out++) = lum[x * 2];
+			*(out++) = u[x];
+			*(out++) = lum[x * 2 + 1];
+			*(out++) = v[x];
+		}
+	}
+
+	memset(frame->data, 0, sizeof(frame->data));
+	memset(frame->linesize, 0, sizeof(frame->linesize));
+	frame->data[0]     = dst;
+	frame->linesize[0] = linesize;
+}
+
 int ffmpeg_decode_video(struct ffmpeg_decode *decode,
 		uint8_t *data, size_t size, long long *ts,
 		struct obs_source_frame *frame,
@@ -160,6 +305,8 @@ int ffmpeg_decode_video(struct ffmpeg_decode *decode,
 	AVPacket packet = {0};
 	int got_frame = false;
 	enum video_format new_format;
+	AVFrame *out;
+	bool full_range;
 	int len;
 
 	*got_output = false;
@@ -187,19 +334,50 @@ int ffmpeg_decode_video(struct ffmpeg_decode *decode,
 	if (len <= 0 || !got_frame)
 		return len;
 
-	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
-		frame->data[i]     = decode->frame->data[i];
-		frame->linesize[i] = decode->frame->linesize[i];
+	out = decode->frame;
+
+#ifdef ENABLE_HW_DECODE
+	/* hardware frames come back as NV12, which is uploaded as is */
+	if (decode->hw_device_ctx && out->format == decode->hw_format) {
+		if (!decode->sw_frame) {
+			decode->sw_frame = av_frame_alloc();
+			if (!decode->sw_frame)
+				return -1;
+		}
+
+		av_frame_unref(decode->sw_frame);
+		if (av_hwframe_transfer_data(decode->sw_frame, out, 0) < 0)
+			return -1;
+
+		decode->sw_frame->pts     = out->pts;
+		decode->sw_frame->pkt_pts = out->pkt_pts;
+		decode->sw_frame->color_range = out->color_range;
+		out = decode->sw_frame;
 	}
+#endif
+
+	if (out->format == AV_PIX_FMT_YUVJ422P ||
+	    out->format == AV_PIX_FMT_YUV422P) {
+		pack_yuv422(decode, out, frame);
+		new_format = VIDEO_FORMAT_YUY2;
+	} else {
+		for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+			frame->data[i]     = out->data[i];
+			frame->linesize[i] = out->linesize[i];
+		}
+		new_format = convert_pixel_format(out->format);
+	}
+
+	full_range = out->color_range == AVCOL_RANGE_JPEG ||
+	             out->format == AV_PIX_FMT_YUVJ420P ||
+	             out->format == AV_PIX_FMT_YUVJ422P;
 
-	new_format = convert_pixel_format(decode->frame->format);
-	if (new_format != frame->format) {
+	if (new_format != frame->format || full_range != frame->full_range) {
 		bool success;
 		enum video_range_type range;
 
 		frame->format = new_format;
-		frame->full_range =
-			decode->frame->color_range == AVCOL_RANGE_JPEG;
+		frame->full_range = full_range;
 
 		range = frame->full_range ?
 			VIDEO_RANGE_FULL : VIDEO_RANGE_PARTIAL;
@@ -215,10 +393,10 @@ int ffmpeg_decode_video(struct ffmpeg_decode *decode,
 		}
 	}
 
-	*ts = decode->frame->pkt_pts;
+	*ts = out->pkt_pts;
 
-	frame->width  = decode->frame->width;
-	frame->height = decode->frame->height;
+	frame->width  = out->width;
+	frame->height = out->height;
 	frame->flip   = false;
 
 	if (frame->format == VIDEO_FORMAT_NONE)
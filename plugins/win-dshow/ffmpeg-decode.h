@@ -32,6 +32,12 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavutil/log.h>
 
+/* the hardware decode configuration API was added in FFmpeg 4.0 */
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(58, 18, 100)
+#include <libavutil/hwcontext.h>
+#define ENABLE_HW_DECODE 1
+#endif
+
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
@@ -42,11 +48,21 @@ struct ffmpeg_decode {
 
 	AVFrame        *frame;
 
+#ifdef ENABLE_HW_DECODE
+	AVBufferRef    *hw_device_ctx;
+	enum AVPixelFormat hw_format;
+	AVFrame        *sw_frame;
+#endif
+
+	uint8_t        *packed_buffer;
+	size_t         packed_size;
+
 	uint8_t        *packet_buffer;
 	size_t         packet_size;
 };
 
-extern int ffmpeg_decode_init(struct ffmpeg_decode *decode, enum AVCodecID id);
+extern int ffmpeg_decode_init(struct ffmpeg_decode *decode, enum AVCodecID id,
+		bool use_hw);
 extern void ffmpeg_decode_free(struct ffmpeg_decode *decode);
 
 extern int ffmpeg_decode_audio(struct ffmpeg_decode *decode,
@@ -43,6 +43,7 @@ using namespace DShow;
 #define AUDIO_DEVICE_ID   "audio_device_id"
 #define COLOR_SPACE       "color_space"
 #define COLOR_RANGE       "color_range"
+#define HW_DECODE         "hw_decode"
 
 #define TEXT_INPUT_NAME     obs_module_text("VideoCaptureDevice")
 #define TEXT_DEVICE         obs_module_text("Device")
@@ -74,6 +75,7 @@ using namespace DShow;
 #define TEXT_COLOR_RANGE    obs_module_text("ColorRange")
 #define TEXT_RANGE_PARTIAL  obs_module_text("ColorRange.Partial")
 #define TEXT_RANGE_FULL     obs_module_text("ColorRange.Full")
+#define TEXT_HW_DECODE      obs_module_text("HardwareDecode")
 
 enum ResType {
 	ResType_Preferred,
@@ -163,6 +165,8 @@ struct DShowInput {
 	bool         deviceHasAudio = false;
 	bool         flip = false;
 	bool         active = false;
+	bool         hwDecode = false;
+	bool         videoDecoderHw = false;
 
 	Decoder      audio_decoder;
 	Decoder      video_decoder;
@@ -398,11 +402,20 @@ static inline audio_format ConvertAudioFormat(AudioFormat format)
 void DShowInput::OnEncodedVideoData(enum AVCodecID id,
 		unsigned char *data, size_t size, long long ts)
 {
+	/* the device or the settings may have changed since the decoder was
+	 * created */
+	if (ffmpeg_decode_valid(video_decoder)) {
+		ffmpeg_decode *decode = video_decoder;
+		if (decode->codec->id != id || videoDecoderHw != hwDecode)
+			ffmpeg_decode_free(video_decoder);
+	}
+
 	if (!ffmpeg_decode_valid(video_decoder)) {
-		if (ffmpeg_decode_init(video_decoder, id) < 0) {
+		if (ffmpeg_decode_init(video_decoder, id, hwDecode) < 0) {
 			blog(LOG_WARNING, "Could not initialize video decoder");
 			return;
 		}
+		videoDecoderHw = hwDecode;
 	}
 
 	bool got_output;
@@ -433,6 +446,11 @@ void DShowInput::OnVideoData(const VideoConfig &config,
 		return;
 	}
 
+	if (videoConfig.format == VideoFormat::MJPEG) {
+		OnEncodedVideoData(AV_CODEC_ID_MJPEG, data, size, startTime);
+		return;
+	}
+
 	const int cx = config.cx;
 	const int cy = config.cy;
 
@@ -496,7 +514,7 @@ void DShowInput::OnEncodedAudioData(enum AVCodecID id,
 		unsigned char *data, size_t size, long long ts)
 {
 	if (!ffmpeg_decode_valid(audio_decoder)) {
-		if (ffmpeg_decode_init(audio_decoder, id) < 0) {
+		if (ffmpeg_decode_init(audio_decoder, id, false) < 0) {
 			blog(LOG_WARNING, "Could not initialize audio decoder");
 			return;
 		}
@@ -744,6 +762,7 @@ bool DShowInput::UpdateVideoConfig(obs_data_t *settings)
 {
 	string video_device_id = obs_data_get_string(settings, VIDEO_DEVICE_ID);
 	flip = obs_data_get_bool(settings, FLIP_IMAGE);
+	hwDecode = obs_data_get_bool(settings, HW_DECODE);
 
 	DeviceId id;
 	if (!DecodeDeviceId(id, video_device_id.c_str()))
@@ -804,13 +823,14 @@ bool DShowInput::UpdateVideoConfig(obs_data_t *settings)
 			placeholders::_3, placeholders::_4,
 			placeholders::_5);
 
-	if (videoConfig.internalFormat != VideoFormat::MJPEG)
-		videoConfig.format = videoConfig.internalFormat;
+	/* MJPEG is decoded with FFmpeg, which can use the GPU and multiple
+	 * threads, rather than with the system's MJPEG decompressor */
+	videoConfig.format = videoConfig.internalFormat;
 
-	if (!device.SetVideoConfig(&videoConfig))
-		return false;
+	if (!device.SetVideoConfig(&videoConfig)) {
+		if (videoConfig.internalFormat != VideoFormat::MJPEG)
+			return false;
 
-	if (videoConfig.internalFormat == VideoFormat::MJPEG) {
 		videoConfig.format = VideoFormat::XRGB;
 		if (!device.SetVideoConfig(&videoConfig))
 			return false;
@@ -1024,6 +1044,7 @@ static void GetDShowDefaults(obs_data_t *settings)
 	obs_data_set_default_bool(settings, "active", true);
 	obs_data_set_default_string(settings, COLOR_SPACE, "default");
 	obs_data_set_default_string(settings, COLOR_RANGE, "partial");
+	obs_data_set_default_bool(settings, HW_DECODE, true);
 	obs_data_set_default_int(settings, AUDIO_OUTPUT_MODE,
 			(int)AudioMode::Capture);
 }
@@ -1762,6 +1783,7 @@ static obs_properties_t *GetDShowProperties(void *obj)
 			(int64_t)BufferingType::Off);
 
 	obs_properties_add_bool(ppts, FLIP_IMAGE, TEXT_FLIP_IMAGE);
+	obs_properties_add_bool(ppts, HW_DECODE, TEXT_HW_DECODE);
 
 	/* ------------------------------------- */
 	/* audio settings */
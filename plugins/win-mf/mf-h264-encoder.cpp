@@ -1,5 +1,6 @@
 #include <obs-module.h>
 #include <util/profiler.hpp>
+#include <util/threading.h>
 
 #include "mf-common.hpp"
 #include "mf-h264-encoder.hpp"
@@ -9,6 +10,13 @@
 
 using namespace MF;
 
+// Input samples the encode callback may queue ahead of an asynchronous
+// transform before it waits for the transform to take one
+#define MAX_QUEUED_INPUT_SAMPLES 4
+
+// How long to wait for an asynchronous transform to drain when stopping
+#define DRAIN_TIMEOUT_MS 1000
+
 static eAVEncH264VProfile MapProfile(H264Profile profile)
 {
 	switch (profile) {
@@ -71,26 +79,7 @@ H264Encoder::H264Encoder(const obs_encoder_t *encoder,
 
 H264Encoder::~H264Encoder()
 {
-	HRESULT hr;
-
-	if (!descriptor->Async() || !eventGenerator || !pendingRequests)
-		return;
-
-	// Make sure all events have finished before releasing, and drain
-	// all output requests until it makes an input request.
-	// If you do not do this, you risk it releasing while there's still
-	// encoder activity, which can cause a crash with certain interfaces.
-	while (inputRequests == 0) {
-		hr = ProcessOutput();
-		if (hr != MF_E_TRANSFORM_NEED_MORE_INPUT && FAILED(hr)) {
-			MF_LOG_COM(LOG_ERROR, "H264Encoder::~H264Encoder: "
-					"ProcessOutput()", hr);
-			break;
-		}
-
-		if (inputRequests == 0)
-			Sleep(1);
-	}
+	StopEventThread();
 }
 
 HRESULT H264Encoder::CreateMediaTypes(ComPtr<IMFMediaType> &i,
@@ -127,39 +116,46 @@ fail:
 	return hr;
 }
 
-HRESULT H264Encoder::DrainEvents()
-{
-	HRESULT hr;
-	while ((hr = DrainEvent(false)) == S_OK);
-	if (hr == MF_E_NO_EVENTS_AVAILABLE)
-		hr = S_OK;
-	return hr;
-}
-
-HRESULT H264Encoder::DrainEvent(bool block)
+HRESULT H264Encoder::HandleEvent()
 {
 	HRESULT hr, eventStatus;
 	ComPtr<IMFMediaEvent> event;
 	MediaEventType type;
 
-	hr = eventGenerator->GetEvent(
-		block ? 0 : MF_EVENT_FLAG_NO_WAIT, &event);
-
-	if (hr != MF_E_NO_EVENTS_AVAILABLE && FAILED(hr))
+	hr = eventGenerator->GetEvent(0, &event);
+	if (hr == MF_E_SHUTDOWN)
+		return S_FALSE;
+	if (FAILED(hr))
 		goto fail;
-	if (hr == MF_E_NO_EVENTS_AVAILABLE)
-		return hr;
 
 	HRC(event->GetType(&type));
 	HRC(event->GetStatus(&eventStatus));
 
-	if (SUCCEEDED(eventStatus)) {
-		if (type == METransformNeedInput) {
+	if (FAILED(eventStatus)) {
+		MF_LOG_COM(LOG_ERROR, "Transform event", eventStatus);
+		return eventStatus;
+	}
+
+	if (type == METransformNeedInput) {
+		std::lock_guard<std::mutex> lock(queueMutex);
+
+		if (inputSamples.empty()) {
 			inputRequests++;
+			return S_OK;
 		}
-		else if (type == METransformHaveOutput) {
-			outputRequests++;
-		}
+
+		ComPtr<IMFSample> sample = inputSamples.front();
+		inputSamples.pop();
+		inputTaken.notify_one();
+
+		std::lock_guard<std::mutex> transformLock(transformMutex);
+		return transform->ProcessInput(0, sample, 0);
+
+	} else if (type == METransformHaveOutput) {
+		return ProcessOutput();
+
+	} else if (type == METransformDrainComplete) {
+		return S_FALSE;
 	}
 
 	return S_OK;
@@ -168,6 +164,65 @@ fail:
 	return hr;
 }
 
+void H264Encoder::EventThread()
+{
+	HRESULT hr;
+
+	os_set_thread_name("mf-h264: event thread");
+
+	while ((hr = HandleEvent()) == S_OK);
+
+	if (FAILED(hr)) {
+		MF_LOG_COM(LOG_ERROR, "H264Encoder::EventThread", hr);
+		asyncFailed = true;
+	}
+
+	std::lock_guard<std::mutex> lock(queueMutex);
+	eventThreadDone = true;
+	inputTaken.notify_all();
+	eventThreadExited.notify_all();
+}
+
+void H264Encoder::StopEventThread()
+{
+	ComPtr<IMFShutdown> shutdown;
+	bool drained;
+
+	if (!eventThread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		stopping = true;
+		inputTaken.notify_all();
+	}
+
+	// Let the transform finish everything it still has in flight
+	// before releasing it, some interfaces crash if it is released
+	// while there is still encoder activity.
+	{
+		std::lock_guard<std::mutex> lock(transformMutex);
+		transform->ProcessMessage(MFT_MESSAGE_NOTIFY_END_OF_STREAM, 0);
+		transform->ProcessMessage(MFT_MESSAGE_COMMAND_DRAIN, 0);
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(queueMutex);
+		drained = eventThreadExited.wait_for(lock,
+				std::chrono::milliseconds(DRAIN_TIMEOUT_MS),
+				[this] () { return eventThreadDone; });
+	}
+
+	if (!drained) {
+		MF_LOG(LOG_WARNING, "Transform did not finish draining, "
+				"shutting it down");
+		if (SUCCEEDED(transform->QueryInterface(&shutdown)))
+			shutdown->Shutdown();
+	}
+
+	eventThread.join();
+}
+
 HRESULT H264Encoder::InitializeEventGenerator()
 {
 	HRESULT hr;
@@ -465,6 +520,9 @@ bool H264Encoder::Initialize(std::function<bool(void)> func)
 			       (MFT_OUTPUT_STREAM_PROVIDES_SAMPLES |
 			        MFT_OUTPUT_STREAM_CAN_PROVIDE_SAMPLES));
 
+	if (descriptor->Async())
+		eventThread = std::thread(&H264Encoder::EventThread, this);
+
 	return true;
 
 fail:
@@ -529,29 +587,32 @@ HRESULT H264Encoder::ProcessInput(ComPtr<IMFSample> &sample)
 {
 	ProfileScope("H264Encoder::ProcessInput(sample)");
 
-	HRESULT hr = S_OK;
-	if (descriptor->Async()) {
-		if (inputRequests == 1 && inputSamples.empty()) {
-			inputRequests--;
-			return transform->ProcessInput(0, sample, 0);
-		}
+	if (!descriptor->Async())
+		return transform->ProcessInput(0, sample, 0);
 
-		inputSamples.push(sample);
+	std::unique_lock<std::mutex> lock(queueMutex);
 
-		while (inputRequests > 0) {
-			if (inputSamples.empty())
-				return hr;
-			ComPtr<IMFSample> queuedSample = inputSamples.front();
-			inputSamples.pop();
-			inputRequests--;
-			HRC(transform->ProcessInput(0, queuedSample, 0));
-		}
-	} else {
+	if (inputRequests > 0 && inputSamples.empty()) {
+		inputRequests--;
+
+		std::lock_guard<std::mutex> transformLock(transformMutex);
 		return transform->ProcessInput(0, sample, 0);
 	}
 
-fail:
-	return hr;
+	// Only wait when the transform has fallen behind by several
+	// frames, otherwise the event thread submits the sample as soon
+	// as the transform asks for one.
+	inputTaken.wait(lock, [this] ()
+	{
+		return inputSamples.size() < MAX_QUEUED_INPUT_SAMPLES ||
+			eventThreadDone || stopping;
+	});
+
+	if (eventThreadDone)
+		return E_FAIL;
+
+	inputSamples.push(sample);
+	return S_OK;
 }
 
 bool H264Encoder::ProcessInput(UINT8 **data, UINT32 *linesize, UINT64 pts,
@@ -590,40 +651,8 @@ bool H264Encoder::ProcessInput(UINT8 **data, UINT32 *linesize, UINT64 pts,
 	HRC(sample->SetSampleTime(pts * sampleDur));
 	HRC(sample->SetSampleDuration(sampleDur));
 
-	if (descriptor->Async()) {
-		HRC(DrainEvents());
-
-		while (outputRequests > 0 && (hr = ProcessOutput()) == S_OK);
-
-		if (hr != MF_E_TRANSFORM_NEED_MORE_INPUT && FAILED(hr)) {
-			MF_LOG_COM(LOG_ERROR, "ProcessOutput()", hr);
-			goto fail;
-		}
-
-
-		while (inputRequests == 0) {
-			hr = DrainEvent(false);
-			if (hr == MF_E_NO_EVENTS_AVAILABLE) {
-				Sleep(1);
-				continue;
-			}
-			if (FAILED(hr)) {
-				MF_LOG_COM(LOG_ERROR, "DrainEvent()", hr);
-				goto fail;
-			}
-			if (outputRequests > 0) {
-				hr = ProcessOutput();
-				if (hr != MF_E_TRANSFORM_NEED_MORE_INPUT &&
-				    FAILED(hr))
-					goto fail;
-			}
-		}
-	}
-
 	HRC(ProcessInput(sample));
 
-	pendingRequests++;
-
 	*status = SUCCESS;
 	return true;
 
@@ -649,15 +678,7 @@ HRESULT H264Encoder::ProcessOutput()
 	std::unique_ptr<std::vector<BYTE>> data(new std::vector<BYTE>());
 	ComPtr<IMFMediaType> type;
 	std::unique_ptr<H264Frame> frame;
-
-	if (descriptor->Async()) {
-		HRC(DrainEvents());
-
-		if (outputRequests == 0)
-			return S_OK;
-
-		outputRequests--;
-	}
+	std::unique_lock<std::mutex> transformLock(transformMutex);
 
 	if (createOutputSample) {
 		HRC(transform->GetOutputStreamInfo(0, &outputInfo));
@@ -680,12 +701,13 @@ HRESULT H264Encoder::ProcessOutput()
 			HRC(transform->SetOutputType(0, type, 0));
 			MF_LOG(LOG_INFO, "Updating output type to transform");
 			LogMediaType(type);
-			if (descriptor->Async() && outputRequests > 0) {
-				outputRequests--;
-				continue;
-			} else {
-				return MF_E_TRANSFORM_NEED_MORE_INPUT;
-			}
+
+			// The output itself comes with the next
+			// METransformHaveOutput event
+			if (descriptor->Async())
+				return S_OK;
+
+			return MF_E_TRANSFORM_NEED_MORE_INPUT;
 		}
 
 		if (hr != S_OK) {
@@ -730,7 +752,13 @@ HRESULT H264Encoder::ProcessOutput()
 			sampleDts / sampleDur,
 			std::move(data)));
 
-	encodedFrames.push(std::move(frame));
+	// Released first, input is submitted with queueMutex held
+	transformLock.unlock();
+
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		encodedFrames.push(std::move(frame));
+	}
 
 	return S_OK;
 
@@ -743,9 +771,18 @@ bool H264Encoder::ProcessOutput(UINT8 **data, UINT32 *dataLength,
 {
 	ProfileScope("H264Encoder::ProcessOutput");
 
-	HRESULT hr;
+	HRESULT hr = S_OK;
+
+	if (descriptor->Async()) {
+		if (asyncFailed) {
+			*status = FAILURE;
+			return false;
+		}
+	} else {
+		hr = ProcessOutput();
+	}
 
-	hr = ProcessOutput();
+	std::unique_lock<std::mutex> lock(queueMutex);
 
 	if (hr == MF_E_TRANSFORM_NEED_MORE_INPUT || encodedFrames.empty()) {
 		*status = NEED_MORE_INPUT;
@@ -760,6 +797,8 @@ bool H264Encoder::ProcessOutput(UINT8 **data, UINT32 *dataLength,
 	activeFrame = std::move(encodedFrames.front());
 	encodedFrames.pop();
 
+	lock.unlock();
+
 	*data = activeFrame.get()->Data();
 	*dataLength = activeFrame.get()->DataLength();
 	*pts = activeFrame.get()->Pts();
@@ -767,7 +806,5 @@ bool H264Encoder::ProcessOutput(UINT8 **data, UINT32 *dataLength,
 	*keyframe = activeFrame.get()->Keyframe();
 	*status = SUCCESS;
 
-	pendingRequests--;
-
 	return true;
 }
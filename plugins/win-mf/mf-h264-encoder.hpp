@@ -15,6 +15,9 @@
 #include <queue>
 #include <memory>
 #include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include <util/windows/ComPtr.hpp>
 
@@ -137,8 +140,9 @@ namespace MF {
 		HRESULT ProcessInput(ComPtr<IMFSample> &sample);
 		HRESULT ProcessOutput();
 
-		HRESULT DrainEvent(bool block);
-		HRESULT DrainEvents();
+		HRESULT HandleEvent();
+		void EventThread();
+		void StopEventThread();
 	private:
 		const obs_encoder_t *encoder;
 		std::shared_ptr<EncoderDescriptor> descriptor;
@@ -167,9 +171,19 @@ namespace MF {
 		// ProcessOutput yet
 		std::queue<std::unique_ptr<H264Frame>> encodedFrames;
 
+		// Asynchronous transforms are driven by their events from
+		// eventThread.  queueMutex protects both queues and the
+		// request count, transformMutex serializes calls into the
+		// transform itself.
 		ComPtr<IMFMediaEventGenerator> eventGenerator;
-		std::atomic<UINT32> inputRequests = 0;
-		std::atomic<UINT32> outputRequests = 0;
-		std::atomic<UINT32> pendingRequests = 0;
+		std::thread eventThread;
+		std::mutex queueMutex;
+		std::mutex transformMutex;
+		std::condition_variable inputTaken;
+		std::condition_variable eventThreadExited;
+		UINT32 inputRequests = 0;
+		bool stopping = false;
+		bool eventThreadDone = false;
+		std::atomic<bool> asyncFailed = false;
 	};
 }
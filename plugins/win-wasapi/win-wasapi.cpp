@@ -8,10 +8,13 @@
 #include <util/windows/CoTaskMemPtr.hpp>
 #include <util/threading.h>
 
+#include <avrt.h>
+
 using namespace std;
 
 #define OPT_DEVICE_ID         "device_id"
 #define OPT_USE_DEVICE_TIMING "use_device_timing"
+#define OPT_BUFFER_DURATION   "buffer_duration"
 
 static void GetWASAPIDefaults(obs_data_t *settings);
 
@@ -30,6 +33,7 @@ class WASAPISource {
 	bool                        isInputDevice;
 	bool                        useDeviceTiming = false;
 	bool                        isDefaultDevice = false;
+	uint32_t                    bufferMS = 0;
 
 	bool                        reconnecting = false;
 	bool                        previouslyFailed = false;
@@ -44,10 +48,16 @@ class WASAPISource {
 	speaker_layout              speakers;
 	audio_format                format;
 	uint32_t                    sampleRate;
+	uint32_t                    blockSize;
+
+	vector<uint8_t>             batch;
+	uint32_t                    batchFrames = 0;
+	uint64_t                    batchTimestamp = 0;
 
 	static DWORD WINAPI ReconnectThread(LPVOID param);
 	static DWORD WINAPI CaptureThread(LPVOID param);
 
+	void OutputBatch();
 	bool ProcessCaptureData();
 
 	inline void Start();
@@ -127,12 +137,17 @@ void WASAPISource::UpdateSettings(obs_data_t *settings)
 	device_id       = obs_data_get_string(settings, OPT_DEVICE_ID);
 	useDeviceTiming = obs_data_get_bool(settings, OPT_USE_DEVICE_TIMING);
 	isDefaultDevice = _strcmpi(device_id.c_str(), "default") == 0;
+	bufferMS        = (uint32_t)obs_data_get_int(settings,
+			OPT_BUFFER_DURATION);
 }
 
 void WASAPISource::Update(obs_data_t *settings)
 {
 	string newDevice = obs_data_get_string(settings, OPT_DEVICE_ID);
-	bool restart = newDevice.compare(device_id) != 0;
+	uint32_t newBufferMS = (uint32_t)obs_data_get_int(settings,
+			OPT_BUFFER_DURATION);
+	bool restart = newDevice.compare(device_id) != 0 ||
+		newBufferMS != bufferMS;
 
 	if (restart)
 		Stop();
@@ -171,6 +186,14 @@ void WASAPISource::InitClient()
 	CoTaskMemPtr<WAVEFORMATEX> wfex;
 	HRESULT                    res;
 	DWORD                      flags = AUDCLNT_STREAMFLAGS_EVENTCALLBACK;
+	REFERENCE_TIME             duration = BUFFER_TIME_100NS;
+
+	/* a buffer duration of 0 keeps the old (very large) default; the
+	 * buffer size doesn't add latency with event driven capture, but a
+	 * smaller one keeps the audio engine from queueing up a lot of data
+	 * if we ever fall behind */
+	if (bufferMS)
+		duration = (REFERENCE_TIME)bufferMS * 10000;
 
 	res = device->Activate(__uuidof(IAudioClient), CLSCTX_ALL,
 			nullptr, (void**)client.Assign());
@@ -188,7 +211,7 @@ void WASAPISource::InitClient()
 
 	res = client->Initialize(
 			AUDCLNT_SHAREMODE_SHARED, flags,
-			BUFFER_TIME_100NS, 0, wfex, nullptr);
+			duration, 0, wfex, nullptr);
 	if (FAILED(res))
 		throw HRError("Failed to get initialize audio client", res);
 }
@@ -267,6 +290,7 @@ void WASAPISource::InitFormat(WAVEFORMATEX *wfex)
 	sampleRate = wfex->nSamplesPerSec;
 	format     = AUDIO_FORMAT_FLOAT;
 	speakers   = ConvertSpeakerLayout(layout, wfex->nChannels);
+	blockSize  = wfex->nBlockAlign;
 }
 
 void WASAPISource::InitCapture()
@@ -378,6 +402,28 @@ DWORD WINAPI WASAPISource::ReconnectThread(LPVOID param)
 	return 0;
 }
 
+void WASAPISource::OutputBatch()
+{
+	if (!batchFrames)
+		return;
+
+	obs_source_audio data = {};
+	data.data[0]          = batch.data();
+	data.frames           = batchFrames;
+	data.speakers         = speakers;
+	data.samples_per_sec  = sampleRate;
+	data.format           = format;
+	data.timestamp        = batchTimestamp;
+
+	obs_source_output_audio(source, &data);
+
+	batch.clear();
+	batchFrames = 0;
+}
+
+/* Everything that is available when the capture event fires is handed to
+ * libobs at once instead of packet by packet, packets are only split up
+ * where the device reports a discontinuity. */
 bool WASAPISource::ProcessCaptureData()
 {
 	HRESULT res;
@@ -385,47 +431,45 @@ bool WASAPISource::ProcessCaptureData()
 	UINT32  frames;
 	DWORD   flags;
 	UINT64  pos, ts;
-	UINT    captureSize = 0;
 
 	while (true) {
-		res = capture->GetNextPacketSize(&captureSize);
-
+		res = capture->GetBuffer(&buffer, &frames, &flags, &pos, &ts);
 		if (FAILED(res)) {
 			if (res != AUDCLNT_E_DEVICE_INVALIDATED)
 				blog(LOG_WARNING,
 						"[WASAPISource::GetCaptureData]"
-						" capture->GetNextPacketSize"
+						" capture->GetBuffer"
 						" failed: %lX", res);
+			batch.clear();
+			batchFrames = 0;
 			return false;
 		}
 
-		if (!captureSize)
+		if (res == AUDCLNT_S_BUFFER_EMPTY)
 			break;
 
-		res = capture->GetBuffer(&buffer, &frames, &flags, &pos, &ts);
-		if (FAILED(res)) {
-			if (res != AUDCLNT_E_DEVICE_INVALIDATED)
-				blog(LOG_WARNING,
-						"[WASAPISource::GetCaptureData]"
-						" capture->GetBuffer"
-						" failed: %lX", res);
-			return false;
-		}
+		if ((flags & AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY) != 0)
+			OutputBatch();
+
+		if (!batchFrames)
+			batchTimestamp = useDeviceTiming ?
+				ts*100 : os_gettime_ns();
+
+		size_t offset = batch.size();
+		size_t size   = (size_t)frames * blockSize;
+		batch.resize(offset + size);
 
-		obs_source_audio data = {};
-		data.data[0]          = (const uint8_t*)buffer;
-		data.frames           = (uint32_t)frames;
-		data.speakers         = speakers;
-		data.samples_per_sec  = sampleRate;
-		data.format           = format;
-		data.timestamp        = useDeviceTiming ?
-			ts*100 : os_gettime_ns();
+		if ((flags & AUDCLNT_BUFFERFLAGS_SILENT) != 0)
+			memset(batch.data() + offset, 0, size);
+		else
+			memcpy(batch.data() + offset, buffer, size);
 
-		obs_source_output_audio(source, &data);
+		batchFrames += frames;
 
 		capture->ReleaseBuffer(frames);
 	}
 
+	OutputBatch();
 	return true;
 }
 
@@ -453,6 +497,14 @@ DWORD WINAPI WASAPISource::CaptureThread(LPVOID param)
 
 	os_set_thread_name("win-wasapi: capture thread");
 
+	DWORD  taskIndex = 0;
+	HANDLE mmcss = AvSetMmThreadCharacteristicsW(L"Pro Audio",
+			&taskIndex);
+	if (!mmcss)
+		blog(LOG_DEBUG, "[WASAPISource::CaptureThread] Failed to set "
+		                "MMCSS thread characteristics: %lu",
+		                GetLastError());
+
 	while (WaitForCaptureSignal(2, sigs, dur)) {
 		if (!source->ProcessCaptureData()) {
 			reconnect = true;
@@ -460,6 +512,9 @@ DWORD WINAPI WASAPISource::CaptureThread(LPVOID param)
 		}
 	}
 
+	if (mmcss)
+		AvRevertMmThreadCharacteristics(mmcss);
+
 	source->client->Stop();
 
 	source->captureThread = nullptr;
@@ -490,12 +545,14 @@ static void GetWASAPIDefaultsInput(obs_data_t *settings)
 {
 	obs_data_set_default_string(settings, OPT_DEVICE_ID, "default");
 	obs_data_set_default_bool(settings, OPT_USE_DEVICE_TIMING, false);
+	obs_data_set_default_int(settings, OPT_BUFFER_DURATION, 0);
 }
 
 static void GetWASAPIDefaultsOutput(obs_data_t *settings)
 {
 	obs_data_set_default_string(settings, OPT_DEVICE_ID, "default");
 	obs_data_set_default_bool(settings, OPT_USE_DEVICE_TIMING, true);
+	obs_data_set_default_int(settings, OPT_BUFFER_DURATION, 0);
 }
 
 static void *CreateWASAPISource(obs_data_t *settings, obs_source_t *source,
@@ -554,6 +611,9 @@ static obs_properties_t *GetWASAPIProperties(bool input)
 	obs_properties_add_bool(props, OPT_USE_DEVICE_TIMING,
 			obs_module_text("UseDeviceTiming"));
 
+	obs_properties_add_int(props, OPT_BUFFER_DURATION,
+			obs_module_text("BufferDuration"), 0, 5000, 1);
+
 	return props;
 }
 
@@ -0,0 +1,955 @@
+/******************************************************************************
+    Copyright (C) 2016 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * Microbenchmarks for the media-io, util and callback building blocks that
+ * run per frame, per sample or per packet.  Each case is run for a fixed
+ * time several times over, and the fastest run is reported as the cost per
+ * unit of work (pixel, sample, byte or operation).
+ *
+ * Mutexes are measured with up to three other threads locking the same
+ * mutex in a loop, so the contended cases show what a lock costs when the
+ * audio, video and output threads fight over it.  On windows the pthread
+ * emulation's mutexes are compared to the native ones libobs uses.
+ *
+ *   bench-kernels [--filter text] [--time ms] [--runs n] [--json file]
+ *
+ * Cycles are counted with the time stamp counter on x86, so they are
+ * reference cycles rather than core cycles when the clock speed changes.
+ * Elsewhere only nanoseconds are reported.  Results are printed as a table
+ * and, with --json, also written as JSON so they can be compared between
+ * builds.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <obs.h>
+#include <obs-avc.h>
+#include <util/base.h>
+#include <util/circlebuf.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <callback/signal.h>
+#include <media-io/audio-kernels.h>
+#include <media-io/audio-resampler.h>
+#include <media-io/format-conversion.h>
+#include <media-io/video-frame.h>
+#include <media-io/video-scaler.h>
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#define HAVE_TSC 1
+#elif defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+static inline uint64_t get_cycles(void)
+{
+#ifdef HAVE_TSC
+	return (uint64_t)__rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/* ------------------------------------------------------------------------- */
+/* measurement */
+
+typedef void (*bench_func_t)(void *data);
+
+struct bench_params {
+	const char *filter;
+	uint64_t   time_ns;
+	int        runs;
+	const char *json_path;
+};
+
+static struct bench_params params;
+static obs_data_array_t *results = NULL;
+
+/* runs func for roughly time_ns, and returns the time and cycles per call
+ * of the fastest of the runs */
+static void measure(bench_func_t func, void *data, double *ns_per_call,
+		double *cycles_per_call)
+{
+	uint64_t calls = 1;
+	uint64_t elapsed;
+
+	*ns_per_call = 0.0;
+	*cycles_per_call = 0.0;
+
+	/* warm up, and find how many calls fill the run time */
+	for (;;) {
+		uint64_t start = os_gettime_ns();
+		for (uint64_t i = 0; i < calls; i++)
+			func(data);
+		elapsed = os_gettime_ns() - start;
+
+		if (elapsed >= params.time_ns / 4 || calls >= (1ULL << 40))
+			break;
+		calls *= 2;
+	}
+
+	calls = elapsed ? calls * params.time_ns / elapsed : calls;
+	if (!calls)
+		calls = 1;
+
+	for (int run = 0; run < params.runs; run++) {
+		uint64_t start_ns = os_gettime_ns();
+		uint64_t start_cycles = get_cycles();
+		double ns, cycles;
+
+		for (uint64_t i = 0; i < calls; i++)
+			func(data);
+
+		cycles = (double)(get_cycles() - start_cycles) / (double)calls;
+		ns = (double)(os_gettime_ns() - start_ns) / (double)calls;
+
+		if (!run || ns < *ns_per_call) {
+			*ns_per_call = ns;
+			*cycles_per_call = cycles;
+		}
+	}
+}
+
+static void run_case(const char *name, const char *variant, const char *unit,
+		uint64_t units, bench_func_t func, void *data)
+{
+	obs_data_t *result;
+	double ns, cycles;
+
+	if (params.filter && !strstr(name, params.filter))
+		return;
+
+	measure(func, data, &ns, &cycles);
+
+	printf("%-28s %-22s %12.3f %12.3f  per %s\n", name, variant,
+			cycles / (double)units, ns / (double)units, unit);
+	fflush(stdout);
+
+	result = obs_data_create();
+	obs_data_set_string(result, "name", name);
+	obs_data_set_string(result, "variant", variant);
+	obs_data_set_string(result, "unit", unit);
+	obs_data_set_int(result, "units", (long long)units);
+	obs_data_set_double(result, "ns_per_unit", ns / (double)units);
+#ifdef HAVE_TSC
+	obs_data_set_double(result, "cycles_per_unit",
+			cycles / (double)units);
+#endif
+	obs_data_array_push_back(results, result);
+	obs_data_release(result);
+}
+
+/* ------------------------------------------------------------------------- */
+/* video */
+
+struct resolution {
+	uint32_t cx;
+	uint32_t cy;
+};
+
+static const struct resolution resolutions[] = {
+	{640, 360}, {1280, 720}, {1920, 1080}, {3840, 2160}
+};
+
+#define NUM_RESOLUTIONS (sizeof(resolutions) / sizeof(resolutions[0]))
+
+static inline void fill_pattern(uint8_t *data, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+		data[i] = (uint8_t)(i * 7 + (i >> 8));
+}
+
+static void fill_frame(struct video_frame *frame, enum video_format format,
+		uint32_t cy)
+{
+	for (size_t i = 0; i < MAX_AV_PLANES && frame->data[i]; i++) {
+		uint32_t height = cy;
+
+		if (i && (format == VIDEO_FORMAT_I420 ||
+		          format == VIDEO_FORMAT_NV12))
+			height = cy / 2;
+
+		fill_pattern(frame->data[i], frame->linesize[i] * height);
+	}
+}
+
+struct conversion_data {
+	const char         *name;
+	struct resolution  res;
+	struct video_frame packed;
+	struct video_frame planar;
+	enum video_format  planar_format;
+};
+
+static void run_compress_i420(void *data)
+{
+	struct conversion_data *cd = data;
+	compress_uyvx_to_i420(cd->packed.data[0], cd->packed.linesize[0],
+			0, cd->res.cy, cd->planar.data, cd->planar.linesize);
+}
+
+static void run_compress_nv12(void *data)
+{
+	struct conversion_data *cd = data;
+	compress_uyvx_to_nv12(cd->packed.data[0], cd->packed.linesize[0],
+			0, cd->res.cy, cd->planar.data, cd->planar.linesize);
+}
+
+static void run_convert_i444(void *data)
+{
+	struct conversion_data *cd = data;
+	convert_uyvx_to_i444(cd->packed.data[0], cd->packed.linesize[0],
+			0, cd->res.cy, cd->planar.data, cd->planar.linesize);
+}
+
+static void run_decompress_nv12(void *data)
+{
+	struct conversion_data *cd = data;
+	decompress_nv12((const uint8_t *const *)cd->planar.data,
+			cd->planar.linesize, 0, cd->res.cy,
+			cd->packed.data[0], cd->packed.linesize[0]);
+}
+
+static void run_decompress_420(void *data)
+{
+	struct conversion_data *cd = data;
+	decompress_420((const uint8_t *const *)cd->planar.data,
+			cd->planar.linesize, 0, cd->res.cy,
+			cd->packed.data[0], cd->packed.linesize[0]);
+}
+
+/* the packed frame doubles as the 4:2:2 input, only half of it is used */
+static void run_decompress_422(void *data)
+{
+	struct conversion_data *cd = data;
+	decompress_422(cd->packed.data[0], cd->res.cx * 2, 0, cd->res.cy,
+			cd->planar.data[0], cd->res.cx * 4, true);
+}
+
+struct conversion_case {
+	const char        *name;
+	enum video_format planar_format;
+	bench_func_t      func;
+};
+
+static const struct conversion_case conversion_cases[] = {
+	{"compress_uyvx_to_i420", VIDEO_FORMAT_I420, run_compress_i420},
+	{"compress_uyvx_to_nv12", VIDEO_FORMAT_NV12, run_compress_nv12},
+	{"convert_uyvx_to_i444",  VIDEO_FORMAT_I444, run_convert_i444},
+	{"decompress_nv12",       VIDEO_FORMAT_NV12, run_decompress_nv12},
+	{"decompress_420",        VIDEO_FORMAT_I420, run_decompress_420},
+	{"decompress_422",        VIDEO_FORMAT_RGBA, run_decompress_422},
+};
+
+#define NUM_CONVERSION_CASES \
+	(sizeof(conversion_cases) / sizeof(conversion_cases[0]))
+
+static void bench_format_conversion(void)
+{
+	for (size_t i = 0; i < NUM_CONVERSION_CASES; i++) {
+		const struct conversion_case *cc = &conversion_cases[i];
+
+		for (size_t j = 0; j < NUM_RESOLUTIONS; j++) {
+			struct conversion_data cd = {0};
+			struct dstr variant = {0};
+
+			cd.res = resolutions[j];
+			video_frame_init(&cd.packed, VIDEO_FORMAT_RGBA,
+					cd.res.cx, cd.res.cy);
+			video_frame_init(&cd.planar, cc->planar_format,
+					cd.res.cx, cd.res.cy);
+			fill_frame(&cd.packed, VIDEO_FORMAT_RGBA, cd.res.cy);
+			fill_frame(&cd.planar, cc->planar_format, cd.res.cy);
+
+			dstr_printf(&variant, "%ux%u", cd.res.cx, cd.res.cy);
+			run_case(cc->name, variant.array, "pixel",
+					(uint64_t)cd.res.cx * cd.res.cy,
+					cc->func, &cd);
+
+			dstr_free(&variant);
+			video_frame_free(&cd.packed);
+			video_frame_free(&cd.planar);
+		}
+	}
+}
+
+struct copy_data {
+	struct video_frame src;
+	struct video_frame dst;
+	enum video_format  format;
+	uint32_t           cy;
+};
+
+static void run_frame_copy(void *data)
+{
+	struct copy_data *cd = data;
+	video_frame_copy(&cd->dst, &cd->src, cd->format, cd->cy);
+}
+
+static const enum video_format copy_formats[] = {
+	VIDEO_FORMAT_NV12, VIDEO_FORMAT_I420, VIDEO_FORMAT_I444,
+	VIDEO_FORMAT_RGBA
+};
+
+static void bench_video_frame_copy(void)
+{
+	for (size_t i = 0; i < sizeof(copy_formats) / sizeof(copy_formats[0]);
+			i++) {
+		for (size_t j = 0; j < NUM_RESOLUTIONS; j++) {
+			struct copy_data cd = {0};
+			struct resolution res = resolutions[j];
+			struct dstr variant = {0};
+
+			cd.format = copy_formats[i];
+			cd.cy     = res.cy;
+			video_frame_init(&cd.src, cd.format, res.cx, res.cy);
+			video_frame_init(&cd.dst, cd.format, res.cx, res.cy);
+			fill_frame(&cd.src, cd.format, res.cy);
+
+			dstr_printf(&variant, "%s %ux%u",
+					get_video_format_name(cd.format),
+					res.cx, res.cy);
+			run_case("video_frame_copy", variant.array, "pixel",
+					(uint64_t)res.cx * res.cy,
+					run_frame_copy, &cd);
+
+			dstr_free(&variant);
+			video_frame_free(&cd.src);
+			video_frame_free(&cd.dst);
+		}
+	}
+}
+
+struct scaler_data {
+	video_scaler_t     *scaler;
+	struct video_frame src;
+	struct video_frame dst;
+};
+
+static void run_scaler(void *data)
+{
+	struct scaler_data *sd = data;
+	video_scaler_scale(sd->scaler, sd->dst.data, sd->dst.linesize,
+			(const uint8_t *const *)sd->src.data,
+			sd->src.linesize);
+}
+
+struct scaler_case {
+	enum video_format       src_format;
+	struct resolution       src;
+	enum video_format       dst_format;
+	struct resolution       dst;
+	enum video_scale_type   type;
+	const char              *type_name;
+};
+
+static const struct scaler_case scaler_cases[] = {
+	{VIDEO_FORMAT_NV12, {1920, 1080}, VIDEO_FORMAT_NV12, {1280, 720},
+		VIDEO_SCALE_BILINEAR, "bilinear"},
+	{VIDEO_FORMAT_NV12, {1920, 1080}, VIDEO_FORMAT_NV12, {1280, 720},
+		VIDEO_SCALE_BICUBIC, "bicubic"},
+	{VIDEO_FORMAT_NV12, {3840, 2160}, VIDEO_FORMAT_NV12, {1920, 1080},
+		VIDEO_SCALE_BILINEAR, "bilinear"},
+	{VIDEO_FORMAT_RGBA, {1920, 1080}, VIDEO_FORMAT_NV12, {1920, 1080},
+		VIDEO_SCALE_POINT, "point"},
+	{VIDEO_FORMAT_NV12, {1920, 1080}, VIDEO_FORMAT_I420, {1920, 1080},
+		VIDEO_SCALE_POINT, "point"},
+};
+
+static void bench_video_scaler(void)
+{
+	for (size_t i = 0; i < sizeof(scaler_cases) / sizeof(scaler_cases[0]);
+			i++) {
+		const struct scaler_case *sc = &scaler_cases[i];
+		struct video_scale_info src_info = {
+			sc->src_format, sc->src.cx, sc->src.cy,
+			VIDEO_RANGE_PARTIAL, VIDEO_CS_709
+		};
+		struct video_scale_info dst_info = {
+			sc->dst_format, sc->dst.cx, sc->dst.cy,
+			VIDEO_RANGE_PARTIAL, VIDEO_CS_709
+		};
+		struct scaler_data sd = {0};
+		struct dstr variant = {0};
+
+		if (video_scaler_create(&sd.scaler, &dst_info, &src_info,
+					sc->type) != VIDEO_SCALER_SUCCESS) {
+			blog(LOG_WARNING, "Failed to create scaler %d", (int)i);
+			continue;
+		}
+
+		video_frame_init(&sd.src, sc->src_format, sc->src.cx,
+				sc->src.cy);
+		video_frame_init(&sd.dst, sc->dst_format, sc->dst.cx,
+				sc->dst.cy);
+		fill_frame(&sd.src, sc->src_format, sc->src.cy);
+
+		dstr_printf(&variant, "%s %ux%u->%s %ux%u %s",
+				get_video_format_name(sc->src_format),
+				sc->src.cx, sc->src.cy,
+				get_video_format_name(sc->dst_format),
+				sc->dst.cx, sc->dst.cy, sc->type_name);
+		run_case("video_scaler_scale", variant.array, "pixel",
+				(uint64_t)sc->dst.cx * sc->dst.cy,
+				run_scaler, &sd);
+
+		dstr_free(&variant);
+		video_frame_free(&sd.src);
+		video_frame_free(&sd.dst);
+		video_scaler_destroy(sd.scaler);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* audio */
+
+#define AUDIO_FRAMES 1024
+
+struct mix_data {
+	float  *src;
+	float  *mixes[MAX_AUDIO_MIXES];
+	size_t num_mixes;
+};
+
+static void run_mix(void *data)
+{
+	struct mix_data *md = data;
+	audio_mix_float(md->mixes, md->num_mixes, md->src, AUDIO_FRAMES);
+}
+
+static void bench_audio_mix(void)
+{
+	static const size_t mix_counts[] = {1, 2, MAX_AUDIO_MIXES};
+	struct mix_data md = {0};
+
+	md.src = bzalloc(AUDIO_FRAMES * sizeof(float));
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
+		md.mixes[i] = bzalloc(AUDIO_FRAMES * sizeof(float));
+	for (size_t i = 0; i < AUDIO_FRAMES; i++)
+		md.src[i] = (float)(i % 100) / 1000.0f;
+
+	for (size_t i = 0; i < sizeof(mix_counts) / sizeof(mix_counts[0]);
+			i++) {
+		struct dstr variant = {0};
+
+		md.num_mixes = mix_counts[i];
+		dstr_printf(&variant, "%d mixes", (int)md.num_mixes);
+		run_case("audio_mix_float", variant.array, "sample",
+				AUDIO_FRAMES, run_mix, &md);
+		dstr_free(&variant);
+	}
+
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
+		bfree(md.mixes[i]);
+	bfree(md.src);
+}
+
+struct resample_data {
+	audio_resampler_t *resampler;
+	uint8_t           *input[MAX_AV_PLANES];
+};
+
+static void run_resample(void *data)
+{
+	struct resample_data *rd = data;
+	uint8_t *output[MAX_AV_PLANES];
+	uint32_t out_frames;
+	uint64_t ts_offset;
+
+	audio_resampler_resample(rd->resampler, output, &out_frames,
+			&ts_offset, (const uint8_t *const *)rd->input,
+			AUDIO_FRAMES);
+}
+
+struct resample_case {
+	struct resample_info src;
+	struct resample_info dst;
+	const char           *name;
+};
+
+static const struct resample_case resample_cases[] = {
+	{{44100, AUDIO_FORMAT_FLOAT_PLANAR, SPEAKERS_STEREO},
+	 {48000, AUDIO_FORMAT_FLOAT_PLANAR, SPEAKERS_STEREO},
+	 "44.1k->48k float planar stereo"},
+	{{48000, AUDIO_FORMAT_16BIT, SPEAKERS_STEREO},
+	 {48000, AUDIO_FORMAT_FLOAT_PLANAR, SPEAKERS_STEREO},
+	 "48k s16->float planar stereo"},
+	{{48000, AUDIO_FORMAT_FLOAT_PLANAR, SPEAKERS_5POINT1},
+	 {48000, AUDIO_FORMAT_FLOAT_PLANAR, SPEAKERS_STEREO},
+	 "48k 5.1->stereo float planar"},
+};
+
+static void bench_audio_resampler(void)
+{
+	for (size_t i = 0;
+	     i < sizeof(resample_cases) / sizeof(resample_cases[0]); i++) {
+		const struct resample_case *rc = &resample_cases[i];
+		struct resample_data rd = {0};
+		size_t planes = is_audio_planar(rc->src.format) ?
+			get_audio_channels(rc->src.speakers) : 1;
+		size_t size = get_audio_size(rc->src.format,
+				rc->src.speakers, AUDIO_FRAMES) / planes;
+
+		rd.resampler = audio_resampler_create(&rc->dst, &rc->src);
+		if (!rd.resampler) {
+			blog(LOG_WARNING, "Failed to create resampler %d",
+					(int)i);
+			continue;
+		}
+
+		for (size_t j = 0; j < planes; j++) {
+			rd.input[j] = bzalloc(size);
+			fill_pattern(rd.input[j], size);
+		}
+
+		run_case("audio_resampler_resample", rc->name, "sample",
+				AUDIO_FRAMES, run_resample, &rd);
+
+		for (size_t j = 0; j < planes; j++)
+			bfree(rd.input[j]);
+		audio_resampler_destroy(rd.resampler);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* util */
+
+#define CIRCLEBUF_CHUNK 4096
+
+struct circlebuf_data {
+	struct circlebuf buf;
+	uint8_t          chunk[CIRCLEBUF_CHUNK];
+};
+
+static void run_circlebuf(void *data)
+{
+	struct circlebuf_data *cd = data;
+	circlebuf_push_back(&cd->buf, cd->chunk, CIRCLEBUF_CHUNK);
+	circlebuf_pop_front(&cd->buf, cd->chunk, CIRCLEBUF_CHUNK);
+}
+
+static void bench_circlebuf(void)
+{
+	struct circlebuf_data *cd = bzalloc(sizeof(*cd));
+
+	/* keep a few chunks queued so pushes and pops wrap around */
+	circlebuf_init(&cd->buf);
+	for (int i = 0; i < 3; i++)
+		circlebuf_push_back(&cd->buf, cd->chunk, CIRCLEBUF_CHUNK);
+
+	run_case("circlebuf push/pop", "4096 bytes", "byte",
+			CIRCLEBUF_CHUNK, run_circlebuf, cd);
+
+	circlebuf_free(&cd->buf);
+	bfree(cd);
+}
+
+#define DARRAY_ITEMS 1024
+
+struct darray_data {
+	DARRAY(uint32_t) array;
+};
+
+static void run_darray(void *data)
+{
+	struct darray_data *dd = data;
+	uint32_t val = 5;
+
+	da_insert(dd->array, DARRAY_ITEMS / 2, &val);
+	da_erase(dd->array, DARRAY_ITEMS / 2);
+}
+
+static void bench_darray(void)
+{
+	struct darray_data dd = {0};
+
+	for (uint32_t i = 0; i < DARRAY_ITEMS; i++)
+		da_push_back(dd.array, &i);
+
+	run_case("darray insert/erase", "middle of 1024", "op", 1,
+			run_darray, &dd);
+
+	da_free(dd.array);
+}
+
+#define OBS_DATA_ITEMS 64
+
+struct obs_data_data {
+	obs_data_t *data;
+	char       names[OBS_DATA_ITEMS][16];
+	size_t     idx;
+};
+
+static void run_obs_data(void *data)
+{
+	struct obs_data_data *od = data;
+	const char *name = od->names[od->idx++ % OBS_DATA_ITEMS];
+
+	obs_data_set_int(od->data, name,
+			obs_data_get_int(od->data, name) + 1);
+}
+
+static void bench_obs_data(void)
+{
+	struct obs_data_data od = {0};
+
+	od.data = obs_data_create();
+	for (int i = 0; i < OBS_DATA_ITEMS; i++) {
+		snprintf(od.names[i], sizeof(od.names[i]), "setting_%d", i);
+		obs_data_set_int(od.data, od.names[i], i);
+	}
+
+	run_case("obs_data get/set int", "64 items", "op", 1,
+			run_obs_data, &od);
+
+	obs_data_release(od.data);
+}
+
+/* ------------------------------------------------------------------------- */
+/* callbacks and packets */
+
+static void signal_callback(void *data, calldata_t *cd)
+{
+	long long *total = data;
+	*total += calldata_int(cd, "value");
+}
+
+struct signal_data {
+	signal_handler_t *handler;
+	calldata_t       cd;
+};
+
+static void run_signal(void *data)
+{
+	struct signal_data *sd = data;
+	signal_handler_signal(sd->handler, "bench", &sd->cd);
+}
+
+static void bench_signal(void)
+{
+	struct signal_data sd = {0};
+	long long total = 0;
+
+	sd.handler = signal_handler_create();
+	signal_handler_add(sd.handler, "void bench(int value)");
+	signal_handler_connect(sd.handler, "bench", signal_callback, &total);
+	calldata_set_int(&sd.cd, "value", 1);
+
+	run_case("signal_handler_signal", "1 callback", "op", 1,
+			run_signal, &sd);
+
+	calldata_free(&sd.cd);
+	signal_handler_destroy(sd.handler);
+}
+
+#define AVC_NALS     8
+#define AVC_NAL_SIZE 4096
+
+struct avc_data {
+	struct encoder_packet packet;
+};
+
+static void run_avc(void *data)
+{
+	struct avc_data *ad = data;
+	struct encoder_packet parsed;
+
+	obs_parse_avc_packet(&parsed, &ad->packet);
+	obs_encoder_packet_release(&parsed);
+}
+
+/* fills NAL payloads with a pattern that can't form a start code */
+static void create_avc_packet(struct encoder_packet *packet,
+		bool three_byte_codes)
+{
+	size_t code_size = three_byte_codes ? 3 : 4;
+	size_t size = AVC_NALS * (code_size + AVC_NAL_SIZE);
+	uint8_t *data = bmalloc(size);
+	uint8_t *pos = data;
+
+	for (int i = 0; i < AVC_NALS; i++) {
+		if (!three_byte_codes)
+			*(pos++) = 0;
+		*(pos++) = 0;
+		*(pos++) = 0;
+		*(pos++) = 1;
+
+		memset(pos, 0xa5, AVC_NAL_SIZE);
+		pos[0] = i ? 0x41 : 0x65;
+		pos += AVC_NAL_SIZE;
+	}
+
+	memset(packet, 0, sizeof(*packet));
+	packet->data = data;
+	packet->size = size;
+	packet->type = OBS_ENCODER_VIDEO;
+}
+
+static void bench_avc(void)
+{
+	struct avc_data ad;
+
+	create_avc_packet(&ad.packet, false);
+	run_case("obs_parse_avc_packet", "4-byte start codes", "byte",
+			ad.packet.size, run_avc, &ad);
+	bfree(ad.packet.data);
+
+	create_avc_packet(&ad.packet, true);
+	run_case("obs_parse_avc_packet", "3-byte start codes", "byte",
+			ad.packet.size, run_avc, &ad);
+	bfree(ad.packet.data);
+}
+
+/* ------------------------------------------------------------------------- */
+/* locks */
+
+#define LOCK_CASE      "mutex lock/unlock"
+#define MAX_CONTENDERS 3
+
+struct lock_ops {
+	const char *name;
+	void       *mutex;
+	void       (*lock)(void *mutex);
+	void       (*unlock)(void *mutex);
+};
+
+struct lock_data {
+	const struct lock_ops *ops;
+	volatile long         stop;
+	uint64_t              counter;
+};
+
+static void lock_pthread(void *mutex)
+{
+	pthread_mutex_lock(mutex);
+}
+
+static void unlock_pthread(void *mutex)
+{
+	pthread_mutex_unlock(mutex);
+}
+
+#ifdef _WIN32
+static void lock_native(void *mutex)
+{
+	os_win32_mutex_lock(mutex);
+}
+
+static void unlock_native(void *mutex)
+{
+	os_win32_mutex_unlock(mutex);
+}
+#endif
+
+static void run_lock(void *data)
+{
+	struct lock_data *ld = data;
+
+	ld->ops->lock(ld->ops->mutex);
+	ld->counter++;
+	ld->ops->unlock(ld->ops->mutex);
+}
+
+static void *lock_contender(void *data)
+{
+	struct lock_data *ld = data;
+
+	while (!os_atomic_load_long(&ld->stop))
+		run_lock(ld);
+	return NULL;
+}
+
+static void bench_lock(const struct lock_ops *ops)
+{
+	for (int contenders = 0; contenders <= MAX_CONTENDERS; contenders++) {
+		struct lock_data ld = {ops, 0, 0};
+		pthread_t threads[MAX_CONTENDERS];
+		char variant[64];
+		int started = 0;
+
+		for (int i = 0; i < contenders; i++) {
+			if (pthread_create(&threads[started], NULL,
+						lock_contender, &ld) == 0)
+				started++;
+		}
+
+		snprintf(variant, sizeof(variant), "%s, %d thread%s",
+				ops->name, started + 1, started ? "s" : "");
+		run_case(LOCK_CASE, variant, "op", 1, run_lock, &ld);
+
+		os_atomic_set_long(&ld.stop, 1);
+		for (int i = 0; i < started; i++)
+			pthread_join(threads[i], NULL);
+	}
+}
+
+static void bench_locks(void)
+{
+	pthread_mutexattr_t attr;
+	pthread_mutex_t mutex;
+	pthread_mutex_t recursive_mutex;
+	struct lock_ops ops;
+
+	if (params.filter && !strstr(LOCK_CASE, params.filter))
+		return;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&mutex, NULL);
+	pthread_mutex_init(&recursive_mutex, &attr);
+
+	ops.name   = "pthread";
+	ops.mutex  = &mutex;
+	ops.lock   = lock_pthread;
+	ops.unlock = unlock_pthread;
+	bench_lock(&ops);
+
+	ops.name   = "pthread recursive";
+	ops.mutex  = &recursive_mutex;
+	bench_lock(&ops);
+
+	pthread_mutex_destroy(&mutex);
+	pthread_mutex_destroy(&recursive_mutex);
+
+#ifdef _WIN32
+	os_win32_mutex_t native_mutex;
+	os_win32_mutex_t native_recursive_mutex;
+
+	os_win32_mutex_init(&native_mutex, NULL);
+	os_win32_mutex_init(&native_recursive_mutex, &attr);
+
+	ops.name   = "native";
+	ops.mutex  = &native_mutex;
+	ops.lock   = lock_native;
+	ops.unlock = unlock_native;
+	bench_lock(&ops);
+
+	ops.name   = "native recursive";
+	ops.mutex  = &native_recursive_mutex;
+	bench_lock(&ops);
+
+	os_win32_mutex_destroy(&native_mutex);
+	os_win32_mutex_destroy(&native_recursive_mutex);
+#endif
+
+	pthread_mutexattr_destroy(&attr);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void do_log(int log_level, const char *msg, va_list args, void *param)
+{
+	if (log_level <= LOG_WARNING) {
+		vfprintf(stderr, msg, args);
+		fputc('\n', stderr);
+	}
+
+	UNUSED_PARAMETER(param);
+}
+
+static bool parse_args(int argc, char *argv[])
+{
+	long long time_ms = 100;
+
+	params.runs = 5;
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if (!val)
+			return false;
+
+		i++;
+		if (strcmp(arg, "--filter") == 0) {
+			params.filter = val;
+		} else if (strcmp(arg, "--time") == 0) {
+			time_ms = strtoll(val, NULL, 10);
+		} else if (strcmp(arg, "--runs") == 0) {
+			params.runs = atoi(val);
+		} else if (strcmp(arg, "--json") == 0) {
+			params.json_path = val;
+		} else {
+			return false;
+		}
+	}
+
+	params.time_ns = (uint64_t)time_ms * 1000000ULL;
+	return time_ms > 0 && params.runs > 0;
+}
+
+int main(int argc, char *argv[])
+{
+	obs_data_t *output;
+	int ret = 0;
+
+	if (!parse_args(argc, argv)) {
+		fprintf(stderr, "usage: %s [--filter text] [--time ms] "
+				"[--runs n] [--json file]\n", argv[0]);
+		return 1;
+	}
+
+	base_set_log_handler(do_log, NULL);
+	results = obs_data_array_create();
+
+	printf("%-28s %-22s %12s %12s\n", "kernel", "variant",
+#ifdef HAVE_TSC
+			"cycles/unit",
+#else
+			"-",
+#endif
+			"ns/unit");
+
+	bench_format_conversion();
+	bench_video_frame_copy();
+	bench_video_scaler();
+	bench_audio_mix();
+	bench_audio_resampler();
+	bench_circlebuf();
+	bench_darray();
+	bench_obs_data();
+	bench_signal();
+	bench_avc();
+	bench_locks();
+
+	output = obs_data_create();
+	obs_data_set_string(output, "timer",
+#ifdef HAVE_TSC
+			"tsc"
+#else
+			"ns"
+#endif
+			);
+	obs_data_set_array(output, "results", results);
+
+	if (params.json_path && !obs_data_save_json(output,
+				params.json_path)) {
+		fprintf(stderr, "Failed to write '%s'\n", params.json_path);
+		ret = 1;
+	}
+
+	obs_data_release(output);
+	obs_data_array_release(results);
+	return ret;
+}
@@ -0,0 +1,711 @@
+/******************************************************************************
+    Copyright (C) 2016 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * Output path benchmark.  Feeds synthetic H.264/AAC packets at a fixed
+ * bitrate through rtmp-stream (into a loopback RTMP sink), flv-output and
+ * ffmpeg-mux, and reports what each of them managed to deliver, the CPU
+ * time that took, and (for RTMP) how far packets lagged behind their
+ * timestamps at the receiving end.
+ *
+ *   bench-outputs [--output rtmp|flv|ffmpeg|all] [--bitrate kbps]
+ *                 [--tracks n] [--fps n] [--duration sec]
+ *                 [--ramp] [--max-bitrate kbps]
+ *                 [--replay capture] [--speed n]
+ *
+ * With --ramp, the bitrate doubles for every run until the output can't
+ * keep up anymore, to find the highest rate it can sustain.
+ *
+ * With --replay, the packets of a capture written by the packet_capture
+ * output are sent instead of synthetic ones.  --speed runs the video and
+ * audio clocks that many times faster, so the capture goes out at that
+ * multiple of its original bitrate.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <obs.h>
+#include <util/base.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+
+#include "rtmp-sink.h"
+#include "replay.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#endif
+
+/* a run counts as sustained when nothing was dropped and at least this much
+ * of the target bitrate came out the other end */
+#define SUSTAINED_RATIO 0.95
+
+#define STOP_TIMEOUT_MS 10000
+
+/* ------------------------------------------------------------------------- */
+/* synthetic encoders */
+
+/* annex-b SPS/PPS for a 320x180 baseline stream, enough for the muxers */
+static const uint8_t bench_avc_headers[] = {
+	0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0xc0, 0x0d,
+	0xda, 0x05, 0x07, 0xec, 0x04, 0x40, 0x00, 0x00,
+	0x03, 0x00, 0x40, 0x00, 0x00, 0x0f, 0x03, 0xc5,
+	0x0a, 0xa8,
+	0x00, 0x00, 0x00, 0x01, 0x68, 0xce, 0x3c, 0x80
+};
+
+/* AAC-LC, 48 kHz, stereo */
+static const uint8_t bench_aac_header[] = {0x11, 0x90};
+
+struct bench_encoder {
+	obs_encoder_t *encoder;
+	long long     bitrate;
+	uint8_t       *buffer;
+	size_t        size;
+	uint64_t      frames;
+	uint64_t      keyint;
+};
+
+static const char *bench_video_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Benchmark H.264";
+}
+
+static const char *bench_audio_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Benchmark AAC";
+}
+
+/* fills the payload with a byte pattern that can't form a start code */
+static void fill_payload(struct bench_encoder *enc, size_t size)
+{
+	if (size > enc->size) {
+		enc->buffer = brealloc(enc->buffer, size);
+		memset(enc->buffer + enc->size, 0xa5, size - enc->size);
+		enc->size = size;
+	}
+}
+
+static bool bench_update(void *data, obs_data_t *settings)
+{
+	struct bench_encoder *enc = data;
+	enc->bitrate = obs_data_get_int(settings, "bitrate");
+	return true;
+}
+
+static void *bench_create(obs_data_t *settings, obs_encoder_t *encoder)
+{
+	struct bench_encoder *enc = bzalloc(sizeof(*enc));
+	enc->encoder = encoder;
+	bench_update(enc, settings);
+	return enc;
+}
+
+static void bench_destroy(void *data)
+{
+	struct bench_encoder *enc = data;
+	bfree(enc->buffer);
+	bfree(enc);
+}
+
+static bool bench_video_encode(void *data, struct encoder_frame *frame,
+		struct encoder_packet *packet, bool *received_packet)
+{
+	struct bench_encoder *enc = data;
+	video_t *video = obs_encoder_video(enc->encoder);
+	const struct video_output_info *voi = video_output_get_info(video);
+	size_t size;
+	bool keyframe;
+
+	if (!enc->keyint)
+		enc->keyint = (uint64_t)voi->fps_num * 2 / voi->fps_den;
+
+	size = (size_t)(enc->bitrate * 1000 / 8 * voi->fps_den /
+			voi->fps_num);
+	if (size < 16)
+		size = 16;
+
+	keyframe = (enc->frames++ % enc->keyint) == 0;
+	fill_payload(enc, size);
+
+	enc->buffer[0] = 0;
+	enc->buffer[1] = 0;
+	enc->buffer[2] = 0;
+	enc->buffer[3] = 1;
+	enc->buffer[4] = keyframe ? 0x65 : 0x41;
+
+	packet->data     = enc->buffer;
+	packet->size     = size;
+	packet->type     = OBS_ENCODER_VIDEO;
+	packet->pts      = frame->pts;
+	packet->dts      = frame->pts;
+	packet->keyframe = keyframe;
+	*received_packet = true;
+	return true;
+}
+
+static bool bench_video_extra_data(void *data, uint8_t **extra_data,
+		size_t *size)
+{
+	*extra_data = (uint8_t*)bench_avc_headers;
+	*size       = sizeof(bench_avc_headers);
+
+	UNUSED_PARAMETER(data);
+	return true;
+}
+
+static bool bench_audio_encode(void *data, struct encoder_frame *frame,
+		struct encoder_packet *packet, bool *received_packet)
+{
+	struct bench_encoder *enc = data;
+	audio_t *audio = obs_encoder_audio(enc->encoder);
+	size_t size = (size_t)(enc->bitrate * 1000 / 8 * frame->frames /
+			audio_output_get_sample_rate(audio));
+
+	if (size < 8)
+		size = 8;
+	fill_payload(enc, size);
+
+	packet->data     = enc->buffer;
+	packet->size     = size;
+	packet->type     = OBS_ENCODER_AUDIO;
+	packet->pts      = frame->pts;
+	packet->dts      = frame->pts;
+	*received_packet = true;
+	return true;
+}
+
+static size_t bench_audio_frame_size(void *data)
+{
+	UNUSED_PARAMETER(data);
+	return 1024;
+}
+
+static bool bench_audio_extra_data(void *data, uint8_t **extra_data,
+		size_t *size)
+{
+	*extra_data = (uint8_t*)bench_aac_header;
+	*size       = sizeof(bench_aac_header);
+
+	UNUSED_PARAMETER(data);
+	return true;
+}
+
+static void bench_audio_info(void *data, struct audio_convert_info *info)
+{
+	info->format = AUDIO_FORMAT_FLOAT_PLANAR;
+	UNUSED_PARAMETER(data);
+}
+
+static struct obs_encoder_info bench_video_encoder = {
+	.id             = "bench_h264",
+	.type           = OBS_ENCODER_VIDEO,
+	.codec          = "h264",
+	.get_name       = bench_video_name,
+	.create         = bench_create,
+	.destroy        = bench_destroy,
+	.update         = bench_update,
+	.encode         = bench_video_encode,
+	.get_extra_data = bench_video_extra_data
+};
+
+static struct obs_encoder_info bench_audio_encoder = {
+	.id             = "bench_aac",
+	.type           = OBS_ENCODER_AUDIO,
+	.codec          = "AAC",
+	.get_name       = bench_audio_name,
+	.create         = bench_create,
+	.destroy        = bench_destroy,
+	.update         = bench_update,
+	.encode         = bench_audio_encode,
+	.get_frame_size = bench_audio_frame_size,
+	.get_extra_data = bench_audio_extra_data,
+	.get_audio_info = bench_audio_info
+};
+
+/* ------------------------------------------------------------------------- */
+/* benchmark runs */
+
+enum bench_output {
+	BENCH_RTMP,
+	BENCH_FLV,
+	BENCH_FFMPEG,
+	BENCH_COUNT
+};
+
+static const char *output_names[BENCH_COUNT] = {"rtmp", "flv", "ffmpeg"};
+static const char *output_ids[BENCH_COUNT] = {
+	"rtmp_output", "flv_output", "ffmpeg_muxer"
+};
+
+struct bench_params {
+	bool      outputs[BENCH_COUNT];
+	long long bitrate;
+	long long max_bitrate;
+	int       tracks;
+	uint32_t  fps;
+	uint32_t  duration_sec;
+	bool      ramp;
+
+	const char *replay_path;
+	uint32_t  speed;
+};
+
+struct bench_result {
+	long long target_kbps;
+	double    delivered_kbps;
+	double    cpu_percent;
+	int       dropped_frames;
+	int       total_frames;
+	bool      has_latency;
+	double    latency_avg_ms;
+	double    latency_max_ms;
+	bool      sustained;
+};
+
+static struct rtmp_sink *sink = NULL;
+
+static struct replay replay;
+static bool replaying = false;
+
+static obs_encoder_t *create_encoder(const char *id, const char *name,
+		const char *setting, long long val, size_t mixer_idx,
+		bool audio)
+{
+	obs_data_t *settings = obs_data_create();
+	obs_encoder_t *encoder;
+
+	obs_data_set_int(settings, setting, val);
+	encoder = audio ?
+		obs_audio_encoder_create(id, name, settings, mixer_idx, NULL) :
+		obs_video_encoder_create(id, name, settings, NULL);
+	obs_data_release(settings);
+
+	if (!encoder)
+		return NULL;
+
+	if (audio)
+		obs_encoder_set_audio(encoder, obs_get_audio());
+	else
+		obs_encoder_set_video(encoder, obs_get_video());
+	return encoder;
+}
+
+static obs_output_t *create_output(enum bench_output type,
+		obs_service_t **service, struct dstr *path)
+{
+	obs_data_t *settings = obs_data_create();
+	obs_output_t *output;
+
+	if (type == BENCH_RTMP) {
+		struct dstr url = {0};
+		obs_data_t *service_settings = obs_data_create();
+
+		dstr_printf(&url, "rtmp://127.0.0.1:%d/bench",
+				rtmp_sink_port(sink));
+		obs_data_set_string(service_settings, "server", url.array);
+		obs_data_set_string(service_settings, "key", "stream");
+		*service = obs_service_create("rtmp_custom", "bench service",
+				service_settings, NULL);
+		obs_data_release(service_settings);
+		dstr_free(&url);
+	} else {
+		/* written to the working directory, and deleted afterwards */
+		dstr_printf(path, "bench-outputs.%s",
+				type == BENCH_FLV ? "flv" : "mkv");
+		obs_data_set_string(settings, "path", path->array);
+	}
+
+	output = obs_output_create(output_ids[type], "bench output", settings,
+			NULL);
+	obs_data_release(settings);
+
+	if (output && *service)
+		obs_output_set_service(output, *service);
+	return output;
+}
+
+static bool wait_for_stop(obs_output_t *output)
+{
+	for (int i = 0; i < STOP_TIMEOUT_MS / 10; i++) {
+		if (!obs_output_active(output))
+			return true;
+		os_sleep_ms(10);
+	}
+
+	return false;
+}
+
+static bool run_bench(enum bench_output type, const struct bench_params *p,
+		long long bitrate, struct bench_result *result)
+{
+	obs_encoder_t *audio[MAX_AUDIO_MIXES] = {0};
+	obs_encoder_t *video = NULL;
+	obs_service_t *service = NULL;
+	obs_output_t *output = NULL;
+	os_cpu_usage_info_t *cpu = NULL;
+	struct dstr path = {0};
+	long long audio_kbps = 128;
+	long long video_kbps = bitrate - audio_kbps * p->tracks;
+	uint64_t start_ns, elapsed_ns;
+	uint64_t bytes;
+	bool success = false;
+
+	memset(result, 0, sizeof(*result));
+	result->target_kbps = bitrate;
+
+	if (video_kbps < 100)
+		video_kbps = 100;
+
+	if (replaying) {
+		int audio_idx = 0;
+
+		for (size_t i = 0; i < replay.count; i++) {
+			if ((int)i == replay.video_track)
+				video = create_encoder("replay_video",
+						"replay video", "track",
+						(long long)i, 0, false);
+			else if (audio_idx < p->tracks) {
+				audio[audio_idx] = create_encoder(
+						"replay_audio", "replay audio",
+						"track", (long long)i,
+						audio_idx, true);
+				audio_idx++;
+			}
+		}
+	} else {
+		video = create_encoder("bench_h264", "bench video",
+				"bitrate", video_kbps, 0, false);
+		for (int i = 0; i < p->tracks; i++)
+			audio[i] = create_encoder("bench_aac", "bench audio",
+					"bitrate", audio_kbps, i, true);
+	}
+
+	output = create_output(type, &service, &path);
+	if (!video || !output) {
+		blog(LOG_ERROR, "Failed to create the %s output",
+				output_names[type]);
+		goto finish;
+	}
+
+	obs_output_set_video_encoder(output, video);
+	for (int i = 0; i < p->tracks; i++)
+		obs_output_set_audio_encoder(output, audio[i], i);
+
+	if (sink)
+		rtmp_sink_reset(sink);
+
+	cpu = os_cpu_usage_info_start();
+	start_ns = os_gettime_ns();
+
+	if (!obs_output_start(output)) {
+		blog(LOG_ERROR, "Failed to start the %s output",
+				output_names[type]);
+		goto finish;
+	}
+
+	os_sleep_ms(p->duration_sec * 1000);
+
+	bytes = obs_output_get_total_bytes(output);
+	elapsed_ns = os_gettime_ns() - start_ns;
+	result->cpu_percent    = os_cpu_usage_info_query(cpu);
+	result->dropped_frames = obs_output_get_frames_dropped(output);
+	result->total_frames   = obs_output_get_total_frames(output);
+	result->delivered_kbps = (double)bytes * 8.0 * 1000000.0 /
+		(double)elapsed_ns;
+
+	obs_output_stop(output);
+	if (!wait_for_stop(output))
+		blog(LOG_WARNING, "The %s output took too long to stop",
+				output_names[type]);
+
+	if (type == BENCH_RTMP) {
+		struct rtmp_sink_stats stats;
+		rtmp_sink_get_stats(sink, &stats);
+
+		result->has_latency    = true;
+		result->latency_avg_ms = stats.latency_avg_ms;
+		result->latency_max_ms = stats.latency_max_ms;
+	}
+
+	result->sustained = result->dropped_frames == 0 &&
+		result->delivered_kbps >= (double)bitrate * SUSTAINED_RATIO;
+	success = true;
+
+finish:
+	os_cpu_usage_info_destroy(cpu);
+	obs_output_release(output);
+	obs_service_release(service);
+	obs_encoder_release(video);
+	for (int i = 0; i < p->tracks; i++)
+		obs_encoder_release(audio[i]);
+
+	if (path.len)
+		os_unlink(path.array);
+	dstr_free(&path);
+	return success;
+}
+
+static void print_result(enum bench_output type,
+		const struct bench_result *r)
+{
+	double mbps = r->delivered_kbps / 1000.0;
+
+	printf("%-7s %9lld %10.0f %7.2f %9.3f %7d/%-7d",
+			output_names[type], r->target_kbps,
+			r->delivered_kbps, r->cpu_percent,
+			mbps > 0.0 ? r->cpu_percent / mbps : 0.0,
+			r->dropped_frames, r->total_frames);
+
+	if (r->has_latency)
+		printf(" %8.1f %8.1f", r->latency_avg_ms, r->latency_max_ms);
+	else
+		printf(" %8s %8s", "-", "-");
+
+	printf(" %s\n", r->sustained ? "yes" : "no");
+	fflush(stdout);
+}
+
+static void bench_output(enum bench_output type,
+		const struct bench_params *p)
+{
+	long long bitrate = p->bitrate;
+	long long max_sustained = 0;
+	struct bench_result result;
+
+	do {
+		if (!run_bench(type, p, bitrate, &result))
+			return;
+
+		print_result(type, &result);
+		if (!result.sustained)
+			break;
+
+		max_sustained = bitrate;
+		bitrate *= 2;
+	} while (p->ramp && bitrate <= p->max_bitrate);
+
+	if (p->ramp)
+		printf("%-7s max sustained bitrate: %lld kbps\n\n",
+				output_names[type], max_sustained);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void do_log(int log_level, const char *msg, va_list args, void *param)
+{
+	if (log_level <= LOG_WARNING) {
+		vfprintf(stderr, msg, args);
+		fputc('\n', stderr);
+	}
+
+	UNUSED_PARAMETER(param);
+}
+
+static bool parse_args(int argc, char *argv[], struct bench_params *p)
+{
+	bool any_output = false;
+
+	p->bitrate      = 6000;
+	p->max_bitrate  = 1000000;
+	p->tracks       = 1;
+	p->fps          = 60;
+	p->duration_sec = 10;
+	p->ramp         = false;
+	p->speed        = 1;
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if (strcmp(arg, "--ramp") == 0) {
+			p->ramp = true;
+			continue;
+		}
+		if (!val)
+			return false;
+
+		i++;
+		if (strcmp(arg, "--output") == 0) {
+			for (int type = 0; type < BENCH_COUNT; type++)
+				if (strcmp(val, "all") == 0 ||
+				    strcmp(val, output_names[type]) == 0)
+					p->outputs[type] = any_output = true;
+		} else if (strcmp(arg, "--bitrate") == 0) {
+			p->bitrate = strtoll(val, NULL, 10);
+		} else if (strcmp(arg, "--max-bitrate") == 0) {
+			p->max_bitrate = strtoll(val, NULL, 10);
+		} else if (strcmp(arg, "--tracks") == 0) {
+			p->tracks = atoi(val);
+		} else if (strcmp(arg, "--fps") == 0) {
+			p->fps = (uint32_t)atoi(val);
+		} else if (strcmp(arg, "--duration") == 0) {
+			p->duration_sec = (uint32_t)atoi(val);
+		} else if (strcmp(arg, "--replay") == 0) {
+			p->replay_path = val;
+		} else if (strcmp(arg, "--speed") == 0) {
+			p->speed = (uint32_t)atoi(val);
+		} else {
+			return false;
+		}
+	}
+
+	if (!any_output)
+		for (int type = 0; type < BENCH_COUNT; type++)
+			p->outputs[type] = true;
+
+	return p->bitrate > 0 && p->fps > 0 && p->duration_sec > 0 &&
+		p->speed > 0 && p->tracks >= 1 &&
+		p->tracks <= MAX_AUDIO_MIXES;
+}
+
+/* runs the clocks at the capture's own rates, times the replay speed */
+static void apply_replay(struct bench_params *p, struct obs_video_info *ovi,
+		struct obs_audio_info *oai)
+{
+	int audio_tracks = 0;
+
+	for (size_t i = 0; i < replay.count; i++) {
+		const struct packet_capture_track *info =
+			&replay.tracks[i].info;
+
+		if (info->type == OBS_ENCODER_VIDEO) {
+			ovi->fps_num = (uint32_t)info->timebase_den * p->speed;
+			ovi->fps_den = (uint32_t)info->timebase_num;
+		} else {
+			oai->samples_per_sec = info->sample_rate * p->speed;
+			audio_tracks++;
+		}
+	}
+
+	p->tracks  = audio_tracks < MAX_AUDIO_MIXES ?
+		audio_tracks : MAX_AUDIO_MIXES;
+	p->bitrate = replay_kbps(&replay) * p->speed;
+	p->ramp    = false;
+}
+
+static bool init_obs(struct bench_params *p)
+{
+	struct obs_video_info ovi = {0};
+	struct obs_audio_info oai = {0};
+
+	if (!obs_startup("en-US", NULL, NULL))
+		return false;
+
+#ifdef _WIN32
+	ovi.graphics_module = DL_D3D11;
+#else
+	ovi.graphics_module = DL_OPENGL;
+#endif
+	ovi.fps_num         = p->fps;
+	ovi.fps_den         = 1;
+	ovi.base_width      = 320;
+	ovi.base_height     = 180;
+	ovi.output_width    = 320;
+	ovi.output_height   = 180;
+	ovi.output_format   = VIDEO_FORMAT_NV12;
+	ovi.colorspace      = VIDEO_CS_709;
+	ovi.range           = VIDEO_RANGE_PARTIAL;
+	ovi.scale_type      = OBS_SCALE_BICUBIC;
+	ovi.gpu_conversion  = true;
+
+	oai.samples_per_sec = 48000;
+	oai.speakers        = SPEAKERS_STEREO;
+	oai.buffer_ms       = 1000;
+
+	if (replaying)
+		apply_replay(p, &ovi, &oai);
+
+	if (obs_reset_video(&ovi) != OBS_VIDEO_SUCCESS)
+		return false;
+
+	if (!obs_reset_audio(&oai))
+		return false;
+
+	obs_register_encoder(&bench_video_encoder);
+	obs_register_encoder(&bench_audio_encoder);
+	if (replaying)
+		replay_register_encoders(&replay);
+	obs_load_all_modules();
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_params params = {0};
+	int ret = 0;
+
+#ifdef _WIN32
+	WSADATA wsad;
+	WSAStartup(MAKEWORD(2, 2), &wsad);
+#endif
+
+	if (!parse_args(argc, argv, &params)) {
+		fprintf(stderr, "usage: %s [--output rtmp|flv|ffmpeg|all] "
+				"[--bitrate kbps] [--tracks n] [--fps n] "
+				"[--duration sec] [--ramp] "
+				"[--max-bitrate kbps] [--replay capture] "
+				"[--speed n]\n", argv[0]);
+		return 1;
+	}
+
+	if (params.replay_path) {
+		if (!replay_load(&replay, params.replay_path))
+			return 1;
+		replaying = true;
+	}
+
+	base_set_log_handler(do_log, NULL);
+
+	if (!init_obs(&params)) {
+		fprintf(stderr, "Failed to initialize libobs\n");
+		ret = 1;
+		goto finish;
+	}
+
+	if (params.outputs[BENCH_RTMP]) {
+		sink = rtmp_sink_create();
+		if (!sink) {
+			fprintf(stderr, "Failed to start the RTMP sink\n");
+			params.outputs[BENCH_RTMP] = false;
+		}
+	}
+
+	printf("%-7s %9s %10s %7s %9s %15s %8s %8s %s\n",
+			"output", "kbps", "delivered", "cpu%", "cpu%/Mbps",
+			"dropped/total", "lat avg", "lat max", "sustained");
+
+	for (int type = 0; type < BENCH_COUNT; type++)
+		if (params.outputs[type])
+			bench_output((enum bench_output)type, &params);
+
+	rtmp_sink_destroy(sink);
+
+finish:
+	obs_shutdown();
+	if (replaying)
+		replay_free(&replay);
+#ifdef _WIN32
+	WSACleanup();
+#endif
+	return ret;
+}
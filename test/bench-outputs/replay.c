@@ -0,0 +1,268 @@
+/******************************************************************************
+    Copyright (C) 2016 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <util/file-serializer.h>
+#include "replay.h"
+
+static struct replay *cur_replay = NULL;
+
+/* ------------------------------------------------------------------------- */
+
+static void finish_track(struct replay_track *track)
+{
+	struct encoder_packet *first = track->packets.array;
+	struct encoder_packet *last = da_end(track->packets);
+	size_t num = track->packets.num;
+	int64_t interval;
+
+	if (num < 2) {
+		track->duration   = 1;
+		track->frame_size = 1024;
+		return;
+	}
+
+	interval = (last->dts - first->dts) / (int64_t)(num - 1);
+	if (interval <= 0)
+		interval = 1;
+
+	track->duration   = last->dts - first->dts + interval;
+	track->frame_size = track->info.type == OBS_ENCODER_AUDIO ?
+		(size_t)interval : 1;
+}
+
+static struct replay_track *find_track(struct replay *replay,
+		const struct encoder_packet *packet)
+{
+	for (size_t i = 0; i < replay->count; i++) {
+		struct replay_track *track = &replay->tracks[i];
+
+		if (track->info.type != packet->type)
+			continue;
+		if (packet->type == OBS_ENCODER_VIDEO ||
+		    track->info.track_idx == packet->track_idx)
+			return track;
+	}
+
+	return NULL;
+}
+
+bool replay_load(struct replay *replay, const char *path)
+{
+	struct packet_capture_track tracks[PACKET_CAPTURE_MAX_TRACKS];
+	struct serializer s;
+	struct encoder_packet packet;
+	int64_t first_usec = 0, last_usec = 0;
+	bool first = true;
+
+	memset(replay, 0, sizeof(*replay));
+	replay->video_track = -1;
+
+	if (!file_input_serializer_init(&s, path)) {
+		blog(LOG_ERROR, "Could not open capture '%s'", path);
+		return false;
+	}
+
+	replay->count = packet_capture_read_header(&s, tracks);
+	if (!replay->count) {
+		blog(LOG_ERROR, "'%s' is not a valid packet capture", path);
+		file_input_serializer_free(&s);
+		return false;
+	}
+
+	for (size_t i = 0; i < replay->count; i++) {
+		replay->tracks[i].info = tracks[i];
+		if (tracks[i].type == OBS_ENCODER_VIDEO)
+			replay->video_track = (int)i;
+	}
+
+	while (packet_capture_read_packet(&s, &packet)) {
+		struct replay_track *track = find_track(replay, &packet);
+
+		if (!track) {
+			bfree(packet.data);
+			continue;
+		}
+
+		if (first) {
+			first_usec = packet.dts_usec;
+			first = false;
+		}
+		last_usec = packet.dts_usec;
+
+		replay->total_bytes += packet.size;
+		da_push_back(track->packets, &packet);
+	}
+
+	file_input_serializer_free(&s);
+
+	for (size_t i = 0; i < replay->count; i++) {
+		if (!replay->tracks[i].packets.num) {
+			blog(LOG_ERROR, "Track %d of '%s' has no packets",
+					(int)i, path);
+			replay_free(replay);
+			return false;
+		}
+
+		finish_track(&replay->tracks[i]);
+	}
+
+	replay->duration_usec = last_usec - first_usec;
+	return true;
+}
+
+void replay_free(struct replay *replay)
+{
+	for (size_t i = 0; i < replay->count; i++) {
+		struct replay_track *track = &replay->tracks[i];
+
+		for (size_t j = 0; j < track->packets.num; j++)
+			bfree(track->packets.array[j].data);
+		da_free(track->packets);
+		packet_capture_free_tracks(&track->info, 1);
+	}
+
+	memset(replay, 0, sizeof(*replay));
+}
+
+long long replay_kbps(const struct replay *replay)
+{
+	if (replay->duration_usec <= 0)
+		return 0;
+
+	return (long long)(replay->total_bytes * 8 * 1000 /
+			(uint64_t)replay->duration_usec);
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct replay_encoder {
+	struct replay_track *track;
+	size_t              next;
+	int64_t             base;
+	int64_t             offset;
+};
+
+static const char *replay_video_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Packet Capture Replay (video)";
+}
+
+static const char *replay_audio_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Packet Capture Replay (audio)";
+}
+
+static void *replay_create(obs_data_t *settings, obs_encoder_t *encoder)
+{
+	size_t idx = (size_t)obs_data_get_int(settings, "track");
+	struct replay_encoder *enc;
+
+	if (!cur_replay || idx >= cur_replay->count ||
+	    cur_replay->tracks[idx].info.type !=
+	    obs_encoder_get_type(encoder))
+		return NULL;
+
+	enc = bzalloc(sizeof(*enc));
+	enc->track = &cur_replay->tracks[idx];
+	enc->base  = enc->track->packets.array[0].dts;
+	return enc;
+}
+
+static void replay_destroy(void *data)
+{
+	bfree(data);
+}
+
+static bool replay_encode(void *data, struct encoder_frame *frame,
+		struct encoder_packet *packet, bool *received_packet)
+{
+	struct replay_encoder *enc = data;
+	struct encoder_packet *src = &enc->track->packets.array[enc->next];
+
+	packet->data     = src->data;
+	packet->size     = src->size;
+	packet->type     = src->type;
+	packet->keyframe = src->keyframe;
+	packet->priority = src->priority;
+	packet->pts      = src->pts - enc->base + enc->offset;
+	packet->dts      = src->dts - enc->base + enc->offset;
+	*received_packet = true;
+
+	if (++enc->next == enc->track->packets.num) {
+		enc->next = 0;
+		enc->offset += enc->track->duration;
+	}
+
+	UNUSED_PARAMETER(frame);
+	return true;
+}
+
+static size_t replay_frame_size(void *data)
+{
+	struct replay_encoder *enc = data;
+	return enc->track->frame_size;
+}
+
+static bool replay_extra_data(void *data, uint8_t **extra_data, size_t *size)
+{
+	struct replay_encoder *enc = data;
+
+	*extra_data = enc->track->info.extra_data;
+	*size       = enc->track->info.extra_data_size;
+	return *size != 0;
+}
+
+static void replay_audio_info(void *data, struct audio_convert_info *info)
+{
+	info->format = AUDIO_FORMAT_FLOAT_PLANAR;
+	UNUSED_PARAMETER(data);
+}
+
+/* the SEI is already part of the first captured video packet, so there's no
+ * get_sei_data here */
+static struct obs_encoder_info replay_video_encoder = {
+	.id             = "replay_video",
+	.type           = OBS_ENCODER_VIDEO,
+	.codec          = "h264",
+	.get_name       = replay_video_name,
+	.create         = replay_create,
+	.destroy        = replay_destroy,
+	.encode         = replay_encode,
+	.get_extra_data = replay_extra_data
+};
+
+static struct obs_encoder_info replay_audio_encoder = {
+	.id             = "replay_audio",
+	.type           = OBS_ENCODER_AUDIO,
+	.codec          = "AAC",
+	.get_name       = replay_audio_name,
+	.create         = replay_create,
+	.destroy        = replay_destroy,
+	.encode         = replay_encode,
+	.get_frame_size = replay_frame_size,
+	.get_extra_data = replay_extra_data,
+	.get_audio_info = replay_audio_info
+};
+
+void replay_register_encoders(struct replay *replay)
+{
+	cur_replay = replay;
+	obs_register_encoder(&replay_video_encoder);
+	obs_register_encoder(&replay_audio_encoder);
+}
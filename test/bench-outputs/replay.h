@@ -0,0 +1,56 @@
+/******************************************************************************
+    Copyright (C) 2016 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <util/darray.h>
+#include "packet-capture.h"
+
+/*
+ * Replays a packet capture (see plugins/obs-outputs/packet-capture.h)
+ * through the "replay_video" and "replay_audio" encoders.  They hand out the
+ * captured packets instead of encoding anything, one per frame, looping
+ * back to the start of the capture with timestamps that keep going.
+ */
+
+struct replay_track {
+	struct packet_capture_track   info;
+	DARRAY(struct encoder_packet) packets;
+
+	/* in the track's timebase, added to the timestamps on every loop */
+	int64_t                       duration;
+	size_t                        frame_size;
+};
+
+struct replay {
+	struct replay_track tracks[PACKET_CAPTURE_MAX_TRACKS];
+	size_t              count;
+	int                 video_track;
+
+	uint64_t            total_bytes;
+	int64_t             duration_usec;
+};
+
+extern bool replay_load(struct replay *replay, const char *path);
+extern void replay_free(struct replay *replay);
+
+/* bitrate of the capture when replayed at its original speed */
+extern long long replay_kbps(const struct replay *replay);
+
+/* registers the replay encoders, which then use the given capture.  their
+ * "track" setting selects the track of the capture they replay */
+extern void replay_register_encoders(struct replay *replay);
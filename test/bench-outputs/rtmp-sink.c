@@ -0,0 +1,389 @@
+/******************************************************************************
+    Copyright (C) 2016 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include "librtmp/rtmp.h"
+#include "librtmp/amf.h"
+#include "rtmp-sink.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#define SHUT_RDWR SD_BOTH
+typedef int socklen_t;
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#define closesocket close
+#define INVALID_SOCKET -1
+#endif
+
+#define SAVC(x) static const AVal av_##x = {(char*)#x, sizeof(#x) - 1}
+#define STR2AVAL(av, str) \
+	do { av.av_val = (char*)str; av.av_len = (int)strlen(str); } while (0)
+
+SAVC(connect);
+SAVC(createStream);
+SAVC(publish);
+SAVC(_result);
+SAVC(onStatus);
+SAVC(level);
+SAVC(code);
+SAVC(description);
+SAVC(fmsVer);
+SAVC(capabilities);
+SAVC(objectEncoding);
+
+struct rtmp_sink {
+	SOCKET          listen_sock;
+	SOCKET          client_sock;
+	int             port;
+
+	pthread_t       thread;
+	bool            stopping;
+
+	pthread_mutex_t mutex;
+	uint64_t        bytes;
+	uint64_t        packets;
+	double          latency_min_ms;
+	double          latency_max_ms;
+	double          latency_sum_ms;
+	uint64_t        latency_count;
+};
+
+/* ------------------------------------------------------------------------- */
+
+static bool send_invoke(RTMP *r, int stream_id, char *body, char *end)
+{
+	RTMPPacket packet = {0};
+
+	packet.m_nChannel    = 0x03;
+	packet.m_headerType  = RTMP_PACKET_SIZE_LARGE;
+	packet.m_packetType  = RTMP_PACKET_TYPE_INVOKE;
+	packet.m_nInfoField2 = stream_id;
+	packet.m_body        = body;
+	packet.m_nBodySize   = (uint32_t)(end - body);
+
+	return RTMP_SendPacket(r, &packet, false) != 0;
+}
+
+static char *encode_status(char *enc, char *end, const char *code,
+		const char *description)
+{
+	AVal val;
+
+	*enc++ = AMF_OBJECT;
+	STR2AVAL(val, "status");
+	enc = AMF_EncodeNamedString(enc, end, &av_level, &val);
+	STR2AVAL(val, code);
+	enc = AMF_EncodeNamedString(enc, end, &av_code, &val);
+	STR2AVAL(val, description);
+	enc = AMF_EncodeNamedString(enc, end, &av_description, &val);
+	enc = AMF_EncodeNamedNumber(enc, end, &av_objectEncoding, 0.0);
+	*enc++ = 0;
+	*enc++ = 0;
+	*enc++ = AMF_OBJECT_END;
+	return enc;
+}
+
+static bool send_connect_result(RTMP *r, double txn)
+{
+	char buf[512 + RTMP_MAX_HEADER_SIZE];
+	char *body = buf + RTMP_MAX_HEADER_SIZE;
+	char *end  = buf + sizeof(buf);
+	char *enc  = body;
+	AVal val;
+
+	enc = AMF_EncodeString(enc, end, &av__result);
+	enc = AMF_EncodeNumber(enc, end, txn);
+	*enc++ = AMF_OBJECT;
+	STR2AVAL(val, "FMS/3,5,7,7009");
+	enc = AMF_EncodeNamedString(enc, end, &av_fmsVer, &val);
+	enc = AMF_EncodeNamedNumber(enc, end, &av_capabilities, 31.0);
+	*enc++ = 0;
+	*enc++ = 0;
+	*enc++ = AMF_OBJECT_END;
+	enc = encode_status(enc, end, "NetConnection.Connect.Success",
+			"Connection succeeded.");
+
+	return send_invoke(r, 0, body, enc);
+}
+
+static bool send_create_stream_result(RTMP *r, double txn, int stream_id)
+{
+	char buf[64 + RTMP_MAX_HEADER_SIZE];
+	char *body = buf + RTMP_MAX_HEADER_SIZE;
+	char *end  = buf + sizeof(buf);
+	char *enc  = body;
+
+	enc = AMF_EncodeString(enc, end, &av__result);
+	enc = AMF_EncodeNumber(enc, end, txn);
+	*enc++ = AMF_NULL;
+	enc = AMF_EncodeNumber(enc, end, (double)stream_id);
+
+	return send_invoke(r, 0, body, enc);
+}
+
+static bool send_publish_start(RTMP *r, int stream_id)
+{
+	char buf[512 + RTMP_MAX_HEADER_SIZE];
+	char *body = buf + RTMP_MAX_HEADER_SIZE;
+	char *end  = buf + sizeof(buf);
+	char *enc  = body;
+
+	enc = AMF_EncodeString(enc, end, &av_onStatus);
+	enc = AMF_EncodeNumber(enc, end, 0.0);
+	*enc++ = AMF_NULL;
+	enc = encode_status(enc, end, "NetStream.Publish.Start",
+			"Publishing.");
+
+	return send_invoke(r, stream_id, body, enc);
+}
+
+static bool handle_invoke(RTMP *r, RTMPPacket *packet, int *next_stream_id)
+{
+	AMFObject obj;
+	AVal method;
+	double txn;
+	bool success = true;
+
+	if (packet->m_body[0] != AMF_STRING)
+		return true;
+	if (AMF_Decode(&obj, packet->m_body, (int)packet->m_nBodySize,
+				false) < 0)
+		return false;
+
+	AMFProp_GetString(AMF_GetProp(&obj, NULL, 0), &method);
+	txn = AMFProp_GetNumber(AMF_GetProp(&obj, NULL, 1));
+
+	if (AVMATCH(&method, &av_connect))
+		success = send_connect_result(r, txn);
+	else if (AVMATCH(&method, &av_createStream))
+		success = send_create_stream_result(r, txn,
+				(*next_stream_id)++);
+	else if (AVMATCH(&method, &av_publish))
+		success = send_publish_start(r, packet->m_nInfoField2);
+
+	AMF_Reset(&obj);
+	return success;
+}
+
+static void count_media(struct rtmp_sink *sink, RTMPPacket *packet,
+		uint64_t start_ms, uint32_t first_ts)
+{
+	uint64_t now_ms = os_gettime_ns() / 1000000;
+	double latency = (double)(now_ms - start_ms) -
+		(double)(int32_t)(packet->m_nTimeStamp - first_ts);
+
+	pthread_mutex_lock(&sink->mutex);
+	sink->bytes += packet->m_nBodySize;
+	sink->packets++;
+
+	if (!sink->latency_count || latency < sink->latency_min_ms)
+		sink->latency_min_ms = latency;
+	if (!sink->latency_count || latency > sink->latency_max_ms)
+		sink->latency_max_ms = latency;
+	sink->latency_sum_ms += latency;
+	sink->latency_count++;
+	pthread_mutex_unlock(&sink->mutex);
+}
+
+static void serve_client(struct rtmp_sink *sink, SOCKET sock)
+{
+	RTMP r;
+	RTMPPacket packet = {0};
+	int next_stream_id = 1;
+	bool started = false;
+	uint64_t start_ms = 0;
+	uint32_t first_ts = 0;
+
+	RTMP_Init(&r);
+	r.m_sb.sb_socket = sock;
+
+	if (!RTMP_Serve(&r))
+		goto finish;
+
+	while (RTMP_IsConnected(&r) && RTMP_ReadPacket(&r, &packet)) {
+		if (!RTMPPacket_IsReady(&packet))
+			continue;
+
+		switch (packet.m_packetType) {
+		case RTMP_PACKET_TYPE_CHUNK_SIZE:
+			if (packet.m_nBodySize >= 4)
+				r.m_inChunkSize = AMF_DecodeInt32(
+						packet.m_body);
+			break;
+
+		case RTMP_PACKET_TYPE_INVOKE:
+			if (!handle_invoke(&r, &packet, &next_stream_id))
+				goto finish;
+			break;
+
+		case RTMP_PACKET_TYPE_AUDIO:
+		case RTMP_PACKET_TYPE_VIDEO:
+		case RTMP_PACKET_TYPE_FLASH_VIDEO:
+			if (!started) {
+				start_ms = os_gettime_ns() / 1000000;
+				first_ts = packet.m_nTimeStamp;
+				started  = true;
+			}
+			count_media(sink, &packet, start_ms, first_ts);
+			break;
+
+		case RTMP_PACKET_TYPE_INFO:
+			pthread_mutex_lock(&sink->mutex);
+			sink->bytes += packet.m_nBodySize;
+			pthread_mutex_unlock(&sink->mutex);
+			break;
+		}
+
+		RTMPPacket_Free(&packet);
+	}
+
+finish:
+	RTMPPacket_Free(&packet);
+	RTMP_Close(&r);
+}
+
+static void *sink_thread(void *data)
+{
+	struct rtmp_sink *sink = data;
+
+	os_set_thread_name("rtmp-sink");
+
+	while (!sink->stopping) {
+		SOCKET sock = accept(sink->listen_sock, NULL, NULL);
+		if (sock == INVALID_SOCKET)
+			break;
+
+		pthread_mutex_lock(&sink->mutex);
+		sink->client_sock = sock;
+		pthread_mutex_unlock(&sink->mutex);
+
+		serve_client(sink, sock);
+
+		pthread_mutex_lock(&sink->mutex);
+		sink->client_sock = INVALID_SOCKET;
+		pthread_mutex_unlock(&sink->mutex);
+	}
+
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct rtmp_sink *rtmp_sink_create(void)
+{
+	struct rtmp_sink *sink = bzalloc(sizeof(*sink));
+	struct sockaddr_in addr = {0};
+	socklen_t addr_len = sizeof(addr);
+
+	sink->client_sock = INVALID_SOCKET;
+	sink->listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (sink->listen_sock == INVALID_SOCKET)
+		goto fail;
+
+	addr.sin_family      = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port        = 0;
+
+	if (bind(sink->listen_sock, (struct sockaddr*)&addr, addr_len) != 0)
+		goto fail;
+	if (listen(sink->listen_sock, 4) != 0)
+		goto fail;
+	if (getsockname(sink->listen_sock, (struct sockaddr*)&addr,
+				&addr_len) != 0)
+		goto fail;
+
+	sink->port = ntohs(addr.sin_port);
+
+	if (pthread_mutex_init(&sink->mutex, NULL) != 0)
+		goto fail;
+	if (pthread_create(&sink->thread, NULL, sink_thread, sink) != 0) {
+		pthread_mutex_destroy(&sink->mutex);
+		goto fail;
+	}
+
+	return sink;
+
+fail:
+	if (sink->listen_sock != INVALID_SOCKET)
+		closesocket(sink->listen_sock);
+	bfree(sink);
+	return NULL;
+}
+
+void rtmp_sink_destroy(struct rtmp_sink *sink)
+{
+	if (!sink)
+		return;
+
+	sink->stopping = true;
+
+	/* wakes up both accept() and the client read */
+	shutdown(sink->listen_sock, SHUT_RDWR);
+	closesocket(sink->listen_sock);
+
+	pthread_mutex_lock(&sink->mutex);
+	if (sink->client_sock != INVALID_SOCKET)
+		shutdown(sink->client_sock, SHUT_RDWR);
+	pthread_mutex_unlock(&sink->mutex);
+
+	pthread_join(sink->thread, NULL);
+	pthread_mutex_destroy(&sink->mutex);
+	bfree(sink);
+}
+
+int rtmp_sink_port(const struct rtmp_sink *sink)
+{
+	return sink->port;
+}
+
+void rtmp_sink_reset(struct rtmp_sink *sink)
+{
+	pthread_mutex_lock(&sink->mutex);
+	sink->bytes          = 0;
+	sink->packets        = 0;
+	sink->latency_min_ms = 0.0;
+	sink->latency_max_ms = 0.0;
+	sink->latency_sum_ms = 0.0;
+	sink->latency_count  = 0;
+	pthread_mutex_unlock(&sink->mutex);
+}
+
+void rtmp_sink_get_stats(struct rtmp_sink *sink,
+		struct rtmp_sink_stats *stats)
+{
+	pthread_mutex_lock(&sink->mutex);
+	stats->bytes   = sink->bytes;
+	stats->packets = sink->packets;
+
+	if (sink->latency_count) {
+		stats->latency_avg_ms = sink->latency_sum_ms /
+			(double)sink->latency_count - sink->latency_min_ms;
+		stats->latency_max_ms = sink->latency_max_ms -
+			sink->latency_min_ms;
+	} else {
+		stats->latency_avg_ms = 0.0;
+		stats->latency_max_ms = 0.0;
+	}
+	pthread_mutex_unlock(&sink->mutex);
+}
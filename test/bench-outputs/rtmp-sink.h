@@ -0,0 +1,48 @@
+/******************************************************************************
+    Copyright (C) 2016 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Minimal loopback RTMP ingest.  Accepts publishing clients on 127.0.0.1,
+ * answers just enough of the connect/createStream/publish sequence to get
+ * media flowing, and then only counts what arrives.
+ */
+
+struct rtmp_sink;
+
+struct rtmp_sink_stats {
+	uint64_t bytes;
+	uint64_t packets;
+
+	/* how much later than the least-delayed packet packets arrived,
+	 * going by their timestamps */
+	double   latency_avg_ms;
+	double   latency_max_ms;
+};
+
+extern struct rtmp_sink *rtmp_sink_create(void);
+extern void rtmp_sink_destroy(struct rtmp_sink *sink);
+
+extern int rtmp_sink_port(const struct rtmp_sink *sink);
+
+/* resets the counters, for the next connection */
+extern void rtmp_sink_reset(struct rtmp_sink *sink);
+extern void rtmp_sink_get_stats(struct rtmp_sink *sink,
+		struct rtmp_sink_stats *stats);
@@ -0,0 +1,800 @@
+/******************************************************************************
+    Copyright (C) 2016 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * Video pipeline benchmark.  Starts libobs without any display, fills a
+ * scene with synthetic texture sources that each have a chain of filters,
+ * and pushes a fixed number of frames through rendering, GPU conversion,
+ * readback and a synthetic encoder that reads every frame it's given.
+ *
+ *   bench-pipeline [--sources n] [--filters n] [--frames n] [--fps n]
+ *                  [--width n] [--height n] [--json file]
+ *
+ * The results are written as JSON (to stdout unless --json is given): the
+ * profiler tree, including GPU times when the renderer supports timer
+ * queries, the video thread's per-stage timings, how many frames were
+ * missed, and the CPU time used.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+
+#include <obs.h>
+#include <util/base.h>
+#include <util/platform.h>
+#include <util/profiler.h>
+#include <util/threading.h>
+
+/* extra time allowed on top of the expected run time before giving up */
+#define RUN_TIMEOUT_MS  10000
+#define STOP_TIMEOUT_MS 10000
+
+/* ------------------------------------------------------------------------- */
+/* synthetic source */
+
+struct bench_source {
+	gs_texture_t *texture;
+	uint32_t     cx;
+	uint32_t     cy;
+};
+
+static const char *bench_source_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Benchmark Source";
+}
+
+static void *bench_source_create(obs_data_t *settings, obs_source_t *source)
+{
+	struct bench_source *bs = bzalloc(sizeof(*bs));
+	uint32_t seed = (uint32_t)obs_data_get_int(settings, "seed");
+	uint32_t *pixels;
+
+	bs->cx = (uint32_t)obs_data_get_int(settings, "width");
+	bs->cy = (uint32_t)obs_data_get_int(settings, "height");
+	if (!bs->cx || !bs->cy) {
+		bfree(bs);
+		return NULL;
+	}
+
+	pixels = bmalloc(bs->cx * bs->cy * sizeof(uint32_t));
+	for (uint32_t y = 0; y < bs->cy; y++)
+		for (uint32_t x = 0; x < bs->cx; x++)
+			pixels[y * bs->cx + x] = 0xFF000000 |
+				((x * 4 + seed * 40) & 0xFF) << 16 |
+				((y * 4 + seed * 80) & 0xFF) << 8 |
+				((x + y + seed * 20) & 0xFF);
+
+	obs_enter_graphics();
+	bs->texture = gs_texture_create(bs->cx, bs->cy, GS_RGBA, 1,
+			(const uint8_t**)&pixels, 0);
+	obs_leave_graphics();
+
+	bfree(pixels);
+
+	if (!bs->texture) {
+		bfree(bs);
+		return NULL;
+	}
+
+	UNUSED_PARAMETER(source);
+	return bs;
+}
+
+static void bench_source_destroy(void *data)
+{
+	struct bench_source *bs = data;
+
+	obs_enter_graphics();
+	gs_texture_destroy(bs->texture);
+	obs_leave_graphics();
+
+	bfree(bs);
+}
+
+static void bench_source_render(void *data, gs_effect_t *effect)
+{
+	struct bench_source *bs = data;
+	obs_source_draw(bs->texture, 0, 0, 0, 0, false);
+
+	UNUSED_PARAMETER(effect);
+}
+
+static uint32_t bench_source_width(void *data)
+{
+	struct bench_source *bs = data;
+	return bs->cx;
+}
+
+static uint32_t bench_source_height(void *data)
+{
+	struct bench_source *bs = data;
+	return bs->cy;
+}
+
+static struct obs_source_info bench_source = {
+	.id           = "bench_source",
+	.type         = OBS_SOURCE_TYPE_INPUT,
+	.output_flags = OBS_SOURCE_VIDEO,
+	.get_name     = bench_source_name,
+	.create       = bench_source_create,
+	.destroy      = bench_source_destroy,
+	.video_render = bench_source_render,
+	.get_width    = bench_source_width,
+	.get_height   = bench_source_height
+};
+
+/* ------------------------------------------------------------------------- */
+/* synthetic filter, always renders through its own texture */
+
+static const char *bench_filter_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Benchmark Filter";
+}
+
+static void *bench_filter_create(obs_data_t *settings, obs_source_t *source)
+{
+	UNUSED_PARAMETER(settings);
+	return source;
+}
+
+static void bench_filter_destroy(void *data)
+{
+	UNUSED_PARAMETER(data);
+}
+
+static void bench_filter_render(void *data, gs_effect_t *effect)
+{
+	obs_source_t *filter = data;
+
+	obs_source_process_filter_begin(filter, GS_RGBA,
+			OBS_NO_DIRECT_RENDERING);
+	obs_source_process_filter_end(filter, obs_get_default_effect(), 0, 0);
+
+	UNUSED_PARAMETER(effect);
+}
+
+static struct obs_source_info bench_filter = {
+	.id           = "bench_filter",
+	.type         = OBS_SOURCE_TYPE_FILTER,
+	.output_flags = OBS_SOURCE_VIDEO,
+	.get_name     = bench_filter_name,
+	.create       = bench_filter_create,
+	.destroy      = bench_filter_destroy,
+	.video_render = bench_filter_render
+};
+
+/* ------------------------------------------------------------------------- */
+/* synthetic encoder, reads all of every frame like a real encoder would */
+
+struct bench_encoder {
+	obs_encoder_t *encoder;
+	uint64_t      checksum;
+	uint8_t       packet[16];
+};
+
+static const char *bench_encoder_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Benchmark Encoder";
+}
+
+static void *bench_encoder_create(obs_data_t *settings,
+		obs_encoder_t *encoder)
+{
+	struct bench_encoder *enc = bzalloc(sizeof(*enc));
+	enc->encoder = encoder;
+
+	UNUSED_PARAMETER(settings);
+	return enc;
+}
+
+static void bench_encoder_destroy(void *data)
+{
+	bfree(data);
+}
+
+static bool bench_encoder_encode(void *data, struct encoder_frame *frame,
+		struct encoder_packet *packet, bool *received_packet)
+{
+	struct bench_encoder *enc = data;
+	video_t *video = obs_encoder_video(enc->encoder);
+	const struct video_output_info *voi = video_output_get_info(video);
+	uint64_t sum = 0;
+
+	for (size_t plane = 0; plane < MAX_AV_PLANES; plane++) {
+		uint32_t height = plane ? voi->height / 2 : voi->height;
+		const uint8_t *line = frame->data[plane];
+
+		if (!line)
+			break;
+
+		for (uint32_t y = 0; y < height; y++) {
+			for (uint32_t x = 0; x < frame->linesize[plane]; x++)
+				sum += line[x];
+			line += frame->linesize[plane];
+		}
+	}
+
+	enc->checksum += sum;
+	memcpy(enc->packet, &enc->checksum, sizeof(enc->checksum));
+
+	packet->data     = enc->packet;
+	packet->size     = sizeof(enc->packet);
+	packet->type     = OBS_ENCODER_VIDEO;
+	packet->pts      = frame->pts;
+	packet->dts      = frame->pts;
+	packet->keyframe = true;
+	*received_packet = true;
+	return true;
+}
+
+static struct obs_encoder_info bench_encoder = {
+	.id       = "bench_encoder",
+	.type     = OBS_ENCODER_VIDEO,
+	.codec    = "bench",
+	.get_name = bench_encoder_name,
+	.create   = bench_encoder_create,
+	.destroy  = bench_encoder_destroy,
+	.encode   = bench_encoder_encode
+};
+
+/* ------------------------------------------------------------------------- */
+/* output that counts the encoded frames */
+
+/* outputs don't expose their data, only one is run at a time anyway */
+static struct bench_output *cur_output = NULL;
+
+struct bench_output {
+	obs_output_t  *output;
+	volatile long packets;
+	long          target;
+	os_event_t    *done;
+};
+
+static const char *bench_output_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Benchmark Output";
+}
+
+static void *bench_output_create(obs_data_t *settings, obs_output_t *output)
+{
+	struct bench_output *bo = bzalloc(sizeof(*bo));
+	bo->output = output;
+	bo->target = (long)obs_data_get_int(settings, "frames");
+
+	if (os_event_init(&bo->done, OS_EVENT_TYPE_MANUAL) != 0) {
+		bfree(bo);
+		return NULL;
+	}
+
+	cur_output = bo;
+	return bo;
+}
+
+static void bench_output_destroy(void *data)
+{
+	struct bench_output *bo = data;
+
+	if (cur_output == bo)
+		cur_output = NULL;
+
+	os_event_destroy(bo->done);
+	bfree(bo);
+}
+
+static bool bench_output_start(void *data)
+{
+	struct bench_output *bo = data;
+
+	if (!obs_output_can_begin_data_capture(bo->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(bo->output, 0))
+		return false;
+
+	return obs_output_begin_data_capture(bo->output, 0);
+}
+
+static void bench_output_stop(void *data)
+{
+	struct bench_output *bo = data;
+	obs_output_end_data_capture(bo->output);
+}
+
+static void bench_output_packet(void *data, struct encoder_packet *packet)
+{
+	struct bench_output *bo = data;
+
+	if (os_atomic_inc_long(&bo->packets) == bo->target)
+		os_event_signal(bo->done);
+
+	UNUSED_PARAMETER(packet);
+}
+
+static struct obs_output_info bench_output = {
+	.id             = "bench_output",
+	.flags          = OBS_OUTPUT_VIDEO | OBS_OUTPUT_ENCODED,
+	.get_name       = bench_output_name,
+	.create         = bench_output_create,
+	.destroy        = bench_output_destroy,
+	.start          = bench_output_start,
+	.stop           = bench_output_stop,
+	.encoded_packet = bench_output_packet
+};
+
+/* ------------------------------------------------------------------------- */
+/* scene setup */
+
+struct bench_params {
+	uint32_t   sources;
+	uint32_t   filters;
+	uint32_t   frames;
+	uint32_t   fps;
+	uint32_t   width;
+	uint32_t   height;
+	const char *json_path;
+};
+
+/* lays the sources out in a grid that covers the whole canvas */
+static obs_scene_t *create_scene(const struct bench_params *p)
+{
+	obs_scene_t *scene = obs_scene_create("bench scene");
+	uint32_t cols = (uint32_t)ceil(sqrt((double)p->sources));
+	uint32_t rows = (p->sources + cols - 1) / cols;
+	uint32_t cx = p->width / cols;
+	uint32_t cy = p->height / rows;
+
+	if (!cx) cx = 1;
+	if (!cy) cy = 1;
+
+	for (uint32_t i = 0; i < p->sources; i++) {
+		obs_data_t *settings = obs_data_create();
+		obs_source_t *source;
+		obs_sceneitem_t *item;
+		struct vec2 pos;
+
+		obs_data_set_int(settings, "width", cx);
+		obs_data_set_int(settings, "height", cy);
+		obs_data_set_int(settings, "seed", i);
+		source = obs_source_create(OBS_SOURCE_TYPE_INPUT,
+				"bench_source", "bench source", settings,
+				NULL);
+		obs_data_release(settings);
+
+		if (!source) {
+			obs_scene_release(scene);
+			return NULL;
+		}
+
+		for (uint32_t j = 0; j < p->filters; j++) {
+			obs_source_t *filter = obs_source_create(
+					OBS_SOURCE_TYPE_FILTER,
+					"bench_filter", "bench filter",
+					NULL, NULL);
+			obs_source_filter_add(source, filter);
+			obs_source_release(filter);
+		}
+
+		item = obs_scene_add(scene, source);
+		vec2_set(&pos, (float)(cx * (i % cols)),
+				(float)(cy * (i / cols)));
+		obs_sceneitem_set_pos(item, &pos);
+
+		obs_source_release(source);
+	}
+
+	return scene;
+}
+
+/* ------------------------------------------------------------------------- */
+/* results */
+
+struct bench_result {
+	long     frames_encoded;
+	bool     timed_out;
+	uint64_t elapsed_ns;
+	double   cpu_percent;
+	double   cpu_time_ms;
+	uint32_t frames_skipped;
+	uint32_t frames_total;
+
+	struct obs_video_frame_timing    frame_timing;
+	struct obs_video_pipeline_timing pipeline_timing;
+};
+
+static obs_data_t *snapshot_entry_to_data(profiler_snapshot_entry_t *entry);
+
+static bool add_child_entry(void *context, profiler_snapshot_entry_t *entry)
+{
+	obs_data_array_t *array = context;
+	obs_data_t *child = snapshot_entry_to_data(entry);
+
+	obs_data_array_push_back(array, child);
+	obs_data_release(child);
+	return true;
+}
+
+static obs_data_t *snapshot_entry_to_data(profiler_snapshot_entry_t *entry)
+{
+	profiler_time_entries_t *times = profiler_snapshot_entry_times(entry);
+	uint64_t count = profiler_snapshot_entry_overall_count(entry);
+	obs_data_t *data = obs_data_create();
+	obs_data_array_t *children;
+	uint64_t total = 0;
+	uint64_t median = 0;
+	uint64_t seen = 0;
+
+	/* times are sorted from longest to shortest */
+	for (size_t i = 0; i < times->num; i++) {
+		total += times->array[i].time_delta * times->array[i].count;
+		seen  += times->array[i].count;
+		if (!median && seen * 2 >= count)
+			median = times->array[i].time_delta;
+	}
+
+	obs_data_set_string(data, "name",
+			profiler_snapshot_entry_name(entry));
+	obs_data_set_int(data, "count", (long long)count);
+	obs_data_set_int(data, "min_us", (long long)
+			(count ? profiler_snapshot_entry_min_time(entry) : 0));
+	obs_data_set_int(data, "max_us", (long long)
+			profiler_snapshot_entry_max_time(entry));
+	obs_data_set_int(data, "median_us", (long long)median);
+	obs_data_set_double(data, "avg_us",
+			count ? (double)total / (double)count : 0.0);
+
+	if (profiler_snapshot_num_children(entry)) {
+		children = obs_data_array_create();
+		profiler_snapshot_enumerate_children(entry, add_child_entry,
+				children);
+		obs_data_set_array(data, "children", children);
+		obs_data_array_release(children);
+	}
+
+	return data;
+}
+
+static void set_timing(obs_data_t *stages, const char *name,
+		const struct video_timing *timing)
+{
+	obs_data_t *data = obs_data_create();
+
+	obs_data_set_int(data, "count", (long long)timing->count);
+	obs_data_set_int(data, "over_budget", (long long)timing->over_budget);
+	obs_data_set_double(data, "avg_ms", (double)timing->avg_ns / 1e6);
+	obs_data_set_double(data, "max_ms", (double)timing->max_ns / 1e6);
+	obs_data_set_obj(stages, name, data);
+
+	obs_data_release(data);
+}
+
+static const char *stage_names[OBS_VIDEO_STAGE_COUNT] = {
+	"tick_sources",
+	"render_displays",
+	"render_video",
+	"download_frame",
+	"output_video_data"
+};
+
+static obs_data_t *create_results(const struct bench_params *p,
+		const struct bench_result *r, profiler_snapshot_t *snap)
+{
+	obs_data_t *results = obs_data_create();
+	obs_data_t *config = obs_data_create();
+	obs_data_t *frames = obs_data_create();
+	obs_data_t *stages = obs_data_create();
+	obs_data_array_t *profiler = obs_data_array_create();
+	double elapsed_ms = (double)r->elapsed_ns / 1e6;
+
+	obs_data_set_int(config, "sources", p->sources);
+	obs_data_set_int(config, "filters", p->filters);
+	obs_data_set_int(config, "frames", p->frames);
+	obs_data_set_int(config, "fps", p->fps);
+	obs_data_set_int(config, "width", p->width);
+	obs_data_set_int(config, "height", p->height);
+	obs_data_set_obj(results, "config", config);
+
+	obs_data_set_int(frames, "encoded", r->frames_encoded);
+	obs_data_set_int(frames, "output", r->frames_total);
+	obs_data_set_int(frames, "skipped", r->frames_skipped);
+	obs_data_set_int(frames, "lagged",
+			(long long)r->frame_timing.lagged_frames);
+	obs_data_set_int(frames, "readback_stalls",
+			(long long)r->pipeline_timing.readback_stalls);
+	obs_data_set_int(frames, "readback_failures",
+			(long long)r->pipeline_timing.readback_failures);
+	obs_data_set_bool(frames, "timed_out", r->timed_out);
+	obs_data_set_obj(results, "frames", frames);
+
+	for (int i = 0; i < OBS_VIDEO_STAGE_COUNT; i++)
+		set_timing(stages, stage_names[i],
+				&r->pipeline_timing.stages[i]);
+	set_timing(stages, "output_callbacks",
+			&r->pipeline_timing.callbacks);
+	obs_data_set_obj(results, "stages", stages);
+
+	obs_data_set_double(results, "elapsed_ms", elapsed_ms);
+	obs_data_set_double(results, "fps_achieved", elapsed_ms > 0.0 ?
+			(double)r->frames_encoded * 1000.0 / elapsed_ms : 0.0);
+	obs_data_set_double(results, "cpu_percent", r->cpu_percent);
+	obs_data_set_double(results, "cpu_time_ms", r->cpu_time_ms);
+
+	profiler_snapshot_enumerate_roots(snap, add_child_entry, profiler);
+	obs_data_set_array(results, "profiler", profiler);
+
+	obs_data_array_release(profiler);
+	obs_data_release(stages);
+	obs_data_release(frames);
+	obs_data_release(config);
+	return results;
+}
+
+/* ------------------------------------------------------------------------- */
+/* benchmark run */
+
+static bool wait_for_stop(obs_output_t *output)
+{
+	for (int i = 0; i < STOP_TIMEOUT_MS / 10; i++) {
+		if (!obs_output_active(output))
+			return true;
+		os_sleep_ms(10);
+	}
+
+	return false;
+}
+
+static bool run_bench(const struct bench_params *p, struct bench_result *r)
+{
+	obs_encoder_t *encoder = NULL;
+	obs_output_t *output = NULL;
+	obs_data_t *settings = NULL;
+	os_cpu_usage_info_t *cpu = NULL;
+	struct bench_output *bo;
+	video_t *video = obs_get_video();
+	uint32_t skipped_start, total_start;
+	unsigned long timeout_ms;
+	uint64_t start_ns;
+	bool success = false;
+
+	memset(r, 0, sizeof(*r));
+
+	encoder = obs_video_encoder_create("bench_encoder", "bench encoder",
+			NULL, NULL);
+	if (!encoder)
+		goto finish;
+	obs_encoder_set_video(encoder, video);
+
+	settings = obs_data_create();
+	obs_data_set_int(settings, "frames", p->frames);
+	output = obs_output_create("bench_output", "bench output", settings,
+			NULL);
+	if (!output || !cur_output)
+		goto finish;
+	obs_output_set_video_encoder(output, encoder);
+
+	bo = cur_output;
+	skipped_start = video_output_get_skipped_frames(video);
+	total_start   = video_output_get_total_frames(video);
+
+	cpu = os_cpu_usage_info_start();
+	start_ns = os_gettime_ns();
+
+	if (!obs_output_start(output)) {
+		blog(LOG_ERROR, "Failed to start the benchmark output");
+		goto finish;
+	}
+
+	timeout_ms = (unsigned long)((uint64_t)p->frames * 1000 / p->fps) +
+		RUN_TIMEOUT_MS;
+	r->timed_out = os_event_timedwait(bo->done, timeout_ms) != 0;
+
+	r->elapsed_ns     = os_gettime_ns() - start_ns;
+	r->cpu_percent    = os_cpu_usage_info_query(cpu);
+	r->cpu_time_ms    = r->cpu_percent / 100.0 *
+		(double)os_get_logical_cores() *
+		(double)r->elapsed_ns / 1e6;
+	r->frames_encoded = os_atomic_load_long(&bo->packets);
+	r->frames_skipped = video_output_get_skipped_frames(video) -
+		skipped_start;
+	r->frames_total   = video_output_get_total_frames(video) -
+		total_start;
+
+	obs_get_video_frame_timing(&r->frame_timing);
+	obs_get_video_pipeline_timing(&r->pipeline_timing);
+
+	obs_output_stop(output);
+	if (!wait_for_stop(output))
+		blog(LOG_WARNING, "The benchmark output took too long to stop");
+
+	success = true;
+
+finish:
+	os_cpu_usage_info_destroy(cpu);
+	obs_output_release(output);
+	obs_encoder_release(encoder);
+	obs_data_release(settings);
+	return success;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void do_log(int log_level, const char *msg, va_list args, void *param)
+{
+	if (log_level <= LOG_WARNING) {
+		vfprintf(stderr, msg, args);
+		fputc('\n', stderr);
+	}
+
+	UNUSED_PARAMETER(param);
+}
+
+static bool parse_args(int argc, char *argv[], struct bench_params *p)
+{
+	p->sources = 16;
+	p->filters = 1;
+	p->frames  = 600;
+	p->fps     = 60;
+	p->width   = 1920;
+	p->height  = 1080;
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if (!val)
+			return false;
+
+		i++;
+		if (strcmp(arg, "--sources") == 0) {
+			p->sources = (uint32_t)atoi(val);
+		} else if (strcmp(arg, "--filters") == 0) {
+			p->filters = (uint32_t)atoi(val);
+		} else if (strcmp(arg, "--frames") == 0) {
+			p->frames = (uint32_t)atoi(val);
+		} else if (strcmp(arg, "--fps") == 0) {
+			p->fps = (uint32_t)atoi(val);
+		} else if (strcmp(arg, "--width") == 0) {
+			p->width = (uint32_t)atoi(val);
+		} else if (strcmp(arg, "--height") == 0) {
+			p->height = (uint32_t)atoi(val);
+		} else if (strcmp(arg, "--json") == 0) {
+			p->json_path = val;
+		} else {
+			return false;
+		}
+	}
+
+	return p->sources > 0 && p->frames > 0 && p->fps > 0 &&
+		p->width >= 2 && p->height >= 2;
+}
+
+static bool init_obs(const struct bench_params *p)
+{
+	struct obs_video_info ovi = {0};
+	struct obs_audio_info oai = {0};
+
+	if (!obs_startup("en-US", NULL, NULL))
+		return false;
+
+#ifdef _WIN32
+	ovi.graphics_module = DL_D3D11;
+#else
+	ovi.graphics_module = DL_OPENGL;
+#endif
+	ovi.fps_num         = p->fps;
+	ovi.fps_den         = 1;
+	ovi.base_width      = p->width;
+	ovi.base_height     = p->height;
+	ovi.output_width    = p->width;
+	ovi.output_height   = p->height;
+	ovi.output_format   = VIDEO_FORMAT_NV12;
+	ovi.colorspace      = VIDEO_CS_709;
+	ovi.range           = VIDEO_RANGE_PARTIAL;
+	ovi.scale_type      = OBS_SCALE_BICUBIC;
+	ovi.gpu_conversion  = true;
+
+	oai.samples_per_sec = 48000;
+	oai.speakers        = SPEAKERS_STEREO;
+	oai.buffer_ms       = 1000;
+
+	if (obs_reset_video(&ovi) != OBS_VIDEO_SUCCESS)
+		return false;
+
+	if (!obs_reset_audio(&oai))
+		return false;
+
+	obs_register_source(&bench_source);
+	obs_register_source(&bench_filter);
+	obs_register_encoder(&bench_encoder);
+	obs_register_output(&bench_output);
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_params params = {0};
+	struct bench_result result;
+	profiler_snapshot_t *snap = NULL;
+	obs_data_t *results = NULL;
+	obs_scene_t *scene = NULL;
+	int ret = 0;
+
+	if (!parse_args(argc, argv, &params)) {
+		fprintf(stderr, "usage: %s [--sources n] [--filters n] "
+				"[--frames n] [--fps n] [--width n] "
+				"[--height n] [--json file]\n", argv[0]);
+		return 1;
+	}
+
+	base_set_log_handler(do_log, NULL);
+	profiler_start();
+
+	if (!init_obs(&params)) {
+		fprintf(stderr, "Failed to initialize libobs\n");
+		ret = 1;
+		goto finish;
+	}
+
+	scene = create_scene(&params);
+	if (!scene) {
+		fprintf(stderr, "Failed to create the benchmark scene\n");
+		ret = 1;
+		goto finish;
+	}
+
+	obs_set_output_source(0, obs_scene_get_source(scene));
+
+	if (!run_bench(&params, &result)) {
+		fprintf(stderr, "Failed to run the benchmark\n");
+		ret = 1;
+		goto finish;
+	}
+
+	profiler_stop();
+	snap = profile_snapshot_create();
+	results = create_results(&params, &result, snap);
+
+	if (params.json_path) {
+		if (!obs_data_save_json(results, params.json_path)) {
+			fprintf(stderr, "Failed to write '%s'\n",
+					params.json_path);
+			ret = 1;
+		}
+	} else {
+		printf("%s\n", obs_data_get_json(results));
+	}
+
+	if (result.timed_out)
+		ret = 2;
+
+finish:
+	obs_data_release(results);
+	profile_snapshot_free(snap);
+
+	obs_set_output_source(0, NULL);
+	obs_scene_release(scene);
+	obs_shutdown();
+
+	profiler_stop();
+	profiler_free();
+	return ret;
+}
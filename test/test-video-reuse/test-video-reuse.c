@@ -0,0 +1,239 @@
+/******************************************************************************
+    Copyright (C) 2016 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * Checks that the main texture is reused while the scene doesn't change.
+ * Starts libobs without any display and counts how often the sources of a
+ * scene are drawn: a scene of sources that report themselves unchanged
+ * should only be drawn once it has settled, a scene with a source that
+ * doesn't implement video_unchanged every frame.
+ *
+ * Exits with 0 if both hold, 1 otherwise.
+ */
+
+#include <stdio.h>
+
+#include <obs.h>
+#include <util/base.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+#define TEST_FPS      60
+#define TEST_SIZE     64
+#define SETTLE_MS     500
+#define RUN_MS        1000
+
+/* frames drawn while running, a static scene is allowed a few for the
+ * frames in flight when the count starts */
+#define MAX_STATIC_DRAWS   2
+#define MIN_CHANGING_DRAWS (TEST_FPS * RUN_MS / 1000 / 2)
+
+/* ------------------------------------------------------------------------- */
+/* sources that count their draws */
+
+/* draws of the source currently shown, reset for every scene */
+static volatile long draws = 0;
+
+struct test_source {
+	gs_texture_t *texture;
+};
+
+static const char *test_source_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Reuse Test Source";
+}
+
+static void *test_source_create(obs_data_t *settings, obs_source_t *source)
+{
+	struct test_source *ts = bzalloc(sizeof(*ts));
+	uint32_t pixels[TEST_SIZE * TEST_SIZE];
+	const uint8_t *data = (const uint8_t*)pixels;
+
+	for (size_t i = 0; i < TEST_SIZE * TEST_SIZE; i++)
+		pixels[i] = 0xFF00FF00;
+
+	obs_enter_graphics();
+	ts->texture = gs_texture_create(TEST_SIZE, TEST_SIZE, GS_RGBA, 1,
+			&data, 0);
+	obs_leave_graphics();
+
+	UNUSED_PARAMETER(settings);
+	UNUSED_PARAMETER(source);
+	return ts;
+}
+
+static void test_source_destroy(void *data)
+{
+	struct test_source *ts = data;
+
+	obs_enter_graphics();
+	gs_texture_destroy(ts->texture);
+	obs_leave_graphics();
+
+	bfree(ts);
+}
+
+static void test_source_render(void *data, gs_effect_t *effect)
+{
+	struct test_source *ts = data;
+
+	os_atomic_inc_long(&draws);
+	obs_source_draw(ts->texture, 0, 0, 0, 0, false);
+
+	UNUSED_PARAMETER(effect);
+}
+
+static uint32_t test_source_size(void *data)
+{
+	UNUSED_PARAMETER(data);
+	return TEST_SIZE;
+}
+
+static bool test_source_unchanged(void *data)
+{
+	UNUSED_PARAMETER(data);
+	return true;
+}
+
+static struct obs_source_info static_source = {
+	.id              = "reuse_static_source",
+	.type            = OBS_SOURCE_TYPE_INPUT,
+	.output_flags    = OBS_SOURCE_VIDEO,
+	.get_name        = test_source_name,
+	.create          = test_source_create,
+	.destroy         = test_source_destroy,
+	.video_render    = test_source_render,
+	.video_unchanged = test_source_unchanged,
+	.get_width       = test_source_size,
+	.get_height      = test_source_size
+};
+
+static struct obs_source_info changing_source = {
+	.id              = "reuse_changing_source",
+	.type            = OBS_SOURCE_TYPE_INPUT,
+	.output_flags    = OBS_SOURCE_VIDEO,
+	.get_name        = test_source_name,
+	.create          = test_source_create,
+	.destroy         = test_source_destroy,
+	.video_render    = test_source_render,
+	.get_width       = test_source_size,
+	.get_height      = test_source_size
+};
+
+/* ------------------------------------------------------------------------- */
+
+/* shows a scene with one source of the given type, and returns how often
+ * that source was drawn once the scene had settled */
+static long count_draws(const char *id)
+{
+	obs_scene_t *scene = obs_scene_create("reuse scene");
+	obs_source_t *source = obs_source_create(OBS_SOURCE_TYPE_INPUT, id,
+			"reuse source", NULL, NULL);
+	long start;
+
+	obs_scene_add(scene, source);
+	obs_set_output_source(0, obs_scene_get_source(scene));
+
+	os_sleep_ms(SETTLE_MS);
+	start = os_atomic_load_long(&draws);
+	os_sleep_ms(RUN_MS);
+
+	obs_set_output_source(0, NULL);
+	obs_source_release(source);
+	obs_scene_release(scene);
+
+	return os_atomic_load_long(&draws) - start;
+}
+
+static void do_log(int log_level, const char *msg, va_list args, void *param)
+{
+	if (log_level <= LOG_WARNING) {
+		vfprintf(stderr, msg, args);
+		fputc('\n', stderr);
+	}
+
+	UNUSED_PARAMETER(param);
+}
+
+static bool init_obs(void)
+{
+	struct obs_video_info ovi = {0};
+
+	if (!obs_startup("en-US", NULL, NULL))
+		return false;
+
+#ifdef _WIN32
+	ovi.graphics_module = DL_D3D11;
+#else
+	ovi.graphics_module = DL_OPENGL;
+#endif
+	ovi.fps_num         = TEST_FPS;
+	ovi.fps_den         = 1;
+	ovi.base_width      = 320;
+	ovi.base_height     = 180;
+	ovi.output_width    = 320;
+	ovi.output_height   = 180;
+	ovi.output_format   = VIDEO_FORMAT_NV12;
+	ovi.colorspace      = VIDEO_CS_709;
+	ovi.range           = VIDEO_RANGE_PARTIAL;
+	ovi.scale_type      = OBS_SCALE_BICUBIC;
+	ovi.gpu_conversion  = true;
+
+	if (obs_reset_video(&ovi) != OBS_VIDEO_SUCCESS)
+		return false;
+
+	obs_register_source(&static_source);
+	obs_register_source(&changing_source);
+	return true;
+}
+
+int main(void)
+{
+	long static_draws, changing_draws;
+	int ret = 0;
+
+	base_set_log_handler(do_log, NULL);
+
+	if (!init_obs()) {
+		fprintf(stderr, "Failed to initialize libobs\n");
+		obs_shutdown();
+		return 1;
+	}
+
+	static_draws   = count_draws("reuse_static_source");
+	changing_draws = count_draws("reuse_changing_source");
+
+	printf("static scene: %ld draws, changing scene: %ld draws\n",
+			static_draws, changing_draws);
+
+	if (static_draws > MAX_STATIC_DRAWS) {
+		fprintf(stderr, "The static scene was drawn %ld times, the "
+				"main texture was not reused\n",
+				static_draws);
+		ret = 1;
+	}
+
+	if (changing_draws < MIN_CHANGING_DRAWS) {
+		fprintf(stderr, "The changing scene was only drawn %ld times\n",
+				changing_draws);
+		ret = 1;
+	}
+
+	obs_shutdown();
+	return ret;
+}